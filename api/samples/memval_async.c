@@ -0,0 +1,449 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Code Manipulation API Sample:
+ * memval_async.c
+ *
+ * Records app write addresses and their written values into per-thread binary
+ * files, keeping the work done in the app threads to a minimum.
+ *
+ * (1) It fills a per-thread asynchronous trace buffer with inlined
+ *     instrumentation: one fixed-size record per write, holding the address,
+ *     size, opcode, and (the first MAX_VALUE_SIZE bytes of) the value written.
+ * (2) When a thread fills a buffer, drx_buf hands it to its consumer thread and
+ *     the app thread moves on to its next buffer.  The consumer writes each
+ *     buffer verbatim to the file of the thread that filled it.
+ *
+ * Compared to memval_simple.c, which reformats each buffer as text in the app
+ * thread, the app threads here never format, copy, or perform I/O.  They only
+ * wait if the consumer falls NUM_BUFFERS buffers behind.  The totals printed
+ * at exit, in the DR log or with SHOW_RESULTS, include that wait time, so the
+ * cost of the tracing pattern itself can be measured by comparing a run against
+ * a native or memval_simple run of the same application.
+ *
+ * Each output file is a sequence of mem_val_t records in the layout and byte
+ * order of the traced process.
+ *
+ * This sample illustrates
+ * - the use of drx_buf_create_trace_buffer_async() to move buffer processing
+ *   off of the app threads,
+ * - the use of drx_buf_get_owner_thread() to find out which thread filled a
+ *   buffer,
+ * - keeping every record within a single buffer by making the records
+ *   fixed-size and advancing the buffer pointer only once a record is complete,
+ * - inserting instrumentation after the current instruction to read the value
+ *   written by it, as in memval_simple.c.
+ */
+
+#include <stddef.h> /* for offsetof */
+#include "dr_api.h"
+#include "drmgr.h"
+#include "drutil.h"
+#include "drreg.h"
+#include "drx.h"
+#include "hashtable.h"
+#include "utils.h"
+
+/* Larger writes are truncated to their first MAX_VALUE_SIZE bytes: the size
+ * field always holds the full size.
+ */
+#define MAX_VALUE_SIZE 32
+
+/* The value is placed first so that drx_buf_insert_buf_memcpy() can copy it to the
+ * buffer pointer itself.
+ */
+typedef struct _mem_val_t {
+    byte   value[MAX_VALUE_SIZE];
+    app_pc addr; /* mem ref addr */
+    ushort size; /* mem ref size */
+    ushort type; /* instr opcode */
+} mem_val_t;
+
+/* Max number of records a buffer can have.  A buffer holds a whole number of
+ * records, so that a record which fits never spills into the next buffer.
+ */
+#define MAX_NUM_MEM_VALS 4096
+#define MEM_BUF_SIZE (sizeof(mem_val_t) * MAX_NUM_MEM_VALS)
+/* Buffers per thread: the consumer can fall this many buffers behind before
+ * an app thread has to wait.
+ */
+#define NUM_BUFFERS 4
+
+#define MINSERT instrlist_meta_preinsert
+
+/* thread private across-app-inst register */
+typedef struct {
+    reg_id_t   reg_addr;
+} per_thread_t;
+
+static client_id_t client_id;
+static int         tls_idx;
+static drx_buf_t  *trace_buffer;
+/* Maps a thread id to its output file.  The files are only closed at exit, as
+ * the consumer may still be writing a thread's buffers after the thread exits.
+ */
+static hashtable_t files;
+/* Only updated by the consumer thread. */
+static uint64      bytes_written;
+static uint64      buffers_written;
+static uint64      start_time;
+
+/* Called on drx_buf's consumer thread for each full buffer. */
+static void
+trace_full(void *drcontext, void *buf_base, size_t size)
+{
+    thread_id_t owner = drx_buf_get_owner_thread(trace_buffer);
+    file_t log = (file_t)(ptr_int_t)
+        hashtable_lookup(&files, (void *)(ptr_uint_t)owner);
+    DR_ASSERT(size % sizeof(mem_val_t) == 0);
+    if (log == INVALID_FILE || log == 0)
+        return;
+    if (dr_write_file(log, buf_base, size) != (ssize_t)size)
+        DR_ASSERT(false);
+    bytes_written += size;
+    buffers_written++;
+}
+
+static void
+close_file(void *payload)
+{
+    log_file_close((file_t)(ptr_int_t)payload);
+}
+
+static reg_id_t
+instrument_mem(void *drcontext, instrlist_t *ilist, instr_t *where, opnd_t ref)
+{
+    reg_id_t reg_ptr, reg_tmp;
+    ushort size;
+    bool ok;
+
+    if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg_tmp)
+        != DRREG_SUCCESS) {
+        DR_ASSERT(false);
+        return DR_REG_NULL;
+    }
+    if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg_ptr)
+        != DRREG_SUCCESS) {
+        DR_ASSERT(false);
+        return DR_REG_NULL;
+    }
+
+    /* i#2449: see the corresponding comment in memval_simple.c. */
+    if (opnd_uses_reg(ref, reg_tmp) &&
+        drreg_get_app_value(drcontext, ilist, where, reg_tmp, reg_tmp)
+        != DRREG_SUCCESS) {
+        DR_ASSERT(false);
+        return DR_REG_NULL;
+    }
+    if (opnd_uses_reg(ref, reg_ptr) &&
+        drreg_get_app_value(drcontext, ilist, where, reg_ptr, reg_ptr)
+        != DRREG_SUCCESS) {
+        DR_ASSERT(false);
+        return DR_REG_NULL;
+    }
+
+    ok = drutil_insert_get_mem_addr(drcontext, ilist, where, ref, reg_tmp, reg_ptr);
+    DR_ASSERT(ok);
+    /* We fill in everything but the value, without advancing the buffer pointer.
+     * If the buffer is full, the first store faults and drx_buf moves us to the
+     * next buffer, so the whole record ends up there.
+     */
+    drx_buf_insert_load_buf_ptr(drcontext, trace_buffer, ilist, where, reg_ptr);
+    drx_buf_insert_buf_store(drcontext, trace_buffer, ilist, where, reg_ptr, DR_REG_NULL,
+                             opnd_create_reg(reg_tmp), OPSZ_PTR,
+                             offsetof(mem_val_t, addr));
+    drx_buf_insert_buf_store(drcontext, trace_buffer, ilist, where, reg_ptr, DR_REG_NULL,
+                             OPND_CREATE_INT16((ushort)instr_get_opcode(where)),
+                             OPSZ_2, offsetof(mem_val_t, type));
+    size = (ushort)drutil_opnd_mem_size_in_bytes(ref, where);
+    drx_buf_insert_buf_store(drcontext, trace_buffer, ilist, where, reg_ptr, DR_REG_NULL,
+                             OPND_CREATE_INT16(size), OPSZ_2, offsetof(mem_val_t, size));
+
+    if (instr_is_call(where)) {
+        app_pc pc;
+
+        /* Note that on ARM the call instruction writes only to the link register, so
+         * we would never even get into instrument_mem() on ARM if this was a call.
+         */
+        IF_AARCHXX(DR_ASSERT(false));
+        /* We can't read the return address after the call has happened, so we
+         * record it now and complete the record.
+         */
+        pc = decode_next_pc(drcontext, instr_get_app_pc(where));
+        drx_buf_insert_buf_store(drcontext, trace_buffer, ilist, where, reg_ptr,
+                                 reg_tmp, OPND_CREATE_INTPTR((ptr_int_t)pc),
+                                 OPSZ_PTR, offsetof(mem_val_t, value));
+        drx_buf_insert_update_buf_ptr(drcontext, trace_buffer, ilist, where, reg_ptr,
+                                      DR_REG_NULL, sizeof(mem_val_t));
+        /* we don't need to persist reg_tmp to the next instruction */
+        if (drreg_unreserve_register(drcontext, ilist, where, reg_tmp) != DRREG_SUCCESS)
+            DR_ASSERT(false);
+        reg_tmp = DR_REG_NULL;
+    }
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_ptr) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+    return reg_tmp;
+}
+
+static void
+instrument_post_write(void *drcontext, instrlist_t *ilist, instr_t *where, opnd_t memref,
+                      instr_t *write, reg_id_t reg_addr)
+{
+    reg_id_t reg_ptr;
+    ushort len = (ushort)drutil_opnd_mem_size_in_bytes(memref, write);
+
+    if (len > MAX_VALUE_SIZE)
+        len = MAX_VALUE_SIZE;
+
+    /* We want to use the same predicate as write when inserting the following
+     * instrumentation.
+     */
+    instrlist_set_auto_predicate(ilist, instr_get_predicate(write));
+
+    if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg_ptr)
+        != DRREG_SUCCESS) {
+        DR_ASSERT(false);
+        return;
+    }
+
+    /* The buffer pointer still points at the record started before the write.
+     * drx_buf_insert_buf_memcpy() copies the value to its start and advances the
+     * pointer by len, and we then advance it to the end of the record.
+     */
+    drx_buf_insert_load_buf_ptr(drcontext, trace_buffer, ilist, where, reg_ptr);
+    drx_buf_insert_buf_memcpy(drcontext, trace_buffer, ilist, where, reg_ptr, reg_addr,
+                              len);
+    drx_buf_insert_update_buf_ptr(drcontext, trace_buffer, ilist, where, reg_ptr,
+                                  DR_REG_NULL, sizeof(mem_val_t) - len);
+
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_ptr)  != DRREG_SUCCESS)
+        DR_ASSERT(false);
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_addr) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+
+    /* Set the predicate back to the default */
+    instrlist_set_auto_predicate(ilist, instr_get_predicate(where));
+}
+
+static void
+handle_post_write(void *drcontext, instrlist_t *ilist, instr_t *where, reg_id_t reg_addr)
+{
+    int i;
+    instr_t *prev_instr = instr_get_prev_app(where);
+    bool seen_memref = false;
+
+    /* XXX: As in memval_simple.c, we assume that no write instruction has multiple
+     * distinct memory destinations, so that we need only persist a single register
+     * across an app instruction.
+     */
+    for (i = 0; i < instr_num_dsts(prev_instr); ++i) {
+        if (opnd_is_memory_reference(instr_get_dst(prev_instr, i))) {
+            if (seen_memref) {
+                DR_ASSERT_MSG(false, "Found inst with multiple memory destinations");
+                break;
+            }
+            seen_memref = true;
+            instrument_post_write(drcontext, ilist, where, instr_get_dst(prev_instr, i),
+                                  prev_instr, reg_addr);
+        }
+    }
+}
+
+static dr_emit_flags_t
+event_app_analysis(void *drcontext, void *tag, instrlist_t *bb, bool
+                   for_trace, bool translating, void **user_data)
+{
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
+
+    *user_data = (void *)&data->reg_addr;
+    DR_ASSERT(data->reg_addr == DR_REG_NULL);
+    return DR_EMIT_DEFAULT;
+}
+
+/* For each memory write app instr, we insert inline code to start a record before
+ * the instruction and to complete it with the written value after it.
+ */
+static dr_emit_flags_t
+event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
+                      instr_t *instr, bool for_trace,
+                      bool translating, void *user_data)
+{
+    int i;
+    reg_id_t *reg_next = (reg_id_t *)user_data;
+    bool seen_memref = false;
+
+    /* If the previous instruction was a write, we should handle it. */
+    if (*reg_next != DR_REG_NULL)
+        handle_post_write(drcontext, bb, instr, *reg_next);
+    *reg_next = DR_REG_NULL;
+
+    if (!instr_is_app(instr))
+        return DR_EMIT_DEFAULT;
+    if (!instr_writes_memory(instr))
+        return DR_EMIT_DEFAULT;
+
+    for (i = 0; i < instr_num_dsts(instr); ++i) {
+        if (opnd_is_memory_reference(instr_get_dst(instr, i))) {
+            if (seen_memref) {
+                DR_ASSERT_MSG(false, "Found inst with multiple memory destinations");
+                break;
+            }
+            *reg_next = instrument_mem(drcontext, bb, instr, instr_get_dst(instr, i));
+            seen_memref = true;
+        }
+    }
+    return DR_EMIT_DEFAULT;
+}
+
+/* We transform string loops into regular loops so we can more easily
+ * monitor every memory reference they make.
+ */
+static dr_emit_flags_t
+event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
+                 bool for_trace, bool translating)
+{
+    if (!drutil_expand_rep_string(drcontext, bb)) {
+        DR_ASSERT(false);
+        /* in release build, carry on: we'll just miss per-iter refs */
+    }
+    drx_tail_pad_block(drcontext, bb);
+    return DR_EMIT_DEFAULT;
+}
+
+static void
+event_thread_init(void *drcontext)
+{
+    per_thread_t *data = dr_thread_alloc(drcontext, sizeof(per_thread_t));
+    file_t log;
+    DR_ASSERT(data != NULL);
+    data->reg_addr = DR_REG_NULL;
+    drmgr_set_tls_field(drcontext, tls_idx, data);
+
+    /* We're going to dump our data to a per-thread file.
+     * On Windows we need an absolute path so we place it in
+     * the same directory as our library. We could also pass
+     * in a path as a client argument.
+     */
+    log = log_file_open(client_id, drcontext, NULL /* using client lib path */,
+                        "memval_async",
+#ifndef WINDOWS
+                        DR_FILE_CLOSE_ON_FORK |
+#endif
+                        DR_FILE_ALLOW_LARGE);
+    hashtable_add_replace(&files, (void *)(ptr_uint_t)dr_get_thread_id(drcontext),
+                          (void *)(ptr_int_t)log);
+}
+
+static void
+event_thread_exit(void *drcontext)
+{
+    per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
+    /* drx_buf queues this thread's final partial buffer itself. */
+    dr_thread_free(drcontext, data, sizeof(per_thread_t));
+}
+
+static void
+event_exit(void)
+{
+    char msg[512];
+    int len;
+    uint64 stall_time;
+
+    if (!drmgr_unregister_tls_field(tls_idx) ||
+        !drmgr_unregister_thread_init_event(event_thread_init) ||
+        !drmgr_unregister_thread_exit_event(event_thread_exit) ||
+        !drmgr_unregister_bb_app2app_event(event_bb_app2app) ||
+        !drmgr_unregister_bb_insertion_event(event_app_instruction))
+        DR_ASSERT(false);
+
+    /* This waits until the consumer has written out every queued buffer. */
+    stall_time = drx_buf_get_stall_time(trace_buffer);
+    drx_buf_free(trace_buffer);
+    hashtable_delete(&files);
+
+    len = dr_snprintf(msg, BUFFER_SIZE_ELEMENTS(msg),
+                      "memval_async results:\n"
+                      "  records written: %llu\n"
+                      "  bytes written:   %llu\n"
+                      "  buffers written: %llu\n"
+                      "  stall time (ms): %llu\n"
+                      "  total time (ms): %llu",
+                      bytes_written / sizeof(mem_val_t), bytes_written,
+                      buffers_written, stall_time / 1000,
+                      dr_get_milliseconds() - start_time);
+    DR_ASSERT(len > 0);
+    NULL_TERMINATE_BUFFER(msg);
+    dr_log(NULL, DR_LOG_ALL, 1, "%s\n", msg);
+#ifdef SHOW_RESULTS
+    DISPLAY_STRING(msg);
+#endif /* SHOW_RESULTS */
+
+    drutil_exit();
+    drreg_exit();
+    drmgr_exit();
+    drx_exit();
+}
+
+DR_EXPORT void
+dr_client_main(client_id_t id, int argc, const char *argv[])
+{
+    drreg_options_t ops = {sizeof(ops), 3 /*max slots needed*/, false};
+
+    dr_set_client_name("DynamoRIO Sample Client 'memval_async'",
+                       "http://dynamorio.org/issues");
+    if (!drmgr_init() || !drutil_init() || !drx_init())
+        DR_ASSERT(false);
+    if (drreg_init(&ops) != DRREG_SUCCESS)
+        DR_ASSERT(false);
+
+    /* register events */
+    dr_register_exit_event(event_exit);
+    if (!drmgr_register_thread_init_event(event_thread_init) ||
+        !drmgr_register_thread_exit_event(event_thread_exit) ||
+        !drmgr_register_bb_app2app_event(event_bb_app2app, NULL) ||
+        !drmgr_register_bb_instrumentation_event(event_app_analysis,
+                                                 event_app_instruction,
+                                                 NULL))
+        DR_ASSERT(false);
+    client_id = id;
+
+    hashtable_init_ex(&files, 8, HASH_INTPTR, false/*!strdup*/, true/*synch*/,
+                      close_file, NULL, NULL);
+    tls_idx = drmgr_register_tls_field();
+    trace_buffer = drx_buf_create_trace_buffer_async(MEM_BUF_SIZE, NUM_BUFFERS,
+                                                     trace_full);
+    DR_ASSERT(tls_idx != -1 && trace_buffer != NULL);
+    start_time = dr_get_milliseconds();
+
+    /* make it easy to tell, by looking at log file, which client executed */
+    dr_log(NULL, DR_LOG_ALL, 1, "Client 'memval_async' initializing\n");
+}
@@ -43,6 +43,8 @@
 
 // To support installation of headers for analysis tools into a single
 // separate directory we omit common/ here and rely on -I.
+#include <stddef.h>
+#include <string>
 #include "memref.h"
 
 /**
@@ -54,6 +56,12 @@
  * the process_memref() function of each tool.  An alternative mode is supported
  * which exposes the iterator and allows a separate control infrastructure to be
  * built.
+ *
+ * A tool that can operate on each thread's references independently should also
+ * override parallel_shard_supported() and the other parallel_shard_ routines.
+ * When the trace is supplied as a directory of per-thread trace files (shards) and
+ * every tool supports it, #analyzer_t processes the shards concurrently on a pool
+ * of worker threads instead of calling process_memref().
  */
 class analysis_tool_t
 {
@@ -72,11 +80,75 @@ class analysis_tool_t
      * The return value indicates whether it was successful or there was an error.
      */
     virtual bool process_memref(const memref_t &memref) = 0;
+    /**
+     * Operates on \p count consecutive trace entries, which #analyzer_t passes in
+     * batches.  The default implementation calls process_memref() on each entry.
+     * A tool can override this to process a whole batch in a tight loop without
+     * a virtual call per entry.  The return value indicates whether all of the
+     * entries were processed successfully.
+     */
+    virtual bool process_memrefs(const memref_t *memrefs, size_t count)
+    {
+        bool res = true;
+        for (size_t i = 0; i < count; ++i)
+            res = process_memref(memrefs[i]) && res;
+        return res;
+    }
     /**
      * This routine reports the results of the trace analysis.
      * The return value indicates whether it was successful or there was an error.
      */
     virtual bool print_results() = 0;
+    /**
+     * Invoked by #analyzer_t between batches of trace entries when this is the
+     * only tool and the trace is processed serially.  A non-zero return value n
+     * requests that the next n instructions, along with the other records among
+     * them, be skipped without being presented to the tool, as
+     * analyzer_t::set_skip_instructions() does at the start of the trace.  A tool
+     * returning non-zero can thus rely on the skip having happened by the time
+     * process_memref() is next called.  A tool that only wants to analyze parts
+     * of the trace should still be prepared to see and drop the other records, as
+     * this is not invoked under other modes of operation.
+     */
+    virtual uint64_t instructions_to_skip() { return 0; }
+
+    /**
+     * Returns whether this tool can analyze each trace shard (the references
+     * from a single thread) independently of the others.  If this returns true,
+     * the parallel_shard_ routines below are invoked instead of process_memref()
+     * when the trace is split into shards.
+     */
+    virtual bool parallel_shard_supported() { return false; }
+    /**
+     * Invoked once for each trace shard prior to calling parallel_shard_memref()
+     * for that shard.  This allows the tool to create data local to the shard.
+     * The return value is passed to parallel_shard_memref() and
+     * parallel_shard_exit().  Each shard is processed by a single worker thread,
+     * but this routine may be invoked concurrently for different shards, so any
+     * access to data shared across shards must be synchronized.
+     */
+    virtual void * parallel_shard_init(int shard_index) { return NULL; }
+    /**
+     * Invoked once when all references in the shard have been processed.  This is
+     * where the tool should merge the shard's results into its global results for
+     * later presentation by print_results(), and free the shard data.  Like
+     * parallel_shard_init(), this may be invoked concurrently for different shards.
+     * The return value indicates whether it was successful or there was an error.
+     */
+    virtual bool parallel_shard_exit(void *shard_data) { return true; }
+    /**
+     * The parallel counterpart of process_memref(), operating on a single trace
+     * entry from the shard identified by \p shard_data.
+     * The return value indicates whether it was successful or there was an error,
+     * in which case parallel_shard_error() can be used to obtain more information.
+     */
+    virtual bool parallel_shard_memref(void *shard_data, const memref_t &memref)
+    {
+        return false;
+    }
+    /** Returns a description of the last error for the shard \p shard_data. */
+    virtual std::string parallel_shard_error(void *shard_data) { return ""; }
+
  protected:
     bool success;
 };
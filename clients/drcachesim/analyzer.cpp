@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2016-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2016-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -30,45 +30,134 @@
  * DAMAGE.
  */
 
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <thread>
+#include <unordered_set>
 #include "analysis_tool.h"
 #include "analyzer.h"
-#include "reader/file_reader.h"
+#include "reader/compact_file_reader.h"
+#include "reader/mmap_file_reader.h"
+#include "reader/queue_reader.h"
+#include "reader/sched_reader.h"
 #ifdef HAS_ZLIB
+# include "reader/chunked_file_reader.h"
 # include "reader/compressed_file_reader.h"
 #endif
+#include "common/directory_iterator.h"
+#include "common/thread_index.h"
 #include "common/utils.h"
 
 analyzer_t::analyzer_t() :
-    success(true), trace_iter(NULL), trace_end(NULL), num_tools(0), tools(NULL)
+    success(true), trace_iter(NULL), trace_end(NULL), num_tools(0), tools(NULL),
+    skip_instrs(0), parallel(false), worker_count(0), next_shard(0), sched_cores(4),
+    sched_quantum(0), pipelined(false), pipeline_produced(0), pipeline_done(false),
+    online_shards(false)
 {
     /* Nothing else: child class needs to initialize. */
 }
 
+reader_t *
+analyzer_t::get_file_reader(const std::string &trace_file)
+{
+    // Uncompressed files are mapped and iterated in place, which is faster than
+    // either file_reader_t's fstream or zlib's gzip interface.
+    if (trace_file.empty())
+        return new mmap_file_reader_t();
+    if (compact_file_reader_t::is_compact_file(trace_file))
+        return new compact_file_reader_t(trace_file.c_str());
+#ifdef HAS_ZLIB
+    if (chunked_file_reader_t::is_chunked_file(trace_file))
+        return new chunked_file_reader_t(trace_file.c_str());
+    const std::string gz_suffix = ".gz";
+    if (trace_file.size() > gz_suffix.size() &&
+        trace_file.compare(trace_file.size() - gz_suffix.size(), gz_suffix.size(),
+                           gz_suffix) == 0)
+        return new compressed_file_reader_t(trace_file.c_str());
+#endif
+    return new mmap_file_reader_t(trace_file.c_str());
+}
+
 bool
-analyzer_t::init_file_reader(const std::string &trace_file)
+analyzer_t::init_file_reader(const std::string &trace_path, int worker_count_in)
 {
-    if (trace_file.empty()) {
+    if (trace_path.empty()) {
         ERRMSG("Trace file name is empty\n");
         return false;
     }
-#ifdef HAS_ZLIB
-    // Even if the file is uncompressed, zlib's gzip interface is faster than
-    // file_reader_t's fstream in our measurements, so we always use it when
-    // available.
-    trace_iter = new compressed_file_reader_t(trace_file.c_str());
-    trace_end = new compressed_file_reader_t();
-#else
-    trace_iter = new file_reader_t(trace_file.c_str());
-    trace_end = new file_reader_t();
-#endif
+    if (directory_iterator_t::is_directory(trace_path)) {
+        // Each file in the directory is one per-thread shard.  We sort the names
+        // to give the shards stable indices.
+        std::vector<std::string> files;
+        std::string index_path = trace_path + DIRSEP + THREAD_INDEX_FILENAME;
+        if (std::ifstream(index_path.c_str())) {
+            // The index lists the files and lets set_thread_subset() pick among them.
+            std::vector<thread_index_entry_t> index;
+            std::string error = thread_index_read(index_path, &index);
+            if (!error.empty()) {
+                ERRMSG("%s\n", error.c_str());
+                return false;
+            }
+            for (const auto &thread : index) {
+                std::string file = trace_path + DIRSEP + thread.file;
+                files.push_back(file);
+                file_tids[file] = (memref_tid_t)thread.tid;
+            }
+        } else {
+            directory_iterator_t end;
+            directory_iterator_t iter(trace_path);
+            if (!iter) {
+                ERRMSG("%s\n", iter.error_string().c_str());
+                return false;
+            }
+            for (; iter != end; ++iter)
+                files.push_back(trace_path + DIRSEP + *iter);
+        }
+        if (files.empty()) {
+            ERRMSG("Trace directory %s is empty\n", trace_path.c_str());
+            return false;
+        }
+        if (num_tools == 0) {
+            ERRMSG("A trace directory is not supported with an external iterator\n");
+            return false;
+        }
+        std::sort(files.begin(), files.end());
+        for (int i = 0; i < num_tools; ++i) {
+            if (!tools[i]->parallel_shard_supported()) {
+                // We interleave the threads for tools that need a single stream,
+                // once set_schedule() has had its chance to be called.
+                sched_files = files;
+                trace_end = get_file_reader("");
+                return true;
+            }
+        }
+        // Each shard's reader is created once a worker reaches it, so as not to
+        // hold every file open at once.
+        for (const auto &file : files)
+            shards.push_back(analyzer_shard_data_t((int)shards.size(), NULL, file));
+        parallel = true;
+        worker_count = worker_count_in;
+        if (worker_count <= 0)
+            worker_count = std::thread::hardware_concurrency();
+        if (worker_count <= 0)
+            worker_count = 1;
+        if (worker_count > (int)shards.size())
+            worker_count = (int)shards.size();
+        trace_end = get_file_reader("");
+        return true;
+    }
+    trace_iter = get_file_reader(trace_path);
+    trace_end = get_file_reader("");
     return true;
 }
 
-analyzer_t::analyzer_t(const std::string &trace_file, analysis_tool_t **tools_in,
-                       int num_tools_in) :
+analyzer_t::analyzer_t(const std::string &trace_path, analysis_tool_t **tools_in,
+                       int num_tools_in, int worker_count_in) :
     success(true), trace_iter(NULL), trace_end(NULL), num_tools(num_tools_in),
-    tools(tools_in)
+    tools(tools_in), skip_instrs(0), parallel(false), worker_count(0), next_shard(0),
+    sched_cores(4), sched_quantum(0), pipelined(false), pipeline_produced(0),
+    pipeline_done(false), online_shards(false)
 {
     for (int i = 0; i < num_tools; ++i) {
         if (tools[i] == NULL || !*tools[i]) {
@@ -77,12 +166,15 @@ analyzer_t::analyzer_t(const std::string &trace_file, analysis_tool_t **tools_in
             return;
         }
     }
-    if (!init_file_reader(trace_file))
+    if (!init_file_reader(trace_path, worker_count_in))
         success = false;
 }
 
 analyzer_t::analyzer_t(const std::string &trace_file) :
-    success(true), trace_iter(NULL), trace_end(NULL), num_tools(0), tools(NULL)
+    success(true), trace_iter(NULL), trace_end(NULL), num_tools(0), tools(NULL),
+    skip_instrs(0), parallel(false), worker_count(0), next_shard(0), sched_cores(4),
+    sched_quantum(0), pipelined(false), pipeline_produced(0), pipeline_done(false),
+    online_shards(false)
 {
     if (!init_file_reader(trace_file))
         success = false;
@@ -92,6 +184,12 @@ analyzer_t::~analyzer_t()
 {
     delete trace_iter;
     delete trace_end;
+    for (auto &shard : shards)
+        delete shard.iter;
+    for (auto shard : online) {
+        delete shard->iter;
+        delete shard;
+    }
 }
 
 bool
@@ -109,6 +207,13 @@ analyzer_t::get_error_string()
 bool
 analyzer_t::start_reading()
 {
+    if (trace_iter == NULL && !sched_files.empty()) {
+        std::vector<reader_t *> inputs;
+        for (const auto &file : sched_files)
+            inputs.push_back(get_file_reader(file));
+        trace_iter = new sched_reader_t(inputs, get_file_reader(""), sched_cores,
+                                        sched_quantum);
+    }
     if (!trace_iter->init()) {
         ERRMSG("Failed to read from trace\n");
         return false;
@@ -116,18 +221,350 @@ analyzer_t::start_reading()
     return true;
 }
 
+void
+analyzer_t::set_skip_instructions(uint64_t instruction_count)
+{
+    skip_instrs = instruction_count;
+}
+
+void
+analyzer_t::set_pipelined(bool pipelined_in)
+{
+    pipelined = pipelined_in;
+}
+
+void
+analyzer_t::set_online_shards(bool shards_in)
+{
+    online_shards = shards_in;
+}
+
+void
+analyzer_t::set_schedule(unsigned int num_cores, uint64_t quantum)
+{
+    sched_cores = num_cores;
+    sched_quantum = quantum;
+}
+
+bool
+analyzer_t::set_thread_subset(const std::vector<memref_tid_t> &tids)
+{
+    if (file_tids.empty()) {
+        error_string = "Selecting threads requires a trace directory with an index";
+        return false;
+    }
+    std::unordered_set<memref_tid_t> keep(tids.begin(), tids.end());
+    auto unwanted = [&](const std::string &file) {
+        return keep.count(file_tids[file]) == 0;
+    };
+    shards.erase(std::remove_if(shards.begin(), shards.end(),
+                                [&](const analyzer_shard_data_t &shard) {
+                                    return unwanted(shard.trace_file);
+                                }),
+                 shards.end());
+    for (size_t i = 0; i < shards.size(); ++i)
+        shards[i].index = (int)i;
+    sched_files.erase(std::remove_if(sched_files.begin(), sched_files.end(), unwanted),
+                      sched_files.end());
+    if (shards.empty() && sched_files.empty()) {
+        error_string = "None of the selected threads is in the trace";
+        return false;
+    }
+    if (parallel && worker_count > (int)shards.size())
+        worker_count = (int)shards.size();
+    return true;
+}
+
+void
+analyzer_t::skip_instructions(reader_t *iter)
+{
+    if (skip_instrs == 0 || *iter == *trace_end)
+        return;
+    // Any non-instruction records prior to the first instruction are dropped too.
+    iter->skip_instructions(skip_instrs);
+}
+
+void
+analyzer_t::process_tasks(std::string *error)
+{
+    std::vector<void *> shard_data(num_tools);
+    while (true) {
+        // We hand out shards dynamically as thread traces can vary widely in size.
+        int index = next_shard++;
+        if (index >= (int)shards.size())
+            break;
+        analyzer_shard_data_t &shard = shards[index];
+        shard.iter = get_file_reader(shard.trace_file);
+        if (!shard.iter->init()) {
+            *error = "Failed to read from trace " + shard.trace_file;
+            return;
+        }
+        skip_instructions(shard.iter);
+        for (int i = 0; i < num_tools; ++i)
+            shard_data[i] = tools[i]->parallel_shard_init(shard.index);
+        for (; *shard.iter != *trace_end && error->empty(); ++(*shard.iter)) {
+            const memref_t &memref = **shard.iter;
+            for (int i = 0; i < num_tools; ++i) {
+                if (!tools[i]->parallel_shard_memref(shard_data[i], memref)) {
+                    *error = tools[i]->parallel_shard_error(shard_data[i]);
+                    if (error->empty())
+                        *error = "Tool failed to process " + shard.trace_file;
+                    break;
+                }
+            }
+        }
+        for (int i = 0; i < num_tools; ++i) {
+            if (!tools[i]->parallel_shard_exit(shard_data[i]) && error->empty())
+                *error = "Tool failed to finalize " + shard.trace_file;
+        }
+        if (!error->empty())
+            return;
+    }
+}
+
+bool
+analyzer_t::run_parallel()
+{
+    std::vector<std::string> errors(worker_count);
+    std::vector<std::thread> threads;
+    next_shard = 0;
+    for (int i = 0; i < worker_count; ++i)
+        threads.push_back(std::thread(&analyzer_t::process_tasks, this, &errors[i]));
+    for (auto &thread : threads)
+        thread.join();
+    for (const auto &error : errors) {
+        if (!error.empty()) {
+            ERRMSG("%s\n", error.c_str());
+            error_string = error;
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+analyzer_t::pipeline_tool(int tool_index, char *result)
+{
+    bool res = true;
+    for (size_t next = 0; ; ++next) {
+        {
+            std::unique_lock<std::mutex> lock(pipeline_mutex);
+            pipeline_cond.wait(lock, [this, next] {
+                return next < pipeline_produced || pipeline_done;
+            });
+            if (next >= pipeline_produced)
+                break;
+        }
+        // The reader does not touch this slot until we mark it consumed.
+        const std::vector<memref_t> &batch = pipeline_ring[next % PIPELINE_BATCHES];
+        res = tools[tool_index]->process_memrefs(&batch[0], batch.size()) && res;
+        {
+            std::lock_guard<std::mutex> lock(pipeline_mutex);
+            pipeline_consumed[tool_index] = next + 1;
+        }
+        pipeline_cond.notify_all();
+    }
+    *result = res;
+}
+
+bool
+analyzer_t::run_pipelined()
+{
+    pipeline_ring.assign(PIPELINE_BATCHES, std::vector<memref_t>());
+    for (auto &batch : pipeline_ring)
+        batch.reserve(MEMREF_BATCH_SIZE);
+    pipeline_produced = 0;
+    pipeline_consumed.assign(num_tools, 0);
+    pipeline_done = false;
+    std::vector<char> results(num_tools, 0);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_tools; ++i)
+        threads.push_back(std::thread(&analyzer_t::pipeline_tool, this, i, &results[i]));
+    while (*trace_iter != *trace_end) {
+        {
+            // Wait for the slowest tool to release the slot we are about to fill.
+            std::unique_lock<std::mutex> lock(pipeline_mutex);
+            pipeline_cond.wait(lock, [this] {
+                return pipeline_produced - *std::min_element(pipeline_consumed.begin(),
+                                                             pipeline_consumed.end()) <
+                    PIPELINE_BATCHES;
+            });
+        }
+        std::vector<memref_t> &batch = pipeline_ring[pipeline_produced % PIPELINE_BATCHES];
+        batch.clear();
+        for (; batch.size() < MEMREF_BATCH_SIZE && *trace_iter != *trace_end;
+             ++(*trace_iter))
+            batch.push_back(**trace_iter);
+        {
+            std::lock_guard<std::mutex> lock(pipeline_mutex);
+            ++pipeline_produced;
+        }
+        pipeline_cond.notify_all();
+    }
+    {
+        std::lock_guard<std::mutex> lock(pipeline_mutex);
+        pipeline_done = true;
+    }
+    pipeline_cond.notify_all();
+    for (auto &thread : threads)
+        thread.join();
+    return std::find(results.begin(), results.end(), 0) == results.end();
+}
+
+analyzer_t::online_shard_t *
+analyzer_t::get_online_shard(memref_tid_t tid)
+{
+    auto it = online_live.find(tid);
+    if (it != online_live.end())
+        return it->second;
+    online_shard_t *shard = new online_shard_t((int)online.size(),
+                                               new queue_reader_t(ONLINE_QUEUED_BATCHES));
+    shard->pending.reserve(MEMREF_BATCH_SIZE);
+    online.push_back(shard);
+    online_live[tid] = shard;
+    shard->thread = std::thread(&analyzer_t::online_shard_main, this, shard);
+    return shard;
+}
+
+void
+analyzer_t::finish_online_shard(online_shard_t *shard)
+{
+    shard->iter->push(&shard->pending);
+    shard->iter->finish();
+}
+
+void
+analyzer_t::online_shard_main(online_shard_t *shard)
+{
+    std::vector<void *> shard_data(num_tools);
+    reader_t &iter = *shard->iter;
+    iter.init();
+    skip_instructions(&iter);
+    for (int i = 0; i < num_tools; ++i)
+        shard_data[i] = tools[i]->parallel_shard_init(shard->index);
+    // After an error we keep draining our queue so the reading thread is not
+    // left waiting on it.
+    for (; iter != *trace_end; ++iter) {
+        if (!shard->error.empty())
+            continue;
+        const memref_t &memref = *iter;
+        for (int i = 0; i < num_tools; ++i) {
+            if (!tools[i]->parallel_shard_memref(shard_data[i], memref)) {
+                shard->error = tools[i]->parallel_shard_error(shard_data[i]);
+                if (shard->error.empty()) {
+                    shard->error = "Tool failed to process thread shard " +
+                        std::to_string(shard->index);
+                }
+                break;
+            }
+        }
+    }
+    for (int i = 0; i < num_tools; ++i) {
+        if (!tools[i]->parallel_shard_exit(shard_data[i]) && shard->error.empty()) {
+            shard->error = "Tool failed to finalize thread shard " +
+                std::to_string(shard->index);
+        }
+    }
+}
+
+bool
+analyzer_t::run_online_shards()
+{
+    if (!trace_iter->init_raw()) {
+        ERRMSG("Failed to read from trace\n");
+        return false;
+    }
+    std::string error;
+    online_shard_t *cur = NULL;
+    // The shards given entries by the current read, whose pending batches we
+    // push once it is consumed so a thread's entries are not held back waiting
+    // for a full batch.
+    std::vector<online_shard_t *> touched;
+    for (bool more = true; more && error.empty(); ) {
+        size_t count;
+        trace_entry_t *entries = trace_iter->read_raw_entries(&count);
+        if (entries == NULL)
+            break;
+        for (size_t i = 0; i < count; ++i) {
+            const trace_entry_t &entry = entries[i];
+            if (entry.type == TRACE_TYPE_FOOTER) {
+                more = false;
+                break;
+            }
+            // Each buffer written by the tracer starts with its thread's id.
+            if (entry.type == TRACE_TYPE_THREAD)
+                cur = get_online_shard((memref_tid_t)entry.addr);
+            if (cur == NULL) {
+                error = "Trace entry precedes any thread id";
+                break;
+            }
+            if (cur->pending.empty())
+                touched.push_back(cur);
+            cur->pending.push_back(entry);
+            if (entry.type == TRACE_TYPE_THREAD_EXIT) {
+                online_live.erase((memref_tid_t)entry.addr);
+                finish_online_shard(cur);
+                cur = NULL;
+            } else if (cur->pending.size() >= MEMREF_BATCH_SIZE)
+                cur->iter->push(&cur->pending);
+        }
+        for (auto shard : touched)
+            shard->iter->push(&shard->pending);
+        touched.clear();
+    }
+    for (const auto &keyval : online_live)
+        finish_online_shard(keyval.second);
+    online_live.clear();
+    for (auto shard : online) {
+        shard->thread.join();
+        if (error.empty())
+            error = shard->error;
+    }
+    if (!error.empty()) {
+        ERRMSG("%s\n", error.c_str());
+        error_string = error;
+        return false;
+    }
+    return true;
+}
+
 bool
 analyzer_t::run()
 {
     bool res = true;
+    if (parallel)
+        return run_parallel();
+    if (online_shards &&
+        std::all_of(tools, tools + num_tools, [](analysis_tool_t *tool) {
+            return tool->parallel_shard_supported();
+        }))
+        return run_online_shards();
     if (!start_reading())
         return false;
+    skip_instructions(trace_iter);
+    if (pipelined && num_tools > 1)
+        return run_pipelined();
 
-    for (; *trace_iter != *trace_end; ++(*trace_iter)) {
-        for (int i = 0; i < num_tools; ++i) {
-            memref_t memref = **trace_iter;
-            res = tools[i]->process_memref(memref) && res;
+    // We hand the tools contiguous batches so they can avoid a virtual call
+    // per entry.
+    std::vector<memref_t> batch;
+    batch.reserve(MEMREF_BATCH_SIZE);
+    for (bool more = true; more; ) {
+        batch.clear();
+        for (; batch.size() < MEMREF_BATCH_SIZE && *trace_iter != *trace_end;
+             ++(*trace_iter))
+            batch.push_back(**trace_iter);
+        if (batch.empty())
+            break;
+        for (int i = 0; i < num_tools; ++i)
+            res = tools[i]->process_memrefs(&batch[0], batch.size()) && res;
+        // A sole tool can ask to fast-forward, as it cannot affect other tools.
+        if (num_tools == 1 && *trace_iter != *trace_end) {
+            uint64_t skip = tools[0]->instructions_to_skip();
+            if (skip > 0)
+                trace_iter->skip_instructions(skip);
         }
+        more = (*trace_iter != *trace_end);
     }
     return res;
 }
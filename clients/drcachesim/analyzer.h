@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2016-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2016-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -43,16 +43,33 @@
  * @brief DrMemtrace top-level trace analysis driver.
  */
 
+#include <atomic>
+#include <condition_variable>
 #include <iterator>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include "analysis_tool.h"
 #include "reader.h"
 
+class queue_reader_t;
+
 /**
  * An analyzer is the top-level driver of a set of trace analysis tools.
  * It supports two different modes of operation: either it iterates over the
  * trace and calls the process_memref() routine of each tool, or it exposes
  * an iteration interface to external control code.
+ *
+ * In the first mode, if the trace is a directory of per-thread trace files
+ * and every tool supports analysis_tool_t::parallel_shard_supported(), each
+ * file is analyzed as a separate shard by a pool of worker threads.  If the
+ * directory holds the index written by drraw2trace -outdir, only the files
+ * listed in the index are used, and set_thread_subset() can select among them.  Otherwise,
+ * the threads are interleaved into a single stream by scheduling them onto
+ * simulated cores in timestamp order (see set_schedule()).  An online trace
+ * can likewise be split into per-thread shards (see set_online_shards()).
  */
 class analyzer_t
 {
@@ -78,9 +95,15 @@ class analyzer_t
      * The analyzer will reference the tools array passed in during its lifetime:
      * it does not make a copy.
      * The user must free them afterward.
+     *
+     * If \p trace_path is a directory, each file within it is treated as the
+     * trace of a single thread.  Such a sharded trace is analyzed in parallel by
+     * \p worker_count worker threads, or one thread per hardware thread if
+     * \p worker_count is 0, if all tools support parallel shard analysis.
+     * Otherwise the threads are scheduled into a single stream.
      */
-    analyzer_t(const std::string &trace_file, analysis_tool_t **tools,
-               int num_tools);
+    analyzer_t(const std::string &trace_path, analysis_tool_t **tools,
+               int num_tools, int worker_count = 0);
     /** Launches the analysis process. */
     virtual bool run();
     /** Presents the results of the analysis. */
@@ -98,19 +121,135 @@ class analyzer_t
     virtual reader_t & begin();
     virtual reader_t & end(); /** End iterator for the external-iterator usage model. */
 
+    /**
+     * Requests that the first \p instruction_count instructions of the trace, and
+     * all other records among them, be skipped without being presented to the
+     * tools in run().  For a directory of per-thread trace files, the count is
+     * applied to each file.  Must be called prior to run().
+     */
+    void set_skip_instructions(uint64_t instruction_count);
+
+    /**
+     * For a directory of per-thread trace files analyzed as a single stream,
+     * sets the number of cores the threads are scheduled onto and the number of
+     * instructions after which a running thread is switched out in favor of a
+     * waiting one, with 0 switching threads only at their timestamps.  Each
+     * placement of a thread on a core is announced by a
+     * #TRACE_MARKER_TYPE_CPU_ID marker holding the core's index.  The defaults
+     * are 4 cores and a \p quantum of 0.  Must be called prior to run().
+     */
+    void set_schedule(unsigned int num_cores, uint64_t quantum);
+
+    /**
+     * For a directory of per-thread trace files with an index, as written by
+     * drraw2trace -outdir, restricts the analysis to the threads whose ids are in
+     * \p tids: the files of other threads are never opened.  Must be called prior
+     * to run().  Returns false, with get_error_string() describing why, if the
+     * trace has no index or contains none of \p tids.
+     */
+    bool set_thread_subset(const std::vector<memref_tid_t> &tids);
+
+    /**
+     * When \p pipelined is true and there are multiple tools, run() gives each
+     * tool a thread of its own, analyzing the same trace in the serial case.
+     * The trace is read once, into batches shared read-only by all tools, so
+     * the analysis takes about as long as the slowest tool rather than the sum
+     * of all of them.  The tools must not share any unsynchronized state.  It
+     * does not affect parallel shard analysis.  Must be called prior to run().
+     */
+    void set_pipelined(bool pipelined);
+
+    /**
+     * When \p shards is true and every tool supports
+     * analysis_tool_t::parallel_shard_supported(), run() splits an online trace
+     * by application thread instead of iterating over it as one stream.  The
+     * reading thread only routes each buffer of entries to its thread's queue,
+     * and each thread is analyzed as a separate shard on a thread of its own
+     * that decodes the queued entries, so the analysis is no longer limited by
+     * the rate at which a single thread can decode the whole trace.  The shards
+     * are numbered in the order in which their threads first appear.  The count
+     * from set_skip_instructions() is applied to each thread.  The trace must
+     * come from a reader that supports raw access, such as that of a pipe.
+     * Must be called prior to run().
+     */
+    void set_online_shards(bool shards);
+
  protected:
-    bool init_file_reader(const std::string &trace_file);
+    struct analyzer_shard_data_t {
+        analyzer_shard_data_t(int index, reader_t *iter, const std::string &trace_file)
+            : index(index), iter(iter), trace_file(trace_file) {}
+        int index;
+        reader_t *iter;
+        std::string trace_file;
+    };
+
+    // For online shard mode: a thread's queue of entries, the batch the reading
+    // thread is filling for it, and the thread analyzing it.
+    struct online_shard_t {
+        online_shard_t(int index, queue_reader_t *iter) : index(index), iter(iter) {}
+        int index;
+        queue_reader_t *iter;
+        std::vector<trace_entry_t> pending;
+        std::string error;
+        std::thread thread;
+    };
+
+    bool init_file_reader(const std::string &trace_path, int worker_count = 0);
+    reader_t * get_file_reader(const std::string &trace_file);
 
     // This finalizes the trace_iter setup.  It can block and is meant to be
     // called at the top of run() or begin().
     bool start_reading();
 
+    bool run_parallel();
+    void process_tasks(std::string *error);
+    bool run_pipelined();
+    void pipeline_tool(int tool_index, char *result);
+    bool run_online_shards();
+    void online_shard_main(online_shard_t *shard);
+    online_shard_t *get_online_shard(memref_tid_t tid);
+    void finish_online_shard(online_shard_t *shard);
+    void skip_instructions(reader_t *iter);
+
+    // The number of entries passed to analysis_tool_t::process_memrefs() at once.
+    static const size_t MEMREF_BATCH_SIZE = 4096;
+
     bool success;
     std::string error_string;
     reader_t *trace_iter;
     reader_t *trace_end;
     int num_tools;
     analysis_tool_t **tools;
+    uint64_t skip_instrs;
+    // Parallel mode state.  Each shard owns its reader; trace_end is shared as
+    // reader comparison only checks for EOF.
+    bool parallel;
+    int worker_count;
+    std::vector<analyzer_shard_data_t> shards;
+    std::atomic<int> next_shard;
+    // For a directory analyzed serially, the files to schedule in start_reading().
+    std::vector<std::string> sched_files;
+    unsigned int sched_cores;
+    uint64_t sched_quantum;
+    // For a directory with a thread index, the thread id of each trace file.
+    std::unordered_map<std::string, memref_tid_t> file_tids;
+    // Pipelined mode state.  The reader fills the batches in a ring, and each
+    // slot is reused once every tool has consumed it.  The counts only grow.
+    static const size_t PIPELINE_BATCHES = 8;
+    bool pipelined;
+    std::vector<std::vector<memref_t>> pipeline_ring;
+    size_t pipeline_produced;
+    std::vector<size_t> pipeline_consumed;
+    bool pipeline_done;
+    std::mutex pipeline_mutex;
+    std::condition_variable pipeline_cond;
+    // Online shard mode state.  The live shards are those of threads that have
+    // not exited, so that a reused thread id gets a new shard.
+    // The batches queued per thread before the reading thread waits for its shard.
+    static const size_t ONLINE_QUEUED_BATCHES = 16;
+    bool online_shards;
+    std::vector<online_shard_t *> online;
+    std::unordered_map<memref_tid_t, online_shard_t *> online_live;
 };
 
 #endif /* _ANALYZER_H_ */
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2016-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2016-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -30,16 +30,19 @@
  * DAMAGE.
  */
 
+#include <iostream>
+#include <sstream>
+#include <stdlib.h>
 #include "analyzer.h"
 #include "analyzer_multi.h"
 #include "analysis_tool_interface.h"
 #include "common/options.h"
 #include "common/utils.h"
-#include "reader/file_reader.h"
-#ifdef HAS_ZLIB
-# include "reader/compressed_file_reader.h"
-#endif
+#include "reader/mmap_file_reader.h"
 #include "reader/ipc_reader.h"
+#ifdef LINUX
+# include "reader/shm_ring_reader.h"
+#endif
 #include "tracer/raw2trace_directory.h"
 #include "tracer/raw2trace.h"
 #ifdef DEBUG
@@ -60,11 +63,25 @@ analyzer_multi_t::analyzer_multi_t()
         success = false;
         return;
     }
+    if (op_per_process.get_value() &&
+        (!op_infile.get_value().empty() || !op_indir.get_value().empty())) {
+        ERRMSG("Usage error: -per_process is only supported for online analysis\n");
+        success = false;
+        return;
+    }
+    if (op_online_shards.get_value() &&
+        (!op_infile.get_value().empty() || !op_indir.get_value().empty() ||
+         op_per_process.get_value())) {
+        ERRMSG("Usage error: -online_shards is only supported for online analysis "
+               "without -per_process\n");
+        success = false;
+        return;
+    }
     if (!op_indir.get_value().empty()) {
         // XXX: better to put in app name + pid, or rely on staying inside subdir?
         std::string tracefile = op_indir.get_value() + std::string(DIRSEP) +
             TRACE_FILENAME;
-        file_reader_t *existing = new file_reader_t(tracefile.c_str());
+        mmap_file_reader_t *existing = new mmap_file_reader_t(tracefile.c_str());
         if (existing->is_complete())
             trace_iter = existing;
         else {
@@ -74,11 +91,26 @@ analyzer_multi_t::analyzer_multi_t()
             std::string error = raw2trace.do_conversion();
             if (!error.empty())
                 ERRMSG("raw2trace failed: %s\n", error.c_str());
-            trace_iter = new file_reader_t(tracefile.c_str());
+            trace_iter = new mmap_file_reader_t(tracefile.c_str());
         }
         // We don't support a compressed file here (is_complete() is too hard
         // to implement).
-        trace_end = new file_reader_t();
+        trace_end = new mmap_file_reader_t();
+    } else if (op_infile.get_value().empty() && op_ipc_ring.get_value()) {
+#ifdef LINUX
+        trace_iter = new shm_ring_reader_t(op_ipc_name.get_value().c_str(),
+                                           op_ipc_ring_slots.get_value(),
+                                           (size_t)op_ipc_ring_slot_size.get_value());
+        trace_end = new shm_ring_reader_t();
+        if (!*trace_iter) {
+            success = false;
+            error_string = "try removing stale ring file " +
+                reinterpret_cast<shm_ring_reader_t*>(trace_iter)->get_ring_name();
+        }
+#else
+        success = false;
+        error_string = "-ipc_ring is only supported on Linux";
+#endif
     } else if (op_infile.get_value().empty()) {
         trace_iter = new ipc_reader_t(op_ipc_name.get_value().c_str());
         trace_end = new ipc_reader_t();
@@ -92,15 +124,35 @@ analyzer_multi_t::analyzer_multi_t()
 #endif
         }
     } else {
-#ifdef HAS_ZLIB
-        // Even for uncompressed files, zlib's gzip interface is faster than fstream.
-        trace_iter = new compressed_file_reader_t(op_infile.get_value().c_str());
-        trace_end = new compressed_file_reader_t();
-#else
-        trace_iter = new file_reader_t(op_infile.get_value().c_str());
-        trace_end = new file_reader_t();
-#endif
+        // This handles both a single file and a directory of per-thread files.
+        if (!init_file_reader(op_infile.get_value(), (int)op_jobs.get_value()))
+            success = false;
+    }
+    if (!success)
+        return;
+    if (!op_only_threads.get_value().empty()) {
+        std::vector<memref_tid_t> tids;
+        std::stringstream list(op_only_threads.get_value());
+        std::string tid;
+        while (std::getline(list, tid, ',')) {
+            char *end;
+            long long value = strtoll(tid.c_str(), &end, 10);
+            if (tid.empty() || *end != '\0') {
+                ERRMSG("Usage error: -only_threads takes a comma-separated list of "
+                       "thread ids\n");
+                success = false;
+                return;
+            }
+            tids.push_back((memref_tid_t)value);
+        }
+        if (!set_thread_subset(tids)) {
+            success = false;
+            return;
+        }
     }
+    set_skip_instructions(op_skip_instrs.get_value());
+    set_schedule(op_num_cores.get_value(), op_sched_quantum.get_value());
+    set_online_shards(op_online_shards.get_value());
     // We can't call trace_iter->init() here as it blocks for ipc_reader_t.
 }
 
@@ -109,36 +161,208 @@ analyzer_multi_t::~analyzer_multi_t()
     destroy_analysis_tools();
 }
 
+bool
+analyzer_multi_t::run()
+{
+    if (op_per_process.get_value())
+        return run_per_process();
+    return analyzer_t::run();
+}
+
+analyzer_multi_t::process_data_t *
+analyzer_multi_t::get_process_data(memref_pid_t pid)
+{
+    auto it = processes.find(pid);
+    if (it != processes.end())
+        return it->second;
+    process_data_t *process = new process_data_t;
+    process->tools = create_tool_set(&process->num_tools);
+    if (process->tools == NULL) {
+        ERRMSG("Failed to create analysis tool for process %lld\n", (long long)pid);
+        delete process;
+        return NULL;
+    }
+    process->pending.reserve(MEMREF_BATCH_SIZE);
+    process->thread = std::thread(&analyzer_multi_t::process_main, this, process);
+    processes[pid] = process;
+    return process;
+}
+
+void
+analyzer_multi_t::enqueue_batch(process_data_t *process)
+{
+    if (process->pending.empty())
+        return;
+    std::unique_lock<std::mutex> lock(process->mutex);
+    // We bound the memory held for a process whose tools fall behind the reader.
+    process->cond.wait(lock, [process] {
+        return process->queue.size() < MAX_QUEUED_BATCHES;
+    });
+    process->queue.push_back(std::move(process->pending));
+    lock.unlock();
+    process->cond.notify_all();
+    process->pending.clear();
+    process->pending.reserve(MEMREF_BATCH_SIZE);
+}
+
+void
+analyzer_multi_t::process_main(process_data_t *process)
+{
+    while (true) {
+        std::vector<memref_t> batch;
+        {
+            std::unique_lock<std::mutex> lock(process->mutex);
+            process->cond.wait(lock, [process] {
+                return !process->queue.empty() || process->done;
+            });
+            if (process->queue.empty())
+                return;
+            batch = std::move(process->queue.front());
+            process->queue.pop_front();
+        }
+        process->cond.notify_all();
+        for (int i = 0; i < process->num_tools; ++i) {
+            process->res = process->tools[i]->process_memrefs(&batch[0], batch.size()) &&
+                process->res;
+        }
+    }
+}
 
 bool
-analyzer_multi_t::create_analysis_tools()
+analyzer_multi_t::run_per_process()
+{
+    bool res = true;
+    if (!start_reading())
+        return false;
+    skip_instructions(trace_iter);
+    // The reader interleaves all processes: we hand each process's references to
+    // its own thread in batches.
+    for (; *trace_iter != *trace_end; ++(*trace_iter)) {
+        const memref_t &memref = **trace_iter;
+        process_data_t *process = get_process_data(memref.data.pid);
+        if (process == NULL) {
+            res = false;
+            break;
+        }
+        process->pending.push_back(memref);
+        ++process->num_records;
+        if (process->pending.size() >= MEMREF_BATCH_SIZE)
+            enqueue_batch(process);
+    }
+    for (auto &keyval : processes) {
+        process_data_t *process = keyval.second;
+        enqueue_batch(process);
+        {
+            std::lock_guard<std::mutex> lock(process->mutex);
+            process->done = true;
+        }
+        process->cond.notify_all();
+    }
+    for (auto &keyval : processes) {
+        keyval.second->thread.join();
+        res = keyval.second->res && res;
+    }
+    return res;
+}
+
+bool
+analyzer_multi_t::print_stats()
+{
+    if (!op_per_process.get_value())
+        return analyzer_t::print_stats();
+    bool res = true;
+    uint64_t total_records = 0;
+    for (const auto &keyval : processes) {
+        const process_data_t *process = keyval.second;
+        std::cerr << "Results for process " << keyval.first << ":\n";
+        for (int i = 0; i < process->num_tools; ++i) {
+            res = process->tools[i]->print_results() && res;
+            if (i+1 < process->num_tools) {
+                std::cerr << "\n------------------------------------------------------"
+                    "---------------------\n";
+            }
+        }
+        // Separate process output.
+        std::cerr << "\n=========================================================="
+            "=================\n";
+        total_records += process->num_records;
+    }
+    std::cerr << "Per-process summary:\n";
+    for (const auto &keyval : processes) {
+        std::cerr << "  Process " << keyval.first << ": " << keyval.second->num_records
+                  << " records\n";
+    }
+    std::cerr << "  Total: " << total_records << " records in " << processes.size()
+              << " process(es)\n";
+    return res;
+}
+
+analysis_tool_t **
+analyzer_multi_t::create_tool_set(int *count)
 {
-    /* FIXME i#2006: add multiple tool support. */
     /* FIXME i#2006: create a single top-level tool for multi-component
      * tools.
      */
-    tools = new analysis_tool_t*[max_num_tools];
-    tools[0] = drmemtrace_analysis_tool_create();
-    if (tools[0] != NULL && !*tools[0]) {
-        delete tools[0];
-        tools[0] = NULL;
+    // -simulator_type may name several tools, which then all analyze the same
+    // pass over the trace.  Room is left for the test mode tool.
+    analysis_tool_t **set = new analysis_tool_t*[max_num_tools];
+    std::stringstream stream(op_simulator_type.get_value());
+    std::string type;
+    *count = 0;
+    while (std::getline(stream, type, ',')) {
+        if (*count >= max_num_tools - 1) {
+            ERRMSG("Usage error: too many simulator types.\n");
+            destroy_tool_set(set, *count);
+            return NULL;
+        }
+        set[*count] = drmemtrace_analysis_tool_create(type);
+        if (set[*count] != NULL && !*set[*count]) {
+            delete set[*count];
+            set[*count] = NULL;
+        }
+        if (set[*count] == NULL) {
+            destroy_tool_set(set, *count);
+            return NULL;
+        }
+        ++*count;
+    }
+    if (*count == 0) {
+        ERRMSG("Usage error: no simulator type.\n");
+        destroy_tool_set(set, 0);
+        return NULL;
     }
-    if (tools[0] == NULL)
-        return false;
-    num_tools = 1;
 #ifdef DEBUG
     if (op_test_mode.get_value()) {
-        tools[1] = new trace_invariants_t(op_offline.get_value(), op_verbose.get_value());
-        if (tools[1] != NULL && !*tools[1]) {
-            delete tools[1];
-            tools[1] = NULL;
+        set[*count] = new trace_invariants_t(op_offline.get_value(),
+                                             op_verbose.get_value());
+        if (set[*count] != NULL && !*set[*count]) {
+            delete set[*count];
+            set[*count] = NULL;
         }
-        if (tools[1] == NULL)
-            return false;
-        num_tools = 2;
+        if (set[*count] == NULL) {
+            destroy_tool_set(set, *count);
+            return NULL;
+        }
+        ++*count;
     }
 #endif
-    return true;
+    return set;
+}
+
+void
+analyzer_multi_t::destroy_tool_set(analysis_tool_t **set, int count)
+{
+    for (int i = 0; i < count; i++)
+        delete set[i];
+    delete [] set;
+}
+
+bool
+analyzer_multi_t::create_analysis_tools()
+{
+    // In -per_process mode these are unused but still vet the tool options up front.
+    tools = create_tool_set(&num_tools);
+    return tools != NULL;
 }
 
 void
@@ -146,7 +370,9 @@ analyzer_multi_t::destroy_analysis_tools()
 {
     if (!success)
         return;
-    for (int i = 0; i < num_tools; i++)
-        delete tools[i];
-    delete [] tools;
+    destroy_tool_set(tools, num_tools);
+    for (auto &keyval : processes) {
+        destroy_tool_set(keyval.second->tools, keyval.second->num_tools);
+        delete keyval.second;
+    }
 }
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2016-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2016-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -37,6 +37,12 @@
 #ifndef _ANALYZER_MULTI_H_
 #define _ANALYZER_MULTI_H_ 1
 
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "analyzer.h"
 
 class analyzer_multi_t : public analyzer_t
@@ -46,12 +52,42 @@ class analyzer_multi_t : public analyzer_t
     // be queried via operator!.
     analyzer_multi_t();
     virtual ~analyzer_multi_t();
+    virtual bool run();
+    virtual bool print_stats();
 
  protected:
+    // For -per_process: each process's tools and the queue of batches of its
+    // references awaiting the thread that runs them.
+    struct process_data_t {
+        process_data_t() : tools(NULL), num_tools(0), num_records(0), done(false),
+                           res(true) {}
+        analysis_tool_t **tools;
+        int num_tools;
+        uint64_t num_records;
+        std::vector<memref_t> pending;
+        std::deque<std::vector<memref_t> > queue;
+        std::mutex mutex;
+        std::condition_variable cond;
+        bool done;
+        bool res;
+        std::thread thread;
+    };
+
     bool create_analysis_tools();
     void destroy_analysis_tools();
+    analysis_tool_t **create_tool_set(int *count);
+    void destroy_tool_set(analysis_tool_t **set, int count);
+
+    bool run_per_process();
+    process_data_t *get_process_data(memref_pid_t pid);
+    void enqueue_batch(process_data_t *process);
+    void process_main(process_data_t *process);
 
     static const int max_num_tools = 8;
+    // The batches queued per process before the reader waits for its thread.
+    static const size_t MAX_QUEUED_BATCHES = 16;
+
+    std::map<memref_pid_t, process_data_t *> processes;
  };
 
 #endif /* _ANALYZER_MULTI_H_ */
@@ -0,0 +1,128 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cardinality_sketch: a HyperLogLog estimator of the number of distinct values
+ * added, using constant space regardless of how many there are.
+ */
+
+#ifndef _CARDINALITY_SKETCH_H_
+#define _CARDINALITY_SKETCH_H_ 1
+
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+
+// Holds 2^precision one-byte registers.  The standard error of estimate() is
+// about 1.04 / sqrt(2^precision): 1.6% for the default of 12, for 4KB.
+class cardinality_sketch_t
+{
+ public:
+    static const unsigned int MIN_PRECISION = 7;
+    static const unsigned int MAX_PRECISION = 16;
+
+    explicit cardinality_sketch_t(unsigned int precision_in = 12) :
+        precision(precision_in), registers((size_t)1 << precision_in, 0)
+    {
+    }
+
+    void
+    add(uint64_t value)
+    {
+        uint64_t hash = mix(value);
+        size_t index = (size_t)(hash >> (64 - precision));
+        // The rank is the position of the first set bit in the remaining bits.
+        uint64_t rest = hash << precision;
+        unsigned char rank = 1;
+        while (rank <= 64 - precision && (rest & (1ULL << 63)) == 0) {
+            ++rank;
+            rest <<= 1;
+        }
+        if (rank > registers[index])
+            registers[index] = rank;
+    }
+
+    double
+    estimate() const
+    {
+        double m = (double)registers.size();
+        double sum = 0.;
+        size_t zeros = 0;
+        for (unsigned char reg : registers) {
+            sum += ldexp(1., -(int)reg);
+            if (reg == 0)
+                ++zeros;
+        }
+        double alpha = 0.7213 / (1. + 1.079 / m);
+        double estimate = alpha * m * m / sum;
+        // Linear counting is more accurate for small cardinalities.  With a
+        // 64-bit hash no large-range correction is needed.
+        if (estimate <= 2.5 * m && zeros > 0)
+            estimate = m * log(m / (double)zeros);
+        return estimate;
+    }
+
+    // Makes this the sketch of the union of both sets, which must have been
+    // sketched with the same precision.
+    void
+    merge(const cardinality_sketch_t &other)
+    {
+        for (size_t i = 0; i < registers.size(); i++) {
+            if (other.registers[i] > registers[i])
+                registers[i] = other.registers[i];
+        }
+    }
+
+    void
+    clear()
+    {
+        registers.assign(registers.size(), 0);
+    }
+
+ private:
+    // The splitmix64 finalizer, so that consecutive lines and pages spread
+    // across the registers.
+    static uint64_t
+    mix(uint64_t value)
+    {
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9ULL;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111ebULL;
+        value ^= value >> 31;
+        return value;
+    }
+
+    unsigned int precision;
+    std::vector<unsigned char> registers;
+};
+
+#endif /* _CARDINALITY_SKETCH_H_ */
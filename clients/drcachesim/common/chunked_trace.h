@@ -0,0 +1,109 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* chunked_trace: the layout of a trace file stored as a sequence of
+ * independently compressed chunks with an index, which supports seeking.
+ */
+
+#ifndef _CHUNKED_TRACE_H_
+#define _CHUNKED_TRACE_H_ 1
+
+#include <stdint.h>
+#include "trace_entry.h"
+
+// A chunked trace file is laid out as follows:
+//   chunked_trace_header_t
+//   The chunks, each a zlib stream holding up to chunk_entries trace_entry_t.
+//   chunked_trace_index_t[num_chunks]
+//   chunked_trace_thread_t[num_threads]
+//   chunked_trace_footer_t
+// The concatenated uncompressed chunks form a regular trace, beginning with
+// the TRACE_TYPE_HEADER entry and ending with the TRACE_TYPE_FOOTER entry.
+
+#define CHUNKED_TRACE_MAGIC 0x4b4e484344524d44ULL // "DMRDCHNK"
+#define CHUNKED_TRACE_VERSION 1
+#define CHUNKED_TRACE_DEFAULT_CHUNK_ENTRIES (64 * 1024)
+
+struct chunked_trace_header_t {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t chunk_entries;
+};
+
+// The index entry for one chunk.  Besides locating the chunk it records the
+// reader state at the chunk's start so that reading can begin there.
+struct chunked_trace_index_t {
+    uint64_t file_offset;
+    uint64_t compressed_size;
+    uint64_t entry_count;
+    // The ordinal of the first instruction in this chunk, counted as described
+    // for chunked_trace_instr_count().
+    uint64_t first_instr;
+    uint64_t instr_count;
+    // The most recent timestamp marker value prior to or at the chunk's start.
+    uint64_t timestamp;
+    uint64_t tid;
+    uint64_t pid;
+    // The pc of the most recent instruction and the pc following it, used for
+    // data references and instruction bundles at the start of the chunk.
+    uint64_t cur_pc;
+    uint64_t next_pc;
+};
+
+struct chunked_trace_thread_t {
+    uint64_t tid;
+    uint64_t pid;
+};
+
+struct chunked_trace_footer_t {
+    uint64_t index_offset;
+    uint64_t num_chunks;
+    uint64_t num_threads;
+    uint64_t magic;
+};
+
+// Returns the number of instructions represented by the entry: these are the
+// entries the reader presents as instruction memref_t, including
+// TRACE_TYPE_INSTR_NO_FETCH, with each bundle expanded.
+static inline uint64_t
+chunked_trace_instr_count(const trace_entry_t &entry)
+{
+    if (entry.type == TRACE_TYPE_INSTR_BUNDLE)
+        return entry.size;
+    if ((type_is_instr((trace_type_t)entry.type) ||
+         entry.type == TRACE_TYPE_INSTR_MAYBE_FETCH ||
+         entry.type == TRACE_TYPE_INSTR_NO_FETCH) && entry.size > 0)
+        return 1;
+    return 0;
+}
+
+#endif /* _CHUNKED_TRACE_H_ */
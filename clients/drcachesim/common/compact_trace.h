@@ -0,0 +1,213 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* compact_trace: a compact encoding of a stream of trace_entry_t, with each
+ * address stored as a variable-length delta from a per-thread prediction.
+ */
+
+#ifndef _COMPACT_TRACE_H_
+#define _COMPACT_TRACE_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unordered_map>
+#include "trace_entry.h"
+
+// A compact trace file is a compact_trace_header_t followed by one record per
+// trace_entry_t of a regular trace, beginning with the TRACE_TYPE_HEADER entry
+// and ending with the TRACE_TYPE_FOOTER entry.  Each record is:
+//   1 byte:   the entry type
+//   varint:   the entry size
+//   varint:   the zigzag-encoded difference between the entry's addr and the
+//             value predicted for it
+// A varint holds 7 bits per byte, least significant first, with the top bit
+// set on every byte but the last.  The prediction is kept separately for each
+// thread (as switched by TRACE_TYPE_THREAD entries) and each kind of entry:
+// an instruction is predicted to follow the prior instruction, a data
+// reference to share the prior data reference's address, and a timestamp to
+// equal the prior timestamp.  Other entries are predicted to be 0.
+// Mostly-sequential instruction fetches thus take 3 bytes rather than
+// sizeof(trace_entry_t).  The file can be further compressed with gzip.
+
+#define COMPACT_TRACE_MAGIC 0x54434d4344524d44ULL // "DMRDCMCT"
+#define COMPACT_TRACE_VERSION 1
+// The largest encoding of one entry.
+#define COMPACT_TRACE_MAX_RECORD (1 + 3 + 10)
+
+struct compact_trace_header_t {
+    uint64_t magic;
+    uint32_t version;
+    // sizeof(addr_t) of the encoded entries.
+    uint32_t addr_size;
+};
+
+// Holds the predictions shared by the encoder and the decoder, which must see
+// the same sequence of entries.
+class compact_trace_codec_t
+{
+ public:
+    compact_trace_codec_t() : cur(&threads[0]) {}
+
+    // Writes the encoding of entry to out, which must have room for
+    // COMPACT_TRACE_MAX_RECORD bytes, and returns the number of bytes written,
+    // or 0 if the entry cannot be encoded.
+    size_t
+    encode(const trace_entry_t &entry, unsigned char *out)
+    {
+        if (entry.type > 0xff)
+            return 0;
+        unsigned char *pos = out;
+        *pos++ = (unsigned char)entry.type;
+        pos = put_varint(pos, entry.size);
+        uint64_t addr = (uint64_t)entry.addr;
+        uint64_t delta = addr - predict(entry);
+        pos = put_varint(pos, (delta << 1) ^ (uint64_t)((int64_t)delta >> 63));
+        update(entry, addr);
+        return pos - out;
+    }
+
+    // Decodes the record at the start of the len bytes at in into entry and
+    // returns the number of bytes consumed.  Returns 0 if the record is
+    // incomplete, or -1 if it is malformed.
+    int
+    decode(const unsigned char *in, size_t len, trace_entry_t *entry)
+    {
+        const unsigned char *pos = in, *end = in + len;
+        uint64_t size, zigzag;
+        if (pos >= end)
+            return 0;
+        entry->type = *pos++;
+        int res = get_varint(&pos, end, &size);
+        if (res <= 0)
+            return res;
+        res = get_varint(&pos, end, &zigzag);
+        if (res <= 0)
+            return res;
+        if (size > 0xffff)
+            return -1;
+        entry->size = (unsigned short)size;
+        uint64_t addr = predict(*entry) + ((zigzag >> 1) ^ (0 - (zigzag & 1)));
+        entry->addr = (addr_t)addr;
+        update(*entry, (uint64_t)entry->addr);
+        return (int)(pos - in);
+    }
+
+ private:
+    struct prediction_t {
+        prediction_t() : next_pc(0), data(0), timestamp(0) {}
+        uint64_t next_pc;
+        uint64_t data;
+        uint64_t timestamp;
+    };
+
+    static bool
+    is_fetch(const trace_entry_t &entry)
+    {
+        return type_is_instr((trace_type_t)entry.type) ||
+            entry.type == TRACE_TYPE_INSTR_NO_FETCH ||
+            entry.type == TRACE_TYPE_INSTR_MAYBE_FETCH;
+    }
+
+    static bool
+    is_data(const trace_entry_t &entry)
+    {
+        return entry.type == TRACE_TYPE_READ || entry.type == TRACE_TYPE_WRITE ||
+            type_is_prefetch((trace_type_t)entry.type) ||
+            (entry.type >= TRACE_TYPE_INSTR_FLUSH &&
+             entry.type <= TRACE_TYPE_DATA_FLUSH_END);
+    }
+
+    static bool
+    is_timestamp(const trace_entry_t &entry)
+    {
+        return entry.type == TRACE_TYPE_MARKER &&
+            entry.size == TRACE_MARKER_TYPE_TIMESTAMP;
+    }
+
+    uint64_t
+    predict(const trace_entry_t &entry) const
+    {
+        if (is_fetch(entry))
+            return cur->next_pc;
+        if (is_data(entry))
+            return cur->data;
+        if (is_timestamp(entry))
+            return cur->timestamp;
+        return 0;
+    }
+
+    void
+    update(const trace_entry_t &entry, uint64_t addr)
+    {
+        if (is_fetch(entry))
+            cur->next_pc = addr + entry.size;
+        else if (is_data(entry))
+            cur->data = addr;
+        else if (is_timestamp(entry))
+            cur->timestamp = addr;
+        else if (entry.type == TRACE_TYPE_THREAD)
+            cur = &threads[addr];
+    }
+
+    static unsigned char *
+    put_varint(unsigned char *pos, uint64_t val)
+    {
+        while (val >= 0x80) {
+            *pos++ = (unsigned char)(val | 0x80);
+            val >>= 7;
+        }
+        *pos++ = (unsigned char)val;
+        return pos;
+    }
+
+    // Returns 1 on success, 0 if incomplete, and -1 if malformed.
+    static int
+    get_varint(const unsigned char **pos, const unsigned char *end, uint64_t *val)
+    {
+        *val = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (*pos >= end)
+                return 0;
+            unsigned char byte = *(*pos)++;
+            *val |= (uint64_t)(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return 1;
+        }
+        return -1;
+    }
+
+    // Pointers to unordered_map values remain valid as the map grows.
+    std::unordered_map<uint64_t, prediction_t> threads;
+    prediction_t *cur;
+};
+
+#endif /* _COMPACT_TRACE_H_ */
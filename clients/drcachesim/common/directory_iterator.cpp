@@ -0,0 +1,154 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string.h>
+#include <sys/stat.h>
+#include "directory_iterator.h"
+#include "utils.h"
+
+#ifdef UNIX
+
+directory_iterator_t::directory_iterator_t() : success(true), at_eof(true), dir(NULL)
+{
+    /* Empty. */
+}
+
+directory_iterator_t::directory_iterator_t(const std::string &directory_in) :
+    success(true), at_eof(false), directory(directory_in)
+{
+    dir = opendir(directory.c_str());
+    if (dir == NULL) {
+        success = false;
+        at_eof = true;
+        error_descr = "Failed to list directory " + directory;
+        return;
+    }
+    ++*this;
+}
+
+directory_iterator_t::~directory_iterator_t()
+{
+    if (dir != NULL)
+        closedir(dir);
+}
+
+directory_iterator_t&
+directory_iterator_t::operator++()
+{
+    struct dirent *ent;
+    while (!at_eof) {
+        ent = readdir(dir);
+        if (ent == NULL) {
+            at_eof = true;
+            break;
+        }
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+            continue;
+        if (is_directory(directory + DIRSEP + ent->d_name))
+            continue;
+        cur_file = ent->d_name;
+        break;
+    }
+    return *this;
+}
+
+bool
+directory_iterator_t::is_directory(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+#else
+
+directory_iterator_t::directory_iterator_t() :
+    success(true), at_eof(true), find(INVALID_HANDLE_VALUE)
+{
+    /* Empty. */
+}
+
+directory_iterator_t::directory_iterator_t(const std::string &directory_in) :
+    success(true), at_eof(false), directory(directory_in)
+{
+    // We use the ANSI interface to avoid a dependence on dr_frontend for
+    // UTF-8 conversion.
+    std::string pattern = directory + "\\*";
+    find = FindFirstFileA(pattern.c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) {
+        success = false;
+        at_eof = true;
+        error_descr = "Failed to list directory " + directory;
+        return;
+    }
+    if (TESTANY(data.dwFileAttributes, FILE_ATTRIBUTE_DIRECTORY))
+        ++*this;
+    else
+        cur_file = data.cFileName;
+}
+
+directory_iterator_t::~directory_iterator_t()
+{
+    if (find != INVALID_HANDLE_VALUE)
+        FindClose(find);
+}
+
+directory_iterator_t&
+directory_iterator_t::operator++()
+{
+    while (!at_eof) {
+        if (FindNextFileA(find, &data) == 0) {
+            at_eof = true;
+            break;
+        }
+        if (TESTANY(data.dwFileAttributes, FILE_ATTRIBUTE_DIRECTORY))
+            continue;
+        cur_file = data.cFileName;
+        break;
+    }
+    return *this;
+}
+
+bool
+directory_iterator_t::is_directory(const std::string &path)
+{
+    DWORD attrib = GetFileAttributesA(path.c_str());
+    return attrib != INVALID_FILE_ATTRIBUTES &&
+        TESTANY(attrib, FILE_ATTRIBUTE_DIRECTORY);
+}
+
+#endif
+
+const std::string &
+directory_iterator_t::operator*()
+{
+    return cur_file;
+}
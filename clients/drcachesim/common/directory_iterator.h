@@ -0,0 +1,94 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* directory_iterator: lists the files in a directory, for use by readers
+ * that take a directory of per-thread trace files as input.
+ */
+
+#ifndef _DIRECTORY_ITERATOR_H_
+#define _DIRECTORY_ITERATOR_H_ 1
+
+#include <iterator>
+#include <string>
+#ifdef WINDOWS
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <dirent.h>
+#endif
+
+// Following stream iterator convention, the default constructor produces an
+// end-of-directory object.  The iterator only returns regular file basenames:
+// "." and ".." and subdirectories are skipped.
+class directory_iterator_t : public std::iterator<std::input_iterator_tag, std::string>
+{
+ public:
+    directory_iterator_t();
+    explicit directory_iterator_t(const std::string &directory);
+    ~directory_iterator_t();
+
+    // Supplied for callers to check whether the directory could be opened.
+    bool operator!() {
+        return !success;
+    }
+    std::string error_string() {
+        return error_descr;
+    }
+
+    const std::string& operator*();
+
+    bool operator==(const directory_iterator_t& rhs) const {
+        return at_eof == rhs.at_eof;
+    }
+    bool operator!=(const directory_iterator_t& rhs) const {
+        return at_eof != rhs.at_eof;
+    }
+
+    directory_iterator_t& operator++();
+
+    static bool is_directory(const std::string &path);
+
+ private:
+    bool success;
+    bool at_eof;
+    std::string error_descr;
+    std::string directory;
+    std::string cur_file;
+#ifdef WINDOWS
+    HANDLE find;
+    WIN32_FIND_DATAA data;
+#else
+    DIR *dir;
+#endif
+};
+
+#endif /* _DIRECTORY_ITERATOR_H_ */
@@ -0,0 +1,195 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* flat_hash_map: a compact open-addressing hash table for integer keys, used by
+ * the analysis tools in place of node-based maps with one allocation per key.
+ */
+
+#ifndef _FLAT_HASH_MAP_H_
+#define _FLAT_HASH_MAP_H_ 1
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+// Maps integer keys to default-constructible values, storing the entries in a
+// single array probed linearly.  One key value, empty_key, marks the free slots;
+// the entry for that key itself is kept aside, so every key is supported.
+// Entries cannot be removed individually.  Inserting can move the entries, which
+// invalidates pointers to values and iterators.
+template <typename K, typename V>
+class flat_hash_map_t
+{
+ public:
+    typedef std::pair<K, V> value_type;
+
+    class const_iterator
+    {
+     public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename flat_hash_map_t::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef const value_type *pointer;
+        typedef const value_type &reference;
+
+        const_iterator(const flat_hash_map_t *map_in, size_t index_in) :
+            map(map_in), index(index_in)
+        {
+            skip_free();
+        }
+        const value_type &operator*() const { return map->slot(index); }
+        const value_type *operator->() const { return &map->slot(index); }
+        const_iterator &operator++()
+        {
+            ++index;
+            skip_free();
+            return *this;
+        }
+        bool operator==(const const_iterator &rhs) const { return index == rhs.index; }
+        bool operator!=(const const_iterator &rhs) const { return index != rhs.index; }
+
+     private:
+        // Index table.size() is the entry for empty_key.
+        void skip_free()
+        {
+            while (index < map->table.size() && map->table[index].first == map->empty_key)
+                ++index;
+            if (index == map->table.size() && !map->has_empty_key_entry)
+                ++index;
+        }
+        const flat_hash_map_t *map;
+        size_t index;
+    };
+
+    explicit flat_hash_map_t(K empty_key_in = K(~0ULL)) :
+        empty_key(empty_key_in), num_entries(0), shift(64),
+        has_empty_key_entry(false)
+    {
+        empty_key_entry.first = empty_key;
+    }
+
+    V &
+    operator[](K key)
+    {
+        if (key == empty_key) {
+            if (!has_empty_key_entry) {
+                has_empty_key_entry = true;
+                ++num_entries;
+            }
+            return empty_key_entry.second;
+        }
+        // We keep the load at most 3/4.
+        if ((num_entries + 1) * 4 > table.size() * 3)
+            grow();
+        size_t index = find_slot(key);
+        if (table[index].first == empty_key) {
+            table[index].first = key;
+            ++num_entries;
+        }
+        return table[index].second;
+    }
+
+    // Returns nullptr if key is not present.
+    const V *
+    find(K key) const
+    {
+        if (key == empty_key)
+            return has_empty_key_entry ? &empty_key_entry.second : nullptr;
+        if (table.empty())
+            return nullptr;
+        const value_type &entry = table[find_slot(key)];
+        return entry.first == key ? &entry.second : nullptr;
+    }
+
+    size_t size() const { return num_entries; }
+    bool empty() const { return num_entries == 0; }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, table.size() + 1); }
+
+    void
+    clear()
+    {
+        table.clear();
+        num_entries = 0;
+        shift = 64;
+        has_empty_key_entry = false;
+        empty_key_entry.second = V();
+    }
+
+ private:
+    const value_type &
+    slot(size_t index) const
+    {
+        return index < table.size() ? table[index] : empty_key_entry;
+    }
+
+    // Returns the slot holding key or else the free slot where it belongs.
+    size_t
+    find_slot(K key) const
+    {
+        // Fibonacci hashing spreads the consecutive keys of addresses and cache
+        // lines across the table.
+        size_t mask = table.size() - 1;
+        size_t index = (size_t)(((uint64_t)key * 0x9e3779b97f4a7c15ULL) >> shift);
+        while (table[index].first != key && table[index].first != empty_key)
+            index = (index + 1) & mask;
+        return index;
+    }
+
+    void
+    grow()
+    {
+        std::vector<value_type> old;
+        old.swap(table);
+        size_t capacity = old.empty() ? 16 : old.size() * 2;
+        // shift is 64 - log2(capacity).
+        shift = 64;
+        for (size_t size = capacity; size > 1; size >>= 1)
+            --shift;
+        table.assign(capacity, value_type(empty_key, V()));
+        for (auto &entry : old) {
+            if (entry.first != empty_key)
+                table[find_slot(entry.first)] = std::move(entry);
+        }
+    }
+
+    const K empty_key;
+    std::vector<value_type> table;
+    size_t num_entries;
+    unsigned int shift;
+    bool has_empty_key_entry;
+    value_type empty_key_entry;
+};
+
+#endif /* _FLAT_HASH_MAP_H_ */
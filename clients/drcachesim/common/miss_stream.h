@@ -0,0 +1,108 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* miss_stream: the binary format of a -LL_miss_file written with
+ * -LL_miss_format binary.
+ */
+
+#ifndef _MISS_STREAM_H_
+#define _MISS_STREAM_H_ 1
+
+/**
+ * @file drmemtrace/miss_stream.h
+ * @brief DrMemtrace binary cache miss stream format.
+ */
+
+#include <stdint.h>
+#include "memref.h"
+
+/**
+ * A binary miss stream starts with the 8 bytes of #MISS_STREAM_MAGIC, a version
+ * byte holding #MISS_STREAM_VERSION, and a byte of #miss_stream_flags_t.  Each miss
+ * follows as a sequence of LEB128 varints: the zigzag-encoded difference between
+ * its program counter and the prior miss's, then the same for its address.  With
+ * #MISS_STREAM_FLAG_TID_TIME, the zigzag-encoded differences of its thread id and
+ * of its timestamp follow.  All prior values start at zero.
+ */
+#define MISS_STREAM_MAGIC "DRMISSES"
+#define MISS_STREAM_MAGIC_SIZE 8 /**< The length of #MISS_STREAM_MAGIC. */
+#define MISS_STREAM_VERSION 1 /**< The current stream version. */
+#define MISS_STREAM_HEADER_SIZE (MISS_STREAM_MAGIC_SIZE + 2) /**< The header size. */
+/** The largest encoding of one miss, in bytes. */
+#define MISS_STREAM_MAX_RECORD_SIZE (4 * 10)
+
+/** The flags in a binary miss stream header. */
+enum miss_stream_flags_t {
+    /** Each miss includes its thread id and the timestamp of its trace chunk. */
+    MISS_STREAM_FLAG_TID_TIME = 0x1,
+};
+
+/** One miss as recorded in a binary miss stream. */
+struct miss_record_t {
+    addr_t pc; /**< The program counter of the missing instruction. */
+    addr_t addr; /**< The address that missed. */
+    /** The thread id, or 0 without #MISS_STREAM_FLAG_TID_TIME. */
+    memref_tid_t tid;
+    /**
+     * The value of the last #TRACE_MARKER_TYPE_TIMESTAMP marker seen before the
+     * miss, or 0 without #MISS_STREAM_FLAG_TID_TIME.
+     */
+    uint64_t timestamp;
+};
+
+// Varint helpers shared by the writer and the reader.
+
+static inline uint64_t
+miss_stream_zigzag(int64_t val)
+{
+    return ((uint64_t)val << 1) ^ (uint64_t)(val >> 63);
+}
+
+static inline int64_t
+miss_stream_unzigzag(uint64_t val)
+{
+    return (int64_t)(val >> 1) ^ -(int64_t)(val & 1);
+}
+
+// Appends the varint encoding of val at buf and returns the following byte.
+static inline unsigned char *
+miss_stream_put_varint(unsigned char *buf, uint64_t val)
+{
+    while (val >= 0x80) {
+        *buf++ = (unsigned char)(val | 0x80);
+        val >>= 7;
+    }
+    *buf++ = (unsigned char)val;
+    return buf;
+}
+
+#endif /* _MISS_STREAM_H_ */
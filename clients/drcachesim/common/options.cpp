@@ -52,6 +52,24 @@ droption_t<std::string> op_ipc_name
  "for each instance of the simulator being run at any one time.  On Windows, the name "
  "is limited to 247 characters.");
 
+droption_t<bool> op_ipc_ring
+(DROPTION_SCOPE_ALL, "ipc_ring", false, "Use a shared-memory ring for online tracing",
+ "For online tracing and simulation, sends the trace through a ring of slots in "
+ "shared memory named by -ipc_name instead of through a named pipe.  Each buffer "
+ "write by a traced thread claims a slot with one atomic increment and copies its "
+ "data in directly, and the two sides only make system calls to sleep and wake up "
+ "when the ring is empty or full.  This is only supported on Linux.");
+
+droption_t<unsigned int> op_ipc_ring_slots
+(DROPTION_SCOPE_FRONTEND, "ipc_ring_slots", 128, "Number of slots in the -ipc_ring ring",
+ "Specifies the number of slots in the shared-memory ring used by -ipc_ring, rounded "
+ "up to a power of two.");
+
+droption_t<bytesize_t> op_ipc_ring_slot_size
+(DROPTION_SCOPE_FRONTEND, "ipc_ring_slot_size", 128*1024, "Size of each -ipc_ring slot",
+ "Specifies the size in bytes of each slot in the shared-memory ring used by "
+ "-ipc_ring.  This is the largest piece in which a traced thread sends its buffer.");
+
 droption_t<std::string> op_outdir
 (DROPTION_SCOPE_ALL, "outdir", ".", "Target directory for offline trace files",
  "For the offline analysis mode (when -offline is requested), specifies the path "
@@ -65,12 +83,58 @@ droption_t<std::string> op_indir
 droption_t<std::string> op_infile
 (DROPTION_SCOPE_ALL, "infile", "", "Offline trace file for input to the simulator",
  "Directs the simulator to use a trace file (not a raw data file from -offline: "
- "such a file neeeds to be converted via drraw2trace or -indir first).");
+ "such a file neeeds to be converted via drraw2trace or -indir first).  "
+ "This can also be a directory containing one trace file per thread, in which "
+ "case the threads are analyzed in parallel (see -jobs) by tools that can analyze "
+ "each thread independently, or are otherwise scheduled onto the simulated cores "
+ "(see -sched_quantum).");
+
+droption_t<unsigned int> op_jobs
+(DROPTION_SCOPE_ALL, "jobs", 0, "Number of parallel analysis threads",
+ "When -infile is a directory of per-thread trace files, specifies the number of "
+ "worker threads used to analyze the threads in parallel.  A value of 0 uses one "
+ "worker per hardware thread.");
+
+droption_t<std::string> op_only_threads
+(DROPTION_SCOPE_FRONTEND, "only_threads", "", "Thread ids to analyze",
+ "When -infile is a directory of per-thread trace files with the index written by "
+ "drraw2trace -outdir, restricts the analysis to the threads in this "
+ "comma-separated list of thread ids.  The files of other threads are not "
+ "opened.");
+
+droption_t<bool> op_per_process
+(DROPTION_SCOPE_FRONTEND, "per_process", false, "Analyze each process separately",
+ "For online analysis of an application that creates child processes, gives each "
+ "process its own instance of the analysis tool, run on its own thread, instead "
+ "of interleaving all processes' references in a single instance.  Each "
+ "process's results are printed at the end.  Not supported with -infile or "
+ "-indir.");
+
+droption_t<bool> op_online_shards
+(DROPTION_SCOPE_FRONTEND, "online_shards", false, "Analyze online threads in parallel",
+ "For online analysis where every tool supports parallel shard analysis (such as "
+ "basic_counts or opcode_mix), splits the trace by application thread and "
+ "analyzes each thread as a separate shard on its own thread, rather than "
+ "decoding all threads' references on a single thread.  The analysis can then "
+ "keep up with more application threads given more cores.  For other tools this "
+ "has no effect.  Not supported with -infile, -indir, or -per_process.");
+
+droption_t<unsigned int> op_sim_threads
+(DROPTION_SCOPE_FRONTEND, "sim_threads", 0, "Number of cache simulation threads",
+ "If greater than 1, the cache simulator runs on this many worker threads: the "
+ "last-level cache is split by set index across half of them, rounded down to a "
+ "power of two, and the L1 caches of the cores are spread across the rest.  The "
+ "results are identical to those of the single-threaded simulation.  This is not "
+ "supported with -warmup_refs, -warmup_fraction, or -LL_miss_file.  For "
+ "-simulator_type " CACHE_SWEEP", this is instead the number of threads the "
+ "configurations are spread across, with 0 using one per hardware thread.");
 
 droption_t<std::string> op_module_file
-(DROPTION_SCOPE_ALL, "module_file", "", "Path to modules.log for opcode_mix tool",
- "The opcode_mix tool needs the modules.log file (generated by the offline "
- "post-processing step in the raw/ subdirectory) in addition to the trace file. "
+(DROPTION_SCOPE_ALL, "module_file", "",
+ "Path to modules.log for opcode_mix tool and -symbolize_reports",
+ "The opcode_mix tool and -symbolize_reports need the modules.log file (generated by "
+ "the offline post-processing step in the raw/ subdirectory) in addition to the "
+ "trace file. "
  "If the file is named modules.log and is in the same directory as the trace file, "
  "or a raw/ subdirectory below the trace file, this parameter can be omitted.");
 
@@ -111,39 +175,194 @@ droption_t<unsigned int> op_LL_assoc
  "Specifies the associativity of the unified last-level (L2) cache.  "
  "Must be a power of 2.");
 
+droption_t<std::string> op_config_file
+(DROPTION_SCOPE_FRONTEND, "config_file", "",
+ "Cache hierarchy configuration file",
+ "If non-empty, the cache simulator reads the hierarchy to simulate from this file "
+ "in place of the L1 and LL sizes and associativities of the other options: any "
+ "number of levels, each cache's inclusion policy and lookup latency, and the "
+ "memory latency, which together give the average memory access time.  It can also "
+ "set -cores and -line_size.  The format is described in the documentation.  This is "
+ "not supported with -sim_threads greater than 1.");
+
+droption_t<unsigned int> op_L1_latency
+(DROPTION_SCOPE_FRONTEND, "L1_latency", 0, "Cycles per L1 cache lookup",
+ "Specifies the cycles taken by a lookup of an L1 instruction or data cache, for the "
+ "average memory access time reported when any latency is non-zero and for -timing.  "
+ "A -config_file sets the latency of each of its caches instead.");
+
+droption_t<unsigned int> op_LL_latency
+(DROPTION_SCOPE_FRONTEND, "LL_latency", 0, "Cycles per LL cache lookup",
+ "Specifies the cycles taken by a lookup of the last-level cache.  See -L1_latency.");
+
+droption_t<unsigned int> op_memory_latency
+(DROPTION_SCOPE_FRONTEND, "memory_latency", 0, "Cycles per memory request",
+ "Specifies the cycles taken by a request which misses in the last-level cache.  "
+ "See -L1_latency.");
+
+droption_t<bool> op_timing
+(DROPTION_SCOPE_FRONTEND, "timing", false, "Estimate cycles with a core model",
+ "If enabled, the cache simulator estimates the cycles of each core and thread, "
+ "reporting their CPI and the part of it due to the memory hierarchy.  Each "
+ "instruction takes -timing_base_cpi cycles.  An instruction fetch which misses in "
+ "the L1 stalls for the latencies of the caches and memory it reaches, set with "
+ "-L1_latency, -LL_latency, and -memory_latency or with a -config_file.  A data miss "
+ "instead overlaps with later instructions until -timing_rob_size instructions "
+ "have issued behind it or -timing_mlp misses are outstanding, and lines from "
+ "memory are limited to -memory_bandwidth.  This is not supported with "
+ "-sim_threads greater than 1.");
+
+droption_t<double> op_timing_base_cpi
+(DROPTION_SCOPE_FRONTEND, "timing_base_cpi", 1.0, 0.0, 1000.0,
+ "Cycles per instruction without memory stalls",
+ "Specifies the cycles each instruction takes under -timing when it does not "
+ "wait on the memory hierarchy.");
+
+droption_t<unsigned int> op_timing_rob_size
+(DROPTION_SCOPE_FRONTEND, "timing_rob_size", 128, "Reorder buffer size for -timing",
+ "Specifies how many instructions can issue under -timing after a data miss before "
+ "the core stalls waiting for it.");
+
+droption_t<unsigned int> op_timing_mlp
+(DROPTION_SCOPE_FRONTEND, "timing_mlp", 8, "Outstanding data misses for -timing",
+ "Specifies how many data misses can be outstanding at once on each core under "
+ "-timing.");
+
+droption_t<double> op_memory_bandwidth
+(DROPTION_SCOPE_FRONTEND, "memory_bandwidth", 0.0, 0.0, 1e9,
+ "Memory bytes per cycle for -timing",
+ "Specifies the bytes per cycle the memory can transfer under -timing, shared by "
+ "all cores.  Each line from memory then occupies it for -line_size divided by "
+ "this many cycles.  Zero means no limit.");
+
 droption_t<std::string> op_LL_miss_file
 (DROPTION_SCOPE_FRONTEND, "LL_miss_file", "",
  "Path for dumping LLC misses", "If non-empty, requests that every last-level "
  "cache miss be written to a file at the specified path.  Each miss is written "
- "in text format as a <program counter, address> pair.  If this tool is linked "
+ "in the format selected by -LL_miss_format.  If this tool is linked "
  "with zlib, the file is written in gzip-compressed format.");
 
+droption_t<std::string> op_LL_miss_format
+(DROPTION_SCOPE_FRONTEND, "LL_miss_format", "text", "Format of -LL_miss_file",
+ "Specifies the format of each miss written to -LL_miss_file.  The 'text' format "
+ "writes a <program counter, address> pair per line.  The 'binary' format writes "
+ "the delta-encoded pairs in the compact form described in miss_stream.h, which can "
+ "be read with miss_stream_reader_t; a buffer of misses is written by a background "
+ "thread while the next one fills.  The 'binary_tid_time' format adds the thread id "
+ "and most recent trace timestamp of each miss.");
+
+droption_t<std::string> op_sweep_L1D_sizes
+(DROPTION_SCOPE_FRONTEND, "sweep_L1D_sizes", "", "L1 data cache sizes to sweep",
+ "For -simulator_type " CACHE_SWEEP", a comma-separated list of L1 data cache sizes "
+ "to evaluate, each of which may have a K, M, or G suffix.  If empty, -L1D_size is "
+ "used.");
+
+droption_t<std::string> op_sweep_LL_sizes
+(DROPTION_SCOPE_FRONTEND, "sweep_LL_sizes", "", "Last-level cache sizes to sweep",
+ "For -simulator_type " CACHE_SWEEP", a comma-separated list of last-level cache "
+ "sizes to evaluate, each of which may have a K, M, or G suffix.  If empty, "
+ "-LL_size is used.");
+
+droption_t<std::string> op_sweep_LL_assocs
+(DROPTION_SCOPE_FRONTEND, "sweep_LL_assocs", "",
+ "Last-level cache associativities to sweep",
+ "For -simulator_type " CACHE_SWEEP", a comma-separated list of last-level cache "
+ "associativities to evaluate.  If empty, -LL_assoc is used.");
+
 droption_t<bool> op_L0_filter
 (DROPTION_SCOPE_CLIENT, "L0_filter", false,
  "Filter out zero-level hits during tracing",
  "Filters out instruction and data hits in a 'zero-level' cache during tracing itself, "
  "shrinking the final trace to only contain instruction and data accesses that miss in "
- "this initial cache.  This cache is direct-mapped with sizes equal to -L0I_size and "
- "-L0D_size.  It uses virtual addresses regardless of -use_physical.");
+ "this initial cache.  This cache has sizes equal to -L0I_size and -L0D_size and is "
+ "direct-mapped unless -L0I_assoc or -L0D_assoc say otherwise.  It uses virtual "
+ "addresses regardless of -use_physical.");
 
 droption_t<bytesize_t> op_L0I_size
 (DROPTION_SCOPE_CLIENT, "L0I_size", 32*1024U,
  "If -L0_filter, filter out instruction hits during tracing",
  "Specifies the size of the 'zero-level' instruction cache for -L0_filter.  "
- "Must be a power of 2 and a multiple of -line_size, unless it is set to 0, "
+ "Must be a power of 2 and a multiple of -L0I_line_size, unless it is set to 0, "
  "which disables instruction fetch entries from appearing in the trace.");
 
 droption_t<bytesize_t> op_L0D_size
 (DROPTION_SCOPE_CLIENT, "L0D_size", 32*1024U,
  "If -L0_filter, filter out data hits during tracing",
  "Specifies the size of the 'zero-level' data cache for -L0_filter.  "
- "Must be a power of 2 and a multiple of -line_size, unless it is set to 0, "
+ "Must be a power of 2 and a multiple of -L0D_line_size, unless it is set to 0, "
  "which disables data entries from appearing in the trace.");
 
+droption_t<unsigned int> op_L0I_assoc
+(DROPTION_SCOPE_CLIENT, "L0I_assoc", 1,
+ "If -L0_filter, associativity of the instruction filter",
+ "Specifies the associativity of the 'zero-level' instruction cache for "
+ "-L0_filter.  Must be 1 (direct-mapped) or 2 (2-way set-associative with "
+ "least-recently-used replacement).");
+
+droption_t<unsigned int> op_L0D_assoc
+(DROPTION_SCOPE_CLIENT, "L0D_assoc", 1,
+ "If -L0_filter, associativity of the data filter",
+ "Specifies the associativity of the 'zero-level' data cache for -L0_filter.  "
+ "Must be 1 (direct-mapped) or 2 (2-way set-associative with least-recently-used "
+ "replacement).");
+
+droption_t<unsigned int> op_L0I_line_size
+(DROPTION_SCOPE_CLIENT, "L0I_line_size", 0,
+ "If -L0_filter, line size of the instruction filter",
+ "Specifies the line size of the 'zero-level' instruction cache for -L0_filter.  "
+ "Must be a power of 2.  If 0, -line_size is used.");
+
+droption_t<unsigned int> op_L0D_line_size
+(DROPTION_SCOPE_CLIENT, "L0D_line_size", 0,
+ "If -L0_filter, line size of the data filter",
+ "Specifies the line size of the 'zero-level' data cache for -L0_filter.  "
+ "Must be a power of 2.  If 0, -line_size is used.");
+
+droption_t<unsigned int> op_L0_counts
+(DROPTION_SCOPE_CLIENT, "L0_counts", 0,
+ "If -L0_filter, periodically record access counts of filtered lines",
+ "If non-zero, -L0_filter keeps a count of the accesses to each line resident in "
+ "its caches, hits included, and adds the non-zero counts to the trace after "
+ "every this many trace buffer outputs of a thread and at the thread's exit.  "
+ "Each count is recorded as a TRACE_MARKER_TYPE_FILTER_ILINE or "
+ "TRACE_MARKER_TYPE_FILTER_DLINE marker holding the line's address followed by a "
+ "TRACE_MARKER_TYPE_FILTER_COUNT marker holding the number of accesses since the "
+ "line was brought in or last recorded, whichever is later.  A line's count is "
+ "discarded when it is evicted.  For instructions, consecutive fetches from one "
+ "line within a basic block count as one access.");
+
+droption_t<bool> op_repstr_ranges
+(DROPTION_SCOPE_CLIENT, "repstr_ranges", false,
+ "Trace rep movs, stos, and lods as address ranges",
+ "By default, string loops are expanded into regular loops so that each iteration's "
+ "data reference is traced, which for large copies produces a long, dispatch-heavy "
+ "instruction sequence and one trace entry per element.  If this option is enabled, "
+ "the rep forms of movs, stos, and lods on x86 are left intact and each of their "
+ "memory operands is traced once per execution as a TRACE_MARKER_TYPE_MEMREF_RANGE "
+ "marker followed by one data reference.  The reader expands these into the "
+ "per-iteration references, so analysis tools see the same data references as "
+ "without this option, though only one instruction fetch per loop execution.  "
+ "Other string loops are still expanded.  This option is ignored with -L0_filter.");
+
+droption_t<bool> op_instr_only
+(DROPTION_SCOPE_CLIENT, "instr_only", false,
+ "Trace only the executed code, not its data references",
+ "For -offline, records only which basic blocks execute: each block costs a single "
+ "entry and no data addresses are collected, reducing tracing overhead for studies "
+ "of control flow or instruction fetch.  Post-processing reconstructs every "
+ "instruction fetch from the module code but produces no data references, and "
+ "begins each thread with a TRACE_MARKER_TYPE_INSTR_ONLY marker so that analysis "
+ "tools can tell that data references are absent rather than nonexistent.  Code "
+ "outside of modules cannot be reconstructed and is omitted.  This option cannot "
+ "be combined with -L0_filter and is ignored for online traces.");
+
 droption_t<bool> op_use_physical
 (DROPTION_SCOPE_CLIENT, "use_physical", false, "Use physical addresses if possible",
  "If available, the default virtual addresses will be translated to physical.  "
- "This is not possible from user mode on all platforms.");
+ "This is not possible from user mode on all platforms.  With -offline, the "
+ "tracer records each virtual-to-physical page mapping once per thread in the raw "
+ "files and raw2trace applies the mappings when producing the final trace.  "
+ "This is not supported in combination with -handoff_buf.");
 
 droption_t<unsigned int> op_virt2phys_freq
 (DROPTION_SCOPE_CLIENT, "virt2phys_freq", 0, "Frequency of physical mapping refresh",
@@ -152,7 +371,8 @@ droption_t<unsigned int> op_virt2phys_freq
  "without notice.  This option controls the frequency with which the cached value is "
  "ignored in order to re-access the actual mapping and ensure accurate results.  "
  "The units are the number of memory accesses per forced access.  A value of 0 "
- "uses the cached values for the entire application execution.");
+ "uses the cached values until the application unmaps, moves, or discards the "
+ "pages via munmap, mremap, or madvise, which always invalidates them.");
 
 droption_t<bool> op_cpu_scheduling
 (DROPTION_SCOPE_CLIENT, "cpu_scheduling", false,
@@ -163,6 +383,27 @@ droption_t<bool> op_cpu_scheduling
  "for scheduling, mapping traced cpu's to cores and running each segment of each thread "
  "on the core that owns the recorded cpu for that segment.");
 
+droption_t<bytesize_t> op_sched_quantum
+(DROPTION_SCOPE_FRONTEND, "sched_quantum", 0,
+ "Instructions a thread runs before yielding its core",
+ "When -infile is a directory of per-thread trace files and the tool needs a single "
+ "stream, the threads are scheduled onto -cores simulated cores: an idle core "
+ "runs the waiting thread with the earliest timestamp, the cores execute in lockstep "
+ "an instruction at a time, and a thread yields its core when it reaches a "
+ "timestamp later than that of a waiting thread.  If this option is non-zero, a "
+ "thread also yields its core after running this many instructions while another "
+ "thread is waiting.  The simulators follow this placement as with "
+ "-cpu_scheduling, which is implied.");
+
+droption_t<bool> op_sched_switch_flush
+(DROPTION_SCOPE_FRONTEND, "sched_switch_flush", false,
+ "Invalidate a core's L1 caches on each context switch",
+ "If enabled, whenever a core switches from one thread to another under "
+ "-cpu_scheduling or the scheduling of -sched_quantum, the cache simulator "
+ "invalidates that core's L1 instruction and data caches, approximating the "
+ "cache pollution of the switch and of the intervening kernel code.  This is "
+ "not supported with -sim_threads greater than 1.");
+
 droption_t<bytesize_t> op_max_trace_size
 (DROPTION_SCOPE_CLIENT, "max_trace_size", 0, "Cap on the raw trace size for each thread",
  "If non-zero, this sets a maximum size on the amount of raw trace data gathered "
@@ -170,6 +411,69 @@ droption_t<bytesize_t> op_max_trace_size
  "of one internal buffer.  Once reached, instrumentation continues for that thread, "
  "but no further data is recorded.");
 
+droption_t<unsigned int> op_async_writers
+(DROPTION_SCOPE_CLIENT, "async_writers", 0, "Number of background trace writer threads",
+ "If non-zero, for offline traces each full buffer is handed to one of this many "
+ "background threads which writes it out, while the application thread continues "
+ "with a fresh buffer.  The application thread only waits when its writer falls "
+ "-async_max_buffers behind.  This is ignored for online traces and when a buffer "
+ "handoff callback is registered via drmemtrace_buffer_handoff().");
+
+droption_t<unsigned int> op_async_max_buffers
+(DROPTION_SCOPE_CLIENT, "async_max_buffers", 8, "Buffers queued per -async_writers thread",
+ "For -async_writers, the number of full buffers each writer thread can have queued "
+ "before application threads handing it more buffers must wait.");
+
+droption_t<unsigned int> op_max_buffer_entries
+(DROPTION_SCOPE_CLIENT, "max_buffer_entries", 0, "Largest per-thread trace buffer",
+ "If non-zero, each thread's trace buffer adapts to how quickly the thread fills it.  "
+ "Every buffer starts out holding 4096 entries.  A buffer that fills up soon after "
+ "its prior write doubles in size, up to this many entries (rounded down to 4096 "
+ "times a power of two), so that hot threads pay for the tracer's clean call and "
+ "write less often.  A buffer that repeatedly holds little when it is written, as "
+ "for a mostly idle thread, halves in size again.  The total size of the buffers "
+ "is bounded by -buffer_memory_budget.  If zero, every buffer holds 4096 entries.");
+
+droption_t<bytesize_t> op_buffer_memory_budget
+(DROPTION_SCOPE_CLIENT, "buffer_memory_budget", 256*1024*1024,
+ "Cap on the growth of trace buffers",
+ "For -max_buffer_entries, the maximum combined size of the growth of all threads' "
+ "trace buffers beyond their initial 4096 entries.  A buffer does not grow once this "
+ "is reached until other buffers shrink or their threads exit.  Buffers queued for "
+ "-async_writers are not counted.");
+
+droption_t<bool> op_raw_compress
+(DROPTION_SCOPE_CLIENT, "raw_compress", false, "Compress offline raw files",
+ "For offline traces, compresses each buffer with the fastest zlib level before "
+ "writing it, producing per-thread files ending in .raw.gz which "
+ "the raw2trace post-processing reads directly.  This reduces the data written "
+ "several times over, which matters when storage bandwidth limits tracing.  "
+ "The compressed data is still written through any drmemtrace_replace_file_ops() "
+ "write function.  It is ignored with drmemtrace_buffer_handoff().  This requires "
+ "zlib.");
+
+droption_t<bool> op_offline_stream
+(DROPTION_SCOPE_CLIENT, "offline_stream", false, "Publish raw files as threads exit",
+ "For offline traces, writes each thread's raw file under a temporary name and "
+ "renames it to its final name as soon as the thread exits, first refreshing a copy "
+ "of the module list (modules.stream.log) that covers it.  A stream.done file is "
+ "created once tracing completes.  This allows drraw2trace -follow to convert the "
+ "finished threads while the application is still running.  It requires the default file functions: it is not supported with "
+ "drmemtrace_replace_file_ops() or drmemtrace_buffer_handoff().");
+
+droption_t<std::string> op_stream_to
+(DROPTION_SCOPE_CLIENT, "stream_to", "", "Send offline raw files to host:port",
+ "For offline traces on UNIX, sends the raw files over a TCP connection to a "
+ "drtrace_collector listening at this address instead of writing them locally, "
+ "where the host must be a numeric IPv4 or IPv6 address (IPv6 in brackets).  The "
+ "collector writes the files under its own -outdir in the same layout, for "
+ "conversion by drraw2trace.  Data is sent as it is written and is never buffered, "
+ "so a slow network or collector slows down the writing threads instead of growing "
+ "memory.  Combine with -async_writers to keep the application threads from "
+ "waiting on the network, within the memory bound of -async_max_buffers, and with "
+ "-raw_compress to reduce the data sent.  This cannot be combined with "
+ "-offline_stream, drmemtrace_replace_file_ops(), or drmemtrace_buffer_handoff().");
+
 droption_t<bytesize_t> op_trace_after_instrs
 (DROPTION_SCOPE_CLIENT, "trace_after_instrs", 0,
  "Do not start tracing until N instructions",
@@ -177,6 +481,64 @@ droption_t<bytesize_t> op_trace_after_instrs
  "executions are observed.  At that point, regular tracing is put into place.  Use "
  "-max_trace_size to set a limit on the subsequent trace length.");
 
+droption_t<bytesize_t> op_trace_for_instrs
+(DROPTION_SCOPE_CLIENT, "trace_for_instrs", 0,
+ "Stop tracing after N instructions",
+ "If non-zero, this causes tracing to be suspended after roughly this many traced "
+ "instructions, at which point only the cheap instruction counting used for "
+ "-trace_after_instrs remains in place.  Combine with -retrace_every_instrs to "
+ "periodically re-enable tracing.  Each traced window starts with a "
+ "TRACE_MARKER_TYPE_WINDOW_ID marker in each thread that executes in it.  The "
+ "count is only checked when a thread's trace buffer is written out, so windows "
+ "may exceed N by up to one buffer per thread.");
+
+droption_t<bytesize_t> op_retrace_every_instrs
+(DROPTION_SCOPE_CLIENT, "retrace_every_instrs", 0,
+ "Trace again after N untraced instructions",
+ "Used with -trace_for_instrs to trace in periodic bursts.  If non-zero, once "
+ "tracing is suspended by -trace_for_instrs it is resumed after this many further "
+ "untraced instructions, for another window of -trace_for_instrs instructions, and "
+ "so on.  If zero, tracing is not resumed.");
+
+droption_t<bool> op_trace_annotations
+(DROPTION_SCOPE_CLIENT, "trace_annotations", false,
+ "Trace only between annotations",
+ "If true, tracing starts out suspended and is only enabled between the "
+ "DRMEMTRACE_ANNOTATE_START_TRACING() and DRMEMTRACE_ANNOTATE_STOP_TRACING() "
+ "annotations from drmemtrace_annotations.h placed in the application's code.  "
+ "While suspended, only a cheap check remains in each block.  Each traced region "
+ "starts with a TRACE_MARKER_TYPE_WINDOW_ID marker in each thread that executes in "
+ "it.  This cannot be combined with -trace_after_instrs or -trace_for_instrs.  "
+ "Annotations are only supported on x86.");
+
+droption_t<bool> op_persistent_instru
+(DROPTION_SCOPE_CLIENT, "persistent_instru", false,
+ "Keep tracing instrumentation across -trace_annotations regions",
+ "By default, each -trace_annotations start or stop flushes the code cache so that "
+ "every block is re-instrumented for the new phase.  If this is true, the tracing "
+ "instrumentation is instead kept in place for the whole run and each block checks "
+ "a global gate to decide whether to record anything, avoiding the re-translation "
+ "cost for applications with many short regions.  The suspended phases are somewhat "
+ "slower than with the default mode.  For threads other than the one executing an "
+ "annotation, up to one buffer of entries may be attributed to the following window. "
+ " This requires -trace_annotations and cannot be combined with -L0_filter.  It is "
+ "only supported on x86.");
+
+droption_t<std::string> op_record_function
+(DROPTION_SCOPE_ALL, "record_function", "",
+ "Functions to mark in the trace",
+ "A list of functions to wrap, each given as its name and the number of its "
+ "arguments to record separated by '|', with entries separated by '&': for example, "
+ "\"malloc|1&free|1\".  Each function is looked up by name in every loaded library "
+ "(as an export or, with symbols available, any symbol) and each call is marked "
+ "in the trace with a TRACE_MARKER_TYPE_FUNC_ID marker holding the function's index "
+ "in this list, followed by its return address and arguments; its return is "
+ "marked with TRACE_MARKER_TYPE_FUNC_ID and TRACE_MARKER_TYPE_FUNC_RETVAL markers.  "
+ "At most 8 arguments per function are "
+ "supported.  Passing the same list to the simulator, including when analyzing an "
+ "offline trace, names the functions in the cache simulator's per-function "
+ "statistics.");
+
 droption_t<bytesize_t> op_exit_after_tracing
 (DROPTION_SCOPE_CLIENT, "exit_after_tracing", 0,
  "Exit the process after tracing N references",
@@ -192,16 +554,63 @@ droption_t<bool> op_online_instr_types
 
 droption_t<std::string> op_replace_policy
 (DROPTION_SCOPE_FRONTEND, "replace_policy", REPLACE_POLICY_LRU,
- "Cache replacement policy (LRU, LFU, FIFO)", "Specifies the replacement policy for "
+ "Cache replacement policy (LRU, LFU, FIFO, PLRU, BIT_PLRU, SRRIP, BRRIP)",
+ "Specifies the replacement policy for "
  "caches. Supported policies: LRU (Least Recently Used), LFU (Least Frequently Used), "
- "FIFO (First-In-First-Out).");
+ "FIFO (First-In-First-Out), PLRU (tree-based pseudo-LRU), BIT_PLRU (bit-based "
+ "pseudo-LRU, with one recently-used bit per way), SRRIP (Static Re-Reference "
+ "Interval Prediction), and BRRIP (Bimodal Re-Reference Interval Prediction).  "
+ "The pseudo-LRU and RRIP policies are what most current hardware implements, and "
+ "they update their state in constant time on a hit, making them faster to "
+ "simulate than LRU for highly associative caches.  PLRU and BIT_PLRU support "
+ "associativities of at most 32.");
 
 droption_t<std::string> op_data_prefetcher
 (DROPTION_SCOPE_FRONTEND, "data_prefetcher", PREFETCH_POLICY_NEXTLINE,
- "Hardware data prefetcher policy (nextline, none)", "Specifies the hardware data "
- "prefetcher policy.  The currently supported policies are 'nextline' (fetch the "
- "subsequent cache line) and 'none' (disables hardware prefetching).  The prefetcher "
- "is located between the L1D and LL caches.");
+ "Hardware data prefetcher policy (nextline, stride, stream, none)", "Specifies the "
+ "hardware data prefetcher policy.  The currently supported policies are 'nextline' "
+ "(fetch the subsequent cache line on a miss), 'stride' (track the stride between "
+ "accesses by each instruction and fetch along it once it repeats), 'stream' (detect "
+ "accesses to nearby lines moving in one direction and fetch ahead of them), and "
+ "'none' (disables hardware prefetching).  The prefetcher is located between the L1D "
+ "and LL caches.  When a prefetcher is enabled, the L1D statistics include its "
+ "accuracy, coverage, and the average number of demand accesses between a prefetch "
+ "and the first use of its line as a measure of timeliness.");
+
+droption_t<unsigned int> op_prefetch_degree
+(DROPTION_SCOPE_FRONTEND, "prefetch_degree", 1, "Lines fetched per prefetch trigger",
+ "Specifies how many cache lines the -data_prefetcher fetches each time it "
+ "triggers.");
+
+droption_t<unsigned int> op_prefetch_distance
+(DROPTION_SCOPE_FRONTEND, "prefetch_distance", 1, "How far ahead to prefetch",
+ "Specifies how far ahead of the triggering access, in lines for 'nextline' and "
+ "'stream' or in strides for 'stride', the first line fetched by the "
+ "-data_prefetcher is.");
+
+droption_t<bool> op_coherence
+(DROPTION_SCOPE_FRONTEND, "coherence", false, "Model cross-core write invalidations",
+ "If enabled, a data write by one core invalidates any copy of the written lines in "
+ "the L1D caches of the other cores, as a write-invalidate (MESI-style) coherence "
+ "protocol would.  Each L1D's statistics then include the number of such "
+ "invalidations it suffered, and the results end with the -report_top cache lines "
+ "and writing PCs that caused the most invalidations.  A line written at disjoint "
+ "bytes by more than one core is flagged as likely false sharing.  Threads are "
+ "mapped to cores as usual, so threads sharing a core never invalidate each other.  "
+ "This is not supported with -sim_threads greater than 1.");
+
+droption_t<bool> op_miss_hotspots
+(DROPTION_SCOPE_FRONTEND, "miss_hotspots", false, "Report the top missing PCs",
+ "If enabled, each cache counts its misses per PC and per aligned data region of "
+ "-miss_region_size bytes, and its statistics end with the -report_top PCs and "
+ "regions with the most misses.  This finds miss hotspots in a single pass without "
+ "writing and post-processing an -LL_miss_file.");
+
+droption_t<bytesize_t> op_miss_region_size
+(DROPTION_SCOPE_FRONTEND, "miss_region_size", bytesize_t(4*1024),
+ "Data region size for -miss_hotspots",
+ "Specifies the size in bytes, a power of 2, of the aligned data regions whose "
+ "misses are counted by -miss_hotspots.");
 
 droption_t<bytesize_t> op_page_size
 (DROPTION_SCOPE_FRONTEND, "page_size", bytesize_t(4*1024), "Virtual/physical page size",
@@ -236,13 +645,116 @@ droption_t<std::string> op_TLB_replace_policy
  "TLB replacement policy", "Specifies the replacement policy for TLBs. "
  "Supported policies: LFU (Least Frequently Used).");
 
+droption_t<std::string> op_TLB_page_policy
+(DROPTION_SCOPE_FRONTEND, "TLB_page_policy", TLB_PAGE_POLICY_BASE,
+ "Which page size backs each address", "Specifies how huge pages are modeled.  '"
+ TLB_PAGE_POLICY_BASE "' maps every address with -page_size pages.  '"
+ TLB_PAGE_POLICY_THP "' models transparent huge pages: code stays on base pages "
+ "while data in each aligned 2MB region moves to a 2MB page once -TLB_thp_threshold "
+ "of its distinct 4KB pages have been touched.  '" TLB_PAGE_POLICY_MAP "' reads the "
+ "page size of each address range from -TLB_page_map.  With huge pages each TLB "
+ "holds a separate entry array per page size, as hardware does, sized by the "
+ "-TLB_*_2M_* and -TLB_*_1G_* options, and the results list each array's hit rates "
+ "and the page walks (misses in the last TLB level present for a page size) per "
+ "core.");
+
+droption_t<std::string> op_TLB_page_map
+(DROPTION_SCOPE_FRONTEND, "TLB_page_map", "", "Page size region map file",
+ "For -TLB_page_policy " TLB_PAGE_POLICY_MAP ", a text file whose lines each hold a "
+ "start address, an exclusive end address, and a page size of 4K, 2M, or 1G.  Text "
+ "after '#' is ignored.  Each region must be aligned to its page size, and addresses "
+ "outside every region use base pages.");
+
+droption_t<unsigned int> op_TLB_thp_threshold
+(DROPTION_SCOPE_FRONTEND, "TLB_thp_threshold", 1, "Pages touched before promotion",
+ "For -TLB_page_policy " TLB_PAGE_POLICY_THP ", the number of distinct 4KB pages "
+ "of an aligned 2MB data region that must be touched before the region is backed by "
+ "a 2MB page.  A value of 1 backs all data with 2MB pages.");
+
+droption_t<unsigned int> op_TLB_L1I_2M_entries
+(DROPTION_SCOPE_FRONTEND, "TLB_L1I_2M_entries", 8, "Number of 2M entries in L1I TLB",
+ "Specifies the number of 2M page entries in each L1 instruction TLB.  Must be a power "
+ "of 2, or 0 for no separate array, in which case those pages are looked up in the "
+ "next level (or walked).  Only used with huge pages (see -TLB_page_policy).");
+
+droption_t<unsigned int> op_TLB_L1I_2M_assoc
+(DROPTION_SCOPE_FRONTEND, "TLB_L1I_2M_assoc", 8, "L1I TLB 2M associativity",
+ "Specifies the associativity of the 2M page entries in each L1 instruction TLB.  Must "
+ "be a power of 2.");
+
+droption_t<unsigned int> op_TLB_L1D_2M_entries
+(DROPTION_SCOPE_FRONTEND, "TLB_L1D_2M_entries", 32, "Number of 2M entries in data TLB",
+ "Specifies the number of 2M page entries in each L1 data TLB.  Must be a power of 2, "
+ "or 0 for no separate array, in which case those pages are looked up in the next "
+ "level (or walked).  Only used with huge pages (see -TLB_page_policy).");
+
+droption_t<unsigned int> op_TLB_L1D_2M_assoc
+(DROPTION_SCOPE_FRONTEND, "TLB_L1D_2M_assoc", 4, "Data TLB 2M associativity",
+ "Specifies the associativity of the 2M page entries in each L1 data TLB.  Must be a "
+ "power of 2.");
+
+droption_t<unsigned int> op_TLB_L2_2M_entries
+(DROPTION_SCOPE_FRONTEND, "TLB_L2_2M_entries", 1024, "Number of 2M entries in L2 TLB",
+ "Specifies the number of 2M page entries in each unified L2 TLB.  Must be a power of "
+ "2, or 0 for no separate array, in which case those pages are looked up in the next "
+ "level (or walked).  Only used with huge pages (see -TLB_page_policy).");
+
+droption_t<unsigned int> op_TLB_L2_2M_assoc
+(DROPTION_SCOPE_FRONTEND, "TLB_L2_2M_assoc", 4, "L2 TLB 2M associativity",
+ "Specifies the associativity of the 2M page entries in each unified L2 TLB.  Must be "
+ "a power of 2.");
+
+droption_t<unsigned int> op_TLB_L1I_1G_entries
+(DROPTION_SCOPE_FRONTEND, "TLB_L1I_1G_entries", 0, "Number of 1G entries in L1I TLB",
+ "Specifies the number of 1G page entries in each L1 instruction TLB.  Must be a power "
+ "of 2, or 0 for no separate array, in which case those pages are looked up in the "
+ "next level (or walked).  Only used with huge pages (see -TLB_page_policy).");
+
+droption_t<unsigned int> op_TLB_L1I_1G_assoc
+(DROPTION_SCOPE_FRONTEND, "TLB_L1I_1G_assoc", 0, "L1I TLB 1G associativity",
+ "Specifies the associativity of the 1G page entries in each L1 instruction TLB.  Must "
+ "be a power of 2.");
+
+droption_t<unsigned int> op_TLB_L1D_1G_entries
+(DROPTION_SCOPE_FRONTEND, "TLB_L1D_1G_entries", 4, "Number of 1G entries in data TLB",
+ "Specifies the number of 1G page entries in each L1 data TLB.  Must be a power of 2, "
+ "or 0 for no separate array, in which case those pages are looked up in the next "
+ "level (or walked).  Only used with huge pages (see -TLB_page_policy).");
+
+droption_t<unsigned int> op_TLB_L1D_1G_assoc
+(DROPTION_SCOPE_FRONTEND, "TLB_L1D_1G_assoc", 4, "Data TLB 1G associativity",
+ "Specifies the associativity of the 1G page entries in each L1 data TLB.  Must be a "
+ "power of 2.");
+
+droption_t<unsigned int> op_TLB_L2_1G_entries
+(DROPTION_SCOPE_FRONTEND, "TLB_L2_1G_entries", 16, "Number of 1G entries in L2 TLB",
+ "Specifies the number of 1G page entries in each unified L2 TLB.  Must be a power of "
+ "2, or 0 for no separate array, in which case those pages are looked up in the next "
+ "level (or walked).  Only used with huge pages (see -TLB_page_policy).");
+
+droption_t<unsigned int> op_TLB_L2_1G_assoc
+(DROPTION_SCOPE_FRONTEND, "TLB_L2_1G_assoc", 4, "L2 TLB 1G associativity",
+ "Specifies the associativity of the 1G page entries in each unified L2 TLB.  Must be "
+ "a power of 2.");
+
 droption_t<std::string> op_simulator_type
 (DROPTION_SCOPE_FRONTEND, "simulator_type", CPU_CACHE,
- "Simulator type (" CPU_CACHE", " TLB", " REUSE_DIST", " REUSE_TIME", "
- HISTOGRAM", or " BASIC_COUNTS").",
+ "Simulator type (" CPU_CACHE", " CACHE_SWEEP", " TLB", " REUSE_DIST", " REUSE_TIME
+ ", " HISTOGRAM", " WORKING_SET", " REGIONS", " INVARIANT_CHECKER", " TRACE_SLICE
+ ", or " BASIC_COUNTS").",
  "Specifies the type of the simulator. "
- "Supported types: " CPU_CACHE", " TLB", " REUSE_DIST", " REUSE_TIME", " HISTOGRAM
- "or " BASIC_COUNTS".");
+ "Supported types: " CPU_CACHE", " CACHE_SWEEP", " TLB", " REUSE_DIST", " REUSE_TIME
+ ", " HISTOGRAM", " WORKING_SET", " REGIONS", " INVARIANT_CHECKER", " TRACE_SLICE
+ ", or " BASIC_COUNTS".  The " CACHE_SWEEP" type simulates every "
+ "combination of -sweep_L1D_sizes, -sweep_LL_sizes, and -sweep_LL_assocs in a single "
+ "pass, using -sim_threads worker threads, and prints a table of miss rates.  With "
+ "LRU replacement it evaluates all of the last-level caches for each L1 data cache "
+ "size at once using per-set LRU stack distances; as this models exact LRU it can "
+ "differ slightly from -simulator_type " CPU_CACHE", whose LRU breaks some recency "
+ "ties by way index.  A comma-separated list of types, such as \"" CPU_CACHE","
+ TLB"\", runs all of them in a single pass over the trace, with their results "
+ "printed in turn.  When threads are scheduled onto cores (see -cpu_scheduling), "
+ "every simulator in the list follows the same schedule.");
 
 droption_t<unsigned int> op_verbose
 (DROPTION_SCOPE_ALL, "verbose", 0, 0, 64, "Verbosity level",
@@ -282,6 +794,14 @@ droption_t<bytesize_t> op_skip_refs
  "in the beginning of the application execution. "
  "These memory references are dropped instead of being simulated.");
 
+droption_t<bytesize_t> op_skip_instrs
+(DROPTION_SCOPE_FRONTEND, "skip_instrs", 0,
+ "Number of instructions to fast-forward over",
+ "Specifies the number of instructions to skip in the beginning of the trace "
+ "before any analysis takes place.  Unlike -skip_refs, the skipped records are never "
+ "presented to the tools, which makes skipping much faster.  When -infile is a "
+ "directory of per-thread trace files, the count applies to each thread separately.");
+
 droption_t<bytesize_t> op_warmup_refs
 (DROPTION_SCOPE_FRONTEND, "warmup_refs", 0,
  "Number of memory references to warm caches up",
@@ -297,6 +817,44 @@ droption_t<double> op_warmup_fraction
  "is computed after the skipped references and before simulated references. "
  "This flag is incompatible with warmup_refs.");
 
+droption_t<std::string> op_warmup_save_file
+(DROPTION_SCOPE_FRONTEND, "warmup_save_file", "",
+ "Path for saving the warmed-up cache or TLB state",
+ "If non-empty, when -warmup_refs or -warmup_fraction completes, the cache or TLB "
+ "simulator writes the contents and replacement state of every cache or TLB, along "
+ "with the mapping of threads to cores, to a file at this path.  A later run over "
+ "the same trace can pass the file to -warmup_load_file, with -skip_refs set to "
+ "the skipped plus warmup references of this run, to start measuring immediately.  "
+ "Statistics and hardware prefetcher training state are not saved.  This is not "
+ "supported with -sim_threads greater than 1.");
+
+droption_t<std::string> op_warmup_load_file
+(DROPTION_SCOPE_FRONTEND, "warmup_load_file", "",
+ "Path for loading a warmed-up cache or TLB state",
+ "If non-empty, the cache or TLB simulator starts from the state saved by "
+ "-warmup_save_file at this path instead of from empty caches and is considered "
+ "to be warmed up from the first reference.  The simulated cache or TLB "
+ "configuration must match the one that saved the file.  This is incompatible "
+ "with -warmup_refs and -warmup_fraction.");
+
+droption_t<std::string> op_stats_file
+(DROPTION_SCOPE_FRONTEND, "stats_file", "",
+ "Path for periodic cache or TLB statistics",
+ "If non-empty, the cache or TLB simulator writes the hit and miss counts of every "
+ "cache or TLB to this file in CSV format after every -stats_interval simulated "
+ "references, and once more at the end.  The first column holds the number of "
+ "references simulated so far and the header names the other columns.  The counts "
+ "are cumulative from the end of any warmup, so the miss rates of any window are "
+ "given by the difference between two rows.  Each row is flushed when written, so "
+ "the file can be followed while the simulation runs.  This is not supported "
+ "with -sim_threads greater than 1.");
+
+droption_t<bytesize_t> op_stats_interval
+(DROPTION_SCOPE_FRONTEND, "stats_interval", bytesize_t(10000000),
+ "Simulated references between -stats_file snapshots",
+ "Specifies how many simulated references separate the rows written to "
+ "-stats_file.");
+
 droption_t<bytesize_t> op_sim_refs
 (DROPTION_SCOPE_FRONTEND, "sim_refs", bytesize_t(1ULL << 63),
  "Number of memory references to simulate",
@@ -310,6 +868,15 @@ droption_t<unsigned int> op_report_top
  "Number of top results to be reported",
  "Specifies the number of top results to be reported.");
 
+droption_t<bool> op_symbolize_reports
+(DROPTION_SCOPE_FRONTEND, "symbolize_reports", false,
+ "Symbolize the addresses in top-N reports",
+ "For offline traces, appends the module, symbol, and source line of each address "
+ "listed in the top cache lines and PCs of the cache simulator's -coherence report "
+ "and of the reuse distance tool's report.  This needs the modules.log file (see "
+ "-module_file) and the libraries and binary from the traced execution at their "
+ "original paths.  The lookups are batched per module when the report is printed.");
+
 // XXX: if we separate histogram + reuse_distance we should move these with them.
 droption_t<unsigned int> op_reuse_distance_threshold
 (DROPTION_SCOPE_FRONTEND, "reuse_distance_threshold", 100,
@@ -317,6 +884,20 @@ droption_t<unsigned int> op_reuse_distance_threshold
  "Specifies the reuse distance threshold for reporting the distant repeated references. "
  "A reference is a distant repeated reference if the distance to the previous reference"
  " on the same cache line exceeds the threshold.");
+droption_t<double> op_reuse_sampling_rate
+(DROPTION_SCOPE_FRONTEND, "reuse_sampling_rate", 1.0, 0.0, 1.0,
+ "Fraction of cache lines to sample for reuse distance.",
+ "If less than 1, the reuse distance tool only tracks the cache lines whose hashed "
+ "tags fall within this fraction of the hash space and scales the distances and "
+ "counts it reports by the sampling rate.  This estimates the results of the full "
+ "analysis at a fraction of the time and memory.  The rate is lowered as needed to "
+ "keep the number of tracked lines within -reuse_sampling_max_lines.");
+droption_t<unsigned int> op_reuse_sampling_max_lines
+(DROPTION_SCOPE_FRONTEND, "reuse_sampling_max_lines", 64*1024,
+ "Maximum cache lines tracked when sampling reuse distance.",
+ "When -reuse_sampling_rate is less than 1, bounds the number of cache lines the "
+ "reuse distance tool tracks, so that its memory use does not grow with the "
+ "footprint of the application.");
 droption_t<bool> op_reuse_distance_histogram
 (DROPTION_SCOPE_FRONTEND, "reuse_distance_histogram", false,
  "Print the entire reuse distance histogram.",
@@ -333,3 +914,128 @@ droption_t<bool> op_reuse_verify_skip
  "Verifies every skip list-calculated reuse distance with a full list walk. "
  "This incurs significant additional overhead.  This option is only available "
  "in debug builds.");
+droption_t<bool> op_reuse_distance_tree
+(DROPTION_SCOPE_FRONTEND, "reuse_distance_tree", false,
+ "Compute reuse distances with a tree instead of the skip list.",
+ "Computes each reuse distance in time logarithmic in the number of unique cache "
+ "lines using a Fenwick tree, in place of the skip list whose cost grows with the "
+ "distance.  The results are identical.  This is much faster for large working "
+ "sets, at the cost of some extra memory per cache line.  -reuse_skip_dist is "
+ "ignored when this is enabled.");
+droption_t<unsigned int> op_reuse_time_max_lines
+(DROPTION_SCOPE_FRONTEND, "reuse_time_max_lines", 0,
+ "Bound on the cache lines tracked by the reuse time tool.",
+ "If non-zero, the reuse time tool only remembers the cache lines accessed within "
+ "this many most recent accesses, so its memory use does not grow with the footprint "
+ "of the application.  Longer reuses are reported together with first accesses, and "
+ "reuse times of 1024 and above are histogrammed in power-of-2 buckets.  The mean "
+ "reuse time remains exact over the reuses that are seen.");
+droption_t<bytesize_t> op_reuse_time_window
+(DROPTION_SCOPE_FRONTEND, "reuse_time_window", 0,
+ "Accesses per reuse time window.",
+ "If non-zero, the reuse time tool also reports the mean reuse time and a power-of-2 "
+ "reuse time histogram for each window of this many accesses, to show how reuse "
+ "changes across program phases.");
+
+droption_t<bytesize_t> op_working_set_window
+(DROPTION_SCOPE_FRONTEND, "working_set_window", bytesize_t(1000000),
+ "Number of references in each working set window.",
+ "The working set tool reports the estimated number of unique cache lines and pages "
+ "touched in each successive window of this many memory references, along with the "
+ "estimated totals so far, giving footprint curves over the execution.");
+droption_t<unsigned int> op_working_set_precision
+(DROPTION_SCOPE_FRONTEND, "working_set_precision", 12,
+ "Log2 of the registers in each working set sketch.",
+ "The working set tool estimates each footprint with a HyperLogLog sketch of "
+ "2^precision one-byte registers, whose standard error is about 1.04 divided by the "
+ "square root of the number of registers: 1.6% for the default of 12.  Each thread "
+ "uses four sketches.  Must be between 7 and 16.");
+
+droption_t<bytesize_t> op_regions_interval
+(DROPTION_SCOPE_FRONTEND, "regions_interval", bytesize_t(10000000),
+ "Number of instructions in each regions tool interval.",
+ "The regions tool splits the trace into intervals of this many instructions, "
+ "computes a basic block vector for each, and clusters the vectors into phases.");
+droption_t<unsigned int> op_regions_max_clusters
+(DROPTION_SCOPE_FRONTEND, "regions_max_clusters", 10,
+ "Maximum number of phases for the regions tool.",
+ "The regions tool groups the intervals into at most this many phases and picks "
+ "one representative interval from each, weighted by the share of the "
+ "instructions in its phase.");
+droption_t<std::string> op_regions_file
+(DROPTION_SCOPE_FRONTEND, "regions_file", "",
+ "Path of the representative regions file.",
+ "For -simulator_type " REGIONS", the file to write the representative intervals "
+ "to.  For the " CPU_CACHE" and " TLB" simulators, a file written by the regions tool "
+ "over the same trace: only the intervals it lists, each preceded by "
+ "-regions_warmup instructions of warmup, are simulated, and the miss rates are "
+ "also reported per cache or TLB weighted by the interval weights.  Instructions "
+ "outside of the regions are fast-forwarded over when the simulator is the only "
+ "tool.  This replaces -skip_refs, -warmup_refs, -warmup_fraction, and "
+ "-warmup_load_file, and is not supported with -sim_threads.  As the regions are "
+ "identified by instruction counts, -skip_instrs must match the value passed to "
+ "the regions tool.");
+droption_t<bytesize_t> op_regions_warmup
+(DROPTION_SCOPE_FRONTEND, "regions_warmup", bytesize_t(1000000),
+ "Instructions of warmup before each region.",
+ "With -regions_file, the cache or TLB simulator simulates this many instructions "
+ "before each region, without counting them in the region results, to warm up the "
+ "caches or TLBs.");
+
+droption_t<unsigned int> op_invariant_reports
+(DROPTION_SCOPE_FRONTEND, "invariant_reports", 10,
+ "Number of violations the invariant checker lists.",
+ "The invariant checker counts every violation it finds but only lists this many, "
+ "with their thread and their record and instruction positions within the thread.  "
+ "The checker analyzes the threads in parallel when -infile is a directory of "
+ "per-thread trace files, and its results fail if any violation is found, so it "
+ "can validate a large trace before spending the time to simulate it.  Checking "
+ "instruction continuity is not meaningful for filtered traces.");
+
+droption_t<std::string> op_slice_file
+(DROPTION_SCOPE_FRONTEND, "slice_file", "", "Path of the trace slice to write.",
+ "For -simulator_type " TRACE_SLICE", the offline trace file to write the selected "
+ "parts of the trace to.  The selected records are those that pass all of "
+ "-slice_tids, -slice_time_start and -slice_time_end, -slice_instr_start and "
+ "-slice_instr_end, and -slice_pc_ranges; the data references of an instruction "
+ "are selected along with it.  The result is a valid trace, with the threads "
+ "interleaved as they were read, which can be passed as -infile to any tool.");
+droption_t<std::string> op_slice_tids
+(DROPTION_SCOPE_FRONTEND, "slice_tids", "", "Threads to keep in the trace slice.",
+ "For -simulator_type " TRACE_SLICE", a comma-separated list of the thread ids to "
+ "keep.  If empty, all threads are kept.");
+droption_t<bytesize_t> op_slice_time_start
+(DROPTION_SCOPE_FRONTEND, "slice_time_start", 0,
+ "First timestamp to keep in the trace slice.",
+ "For -simulator_type " TRACE_SLICE", the records of each thread are only kept "
+ "once the thread's most recent timestamp marker is at least this value.");
+droption_t<bytesize_t> op_slice_time_end
+(DROPTION_SCOPE_FRONTEND, "slice_time_end", 0,
+ "Timestamp at which to stop the trace slice.",
+ "For -simulator_type " TRACE_SLICE", the records of each thread are no longer kept "
+ "once the thread's most recent timestamp marker is at least this value.  "
+ "0 means no end.");
+droption_t<bytesize_t> op_slice_instr_start
+(DROPTION_SCOPE_FRONTEND, "slice_instr_start", 0,
+ "First instruction to keep in the trace slice.",
+ "For -simulator_type " TRACE_SLICE", records are only kept starting with the "
+ "instruction with this ordinal, counting every instruction in the trace from 0 in "
+ "the order they are read.");
+droption_t<bytesize_t> op_slice_instr_end
+(DROPTION_SCOPE_FRONTEND, "slice_instr_end", 0,
+ "Instruction at which to stop the trace slice.",
+ "For -simulator_type " TRACE_SLICE", records are no longer kept starting with the "
+ "instruction with this ordinal.  0 means no end.");
+droption_t<std::string> op_slice_pc_ranges
+(DROPTION_SCOPE_FRONTEND, "slice_pc_ranges", "",
+ "Instruction address ranges to keep in the trace slice.",
+ "For -simulator_type " TRACE_SLICE", a comma-separated list of start-end pairs of "
+ "hexadecimal addresses, each selecting the instructions in [start, end).  A module "
+ "can be selected using its address range from modules.log.  If empty, "
+ "instructions at all addresses are kept.");
+droption_t<unsigned int> op_slice_chunk_entries
+(DROPTION_SCOPE_FRONTEND, "slice_chunk_entries", 0,
+ "Entries per chunk for a chunked trace slice.",
+ "For -simulator_type " TRACE_SLICE", if non-zero, the trace slice is written in "
+ "the compressed and indexed chunked format, with this many entries in each chunk.  "
+ "Otherwise it is written uncompressed.");
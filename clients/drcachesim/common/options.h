@@ -39,23 +39,45 @@
 #define REPLACE_POLICY_LRU                      "LRU"
 #define REPLACE_POLICY_LFU                      "LFU"
 #define REPLACE_POLICY_FIFO                     "FIFO"
+#define REPLACE_POLICY_PLRU                     "PLRU"
+#define REPLACE_POLICY_BIT_PLRU                 "BIT_PLRU"
+#define REPLACE_POLICY_SRRIP                    "SRRIP"
+#define REPLACE_POLICY_BRRIP                    "BRRIP"
+#define TLB_PAGE_POLICY_BASE                    "base"
+#define TLB_PAGE_POLICY_THP                     "thp"
+#define TLB_PAGE_POLICY_MAP                     "map"
 #define PREFETCH_POLICY_NEXTLINE                "nextline"
+#define PREFETCH_POLICY_STRIDE                  "stride"
+#define PREFETCH_POLICY_STREAM                  "stream"
 #define PREFETCH_POLICY_NONE                    "none"
 #define CPU_CACHE                               "cache"
+#define CACHE_SWEEP                             "cache_sweep"
 #define TLB                                     "TLB"
 #define HISTOGRAM                               "histogram"
 #define REUSE_DIST                              "reuse_distance"
 #define REUSE_TIME                              "reuse_time"
 #define BASIC_COUNTS                            "basic_counts"
 #define OPCODE_MIX                              "opcode_mix"
+#define WORKING_SET                             "working_set"
+#define REGIONS                                 "regions"
+#define INVARIANT_CHECKER                       "invariant_checker"
+#define TRACE_SLICE                             "trace_slice"
 
 #include <string>
 #include "droption.h"
 
 extern droption_t<bool> op_offline;
 extern droption_t<std::string> op_ipc_name;
+extern droption_t<bool> op_ipc_ring;
+extern droption_t<unsigned int> op_ipc_ring_slots;
+extern droption_t<bytesize_t> op_ipc_ring_slot_size;
 extern droption_t<std::string> op_outdir;
 extern droption_t<std::string> op_infile;
+extern droption_t<unsigned int> op_jobs;
+extern droption_t<std::string> op_only_threads;
+extern droption_t<bool> op_per_process;
+extern droption_t<bool> op_online_shards;
+extern droption_t<unsigned int> op_sim_threads;
 extern droption_t<std::string> op_indir;
 extern droption_t<std::string> op_module_file;
 extern droption_t<unsigned int> op_num_cores;
@@ -66,19 +88,58 @@ extern droption_t<unsigned int> op_L1I_assoc;
 extern droption_t<unsigned int> op_L1D_assoc;
 extern droption_t<bytesize_t> op_LL_size;
 extern droption_t<unsigned int> op_LL_assoc;
+extern droption_t<std::string> op_config_file;
+extern droption_t<unsigned int> op_L1_latency;
+extern droption_t<unsigned int> op_LL_latency;
+extern droption_t<unsigned int> op_memory_latency;
+extern droption_t<bool> op_timing;
+extern droption_t<double> op_timing_base_cpi;
+extern droption_t<unsigned int> op_timing_rob_size;
+extern droption_t<unsigned int> op_timing_mlp;
+extern droption_t<double> op_memory_bandwidth;
 extern droption_t<std::string> op_LL_miss_file;
+extern droption_t<std::string> op_LL_miss_format;
+extern droption_t<std::string> op_sweep_L1D_sizes;
+extern droption_t<std::string> op_sweep_LL_sizes;
+extern droption_t<std::string> op_sweep_LL_assocs;
 extern droption_t<bytesize_t> op_L0I_size;
 extern droption_t<bool> op_L0_filter;
 extern droption_t<bytesize_t> op_L0D_size;
+extern droption_t<unsigned int> op_L0I_assoc;
+extern droption_t<unsigned int> op_L0D_assoc;
+extern droption_t<unsigned int> op_L0I_line_size;
+extern droption_t<unsigned int> op_L0D_line_size;
+extern droption_t<unsigned int> op_L0_counts;
+extern droption_t<bool> op_repstr_ranges;
+extern droption_t<bool> op_instr_only;
 extern droption_t<bool> op_use_physical;
 extern droption_t<unsigned int> op_virt2phys_freq;
 extern droption_t<bool> op_cpu_scheduling;
+extern droption_t<bytesize_t> op_sched_quantum;
+extern droption_t<bool> op_sched_switch_flush;
 extern droption_t<bytesize_t> op_max_trace_size;
+extern droption_t<unsigned int> op_async_writers;
+extern droption_t<unsigned int> op_async_max_buffers;
+extern droption_t<unsigned int> op_max_buffer_entries;
+extern droption_t<bytesize_t> op_buffer_memory_budget;
+extern droption_t<bool> op_raw_compress;
+extern droption_t<bool> op_offline_stream;
+extern droption_t<std::string> op_stream_to;
 extern droption_t<bytesize_t> op_trace_after_instrs;
+extern droption_t<bytesize_t> op_trace_for_instrs;
+extern droption_t<bytesize_t> op_retrace_every_instrs;
+extern droption_t<bool> op_trace_annotations;
+extern droption_t<bool> op_persistent_instru;
+extern droption_t<std::string> op_record_function;
 extern droption_t<bytesize_t> op_exit_after_tracing;
 extern droption_t<bool> op_online_instr_types;
 extern droption_t<std::string> op_replace_policy;
 extern droption_t<std::string> op_data_prefetcher;
+extern droption_t<unsigned int> op_prefetch_degree;
+extern droption_t<unsigned int> op_prefetch_distance;
+extern droption_t<bool> op_coherence;
+extern droption_t<bool> op_miss_hotspots;
+extern droption_t<bytesize_t> op_miss_region_size;
 extern droption_t<bytesize_t> op_page_size;
 extern droption_t<unsigned int> op_TLB_L1I_entries;
 extern droption_t<unsigned int> op_TLB_L1D_entries;
@@ -87,6 +148,21 @@ extern droption_t<unsigned int> op_TLB_L1D_assoc;
 extern droption_t<unsigned int> op_TLB_L2_entries;
 extern droption_t<unsigned int> op_TLB_L2_assoc;
 extern droption_t<std::string> op_TLB_replace_policy;
+extern droption_t<std::string> op_TLB_page_policy;
+extern droption_t<std::string> op_TLB_page_map;
+extern droption_t<unsigned int> op_TLB_thp_threshold;
+extern droption_t<unsigned int> op_TLB_L1I_2M_entries;
+extern droption_t<unsigned int> op_TLB_L1I_2M_assoc;
+extern droption_t<unsigned int> op_TLB_L1D_2M_entries;
+extern droption_t<unsigned int> op_TLB_L1D_2M_assoc;
+extern droption_t<unsigned int> op_TLB_L2_2M_entries;
+extern droption_t<unsigned int> op_TLB_L2_2M_assoc;
+extern droption_t<unsigned int> op_TLB_L1I_1G_entries;
+extern droption_t<unsigned int> op_TLB_L1I_1G_assoc;
+extern droption_t<unsigned int> op_TLB_L1D_1G_entries;
+extern droption_t<unsigned int> op_TLB_L1D_1G_assoc;
+extern droption_t<unsigned int> op_TLB_L2_1G_entries;
+extern droption_t<unsigned int> op_TLB_L2_1G_assoc;
 extern droption_t<std::string> op_simulator_type;
 extern droption_t<unsigned int> op_verbose;
 #ifdef DEBUG
@@ -98,12 +174,38 @@ extern droption_t<std::string> op_dr_ops;
 extern droption_t<std::string> op_tracer;
 extern droption_t<std::string> op_tracer_ops;
 extern droption_t<bytesize_t> op_skip_refs;
+extern droption_t<bytesize_t> op_skip_instrs;
 extern droption_t<bytesize_t> op_warmup_refs;
 extern droption_t<double> op_warmup_fraction;
+extern droption_t<std::string> op_warmup_save_file;
+extern droption_t<std::string> op_warmup_load_file;
+extern droption_t<std::string> op_stats_file;
+extern droption_t<bytesize_t> op_stats_interval;
 extern droption_t<bytesize_t> op_sim_refs;
 extern droption_t<unsigned int> op_report_top;
+extern droption_t<bool> op_symbolize_reports;
 extern droption_t<unsigned int> op_reuse_distance_threshold;
 extern droption_t<bool> op_reuse_distance_histogram;
 extern droption_t<unsigned int> op_reuse_skip_dist;
 extern droption_t<bool> op_reuse_verify_skip;
+extern droption_t<bool> op_reuse_distance_tree;
+extern droption_t<double> op_reuse_sampling_rate;
+extern droption_t<unsigned int> op_reuse_sampling_max_lines;
+extern droption_t<unsigned int> op_reuse_time_max_lines;
+extern droption_t<bytesize_t> op_reuse_time_window;
+extern droption_t<bytesize_t> op_working_set_window;
+extern droption_t<unsigned int> op_working_set_precision;
+extern droption_t<bytesize_t> op_regions_interval;
+extern droption_t<unsigned int> op_regions_max_clusters;
+extern droption_t<std::string> op_regions_file;
+extern droption_t<bytesize_t> op_regions_warmup;
+extern droption_t<unsigned int> op_invariant_reports;
+extern droption_t<std::string> op_slice_file;
+extern droption_t<std::string> op_slice_tids;
+extern droption_t<bytesize_t> op_slice_time_start;
+extern droption_t<bytesize_t> op_slice_time_end;
+extern droption_t<bytesize_t> op_slice_instr_start;
+extern droption_t<bytesize_t> op_slice_instr_end;
+extern droption_t<std::string> op_slice_pc_ranges;
+extern droption_t<unsigned int> op_slice_chunk_entries;
 #endif /* _OPTIONS_H_ */
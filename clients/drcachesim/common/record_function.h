@@ -0,0 +1,82 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* record_function: parsing of the -record_function list, shared by the tracer,
+ * which wraps the functions, and the simulators, which name them.
+ */
+
+#ifndef _RECORD_FUNCTION_H_
+#define _RECORD_FUNCTION_H_ 1
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// The most arguments recorded for one function.
+#define RECORD_FUNCTION_MAX_ARGS 8
+
+struct record_function_t {
+    std::string name;
+    int num_args;
+};
+
+// Parses a list of "name|num_args" entries separated by '&' into funcs, in order,
+// so that each function's identifier is its index.  Returns false on a malformed
+// entry.
+static inline bool
+parse_record_function_list(const std::string &list,
+                           std::vector<record_function_t> *funcs)
+{
+    funcs->clear();
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find('&', pos);
+        if (end == std::string::npos)
+            end = list.size();
+        std::string entry = list.substr(pos, end - pos);
+        size_t sep = entry.find('|');
+        if (sep == 0 || sep == std::string::npos || sep + 1 == entry.size())
+            return false;
+        char *num_end;
+        long num_args = strtol(entry.c_str() + sep + 1, &num_end, 10);
+        if (*num_end != '\0' || num_args < 0 || num_args > RECORD_FUNCTION_MAX_ARGS)
+            return false;
+        record_function_t func;
+        func.name = entry.substr(0, sep);
+        func.num_args = (int)num_args;
+        funcs->push_back(func);
+        pos = end + 1;
+    }
+    return true;
+}
+
+#endif /* _RECORD_FUNCTION_H_ */
@@ -0,0 +1,155 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* shm_ring: a shared-memory ring of fixed-size slots through which multiple
+ * writer processes and threads send variable-sized messages to a single reader.
+ */
+
+#ifndef _SHM_RING_H_
+#define _SHM_RING_H_ 1
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h> // for ssize_t
+
+#ifndef OUT
+# define OUT // nothing
+#endif
+#ifndef IN
+# define IN // nothing
+#endif
+
+// Usage is as follows, mirroring named_pipe_t:
+// + The reader calls create() up front (and at the end destroy()).
+// + The reader calls open_for_read(), which blocks until a writer attaches,
+//   and then alternates acquire() and release().
+// + Each writer calls open_for_write() or maps get_ring_path() itself and
+//   passes the mapping to attach(), and calls close() when done.
+//
+// The ring is a bounded multi-producer queue: a writer claims the next slot
+// with an atomic increment of the write ticket and becomes the sole owner of
+// that slot while it copies its message in, so writers do not contend beyond
+// the increment.  Each slot has a sequence number recording whether it is free
+// for a given lap, holds a message, or is being read.  The reader and the
+// writers sleep on futex "doorbells" when the ring is empty or full, and ring
+// them only when the other side is waiting, so the common case makes no
+// system calls.
+//
+// The reader sees end-of-file once every attached writer has closed and the
+// ring is drained.  A writer that dies without closing is not detected.
+class shm_ring_t
+{
+ public:
+    shm_ring_t();
+    explicit shm_ring_t(const char *name);
+    ~shm_ring_t();
+    bool set_name(const char *name);
+    std::string get_name() const;
+
+    // Creates the ring's shared memory with num_slots slots (rounded up to a
+    // power of 2) of slot_size bytes (rounded up to a multiple of 64).
+    bool create(size_t num_slots, size_t slot_size);
+    bool destroy();
+
+    // This blocks until a writer has attached.
+    bool open_for_read();
+    bool open_for_write();
+
+    // Returns the path to the file holding the ring, for writers that map it
+    // themselves.  The map must be shared, readable, and writable.
+    const std::string & get_ring_path() const;
+    // Registers a writer on a mapping made by the caller, who unmaps it after
+    // calling close().
+    bool attach(void *map_base, size_t map_size);
+
+    // Detaches a writer or stops using the ring for the reader.
+    bool close();
+
+    // Returns the next message, blocking if there is none yet, or NULL on
+    // end-of-file.  The message stays valid until release() is called, which
+    // must happen before the next acquire().
+    const void * acquire(size_t *size OUT);
+    void release();
+
+    // Returns < 0 on an error, including a message larger than
+    // get_atomic_write_size().  On success returns sz.  This may block if the
+    // ring is full.
+    ssize_t write(const void *buf IN, size_t sz);
+
+    // The largest message, which is sent in one piece.
+    ssize_t get_atomic_write_size() const;
+
+    // The header at the start of the shared memory.  The fields written by
+    // the writers and by the reader are kept on separate cache lines.
+    struct header_t {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t num_slots;
+        uint32_t slot_size;
+        uint32_t pad0[12];
+        // Written by the writers.
+        uint64_t write_ticket;
+        int32_t doorbell;        // futex: bumped after a message is written
+        int32_t writers_waiting; // writers waiting for a free slot
+        int32_t num_writers;     // writers currently attached
+        int32_t ever_attached;   // whether any writer has attached
+        uint32_t pad1[10];
+        // Written by the reader.
+        uint64_t read_ticket;
+        int32_t space_doorbell;  // futex: bumped after a slot is freed
+        int32_t reader_waiting;  // whether the reader is waiting for a message
+        uint32_t pad2[12];
+    };
+    // Each slot starts with this, followed by the message.
+    struct slot_t {
+        // Holds the ticket when free for it, the ticket + 1 once the message
+        // for that ticket is written, and the ticket + num_slots once read.
+        uint64_t seq;
+        uint64_t size;
+        uint64_t pad[6];
+    };
+
+ private:
+    slot_t *get_slot(uint64_t ticket) const;
+    bool map(int fd, size_t size);
+
+    std::string ring_name;
+    header_t *header;
+    size_t map_size;
+    bool owns_map;
+    bool is_writer;
+    // The reader's current message, if acquired.
+    bool acquired;
+};
+
+#endif /* _SHM_RING_H_ */
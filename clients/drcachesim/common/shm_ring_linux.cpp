@@ -0,0 +1,352 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "shm_ring.h"
+
+#define RING_PERMS 0666
+#define RING_MAGIC 0x676e6972 /* "ring" */
+#define RING_VERSION 1
+#define CACHE_LINE 64
+
+// We wake up periodically while waiting rather than relying solely on the
+// doorbells, to notice the last writer detaching.
+#define WAIT_TIMEOUT_NS 100000000
+
+// The ring is shared across processes so we cannot use FUTEX_PRIVATE_FLAG.
+static void
+futex_wait(int32_t *addr, int32_t val)
+{
+    struct timespec timeout = {0, WAIT_TIMEOUT_NS};
+    syscall(SYS_futex, addr, FUTEX_WAIT, val, &timeout, NULL, 0);
+}
+
+static void
+futex_wake_all(int32_t *addr)
+{
+    syscall(SYS_futex, addr, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+}
+
+#define LOAD(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+#define STORE(field, val) __atomic_store_n(&(field), (val), __ATOMIC_RELEASE)
+#define FETCH_ADD(field, val) __atomic_fetch_add(&(field), (val), __ATOMIC_SEQ_CST)
+
+static const char *
+ring_dir()
+{
+#ifdef ANDROID
+    return "/data/local/tmp";
+#else
+    return "/dev/shm";
+#endif
+}
+
+static size_t
+slot_stride(const shm_ring_t::header_t *header)
+{
+    return sizeof(shm_ring_t::slot_t) + header->slot_size;
+}
+
+shm_ring_t::shm_ring_t() :
+    header(NULL), map_size(0), owns_map(false), is_writer(false), acquired(false)
+{
+    // empty
+}
+
+shm_ring_t::shm_ring_t(const char *name) :
+    header(NULL), map_size(0), owns_map(false), is_writer(false), acquired(false)
+{
+    set_name(name); // guaranteed to succeed
+}
+
+shm_ring_t::~shm_ring_t()
+{
+    close();
+}
+
+bool
+shm_ring_t::set_name(const char *name)
+{
+    if (header == NULL) {
+        if (name[0] == '/')
+            ring_name = name;
+        else
+            ring_name = std::string(std::string(ring_dir()) + "/" + name);
+        return true;
+    }
+    return false;
+}
+
+std::string
+shm_ring_t::get_name() const
+{
+    return ring_name;
+}
+
+const std::string &
+shm_ring_t::get_ring_path() const
+{
+    return ring_name;
+}
+
+bool
+shm_ring_t::map(int fd, size_t size)
+{
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        return false;
+    header = (header_t *) base;
+    map_size = size;
+    owns_map = true;
+    return true;
+}
+
+bool
+shm_ring_t::create(size_t num_slots, size_t slot_size)
+{
+    if (num_slots == 0 || slot_size == 0)
+        return false;
+    size_t slots = 1;
+    while (slots < num_slots)
+        slots *= 2;
+    slot_size = (slot_size + CACHE_LINE - 1) & ~((size_t)CACHE_LINE - 1);
+    if (slots > UINT32_MAX || slot_size > UINT32_MAX)
+        return false;
+    size_t size = sizeof(header_t) + slots * (sizeof(slot_t) + slot_size);
+    umask(0);
+    int fd = ::open(ring_name.c_str(), O_RDWR | O_CREAT | O_EXCL, RING_PERMS);
+    if (fd < 0)
+        return false;
+    bool res = ftruncate(fd, size) == 0 && map(fd, size);
+    ::close(fd);
+    if (!res)
+        return false;
+    memset(header, 0, sizeof(*header));
+    header->num_slots = (uint32_t) slots;
+    header->slot_size = (uint32_t) slot_size;
+    for (uint64_t i = 0; i < slots; ++i)
+        get_slot(i)->seq = i;
+    header->version = RING_VERSION;
+    STORE(header->magic, RING_MAGIC);
+    // The creator is not a reader until open_for_read().
+    ::munmap(header, map_size);
+    header = NULL;
+    owns_map = false;
+    return true;
+}
+
+bool
+shm_ring_t::destroy()
+{
+    close();
+    return (unlink(ring_name.c_str()) == 0);
+}
+
+bool
+shm_ring_t::open_for_read()
+{
+    int fd = ::open(ring_name.c_str(), O_RDWR);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    bool res = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(header_t) &&
+        map(fd, st.st_size);
+    ::close(fd);
+    if (!res)
+        return false;
+    if (header->magic != RING_MAGIC || header->version != RING_VERSION) {
+        close();
+        return false;
+    }
+    is_writer = false;
+    // Block until a writer attaches, as opening a pipe does.
+    while (LOAD(header->ever_attached) == 0) {
+        int32_t bell = LOAD(header->doorbell);
+        STORE(header->reader_waiting, 1);
+        if (LOAD(header->ever_attached) == 0)
+            futex_wait(&header->doorbell, bell);
+        STORE(header->reader_waiting, 0);
+    }
+    return true;
+}
+
+bool
+shm_ring_t::open_for_write()
+{
+    int fd = ::open(ring_name.c_str(), O_RDWR);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    bool res = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(header_t) &&
+        map(fd, st.st_size);
+    ::close(fd);
+    if (!res)
+        return false;
+    void *base = header;
+    header = NULL;
+    if (!attach(base, map_size)) {
+        ::munmap(base, map_size);
+        owns_map = false;
+        return false;
+    }
+    return true;
+}
+
+bool
+shm_ring_t::attach(void *map_base, size_t size)
+{
+    header_t *hdr = (header_t *) map_base;
+    if (size < sizeof(header_t) || hdr->magic != RING_MAGIC ||
+        hdr->version != RING_VERSION ||
+        size < sizeof(header_t) + hdr->num_slots * slot_stride(hdr))
+        return false;
+    header = hdr;
+    map_size = size;
+    is_writer = true;
+    FETCH_ADD(header->num_writers, 1);
+    STORE(header->ever_attached, 1);
+    FETCH_ADD(header->doorbell, 1);
+    if (LOAD(header->reader_waiting) != 0)
+        futex_wake_all(&header->doorbell);
+    return true;
+}
+
+bool
+shm_ring_t::close()
+{
+    if (header == NULL)
+        return true;
+    if (is_writer) {
+        FETCH_ADD(header->num_writers, -1);
+        FETCH_ADD(header->doorbell, 1);
+        if (LOAD(header->reader_waiting) != 0)
+            futex_wake_all(&header->doorbell);
+    } else if (acquired)
+        release();
+    if (owns_map)
+        ::munmap(header, map_size);
+    header = NULL;
+    owns_map = false;
+    is_writer = false;
+    return true;
+}
+
+shm_ring_t::slot_t *
+shm_ring_t::get_slot(uint64_t ticket) const
+{
+    return (slot_t *) ((char *)(header + 1) +
+                       (ticket & (header->num_slots - 1)) * slot_stride(header));
+}
+
+ssize_t
+shm_ring_t::write(const void *buf IN, size_t sz)
+{
+    if (header == NULL || !is_writer || sz > header->slot_size)
+        return -1;
+    uint64_t ticket = FETCH_ADD(header->write_ticket, 1);
+    slot_t *slot = get_slot(ticket);
+    // Wait for the reader to free this slot from the prior lap.
+    while (LOAD(slot->seq) != ticket) {
+        int32_t bell = LOAD(header->space_doorbell);
+        FETCH_ADD(header->writers_waiting, 1);
+        if (LOAD(slot->seq) != ticket)
+            futex_wait(&header->space_doorbell, bell);
+        FETCH_ADD(header->writers_waiting, -1);
+    }
+    memcpy(slot + 1, buf, sz);
+    slot->size = sz;
+    STORE(slot->seq, ticket + 1);
+    FETCH_ADD(header->doorbell, 1);
+    if (LOAD(header->reader_waiting) != 0)
+        futex_wake_all(&header->doorbell);
+    return sz;
+}
+
+const void *
+shm_ring_t::acquire(size_t *size OUT)
+{
+    if (header == NULL || is_writer)
+        return NULL;
+    if (acquired)
+        release();
+    uint64_t ticket = header->read_ticket;
+    slot_t *slot = get_slot(ticket);
+    while (LOAD(slot->seq) != ticket + 1) {
+        // Writers finish their messages before detaching, so once none are
+        // left a last look at the slot tells us whether we are done.
+        if (LOAD(header->num_writers) == 0) {
+            if (LOAD(slot->seq) == ticket + 1)
+                break;
+            return NULL;
+        }
+        int32_t bell = LOAD(header->doorbell);
+        STORE(header->reader_waiting, 1);
+        if (LOAD(slot->seq) != ticket + 1 && LOAD(header->num_writers) != 0)
+            futex_wait(&header->doorbell, bell);
+        STORE(header->reader_waiting, 0);
+    }
+    acquired = true;
+    *size = (size_t) slot->size;
+    return slot + 1;
+}
+
+void
+shm_ring_t::release()
+{
+    if (header == NULL || !acquired)
+        return;
+    uint64_t ticket = header->read_ticket;
+    STORE(get_slot(ticket)->seq, ticket + header->num_slots);
+    STORE(header->read_ticket, ticket + 1);
+    acquired = false;
+    FETCH_ADD(header->space_doorbell, 1);
+    if (LOAD(header->writers_waiting) != 0)
+        futex_wake_all(&header->space_doorbell);
+}
+
+ssize_t
+shm_ring_t::get_atomic_write_size() const
+{
+    if (header == NULL)
+        return 0;
+    return header->slot_size;
+}
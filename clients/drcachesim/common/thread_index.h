@@ -0,0 +1,119 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* thread_index: the index of a directory of per-thread final trace files. */
+
+#ifndef _THREAD_INDEX_H_
+#define _THREAD_INDEX_H_ 1
+
+#include <stdint.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// drraw2trace -outdir writes this file alongside the per-thread trace files so
+// that readers can find the threads they want without opening every file.
+// It is a text file consisting of a version line followed by one line per
+// thread file:
+//   <tid> <pid> <first_timestamp> <last_timestamp> <entries> <instrs> <file>
+// The timestamps are the first and last timestamp marker values in the file
+// (0 if there are none), entries is the number of trace_entry_t in the file,
+// including the header and footer, and instrs is the number of instructions as
+// counted by chunked_trace_instr_count().  The file name is relative to the
+// directory and runs to the end of the line.
+
+#define THREAD_INDEX_FILENAME "drmemtrace.index"
+#define THREAD_INDEX_VERSION 1
+
+struct thread_index_entry_t {
+    thread_index_entry_t() : tid(0), pid(0), first_timestamp(0), last_timestamp(0),
+                             entries(0), instrs(0) {}
+    uint64_t tid;
+    uint64_t pid;
+    uint64_t first_timestamp;
+    uint64_t last_timestamp;
+    uint64_t entries;
+    uint64_t instrs;
+    std::string file;
+};
+
+// Returns a non-empty error message on failure.
+static inline std::string
+thread_index_write(const std::string &path,
+                   const std::vector<thread_index_entry_t> &threads)
+{
+    std::ofstream out(path.c_str());
+    if (!out)
+        return "Failed to open " + path;
+    out << "drmemtrace thread index version " << THREAD_INDEX_VERSION << "\n";
+    for (const auto &thread : threads) {
+        out << thread.tid << " " << thread.pid << " " << thread.first_timestamp
+            << " " << thread.last_timestamp << " " << thread.entries << " "
+            << thread.instrs << " " << thread.file << "\n";
+    }
+    if (!out)
+        return "Failed to write " + path;
+    return "";
+}
+
+// Returns a non-empty error message on failure.
+static inline std::string
+thread_index_read(const std::string &path, std::vector<thread_index_entry_t> *threads)
+{
+    std::ifstream in(path.c_str());
+    if (!in)
+        return "Failed to open " + path;
+    std::string line;
+    std::stringstream header;
+    header << "drmemtrace thread index version " << THREAD_INDEX_VERSION;
+    if (!std::getline(in, line) || line != header.str())
+        return "Unsupported thread index " + path;
+    threads->clear();
+    while (std::getline(in, line)) {
+        if (line.empty())
+            continue;
+        std::istringstream fields(line);
+        thread_index_entry_t thread;
+        if (!(fields >> thread.tid >> thread.pid >> thread.first_timestamp >>
+              thread.last_timestamp >> thread.entries >> thread.instrs))
+            return "Malformed line in thread index " + path + ": " + line;
+        fields >> std::ws;
+        std::getline(fields, thread.file);
+        if (thread.file.empty())
+            return "Malformed line in thread index " + path + ": " + line;
+        threads->push_back(thread);
+    }
+    return "";
+}
+
+#endif /* _THREAD_INDEX_H_ */
@@ -190,6 +190,115 @@ typedef enum {
      * cpu could not be determined.
      */
     TRACE_MARKER_TYPE_CPU_ID,
+    /**
+     * The marker value contains the ordinal of the tracing window that the
+     * subsequent entries belong to, for traces gathered with -trace_for_instrs.
+     * Windows are numbered from 0 and there are untraced instructions between
+     * consecutive windows.
+     */
+    TRACE_MARKER_TYPE_WINDOW_ID,
+    /**
+     * The marker value contains the identifier of a function traced with the
+     * -record_function option, which is its index in that option's list.  It
+     * begins each group of markers for that function: at the function's entry,
+     * it is followed by a #TRACE_MARKER_TYPE_FUNC_RETADDR marker and one
+     * #TRACE_MARKER_TYPE_FUNC_ARG marker per recorded argument; at its return it
+     * is followed by a #TRACE_MARKER_TYPE_FUNC_RETVAL marker.
+     */
+    TRACE_MARKER_TYPE_FUNC_ID,
+    /**
+     * The marker value contains the return address of the function entry
+     * identified by the preceding #TRACE_MARKER_TYPE_FUNC_ID marker.
+     */
+    TRACE_MARKER_TYPE_FUNC_RETADDR,
+    /**
+     * The marker value contains one argument of the function entry identified by
+     * the preceding #TRACE_MARKER_TYPE_FUNC_ID marker, in order.  For offline
+     * traces, values are truncated to 48 bits.
+     */
+    TRACE_MARKER_TYPE_FUNC_ARG,
+    /**
+     * The marker value contains the return value of the function return
+     * identified by the preceding #TRACE_MARKER_TYPE_FUNC_ID marker.  For offline
+     * traces, the value is truncated to 48 bits.
+     */
+    TRACE_MARKER_TYPE_FUNC_RETVAL,
+    /**
+     * The marker value contains the address of a line of the -L0_filter
+     * instruction cache whose access count follows in a
+     * #TRACE_MARKER_TYPE_FILTER_COUNT marker, for traces gathered with -L0_counts.
+     */
+    TRACE_MARKER_TYPE_FILTER_ILINE,
+    /**
+     * The marker value contains the address of a line of the -L0_filter data
+     * cache whose access count follows in a #TRACE_MARKER_TYPE_FILTER_COUNT
+     * marker, for traces gathered with -L0_counts.
+     */
+    TRACE_MARKER_TYPE_FILTER_DLINE,
+    /**
+     * The marker value contains the number of accesses, hits included, to the
+     * line named by the preceding #TRACE_MARKER_TYPE_FILTER_ILINE or
+     * #TRACE_MARKER_TYPE_FILTER_DLINE marker since the line was brought into
+     * the -L0_filter cache or since it was last recorded.
+     */
+    TRACE_MARKER_TYPE_FILTER_COUNT,
+    /**
+     * For traces gathered with -repstr_ranges, stands for all iterations of a
+     * string loop's memory operand: the single data reference that follows holds
+     * the lowest address accessed and the per-iteration size.  The marker value
+     * holds the total number of bytes accessed shifted left by one, with the low
+     * bit set if the loop walks downward from the highest address.  reader_t
+     * expands the pair into one data reference per iteration, in execution
+     * order, and does not pass this marker on to analysis tools.
+     */
+    TRACE_MARKER_TYPE_MEMREF_RANGE,
+
+    /**
+     * Present at the start of each thread's trace when it was gathered with
+     * -instr_only.  Such a trace contains instruction fetches but no data
+     * references, so the lack of data references after an instruction does not
+     * mean that the instruction did not access memory.  The marker value is 0.
+     */
+    TRACE_MARKER_TYPE_INSTR_ONLY,
+
+    /**
+     * For traces converted with raw2trace's -repeat, stands for a sequence of
+     * entries that repeats several times in a row, such as the iterations of a
+     * loop, with each data reference's address advancing by a constant stride
+     * per iteration.  The low #TRACE_REPEAT_BODY_BITS bits of the marker value
+     * hold the number of entries in one iteration and the remaining bits hold the
+     * number of iterations.  The marker is followed by one
+     * #TRACE_MARKER_TYPE_REPEAT_STRIDE marker per data reference in an iteration
+     * and then by the entries of the first iteration, which start with an
+     * instruction fetch and contain only instruction fetches, instruction
+     * bundles, and data references.  reader_t expands the sequence into every
+     * iteration and does not pass these markers on to analysis tools.
+     */
+    TRACE_MARKER_TYPE_REPEAT,
+
+    /**
+     * Follows a #TRACE_MARKER_TYPE_REPEAT marker, one for each data reference in
+     * the repeated entries, in order.  The marker value holds the amount, as a
+     * two's complement value, added to the address of the corresponding data
+     * reference in each subsequent iteration.
+     */
+    TRACE_MARKER_TYPE_REPEAT_STRIDE,
+
+    /**
+     * Present near the start of each thread's trace when it was gathered with
+     * -offline.  The marker value holds the thread's stack pointer when it
+     * started, or for the initial thread on UNIX, the location of the
+     * application's environment array, which the kernel places at a fixed offset
+     * from the initial stack pointer.  Omitted when neither is available.
+     */
+    TRACE_MARKER_TYPE_STACK_BASE,
+
+    /**
+     * Present near the start of each thread's trace when it was gathered with
+     * -offline on Linux.  The marker value holds the process's program break when
+     * tracing started, which is the start of its brk-based heap.
+     */
+    TRACE_MARKER_TYPE_HEAP_BASE,
 
     // ...
     // These values are reserved for future built-in marker types.
@@ -198,6 +307,12 @@ typedef enum {
     // Values below here are available for users to use for custom markers.
 } trace_marker_type_t;
 
+/**
+ * The number of low bits of a #TRACE_MARKER_TYPE_REPEAT marker value that hold the
+ * number of entries in one iteration of the repeated sequence.
+ */
+#define TRACE_REPEAT_BODY_BITS 8
+
 extern const char * const trace_type_names[];
 
 /**
@@ -266,6 +381,14 @@ typedef struct _trace_entry_t trace_entry_t;
 // a type field in those top bits.
 // For the most common, a memref, we have both all 0's and all 1's be its
 // type to reduce instrumentation overhead.
+// XXX: We considered packing memrefs as 32-bit deltas against a per-block base
+// with an escape to full entries.  The inline instrumentation, however, writes
+// each block's entries at offsets fixed when the block is instrumented, and the
+// buffer pointer is bumped once by a constant.  Variable-sized entries would need
+// a runtime size check and pointer bump per memref, which costs more than the
+// stores it saves.  Post-processing would also lose its fixed-size entry walk.
+// For bandwidth-bound tracing, use -raw_compress, which removes this redundancy
+// (and more) off the instrumentation path.
 // The type simply identifies which union alternative:
 typedef enum {
     OFFLINE_TYPE_MEMREF, // We rely on this being 0.
@@ -293,12 +416,40 @@ typedef enum {
     // Used for filters on multi-memref instrs where post-processing can't tell
     // which memref passed the filter.
     OFFLINE_EXT_TYPE_MEMINFO,
+    // Holds OFFLINE_FILE_FLAG_* bits in valueA.  It immediately follows the pid
+    // entry in files of version 2 and later.
+    OFFLINE_EXT_TYPE_FILE_FLAGS,
+    // Gives the physical page backing a virtual page in files with
+    // OFFLINE_FILE_FLAG_PHYSICAL.  The valueA field holds the virtual page number
+    // and the entry that follows holds the physical page number in its
+    // combined_value, both in units of 1<<OFFLINE_PHYS_PAGE_BITS bytes.
+    // The mapping applies to the thread's subsequent entries.
+    OFFLINE_EXT_TYPE_PHYS_MAPPING,
 } offline_ext_type_t;
 
+// Describes how the tracer encoded a thread file.
+enum {
+    // No entry is written for an x86_64 rip-relative memref in module code whose
+    // instr is not predicated, as post-processing can compute its address from
+    // the instr's pc.  This is not set when filtering.
+    OFFLINE_FILE_FLAG_ELIDE_RIP_REL = 0x1,
+    // No data reference entries are present: each block is represented by its pc
+    // entry alone, and post-processing emits only instruction entries for it.
+    OFFLINE_FILE_FLAG_INSTR_ONLY = 0x2,
+    // Addresses are virtual, and each memref entry holds the full address.  Before
+    // the first reference to a page, and again whenever the mapping may have
+    // changed, the thread records an OFFLINE_EXT_TYPE_PHYS_MAPPING entry for it,
+    // which post-processing uses to convert the thread's addresses to physical.
+    OFFLINE_FILE_FLAG_PHYSICAL = 0x4,
+};
+
+#define OFFLINE_PHYS_PAGE_BITS 12
+
 #define EXT_VALUE_A_BITS 48
 #define EXT_VALUE_B_BITS 8
 
-#define OFFLINE_FILE_VERSION 1
+#define OFFLINE_FILE_VERSION_OLDEST_SUPPORTED 1
+#define OFFLINE_FILE_VERSION 2
 
 START_PACKED_STRUCTURE
 struct _offline_entry_t {
@@ -0,0 +1,126 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* trace_socket: a TCP connection carrying offline trace files from the tracer
+ * to a remote collector, along with the message format used over it.
+ */
+
+#ifndef _TRACE_SOCKET_H_
+#define _TRACE_SOCKET_H_ 1
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h> // for ssize_t
+
+#ifndef OUT
+# define OUT // nothing
+#endif
+#ifndef IN
+# define IN // nothing
+#endif
+
+// The tracer's -stream_to replaces its file operations with messages sent over a
+// single connection per process, so that the collector can recreate the files
+// that the tracer would otherwise have written under -outdir.  Each message is a
+// trace_socket_msg_t followed by size bytes of payload.
+//
+// The tracer first sends TRACE_SOCKET_MSG_HELLO with the protocol version in the
+// id field.  Directory creation and file opening are requests whose outcome the
+// tracer needs, so the collector answers each with TRACE_SOCKET_MSG_REPLY.  Data
+// is sent without any reply, so that the tracer only waits for the network
+// itself.
+#define TRACE_SOCKET_VERSION 1
+
+enum {
+    TRACE_SOCKET_MSG_HELLO,
+    // The payload is the path of a directory to create, relative to -outdir.
+    // The request fails if the directory already exists.
+    TRACE_SOCKET_MSG_CREATE_DIR,
+    // The payload is the path of a new file, relative to -outdir, which the id
+    // names in later messages.  The request fails if the file already exists.
+    TRACE_SOCKET_MSG_OPEN,
+    // The payload is appended to the file named by id.
+    TRACE_SOCKET_MSG_WRITE,
+    TRACE_SOCKET_MSG_CLOSE,
+    // Sent by the collector in response to a request.  The id field is 1 if the
+    // request succeeded and 0 if it failed.
+    TRACE_SOCKET_MSG_REPLY,
+};
+
+struct trace_socket_msg_t {
+    uint32_t type;
+    uint32_t id;
+    uint64_t size;
+};
+
+// Usage is as follows:
+// + The tracer calls connect_to() and then write() messages, reading replies
+//   with read().
+// + The collector calls listen_on() once and then accept_from() on a separate
+//   trace_socket_t for each incoming connection.
+// Each side calls close() when done.
+class trace_socket_t
+{
+ public:
+    trace_socket_t();
+    ~trace_socket_t();
+
+    // Connects to address, which has the form host:port.  The host must be a
+    // numeric IPv4 or IPv6 address (with IPv6 addresses enclosed in brackets),
+    // which avoids name resolution inside the traced application.
+    bool connect_to(const std::string &address);
+    // Listens on address, of the form [host:]port, where the host can be a name.
+    bool listen_on(const std::string &address);
+    // Blocks until a connection arrives on listener.
+    bool accept_from(const trace_socket_t &listener);
+    bool close();
+    bool is_open() const;
+
+    // These block until all of sz bytes are transferred, returning false on an
+    // error or if the connection is closed first.  A write to a connection
+    // closed by the other side fails rather than raising SIGPIPE.
+    bool read(void *buf OUT, size_t sz);
+    bool write(const void *buf IN, size_t sz);
+
+    // Sends a message header followed by payload_size bytes from payload.
+    bool write_msg(uint32_t type, uint32_t id, const void *payload IN,
+                   size_t payload_size);
+
+ private:
+    // Splits address into a host, which may be empty, and a port.
+    static bool parse_address(const std::string &address, OUT std::string *host,
+                              OUT std::string *port);
+    int fd;
+};
+
+#endif /* _TRACE_SOCKET_H_ */
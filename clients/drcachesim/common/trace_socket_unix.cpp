@@ -0,0 +1,220 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* trace_socket: TCP connections for streaming offline traces on UNIX. */
+
+#include <string>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include "trace_socket.h"
+
+#ifdef MSG_NOSIGNAL
+# define SEND_FLAGS MSG_NOSIGNAL
+#else
+# define SEND_FLAGS 0
+#endif
+
+#define LISTEN_BACKLOG 64
+
+trace_socket_t::trace_socket_t() :
+    fd(-1)
+{
+}
+
+trace_socket_t::~trace_socket_t()
+{
+    close();
+}
+
+bool
+trace_socket_t::parse_address(const std::string &address, OUT std::string *host,
+                              OUT std::string *port)
+{
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+        host->clear();
+        *port = address;
+    } else {
+        *host = address.substr(0, colon);
+        *port = address.substr(colon + 1);
+    }
+    if (host->size() >= 2 && (*host)[0] == '[' && (*host)[host->size() - 1] == ']')
+        *host = host->substr(1, host->size() - 2);
+    return !port->empty();
+}
+
+bool
+trace_socket_t::connect_to(const std::string &address)
+{
+    std::string host, port;
+    if (is_open() || !parse_address(address, &host, &port) || host.empty())
+        return false;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+    struct addrinfo *list;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &list) != 0)
+        return false;
+    for (struct addrinfo *ai = list; ai != NULL && fd == -1; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1)
+            continue;
+        if (connect(fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    if (fd == -1)
+        return false;
+    // Requests are small and wait for a reply, so we do not want them delayed.
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    return true;
+}
+
+bool
+trace_socket_t::listen_on(const std::string &address)
+{
+    std::string host, port;
+    if (is_open() || !parse_address(address, &host, &port))
+        return false;
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    struct addrinfo *list;
+    if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(), &hints,
+                    &list) != 0)
+        return false;
+    for (struct addrinfo *ai = list; ai != NULL && fd == -1; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd == -1)
+            continue;
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) != 0 ||
+            listen(fd, LISTEN_BACKLOG) != 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+    freeaddrinfo(list);
+    return fd != -1;
+}
+
+bool
+trace_socket_t::accept_from(const trace_socket_t &listener)
+{
+    if (is_open() || !listener.is_open())
+        return false;
+    do {
+        fd = accept(listener.fd, NULL, NULL);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1)
+        return false;
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return true;
+}
+
+bool
+trace_socket_t::close()
+{
+    if (fd == -1)
+        return false;
+    bool res = ::close(fd) == 0;
+    fd = -1;
+    return res;
+}
+
+bool
+trace_socket_t::is_open() const
+{
+    return fd != -1;
+}
+
+bool
+trace_socket_t::read(void *buf OUT, size_t sz)
+{
+    char *cur = (char *)buf;
+    while (sz > 0) {
+        ssize_t res = recv(fd, cur, sz, 0);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return false;
+        cur += res;
+        sz -= res;
+    }
+    return true;
+}
+
+bool
+trace_socket_t::write(const void *buf IN, size_t sz)
+{
+    const char *cur = (const char *)buf;
+    while (sz > 0) {
+        ssize_t res = send(fd, cur, sz, SEND_FLAGS);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+            return false;
+        cur += res;
+        sz -= res;
+    }
+    return true;
+}
+
+bool
+trace_socket_t::write_msg(uint32_t type, uint32_t id, const void *payload IN,
+                          size_t payload_size)
+{
+    trace_socket_msg_t msg;
+    msg.type = type;
+    msg.id = id;
+    msg.size = payload_size;
+    return write(&msg, sizeof(msg)) &&
+        (payload_size == 0 || write(payload, payload_size));
+}
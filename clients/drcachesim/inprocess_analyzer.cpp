@@ -0,0 +1,300 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <string.h>
+#include "dr_api.h"
+#include "tracer/drmemtrace.h"
+#include "inprocess_analyzer.h"
+#include "reader/memory_reader.h"
+#include "tracer/raw2trace.h"
+#include "common/utils.h"
+
+// Reads a thread's raw buffers in sequence, without concatenating them.
+class raw_buffer_streambuf_t : public std::streambuf
+{
+ public:
+    explicit raw_buffer_streambuf_t(const std::vector<char *> &starts,
+                                    const std::vector<size_t> &sizes) :
+        starts(starts), sizes(sizes), next(0) {}
+
+ protected:
+    int_type
+    underflow() override
+    {
+        while (gptr() == egptr()) {
+            if (next >= starts.size())
+                return traits_type::eof();
+            setg(starts[next], starts[next], starts[next] + sizes[next]);
+            ++next;
+        }
+        return traits_type::to_int_type(*gptr());
+    }
+
+ private:
+    std::vector<char *> starts;
+    std::vector<size_t> sizes;
+    size_t next;
+};
+
+// Appends the final trace to a vector, which the readers then use in place.
+class vector_streambuf_t : public std::streambuf
+{
+ public:
+    explicit vector_streambuf_t(std::vector<char> *dest) : dest(dest) {}
+
+ protected:
+    std::streamsize
+    xsputn(const char *s, std::streamsize n) override
+    {
+        dest->insert(dest->end(), s, s + n);
+        return n;
+    }
+    int_type
+    overflow(int_type c) override
+    {
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+            dest->push_back(traits_type::to_char_type(c));
+        return traits_type::not_eof(c);
+    }
+
+ private:
+    std::vector<char> *dest;
+};
+
+inprocess_analyzer_t *inprocess_analyzer_t::instance;
+
+inprocess_analyzer_t::inprocess_analyzer_t(analysis_tool_t **tools_in,
+                                           int num_tools_in) :
+    lock(NULL), analyzed(false), analysis_res(false)
+{
+    num_tools = num_tools_in;
+    tools = tools_in;
+    for (int i = 0; i < num_tools; ++i) {
+        if (tools[i] == NULL || !*tools[i]) {
+            success = false;
+            error_string = "Tool is not successfully initialized";
+            return;
+        }
+    }
+    if (instance != NULL) {
+        success = false;
+        error_string = "Only one in-process analyzer is supported at a time";
+        return;
+    }
+    if (drmemtrace_replace_file_ops(open_file, read_file, write_file, close_file,
+                                    create_dir) != DRMEMTRACE_SUCCESS ||
+        drmemtrace_buffer_handoff(handoff_buffer, exit_tracer, this) !=
+        DRMEMTRACE_SUCCESS) {
+        success = false;
+        error_string = "Failed to register with the tracer";
+        return;
+    }
+    instance = this;
+}
+
+inprocess_analyzer_t::~inprocess_analyzer_t()
+{
+    if (instance == this)
+        instance = NULL;
+    // If the tracer never exited, the buffers are leaked: DR may no longer be
+    // around to free them.
+}
+
+bool
+inprocess_analyzer_t::run()
+{
+    return analyzed && analysis_res;
+}
+
+// We identify each file by its index in "files".
+
+file_t
+inprocess_analyzer_t::open_file(const char *fname, uint mode_flags)
+{
+    // The first file, the module list, is opened during the tracer's
+    // single-threaded initialization.
+    if (instance->lock == NULL)
+        instance->lock = dr_mutex_create();
+    const size_t suffix_len = strlen(DRMEMTRACE_MODULE_LIST_FILENAME);
+    size_t len = strlen(fname);
+    bool is_module_list = len >= suffix_len &&
+        strcmp(fname + len - suffix_len, DRMEMTRACE_MODULE_LIST_FILENAME) == 0;
+    dr_mutex_lock(instance->lock);
+    file_t file = (file_t)(ptr_int_t)instance->files.size();
+    instance->files.push_back(memory_file_t(is_module_list));
+    dr_mutex_unlock(instance->lock);
+    return file;
+}
+
+ssize_t
+inprocess_analyzer_t::read_file(file_t file, void *data, size_t count)
+{
+    return 0; // Nothing reads back what it wrote.
+}
+
+inprocess_analyzer_t::memory_file_t *
+inprocess_analyzer_t::lookup_file(file_t file)
+{
+    size_t index = (size_t)(ptr_int_t)file;
+    if (index >= files.size())
+        return NULL;
+    return &files[index];
+}
+
+ssize_t
+inprocess_analyzer_t::write_file(file_t file, const void *data, size_t size)
+{
+    // Only buffers the tracer keeps, like the module list, are written
+    // rather than handed off, so we need a copy.
+    void *copy = dr_raw_mem_alloc(size, DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+    if (copy == NULL)
+        return -1;
+    memcpy(copy, data, size);
+    if (!handoff_buffer(file, copy, size, size)) {
+        dr_raw_mem_free(copy, size);
+        return -1;
+    }
+    return size;
+}
+
+void
+inprocess_analyzer_t::close_file(file_t file)
+{
+    /* Nothing: the data stays in memory until the tracer exits. */
+}
+
+bool
+inprocess_analyzer_t::create_dir(const char *dir)
+{
+    return true; // Nothing is written to disk.
+}
+
+bool
+inprocess_analyzer_t::handoff_buffer(file_t file, void *data, size_t data_size,
+                                     size_t alloc_size)
+{
+    dr_mutex_lock(instance->lock);
+    memory_file_t *mem_file = instance->lookup_file(file);
+    if (mem_file != NULL)
+        mem_file->buffers.push_back(raw_buffer_t(data, data_size, alloc_size));
+    dr_mutex_unlock(instance->lock);
+    return mem_file != NULL;
+}
+
+void
+inprocess_analyzer_t::exit_tracer(void *arg)
+{
+    inprocess_analyzer_t *analyzer = (inprocess_analyzer_t *)arg;
+    analyzer->analysis_res = analyzer->convert_and_analyze();
+    analyzer->analyzed = true;
+    // All threads have exited, so we no longer need the lock.
+    if (analyzer->lock != NULL) {
+        dr_mutex_destroy(analyzer->lock);
+        analyzer->lock = NULL;
+    }
+    // The readers are done with the trace.
+    std::vector<char>().swap(analyzer->trace);
+}
+
+void
+inprocess_analyzer_t::free_buffers()
+{
+    for (auto &file : files) {
+        for (auto &buf : file.buffers)
+            dr_raw_mem_free(buf.data, buf.alloc_size);
+        file.buffers.clear();
+    }
+}
+
+bool
+inprocess_analyzer_t::convert_and_analyze()
+{
+    std::string modmap;
+    std::vector<raw_buffer_streambuf_t *> bufs;
+    std::vector<std::istream *> thread_files;
+    std::string error;
+    for (const auto &file : files) {
+        if (file.is_module_list) {
+            for (const auto &buf : file.buffers)
+                modmap.append((const char *)buf.data, buf.size);
+            continue;
+        }
+        // A thread that was filtered out, or that exited before writing
+        // anything, has no data.
+        if (file.buffers.empty())
+            continue;
+        std::vector<char *> starts;
+        std::vector<size_t> sizes;
+        for (const auto &buf : file.buffers) {
+            starts.push_back((char *)buf.data);
+            sizes.push_back(buf.size);
+        }
+        bufs.push_back(new raw_buffer_streambuf_t(starts, sizes));
+        thread_files.push_back(new std::istream(bufs.back()));
+        error = raw2trace_t::check_thread_file(thread_files.back());
+        if (!error.empty()) {
+            error = "Failed sanity checks for thread data: " + error;
+            break;
+        }
+    }
+    if (error.empty() && modmap.empty())
+        error = "The tracer wrote no module list";
+    if (error.empty() && thread_files.empty())
+        error = "The tracer wrote no thread data";
+    if (error.empty()) {
+        vector_streambuf_t outbuf(&trace);
+        std::ostream out_file(&outbuf);
+        raw2trace_t raw2trace(modmap.c_str(), thread_files, &out_file,
+                              dr_get_current_drcontext());
+        error = raw2trace.do_conversion();
+        if (!error.empty())
+            error = "Failed to convert the trace: " + error;
+    }
+    for (size_t i = 0; i < thread_files.size(); ++i) {
+        delete thread_files[i];
+        delete bufs[i];
+    }
+    // We free the raw data before analyzing to reduce the peak footprint.
+    free_buffers();
+    if (!error.empty()) {
+        ERRMSG("%s\n", error.c_str());
+        error_string = error;
+        return false;
+    }
+    trace_iter = new memory_reader_t((const trace_entry_t *)trace.data(),
+                                     trace.size() / sizeof(trace_entry_t));
+    trace_end = new memory_reader_t();
+    return analyzer_t::run();
+}
@@ -0,0 +1,128 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* inprocess_analyzer: runs analysis tools on an offline trace inside the traced
+ * process, with no files or pipes involved.
+ */
+
+#ifndef _INPROCESS_ANALYZER_H_
+#define _INPROCESS_ANALYZER_H_ 1
+
+/**
+ * @file drmemtrace/inprocess_analyzer.h
+ * @brief DrMemtrace in-process analysis of offline traces.
+ */
+
+#include <string>
+#include <vector>
+#include "dr_api.h"
+#include "analyzer.h"
+
+/**
+ * Analyzes the trace of the current process in memory, combining the low
+ * instrumentation cost of offline tracing with the immediate results of online
+ * analysis.  This is meant for an application or a client that links with the
+ * \p drmemtrace_static tracer in \p -offline mode.  It takes over the tracer's
+ * file operations and buffer handoff, via drmemtrace_replace_file_ops() and
+ * drmemtrace_buffer_handoff(), to keep each thread's raw buffers in memory
+ * without copying them.  When the tracer exits, either at process exit or in
+ * dr_app_stop_and_cleanup(), the buffers are converted by a #raw2trace_t
+ * instance into a single final trace held in memory, which is handed to the
+ * tools in place just as #analyzer_t would present a trace file.
+ *
+ * Only one instance may exist at a time, and it must be created prior to the
+ * tracer's initialization, i.e., before dr_app_setup() or before the client's
+ * call to drmemtrace_client_main().  It must remain alive until the tracer has
+ * exited.  The tools' results can then be presented with print_stats().
+ */
+class inprocess_analyzer_t : public analyzer_t
+{
+ public:
+    /**
+     * Registers with the tracer to analyze its trace with the \p num_tools tools
+     * in \p tools.  As with #analyzer_t, the tools are referenced rather than
+     * copied and must be freed by the caller afterward.  Errors will set a flag
+     * that should be queried via operator!().
+     */
+    inprocess_analyzer_t(analysis_tool_t **tools, int num_tools);
+    virtual ~inprocess_analyzer_t(); /**< Destructor. */
+    /**
+     * The analysis itself has already taken place in the tracer's exit, so this
+     * only returns whether it succeeded, or false if the tracer has not yet
+     * exited.  get_error_string() can be used to obtain more information.
+     */
+    virtual bool run();
+
+ protected:
+    // A raw buffer allocated with dr_raw_mem_alloc(), which we free once the
+    // trace is converted.
+    struct raw_buffer_t {
+        raw_buffer_t(void *data, size_t size, size_t alloc_size) :
+            data(data), size(size), alloc_size(alloc_size) {}
+        void *data;
+        size_t size;
+        size_t alloc_size;
+    };
+    // One file opened by the tracer.
+    struct memory_file_t {
+        explicit memory_file_t(bool is_module_list) : is_module_list(is_module_list) {}
+        bool is_module_list;
+        std::vector<raw_buffer_t> buffers;
+    };
+
+    static file_t open_file(const char *fname, uint mode_flags);
+    static ssize_t read_file(file_t file, void *data, size_t count);
+    static ssize_t write_file(file_t file, const void *data, size_t size);
+    static void close_file(file_t file);
+    static bool create_dir(const char *dir);
+    static bool handoff_buffer(file_t file, void *data, size_t data_size,
+                               size_t alloc_size);
+    static void exit_tracer(void *arg);
+
+    memory_file_t *lookup_file(file_t file);
+    bool convert_and_analyze();
+    void free_buffers();
+
+    // The file operations have no user data parameter.
+    static inprocess_analyzer_t *instance;
+
+    // Guards files, as threads open and hand off concurrently.  This is created
+    // once DR is initialized, at the tracer's first file open.
+    void *lock;
+    std::vector<memory_file_t> files;
+    // The final trace, which the readers iterate over in place.
+    std::vector<char> trace;
+    bool analyzed;
+    bool analysis_res;
+};
+
+#endif /* _INPROCESS_ANALYZER_H_ */
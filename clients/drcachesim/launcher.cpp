@@ -347,7 +347,10 @@ _tmain(int argc, const TCHAR *targv[])
     } else
         errcode = 0;
 
-    analyzer->print_stats();
+    // A tool whose results fail, such as the invariant checker finding a
+    // malformed trace, makes us fail too.
+    if (!analyzer->print_stats() && errcode == 0)
+        errcode = 1;
 
     // release analyzer's space
     delete analyzer;
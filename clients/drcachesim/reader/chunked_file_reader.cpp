@@ -0,0 +1,217 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <assert.h>
+#include <zlib.h>
+#include "chunked_file_reader.h"
+#include "../common/memref.h"
+#include "../common/utils.h"
+
+chunked_file_reader_t::chunked_file_reader_t() : valid(false), chunk_entries(0),
+    next_chunk(0), chunk_pos(0)
+{
+    /* Empty. */
+}
+
+chunked_file_reader_t::chunked_file_reader_t(const char *file_name) :
+    file(file_name, std::ifstream::binary), valid(false), chunk_entries(0),
+    next_chunk(0), chunk_pos(0)
+{
+    chunked_trace_header_t header;
+    if (!file.read((char *)&header, sizeof(header)) ||
+        header.magic != CHUNKED_TRACE_MAGIC || header.version != CHUNKED_TRACE_VERSION)
+        return;
+    chunk_entries = header.chunk_entries;
+    chunked_trace_footer_t footer;
+    if (!file.seekg(-(int)sizeof(footer), file.end) ||
+        !file.read((char *)&footer, sizeof(footer)) ||
+        footer.magic != CHUNKED_TRACE_MAGIC)
+        return;
+    index.resize((size_t)footer.num_chunks);
+    threads.resize((size_t)footer.num_threads);
+    if (!file.seekg((std::streamoff)footer.index_offset, file.beg) ||
+        (!index.empty() &&
+         !file.read((char *)&index[0], index.size() * sizeof(index[0]))) ||
+        (!threads.empty() &&
+         !file.read((char *)&threads[0], threads.size() * sizeof(threads[0]))))
+        return;
+    for (const auto &thread : threads)
+        add_thread_pid((memref_tid_t)thread.tid, (memref_pid_t)thread.pid);
+    valid = true;
+}
+
+chunked_file_reader_t::~chunked_file_reader_t()
+{
+    file.close();
+}
+
+bool
+chunked_file_reader_t::is_chunked_file(const std::string &path)
+{
+    std::ifstream f(path.c_str(), std::ifstream::binary);
+    uint64_t magic;
+    return f.read((char *)&magic, sizeof(magic)) && magic == CHUNKED_TRACE_MAGIC;
+}
+
+bool
+chunked_file_reader_t::operator!()
+{
+    return !valid;
+}
+
+bool
+chunked_file_reader_t::init()
+{
+    at_eof = false;
+    if (!valid)
+        return false;
+    trace_entry_t *first_entry = read_next_entry();
+    if (first_entry == NULL)
+        return false;
+    if (first_entry->type != TRACE_TYPE_HEADER ||
+        first_entry->addr != TRACE_ENTRY_VERSION) {
+        ERRMSG("missing header or version mismatch\n");
+        return false;
+    }
+    ++*this;
+    return true;
+}
+
+bool
+chunked_file_reader_t::is_complete()
+{
+    // The footer is only written once the whole trace has been written.
+    return valid;
+}
+
+bool
+chunked_file_reader_t::load_chunk(uint64_t chunk_idx)
+{
+    if (chunk_idx >= index.size())
+        return false;
+    const chunked_trace_index_t &entry = index[(size_t)chunk_idx];
+    if (entry.entry_count > chunk_entries)
+        return false;
+    compressed.resize((size_t)entry.compressed_size);
+    chunk.resize((size_t)entry.entry_count);
+    uLongf size = (uLongf)(chunk.size() * sizeof(chunk[0]));
+    if (!file.seekg((std::streamoff)entry.file_offset, file.beg) ||
+        !file.read(&compressed[0], compressed.size()) ||
+        uncompress((Bytef *)&chunk[0], &size, (const Bytef *)&compressed[0],
+                   (uLong)compressed.size()) != Z_OK ||
+        size != chunk.size() * sizeof(chunk[0])) {
+        ERRMSG("Failed to read chunk %zu\n", (size_t)chunk_idx);
+        chunk.clear();
+        return false;
+    }
+    next_chunk = chunk_idx + 1;
+    chunk_pos = 0;
+    return true;
+}
+
+trace_entry_t *
+chunked_file_reader_t::read_next_entries(size_t *count)
+{
+    if (chunk_pos >= chunk.size() && !load_chunk(next_chunk))
+        return NULL;
+    *count = chunk.size() - chunk_pos;
+    trace_entry_t *entries = &chunk[chunk_pos];
+    chunk_pos = chunk.size();
+    return entries;
+}
+
+trace_entry_t *
+chunked_file_reader_t::read_next_entry()
+{
+    if (chunk_pos >= chunk.size() && !load_chunk(next_chunk))
+        return NULL;
+    return &chunk[chunk_pos++];
+}
+
+bool
+chunked_file_reader_t::skip_to_instruction(uint64_t ordinal)
+{
+    if (!valid)
+        return false;
+    // Binary search for the chunk containing the instruction.
+    size_t lo = 0, hi = index.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index[mid].first_instr + index[mid].instr_count <= ordinal)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == index.size() || index[lo].first_instr > ordinal)
+        return false;
+    const chunked_trace_index_t &entry = index[lo];
+    if (!load_chunk(lo))
+        return false;
+    // The first chunk starts with the header, which only init() processes.
+    if (lo == 0 && !chunk.empty() && chunk[0].type == TRACE_TYPE_HEADER)
+        chunk_pos = 1;
+    set_seek_state((memref_tid_t)entry.tid, (memref_pid_t)entry.pid,
+                   (addr_t)entry.cur_pc, (addr_t)entry.next_pc, entry.first_instr);
+    // XXX: a chunk starting between a flush entry and its _END entry will not
+    // have the flush's start address: we live with that rare inaccuracy.
+    at_eof = false;
+    // Advance to the chunk's first instruction, whose ordinal is first_instr.
+    for (++*this; !at_eof; ++*this) {
+        const memref_t &memref = **this;
+        if (type_is_instr(memref.instr.type) ||
+            memref.instr.type == TRACE_TYPE_INSTR_NO_FETCH)
+            break;
+    }
+    if (at_eof)
+        return false;
+    skip_instructions(ordinal - entry.first_instr);
+    return !at_eof;
+}
+
+reader_t&
+chunked_file_reader_t::skip_instructions(uint64_t instruction_count)
+{
+    if (at_eof || instruction_count == 0)
+        return *this;
+    const memref_t &memref = **this;
+    bool on_instr = type_is_instr(memref.instr.type) ||
+        memref.instr.type == TRACE_TYPE_INSTR_NO_FETCH;
+    // The ordinal of the instruction we will end up at.
+    uint64_t target = get_instruction_count() + instruction_count - (on_instr ? 1 : 0);
+    if (next_chunk == 0 || next_chunk > index.size() ||
+        target < index[(size_t)next_chunk - 1].first_instr +
+        index[(size_t)next_chunk - 1].instr_count)
+        return reader_t::skip_instructions(instruction_count);
+    if (!skip_to_instruction(target))
+        at_eof = true;
+    return *this;
+}
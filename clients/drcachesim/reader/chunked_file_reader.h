@@ -0,0 +1,95 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* chunked_file_reader: reads a trace file in the chunked, indexed format
+ * described in chunked_trace.h, supporting seeking by instruction ordinal.
+ */
+
+#ifndef _CHUNKED_FILE_READER_H_
+#define _CHUNKED_FILE_READER_H_ 1
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "reader.h"
+#include "../common/chunked_trace.h"
+#include "../common/memref.h"
+#include "../common/trace_entry.h"
+
+class chunked_file_reader_t : public reader_t
+{
+ public:
+    chunked_file_reader_t();
+    explicit chunked_file_reader_t(const char *file_name);
+    virtual ~chunked_file_reader_t();
+    virtual bool init();
+    virtual bool is_complete();
+    virtual bool operator!();
+
+    // Positions the reader at the instruction with the given 0-based ordinal
+    // (counted as described for chunked_trace_instr_count()), decompressing only
+    // the chunk containing it.  Returns false if there is no such instruction.
+    bool skip_to_instruction(uint64_t ordinal);
+
+    // Uses the index to avoid decompressing chunks entirely within the skipped
+    // instructions.
+    virtual reader_t& skip_instructions(uint64_t instruction_count);
+
+    // The index of chunks, which can be used to decompress chunks in parallel.
+    const std::vector<chunked_trace_index_t> &get_index() const
+    {
+        return index;
+    }
+
+    static bool is_chunked_file(const std::string &path);
+
+ protected:
+    virtual trace_entry_t * read_next_entry();
+    virtual trace_entry_t * read_next_entries(size_t *count);
+
+ private:
+    bool load_chunk(uint64_t chunk_idx);
+
+    std::ifstream file;
+    bool valid;
+    uint32_t chunk_entries;
+    std::vector<chunked_trace_index_t> index;
+    std::vector<chunked_trace_thread_t> threads;
+    std::vector<char> compressed;
+    std::vector<trace_entry_t> chunk;
+    // The index of the next chunk to load.
+    uint64_t next_chunk;
+    // The position in chunk of the next entry to return.
+    size_t chunk_pos;
+};
+
+#endif /* _CHUNKED_FILE_READER_H_ */
@@ -0,0 +1,192 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string.h>
+#include "compact_file_reader.h"
+#include "../common/memref.h"
+#include "../common/utils.h"
+
+compact_file_reader_t::compact_file_reader_t() :
+#ifdef HAS_ZLIB
+    file(NULL),
+#endif
+    valid(false), in_pos(0), in_end(0)
+{
+    /* Empty. */
+}
+
+compact_file_reader_t::compact_file_reader_t(const char *file_name) :
+#ifdef HAS_ZLIB
+    file(gzopen(file_name, "rb")),
+#else
+    file(file_name, std::ifstream::binary),
+#endif
+    valid(false), in(BUF_SIZE * COMPACT_TRACE_MAX_RECORD), in_pos(0), in_end(0)
+{
+#ifdef HAS_ZLIB
+    if (file == NULL)
+        return;
+#endif
+    compact_trace_header_t header;
+    if (read_bytes((unsigned char *)&header, sizeof(header)) != sizeof(header) ||
+        header.magic != COMPACT_TRACE_MAGIC || header.version != COMPACT_TRACE_VERSION)
+        return;
+    if (header.addr_size != sizeof(addr_t)) {
+        ERRMSG("compact trace was written for a different address size\n");
+        return;
+    }
+    valid = true;
+}
+
+compact_file_reader_t::~compact_file_reader_t()
+{
+#ifdef HAS_ZLIB
+    if (file != NULL)
+        gzclose(file);
+#endif
+}
+
+bool
+compact_file_reader_t::is_compact_file(const std::string &path)
+{
+    // For a gzipped file we look at the uncompressed data, as gzread passes
+    // through a file that is not compressed.
+    uint64_t magic;
+#ifdef HAS_ZLIB
+    gzFile f = gzopen(path.c_str(), "rb");
+    if (f == NULL)
+        return false;
+    int len = gzread(f, (char *)&magic, sizeof(magic));
+    gzclose(f);
+    return len == (int)sizeof(magic) && magic == COMPACT_TRACE_MAGIC;
+#else
+    std::ifstream f(path.c_str(), std::ifstream::binary);
+    return f.read((char *)&magic, sizeof(magic)) && magic == COMPACT_TRACE_MAGIC;
+#endif
+}
+
+size_t
+compact_file_reader_t::read_bytes(unsigned char *dest, size_t size)
+{
+#ifdef HAS_ZLIB
+    int len = gzread(file, (char *)dest, (unsigned int)size);
+    return len < 0 ? 0 : (size_t)len;
+#else
+    file.read((char *)dest, size);
+    return (size_t)file.gcount();
+#endif
+}
+
+// Moves the undecoded bytes to the front of the buffer and reads more after
+// them.  Returns false if nothing more could be read.
+bool
+compact_file_reader_t::fill()
+{
+    memmove(in.data(), in.data() + in_pos, in_end - in_pos);
+    in_end -= in_pos;
+    in_pos = 0;
+    size_t len = read_bytes(in.data() + in_end, in.size() - in_end);
+    in_end += len;
+    return len > 0;
+}
+
+bool
+compact_file_reader_t::operator!()
+{
+    return !valid;
+}
+
+bool
+compact_file_reader_t::init()
+{
+    at_eof = false;
+    if (!valid)
+        return false;
+    trace_entry_t *first_entry = read_next_entry();
+    if (first_entry == NULL)
+        return false;
+    if (first_entry->type != TRACE_TYPE_HEADER ||
+        first_entry->addr != TRACE_ENTRY_VERSION) {
+        ERRMSG("missing header or version mismatch\n");
+        return false;
+    }
+    ++*this;
+    return true;
+}
+
+trace_entry_t *
+compact_file_reader_t::read_next_entry()
+{
+    while (true) {
+        int len = codec.decode(in.data() + in_pos, in_end - in_pos, &entry_copy);
+        if (len > 0) {
+            in_pos += len;
+            return &entry_copy;
+        }
+        if (len < 0) {
+            ERRMSG("malformed compact trace record\n");
+            return NULL;
+        }
+        if (!fill())
+            return NULL;
+    }
+}
+
+trace_entry_t *
+compact_file_reader_t::read_next_entries(size_t *count)
+{
+    *count = 0;
+    while (*count < BUF_SIZE) {
+        int len = codec.decode(in.data() + in_pos, in_end - in_pos, &buf[*count]);
+        if (len > 0) {
+            in_pos += len;
+            ++*count;
+            continue;
+        }
+        if (len < 0) {
+            ERRMSG("malformed compact trace record\n");
+            break;
+        }
+        // Return what we have rather than waiting on more input.
+        if (*count > 0 || !fill())
+            break;
+    }
+    return *count == 0 ? NULL : buf;
+}
+
+bool
+compact_file_reader_t::is_complete()
+{
+    // As with compressed_file_reader_t, there is no efficient way to find the
+    // footer without decoding the whole file.
+    return false;
+}
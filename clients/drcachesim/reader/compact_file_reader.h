@@ -0,0 +1,91 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* compact_file_reader: reads a trace file in the compact encoding described in
+ * compact_trace.h, which may itself be gzip-compressed if zlib is available.
+ */
+
+#ifndef _COMPACT_FILE_READER_H_
+#define _COMPACT_FILE_READER_H_ 1
+
+#include <string>
+#include <vector>
+#ifdef HAS_ZLIB
+# include <zlib.h>
+#else
+# include <fstream>
+#endif
+#include "reader.h"
+#include "../common/compact_trace.h"
+#include "../common/memref.h"
+#include "../common/trace_entry.h"
+
+class compact_file_reader_t : public reader_t
+{
+ public:
+    compact_file_reader_t();
+    explicit compact_file_reader_t(const char *file_name);
+    virtual ~compact_file_reader_t();
+    virtual bool init();
+    virtual bool is_complete();
+    virtual bool operator!();
+
+    static bool is_compact_file(const std::string &path);
+
+ protected:
+    virtual trace_entry_t * read_next_entry();
+    virtual trace_entry_t * read_next_entries(size_t *count);
+
+ private:
+    // Returns the number of bytes read, which is less than size only at the end
+    // of the file or on an error.
+    size_t read_bytes(unsigned char *dest, size_t size);
+    bool fill();
+
+#ifdef HAS_ZLIB
+    gzFile file;
+#else
+    std::ifstream file;
+#endif
+    bool valid;
+    compact_trace_codec_t codec;
+    // The encoded bytes read but not yet decoded are in [in_pos, in_end).
+    std::vector<unsigned char> in;
+    size_t in_pos;
+    size_t in_end;
+    trace_entry_t entry_copy;
+    // We decode in large chunks to reduce the per-entry overhead.
+    static const int BUF_SIZE = 4096;
+    trace_entry_t buf[BUF_SIZE];
+};
+
+#endif /* _COMPACT_FILE_READER_H_ */
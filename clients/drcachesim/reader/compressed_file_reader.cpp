@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2017-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -84,6 +84,17 @@ compressed_file_reader_t::read_next_entry()
     return &entry_copy;
 }
 
+trace_entry_t *
+compressed_file_reader_t::read_next_entries(size_t *count)
+{
+    int len = gzread(file, (char*)buf, sizeof(buf));
+    // Returns less than asked-for for end of file, or –1 for error.
+    if (len < (int)sizeof(buf[0]))
+        return NULL;
+    *count = len / sizeof(buf[0]);
+    return buf;
+}
+
 bool
 compressed_file_reader_t::is_complete()
 {
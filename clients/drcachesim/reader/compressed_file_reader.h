@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2017-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -51,10 +51,14 @@ class compressed_file_reader_t : public reader_t
 
  protected:
     virtual trace_entry_t * read_next_entry();
+    virtual trace_entry_t * read_next_entries(size_t *count);
 
  private:
     gzFile file;
     trace_entry_t entry_copy;
+    // We read in large chunks to reduce the per-entry overhead.
+    static const int BUF_SIZE = 4096;
+    trace_entry_t buf[BUF_SIZE];
 };
 
 #endif /* _COMPRESSED_FILE_READER_H_ */
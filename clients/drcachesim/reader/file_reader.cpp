@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2016-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2016-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -82,6 +82,17 @@ file_reader_t::read_next_entry()
     return &entry_copy;
 }
 
+trace_entry_t *
+file_reader_t::read_next_entries(size_t *count)
+{
+    // A partial final read still returns its complete entries.
+    fstream.read((char*)buf, sizeof(buf));
+    *count = (size_t)fstream.gcount() / sizeof(buf[0]);
+    if (*count == 0)
+        return NULL;
+    return buf;
+}
+
 bool
 file_reader_t::is_complete()
 {
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2016-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2016-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -54,10 +54,14 @@ class file_reader_t : public reader_t
 
  protected:
     virtual trace_entry_t * read_next_entry();
+    virtual trace_entry_t * read_next_entries(size_t *count);
 
  private:
     std::ifstream fstream;
     trace_entry_t entry_copy;
+    // We read in large chunks to reduce the per-entry overhead.
+    static const int BUF_SIZE = 4096;
+    trace_entry_t buf[BUF_SIZE];
 };
 
 #endif /* _FILE_READER_H_ */
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2015-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2015-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -66,7 +66,7 @@ ipc_reader_t::get_pipe_name() const
 }
 
 bool
-ipc_reader_t::init()
+ipc_reader_t::init_raw()
 {
     at_eof = false;
     if (!creation_success ||
@@ -75,6 +75,14 @@ ipc_reader_t::init()
     pipe.maximize_buffer();
     cur_buf = buf;
     end_buf = buf;
+    return true;
+}
+
+bool
+ipc_reader_t::init()
+{
+    if (!init_raw())
+        return false;
     ++*this;
     return true;
 }
@@ -96,6 +104,7 @@ ipc_reader_t::read_next_entry()
             // end (we could at least ensure the prior entry was a thread exit
             // I suppose).
             cur_buf = buf;
+            end_buf = buf + 1;
             cur_buf->type = TRACE_TYPE_FOOTER;
             cur_buf->size = 0;
             cur_buf->addr = 0;
@@ -106,3 +115,13 @@ ipc_reader_t::read_next_entry()
     }
     return cur_buf;
 }
+
+trace_entry_t *
+ipc_reader_t::read_next_entries(size_t *count)
+{
+    // We hand out the rest of the current buffer all at once.
+    trace_entry_t *next = read_next_entry();
+    *count = end_buf - next;
+    cur_buf = end_buf - 1;
+    return next;
+}
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2015-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2015-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -52,10 +52,13 @@ class ipc_reader_t : public reader_t
     virtual bool operator!();
     // This potentially blocks.
     virtual bool init();
+    // This potentially blocks.
+    virtual bool init_raw();
     std::string get_pipe_name() const;
 
  protected:
     virtual trace_entry_t * read_next_entry();
+    virtual trace_entry_t * read_next_entries(size_t *count);
 
  private:
     named_pipe_t pipe;
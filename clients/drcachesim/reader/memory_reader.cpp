@@ -0,0 +1,93 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "memory_reader.h"
+#include "../common/memref.h"
+#include "../common/utils.h"
+
+memory_reader_t::memory_reader_t() : entries(NULL), count(0), cur(0)
+{
+    /* Empty. */
+}
+
+memory_reader_t::memory_reader_t(const trace_entry_t *entries_in, size_t count_in) :
+    entries(const_cast<trace_entry_t *>(entries_in)), count(count_in), cur(0)
+{
+    /* Empty. */
+}
+
+memory_reader_t::~memory_reader_t()
+{
+    /* Empty. */
+}
+
+bool
+memory_reader_t::init()
+{
+    at_eof = false;
+    trace_entry_t *first_entry = read_next_entry();
+    if (first_entry == NULL)
+        return false;
+    if (first_entry->type != TRACE_TYPE_HEADER ||
+        first_entry->addr != TRACE_ENTRY_VERSION) {
+        ERRMSG("missing header or version mismatch\n");
+        return false;
+    }
+    ++*this;
+    return true;
+}
+
+trace_entry_t *
+memory_reader_t::read_next_entries(size_t *count_out)
+{
+    // Everything is already in memory, so we hand out the rest at once.
+    if (cur >= count)
+        return NULL;
+    *count_out = count - cur;
+    trace_entry_t *res = &entries[cur];
+    cur = count;
+    return res;
+}
+
+trace_entry_t *
+memory_reader_t::read_next_entry()
+{
+    if (cur >= count)
+        return NULL;
+    return &entries[cur++];
+}
+
+bool
+memory_reader_t::is_complete()
+{
+    return count > 0 && entries[count - 1].type == TRACE_TYPE_FOOTER;
+}
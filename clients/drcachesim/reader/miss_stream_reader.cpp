@@ -0,0 +1,127 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string.h>
+#include "miss_stream_reader.h"
+
+miss_stream_reader_t::miss_stream_reader_t(const std::string &path) :
+    success(false), with_tid_and_time(false), buf(64*1024), buf_pos(0), buf_end(0)
+{
+    memset(&last, 0, sizeof(last));
+#ifdef HAS_ZLIB
+    // gzread transparently reads uncompressed files as well.
+    file = gzopen(path.c_str(), "rb");
+#else
+    file = fopen(path.c_str(), "rb");
+#endif
+    if (file == nullptr)
+        return;
+    unsigned char header[MISS_STREAM_HEADER_SIZE];
+    for (size_t i = 0; i < sizeof(header); i++) {
+        if (buf_pos == buf_end && !refill())
+            return;
+        header[i] = buf[buf_pos++];
+    }
+    if (memcmp(header, MISS_STREAM_MAGIC, MISS_STREAM_MAGIC_SIZE) != 0 ||
+        header[MISS_STREAM_MAGIC_SIZE] != MISS_STREAM_VERSION)
+        return;
+    with_tid_and_time =
+        (header[MISS_STREAM_MAGIC_SIZE + 1] & MISS_STREAM_FLAG_TID_TIME) != 0;
+    success = true;
+}
+
+miss_stream_reader_t::~miss_stream_reader_t()
+{
+    if (file != nullptr) {
+#ifdef HAS_ZLIB
+        gzclose(file);
+#else
+        fclose(file);
+#endif
+    }
+}
+
+bool
+miss_stream_reader_t::refill()
+{
+#ifdef HAS_ZLIB
+    int got = gzread(file, buf.data(), (unsigned int)buf.size());
+    if (got <= 0)
+        return false;
+#else
+    size_t got = fread(buf.data(), 1, buf.size(), file);
+    if (got == 0)
+        return false;
+#endif
+    buf_pos = 0;
+    buf_end = (size_t)got;
+    return true;
+}
+
+bool
+miss_stream_reader_t::read_varint(uint64_t *val)
+{
+    uint64_t res = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (buf_pos == buf_end && !refill())
+            return false;
+        unsigned char byte = buf[buf_pos++];
+        res |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *val = res;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool
+miss_stream_reader_t::next(miss_record_t *record)
+{
+    if (!success)
+        return false;
+    if (buf_pos == buf_end && !refill())
+        return false; // A clean end of the stream.
+    uint64_t pc_delta, addr_delta, tid_delta = 0, time_delta = 0;
+    if (!read_varint(&pc_delta) || !read_varint(&addr_delta) ||
+        (with_tid_and_time &&
+         (!read_varint(&tid_delta) || !read_varint(&time_delta)))) {
+        success = false;
+        return false;
+    }
+    last.pc += (addr_t)miss_stream_unzigzag(pc_delta);
+    last.addr += (addr_t)miss_stream_unzigzag(addr_delta);
+    last.tid += (memref_tid_t)miss_stream_unzigzag(tid_delta);
+    last.timestamp += (uint64_t)miss_stream_unzigzag(time_delta);
+    *record = last;
+    return true;
+}
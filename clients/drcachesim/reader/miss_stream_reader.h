@@ -0,0 +1,95 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* miss_stream_reader: reads a binary cache miss stream. */
+
+#ifndef _MISS_STREAM_READER_H_
+#define _MISS_STREAM_READER_H_ 1
+
+/**
+ * @file drmemtrace/miss_stream_reader.h
+ * @brief DrMemtrace binary cache miss stream reader.
+ */
+
+#include <string>
+#include <vector>
+#include <stdio.h>
+#ifdef HAS_ZLIB
+# include <zlib.h>
+#endif
+#include "miss_stream.h"
+
+/**
+ * Reads the misses written by the cache simulator's -LL_miss_file option with
+ * -LL_miss_format binary, whose format is described in miss_stream.h.  The file
+ * may be gzip-compressed if this reader is linked with zlib.
+ */
+class miss_stream_reader_t
+{
+ public:
+    /**
+     * Opens the stream at path and reads its header.  Check for failure with
+     * operator!().
+     */
+    explicit miss_stream_reader_t(const std::string &path);
+    ~miss_stream_reader_t();
+    /**
+     * Returns whether the file could not be opened or has an invalid header, or
+     * whether next() encountered a truncated record.
+     */
+    bool operator!() { return !success; }
+    /** Returns whether each record holds a thread id and timestamp. */
+    bool has_tid_and_time() const { return with_tid_and_time; }
+    /**
+     * Reads the next miss into *record.  Returns false at the end of the stream
+     * or on an error, which can be distinguished with operator!().
+     */
+    bool next(miss_record_t *record);
+
+ private:
+    bool refill();
+    bool read_varint(uint64_t *val);
+
+#ifdef HAS_ZLIB
+    gzFile file;
+#else
+    FILE *file;
+#endif
+    bool success;
+    bool with_tid_and_time;
+    std::vector<unsigned char> buf;
+    size_t buf_pos;
+    size_t buf_end;
+    miss_record_t last;
+};
+
+#endif /* _MISS_STREAM_READER_H_ */
@@ -0,0 +1,267 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <assert.h>
+#ifdef UNIX
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+#include "mmap_file_reader.h"
+#include "../common/memref.h"
+#include "../common/utils.h"
+
+#ifdef VERBOSE
+# include <iostream>
+#endif
+
+#ifdef UNIX
+
+mmap_file_reader_t::mmap_file_reader_t() : fd(-1), opened(false), file_size(0),
+    cur_offset(0), window_base(NULL), window_offset(0), window_size(0),
+    granularity(0)
+{
+    /* Empty. */
+}
+
+mmap_file_reader_t::mmap_file_reader_t(const char *file_name) : fd(-1),
+    opened(false), file_size(0), cur_offset(0), window_base(NULL), window_offset(0),
+    window_size(0)
+{
+    granularity = (size_t)sysconf(_SC_PAGESIZE);
+    fd = open(file_name, O_RDONLY);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+        return;
+    file_size = (uint64_t)st.st_size;
+    opened = true;
+}
+
+mmap_file_reader_t::~mmap_file_reader_t()
+{
+    unmap_window();
+    if (fd >= 0)
+        close(fd);
+}
+
+bool
+mmap_file_reader_t::map_window(uint64_t offset)
+{
+    unmap_window();
+    window_offset = offset - (offset % granularity);
+    window_size = WINDOW_SIZE;
+    if (window_offset + window_size > file_size)
+        window_size = (size_t)(file_size - window_offset);
+    if (window_size == 0)
+        return false;
+    void *map = mmap(NULL, window_size, PROT_READ, MAP_PRIVATE, fd,
+                     (off_t)window_offset);
+    if (map == MAP_FAILED) {
+        window_size = 0;
+        return false;
+    }
+    window_base = (char *)map;
+    // We read sequentially.
+    madvise(window_base, window_size, MADV_SEQUENTIAL);
+    return true;
+}
+
+void
+mmap_file_reader_t::unmap_window()
+{
+    if (window_base != NULL) {
+        munmap(window_base, window_size);
+        window_base = NULL;
+    }
+}
+
+#else /* WINDOWS */
+
+mmap_file_reader_t::mmap_file_reader_t() : file(INVALID_HANDLE_VALUE), mapping(NULL),
+    opened(false), file_size(0), cur_offset(0), window_base(NULL), window_offset(0),
+    window_size(0), granularity(0)
+{
+    /* Empty. */
+}
+
+mmap_file_reader_t::mmap_file_reader_t(const char *file_name) :
+    file(INVALID_HANDLE_VALUE), mapping(NULL), opened(false), file_size(0),
+    cur_offset(0), window_base(NULL), window_offset(0), window_size(0)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    // Views must start at a multiple of the allocation granularity.
+    granularity = info.dwAllocationGranularity;
+    file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                       FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+        return;
+    file_size = (uint64_t)size.QuadPart;
+    if (file_size == 0)
+        return; // CreateFileMapping fails on an empty file.
+    mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+        return;
+    opened = true;
+}
+
+mmap_file_reader_t::~mmap_file_reader_t()
+{
+    unmap_window();
+    if (mapping != NULL)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+}
+
+bool
+mmap_file_reader_t::map_window(uint64_t offset)
+{
+    unmap_window();
+    window_offset = offset - (offset % granularity);
+    window_size = WINDOW_SIZE;
+    if (window_offset + window_size > file_size)
+        window_size = (size_t)(file_size - window_offset);
+    if (window_size == 0)
+        return false;
+    window_base = (char *)MapViewOfFile(mapping, FILE_MAP_READ,
+                                        (DWORD)(window_offset >> 32),
+                                        (DWORD)window_offset, window_size);
+    if (window_base == NULL) {
+        window_size = 0;
+        return false;
+    }
+    return true;
+}
+
+void
+mmap_file_reader_t::unmap_window()
+{
+    if (window_base != NULL) {
+        UnmapViewOfFile(window_base);
+        window_base = NULL;
+    }
+}
+
+#endif
+
+bool
+mmap_file_reader_t::operator!()
+{
+    return !opened;
+}
+
+bool
+mmap_file_reader_t::init()
+{
+    at_eof = false;
+    if (!opened)
+        return false;
+    trace_entry_t *first_entry = read_next_entry();
+    if (first_entry == NULL)
+        return false;
+    if (first_entry->type != TRACE_TYPE_HEADER ||
+        first_entry->addr != TRACE_ENTRY_VERSION) {
+        ERRMSG("missing header or version mismatch\n");
+        return false;
+    }
+    ++*this;
+    return true;
+}
+
+trace_entry_t *
+mmap_file_reader_t::read_next_entries(size_t *count)
+{
+    if (cur_offset + sizeof(trace_entry_t) > file_size)
+        return NULL;
+    // We keep the current window until it has no complete entry left, as the
+    // caller may still be using the prior batch.
+    if (window_base == NULL || cur_offset < window_offset ||
+        cur_offset + sizeof(trace_entry_t) > window_offset + window_size) {
+        if (!map_window(cur_offset))
+            return NULL;
+    }
+    size_t in_window = (size_t)(window_offset + window_size - cur_offset);
+    *count = in_window / sizeof(trace_entry_t);
+    trace_entry_t *entries = (trace_entry_t *)(window_base + (cur_offset -
+                                                              window_offset));
+    cur_offset += *count * sizeof(trace_entry_t);
+    return entries;
+}
+
+trace_entry_t *
+mmap_file_reader_t::read_next_entry()
+{
+    if (cur_offset + sizeof(trace_entry_t) > file_size)
+        return NULL;
+    if (window_base == NULL || cur_offset < window_offset ||
+        cur_offset + sizeof(trace_entry_t) > window_offset + window_size) {
+        if (!map_window(cur_offset))
+            return NULL;
+    }
+    trace_entry_t *entry = (trace_entry_t *)(window_base + (cur_offset -
+                                                            window_offset));
+    cur_offset += sizeof(trace_entry_t);
+    return entry;
+}
+
+bool
+mmap_file_reader_t::is_complete()
+{
+    if (!opened || file_size < sizeof(trace_entry_t))
+        return false;
+    // We read the final entry via a separate window so as not to disturb the
+    // current one.
+    uint64_t last = file_size - sizeof(trace_entry_t);
+    if (last % sizeof(trace_entry_t) != 0)
+        return false;
+    char *save_base = window_base;
+    uint64_t save_offset = window_offset;
+    size_t save_size = window_size;
+    window_base = NULL;
+    bool res = false;
+    if (map_window(last)) {
+        trace_entry_t *entry = (trace_entry_t *)(window_base + (last - window_offset));
+        res = entry->type == TRACE_TYPE_FOOTER;
+        unmap_window();
+    }
+    window_base = save_base;
+    window_offset = save_offset;
+    window_size = save_size;
+    return res;
+}
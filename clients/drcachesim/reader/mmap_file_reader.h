@@ -0,0 +1,87 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* mmap_file_reader: reads an uncompressed trace file by mapping it into memory
+ * and iterating over its entries in place, avoiding a copy per entry.
+ */
+
+#ifndef _MMAP_FILE_READER_H_
+#define _MMAP_FILE_READER_H_ 1
+
+#ifdef WINDOWS
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#endif
+#include <stdint.h>
+#include <string>
+#include "reader.h"
+#include "../common/memref.h"
+#include "../common/trace_entry.h"
+
+class mmap_file_reader_t : public reader_t
+{
+ public:
+    mmap_file_reader_t();
+    explicit mmap_file_reader_t(const char *file_name);
+    virtual ~mmap_file_reader_t();
+    virtual bool init();
+    virtual bool is_complete();
+    virtual bool operator!();
+
+ protected:
+    virtual trace_entry_t * read_next_entry();
+    virtual trace_entry_t * read_next_entries(size_t *count);
+
+ private:
+    bool map_window(uint64_t offset);
+    void unmap_window();
+
+    // We map the file a window at a time to bound our address space usage for
+    // large traces, which matters for 32-bit.
+    static const size_t WINDOW_SIZE = 64 * 1024 * 1024;
+#ifdef WINDOWS
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    bool opened;
+    uint64_t file_size;
+    // The file offset of the next entry to return.
+    uint64_t cur_offset;
+    char *window_base;
+    uint64_t window_offset;
+    size_t window_size;
+    size_t granularity;
+};
+
+#endif /* _MMAP_FILE_READER_H_ */
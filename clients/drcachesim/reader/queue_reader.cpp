@@ -0,0 +1,128 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <utility>
+#include "queue_reader.h"
+#include "../common/memref.h"
+#include "../common/utils.h"
+
+queue_reader_t::queue_reader_t() : max_batches(0), done(true), cur(0)
+{
+    /* Empty. */
+}
+
+queue_reader_t::queue_reader_t(size_t max_batches_in) :
+    max_batches(max_batches_in), done(false), cur(0)
+{
+    /* Empty. */
+}
+
+queue_reader_t::~queue_reader_t()
+{
+    /* Empty. */
+}
+
+bool
+queue_reader_t::init()
+{
+    at_eof = false;
+    ++*this;
+    return true;
+}
+
+void
+queue_reader_t::push(std::vector<trace_entry_t> *batch)
+{
+    if (batch->empty())
+        return;
+    {
+        // We bound the memory held for a consumer that falls behind.
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return queue.size() < max_batches; });
+        queue.push_back(std::move(*batch));
+    }
+    cond.notify_all();
+    batch->clear();
+}
+
+void
+queue_reader_t::finish()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    cond.notify_all();
+}
+
+bool
+queue_reader_t::next_batch()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [this] { return !queue.empty() || done; });
+        if (queue.empty())
+            return false;
+        cur_batch = std::move(queue.front());
+        queue.pop_front();
+    }
+    cond.notify_all();
+    cur = 0;
+    return true;
+}
+
+trace_entry_t *
+queue_reader_t::read_next_entry()
+{
+    if (cur >= cur_batch.size() && !next_batch()) {
+        // Like ipc_reader_t, we end the stream with a footer.
+        footer.type = TRACE_TYPE_FOOTER;
+        footer.size = 0;
+        footer.addr = 0;
+        return &footer;
+    }
+    return &cur_batch[cur++];
+}
+
+trace_entry_t *
+queue_reader_t::read_next_entries(size_t *count)
+{
+    // We hand out the rest of the current batch all at once.
+    trace_entry_t *next = read_next_entry();
+    if (next == &footer) {
+        *count = 1;
+        return next;
+    }
+    *count = cur_batch.size() - (cur - 1);
+    cur = cur_batch.size();
+    return next;
+}
@@ -0,0 +1,86 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* queue_reader: iterates over batches of entries handed to it by another
+ * thread, such as one application thread's share of an online trace.
+ */
+
+#ifndef _QUEUE_READER_H_
+#define _QUEUE_READER_H_ 1
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stddef.h>
+#include <vector>
+#include "reader.h"
+#include "../common/memref.h"
+#include "../common/trace_entry.h"
+
+// The producer calls push() and then finish(), while the consumer iterates,
+// blocking whenever the queue is empty.  As with ipc_reader_t, no header is
+// expected at the start of the entries.
+class queue_reader_t : public reader_t
+{
+ public:
+    queue_reader_t();
+    // Up to max_batches batches are held before push() waits for the consumer.
+    explicit queue_reader_t(size_t max_batches);
+    virtual ~queue_reader_t();
+    // This blocks until the first record arrives.
+    virtual bool init();
+    // Appends a batch, leaving the vector empty.
+    void push(std::vector<trace_entry_t> *batch);
+    // Indicates that no more batches will be pushed.
+    void finish();
+
+ protected:
+    virtual trace_entry_t * read_next_entry();
+    virtual trace_entry_t * read_next_entries(size_t *count);
+
+ private:
+    // Replaces cur_batch with the next queued batch, returning false at the end.
+    bool next_batch();
+
+    size_t max_batches;
+    std::deque<std::vector<trace_entry_t> > queue;
+    bool done;
+    std::mutex mutex;
+    std::condition_variable cond;
+    // The batch being consumed, owned by the consumer, and the index of its
+    // next entry.
+    std::vector<trace_entry_t> cur_batch;
+    size_t cur;
+    trace_entry_t footer;
+};
+
+#endif /* _QUEUE_READER_H_ */
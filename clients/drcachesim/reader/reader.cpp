@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2016-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2016-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -41,12 +41,138 @@
 
 // Following typical stream iterator convention, the default constructor
 // produces an EOF object.
-reader_t::reader_t() : at_eof(true), input_entry(NULL), cur_tid(0), cur_pid(0),
-                       cur_pc(0), prev_instr_addr(0), bundle_idx(0)
+reader_t::reader_t() : at_eof(true), input_entry(NULL), batch_cur(NULL),
+                       batch_end(NULL), cur_tid(0), cur_pid(0), cur_pc(0),
+                       prev_instr_addr(0), bundle_idx(0), range_value(0),
+                       range_remaining(0), reuse_entry(false),
+                       repeat_iterations(0), repeat_iter(0), repeat_pos(0),
+                       cur_instr_count(0)
 {
     /* Empty. */
 }
 
+trace_entry_t *
+reader_t::read_next_entries(size_t *count)
+{
+    *count = 1;
+    return read_next_entry();
+}
+
+void
+reader_t::set_seek_state(memref_tid_t tid, memref_pid_t pid, addr_t pc, addr_t next,
+                         uint64_t instr_count)
+{
+    cur_instr_count = instr_count;
+    batch_cur = NULL;
+    batch_end = NULL;
+    bundle_idx = 0;
+    range_value = 0;
+    range_remaining = 0;
+    reuse_entry = false;
+    repeat_iterations = 0;
+    repeat_iter = 0;
+    repeat_pos = 0;
+    cur_tid = tid;
+    cur_pid = pid;
+    cur_pc = pc;
+    next_pc = next;
+    // The bundle handling expects the prior instruction to have been an
+    // instruction, as it always is in a regular pass.
+    cur_ref.instr.type = TRACE_TYPE_INSTR;
+}
+
+void
+reader_t::add_thread_pid(memref_tid_t tid, memref_pid_t pid)
+{
+    tid2pid[tid] = pid;
+}
+
+trace_entry_t *
+reader_t::read_input_entry()
+{
+    if (batch_cur == batch_end) {
+        size_t count;
+        batch_cur = read_next_entries(&count);
+        batch_end = (batch_cur == NULL) ? NULL : batch_cur + count;
+    }
+    trace_entry_t *entry = batch_cur;
+    if (batch_cur != NULL)
+        ++batch_cur;
+    return entry;
+}
+
+// Reads the strides and the first iteration of the repeat sequence whose
+// TRACE_MARKER_TYPE_REPEAT marker holds value.
+bool
+reader_t::start_repeat(addr_t value)
+{
+    size_t body_size = (size_t)(value & ((1 << TRACE_REPEAT_BODY_BITS) - 1));
+    repeat_iterations = value >> TRACE_REPEAT_BODY_BITS;
+    repeat_iter = 0;
+    repeat_pos = 0;
+    repeat_body.clear();
+    repeat_strides.clear();
+    std::vector<addr_t> data_strides;
+    while (repeat_body.size() < body_size) {
+        trace_entry_t *entry = read_input_entry();
+        if (entry == NULL)
+            return false;
+        if (repeat_body.empty() && entry->type == TRACE_TYPE_MARKER &&
+            entry->size == TRACE_MARKER_TYPE_REPEAT_STRIDE) {
+            data_strides.push_back(entry->addr);
+            continue;
+        }
+        repeat_body.push_back(*entry);
+    }
+    size_t data_idx = 0;
+    for (size_t i = 0; i < body_size; ++i) {
+        trace_type_t type = (trace_type_t) repeat_body[i].type;
+        addr_t stride = 0;
+        if (type == TRACE_TYPE_READ || type == TRACE_TYPE_WRITE ||
+            type_is_prefetch(type)) {
+            if (data_idx >= data_strides.size())
+                break;
+            stride = data_strides[data_idx++];
+        }
+        repeat_strides.push_back(stride);
+    }
+    if (body_size == 0 || data_idx != data_strides.size() ||
+        repeat_strides.size() != body_size) {
+        ERRMSG("Malformed repeat sequence\n");
+        repeat_iterations = 0;
+        return false;
+    }
+    return true;
+}
+
+trace_entry_t *
+reader_t::next_input_entry()
+{
+    if (reuse_entry) {
+        reuse_entry = false;
+        return input_entry;
+    }
+    while (repeat_iter >= repeat_iterations) {
+        trace_entry_t *entry = read_input_entry();
+        if (entry == NULL || entry->type != TRACE_TYPE_MARKER ||
+            entry->size != TRACE_MARKER_TYPE_REPEAT)
+            return entry;
+        if (!start_repeat(entry->addr))
+            return NULL;
+    }
+    trace_entry_t *entry = &repeat_body[repeat_pos];
+    if (repeat_strides[repeat_pos] != 0 && repeat_iter > 0) {
+        repeat_entry = *entry;
+        repeat_entry.addr += (addr_t)repeat_iter * repeat_strides[repeat_pos];
+        entry = &repeat_entry;
+    }
+    if (++repeat_pos == repeat_body.size()) {
+        repeat_pos = 0;
+        ++repeat_iter;
+    }
+    return entry;
+}
+
 const memref_t&
 reader_t::operator*()
 {
@@ -56,10 +182,22 @@ reader_t::operator*()
 reader_t&
 reader_t::operator++()
 {
+    if (range_remaining > 0) {
+        // The next iteration of a TRACE_MARKER_TYPE_MEMREF_RANGE.
+        assert(cur_ref.data.type == TRACE_TYPE_READ ||
+               cur_ref.data.type == TRACE_TYPE_WRITE);
+        if (TESTANY(1, range_value))
+            cur_ref.data.addr -= cur_ref.data.size;
+        else
+            cur_ref.data.addr += cur_ref.data.size;
+        if (--range_remaining == 0)
+            range_value = 0;
+        return *this;
+    }
     // We bail if we get a partial read, or EOF, or any error.
     while (true) {
         if (bundle_idx == 0/*not in instr bundle*/)
-            input_entry = read_next_entry();
+            input_entry = next_input_entry();
         if (input_entry == NULL) {
             ERRMSG("Trace is truncated\n");
             assert(false);
@@ -78,7 +216,9 @@ reader_t::operator++()
             " addr=" << (void *)input_entry->addr << std::endl;
 #endif
         bool have_memref = false;
-        switch (input_entry->type) {
+        // We do not modify *input_entry, which may be read-only memory.
+        trace_type_t type = (trace_type_t) input_entry->type;
+        switch (type) {
         case TRACE_TYPE_READ:
         case TRACE_TYPE_WRITE:
         case TRACE_TYPE_PREFETCH:
@@ -93,21 +233,34 @@ reader_t::operator++()
             assert(cur_tid != 0 && cur_pid != 0);
             cur_ref.data.pid = cur_pid;
             cur_ref.data.tid = cur_tid;
-            cur_ref.data.type = (trace_type_t) input_entry->type;
+            cur_ref.data.type = type;
             cur_ref.data.size = input_entry->size;
             cur_ref.data.addr = input_entry->addr;
             // The trace stream always has the instr fetch first, which we
             // use to obtain the PC for subsequent data references.
             cur_ref.data.pc = cur_pc;
+            if (range_value != 0) {
+                // We deliver the iterations in execution order, starting from
+                // the top for a downward loop.
+                addr_t bytes = range_value >> 1;
+                if (cur_ref.data.size > 0 && bytes >= cur_ref.data.size) {
+                    range_remaining = bytes / cur_ref.data.size - 1;
+                    if (TESTANY(1, range_value))
+                        cur_ref.data.addr += bytes - cur_ref.data.size;
+                } else
+                    range_value = 0;
+                if (range_remaining == 0)
+                    range_value = 0;
+            }
             break;
         case TRACE_TYPE_INSTR_MAYBE_FETCH:
             // While offline traces can convert rep string per-iter instrs into
             // no-fetch entries, online can't w/o extra work, so we do the work
             // here:
             if (prev_instr_addr == input_entry->addr)
-                input_entry->type = TRACE_TYPE_INSTR_NO_FETCH;
+                type = TRACE_TYPE_INSTR_NO_FETCH;
             else
-                input_entry->type = TRACE_TYPE_INSTR;
+                type = TRACE_TYPE_INSTR;
             ANNOTATE_FALLTHROUGH;
         case TRACE_TYPE_INSTR:
         case TRACE_TYPE_INSTR_DIRECT_JUMP:
@@ -128,12 +281,13 @@ reader_t::operator++()
                 have_memref = true;
                 cur_ref.instr.pid = cur_pid;
                 cur_ref.instr.tid = cur_tid;
-                cur_ref.instr.type = (trace_type_t) input_entry->type;
+                cur_ref.instr.type = type;
                 cur_ref.instr.size = input_entry->size;
                 cur_pc = input_entry->addr;
                 cur_ref.instr.addr = cur_pc;
                 next_pc = cur_pc + cur_ref.instr.size;
                 prev_instr_addr = input_entry->addr;
+                ++cur_instr_count;
             }
             break;
         case TRACE_TYPE_INSTR_BUNDLE:
@@ -145,6 +299,7 @@ reader_t::operator++()
             cur_pc = next_pc;
             cur_ref.instr.addr = cur_pc;
             next_pc = cur_pc + cur_ref.instr.size;
+            ++cur_instr_count;
             // input_entry->size stores the number of instrs in this bundle
             assert(input_entry->size <= sizeof(input_entry->length));
             if (bundle_idx == input_entry->size)
@@ -155,7 +310,7 @@ reader_t::operator++()
             assert(cur_tid != 0 && cur_pid != 0);
             cur_ref.flush.pid = cur_pid;
             cur_ref.flush.tid = cur_tid;
-            cur_ref.flush.type = (trace_type_t) input_entry->type;
+            cur_ref.flush.type = type;
             cur_ref.flush.size = input_entry->size;
             cur_ref.flush.addr = input_entry->addr;
             if (cur_ref.flush.size != 0)
@@ -180,7 +335,7 @@ reader_t::operator++()
             // We do pass this to the caller but only some fields are valid:
             cur_ref.exit.pid = cur_pid;
             cur_ref.exit.tid = cur_tid;
-            cur_ref.exit.type = (trace_type_t) input_entry->type;
+            cur_ref.exit.type = type;
             have_memref = true;
             break;
         case TRACE_TYPE_PID:
@@ -189,8 +344,13 @@ reader_t::operator++()
             tid2pid[cur_tid] = cur_pid;
             break;
         case TRACE_TYPE_MARKER:
+            if (input_entry->size == TRACE_MARKER_TYPE_MEMREF_RANGE) {
+                // We expand the range when its data reference arrives.
+                range_value = input_entry->addr;
+                break;
+            }
             have_memref = true;
-            cur_ref.marker.type = (trace_type_t) input_entry->type;
+            cur_ref.marker.type = type;
             assert(cur_tid != 0 && cur_pid != 0);
             cur_ref.marker.pid = cur_pid;
             cur_ref.marker.tid = cur_tid;
@@ -209,3 +369,105 @@ reader_t::operator++()
 
     return *this;
 }
+
+reader_t&
+reader_t::skip_instructions(uint64_t instruction_count)
+{
+    if (at_eof || instruction_count == 0)
+        return *this;
+    // Any range in progress belongs to the current instruction.
+    range_value = 0;
+    range_remaining = 0;
+    // The current record is the first instruction skipped, if it is one.
+    uint64_t remaining = instruction_count;
+    if (type_is_instr(cur_ref.instr.type) ||
+        cur_ref.instr.type == TRACE_TYPE_INSTR_NO_FETCH)
+        --remaining;
+    // Finish any bundle we're in the middle of.
+    while (bundle_idx != 0 && remaining > 0) {
+        cur_pc = next_pc;
+        next_pc = cur_pc + input_entry->length[bundle_idx++];
+        ++cur_instr_count;
+        --remaining;
+        if (bundle_idx == input_entry->size)
+            bundle_idx = 0;
+    }
+    // We walk the raw entries, tracking only the state needed to resume regular
+    // iteration, until we reach the first instruction not to skip.
+    while (bundle_idx == 0) {
+        input_entry = next_input_entry();
+        if (input_entry == NULL) {
+            ERRMSG("Trace is truncated\n");
+            assert(false);
+            at_eof = true; // bail
+            return *this;
+        }
+        switch (input_entry->type) {
+        case TRACE_TYPE_FOOTER:
+            at_eof = true;
+            return *this;
+        case TRACE_TYPE_INSTR_MAYBE_FETCH:
+        case TRACE_TYPE_INSTR:
+        case TRACE_TYPE_INSTR_DIRECT_JUMP:
+        case TRACE_TYPE_INSTR_INDIRECT_JUMP:
+        case TRACE_TYPE_INSTR_CONDITIONAL_JUMP:
+        case TRACE_TYPE_INSTR_DIRECT_CALL:
+        case TRACE_TYPE_INSTR_INDIRECT_CALL:
+        case TRACE_TYPE_INSTR_RETURN:
+        case TRACE_TYPE_INSTR_SYSENTER:
+        case TRACE_TYPE_INSTR_NO_FETCH:
+            if (input_entry->size == 0) {
+                cur_pc = input_entry->addr;
+                break;
+            }
+            if (remaining == 0) {
+                // Let operator++ process this one.
+                reuse_entry = true;
+                return ++*this;
+            }
+            --remaining;
+            cur_pc = input_entry->addr;
+            next_pc = cur_pc + input_entry->size;
+            prev_instr_addr = input_entry->addr;
+            cur_ref.instr.type = TRACE_TYPE_INSTR;
+            ++cur_instr_count;
+            break;
+        case TRACE_TYPE_INSTR_BUNDLE:
+            if (remaining >= input_entry->size) {
+                // We skip the whole bundle arithmetically.
+                for (int i = 0; i < input_entry->size; ++i)
+                    next_pc += input_entry->length[i];
+                cur_instr_count += input_entry->size;
+                remaining -= input_entry->size;
+                break;
+            }
+            for (; remaining > 0; --remaining) {
+                cur_pc = next_pc;
+                next_pc = cur_pc + input_entry->length[bundle_idx++];
+                ++cur_instr_count;
+            }
+            if (bundle_idx == 0) {
+                reuse_entry = true;
+                return ++*this;
+            }
+            break;
+        case TRACE_TYPE_THREAD:
+            cur_tid = (memref_tid_t) input_entry->addr;
+            cur_pid = tid2pid[cur_tid];
+            break;
+        case TRACE_TYPE_THREAD_EXIT:
+            cur_tid = (memref_tid_t) input_entry->addr;
+            cur_pid = tid2pid[cur_tid];
+            break;
+        case TRACE_TYPE_PID:
+            cur_pid = (memref_pid_t) input_entry->addr;
+            tid2pid[cur_tid] = cur_pid;
+            break;
+        default:
+            // Data references, flushes, and markers carry no state we need.
+            break;
+        }
+    }
+    // We stopped in the middle of a bundle: operator++ resumes from bundle_idx.
+    return ++*this;
+}
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2015-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2015-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -39,7 +39,9 @@
 
 #include <assert.h>
 #include <iterator>
+#include <stdint.h>
 #include <unordered_map>
+#include <vector>
 // For exporting we avoid "../common" and rely on -I.
 #include "memref.h"
 #include "utils.h"
@@ -53,6 +55,21 @@ class reader_t : public std::iterator<std::input_iterator_tag, memref_t>
     // This may block.
     virtual bool init() = 0;
 
+    // For a reader of an online stream whose entries are to be handed out raw
+    // rather than iterated over, such as to split them up by thread: opens the
+    // input like init() but without reading from it.  This may block.  Returns
+    // false if the reader does not support raw access.
+    virtual bool init_raw() {
+        return false;
+    }
+
+    // Returns the next batch of entries of a reader set up with init_raw(), as
+    // read_next_entries() does below.  A footer entry marks the end of the
+    // stream.  This must not be mixed with iteration.
+    trace_entry_t *read_raw_entries(size_t *count) {
+        return read_next_entries(count);
+    }
+
     virtual const memref_t& operator*();
 
     // To avoid double-dispatch (requires listing all derived types in the base here)
@@ -69,6 +86,19 @@ class reader_t : public std::iterator<std::input_iterator_tag, memref_t>
 
     virtual reader_t& operator++();
 
+    // Skips the next instruction_count instructions, where the current record
+    // counts as the first if it is an instruction, along with the non-instruction
+    // records among them.  The iterator is left at the instruction following the
+    // skipped ones.  This is much faster than repeated operator++ as records are
+    // not converted to memref_t and instruction bundles are skipped whole.
+    virtual reader_t& skip_instructions(uint64_t instruction_count);
+
+    // Returns the number of instructions read so far, including the current
+    // record if it is an instruction.
+    uint64_t get_instruction_count() const {
+        return cur_instr_count;
+    }
+
     // Supplied for subclasses that may fail in their constructors.
     virtual bool operator!() {
         return false;
@@ -82,11 +112,35 @@ class reader_t : public std::iterator<std::input_iterator_tag, memref_t>
 
  protected:
     virtual trace_entry_t * read_next_entry() = 0;
+    // Returns a pointer to an array of *count consecutive entries, or NULL on EOF
+    // or error.  The entries must remain valid until the next call.  This lets
+    // operator++ process a block of entries with a single virtual call; the
+    // default implementation returns one entry at a time from read_next_entry().
+    // A subclass overriding this should still implement read_next_entry(),
+    // which is used for the header prior to any batched reads.
+    virtual trace_entry_t * read_next_entries(size_t *count);
+
+    // For subclasses that can seek: discards any pending entries and sets the
+    // state that reading the entries prior to the new position would have
+    // accumulated.
+    // The instructions prior to the new position number instr_count.
+    void set_seek_state(memref_tid_t tid, memref_pid_t pid, addr_t pc, addr_t next,
+                        uint64_t instr_count);
+    // Records the process for a thread, as a TRACE_TYPE_PID entry would.
+    void add_thread_pid(memref_tid_t tid, memref_pid_t pid);
 
     bool at_eof;
 
  private:
+    // Returns the next entry to process, with TRACE_MARKER_TYPE_REPEAT sequences
+    // expanded, or NULL at the end of the input.
+    trace_entry_t *next_input_entry();
+    trace_entry_t *read_input_entry();
+    bool start_repeat(addr_t value);
+
     trace_entry_t *input_entry;
+    trace_entry_t *batch_cur;
+    trace_entry_t *batch_end;
     memref_t cur_ref;
     memref_tid_t cur_tid;
     memref_pid_t cur_pid;
@@ -94,6 +148,24 @@ class reader_t : public std::iterator<std::input_iterator_tag, memref_t>
     addr_t next_pc;
     addr_t prev_instr_addr;
     int bundle_idx;
+    // The value of a TRACE_MARKER_TYPE_MEMREF_RANGE marker awaiting its data
+    // reference, and the count of iterations of the current range still to
+    // be delivered.
+    addr_t range_value;
+    uint64_t range_remaining;
+    // Whether next_input_entry() should return input_entry again.
+    bool reuse_entry;
+    // The TRACE_MARKER_TYPE_REPEAT sequence being expanded: one iteration of its
+    // entries with their strides, the iteration being delivered, and the index of
+    // the next entry in it.  An entry whose address must be adjusted is returned
+    // in a copy, repeat_entry.
+    std::vector<trace_entry_t> repeat_body;
+    std::vector<addr_t> repeat_strides;
+    uint64_t repeat_iterations;
+    uint64_t repeat_iter;
+    size_t repeat_pos;
+    trace_entry_t repeat_entry;
+    uint64_t cur_instr_count;
     std::unordered_map<memref_tid_t, memref_pid_t> tid2pid;
 };
 
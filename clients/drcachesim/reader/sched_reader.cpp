@@ -0,0 +1,236 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <iostream>
+#include "sched_reader.h"
+#include "../common/memref.h"
+#include "../common/utils.h"
+
+sched_reader_t::sched_reader_t(const std::vector<reader_t *> &inputs_in,
+                               reader_t *input_end_in, unsigned int num_cores,
+                               uint64_t quantum_in, unsigned int verbose_in) :
+    input_end(input_end_in), cores(num_cores == 0 ? 1 : num_cores),
+    quantum(quantum_in), verbose(verbose_in), ready_seq(0), now(0), live_inputs(0),
+    num_running(0), cur_core(0), cur_is_ours(false)
+{
+    for (reader_t *reader : inputs_in)
+        inputs.push_back(input_t(reader));
+}
+
+sched_reader_t::~sched_reader_t()
+{
+    for (auto &input : inputs)
+        delete input.reader;
+    delete input_end;
+}
+
+bool
+sched_reader_t::init()
+{
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        input_t &input = inputs[i];
+        if (!input.reader->init())
+            return false;
+        if (*input.reader == *input_end) {
+            input.done = true;
+            continue;
+        }
+        // Each thread is ready from its first timestamp, which normally
+        // precedes all of its other records.
+        const memref_t &ref = **input.reader;
+        if (ref.marker.type == TRACE_TYPE_MARKER &&
+            ref.marker.marker_type == TRACE_MARKER_TYPE_TIMESTAMP)
+            input.time = ref.marker.marker_value;
+        ready.insert(std::make_pair(std::make_pair(input.time, ready_seq++), (int)i));
+        ++live_inputs;
+    }
+    at_eof = false;
+    advance();
+    return true;
+}
+
+const memref_t &
+sched_reader_t::operator*()
+{
+    return cur_ref;
+}
+
+reader_t &
+sched_reader_t::operator++()
+{
+    if (!cur_is_ours) {
+        input_t &input = inputs[cores[cur_core].input];
+        ++(*input.reader);
+        if (*input.reader == *input_end)
+            finish(cur_core);
+    }
+    advance();
+    return *this;
+}
+
+reader_t &
+sched_reader_t::skip_instructions(uint64_t instruction_count)
+{
+    // The skipped records must still be scheduled, so we walk them.
+    while (!at_eof) {
+        if (!cur_is_ours && type_is_instr(cur_ref.instr.type)) {
+            if (instruction_count == 0)
+                break;
+            --instruction_count;
+        }
+        ++(*this);
+    }
+    if (at_eof)
+        return *this;
+    // The placement markers of the running threads were skipped too, so we
+    // return the threads to the ready set to have them presented anew.
+    for (int i = 0; i < (int)cores.size(); ++i) {
+        if (cores[i].input >= 0)
+            preempt(i);
+    }
+    advance();
+    return *this;
+}
+
+bool
+sched_reader_t::ready_before(uint64_t time) const
+{
+    return !ready.empty() && ready.begin()->first.first < time;
+}
+
+bool
+sched_reader_t::schedule(int core)
+{
+    if (ready.empty())
+        return false;
+    auto next = ready.begin();
+    // Unless every core is idle, a thread waits for the presented timestamps
+    // to reach its own.
+    if (num_running > 0 && next->first.first > now)
+        return false;
+    cores[core].input = next->second;
+    cores[core].instrs = 0;
+    ++num_running;
+    ready.erase(next);
+    if (verbose >= 1) {
+        std::cerr << "sched: core " << core << " runs input " << cores[core].input <<
+            " @" << inputs[cores[core].input].time << std::endl;
+    }
+    return true;
+}
+
+void
+sched_reader_t::preempt(int core)
+{
+    int input = cores[core].input;
+    if (verbose >= 1) {
+        std::cerr << "sched: core " << core << " switches out input " << input <<
+            " after " << cores[core].instrs << " instrs" << std::endl;
+    }
+    ready.insert(std::make_pair(std::make_pair(inputs[input].time, ready_seq++), input));
+    cores[core].input = -1;
+    --num_running;
+}
+
+void
+sched_reader_t::finish(int core)
+{
+    inputs[cores[core].input].done = true;
+    cores[core].input = -1;
+    --num_running;
+    --live_inputs;
+}
+
+void
+sched_reader_t::advance()
+{
+    while (true) {
+        if (live_inputs == 0) {
+            at_eof = true;
+            return;
+        }
+        core_t &core = cores[cur_core];
+        if (core.input < 0) {
+            if (!schedule(cur_core)) {
+                cur_core = (cur_core + 1) % cores.size();
+                continue;
+            }
+            const memref_t &next = **inputs[core.input].reader;
+            cur_ref = memref_t();
+            cur_ref.marker.type = TRACE_TYPE_MARKER;
+            cur_ref.marker.pid = next.data.pid;
+            cur_ref.marker.tid = next.data.tid;
+            cur_ref.marker.marker_type = TRACE_MARKER_TYPE_CPU_ID;
+            cur_ref.marker.marker_value = (uintptr_t)cur_core;
+            cur_is_ours = true;
+            return;
+        }
+        input_t &input = inputs[core.input];
+        const memref_t &ref = **input.reader;
+        if (ref.marker.type == TRACE_TYPE_MARKER) {
+            if (ref.marker.marker_type == TRACE_MARKER_TYPE_CPU_ID) {
+                // Our own placement supersedes the recorded cpu.
+                ++(*input.reader);
+                if (*input.reader == *input_end)
+                    finish(cur_core);
+                continue;
+            }
+            if (ref.marker.marker_type == TRACE_MARKER_TYPE_TIMESTAMP) {
+                input.time = ref.marker.marker_value;
+                if (ready_before(input.time)) {
+                    preempt(cur_core);
+                    continue;
+                }
+                if (input.time > now)
+                    now = input.time;
+            }
+        } else if (type_is_instr(ref.instr.type) ||
+                   ref.instr.type == TRACE_TYPE_INSTR_NO_FETCH) {
+            if (core.stepped) {
+                // This core's turn is over.
+                core.stepped = false;
+                cur_core = (cur_core + 1) % cores.size();
+                continue;
+            }
+            if (quantum > 0 && core.instrs >= quantum && !ready.empty() &&
+                ready.begin()->first.first <= now) {
+                preempt(cur_core);
+                continue;
+            }
+            core.stepped = true;
+            ++core.instrs;
+        }
+        cur_ref = ref;
+        cur_is_ours = false;
+        return;
+    }
+}
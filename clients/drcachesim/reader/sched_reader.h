@@ -0,0 +1,122 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* sched_reader: interleaves the traces of separate threads onto a set of
+ * simulated cores, ordering the threads by their recorded timestamps.
+ */
+
+#ifndef _SCHED_READER_H_
+#define _SCHED_READER_H_ 1
+
+#include <set>
+#include <utility>
+#include <vector>
+#include "reader.h"
+#include "../common/memref.h"
+#include "../common/trace_entry.h"
+
+// Presents the records of a set of single-thread readers as one stream, as
+// though the threads were scheduled onto num_cores cores.  Each core runs one
+// thread at a time, and the cores take turns presenting an instruction (along
+// with its data references) in lockstep.  An idle core picks the ready thread
+// with the smallest timestamp, once the timestamps presented so far have caught
+// up with it.  A running thread gives up its core when it reaches a timestamp
+// later than that of a ready thread or, if quantum is non-zero, after it has
+// run quantum instructions while another thread is ready.
+//
+// Each time a thread is placed on a core a TRACE_MARKER_TYPE_CPU_ID marker is
+// presented for it with the core's index as the value, for consumption by
+// -cpu_scheduling, while any recorded cpu markers are dropped.
+class sched_reader_t : public reader_t
+{
+ public:
+    // Takes ownership of the inputs, each of which must hold a single thread,
+    // and input_end, their end-of-stream comparison reader.
+    sched_reader_t(const std::vector<reader_t *> &inputs, reader_t *input_end,
+                   unsigned int num_cores, uint64_t quantum, unsigned int verbose = 0);
+    virtual ~sched_reader_t();
+    virtual bool init();
+    virtual const memref_t& operator*();
+    virtual reader_t& operator++();
+    virtual reader_t& skip_instructions(uint64_t instruction_count);
+
+ protected:
+    // We present the inputs' memrefs directly and never read entries ourselves.
+    virtual trace_entry_t * read_next_entry() { return NULL; }
+
+ private:
+    struct input_t {
+        input_t(reader_t *reader) : reader(reader), time(0), done(false) {}
+        reader_t *reader;
+        // The last timestamp seen in the input.
+        uint64_t time;
+        bool done;
+    };
+    struct core_t {
+        core_t() : input(-1), instrs(0), stepped(false) {}
+        // The index of the running input, or -1 when idle.
+        int input;
+        // Instructions presented since the running input was placed here.
+        uint64_t instrs;
+        // Whether an instruction was presented in the current turn.
+        bool stepped;
+    };
+
+    // Sets cur_ref to the next record to present, or sets at_eof.
+    void advance();
+    // Places the next eligible ready input on core, returning false if none.
+    bool schedule(int core);
+    void preempt(int core);
+    // Retires the input on core, which has reached its end.
+    void finish(int core);
+    bool ready_before(uint64_t time) const;
+
+    std::vector<input_t> inputs;
+    reader_t *input_end;
+    std::vector<core_t> cores;
+    uint64_t quantum;
+    unsigned int verbose;
+    // Ready inputs keyed by their timestamps, with ties broken by the order in
+    // which they became ready.
+    std::set<std::pair<std::pair<uint64_t, uint64_t>, int> > ready;
+    uint64_t ready_seq;
+    // The largest timestamp presented so far.
+    uint64_t now;
+    int live_inputs;
+    int num_running;
+    int cur_core;
+    // Whether cur_ref is one of our own markers rather than an input's record.
+    bool cur_is_ours;
+    memref_t cur_ref;
+};
+
+#endif /* _SCHED_READER_H_ */
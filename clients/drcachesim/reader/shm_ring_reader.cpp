@@ -0,0 +1,124 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "shm_ring_reader.h"
+#include "../common/memref.h"
+#include "../common/utils.h"
+
+shm_ring_reader_t::shm_ring_reader_t() : creation_success(false)
+{
+    /* Empty. */
+}
+
+shm_ring_reader_t::shm_ring_reader_t(const char *ipc_name, size_t num_slots,
+                                     size_t slot_size) :
+    ring(ipc_name)
+{
+    // We create the ring here so the user can set up a writer
+    // *before* calling the blocking analyzer_t::run().
+    creation_success = ring.create(num_slots, slot_size);
+}
+
+bool
+shm_ring_reader_t::operator!()
+{
+    return !creation_success;
+}
+
+std::string
+shm_ring_reader_t::get_ring_name() const
+{
+    return ring.get_name();
+}
+
+bool
+shm_ring_reader_t::init_raw()
+{
+    at_eof = false;
+    if (!creation_success ||
+        !ring.open_for_read())
+        return false;
+    cur_buf = NULL;
+    end_buf = NULL;
+    return true;
+}
+
+bool
+shm_ring_reader_t::init()
+{
+    if (!init_raw())
+        return false;
+    ++*this;
+    return true;
+}
+
+shm_ring_reader_t::~shm_ring_reader_t()
+{
+    ring.close();
+    if (creation_success)
+        ring.destroy();
+}
+
+trace_entry_t *
+shm_ring_reader_t::read_next_entry()
+{
+    if (cur_buf != NULL)
+        ++cur_buf;
+    while (cur_buf >= end_buf) {
+        // The ring blocks until the next message arrives and returns the
+        // slot to the writers once we move on.
+        size_t sz;
+        const void *msg = ring.acquire(&sz);
+        if (msg == NULL || sz % sizeof(*end_buf) != 0) {
+            footer.type = TRACE_TYPE_FOOTER;
+            footer.size = 0;
+            footer.addr = 0;
+            cur_buf = &footer;
+            end_buf = &footer + 1;
+            return cur_buf;
+        }
+        // The entries are not modified by our caller.
+        cur_buf = (trace_entry_t *) msg;
+        end_buf = cur_buf + (sz / sizeof(*end_buf));
+    }
+    return cur_buf;
+}
+
+trace_entry_t *
+shm_ring_reader_t::read_next_entries(size_t *count)
+{
+    // We hand out the rest of the current slot all at once.
+    trace_entry_t *next = read_next_entry();
+    *count = end_buf - next;
+    cur_buf = end_buf - 1;
+    return next;
+}
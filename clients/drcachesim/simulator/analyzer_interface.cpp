@@ -33,8 +33,10 @@
 #include "../analysis_tool_interface.h"
 #include "../analysis_tool.h"
 #include "../common/options.h"
+#include "../common/directory_iterator.h"
 #include "../common/utils.h"
 #include "cache_simulator_create.h"
+#include "cache_sweep_create.h"
 #include "tlb_simulator_create.h"
 /* XXX i#2006: we include these here for now but it's undecided whether they
  * should be separated and this should only include
@@ -44,34 +46,210 @@
 #include "../tools/reuse_distance_create.h"
 #include "../tools/reuse_time_create.h"
 #include "../tools/basic_counts_create.h"
+#include "../tools/working_set_create.h"
+#include "../tools/regions_create.h"
+#include "../tools/invariant_checker_create.h"
 #include "../tools/opcode_mix_create.h"
+#include "../tools/trace_slice_create.h"
+#include "../tools/report_symbolizer.h"
 #include "../tracer/raw2trace.h"
 #include <fstream>
+#include <sstream>
+#include <stdlib.h>
+
+// The analyzer schedules the threads of a directory of per-thread traces onto
+// the cores, announcing each placement with a cpu marker for the simulators to
+// follow.
+static bool
+use_cpu_scheduling()
+{
+    return op_cpu_scheduling.get_value() ||
+        (!op_infile.get_value().empty() &&
+         directory_iterator_t::is_directory(op_infile.get_value()));
+}
+
+// Tools that need the modules.log assume it is next to the trace file or in the
+// raw/ subdir from raw2trace, unless -module_file is given.
+static bool
+get_module_file_path(const std::string &user, std::string *module_file_path)
+{
+    if (!op_module_file.get_value().empty()) {
+        *module_file_path = op_module_file.get_value();
+        return true;
+    }
+    std::string trace_dir;
+    if (!op_indir.get_value().empty())
+        trace_dir = op_indir.get_value();
+    else {
+        if (op_infile.get_value().empty()) {
+            ERRMSG("Usage error: %s requires offline traces.\n", user.c_str());
+            return false;
+        }
+        size_t sep_index = op_infile.get_value().find_last_of(DIRSEP ALT_DIRSEP);
+        if (sep_index != std::string::npos)
+            trace_dir = std::string(op_infile.get_value(), 0, sep_index);
+    }
+    *module_file_path = trace_dir + std::string(DIRSEP) +
+        DRMEMTRACE_MODULE_LIST_FILENAME;
+    if (!std::ifstream(module_file_path->c_str()).good()) {
+        trace_dir += std::string(DIRSEP) + OUTFILE_SUBDIR;
+        *module_file_path = trace_dir + std::string(DIRSEP) +
+            DRMEMTRACE_MODULE_LIST_FILENAME;
+    }
+    return true;
+}
+
+// Creates the symbolizer for -symbolize_reports.  It is shared by the tools and,
+// like the tools' own uses of standalone DR, lives until exit.
+static bool
+get_report_symbolizer(report_symbolizer_t **symbolizer)
+{
+    static report_symbolizer_t *report_symbolizer;
+    *symbolizer = nullptr;
+    if (!op_symbolize_reports.get_value())
+        return true;
+    if (report_symbolizer == nullptr) {
+        std::string module_file_path, error;
+        if (!get_module_file_path("-symbolize_reports", &module_file_path))
+            return false;
+        report_symbolizer = report_symbolizer_create(module_file_path, &error);
+        if (report_symbolizer == nullptr) {
+            ERRMSG("Failed to create the report symbolizer: %s\n", error.c_str());
+            return false;
+        }
+    }
+    *symbolizer = report_symbolizer;
+    return true;
+}
+
+// Parses a comma-separated list of sizes with optional K, M, or G suffixes.
+static bool
+parse_size_list(const std::string &list, std::vector<uint64_t> *sizes)
+{
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char *end;
+        uint64_t size = strtoull(item.c_str(), &end, 0);
+        if (end == item.c_str())
+            return false;
+        if (*end == 'K' || *end == 'k') {
+            size *= 1024;
+            ++end;
+        } else if (*end == 'M' || *end == 'm') {
+            size *= 1024 * 1024;
+            ++end;
+        } else if (*end == 'G' || *end == 'g') {
+            size *= 1024 * 1024 * 1024;
+            ++end;
+        }
+        if (*end != '\0')
+            return false;
+        sizes->push_back(size);
+    }
+    return true;
+}
+
+// Parses a comma-separated list of hexadecimal start-end address pairs.
+static bool
+parse_range_list(const std::string &list,
+                 std::vector<std::pair<addr_t, addr_t> > *ranges)
+{
+    std::stringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char *end;
+        addr_t start = (addr_t)strtoull(item.c_str(), &end, 16);
+        if (end == item.c_str() || *end != '-')
+            return false;
+        const char *last = end + 1;
+        addr_t stop = (addr_t)strtoull(last, &end, 16);
+        if (end == last || *end != '\0' || stop <= start)
+            return false;
+        ranges->push_back(std::make_pair(start, stop));
+    }
+    return true;
+}
+
+static void
+set_cache_knobs(cache_simulator_knobs_t *knobs)
+{
+    knobs->num_cores = op_num_cores.get_value();
+    knobs->line_size = op_line_size.get_value();
+    knobs->L1I_size = op_L1I_size.get_value();
+    knobs->L1D_size = op_L1D_size.get_value();
+    knobs->L1I_assoc = op_L1I_assoc.get_value();
+    knobs->L1D_assoc = op_L1D_assoc.get_value();
+    knobs->LL_size = op_LL_size.get_value();
+    knobs->LL_assoc = op_LL_assoc.get_value();
+    knobs->LL_miss_file = op_LL_miss_file.get_value();
+    knobs->LL_miss_format = op_LL_miss_format.get_value();
+    knobs->replace_policy = op_replace_policy.get_value();
+    knobs->data_prefetcher = op_data_prefetcher.get_value();
+    knobs->prefetch_degree = op_prefetch_degree.get_value();
+    knobs->prefetch_distance = op_prefetch_distance.get_value();
+    knobs->skip_refs = op_skip_refs.get_value();
+    knobs->warmup_refs = op_warmup_refs.get_value();
+    knobs->warmup_fraction = op_warmup_fraction.get_value();
+    knobs->warmup_save_file = op_warmup_save_file.get_value();
+    knobs->warmup_load_file = op_warmup_load_file.get_value();
+    knobs->regions_file = op_regions_file.get_value();
+    knobs->regions_warmup = op_regions_warmup.get_value();
+    knobs->stats_file = op_stats_file.get_value();
+    knobs->stats_interval = op_stats_interval.get_value();
+    knobs->sim_refs = op_sim_refs.get_value();
+    knobs->verbose = op_verbose.get_value();
+    knobs->cpu_scheduling = use_cpu_scheduling();
+}
 
 analysis_tool_t *
 drmemtrace_analysis_tool_create()
 {
-    if (op_simulator_type.get_value() == CPU_CACHE) {
+    return drmemtrace_analysis_tool_create(op_simulator_type.get_value());
+}
+
+analysis_tool_t *
+drmemtrace_analysis_tool_create(const std::string &simulator_type)
+{
+    if (simulator_type == CPU_CACHE) {
         cache_simulator_knobs_t knobs;
-        knobs.num_cores = op_num_cores.get_value();
-        knobs.line_size = op_line_size.get_value();
-        knobs.L1I_size = op_L1I_size.get_value();
-        knobs.L1D_size = op_L1D_size.get_value();
-        knobs.L1I_assoc = op_L1I_assoc.get_value();
-        knobs.L1D_assoc = op_L1D_assoc.get_value();
-        knobs.LL_size = op_LL_size.get_value();
-        knobs.LL_assoc = op_LL_assoc.get_value();
-        knobs.LL_miss_file = op_LL_miss_file.get_value();
-        knobs.replace_policy = op_replace_policy.get_value();
-        knobs.data_prefetcher = op_data_prefetcher.get_value();
-        knobs.skip_refs = op_skip_refs.get_value();
-        knobs.warmup_refs = op_warmup_refs.get_value();
-        knobs.warmup_fraction = op_warmup_fraction.get_value();
-        knobs.sim_refs = op_sim_refs.get_value();
-        knobs.verbose = op_verbose.get_value();
-        knobs.cpu_scheduling = op_cpu_scheduling.get_value();
+        set_cache_knobs(&knobs);
+        knobs.sim_threads = op_sim_threads.get_value();
+        knobs.coherence = op_coherence.get_value();
+        knobs.report_top = op_report_top.get_value();
+        knobs.miss_hotspots = op_miss_hotspots.get_value();
+        knobs.miss_region_size = op_miss_region_size.get_value();
+        knobs.switch_flush = op_sched_switch_flush.get_value();
+        knobs.record_function = op_record_function.get_value();
+        knobs.L1_latency = op_L1_latency.get_value();
+        knobs.LL_latency = op_LL_latency.get_value();
+        knobs.memory_latency = op_memory_latency.get_value();
+        knobs.timing = op_timing.get_value();
+        knobs.timing_base_cpi = op_timing_base_cpi.get_value();
+        knobs.timing_rob_size = op_timing_rob_size.get_value();
+        knobs.timing_mlp = op_timing_mlp.get_value();
+        knobs.memory_bandwidth = op_memory_bandwidth.get_value();
+        if (!op_config_file.get_value().empty() &&
+            !cache_simulator_read_config(op_config_file.get_value(), &knobs))
+            return nullptr;
+        if (!get_report_symbolizer(&knobs.symbolizer))
+            return nullptr;
         return cache_simulator_create(knobs);
-    } else if (op_simulator_type.get_value() == TLB) {
+    } else if (simulator_type == CACHE_SWEEP) {
+        cache_sweep_knobs_t knobs;
+        set_cache_knobs(&knobs.cache);
+        std::vector<uint64_t> assocs;
+        if (!parse_size_list(op_sweep_L1D_sizes.get_value(), &knobs.L1D_sizes) ||
+            !parse_size_list(op_sweep_LL_sizes.get_value(), &knobs.LL_sizes) ||
+            !parse_size_list(op_sweep_LL_assocs.get_value(), &assocs)) {
+            ERRMSG("Usage error: invalid cache sweep list.\n");
+            return nullptr;
+        }
+        for (uint64_t assoc : assocs)
+            knobs.LL_assocs.push_back((unsigned int)assoc);
+        knobs.num_threads = op_sim_threads.get_value();
+        return cache_sweep_create(knobs);
+    } else if (simulator_type == TLB) {
         tlb_simulator_knobs_t knobs;
         knobs.num_cores = op_num_cores.get_value();
         knobs.page_size = op_page_size.get_value();
@@ -82,18 +260,39 @@ drmemtrace_analysis_tool_create()
         knobs.TLB_L2_entries = op_TLB_L2_entries.get_value();
         knobs.TLB_L2_assoc = op_TLB_L2_assoc.get_value();
         knobs.TLB_replace_policy = op_TLB_replace_policy.get_value();
+        knobs.TLB_page_policy = op_TLB_page_policy.get_value();
+        knobs.TLB_page_map = op_TLB_page_map.get_value();
+        knobs.TLB_thp_threshold = op_TLB_thp_threshold.get_value();
+        knobs.TLB_L1I_2M_entries = op_TLB_L1I_2M_entries.get_value();
+        knobs.TLB_L1I_2M_assoc = op_TLB_L1I_2M_assoc.get_value();
+        knobs.TLB_L1D_2M_entries = op_TLB_L1D_2M_entries.get_value();
+        knobs.TLB_L1D_2M_assoc = op_TLB_L1D_2M_assoc.get_value();
+        knobs.TLB_L2_2M_entries = op_TLB_L2_2M_entries.get_value();
+        knobs.TLB_L2_2M_assoc = op_TLB_L2_2M_assoc.get_value();
+        knobs.TLB_L1I_1G_entries = op_TLB_L1I_1G_entries.get_value();
+        knobs.TLB_L1I_1G_assoc = op_TLB_L1I_1G_assoc.get_value();
+        knobs.TLB_L1D_1G_entries = op_TLB_L1D_1G_entries.get_value();
+        knobs.TLB_L1D_1G_assoc = op_TLB_L1D_1G_assoc.get_value();
+        knobs.TLB_L2_1G_entries = op_TLB_L2_1G_entries.get_value();
+        knobs.TLB_L2_1G_assoc = op_TLB_L2_1G_assoc.get_value();
         knobs.skip_refs = op_skip_refs.get_value();
         knobs.warmup_refs = op_warmup_refs.get_value();
         knobs.warmup_fraction = op_warmup_fraction.get_value();
+        knobs.warmup_save_file = op_warmup_save_file.get_value();
+        knobs.warmup_load_file = op_warmup_load_file.get_value();
+        knobs.regions_file = op_regions_file.get_value();
+        knobs.regions_warmup = op_regions_warmup.get_value();
+        knobs.stats_file = op_stats_file.get_value();
+        knobs.stats_interval = op_stats_interval.get_value();
         knobs.sim_refs = op_sim_refs.get_value();
         knobs.verbose = op_verbose.get_value();
-        knobs.cpu_scheduling = op_cpu_scheduling.get_value();
+        knobs.cpu_scheduling = use_cpu_scheduling();
         return tlb_simulator_create(knobs);
-    } else if (op_simulator_type.get_value() == HISTOGRAM) {
+    } else if (simulator_type == HISTOGRAM) {
         return histogram_tool_create(op_line_size.get_value(),
                                      op_report_top.get_value(),
                                      op_verbose.get_value());
-    } else if (op_simulator_type.get_value() == REUSE_DIST) {
+    } else if (simulator_type == REUSE_DIST) {
         reuse_distance_knobs_t knobs;
         knobs.line_size = op_line_size.get_value();
         knobs.report_histogram = op_reuse_distance_histogram.get_value();
@@ -101,45 +300,71 @@ drmemtrace_analysis_tool_create()
         knobs.report_top = op_report_top.get_value();
         knobs.skip_list_distance = op_reuse_skip_dist.get_value();
         knobs.verify_skip = op_reuse_verify_skip.get_value();
+        knobs.use_distance_tree = op_reuse_distance_tree.get_value();
+        knobs.sampling_rate = op_reuse_sampling_rate.get_value();
+        knobs.sampling_max_lines = op_reuse_sampling_max_lines.get_value();
         knobs.verbose = op_verbose.get_value();
+        if (!get_report_symbolizer(&knobs.symbolizer))
+            return nullptr;
         return reuse_distance_tool_create(knobs);
-    } else if (op_simulator_type.get_value() == REUSE_TIME) {
+    } else if (simulator_type == REUSE_TIME) {
         return reuse_time_tool_create(op_line_size.get_value(),
-                                      op_verbose.get_value());
-    } else if (op_simulator_type.get_value() == BASIC_COUNTS) {
+                                      op_verbose.get_value(),
+                                      op_reuse_time_max_lines.get_value(),
+                                      op_reuse_time_window.get_value());
+    } else if (simulator_type == WORKING_SET) {
+        working_set_knobs_t knobs;
+        knobs.line_size = op_line_size.get_value();
+        knobs.page_size = (unsigned int)op_page_size.get_value();
+        knobs.window_refs = op_working_set_window.get_value();
+        knobs.sketch_precision = op_working_set_precision.get_value();
+        knobs.verbose = op_verbose.get_value();
+        return working_set_tool_create(knobs);
+    } else if (simulator_type == REGIONS) {
+        regions_knobs_t knobs;
+        knobs.interval_instrs = op_regions_interval.get_value();
+        knobs.max_clusters = op_regions_max_clusters.get_value();
+        knobs.output_file = op_regions_file.get_value();
+        knobs.verbose = op_verbose.get_value();
+        return regions_tool_create(knobs);
+    } else if (simulator_type == INVARIANT_CHECKER) {
+        invariant_checker_knobs_t knobs;
+        // A trace read from disk was gathered offline.
+        knobs.offline = op_offline.get_value() || !op_indir.get_value().empty() ||
+            !op_infile.get_value().empty();
+        knobs.max_reports = op_invariant_reports.get_value();
+        knobs.verbose = op_verbose.get_value();
+        return invariant_checker_create(knobs);
+    } else if (simulator_type == TRACE_SLICE) {
+        trace_slice_knobs_t knobs;
+        std::vector<uint64_t> tids;
+        knobs.output_file = op_slice_file.get_value();
+        if (!parse_size_list(op_slice_tids.get_value(), &tids) ||
+            !parse_range_list(op_slice_pc_ranges.get_value(), &knobs.pc_ranges)) {
+            ERRMSG("Usage error: invalid trace slice list.\n");
+            return nullptr;
+        }
+        for (uint64_t tid : tids)
+            knobs.tids.push_back((memref_tid_t)tid);
+        knobs.timestamp_start = op_slice_time_start.get_value();
+        knobs.timestamp_end = op_slice_time_end.get_value();
+        knobs.instr_start = op_slice_instr_start.get_value();
+        knobs.instr_end = op_slice_instr_end.get_value();
+        knobs.chunk_entries = op_slice_chunk_entries.get_value();
+        knobs.verbose = op_verbose.get_value();
+        return trace_slice_tool_create(knobs);
+    } else if (simulator_type == BASIC_COUNTS) {
         return basic_counts_tool_create(op_verbose.get_value());
-    } else if (op_simulator_type.get_value() == OPCODE_MIX) {
-        // This tool needs the modules.log, which we assume is next to the trace file or
-        // in the raw/ subdir from raw2trace.
+    } else if (simulator_type == OPCODE_MIX) {
         std::string module_file_path;
-        if (!op_module_file.get_value().empty())
-            module_file_path = op_module_file.get_value();
-        else {
-            std::string trace_dir;
-            if (!op_indir.get_value().empty())
-                trace_dir = op_indir.get_value();
-            else {
-                if (op_infile.get_value().empty()) {
-                    ERRMSG("Usage error: the opcode mix tool requires offline traces.\n");
-                    return nullptr;
-                }
-                size_t sep_index = op_infile.get_value().find_last_of(DIRSEP ALT_DIRSEP);
-                if (sep_index != std::string::npos)
-                    trace_dir = std::string(op_infile.get_value(), 0, sep_index);
-            }
-            module_file_path = trace_dir + std::string(DIRSEP) +
-                DRMEMTRACE_MODULE_LIST_FILENAME;
-            if (!std::ifstream(module_file_path.c_str()).good()) {
-                trace_dir += std::string(DIRSEP) + OUTFILE_SUBDIR;
-                module_file_path = trace_dir + std::string(DIRSEP) +
-                    DRMEMTRACE_MODULE_LIST_FILENAME;
-            }
-        }
+        if (!get_module_file_path("the opcode mix tool", &module_file_path))
+            return nullptr;
         return opcode_mix_tool_create(module_file_path, op_verbose.get_value());
     } else {
         ERRMSG("Usage error: unsupported analyzer type. "
-               "Please choose " CPU_CACHE ", " TLB ", "
-               HISTOGRAM ", " REUSE_DIST ", or " BASIC_COUNTS ".\n");
+               "Please choose " CPU_CACHE ", " CACHE_SWEEP ", " TLB ", "
+               HISTOGRAM ", " REUSE_DIST ", " WORKING_SET ", " REGIONS ", "
+               INVARIANT_CHECKER ", " TRACE_SLICE ", or " BASIC_COUNTS ".\n");
         return nullptr;
     }
 }
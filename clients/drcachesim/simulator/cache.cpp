@@ -46,14 +46,6 @@ cache_t::init(int associativity_, int line_size_, int total_size,
                                   parent_, stats_, prefetcher_);
 }
 
-void
-cache_t::init_blocks()
-{
-    for (int i = 0; i < num_blocks; i++) {
-        blocks[i] = new cache_line_t;
-    }
-}
-
 void
 cache_t::request(const memref_t &memref_in)
 {
@@ -63,7 +55,7 @@ cache_t::request(const memref_t &memref_in)
 }
 
 void
-cache_t::flush(const memref_t &memref)
+cache_t::invalidate(const memref_t &memref)
 {
     addr_t tag = compute_tag(memref.flush.addr);
     addr_t final_tag = compute_tag(memref.flush.addr +
@@ -72,13 +64,29 @@ cache_t::flush(const memref_t &memref)
     for (; tag <= final_tag; ++tag) {
         int block_idx = compute_block_idx(tag);
         for (int way = 0; way < associativity; ++way) {
-            if (get_caching_device_block(block_idx, way).tag == tag) {
-                get_caching_device_block(block_idx, way).tag = TAG_INVALID;
-                // Xref cache_block_t constructor about why we set counter to 0.
-                get_caching_device_block(block_idx, way).counter = 0;
+            if (get_block_tag(block_idx, way) == tag) {
+                get_block_tag(block_idx, way) = TAG_INVALID;
+                // Xref caching_device_block.h about why we set counter to 0.
+                get_block_counter(block_idx, way) = 0;
             }
         }
     }
+}
+
+void
+cache_t::invalidate_all()
+{
+    last_tag = TAG_INVALID;
+    for (int i = 0; i < num_blocks; ++i) {
+        tags[i] = TAG_INVALID;
+        counters[i] = 0;
+    }
+}
+
+void
+cache_t::flush(const memref_t &memref)
+{
+    invalidate(memref);
     // We flush parent's code cache here.
     // XXX: should L1 data cache be flushed when L1 instr cache is flushed?
     if (parent != NULL)
@@ -37,7 +37,6 @@
 #define _CACHE_H_ 1
 
 #include "caching_device.h"
-#include "cache_line.h"
 #include "cache_stats.h"
 
 class cache_t : public caching_device_t
@@ -50,8 +49,11 @@ class cache_t : public caching_device_t
                       prefetcher_t *prefetcher = nullptr);
     virtual void request(const memref_t &memref);
     virtual void flush(const memref_t &memref);
- protected:
-    virtual void init_blocks();
+    // Invalidates the lines covered by the flush request memref, without
+    // passing the flush on to the parent or recording it in the stats.
+    virtual void invalidate(const memref_t &memref);
+    // Invalidates every line, again without involving the parent or the stats.
+    virtual void invalidate_all();
 };
 
 #endif /* _CACHE_H_ */
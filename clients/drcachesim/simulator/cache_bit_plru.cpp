@@ -0,0 +1,87 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "cache_bit_plru.h"
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
+
+static inline int
+lowest_set_bit(unsigned int bits)
+{
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanForward(&idx, bits);
+    return (int)idx;
+#else
+    return __builtin_ctz(bits);
+#endif
+}
+
+bool
+cache_bit_plru_t::init(int associativity_, int line_size_, int total_size,
+                       caching_device_t *parent_, caching_device_stats_t *stats_,
+                       prefetcher_t *prefetcher_)
+{
+    // The bits of a set must fit in one counter.
+    const int max_ways = (int)(sizeof(unsigned int) * 8);
+    if (associativity_ > max_ways)
+        return false;
+    if (!cache_t::init(associativity_, line_size_, total_size, parent_, stats_,
+                       prefetcher_))
+        return false;
+    all_ways_mask = associativity == max_ways ? ~0U : (1U << associativity) - 1;
+    return true;
+}
+
+void
+cache_bit_plru_t::access_update(int block_idx, int way)
+{
+    unsigned int &bits = (unsigned int &)get_block_counter(block_idx, 0);
+    bits |= 1U << way;
+    if (bits == all_ways_mask)
+        bits = 1U << way;
+}
+
+int
+cache_bit_plru_t::replace_which_way(int block_idx)
+{
+    // Invalid blocks are replaced first.
+    int way = find_way(block_idx, TAG_INVALID);
+    if (way != associativity)
+        return way;
+    unsigned int clear = ~(unsigned int)get_block_counter(block_idx, 0) & all_ways_mask;
+    // With a single way the bit is never cleared.
+    if (clear == 0)
+        return 0;
+    return lowest_set_bit(clear);
+}
@@ -0,0 +1,60 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cache_bit_plru: represents a single hardware cache with bit-based pseudo-LRU
+ * algo, also known as MRU-bit replacement.
+ */
+
+#ifndef _CACHE_BIT_PLRU_H_
+#define _CACHE_BIT_PLRU_H_ 1
+
+#include "cache.h"
+
+// Each set keeps one recently-used bit per way, packed into the counter of its
+// first block.  An access sets the bit of its way, clearing the others once they
+// would all be set, and the lowest way with a clear bit is replaced.  As for
+// cache_plru_t, flushing the first block of a set clears its bits.
+class cache_bit_plru_t : public cache_t
+{
+ public:
+    virtual bool init(int associativity, int line_size, int total_size,
+                      caching_device_t *parent, caching_device_stats_t *stats,
+                      prefetcher_t *prefetcher = nullptr);
+
+ protected:
+    virtual void access_update(int line_idx, int way);
+    virtual int replace_which_way(int line_idx);
+
+    unsigned int all_ways_mask;
+};
+
+#endif /* _CACHE_BIT_PLRU_H_ */
@@ -0,0 +1,199 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cache_config: reads a cache hierarchy configuration file.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits.h>
+#include <stdlib.h>
+#include "cache_simulator_create.h"
+#include "../common/utils.h"
+
+namespace {
+
+struct config_token_t {
+    std::string text;
+    int line;
+};
+
+// Parses a count with an optional K, M, or G suffix.
+bool
+parse_count(const std::string &text, uint64_t *value)
+{
+    char *end;
+    uint64_t res = strtoull(text.c_str(), &end, 0);
+    if (end == text.c_str())
+        return false;
+    switch (*end) {
+    case 'k': case 'K': res <<= 10; ++end; break;
+    case 'm': case 'M': res <<= 20; ++end; break;
+    case 'g': case 'G': res <<= 30; ++end; break;
+    default: break;
+    }
+    if (*end != '\0')
+        return false;
+    *value = res;
+    return true;
+}
+
+bool
+parse_count(const std::string &text, unsigned int *value)
+{
+    uint64_t res;
+    if (!parse_count(text, &res) || res > UINT_MAX)
+        return false;
+    *value = (unsigned int)res;
+    return true;
+}
+
+bool
+set_cache_param(cache_params_t *cache, const std::string &key, const std::string &value)
+{
+    if (key == "type") {
+        cache->type = value;
+        return value == "instruction" || value == "data" || value == "unified";
+    } else if (key == "core") {
+        unsigned int core;
+        if (!parse_count(value, &core) || core > INT_MAX)
+            return false;
+        cache->core = (int)core;
+        return true;
+    } else if (key == "size")
+        return parse_count(value, &cache->size);
+    else if (key == "assoc")
+        return parse_count(value, &cache->assoc);
+    else if (key == "inclusion") {
+        cache->inclusion = value;
+        return value == "nine" || value == "inclusive" || value == "exclusive";
+    } else if (key == "parent")
+        cache->parent = value;
+    else if (key == "replace_policy")
+        cache->replace_policy = value;
+    else if (key == "prefetcher")
+        cache->prefetcher = value;
+    else if (key == "latency")
+        return parse_count(value, &cache->latency);
+    else
+        return false;
+    return true;
+}
+
+bool
+set_knob(cache_simulator_knobs_t *knobs, const std::string &key,
+         const std::string &value)
+{
+    if (key == "num_cores")
+        return parse_count(value, &knobs->num_cores);
+    else if (key == "line_size")
+        return parse_count(value, &knobs->line_size);
+    else if (key == "memory_latency")
+        return parse_count(value, &knobs->memory_latency);
+    else if (key == "replace_policy")
+        knobs->replace_policy = value;
+    else if (key == "data_prefetcher")
+        knobs->data_prefetcher = value;
+    else
+        return false;
+    return true;
+}
+
+} // namespace
+
+bool
+cache_simulator_read_config(const std::string &path, cache_simulator_knobs_t *knobs)
+{
+    std::ifstream in(path);
+    if (!in.good()) {
+        ERRMSG("Usage error: failed to open cache configuration file %s.\n",
+               path.c_str());
+        return false;
+    }
+    std::vector<config_token_t> tokens;
+    std::string line;
+    for (int line_num = 1; std::getline(in, line); ++line_num) {
+        // Comments run from "//" to the end of the line.
+        std::istringstream words(line.substr(0, line.find("//")));
+        config_token_t token;
+        token.line = line_num;
+        while (words >> token.text)
+            tokens.push_back(token);
+    }
+    std::vector<cache_params_t> caches;
+    for (size_t i = 0; i < tokens.size(); i += 2) {
+        if (i + 1 == tokens.size()) {
+            ERRMSG("Usage error: %s line %d: missing value for %s.\n", path.c_str(),
+                   tokens[i].line, tokens[i].text.c_str());
+            return false;
+        }
+        if (tokens[i + 1].text != "{") {
+            if (!set_knob(knobs, tokens[i].text, tokens[i + 1].text)) {
+                ERRMSG("Usage error: %s line %d: invalid setting %s %s.\n",
+                       path.c_str(), tokens[i].line, tokens[i].text.c_str(),
+                       tokens[i + 1].text.c_str());
+                return false;
+            }
+            continue;
+        }
+        // A cache: its name followed by its parameters within braces.
+        cache_params_t cache;
+        cache.name = tokens[i].text;
+        int start_line = tokens[i].line;
+        for (i += 2; i < tokens.size() && tokens[i].text != "}"; i += 2) {
+            if (i + 1 == tokens.size() || tokens[i + 1].text == "}" ||
+                !set_cache_param(&cache, tokens[i].text, tokens[i + 1].text)) {
+                ERRMSG("Usage error: %s line %d: invalid parameter %s of cache %s.\n",
+                       path.c_str(), tokens[i].line, tokens[i].text.c_str(),
+                       cache.name.c_str());
+                return false;
+            }
+        }
+        if (i == tokens.size()) {
+            ERRMSG("Usage error: %s line %d: missing } for cache %s.\n", path.c_str(),
+                   start_line, cache.name.c_str());
+            return false;
+        }
+        // Skip the "}" such that the loop's step reaches the next item.
+        --i;
+        caches.push_back(cache);
+    }
+    if (caches.empty()) {
+        ERRMSG("Usage error: cache configuration file %s describes no caches.\n",
+               path.c_str());
+        return false;
+    }
+    knobs->caches = caches;
+    return true;
+}
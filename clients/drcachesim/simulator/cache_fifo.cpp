@@ -54,11 +54,38 @@ cache_fifo_t::init(int associativity_, int block_size_, int total_size,
     // Create a replacement pointer for each set, and
     // initialize it to point to the first block.
     for (int i = 0; i < blocks_per_set; i++) {
-        get_caching_device_block(i << assoc_bits, 0).counter = 1;
+        get_block_counter(i << assoc_bits, 0) = 1;
     }
     return true;
 }
 
+void
+cache_fifo_t::invalidate(const memref_t &memref)
+{
+    // Unlike the base class, we must leave the counters alone, as they hold the
+    // replacement pointer of each set.
+    addr_t tag = compute_tag(memref.flush.addr);
+    addr_t final_tag = compute_tag(memref.flush.addr +
+                                   memref.flush.size - 1/*no overflow*/);
+    last_tag = TAG_INVALID;
+    for (; tag <= final_tag; ++tag) {
+        int block_idx = compute_block_idx(tag);
+        for (int way = 0; way < associativity; ++way) {
+            if (get_block_tag(block_idx, way) == tag)
+                get_block_tag(block_idx, way) = TAG_INVALID;
+        }
+    }
+}
+
+void
+cache_fifo_t::invalidate_all()
+{
+    // As in invalidate(), we leave the counters alone.
+    last_tag = TAG_INVALID;
+    for (int i = 0; i < num_blocks; ++i)
+        tags[i] = TAG_INVALID;
+}
+
 void
 cache_fifo_t::access_update(int block_idx, int way)
 {
@@ -72,12 +99,11 @@ cache_fifo_t::replace_which_way(int block_idx)
 {
     // We replace the block whose counter is 1.
     for (int i = 0; i < associativity; i++) {
-        if (get_caching_device_block(block_idx, i).counter == 1) {
+        if (get_block_counter(block_idx, i) == 1) {
             // clear the counter of the victim block
-            get_caching_device_block(block_idx, i).counter = 0;
+            get_block_counter(block_idx, i) = 0;
             // set the next block as victim
-            get_caching_device_block(block_idx, (i + 1) & (associativity - 1)).counter
-                = 1;
+            get_block_counter(block_idx, (i + 1) & (associativity - 1)) = 1;
             return i;
         }
     }
@@ -44,6 +44,8 @@ class cache_fifo_t : public cache_t
     virtual bool init(int associativity, int line_size, int total_size,
                       caching_device_t *parent, caching_device_stats_t *stats,
                       prefetcher_t *prefetcher);
+    virtual void invalidate(const memref_t &memref);
+    virtual void invalidate_all();
 
  protected:
     virtual void access_update(int line_idx, int way);
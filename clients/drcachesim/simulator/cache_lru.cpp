@@ -40,17 +40,18 @@
 void
 cache_lru_t::access_update(int line_idx, int way)
 {
-    int cnt = get_caching_device_block(line_idx, way).counter;
+    int cnt = get_block_counter(line_idx, way);
     // Optimization: return early if it is a repeated access.
     if (cnt == 0)
         return;
     // We inc all the counters that are not larger than cnt for LRU.
-    for (int i = 0; i < associativity; ++i) {
-        if (i != way && get_caching_device_block(line_idx, i).counter <= cnt)
-            get_caching_device_block(line_idx, i).counter++;
-    }
+    // This is written without branches so it vectorizes across the set: we
+    // include way itself, whose counter is cleared below anyway.
+    int *set = &get_block_counter(line_idx, 0);
+    for (int i = 0; i < associativity; ++i)
+        set[i] += (set[i] <= cnt) ? 1 : 0;
     // Clear the counter for LRU.
-    get_caching_device_block(line_idx, way).counter = 0;
+    get_block_counter(line_idx, way) = 0;
 }
 
 int
@@ -60,16 +61,16 @@ cache_lru_t::replace_which_way(int line_idx)
     int max_counter = 0;
     int max_way = 0;
     for (int way = 0; way < associativity; ++way) {
-        if (get_caching_device_block(line_idx, way).tag == TAG_INVALID) {
+        if (get_block_tag(line_idx, way) == TAG_INVALID) {
             max_way = way;
             break;
         }
-        if (get_caching_device_block(line_idx, way).counter > max_counter) {
-            max_counter = get_caching_device_block(line_idx, way).counter;
+        if (get_block_counter(line_idx, way) > max_counter) {
+            max_counter = get_block_counter(line_idx, way);
             max_way = way;
         }
     }
     // Set to non-zero for later access_update optimization on repeated access
-    get_caching_device_block(line_idx, max_way).counter = 1;
+    get_block_counter(line_idx, max_way) = 1;
     return max_way;
 }
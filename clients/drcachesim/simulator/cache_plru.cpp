@@ -0,0 +1,85 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "cache_plru.h"
+
+// The tree nodes are numbered as in a binary heap: the root is bit 1 and the
+// children of node n are 2n and 2n + 1, so the leaves associativity through
+// 2 * associativity - 1 are the ways.  A clear bit points to the left child.
+
+bool
+cache_plru_t::init(int associativity_, int line_size_, int total_size,
+                   caching_device_t *parent_, caching_device_stats_t *stats_,
+                   prefetcher_t *prefetcher_)
+{
+    // The tree bits of a set must fit in one counter.
+    if (associativity_ > (int)(sizeof(unsigned int) * 8))
+        return false;
+    if (!cache_t::init(associativity_, line_size_, total_size, parent_, stats_,
+                       prefetcher_))
+        return false;
+    path_mask.assign(associativity, 0);
+    path_bits.assign(associativity, 0);
+    for (int way = 0; way < associativity; ++way) {
+        unsigned int node = 1;
+        for (int level = assoc_bits - 1; level >= 0; --level) {
+            unsigned int right = (way >> level) & 1;
+            path_mask[way] |= 1U << node;
+            // Point at the other child.
+            if (right == 0)
+                path_bits[way] |= 1U << node;
+            node = 2 * node + right;
+        }
+    }
+    return true;
+}
+
+void
+cache_plru_t::access_update(int block_idx, int way)
+{
+    unsigned int &bits = (unsigned int &)get_block_counter(block_idx, 0);
+    bits = (bits & ~path_mask[way]) | path_bits[way];
+}
+
+int
+cache_plru_t::replace_which_way(int block_idx)
+{
+    // Invalid blocks are replaced first.
+    int way = find_way(block_idx, TAG_INVALID);
+    if (way != associativity)
+        return way;
+    unsigned int bits = (unsigned int)get_block_counter(block_idx, 0);
+    unsigned int node = 1;
+    while (node < (unsigned int)associativity)
+        node = 2 * node + ((bits >> node) & 1);
+    return node - associativity;
+}
@@ -0,0 +1,63 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cache_plru: represents a single hardware cache with tree-based pseudo-LRU algo.
+ */
+
+#ifndef _CACHE_PLRU_H_
+#define _CACHE_PLRU_H_ 1
+
+#include <vector>
+#include "cache.h"
+
+// Each set keeps a binary tree of associativity - 1 bits, packed into the counter
+// of its first block, whose leaves are the ways.  Each bit points toward the half
+// of its subtree to replace next.  Flushing the first block of a set clears its
+// bits, which just forgets the recency order of that set.
+class cache_plru_t : public cache_t
+{
+ public:
+    virtual bool init(int associativity, int line_size, int total_size,
+                      caching_device_t *parent, caching_device_stats_t *stats,
+                      prefetcher_t *prefetcher = nullptr);
+
+ protected:
+    virtual void access_update(int line_idx, int way);
+    virtual int replace_which_way(int line_idx);
+
+    // For each way, the tree bits on its path and their values pointing away
+    // from it, so an access is a single masked update.
+    std::vector<unsigned int> path_mask;
+    std::vector<unsigned int> path_bits;
+};
+
+#endif /* _CACHE_PLRU_H_ */
@@ -0,0 +1,92 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "cache_rrip.h"
+
+cache_rrip_t::cache_rrip_t(bool bimodal_) :
+    bimodal(bimodal_), pending_fill(-1)
+{
+}
+
+bool
+cache_rrip_t::init(int associativity_, int line_size_, int total_size,
+                   caching_device_t *parent_, caching_device_stats_t *stats_,
+                   prefetcher_t *prefetcher_)
+{
+    if (!cache_t::init(associativity_, line_size_, total_size, parent_, stats_,
+                       prefetcher_))
+        return false;
+    set_fills.assign(blocks_per_set, 0);
+    return true;
+}
+
+void
+cache_rrip_t::access_update(int block_idx, int way)
+{
+    int &rrpv = get_block_counter(block_idx, way);
+    if (block_idx + way != pending_fill) {
+        rrpv = 0;
+        return;
+    }
+    pending_fill = -1;
+    // BRRIP uses a fixed period rather than a random choice so that runs are
+    // reproducible.  We count per set so that the choice does not depend on how
+    // the sets are split across the partitions of a parallel simulation.
+    if (bimodal && ++set_fills[block_idx >> assoc_bits] % BRRIP_LONG_PERIOD != 0)
+        rrpv = RRPV_MAX;
+    else
+        rrpv = RRPV_MAX - 1;
+}
+
+int
+cache_rrip_t::replace_which_way(int block_idx)
+{
+    // Invalid blocks are replaced first.
+    int victim = find_way(block_idx, TAG_INVALID);
+    if (victim == associativity) {
+        int *set = &get_block_counter(block_idx, 0);
+        victim = 0;
+        for (int way = 1; way < associativity; ++way) {
+            if (set[way] > set[victim])
+                victim = way;
+        }
+        // Hardware increments every RRPV in the set until one reaches RRPV_MAX:
+        // we do it in one step.
+        int age = RRPV_MAX - set[victim];
+        if (age > 0) {
+            for (int way = 0; way < associativity; ++way)
+                set[way] += age;
+        }
+    }
+    pending_fill = block_idx + victim;
+    return victim;
+}
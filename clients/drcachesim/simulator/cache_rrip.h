@@ -0,0 +1,75 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* cache_rrip: represents a single hardware cache with re-reference interval
+ * prediction (RRIP) algo.
+ */
+
+#ifndef _CACHE_RRIP_H_
+#define _CACHE_RRIP_H_ 1
+
+#include <vector>
+#include "cache.h"
+
+// The counter of each block holds its re-reference prediction value (RRPV), from
+// 0 for a block expected to be reused soon up to RRPV_MAX for one expected to be
+// reused in the distant future.  A hit sets the RRPV to 0, and the first block
+// with RRPV_MAX is replaced, after aging the whole set until there is one.
+// Static RRIP (SRRIP) inserts new blocks with RRPV_MAX - 1, so a block must be
+// reused to outlast a scan.  Bimodal RRIP (BRRIP) inserts most blocks with
+// RRPV_MAX, which protects a working set larger than the cache from thrashing.
+class cache_rrip_t : public cache_t
+{
+ public:
+    explicit cache_rrip_t(bool bimodal = false);
+    virtual bool init(int associativity, int line_size, int total_size,
+                      caching_device_t *parent, caching_device_stats_t *stats,
+                      prefetcher_t *prefetcher = nullptr);
+
+ protected:
+    virtual void access_update(int line_idx, int way);
+    virtual int replace_which_way(int line_idx);
+
+    // A 2-bit RRPV, as in most hardware implementations.
+    static const int RRPV_MAX = 3;
+    // BRRIP inserts one in this many blocks with RRPV_MAX - 1.
+    static const unsigned int BRRIP_LONG_PERIOD = 32;
+
+    bool bimodal;
+    // The block_idx + way of the block chosen by replace_which_way(), whose next
+    // access_update() is its insertion rather than a hit; else -1.
+    int pending_fill;
+    // The number of blocks inserted into each set, for BRRIP.
+    std::vector<unsigned int> set_fills;
+};
+
+#endif /* _CACHE_RRIP_H_ */
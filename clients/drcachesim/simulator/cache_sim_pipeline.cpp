@@ -0,0 +1,280 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+#include <assert.h>
+#include "cache_sim_pipeline.h"
+#include "../common/utils.h"
+
+cache_sim_pipeline_t::ll_forwarder_t::ll_forwarder_t(cache_sim_pipeline_t *pipeline_,
+                                                    unsigned int worker_) :
+    cur_seq(0), pipeline(pipeline_), worker(worker_)
+{
+    // The L1 caches record their accesses to us here.
+    set_stats(new cache_stats_t);
+}
+
+cache_sim_pipeline_t::ll_forwarder_t::~ll_forwarder_t()
+{
+    delete get_stats();
+}
+
+void
+cache_sim_pipeline_t::ll_forwarder_t::request(const memref_t &memref)
+{
+    pipeline->forward(worker, cur_seq, memref, false);
+}
+
+void
+cache_sim_pipeline_t::ll_forwarder_t::flush(const memref_t &memref)
+{
+    // We count the flush once here, as every partition must see it.
+    ((cache_stats_t *)stats)->flush(memref);
+    pipeline->forward(worker, cur_seq, memref, true);
+}
+
+cache_sim_pipeline_t::cache_sim_pipeline_t(unsigned int num_cores_,
+                                           unsigned int num_l1_workers_,
+                                           unsigned int line_size,
+                                           unsigned int ll_sets,
+                                           const std::vector<cache_t *> &partitions) :
+    num_cores(num_cores_), num_l1_workers(num_l1_workers_), ll_partitions(partitions),
+    icaches(NULL), dcaches(NULL), next_seq(0), batch_count(0), dispatch_buf(0),
+    l1_in_buf(0), l1_out_buf(0), step(0), pending(0), exiting(false), finished(false)
+{
+    assert(IS_POWER_OF_2(ll_partitions.size()) && ll_sets >= ll_partitions.size());
+    line_bits = compute_log2((int)line_size);
+    partition_shift = compute_log2((int)(ll_sets / ll_partitions.size()));
+    for (unsigned int i = 0; i < num_l1_workers; ++i)
+        forwarders.push_back(new ll_forwarder_t(this, i));
+    for (int buf = 0; buf < 2; ++buf) {
+        l1_items[buf].resize(num_l1_workers);
+        ll_items[buf].resize(num_l1_workers * ll_partitions.size());
+    }
+}
+
+cache_sim_pipeline_t::~cache_sim_pipeline_t()
+{
+    if (!threads.empty()) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            exiting = true;
+        }
+        start_cond.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+    for (auto forwarder : forwarders)
+        delete forwarder;
+    for (auto partition : ll_partitions) {
+        delete partition->get_stats();
+        delete partition;
+    }
+}
+
+unsigned int
+cache_sim_pipeline_t::compute_ll_partitions(unsigned int num_threads,
+                                            unsigned int num_sets)
+{
+    // We give half of the threads to the LL, as a power of two.
+    unsigned int partitions = 1;
+    while (partitions * 2 <= num_threads / 2 && partitions * 2 <= num_sets)
+        partitions *= 2;
+    return partitions;
+}
+
+cache_t *
+cache_sim_pipeline_t::get_l1_parent(unsigned int core)
+{
+    return forwarders[core % num_l1_workers];
+}
+
+void
+cache_sim_pipeline_t::start(cache_t **icaches_, cache_t **dcaches_)
+{
+    icaches = icaches_;
+    dcaches = dcaches_;
+    unsigned int num_threads = num_l1_workers + (unsigned int)ll_partitions.size();
+    for (unsigned int i = 0; i < num_threads; ++i)
+        threads.push_back(std::thread(&cache_sim_pipeline_t::worker_main, this, i));
+}
+
+void
+cache_sim_pipeline_t::dispatch(unsigned int core, op_t op, const memref_t &memref)
+{
+    l1_item_t item;
+    item.seq = next_seq++;
+    item.core = core;
+    item.op = op;
+    item.memref = memref;
+    l1_items[dispatch_buf][core % num_l1_workers].push_back(item);
+    if (++batch_count >= BATCH_SIZE) {
+        batch_count = 0;
+        launch_step();
+    }
+}
+
+void
+cache_sim_pipeline_t::forward(unsigned int worker, uint64_t seq,
+                              const memref_t &memref, bool invalidate)
+{
+    ll_item_t item;
+    item.seq = seq;
+    item.invalidate = invalidate;
+    item.memref = memref;
+    if (invalidate) {
+        // A flush can cover lines in any partition.
+        for (unsigned int i = 0; i < ll_partitions.size(); ++i)
+            ll_queue(l1_out_buf, worker, i).push_back(item);
+        return;
+    }
+    // The L1 only forwards single-line requests.
+    addr_t tag = memref.data.addr >> line_bits;
+    unsigned int partition =
+        (unsigned int)(tag >> partition_shift) & (ll_partitions.size() - 1);
+    ll_queue(l1_out_buf, worker, partition).push_back(item);
+}
+
+void
+cache_sim_pipeline_t::wait_for_step()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cond.wait(lock, [this]{ return pending == 0; });
+}
+
+void
+cache_sim_pipeline_t::launch_step()
+{
+    wait_for_step();
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        // The L1 workers take the batch just gathered and the main thread
+        // moves on to the buffer they finished with in the prior step.
+        l1_in_buf = dispatch_buf;
+        dispatch_buf = 1 - dispatch_buf;
+        for (auto &items : l1_items[dispatch_buf])
+            items.clear();
+        // The LL workers take the L1 output of the prior step, while the L1
+        // workers write to the buffer the LL workers finished with.
+        l1_out_buf = 1 - l1_out_buf;
+        for (auto &items : ll_items[l1_out_buf])
+            items.clear();
+        pending = (unsigned int)threads.size();
+        ++step;
+    }
+    start_cond.notify_all();
+}
+
+void
+cache_sim_pipeline_t::worker_main(unsigned int id)
+{
+    uint64_t last_step = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cond.wait(lock, [&]{ return exiting || step != last_step; });
+            if (exiting)
+                return;
+            last_step = step;
+        }
+        if (id < num_l1_workers)
+            run_l1_worker(id);
+        else
+            run_ll_worker(id - num_l1_workers);
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (--pending == 0)
+                done_cond.notify_one();
+        }
+    }
+}
+
+void
+cache_sim_pipeline_t::run_l1_worker(unsigned int worker)
+{
+    ll_forwarder_t *forwarder = forwarders[worker];
+    for (const auto &item : l1_items[l1_in_buf][worker]) {
+        forwarder->cur_seq = item.seq;
+        switch (item.op) {
+        case L1I_REQUEST: icaches[item.core]->request(item.memref); break;
+        case L1D_REQUEST: dcaches[item.core]->request(item.memref); break;
+        case L1I_FLUSH: icaches[item.core]->flush(item.memref); break;
+        case L1D_FLUSH: dcaches[item.core]->flush(item.memref); break;
+        }
+    }
+}
+
+void
+cache_sim_pipeline_t::run_ll_worker(unsigned int partition)
+{
+    // We merge the L1 workers' requests back into reference order.  Each
+    // worker's requests are already in order, and all of the requests from one
+    // reference come from the same worker.
+    int buf = 1 - l1_out_buf;
+    cache_t *cache = ll_partitions[partition];
+    std::vector<size_t> pos(num_l1_workers, 0);
+    while (true) {
+        const std::vector<ll_item_t> *min_queue = NULL;
+        unsigned int min_worker = 0;
+        for (unsigned int i = 0; i < num_l1_workers; ++i) {
+            const std::vector<ll_item_t> &queue = ll_queue(buf, i, partition);
+            if (pos[i] < queue.size() &&
+                (min_queue == NULL ||
+                 queue[pos[i]].seq < (*min_queue)[pos[min_worker]].seq)) {
+                min_queue = &queue;
+                min_worker = i;
+            }
+        }
+        if (min_queue == NULL)
+            break;
+        const ll_item_t &item = (*min_queue)[pos[min_worker]++];
+        if (item.invalidate)
+            cache->invalidate(item.memref);
+        else
+            cache->request(item.memref);
+    }
+}
+
+void
+cache_sim_pipeline_t::finish(caching_device_stats_t *ll_stats)
+{
+    if (finished)
+        return;
+    finished = true;
+    // One step for the L1 workers to process the last batch and another for
+    // the LL workers to process the resulting misses.
+    launch_step();
+    launch_step();
+    wait_for_step();
+    for (auto partition : ll_partitions)
+        ll_stats->merge(*partition->get_stats());
+    for (auto forwarder : forwarders)
+        ll_stats->merge(*forwarder->get_stats());
+}
@@ -0,0 +1,174 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+/* cache_sim_pipeline: simulates the caches of cache_simulator_t on worker
+ * threads, with the last-level cache partitioned by set index.
+ */
+
+#ifndef _CACHE_SIM_PIPELINE_H_
+#define _CACHE_SIM_PIPELINE_H_ 1
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "cache.h"
+#include "cache_stats.h"
+#include "memref.h"
+
+// The L1 caches of each core are simulated by one of a set of L1 workers, and
+// each L1 worker's misses are forwarded to the LL worker owning the partition of
+// the LL holding the missed line.  The partitions are separate caches, each with
+// the LL's associativity and a contiguous range of its sets: since the set index
+// is the low bits of the tag, a partition of sets/N sets indexes exactly the
+// same ways as the full cache would.
+//
+// To produce exactly the same results as the serial simulation, each LL
+// partition must see its requests in the serial order.  References are
+// processed in batches: while the main thread gathers one batch, the L1
+// workers process the prior batch, and the LL workers process the L1 misses from
+// the batch before that, merging each L1 worker's misses by the sequence number
+// of the reference that caused them.
+//
+// Warmup and LL miss files are not supported, as they depend on the global
+// order of LL accesses.
+
+class cache_sim_pipeline_t
+{
+ public:
+    enum op_t {
+        L1I_REQUEST,
+        L1D_REQUEST,
+        L1I_FLUSH,
+        L1D_FLUSH,
+    };
+
+    // Takes ownership of the partitions, which must be initialized and have
+    // no parent, and of their stats.  ll_sets is the number of sets in the
+    // whole LL.
+    cache_sim_pipeline_t(unsigned int num_cores, unsigned int num_l1_workers,
+                         unsigned int line_size, unsigned int ll_sets,
+                         const std::vector<cache_t *> &ll_partitions);
+    ~cache_sim_pipeline_t();
+
+    // The device to use as the parent of core's L1 caches.
+    cache_t *get_l1_parent(unsigned int core);
+
+    // Must be called once the L1 caches are initialized and before dispatch().
+    void start(cache_t **icaches, cache_t **dcaches);
+
+    // Called from the main thread for each reference to simulate.
+    void dispatch(unsigned int core, op_t op, const memref_t &memref);
+
+    // Completes the simulation of all references dispatched and adds the
+    // combined LL partition statistics into ll_stats.
+    void finish(caching_device_stats_t *ll_stats);
+
+    // Returns the number of LL partitions for an LL with num_sets sets to use
+    // when num_threads worker threads are requested.
+    static unsigned int compute_ll_partitions(unsigned int num_threads,
+                                              unsigned int num_sets);
+
+ private:
+    // The parent of the L1 caches of one L1 worker, which forwards their misses
+    // and flushes to the LL workers and counts their accesses.
+    class ll_forwarder_t : public cache_t
+    {
+     public:
+        ll_forwarder_t(cache_sim_pipeline_t *pipeline, unsigned int worker);
+        virtual ~ll_forwarder_t();
+        virtual void request(const memref_t &memref);
+        virtual void flush(const memref_t &memref);
+        uint64_t cur_seq;
+     private:
+        cache_sim_pipeline_t *pipeline;
+        unsigned int worker;
+    };
+
+    struct l1_item_t {
+        uint64_t seq;
+        unsigned int core;
+        op_t op;
+        memref_t memref;
+    };
+    struct ll_item_t {
+        uint64_t seq;
+        bool invalidate;
+        memref_t memref;
+    };
+
+    void forward(unsigned int worker, uint64_t seq, const memref_t &memref,
+                 bool invalidate);
+    std::vector<ll_item_t> &ll_queue(int buf, unsigned int l1_worker,
+                                     unsigned int partition)
+    {
+        return ll_items[buf][l1_worker * ll_partitions.size() + partition];
+    }
+    void launch_step();
+    void wait_for_step();
+    void worker_main(unsigned int id);
+    void run_l1_worker(unsigned int worker);
+    void run_ll_worker(unsigned int partition);
+
+    // The number of references gathered before handing them to the workers.
+    static const size_t BATCH_SIZE = 64 * 1024;
+
+    unsigned int num_cores;
+    unsigned int num_l1_workers;
+    std::vector<cache_t *> ll_partitions;
+    std::vector<ll_forwarder_t *> forwarders;
+    cache_t **icaches;
+    cache_t **dcaches;
+    int partition_shift;
+    int line_bits;
+
+    // Double-buffered work, indexed by the *_buf fields below.
+    std::vector<std::vector<l1_item_t> > l1_items[2];
+    std::vector<std::vector<ll_item_t> > ll_items[2];
+    uint64_t next_seq;
+    size_t batch_count;
+    // The buffer the main thread is filling.
+    int dispatch_buf;
+    // The buffers used by the current step.
+    int l1_in_buf;
+    int l1_out_buf;
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start_cond;
+    std::condition_variable done_cond;
+    uint64_t step;
+    unsigned int pending;
+    bool exiting;
+    bool finished;
+};
+
+#endif /* _CACHE_SIM_PIPELINE_H_ */
@@ -30,9 +30,14 @@
  * DAMAGE.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <iterator>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
 #include <string>
+#include <vector>
 #include <assert.h>
 #include <limits.h>
 #include <stdint.h> /* for supporting 64-bit integers*/
@@ -45,7 +50,11 @@
 #include "cache.h"
 #include "cache_lru.h"
 #include "cache_fifo.h"
+#include "cache_plru.h"
+#include "cache_bit_plru.h"
+#include "cache_rrip.h"
 #include "cache_simulator.h"
+#include "../tools/report_symbolizer.h"
 #include "droption.h"
 
 analysis_tool_t *
@@ -61,68 +70,420 @@ cache_simulator_t::cache_simulator_t(const cache_simulator_knobs_t &knobs_) :
     knobs(knobs_),
     icaches(NULL),
     dcaches(NULL),
-    is_warmed_up(false)
+    llcache(NULL),
+    timing(NULL),
+    pipeline(NULL),
+    is_warmed_up(false),
+    num_invalidations(0)
 {
     // XXX i#1703: get defaults from hardware being run on.
 
-    llcache = create_cache(knobs.replace_policy);
-    if (llcache == NULL) {
+    if (!prefetcher_t::is_valid_policy(knobs.data_prefetcher)) {
+        // Unknown value.
         success = false;
         return;
     }
 
-    if (knobs.data_prefetcher != PREFETCH_POLICY_NEXTLINE &&
-        knobs.data_prefetcher != PREFETCH_POLICY_NONE) {
-        // Unknown value.
+    if (!parse_record_function_list(knobs.record_function, &func_names)) {
+        ERRMSG("Usage error: invalid -record_function list.\n");
         success = false;
         return;
     }
 
     bool warmup_enabled = ((knobs.warmup_refs > 0) || (knobs.warmup_fraction > 0.0));
 
-    if (!llcache->init(knobs.LL_assoc, (int)knobs.line_size,
-                       (int)knobs.LL_size, NULL,
-                       new cache_stats_t(knobs.LL_miss_file, warmup_enabled))) {
-        ERRMSG("Usage error: failed to initialize LL cache.  Ensure sizes and "
-               "associativity are powers of 2, that the total size is a multiple "
-               "of the line size, and that any miss file path is writable.\n");
+    miss_file_format_t miss_format;
+    if (knobs.LL_miss_format == "text")
+        miss_format = MISS_FILE_TEXT;
+    else if (knobs.LL_miss_format == "binary")
+        miss_format = MISS_FILE_BINARY;
+    else if (knobs.LL_miss_format == "binary_tid_time")
+        miss_format = MISS_FILE_BINARY_TID_TIME;
+    else {
+        ERRMSG("Usage error: unknown -LL_miss_format %s.\n",
+               knobs.LL_miss_format.c_str());
         success = false;
         return;
     }
 
-    icaches = new cache_t* [knobs.num_cores];
-    dcaches = new cache_t* [knobs.num_cores];
-    for (unsigned int i = 0; i < knobs.num_cores; i++) {
-        icaches[i] = create_cache(knobs.replace_policy);
-        if (icaches[i] == NULL) {
+    if (knobs.timing &&
+        (knobs.sim_threads > 1 || knobs.timing_mlp == 0 || knobs.timing_rob_size == 0)) {
+        ERRMSG("Usage error: -timing needs positive -timing_mlp and -timing_rob_size "
+               "and is not supported with -sim_threads.\n");
+        success = false;
+        return;
+    }
+
+    if (!knobs.caches.empty()) {
+        if (knobs.sim_threads > 1) {
+            ERRMSG("Usage error: a cache configuration file is not supported with "
+                   "-sim_threads.\n");
             success = false;
             return;
         }
-        dcaches[i] = create_cache(knobs.replace_policy);
-        if (dcaches[i] == NULL) {
+        if (!init_hierarchy(warmup_enabled, miss_format)) {
             success = false;
             return;
         }
+    } else if ((llcache = create_cache(knobs.replace_policy)) == NULL) {
+        success = false;
+        return;
+    } else if (!llcache->init(knobs.LL_assoc, (int)knobs.line_size,
+                              (int)knobs.LL_size, NULL,
+                              new cache_stats_t(knobs.LL_miss_file, warmup_enabled,
+                                                miss_format))) {
+        ERRMSG("Usage error: failed to initialize LL cache.  Ensure sizes and "
+               "associativity are powers of 2, that the total size is a multiple "
+               "of the line size, and that any miss file path is writable.\n");
+        success = false;
+        return;
+    }
+
+    if (!knobs.warmup_load_file.empty() && warmup_enabled) {
+        ERRMSG("Usage error: -warmup_load_file replaces -warmup_refs and "
+               "-warmup_fraction.\n");
+        success = false;
+        return;
+    }
+    if (!knobs.warmup_save_file.empty() && !warmup_enabled) {
+        ERRMSG("Usage error: -warmup_save_file requires -warmup_refs or "
+               "-warmup_fraction.\n");
+        success = false;
+        return;
+    }
+    if ((!knobs.warmup_save_file.empty() || !knobs.warmup_load_file.empty()) &&
+        knobs.sim_threads > 1) {
+        ERRMSG("Usage error: -warmup_save_file and -warmup_load_file are not "
+               "supported with -sim_threads.\n");
+        success = false;
+        return;
+    }
+
+    if (!knobs.regions_file.empty() &&
+        (warmup_enabled || !knobs.warmup_load_file.empty() || knobs.skip_refs > 0 ||
+         knobs.sim_threads > 1)) {
+        ERRMSG("Usage error: -regions_file replaces -skip_refs, -warmup_refs, "
+               "-warmup_fraction, and -warmup_load_file, and is not supported with "
+               "-sim_threads.\n");
+        success = false;
+        return;
+    }
+
+    if (!knobs.stats_file.empty() && knobs.sim_threads > 1) {
+        ERRMSG("Usage error: -stats_file is not supported with -sim_threads.\n");
+        success = false;
+        return;
+    }
+
+    if ((knobs.coherence || knobs.switch_flush) && knobs.sim_threads > 1) {
+        ERRMSG("Usage error: -coherence and -sched_switch_flush are not supported "
+               "with -sim_threads.\n");
+        success = false;
+        return;
+    }
+
+    if (knobs.miss_hotspots && !IS_POWER_OF_2(knobs.miss_region_size)) {
+        ERRMSG("Usage error: -miss_region_size must be a power of 2.\n");
+        success = false;
+        return;
+    }
 
-        if (!icaches[i]->init(knobs.L1I_assoc, (int)knobs.line_size,
-                              (int)knobs.L1I_size, llcache,
-                              new cache_stats_t("", warmup_enabled)) ||
-            !dcaches[i]->init(knobs.L1D_assoc, (int)knobs.line_size,
-                              (int)knobs.L1D_size, llcache,
-                              new cache_stats_t("", warmup_enabled),
-                              knobs.data_prefetcher == PREFETCH_POLICY_NEXTLINE ?
-                              new prefetcher_t((int)knobs.line_size) : nullptr)) {
-            ERRMSG("Usage error: failed to initialize L1 caches.  Ensure sizes and "
-                   "associativity are powers of 2 "
-                   "and that the total sizes are multiples of the line size.\n");
+    if (knobs.sim_threads > 1 && !init_pipeline(knobs.sim_threads)) {
+        success = false;
+        return;
+    }
+
+    // The caches of a configuration file were all set up above.
+    if (knobs.caches.empty()) {
+        icaches = new cache_t* [knobs.num_cores];
+        dcaches = new cache_t* [knobs.num_cores];
+        for (unsigned int i = 0; i < knobs.num_cores; i++) {
+            icaches[i] = create_cache(knobs.replace_policy);
+            if (icaches[i] == NULL) {
+                success = false;
+                return;
+            }
+            dcaches[i] = create_cache(knobs.replace_policy);
+            if (dcaches[i] == NULL) {
+                success = false;
+                return;
+            }
+
+            cache_t *parent = (pipeline == NULL) ? llcache : pipeline->get_l1_parent(i);
+            if (!icaches[i]->init(knobs.L1I_assoc, (int)knobs.line_size,
+                                  (int)knobs.L1I_size, parent,
+                                  new cache_stats_t("", warmup_enabled)) ||
+                !dcaches[i]->init(knobs.L1D_assoc, (int)knobs.line_size,
+                                  (int)knobs.L1D_size, parent,
+                                  new cache_stats_t("", warmup_enabled),
+                                  prefetcher_t::create(knobs.data_prefetcher,
+                                                       (int)knobs.line_size,
+                                                       (int)knobs.prefetch_degree,
+                                                       (int)knobs.prefetch_distance))) {
+                ERRMSG("Usage error: failed to initialize L1 caches.  Ensure sizes and "
+                       "associativity are powers of 2 "
+                       "and that the total sizes are multiples of the line size.\n");
+                success = false;
+                return;
+            }
+        }
+    }
+    if (knobs.caches.empty()) {
+        latencies[llcache] = knobs.LL_latency;
+        for (unsigned int i = 0; i < knobs.num_cores; i++) {
+            latencies[icaches[i]] = knobs.L1_latency;
+            latencies[dcaches[i]] = knobs.L1_latency;
+        }
+    }
+    if (knobs.timing)
+        init_timing();
+    if (knobs.miss_hotspots) {
+        for (caching_device_t *device : warmup_devices()) {
+            device->get_stats()->enable_miss_hotspots(knobs.report_top,
+                                                      knobs.miss_region_size);
+        }
+    }
+    if (pipeline != NULL)
+        pipeline->start(icaches, dcaches);
+
+    if (!knobs.warmup_load_file.empty()) {
+        if (!load_warmup_state(knobs.warmup_load_file, warmup_config(),
+                               warmup_devices())) {
+            ERRMSG("Usage error: failed to load warmup state from %s.  Ensure it was "
+                   "saved with the same cache configuration.\n",
+                   knobs.warmup_load_file.c_str());
             success = false;
             return;
         }
+        is_warmed_up = true;
+    }
+    if (!knobs.regions_file.empty() &&
+        !load_regions(knobs.regions_file, knobs.regions_warmup, warmup_devices())) {
+        ERRMSG("Usage error: failed to read the regions from %s.  Ensure it was "
+               "written by the regions tool.\n", knobs.regions_file.c_str());
+        success = false;
+        return;
+    }
+    if (!knobs.stats_file.empty() &&
+        !open_stats_file(knobs.stats_file, knobs.stats_interval, warmup_devices(),
+                         warmup_device_names())) {
+        ERRMSG("Usage error: failed to open -stats_file %s.  Ensure it is writable "
+               "and that -stats_interval is positive.\n", knobs.stats_file.c_str());
+        success = false;
+        return;
     }
 }
 
+bool
+cache_simulator_t::init_hierarchy(bool warmup_enabled, miss_file_format_t miss_format)
+{
+    std::unordered_map<std::string, size_t> by_name;
+    for (const cache_params_t &params : knobs.caches) {
+        if (params.name == "memory" || by_name.find(params.name) != by_name.end()) {
+            ERRMSG("Usage error: cache name %s is reserved or used twice.\n",
+                   params.name.c_str());
+            return false;
+        }
+        cache_t *cache = create_cache(params.replace_policy.empty() ?
+                                      knobs.replace_policy : params.replace_policy);
+        if (cache == NULL)
+            return false;
+        by_name[params.name] = hierarchy.size();
+        hierarchy.push_back(cache);
+    }
+    icaches = new cache_t* [knobs.num_cores];
+    dcaches = new cache_t* [knobs.num_cores];
+    for (unsigned int i = 0; i < knobs.num_cores; i++) {
+        icaches[i] = NULL;
+        dcaches[i] = NULL;
+    }
+    for (size_t i = 0; i < knobs.caches.size(); i++) {
+        const cache_params_t &params = knobs.caches[i];
+        cache_t *cache = hierarchy[i];
+        bool is_l1 = params.type != "unified";
+        cache_t *parent = NULL;
+        if (params.parent == "memory") {
+            if (llcache != NULL || is_l1) {
+                ERRMSG("Usage error: only a single unified cache may have memory as "
+                       "its parent.\n");
+                return false;
+            }
+            llcache = cache;
+        } else {
+            auto it = by_name.find(params.parent);
+            if (it == by_name.end() || knobs.caches[it->second].type != "unified") {
+                ERRMSG("Usage error: parent %s of cache %s is unknown or a "
+                       "first-level cache.\n", params.parent.c_str(),
+                       params.name.c_str());
+                return false;
+            }
+            parent = hierarchy[it->second];
+        }
+        if (is_l1) {
+            cache_t **l1 = params.type == "instruction" ? icaches : dcaches;
+            if (params.core < 0 || params.core >= (int)knobs.num_cores ||
+                l1[params.core] != NULL || params.inclusion == "exclusive") {
+                ERRMSG("Usage error: cache %s must be the only %s cache of a core "
+                       "below num_cores and cannot be exclusive.\n",
+                       params.name.c_str(), params.type.c_str());
+                return false;
+            }
+            l1[params.core] = cache;
+        } else if (cache != llcache) {
+            mid_caches.push_back(cache);
+            mid_cache_names.push_back(params.name);
+        }
+        std::string prefetch = params.prefetcher;
+        if (prefetch.empty())
+            prefetch = params.type == "data" ? knobs.data_prefetcher : "none";
+        if (!prefetcher_t::is_valid_policy(prefetch)) {
+            ERRMSG("Usage error: unknown prefetcher %s of cache %s.\n",
+                   prefetch.c_str(), params.name.c_str());
+            return false;
+        }
+        if (!cache->init(params.assoc, (int)knobs.line_size, (int)params.size, parent,
+                         new cache_stats_t(cache == llcache ? knobs.LL_miss_file : "",
+                                           warmup_enabled, miss_format),
+                         prefetcher_t::create(prefetch, (int)knobs.line_size,
+                                              (int)knobs.prefetch_degree,
+                                              (int)knobs.prefetch_distance))) {
+            ERRMSG("Usage error: failed to initialize cache %s.  Ensure its size and "
+                   "associativity are powers of 2, that its size is a multiple of "
+                   "the line size, and that any miss file path is writable.\n",
+                   params.name.c_str());
+            return false;
+        }
+        latencies[cache] = params.latency;
+        if (params.inclusion == "inclusive")
+            cache->set_inclusion(INCLUSION_INCLUSIVE);
+        else if (params.inclusion == "exclusive")
+            cache->set_inclusion(INCLUSION_EXCLUSIVE);
+    }
+    if (llcache == NULL) {
+        ERRMSG("Usage error: no cache has memory as its parent.\n");
+        return false;
+    }
+    for (unsigned int i = 0; i < knobs.num_cores; i++) {
+        if (icaches[i] == NULL || dcaches[i] == NULL) {
+            ERRMSG("Usage error: core %u lacks an instruction or data cache.\n", i);
+            return false;
+        }
+    }
+    // Every cache must reach memory: a chain of parents longer than the number
+    // of caches is a cycle.
+    for (size_t i = 0; i < hierarchy.size(); i++) {
+        caching_device_t *device = hierarchy[i];
+        for (size_t steps = 0; device != NULL; steps++) {
+            if (steps == hierarchy.size()) {
+                ERRMSG("Usage error: cache %s is part of a parent cycle.\n",
+                       knobs.caches[i].name.c_str());
+                return false;
+            }
+            device = device->get_parent();
+        }
+    }
+    return true;
+}
+
+std::string
+cache_simulator_t::warmup_config() const
+{
+    std::ostringstream config;
+    config << "cache " << knobs.num_cores << " " << knobs.replace_policy << " "
+           << knobs.data_prefetcher;
+    for (const cache_params_t &params : knobs.caches) {
+        config << " " << params.name << ":" << params.parent << ":" << params.inclusion
+               << ":" << params.replace_policy << ":" << params.prefetcher;
+    }
+    return config.str();
+}
+
+std::vector<caching_device_t *>
+cache_simulator_t::warmup_devices() const
+{
+    std::vector<caching_device_t *> devices;
+    devices.push_back(llcache);
+    for (unsigned int i = 0; i < knobs.num_cores; i++) {
+        devices.push_back(icaches[i]);
+        devices.push_back(dcaches[i]);
+    }
+    devices.insert(devices.end(), mid_caches.begin(), mid_caches.end());
+    return devices;
+}
+
+std::vector<std::string>
+cache_simulator_t::warmup_device_names() const
+{
+    std::vector<std::string> names;
+    names.push_back("LL");
+    for (unsigned int i = 0; i < knobs.num_cores; i++) {
+        std::string core = "Core #" + std::to_string(i);
+        names.push_back(core + " L1I");
+        names.push_back(core + " L1D");
+    }
+    names.insert(names.end(), mid_cache_names.begin(), mid_cache_names.end());
+    return names;
+}
+
+bool
+cache_simulator_t::init_pipeline(unsigned int num_threads)
+{
+    if (knobs.warmup_refs > 0 || knobs.warmup_fraction > 0.0 ||
+        !knobs.LL_miss_file.empty()) {
+        ERRMSG("Usage error: multi-threaded simulation does not support warmup or "
+               "an LL miss file.\n");
+        return false;
+    }
+    unsigned int ll_sets =
+        (unsigned int)(knobs.LL_size / knobs.line_size / knobs.LL_assoc);
+    unsigned int num_partitions =
+        cache_sim_pipeline_t::compute_ll_partitions(num_threads, ll_sets);
+    unsigned int num_l1_workers = num_threads - num_partitions;
+    if (num_l1_workers > knobs.num_cores)
+        num_l1_workers = knobs.num_cores;
+    // Each partition holds a contiguous range of the LL's sets.
+    std::vector<cache_t *> partitions;
+    for (unsigned int i = 0; i < num_partitions; i++) {
+        cache_t *partition = create_cache(knobs.replace_policy);
+        if (partition == NULL ||
+            !partition->init(knobs.LL_assoc, (int)knobs.line_size,
+                             (int)(knobs.LL_size / num_partitions), NULL,
+                             new cache_stats_t)) {
+            // The LL's own init already succeeded so this should not happen.
+            ERRMSG("Usage error: failed to initialize LL cache partitions.\n");
+            delete partition;
+            for (auto p : partitions) {
+                delete p->get_stats();
+                delete p;
+            }
+            return false;
+        }
+        if (knobs.miss_hotspots) {
+            partition->get_stats()->enable_miss_hotspots(knobs.report_top,
+                                                         knobs.miss_region_size);
+        }
+        partitions.push_back(partition);
+    }
+    pipeline = new cache_sim_pipeline_t(knobs.num_cores, num_l1_workers,
+                                        knobs.line_size, ll_sets, partitions);
+    return true;
+}
+
 cache_simulator_t::~cache_simulator_t()
 {
+    // The workers must be stopped before the caches they use are deleted.
+    delete pipeline;
+    delete timing;
+    if (!hierarchy.empty()) {
+        for (cache_t *cache : hierarchy) {
+            delete cache->get_stats();
+            delete cache->get_prefetcher();
+            delete cache;
+        }
+        delete [] icaches;
+        delete [] dcaches;
+        return;
+    }
     if (llcache == NULL)
         return;
     delete llcache->get_stats();
@@ -155,9 +516,16 @@ cache_simulator_t::process_memref(const memref_t &memref)
         return true;
     }
 
+    // The references outside of the -regions_file regions and their warmup are
+    // dropped.
+    if (!regions.empty() && !in_region(memref))
+        return true;
+
     // The references after warmup and simulated ones are dropped.
-    if (check_warmed_up() && knobs.sim_refs == 0)
-        return true;;
+    // Warmup completion is only detected below, after simulating a reference, so
+    // that it is handled exactly once.
+    if (is_warmed_up && knobs.sim_refs == 0)
+        return true;
 
     // Both warmup and simulated references are simulated.
 
@@ -171,6 +539,12 @@ cache_simulator_t::process_memref(const memref_t &memref)
                 "marker type " << memref.marker.marker_type <<
                 " value " << memref.marker.marker_value << "\n";
         }
+        if (memref.marker.marker_type == TRACE_MARKER_TYPE_TIMESTAMP &&
+            !knobs.LL_miss_file.empty())
+            llcache->get_stats()->set_miss_timestamp(memref.marker.marker_value);
+        else if (memref.marker.marker_type >= TRACE_MARKER_TYPE_FUNC_ID &&
+                 memref.marker.marker_type <= TRACE_MARKER_TYPE_FUNC_RETVAL)
+            handle_func_marker(memref);
         return true;
     }
 
@@ -186,6 +560,19 @@ cache_simulator_t::process_memref(const memref_t &memref)
         last_core = core;
     }
 
+    // With -record_function, we attribute the misses of each reference to the
+    // innermost recorded function active in its thread.
+    func_stats_t *func = NULL;
+    int_least64_t L1I_misses = 0, L1D_misses = 0, LL_misses = 0;
+    if (!func_threads.empty() && pipeline == NULL) {
+        func = innermost_func(memref.data.tid);
+        if (func != NULL) {
+            L1I_misses = icaches[core]->get_stats()->get_misses();
+            L1D_misses = dcaches[core]->get_stats()->get_misses();
+            LL_misses = llcache->get_stats()->get_misses();
+        }
+    }
+
     if (type_is_instr(memref.instr.type) ||
         memref.instr.type == TRACE_TYPE_PREFETCH_INSTR) {
         if (knobs.verbose >= 3) {
@@ -193,7 +580,16 @@ cache_simulator_t::process_memref(const memref_t &memref)
                 " @" << (void *)memref.instr.addr << " instr x" <<
                 memref.instr.size << "\n";
         }
-        icaches[core]->request(memref);
+        if (pipeline != NULL)
+            pipeline->dispatch(core, cache_sim_pipeline_t::L1I_REQUEST, memref);
+        else if (timing != NULL && type_is_instr(memref.instr.type)) {
+            snapshot_misses(ichains[core]);
+            icaches[core]->request(memref);
+            bool from_memory;
+            double stall = request_stall(ichains[core], &from_memory);
+            timing->instruction(core, memref.instr.tid, stall, from_memory);
+        } else
+            icaches[core]->request(memref);
     } else if (memref.data.type == TRACE_TYPE_READ ||
                memref.data.type == TRACE_TYPE_WRITE ||
                // We may potentially handle prefetches differently.
@@ -205,21 +601,38 @@ cache_simulator_t::process_memref(const memref_t &memref)
                 " " << trace_type_names[memref.data.type] << " " <<
                 (void *)memref.data.addr << " x" << memref.data.size << "\n";
         }
-        dcaches[core]->request(memref);
+        if (knobs.coherence && memref.data.type == TRACE_TYPE_WRITE)
+            invalidate_sharers(core, memref);
+        if (pipeline != NULL)
+            pipeline->dispatch(core, cache_sim_pipeline_t::L1D_REQUEST, memref);
+        else if (timing != NULL) {
+            snapshot_misses(dchains[core]);
+            dcaches[core]->request(memref);
+            bool from_memory;
+            double stall = request_stall(dchains[core], &from_memory);
+            timing->data_access(core, memref.data.tid, stall, from_memory);
+        } else
+            dcaches[core]->request(memref);
     } else if (memref.flush.type == TRACE_TYPE_INSTR_FLUSH) {
         if (knobs.verbose >= 3) {
             std::cerr << "::" << memref.data.pid << "." << memref.data.tid << ":: " <<
                 " @" << (void *)memref.data.pc << " iflush " <<
                 (void *)memref.data.addr << " x" << memref.data.size << "\n";
         }
-        icaches[core]->flush(memref);
+        if (pipeline != NULL)
+            pipeline->dispatch(core, cache_sim_pipeline_t::L1I_FLUSH, memref);
+        else
+            icaches[core]->flush(memref);
     } else if (memref.flush.type == TRACE_TYPE_DATA_FLUSH) {
         if (knobs.verbose >= 3) {
             std::cerr << "::" << memref.data.pid << "." << memref.data.tid << ":: " <<
                 " @" << (void *)memref.data.pc << " dflush " <<
                 (void *)memref.data.addr << " x" << memref.data.size << "\n";
         }
-        dcaches[core]->flush(memref);
+        if (pipeline != NULL)
+            pipeline->dispatch(core, cache_sim_pipeline_t::L1D_FLUSH, memref);
+        else
+            dcaches[core]->flush(memref);
     } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
         handle_thread_exit(memref.exit.tid);
         last_thread = 0;
@@ -235,22 +648,106 @@ cache_simulator_t::process_memref(const memref_t &memref)
         return false;
     }
 
+    if (func != NULL) {
+        func->refs++;
+        func->L1I_misses += icaches[core]->get_stats()->get_misses() - L1I_misses;
+        func->L1D_misses += dcaches[core]->get_stats()->get_misses() - L1D_misses;
+        func->LL_misses += llcache->get_stats()->get_misses() - LL_misses;
+    }
+
     // reset cache stats when warming up is completed
     if (!is_warmed_up && check_warmed_up()) {
-        for (unsigned int i = 0; i < knobs.num_cores; i++) {
-            icaches[i]->get_stats()->reset();
-            dcaches[i]->get_stats()->reset();
+        if (!knobs.warmup_save_file.empty() &&
+            !save_warmup_state(knobs.warmup_save_file, warmup_config(),
+                               warmup_devices())) {
+            ERRMSG("Failed to save warmup state to %s.\n",
+                   knobs.warmup_save_file.c_str());
+            return false;
         }
-        llcache->get_stats()->reset();
+        for (caching_device_t *device : warmup_devices())
+            device->get_stats()->reset();
+        if (timing != NULL)
+            timing->reset();
+        line_sharing.clear();
+        pc_invalidations.clear();
+        num_invalidations = 0;
+        func_stats.clear();
         if (knobs.verbose >= 1) {
             std::cerr << "Cache simulation warmed up\n";
         }
     } else {
         knobs.sim_refs--;
+        // Snapshots cover the simulated references after any warmup.
+        if (is_warmed_up || (knobs.warmup_refs == 0 && knobs.warmup_fraction == 0.0))
+            count_stats_ref();
     }
     return true;
 }
 
+void
+cache_simulator_t::handle_context_switch(int core)
+{
+    if (!knobs.switch_flush)
+        return;
+    icaches[core]->invalidate_all();
+    dcaches[core]->invalidate_all();
+}
+
+void
+cache_simulator_t::invalidate_sharers(int core, const memref_t &memref)
+{
+    // We model only the invalidations of a write-invalidate protocol: we do not
+    // track line states, so reads neither downgrade nor invalidate other copies.
+    addr_t line_size = knobs.line_size;
+    addr_t first = memref.data.addr & ~(line_size - 1);
+    addr_t last = (memref.data.addr + memref.data.size - 1/*no overflow*/) &
+        ~(line_size - 1);
+    // Each mask bit covers line_size/64 bytes for lines larger than 64 bytes.
+    addr_t granule = line_size > 64 ? line_size / 64 : 1;
+    memref_t inval = memref;
+    inval.flush.size = 1;
+    for (addr_t line = first; line <= last; line += line_size) {
+        int_least64_t count = 0;
+        inval.flush.addr = line;
+        for (unsigned int i = 0; i < knobs.num_cores; i++) {
+            if ((int)i == core || !dcaches[i]->contains(line))
+                continue;
+            dcaches[i]->invalidate(inval);
+            ((cache_stats_t *)dcaches[i]->get_stats())->coherence_invalidation();
+            ++count;
+        }
+        if (count == 0)
+            continue;
+        num_invalidations += count;
+        pc_invalidations[memref.data.pc] += count;
+        line_sharing_t &sharing = line_sharing[line];
+        sharing.invalidations += count;
+        addr_t start = std::max(memref.data.addr, line) - line;
+        addr_t end = std::min(memref.data.addr + memref.data.size - 1,
+                              line + line_size - 1) - line;
+        uint64_t mask = 0;
+        for (addr_t bit = start / granule; bit <= end / granule; ++bit)
+            mask |= 1ULL << bit;
+        sharing.write_masks[core] |= mask;
+    }
+}
+
+bool
+cache_simulator_t::process_memrefs(const memref_t *memrefs, size_t count)
+{
+    // Skipped references are dropped wholesale.
+    size_t start = 0;
+    if (knobs.skip_refs > 0) {
+        start = (size_t)std::min<uint64_t>(knobs.skip_refs, count);
+        knobs.skip_refs -= start;
+    }
+    bool res = true;
+    // We avoid the virtual dispatch of the default implementation.
+    for (size_t i = start; i < count; ++i)
+        res = cache_simulator_t::process_memref(memrefs[i]) && res;
+    return res;
+}
+
 // Return true if the number of warmup references have been executed or if
 // specified fraction of the llcache has been loaded. Also return true if the
 // cache has already been warmed up.
@@ -286,6 +783,9 @@ cache_simulator_t::check_warmed_up()
 bool
 cache_simulator_t::print_results()
 {
+    if (pipeline != NULL)
+        pipeline->finish(llcache->get_stats());
+    finish_stats();
     std::cerr << "Cache simulation results:\n";
     for (unsigned int i = 0; i < knobs.num_cores; i++) {
         print_core(i);
@@ -296,11 +796,243 @@ cache_simulator_t::print_results()
             dcaches[i]->get_stats()->print_stats("    ");
         }
     }
+    for (size_t i = 0; i < mid_caches.size(); i++) {
+        std::cerr << mid_cache_names[i] << " stats:" << std::endl;
+        mid_caches[i]->get_stats()->print_stats("    ");
+    }
     std::cerr << "LL stats:" << std::endl;
     llcache->get_stats()->print_stats("    ");
+    print_access_time();
+    if (timing != NULL)
+        timing->print_results();
+    if (knobs.coherence)
+        print_coherence_results();
+    if (!func_stats.empty())
+        print_func_results();
+    if (!regions.empty())
+        print_region_results(warmup_device_names());
     return true;
 }
 
+void
+cache_simulator_t::print_access_time()
+{
+    // Each demand lookup of a cache takes its latency, and each of the LL's
+    // demand misses takes the memory latency on top.
+    double cycles = (double)llcache->get_stats()->get_misses() * knobs.memory_latency;
+    bool have_latency = knobs.memory_latency > 0;
+    for (caching_device_t *device : warmup_devices()) {
+        const caching_device_stats_t *stats = device->get_stats();
+        cycles += (double)(stats->get_hits() + stats->get_misses()) * latencies[device];
+        have_latency = have_latency || latencies[device] > 0;
+    }
+    int_least64_t accesses = 0;
+    for (unsigned int i = 0; i < knobs.num_cores; i++) {
+        accesses += icaches[i]->get_stats()->get_hits() +
+            icaches[i]->get_stats()->get_misses() +
+            dcaches[i]->get_stats()->get_hits() + dcaches[i]->get_stats()->get_misses();
+    }
+    if (!have_latency || accesses == 0)
+        return;
+    std::cerr << "Average memory access time: " << std::fixed << std::setprecision(2)
+              << cycles / accesses << " cycles" << std::endl;
+}
+
+void
+cache_simulator_t::init_timing()
+{
+    timing = new timing_model_t(knobs.num_cores, knobs.timing_base_cpi,
+                                knobs.timing_rob_size, knobs.timing_mlp,
+                                knobs.memory_bandwidth, knobs.line_size);
+    ichains.resize(knobs.num_cores);
+    dchains.resize(knobs.num_cores);
+    for (unsigned int i = 0; i < knobs.num_cores; i++) {
+        for (caching_device_t *device = icaches[i]; device != NULL;
+             device = device->get_parent())
+            ichains[i].push_back(device);
+        for (caching_device_t *device = dcaches[i]; device != NULL;
+             device = device->get_parent())
+            dchains[i].push_back(device);
+    }
+}
+
+void
+cache_simulator_t::snapshot_misses(const std::vector<caching_device_t *> &chain)
+{
+    chain_misses.resize(chain.size());
+    for (size_t i = 0; i < chain.size(); i++)
+        chain_misses[i] = chain[i]->get_stats()->get_misses();
+}
+
+double
+cache_simulator_t::request_stall(const std::vector<caching_device_t *> &chain,
+                                 bool *from_memory)
+{
+    // The request was served by the first cache whose demand misses did not
+    // grow, after a lookup of each cache up to it, or else by memory.  A
+    // first-level hit's latency is part of the base CPI.
+    double stall = 0;
+    *from_memory = false;
+    for (size_t i = 0; i < chain.size(); i++) {
+        if (chain[i]->get_stats()->get_misses() == chain_misses[i])
+            break;
+        if (i + 1 < chain.size())
+            stall += latencies[chain[i + 1]];
+        else {
+            stall += knobs.memory_latency;
+            *from_memory = true;
+        }
+    }
+    return stall;
+}
+
+void
+cache_simulator_t::handle_func_marker(const memref_t &memref)
+{
+    func_thread_t &thread = func_threads[memref.marker.tid];
+    uintptr_t value = memref.marker.marker_value;
+    switch (memref.marker.marker_type) {
+    case TRACE_MARKER_TYPE_FUNC_ID:
+        thread.pending_id = (intptr_t)value;
+        break;
+    case TRACE_MARKER_TYPE_FUNC_RETADDR:
+        // The function is entered.
+        if (thread.pending_id >= 0) {
+            thread.stack.push_back((uintptr_t)thread.pending_id);
+            func_stats[(uintptr_t)thread.pending_id].calls++;
+        }
+        thread.pending_id = -1;
+        break;
+    case TRACE_MARKER_TYPE_FUNC_RETVAL:
+        // The function returns.  Any inner functions still on the stack were
+        // skipped by a longjmp or an untraced window, so we pop them as well.
+        for (size_t i = thread.stack.size(); i > 0; i--) {
+            if (thread.stack[i - 1] == (uintptr_t)thread.pending_id) {
+                thread.stack.resize(i - 1);
+                break;
+            }
+        }
+        thread.pending_id = -1;
+        break;
+    default:
+        // We do not use the arguments.
+        break;
+    }
+}
+
+cache_simulator_t::func_stats_t *
+cache_simulator_t::innermost_func(memref_tid_t tid)
+{
+    auto thread = func_threads.find(tid);
+    if (thread == func_threads.end() || thread->second.stack.empty())
+        return NULL;
+    return &func_stats[thread->second.stack.back()];
+}
+
+void
+cache_simulator_t::print_func_results()
+{
+    std::vector<std::pair<uintptr_t, const func_stats_t *> > funcs;
+    for (const auto &entry : func_stats)
+        funcs.push_back(std::make_pair(entry.first, &entry.second));
+    size_t num_funcs = std::min<size_t>(knobs.report_top, funcs.size());
+    std::partial_sort(funcs.begin(), funcs.begin() + num_funcs, funcs.end(),
+                      [](const std::pair<uintptr_t, const func_stats_t *> &l,
+                         const std::pair<uintptr_t, const func_stats_t *> &r) {
+                          if (l.second->LL_misses != r.second->LL_misses)
+                              return l.second->LL_misses > r.second->LL_misses;
+                          return l.first < r.first;
+                      });
+    std::cerr << "Top " << num_funcs << " recorded functions by LL misses\n";
+    std::cerr << std::setw(18) << "function" << ": " << std::setw(10) << "#calls" <<
+        ", " << std::setw(12) << "#refs" << ", " << std::setw(12) << "#L1I misses" <<
+        ", " << std::setw(12) << "#L1D misses" << ", " << std::setw(12) <<
+        "#LL misses" << "\n";
+    for (size_t i = 0; i < num_funcs; i++) {
+        uintptr_t id = funcs[i].first;
+        const func_stats_t *stats = funcs[i].second;
+        std::string name = id < func_names.size() ? func_names[id].name :
+            "#" + std::to_string(id);
+        std::cerr << std::setw(18) << name << ": " << std::setw(10) << stats->calls <<
+            ", " << std::setw(12) << stats->refs << ", " << std::setw(12) <<
+            stats->L1I_misses << ", " << std::setw(12) << stats->L1D_misses << ", " <<
+            std::setw(12) << stats->LL_misses << "\n";
+    }
+}
+
+void
+cache_simulator_t::print_coherence_results()
+{
+    std::cerr << "Coherence invalidations: " << num_invalidations << "\n";
+
+    std::vector<std::pair<addr_t, const line_sharing_t *> > lines;
+    for (const auto &entry : line_sharing)
+        lines.push_back(std::make_pair(entry.first, &entry.second));
+    size_t num_lines = std::min<size_t>(knobs.report_top, lines.size());
+    std::partial_sort(lines.begin(), lines.begin() + num_lines, lines.end(),
+                      [](const std::pair<addr_t, const line_sharing_t *> &l,
+                         const std::pair<addr_t, const line_sharing_t *> &r) {
+                          if (l.second->invalidations != r.second->invalidations)
+                              return l.second->invalidations > r.second->invalidations;
+                          return l.first < r.first;
+                      });
+    std::vector<std::pair<addr_t, int_least64_t> > pcs(pc_invalidations.begin(),
+                                                        pc_invalidations.end());
+    size_t num_pcs = std::min<size_t>(knobs.report_top, pcs.size());
+    std::partial_sort(pcs.begin(), pcs.begin() + num_pcs, pcs.end(),
+                      [](const std::pair<addr_t, int_least64_t> &l,
+                         const std::pair<addr_t, int_least64_t> &r) {
+                          if (l.second != r.second)
+                              return l.second > r.second;
+                          return l.first < r.first;
+                      });
+    // We symbolize both lists in one batch.
+    std::vector<std::string> names(num_lines + num_pcs);
+    if (knobs.symbolizer != NULL) {
+        std::vector<addr_t> addrs;
+        for (size_t i = 0; i < num_lines; i++)
+            addrs.push_back(lines[i].first);
+        for (size_t i = 0; i < num_pcs; i++)
+            addrs.push_back(pcs[i].first);
+        knobs.symbolizer->symbolize(addrs, &names);
+    }
+
+    std::cerr << "Top " << num_lines << " cache lines by cross-core invalidations\n";
+    std::cerr << std::setw(18) << "cache line" << ": " << std::setw(14) <<
+        "#invalidations" << ", " << std::setw(8) << "#writers" << "\n";
+    for (size_t i = 0; i < num_lines; i++) {
+        const line_sharing_t *sharing = lines[i].second;
+        // If no two writing cores touched the same bytes, the line is only
+        // falsely shared among them.
+        uint64_t written = 0;
+        bool overlap = false;
+        for (const auto &mask : sharing->write_masks) {
+            if ((written & mask.second) != 0)
+                overlap = true;
+            written |= mask.second;
+        }
+        std::cerr << std::setw(18) << std::hex << std::showbase << lines[i].first <<
+            ": " << std::setw(14) << std::dec << sharing->invalidations <<
+            ", " << std::setw(8) << sharing->write_masks.size();
+        if (sharing->write_masks.size() > 1 && !overlap)
+            std::cerr << "  (likely false sharing)";
+        if (!names[i].empty())
+            std::cerr << "  " << names[i];
+        std::cerr << "\n";
+    }
+
+    std::cerr << "Top " << num_pcs << " writing PCs by cross-core invalidations\n";
+    std::cerr << std::setw(18) << "pc" << ": " << std::setw(14) <<
+        "#invalidations" << "\n";
+    for (size_t i = 0; i < num_pcs; i++) {
+        std::cerr << std::setw(18) << std::hex << std::showbase << pcs[i].first <<
+            ": " << std::setw(14) << std::dec << pcs[i].second;
+        if (!names[num_lines + i].empty())
+            std::cerr << "  " << names[num_lines + i];
+        std::cerr << "\n";
+    }
+}
+
 cache_t*
 cache_simulator_t::create_cache(std::string policy)
 {
@@ -311,9 +1043,19 @@ cache_simulator_t::create_cache(std::string policy)
         return new cache_t;
     if (policy == REPLACE_POLICY_FIFO) // set to FIFO
         return new cache_fifo_t;
+    if (policy == REPLACE_POLICY_PLRU)
+        return new cache_plru_t;
+    if (policy == REPLACE_POLICY_BIT_PLRU)
+        return new cache_bit_plru_t;
+    if (policy == REPLACE_POLICY_SRRIP)
+        return new cache_rrip_t(false/*!bimodal*/);
+    if (policy == REPLACE_POLICY_BRRIP)
+        return new cache_rrip_t(true/*bimodal*/);
 
     // undefined replacement policy
     ERRMSG("Usage error: undefined replacement policy. "
-           "Please choose " REPLACE_POLICY_LRU" or " REPLACE_POLICY_LFU".\n");
+           "Please choose " REPLACE_POLICY_LRU", " REPLACE_POLICY_LFU", "
+           REPLACE_POLICY_FIFO", " REPLACE_POLICY_PLRU", " REPLACE_POLICY_BIT_PLRU", "
+           REPLACE_POLICY_SRRIP", or " REPLACE_POLICY_BRRIP".\n");
     return NULL;
 }
@@ -41,6 +41,9 @@
 #include "cache_simulator_create.h"
 #include "cache_stats.h"
 #include "cache.h"
+#include "cache_sim_pipeline.h"
+#include "timing_model.h"
+#include "../common/record_function.h"
 
 class cache_simulator_t : public simulator_t
 {
@@ -48,6 +51,7 @@ class cache_simulator_t : public simulator_t
     cache_simulator_t(const cache_simulator_knobs_t &knobs);
     virtual ~cache_simulator_t();
     virtual bool process_memref(const memref_t &memref);
+    virtual bool process_memrefs(const memref_t *memrefs, size_t count);
     virtual bool print_results();
 
     // Exposed to make it easy to test
@@ -55,6 +59,7 @@ class cache_simulator_t : public simulator_t
  protected:
     // Create a cache_t object with a specific replacement policy.
     virtual cache_t *create_cache(std::string policy);
+    virtual void handle_context_switch(int core);
 
     // Currently we only support a simple 2-level hierarchy.
     // XXX i#1715: add support for arbitrary cache layouts.
@@ -67,8 +72,84 @@ class cache_simulator_t : public simulator_t
     cache_t **dcaches;
 
     cache_t *llcache;
+
+    // With a configuration file, every cache, in its order, which we own.  The
+    // caches between the first-level ones and llcache are also listed in
+    // mid_caches, with their names.
+    std::vector<cache_t *> hierarchy;
+    std::vector<cache_t *> mid_caches;
+    std::vector<std::string> mid_cache_names;
+
+    // The lookup latency of every cache.
+    std::unordered_map<caching_device_t *, unsigned int> latencies;
+
+    timing_model_t *timing;
+    // Each core's first-level caches followed by their ancestors.
+    std::vector<std::vector<caching_device_t *> > ichains;
+    std::vector<std::vector<caching_device_t *> > dchains;
+    std::vector<int_least64_t> chain_misses;
+
+    // Non-NULL when the caches are simulated on worker threads.
+    cache_sim_pipeline_t *pipeline;
  private:
+    bool init_pipeline(unsigned int num_threads);
+    bool init_hierarchy(bool warmup_enabled, miss_file_format_t miss_format);
+    void print_access_time();
+    void init_timing();
+    // For the timing model: records the misses of chain and then returns the
+    // cycles a request took beyond a first-level hit.
+    void snapshot_misses(const std::vector<caching_device_t *> &chain);
+    double request_stall(const std::vector<caching_device_t *> &chain,
+                         bool *from_memory);
+    // For knobs.coherence: invalidates the lines written by memref on core in
+    // the L1D caches of all the other cores.
+    void invalidate_sharers(int core, const memref_t &memref);
+    void print_coherence_results();
+    // The configuration string and devices for knobs.warmup_save_file and
+    // knobs.warmup_load_file.
+    std::string warmup_config() const;
+    std::vector<caching_device_t *> warmup_devices() const;
+    // Names for the devices of warmup_devices(), in the same order.
+    std::vector<std::string> warmup_device_names() const;
+
     bool is_warmed_up;
+
+    // Cross-core invalidations caused by writes to one line, for knobs.coherence.
+    struct line_sharing_t {
+        line_sharing_t() : invalidations(0) {}
+        int_least64_t invalidations;
+        // For each writing core, a bitmask of the parts of the line written by
+        // its invalidating writes, with one bit per line_size/64 bytes.
+        std::unordered_map<int, uint64_t> write_masks;
+    };
+    std::unordered_map<addr_t, line_sharing_t> line_sharing;
+    std::unordered_map<addr_t, int_least64_t> pc_invalidations;
+    int_least64_t num_invalidations;
+
+    // Per-function statistics from the markers of -record_function.
+    struct func_stats_t {
+        func_stats_t() : calls(0), refs(0), L1I_misses(0), L1D_misses(0),
+                         LL_misses(0) {}
+        int_least64_t calls;
+        int_least64_t refs;
+        int_least64_t L1I_misses;
+        int_least64_t L1D_misses;
+        int_least64_t LL_misses;
+    };
+    struct func_thread_t {
+        func_thread_t() : pending_id(-1) {}
+        // The identifiers of the recorded functions active in the thread.
+        std::vector<uintptr_t> stack;
+        // A function identifier whose marker group is not yet complete.
+        intptr_t pending_id;
+    };
+    void handle_func_marker(const memref_t &memref);
+    // Returns the stats of the innermost recorded function active in tid, if any.
+    func_stats_t *innermost_func(memref_tid_t tid);
+    void print_func_results();
+    std::vector<record_function_t> func_names;
+    std::unordered_map<memref_tid_t, func_thread_t> func_threads;
+    std::unordered_map<uintptr_t, func_stats_t> func_stats;
 };
 
 #endif /* _CACHE_SIMULATOR_H_ */
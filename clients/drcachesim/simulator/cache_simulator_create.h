@@ -36,13 +36,52 @@
 #define _CACHE_SIMULATOR_CREATE_H_ 1
 
 #include <string>
+#include <vector>
 #include "analysis_tool.h"
 
+class report_symbolizer_t;
+
 /**
  * @file drmemtrace/cache_simulator_create.h
  * @brief DrMemtrace cache simulator creation.
  */
 
+/**
+ * The parameters of one cache of a hierarchy described by a configuration file,
+ * as read by cache_simulator_read_config().
+ */
+struct cache_params_t {
+    cache_params_t() :
+        type("unified"),
+        core(-1),
+        size(0),
+        assoc(0),
+        inclusion("nine"),
+        parent("memory"),
+        replace_policy(""),
+        prefetcher(""),
+        latency(0) {}
+    std::string name;
+    // One of "instruction" or "data" for a core's first-level cache, which must
+    // set core, or "unified" for any other.
+    std::string type;
+    int core;
+    uint64_t size;
+    unsigned int assoc;
+    // One of "nine" (neither inclusive nor exclusive), "inclusive", or
+    // "exclusive", describing this cache's relation to its children.
+    std::string inclusion;
+    // The name of the next cache, or "memory" for the single last-level cache.
+    std::string parent;
+    // If empty, the knobs' replace_policy is used.
+    std::string replace_policy;
+    // If empty, the knobs' data_prefetcher is used for data caches and there is
+    // no prefetcher for the others.
+    std::string prefetcher;
+    // The cycles taken by each lookup, for the average memory access time.
+    unsigned int latency;
+};
+
 /**
  * The options for cache_simulator_create().
  * The options are currently documented in \ref sec_drcachesim_ops.
@@ -59,13 +98,38 @@ struct cache_simulator_knobs_t {
         LL_size(8*1024*1024),
         LL_assoc(16),
         LL_miss_file(""),
+        LL_miss_format("text"),
         replace_policy("LRU"),
         data_prefetcher("nextline"),
+        prefetch_degree(1),
+        prefetch_distance(1),
         skip_refs(0),
         warmup_refs(0),
         warmup_fraction(0.0),
         sim_refs(1ULL << 63),
         cpu_scheduling(false),
+        sim_threads(0),
+        coherence(false),
+        report_top(10),
+        miss_hotspots(false),
+        miss_region_size(4096),
+        switch_flush(false),
+        warmup_save_file(""),
+        warmup_load_file(""),
+        regions_file(""),
+        regions_warmup(1000000),
+        stats_file(""),
+        stats_interval(10000000),
+        record_function(""),
+        symbolizer(nullptr),
+        L1_latency(0),
+        LL_latency(0),
+        memory_latency(0),
+        timing(false),
+        timing_base_cpi(1.0),
+        timing_rob_size(128),
+        timing_mlp(8),
+        memory_bandwidth(0.0),
         verbose(0) {}
     unsigned int num_cores;
     unsigned int line_size;
@@ -76,16 +140,69 @@ struct cache_simulator_knobs_t {
     uint64_t LL_size;
     unsigned int LL_assoc;
     std::string LL_miss_file;
+    std::string LL_miss_format;
     std::string replace_policy;
     std::string data_prefetcher;
+    unsigned int prefetch_degree;
+    unsigned int prefetch_distance;
     uint64_t skip_refs;
     uint64_t warmup_refs;
     double warmup_fraction;
     uint64_t sim_refs;
     bool cpu_scheduling;
+    unsigned int sim_threads;
+    bool coherence;
+    unsigned int report_top;
+    // If true, each cache counts its misses per PC and per aligned data region
+    // of miss_region_size bytes and reports the report_top of each.
+    bool miss_hotspots;
+    uint64_t miss_region_size;
+    bool switch_flush;
+    std::string warmup_save_file;
+    std::string warmup_load_file;
+    // If non-empty, a file written by the regions tool: only its regions and the
+    // regions_warmup instructions before each are simulated.
+    std::string regions_file;
+    uint64_t regions_warmup;
+    // If non-empty, a CSV file to which the hit and miss counts of every cache
+    // or TLB are written after every stats_interval simulated references.
+    std::string stats_file;
+    uint64_t stats_interval;
+    std::string record_function;
+    // If non-null, used to symbolize the top-N report addresses.  It is owned by
+    // the caller and must outlive the simulator.
+    report_symbolizer_t *symbolizer;
+    // If non-empty, the hierarchy to simulate in place of the first-level and
+    // last-level caches described by the size and associativity knobs above.
+    std::vector<cache_params_t> caches;
+    // The cycles taken by a lookup of the first-level and last-level caches when
+    // caches is empty, and by a request to memory, for the average memory access
+    // time and the timing model.
+    unsigned int L1_latency;
+    unsigned int LL_latency;
+    unsigned int memory_latency;
+    // If true, the cycles of each core and thread are estimated with an
+    // out-of-order core model taking timing_base_cpi cycles per instruction,
+    // overlapping up to timing_mlp data misses within a reorder buffer of
+    // timing_rob_size instructions, and limiting memory to memory_bandwidth
+    // bytes per cycle, or no limit if zero.
+    bool timing;
+    double timing_base_cpi;
+    unsigned int timing_rob_size;
+    unsigned int timing_mlp;
+    double memory_bandwidth;
     unsigned int verbose;
 };
 
+/**
+ * Reads the cache hierarchy configuration file at \p path into \p knobs,
+ * setting its caches along with any other knobs the file specifies.  The
+ * format is described in \ref sec_drcachesim_config.  Returns false and
+ * prints an error on failure.
+ */
+bool
+cache_simulator_read_config(const std::string &path, cache_simulator_knobs_t *knobs);
+
 /** Creates an instance of a cache simulator. */
 analysis_tool_t *
 cache_simulator_create(const cache_simulator_knobs_t &knobs);
@@ -34,9 +34,11 @@
 #include <iomanip>
 #include "cache_stats.h"
 
-cache_stats_t::cache_stats_t(const std::string &miss_file, bool warmup_enabled) :
-    caching_device_stats_t(miss_file, warmup_enabled),
-    num_flushes(0), num_prefetch_hits(0), num_prefetch_misses(0)
+cache_stats_t::cache_stats_t(const std::string &miss_file, bool warmup_enabled,
+                             miss_file_format_t miss_format) :
+    caching_device_stats_t(miss_file, warmup_enabled, miss_format),
+    num_flushes(0), num_prefetch_hits(0), num_prefetch_misses(0),
+    num_coherence_invalidations(0)
 {
 }
 
@@ -71,6 +73,10 @@ cache_stats_t::print_counts(std::string prefix)
         std::cerr << prefix << std::setw(18) << std::left << "Flushes:" <<
             std::setw(20) << std::right << num_flushes << std::endl;
     }
+    if (num_coherence_invalidations != 0) {
+        std::cerr << prefix << std::setw(18) << std::left << "Invalidations:" <<
+            std::setw(20) << std::right << num_coherence_invalidations << std::endl;
+    }
     if (num_prefetch_hits + num_prefetch_misses != 0) {
         std::cerr << prefix << std::setw(18) << std::left << "Prefetch hits:" <<
             std::setw(20) << std::right << num_prefetch_hits << std::endl;
@@ -79,6 +85,17 @@ cache_stats_t::print_counts(std::string prefix)
     }
 }
 
+void
+cache_stats_t::merge(const caching_device_stats_t &other_in)
+{
+    caching_device_stats_t::merge(other_in);
+    const cache_stats_t &other = (const cache_stats_t &)other_in;
+    num_flushes += other.num_flushes;
+    num_prefetch_hits += other.num_prefetch_hits;
+    num_prefetch_misses += other.num_prefetch_misses;
+    num_coherence_invalidations += other.num_coherence_invalidations;
+}
+
 void
 cache_stats_t::reset()
 {
@@ -86,4 +103,5 @@ cache_stats_t::reset()
     num_flushes = 0;
     num_prefetch_hits = 0;
     num_prefetch_misses = 0;
+    num_coherence_invalidations = 0;
 }
@@ -43,7 +43,8 @@ class cache_stats_t : public caching_device_stats_t
 {
  public:
     explicit cache_stats_t(const std::string &miss_file = "",
-                           bool warmup_enabled = false);
+                           bool warmup_enabled = false,
+                           miss_file_format_t miss_format = MISS_FILE_TEXT);
 
     // In addition to caching_device_stats_t::access,
     // cache_stats_t::access processes prefetching requests.
@@ -52,8 +53,13 @@ class cache_stats_t : public caching_device_stats_t
     // process CPU cache flushes
     virtual void flush(const memref_t &memref);
 
+    // Records the invalidation of a line by another core's write.
+    void coherence_invalidation() { num_coherence_invalidations++; }
+
     virtual void reset();
 
+    virtual void merge(const caching_device_stats_t &other);
+
  protected:
     // In addition to caching_device_stats_t::print_counts,
     // cache_stats_t::print_counts prints stats for flushes and
@@ -65,6 +71,7 @@ class cache_stats_t : public caching_device_stats_t
     int_least64_t num_flushes;
     int_least64_t num_prefetch_hits;
     int_least64_t num_prefetch_misses;
+    int_least64_t num_coherence_invalidations;
 };
 
 #endif /* _CACHE_STATS_H_ */
@@ -0,0 +1,522 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <assert.h>
+#include "../common/options.h"
+#include "../common/utils.h"
+#include "caching_device_block.h"
+#include "cache_lru.h"
+#include "cache_fifo.h"
+#include "cache_plru.h"
+#include "cache_bit_plru.h"
+#include "cache_rrip.h"
+#include "cache_sweep.h"
+
+analysis_tool_t *
+cache_sweep_create(const cache_sweep_knobs_t &knobs)
+{
+    return new cache_sweep_t(knobs);
+}
+
+cache_sweep_t::lru_stack_t::lru_stack_t(int line_size)
+{
+    line_bits = compute_log2(line_size);
+    // The L1 caches record their accesses to us here.
+    set_stats(new cache_stats_t);
+}
+
+cache_sweep_t::lru_stack_t::~lru_stack_t()
+{
+    delete get_stats();
+    for (auto stats : ll_stats)
+        delete stats;
+}
+
+bool
+cache_sweep_t::lru_stack_t::add_config(uint64_t size, unsigned int assoc,
+                                       size_t *index)
+{
+    uint64_t num_lines = size >> line_bits;
+    if (assoc == 0 || !IS_POWER_OF_2(assoc) || !IS_POWER_OF_2(num_lines) ||
+        (num_lines << line_bits) != size || num_lines < assoc)
+        return false;
+    addr_t set_mask = (addr_t)(num_lines / assoc) - 1;
+    sets_t *stack = NULL;
+    for (auto &existing : stacks) {
+        if (existing.set_mask == set_mask)
+            stack = &existing;
+    }
+    if (stack == NULL) {
+        stacks.push_back(sets_t());
+        stack = &stacks.back();
+        stack->set_mask = set_mask;
+        stack->depth = 0;
+    }
+    if (assoc > stack->depth) {
+        // Every way starts out invalid.
+        stack->depth = assoc;
+        stack->lines.assign((size_t)(set_mask + 1) * assoc, TAG_INVALID);
+    }
+    *index = ll_stats.size();
+    ll_stats.push_back(new cache_stats_t);
+    stack->assoc_and_stats.push_back(std::make_pair(assoc, *index));
+    return true;
+}
+
+void
+cache_sweep_t::lru_stack_t::request(const memref_t &memref)
+{
+    // The L1 only passes single-line requests to its parent.
+    addr_t tag = memref.data.addr >> line_bits;
+    for (auto &stack : stacks) {
+        addr_t *set = &stack.lines[(size_t)(tag & stack.set_mask) * stack.depth];
+        // Find the line's stack distance and the first invalid way.
+        unsigned int pos = 0, hole = stack.depth;
+        for (; pos < stack.depth; ++pos) {
+            if (set[pos] == tag)
+                break;
+            if (set[pos] == TAG_INVALID && hole == stack.depth)
+                hole = pos;
+        }
+        for (const auto &config : stack.assoc_and_stats)
+            ll_stats[config.second]->access(memref, pos < config.first);
+        // A cache which misses fills its first invalid way, if it has one, and
+        // otherwise evicts its least recently used line: either way, removing
+        // the shallower of the line and the first invalid way keeps the top
+        // assoc entries equal to the contents of each cache.  When the line is
+        // below the invalid way, the caches that hit keep their invalid way,
+        // which moves to where the line was.
+        unsigned int remove = std::min(std::min(pos, hole), stack.depth - 1);
+        for (unsigned int i = remove; i > 0; --i)
+            set[i] = set[i - 1];
+        set[0] = tag;
+        if (hole < pos && pos < stack.depth)
+            set[pos] = TAG_INVALID;
+    }
+}
+
+void
+cache_sweep_t::lru_stack_t::flush(const memref_t &memref)
+{
+    ((cache_stats_t *)stats)->flush(memref);
+    addr_t tag = memref.flush.addr >> line_bits;
+    addr_t final_tag = (memref.flush.addr + memref.flush.size - 1/*no overflow*/) >>
+        line_bits;
+    for (auto &stack : stacks) {
+        for (addr_t cur = tag; cur <= final_tag; ++cur) {
+            addr_t *set = &stack.lines[(size_t)(cur & stack.set_mask) * stack.depth];
+            for (unsigned int pos = 0; pos < stack.depth; ++pos) {
+                if (set[pos] == cur)
+                    set[pos] = TAG_INVALID;
+            }
+        }
+    }
+}
+
+void
+cache_sweep_t::lru_stack_t::merge_child_stats()
+{
+    for (auto stats : ll_stats)
+        stats->merge(*get_stats());
+}
+
+cache_sweep_t::cache_sweep_t(const cache_sweep_knobs_t &knobs_) :
+    simulator_t(knobs_.cache.num_cores, knobs_.cache.skip_refs, 0, 0.0,
+                knobs_.cache.sim_refs, knobs_.cache.cpu_scheduling,
+                knobs_.cache.verbose),
+    knobs(knobs_), dispatch_buf(0), worker_buf(0), step(0), pending(0),
+    exiting(false), finished(false)
+{
+    if (knobs.cache.warmup_refs > 0 || knobs.cache.warmup_fraction > 0.0 ||
+        !knobs.cache.warmup_load_file.empty() || !knobs.cache.regions_file.empty() ||
+        !knobs.cache.stats_file.empty() || !knobs.cache.LL_miss_file.empty() ||
+        knobs.cache.sim_threads > 1) {
+        ERRMSG("Usage error: the cache sweep does not support warmup, regions, a "
+               "stats file, an LL miss file, or -sim_threads.\n");
+        success = false;
+        return;
+    }
+    if (!prefetcher_t::is_valid_policy(knobs.cache.data_prefetcher)) {
+        // Unknown value.
+        success = false;
+        return;
+    }
+    if (knobs.L1D_sizes.empty())
+        knobs.L1D_sizes.push_back(knobs.cache.L1D_size);
+    if (knobs.LL_sizes.empty())
+        knobs.LL_sizes.push_back(knobs.cache.LL_size);
+    if (knobs.LL_assocs.empty())
+        knobs.LL_assocs.push_back(knobs.cache.LL_assoc);
+    bool is_lru = knobs.cache.replace_policy == REPLACE_POLICY_NON_SPECIFIED ||
+        knobs.cache.replace_policy == REPLACE_POLICY_LRU;
+
+    for (uint64_t L1D_size : knobs.L1D_sizes) {
+        lru_stack_t *stack = NULL;
+        if (is_lru) {
+            // One unit evaluates every LL config for this L1D size.
+            stack = new lru_stack_t((int)knobs.cache.line_size);
+            units.push_back(unit_t());
+            units.back().is_stack = true;
+            if (!init_unit(&units.back(), L1D_size, stack)) {
+                success = false;
+                return;
+            }
+        }
+        for (uint64_t LL_size : knobs.LL_sizes) {
+            for (unsigned int LL_assoc : knobs.LL_assocs) {
+                config_t config;
+                config.L1D_size = L1D_size;
+                config.LL_size = LL_size;
+                config.LL_assoc = LL_assoc;
+                config.ll_index = 0;
+                if (is_lru) {
+                    config.unit = units.size() - 1;
+                    if (!stack->add_config(LL_size, LL_assoc, &config.ll_index)) {
+                        ERRMSG("Usage error: failed to initialize LL cache.  Ensure "
+                               "sizes and associativity are powers of 2 and that "
+                               "the total size is a multiple of the line size.\n");
+                        success = false;
+                        return;
+                    }
+                } else {
+                    cache_t *ll = create_cache(knobs.cache.replace_policy);
+                    if (ll == NULL) {
+                        success = false;
+                        return;
+                    }
+                    if (!ll->init(LL_assoc, (int)knobs.cache.line_size, (int)LL_size,
+                                  NULL, new cache_stats_t)) {
+                        ERRMSG("Usage error: failed to initialize LL cache.  Ensure "
+                               "sizes and associativity are powers of 2 and that "
+                               "the total size is a multiple of the line size.\n");
+                        delete ll->get_stats();
+                        delete ll;
+                        success = false;
+                        return;
+                    }
+                    config.unit = units.size();
+                    units.push_back(unit_t());
+                    if (!init_unit(&units.back(), L1D_size, ll)) {
+                        success = false;
+                        return;
+                    }
+                }
+                configs.push_back(config);
+            }
+        }
+    }
+
+    unsigned int num_threads = knobs.num_threads;
+    if (num_threads == 0)
+        num_threads = std::max(1U, std::thread::hardware_concurrency());
+    if (num_threads > units.size())
+        num_threads = (unsigned int)units.size();
+    for (unsigned int i = 0; i < num_threads; ++i)
+        threads.push_back(std::thread(&cache_sweep_t::worker_main, this, i));
+}
+
+cache_sweep_t::~cache_sweep_t()
+{
+    // The workers must be stopped before the caches they use are deleted.
+    if (!threads.empty()) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            exiting = true;
+        }
+        start_cond.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+    for (auto &unit : units)
+        delete_unit(&unit);
+}
+
+cache_t *
+cache_sweep_t::create_cache(const std::string &policy)
+{
+    if (policy == REPLACE_POLICY_NON_SPECIFIED || policy == REPLACE_POLICY_LRU)
+        return new cache_lru_t;
+    if (policy == REPLACE_POLICY_LFU)
+        return new cache_t;
+    if (policy == REPLACE_POLICY_FIFO)
+        return new cache_fifo_t;
+    if (policy == REPLACE_POLICY_PLRU)
+        return new cache_plru_t;
+    if (policy == REPLACE_POLICY_BIT_PLRU)
+        return new cache_bit_plru_t;
+    if (policy == REPLACE_POLICY_SRRIP)
+        return new cache_rrip_t(false/*!bimodal*/);
+    if (policy == REPLACE_POLICY_BRRIP)
+        return new cache_rrip_t(true/*bimodal*/);
+    ERRMSG("Usage error: undefined replacement policy. "
+           "Please choose " REPLACE_POLICY_LRU", " REPLACE_POLICY_LFU", "
+           REPLACE_POLICY_FIFO", " REPLACE_POLICY_PLRU", " REPLACE_POLICY_BIT_PLRU", "
+           REPLACE_POLICY_SRRIP", or " REPLACE_POLICY_BRRIP".\n");
+    return NULL;
+}
+
+bool
+cache_sweep_t::init_unit(unit_t *unit, uint64_t L1D_size, cache_t *ll)
+{
+    // We take ownership of ll even on failure.
+    unit->ll = ll;
+    for (unsigned int i = 0; i < knobs.cache.num_cores; i++) {
+        cache_t *icache = create_cache(knobs.cache.replace_policy);
+        if (icache == NULL)
+            return false;
+        unit->icaches.push_back(icache);
+        cache_t *dcache = create_cache(knobs.cache.replace_policy);
+        if (dcache == NULL)
+            return false;
+        unit->dcaches.push_back(dcache);
+        if (!icache->init(knobs.cache.L1I_assoc, (int)knobs.cache.line_size,
+                          (int)knobs.cache.L1I_size, ll, new cache_stats_t) ||
+            !dcache->init(knobs.cache.L1D_assoc, (int)knobs.cache.line_size,
+                          (int)L1D_size, ll, new cache_stats_t,
+                          prefetcher_t::create(knobs.cache.data_prefetcher,
+                                               (int)knobs.cache.line_size,
+                                               (int)knobs.cache.prefetch_degree,
+                                               (int)knobs.cache.prefetch_distance))) {
+            ERRMSG("Usage error: failed to initialize L1 caches.  Ensure sizes and "
+                   "associativity are powers of 2 "
+                   "and that the total sizes are multiples of the line size.\n");
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+cache_sweep_t::delete_unit(unit_t *unit)
+{
+    std::vector<cache_t *> caches = unit->icaches;
+    caches.insert(caches.end(), unit->dcaches.begin(), unit->dcaches.end());
+    for (auto cache : caches) {
+        delete cache->get_stats();
+        delete cache->get_prefetcher();
+        delete cache;
+    }
+    if (unit->ll == NULL)
+        return;
+    // The stack deletes its own stats.
+    if (!unit->is_stack)
+        delete unit->ll->get_stats();
+    delete unit->ll;
+}
+
+bool
+cache_sweep_t::process_memref(const memref_t &memref)
+{
+    if (knobs.cache.skip_refs > 0) {
+        knobs.cache.skip_refs--;
+        return true;
+    }
+    if (knobs.cache.sim_refs == 0)
+        return true;
+
+    simulator_t::process_memref(memref);
+
+    if (memref.marker.type == TRACE_TYPE_MARKER) {
+        // We ignore markers before we ask core_for_thread, to avoid asking
+        // too early on a timestamp marker.
+        return true;
+    }
+
+    int core;
+    if (memref.data.tid == last_thread)
+        core = last_core;
+    else {
+        core = core_for_thread(memref.data.tid);
+        last_thread = memref.data.tid;
+        last_core = core;
+    }
+
+    if (type_is_instr(memref.instr.type) ||
+        memref.instr.type == TRACE_TYPE_PREFETCH_INSTR)
+        dispatch(core, L1I_REQUEST, memref);
+    else if (memref.data.type == TRACE_TYPE_READ ||
+             memref.data.type == TRACE_TYPE_WRITE ||
+             type_is_prefetch(memref.data.type))
+        dispatch(core, L1D_REQUEST, memref);
+    else if (memref.flush.type == TRACE_TYPE_INSTR_FLUSH)
+        dispatch(core, L1I_FLUSH, memref);
+    else if (memref.flush.type == TRACE_TYPE_DATA_FLUSH)
+        dispatch(core, L1D_FLUSH, memref);
+    else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
+        handle_thread_exit(memref.exit.tid);
+        last_thread = 0;
+    } else if (memref.marker.type != TRACE_TYPE_INSTR_NO_FETCH) {
+        ERRMSG("unhandled memref type");
+        return false;
+    }
+    knobs.cache.sim_refs--;
+    return true;
+}
+
+bool
+cache_sweep_t::process_memrefs(const memref_t *memrefs, size_t count)
+{
+    // Skipped references are dropped wholesale.
+    size_t start = 0;
+    if (knobs.cache.skip_refs > 0) {
+        start = (size_t)std::min<uint64_t>(knobs.cache.skip_refs, count);
+        knobs.cache.skip_refs -= start;
+    }
+    bool res = true;
+    // We avoid the virtual dispatch of the default implementation.
+    for (size_t i = start; i < count; ++i)
+        res = cache_sweep_t::process_memref(memrefs[i]) && res;
+    return res;
+}
+
+void
+cache_sweep_t::dispatch(unsigned int core, op_t op, const memref_t &memref)
+{
+    item_t item;
+    item.core = core;
+    item.op = op;
+    item.memref = memref;
+    items[dispatch_buf].push_back(item);
+    if (items[dispatch_buf].size() >= BATCH_SIZE)
+        launch_step();
+}
+
+void
+cache_sweep_t::wait_for_step()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    done_cond.wait(lock, [this]{ return pending == 0; });
+}
+
+void
+cache_sweep_t::launch_step()
+{
+    wait_for_step();
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        // The workers take the batch just gathered and the main thread moves
+        // on to the buffer they finished with.
+        worker_buf = dispatch_buf;
+        dispatch_buf = 1 - dispatch_buf;
+        items[dispatch_buf].clear();
+        pending = (unsigned int)threads.size();
+        ++step;
+    }
+    start_cond.notify_all();
+}
+
+void
+cache_sweep_t::worker_main(unsigned int id)
+{
+    uint64_t last_step = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_cond.wait(lock, [&]{ return exiting || step != last_step; });
+            if (exiting)
+                return;
+            last_step = step;
+        }
+        for (size_t i = id; i < units.size(); i += threads.size()) {
+            unit_t &unit = units[i];
+            for (const auto &item : items[worker_buf]) {
+                switch (item.op) {
+                case L1I_REQUEST: unit.icaches[item.core]->request(item.memref); break;
+                case L1D_REQUEST: unit.dcaches[item.core]->request(item.memref); break;
+                case L1I_FLUSH: unit.icaches[item.core]->flush(item.memref); break;
+                case L1D_FLUSH: unit.dcaches[item.core]->flush(item.memref); break;
+                }
+            }
+        }
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (--pending == 0)
+                done_cond.notify_one();
+        }
+    }
+}
+
+void
+cache_sweep_t::finish()
+{
+    if (finished)
+        return;
+    finished = true;
+    launch_step();
+    wait_for_step();
+    for (auto &unit : units) {
+        if (unit.is_stack)
+            ((lru_stack_t *)unit.ll)->merge_child_stats();
+    }
+}
+
+bool
+cache_sweep_t::print_results()
+{
+    finish();
+    std::cerr << "Cache sweep results:\n";
+    std::cerr << std::setw(12) << "L1D size" << std::setw(12) << "LL size" <<
+        std::setw(10) << "LL assoc" << std::setw(14) << "L1D misses" <<
+        std::setw(10) << "L1D miss" << std::setw(14) << "LL misses" <<
+        std::setw(10) << "LL local" << std::setw(10) << "LL total" << "\n";
+    for (const auto &config : configs) {
+        const unit_t &unit = units[config.unit];
+        int_least64_t L1D_hits = 0, L1D_misses = 0;
+        for (auto dcache : unit.dcaches) {
+            L1D_hits += dcache->get_stats()->get_hits();
+            L1D_misses += dcache->get_stats()->get_misses();
+        }
+        caching_device_stats_t *ll_stats = unit.is_stack ?
+            ((lru_stack_t *)unit.ll)->get_ll_stats(config.ll_index) :
+            unit.ll->get_stats();
+        int_least64_t LL_hits = ll_stats->get_hits();
+        int_least64_t LL_misses = ll_stats->get_misses();
+        int_least64_t LL_child_hits = ll_stats->get_child_hits();
+        std::cerr << std::setw(12) << config.L1D_size << std::setw(12) <<
+            config.LL_size << std::setw(10) << config.LL_assoc <<
+            std::setw(14) << L1D_misses << std::setw(9) << std::fixed <<
+            std::setprecision(2) <<
+            (L1D_hits + L1D_misses == 0 ? 0.0 :
+             (double)L1D_misses * 100 / (L1D_hits + L1D_misses)) << "%" <<
+            std::setw(14) << LL_misses << std::setw(9) <<
+            (LL_hits + LL_misses == 0 ? 0.0 :
+             (double)LL_misses * 100 / (LL_hits + LL_misses)) << "%" <<
+            std::setw(9) <<
+            (LL_hits + LL_child_hits + LL_misses == 0 ? 0.0 :
+             (double)LL_misses * 100 / (LL_hits + LL_child_hits + LL_misses)) <<
+            "%\n";
+    }
+    return true;
+}
@@ -0,0 +1,159 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+/* cache_sweep: simulates many cache configurations in one pass over a trace.
+ */
+
+#ifndef _CACHE_SWEEP_H_
+#define _CACHE_SWEEP_H_ 1
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "simulator.h"
+#include "cache_sweep_create.h"
+#include "cache.h"
+#include "cache_stats.h"
+
+// The configurations are split into units which are simulated independently
+// of each other on worker threads, with the main thread scheduling threads to
+// cores and handing the references of each batch to all of the units.
+//
+// With LRU replacement we use one unit per L1D size.  As the LL reference
+// stream of a unit does not depend on the LL, its LL is an lru_stack_t which
+// evaluates every LL size and associativity at once via per-set LRU stack
+// distances: a reference hits in a cache with associativity A exactly when
+// fewer than A other lines of its set were referenced since its prior
+// reference.  Other replacement policies are not stack algorithms and so each
+// of their configurations is its own unit with a regular LL.
+
+class cache_sweep_t : public simulator_t
+{
+ public:
+    cache_sweep_t(const cache_sweep_knobs_t &knobs);
+    virtual ~cache_sweep_t();
+    virtual bool process_memref(const memref_t &memref);
+    virtual bool process_memrefs(const memref_t *memrefs, size_t count);
+    virtual bool print_results();
+
+ protected:
+    struct config_t {
+        uint64_t L1D_size;
+        uint64_t LL_size;
+        unsigned int LL_assoc;
+        // Where the config's results are: the unit, and its LL config index.
+        size_t unit;
+        size_t ll_index;
+    };
+
+    // Records the accesses to an LL for multiple sizes and associativities.
+    class lru_stack_t : public cache_t
+    {
+     public:
+        lru_stack_t(int line_size);
+        virtual ~lru_stack_t();
+        // Adds an LL configuration, returning false if it is invalid.  The
+        // returned index is passed to get_ll_stats().
+        bool add_config(uint64_t size, unsigned int assoc, size_t *index);
+        virtual void request(const memref_t &memref);
+        virtual void flush(const memref_t &memref);
+        // Adds the accesses by the children and the flushes, which we record
+        // just once, to each configuration's stats.
+        void merge_child_stats();
+        cache_stats_t *get_ll_stats(size_t index) { return ll_stats[index]; }
+     private:
+        // The stacks for all configs with the same number of sets.
+        struct sets_t {
+            addr_t set_mask;
+            unsigned int depth;
+            // Each set's lines, most recently used first.
+            std::vector<addr_t> lines;
+            std::vector<std::pair<unsigned int, size_t>> assoc_and_stats;
+        };
+        std::vector<sets_t> stacks;
+        std::vector<cache_stats_t *> ll_stats;
+        int line_bits;
+    };
+
+    struct unit_t {
+        unit_t() : ll(NULL), is_stack(false) {}
+        std::vector<cache_t *> icaches;
+        std::vector<cache_t *> dcaches;
+        // Either an lru_stack_t or a regular cache.
+        cache_t *ll;
+        bool is_stack;
+    };
+
+    enum op_t {
+        L1I_REQUEST,
+        L1D_REQUEST,
+        L1I_FLUSH,
+        L1D_FLUSH,
+    };
+    struct item_t {
+        unsigned int core;
+        op_t op;
+        memref_t memref;
+    };
+
+    cache_t *create_cache(const std::string &policy);
+    bool init_unit(unit_t *unit, uint64_t L1D_size, cache_t *ll);
+    void delete_unit(unit_t *unit);
+    void dispatch(unsigned int core, op_t op, const memref_t &memref);
+    void launch_step();
+    void wait_for_step();
+    void worker_main(unsigned int id);
+    void finish();
+
+    // The number of references gathered before handing them to the workers.
+    static const size_t BATCH_SIZE = 64 * 1024;
+
+    cache_sweep_knobs_t knobs;
+    std::vector<config_t> configs;
+    std::vector<unit_t> units;
+
+    // While the main thread fills one buffer the workers process the other.
+    std::vector<item_t> items[2];
+    int dispatch_buf;
+    int worker_buf;
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start_cond;
+    std::condition_variable done_cond;
+    uint64_t step;
+    unsigned int pending;
+    bool exiting;
+    bool finished;
+};
+
+#endif /* _CACHE_SWEEP_H_ */
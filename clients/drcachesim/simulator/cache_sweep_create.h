@@ -0,0 +1,79 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+/* cache sweep creation */
+
+#ifndef _CACHE_SWEEP_CREATE_H_
+#define _CACHE_SWEEP_CREATE_H_ 1
+
+#include <vector>
+#include "analysis_tool.h"
+#include "cache_simulator_create.h"
+
+/**
+ * @file drmemtrace/cache_sweep_create.h
+ * @brief DrMemtrace cache configuration sweep creation.
+ */
+
+/**
+ * The options for cache_sweep_create().
+ * The options are currently documented in \ref sec_drcachesim_ops.
+ */
+// The options are currently documented in ../common/options.cpp.
+struct cache_sweep_knobs_t {
+    cache_sweep_knobs_t() : num_threads(0) {}
+    /**
+     * The settings shared by every configuration.  Its L1D_size, LL_size, and
+     * LL_assoc are used in place of any of the lists below that are empty.
+     * Warmup, the LL miss file, and sim_threads are not supported.
+     */
+    cache_simulator_knobs_t cache;
+    /** The L1 data cache sizes to evaluate. */
+    std::vector<uint64_t> L1D_sizes;
+    /** The last-level cache sizes to evaluate. */
+    std::vector<uint64_t> LL_sizes;
+    /** The last-level cache associativities to evaluate. */
+    std::vector<unsigned int> LL_assocs;
+    /**
+     * The number of worker threads, or 0 to use one per hardware thread.
+     */
+    unsigned int num_threads;
+};
+
+/**
+ * Creates an analysis tool which simulates every combination of the knobs'
+ * L1D_sizes, LL_sizes, and LL_assocs in a single pass over the trace and reports
+ * a table of miss rates.
+ */
+analysis_tool_t *
+cache_sweep_create(const cache_sweep_knobs_t &knobs);
+
+#endif /* _CACHE_SWEEP_CREATE_H_ */
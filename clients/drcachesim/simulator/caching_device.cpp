@@ -36,20 +36,22 @@
 #include "prefetcher.h"
 #include "../common/utils.h"
 #include <assert.h>
+#ifdef X86_64
+# include <emmintrin.h>
+#endif
 
 caching_device_t::caching_device_t() :
-    blocks(NULL), stats(NULL), prefetcher(NULL)
+    parent(NULL), inclusion(INCLUSION_NINE), tags(NULL), counters(NULL), stats(NULL),
+    prefetcher(NULL), prefetch_fill_times(NULL), num_demand_accesses(0)
 {
     /* Empty. */
 }
 
 caching_device_t::~caching_device_t()
 {
-    if (blocks == NULL)
-        return;
-    for (int i = 0; i < num_blocks; i++)
-        delete blocks[i];
-    delete [] blocks;
+    delete [] tags;
+    delete [] counters;
+    delete [] prefetch_fill_times;
 }
 
 bool
@@ -78,16 +80,96 @@ caching_device_t::init(int associativity_, int block_size_, int num_blocks_,
     if (assoc_bits == -1 || block_size_bits == -1 || !IS_POWER_OF_2(blocks_per_set))
         return false;
     parent = parent_;
+    if (parent != NULL)
+        parent->children.push_back(this);
     stats = stats_;
     prefetcher = prefetcher_;
 
-    blocks = new caching_device_block_t* [num_blocks];
+    tags = new addr_t[num_blocks];
+    counters = new int[num_blocks];
+    for (int i = 0; i < num_blocks; i++) {
+        tags[i] = TAG_INVALID;
+        counters[i] = 0;
+    }
+    if (prefetcher != nullptr) {
+        prefetch_fill_times = new int_least64_t[num_blocks];
+        for (int i = 0; i < num_blocks; i++)
+            prefetch_fill_times[i] = 0;
+    }
     init_blocks();
 
     last_tag = TAG_INVALID; // sentinel
     return true;
 }
 
+bool
+caching_device_t::contains(addr_t addr)
+{
+    addr_t tag = compute_tag(addr);
+    return find_way(compute_block_idx(tag), tag) != associativity;
+}
+
+bool
+caching_device_t::save_state(std::ostream &out)
+{
+    int_least64_t header[] = {associativity, block_size, num_blocks,
+                              prefetch_fill_times != NULL, loaded_blocks,
+                              num_demand_accesses};
+    out.write((const char *)header, sizeof(header));
+    out.write((const char *)tags, sizeof(tags[0]) * num_blocks);
+    out.write((const char *)counters, sizeof(counters[0]) * num_blocks);
+    if (prefetch_fill_times != NULL) {
+        out.write((const char *)prefetch_fill_times,
+                  sizeof(prefetch_fill_times[0]) * num_blocks);
+    }
+    return out.good();
+}
+
+bool
+caching_device_t::load_state(std::istream &in)
+{
+    int_least64_t header[6];
+    if (!in.read((char *)header, sizeof(header)) ||
+        header[0] != associativity || header[1] != block_size ||
+        header[2] != num_blocks || header[3] != (prefetch_fill_times != NULL))
+        return false;
+    loaded_blocks = (int)header[4];
+    num_demand_accesses = header[5];
+    in.read((char *)tags, sizeof(tags[0]) * num_blocks);
+    in.read((char *)counters, sizeof(counters[0]) * num_blocks);
+    if (prefetch_fill_times != NULL) {
+        in.read((char *)prefetch_fill_times,
+                sizeof(prefetch_fill_times[0]) * num_blocks);
+    }
+    last_tag = TAG_INVALID;
+    return in.good();
+}
+
+int
+caching_device_t::find_way(int block_idx, addr_t tag)
+{
+    const addr_t *set = &tags[block_idx];
+    int way = 0;
+#ifdef X86_64
+    // We compare two tags at a time.  SSE2 has no 64-bit compare, so we combine
+    // the results of comparing the two 32-bit halves.
+    __m128i key = _mm_set1_epi64x((long long)tag);
+    for (; way + 1 < associativity; way += 2) {
+        __m128i vals = _mm_loadu_si128((const __m128i *)&set[way]);
+        __m128i cmp = _mm_cmpeq_epi32(vals, key);
+        cmp = _mm_and_si128(cmp, _mm_shuffle_epi32(cmp, _MM_SHUFFLE(2, 3, 0, 1)));
+        int mask = _mm_movemask_pd(_mm_castsi128_pd(cmp));
+        if (mask != 0)
+            return way + ((mask & 1) != 0 ? 0 : 1);
+    }
+#endif
+    for (; way < associativity; ++way) {
+        if (set[way] == tag)
+            return way;
+    }
+    return associativity;
+}
+
 void
 caching_device_t::request(const memref_t &memref_in)
 {
@@ -100,12 +182,17 @@ caching_device_t::request(const memref_t &memref_in)
     addr_t final_addr = memref_in.data.addr + memref_in.data.size - 1/*avoid overflow*/;
     addr_t final_tag = compute_tag(final_addr);
     addr_t tag = compute_tag(memref_in.data.addr);
+    bool is_demand = !type_is_prefetch(memref_in.data.type);
+    if (is_demand)
+        num_demand_accesses++;
 
-    // Optimization: check last tag if single-block
+    // Optimization: check last tag if single-block.  The last block is never one
+    // that was prefetched and not yet used, and we do not train the prefetcher on
+    // repeated accesses to one block.
     if (tag == final_tag && tag == last_tag) {
         // Make sure last_tag is properly in sync.
         assert(tag != TAG_INVALID &&
-               tag == get_caching_device_block(last_block_idx, last_way).tag);
+               tag == get_block_tag(last_block_idx, last_way));
         stats->access(memref_in, true/*hit*/);
         if (parent != NULL)
             parent->stats->child_access(memref_in, true);
@@ -122,16 +209,18 @@ caching_device_t::request(const memref_t &memref_in)
         if (tag + 1 <= final_tag)
             memref.data.size = ((tag + 1) << block_size_bits) - memref.data.addr;
 
-        for (way = 0; way < associativity; ++way) {
-            if (get_caching_device_block(block_idx, way).tag == tag) {
-                stats->access(memref, true/*hit*/);
-                if (parent != NULL)
-                    parent->stats->child_access(memref, true);
-                break;
+        way = find_way(block_idx, tag);
+        if (way != associativity) {
+            stats->access(memref, true/*hit*/);
+            if (parent != NULL)
+                parent->stats->child_access(memref, true);
+            if (prefetch_fill_times != NULL && is_demand &&
+                prefetch_fill_times[block_idx + way] != 0) {
+                stats->prefetch_used(num_demand_accesses + 1 -
+                                     prefetch_fill_times[block_idx + way]);
+                prefetch_fill_times[block_idx + way] = 0;
             }
-        }
-
-        if (way == associativity) {
+        } else {
             stats->access(memref, false/*miss*/);
             missed = true;
             // If no parent we assume we get the data from main memory
@@ -142,21 +231,35 @@ caching_device_t::request(const memref_t &memref_in)
 
             // FIXME i#1726: coherence policy
 
-            way = replace_which_way(block_idx);
-            // Check if we are inserting a new block, if we are then increment
-            // the block loaded count.
-            if (get_caching_device_block(block_idx, way).tag == TAG_INVALID) {
-                loaded_blocks++;
+            if (inclusion != INCLUSION_EXCLUSIVE) {
+                way = replace_which_way(block_idx);
+                evict(block_idx, way);
+                get_block_tag(block_idx, way) = tag;
+            }
+            if (prefetch_fill_times != NULL && inclusion != INCLUSION_EXCLUSIVE) {
+                if (memref.data.type == TRACE_TYPE_HARDWARE_PREFETCH) {
+                    stats->prefetch_filled();
+                    prefetch_fill_times[block_idx + way] = 1 + num_demand_accesses;
+                } else
+                    prefetch_fill_times[block_idx + way] = 0;
             }
-            get_caching_device_block(block_idx, way).tag = tag;
         }
 
-        access_update(block_idx, way);
+        if (inclusion == INCLUSION_EXCLUSIVE) {
+            // The requesting child now holds the block, so a hit moves it out of
+            // here and a miss passes it straight from our parent to the child.
+            if (way != associativity) {
+                get_block_tag(block_idx, way) = TAG_INVALID;
+                loaded_blocks--;
+            }
+            last_tag = TAG_INVALID;
+        } else
+            access_update(block_idx, way);
 
         // Issue a hardware prefetch, if any, before we remember the last tag,
         // so we remember this line and not the prefetched line.
-        if (missed && !type_is_prefetch(memref.data.type) && prefetcher != nullptr)
-            prefetcher->prefetch(this, memref);
+        if (is_demand && prefetcher != nullptr)
+            prefetcher->prefetch(this, memref, missed);
 
         if (tag + 1 <= final_tag) {
             addr_t next_addr = (tag + 1) << block_size_bits;
@@ -165,17 +268,77 @@ caching_device_t::request(const memref_t &memref_in)
         }
 
         // Optimization: remember last tag
-        last_tag = tag;
-        last_way = way;
-        last_block_idx = block_idx;
+        if (inclusion != INCLUSION_EXCLUSIVE) {
+            last_tag = tag;
+            last_way = way;
+            last_block_idx = block_idx;
+        }
+    }
+}
+
+void
+caching_device_t::evict(int block_idx, int way)
+{
+    addr_t victim = get_block_tag(block_idx, way);
+    // Check if we are inserting a new block, if we are then increment
+    // the block loaded count.
+    if (victim == TAG_INVALID) {
+        loaded_blocks++;
+        return;
+    }
+    if (prefetch_fill_times != NULL && prefetch_fill_times[block_idx + way] != 0)
+        stats->prefetch_unused();
+    addr_t victim_addr = victim << block_size_bits;
+    if (inclusion == INCLUSION_INCLUSIVE) {
+        for (caching_device_t *child : children)
+            child->invalidate_block(victim_addr);
+    }
+    if (parent != NULL && parent->inclusion == INCLUSION_EXCLUSIVE)
+        parent->insert_victim(victim_addr);
+}
+
+void
+caching_device_t::insert_victim(addr_t addr)
+{
+    assert(inclusion == INCLUSION_EXCLUSIVE);
+    addr_t tag = compute_tag(addr);
+    int block_idx = compute_block_idx(tag);
+    int way = find_way(block_idx, tag);
+    if (way == associativity) {
+        way = replace_which_way(block_idx);
+        evict(block_idx, way);
+        get_block_tag(block_idx, way) = tag;
+        if (prefetch_fill_times != NULL)
+            prefetch_fill_times[block_idx + way] = 0;
+    }
+    access_update(block_idx, way);
+}
+
+void
+caching_device_t::invalidate_block(addr_t addr)
+{
+    addr_t tag = compute_tag(addr);
+    int block_idx = compute_block_idx(tag);
+    int way = find_way(block_idx, tag);
+    if (way != associativity) {
+        // We leave the counter alone, as for some policies it holds per-set
+        // state, and an invalid block is always the first to be replaced.
+        get_block_tag(block_idx, way) = TAG_INVALID;
+        loaded_blocks--;
+        if (prefetch_fill_times != NULL)
+            prefetch_fill_times[block_idx + way] = 0;
+        stats->inclusive_invalidation();
+        last_tag = TAG_INVALID;
     }
+    for (caching_device_t *child : children)
+        child->invalidate_block(addr);
 }
 
 void
 caching_device_t::access_update(int block_idx, int way)
 {
     // We just inc the counter for LFU.  We live with any blip on overflow.
-    get_caching_device_block(block_idx, way).counter++;
+    get_block_counter(block_idx, way)++;
 }
 
 int
@@ -187,16 +350,16 @@ caching_device_t::replace_which_way(int block_idx)
     int min_counter = 0; /* avoid "may be used uninitialized" with GCC 4.4.7 */
     int min_way = 0;
     for (int way = 0; way < associativity; ++way) {
-        if (get_caching_device_block(block_idx, way).tag == TAG_INVALID) {
+        if (get_block_tag(block_idx, way) == TAG_INVALID) {
             min_way = way;
             break;
         }
-        if (way == 0 || get_caching_device_block(block_idx, way).counter < min_counter) {
-            min_counter = get_caching_device_block(block_idx, way).counter;
+        if (way == 0 || get_block_counter(block_idx, way) < min_counter) {
+            min_counter = get_block_counter(block_idx, way);
             min_way = way;
         }
     }
     // Clear the counter for LFU.
-    get_caching_device_block(block_idx, min_way).counter = 0;
+    get_block_counter(block_idx, min_way) = 0;
     return min_way;
 }
@@ -36,6 +36,9 @@
 #ifndef _CACHING_DEVICE_H_
 #define _CACHING_DEVICE_H_ 1
 
+#include <istream>
+#include <ostream>
+#include <vector>
 #include "caching_device_block.h"
 #include "caching_device_stats.h"
 #include "memref.h"
@@ -49,6 +52,21 @@
 // We assume we're only invoked from a single thread of control and do
 // not need to synchronize data access.
 
+// How the blocks held by a device relate to those held by its children, the
+// devices which name it as their parent.  All devices in a hierarchy are assumed
+// to share one block size.
+enum inclusion_policy_t {
+    // Neither inclusive nor exclusive: blocks are filled on a miss and evicted
+    // independently of the children.
+    INCLUSION_NINE,
+    // Every block of a child is also held here: evicting a block invalidates it
+    // in all of the descendants.
+    INCLUSION_INCLUSIVE,
+    // No block of a child is also held here: the device is only filled with the
+    // blocks evicted by its children, and a block hit here moves to the child.
+    INCLUSION_EXCLUSIVE,
+};
+
 class caching_device_t
 {
  public:
@@ -63,9 +81,20 @@ class caching_device_t
     void set_stats(caching_device_stats_t *stats_) { stats = stats_; }
     prefetcher_t *get_prefetcher() const { return prefetcher; }
     caching_device_t *get_parent() const { return parent; }
+    void set_inclusion(inclusion_policy_t policy) { inclusion = policy; }
+    inclusion_policy_t get_inclusion() const { return inclusion; }
     inline double get_loaded_fraction() const {
         return double(loaded_blocks)/num_blocks;
     }
+    // Returns whether the block holding addr is present, without updating any
+    // replacement or statistics state.
+    bool contains(addr_t addr);
+    // Writes the block and replacement state, so that a warmed-up device can be
+    // restored with load_state() in a later run.  Statistics are not saved.
+    virtual bool save_state(std::ostream &out);
+    // Restores the state written by save_state(), failing if the saved geometry
+    // differs from ours.
+    virtual bool load_state(std::istream &in);
 
  protected:
     virtual void access_update(int block_idx, int way);
@@ -75,11 +104,28 @@ class caching_device_t
     inline int compute_block_idx(addr_t tag) {
         return (tag & blocks_per_set_mask) << assoc_bits;
     }
-    inline caching_device_block_t& get_caching_device_block(int block_idx, int way) {
-        return *(blocks[block_idx + way]);
+    inline addr_t& get_block_tag(int block_idx, int way) {
+        return tags[block_idx + way];
+    }
+    inline int& get_block_counter(int block_idx, int way) {
+        return counters[block_idx + way];
     }
-    // a pure virtual function for subclasses to initialize their own block array
-    virtual void init_blocks() = 0;
+    // Returns the way in the set starting at block_idx holding tag, or
+    // associativity if there is none.
+    int find_way(int block_idx, addr_t tag);
+    // For subclasses to allocate any additional per-block state, which should
+    // be kept in arrays indexed like tags and counters.
+    virtual void init_blocks() {}
+    // Makes room in way of the set starting at block_idx for a new block,
+    // handing any evicted block to the parent or the children as the inclusion
+    // policies require.
+    void evict(int block_idx, int way);
+    // Installs the block holding addr, evicted by a child, here.  This is only
+    // invoked on an exclusive device.
+    void insert_victim(addr_t addr);
+    // Removes the block holding addr from this device and its descendants, for
+    // an inclusive ancestor's eviction.
+    void invalidate_block(addr_t addr);
 
     int associativity;
     int block_size;
@@ -87,10 +133,16 @@ class caching_device_t
     // Current valid blocks in the cache
     int loaded_blocks;
     caching_device_t *parent;
-    // This should be an array of caching_device_block_t pointers, otherwise
-    // an extended block class which has its own member variables cannot be indexed
-    // correctly by base class pointers.
-    caching_device_block_t **blocks;
+    std::vector<caching_device_t *> children;
+    inclusion_policy_t inclusion;
+    // The block state is stored as separate flat arrays, indexed by
+    // block_idx + way, so that the ways of a set are contiguous and a lookup
+    // scans a single cache line or two of tags.
+    addr_t *tags;
+    // For use by replacement policies.
+    // XXX: using int_least64_t here results in a ~4% slowdown for 32-bit apps.
+    // A 32-bit counter should be sufficient but we may want to revisit.
+    int *counters;
     int blocks_per_set;
     // Optimization fields for fast bit operations
     int blocks_per_set_mask;
@@ -99,6 +151,10 @@ class caching_device_t
 
     caching_device_stats_t *stats;
     prefetcher_t *prefetcher;
+    // With a prefetcher, for each block brought in by a hardware prefetch and not
+    // yet used, 1 + the value of num_demand_accesses when it was filled; else 0.
+    int_least64_t *prefetch_fill_times;
+    int_least64_t num_demand_accesses;
 
     // Optimization: remember last tag
     addr_t last_tag;
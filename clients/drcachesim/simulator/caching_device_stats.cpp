@@ -33,16 +33,30 @@
 #include <assert.h>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <vector>
 #include "caching_device_stats.h"
+#include "../common/utils.h"
 
 caching_device_stats_t::caching_device_stats_t(const std::string &miss_file,
-                                               bool warmup_enabled) :
+                                               bool warmup_enabled,
+                                               miss_file_format_t miss_format) :
     success(true), num_hits(0), num_misses(0), num_child_hits(0),
+    num_inclusive_invalidations(0),
+    num_prefetch_fills(0), num_prefetches_used(0), num_prefetches_unused(0),
+    prefetch_use_distance_sum(0),
     num_hits_at_reset(0), num_misses_at_reset(0), num_child_hits_at_reset(0),
-    warmup_enabled(warmup_enabled), file(nullptr)
+    warmup_enabled(warmup_enabled), file(nullptr), miss_writer(nullptr),
+    miss_timestamp(0), count_hotspots(false), hotspot_top_count(0), region_bits(0)
 {
     if (miss_file.empty()) {
         dump_misses = false;
+    } else if (miss_format != MISS_FILE_TEXT) {
+        miss_writer = new miss_stream_writer_t;
+        dump_misses = miss_writer->open(miss_file,
+                                        miss_format == MISS_FILE_BINARY_TID_TIME);
+        if (!dump_misses)
+            success = false;
     } else {
 #ifdef HAS_ZLIB
         file = gzopen(miss_file.c_str(), "w");
@@ -59,6 +73,11 @@ caching_device_stats_t::caching_device_stats_t(const std::string &miss_file,
 
 caching_device_stats_t::~caching_device_stats_t()
 {
+    if (miss_writer != nullptr) {
+        if (dump_misses && !miss_writer->close())
+            ERRMSG("Failed to write the LL miss file.\n");
+        delete miss_writer;
+    }
     if (file != nullptr) {
 #ifdef HAS_ZLIB
         gzclose(file);
@@ -79,6 +98,8 @@ caching_device_stats_t::access(const memref_t &memref, bool hit)
         num_misses++;
         if (dump_misses)
             dump_miss(memref);
+        if (count_hotspots)
+            count_miss_hotspot(memref);
     }
 }
 
@@ -91,18 +112,62 @@ caching_device_stats_t::child_access(const memref_t &memref, bool hit)
 }
 
 void
-caching_device_stats_t::dump_miss(const memref_t &memref)
+caching_device_stats_t::prefetch_filled()
+{
+    num_prefetch_fills++;
+}
+
+void
+caching_device_stats_t::prefetch_used(int_least64_t use_distance)
+{
+    num_prefetches_used++;
+    prefetch_use_distance_sum += use_distance;
+}
+
+void
+caching_device_stats_t::prefetch_unused()
+{
+    num_prefetches_unused++;
+}
+
+void
+caching_device_stats_t::enable_miss_hotspots(unsigned int top_count,
+                                             uint64_t region_size)
+{
+    assert(IS_POWER_OF_2(region_size));
+    count_hotspots = true;
+    hotspot_top_count = top_count;
+    region_bits = compute_log2((int)region_size);
+}
+
+addr_t
+caching_device_stats_t::miss_pc(const memref_t &memref)
 {
-    addr_t pc, addr;
     if (type_is_instr(memref.data.type))
-        pc = memref.instr.addr;
-    else { // data ref: others shouldn't get here
-        assert(type_is_prefetch(memref.data.type) ||
-               memref.data.type == TRACE_TYPE_READ ||
-               memref.data.type == TRACE_TYPE_WRITE);
-        pc = memref.data.pc;
-    }
+        return memref.instr.addr;
+    // data ref: others shouldn't get here
+    assert(type_is_prefetch(memref.data.type) ||
+           memref.data.type == TRACE_TYPE_READ ||
+           memref.data.type == TRACE_TYPE_WRITE);
+    return memref.data.pc;
+}
+
+void
+caching_device_stats_t::count_miss_hotspot(const memref_t &memref)
+{
+    pc_misses[miss_pc(memref)]++;
+    region_misses[memref.data.addr >> region_bits]++;
+}
+
+void
+caching_device_stats_t::dump_miss(const memref_t &memref)
+{
+    addr_t pc = miss_pc(memref), addr;
     addr = memref.data.addr;
+    if (miss_writer != nullptr) {
+        miss_writer->write(pc, addr, memref.data.tid, miss_timestamp);
+        return;
+    }
 #ifdef HAS_ZLIB
     gzprintf(file, "0x%zx,0x%zx\n", pc, addr);
 #else
@@ -126,6 +191,10 @@ caching_device_stats_t::print_counts(std::string prefix)
         std::setw(20) << std::right << num_hits << std::endl;
     std::cerr << prefix << std::setw(18) << std::left << "Misses:" <<
         std::setw(20) << std::right << num_misses << std::endl;
+    if (num_inclusive_invalidations != 0) {
+        std::cerr << prefix << std::setw(18) << std::left << "Inclusive invals:" <<
+            std::setw(20) << std::right << num_inclusive_invalidations << std::endl;
+    }
 }
 
 void
@@ -154,6 +223,71 @@ caching_device_stats_t::print_child_stats(std::string prefix)
     }
 }
 
+void
+caching_device_stats_t::print_prefetcher_stats(std::string prefix)
+{
+    if (num_prefetch_fills == 0)
+        return;
+    std::cerr << prefix << std::setw(18) << std::left << "Prefetch fills:" <<
+        std::setw(20) << std::right << num_prefetch_fills << std::endl;
+    std::cerr << prefix << std::setw(18) << std::left << "Prefetches used:" <<
+        std::setw(20) << std::right << num_prefetches_used << std::endl;
+    std::cerr << prefix << std::setw(18) << std::left << "Prefetches unused:" <<
+        std::setw(20) << std::right << num_prefetches_unused << std::endl;
+    // Accuracy is the fraction of prefetched blocks that were used, and coverage
+    // the fraction of would-be misses that the prefetcher eliminated.
+    std::cerr << prefix << std::setw(18) << std::left << "Prefetch accuracy:" <<
+        std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
+        ((float)num_prefetches_used*100/num_prefetch_fills) << "%" << std::endl;
+    if (num_prefetches_used + num_misses > 0) {
+        std::cerr << prefix << std::setw(18) << std::left << "Prefetch coverage:" <<
+            std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
+            ((float)num_prefetches_used*100/(num_prefetches_used + num_misses)) <<
+            "%" << std::endl;
+    }
+    // We have no timing model, so for timeliness we report how many demand
+    // accesses separate a prefetch from the first use of its block.
+    if (num_prefetches_used > 0) {
+        std::cerr << prefix << std::setw(18) << std::left << "Avg use distance:" <<
+            std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
+            ((double)prefetch_use_distance_sum/num_prefetches_used) << std::endl;
+    }
+}
+
+// Prints the top_count keys of table with the most misses, shifted left by shift.
+static void
+print_top_misses(const std::string &prefix, const std::string &label,
+                 const flat_hash_map_t<addr_t, int_least64_t> &table,
+                 unsigned int top_count, int shift)
+{
+    std::vector<std::pair<addr_t, int_least64_t> > top(table.begin(), table.end());
+    size_t count = std::min<size_t>(top_count, top.size());
+    std::partial_sort(top.begin(), top.begin() + count, top.end(),
+                      [](const std::pair<addr_t, int_least64_t> &l,
+                         const std::pair<addr_t, int_least64_t> &r) {
+                          if (l.second != r.second)
+                              return l.second > r.second;
+                          return l.first < r.first;
+                      });
+    std::cerr << prefix << "Top " << count << " " << label << " by misses:" <<
+        std::endl;
+    for (size_t i = 0; i < count; i++) {
+        std::cerr << prefix << "  " << std::setw(18) << std::right << std::hex <<
+            std::showbase << (top[i].first << shift) << ": " << std::dec <<
+            std::noshowbase << std::setw(16) << top[i].second << std::endl;
+    }
+}
+
+void
+caching_device_stats_t::print_miss_hotspots(std::string prefix)
+{
+    if (!count_hotspots || num_misses == 0)
+        return;
+    print_top_misses(prefix, "PCs", pc_misses, hotspot_top_count, 0);
+    print_top_misses(prefix, "data regions", region_misses, hotspot_top_count,
+                     region_bits);
+}
+
 void
 caching_device_stats_t::print_stats(std::string prefix)
 {
@@ -164,7 +298,30 @@ caching_device_stats_t::print_stats(std::string prefix)
     print_counts(prefix);
     print_rates(prefix);
     print_child_stats(prefix);
+    print_prefetcher_stats(prefix);
     std::cerr.imbue(std::locale("C")); // Reset to avoid affecting later prints.
+    // Digit grouping would garble the addresses.
+    print_miss_hotspots(prefix);
+}
+
+void
+caching_device_stats_t::merge(const caching_device_stats_t &other)
+{
+    num_hits += other.num_hits;
+    num_misses += other.num_misses;
+    num_child_hits += other.num_child_hits;
+    num_inclusive_invalidations += other.num_inclusive_invalidations;
+    num_prefetch_fills += other.num_prefetch_fills;
+    num_prefetches_used += other.num_prefetches_used;
+    num_prefetches_unused += other.num_prefetches_unused;
+    prefetch_use_distance_sum += other.prefetch_use_distance_sum;
+    num_hits_at_reset += other.num_hits_at_reset;
+    num_misses_at_reset += other.num_misses_at_reset;
+    num_child_hits_at_reset += other.num_child_hits_at_reset;
+    for (const auto &entry : other.pc_misses)
+        pc_misses[entry.first] += entry.second;
+    for (const auto &entry : other.region_misses)
+        region_misses[entry.first] += entry.second;
 }
 
 void
@@ -176,4 +333,11 @@ caching_device_stats_t::reset()
     num_hits = 0;
     num_misses = 0;
     num_child_hits = 0;
+    num_inclusive_invalidations = 0;
+    num_prefetch_fills = 0;
+    num_prefetches_used = 0;
+    num_prefetches_unused = 0;
+    prefetch_use_distance_sum = 0;
+    pc_misses.clear();
+    region_misses.clear();
 }
@@ -42,12 +42,22 @@
 # include <zlib.h>
 #endif
 #include "memref.h"
+#include "miss_stream_writer.h"
+#include "../common/flat_hash_map.h"
+
+// The format of a miss file.
+enum miss_file_format_t {
+    MISS_FILE_TEXT, // One "0x<pc>,0x<addr>" line per miss.
+    MISS_FILE_BINARY, // The binary format of miss_stream.h.
+    MISS_FILE_BINARY_TID_TIME, // The binary format with thread ids and timestamps.
+};
 
 class caching_device_stats_t
 {
  public:
     explicit caching_device_stats_t(const std::string &miss_file,
-                                    bool warmup_enabled = false);
+                                    bool warmup_enabled = false,
+                                    miss_file_format_t miss_format = MISS_FILE_TEXT);
     virtual ~caching_device_stats_t();
 
     // Called on each access.
@@ -58,12 +68,39 @@ class caching_device_stats_t
     // Called on each access by a child caching device.
     virtual void child_access(const memref_t &memref, bool hit);
 
+    // Called by a device with a hardware prefetcher when a prefetch brings in a
+    // block, when a demand access first uses such a block use_distance demand
+    // accesses after it was filled, and when one is evicted without being used.
+    virtual void prefetch_filled();
+    virtual void prefetch_used(int_least64_t use_distance);
+    virtual void prefetch_unused();
+
+    // Called when an inclusive ancestor's eviction removes a block from us.
+    void inclusive_invalidation() { num_inclusive_invalidations++; }
+
     virtual void print_stats(std::string prefix);
 
     virtual void reset();
 
+    // Adds the counts from other, which must be of the same type, to ours.
+    // This is used to combine the stats of a device simulated in pieces.
+    virtual void merge(const caching_device_stats_t &other);
+
     virtual bool operator!() { return !success; }
 
+    // Supplies the timestamp recorded with subsequent misses in a
+    // MISS_FILE_BINARY_TID_TIME miss file.
+    void set_miss_timestamp(uint64_t timestamp) { miss_timestamp = timestamp; }
+
+    // Enables counting the misses of each PC and of each aligned data region of
+    // region_size bytes, a power of 2, with the top_count PCs and regions with
+    // the most misses reported by print_stats().
+    void enable_miss_hotspots(unsigned int top_count, uint64_t region_size);
+
+    int_least64_t get_hits() const { return num_hits; }
+    int_least64_t get_misses() const { return num_misses; }
+    int_least64_t get_child_hits() const { return num_child_hits; }
+
  protected:
     bool success;
 
@@ -72,12 +109,23 @@ class caching_device_stats_t
     virtual void print_counts(std::string prefix); // hit/miss numbers
     virtual void print_rates(std::string prefix); // hit/miss rates
     virtual void print_child_stats(std::string prefix); // child/total info
+    virtual void print_prefetcher_stats(std::string prefix); // prefetcher efficacy
+    virtual void print_miss_hotspots(std::string prefix); // top missing PCs/regions
 
     virtual void dump_miss(const memref_t &memref);
+    void count_miss_hotspot(const memref_t &memref);
+    static addr_t miss_pc(const memref_t &memref);
 
     int_least64_t num_hits;
     int_least64_t num_misses;
     int_least64_t num_child_hits;
+    int_least64_t num_inclusive_invalidations;
+
+    // For the hardware prefetcher.
+    int_least64_t num_prefetch_fills;
+    int_least64_t num_prefetches_used;
+    int_least64_t num_prefetches_unused;
+    int_least64_t prefetch_use_distance_sum;
 
     // Stats saved when the last reset was called. This helps us get insight
     // into what the stats were when the cache was warmed up.
@@ -94,6 +142,17 @@ class caching_device_stats_t
 #else
     FILE *file;
 #endif
+    // Used instead of file for the binary formats.
+    miss_stream_writer_t *miss_writer;
+    uint64_t miss_timestamp;
+
+    // For enable_miss_hotspots().  A miss costs two hash table updates, so the
+    // tables are kept flat to avoid an allocation per new key.
+    bool count_hotspots;
+    unsigned int hotspot_top_count;
+    int region_bits;
+    flat_hash_map_t<addr_t, int_least64_t> pc_misses;
+    flat_hash_map_t<addr_t, int_least64_t> region_misses; // Keyed by addr >> bits.
 };
 
 #endif /* _CACHING_DEVICE_STATS_H_ */
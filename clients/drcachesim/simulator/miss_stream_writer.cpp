@@ -0,0 +1,137 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string.h>
+#include "miss_stream_writer.h"
+
+miss_stream_writer_t::miss_stream_writer_t() :
+    file(nullptr), with_tid_and_time(false), last_pc(0), last_addr(0), last_tid(0),
+    last_timestamp(0), fill_size(0), pending_size(0), pending_full(false),
+    done(false), failed(false)
+{
+}
+
+miss_stream_writer_t::~miss_stream_writer_t()
+{
+    close();
+}
+
+bool
+miss_stream_writer_t::open(const std::string &path, bool with_tid_and_time_)
+{
+#ifdef HAS_ZLIB
+    file = gzopen(path.c_str(), "wb");
+#else
+    file = fopen(path.c_str(), "wb");
+#endif
+    if (file == nullptr)
+        return false;
+    with_tid_and_time = with_tid_and_time_;
+    filling.resize(BUFFER_SIZE + MISS_STREAM_MAX_RECORD_SIZE);
+    pending.resize(filling.size());
+    memcpy(filling.data(), MISS_STREAM_MAGIC, MISS_STREAM_MAGIC_SIZE);
+    filling[MISS_STREAM_MAGIC_SIZE] = MISS_STREAM_VERSION;
+    filling[MISS_STREAM_MAGIC_SIZE + 1] =
+        with_tid_and_time ? MISS_STREAM_FLAG_TID_TIME : 0;
+    fill_size = MISS_STREAM_HEADER_SIZE;
+    writer = std::thread(&miss_stream_writer_t::writer_main, this);
+    return true;
+}
+
+bool
+miss_stream_writer_t::close()
+{
+    if (file == nullptr)
+        return !failed;
+    if (fill_size > 0)
+        hand_off();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done = true;
+    }
+    cond.notify_all();
+    writer.join();
+#ifdef HAS_ZLIB
+    if (gzclose(file) != Z_OK)
+        failed = true;
+#else
+    if (fclose(file) != 0)
+        failed = true;
+#endif
+    file = nullptr;
+    return !failed;
+}
+
+void
+miss_stream_writer_t::hand_off()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    // Wait for the writer to finish the previous buffer.
+    while (pending_full)
+        cond.wait(lock);
+    filling.swap(pending);
+    pending_size = fill_size;
+    pending_full = true;
+    fill_size = 0;
+    lock.unlock();
+    cond.notify_all();
+}
+
+bool
+miss_stream_writer_t::write_bytes(const unsigned char *buf, size_t size)
+{
+#ifdef HAS_ZLIB
+    return gzwrite(file, buf, (unsigned int)size) == (int)size;
+#else
+    return fwrite(buf, 1, size, file) == size;
+#endif
+}
+
+void
+miss_stream_writer_t::writer_main()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        while (!pending_full && !done)
+            cond.wait(lock);
+        if (!pending_full)
+            break;
+        // The simulation thread does not touch pending until we clear pending_full.
+        lock.unlock();
+        bool ok = write_bytes(pending.data(), pending_size);
+        lock.lock();
+        if (!ok)
+            failed = true;
+        pending_full = false;
+        cond.notify_all();
+    }
+}
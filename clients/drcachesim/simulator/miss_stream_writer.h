@@ -0,0 +1,120 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* miss_stream_writer: writes cache misses in the binary format of miss_stream.h.
+ * Misses are encoded into a buffer which is handed to a background thread to be
+ * written out while the next buffer fills, keeping file I/O and compression off
+ * the simulation thread.
+ */
+
+#ifndef _MISS_STREAM_WRITER_H_
+#define _MISS_STREAM_WRITER_H_ 1
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#ifdef HAS_ZLIB
+# include <zlib.h>
+#endif
+#include "memref.h"
+#include "miss_stream.h"
+
+class miss_stream_writer_t
+{
+ public:
+    miss_stream_writer_t();
+    ~miss_stream_writer_t();
+    // Creates the file at path and writes the stream header.
+    // Returns false if the file cannot be created.
+    bool open(const std::string &path, bool with_tid_and_time);
+    // Flushes all buffered misses and closes the file.
+    // Returns false if any write failed.
+    bool close();
+
+    void write(addr_t pc, addr_t addr, memref_tid_t tid, uint64_t timestamp)
+    {
+        unsigned char *pos = filling.data() + fill_size;
+        pos = miss_stream_put_varint(pos, miss_stream_zigzag((int64_t)(pc - last_pc)));
+        pos = miss_stream_put_varint(pos, miss_stream_zigzag((int64_t)
+                                                             (addr - last_addr)));
+        if (with_tid_and_time) {
+            pos = miss_stream_put_varint(pos, miss_stream_zigzag(tid - last_tid));
+            pos = miss_stream_put_varint(pos, miss_stream_zigzag((int64_t)
+                                                                 (timestamp -
+                                                                  last_timestamp)));
+            last_tid = tid;
+            last_timestamp = timestamp;
+        }
+        last_pc = pc;
+        last_addr = addr;
+        fill_size = pos - filling.data();
+        if (fill_size > BUFFER_SIZE)
+            hand_off();
+    }
+
+ private:
+    // A buffer is handed off once it holds this many bytes.
+    static const size_t BUFFER_SIZE = 1 << 20;
+
+    void hand_off();
+    void writer_main();
+    bool write_bytes(const unsigned char *buf, size_t size);
+
+#ifdef HAS_ZLIB
+    gzFile file;
+#else
+    FILE *file;
+#endif
+    bool with_tid_and_time;
+    addr_t last_pc;
+    addr_t last_addr;
+    memref_tid_t last_tid;
+    uint64_t last_timestamp;
+
+    // The buffer being encoded into, owned by the simulation thread.
+    std::vector<unsigned char> filling;
+    size_t fill_size;
+    // The buffer being written, owned by the writer thread while pending_full.
+    std::vector<unsigned char> pending;
+    size_t pending_size;
+    bool pending_full;
+    bool done;
+    bool failed;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread writer;
+};
+
+#endif /* _MISS_STREAM_WRITER_H_ */
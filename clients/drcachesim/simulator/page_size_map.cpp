@@ -0,0 +1,153 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+#include "page_size_map.h"
+
+page_size_map_t::page_size_map_t() : use_thp(false), thp_threshold(1), last_region(0)
+{
+}
+
+static bool
+parse_page_size(const std::string &str, page_size_index_t *size)
+{
+    if (str == "4K" || str == "4k" || str == "4096")
+        *size = PAGE_SIZE_BASE;
+    else if (str == "2M" || str == "2m" || str == "2097152")
+        *size = PAGE_SIZE_2M;
+    else if (str == "1G" || str == "1g" || str == "1073741824")
+        *size = PAGE_SIZE_1G;
+    else
+        return false;
+    return true;
+}
+
+bool
+page_size_map_t::init_regions(const std::string &path, std::string *error)
+{
+    std::ifstream file(path.c_str());
+    if (!file.good()) {
+        *error = "failed to open " + path;
+        return false;
+    }
+    std::string line;
+    int line_num = 0;
+    while (std::getline(file, line)) {
+        ++line_num;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos)
+            line.erase(comment);
+        std::istringstream fields(line);
+        std::string start_str, end_str, size_str;
+        if (!(fields >> start_str))
+            continue; // Blank line.
+        std::ostringstream where;
+        where << path << ":" << line_num;
+        if (!(fields >> end_str >> size_str)) {
+            *error = "missing fields at " + where.str();
+            return false;
+        }
+        region_t region;
+        char *start_end, *end_end;
+        region.start = strtoull(start_str.c_str(), &start_end, 0);
+        region.end = strtoull(end_str.c_str(), &end_end, 0);
+        if (*start_end != '\0' || *end_end != '\0' || region.end <= region.start ||
+            !parse_page_size(size_str, &region.size)) {
+            *error = "invalid region at " + where.str();
+            return false;
+        }
+        uint64_t align = region.size == PAGE_SIZE_2M ? SIZE_2M :
+            (region.size == PAGE_SIZE_1G ? SIZE_1G : 1);
+        if (region.start % align != 0 || region.end % align != 0) {
+            *error = "region not aligned to its page size at " + where.str();
+            return false;
+        }
+        regions.push_back(region);
+    }
+    std::sort(regions.begin(), regions.end(),
+              [](const region_t &l, const region_t &r) { return l.start < r.start; });
+    for (size_t i = 1; i < regions.size(); i++) {
+        if (regions[i].start < regions[i - 1].end) {
+            *error = "overlapping regions in " + path;
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+page_size_map_t::init_thp(unsigned int threshold)
+{
+    use_thp = true;
+    thp_threshold = threshold;
+}
+
+page_size_index_t
+page_size_map_t::get_page_size(addr_t addr, bool is_instr)
+{
+    if (use_thp) {
+        if (is_instr)
+            return PAGE_SIZE_BASE;
+        if (thp_threshold <= 1)
+            return PAGE_SIZE_2M;
+        thp_region_t &region = thp_regions[addr / SIZE_2M];
+        if (!region.huge) {
+            unsigned int page = (unsigned int)((addr % SIZE_2M) >> 12);
+            uint64_t bit = 1ULL << (page % 64);
+            if ((region.touched[page / 64] & bit) == 0) {
+                region.touched[page / 64] |= bit;
+                if (++region.count >= thp_threshold)
+                    region.huge = true;
+            }
+        }
+        return region.huge ? PAGE_SIZE_2M : PAGE_SIZE_BASE;
+    }
+    if (regions.empty())
+        return PAGE_SIZE_BASE;
+    // Accesses tend to stay within a region.
+    if (addr >= regions[last_region].start && addr < regions[last_region].end)
+        return regions[last_region].size;
+    auto it = std::upper_bound(regions.begin(), regions.end(), addr,
+                               [](addr_t value, const region_t &region) {
+                                   return value < region.start;
+                               });
+    if (it == regions.begin())
+        return PAGE_SIZE_BASE;
+    --it;
+    if (addr >= it->end)
+        return PAGE_SIZE_BASE;
+    last_region = it - regions.begin();
+    return it->size;
+}
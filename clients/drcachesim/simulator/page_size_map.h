@@ -0,0 +1,98 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* page_size_map: decides which page size backs each address for the TLB
+ * simulator's huge page modeling.
+ */
+
+#ifndef _PAGE_SIZE_MAP_H_
+#define _PAGE_SIZE_MAP_H_ 1
+
+#include <string>
+#include <vector>
+#include "../common/flat_hash_map.h"
+#include "../common/memref.h"
+
+// The page sizes modeled, each with its own TLB entry arrays.  The base size
+// is -page_size.
+enum page_size_index_t {
+    PAGE_SIZE_BASE,
+    PAGE_SIZE_2M,
+    PAGE_SIZE_1G,
+    PAGE_SIZE_COUNT,
+};
+
+class page_size_map_t
+{
+ public:
+    page_size_map_t();
+    // Reads a region map: each line holds a start address, an end address
+    // (exclusive), and a page size of 4K, 2M, or 1G, with '#' starting a
+    // comment.  Addresses outside any region use the base page size.
+    // Returns false and sets error on failure.
+    bool init_regions(const std::string &path, std::string *error);
+    // Models transparent huge pages: data in each aligned 2MB region is backed by
+    // a 2MB page once that many of its distinct 4KB pages have been touched.
+    // Code stays on base pages.
+    void init_thp(unsigned int threshold);
+    page_size_index_t get_page_size(addr_t addr, bool is_instr);
+
+    static const uint64_t SIZE_2M = 2 * 1024 * 1024;
+    static const uint64_t SIZE_1G = 1024 * 1024 * 1024;
+
+ protected:
+    struct region_t {
+        addr_t start;
+        addr_t end;
+        page_size_index_t size;
+    };
+    // The 4KB pages touched so far in a transparent huge page candidate.
+    struct thp_region_t {
+        thp_region_t() : count(0), huge(false)
+        {
+            for (int i = 0; i < 8; i++)
+                touched[i] = 0;
+        }
+        uint64_t touched[8];
+        unsigned int count;
+        bool huge;
+    };
+
+    bool use_thp;
+    unsigned int thp_threshold;
+    flat_hash_map_t<addr_t, thp_region_t> thp_regions;
+    // Sorted by start.
+    std::vector<region_t> regions;
+    size_t last_region;
+};
+
+#endif /* _PAGE_SIZE_MAP_H_ */
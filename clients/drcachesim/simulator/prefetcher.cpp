@@ -34,19 +34,53 @@
  */
 
 #include "caching_device.h"
+#include "prefetcher_stride.h"
+#include "prefetcher_stream.h"
 #include "../common/memref.h"
+#include "../common/options.h"
 
-prefetcher_t::prefetcher_t(int block_size) : block_size(block_size)
+prefetcher_t::prefetcher_t(int block_size, int degree, int distance) :
+    block_size(block_size), degree(degree), distance(distance)
 {
     // Nothing else to do.
 }
 
+bool
+prefetcher_t::is_valid_policy(const std::string &policy)
+{
+    return policy == PREFETCH_POLICY_NEXTLINE || policy == PREFETCH_POLICY_STRIDE ||
+        policy == PREFETCH_POLICY_STREAM || policy == PREFETCH_POLICY_NONE;
+}
+
+prefetcher_t *
+prefetcher_t::create(const std::string &policy, int block_size, int degree,
+                     int distance)
+{
+    if (policy == PREFETCH_POLICY_NEXTLINE)
+        return new prefetcher_t(block_size, degree, distance);
+    if (policy == PREFETCH_POLICY_STRIDE)
+        return new prefetcher_stride_t(block_size, degree, distance);
+    if (policy == PREFETCH_POLICY_STREAM)
+        return new prefetcher_stream_t(block_size, degree, distance);
+    return nullptr;
+}
+
 void
-prefetcher_t::prefetch(caching_device_t *cache, const memref_t &memref_in)
+prefetcher_t::issue(caching_device_t *cache, const memref_t &memref_in, addr_t addr)
 {
-    // We implement a simple next-line prefetcher.
     memref_t memref = memref_in;
-    memref.data.addr += block_size;
+    memref.data.addr = addr;
+    memref.data.size = 1;
     memref.data.type = TRACE_TYPE_HARDWARE_PREFETCH;
     cache->request(memref);
 }
+
+void
+prefetcher_t::prefetch(caching_device_t *cache, const memref_t &memref_in, bool missed)
+{
+    if (!missed)
+        return;
+    // We fetch the subsequent line(s).
+    for (int i = 0; i < degree; i++)
+        issue(cache, memref_in, memref_in.data.addr + (distance + i) * block_size);
+}
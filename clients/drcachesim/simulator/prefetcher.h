@@ -36,19 +36,36 @@
 #ifndef _PREFETCHER_H_
 #define _PREFETCHER_H_ 1
 
-#include "caching_device.h"
+#include <string>
 #include "memref.h"
 
 class caching_device_t;
 
+// The base class implements a next-line prefetcher.  Other models subclass it
+// and override prefetch().
 class prefetcher_t
 {
  public:
-    prefetcher_t(int block_size);
+    // The degree is how many blocks are prefetched per trigger, and the distance
+    // is how far ahead of the triggering access, in blocks or strides, the first
+    // of them is.
+    prefetcher_t(int block_size, int degree = 1, int distance = 1);
     virtual ~prefetcher_t() {}
-    virtual void prefetch(caching_device_t *cache, const memref_t &memref);
- private:
+    // Called on each demand access to cache, where missed says whether it missed.
+    virtual void prefetch(caching_device_t *cache, const memref_t &memref, bool missed);
+
+    static bool is_valid_policy(const std::string &policy);
+    // Returns nullptr for PREFETCH_POLICY_NONE.
+    static prefetcher_t *create(const std::string &policy, int block_size,
+                                int degree, int distance);
+
+ protected:
+    // Requests a hardware prefetch of the block containing addr.
+    void issue(caching_device_t *cache, const memref_t &memref, addr_t addr);
+
     int block_size;
+    int degree;
+    int distance;
 };
 
 #endif /* _PREFETCHER_H_ */
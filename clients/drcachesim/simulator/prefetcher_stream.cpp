@@ -0,0 +1,89 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* prefetcher_stream: a stream prefetcher.
+ */
+
+#include "prefetcher_stream.h"
+
+// XXX: make these knobs if they turn out to matter.
+static const int NUM_STREAMS = 16;
+// How many blocks away from a stream's last block an access may be and still
+// belong to it.
+static const int_least64_t STREAM_WINDOW = 16;
+// A stream is trusted once it has advanced this many times in one direction.
+static const int CONFIDENCE_THRESHOLD = 2;
+
+prefetcher_stream_t::prefetcher_stream_t(int block_size, int degree, int distance) :
+    prefetcher_t(block_size, degree, distance), streams(NUM_STREAMS), time(0)
+{
+    // Nothing else to do.
+}
+
+void
+prefetcher_stream_t::prefetch(caching_device_t *cache, const memref_t &memref,
+                              bool missed)
+{
+    addr_t block = memref.data.addr / block_size;
+    ++time;
+    stream_t *lru = &streams[0];
+    for (auto &stream : streams) {
+        int_least64_t delta = (int_least64_t)(block - stream.last_block);
+        if (stream.last_use == 0 || delta < -STREAM_WINDOW || delta > STREAM_WINDOW) {
+            if (stream.last_use < lru->last_use)
+                lru = &stream;
+            continue;
+        }
+        stream.last_use = time;
+        if (delta == 0)
+            return;
+        int direction = delta > 0 ? 1 : -1;
+        if (direction != stream.direction) {
+            stream.direction = direction;
+            stream.confidence = 0;
+        } else if (stream.confidence < CONFIDENCE_THRESHOLD)
+            stream.confidence++;
+        stream.last_block = block;
+        if (stream.confidence < CONFIDENCE_THRESHOLD)
+            return;
+        for (int i = 0; i < degree; i++) {
+            issue(cache, memref,
+                  (block + direction * (distance + i)) * (addr_t)block_size);
+        }
+        return;
+    }
+    // Start a new stream, replacing the least recently used one.
+    lru->last_block = block;
+    lru->direction = 0;
+    lru->confidence = 0;
+    lru->last_use = time;
+}
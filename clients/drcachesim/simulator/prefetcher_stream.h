@@ -0,0 +1,62 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* prefetcher_stream: a stream prefetcher.
+ */
+
+#ifndef _PREFETCHER_STREAM_H_
+#define _PREFETCHER_STREAM_H_ 1
+
+#include <vector>
+#include "prefetcher.h"
+
+// Detects sequences of accesses to nearby blocks moving in one direction,
+// regardless of which instructions make them, and prefetches ahead of each.
+class prefetcher_stream_t : public prefetcher_t
+{
+ public:
+    prefetcher_stream_t(int block_size, int degree, int distance);
+    virtual void prefetch(caching_device_t *cache, const memref_t &memref, bool missed);
+
+ protected:
+    struct stream_t {
+        stream_t() : last_block(0), direction(0), confidence(0), last_use(0) {}
+        addr_t last_block;
+        int direction;
+        int confidence;
+        int_least64_t last_use;
+    };
+    std::vector<stream_t> streams;
+    int_least64_t time;
+};
+
+#endif /* _PREFETCHER_STREAM_H_ */
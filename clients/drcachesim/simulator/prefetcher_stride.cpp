@@ -0,0 +1,86 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* prefetcher_stride: a per-PC stride prefetcher.
+ */
+
+#include "prefetcher_stride.h"
+
+// XXX: make these knobs if they turn out to matter.
+static const int TABLE_ENTRIES = 256;
+// A stride is trusted once it has repeated this many times in a row.
+static const int CONFIDENCE_THRESHOLD = 2;
+static const int CONFIDENCE_MAX = 3;
+
+prefetcher_stride_t::prefetcher_stride_t(int block_size, int degree, int distance) :
+    prefetcher_t(block_size, degree, distance), table(TABLE_ENTRIES)
+{
+    // Nothing else to do.
+}
+
+void
+prefetcher_stride_t::prefetch(caching_device_t *cache, const memref_t &memref,
+                              bool missed)
+{
+    addr_t pc = memref.data.pc;
+    addr_t addr = memref.data.addr;
+    // Instructions are mostly at least 2 bytes apart, so skip the low bit.
+    entry_t &entry = table[(pc >> 1) % TABLE_ENTRIES];
+    if (entry.pc != pc) {
+        entry.pc = pc;
+        entry.last_addr = addr;
+        entry.stride = 0;
+        entry.confidence = 0;
+        return;
+    }
+    int_least64_t stride = (int_least64_t)(addr - entry.last_addr);
+    entry.last_addr = addr;
+    if (stride == 0)
+        return;
+    if (stride == entry.stride) {
+        if (entry.confidence < CONFIDENCE_MAX)
+            entry.confidence++;
+    } else if (entry.confidence > 0)
+        entry.confidence--;
+    else
+        entry.stride = stride;
+    if (entry.confidence < CONFIDENCE_THRESHOLD)
+        return;
+    // Strides within a block would just prefetch the same block repeatedly.
+    int_least64_t step = entry.stride;
+    if (step > 0 && step < block_size)
+        step = block_size;
+    else if (step < 0 && step > -block_size)
+        step = -block_size;
+    for (int i = 0; i < degree; i++)
+        issue(cache, memref, addr + (distance + i) * step);
+}
@@ -30,10 +30,15 @@
  * DAMAGE.
  */
 
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <limits>
+#include <sstream>
 #include <assert.h>
 #include <limits.h>
+#include <string.h>
 #include "../common/memref.h"
 #include "../common/options.h"
 #include "../common/utils.h"
@@ -58,7 +63,16 @@ simulator_t::simulator_t(unsigned int num_cores,
     last_core(0),
     cpu_counts(knob_num_cores, 0),
     thread_counts(knob_num_cores, 0),
-    thread_ever_counts(knob_num_cores, 0)
+    thread_ever_counts(knob_num_cores, 0),
+    core_threads(knob_num_cores, 0),
+    region_warmup(0),
+    region_index(0),
+    region_started(false),
+    region_instrs(0),
+    stats_interval(0),
+    stats_countdown(0),
+    stats_refs(0),
+    stats_written_refs(0)
 {
     if (knob_warmup_refs > 0 && (knob_warmup_fraction > 0.0)) {
         ERRMSG("Usage error: Either warmup_refs OR warmup_fraction can be set");
@@ -96,6 +110,17 @@ simulator_t::process_memref(const memref_t &memref)
         thread2core[memref.marker.tid] = min_core;
         ++thread_counts[min_core];
         ++thread_ever_counts[min_core];
+        if (core_threads[min_core] != memref.marker.tid) {
+            if (core_threads[min_core] != 0) {
+                if (knob_verbose >= 2) {
+                    std::cerr << "core " << min_core << " switches from thread " <<
+                        core_threads[min_core] << " to " << memref.marker.tid <<
+                        std::endl;
+                }
+                handle_context_switch(min_core);
+            }
+            core_threads[min_core] = memref.marker.tid;
+        }
     }
     return true;
 }
@@ -156,6 +181,245 @@ simulator_t::handle_thread_exit(memref_tid_t tid)
     thread2core.erase(tid);
 }
 
+// The first bytes of a warmup state file.
+static const char WARMUP_STATE_MAGIC[] = "DRWARM01";
+
+static void
+write_value(std::ostream &out, int_least64_t val)
+{
+    out.write((const char *)&val, sizeof(val));
+}
+
+static int_least64_t
+read_value(std::istream &in)
+{
+    int_least64_t val = 0;
+    in.read((char *)&val, sizeof(val));
+    return val;
+}
+
+template <typename K>
+static void
+write_map(std::ostream &out, const std::unordered_map<K, int> &map)
+{
+    write_value(out, map.size());
+    for (const auto &entry : map) {
+        write_value(out, entry.first);
+        write_value(out, entry.second);
+    }
+}
+
+template <typename K>
+static void
+read_map(std::istream &in, std::unordered_map<K, int> *map)
+{
+    map->clear();
+    int_least64_t size = read_value(in);
+    for (int_least64_t i = 0; i < size && in; i++) {
+        K key = (K)read_value(in);
+        (*map)[key] = (int)read_value(in);
+    }
+}
+
+template <typename T>
+static void
+write_vector(std::ostream &out, const std::vector<T> &vec)
+{
+    for (const T val : vec)
+        write_value(out, val);
+}
+
+template <typename T>
+static void
+read_vector(std::istream &in, std::vector<T> *vec)
+{
+    for (T &val : *vec)
+        val = (T)read_value(in);
+}
+
+bool
+simulator_t::save_warmup_state(const std::string &path, const std::string &config,
+                               const std::vector<caching_device_t *> &devices)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+    out.write(WARMUP_STATE_MAGIC, sizeof(WARMUP_STATE_MAGIC) - 1);
+    write_value(out, config.size());
+    out.write(config.data(), config.size());
+    write_map(out, cpu2core);
+    write_map(out, thread2core);
+    write_vector(out, cpu_counts);
+    write_vector(out, thread_counts);
+    write_vector(out, thread_ever_counts);
+    write_vector(out, core_threads);
+    for (caching_device_t *device : devices) {
+        if (!device->save_state(out))
+            return false;
+    }
+    out.close();
+    return !out.fail();
+}
+
+bool
+simulator_t::load_warmup_state(const std::string &path, const std::string &config,
+                               const std::vector<caching_device_t *> &devices)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(WARMUP_STATE_MAGIC) - 1];
+    if (!in.read(magic, sizeof(magic)) ||
+        memcmp(magic, WARMUP_STATE_MAGIC, sizeof(magic)) != 0)
+        return false;
+    if (read_value(in) != (int_least64_t)config.size())
+        return false;
+    std::string saved_config(config.size(), '\0');
+    if (!in.read(&saved_config[0], saved_config.size()) || saved_config != config)
+        return false;
+    read_map(in, &cpu2core);
+    read_map(in, &thread2core);
+    read_vector(in, &cpu_counts);
+    read_vector(in, &thread_counts);
+    read_vector(in, &thread_ever_counts);
+    read_vector(in, &core_threads);
+    for (caching_device_t *device : devices) {
+        if (!device->load_state(in))
+            return false;
+    }
+    return true;
+}
+
+bool
+simulator_t::load_regions(const std::string &path, uint64_t warmup_instrs,
+                          const std::vector<caching_device_t *> &devices)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+    regions.clear();
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        region_t region;
+        if (!(fields >> region.start >> region.instrs >> region.weight) ||
+            region.instrs == 0 || region.weight < 0.)
+            return false;
+        // The regions must be in order and must not overlap.
+        if (!regions.empty() &&
+            region.start < regions.back().start + regions.back().instrs)
+            return false;
+        region.hits.resize(devices.size(), 0);
+        region.misses.resize(devices.size(), 0);
+        regions.push_back(region);
+    }
+    if (regions.empty())
+        return false;
+    region_devices = devices;
+    region_warmup = warmup_instrs;
+    return true;
+}
+
+// Finishes the regions that end before instruction number instr.
+void
+simulator_t::advance_regions(uint64_t instr)
+{
+    while (region_index < regions.size() &&
+           instr >= regions[region_index].start + regions[region_index].instrs) {
+        region_t &region = regions[region_index];
+        if (region_started) {
+            for (size_t i = 0; i < region_devices.size(); i++) {
+                region.hits[i] += region_devices[i]->get_stats()->get_hits();
+                region.misses[i] += region_devices[i]->get_stats()->get_misses();
+            }
+            region_started = false;
+            if (knob_verbose >= 1)
+                std::cerr << "Region " << region_index << " simulated\n";
+        }
+        ++region_index;
+    }
+}
+
+bool
+simulator_t::in_region(const memref_t &memref)
+{
+    // Markers and thread exits keep the thread to core mapping up to date and
+    // do not affect the statistics.
+    if (memref.marker.type == TRACE_TYPE_MARKER ||
+        memref.exit.type == TRACE_TYPE_THREAD_EXIT)
+        return true;
+    // The data references of an instruction, and any records before the first
+    // instruction, go with that instruction.
+    if (type_is_instr(memref.instr.type) ||
+        memref.instr.type == TRACE_TYPE_INSTR_NO_FETCH)
+        ++region_instrs;
+    uint64_t instr = (region_instrs == 0) ? 0 : region_instrs - 1;
+    advance_regions(instr);
+    if (region_index == regions.size())
+        return false;
+    region_t &region = regions[region_index];
+    if (!region_started && instr >= region.start) {
+        // We record the counts at the start and add the counts at the end.
+        for (size_t i = 0; i < region_devices.size(); i++) {
+            region.hits[i] = -region_devices[i]->get_stats()->get_hits();
+            region.misses[i] = -region_devices[i]->get_stats()->get_misses();
+        }
+        region_started = true;
+    }
+    return instr + region_warmup >= region.start;
+}
+
+uint64_t
+simulator_t::instructions_to_skip()
+{
+    if (regions.empty())
+        return 0;
+    advance_regions(region_instrs);
+    if (region_index == regions.size()) {
+        // There is nothing left to simulate.
+        return std::numeric_limits<uint64_t>::max();
+    }
+    const region_t &region = regions[region_index];
+    uint64_t warmup_start =
+        (region.start > region_warmup) ? region.start - region_warmup : 0;
+    if (region_instrs >= warmup_start)
+        return 0;
+    uint64_t skip = warmup_start - region_instrs;
+    region_instrs = warmup_start;
+    return skip;
+}
+
+void
+simulator_t::print_region_results(const std::vector<std::string> &names)
+{
+    advance_regions(std::numeric_limits<uint64_t>::max());
+    double total_weight = 0.;
+    for (const region_t &region : regions)
+        total_weight += region.weight;
+    std::cerr << "Weighted results over " << regions.size() << " regions:\n";
+    for (size_t i = 0; i < region_devices.size(); i++) {
+        // A region's miss rate only counts if the device saw accesses within it.
+        double rate_sum = 0., rate_weight = 0., mpki_sum = 0.;
+        for (const region_t &region : regions) {
+            int_least64_t accesses = region.hits[i] + region.misses[i];
+            if (accesses > 0) {
+                rate_sum += region.weight * region.misses[i] / accesses;
+                rate_weight += region.weight;
+            }
+            mpki_sum += region.weight * region.misses[i] * 1000. / region.instrs;
+        }
+        if (rate_weight == 0.)
+            continue;
+        std::cerr << "  " << names[i] << ":" << std::endl;
+        std::cerr << "    " << std::setw(18) << std::left << "Miss rate:" <<
+            std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
+            (rate_sum * 100 / rate_weight) << "%" << std::endl;
+        std::cerr << "    " << std::setw(18) << std::left << "Misses per 1K:" <<
+            std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
+            (mpki_sum / total_weight) << std::endl;
+    }
+}
+
 void
 simulator_t::print_core(int core) const
 {
@@ -182,3 +446,51 @@ simulator_t::print_core(int core) const
         std::cerr << ")" << std::endl;
     }
 }
+
+bool
+simulator_t::open_stats_file(const std::string &path, uint64_t interval,
+                             const std::vector<caching_device_t *> &devices,
+                             const std::vector<std::string> &names)
+{
+    if (interval == 0)
+        return false;
+    stats_out.open(path);
+    if (!stats_out)
+        return false;
+    // Each row holds the counts since the start of simulation, or since the
+    // end of warmup, so any window's rates are the difference of two rows.
+    stats_out << "refs";
+    for (const std::string &name : names)
+        stats_out << "," << name << " hits," << name << " misses";
+    stats_out << "\n";
+    stats_devices = devices;
+    stats_interval = interval;
+    stats_countdown = interval;
+    return !stats_out.fail();
+}
+
+void
+simulator_t::write_stats_snapshot()
+{
+    stats_out << stats_refs;
+    for (caching_device_t *device : stats_devices) {
+        stats_out << "," << device->get_stats()->get_hits() << ","
+                  << device->get_stats()->get_misses();
+    }
+    stats_out << "\n";
+    // Flushing each row lets a dashboard follow a running simulation, and
+    // costs little at a sensible interval.
+    stats_out.flush();
+    stats_written_refs = stats_refs;
+}
+
+void
+simulator_t::finish_stats()
+{
+    if (!stats_out.is_open())
+        return;
+    if (stats_refs != stats_written_refs)
+        write_stats_snapshot();
+    stats_out.close();
+    stats_countdown = 0;
+}
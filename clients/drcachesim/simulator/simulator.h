@@ -36,6 +36,8 @@
 #ifndef _SIMULATOR_H_
 #define _SIMULATOR_H_ 1
 
+#include <fstream>
+#include <string>
 #include <unordered_map>
 #include <vector>
 #include "caching_device_stats.h"
@@ -55,12 +57,55 @@ class simulator_t : public analysis_tool_t
                 unsigned int verbose);
     virtual ~simulator_t() = 0;
     virtual bool process_memref(const memref_t &memref);
+    // Under -regions_file, fast-forwards to the warmup of the next region.
+    virtual uint64_t instructions_to_skip();
 
  protected:
     void print_core(int core) const;
     int find_emptiest_core(std::vector<int> &counts) const;
     virtual int core_for_thread(memref_tid_t tid);
     virtual void handle_thread_exit(memref_tid_t tid);
+    // Called under knob_cpu_scheduling when core switches to a different thread.
+    virtual void handle_context_switch(int core) {}
+    // Writes the thread-to-core mapping and the state of devices to path, after a
+    // header holding config, which should identify the simulated configuration.
+    bool save_warmup_state(const std::string &path, const std::string &config,
+                           const std::vector<caching_device_t *> &devices);
+    // Restores the state written by save_warmup_state() with the same config
+    // and device list.
+    bool load_warmup_state(const std::string &path, const std::string &config,
+                           const std::vector<caching_device_t *> &devices);
+    // Reads the representative regions written by the regions tool to path.
+    // Only the records within each region and the warmup_instrs instructions
+    // prior to it are then simulated, and the hits and misses of the devices
+    // within each region are recorded.
+    bool load_regions(const std::string &path, uint64_t warmup_instrs,
+                      const std::vector<caching_device_t *> &devices);
+    // Returns whether memref lies within a region or its warmup.  Must only be
+    // called once per record, in trace order, and only if regions were loaded.
+    bool in_region(const memref_t &memref);
+    // Prints the miss rates of the region devices, whose names are passed in the
+    // same order, over the regions and weighted by the region weights.
+    void print_region_results(const std::vector<std::string> &names);
+    // Opens path for -stats_file snapshots of the devices, whose names are
+    // passed in the same order, and writes the CSV header.
+    bool open_stats_file(const std::string &path, uint64_t interval,
+                         const std::vector<caching_device_t *> &devices,
+                         const std::vector<std::string> &names);
+    // Counts a simulated reference, writing a snapshot after every stats
+    // interval references.  This is inline as it is called for every reference.
+    void count_stats_ref()
+    {
+        if (stats_countdown == 0)
+            return;
+        ++stats_refs;
+        if (--stats_countdown == 0) {
+            write_stats_snapshot();
+            stats_countdown = stats_interval;
+        }
+    }
+    // Writes the final snapshot, if the counts changed since the last one.
+    void finish_stats();
 
     unsigned int knob_num_cores;
     uint64_t knob_skip_refs;
@@ -79,6 +124,37 @@ class simulator_t : public analysis_tool_t
     std::vector<int> cpu_counts;
     std::vector<int> thread_counts;
     std::vector<int> thread_ever_counts;
+    // The thread last placed on each core under knob_cpu_scheduling.
+    std::vector<memref_tid_t> core_threads;
+
+    // For -regions_file:
+    struct region_t {
+        uint64_t start;
+        uint64_t instrs;
+        double weight;
+        // The device counts within the region, per device.
+        std::vector<int_least64_t> hits;
+        std::vector<int_least64_t> misses;
+    };
+    void advance_regions(uint64_t instr);
+    std::vector<region_t> regions;
+    std::vector<caching_device_t *> region_devices;
+    uint64_t region_warmup;
+    // The region being simulated or warmed up for.
+    size_t region_index;
+    bool region_started;
+    // The instructions seen or skipped so far.
+    uint64_t region_instrs;
+
+    // For -stats_file:
+    void write_stats_snapshot();
+    std::ofstream stats_out;
+    std::vector<caching_device_t *> stats_devices;
+    uint64_t stats_interval;
+    // Zero when snapshots are off.
+    uint64_t stats_countdown;
+    uint64_t stats_refs;
+    uint64_t stats_written_refs;
 };
 
 #endif /* _SIMULATOR_H_ */
@@ -0,0 +1,175 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "timing_model.h"
+
+timing_model_t::timing_model_t(unsigned int num_cores, double base_cpi_,
+                               unsigned int rob_size_, unsigned int mlp_,
+                               double bytes_per_cycle, unsigned int line_size) :
+    base_cpi(base_cpi_), rob_size(rob_size_), mlp(mlp_),
+    line_transfer(bytes_per_cycle > 0 ? line_size / bytes_per_cycle : 0),
+    memory_free(0), cores(num_cores)
+{
+}
+
+void
+timing_model_t::advance(core_t &core, double time)
+{
+    if (time <= core.now)
+        return;
+    threads[core.tid].cycles += time - core.now;
+    core.now = time;
+}
+
+double
+timing_model_t::complete(double issue, double stall, bool from_memory)
+{
+    double done = issue + stall;
+    if (from_memory && line_transfer > 0) {
+        // The line's transfer queues behind those already on the channel.
+        memory_free = std::max(memory_free, issue) + line_transfer;
+        done = std::max(done, memory_free);
+    }
+    return done;
+}
+
+void
+timing_model_t::instruction(int core_idx, memref_tid_t tid, double stall,
+                            bool from_memory)
+{
+    core_t &core = cores[core_idx];
+    core.tid = tid;
+    threads[tid].instrs++;
+    core.instrs++;
+    // An instruction cannot issue while a miss rob_size instructions older is
+    // still outstanding at the head of the reorder buffer.
+    for (size_t i = 0; i < core.outstanding.size();) {
+        if (core.outstanding[i].instr + rob_size <= core.instrs) {
+            advance(core, core.outstanding[i].done);
+            core.outstanding.erase(core.outstanding.begin() + i);
+        } else
+            ++i;
+    }
+    double start = core.now;
+    if (stall > 0)
+        start = complete(core.now, stall, from_memory);
+    advance(core, start + base_cpi);
+}
+
+void
+timing_model_t::data_access(int core_idx, memref_tid_t tid, double stall,
+                            bool from_memory)
+{
+    if (stall <= 0)
+        return;
+    core_t &core = cores[core_idx];
+    core.tid = tid;
+    auto is_done = [&core](const miss_t &miss) { return miss.done <= core.now; };
+    core.outstanding.erase(std::remove_if(core.outstanding.begin(),
+                                          core.outstanding.end(), is_done),
+                           core.outstanding.end());
+    if (core.outstanding.size() >= mlp) {
+        // We wait for the first outstanding miss to complete.
+        auto first = std::min_element(core.outstanding.begin(), core.outstanding.end(),
+                                      [](const miss_t &l, const miss_t &r) {
+                                          return l.done < r.done;
+                                      });
+        advance(core, first->done);
+        core.outstanding.erase(first);
+    }
+    miss_t miss;
+    miss.instr = core.instrs;
+    miss.done = complete(core.now, stall, from_memory);
+    core.outstanding.push_back(miss);
+}
+
+void
+timing_model_t::reset()
+{
+    for (core_t &core : cores) {
+        core.now = 0;
+        core.instrs = 0;
+        core.outstanding.clear();
+    }
+    memory_free = 0;
+    threads.clear();
+}
+
+static void
+print_cpi(const std::string &prefix, uint64_t instrs, double cycles, double base_cpi)
+{
+    std::cerr << prefix << std::setw(18) << std::left << "Instructions:" <<
+        std::setw(20) << std::right << instrs << std::endl;
+    std::cerr << prefix << std::setw(18) << std::left << "Cycles:" <<
+        std::setw(20) << std::right << (uint64_t)cycles << std::endl;
+    std::cerr << prefix << std::setw(18) << std::left << "CPI:" <<
+        std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
+        cycles / instrs << std::endl;
+    // Every instruction takes base_cpi, so the rest is the memory hierarchy's.
+    std::cerr << prefix << std::setw(18) << std::left << "Memory CPI:" <<
+        std::setw(20) << std::fixed << std::setprecision(2) << std::right <<
+        cycles / instrs - base_cpi << std::endl;
+}
+
+void
+timing_model_t::print_results()
+{
+    // The outstanding misses complete before the end.
+    for (core_t &core : cores) {
+        for (const miss_t &miss : core.outstanding)
+            advance(core, miss.done);
+        core.outstanding.clear();
+    }
+    std::cerr << "Timing model results:" << std::endl;
+    std::cerr.imbue(std::locale("")); // Add commas, at least for my locale
+    for (size_t i = 0; i < cores.size(); i++) {
+        if (cores[i].instrs == 0)
+            continue;
+        std::cerr << "Core #" << i << ":" << std::endl;
+        print_cpi("    ", cores[i].instrs, cores[i].now, base_cpi);
+    }
+    std::vector<memref_tid_t> tids;
+    for (const auto &thread : threads) {
+        if (thread.second.instrs > 0)
+            tids.push_back(thread.first);
+    }
+    std::sort(tids.begin(), tids.end());
+    for (memref_tid_t tid : tids) {
+        std::cerr << "Thread " << tid << ":" << std::endl;
+        print_cpi("    ", threads[tid].instrs, threads[tid].cycles, base_cpi);
+    }
+    std::cerr.imbue(std::locale("C")); // Reset to avoid affecting later prints.
+}
@@ -0,0 +1,101 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* timing_model: estimates the cycles the memory hierarchy adds to each core.
+ */
+
+#ifndef _TIMING_MODEL_H_
+#define _TIMING_MODEL_H_ 1
+
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include "memref.h"
+
+// A simple out-of-order core model driven by the cache simulator.  Every
+// instruction takes base_cpi cycles.  A data access served beyond the first-level
+// cache issues a miss which overlaps with later instructions until either the
+// reorder buffer of rob_size instructions fills behind it or mlp misses are
+// already outstanding.  An instruction fetch miss stalls the core for its whole
+// latency.  Memory requests share one channel transferring bytes_per_cycle
+// bytes per cycle, which is unlimited if zero.
+class timing_model_t
+{
+ public:
+    timing_model_t(unsigned int num_cores, double base_cpi, unsigned int rob_size,
+                   unsigned int mlp, double bytes_per_cycle, unsigned int line_size);
+
+    // Accounts for an instruction executed on core by thread tid, where the
+    // fetch took stall cycles beyond a first-level hit.
+    void instruction(int core, memref_tid_t tid, double stall, bool from_memory);
+    // Accounts for a data access which took stall cycles beyond a first-level hit.
+    void data_access(int core, memref_tid_t tid, double stall, bool from_memory);
+
+    // Discards the cycles counted so far, when warmup completes.
+    void reset();
+
+    void print_results();
+
+ private:
+    struct miss_t {
+        uint64_t instr; // The number of instructions issued before the miss.
+        double done;
+    };
+    struct core_t {
+        core_t() : now(0), instrs(0), tid(0) {}
+        double now;
+        uint64_t instrs;
+        memref_tid_t tid; // The last thread to run.
+        std::vector<miss_t> outstanding;
+    };
+    struct thread_t {
+        thread_t() : instrs(0), cycles(0) {}
+        uint64_t instrs;
+        double cycles;
+    };
+
+    // Advances the core's clock to time, charging its current thread.
+    void advance(core_t &core, double time);
+    // Returns when a miss issued at issue with latency stall completes.
+    double complete(double issue, double stall, bool from_memory);
+
+    double base_cpi;
+    unsigned int rob_size;
+    unsigned int mlp;
+    // Cycles taken by a line on the memory channel, or zero.
+    double line_transfer;
+    double memory_free;
+    std::vector<core_t> cores;
+    std::unordered_map<memref_tid_t, thread_t> threads;
+};
+
+#endif /* _TIMING_MODEL_H_ */
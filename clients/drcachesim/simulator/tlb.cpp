@@ -34,12 +34,41 @@
 #include "../common/utils.h"
 #include <assert.h>
 
+tlb_t::tlb_t() : pids(NULL)
+{
+    /* Empty. */
+}
+
+tlb_t::~tlb_t()
+{
+    delete [] pids;
+}
+
 void
 tlb_t::init_blocks()
 {
-    for (int i = 0; i < num_blocks; i++) {
-        blocks[i] = new tlb_entry_t;
-    }
+    pids = new memref_pid_t[num_blocks];
+    for (int i = 0; i < num_blocks; i++)
+        pids[i] = 0;
+}
+
+bool
+tlb_t::save_state(std::ostream &out)
+{
+    if (!caching_device_t::save_state(out))
+        return false;
+    out.write((const char *)pids, sizeof(pids[0]) * num_blocks);
+    return out.good();
+}
+
+bool
+tlb_t::load_state(std::istream &in)
+{
+    if (!caching_device_t::load_state(in))
+        return false;
+    in.read((char *)pids, sizeof(pids[0]) * num_blocks);
+    last_pid = 0;
+    return in.good();
 }
 
 void
@@ -65,9 +94,8 @@ tlb_t::request(const memref_t &memref_in)
     if (tag == final_tag && tag == last_tag && pid == last_pid) {
         // Make sure last_tag and pid are properly in sync.
         assert(tag != TAG_INVALID &&
-               tag == get_caching_device_block(last_block_idx, last_way).tag &&
-               pid == ((tlb_entry_t &)get_caching_device_block(
-                       last_block_idx, last_way)).pid);
+               tag == get_block_tag(last_block_idx, last_way) &&
+               pid == get_block_pid(last_block_idx, last_way));
         stats->access(memref_in, true/*hit*/);
         if (parent != NULL)
             parent->get_stats()->child_access(memref_in, true);
@@ -84,8 +112,8 @@ tlb_t::request(const memref_t &memref_in)
             memref.data.size = ((tag + 1) << block_size_bits) - memref.data.addr;
 
         for (way = 0; way < associativity; ++way) {
-            if (get_caching_device_block(block_idx, way).tag == tag &&
-                ((tlb_entry_t &)get_caching_device_block(block_idx, way)).pid == pid) {
+            if (get_block_tag(block_idx, way) == tag &&
+                get_block_pid(block_idx, way) == pid) {
                 stats->access(memref, true/*hit*/);
                 if (parent != NULL)
                     parent->get_stats()->child_access(memref, true);
@@ -104,8 +132,8 @@ tlb_t::request(const memref_t &memref_in)
             // XXX: do we need to handle TLB coherency?
 
             way = replace_which_way(block_idx);
-            get_caching_device_block(block_idx, way).tag = tag;
-            ((tlb_entry_t &)get_caching_device_block(block_idx, way)).pid = pid;
+            get_block_tag(block_idx, way) = tag;
+            get_block_pid(block_idx, way) = pid;
         }
 
         access_update(block_idx, way);
@@ -37,16 +37,29 @@
 #define _TLB_H_ 1
 
 #include "caching_device.h"
-#include "tlb_entry.h"
 #include "tlb_stats.h"
 
 class tlb_t : public caching_device_t
 {
  public:
+    tlb_t();
+    virtual ~tlb_t();
     virtual void request(const memref_t &memref);
+    virtual bool save_state(std::ostream &out);
+    virtual bool load_state(std::istream &in);
  protected:
     virtual void init_blocks();
 
+    inline memref_pid_t& get_block_pid(int block_idx, int way) {
+        return pids[block_idx + way];
+    }
+
+    // The process ID of each entry, to differentiate virtual pages that have
+    // the same VPN but belong to different processes.  This is indexed like
+    // caching_device_t::tags.
+    // XXX: support page privilege and MMU-related exceptions
+    memref_pid_t *pids;
+
     // Optimization: remember last pid in addition to last tag
     memref_pid_t last_pid;
 };
@@ -30,8 +30,10 @@
  * DAMAGE.
  */
 
+#include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <sstream>
 #include <string>
 #include <assert.h>
 #include <limits.h>
@@ -54,62 +56,225 @@ tlb_simulator_t::tlb_simulator_t(const tlb_simulator_knobs_t &knobs_) :
     simulator_t(knobs_.num_cores, knobs_.skip_refs, knobs_.warmup_refs,
                 knobs_.warmup_fraction, knobs_.sim_refs,
                 knobs_.cpu_scheduling, knobs_.verbose),
-    knobs(knobs_)
+    knobs(knobs_), page_sizes(NULL), direct_walks(NULL)
 {
-    itlbs = new tlb_t* [knobs.num_cores];
-    dtlbs = new tlb_t* [knobs.num_cores];
-    lltlbs = new tlb_t* [knobs.num_cores];
+    for (int size = 0; size < PAGE_SIZE_COUNT; size++) {
+        itlbs[size] = new tlb_t* [knobs.num_cores];
+        dtlbs[size] = new tlb_t* [knobs.num_cores];
+        lltlbs[size] = new tlb_t* [knobs.num_cores];
+        for (unsigned int i = 0; i < knobs.num_cores; i++) {
+            itlbs[size][i] = NULL;
+            dtlbs[size][i] = NULL;
+            lltlbs[size][i] = NULL;
+        }
+    }
+    direct_walks = new int_least64_t[knobs.num_cores];
+    for (unsigned int i = 0; i < knobs.num_cores; i++)
+        direct_walks[i] = 0;
+
+    if (knobs.TLB_page_policy == TLB_PAGE_POLICY_THP) {
+        page_sizes = new page_size_map_t;
+        page_sizes->init_thp(knobs.TLB_thp_threshold);
+    } else if (knobs.TLB_page_policy == TLB_PAGE_POLICY_MAP) {
+        if (knobs.TLB_page_map.empty()) {
+            ERRMSG("Usage error: -TLB_page_policy " TLB_PAGE_POLICY_MAP
+                   " requires -TLB_page_map.\n");
+            success = false;
+            return;
+        }
+        page_sizes = new page_size_map_t;
+        std::string error;
+        if (!page_sizes->init_regions(knobs.TLB_page_map, &error)) {
+            ERRMSG("Usage error: failed to read -TLB_page_map: %s.\n", error.c_str());
+            success = false;
+            return;
+        }
+    } else if (knobs.TLB_page_policy != TLB_PAGE_POLICY_BASE) {
+        ERRMSG("Usage error: undefined page policy. Please choose "
+               TLB_PAGE_POLICY_BASE ", " TLB_PAGE_POLICY_THP ", or "
+               TLB_PAGE_POLICY_MAP ".\n");
+        success = false;
+        return;
+    }
+
     for (unsigned int i = 0; i < knobs.num_cores; i++) {
-        itlbs[i] = create_tlb(knobs.TLB_replace_policy);
-        if (itlbs[i] == NULL) {
+        if (!create_page_size_tlb((int)knobs.page_size, knobs.TLB_L2_entries,
+                                  knobs.TLB_L2_assoc, NULL,
+                                  &lltlbs[PAGE_SIZE_BASE][i]) ||
+            !create_page_size_tlb((int)knobs.page_size, knobs.TLB_L1I_entries,
+                                  knobs.TLB_L1I_assoc, lltlbs[PAGE_SIZE_BASE][i],
+                                  &itlbs[PAGE_SIZE_BASE][i]) ||
+            !create_page_size_tlb((int)knobs.page_size, knobs.TLB_L1D_entries,
+                                  knobs.TLB_L1D_assoc, lltlbs[PAGE_SIZE_BASE][i],
+                                  &dtlbs[PAGE_SIZE_BASE][i])) {
             success = false;
             return;
         }
-        dtlbs[i] = create_tlb(knobs.TLB_replace_policy);
-        if (dtlbs[i] == NULL) {
+        if (itlbs[PAGE_SIZE_BASE][i] == NULL || dtlbs[PAGE_SIZE_BASE][i] == NULL ||
+            lltlbs[PAGE_SIZE_BASE][i] == NULL) {
+            ERRMSG("Usage error: the base page size TLBs must have entries.\n");
             success = false;
             return;
         }
-        lltlbs[i] = create_tlb(knobs.TLB_replace_policy);
-        if (lltlbs[i] == NULL) {
+        if (page_sizes == NULL)
+            continue;
+        if (!create_page_size_tlb((int)page_size_map_t::SIZE_2M,
+                                  knobs.TLB_L2_2M_entries, knobs.TLB_L2_2M_assoc,
+                                  NULL, &lltlbs[PAGE_SIZE_2M][i]) ||
+            !create_page_size_tlb((int)page_size_map_t::SIZE_2M,
+                                  knobs.TLB_L1I_2M_entries, knobs.TLB_L1I_2M_assoc,
+                                  lltlbs[PAGE_SIZE_2M][i], &itlbs[PAGE_SIZE_2M][i]) ||
+            !create_page_size_tlb((int)page_size_map_t::SIZE_2M,
+                                  knobs.TLB_L1D_2M_entries, knobs.TLB_L1D_2M_assoc,
+                                  lltlbs[PAGE_SIZE_2M][i], &dtlbs[PAGE_SIZE_2M][i]) ||
+            !create_page_size_tlb((int)page_size_map_t::SIZE_1G,
+                                  knobs.TLB_L2_1G_entries, knobs.TLB_L2_1G_assoc,
+                                  NULL, &lltlbs[PAGE_SIZE_1G][i]) ||
+            !create_page_size_tlb((int)page_size_map_t::SIZE_1G,
+                                  knobs.TLB_L1I_1G_entries, knobs.TLB_L1I_1G_assoc,
+                                  lltlbs[PAGE_SIZE_1G][i], &itlbs[PAGE_SIZE_1G][i]) ||
+            !create_page_size_tlb((int)page_size_map_t::SIZE_1G,
+                                  knobs.TLB_L1D_1G_entries, knobs.TLB_L1D_1G_assoc,
+                                  lltlbs[PAGE_SIZE_1G][i], &dtlbs[PAGE_SIZE_1G][i])) {
             success = false;
             return;
         }
+    }
 
-        if (!itlbs[i]->init(knobs.TLB_L1I_assoc, (int)knobs.page_size,
-                            knobs.TLB_L1I_entries, lltlbs[i], new tlb_stats_t) ||
-            !dtlbs[i]->init(knobs.TLB_L1D_assoc, (int)knobs.page_size,
-                            knobs.TLB_L1D_entries, lltlbs[i], new tlb_stats_t) ||
-            !lltlbs[i]->init(knobs.TLB_L2_assoc, (int)knobs.page_size,
-                             knobs.TLB_L2_entries, NULL, new tlb_stats_t)) {
-            ERRMSG("Usage error: failed to initialize TLBs. Ensure entry number, "
-                   "page size and associativity are powers of 2.\n");
+    if (!knobs.warmup_save_file.empty() && knobs.warmup_refs == 0) {
+        ERRMSG("Usage error: -warmup_save_file requires -warmup_refs.\n");
+        success = false;
+        return;
+    }
+    if (!knobs.regions_file.empty()) {
+        if (knobs.warmup_refs > 0 || !knobs.warmup_load_file.empty() ||
+            knobs.skip_refs > 0) {
+            ERRMSG("Usage error: -regions_file replaces -skip_refs, -warmup_refs, "
+                   "and -warmup_load_file.\n");
+            success = false;
+            return;
+        }
+        if (!load_regions(knobs.regions_file, knobs.regions_warmup,
+                          warmup_devices())) {
+            ERRMSG("Usage error: failed to read the regions from %s.  Ensure it was "
+                   "written by the regions tool.\n", knobs.regions_file.c_str());
+            success = false;
+            return;
+        }
+    }
+    if (!knobs.stats_file.empty() &&
+        !open_stats_file(knobs.stats_file, knobs.stats_interval, warmup_devices(),
+                         warmup_device_names())) {
+        ERRMSG("Usage error: failed to open -stats_file %s.  Ensure it is writable "
+               "and that -stats_interval is positive.\n", knobs.stats_file.c_str());
+        success = false;
+        return;
+    }
+    if (!knobs.warmup_load_file.empty()) {
+        if (knobs.warmup_refs > 0) {
+            ERRMSG("Usage error: -warmup_load_file replaces -warmup_refs.\n");
+            success = false;
+            return;
+        }
+        if (!load_warmup_state(knobs.warmup_load_file, warmup_config(),
+                               warmup_devices())) {
+            ERRMSG("Usage error: failed to load warmup state from %s.  Ensure it was "
+                   "saved with the same TLB configuration.\n",
+                   knobs.warmup_load_file.c_str());
             success = false;
             return;
         }
     }
 }
 
-tlb_simulator_t::~tlb_simulator_t()
+bool
+tlb_simulator_t::create_page_size_tlb(int page_size, unsigned int entries,
+                                      unsigned int assoc, tlb_t *parent, tlb_t **tlb)
+{
+    if (entries == 0)
+        return true;
+    *tlb = create_tlb(knobs.TLB_replace_policy);
+    if (*tlb == NULL)
+        return false;
+    if (!(*tlb)->init(assoc, page_size, entries, parent, new tlb_stats_t)) {
+        ERRMSG("Usage error: failed to initialize TLBs. Ensure entry number, "
+               "page size and associativity are powers of 2.\n");
+        return false;
+    }
+    return true;
+}
+
+std::string
+tlb_simulator_t::warmup_config() const
+{
+    std::ostringstream config;
+    config << "tlb " << knobs.num_cores << " " << knobs.TLB_replace_policy;
+    if (page_sizes != NULL) {
+        // The huge page arrays are saved too, so their shape must match.
+        config << " " << knobs.TLB_page_policy << " " << knobs.TLB_L1I_2M_entries
+               << " " << knobs.TLB_L1D_2M_entries << " " << knobs.TLB_L2_2M_entries
+               << " " << knobs.TLB_L1I_1G_entries << " " << knobs.TLB_L1D_1G_entries
+               << " " << knobs.TLB_L2_1G_entries;
+    }
+    return config.str();
+}
+
+std::vector<caching_device_t *>
+tlb_simulator_t::warmup_devices() const
 {
+    std::vector<caching_device_t *> devices;
     for (unsigned int i = 0; i < knobs.num_cores; i++) {
-        // Try to handle failure during construction.
-        if (itlbs[i] == NULL)
-            return;
-        delete itlbs[i]->get_stats();
-        delete itlbs[i];
-        if (dtlbs[i] == NULL)
-            return;
-        delete dtlbs[i]->get_stats();
-        delete dtlbs[i];
-        if (lltlbs[i] == NULL)
-            return;
-        delete lltlbs[i]->get_stats();
-        delete lltlbs[i];
+        for (int size = 0; size < PAGE_SIZE_COUNT; size++) {
+            if (itlbs[size][i] != NULL)
+                devices.push_back(itlbs[size][i]);
+            if (dtlbs[size][i] != NULL)
+                devices.push_back(dtlbs[size][i]);
+            if (lltlbs[size][i] != NULL)
+                devices.push_back(lltlbs[size][i]);
+        }
+    }
+    return devices;
+}
+
+std::vector<std::string>
+tlb_simulator_t::warmup_device_names() const
+{
+    const int sizes[PAGE_SIZE_COUNT] = {(int)knobs.page_size,
+                                        (int)page_size_map_t::SIZE_2M,
+                                        (int)page_size_map_t::SIZE_1G};
+    std::vector<std::string> names;
+    for (unsigned int i = 0; i < knobs.num_cores; i++) {
+        for (int size = 0; size < PAGE_SIZE_COUNT; size++) {
+            std::string prefix = "Core #" + std::to_string(i) + " ";
+            std::string suffix =
+                (page_sizes == NULL) ? "" : " " + page_size_name(sizes[size]);
+            if (itlbs[size][i] != NULL)
+                names.push_back(prefix + "L1I" + suffix);
+            if (dtlbs[size][i] != NULL)
+                names.push_back(prefix + "L1D" + suffix);
+            if (lltlbs[size][i] != NULL)
+                names.push_back(prefix + "LL" + suffix);
+        }
     }
-    delete [] itlbs;
-    delete [] dtlbs;
-    delete [] lltlbs;
+    return names;
+}
+
+tlb_simulator_t::~tlb_simulator_t()
+{
+    for (int size = 0; size < PAGE_SIZE_COUNT; size++) {
+        tlb_t **levels[] = {itlbs[size], dtlbs[size], lltlbs[size]};
+        for (tlb_t **tlbs : levels) {
+            for (unsigned int i = 0; i < knobs.num_cores; i++) {
+                if (tlbs[i] == NULL)
+                    continue;
+                delete tlbs[i]->get_stats();
+                delete tlbs[i];
+            }
+            delete [] tlbs;
+        }
+    }
+    delete [] direct_walks;
+    delete page_sizes;
 }
 
 bool
@@ -120,6 +285,11 @@ tlb_simulator_t::process_memref(const memref_t &memref)
         return true;
     }
 
+    // The references outside of the -regions_file regions and their warmup are
+    // dropped.
+    if (!regions.empty() && !in_region(memref))
+        return true;
+
     // The references after warmup and simulated ones are dropped.
     if (knobs.warmup_refs == 0 && knobs.sim_refs == 0)
         return true;
@@ -146,12 +316,12 @@ tlb_simulator_t::process_memref(const memref_t &memref)
         last_core = core;
     }
 
-    if (type_is_instr(memref.instr.type))
-        itlbs[core]->request(memref);
-    else if (memref.data.type == TRACE_TYPE_READ ||
-             memref.data.type == TRACE_TYPE_WRITE)
-        dtlbs[core]->request(memref);
-    else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
+    if (type_is_instr(memref.instr.type)) {
+        request(itlbs, core, memref, memref.instr.addr, true);
+    } else if (memref.data.type == TRACE_TYPE_READ ||
+               memref.data.type == TRACE_TYPE_WRITE) {
+        request(dtlbs, core, memref, memref.data.addr, false);
+    } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
         handle_thread_exit(memref.exit.tid);
         last_thread = 0;
     }
@@ -178,15 +348,23 @@ tlb_simulator_t::process_memref(const memref_t &memref)
         knobs.warmup_refs--;
         // reset tlb stats when warming up is completed
         if (knobs.warmup_refs == 0) {
-            for (unsigned int i = 0; i < knobs.num_cores; i++) {
-                itlbs[i]->get_stats()->reset();
-                dtlbs[i]->get_stats()->reset();
-                lltlbs[i]->get_stats()->reset();
+            if (!knobs.warmup_save_file.empty() &&
+                !save_warmup_state(knobs.warmup_save_file, warmup_config(),
+                                   warmup_devices())) {
+                ERRMSG("Failed to save warmup state to %s.\n",
+                       knobs.warmup_save_file.c_str());
+                return false;
             }
+            std::vector<caching_device_t *> devices = warmup_devices();
+            for (caching_device_t *device : devices)
+                device->get_stats()->reset();
+            for (unsigned int i = 0; i < knobs.num_cores; i++)
+                direct_walks[i] = 0;
         }
     }
     else {
         knobs.sim_refs--;
+        count_stats_ref();
     }
     return true;
 }
@@ -194,21 +372,88 @@ tlb_simulator_t::process_memref(const memref_t &memref)
 bool
 tlb_simulator_t::print_results()
 {
+    finish_stats();
     std::cerr << "TLB simulation results:\n";
     for (unsigned int i = 0; i < knobs.num_cores; i++) {
         print_core(i);
-        if (thread_ever_counts[i] > 0) {
+        if (thread_ever_counts[i] == 0)
+            continue;
+        if (page_sizes == NULL) {
             std::cerr << "  L1I stats:" << std::endl;
-            itlbs[i]->get_stats()->print_stats("    ");
+            itlbs[PAGE_SIZE_BASE][i]->get_stats()->print_stats("    ");
             std::cerr << "  L1D stats:" << std::endl;
-            dtlbs[i]->get_stats()->print_stats("    ");
+            dtlbs[PAGE_SIZE_BASE][i]->get_stats()->print_stats("    ");
             std::cerr << "  LL stats:" << std::endl;
-            lltlbs[i]->get_stats()->print_stats("    ");
+            lltlbs[PAGE_SIZE_BASE][i]->get_stats()->print_stats("    ");
+            continue;
+        }
+        const int sizes[PAGE_SIZE_COUNT] = {(int)knobs.page_size,
+                                            (int)page_size_map_t::SIZE_2M,
+                                            (int)page_size_map_t::SIZE_1G};
+        int_least64_t walks = direct_walks[i];
+        for (int size = 0; size < PAGE_SIZE_COUNT; size++) {
+            print_tlb("L1I", sizes[size], itlbs[size][i]);
+            print_tlb("L1D", sizes[size], dtlbs[size][i]);
+            print_tlb("LL", sizes[size], lltlbs[size][i]);
+            // Every miss in the last level present for a size walks the page
+            // table.
+            if (lltlbs[size][i] != NULL)
+                walks += lltlbs[size][i]->get_stats()->get_misses();
+            else {
+                if (itlbs[size][i] != NULL)
+                    walks += itlbs[size][i]->get_stats()->get_misses();
+                if (dtlbs[size][i] != NULL)
+                    walks += dtlbs[size][i]->get_stats()->get_misses();
+            }
         }
+        std::cerr << "  " << std::setw(20) << std::left << "Page walks:" <<
+            std::setw(20) << std::right << walks << std::endl;
     }
+    if (!regions.empty())
+        print_region_results(warmup_device_names());
     return true;
 }
 
+std::string
+tlb_simulator_t::page_size_name(int page_size)
+{
+    std::ostringstream name;
+    if (page_size >= (int)page_size_map_t::SIZE_1G)
+        name << page_size / page_size_map_t::SIZE_1G << "G";
+    else if (page_size >= 1024 * 1024)
+        name << page_size / (1024 * 1024) << "M";
+    else if (page_size >= 1024)
+        name << page_size / 1024 << "K";
+    else
+        name << page_size << "B";
+    return name.str();
+}
+
+void
+tlb_simulator_t::print_tlb(const char *name, int page_size, tlb_t *tlb)
+{
+    if (tlb == NULL)
+        return;
+    std::cerr << "  " << name << " " << page_size_name(page_size) << " stats:"
+              << std::endl;
+    tlb->get_stats()->print_stats("    ");
+}
+
+void
+tlb_simulator_t::request(tlb_t ***tlbs, int core, const memref_t &memref, addr_t addr,
+                         bool is_instr)
+{
+    int size = PAGE_SIZE_BASE;
+    if (page_sizes != NULL)
+        size = page_sizes->get_page_size(addr, is_instr);
+    if (tlbs[size][core] != NULL)
+        tlbs[size][core]->request(memref);
+    else if (lltlbs[size][core] != NULL)
+        lltlbs[size][core]->request(memref);
+    else
+        ++direct_walks[core];
+}
+
 tlb_t*
 tlb_simulator_t::create_tlb(std::string policy)
 {
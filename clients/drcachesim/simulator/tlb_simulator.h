@@ -36,7 +36,10 @@
 #ifndef _TLB_SIMULATOR_H_
 #define _TLB_SIMULATOR_H_ 1
 
+#include <string>
 #include <unordered_map>
+#include <vector>
+#include "page_size_map.h"
 #include "simulator.h"
 #include "tlb_simulator_create.h"
 #include "tlb_stats.h"
@@ -53,14 +56,36 @@ class tlb_simulator_t : public simulator_t
  protected:
     // Create a tlb_t object with a specific replacement policy.
     virtual tlb_t *create_tlb(std::string policy);
+    // The configuration string and devices for knobs.warmup_save_file and
+    // knobs.warmup_load_file.
+    std::string warmup_config() const;
+    std::vector<caching_device_t *> warmup_devices() const;
+    // Names for the devices of warmup_devices(), in the same order.
+    std::vector<std::string> warmup_device_names() const;
+
+    // Creates the TLB for one page size and level on one core, or sets *tlb to
+    // NULL if it has no entries.
+    // Sends a reference to the first level present for its page size.
+    void request(tlb_t ***tlbs, int core, const memref_t &memref, addr_t addr,
+                 bool is_instr);
+    bool create_page_size_tlb(int page_size, unsigned int entries, unsigned int assoc,
+                              tlb_t *parent, tlb_t **tlb);
+    void print_tlb(const char *name, int page_size, tlb_t *tlb);
+    static std::string page_size_name(int page_size);
 
     tlb_simulator_knobs_t knobs;
 
     // Each CPU core contains a L1 ITLB, L1 DTLB and L2 TLB.
-    // All of them are private to the core.
-    tlb_t **itlbs;
-    tlb_t **dtlbs;
-    tlb_t **lltlbs;
+    // All of them are private to the core.  With huge pages each holds a
+    // separate entry array per page size, indexed by page_size_index_t, any of
+    // which but those for the base size may be NULL.
+    tlb_t **itlbs[PAGE_SIZE_COUNT];
+    tlb_t **dtlbs[PAGE_SIZE_COUNT];
+    tlb_t **lltlbs[PAGE_SIZE_COUNT];
+    // NULL unless huge pages are modeled.
+    page_size_map_t *page_sizes;
+    // Per core, the lookups for page sizes with no entry array at any level.
+    int_least64_t *direct_walks;
 };
 
 #endif /* _TLB_SIMULATOR_H_ */
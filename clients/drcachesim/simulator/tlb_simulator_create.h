@@ -59,11 +59,32 @@ struct tlb_simulator_knobs_t {
         TLB_L2_entries(1024),
         TLB_L2_assoc(4),
         TLB_replace_policy("LFU"),
+        TLB_page_policy("base"),
+        TLB_page_map(""),
+        TLB_thp_threshold(1),
+        TLB_L1I_2M_entries(8),
+        TLB_L1I_2M_assoc(8),
+        TLB_L1D_2M_entries(32),
+        TLB_L1D_2M_assoc(4),
+        TLB_L2_2M_entries(1024),
+        TLB_L2_2M_assoc(4),
+        TLB_L1I_1G_entries(0),
+        TLB_L1I_1G_assoc(0),
+        TLB_L1D_1G_entries(4),
+        TLB_L1D_1G_assoc(4),
+        TLB_L2_1G_entries(16),
+        TLB_L2_1G_assoc(4),
         skip_refs(0),
         warmup_refs(0),
         warmup_fraction(0.0),
         sim_refs(1ULL << 63),
         cpu_scheduling(false),
+        warmup_save_file(""),
+        warmup_load_file(""),
+        regions_file(""),
+        regions_warmup(1000000),
+        stats_file(""),
+        stats_interval(10000000),
         verbose(0) {}
     unsigned int num_cores;
     uint64_t page_size;
@@ -74,11 +95,38 @@ struct tlb_simulator_knobs_t {
     unsigned int TLB_L2_entries;
     unsigned int TLB_L2_assoc;
     std::string TLB_replace_policy;
+    std::string TLB_page_policy;
+    std::string TLB_page_map;
+    unsigned int TLB_thp_threshold;
+    // The entry arrays for huge pages.  An array with no entries is absent, and
+    // lookups for its page size go straight to the next level.
+    unsigned int TLB_L1I_2M_entries;
+    unsigned int TLB_L1I_2M_assoc;
+    unsigned int TLB_L1D_2M_entries;
+    unsigned int TLB_L1D_2M_assoc;
+    unsigned int TLB_L2_2M_entries;
+    unsigned int TLB_L2_2M_assoc;
+    unsigned int TLB_L1I_1G_entries;
+    unsigned int TLB_L1I_1G_assoc;
+    unsigned int TLB_L1D_1G_entries;
+    unsigned int TLB_L1D_1G_assoc;
+    unsigned int TLB_L2_1G_entries;
+    unsigned int TLB_L2_1G_assoc;
     uint64_t skip_refs;
     uint64_t warmup_refs;
     double warmup_fraction;
     uint64_t sim_refs;
     bool cpu_scheduling;
+    std::string warmup_save_file;
+    std::string warmup_load_file;
+    // If non-empty, a file written by the regions tool: only its regions and the
+    // regions_warmup instructions before each are simulated.
+    std::string regions_file;
+    uint64_t regions_warmup;
+    // If non-empty, a CSV file to which the hit and miss counts of every cache
+    // or TLB are written after every stats_interval simulated references.
+    std::string stats_file;
+    uint64_t stats_interval;
     unsigned int verbose;
 };
 
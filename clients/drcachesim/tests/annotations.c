@@ -0,0 +1,64 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Test of -trace_annotations: only the regions between the annotations are traced. */
+
+#include "drmemtrace_annotations.h"
+#include <stdio.h>
+
+#define NUM_ITERS 100000
+
+static volatile int sink;
+
+static void
+do_some_work(int iters)
+{
+    int i;
+    for (i = 0; i < iters; i++)
+        sink += i;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    do_some_work(NUM_ITERS);
+    DRMEMTRACE_ANNOTATE_START_TRACING();
+    do_some_work(NUM_ITERS / 100);
+    DRMEMTRACE_ANNOTATE_STOP_TRACING();
+    do_some_work(NUM_ITERS);
+    DRMEMTRACE_ANNOTATE_START_TRACING();
+    do_some_work(NUM_ITERS / 100);
+    DRMEMTRACE_ANNOTATE_STOP_TRACING();
+    do_some_work(NUM_ITERS);
+    printf("All done\n");
+    return 0;
+}
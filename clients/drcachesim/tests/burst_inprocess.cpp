@@ -0,0 +1,114 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* This application links in drmemtrace_static along with drmemtrace_inprocess and
+ * analyzes its trace of a "burst" of execution without writing any files.
+ */
+
+/* We deliberately do not include configure.h here to simulate what an
+ * actual app will look like.  configure_DynamoRIO_static sets DR_APP_EXPORTS
+ * for us.
+ */
+#include "dr_api.h"
+#include "inprocess_analyzer.h"
+#include "tools/basic_counts_create.h"
+#include <assert.h>
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+
+bool
+my_setenv(const char *var, const char *value)
+{
+#ifdef UNIX
+    return setenv(var, value, 1/*override*/) == 0;
+#else
+    return SetEnvironmentVariable(var, value) == TRUE;
+#endif
+}
+
+static int
+do_some_work(int arg)
+{
+    static int iters = 512;
+    double val = (double)arg;
+    for (int i = 0; i < iters; ++i) {
+        val += sin(val);
+    }
+    return (val > 0);
+}
+
+int
+main(int argc, const char *argv[])
+{
+    static int outer_iters = 2048;
+    /* We trace a 4-iter burst of execution. */
+    static int iter_start = outer_iters/3;
+    static int iter_stop = iter_start + 4;
+
+    if (!my_setenv("DYNAMORIO_OPTIONS", "-stderr_mask 0xc -client_lib ';;-offline'"))
+        std::cerr << "failed to set env var!\n";
+
+    analysis_tool_t *tool = basic_counts_tool_create();
+    inprocess_analyzer_t *analyzer = new inprocess_analyzer_t(&tool, 1);
+    assert(!!*analyzer);
+
+    std::cerr << "pre-DR init\n";
+    dr_app_setup();
+    assert(!dr_app_running_under_dynamorio());
+
+    for (int i = 0; i < outer_iters; ++i) {
+        if (i == iter_start) {
+            std::cerr << "pre-DR start\n";
+            dr_app_start();
+        }
+        if (i >= iter_start && i <= iter_stop)
+            assert(dr_app_running_under_dynamorio());
+        else
+            assert(!dr_app_running_under_dynamorio());
+        if (do_some_work(i) < 0)
+            std::cerr << "error in computation\n";
+        if (i == iter_stop) {
+            std::cerr << "pre-DR detach\n";
+            dr_app_stop_and_cleanup();
+        }
+    }
+    std::cerr << "all done\n";
+
+    // The tracer exit already converted and analyzed the trace.
+    if (!analyzer->run())
+        std::cerr << "analysis failed: " << analyzer->get_error_string() << "\n";
+    analyzer->print_stats();
+    delete analyzer;
+    delete tool;
+    return 0;
+}
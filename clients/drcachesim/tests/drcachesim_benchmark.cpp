@@ -0,0 +1,449 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+// Throughput benchmark for the drcachesim trace readers and analysis tools.
+//
+// A synthetic trace of the requested size and access pattern is generated and
+// then read by each reader and fed, in the batches the analyzer uses, to each
+// tool.  For every reader and tool combination we report the memrefs processed
+// per second and, on UNIX where each combination runs in its own process, the
+// peak resident set size.  The "none" tool measures a reader alone.
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifdef UNIX
+# include <sys/resource.h>
+# include <sys/wait.h>
+# include <unistd.h>
+#endif
+#include "analysis_tool.h"
+#include "reader/file_reader.h"
+#include "reader/mmap_file_reader.h"
+#ifdef HAS_ZLIB
+# include "reader/compressed_file_reader.h"
+# include <zlib.h>
+#endif
+#include "simulator/cache_simulator_create.h"
+#include "simulator/tlb_simulator_create.h"
+#include "tools/basic_counts_create.h"
+#include "tools/histogram_create.h"
+#include "tools/reuse_distance_create.h"
+#include "tools/reuse_time_create.h"
+#include "../common/memref.h"
+#include "../common/trace_entry.h"
+#include "../common/utils.h"
+
+struct bench_options_t {
+    bench_options_t() : refs(10*1000*1000), pattern("mixed"), threads(4),
+                        working_set(64*1024*1024), reader(""), tool("") {}
+    uint64_t refs;
+    std::string pattern;
+    unsigned int threads;
+    uint64_t working_set;
+    // Restrict the runs to one reader or tool when non-empty.
+    std::string reader;
+    std::string tool;
+};
+
+struct bench_result_t {
+    uint64_t refs;
+    double seconds;
+};
+
+static const char *const readers[] = {
+    "file", "mmap",
+#ifdef HAS_ZLIB
+    "gzip",
+#endif
+};
+static const char *const tools[] = {
+    "none", "basic_counts", "histogram", "reuse_time", "reuse_distance", "cache",
+    "TLB",
+};
+
+// As in analyzer_t.
+static const size_t BATCH_SIZE = 4096;
+
+static void
+usage(const char *name)
+{
+    std::cerr << "Usage: " << name << " [-refs <count>] [-pattern "
+              << "seq|stride|random|mixed] [-threads <count>] "
+              << "[-working_set <bytes>] [-reader <name>] [-tool <name>]\n";
+    exit(1);
+}
+
+static bool
+parse_args(int argc, const char *argv[], bench_options_t *ops)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+            return false;
+        const char *val = argv[++i];
+        if (arg == "-refs")
+            ops->refs = strtoull(val, NULL, 0);
+        else if (arg == "-pattern")
+            ops->pattern = val;
+        else if (arg == "-threads")
+            ops->threads = (unsigned int)strtoul(val, NULL, 0);
+        else if (arg == "-working_set")
+            ops->working_set = strtoull(val, NULL, 0);
+        else if (arg == "-reader")
+            ops->reader = val;
+        else if (arg == "-tool")
+            ops->tool = val;
+        else
+            return false;
+    }
+    return ops->refs > 0 && ops->threads > 0 && ops->working_set >= 64 &&
+        (ops->pattern == "seq" || ops->pattern == "stride" ||
+         ops->pattern == "random" || ops->pattern == "mixed");
+}
+
+// Produces the trace in pieces so that generating a large one needs little
+// memory of its own.  Each thread runs a quantum of 1000 memrefs at a time,
+// with every instruction fetch followed by a data reference from the pattern
+// half of the time.
+class trace_generator_t
+{
+ public:
+    explicit trace_generator_t(const bench_options_t &ops) :
+        ops(ops), seed(1), emitted(0), cur_thread(0), quantum_left(0),
+        finished(false), started(ops.threads, false), pcs(ops.threads, 0), addrs(ops.threads, 0)
+    {
+        add(TRACE_TYPE_HEADER, 0, TRACE_ENTRY_VERSION);
+    }
+    // Returns false once the whole trace has been produced.
+    bool next_piece(std::vector<trace_entry_t> *piece)
+    {
+        piece->clear();
+        if (entries.empty() && emitted >= ops.refs)
+            return false;
+        while (entries.size() < 64*1024 && emitted < ops.refs)
+            add_memref();
+        if (emitted >= ops.refs && !finished) {
+            for (unsigned int i = 0; i < ops.threads; i++) {
+                if (!started[i])
+                    continue;
+                add(TRACE_TYPE_THREAD_EXIT, 0, tid(i));
+            }
+            add(TRACE_TYPE_FOOTER, 0, 0);
+            finished = true;
+        }
+        piece->swap(entries);
+        return true;
+    }
+
+ private:
+    memref_tid_t tid(unsigned int thread) { return (memref_tid_t)(1000 + thread); }
+    void add(unsigned short type, unsigned short size, addr_t addr)
+    {
+        trace_entry_t entry;
+        entry.type = type;
+        entry.size = size;
+        entry.addr = addr;
+        entries.push_back(entry);
+    }
+    uint64_t next_rand()
+    {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        return seed >> 16;
+    }
+    addr_t next_data_addr(unsigned int thread)
+    {
+        const addr_t base = 0x10000000 + (addr_t)thread * ops.working_set;
+        std::string pattern = ops.pattern;
+        if (pattern == "mixed") {
+            uint64_t pick = next_rand() % 10;
+            pattern = pick < 5 ? "seq" : (pick < 8 ? "stride" : "random");
+        }
+        if (pattern == "seq")
+            addrs[thread] += 8;
+        else if (pattern == "stride")
+            addrs[thread] += 4096 + 64;
+        else
+            addrs[thread] = next_rand();
+        addrs[thread] %= ops.working_set;
+        return base + (addrs[thread] & ~(addr_t)7);
+    }
+    void add_memref()
+    {
+        if (quantum_left == 0) {
+            cur_thread = (unsigned int)(next_rand() % ops.threads);
+            add(TRACE_TYPE_THREAD, 0, tid(cur_thread));
+            if (!started[cur_thread]) {
+                add(TRACE_TYPE_PID, 0, 1);
+                started[cur_thread] = true;
+            }
+            add(TRACE_TYPE_MARKER, TRACE_MARKER_TYPE_TIMESTAMP, (addr_t)emitted + 1);
+            quantum_left = 1000;
+        }
+        // Code loops over a 64K region.
+        pcs[cur_thread] = (pcs[cur_thread] + 4) % (64*1024);
+        add(TRACE_TYPE_INSTR, 4, 0x400000 + pcs[cur_thread]);
+        ++emitted;
+        --quantum_left;
+        if (emitted < ops.refs && quantum_left > 0 && next_rand() % 2 == 0) {
+            add(next_rand() % 3 == 0 ? TRACE_TYPE_WRITE : TRACE_TYPE_READ, 8,
+                next_data_addr(cur_thread));
+            ++emitted;
+            --quantum_left;
+        }
+    }
+
+    const bench_options_t &ops;
+    uint64_t seed;
+    uint64_t emitted;
+    unsigned int cur_thread;
+    unsigned int quantum_left;
+    bool finished;
+    std::vector<bool> started;
+    std::vector<addr_t> pcs;
+    std::vector<addr_t> addrs;
+    std::vector<trace_entry_t> entries;
+};
+
+static bool
+generate_traces(const bench_options_t &ops, const std::string &path,
+                const std::string &gz_path)
+{
+    std::ofstream out(path.c_str(), std::ofstream::binary);
+    if (!out)
+        return false;
+#ifdef HAS_ZLIB
+    gzFile gz = gzopen(gz_path.c_str(), "wb");
+    if (gz == NULL)
+        return false;
+#endif
+    trace_generator_t gen(ops);
+    std::vector<trace_entry_t> piece;
+    while (gen.next_piece(&piece)) {
+        size_t size = piece.size() * sizeof(piece[0]);
+        if (!out.write((const char *)&piece[0], size))
+            return false;
+#ifdef HAS_ZLIB
+        if (gzwrite(gz, &piece[0], (unsigned int)size) != (int)size)
+            return false;
+#endif
+    }
+#ifdef HAS_ZLIB
+    if (gzclose(gz) != Z_OK)
+        return false;
+#endif
+    return true;
+}
+
+static reader_t *
+create_reader(const std::string &name, const std::string &path,
+              const std::string &gz_path)
+{
+    if (name == "file")
+        return new file_reader_t(path.c_str());
+    if (name == "mmap")
+        return new mmap_file_reader_t(path.c_str());
+#ifdef HAS_ZLIB
+    if (name == "gzip")
+        return new compressed_file_reader_t(gz_path.c_str());
+#endif
+    return NULL;
+}
+
+static analysis_tool_t *
+create_tool(const std::string &name)
+{
+    if (name == "basic_counts")
+        return basic_counts_tool_create();
+    if (name == "histogram")
+        return histogram_tool_create();
+    if (name == "reuse_time")
+        return reuse_time_tool_create();
+    if (name == "reuse_distance") {
+        reuse_distance_knobs_t knobs;
+        return reuse_distance_tool_create(knobs);
+    }
+    if (name == "cache") {
+        cache_simulator_knobs_t knobs;
+        return cache_simulator_create(knobs);
+    }
+    if (name == "TLB") {
+        tlb_simulator_knobs_t knobs;
+        return tlb_simulator_create(knobs);
+    }
+    return NULL;
+}
+
+// Reads the whole trace with the reader, handing it to the tool unless the
+// tool is "none".  The time includes the tool's print_results(), whose output
+// we discard, as some tools defer work to it.
+static bool
+run_one(const std::string &reader_name, const std::string &tool_name,
+        const std::string &path, const std::string &gz_path, bench_result_t *result)
+{
+    reader_t *reader = create_reader(reader_name, path, gz_path);
+    mmap_file_reader_t end;
+    analysis_tool_t *tool = NULL;
+    if (tool_name != "none") {
+        tool = create_tool(tool_name);
+        if (tool == NULL || !*tool)
+            return false;
+    }
+    auto start = std::chrono::steady_clock::now();
+    if (reader == NULL || !reader->init())
+        return false;
+    std::vector<memref_t> batch;
+    batch.reserve(BATCH_SIZE);
+    uint64_t refs = 0;
+    bool res = true;
+    while (*reader != end) {
+        batch.clear();
+        for (; batch.size() < BATCH_SIZE && *reader != end; ++(*reader))
+            batch.push_back(**reader);
+        refs += batch.size();
+        if (tool != NULL)
+            res = tool->process_memrefs(&batch[0], batch.size()) && res;
+    }
+    if (tool != NULL) {
+        std::stringstream discard;
+        std::streambuf *old = std::cerr.rdbuf(discard.rdbuf());
+        res = tool->print_results() && res;
+        std::cerr.rdbuf(old);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result->refs = refs;
+    result->seconds = elapsed.count();
+    delete tool;
+    delete reader;
+    return res;
+}
+
+static void
+print_row(const std::string &reader_name, const std::string &tool_name,
+          const bench_result_t &result, double peak_mb)
+{
+    std::cout << std::left << std::setw(8) << reader_name << std::setw(16) <<
+        tool_name << std::right << std::setw(14) << result.refs << std::setw(10) <<
+        std::fixed << std::setprecision(3) << result.seconds << std::setw(12) <<
+        std::setprecision(2) << (result.seconds > 0 ?
+                                 result.refs / result.seconds / 1000000. : 0.);
+    if (peak_mb >= 0)
+        std::cout << std::setw(12) << std::setprecision(1) << peak_mb;
+    else
+        std::cout << std::setw(12) << "-";
+    std::cout << std::endl;
+}
+
+// Runs one combination, in a child process on UNIX so that its peak RSS is its
+// own.  Returns false on failure.
+static bool
+run_and_report(const std::string &reader_name, const std::string &tool_name,
+               const std::string &path, const std::string &gz_path)
+{
+    bench_result_t result;
+#ifdef UNIX
+    int fds[2];
+    if (pipe(fds) != 0)
+        return false;
+    pid_t child = fork();
+    if (child < 0)
+        return false;
+    if (child == 0) {
+        close(fds[0]);
+        bool ok = run_one(reader_name, tool_name, path, gz_path, &result);
+        ok = ok && write(fds[1], &result, sizeof(result)) == sizeof(result);
+        _exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    bool ok = read(fds[0], &result, sizeof(result)) == sizeof(result);
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    if (wait4(child, &status, 0, &usage) != child || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0 || !ok)
+        return false;
+# ifdef MACOS
+    double peak_mb = usage.ru_maxrss / (1024. * 1024.); // In bytes.
+# else
+    double peak_mb = usage.ru_maxrss / 1024.; // In kilobytes.
+# endif
+#else
+    if (!run_one(reader_name, tool_name, path, gz_path, &result))
+        return false;
+    double peak_mb = -1;
+#endif
+    print_row(reader_name, tool_name, result, peak_mb);
+    return true;
+}
+
+int
+main(int argc, const char *argv[])
+{
+    bench_options_t ops;
+    if (!parse_args(argc, argv, &ops))
+        usage(argv[0]);
+    const std::string path = "drcachesim_benchmark.trace";
+    const std::string gz_path = "drcachesim_benchmark.trace.gz";
+    if (!generate_traces(ops, path, gz_path)) {
+        std::cerr << "Failed to write the synthetic traces\n";
+        return 1;
+    }
+    std::cout << "Synthetic " << ops.pattern << " trace: " << ops.refs <<
+        " memrefs from " << ops.threads << " threads over a " << ops.working_set <<
+        "-byte working set per thread\n";
+    std::cout << std::left << std::setw(8) << "reader" << std::setw(16) << "tool" <<
+        std::right << std::setw(14) << "memrefs" << std::setw(10) << "seconds" <<
+        std::setw(12) << "Mrefs/s" << std::setw(12) << "peak RSS MB" << std::endl;
+    bool ok = true;
+    for (const char *reader_name : readers) {
+        if (!ops.reader.empty() && ops.reader != reader_name)
+            continue;
+        for (const char *tool_name : tools) {
+            if (!ops.tool.empty() && ops.tool != tool_name)
+                continue;
+            if (!run_and_report(reader_name, tool_name, path, gz_path)) {
+                std::cerr << "Failed to run " << tool_name << " on the " <<
+                    reader_name << " reader\n";
+                ok = false;
+            }
+        }
+    }
+    remove(path.c_str());
+    remove(gz_path.c_str());
+    return ok ? 0 : 1;
+}
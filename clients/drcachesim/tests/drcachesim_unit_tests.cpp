@@ -31,10 +31,62 @@
  */
 
 // Unit tests for drcachesim
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifdef UNIX
+# include <sys/stat.h>
+#else
+# include <direct.h>
+#endif
+#include "analyzer.h"
+#include "reader/compact_file_reader.h"
+#include "reader/file_reader.h"
+#include "reader/memory_reader.h"
+#include "reader/mmap_file_reader.h"
+#include "reader/miss_stream_reader.h"
+#ifdef LINUX
+# include "reader/shm_ring_reader.h"
+#endif
+#ifdef HAS_ZLIB
+# include "reader/chunked_file_reader.h"
+# include "tracer/chunked_ostream.h"
+# include "tracer/gzip_istream.h"
+# include <zlib.h>
+#endif
+#include "tracer/addr_canonicalizer.h"
+#include "tracer/compact_ostream.h"
+#include "tracer/repeat_ostream.h"
+#include "simulator/cache_bit_plru.h"
+#include "simulator/cache_lru.h"
+#include "simulator/cache_plru.h"
+#include "simulator/cache_rrip.h"
 #include "simulator/cache_simulator.h"
+#include "simulator/cache_stats.h"
+#include "simulator/cache_sweep.h"
+#include "simulator/page_size_map.h"
+#include "simulator/tlb_simulator.h"
+#include "tools/invariant_checker_create.h"
+#include "tools/regions_create.h"
+#include "tools/report_symbolizer.h"
+#include "tools/reuse_distance_create.h"
+#include "tools/reuse_time_create.h"
+#include "tools/trace_slice_create.h"
+#include "../common/cardinality_sketch.h"
+#include "../common/flat_hash_map.h"
 #include "../common/memref.h"
+#include "../common/thread_index.h"
+#include "../common/trace_entry.h"
+#include "../common/utils.h"
 
 void
 unit_test_warmup_fraction()
@@ -100,11 +152,2734 @@ unit_test_warmup_refs()
     }
 }
 
+// Exposes the prefetcher counters.
+class prefetch_test_stats_t : public cache_stats_t
+{
+ public:
+    int_least64_t get_fills() const { return num_prefetch_fills; }
+    int_least64_t get_used() const { return num_prefetches_used; }
+};
+
+// Runs a strided walk through an L1 with the given prefetcher and checks that
+// enough of the misses are covered and enough of the prefetches used.
+static void
+check_prefetcher(const std::string &policy, int_least64_t stride, double min_coverage,
+                 double min_accuracy)
+{
+    const int line_size = 64;
+    cache_lru_t ll, l1;
+    prefetch_test_stats_t *ll_stats = new prefetch_test_stats_t;
+    prefetch_test_stats_t *l1_stats = new prefetch_test_stats_t;
+    if (!ll.init(16, line_size, 1024*line_size, NULL, ll_stats) ||
+        !l1.init(4, line_size, 64*line_size, &ll, l1_stats,
+                 prefetcher_t::create(policy, line_size, 2, 2))) {
+        std::cerr << "drcachesim unit_test_prefetchers failed to init caches\n";
+        exit(1);
+    }
+    addr_t addr = 1ULL << 30;
+    for (int i = 0; i < 10000; i++) {
+        memref_t ref;
+        ref.data.type = TRACE_TYPE_READ;
+        ref.data.size = 8;
+        ref.data.addr = addr;
+        ref.data.pc = 0x1000;
+        l1.request(ref);
+        addr += stride;
+        // Interleave a second instruction with no pattern over a few lines,
+        // which should not disturb the first one's stride.
+        ref.data.addr = (1ULL << 20) + (i * 7919 % 8) * line_size;
+        ref.data.pc = 0x1004;
+        l1.request(ref);
+    }
+    double coverage = (double)l1_stats->get_used() /
+        (l1_stats->get_used() + l1_stats->get_misses());
+    double accuracy = (double)l1_stats->get_used() / l1_stats->get_fills();
+    if (l1_stats->get_fills() == 0 || coverage < min_coverage ||
+        accuracy < min_accuracy) {
+        std::cerr << "drcachesim unit_test_prefetchers failed for " << policy <<
+            ": coverage " << coverage << ", accuracy " << accuracy << "\n";
+        exit(1);
+    }
+    delete l1.get_prefetcher();
+    delete l1_stats;
+    delete ll_stats;
+}
+
+void
+unit_test_prefetchers()
+{
+    // A forward sequential walk.  Next-line only triggers on misses, so it
+    // covers just over half of them.
+    check_prefetcher("nextline", 32, 0.5, 0.9);
+    check_prefetcher("stream", 32, 0.9, 0.9);
+    // A backward walk skipping lines.  The stream prefetcher follows it but
+    // also fetches the skipped lines.
+    check_prefetcher("stride", -3 * 64, 0.9, 0.9);
+    check_prefetcher("stream", -3 * 64, 0.9, 0.4);
+    if (prefetcher_t::is_valid_policy("bogus") ||
+        prefetcher_t::create("none", 64, 1, 1) != nullptr) {
+        std::cerr << "drcachesim unit_test_prefetchers failed on policies\n";
+        exit(1);
+    }
+}
+
+// Checks the victims chosen by each replacement policy in a single 4-way set.
+static void
+check_replace_policy(const std::string &policy, cache_t *cache, const std::string &expect)
+{
+    const int line_size = 64;
+    cache_stats_t *stats = new cache_stats_t;
+    if (!cache->init(4, line_size, 4*line_size, NULL, stats)) {
+        std::cerr << "drcachesim unit_test_replace_policies failed to init "
+                  << policy << "\n";
+        exit(1);
+    }
+    // Fill the set with lines A-D, reuse B and A, and then bring in E and F.
+    const std::string refs = "ABCDBAEF";
+    for (char line : refs) {
+        memref_t ref;
+        ref.data.type = TRACE_TYPE_READ;
+        ref.data.size = 8;
+        ref.data.addr = (line - 'A') * line_size;
+        ref.data.pc = 0x1000;
+        cache->request(ref);
+    }
+    std::string present;
+    for (char line = 'A'; line <= 'F'; ++line) {
+        if (cache->contains((line - 'A') * line_size))
+            present += line;
+    }
+    if (present != expect) {
+        std::cerr << "drcachesim unit_test_replace_policies failed for " << policy
+                  << ": holds " << present << " instead of " << expect << "\n";
+        exit(1);
+    }
+    delete cache;
+    delete stats;
+}
+
+void
+unit_test_replace_policies()
+{
+    // True LRU would replace C and D.  A and B share a subtree, which only
+    // remembers that A was used after B, so after E replaces C, F replaces B
+    // rather than the older D.
+    check_replace_policy("PLRU", new cache_plru_t, "ADEF");
+    // E replaces C and sets the last clear bit, so the bits of the other ways are
+    // cleared and F replaces A.
+    check_replace_policy("BIT_PLRU", new cache_bit_plru_t, "BDEF");
+    // E replaces C in both.  SRRIP inserts E nearer than the unused D, while
+    // BRRIP inserts E at the distant interval so that F replaces it.
+    check_replace_policy("SRRIP", new cache_rrip_t(false/*!bimodal*/), "ABEF");
+    check_replace_policy("BRRIP", new cache_rrip_t(true/*bimodal*/), "ABDF");
+}
+
+// Feeds a deterministic mix of instruction fetches, loads spanning lines, stores,
+// and flushes from several threads.
+static void
+feed_mixed_memrefs(analysis_tool_t &tool)
+{
+    uint64_t rand = 1;
+    for (int i = 0; i < 200000; i++) {
+        rand = rand * 6364136223846793005ULL + 1442695040888963407ULL;
+        memref_t ref;
+        ref.data.pid = 1;
+        ref.data.tid = 1 + (i / 1000) % 6;
+        ref.data.pc = 0x400000 + (i % 4096) * 4;
+        int kind = (int)((rand >> 33) % 100);
+        if (kind < 60) {
+            ref.instr.type = TRACE_TYPE_INSTR;
+            ref.instr.size = 4;
+            ref.instr.addr = ref.data.pc;
+        } else if (kind < 98) {
+            ref.data.type = kind < 85 ? TRACE_TYPE_READ : TRACE_TYPE_WRITE;
+            ref.data.size = kind % 7 == 0 ? 100 : 8;
+            ref.data.addr = 0x10000000 + ((rand >> 20) % (1 << 20)) * 8;
+        } else {
+            ref.flush.type = kind == 98 ? TRACE_TYPE_DATA_FLUSH : TRACE_TYPE_INSTR_FLUSH;
+            ref.flush.size = 512;
+            ref.flush.addr = kind == 98 ? 0x10000000 : 0x400000;
+        }
+        tool.process_memref(ref);
+    }
+}
+
+static std::string
+simulate_and_print(const cache_simulator_knobs_t &knobs)
+{
+    cache_simulator_t cache_sim(knobs);
+    if (!cache_sim) {
+        std::cerr << "drcachesim failed to create cache simulator\n";
+        exit(1);
+    }
+    feed_mixed_memrefs(cache_sim);
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    cache_sim.print_results();
+    std::cerr.rdbuf(old);
+    return out.str();
+}
+
+void
+unit_test_parallel_cache_sim()
+{
+    const char *policies[] = {"LRU", "LFU", "FIFO", "PLRU", "BIT_PLRU", "SRRIP",
+                              "BRRIP"};
+    for (const char *policy : policies) {
+        cache_simulator_knobs_t knobs;
+        knobs.L1I_size = 8*1024;
+        knobs.L1D_size = 4*1024;
+        knobs.LL_size = 64*1024;
+        knobs.replace_policy = policy;
+        std::string serial = simulate_and_print(knobs);
+        // Both with L1 workers sharing cores and with a worker per core.
+        const unsigned int threads[] = {2, 5, 8};
+        for (unsigned int num_threads : threads) {
+            knobs.sim_threads = num_threads;
+            if (simulate_and_print(knobs) != serial) {
+                std::cerr << "drcachesim unit_test_parallel_cache_sim failed for "
+                          << policy << " with " << num_threads << " threads\n";
+                exit(1);
+            }
+        }
+    }
+}
+
+// Drops the warmup statistics, which are not known to a run resuming from a
+// saved warmup state.
+static std::string
+strip_warmup_lines(const std::string &results)
+{
+    std::istringstream in(results);
+    std::string line, res;
+    while (std::getline(in, line)) {
+        if (line.find("Warmup") == std::string::npos)
+            res += line + "\n";
+    }
+    return res;
+}
+
+void
+unit_test_warmup_state()
+{
+    const std::string path = "drcachesim_unit_tests.warmup";
+    const uint64_t warmup_refs = 100000;
+    cache_simulator_knobs_t knobs;
+    knobs.L1I_size = 8*1024;
+    knobs.L1D_size = 4*1024;
+    knobs.LL_size = 64*1024;
+    knobs.warmup_refs = warmup_refs;
+    std::string expect = strip_warmup_lines(simulate_and_print(knobs));
+    knobs.warmup_save_file = path;
+    simulate_and_print(knobs);
+    // Resuming after the warmup references must match the full run.
+    knobs.warmup_save_file = "";
+    knobs.warmup_refs = 0;
+    knobs.warmup_load_file = path;
+    knobs.skip_refs = warmup_refs;
+    std::string res = simulate_and_print(knobs);
+    if (res != expect) {
+        std::cerr << "drcachesim unit_test_warmup_state failed:\n" << res
+                  << "vs\n" << expect;
+        exit(1);
+    }
+    // A different configuration must be rejected.
+    knobs.LL_size = 128*1024;
+    cache_simulator_t mismatch(knobs);
+    if (!!mismatch) {
+        std::cerr << "drcachesim unit_test_warmup_state failed to detect a "
+                  << "mismatched configuration\n";
+        exit(1);
+    }
+}
+
+// Returns the rows of a -stats_file, checking that the counts never decrease.
+static std::vector<std::vector<int_least64_t>>
+read_stats_rows(const std::string &path, std::string *header)
+{
+    std::ifstream in(path);
+    std::vector<std::vector<int_least64_t>> rows;
+    std::string line;
+    std::getline(in, *header);
+    while (std::getline(in, line)) {
+        std::vector<int_least64_t> row;
+        std::istringstream fields(line);
+        std::string field;
+        while (std::getline(fields, field, ','))
+            row.push_back(atoll(field.c_str()));
+        for (size_t i = 0; !rows.empty() && i < row.size(); i++) {
+            if (row.size() != rows.back().size() || row[i] < rows.back()[i]) {
+                std::cerr << "drcachesim unit_test_stats_file failed: " << line << "\n";
+                exit(1);
+            }
+        }
+        rows.push_back(row);
+    }
+    return rows;
+}
+
+void
+unit_test_stats_file()
+{
+    const std::string path = "drcachesim_unit_tests.stats.csv";
+    cache_simulator_knobs_t knobs;
+    knobs.num_cores = 1;
+    knobs.L1I_size = 8*1024;
+    knobs.L1D_size = 4*1024;
+    knobs.LL_size = 64*1024;
+    knobs.stats_file = path;
+    knobs.stats_interval = 30000;
+    simulate_and_print(knobs);
+    std::string header;
+    std::vector<std::vector<int_least64_t>> rows = read_stats_rows(path, &header);
+    // The last row holds the final counts of all of the references.
+    if (header != "refs,LL hits,LL misses,Core #0 L1I hits,Core #0 L1I misses,"
+        "Core #0 L1D hits,Core #0 L1D misses" || rows.size() != 7 ||
+        rows[0][0] != 30000 || rows.back()[0] != 200000 || rows.back()[2] == 0) {
+        std::cerr << "drcachesim unit_test_stats_file failed: " << header << " with "
+                  << rows.size() << " rows\n";
+        exit(1);
+    }
+    // Snapshots start once warmed up.
+    knobs.warmup_refs = 100000;
+    simulate_and_print(knobs);
+    rows = read_stats_rows(path, &header);
+    if (rows.size() != 4 || rows.back()[0] != 100000) {
+        std::cerr << "drcachesim unit_test_stats_file failed with warmup: "
+                  << rows.size() << " rows\n";
+        exit(1);
+    }
+}
+
+static void
+feed_func_marker(cache_simulator_t &cache_sim, trace_marker_type_t type,
+                 uintptr_t value)
+{
+    memref_t ref;
+    ref.marker.type = TRACE_TYPE_MARKER;
+    ref.marker.pid = 1;
+    ref.marker.tid = 1;
+    ref.marker.marker_type = type;
+    ref.marker.marker_value = value;
+    cache_sim.process_memref(ref);
+}
+
+// Reads count bytes from addr, a cache line apart if stride.
+static void
+feed_reads(cache_simulator_t &cache_sim, addr_t addr, int count, bool stride)
+{
+    for (int i = 0; i < count; i++) {
+        memref_t ref;
+        ref.data.type = TRACE_TYPE_READ;
+        ref.data.pid = 1;
+        ref.data.tid = 1;
+        ref.data.pc = 0x400000;
+        ref.data.size = 1;
+        ref.data.addr = addr + (stride ? i * 64 : i);
+        cache_sim.process_memref(ref);
+    }
+}
+
+static void
+feed_hot_call(cache_simulator_t &cache_sim, addr_t addr)
+{
+    feed_func_marker(cache_sim, TRACE_MARKER_TYPE_FUNC_ID, 0);
+    feed_func_marker(cache_sim, TRACE_MARKER_TYPE_FUNC_RETADDR, 0x400100);
+    feed_reads(cache_sim, addr, 10, true);
+    feed_func_marker(cache_sim, TRACE_MARKER_TYPE_FUNC_ID, 0);
+    feed_func_marker(cache_sim, TRACE_MARKER_TYPE_FUNC_RETVAL, 0);
+}
+
+void
+unit_test_func_stats()
+{
+    cache_simulator_knobs_t knobs;
+    knobs.num_cores = 1;
+    knobs.data_prefetcher = "none";
+    knobs.record_function = "hot|0&cold|1";
+    cache_simulator_t cache_sim(knobs);
+    if (!cache_sim) {
+        std::cerr << "drcachesim failed to create cache simulator\n";
+        exit(1);
+    }
+    feed_reads(cache_sim, 0x900000, 7, true);
+    for (int i = 0; i < 3; i++)
+        feed_hot_call(cache_sim, 0x100000 + i * 0x1000);
+    // A call to cold which reads one line and makes a nested call to hot.
+    feed_func_marker(cache_sim, TRACE_MARKER_TYPE_FUNC_ID, 1);
+    feed_func_marker(cache_sim, TRACE_MARKER_TYPE_FUNC_RETADDR, 0x400200);
+    feed_func_marker(cache_sim, TRACE_MARKER_TYPE_FUNC_ARG, 42);
+    feed_reads(cache_sim, 0x200000, 5, false);
+    feed_hot_call(cache_sim, 0x300000);
+    feed_func_marker(cache_sim, TRACE_MARKER_TYPE_FUNC_ID, 1);
+    feed_func_marker(cache_sim, TRACE_MARKER_TYPE_FUNC_RETVAL, 0);
+    feed_reads(cache_sim, 0x900000, 7, true);
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    cache_sim.print_results();
+    std::cerr.rdbuf(old);
+    std::string res = out.str();
+    if (res.find("Top 2 recorded functions by LL misses\n") == std::string::npos ||
+        res.find("               hot:          4,           40,            0,"
+                 "           40,           40\n") == std::string::npos ||
+        res.find("              cold:          1,            5,            0,"
+                 "            1,            1\n") == std::string::npos) {
+        std::cerr << "drcachesim unit_test_func_stats failed:\n" << res;
+        exit(1);
+    }
+}
+
+// Has one PC stream through memory while another rereads a single line.
+static std::string
+simulate_streaming_and_print(const cache_simulator_knobs_t &knobs)
+{
+    cache_simulator_t cache_sim(knobs);
+    if (!cache_sim) {
+        std::cerr << "drcachesim failed to create cache simulator\n";
+        exit(1);
+    }
+    for (int i = 0; i < 1000; i++) {
+        memref_t ref;
+        ref.data.type = TRACE_TYPE_READ;
+        ref.data.pid = 1;
+        ref.data.tid = 1;
+        ref.data.pc = 0x400000;
+        ref.data.size = 8;
+        ref.data.addr = 0x10000000 + i * 64;
+        cache_sim.process_memref(ref);
+        ref.data.pc = 0x400100;
+        ref.data.addr = 0x20000000;
+        cache_sim.process_memref(ref);
+    }
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    cache_sim.print_results();
+    std::cerr.rdbuf(old);
+    return out.str();
+}
+
+void
+unit_test_miss_hotspots()
+{
+    cache_simulator_knobs_t knobs;
+    knobs.num_cores = 1;
+    knobs.data_prefetcher = "none";
+    knobs.report_top = 2;
+    std::string res = simulate_streaming_and_print(knobs);
+    if (res.find("by misses") != std::string::npos) {
+        std::cerr << "drcachesim unit_test_miss_hotspots failed: hotspots without "
+                  << "-miss_hotspots\n" << res;
+        exit(1);
+    }
+    knobs.miss_hotspots = true;
+    res = simulate_streaming_and_print(knobs);
+    // The L1D and the LL each miss on every streaming read, 64 times in each 4K
+    // region, and once on the reread line.
+    const std::string expect =
+        "    Top 2 PCs by misses:\n"
+        "                0x400000:             1000\n"
+        "                0x400100:                1\n"
+        "    Top 2 data regions by misses:\n"
+        "              0x10000000:               64\n"
+        "              0x10001000:               64\n";
+    size_t pos = res.find(expect);
+    if (pos == std::string::npos || res.find(expect, pos + 1) == std::string::npos) {
+        std::cerr << "drcachesim unit_test_miss_hotspots failed:\n" << res;
+        exit(1);
+    }
+    // The LL partitions' counts are merged.
+    knobs.sim_threads = 3;
+    if (simulate_streaming_and_print(knobs) != res) {
+        std::cerr << "drcachesim unit_test_miss_hotspots failed with -sim_threads\n";
+        exit(1);
+    }
+}
+
+// Simulates the hierarchy of a configuration file whose last-level cache has
+// the given parameters, reading lines in the given order.
+static std::string
+simulate_config_and_print(const std::string &LL_params, const std::string &order,
+                          const std::string &policy = "LRU")
+{
+    const std::string path = "drcachesim_unit_tests.cache_config";
+    {
+        std::ofstream config(path.c_str());
+        config << "// One core with tiny caches.\n"
+               << "num_cores 1\nline_size 64\nmemory_latency 100\n"
+               << "replace_policy " << policy << "\n"
+               << "L1I { type instruction core 0 size 1K assoc 2 parent LLC }\n"
+               << "L1D { type data core 0 size 256 assoc 4 parent LLC latency 1 "
+               << "prefetcher none }\n"
+               << "LLC {\n  latency 10\n  " << LL_params << "\n}\n";
+    }
+    cache_simulator_knobs_t knobs;
+    if (!cache_simulator_read_config(path, &knobs)) {
+        std::cerr << "drcachesim unit_test_cache_config failed to read config\n";
+        exit(1);
+    }
+    cache_simulator_t cache_sim(knobs);
+    if (!cache_sim) {
+        std::cerr << "drcachesim failed to create cache simulator\n";
+        exit(1);
+    }
+    for (char line : order) {
+        memref_t ref;
+        ref.data.type = TRACE_TYPE_READ;
+        ref.data.pid = 1;
+        ref.data.tid = 1;
+        ref.data.pc = 0x400000;
+        ref.data.size = 8;
+        ref.data.addr = 0x10000 + (line - 'A') * 64;
+        cache_sim.process_memref(ref);
+    }
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    cache_sim.print_results();
+    std::cerr.rdbuf(old);
+    return out.str();
+}
+
+void
+unit_test_cache_config()
+{
+    // Rereading A hits in the L1D, so A becomes the LLC's least recently used
+    // line and is evicted by E.  Only an inclusive LLC then takes A from the L1D,
+    // and rereading A evicts B from both.
+    const std::string order = "ABCDAAAEA";
+    std::string res = simulate_config_and_print("size 256 assoc 4", order);
+    if (res.find("  L1D stats:\n    Hits:                                4\n"
+                 "    Misses:                              5\n") == std::string::npos) {
+        std::cerr << "drcachesim unit_test_cache_config failed:\n" << res;
+        exit(1);
+    }
+    res = simulate_config_and_print("size 256 assoc 4 inclusion inclusive", order);
+    if (res.find("  L1D stats:\n    Hits:                                3\n"
+                 "    Misses:                              6\n"
+                 "    Inclusive invals:                    2\n") == std::string::npos) {
+        std::cerr << "drcachesim unit_test_cache_config failed for inclusive:\n" << res;
+        exit(1);
+    }
+    // Two passes over six lines thrash the four-line FIFO L1D, and a two-line
+    // victim LLC then holds the other two, while a regular LLC of that size
+    // thrashes too.
+    const std::string loop = "ABCDEFABCDEF";
+    res = simulate_config_and_print("size 128 assoc 2", loop, "FIFO");
+    if (res.find("LL stats:\n    Hits:                                0\n"
+                 "    Misses:                             12\n") == std::string::npos) {
+        std::cerr << "drcachesim unit_test_cache_config failed:\n" << res;
+        exit(1);
+    }
+    res = simulate_config_and_print("size 128 assoc 2 inclusion exclusive", loop,
+                                    "FIFO");
+    // Each read looks up the L1D and LLC, and the first six go to memory.
+    if (res.find("LL stats:\n    Hits:                                6\n"
+                 "    Misses:                              6\n") == std::string::npos ||
+        res.find("Average memory access time: 61.00 cycles\n") == std::string::npos) {
+        std::cerr << "drcachesim unit_test_cache_config failed for exclusive:\n" << res;
+        exit(1);
+    }
+    // A hierarchy with no path to memory is rejected.
+    cache_simulator_knobs_t knobs;
+    knobs.num_cores = 1;
+    knobs.caches.resize(3);
+    knobs.caches[0].name = "L1I";
+    knobs.caches[0].type = "instruction";
+    knobs.caches[1].name = "L1D";
+    knobs.caches[1].type = "data";
+    knobs.caches[2].name = "L2";
+    for (cache_params_t &params : knobs.caches) {
+        params.core = 0;
+        params.size = 1024;
+        params.assoc = 2;
+        params.parent = "L2";
+    }
+    cache_simulator_t cache_sim(knobs);
+    if (!!cache_sim) {
+        std::cerr << "drcachesim unit_test_cache_config failed to reject a cycle\n";
+        exit(1);
+    }
+}
+
+// Runs 100 instructions from one line, each reading the next data line if
+// data is true, and returns the first CPI reported by -timing.
+static double
+simulate_timing(const cache_simulator_knobs_t &knobs, bool data, std::string *res)
+{
+    cache_simulator_t cache_sim(knobs);
+    if (!cache_sim) {
+        std::cerr << "drcachesim failed to create cache simulator\n";
+        exit(1);
+    }
+    for (int i = 0; i < 100; i++) {
+        memref_t ref;
+        ref.instr.type = TRACE_TYPE_INSTR;
+        ref.instr.pid = 1;
+        ref.instr.tid = 1;
+        ref.instr.addr = 0x400000 + (i % 8) * 4;
+        ref.instr.size = 4;
+        cache_sim.process_memref(ref);
+        if (!data)
+            continue;
+        ref.data.type = TRACE_TYPE_READ;
+        ref.data.pc = 0x400000 + (i % 8) * 4;
+        ref.data.size = 8;
+        ref.data.addr = 0x10000000 + i * 64;
+        cache_sim.process_memref(ref);
+    }
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    cache_sim.print_results();
+    std::cerr.rdbuf(old);
+    *res = out.str();
+    size_t pos = res->find("    CPI:");
+    if (pos == std::string::npos) {
+        std::cerr << "drcachesim unit_test_timing failed: no CPI\n" << *res;
+        exit(1);
+    }
+    return atof(res->c_str() + pos + strlen("    CPI:"));
+}
+
+void
+unit_test_timing()
+{
+    cache_simulator_knobs_t knobs;
+    knobs.num_cores = 1;
+    knobs.data_prefetcher = "none";
+    knobs.LL_latency = 10;
+    knobs.memory_latency = 100;
+    knobs.timing = true;
+    std::string res;
+    // Only the first fetch misses, going to memory through the LL.
+    simulate_timing(knobs, false, &res);
+    if (res.find("Timing model results:\nCore #0:\n"
+                 "    Instructions:                      100\n"
+                 "    Cycles:                            210\n"
+                 "    CPI:                              2.10\n"
+                 "    Memory CPI:                       1.10\n"
+                 "Thread 1:\n") == std::string::npos) {
+        std::cerr << "drcachesim unit_test_timing failed:\n" << res;
+        exit(1);
+    }
+    // Independent data misses overlap, unless too few can be outstanding or
+    // memory bandwidth is short.
+    knobs.timing_mlp = 1;
+    double serial = simulate_timing(knobs, true, &res);
+    knobs.timing_mlp = 8;
+    double overlapped = simulate_timing(knobs, true, &res);
+    knobs.memory_bandwidth = 1.0;
+    double limited = simulate_timing(knobs, true, &res);
+    if (serial < 100 || overlapped > serial / 4 || limited < 64) {
+        std::cerr << "drcachesim unit_test_timing failed: CPI " << serial << " "
+                  << overlapped << " " << limited << "\n";
+        exit(1);
+    }
+}
+
+// Has two threads on different cores take turns writing to one line at disjoint
+// bytes and to another line at the same bytes.
+static std::string
+simulate_sharing_and_print(const cache_simulator_knobs_t &knobs)
+{
+    cache_simulator_t cache_sim(knobs);
+    if (!cache_sim) {
+        std::cerr << "drcachesim failed to create cache simulator\n";
+        exit(1);
+    }
+    for (int i = 0; i < 200; i++) {
+        memref_t ref;
+        ref.data.type = TRACE_TYPE_WRITE;
+        ref.data.pid = 1;
+        ref.data.tid = 1 + i % 2;
+        ref.data.pc = 0x400000 + (i % 2) * 0x100;
+        ref.data.size = 8;
+        ref.data.addr = 0x10000 + (i % 2) * 8;
+        cache_sim.process_memref(ref);
+        ref.data.pc += 4;
+        ref.data.addr = 0x20000;
+        cache_sim.process_memref(ref);
+    }
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    cache_sim.print_results();
+    std::cerr.rdbuf(old);
+    return out.str();
+}
+
+void
+unit_test_coherence()
+{
+    cache_simulator_knobs_t knobs;
+    knobs.num_cores = 2;
+    std::string res = simulate_sharing_and_print(knobs);
+    if (res.find("Invalidations:") != std::string::npos ||
+        res.find("Coherence") != std::string::npos) {
+        std::cerr << "drcachesim unit_test_coherence failed: invalidations without "
+                  << "-coherence\n" << res;
+        exit(1);
+    }
+    knobs.coherence = true;
+    res = simulate_sharing_and_print(knobs);
+    // Every write but the first to each line invalidates the other core's copy,
+    // so core #1 suffers one fewer than core #0.
+    if (res.find("Coherence invalidations: 398\n") == std::string::npos ||
+        res.find("Invalidations:                     198\n") == std::string::npos ||
+        res.find("0x10000:            199,        2  (likely false sharing)\n") ==
+        std::string::npos ||
+        res.find("0x20000:            199,        2\n") == std::string::npos ||
+        res.find("0x400104:            100\n") == std::string::npos) {
+        std::cerr << "drcachesim unit_test_coherence failed:\n" << res;
+        exit(1);
+    }
+}
+
+// Exposes the miss counts of a cache simulation.
+class miss_count_sim_t : public cache_simulator_t
+{
+ public:
+    miss_count_sim_t(const cache_simulator_knobs_t &knobs) : cache_simulator_t(knobs) {}
+    int_least64_t get_L1D_misses()
+    {
+        int_least64_t misses = 0;
+        for (unsigned int i = 0; i < knobs.num_cores; i++)
+            misses += dcaches[i]->get_stats()->get_misses();
+        return misses;
+    }
+    int_least64_t get_LL_misses() { return llcache->get_stats()->get_misses(); }
+};
+
+// Runs the mixed memrefs through a simulation writing an LL miss file in the
+// given format and returns the number of LL misses.
+static int_least64_t
+write_LL_misses(const std::string &path, const std::string &format)
+{
+    cache_simulator_knobs_t knobs;
+    knobs.L1I_size = 8*1024;
+    knobs.L1D_size = 4*1024;
+    knobs.LL_size = 64*1024;
+    knobs.LL_miss_file = path;
+    knobs.LL_miss_format = format;
+    miss_count_sim_t cache_sim(knobs);
+    if (!cache_sim) {
+        std::cerr << "drcachesim failed to create cache simulator\n";
+        exit(1);
+    }
+    memref_t marker;
+    marker.marker.type = TRACE_TYPE_MARKER;
+    marker.marker.pid = 1;
+    marker.marker.tid = 1;
+    marker.marker.marker_type = TRACE_MARKER_TYPE_TIMESTAMP;
+    marker.marker.marker_value = 1234;
+    cache_sim.process_memref(marker);
+    feed_mixed_memrefs(cache_sim);
+    // The file is completed when cache_sim is destroyed.
+    return cache_sim.get_LL_misses();
+}
+
+void
+unit_test_miss_stream()
+{
+    const std::string text_path = "drcachesim_unit_tests.misses.txt";
+    const std::string binary_path = "drcachesim_unit_tests.misses.bin";
+    int_least64_t misses = write_LL_misses(text_path, "text");
+    if (write_LL_misses(binary_path, "binary_tid_time") != misses) {
+        std::cerr << "drcachesim unit_test_miss_stream failed: miss count changed\n";
+        exit(1);
+    }
+#ifdef HAS_ZLIB
+    gzFile text = gzopen(text_path.c_str(), "rb");
+#else
+    FILE *text = fopen(text_path.c_str(), "r");
+#endif
+    miss_stream_reader_t binary(binary_path);
+    if (text == nullptr || !binary || !binary.has_tid_and_time()) {
+        std::cerr << "drcachesim unit_test_miss_stream failed to open miss files\n";
+        exit(1);
+    }
+    char line[128];
+    miss_record_t record;
+    int_least64_t count = 0;
+#ifdef HAS_ZLIB
+    while (gzgets(text, line, sizeof(line)) != nullptr) {
+#else
+    while (fgets(line, sizeof(line), text) != nullptr) {
+#endif
+        std::stringstream expect;
+        if (binary.next(&record))
+            expect << "0x" << std::hex << record.pc << ",0x" << record.addr << "\n";
+        if (expect.str() != line || record.tid < 1 || record.tid > 6 ||
+            record.timestamp != 1234) {
+            std::cerr << "drcachesim unit_test_miss_stream failed at miss " << count
+                      << ": " << line << " vs " << expect.str() << "\n";
+            exit(1);
+        }
+        count++;
+    }
+#ifdef HAS_ZLIB
+    gzclose(text);
+#else
+    fclose(text);
+#endif
+    // Prefetch misses are written as well but not counted as misses.
+    if (count < misses || misses == 0 || binary.next(&record) || !binary) {
+        std::cerr << "drcachesim unit_test_miss_stream failed: " << count
+                  << " of " << misses << " misses\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_cache_sweep()
+{
+    // The LRU sweep models exact LRU, which cache_lru_t matches for
+    // associativities of at most 2.
+    const char *policies[] = {"LRU", "FIFO", "LFU", "PLRU", "SRRIP"};
+    for (const char *policy : policies) {
+        cache_sweep_knobs_t knobs;
+        knobs.cache.L1I_size = 8*1024;
+        knobs.cache.replace_policy = policy;
+        knobs.L1D_sizes = {2*1024, 8*1024};
+        knobs.LL_sizes = {16*1024, 64*1024};
+        if (std::string(policy) == "LRU")
+            knobs.LL_assocs = {1, 2};
+        else
+            knobs.LL_assocs = {4, 16};
+        knobs.num_threads = 3;
+        cache_sweep_t sweep(knobs);
+        if (!sweep) {
+            std::cerr << "drcachesim failed to create cache sweep\n";
+            exit(1);
+        }
+        feed_mixed_memrefs(sweep);
+        std::stringstream out;
+        std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+        sweep.print_results();
+        std::cerr.rdbuf(old);
+
+        std::string line;
+        // Skip the title and the column headers.
+        std::getline(out, line);
+        std::getline(out, line);
+        int rows = 0;
+        while (std::getline(out, line)) {
+            std::stringstream row(line);
+            uint64_t L1D_size, LL_size;
+            unsigned int LL_assoc;
+            int_least64_t L1D_misses, LL_misses;
+            std::string rate;
+            row >> L1D_size >> LL_size >> LL_assoc >> L1D_misses >> rate >> LL_misses;
+            cache_simulator_knobs_t single = knobs.cache;
+            single.L1D_size = L1D_size;
+            single.LL_size = LL_size;
+            single.LL_assoc = LL_assoc;
+            miss_count_sim_t cache_sim(single);
+            feed_mixed_memrefs(cache_sim);
+            if (cache_sim.get_L1D_misses() != L1D_misses ||
+                cache_sim.get_LL_misses() != LL_misses) {
+                std::cerr << "drcachesim unit_test_cache_sweep failed for " << policy
+                          << ": " << line << "\n";
+                exit(1);
+            }
+            ++rows;
+        }
+        if (rows != 8) {
+            std::cerr << "drcachesim unit_test_cache_sweep failed for " << policy
+                      << ": " << rows << " rows\n";
+            exit(1);
+        }
+    }
+}
+
+static std::string
+reuse_distance_and_print(const reuse_distance_knobs_t &knobs)
+{
+    analysis_tool_t *tool = reuse_distance_tool_create(knobs);
+    feed_mixed_memrefs(*tool);
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    tool->print_results();
+    std::cerr.rdbuf(old);
+    delete tool;
+    return out.str();
+}
+
+void
+unit_test_reuse_distance_tree()
+{
+    reuse_distance_knobs_t knobs;
+    knobs.report_histogram = true;
+    std::string skip_list = reuse_distance_and_print(knobs);
+    knobs.use_distance_tree = true;
+    if (reuse_distance_and_print(knobs) != skip_list) {
+        std::cerr << "drcachesim unit_test_reuse_distance_tree failed\n";
+        exit(1);
+    }
+}
+
+static double
+find_reuse_mean(const std::string &results)
+{
+    const std::string label = "Reuse distance mean: ";
+    size_t pos = results.find(label);
+    if (pos == std::string::npos)
+        return -1.;
+    return atof(results.c_str() + pos + label.size());
+}
+
+void
+unit_test_reuse_distance_sampling()
+{
+    reuse_distance_knobs_t knobs;
+    double exact = find_reuse_mean(reuse_distance_and_print(knobs));
+    knobs.sampling_rate = 0.2;
+    // Small enough that the rate must be lowered.
+    knobs.sampling_max_lines = 4096;
+    std::string sampled = reuse_distance_and_print(knobs);
+    double estimate = find_reuse_mean(sampled);
+    size_t pos = sampled.find("Sampling rate: ");
+    double rate = pos == std::string::npos ? 1. : atof(sampled.c_str() + pos + 15);
+    if (exact <= 0. || estimate < exact * 0.9 || estimate > exact * 1.1 ||
+        rate >= knobs.sampling_rate) {
+        std::cerr << "drcachesim unit_test_reuse_distance_sampling failed: mean "
+                  << estimate << " vs " << exact << " at rate " << rate << "\n";
+        exit(1);
+    }
+}
+
+static std::string
+reuse_time_and_print(unsigned int max_lines, uint64_t window_refs)
+{
+    analysis_tool_t *tool = reuse_time_tool_create(64, 0, max_lines, window_refs);
+    feed_mixed_memrefs(*tool);
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    tool->print_results();
+    std::cerr.rdbuf(old);
+    delete tool;
+    return out.str();
+}
+
+static std::string
+find_line(const std::string &results, const std::string &label)
+{
+    size_t pos = results.find(label);
+    if (pos == std::string::npos)
+        return "";
+    return results.substr(pos, results.find('\n', pos) - pos);
+}
+
+void
+unit_test_reuse_time_bounded()
+{
+    std::string exact = reuse_time_and_print(0, 0);
+    // A bound above the access count forgets nothing.
+    std::string bounded = reuse_time_and_print(1 << 20, 10000);
+    std::string small = reuse_time_and_print(256, 0);
+    const std::string untracked = "Accesses with no reuse within ";
+    std::string none_bounded = find_line(bounded, untracked);
+    std::string none_small = find_line(small, untracked);
+    if (find_line(exact, "Mean reuse time: ").empty() ||
+        find_line(exact, "Mean reuse time: ") !=
+        find_line(bounded, "Mean reuse time: ") ||
+        find_line(bounded, "Reuse time by window of 10000 accesses").empty() ||
+        // The second window is full.
+        find_line(bounded, "       1 mean").empty() ||
+        none_bounded.empty() || none_small.empty() ||
+        atoll(none_small.c_str() + none_small.find(": ") + 2) <=
+        atoll(none_bounded.c_str() + none_bounded.find(": ") + 2)) {
+        std::cerr << "drcachesim unit_test_reuse_time_bounded failed:\n"
+                  << find_line(exact, "Mean") << "\n" << find_line(bounded, "Mean")
+                  << "\n" << none_bounded << "\n" << none_small << "\n";
+        exit(1);
+    }
+}
+
+// Feeds instructions from through to-1 of a trace that alternates every
+// phase_instrs instructions between a loop over a small array and a loop striding
+// through a large one.
+static void
+feed_phases(analysis_tool_t &tool, int from, int to, int phase_instrs)
+{
+    for (int i = from; i < to; i++) {
+        bool striding = (i / phase_instrs) % 2 == 1;
+        memref_t ref;
+        // Each loop body is a single block of 8 instructions.
+        ref.instr.type = (i % 8 == 7) ? TRACE_TYPE_INSTR_CONDITIONAL_JUMP :
+            TRACE_TYPE_INSTR;
+        ref.instr.pid = 1;
+        ref.instr.tid = 1;
+        ref.instr.addr = (striding ? 0x500000 : 0x400000) + (i % 8) * 4;
+        ref.instr.size = 4;
+        tool.process_memref(ref);
+        memref_t data;
+        data.data.type = TRACE_TYPE_READ;
+        data.data.pid = 1;
+        data.data.tid = 1;
+        data.data.pc = ref.instr.addr;
+        data.data.size = 8;
+        data.data.addr = striding ? 0x10000000 + (i * 64) % (1 << 20) :
+            0x20000000 + (i * 8) % 1024;
+        tool.process_memref(data);
+    }
+}
+
+void
+unit_test_regions()
+{
+    const std::string path = "drcachesim_unit_tests.regions";
+    regions_knobs_t knobs;
+    knobs.interval_instrs = 1000;
+    knobs.max_clusters = 4;
+    knobs.output_file = path;
+    analysis_tool_t *tool = regions_tool_create(knobs);
+    feed_phases(*tool, 0, 20000, 2000);
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    tool->print_results();
+    std::cerr.rdbuf(old);
+    delete tool;
+    // The two phases are found, each represented by its first interval and
+    // covering half of the instructions.
+    std::ifstream in(path);
+    std::string line, regions;
+    while (std::getline(in, line)) {
+        if (line[0] != '#')
+            regions += line + "\n";
+    }
+    if (regions != "0 1000 0.5\n2000 1000 0.5\n") {
+        std::cerr << "drcachesim unit_test_regions failed:\n" << regions << out.str();
+        exit(1);
+    }
+
+    cache_simulator_knobs_t cache_knobs;
+    cache_knobs.L1D_size = 4*1024;
+    cache_knobs.data_prefetcher = "none";
+    cache_knobs.regions_file = path;
+    cache_knobs.regions_warmup = 500;
+    cache_simulator_t cache_sim(cache_knobs);
+    if (!cache_sim) {
+        std::cerr << "drcachesim unit_test_regions failed to load the regions\n";
+        exit(1);
+    }
+    // The simulator asks to skip between the first region and the warmup of the
+    // second, and then past the second.
+    uint64_t first_skip = cache_sim.instructions_to_skip();
+    feed_phases(cache_sim, 0, 1000, 2000);
+    uint64_t second_skip = cache_sim.instructions_to_skip();
+    feed_phases(cache_sim, 1500, 3000, 2000);
+    uint64_t last_skip = cache_sim.instructions_to_skip();
+    out.str("");
+    old = std::cerr.rdbuf(out.rdbuf());
+    cache_sim.print_results();
+    std::cerr.rdbuf(old);
+    // The small array misses only when first touched while the striding loop
+    // always misses, so their weighted miss rate is just over half.
+    std::string weighted = out.str().substr(out.str().find("Weighted results"));
+    std::string rate = find_line(weighted.substr(weighted.find("Core #0 L1D")),
+                                 "Miss rate:");
+    double miss_rate = rate.empty() ? 0. : atof(rate.c_str() + strlen("Miss rate:"));
+    if (first_skip != 0 || second_skip != 500 ||
+        last_skip != std::numeric_limits<uint64_t>::max() ||
+        miss_rate < 50. || miss_rate > 52.) {
+        std::cerr << "drcachesim unit_test_regions failed: skips " << first_skip << " "
+                  << second_skip << " " << last_skip << "\n" << out.str();
+        exit(1);
+    }
+}
+
+static memref_t
+make_instr(memref_tid_t tid, addr_t pc, trace_type_t type = TRACE_TYPE_INSTR)
+{
+    memref_t ref;
+    ref.instr.type = type;
+    ref.instr.pid = 1;
+    ref.instr.tid = tid;
+    ref.instr.addr = pc;
+    ref.instr.size = 4;
+    return ref;
+}
+
+static memref_t
+make_marker(memref_tid_t tid, trace_marker_type_t type, uintptr_t value)
+{
+    memref_t ref;
+    ref.marker.type = TRACE_TYPE_MARKER;
+    ref.marker.pid = 1;
+    ref.marker.tid = tid;
+    ref.marker.marker_type = type;
+    ref.marker.marker_value = value;
+    return ref;
+}
+
+static std::string
+check_invariants(const std::vector<memref_t> &refs, bool sharded)
+{
+    invariant_checker_knobs_t knobs;
+    knobs.max_reports = 2;
+    analysis_tool_t *tool = invariant_checker_create(knobs);
+    if (sharded) {
+        void *shard = tool->parallel_shard_init(0);
+        for (const memref_t &ref : refs)
+            tool->parallel_shard_memref(shard, ref);
+        tool->parallel_shard_exit(shard);
+    } else
+        tool->process_memrefs(&refs[0], refs.size());
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    bool res = tool->print_results();
+    std::cerr.rdbuf(old);
+    delete tool;
+    return out.str() + (res ? "passed" : "failed");
+}
+
+void
+unit_test_invariant_checker()
+{
+    std::vector<memref_t> good;
+    good.push_back(make_marker(1, TRACE_MARKER_TYPE_TIMESTAMP, 10));
+    good.push_back(make_instr(1, 0x1000));
+    good.push_back(make_instr(1, 0x1004, TRACE_TYPE_INSTR_CONDITIONAL_JUMP));
+    good.push_back(make_instr(1, 0x2000));
+    // A string loop repeats its instruction.
+    good.push_back(make_instr(1, 0x2000, TRACE_TYPE_INSTR_NO_FETCH));
+    // A kernel transfer may go anywhere.
+    good.push_back(make_marker(1, TRACE_MARKER_TYPE_KERNEL_EVENT, 0x2004));
+    good.push_back(make_instr(1, 0x3000));
+    good.push_back(make_marker(1, TRACE_MARKER_TYPE_TIMESTAMP, 20));
+    good.push_back(make_instr(1, 0x3004));
+    std::string res = check_invariants(good, false);
+    if (res.find("Checked 9 records in 1 threads") == std::string::npos ||
+        res.find("passed") == std::string::npos) {
+        std::cerr << "drcachesim unit_test_invariant_checker failed:\n" << res;
+        exit(1);
+    }
+
+    std::vector<memref_t> bad;
+    bad.push_back(make_marker(1, TRACE_MARKER_TYPE_TIMESTAMP, 20));
+    bad.push_back(make_instr(1, 0x1000, TRACE_TYPE_INSTR_DIRECT_JUMP));
+    // Only a serial check sees a switch right after a branch.
+    bad.push_back(make_instr(2, 0x5000));
+    bad.push_back(make_instr(1, 0x2000));
+    // A gap with no branch or marker.
+    bad.push_back(make_instr(1, 0x2010));
+    bad.push_back(make_marker(1, TRACE_MARKER_TYPE_TIMESTAMP, 10));
+    memref_t exit_ref;
+    exit_ref.exit.type = TRACE_TYPE_THREAD_EXIT;
+    exit_ref.exit.pid = 1;
+    exit_ref.exit.tid = 1;
+    bad.push_back(exit_ref);
+    bad.push_back(make_instr(1, 0x3000));
+    res = check_invariants(bad, false);
+    if (res.find("4 invariant violations found; the first 2:") == std::string::npos ||
+        res.find("Thread 1 record 2 (instruction 1): thread switch to 2") ==
+        std::string::npos ||
+        res.find("Thread 1 record 4 (instruction 3): instruction 0x2010") ==
+        std::string::npos ||
+        res.find("failed") == std::string::npos) {
+        std::cerr << "drcachesim unit_test_invariant_checker failed:\n" << res;
+        exit(1);
+    }
+    // A shard holds a single thread.
+    bad.erase(bad.begin() + 2);
+    res = check_invariants(bad, true);
+    if (res.find("3 invariant violations found; the first 2:") == std::string::npos ||
+        res.find("Thread 1 record 4 (instruction 3): instruction 0x2010") ==
+        std::string::npos ||
+        res.find("Thread 1 record 5 (instruction 3): timestamp 10") ==
+        std::string::npos) {
+        std::cerr << "drcachesim unit_test_invariant_checker failed:\n" << res;
+        exit(1);
+    }
+}
+
+// Names each address after itself and counts the batches requested.
+class fake_symbolizer_t : public report_symbolizer_t
+{
+ public:
+    fake_symbolizer_t() : batches(0), addrs(0) {}
+    void symbolize(const std::vector<addr_t> &addrs_in, std::vector<std::string> *names)
+    {
+        ++batches;
+        addrs += addrs_in.size();
+        names->clear();
+        for (addr_t addr : addrs_in) {
+            std::stringstream name;
+            name << "sym_" << std::hex << addr;
+            names->push_back(name.str());
+        }
+    }
+    int batches;
+    size_t addrs;
+};
+
+void
+unit_test_report_symbolizer()
+{
+    fake_symbolizer_t symbolizer;
+    reuse_distance_knobs_t knobs;
+    knobs.report_top = 5;
+    knobs.symbolizer = &symbolizer;
+    std::string results = reuse_distance_and_print(knobs);
+    // Both top lists are looked up in one batch.
+    if (symbolizer.batches != 1 || symbolizer.addrs != 2 * knobs.report_top) {
+        std::cerr << "drcachesim unit_test_report_symbolizer failed: "
+                  << symbolizer.batches << " batches of " << symbolizer.addrs << "\n";
+        exit(1);
+    }
+    // Each listed line is followed by its own name.
+    std::stringstream in(results);
+    std::string line;
+    int symbolized = 0;
+    while (std::getline(in, line)) {
+        size_t colon = line.find(": ");
+        size_t sym = line.find("  sym_");
+        if (colon == std::string::npos || sym == std::string::npos)
+            continue;
+        addr_t addr = strtoull(line.c_str(), NULL, 16);
+        if (strtoull(line.c_str() + sym + 6, NULL, 16) != addr) {
+            std::cerr << "drcachesim unit_test_report_symbolizer failed: " << line
+                      << "\n";
+            exit(1);
+        }
+        ++symbolized;
+    }
+    if (symbolized != 2 * (int)knobs.report_top) {
+        std::cerr << "drcachesim unit_test_report_symbolizer failed: " << symbolized
+                  << " symbolized lines\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_flat_hash_map()
+{
+    flat_hash_map_t<addr_t, uint64_t> map;
+    std::unordered_map<addr_t, uint64_t> expect;
+    // Clustered keys like cache lines, plus the free slot marker as a real key.
+    uint64_t seed = 1;
+    for (int i = 0; i < 100000; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        addr_t key = (i % 3 == 0) ? (addr_t)(seed >> 40) : (addr_t)(i % 5000);
+        if (i % 1000 == 0)
+            key = ~(addr_t)0;
+        ++map[key];
+        ++expect[key];
+    }
+    size_t visited = 0;
+    for (const auto &entry : map) {
+        if (expect[entry.first] != entry.second) {
+            std::cerr << "drcachesim unit_test_flat_hash_map failed for " << entry.first
+                      << "\n";
+            exit(1);
+        }
+        ++visited;
+    }
+    if (visited != expect.size() || map.size() != expect.size() ||
+        map.find(~(addr_t)0) == nullptr || *map.find(~(addr_t)0) != 100 ||
+        map.find(~(addr_t)1) != nullptr) {
+        std::cerr << "drcachesim unit_test_flat_hash_map failed: " << visited << " vs "
+                  << expect.size() << "\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_cardinality_sketch()
+{
+    cardinality_sketch_t small, low, high, all;
+    for (addr_t line = 0; line < 100; line++)
+        small.add(line);
+    // Consecutive lines, with repeats, split across two sketches.
+    for (addr_t line = 0; line < 300000; line++) {
+        low.add(line / 2);
+        high.add(150000 + line / 2);
+        all.add(line);
+    }
+    low.merge(high);
+    double estimates[] = {small.estimate(), low.estimate(), all.estimate()};
+    double actual[] = {100., 300000., 300000.};
+    for (int i = 0; i < 3; i++) {
+        // Well beyond the 1.6% standard error, to avoid flakiness.
+        if (estimates[i] < actual[i] * 0.93 || estimates[i] > actual[i] * 1.07) {
+            std::cerr << "drcachesim unit_test_cardinality_sketch failed: "
+                      << estimates[i] << " vs " << actual[i] << "\n";
+            exit(1);
+        }
+    }
+    all.clear();
+    if (all.estimate() != 0.) {
+        std::cerr << "drcachesim unit_test_cardinality_sketch failed to clear\n";
+        exit(1);
+    }
+}
+
+// Returns the page walk count of the first core in TLB results.
+static int_least64_t
+get_page_walks(const std::string &results)
+{
+    size_t pos = results.find("Page walks:");
+    if (pos == std::string::npos)
+        return -1;
+    return strtoll(results.c_str() + pos + strlen("Page walks:"), NULL, 10);
+}
+
+void
+unit_test_page_sizes()
+{
+    const std::string path = "drcachesim_unit_tests.page_map";
+    {
+        std::ofstream map(path.c_str());
+        map << "# Heap.\n0x10000000 0x10200000 2M\n\n"
+            << "0x40000000 0x80000000 1G # Reserved.\n";
+    }
+    page_size_map_t regions;
+    std::string error;
+    if (!regions.init_regions(path, &error) ||
+        regions.get_page_size(0x10001234, false) != PAGE_SIZE_2M ||
+        regions.get_page_size(0x7fffffff, true) != PAGE_SIZE_1G ||
+        regions.get_page_size(0x10200000, false) != PAGE_SIZE_BASE ||
+        regions.get_page_size(0x1000, false) != PAGE_SIZE_BASE) {
+        std::cerr << "drcachesim unit_test_page_sizes failed for regions " << error
+                  << "\n";
+        exit(1);
+    }
+    {
+        std::ofstream map("drcachesim_unit_tests.bad_page_map");
+        map << "0x10001000 0x10201000 2M\n";
+    }
+    page_size_map_t misaligned;
+    if (misaligned.init_regions("drcachesim_unit_tests.bad_page_map", &error)) {
+        std::cerr << "drcachesim unit_test_page_sizes failed to reject a misaligned "
+                  << "region\n";
+        exit(1);
+    }
+    // A data region is promoted once its third distinct page is touched.
+    page_size_map_t thp;
+    thp.init_thp(3);
+    if (thp.get_page_size(0x200000, false) != PAGE_SIZE_BASE ||
+        thp.get_page_size(0x200008, false) != PAGE_SIZE_BASE ||
+        thp.get_page_size(0x201000, false) != PAGE_SIZE_BASE ||
+        thp.get_page_size(0x3ff000, false) != PAGE_SIZE_2M ||
+        thp.get_page_size(0x200000, false) != PAGE_SIZE_2M ||
+        thp.get_page_size(0x200000, true) != PAGE_SIZE_BASE ||
+        thp.get_page_size(0x400000, false) != PAGE_SIZE_BASE) {
+        std::cerr << "drcachesim unit_test_page_sizes failed for thp\n";
+        exit(1);
+    }
+    // Sweeping the 512 base pages of the 2MB region thrashes the base page
+    // TLBs, but a single 2MB entry covers them.  Base pages alone keep the
+    // original results, without per-size arrays or page walks.
+    const char *policies[] = {"base", "map"};
+    for (int i = 0; i < 2; i++) {
+        tlb_simulator_knobs_t knobs;
+        knobs.num_cores = 1;
+        knobs.TLB_L2_entries = 256;
+        knobs.TLB_page_policy = policies[i];
+        knobs.TLB_page_map = path;
+        tlb_simulator_t tlb_sim(knobs);
+        if (!tlb_sim) {
+            std::cerr << "drcachesim failed to create tlb simulator\n";
+            exit(1);
+        }
+        for (int pass = 0; pass < 4; pass++) {
+            for (addr_t page = 0; page < 512; page++) {
+                memref_t ref;
+                ref.data.type = TRACE_TYPE_READ;
+                ref.data.pid = 1;
+                ref.data.tid = 1;
+                ref.data.pc = 0x400000;
+                ref.data.addr = 0x10000000 + page * 4096;
+                ref.data.size = 8;
+                tlb_sim.process_memref(ref);
+            }
+        }
+        std::stringstream out;
+        std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+        tlb_sim.print_results();
+        std::cerr.rdbuf(old);
+        int_least64_t walks = get_page_walks(out.str());
+        if ((i == 0 && (walks != -1 ||
+                        out.str().find("2M stats") != std::string::npos)) ||
+            (i == 1 && (walks != 1 ||
+                        out.str().find("L1D 2M stats:\n"
+                                       "    Hits:                             2047\n") ==
+                        std::string::npos))) {
+            std::cerr << "drcachesim unit_test_page_sizes failed for " << policies[i]
+                      << ":\n" << out.str();
+            exit(1);
+        }
+    }
+}
+
+// Counts references per shard and checks that each shard only sees one thread.
+class shard_count_tool_t : public analysis_tool_t
+{
+ public:
+    shard_count_tool_t() : total_refs(0), total_shards(0) {}
+    bool process_memref(const memref_t &memref) { return false; }
+    bool print_results() { return true; }
+    bool parallel_shard_supported() { return true; }
+    void * parallel_shard_init(int shard_index) { return new shard_t; }
+    bool parallel_shard_memref(void *shard_data, const memref_t &memref)
+    {
+        shard_t *shard = reinterpret_cast<shard_t*>(shard_data);
+        if (shard->tid == 0)
+            shard->tid = memref.data.tid;
+        else if (shard->tid != memref.data.tid)
+            return false;
+        ++shard->refs;
+        return true;
+    }
+    bool parallel_shard_exit(void *shard_data)
+    {
+        shard_t *shard = reinterpret_cast<shard_t*>(shard_data);
+        std::lock_guard<std::mutex> guard(mutex);
+        total_refs += shard->refs;
+        ++total_shards;
+        delete shard;
+        return true;
+    }
+    int total_refs;
+    int total_shards;
+ private:
+    struct shard_t {
+        shard_t() : tid(0), refs(0) {}
+        memref_tid_t tid;
+        int refs;
+    };
+    std::mutex mutex;
+};
+
+static std::vector<trace_entry_t>
+make_thread_entries(memref_tid_t tid, int num_refs)
+{
+    std::vector<trace_entry_t> entries;
+    trace_entry_t entry;
+    entry.type = TRACE_TYPE_HEADER;
+    entry.size = 0;
+    entry.addr = TRACE_ENTRY_VERSION;
+    entries.push_back(entry);
+    entry.type = TRACE_TYPE_THREAD;
+    entry.addr = (addr_t)tid;
+    entries.push_back(entry);
+    entry.type = TRACE_TYPE_PID;
+    entry.addr = 1;
+    entries.push_back(entry);
+    for (int i = 0; i < num_refs; i++) {
+        entry.type = TRACE_TYPE_INSTR;
+        entry.size = 4;
+        entry.addr = 0x1000 + i * 4;
+        entries.push_back(entry);
+    }
+    entry.type = TRACE_TYPE_THREAD_EXIT;
+    entry.size = 0;
+    entry.addr = (addr_t)tid;
+    entries.push_back(entry);
+    entry.type = TRACE_TYPE_FOOTER;
+    entry.addr = 0;
+    entries.push_back(entry);
+    return entries;
+}
+
+static void
+write_shard_file(const std::string &path, memref_tid_t tid, int num_refs)
+{
+    std::ofstream out(path.c_str(), std::ofstream::binary);
+    std::vector<trace_entry_t> entries = make_thread_entries(tid, num_refs);
+    out.write((char *)&entries[0], entries.size() * sizeof(entries[0]));
+}
+
+void
+unit_test_parallel_shards()
+{
+    const std::string dir = "drcachesim_unit_tests.shards";
+    const int num_shards = 4;
+#ifdef UNIX
+    mkdir(dir.c_str(), 0755);
+#else
+    _mkdir(dir.c_str());
+#endif
+    int expected_refs = 0;
+    for (int i = 0; i < num_shards; i++) {
+        // Each shard has its instrs plus a thread exit.
+        write_shard_file(dir + DIRSEP + "shard" + std::to_string(i) + ".trace",
+                         (memref_tid_t)(100 + i), 10 * (i + 1));
+        expected_refs += 10 * (i + 1) + 1;
+    }
+    shard_count_tool_t tool;
+    analysis_tool_t *tools[] = {&tool};
+    analyzer_t analyzer(dir, tools, 1, 2);
+    if (!analyzer || !analyzer.run() || tool.total_shards != num_shards ||
+        tool.total_refs != expected_refs) {
+        std::cerr << "drcachesim unit_test_parallel_shards failed\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_thread_subset()
+{
+    const std::string dir = "drcachesim_unit_tests.subset";
+#ifdef UNIX
+    mkdir(dir.c_str(), 0755);
+#else
+    _mkdir(dir.c_str());
+#endif
+    std::vector<thread_index_entry_t> index;
+    for (int i = 0; i < 3; i++) {
+        thread_index_entry_t thread;
+        thread.tid = 200 + i;
+        thread.pid = 1;
+        thread.entries = 10 * (i + 1) + 5;
+        thread.instrs = 10 * (i + 1);
+        thread.file = "drmemtrace.app." + std::to_string(thread.tid) + ".trace";
+        write_shard_file(dir + DIRSEP + thread.file, (memref_tid_t)thread.tid,
+                         10 * (i + 1));
+        index.push_back(thread);
+    }
+    std::string index_path = dir + DIRSEP + THREAD_INDEX_FILENAME;
+    std::vector<thread_index_entry_t> read_back;
+    if (!thread_index_write(index_path, index).empty() ||
+        !thread_index_read(index_path, &read_back).empty() ||
+        read_back.size() != index.size() || read_back[2].tid != index[2].tid ||
+        read_back[2].file != index[2].file || read_back[1].instrs != 20) {
+        std::cerr << "drcachesim unit_test_thread_subset index failed\n";
+        exit(1);
+    }
+    shard_count_tool_t tool;
+    analysis_tool_t *tools[] = {&tool};
+    analyzer_t analyzer(dir, tools, 1, 2);
+    // Only the second and third threads: their instrs plus a thread exit each.
+    if (!analyzer || !analyzer.set_thread_subset({201, 202}) || !analyzer.run() ||
+        tool.total_shards != 2 || tool.total_refs != 21 + 31) {
+        std::cerr << "drcachesim unit_test_thread_subset failed\n";
+        exit(1);
+    }
+    shard_count_tool_t missing_tool;
+    analysis_tool_t *missing_tools[] = {&missing_tool};
+    analyzer_t missing(dir, missing_tools, 1, 2);
+    if (!missing || missing.set_thread_subset({999})) {
+        std::cerr << "drcachesim unit_test_thread_subset missing thread failed\n";
+        exit(1);
+    }
+}
+
+// Writes a thread whose instructions are split into chunks, each preceded by a
+// timestamp.
+static void
+write_timed_thread_file(const std::string &path, memref_tid_t tid,
+                        const std::vector<std::pair<uint64_t, int> > &chunks)
+{
+    std::vector<trace_entry_t> entries = make_thread_entries(tid, 0);
+    std::vector<trace_entry_t> tail(entries.end() - 2, entries.end());
+    entries.resize(entries.size() - 2);
+    int num_instrs = 0;
+    for (const auto &chunk : chunks) {
+        trace_entry_t entry;
+        entry.type = TRACE_TYPE_MARKER;
+        entry.size = TRACE_MARKER_TYPE_TIMESTAMP;
+        entry.addr = (addr_t)chunk.first;
+        entries.push_back(entry);
+        for (int i = 0; i < chunk.second; i++, num_instrs++) {
+            entry.type = TRACE_TYPE_INSTR;
+            entry.size = 4;
+            entry.addr = 0x1000 + num_instrs * 4;
+            entries.push_back(entry);
+        }
+    }
+    entries.insert(entries.end(), tail.begin(), tail.end());
+    std::ofstream out(path.c_str(), std::ofstream::binary);
+    out.write((char *)&entries[0], entries.size() * sizeof(entries[0]));
+}
+
+// Records the thread of each instruction and counts the core placements.
+class sched_record_tool_t : public analysis_tool_t
+{
+ public:
+    sched_record_tool_t() : placements(0), in_order(true) {}
+    bool process_memref(const memref_t &memref)
+    {
+        if (memref.marker.type == TRACE_TYPE_MARKER &&
+            memref.marker.marker_type == TRACE_MARKER_TYPE_CPU_ID)
+            ++placements;
+        else if (memref.instr.type == TRACE_TYPE_INSTR) {
+            addr_t &next = next_pc[memref.instr.tid];
+            if (next == 0)
+                next = 0x1000;
+            if (memref.instr.addr != next)
+                in_order = false;
+            next += 4;
+            tids.push_back(memref.instr.tid);
+        }
+        return true;
+    }
+    bool print_results() { return true; }
+    int placements;
+    bool in_order;
+    std::vector<memref_tid_t> tids;
+ private:
+    std::unordered_map<memref_tid_t, addr_t> next_pc;
+};
+
+static std::string
+make_sched_dir(const std::string &name)
+{
+    std::string dir = "drcachesim_unit_tests.sched." + name;
+#ifdef UNIX
+    mkdir(dir.c_str(), 0755);
+#else
+    _mkdir(dir.c_str());
+#endif
+    return dir;
+}
+
+static void
+run_sched(const std::string &dir, unsigned int num_cores, uint64_t quantum,
+          analysis_tool_t *tool)
+{
+    analysis_tool_t *tools[] = {tool};
+    analyzer_t analyzer(dir, tools, 1);
+    analyzer.set_schedule(num_cores, quantum);
+    if (!analyzer || !analyzer.run()) {
+        std::cerr << "drcachesim unit_test_sched_threads failed to run " << dir << "\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_sched_threads()
+{
+    // Threads ready at the same time run side by side, an instruction at a time.
+    std::string dir = make_sched_dir("lockstep");
+    write_timed_thread_file(dir + DIRSEP + "a.trace", 201, {{100, 20}});
+    write_timed_thread_file(dir + DIRSEP + "b.trace", 202, {{100, 20}});
+    write_timed_thread_file(dir + DIRSEP + "c.trace", 203, {{100, 20}});
+    sched_record_tool_t lockstep;
+    run_sched(dir, 2, 0, &lockstep);
+    bool ok = lockstep.in_order && lockstep.tids.size() == 60 &&
+        lockstep.placements == 3;
+    for (int i = 0; ok && i < 40; i++)
+        ok = lockstep.tids[i] == (memref_tid_t)(201 + i % 2);
+    if (!ok) {
+        std::cerr << "drcachesim unit_test_sched_threads failed lockstep\n";
+        exit(1);
+    }
+
+    // A later timestamp yields to a waiting thread, which in turn waits for the
+    // presented timestamps to catch up with its own.
+    dir = make_sched_dir("timestamps");
+    write_timed_thread_file(dir + DIRSEP + "a.trace", 201, {{100, 10}, {600, 10}});
+    write_timed_thread_file(dir + DIRSEP + "b.trace", 202, {{500, 10}});
+    sched_record_tool_t timed;
+    run_sched(dir, 2, 0, &timed);
+    ok = timed.in_order && timed.tids.size() == 30 && timed.placements == 3;
+    for (int i = 0; ok && i < 30; i++)
+        ok = timed.tids[i] == (memref_tid_t)(i / 10 == 1 ? 202 : 201);
+    if (!ok) {
+        std::cerr << "drcachesim unit_test_sched_threads failed timestamps\n";
+        exit(1);
+    }
+
+    // With a quantum, threads sharing a core take turns.
+    sched_record_tool_t quantum;
+    run_sched(make_sched_dir("lockstep"), 1, 5, &quantum);
+    ok = quantum.in_order && quantum.tids.size() == 60 && quantum.placements == 12;
+    for (int i = 0; ok && i < 60; i++)
+        ok = quantum.tids[i] == (memref_tid_t)(201 + (i / 5) % 3);
+    if (!ok) {
+        std::cerr << "drcachesim unit_test_sched_threads failed quantum\n";
+        exit(1);
+    }
+
+    // Flushing the L1 caches on each switch makes every turn start cold.
+    cache_simulator_knobs_t knobs;
+    knobs.num_cores = 1;
+    knobs.cpu_scheduling = true;
+    std::string results[2];
+    for (int flush = 0; flush < 2; flush++) {
+        knobs.switch_flush = flush == 1;
+        cache_simulator_t cache_sim(knobs);
+        run_sched(make_sched_dir("lockstep"), 1, 5, &cache_sim);
+        std::stringstream out;
+        std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+        cache_sim.print_results();
+        std::cerr.rdbuf(old);
+        results[flush] = out.str();
+    }
+    // The threads' 20 instructions span 2 lines.  With flushing, each of the 12
+    // turns misses on its first line and each thread's last turn on the second.
+    if (results[0].find("Misses:                              2\n") ==
+        std::string::npos ||
+        results[1].find("Misses:                             15\n") ==
+        std::string::npos) {
+        std::cerr << "drcachesim unit_test_sched_threads failed switch flush:\n"
+                  << results[0] << results[1];
+        exit(1);
+    }
+}
+
+// Checks that batches arrive in trace order.
+class batch_count_tool_t : public analysis_tool_t
+{
+ public:
+    batch_count_tool_t() : total_refs(0), total_batches(0), in_order(true) {}
+    bool process_memref(const memref_t &memref) { return false; }
+    bool process_memrefs(const memref_t *memrefs, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i) {
+            if (memrefs[i].instr.type == TRACE_TYPE_INSTR &&
+                memrefs[i].instr.addr != (addr_t)(0x1000 + total_refs * 4))
+                in_order = false;
+            ++total_refs;
+        }
+        ++total_batches;
+        return true;
+    }
+    bool print_results() { return true; }
+    int total_refs;
+    int total_batches;
+    bool in_order;
+};
+
+void
+unit_test_batched_memrefs()
+{
+    const std::string path = "drcachesim_unit_tests.batch.trace";
+    const int num_instrs = 10000;
+    write_shard_file(path, 42, num_instrs);
+    batch_count_tool_t tool;
+    analysis_tool_t *tools[] = {&tool};
+    analyzer_t analyzer(path, tools, 1);
+    // The instrs plus the thread exit, in more than one batch.
+    if (!analyzer || !analyzer.run() || tool.total_refs != num_instrs + 1 ||
+        tool.total_batches < 2 || !tool.in_order) {
+        std::cerr << "drcachesim unit_test_batched_memrefs failed\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_pipelined_tools()
+{
+    const std::string path = "drcachesim_unit_tests.pipeline.trace";
+    // Enough batches to wrap around the analyzer's ring several times.
+    const int num_instrs = 100000;
+    write_shard_file(path, 42, num_instrs);
+    batch_count_tool_t tool1, tool2, tool3;
+    analysis_tool_t *tools[] = {&tool1, &tool2, &tool3};
+    analyzer_t analyzer(path, tools, 3);
+    analyzer.set_pipelined(true);
+    if (!analyzer || !analyzer.run()) {
+        std::cerr << "drcachesim unit_test_pipelined_tools failed to run\n";
+        exit(1);
+    }
+    for (batch_count_tool_t *tool : {&tool1, &tool2, &tool3}) {
+        if (tool->total_refs != num_instrs + 1 || !tool->in_order ||
+            tool->total_batches != tool1.total_batches) {
+            std::cerr << "drcachesim unit_test_pipelined_tools failed\n";
+            exit(1);
+        }
+    }
+}
+
+// Hands out an online-style stream a few entries at a time, so that reads
+// straddle the threads' buffers.
+class raw_chunk_reader_t : public reader_t
+{
+ public:
+    raw_chunk_reader_t(const std::vector<trace_entry_t> &entries, size_t chunk)
+        : entries(entries), chunk(chunk), cur(0) {}
+    bool init() { return false; }
+    bool init_raw()
+    {
+        at_eof = false;
+        return true;
+    }
+
+ protected:
+    trace_entry_t * read_next_entry()
+    {
+        size_t count;
+        return read_next_entries(&count);
+    }
+    trace_entry_t * read_next_entries(size_t *count)
+    {
+        if (cur >= entries.size())
+            return NULL;
+        *count = std::min(chunk, entries.size() - cur);
+        cur += *count;
+        return &entries[cur - *count];
+    }
+
+ private:
+    std::vector<trace_entry_t> entries;
+    size_t chunk;
+    size_t cur;
+};
+
+// Gives a test stream to the analyzer as though it came from a pipe.
+class online_test_analyzer_t : public analyzer_t
+{
+ public:
+    online_test_analyzer_t(reader_t *iter, analysis_tool_t **tools_in, int num_tools_in)
+    {
+        trace_iter = iter;
+        trace_end = new memory_reader_t();
+        tools = tools_in;
+        num_tools = num_tools_in;
+    }
+};
+
+static void
+append_online_piece(std::vector<trace_entry_t> *entries, memref_tid_t tid,
+                    bool first, int num_instrs, bool exit)
+{
+    trace_entry_t entry;
+    entry.type = TRACE_TYPE_THREAD;
+    entry.size = 0;
+    entry.addr = (addr_t)tid;
+    entries->push_back(entry);
+    if (first) {
+        entry.type = TRACE_TYPE_PID;
+        entry.addr = 1;
+        entries->push_back(entry);
+    }
+    for (int i = 0; i < num_instrs; i++) {
+        entry.type = TRACE_TYPE_INSTR;
+        entry.size = 4;
+        entry.addr = 0x1000 + i * 4;
+        entries->push_back(entry);
+    }
+    if (exit) {
+        entry.type = TRACE_TYPE_THREAD_EXIT;
+        entry.size = 0;
+        entry.addr = (addr_t)tid;
+        entries->push_back(entry);
+    }
+}
+
+void
+unit_test_online_shards()
+{
+    // Three threads interleave their pieces, with more pieces than a shard's
+    // queue holds.  Once the first has exited its id is reused by a fourth.
+    const int num_threads = 3;
+    const int num_pieces = 200;
+    const int piece_instrs = 50;
+    std::vector<trace_entry_t> entries;
+    for (int piece = 0; piece < num_pieces; piece++) {
+        for (int t = 0; t < num_threads; t++) {
+            append_online_piece(&entries, 100 + t, piece == 0, piece_instrs,
+                                piece == num_pieces - 1);
+        }
+    }
+    append_online_piece(&entries, 100, true, piece_instrs, true);
+    trace_entry_t footer;
+    footer.type = TRACE_TYPE_FOOTER;
+    footer.size = 0;
+    footer.addr = 0;
+    entries.push_back(footer);
+    shard_count_tool_t tool;
+    analysis_tool_t *tools[] = {&tool};
+    online_test_analyzer_t analyzer(new raw_chunk_reader_t(entries, 37), tools, 1);
+    analyzer.set_online_shards(true);
+    // Each thread has its instrs plus a thread exit.
+    int expected_refs = num_threads * (num_pieces * piece_instrs + 1) + piece_instrs + 1;
+    if (!analyzer.run() || tool.total_shards != num_threads + 1 ||
+        tool.total_refs != expected_refs) {
+        std::cerr << "drcachesim unit_test_online_shards failed\n";
+        exit(1);
+    }
+}
+
+#ifdef LINUX
+// Each writer sends its instrs in pieces which each start with its thread and
+// process, as the tracer's buffer writes do.
+static void
+write_ring_entries(shm_ring_t *ring, memref_tid_t tid, int num_instrs)
+{
+    const size_t header_entries = 2;
+    size_t max_instrs = ring->get_atomic_write_size() / sizeof(trace_entry_t) -
+        header_entries;
+    std::vector<trace_entry_t> piece;
+    for (int i = 0; i <= num_instrs; ) {
+        piece.clear();
+        trace_entry_t entry;
+        entry.type = TRACE_TYPE_THREAD;
+        entry.size = 0;
+        entry.addr = (addr_t)tid;
+        piece.push_back(entry);
+        entry.type = TRACE_TYPE_PID;
+        entry.addr = 1;
+        piece.push_back(entry);
+        // Vary the piece sizes to exercise partially filled slots.
+        size_t count = 1 + (i + tid) % max_instrs;
+        for (; i < num_instrs && piece.size() < header_entries + count; i++) {
+            entry.type = TRACE_TYPE_INSTR;
+            entry.size = 4;
+            entry.addr = 0x1000 + i * 4;
+            piece.push_back(entry);
+        }
+        if (i == num_instrs && piece.size() < header_entries + count) {
+            entry.type = TRACE_TYPE_THREAD_EXIT;
+            entry.size = 0;
+            entry.addr = (addr_t)tid;
+            piece.push_back(entry);
+            ++i;
+        }
+        if (ring->write(&piece[0], piece.size() * sizeof(piece[0])) < 0) {
+            std::cerr << "drcachesim unit_test_shm_ring failed to write\n";
+            exit(1);
+        }
+    }
+    ring->close();
+}
+
+void
+unit_test_shm_ring()
+{
+    const std::string name = "drcachesim_unit_tests.ring." +
+        std::to_string(getpid());
+    const int num_writers = 4;
+    const int num_instrs = 5000;
+    // A small ring so the writers wrap around it many times.
+    shm_ring_reader_t reader(name.c_str(), 4, 16 * sizeof(trace_entry_t));
+    shm_ring_reader_t end;
+    if (!reader) {
+        std::cerr << "drcachesim unit_test_shm_ring failed to create ring\n";
+        exit(1);
+    }
+    // We attach all writers up front so the reader does not see end-of-file
+    // between them.
+    std::vector<shm_ring_t *> rings;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_writers; i++) {
+        rings.push_back(new shm_ring_t(name.c_str()));
+        if (!rings.back()->open_for_write()) {
+            std::cerr << "drcachesim unit_test_shm_ring failed to attach\n";
+            exit(1);
+        }
+    }
+    for (int i = 0; i < num_writers; i++) {
+        threads.push_back(std::thread(write_ring_entries, rings[i],
+                                      (memref_tid_t)(100 + i), num_instrs));
+    }
+    if (!reader.init()) {
+        std::cerr << "drcachesim unit_test_shm_ring failed to init\n";
+        exit(1);
+    }
+    std::vector<int> instrs(num_writers, 0);
+    int exits = 0;
+    bool in_order = true;
+    for (; reader != end; ++reader) {
+        const memref_t &memref = *reader;
+        int idx = (int)(memref.data.tid - 100);
+        if (idx < 0 || idx >= num_writers) {
+            in_order = false;
+            continue;
+        }
+        if (memref.instr.type == TRACE_TYPE_INSTR) {
+            if (memref.instr.addr != (addr_t)(0x1000 + instrs[idx] * 4))
+                in_order = false;
+            ++instrs[idx];
+        } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT)
+            ++exits;
+    }
+    for (int i = 0; i < num_writers; i++) {
+        threads[i].join();
+        delete rings[i];
+        if (instrs[i] != num_instrs)
+            in_order = false;
+    }
+    if (!in_order || exits != num_writers) {
+        std::cerr << "drcachesim unit_test_shm_ring failed\n";
+        exit(1);
+    }
+}
+#endif
+
+void
+unit_test_mmap_reader()
+{
+    // We compare the mapped reader against the stream reader on the same file.
+    const std::string path = "drcachesim_unit_tests.mmap.trace";
+    write_shard_file(path, 42, 10000);
+    file_reader_t stream_reader(path.c_str());
+    mmap_file_reader_t mmap_reader(path.c_str());
+    file_reader_t stream_end;
+    mmap_file_reader_t mmap_end;
+    if (!mmap_reader || !stream_reader.init() || !mmap_reader.init() ||
+        !mmap_reader.is_complete()) {
+        std::cerr << "drcachesim unit_test_mmap_reader failed to init\n";
+        exit(1);
+    }
+    int count = 0;
+    for (; stream_reader != stream_end && mmap_reader != mmap_end;
+         ++stream_reader, ++mmap_reader, ++count) {
+        const memref_t &a = *stream_reader;
+        const memref_t &b = *mmap_reader;
+        if (a.data.type != b.data.type || a.data.tid != b.data.tid ||
+            a.data.addr != b.data.addr || a.data.size != b.data.size) {
+            std::cerr << "drcachesim unit_test_mmap_reader mismatch at " << count
+                      << "\n";
+            exit(1);
+        }
+    }
+    // The refs plus the thread exit.
+    if (stream_reader != stream_end || mmap_reader != mmap_end || count != 10001) {
+        std::cerr << "drcachesim unit_test_mmap_reader failed\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_memory_reader()
+{
+    // We compare the in-memory reader against the stream reader on the same data.
+    const std::string path = "drcachesim_unit_tests.memory.trace";
+    write_shard_file(path, 43, 10000);
+    std::vector<trace_entry_t> entries;
+    {
+        std::ifstream in(path.c_str(), std::ifstream::binary);
+        trace_entry_t entry;
+        while (in.read((char *)&entry, sizeof(entry)))
+            entries.push_back(entry);
+    }
+    file_reader_t stream_reader(path.c_str());
+    memory_reader_t memory_reader(&entries[0], entries.size());
+    file_reader_t stream_end;
+    memory_reader_t memory_end;
+    if (!stream_reader.init() || !memory_reader.init() ||
+        !memory_reader.is_complete()) {
+        std::cerr << "drcachesim unit_test_memory_reader failed to init\n";
+        exit(1);
+    }
+    int count = 0;
+    for (; stream_reader != stream_end && memory_reader != memory_end;
+         ++stream_reader, ++memory_reader, ++count) {
+        const memref_t &a = *stream_reader;
+        const memref_t &b = *memory_reader;
+        if (a.data.type != b.data.type || a.data.tid != b.data.tid ||
+            a.data.addr != b.data.addr || a.data.size != b.data.size) {
+            std::cerr << "drcachesim unit_test_memory_reader mismatch at " << count
+                      << "\n";
+            exit(1);
+        }
+    }
+    // The refs plus the thread exit.
+    if (stream_reader != stream_end || memory_reader != memory_end || count != 10001) {
+        std::cerr << "drcachesim unit_test_memory_reader failed\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_memref_ranges()
+{
+    // A forward 4-byte range and a backward 2-byte range, as from rep movs, that
+    // the reader must expand into per-iteration references.
+    const std::string path = "drcachesim_unit_tests.ranges.trace";
+    std::vector<trace_entry_t> entries = make_thread_entries(7, 2);
+    trace_entry_t *instr = &entries[3];
+    std::vector<trace_entry_t> range(4);
+    range[0].type = TRACE_TYPE_MARKER;
+    range[0].size = TRACE_MARKER_TYPE_MEMREF_RANGE;
+    range[0].addr = 16 << 1;
+    range[1].type = TRACE_TYPE_READ;
+    range[1].size = 4;
+    range[1].addr = 0x2000;
+    range[2].type = TRACE_TYPE_MARKER;
+    range[2].size = TRACE_MARKER_TYPE_MEMREF_RANGE;
+    range[2].addr = (8 << 1) | 1;
+    range[3].type = TRACE_TYPE_WRITE;
+    range[3].size = 2;
+    range[3].addr = 0x3000;
+    entries.insert(entries.begin() + (instr - &entries[0]) + 1, range.begin(),
+                   range.end());
+    {
+        std::ofstream out(path.c_str(), std::ofstream::binary);
+        out.write((char *)&entries[0], entries.size() * sizeof(entries[0]));
+    }
+    const addr_t expect[] = {0x1000, 0x2000, 0x2004, 0x2008, 0x200c,
+                             0x3006, 0x3004, 0x3002, 0x3000, 0x1004};
+    file_reader_t reader(path.c_str());
+    file_reader_t end;
+    if (!reader.init()) {
+        std::cerr << "drcachesim unit_test_memref_ranges failed to init\n";
+        exit(1);
+    }
+    size_t count = 0;
+    for (; reader != end; ++reader, ++count) {
+        const memref_t &ref = *reader;
+        if (ref.data.type == TRACE_TYPE_THREAD_EXIT)
+            continue;
+        if (count >= sizeof(expect) / sizeof(expect[0]) ||
+            ref.data.type == TRACE_TYPE_MARKER || ref.data.addr != expect[count] ||
+            (count > 0 && count < 9 && ref.data.pc != 0x1000)) {
+            std::cerr << "drcachesim unit_test_memref_ranges mismatch at " << count
+                      << "\n";
+            exit(1);
+        }
+    }
+    if (count != sizeof(expect) / sizeof(expect[0]) + 1) {
+        std::cerr << "drcachesim unit_test_memref_ranges failed\n";
+        exit(1);
+    }
+    // Skipping the first instruction must skip its ranges too.
+    file_reader_t skipper(path.c_str());
+    if (!skipper.init() || (*skipper).instr.addr != 0x1000 ||
+        (*skipper.skip_instructions(1)).instr.addr != 0x1004) {
+        std::cerr << "drcachesim unit_test_memref_ranges failed to skip\n";
+        exit(1);
+    }
+}
+
+#ifdef HAS_ZLIB
+void
+unit_test_chunked_trace()
+{
+    const std::string path = "drcachesim_unit_tests.chunked.trace";
+    const int num_instrs = 10000;
+    {
+        // Small chunks give us many chunk boundaries.
+        chunked_ostream_t out(path, 128);
+        std::vector<trace_entry_t> entries = make_thread_entries(42, num_instrs);
+        out.write((char *)&entries[0], entries.size() * sizeof(entries[0]));
+        if (!out) {
+            std::cerr << "drcachesim unit_test_chunked_trace failed to write\n";
+            exit(1);
+        }
+    }
+    chunked_file_reader_t reader(path.c_str());
+    chunked_file_reader_t end;
+    if (!chunked_file_reader_t::is_chunked_file(path) || !reader ||
+        !reader.is_complete() || !reader.init() || reader.get_index().size() < 2) {
+        std::cerr << "drcachesim unit_test_chunked_trace failed to init\n";
+        exit(1);
+    }
+    int count = 0;
+    for (; reader != end; ++reader) {
+        const memref_t &memref = *reader;
+        if (memref.instr.tid != 42 ||
+            (memref.instr.type == TRACE_TYPE_INSTR &&
+             memref.instr.addr != (addr_t)(0x1000 + count * 4))) {
+            std::cerr << "drcachesim unit_test_chunked_trace mismatch at " << count
+                      << "\n";
+            exit(1);
+        }
+        ++count;
+    }
+    // The instrs plus the thread exit.
+    if (count != num_instrs + 1) {
+        std::cerr << "drcachesim unit_test_chunked_trace failed\n";
+        exit(1);
+    }
+    // Seek both forward and backward via the index.
+    const int targets[] = {5000, 17, num_instrs - 1};
+    for (int target : targets) {
+        if (!reader.skip_to_instruction(target) ||
+            (*reader).instr.addr != (addr_t)(0x1000 + target * 4) ||
+            (*reader).instr.tid != 42 || (*reader).instr.pid != 1) {
+            std::cerr << "drcachesim unit_test_chunked_trace failed to skip to "
+                      << target << "\n";
+            exit(1);
+        }
+    }
+    if (reader.skip_to_instruction(num_instrs)) {
+        std::cerr << "drcachesim unit_test_chunked_trace skipped past the end\n";
+        exit(1);
+    }
+}
+#endif
+
+static std::vector<trace_entry_t>
+make_bundle_entries(memref_tid_t tid, int num_groups)
+{
+    // Each group is an instr fetch followed by a bundle of two more instrs and
+    // then an instr with a load.
+    std::vector<trace_entry_t> entries = make_thread_entries(tid, 0);
+    std::vector<trace_entry_t> body;
+    addr_t pc = 0x1000;
+    for (int i = 0; i < num_groups; i++) {
+        trace_entry_t entry;
+        entry.type = TRACE_TYPE_INSTR;
+        entry.size = 2;
+        entry.addr = pc;
+        body.push_back(entry);
+        entry.type = TRACE_TYPE_INSTR_BUNDLE;
+        entry.size = 2;
+        entry.length[0] = 3;
+        entry.length[1] = 5;
+        body.push_back(entry);
+        entry.type = TRACE_TYPE_INSTR;
+        entry.size = 4;
+        entry.addr = pc + 2 + 3 + 5;
+        body.push_back(entry);
+        entry.type = TRACE_TYPE_READ;
+        entry.size = 8;
+        entry.addr = 0x8000 + i * 8;
+        body.push_back(entry);
+        pc += 2 + 3 + 5 + 4;
+    }
+    // Insert before the thread exit and footer.
+    entries.insert(entries.end() - 2, body.begin(), body.end());
+    return entries;
+}
+
+static bool
+is_instr_memref(const memref_t &memref)
+{
+    return type_is_instr(memref.instr.type) ||
+        memref.instr.type == TRACE_TYPE_INSTR_NO_FETCH;
+}
+
+static void
+check_skip(reader_t &reader, reader_t &end, reader_t &expect, uint64_t skip,
+           const char *name)
+{
+    // We compare reader.skip_instructions() against plain iteration of expect.
+    reader.skip_instructions(skip);
+    uint64_t to_skip = skip;
+    if (skip > 0 && expect != end) {
+        if (is_instr_memref(*expect))
+            --to_skip;
+        for (++expect; expect != end; ++expect) {
+            if (!is_instr_memref(*expect))
+                continue;
+            if (to_skip == 0)
+                break;
+            --to_skip;
+        }
+    }
+    if ((reader == end) != (expect == end) ||
+        (reader != end &&
+         ((*reader).instr.type != (*expect).instr.type ||
+          (*reader).instr.addr != (*expect).instr.addr ||
+          (*reader).instr.size != (*expect).instr.size ||
+          (*reader).instr.tid != (*expect).instr.tid ||
+          reader.get_instruction_count() != expect.get_instruction_count()))) {
+        std::cerr << "drcachesim unit_test_skip_instructions " << name
+                  << " mismatch skipping " << skip << "\n";
+        exit(1);
+    }
+}
+
+static void
+compare_readers(reader_t &reader, reader_t &expect, reader_t &end, const char *name)
+{
+    if (!reader.init() || !expect.init()) {
+        std::cerr << "drcachesim compare_readers " << name
+                  << " failed to init\n";
+        exit(1);
+    }
+    for (; expect != end; ++reader, ++expect) {
+        if (reader == end || (*reader).instr.type != (*expect).instr.type ||
+            (*reader).instr.addr != (*expect).instr.addr ||
+            (*reader).instr.size != (*expect).instr.size ||
+            (*reader).instr.tid != (*expect).instr.tid ||
+            (*reader).instr.pid != (*expect).instr.pid) {
+            std::cerr << "drcachesim compare_readers " << name
+                      << " mismatch\n";
+            exit(1);
+        }
+    }
+    if (reader != end) {
+        std::cerr << "drcachesim compare_readers " << name << " too long\n";
+        exit(1);
+    }
+}
+
+void
+unit_test_compact_trace()
+{
+    const std::string path = "drcachesim_unit_tests.regular.trace";
+    const std::string compact_path = "drcachesim_unit_tests.compact.trace";
+    std::vector<trace_entry_t> entries = make_bundle_entries(42, 2000);
+    // Add a second thread with timestamps to exercise the per-thread predictions.
+    std::vector<trace_entry_t> other = make_thread_entries(43, 1000);
+    trace_entry_t marker;
+    marker.type = TRACE_TYPE_MARKER;
+    marker.size = TRACE_MARKER_TYPE_TIMESTAMP;
+    for (int i = 0; i < 4; i++) {
+        marker.addr = (addr_t)(0x12345678 + i * 1000);
+        other.insert(other.begin() + 3 + i * 250, marker);
+    }
+    // Interleave thread 43's entries, omitting its header and footer, into the
+    // middle of thread 42's, followed by a switch back to thread 42.
+    trace_entry_t back;
+    back.type = TRACE_TYPE_THREAD;
+    back.size = 0;
+    back.addr = 42;
+    other.erase(other.end() - 1);
+    other.erase(other.begin());
+    other.push_back(back);
+    entries.insert(entries.begin() + entries.size() / 2, other.begin(), other.end());
+    {
+        std::ofstream out(path.c_str(), std::ofstream::binary);
+        out.write((char *)&entries[0], entries.size() * sizeof(entries[0]));
+    }
+    {
+        // Odd-sized writes split entries across calls.
+        compact_ostream_t out(compact_path);
+        const char *data = (const char *)&entries[0];
+        size_t size = entries.size() * sizeof(entries[0]);
+        for (size_t pos = 0; pos < size; pos += 1001)
+            out.write(data + pos, std::min((size_t)1001, size - pos));
+        if (!out) {
+            std::cerr << "drcachesim unit_test_compact_trace failed to write\n";
+            exit(1);
+        }
+    }
+    std::ifstream regular(path.c_str(), std::ifstream::binary | std::ifstream::ate);
+    std::ifstream compact(compact_path.c_str(),
+                          std::ifstream::binary | std::ifstream::ate);
+    if (!compact_file_reader_t::is_compact_file(compact_path) ||
+        compact_file_reader_t::is_compact_file(path) ||
+        compact.tellg() * 3 > regular.tellg()) {
+        std::cerr << "drcachesim unit_test_compact_trace bad file\n";
+        exit(1);
+    }
+    {
+        compact_file_reader_t reader(compact_path.c_str());
+        file_reader_t expect(path.c_str());
+        file_reader_t end;
+        compare_readers(reader, expect, end, "compact");
+    }
+#ifdef HAS_ZLIB
+    // A gzipped compact file is read directly.
+    const std::string gz_path = "drcachesim_unit_tests.compact.trace.gz";
+    {
+        std::ifstream in(compact_path.c_str(), std::ifstream::binary);
+        std::string bytes((std::istreambuf_iterator<char>(in)),
+                          std::istreambuf_iterator<char>());
+        gzFile gz = gzopen(gz_path.c_str(), "wb");
+        gzwrite(gz, bytes.data(), (unsigned int)bytes.size());
+        gzclose(gz);
+    }
+    {
+        compact_file_reader_t reader(gz_path.c_str());
+        file_reader_t expect(path.c_str());
+        file_reader_t end;
+        if (!compact_file_reader_t::is_compact_file(gz_path)) {
+            std::cerr << "drcachesim unit_test_compact_trace gz not detected\n";
+            exit(1);
+        }
+        compare_readers(reader, expect, end, "gzip");
+    }
+#endif
+}
+
+// Appends iterations of a loop of an instruction and a bundle, an instruction
+// with a load, and a branch with a store, whose data addresses are those
+// returned by addr().
+template <typename addr_func_t>
+static void
+append_loop(std::vector<trace_entry_t> *entries, addr_t pc, int iterations,
+            addr_func_t addr)
+{
+    for (int i = 0; i < iterations; i++) {
+        trace_entry_t entry;
+        entry.type = TRACE_TYPE_INSTR;
+        entry.size = 4;
+        entry.addr = pc;
+        entries->push_back(entry);
+        entry.type = TRACE_TYPE_INSTR_BUNDLE;
+        entry.size = 2;
+        entry.addr = 0;
+        entry.length[0] = 3;
+        entry.length[1] = 5;
+        entries->push_back(entry);
+        entry.type = TRACE_TYPE_INSTR;
+        entry.size = 4;
+        entry.addr = pc + 4 + 3 + 5;
+        entries->push_back(entry);
+        entry.type = TRACE_TYPE_READ;
+        entry.size = 8;
+        entry.addr = addr(i, 0);
+        entries->push_back(entry);
+        entry.type = TRACE_TYPE_INSTR_CONDITIONAL_JUMP;
+        entry.size = 2;
+        entry.addr = pc + 4 + 3 + 5 + 4;
+        entries->push_back(entry);
+        entry.type = TRACE_TYPE_WRITE;
+        entry.size = 4;
+        entry.addr = addr(i, 1);
+        entries->push_back(entry);
+    }
+}
+
+void
+unit_test_repeat_trace()
+{
+    const std::string path = "drcachesim_unit_tests.unrepeated.trace";
+    const std::string repeat_path = "drcachesim_unit_tests.repeat.trace";
+    std::vector<trace_entry_t> entries = make_thread_entries(42, 0);
+    std::vector<trace_entry_t> body;
+    // A loop walking one array up and another down.
+    append_loop(&body, 0x1000, 1000, [](int i, int op) {
+        return op == 0 ? (addr_t)(0x10000 + i * 8) : (addr_t)(0x40000 - i * 16);
+    });
+    // A loop with irregular addresses, which cannot be repeated, then a marker
+    // to end the run, and a loop too short to be worth repeating.
+    append_loop(&body, 0x2000, 50, [](int i, int op) {
+        return (addr_t)(0x10000 + (i * i) % 97 * 8 + op);
+    });
+    trace_entry_t marker;
+    marker.type = TRACE_TYPE_MARKER;
+    marker.size = TRACE_MARKER_TYPE_TIMESTAMP;
+    marker.addr = 0x12345678;
+    body.push_back(marker);
+    append_loop(&body, 0x3000, 1, [](int i, int op) { return (addr_t)0x20000; });
+    // A loop whose strides change part way through an iteration.
+    append_loop(&body, 0x4000, 500, [](int i, int op) {
+        return (addr_t)(0x30000 + i * (i < 300 || op == 0 ? 64 : 32));
+    });
+    entries.insert(entries.end() - 2, body.begin(), body.end());
+    {
+        std::ofstream out(path.c_str(), std::ofstream::binary);
+        out.write((char *)&entries[0], entries.size() * sizeof(entries[0]));
+    }
+    {
+        // Odd-sized writes split entries across calls.
+        repeat_ostream_t out(new std::ofstream(repeat_path.c_str(),
+                                               std::ofstream::binary));
+        const char *data = (const char *)&entries[0];
+        size_t size = entries.size() * sizeof(entries[0]);
+        for (size_t pos = 0; pos < size; pos += 1001)
+            out.write(data + pos, std::min((size_t)1001, size - pos));
+        if (!out) {
+            std::cerr << "drcachesim unit_test_repeat_trace failed to write\n";
+            exit(1);
+        }
+    }
+    std::ifstream regular(path.c_str(), std::ifstream::binary | std::ifstream::ate);
+    std::ifstream repeated(repeat_path.c_str(),
+                           std::ifstream::binary | std::ifstream::ate);
+    if (repeated.tellg() * 5 > regular.tellg()) {
+        std::cerr << "drcachesim unit_test_repeat_trace bad size\n";
+        exit(1);
+    }
+    {
+        file_reader_t reader(repeat_path.c_str());
+        file_reader_t expect(path.c_str());
+        file_reader_t end;
+        compare_readers(reader, expect, end, "repeat");
+    }
+    // Skips land both inside and across repeated iterations.
+    const uint64_t skips[] = {1, 2, 7, 1, 1999, 3, 1500, 1, 2, 10000};
+    file_reader_t reader(repeat_path.c_str());
+    file_reader_t expect(path.c_str());
+    file_reader_t end;
+    if (!reader.init() || !expect.init()) {
+        std::cerr << "drcachesim unit_test_repeat_trace failed to init\n";
+        exit(1);
+    }
+    for (uint64_t skip : skips)
+        check_skip(reader, end, expect, skip, "repeat");
+}
+
+void
+unit_test_skip_instructions()
+{
+    const std::string path = "drcachesim_unit_tests.skip.trace";
+    const int num_groups = 20;
+    std::vector<trace_entry_t> entries = make_bundle_entries(42, num_groups);
+    {
+        std::ofstream out(path.c_str(), std::ofstream::binary);
+        out.write((char *)&entries[0], entries.size() * sizeof(entries[0]));
+    }
+    // Skip from the start by every count, landing both on fetches and inside
+    // bundles.
+    for (uint64_t skip = 0; skip <= num_groups * 4 + 1; skip++) {
+        file_reader_t reader(path.c_str());
+        file_reader_t expect(path.c_str());
+        file_reader_t end;
+        if (!reader.init() || !expect.init()) {
+            std::cerr << "drcachesim unit_test_skip_instructions failed to init\n";
+            exit(1);
+        }
+        check_skip(reader, end, expect, skip, "file");
+    }
+    // Repeated skips from the middle of the trace.
+    {
+        file_reader_t reader(path.c_str());
+        file_reader_t expect(path.c_str());
+        file_reader_t end;
+        reader.init();
+        expect.init();
+        ++reader;
+        ++expect;
+        for (uint64_t skip = 1; reader != end; skip = skip % 4 + 1)
+            check_skip(reader, end, expect, skip, "file repeated");
+    }
+#ifdef HAS_ZLIB
+    // The chunked reader uses its index for skips past the current chunk.
+    const std::string chunked_path = "drcachesim_unit_tests.skip_chunked.trace";
+    {
+        chunked_ostream_t out(chunked_path, 8);
+        out.write((char *)&entries[0], entries.size() * sizeof(entries[0]));
+    }
+    const uint64_t skips[] = {1, 2, 14, 1, 9, 3, 100};
+    chunked_file_reader_t reader(chunked_path.c_str());
+    file_reader_t expect(path.c_str());
+    file_reader_t end;
+    if (!reader.init() || !expect.init()) {
+        std::cerr << "drcachesim unit_test_skip_instructions failed to init chunked\n";
+        exit(1);
+    }
+    for (uint64_t skip : skips)
+        check_skip(reader, end, expect, skip, "chunked");
+#endif
+}
+
+#ifdef HAS_ZLIB
+// The tracer's -raw_compress writes each buffer as a separate gzip member.
+void
+unit_test_gzip_istream()
+{
+    const std::string path = "drcachesim_unit_tests.raw.gz";
+    const size_t num_words = 100000;
+    const size_t piece_words = 4096 + 3;
+    std::vector<uint64_t> words(num_words);
+    for (size_t i = 0; i < num_words; i++)
+        words[i] = i * 0x9e3779b97f4a7c15ULL >> (i % 48);
+    {
+        std::ofstream out(path.c_str(), std::ofstream::binary);
+        std::vector<unsigned char> compressed;
+        for (size_t start = 0; start < num_words; start += piece_words) {
+            size_t count = std::min(piece_words, num_words - start);
+            z_stream zstream = {};
+            deflateInit2(&zstream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8,
+                         Z_DEFAULT_STRATEGY);
+            compressed.resize(deflateBound(&zstream, count * sizeof(uint64_t)));
+            zstream.next_in = (Bytef *)&words[start];
+            zstream.avail_in = (uInt)(count * sizeof(uint64_t));
+            zstream.next_out = &compressed[0];
+            zstream.avail_out = (uInt)compressed.size();
+            if (deflate(&zstream, Z_FINISH) != Z_STREAM_END) {
+                std::cerr << "drcachesim unit_test_gzip_istream failed to compress\n";
+                exit(1);
+            }
+            out.write((char *)&compressed[0], compressed.size() - zstream.avail_out);
+            deflateEnd(&zstream);
+        }
+    }
+    gzip_istream_t in(path);
+    std::vector<uint64_t> read_words(num_words + 1000);
+    // Read in pieces which do not line up with the members.
+    size_t total = 0;
+    while (in.read((char *)&read_words[total], 1000 * sizeof(uint64_t)))
+        total += 1000;
+    total += (size_t)in.gcount() / sizeof(uint64_t);
+    read_words.resize(num_words);
+    if (total != num_words || read_words != words || !in.eof()) {
+        std::cerr << "drcachesim unit_test_gzip_istream failed\n";
+        exit(1);
+    }
+}
+#endif
+
+// Slices the interleaved refs of two threads, then checks what is read back.
+static void
+check_trace_slice(const std::string &path, unsigned int chunk_entries)
+{
+    std::vector<memref_t> refs;
+    for (memref_tid_t tid = 1; tid <= 2; ++tid)
+        refs.push_back(make_marker(tid, TRACE_MARKER_TYPE_TIMESTAMP, 10));
+    for (int i = 0; i < 20; ++i) {
+        for (memref_tid_t tid = 1; tid <= 2; ++tid) {
+            addr_t pc = (tid == 1 ? 0x1000 : 0x2000) + i * 4;
+            refs.push_back(make_instr(tid, pc));
+            memref_t data;
+            data.data.type = TRACE_TYPE_READ;
+            data.data.pid = 1;
+            data.data.tid = tid;
+            data.data.addr = 0x9000 + i * 8;
+            data.data.size = 8;
+            data.data.pc = pc;
+            refs.push_back(data);
+        }
+    }
+    for (memref_tid_t tid = 1; tid <= 2; ++tid) {
+        memref_t exit_ref;
+        exit_ref.exit.type = TRACE_TYPE_THREAD_EXIT;
+        exit_ref.exit.pid = 1;
+        exit_ref.exit.tid = tid;
+        refs.push_back(exit_ref);
+    }
+    trace_slice_knobs_t knobs;
+    knobs.output_file = path;
+    knobs.tids.push_back(1);
+    // Thread 1's instruction i has ordinal 2*i, so this keeps i in [2, 10).
+    knobs.instr_start = 4;
+    knobs.pc_ranges.push_back(std::make_pair(0x1000, 0x1000 + 10 * 4));
+    knobs.chunk_entries = chunk_entries;
+    analysis_tool_t *tool = trace_slice_tool_create(knobs);
+    std::stringstream out;
+    std::streambuf *old = std::cerr.rdbuf(out.rdbuf());
+    bool res = !!*tool && tool->process_memrefs(&refs[0], refs.size()) &&
+        tool->print_results();
+    std::cerr.rdbuf(old);
+    delete tool;
+    if (!res) {
+        std::cerr << "drcachesim unit_test_trace_slice failed to write: " << out.str();
+        exit(1);
+    }
+    reader_t *reader;
+#ifdef HAS_ZLIB
+    if (chunk_entries > 0)
+        reader = new chunked_file_reader_t(path.c_str());
+    else
+#endif
+        reader = new file_reader_t(path.c_str());
+    file_reader_t end;
+    if (!reader->init()) {
+        std::cerr << "drcachesim unit_test_trace_slice failed to init\n";
+        exit(1);
+    }
+    int count = 0;
+    for (; *reader != end; ++*reader, ++count) {
+        const memref_t &memref = **reader;
+        int i = 2 + count / 2;
+        bool ok = memref.data.tid == 1 && memref.data.pid == 1;
+        if (count == 16)
+            ok = ok && memref.exit.type == TRACE_TYPE_THREAD_EXIT;
+        else if (count % 2 == 0) {
+            ok = ok && memref.instr.type == TRACE_TYPE_INSTR &&
+                memref.instr.addr == (addr_t)(0x1000 + i * 4);
+        } else {
+            ok = ok && memref.data.type == TRACE_TYPE_READ &&
+                memref.data.addr == (addr_t)(0x9000 + i * 8) &&
+                memref.data.pc == (addr_t)(0x1000 + i * 4);
+        }
+        if (!ok) {
+            std::cerr << "drcachesim unit_test_trace_slice mismatch at " << count
+                      << "\n";
+            exit(1);
+        }
+    }
+    delete reader;
+    if (count != 17 || out.str().find("Kept 17 of 84 records, 8 of 40 instructions, "
+                                      "from 1 of 2 threads") == std::string::npos) {
+        std::cerr << "drcachesim unit_test_trace_slice failed: " << out.str();
+        exit(1);
+    }
+}
+
+void
+unit_test_trace_slice()
+{
+    check_trace_slice("drcachesim_unit_tests.slice.trace", 0);
+#ifdef HAS_ZLIB
+    check_trace_slice("drcachesim_unit_tests.slice.chunked.trace", 4);
+#endif
+}
+
+// Sets up a layout whose module, heap and stacks are at the given bases.
+static void
+add_canonical_regions(addr_canonicalizer_t &canon, uint64_t mod, uint64_t heap,
+                      uint64_t main_stack, uint64_t thread_stack)
+{
+    canon.add_module(mod, 0x10000, mod, 0);
+    // A second segment of the same module.
+    canon.add_module(mod + 0x20000, 0x1000, mod, 0);
+    canon.add_module(mod + 0x100000, 0x8000, mod + 0x100000, 2);
+    canon.add_heap(heap);
+    canon.add_heap(heap);
+    canon.add_stack(thread_stack);
+    canon.add_stack(main_stack);
+    canon.finalize();
+}
+
+void
+unit_test_addr_canonicalizer()
+{
+    // Two runs of the same program with different randomized bases.
+    addr_canonicalizer_t run1, run2;
+    add_canonical_regions(run1, 0x555555554000ULL, 0x555555600000ULL,
+                          0x7ffd12340008ULL, 0x7f1234567010ULL);
+    add_canonical_regions(run2, 0x561234000000ULL, 0x561235000000ULL,
+                          0x7ffe00001238ULL, 0x7f0000003040ULL);
+    // Offsets from the bases below, the first two of which are the module start.
+    const int64_t offsets[][5] = {
+        {0x10, 0x20010, 0x0, -0x100, -0x8},
+        {0xfff8, 0x20ff0, 0x123456, 0x800, -0x12345},
+        {0x100004, 0x100010, 0x10000000, -0x1000000, 0x40},
+    };
+    const uint64_t bases1[] = {0x555555554000ULL, 0x555555554000ULL, 0x555555600000ULL,
+                               0x7ffd12340008ULL, 0x7f1234567010ULL};
+    const uint64_t bases2[] = {0x561234000000ULL, 0x561234000000ULL, 0x561235000000ULL,
+                               0x7ffe00001238ULL, 0x7f0000003040ULL};
+    std::vector<uint64_t> seen;
+    for (const auto &row : offsets) {
+        for (int i = 0; i < 5; ++i) {
+            uint64_t canon1 = run1.canonicalize(bases1[i] + row[i]);
+            uint64_t canon2 = run2.canonicalize(bases2[i] + row[i]);
+            if (canon1 != canon2 ||
+                (canon1 & addr_canonicalizer_t::CANONICAL_FLAG) == 0) {
+                std::cerr << "drcachesim unit_test_addr_canonicalizer failed: "
+                          << "region " << i << " offset " << row[i] << "\n";
+                exit(1);
+            }
+            seen.push_back(canon1);
+        }
+    }
+    // Distinct addresses must stay distinct across the regions.
+    std::sort(seen.begin(), seen.end());
+    if (std::unique(seen.begin(), seen.end()) != seen.end() ||
+        // Addresses outside every region are left alone.
+        run1.canonicalize(0x1000) != 0x1000 ||
+        run1.canonicalize(0x555555554000ULL + 0x18000) != 0x555555554000ULL + 0x18000) {
+        std::cerr << "drcachesim unit_test_addr_canonicalizer failed\n";
+        exit(1);
+    }
+}
 
 int
 main(int argc, const char *argv[])
 {
     unit_test_warmup_fraction();
     unit_test_warmup_refs();
+    unit_test_prefetchers();
+    unit_test_replace_policies();
+    unit_test_parallel_cache_sim();
+    unit_test_warmup_state();
+    unit_test_stats_file();
+    unit_test_coherence();
+    unit_test_miss_hotspots();
+    unit_test_cache_config();
+    unit_test_timing();
+    unit_test_func_stats();
+    unit_test_cache_sweep();
+    unit_test_miss_stream();
+    unit_test_reuse_distance_tree();
+    unit_test_reuse_distance_sampling();
+    unit_test_reuse_time_bounded();
+    unit_test_regions();
+    unit_test_invariant_checker();
+    unit_test_report_symbolizer();
+    unit_test_flat_hash_map();
+    unit_test_cardinality_sketch();
+    unit_test_page_sizes();
+    unit_test_parallel_shards();
+    unit_test_thread_subset();
+    unit_test_sched_threads();
+    unit_test_mmap_reader();
+    unit_test_memory_reader();
+    unit_test_memref_ranges();
+#ifdef LINUX
+    unit_test_shm_ring();
+#endif
+    unit_test_batched_memrefs();
+    unit_test_pipelined_tools();
+    unit_test_online_shards();
+    unit_test_skip_instructions();
+    unit_test_compact_trace();
+    unit_test_repeat_trace();
+    unit_test_trace_slice();
+    unit_test_addr_canonicalizer();
+#ifdef HAS_ZLIB
+    unit_test_chunked_trace();
+    unit_test_gzip_istream();
+#endif
     return 0;
 }
@@ -47,9 +47,7 @@ basic_counts_tool_create(unsigned int verbose)
 }
 
 basic_counts_t::basic_counts_t(unsigned int verbose) :
-    total_threads(0), total_instrs(0), total_instrs_nofetch(0), total_prefetches(0),
-    total_loads(0), total_stores(0), total_sched_markers(0), total_xfer_markers(0),
-    total_other_markers(0), knob_verbose(verbose)
+    knob_verbose(verbose)
 {
     // Empty.
 }
@@ -59,82 +57,143 @@ basic_counts_t::~basic_counts_t()
     // Empty.
 }
 
-bool
-basic_counts_t::process_memref(const memref_t &memref)
+void
+basic_counts_t::count_memref(counters_t &counters, const memref_t &memref)
 {
   if (type_is_instr(memref.instr.type)) {
-      ++thread_instrs[memref.instr.tid];
-      ++total_instrs;
+      ++counters.instrs;
   } else if (memref.data.type == TRACE_TYPE_INSTR_NO_FETCH) {
-      ++thread_instrs_nofetch[memref.instr.tid];
-      ++total_instrs_nofetch;
+      ++counters.instrs_nofetch;
   } else if (type_is_prefetch(memref.data.type)) {
-      ++thread_prefetches[memref.data.tid];
-      ++total_prefetches;
+      ++counters.prefetches;
   } else if (memref.data.type == TRACE_TYPE_READ) {
-      ++thread_loads[memref.data.tid];
-      ++total_loads;
+      ++counters.loads;
   } else if (memref.data.type == TRACE_TYPE_WRITE) {
-      ++thread_stores[memref.data.tid];
-      ++total_stores;
+      ++counters.stores;
   } else if (memref.marker.type == TRACE_TYPE_MARKER) {
       if (memref.marker.marker_type == TRACE_MARKER_TYPE_TIMESTAMP ||
           memref.marker.marker_type == TRACE_MARKER_TYPE_CPU_ID) {
-          ++thread_sched_markers[memref.data.tid];
-          ++total_sched_markers;
+          ++counters.sched_markers;
       } else if (memref.marker.marker_type == TRACE_MARKER_TYPE_KERNEL_EVENT ||
                  memref.marker.marker_type == TRACE_MARKER_TYPE_KERNEL_XFER) {
-          ++thread_xfer_markers[memref.data.tid];
-          ++total_xfer_markers;
+          ++counters.xfer_markers;
+      } else if (memref.marker.marker_type == TRACE_MARKER_TYPE_STACK_BASE ||
+                 memref.marker.marker_type == TRACE_MARKER_TYPE_HEAP_BASE) {
+          // These describe the address space layout rather than thread events.
       } else {
-          ++thread_other_markers[memref.data.tid];
-          ++total_other_markers;
+          ++counters.other_markers;
       }
   } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
-      ++total_threads;
+      ++counters.threads;
   }
-  return true;
+}
+
+bool
+basic_counts_t::process_memref(const memref_t &memref)
+{
+    count_memref(thread_counters[memref.data.tid], memref);
+    return true;
+}
+
+bool
+basic_counts_t::process_memrefs(const memref_t *memrefs, size_t count)
+{
+    // Consecutive entries are usually from the same thread, so we only look up
+    // the thread's counters when the thread changes.
+    memref_tid_t tid = 0;
+    counters_t *counters = NULL;
+    for (size_t i = 0; i < count; ++i) {
+        if (counters == NULL || memrefs[i].data.tid != tid) {
+            tid = memrefs[i].data.tid;
+            counters = &thread_counters[tid];
+        }
+        count_memref(*counters, memrefs[i]);
+    }
+    return true;
+}
+
+bool
+basic_counts_t::parallel_shard_supported()
+{
+    return true;
+}
+
+void *
+basic_counts_t::parallel_shard_init(int shard_index)
+{
+    return new shard_data_t;
+}
+
+bool
+basic_counts_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
+{
+    shard_data_t *shard = reinterpret_cast<shard_data_t*>(shard_data);
+    shard->tid = memref.data.tid;
+    count_memref(shard->counters, memref);
+    return true;
+}
+
+bool
+basic_counts_t::parallel_shard_exit(void *shard_data)
+{
+    shard_data_t *shard = reinterpret_cast<shard_data_t*>(shard_data);
+    {
+        std::lock_guard<std::mutex> guard(merge_mutex);
+        thread_counters[shard->tid] += shard->counters;
+    }
+    delete shard;
+    return true;
 }
 
 static bool
 cmp_val(const std::pair<memref_tid_t, int_least64_t> &l,
         const std::pair<memref_tid_t, int_least64_t> &r)
 {
-    return (l.second > r.second);
+    // We break ties by thread id so the output does not depend on the table layout.
+    if (l.second != r.second)
+        return l.second > r.second;
+    return l.first < r.first;
 }
 
 bool
 basic_counts_t::print_results() {
+    counters_t total;
+    for (const auto &keyvals : thread_counters)
+        total += keyvals.second;
     std::cerr << TOOL_NAME << " results:\n";
     std::cerr << "Total counts:\n";
-    std::cerr << std::setw(12) << total_instrs << " total (fetched) instructions\n";
-    std::cerr << std::setw(12) << total_instrs_nofetch <<
+    std::cerr << std::setw(12) << total.instrs << " total (fetched) instructions\n";
+    std::cerr << std::setw(12) << total.instrs_nofetch <<
         " total non-fetched instructions\n";
-    std::cerr << std::setw(12) << total_prefetches << " total prefetches\n";
-    std::cerr << std::setw(12) << total_loads << " total data loads\n";
-    std::cerr << std::setw(12) << total_stores << " total data stores\n";
-    std::cerr << std::setw(12) << total_threads << " total threads\n";
-    std::cerr << std::setw(12) << total_sched_markers << " total scheduling markers\n";
-    std::cerr << std::setw(12) << total_xfer_markers << " total transfer markers\n";
-    std::cerr << std::setw(12) << total_other_markers << " total other markers\n";
+    std::cerr << std::setw(12) << total.prefetches << " total prefetches\n";
+    std::cerr << std::setw(12) << total.loads << " total data loads\n";
+    std::cerr << std::setw(12) << total.stores << " total data stores\n";
+    std::cerr << std::setw(12) << total.threads << " total threads\n";
+    std::cerr << std::setw(12) << total.sched_markers << " total scheduling markers\n";
+    std::cerr << std::setw(12) << total.xfer_markers << " total transfer markers\n";
+    std::cerr << std::setw(12) << total.other_markers << " total other markers\n";
 
     // Print the threads sorted by instrs.
-    std::vector<std::pair<memref_tid_t, int_least64_t>> sorted(thread_instrs.begin(),
-                                                               thread_instrs.end());
+    std::vector<std::pair<memref_tid_t, int_least64_t>> sorted;
+    for (const auto &keyvals : thread_counters) {
+        if (keyvals.second.instrs > 0)
+            sorted.push_back(std::make_pair(keyvals.first, keyvals.second.instrs));
+    }
     std::sort(sorted.begin(), sorted.end(), cmp_val);
     for (const auto& keyvals : sorted) {
         memref_tid_t tid = keyvals.first;
+        const counters_t &counters = thread_counters[tid];
         std::cerr << "Thread " << tid << " counts:\n";
-        std::cerr << std::setw(12) << thread_instrs[tid] << " (fetched) instructions\n";
-        std::cerr << std::setw(12) << thread_instrs_nofetch[tid] <<
+        std::cerr << std::setw(12) << counters.instrs << " (fetched) instructions\n";
+        std::cerr << std::setw(12) << counters.instrs_nofetch <<
             " non-fetched instructions\n";
-        std::cerr << std::setw(12) << thread_prefetches[tid] << " prefetches\n";
-        std::cerr << std::setw(12) << thread_loads[tid] << " data loads\n";
-        std::cerr << std::setw(12) << thread_stores[tid] << " data stores\n";
-        std::cerr << std::setw(12) << thread_sched_markers[tid] <<
+        std::cerr << std::setw(12) << counters.prefetches << " prefetches\n";
+        std::cerr << std::setw(12) << counters.loads << " data loads\n";
+        std::cerr << std::setw(12) << counters.stores << " data stores\n";
+        std::cerr << std::setw(12) << counters.sched_markers <<
             " scheduling markers\n";
-        std::cerr << std::setw(12) << thread_xfer_markers[tid] << " transfer markers\n";
-        std::cerr << std::setw(12) << thread_other_markers[tid] << " other markers\n";
+        std::cerr << std::setw(12) << counters.xfer_markers << " transfer markers\n";
+        std::cerr << std::setw(12) << counters.other_markers << " other markers\n";
     }
     return true;
 }
@@ -33,10 +33,11 @@
 #ifndef _BASIC_COUNTS_H_
 #define _BASIC_COUNTS_H_ 1
 
-#include <unordered_map>
+#include <mutex>
 #include <string>
 
 #include "analysis_tool.h"
+#include "flat_hash_map.h"
 
 class basic_counts_t : public analysis_tool_t
 {
@@ -44,26 +45,52 @@ class basic_counts_t : public analysis_tool_t
     basic_counts_t(unsigned int verbose);
     virtual ~basic_counts_t();
     virtual bool process_memref(const memref_t &memref);
+    virtual bool process_memrefs(const memref_t *memrefs, size_t count);
     virtual bool print_results();
+    virtual bool parallel_shard_supported();
+    virtual void * parallel_shard_init(int shard_index);
+    virtual bool parallel_shard_exit(void *shard_data);
+    virtual bool parallel_shard_memref(void *shard_data, const memref_t &memref);
 
  protected:
-    int_least64_t total_threads;
-    int_least64_t total_instrs;
-    int_least64_t total_instrs_nofetch;
-    int_least64_t total_prefetches;
-    int_least64_t total_loads;
-    int_least64_t total_stores;
-    int_least64_t total_sched_markers;
-    int_least64_t total_xfer_markers;
-    int_least64_t total_other_markers;
-    std::unordered_map<memref_tid_t, int_least64_t> thread_instrs;
-    std::unordered_map<memref_tid_t, int_least64_t> thread_instrs_nofetch;
-    std::unordered_map<memref_tid_t, int_least64_t> thread_prefetches;
-    std::unordered_map<memref_tid_t, int_least64_t> thread_loads;
-    std::unordered_map<memref_tid_t, int_least64_t> thread_stores;
-    std::unordered_map<memref_tid_t, int_least64_t> thread_sched_markers;
-    std::unordered_map<memref_tid_t, int_least64_t> thread_xfer_markers;
-    std::unordered_map<memref_tid_t, int_least64_t> thread_other_markers;
+    struct counters_t {
+        counters_t() : threads(0), instrs(0), instrs_nofetch(0), prefetches(0),
+                       loads(0), stores(0), sched_markers(0), xfer_markers(0),
+                       other_markers(0) {}
+        counters_t &operator+=(const counters_t &rhs) {
+            threads += rhs.threads;
+            instrs += rhs.instrs;
+            instrs_nofetch += rhs.instrs_nofetch;
+            prefetches += rhs.prefetches;
+            loads += rhs.loads;
+            stores += rhs.stores;
+            sched_markers += rhs.sched_markers;
+            xfer_markers += rhs.xfer_markers;
+            other_markers += rhs.other_markers;
+            return *this;
+        }
+        int_least64_t threads;
+        int_least64_t instrs;
+        int_least64_t instrs_nofetch;
+        int_least64_t prefetches;
+        int_least64_t loads;
+        int_least64_t stores;
+        int_least64_t sched_markers;
+        int_least64_t xfer_markers;
+        int_least64_t other_markers;
+    };
+    struct shard_data_t {
+        shard_data_t() : tid(0) {}
+        memref_tid_t tid;
+        counters_t counters;
+    };
+
+    // Shared by the serial and parallel paths.
+    static void count_memref(counters_t &counters, const memref_t &memref);
+
+    flat_hash_map_t<memref_tid_t, counters_t> thread_counters;
+    // Protects thread_counters when merging shards.
+    std::mutex merge_mutex;
 
     unsigned int knob_verbose;
 
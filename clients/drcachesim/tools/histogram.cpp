@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2016-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2016-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -59,25 +59,69 @@ histogram_t::~histogram_t()
 {
 }
 
-bool
-histogram_t::process_memref(const memref_t &memref)
+void
+histogram_t::add_memref(line_map_t &imap, line_map_t &dmap, const memref_t &memref)
 {
     if (type_is_instr(memref.instr.type) ||
         memref.instr.type == TRACE_TYPE_PREFETCH_INSTR)
-        ++icache_map[memref.instr.addr >> line_size_bits];
+        ++imap[memref.instr.addr >> line_size_bits];
     else if (memref.data.type == TRACE_TYPE_READ ||
              memref.data.type == TRACE_TYPE_WRITE ||
              // We may potentially handle prefetches differently.
              // TRACE_TYPE_PREFETCH_INSTR is handled above.
              type_is_prefetch(memref.data.type))
-        ++dcache_map[memref.data.addr >> line_size_bits];
+        ++dmap[memref.data.addr >> line_size_bits];
+}
+
+bool
+histogram_t::process_memref(const memref_t &memref)
+{
+    add_memref(icache_map, dcache_map, memref);
+    return true;
+}
+
+bool
+histogram_t::parallel_shard_supported()
+{
+    return true;
+}
+
+void *
+histogram_t::parallel_shard_init(int shard_index)
+{
+    return new shard_data_t;
+}
+
+bool
+histogram_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
+{
+    shard_data_t *shard = reinterpret_cast<shard_data_t*>(shard_data);
+    add_memref(shard->icache_map, shard->dcache_map, memref);
+    return true;
+}
+
+bool
+histogram_t::parallel_shard_exit(void *shard_data)
+{
+    shard_data_t *shard = reinterpret_cast<shard_data_t*>(shard_data);
+    {
+        std::lock_guard<std::mutex> guard(merge_mutex);
+        for (const auto &keyvals : shard->icache_map)
+            icache_map[keyvals.first] += keyvals.second;
+        for (const auto &keyvals : shard->dcache_map)
+            dcache_map[keyvals.first] += keyvals.second;
+    }
+    delete shard;
     return true;
 }
 
 bool cmp(const std::pair<addr_t, uint64_t> &l,
          const std::pair<addr_t, uint64_t> &r)
 {
-    return l.second > r.second;
+    // We break ties by address so the output does not depend on the table layout.
+    if (l.second != r.second)
+        return l.second > r.second;
+    return l.first < r.first;
 }
 
 bool
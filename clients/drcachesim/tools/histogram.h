@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2016-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2016-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -36,9 +36,10 @@
 #ifndef _HISTOGRAM_H_
 #define _HISTOGRAM_H_ 1
 
-#include <unordered_map>
+#include <mutex>
 #include <string>
 #include "analysis_tool.h"
+#include "flat_hash_map.h"
 #include "memref.h"
 
 class histogram_t : public analysis_tool_t
@@ -50,10 +51,27 @@ class histogram_t : public analysis_tool_t
     virtual ~histogram_t();
     virtual bool process_memref(const memref_t &memref);
     virtual bool print_results();
+    virtual bool parallel_shard_supported();
+    virtual void * parallel_shard_init(int shard_index);
+    virtual bool parallel_shard_exit(void *shard_data);
+    virtual bool parallel_shard_memref(void *shard_data, const memref_t &memref);
 
  protected:
-    std::unordered_map<addr_t, uint64_t> icache_map;
-    std::unordered_map<addr_t, uint64_t> dcache_map;
+    // Traces can touch hundreds of millions of lines, so we use a flat table
+    // rather than a node per line.
+    typedef flat_hash_map_t<addr_t, uint64_t> line_map_t;
+
+    struct shard_data_t {
+        line_map_t icache_map;
+        line_map_t dcache_map;
+    };
+
+    void add_memref(line_map_t &imap, line_map_t &dmap, const memref_t &memref);
+
+    line_map_t icache_map;
+    line_map_t dcache_map;
+    // Protects icache_map and dcache_map when merging shards.
+    std::mutex merge_mutex;
 
     unsigned int knob_line_size;
     unsigned int knob_report_top; /* most accessed lines */
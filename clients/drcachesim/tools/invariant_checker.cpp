@@ -0,0 +1,237 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include "invariant_checker.h"
+#include "../common/utils.h"
+
+const std::string invariant_checker_t::TOOL_NAME = "Trace invariant checker";
+
+analysis_tool_t *
+invariant_checker_create(const invariant_checker_knobs_t &knobs)
+{
+    return new invariant_checker_t(knobs);
+}
+
+invariant_checker_t::invariant_checker_t(const invariant_checker_knobs_t &knobs_) :
+    knobs(knobs_), last_tid(0), last_thread(NULL), last_was_branch(false),
+    shard_records(0), shard_threads(0)
+{
+}
+
+invariant_checker_t::~invariant_checker_t()
+{
+}
+
+void
+invariant_checker_t::report_violation(report_t &report, const thread_t &thread,
+                                      memref_tid_t tid, const std::string &message)
+{
+    ++report.count;
+    if (report.first.size() >= knobs.max_reports)
+        return;
+    violation_t violation;
+    violation.tid = tid;
+    violation.record = thread.records;
+    violation.instr = thread.instrs;
+    violation.message = message;
+    report.first.push_back(violation);
+    if (knobs.verbose >= 1) {
+        std::cerr << "Thread " << tid << " record " << thread.records << ": "
+                  << message << "\n";
+    }
+}
+
+// The per-thread checks, shared by the serial and parallel paths.  This is kept
+// to a few compares per record so that checking keeps up with the reader.
+void
+invariant_checker_t::check_memref(thread_t &thread, report_t &report,
+                                  const memref_t &memref)
+{
+    ++thread.records;
+    if (thread.exited) {
+        report_violation(report, thread, memref.data.tid, "record after thread exit");
+        // We report only the first such record.
+        thread.exited = false;
+    }
+    if (type_is_instr(memref.instr.type) ||
+        memref.instr.type == TRACE_TYPE_INSTR_NO_FETCH) {
+        ++thread.instrs;
+        // Non-explicit control flow (i.e., kernel-mediated) is indicated by
+        // markers, which clear have_prev.
+        if (thread.have_prev && !type_is_instr_branch((trace_type_t)thread.prev_type) &&
+            thread.prev_type != TRACE_TYPE_INSTR_SYSENTER &&
+            // Regular fall-through.
+            thread.prev_pc + thread.prev_size != memref.instr.addr &&
+            // String loop.
+            !(thread.prev_pc == memref.instr.addr &&
+              memref.instr.type == TRACE_TYPE_INSTR_NO_FETCH)) {
+            std::ostringstream message;
+            message << "instruction " << (void *)memref.instr.addr
+                    << " does not follow non-branch " << (void *)thread.prev_pc;
+            report_violation(report, thread, memref.instr.tid, message.str());
+        }
+        thread.prev_pc = memref.instr.addr;
+        thread.prev_size = memref.instr.size;
+        thread.prev_type = memref.instr.type;
+        thread.have_prev = true;
+    } else if (memref.marker.type == TRACE_TYPE_MARKER) {
+        thread.have_prev = false;
+        if (memref.marker.marker_type == TRACE_MARKER_TYPE_TIMESTAMP) {
+            if (memref.marker.marker_value < thread.last_timestamp) {
+                std::ostringstream message;
+                message << "timestamp " << memref.marker.marker_value
+                        << " precedes prior timestamp " << thread.last_timestamp;
+                report_violation(report, thread, memref.marker.tid, message.str());
+            }
+            thread.last_timestamp = memref.marker.marker_value;
+        }
+    } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT)
+        thread.exited = true;
+}
+
+bool
+invariant_checker_t::process_memref(const memref_t &memref)
+{
+    return process_memrefs(&memref, 1);
+}
+
+bool
+invariant_checker_t::process_memrefs(const memref_t *memrefs, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const memref_t &memref = memrefs[i];
+        bool is_instr = type_is_instr(memref.instr.type) ||
+            memref.instr.type == TRACE_TYPE_INSTR_NO_FETCH;
+        // Consecutive entries are usually from the same thread, so we only look
+        // up the thread when the thread changes.
+        if (last_thread == NULL || memref.data.tid != last_tid) {
+            // Offline traces guarantee that a branch target immediately follows
+            // the branch with no intervening thread switch, unless the thread
+            // exited after the branch in a limited-window trace.
+            if (knobs.offline && is_instr && last_was_branch && !last_thread->exited) {
+                std::ostringstream message;
+                message << "thread switch to " << memref.data.tid
+                        << " follows a branch";
+                report_violation(report, *last_thread, last_tid, message.str());
+            }
+            last_tid = memref.data.tid;
+            last_thread = &threads[last_tid];
+        }
+        check_memref(*last_thread, report, memref);
+        if (is_instr)
+            last_was_branch = type_is_instr_branch(memref.instr.type);
+        else if (memref.marker.type == TRACE_TYPE_MARKER) {
+            // This avoids flagging things like the wow64 call* NtContinue syscall.
+            last_was_branch = false;
+        }
+    }
+    return true;
+}
+
+bool
+invariant_checker_t::parallel_shard_supported()
+{
+    return true;
+}
+
+void *
+invariant_checker_t::parallel_shard_init(int shard_index)
+{
+    return new shard_data_t;
+}
+
+bool
+invariant_checker_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
+{
+    shard_data_t *shard = reinterpret_cast<shard_data_t*>(shard_data);
+    shard->tid = memref.data.tid;
+    check_memref(shard->thread, shard->report, memref);
+    return true;
+}
+
+bool
+invariant_checker_t::parallel_shard_exit(void *shard_data)
+{
+    shard_data_t *shard = reinterpret_cast<shard_data_t*>(shard_data);
+    {
+        std::lock_guard<std::mutex> guard(merge_mutex);
+        report.count += shard->report.count;
+        report.first.insert(report.first.end(), shard->report.first.begin(),
+                            shard->report.first.end());
+        shard_records += shard->thread.records;
+        ++shard_threads;
+    }
+    delete shard;
+    return true;
+}
+
+bool
+invariant_checker_t::print_results()
+{
+    uint64_t records = shard_records;
+    uint64_t num_threads = shard_threads;
+    for (const auto &keyval : threads) {
+        records += keyval.second.records;
+        ++num_threads;
+    }
+    if (shard_threads > 0) {
+        // The shards merged in no particular order.
+        std::sort(report.first.begin(), report.first.end(),
+                  [](const violation_t &l, const violation_t &r) {
+                      if (l.tid != r.tid)
+                          return l.tid < r.tid;
+                      return l.record < r.record;
+                  });
+        if (report.first.size() > knobs.max_reports)
+            report.first.resize(knobs.max_reports);
+    }
+    std::cerr << TOOL_NAME << " results:\n";
+    std::cerr << "Checked " << records << " records in " << num_threads
+              << " threads\n";
+    if (report.count == 0) {
+        std::cerr << "Trace invariant checks passed\n";
+        return true;
+    }
+    std::cerr << report.count << " invariant violations found";
+    if (!report.first.empty())
+        std::cerr << "; the first " << report.first.size() << ":";
+    std::cerr << "\n";
+    for (const violation_t &violation : report.first) {
+        std::cerr << "  Thread " << violation.tid << " record " << violation.record
+                  << " (instruction " << violation.instr << "): " << violation.message
+                  << "\n";
+    }
+    return false;
+}
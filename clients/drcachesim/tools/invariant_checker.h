@@ -0,0 +1,116 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* invariant_checker: a production trace validator.
+ */
+
+#ifndef _INVARIANT_CHECKER_H_
+#define _INVARIANT_CHECKER_H_ 1
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include "analysis_tool.h"
+#include "flat_hash_map.h"
+#include "memref.h"
+#include "invariant_checker_create.h"
+
+class invariant_checker_t : public analysis_tool_t
+{
+ public:
+    invariant_checker_t(const invariant_checker_knobs_t &knobs);
+    virtual ~invariant_checker_t();
+    virtual bool process_memref(const memref_t &memref);
+    virtual bool process_memrefs(const memref_t *memrefs, size_t count);
+    virtual bool print_results();
+    virtual bool parallel_shard_supported();
+    virtual void * parallel_shard_init(int shard_index);
+    virtual bool parallel_shard_exit(void *shard_data);
+    virtual bool parallel_shard_memref(void *shard_data, const memref_t &memref);
+
+ protected:
+    struct violation_t {
+        memref_tid_t tid;
+        // The positions within the thread, counting from 1.
+        uint64_t record;
+        uint64_t instr;
+        std::string message;
+    };
+    // The state of one thread, holding just enough of its last instruction and
+    // marker to check the next record.
+    struct thread_t {
+        thread_t() : records(0), instrs(0), prev_pc(0), prev_size(0),
+                     prev_type(TRACE_TYPE_INSTR), have_prev(false),
+                     last_timestamp(0), exited(false) {}
+        uint64_t records;
+        uint64_t instrs;
+        addr_t prev_pc;
+        size_t prev_size;
+        unsigned short prev_type;
+        // Cleared by a marker, which may indicate a kernel transfer.
+        bool have_prev;
+        uintptr_t last_timestamp;
+        bool exited;
+    };
+    // The violations found by a worker or by the serial path.
+    struct report_t {
+        report_t() : count(0) {}
+        uint64_t count;
+        std::vector<violation_t> first;
+    };
+    struct shard_data_t {
+        shard_data_t() : tid(0) {}
+        memref_tid_t tid;
+        thread_t thread;
+        report_t report;
+    };
+
+    void check_memref(thread_t &thread, report_t &report, const memref_t &memref);
+    void report_violation(report_t &report, const thread_t &thread,
+                          memref_tid_t tid, const std::string &message);
+
+    invariant_checker_knobs_t knobs;
+    flat_hash_map_t<memref_tid_t, thread_t> threads;
+    memref_tid_t last_tid;
+    thread_t *last_thread;
+    // For the serial check that a branch target follows its branch.
+    bool last_was_branch;
+    report_t report;
+    // The totals of the shards merged so far.
+    uint64_t shard_records;
+    uint64_t shard_threads;
+    // Protects report and the shard totals when merging shards.
+    std::mutex merge_mutex;
+    static const std::string TOOL_NAME;
+};
+
+#endif /* _INVARIANT_CHECKER_H_ */
@@ -0,0 +1,73 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* invariant checker tool creation */
+
+#ifndef _INVARIANT_CHECKER_CREATE_H_
+#define _INVARIANT_CHECKER_CREATE_H_ 1
+
+#include "analysis_tool.h"
+
+/**
+ * @file drmemtrace/invariant_checker_create.h
+ * @brief DrMemtrace trace invariant checker tool creation.
+ */
+
+/**
+ * The options for invariant_checker_create().
+ * The options are currently documented in \ref sec_drcachesim_ops.
+ */
+// These options are currently documented in ../common/options.cpp.
+struct invariant_checker_knobs_t {
+    invariant_checker_knobs_t() :
+        offline(true),
+        max_reports(10),
+        verbose(0) {}
+    // Whether the trace was gathered offline, which guarantees that a branch
+    // target immediately follows its branch.
+    bool offline;
+    unsigned int max_reports;
+    unsigned int verbose;
+};
+
+/**
+ * Creates an analysis tool which checks that a trace is well-formed: that each
+ * thread's instructions are contiguous except across branches and kernel
+ * transfer markers, that timestamps do not go backward, and that nothing
+ * follows a thread's exit.  It reports the number of violations and the
+ * positions of the first few, and supports parallel analysis of per-thread
+ * trace files.  Its print_results() fails if any violation was found.
+ */
+analysis_tool_t *
+invariant_checker_create(const invariant_checker_knobs_t &knobs);
+
+#endif /* _INVARIANT_CHECKER_CREATE_H_ */
@@ -55,7 +55,7 @@ opcode_mix_tool_create(const std::string& module_file_path, unsigned int verbose
 }
 
 opcode_mix_t::opcode_mix_t(const std::string& module_file_path, unsigned int verbose) :
-    dcontext(nullptr), raw2trace(nullptr), knob_verbose(verbose), instr_count(0)
+    dcontext(nullptr), raw2trace(nullptr), knob_verbose(verbose)
 {
     if (module_file_path.empty()) {
         success = false;
@@ -77,50 +77,128 @@ opcode_mix_t::~opcode_mix_t()
     delete raw2trace;
 }
 
+opcode_mix_t::module_cache_t *
+opcode_mix_t::find_module(shard_data_t *shard, app_pc pc)
+{
+    for (const auto &module : shard->modules) {
+        if (pc >= module->trace_start && pc < module->trace_start + module->size)
+            return module.get();
+    }
+    app_pc trace_start = nullptr, mapped_start = nullptr;
+    size_t size = 0;
+    {
+        std::lock_guard<std::mutex> guard(raw2trace_mutex);
+        shard->error = raw2trace->find_mapped_trace_bounds(pc, &trace_start,
+                                                           &mapped_start, &size);
+    }
+    if (!shard->error.empty())
+        return nullptr;
+    shard->modules.push_back(std::unique_ptr<module_cache_t>
+                             (new module_cache_t(trace_start, mapped_start, size)));
+    return shard->modules.back().get();
+}
+
 bool
-opcode_mix_t::process_memref(const memref_t &memref)
+opcode_mix_t::add_memref(shard_data_t *shard, const memref_t &memref)
 {
   if (!type_is_instr(memref.instr.type) &&
       memref.data.type != TRACE_TYPE_INSTR_NO_FETCH)
       return true;
-  ++instr_count;
-  app_pc mapped_pc;
-  std::string err =
-      raw2trace->find_mapped_trace_address((app_pc)memref.instr.addr, &mapped_pc);
-  if (!err.empty())
-      return false;
-  int opcode;
-  auto cached_opcode = opcode_cache.find(mapped_pc);
-  if (cached_opcode != opcode_cache.end()) {
-      opcode = cached_opcode->second;
-  } else {
-      instr_t instr;
-      instr_init(dcontext, &instr);
-      app_pc next_pc = decode(dcontext, mapped_pc, &instr);
-      if (next_pc == NULL || !instr_valid(&instr))
+  ++shard->instr_count;
+  app_pc pc = (app_pc)memref.instr.addr;
+  module_cache_t *module = shard->last_module;
+  if (module == nullptr || pc < module->trace_start ||
+      pc >= module->trace_start + module->size) {
+      module = find_module(shard, pc);
+      if (module == nullptr)
+          return false;
+      shard->last_module = module;
+  }
+  size_t offset = pc - module->trace_start;
+  std::unique_ptr<unsigned short[]> &chunk = module->chunks[offset / CHUNK_SIZE];
+  if (!chunk) {
+      chunk.reset(new unsigned short[CHUNK_SIZE]);
+      std::fill(chunk.get(), chunk.get() + CHUNK_SIZE, (unsigned short)OP_INVALID);
+  }
+  unsigned short &opcode = chunk[offset % CHUNK_SIZE];
+  if (opcode == OP_INVALID) {
+      int decoded;
+      app_pc next_pc = decode_opcode_only(dcontext, module->mapped_start + offset,
+                                          &decoded);
+      if (next_pc == NULL) {
+          shard->error = "Failed to decode instruction";
           return false;
-      opcode = instr_get_opcode(&instr);
-      opcode_cache[mapped_pc] = opcode;
-      instr_free(dcontext, &instr);
+      }
+      opcode = (unsigned short)decoded;
   }
-  ++opcode_counts[opcode];
+  ++shard->opcode_counts[opcode];
   return true;
 }
 
+bool
+opcode_mix_t::process_memref(const memref_t &memref)
+{
+    return add_memref(&serial_shard, memref);
+}
+
+bool
+opcode_mix_t::parallel_shard_supported()
+{
+    return true;
+}
+
+void *
+opcode_mix_t::parallel_shard_init(int shard_index)
+{
+    return new shard_data_t;
+}
+
+bool
+opcode_mix_t::parallel_shard_memref(void *shard_data, const memref_t &memref)
+{
+    return add_memref(reinterpret_cast<shard_data_t*>(shard_data), memref);
+}
+
+std::string
+opcode_mix_t::parallel_shard_error(void *shard_data)
+{
+    return reinterpret_cast<shard_data_t*>(shard_data)->error;
+}
+
+bool
+opcode_mix_t::parallel_shard_exit(void *shard_data)
+{
+    shard_data_t *shard = reinterpret_cast<shard_data_t*>(shard_data);
+    {
+        std::lock_guard<std::mutex> guard(merge_mutex);
+        serial_shard.instr_count += shard->instr_count;
+        for (size_t i = 0; i < shard->opcode_counts.size(); i++)
+            serial_shard.opcode_counts[i] += shard->opcode_counts[i];
+    }
+    delete shard;
+    return true;
+}
+
 static bool
 cmp_val(const std::pair<int, int_least64_t> &l,
         const std::pair<int, int_least64_t> &r)
 {
-    return (l.second > r.second);
+    if (l.second != r.second)
+        return l.second > r.second;
+    return l.first < r.first;
 }
 
 bool
 opcode_mix_t::print_results()
 {
     std::cerr << TOOL_NAME << " results:\n";
-    std::cerr << std::setw(15) << instr_count << " : total executed instructions\n";
-    std::vector<std::pair<int, int_least64_t>> sorted(opcode_counts.begin(),
-                                                      opcode_counts.end());
+    std::cerr << std::setw(15) << serial_shard.instr_count <<
+        " : total executed instructions\n";
+    std::vector<std::pair<int, int_least64_t>> sorted;
+    for (size_t i = 0; i < serial_shard.opcode_counts.size(); i++) {
+        if (serial_shard.opcode_counts[i] > 0)
+            sorted.push_back(std::make_pair((int)i, serial_shard.opcode_counts[i]));
+    }
     std::sort(sorted.begin(), sorted.end(), cmp_val);
     for (const auto &keyvals : sorted) {
         std::cerr << std::setw(15) << keyvals.second << " : "
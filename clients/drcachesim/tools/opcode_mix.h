@@ -33,8 +33,10 @@
 #ifndef _OPCODE_MIX_H_
 #define _OPCODE_MIX_H_ 1
 
+#include <memory>
+#include <mutex>
 #include <string>
-#include <unordered_map>
+#include <vector>
 
 #include "analysis_tool.h"
 #include "tracer/raw2trace.h"
@@ -46,14 +48,49 @@ class opcode_mix_t : public analysis_tool_t
     virtual ~opcode_mix_t();
     virtual bool process_memref(const memref_t &memref);
     virtual bool print_results();
+    virtual bool parallel_shard_supported();
+    virtual void * parallel_shard_init(int shard_index);
+    virtual bool parallel_shard_exit(void *shard_data);
+    virtual bool parallel_shard_memref(void *shard_data, const memref_t &memref);
+    virtual std::string parallel_shard_error(void *shard_data);
 
  protected:
+    // The opcodes decoded so far in one module, indexed by offset from its start
+    // and allocated in chunks as they are touched.  OP_INVALID marks an offset not
+    // yet decoded, as we fail on invalid instructions.
+    struct module_cache_t {
+        module_cache_t(app_pc trace_start_in, app_pc mapped_start_in, size_t size_in) :
+            trace_start(trace_start_in), mapped_start(mapped_start_in),
+            size(size_in), chunks((size_in + CHUNK_SIZE - 1) / CHUNK_SIZE) {}
+        app_pc trace_start;
+        app_pc mapped_start;
+        size_t size;
+        std::vector<std::unique_ptr<unsigned short[]>> chunks;
+    };
+    struct shard_data_t {
+        shard_data_t() : instr_count(0), opcode_counts(OP_LAST + 1, 0),
+                         last_module(nullptr) {}
+        int_least64_t instr_count;
+        // Indexed by opcode.
+        std::vector<int_least64_t> opcode_counts;
+        std::vector<std::unique_ptr<module_cache_t>> modules;
+        module_cache_t *last_module;
+        std::string error;
+    };
+    static const size_t CHUNK_SIZE = 4096;
+
+    module_cache_t *find_module(shard_data_t *shard, app_pc pc);
+    bool add_memref(shard_data_t *shard, const memref_t &memref);
+
     void *dcontext;
     raw2trace_t *raw2trace;
+    // Serializes raw2trace lookups, which cache the last module hit.  The shards
+    // only look up a module the first time they see it.
+    std::mutex raw2trace_mutex;
     unsigned int knob_verbose;
-    int_least64_t instr_count;
-    std::unordered_map<int, int_least64_t> opcode_counts;
-    std::unordered_map<app_pc, int> opcode_cache;
+    // The serial path's state, into which parallel shards are merged.
+    shard_data_t serial_shard;
+    std::mutex merge_mutex;
     static const std::string TOOL_NAME;
 };
 
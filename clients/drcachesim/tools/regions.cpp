@@ -0,0 +1,286 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <vector>
+#include "regions.h"
+#include "../common/utils.h"
+
+const std::string regions_t::TOOL_NAME = "Regions tool";
+
+analysis_tool_t *
+regions_tool_create(const regions_knobs_t &knobs)
+{
+    return new regions_t(knobs);
+}
+
+regions_t::regions_t(const regions_knobs_t &knobs_) :
+    knobs(knobs_), total_instrs(0), interval_instrs(0), block_pc(0), block_instrs(0),
+    last_tid(0), next_pc(0), block_ended(true)
+{
+    if (knobs.interval_instrs == 0) {
+        ERRMSG("Usage error: the regions interval must be positive\n");
+        success = false;
+        return;
+    }
+    if (knobs.max_clusters == 0) {
+        ERRMSG("Usage error: the regions cluster count must be positive\n");
+        success = false;
+        return;
+    }
+}
+
+regions_t::~regions_t()
+{
+}
+
+void
+regions_t::end_block()
+{
+    if (block_instrs == 0)
+        return;
+    blocks[block_pc] += block_instrs;
+    block_instrs = 0;
+}
+
+// Returns a pseudo-random value in [-1, 1] that depends only on the block and
+// the dimension, so the projection is the same for every interval.
+static double
+projection_weight(addr_t pc, int dim)
+{
+    // The splitmix64 finalizer.
+    uint64_t x = (uint64_t)pc + 0x9e3779b97f4a7c15ULL * (uint64_t)(dim + 1);
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x = x ^ (x >> 31);
+    return (double)(x >> 11) / (double)(1ULL << 52) - 1.;
+}
+
+void
+regions_t::end_interval()
+{
+    end_block();
+    interval_t interval;
+    interval.start = total_instrs - interval_instrs;
+    interval.instrs = interval_instrs;
+    for (int d = 0; d < VECTOR_DIMS; ++d)
+        interval.vec[d] = 0.;
+    // We normalize by the interval length so a short final interval can still
+    // match the phase it belongs to.
+    for (const auto &keyval : blocks) {
+        double frac = (double)keyval.second / (double)interval_instrs;
+        for (int d = 0; d < VECTOR_DIMS; ++d)
+            interval.vec[d] += frac * projection_weight(keyval.first, d);
+    }
+    intervals.push_back(interval);
+    blocks.clear();
+    interval_instrs = 0;
+    // A block does not span intervals.
+    block_ended = true;
+}
+
+bool
+regions_t::process_memref(const memref_t &memref)
+{
+    if (!type_is_instr(memref.instr.type) &&
+        memref.instr.type != TRACE_TYPE_INSTR_NO_FETCH)
+        return true;
+    // A block ends at a branch, at a thread switch, and wherever control does
+    // not fall through, such as at a signal.
+    if (block_ended || memref.instr.tid != last_tid || memref.instr.addr != next_pc) {
+        end_block();
+        block_pc = memref.instr.addr;
+    }
+    ++block_instrs;
+    last_tid = memref.instr.tid;
+    next_pc = memref.instr.addr + memref.instr.size;
+    block_ended = type_is_instr_branch(memref.instr.type);
+    ++total_instrs;
+    if (++interval_instrs == knobs.interval_instrs)
+        end_interval();
+    return true;
+}
+
+double
+regions_t::distance(const double *a, const double *b)
+{
+    double sum = 0.;
+    for (int d = 0; d < VECTOR_DIMS; ++d)
+        sum += (a[d] - b[d]) * (a[d] - b[d]);
+    return sum;
+}
+
+// Clusters the intervals with k-means and picks the interval closest to each
+// centroid.  The centroids start from the first interval and then repeatedly
+// the interval farthest from those chosen so far, which makes the result
+// deterministic and stops adding clusters once every interval is matched exactly.
+void
+regions_t::choose_regions()
+{
+    size_t num = intervals.size();
+    std::vector<std::vector<double> > centroids;
+    std::vector<double> nearest(num, std::numeric_limits<double>::max());
+    size_t next = 0;
+    while (centroids.size() < knobs.max_clusters && centroids.size() < num) {
+        centroids.push_back(std::vector<double>(intervals[next].vec,
+                                                intervals[next].vec + VECTOR_DIMS));
+        double farthest = 0.;
+        for (size_t i = 0; i < num; ++i) {
+            nearest[i] = std::min(nearest[i],
+                                  distance(intervals[i].vec, &centroids.back()[0]));
+            if (nearest[i] > farthest) {
+                farthest = nearest[i];
+                next = i;
+            }
+        }
+        if (farthest == 0.)
+            break;
+    }
+    size_t k = centroids.size();
+    std::vector<size_t> cluster(num, 0);
+    for (int iter = 0; iter < MAX_ITERATIONS; ++iter) {
+        bool changed = false;
+        for (size_t i = 0; i < num; ++i) {
+            size_t best = 0;
+            double best_dist = std::numeric_limits<double>::max();
+            for (size_t c = 0; c < k; ++c) {
+                double dist = distance(intervals[i].vec, &centroids[c][0]);
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    best = c;
+                }
+            }
+            if (iter == 0 || cluster[i] != best) {
+                cluster[i] = best;
+                changed = true;
+            }
+        }
+        if (!changed)
+            break;
+        // Each centroid moves to the mean of its members, weighting each
+        // interval by its length.  A centroid left without members stays put.
+        std::vector<double> sums(k * VECTOR_DIMS, 0.);
+        std::vector<double> counts(k, 0.);
+        for (size_t i = 0; i < num; ++i) {
+            counts[cluster[i]] += (double)intervals[i].instrs;
+            for (int d = 0; d < VECTOR_DIMS; ++d) {
+                sums[cluster[i] * VECTOR_DIMS + d] +=
+                    (double)intervals[i].instrs * intervals[i].vec[d];
+            }
+        }
+        for (size_t c = 0; c < k; ++c) {
+            if (counts[c] == 0.)
+                continue;
+            for (int d = 0; d < VECTOR_DIMS; ++d)
+                centroids[c][d] = sums[c * VECTOR_DIMS + d] / counts[c];
+        }
+    }
+    std::vector<size_t> representative(k, num);
+    std::vector<double> rep_dist(k, std::numeric_limits<double>::max());
+    std::vector<uint64_t> cluster_instrs(k, 0);
+    for (size_t i = 0; i < num; ++i) {
+        size_t c = cluster[i];
+        cluster_instrs[c] += intervals[i].instrs;
+        double dist = distance(intervals[i].vec, &centroids[c][0]);
+        if (dist < rep_dist[c]) {
+            rep_dist[c] = dist;
+            representative[c] = i;
+        }
+    }
+    regions.clear();
+    for (size_t c = 0; c < k; ++c) {
+        if (representative[c] == num)
+            continue;
+        region_t region;
+        region.interval = representative[c];
+        region.weight = (double)cluster_instrs[c] / (double)total_instrs;
+        regions.push_back(region);
+    }
+    std::sort(regions.begin(), regions.end(),
+              [](const region_t &l, const region_t &r) {
+                  return l.interval < r.interval;
+              });
+}
+
+// The file holds one line per region with its first instruction, its length in
+// instructions, and its weight, after comment lines starting with '#'.
+bool
+regions_t::write_regions()
+{
+    std::ofstream out(knobs.output_file);
+    if (!out)
+        return false;
+    out << "# " << TOOL_NAME << ": " << intervals.size() << " intervals of "
+        << knobs.interval_instrs << " instructions\n";
+    out << "# start_instr instructions weight\n";
+    out << std::setprecision(10);
+    for (const auto &region : regions) {
+        const interval_t &interval = intervals[region.interval];
+        out << interval.start << " " << interval.instrs << " " << region.weight << "\n";
+    }
+    out.close();
+    return !out.fail();
+}
+
+bool
+regions_t::print_results()
+{
+    if (interval_instrs > 0)
+        end_interval();
+    choose_regions();
+    std::cerr << TOOL_NAME << " results:\n";
+    std::cerr << "Total instructions: " << total_instrs << "\n";
+    std::cerr << "Intervals of " << knobs.interval_instrs << " instructions: "
+              << intervals.size() << "\n";
+    std::cerr << "Representative intervals: " << regions.size() << "\n";
+    std::cerr << std::setw(10) << "Interval" << std::setw(16) << "Start instr"
+              << std::setw(14) << "Instrs" << std::setw(10) << "Weight" << "\n";
+    for (const auto &region : regions) {
+        const interval_t &interval = intervals[region.interval];
+        std::cerr << std::setw(10) << region.interval << std::setw(16) << interval.start
+                  << std::setw(14) << interval.instrs << std::setw(10)
+                  << std::fixed << std::setprecision(4) << region.weight << "\n";
+    }
+    if (!knobs.output_file.empty()) {
+        if (!write_regions()) {
+            ERRMSG("Failed to write the regions to %s\n", knobs.output_file.c_str());
+            return false;
+        }
+        if (knobs.verbose >= 1)
+            std::cerr << "Wrote the regions to " << knobs.output_file << "\n";
+    }
+    return true;
+}
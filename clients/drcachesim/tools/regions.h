@@ -0,0 +1,95 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* regions: chooses representative intervals of the trace from basic block vectors. */
+
+#ifndef _REGIONS_H_
+#define _REGIONS_H_ 1
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "analysis_tool.h"
+#include "memref.h"
+#include "regions_create.h"
+
+class regions_t : public analysis_tool_t
+{
+ public:
+    regions_t(const regions_knobs_t &knobs);
+    virtual ~regions_t();
+    virtual bool process_memref(const memref_t &memref);
+    virtual bool print_results();
+
+ protected:
+    // Each basic block vector is randomly projected down to this many
+    // dimensions, as SimPoint does, which keeps the per-interval state and the
+    // clustering cost independent of the number of blocks.
+    static const int VECTOR_DIMS = 15;
+    // The clustering stops after this many rounds even if it has not converged.
+    static const int MAX_ITERATIONS = 100;
+
+    struct interval_t {
+        uint64_t start;
+        uint64_t instrs;
+        double vec[VECTOR_DIMS];
+    };
+    // A representative interval and the share of the instructions in its phase.
+    struct region_t {
+        size_t interval;
+        double weight;
+    };
+
+    void end_block();
+    void end_interval();
+    void choose_regions();
+    bool write_regions();
+    static double distance(const double *a, const double *b);
+
+    regions_knobs_t knobs;
+    uint64_t total_instrs;
+    // The instructions in each block of the current interval, keyed by the
+    // block's first pc.
+    std::unordered_map<addr_t, uint64_t> blocks;
+    uint64_t interval_instrs;
+    // The block being executed.
+    addr_t block_pc;
+    uint64_t block_instrs;
+    memref_tid_t last_tid;
+    addr_t next_pc;
+    bool block_ended;
+    std::vector<interval_t> intervals;
+    std::vector<region_t> regions;
+    static const std::string TOOL_NAME;
+};
+
+#endif /* _REGIONS_H_ */
@@ -0,0 +1,74 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* regions tool creation */
+
+#ifndef _REGIONS_CREATE_H_
+#define _REGIONS_CREATE_H_ 1
+
+#include <string>
+#include "analysis_tool.h"
+
+/**
+ * @file drmemtrace/regions_create.h
+ * @brief DrMemtrace representative region selection tool creation.
+ */
+
+/**
+ * The options for regions_tool_create().
+ * The options are currently documented in \ref sec_drcachesim_ops.
+ */
+// These options are currently documented in ../common/options.cpp.
+struct regions_knobs_t {
+    regions_knobs_t() :
+        interval_instrs(10000000),
+        max_clusters(10),
+        verbose(0) {}
+    uint64_t interval_instrs;
+    unsigned int max_clusters;
+    std::string output_file;
+    unsigned int verbose;
+};
+
+/**
+ * Creates an analysis tool which splits the instruction stream into intervals of
+ * a fixed number of instructions, computes a basic block vector for each,
+ * clusters the vectors into phases, and chooses the interval closest to the
+ * center of each phase as its representative, weighted by the share of the
+ * instructions that the phase covers.  The chosen intervals are printed and, if
+ * an output file is given, written out in the format that the cache and TLB
+ * simulators read to simulate only those intervals.
+ */
+analysis_tool_t *
+regions_tool_create(const regions_knobs_t &knobs);
+
+#endif /* _REGIONS_CREATE_H_ */
@@ -0,0 +1,214 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* This symbolizer requires access to the modules.log file and the libraries
+ * and binary from the traced execution.  It is meant for final traces only.
+ */
+
+#include "dr_api.h"
+#include "drsyms.h"
+#include "report_symbolizer.h"
+#include "tracer/raw2trace.h"
+#include "tracer/raw2trace_directory.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+#include <unordered_map>
+
+class module_symbolizer_t : public report_symbolizer_t
+{
+ public:
+    module_symbolizer_t();
+    virtual ~module_symbolizer_t();
+    bool init(const std::string &module_file_path, std::string *error);
+    virtual void symbolize(const std::vector<addr_t> &addrs,
+                           std::vector<std::string> *names);
+
+ protected:
+    struct module_range_t {
+        module_range_t(addr_t start_in, addr_t end_in, addr_t base_in,
+                       const std::string &path_in) :
+            start(start_in), end(end_in), base(base_in), path(path_in),
+            has_symbols(true)
+        {
+            size_t sep_index = path.find_last_of(DIRSEP ALT_DIRSEP);
+            name = sep_index == std::string::npos ? path : path.substr(sep_index + 1);
+        }
+        addr_t start;
+        addr_t end;
+        // For a secondary segment, the base of the first segment, which is what
+        // symbol offsets are relative to.
+        addr_t base;
+        std::string path;
+        std::string name;
+        // Cleared after a failed load so we do not retry for every address.
+        bool has_symbols;
+    };
+
+    module_range_t *find_module(addr_t addr);
+    std::string lookup(module_range_t *module, addr_t addr);
+
+    bool drsyms_initialized;
+    // Sorted by start.
+    std::vector<module_range_t> modules;
+    std::unordered_map<addr_t, std::string> cache;
+};
+
+report_symbolizer_t *
+report_symbolizer_create(const std::string &module_file_path, std::string *error)
+{
+    module_symbolizer_t *symbolizer = new module_symbolizer_t();
+    if (!symbolizer->init(module_file_path, error)) {
+        delete symbolizer;
+        return nullptr;
+    }
+    return symbolizer;
+}
+
+module_symbolizer_t::module_symbolizer_t() : drsyms_initialized(false)
+{
+}
+
+module_symbolizer_t::~module_symbolizer_t()
+{
+    if (drsyms_initialized)
+        drsym_exit();
+}
+
+bool
+module_symbolizer_t::init(const std::string &module_file_path, std::string *error)
+{
+    // raw2trace_directory_t treats a missing file as fatal.
+    if (!std::ifstream(module_file_path.c_str()).good()) {
+        *error = "Failed to open module file " + module_file_path;
+        return false;
+    }
+    void *dcontext = dr_standalone_init();
+    raw2trace_directory_t dir(module_file_path);
+    raw2trace_t raw2trace(dir.modfile_bytes, std::vector<std::istream*>(), nullptr,
+                          dcontext);
+    *error = raw2trace.do_module_parsing();
+    if (!error->empty())
+        return false;
+    // We copy what we need so the raw2trace state can go away now.
+    const std::vector<drmodtrack_info_t> &modlist = raw2trace.get_module_list();
+    for (const auto &info : modlist) {
+        addr_t start = (addr_t)info.start;
+        addr_t base = info.containing_index == info.index ? start :
+            (addr_t)modlist[info.containing_index].start;
+        modules.push_back(module_range_t(start, start + info.size, base, info.path));
+        if (strcmp(info.path, "<unknown>") == 0 || strcmp(info.path, "[vdso]") == 0)
+            modules.back().has_symbols = false;
+    }
+    std::sort(modules.begin(), modules.end(),
+              [](const module_range_t &l, const module_range_t &r) {
+                  return l.start < r.start;
+              });
+    if (drsym_init(0) != DRSYM_SUCCESS) {
+        *error = "Failed to initialize drsyms";
+        return false;
+    }
+    drsyms_initialized = true;
+    return true;
+}
+
+module_symbolizer_t::module_range_t *
+module_symbolizer_t::find_module(addr_t addr)
+{
+    auto it = std::upper_bound(modules.begin(), modules.end(), addr,
+                               [](addr_t value, const module_range_t &module) {
+                                   return value < module.start;
+                               });
+    if (it == modules.begin())
+        return nullptr;
+    --it;
+    if (addr >= it->end)
+        return nullptr;
+    return &*it;
+}
+
+std::string
+module_symbolizer_t::lookup(module_range_t *module, addr_t addr)
+{
+    size_t modoffs = (size_t)(addr - module->base);
+    std::ostringstream result;
+    result << module->name;
+    if (module->has_symbols) {
+        char name[256];
+        char file[MAXIMUM_PATH];
+        drsym_info_t sym;
+        sym.struct_size = sizeof(sym);
+        sym.name = name;
+        sym.name_size = sizeof(name);
+        sym.file = file;
+        sym.file_size = sizeof(file);
+        drsym_error_t res = drsym_lookup_address(module->path.c_str(), modoffs, &sym,
+                                                 DRSYM_DEMANGLE);
+        if (res == DRSYM_SUCCESS || res == DRSYM_ERROR_LINE_NOT_AVAILABLE) {
+            result << "!" << name << "+" << std::hex << std::showbase <<
+                (modoffs - sym.start_offs);
+            if (res == DRSYM_SUCCESS && sym.file != NULL && sym.file[0] != '\0')
+                result << " " << sym.file << ":" << std::dec << sym.line;
+            return result.str();
+        }
+        if (res == DRSYM_ERROR_LOAD_FAILED)
+            module->has_symbols = false;
+    }
+    result << "+" << std::hex << std::showbase << modoffs;
+    return result.str();
+}
+
+void
+module_symbolizer_t::symbolize(const std::vector<addr_t> &addrs,
+                               std::vector<std::string> *names)
+{
+    // We sort the addresses we have not seen before so that all lookups in one
+    // module are made together, keeping each module's debug information hot in
+    // drsyms, and so that we can walk the sorted module list alongside them.
+    std::vector<addr_t> todo;
+    for (addr_t addr : addrs) {
+        if (cache.find(addr) == cache.end())
+            todo.push_back(addr);
+    }
+    std::sort(todo.begin(), todo.end());
+    todo.erase(std::unique(todo.begin(), todo.end()), todo.end());
+    module_range_t *module = nullptr;
+    for (addr_t addr : todo) {
+        if (module == nullptr || addr < module->start || addr >= module->end)
+            module = find_module(addr);
+        cache[addr] = module == nullptr ? "" : lookup(module, addr);
+    }
+    names->resize(addrs.size());
+    for (size_t i = 0; i < addrs.size(); i++)
+        (*names)[i] = cache[addrs[i]];
+}
@@ -0,0 +1,76 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* report_symbolizer: maps addresses printed in analysis tool reports to symbols. */
+
+#ifndef _REPORT_SYMBOLIZER_H_
+#define _REPORT_SYMBOLIZER_H_ 1
+
+#include <string>
+#include <vector>
+#include "trace_entry.h"
+
+/**
+ * @file drmemtrace/report_symbolizer.h
+ * @brief DrMemtrace symbolization of the addresses in analysis tool reports.
+ */
+
+/**
+ * Symbolizes the addresses printed in the top-N lists of analysis tool reports.
+ * A tool collects all of the addresses it is about to print and passes them to
+ * symbolize() in a single call, which lets the symbolizer sort and group the
+ * lookups by module.  Results are cached across calls.
+ */
+class report_symbolizer_t
+{
+ public:
+    virtual ~report_symbolizer_t() {}
+    /**
+     * Sets (*names)[i] to a description of addrs[i]: "module!symbol+0x12
+     * file:line" when symbols and line information are available,
+     * "module!symbol+0x12" or "module+0x34" with less information, or an
+     * empty string for an address not inside any traced module.
+     */
+    virtual void symbolize(const std::vector<addr_t> &addrs,
+                           std::vector<std::string> *names) = 0;
+};
+
+/**
+ * Creates a symbolizer for the modules listed in the modules.log file at
+ * \p module_file_path, which was saved by raw2trace alongside the final trace.
+ * The libraries and binary from the traced execution must be present at their
+ * recorded paths to obtain symbols.  Returns nullptr and sets \p error on failure.
+ */
+report_symbolizer_t *
+report_symbolizer_create(const std::string &module_file_path, std::string *error);
+
+#endif /* _REPORT_SYMBOLIZER_H_ */
@@ -34,8 +34,10 @@
 #include <cmath>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <vector>
 #include "reuse_distance.h"
+#include "report_symbolizer.h"
 #include "../common/utils.h"
 
 const std::string reuse_distance_t::TOOL_NAME = "Reuse distance tool";
@@ -49,15 +51,27 @@ reuse_distance_tool_create(const reuse_distance_knobs_t &knobs)
 }
 
 reuse_distance_t::reuse_distance_t(const reuse_distance_knobs_t &knobs_) :
-    knobs(knobs_), total_refs(0)
+    knobs(knobs_), sampling(false), sample_threshold(SAMPLE_MODULUS),
+    sample_rate(1.0), sampled_unique(0.), total_refs(0)
 {
     line_size_bits = compute_log2((int)knobs.line_size);
-    ref_list = new line_ref_list_t(knobs.distance_threshold,
+    if (knobs.sampling_rate > 0. && knobs.sampling_rate < 1.0) {
+        sampling = true;
+        sample_threshold = std::max((uint64_t)1, (uint64_t)
+                                    (knobs.sampling_rate * SAMPLE_MODULUS));
+        sample_rate = (double)sample_threshold / SAMPLE_MODULUS;
+    }
+    // When sampling, the list's distances are in sampled lines, so we identify
+    // distant references ourselves from the scaled distances.  Removing
+    // sampled lines requires the tree.
+    ref_list = new line_ref_list_t(sampling ? std::numeric_limits<uint64_t>::max() :
+                                   knobs.distance_threshold,
                                    knobs.skip_list_distance,
-                                   knobs.verify_skip);
+                                   knobs.verify_skip,
+                                   knobs.use_distance_tree || sampling);
     if (DEBUG_VERBOSE(2)) {
         std::cerr << "cache line size " << knobs.line_size << ", "
-                  << "reuse distance threshold " << ref_list->threshold << std::endl;
+                  << "reuse distance threshold " << knobs.distance_threshold << std::endl;
     }
 }
 
@@ -88,6 +102,12 @@ reuse_distance_t::process_memref(const memref_t &memref)
         type_is_prefetch(memref.data.type)) {
         ++total_refs;
         addr_t tag = memref.data.addr >> line_size_bits;
+        uint64_t hash = 0;
+        if (sampling) {
+            hash = sample_hash(tag);
+            if (hash >= sample_threshold)
+                return true;
+        }
         std::unordered_map<addr_t, line_ref_t*>::iterator it = cache_map.find(tag);
         if (it == cache_map.end()) {
             line_ref_t *ref = new line_ref_t(tag);
@@ -95,14 +115,29 @@ reuse_distance_t::process_memref(const memref_t &memref)
             cache_map.insert(std::pair<addr_t, line_ref_t*>(tag, ref));
             // insert into the list
             ref_list->add_to_front(ref);
+            if (sampling) {
+                sampled_lines.push(std::make_pair(hash, tag));
+                sampled_unique += 1. / sample_rate;
+                if (cache_map.size() > knobs.sampling_max_lines)
+                    shrink_sample();
+            }
         } else {
             int_least64_t dist = ref_list->move_to_front(it->second);
-            std::unordered_map<int_least64_t, int_least64_t>::iterator dist_it =
-                dist_map.find(dist);
-            if (dist_it == dist_map.end())
-                dist_map.insert(std::pair<int_least64_t, int_least64_t>(dist, 1));
-            else
-                ++dist_it->second;
+            if (sampling) {
+                dist = (int_least64_t)llround(dist / sample_rate);
+                if (dist > (int_least64_t)knobs.distance_threshold)
+                    it->second->distant_refs++;
+                // Each sampled reference stands for 1/rate references, at the
+                // rate it was sampled at.
+                sampled_dist_map[dist] += 1. / sample_rate;
+            } else {
+                std::unordered_map<int_least64_t, int_least64_t>::iterator dist_it =
+                    dist_map.find(dist);
+                if (dist_it == dist_map.end())
+                    dist_map.insert(std::pair<int_least64_t, int_least64_t>(dist, 1));
+                else
+                    ++dist_it->second;
+            }
             if (DEBUG_VERBOSE(3)) {
                 std::cerr << "Distance is " << dist << "\n";
             }
@@ -111,6 +146,40 @@ reuse_distance_t::process_memref(const memref_t &memref)
     return true;
 }
 
+uint64_t
+reuse_distance_t::sample_hash(addr_t tag)
+{
+    // We need a well-mixed hash, as nearby lines must be sampled independently.
+    uint64_t hash = (uint64_t)tag;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash & (SAMPLE_MODULUS - 1);
+}
+
+void
+reuse_distance_t::shrink_sample()
+{
+    uint64_t new_threshold = sampled_lines.top().first;
+    if (new_threshold == 0)
+        return; // We cannot sample any less.
+    while (!sampled_lines.empty() && sampled_lines.top().first == new_threshold) {
+        std::unordered_map<addr_t, line_ref_t*>::iterator it =
+            cache_map.find(sampled_lines.top().second);
+        assert(it != cache_map.end());
+        ref_list->remove(it->second);
+        delete it->second;
+        cache_map.erase(it);
+        sampled_lines.pop();
+    }
+    sample_threshold = new_threshold;
+    sample_rate = (double)new_threshold / SAMPLE_MODULUS;
+    if (DEBUG_VERBOSE(1))
+        std::cerr << "Reuse distance sampling rate lowered to " << sample_rate << "\n";
+}
+
 static bool
 cmp_dist_key(const std::pair<int_least64_t, int_least64_t> &l,
                   const std::pair<int_least64_t, int_least64_t> &r)
@@ -148,13 +217,46 @@ cmp_distant_refs(const std::pair<addr_t, line_ref_t*> &l,
     return l.first < r.first;
 }
 
+void
+reuse_distance_t::print_top_lines(const std::vector<std::pair<addr_t, line_ref_t*> >
+                                  &top, const std::vector<std::string> &names,
+                                  size_t name_index)
+{
+    std::cerr << std::setw(18) << "cache line"
+              << ": " << std::setw(17) << "#references  "
+              << std::setw(14) << "#distant refs" << "\n";
+    for (size_t i = 0; i < top.size(); i++) {
+        if (top[i].second == NULL) // Very small app.
+            break;
+        std::cerr << std::setw(18) << std::hex << std::showbase
+                  << (top[i].first << line_size_bits)
+                  << ": " << std::setw(12) << std::dec << top[i].second->total_refs
+                  << ", " << std::setw(12) << std::dec << top[i].second->distant_refs;
+        if (!names[name_index + i].empty())
+            std::cerr << "  " << names[name_index + i];
+        std::cerr << "\n";
+    }
+}
+
 bool
 reuse_distance_t::print_results()
 {
     std::cerr << TOOL_NAME << " results:\n";
     std::cerr << "Total accesses: " << total_refs << "\n";
-    std::cerr << "Unique accesses: " << ref_list->cur_time << "\n";
-    std::cerr << "Unique cache lines accessed: " << ref_list->unique_lines << "\n";
+    if (sampling) {
+        // The unique accesses depend on which line was accessed just before,
+        // which sampling cannot estimate.
+        std::cerr << "Sampling rate: " << sample_rate << " with " << cache_map.size()
+                  << " lines tracked (the counts below are estimates)\n";
+        std::cerr << "Unique cache lines accessed: " << llround(sampled_unique) << "\n";
+        if (dist_map.empty()) {
+            for (const auto &entry : sampled_dist_map)
+                dist_map[entry.first] = llround(entry.second);
+        }
+    } else {
+        std::cerr << "Unique accesses: " << ref_list->cur_time << "\n";
+        std::cerr << "Unique cache lines accessed: " << ref_list->unique_lines << "\n";
+    }
     std::cerr << "\n";
 
     std::cerr.precision(2);
@@ -208,42 +310,28 @@ reuse_distance_t::print_results()
 
     std::cerr << "\n";
     std::cerr << "Reuse distance threshold = "
-              << ref_list->threshold << " cache lines\n";
+              << knobs.distance_threshold << " cache lines\n";
     std::vector<std::pair<addr_t, line_ref_t*> > top(knobs.report_top);
     std::partial_sort_copy(cache_map.begin(), cache_map.end(),
                            top.begin(), top.end(), cmp_total_refs);
-    std::cerr << "Top " << top.size() << " frequently referenced cache lines\n";
-    std::cerr << std::setw(18) << "cache line"
-              << ": " << std::setw(17) << "#references  "
-              << std::setw(14) << "#distant refs" << "\n";
-    for (std::vector<std::pair<addr_t, line_ref_t*> >::iterator it = top.begin();
-         it != top.end(); ++it) {
-        if (it->second == NULL) // Very small app.
-            break;
-        std::cerr << std::setw(18) << std::hex << std::showbase
-                  << (it->first << line_size_bits)
-                  << ": " << std::setw(12) << std::dec << it->second->total_refs
-                  << ", " << std::setw(12) << std::dec << it->second->distant_refs
-                  << "\n";
-    }
-    top.clear();
-    top.resize(knobs.report_top);
+    std::vector<std::pair<addr_t, line_ref_t*> > top_distant(knobs.report_top);
     std::partial_sort_copy(cache_map.begin(), cache_map.end(),
-                           top.begin(), top.end(), cmp_distant_refs);
-    std::cerr << "Top " << top.size() << " distant repeatedly referenced cache lines\n";
-    std::cerr << std::setw(18) << "cache line"
-              << ": " << std::setw(17) << "#references  "
-              << std::setw(14) << "#distant refs" << "\n";
-    for (std::vector<std::pair<addr_t, line_ref_t*> >::iterator it = top.begin();
-         it != top.end(); ++it) {
-        if (it->second == NULL) // Very small app.
-            break;
-        std::cerr << std::setw(18) << std::hex << std::showbase
-                  << (it->first << line_size_bits)
-                  << ": " << std::setw(12) << std::dec << it->second->total_refs
-                  << ", " << std::setw(12) << std::dec << it->second->distant_refs
-                  << "\n";
+                           top_distant.begin(), top_distant.end(), cmp_distant_refs);
+    // We symbolize both lists in one batch.
+    std::vector<std::string> names(top.size() + top_distant.size());
+    if (knobs.symbolizer != NULL) {
+        std::vector<addr_t> addrs;
+        for (const auto &entry : top)
+            addrs.push_back(entry.first << line_size_bits);
+        for (const auto &entry : top_distant)
+            addrs.push_back(entry.first << line_size_bits);
+        knobs.symbolizer->symbolize(addrs, &names);
     }
+    std::cerr << "Top " << top.size() << " frequently referenced cache lines\n";
+    print_top_lines(top, names, 0);
+    std::cerr << "Top " << top_distant.size() <<
+        " distant repeatedly referenced cache lines\n";
+    print_top_lines(top_distant, names, top.size());
 
     return true;
 }
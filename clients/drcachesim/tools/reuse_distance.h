@@ -36,8 +36,11 @@
 #ifndef _REUSE_DISTANCE_H_
 #define _REUSE_DISTANCE_H_ 1
 
+#include <algorithm>
+#include <queue>
 #include <unordered_map>
 #include <string>
+#include <vector>
 #include <assert.h>
 #include <iostream>
 #include "analysis_tool.h"
@@ -69,6 +72,9 @@ class reuse_distance_t : public analysis_tool_t
     static unsigned int knob_verbose;
 
  protected:
+    void print_top_lines(const std::vector<std::pair<addr_t, line_ref_t*> > &top,
+                         const std::vector<std::string> &names, size_t name_index);
+
     std::unordered_map<addr_t, line_ref_t*> cache_map;
     // This is our reuse distance histogram.
     std::unordered_map<int_least64_t, int_least64_t> dist_map;
@@ -76,6 +82,23 @@ class reuse_distance_t : public analysis_tool_t
 
     reuse_distance_knobs_t knobs;
 
+    // For sampling, we only track the lines whose tag hashes below
+    // sample_threshold, out of SAMPLE_MODULUS, and scale the results by the
+    // sampling rate.  To bound the memory used, once more than
+    // knobs.sampling_max_lines lines are tracked we lower the threshold to the
+    // largest hash tracked and drop the lines with that hash.
+    static uint64_t sample_hash(addr_t tag);
+    void shrink_sample();
+    static const uint64_t SAMPLE_MODULUS = 1 << 24;
+    bool sampling;
+    uint64_t sample_threshold;
+    double sample_rate;
+    // The tracked lines by hash, largest first.
+    std::priority_queue<std::pair<uint64_t, addr_t> > sampled_lines;
+    // The estimated unique lines, and the estimated histogram.
+    double sampled_unique;
+    std::unordered_map<int_least64_t, double> sampled_dist_map;
+
     uint64_t time_stamp;
     size_t line_size_bits;
     int_least64_t total_refs;
@@ -98,9 +121,12 @@ struct line_ref_t
     struct line_ref_t *next_skip;  // the next line_ref in the skip list
     int_least64_t depth; // only valid for skip list nodes; -1 for others
 
+    // The position of the line's most recent reference in the distance tree.
+    uint64_t slot;
+
     line_ref_t(addr_t val) :
         prev(NULL), next(NULL), total_refs(1), distant_refs(0), tag(val),
-        prev_skip(NULL), next_skip(NULL), depth(-1)
+        prev_skip(NULL), next_skip(NULL), depth(-1), slot(0)
     {
     }
 };
@@ -120,19 +146,30 @@ struct line_ref_t
 // We have a second doubly-linked list, a one-layer skip list, for
 // more efficient computation of the depth.  Each node in the skip
 // list stores its depth from the front.
+//
+// Alternatively, the depth is computed in logarithmic time with a Fenwick
+// tree over the lines' slots, which are handed out in reference order: a
+// slot holds 1 if it is the slot of some line's most recent reference, and
+// the depth of a line is the number of set slots after its own.  When the
+// slots run out we renumber the lines in list order and double the capacity.
 struct line_ref_list_t
 {
     line_ref_t *head;       // the most recently accessed cache line
     line_ref_t *gate;       // the earliest cache line refs within the threshold
     uint64_t cur_time;      // current time stamp
-    uint64_t unique_lines;  // the total number of unique cache lines accessed
+    uint64_t unique_lines;  // the number of unique cache lines not removed
     uint64_t threshold;     // the reuse distance threshold
     uint64_t skip_distance; // distance between skip list nodes
     bool verify_skip;       // check results using brute-force walks
+    bool use_tree;          // compute depths with the tree instead of skip list
+    std::vector<int_least64_t> tree; // 1-based Fenwick tree over the slots
+    uint64_t next_slot;     // the next free slot
 
-    line_ref_list_t(uint64_t reuse_threshold, uint64_t skip_dist, bool verify) :
+    line_ref_list_t(uint64_t reuse_threshold, uint64_t skip_dist, bool verify,
+                    bool distance_tree = false) :
         head(NULL), gate(NULL), cur_time(0), unique_lines(0),
-        threshold(reuse_threshold), skip_distance(skip_dist), verify_skip(verify)
+        threshold(reuse_threshold), skip_distance(skip_dist), verify_skip(verify),
+        use_tree(distance_tree), tree(1, 0), next_slot(0)
     {
     }
 
@@ -191,6 +228,76 @@ struct line_ref_list_t
         src->depth = -1;
     }
 
+    void
+    tree_update(uint64_t slot, int_least64_t delta)
+    {
+        for (uint64_t i = slot + 1; i < tree.size(); i += i & (~i + 1))
+            tree[i] += delta;
+    }
+
+    // Returns the number of set slots up to and including slot.
+    int_least64_t
+    tree_prefix(uint64_t slot)
+    {
+        int_least64_t sum = 0;
+        for (uint64_t i = slot + 1; i > 0; i -= i & (~i + 1))
+            sum += tree[i];
+        return sum;
+    }
+
+    // Gives head, which must not be in the tree, the newest slot.
+    void
+    tree_insert_head()
+    {
+        if (next_slot + 1 < tree.size()) {
+            head->slot = next_slot++;
+            tree_update(head->slot, 1);
+            return;
+        }
+        // Renumber all of the lines, oldest first, and rebuild the tree in
+        // linear time.
+        uint64_t capacity = 2 * std::max(unique_lines, (uint64_t)1024);
+        tree.assign(capacity + 1, 0);
+        uint64_t slot = unique_lines;
+        for (line_ref_t *node = head; node != NULL; node = node->next) {
+            node->slot = --slot;
+            tree[node->slot + 1] = 1;
+        }
+        assert(slot == 0);
+        for (uint64_t i = 1; i < tree.size(); ++i) {
+            uint64_t parent = i + (i & (~i + 1));
+            if (parent < tree.size())
+                tree[parent] += tree[i];
+        }
+        next_slot = unique_lines;
+    }
+
+    // Removes ref from the list, which is only supported with the tree.  The
+    // caller is responsible for deleting ref.
+    void
+    remove(line_ref_t *ref)
+    {
+        assert(use_tree);
+        if (DEBUG_VERBOSE(3))
+            std::cerr << "Remove tag 0x" << std::hex << ref->tag << "\n";
+        // Keep the gate at the same depth, or at the tail if the list is
+        // shorter than the threshold.
+        if (!ref_is_distant(ref)) {
+            if (gate->next != NULL)
+                gate = gate->next;
+            else if (ref == gate)
+                gate = gate->prev;
+        }
+        tree_update(ref->slot, -1);
+        if (ref->prev != NULL)
+            ref->prev->next = ref->next;
+        else
+            head = ref->next;
+        if (ref->next != NULL)
+            ref->next->prev = ref->prev;
+        unique_lines--;
+    }
+
     // Add a new cache line to the front of the list.
     // We may need to move gate forward if there are more cache lines
     // than the threshold so that the gate points to the earliest
@@ -213,6 +320,11 @@ struct line_ref_list_t
         unique_lines++;
         head->time_stamp = cur_time++;
 
+        if (use_tree) {
+            tree_insert_head();
+            return;
+        }
+
         // Add a new skip node if necessary.
         // We don't bother keeping one right at the front: too much overhead.
         uint64_t count = 0;
@@ -266,13 +378,18 @@ struct line_ref_list_t
 
         // Compute reuse distance.
         int_least64_t dist = 0;
-        line_ref_t *skip;
-        for (skip = ref; skip != NULL && skip->depth == -1; skip = skip->prev)
-            ++dist;
-        if (skip != NULL)
-            dist += skip->depth;
-        else
-            --dist; // Don't count self.
+        line_ref_t *skip = NULL;
+        if (use_tree) {
+            dist = (int_least64_t)unique_lines - tree_prefix(ref->slot);
+            tree_update(ref->slot, -1);
+        } else {
+            for (skip = ref; skip != NULL && skip->depth == -1; skip = skip->prev)
+                ++dist;
+            if (skip != NULL)
+                dist += skip->depth;
+            else
+                --dist; // Don't count self.
+        }
 
         if (DEBUG_VERBOSE(0) && verify_skip) {
             // Compute reuse distance with a full list walk as a sanity check.
@@ -313,6 +430,8 @@ struct line_ref_list_t
         head->prev = ref;
         head = ref;
         head->time_stamp = cur_time++;
+        if (use_tree)
+            tree_insert_head();
 
         if (DEBUG_VERBOSE(3))
             print_list();
@@ -37,6 +37,8 @@
 
 #include "analysis_tool.h"
 
+class report_symbolizer_t;
+
 /**
  * @file drmemtrace/reuse_distance_create.h
  * @brief DrMemtrace reuse distance tool creation.
@@ -55,6 +57,10 @@ struct reuse_distance_knobs_t {
         report_top(10),
         skip_list_distance(500),
         verify_skip(false),
+        use_distance_tree(false),
+        sampling_rate(1.0),
+        sampling_max_lines(64*1024),
+        symbolizer(nullptr),
         verbose(0) {}
      unsigned int line_size;
      bool report_histogram;
@@ -62,6 +68,12 @@ struct reuse_distance_knobs_t {
      unsigned int report_top;
      unsigned int skip_list_distance;
      bool verify_skip;
+     bool use_distance_tree;
+     double sampling_rate;
+     unsigned int sampling_max_lines;
+     // If non-null, used to symbolize the top-N report addresses.  It is owned by
+     // the caller and must outlive the tool.
+     report_symbolizer_t *symbolizer;
      unsigned int verbose;
 };
 
@@ -46,17 +46,56 @@
 
 const std::string reuse_time_t::TOOL_NAME = "Reuse time tool";
 
+// With a bound on the tracked lines, reuse times at or above this are
+// histogrammed in power-of-2 buckets rather than individually.
+static const int_least64_t BOUNDED_EXACT_LIMIT = 1024;
+
 analysis_tool_t *
 reuse_time_tool_create(unsigned int line_size,
-                       unsigned int verbose)
+                       unsigned int verbose,
+                       unsigned int max_lines,
+                       uint64_t window_refs)
 {
-    return new reuse_time_t(line_size, verbose);
+    return new reuse_time_t(line_size, verbose, max_lines, window_refs);
 }
 
-reuse_time_t::reuse_time_t(unsigned int line_size, unsigned int verbose) :
-    time_stamp(0), total_instructions(0), knob_verbose(verbose), knob_line_size(line_size)
+reuse_time_t::reuse_time_t(unsigned int line_size, unsigned int verbose,
+                           unsigned int max_lines, uint64_t window_refs) :
+    time_stamp(0), total_instructions(0), reuse_count(0), reuse_sum(0),
+    untracked_accesses(0), knob_verbose(verbose), knob_line_size(line_size),
+    knob_max_lines(max_lines), knob_window_refs(window_refs)
 {
     line_size_bits = compute_log2((int)knob_line_size);
+    if (knob_max_lines > 0) {
+        recent_lines.resize(knob_max_lines);
+        time_map.reserve(knob_max_lines);
+    }
+}
+
+static int
+log2_bucket(int_least64_t value)
+{
+    int bucket = 0;
+    while (value >>= 1)
+        ++bucket;
+    return bucket;
+}
+
+int_least64_t
+reuse_time_t::histogram_key(int_least64_t reuse_time)
+{
+    // The exact histogram grows with the longest reuse time, so when bounding
+    // memory we only keep short reuse times exactly.
+    if (knob_max_lines == 0 || reuse_time < BOUNDED_EXACT_LIMIT)
+        return reuse_time;
+    return int_least64_t(1) << log2_bucket(reuse_time);
+}
+
+void
+reuse_time_t::end_window()
+{
+    windows.push_back(cur_window);
+    cur_window = window_t();
 }
 
 reuse_time_t::~reuse_time_t()
@@ -94,14 +133,42 @@ reuse_time_t::process_memref(const memref_t &memref)
 
     time_stamp++;
     addr_t line = memref.data.addr >> line_size_bits;
-    if (time_map.count(line) > 0) {
-        int_least64_t reuse_time = time_stamp - time_map[line];
+    auto it = time_map.find(line);
+    if (it != time_map.end()) {
+        int_least64_t reuse_time = time_stamp - it->second;
         if (DEBUG_VERBOSE(3)) {
             std::cerr << "Reuse " << reuse_time << std::endl;
         }
-        reuse_time_histogram[reuse_time]++;
+        reuse_time_histogram[histogram_key(reuse_time)]++;
+        reuse_count++;
+        reuse_sum += reuse_time;
+        if (knob_window_refs > 0) {
+            size_t bucket = log2_bucket(reuse_time);
+            if (cur_window.buckets.size() <= bucket)
+                cur_window.buckets.resize(bucket + 1);
+            cur_window.buckets[bucket]++;
+            cur_window.reuse_count++;
+            cur_window.reuse_sum += reuse_time;
+        }
+        it->second = time_stamp;
+    } else {
+        untracked_accesses++;
+        cur_window.untracked++;
+        time_map[line] = time_stamp;
+    }
+    if (knob_max_lines > 0) {
+        addr_t &slot = recent_lines[time_stamp % knob_max_lines];
+        if (time_stamp > knob_max_lines) {
+            // The slot's line was accessed knob_max_lines ago: drop it unless it
+            // has been accessed again since.
+            auto old = time_map.find(slot);
+            if (old != time_map.end() && old->second == time_stamp - knob_max_lines)
+                time_map.erase(old);
+        }
+        slot = line;
     }
-    time_map[line] = time_stamp;
+    if (knob_window_refs > 0 && (uint64_t)time_stamp % knob_window_refs == 0)
+        end_window();
     return true;
 }
 
@@ -120,16 +187,39 @@ reuse_time_t::print_results() {
     std::cerr.precision(2);
     std::cerr.setf(std::ios::fixed);
 
-    int_least64_t count = 0;
-    int_least64_t sum = 0;
-    for (std::unordered_map<int_least64_t, int_least64_t>::iterator it =
-         reuse_time_histogram.begin(); it != reuse_time_histogram.end(); it++) {
-        count += it->second;
-        sum += it->first * it->second;
+    int_least64_t count = reuse_count;
+    std::cerr << "Mean reuse time: " << reuse_sum / static_cast<double>(count) << "\n";
+    if (knob_max_lines > 0) {
+        std::cerr << "Accesses with no reuse within " << knob_max_lines
+                  << " accesses: " << untracked_accesses << "\n";
     }
-    std::cerr << "Mean reuse time: " << sum / static_cast<double>(count) << "\n";
 
-    std::cerr << "Reuse time histogram:\n";
+    if (knob_window_refs > 0) {
+        // Include the final partial window.
+        std::vector<window_t> all = windows;
+        if (cur_window.reuse_count > 0 || cur_window.untracked > 0)
+            all.push_back(cur_window);
+        std::cerr << "Reuse time by window of " << knob_window_refs << " accesses"
+                  << " (count of reuse times in [2^i, 2^(i+1)) for i = 0, 1, ...):\n";
+        for (size_t i = 0; i < all.size(); ++i) {
+            const window_t &window = all[i];
+            std::cerr << std::setw(8) << i << " mean "
+                      << std::setw(10) << (window.reuse_count == 0 ? 0.0 :
+                                           window.reuse_sum /
+                                           static_cast<double>(window.reuse_count))
+                      << " none " << std::setw(8) << window.untracked << " :";
+            for (auto bucket : window.buckets)
+                std::cerr << " " << bucket;
+            std::cerr << std::endl;
+        }
+    }
+
+    std::cerr << "Reuse time histogram";
+    if (knob_max_lines > 0) {
+        std::cerr << " (from " << BOUNDED_EXACT_LIMIT
+                  << " on, each row covers up to twice its distance)";
+    }
+    std::cerr << ":\n";
     std::cerr << std::setw(8) << "Distance"
               << std::setw(12) << "Count"
               << std::setw(9) << "Percent"
@@ -35,25 +35,55 @@
 
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 #include "analysis_tool.h"
 
 class reuse_time_t : public analysis_tool_t
 {
  public:
-    reuse_time_t(unsigned int line_size, unsigned int verbose);
+    reuse_time_t(unsigned int line_size, unsigned int verbose,
+                 unsigned int max_lines = 0, uint64_t window_refs = 0);
     virtual ~reuse_time_t();
     virtual bool process_memref(const memref_t &memref);
     virtual bool print_results();
 
  protected:
+    int_least64_t histogram_key(int_least64_t reuse_time);
+    void end_window();
+
     std::unordered_map<addr_t, int_least64_t> time_map;
     int_least64_t time_stamp;
     int_least64_t total_instructions;
     std::unordered_map<int_least64_t, int_least64_t> reuse_time_histogram;
+    // Kept separately as a bounded histogram's keys are inexact.
+    int_least64_t reuse_count;
+    int_least64_t reuse_sum;
+
+    // With knob_max_lines, the line accessed at time t is kept in slot
+    // t % knob_max_lines, and is dropped from time_map when the slot is reused
+    // unless it has been accessed again since.
+    std::vector<addr_t> recent_lines;
+    // Accesses to lines not in time_map: first uses, plus reuses more than
+    // knob_max_lines accesses apart.
+    int_least64_t untracked_accesses;
+
+    // Per-window power-of-2 reuse time histograms, where bucket i counts the
+    // reuse times in [2^i, 2^(i+1)).
+    struct window_t {
+        window_t() : reuse_count(0), reuse_sum(0), untracked(0) {}
+        int_least64_t reuse_count;
+        int_least64_t reuse_sum;
+        int_least64_t untracked;
+        std::vector<int_least64_t> buckets;
+    };
+    std::vector<window_t> windows;
+    window_t cur_window;
 
     unsigned int knob_verbose;
     unsigned int knob_line_size;
+    unsigned int knob_max_lines;
+    uint64_t knob_window_refs;
     unsigned int line_size_bits;
 
     static const std::string TOOL_NAME;
@@ -46,10 +46,14 @@
 /**
  * Creates an analysis tool which computes reuse time (i.e., reuse
  * distance without regard to uniqueness).  The options are currently
- * documented in \ref sec_drcachesim_ops.
+ * documented in \ref sec_drcachesim_ops.  A non-zero \p max_lines bounds
+ * memory use by tracking only the lines accessed in that many most recent
+ * accesses, and a non-zero \p window_refs adds a histogram per window of that
+ * many accesses.
  */
 // These options are currently documented in ../common/options.cpp.
 analysis_tool_t *
-reuse_time_tool_create(unsigned int line_size = 64, unsigned int verbose = 0);
+reuse_time_tool_create(unsigned int line_size = 64, unsigned int verbose = 0,
+                       unsigned int max_lines = 0, uint64_t window_refs = 0);
 
 #endif /* _REUSE_TIME_CREATE_H_ */
@@ -0,0 +1,237 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <fstream>
+#include <iostream>
+#include <limits.h>
+#include "trace_slice.h"
+#include "../common/utils.h"
+#ifdef HAS_ZLIB
+# include "../tracer/chunked_ostream.h"
+#endif
+
+const std::string trace_slice_t::TOOL_NAME = "Trace slice tool";
+
+analysis_tool_t *
+trace_slice_tool_create(const trace_slice_knobs_t &knobs)
+{
+    return new trace_slice_t(knobs);
+}
+
+trace_slice_t::trace_slice_t(const trace_slice_knobs_t &knobs_) :
+    knobs(knobs_), out(NULL), tids(knobs_.tids.begin(), knobs_.tids.end()),
+    last_tid(0), last_thread(NULL), written_tid(0), total_instrs(0), total_refs(0),
+    kept_instrs(0), kept_refs(0), kept_threads(0)
+{
+    if (knobs.output_file.empty()) {
+        ERRMSG("Usage error: the trace slice tool requires an output file\n");
+        success = false;
+        return;
+    }
+    if ((knobs.timestamp_end != 0 && knobs.timestamp_end <= knobs.timestamp_start) ||
+        (knobs.instr_end != 0 && knobs.instr_end <= knobs.instr_start)) {
+        ERRMSG("Usage error: the trace slice window is empty\n");
+        success = false;
+        return;
+    }
+    if (knobs.chunk_entries > 0) {
+#ifdef HAS_ZLIB
+        out = new chunked_ostream_t(knobs.output_file, knobs.chunk_entries);
+#else
+        ERRMSG("Usage error: chunked output requires zlib support\n");
+        success = false;
+        return;
+#endif
+    } else
+        out = new std::ofstream(knobs.output_file.c_str(), std::ofstream::binary);
+    if (!*out) {
+        ERRMSG("Failed to open %s\n", knobs.output_file.c_str());
+        delete out;
+        out = NULL;
+        success = false;
+        return;
+    }
+    write_entry(TRACE_TYPE_HEADER, 0, TRACE_ENTRY_VERSION);
+}
+
+trace_slice_t::~trace_slice_t()
+{
+    finish();
+}
+
+// Writes the footer and closes the output, which for the chunked format is
+// what writes its index.
+bool
+trace_slice_t::finish()
+{
+    if (out == NULL)
+        return true;
+    write_entry(TRACE_TYPE_FOOTER, 0, 0);
+    bool res = !!*out;
+    delete out;
+    out = NULL;
+    return res;
+}
+
+bool
+trace_slice_t::in_window(const thread_t &thread) const
+{
+    if (thread.timestamp < knobs.timestamp_start ||
+        (knobs.timestamp_end != 0 && thread.timestamp >= knobs.timestamp_end))
+        return false;
+    return total_instrs >= knobs.instr_start &&
+        (knobs.instr_end == 0 || total_instrs < knobs.instr_end);
+}
+
+bool
+trace_slice_t::pc_selected(addr_t pc) const
+{
+    if (knobs.pc_ranges.empty())
+        return true;
+    for (const auto &range : knobs.pc_ranges) {
+        if (pc >= range.first && pc < range.second)
+            return true;
+    }
+    return false;
+}
+
+void
+trace_slice_t::write_entry(unsigned short type, unsigned short size, addr_t addr)
+{
+    trace_entry_t entry;
+    entry.type = type;
+    entry.size = size;
+    entry.addr = addr;
+    out->write((const char *)&entry, sizeof(entry));
+}
+
+void
+trace_slice_t::write_memref(const memref_t &memref, thread_t &thread)
+{
+    // Each switch to another thread is announced as the tracer does, with its
+    // process following so the reader need not have seen the thread before.
+    if (memref.data.tid != written_tid) {
+        write_entry(TRACE_TYPE_THREAD, 0, (addr_t)memref.data.tid);
+        write_entry(TRACE_TYPE_PID, 0, (addr_t)memref.data.pid);
+        written_tid = memref.data.tid;
+    }
+    if (!thread.written) {
+        thread.written = true;
+        ++kept_threads;
+    }
+    ++kept_refs;
+    if (type_is_instr(memref.instr.type) ||
+        memref.instr.type == TRACE_TYPE_INSTR_NO_FETCH) {
+        write_entry((unsigned short)memref.instr.type,
+                    (unsigned short)memref.instr.size, memref.instr.addr);
+    } else if (memref.marker.type == TRACE_TYPE_MARKER) {
+        write_entry(TRACE_TYPE_MARKER, (unsigned short)memref.marker.marker_type,
+                    memref.marker.marker_value);
+    } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
+        write_entry(TRACE_TYPE_THREAD_EXIT, 0, (addr_t)memref.exit.tid);
+    } else if (memref.flush.type == TRACE_TYPE_INSTR_FLUSH ||
+               memref.flush.type == TRACE_TYPE_DATA_FLUSH) {
+        // Large flushes are split in two entries as the size field is too small.
+        if (memref.flush.size <= USHRT_MAX) {
+            write_entry((unsigned short)memref.flush.type,
+                        (unsigned short)memref.flush.size, memref.flush.addr);
+        } else {
+            write_entry((unsigned short)memref.flush.type, 0, memref.flush.addr);
+            write_entry((unsigned short)(memref.flush.type + 1), 0,
+                        memref.flush.addr + memref.flush.size);
+        }
+    } else {
+        write_entry((unsigned short)memref.data.type, (unsigned short)memref.data.size,
+                    memref.data.addr);
+    }
+}
+
+bool
+trace_slice_t::process_memref(const memref_t &memref)
+{
+    if (out == NULL)
+        return false;
+    thread_t *thread;
+    if (memref.data.tid == last_tid && last_thread != NULL)
+        thread = last_thread;
+    else {
+        thread = &threads[memref.data.tid];
+        last_tid = memref.data.tid;
+        last_thread = thread;
+    }
+    ++total_refs;
+    bool keep;
+    if (!tids.empty() && tids.find(memref.data.tid) == tids.end())
+        keep = false;
+    else if (type_is_instr(memref.instr.type) ||
+             memref.instr.type == TRACE_TYPE_INSTR_NO_FETCH) {
+        thread->instr_kept = in_window(*thread) && pc_selected(memref.instr.addr);
+        keep = thread->instr_kept;
+    } else if (memref.marker.type == TRACE_TYPE_MARKER) {
+        if (memref.marker.marker_type == TRACE_MARKER_TYPE_TIMESTAMP)
+            thread->timestamp = memref.marker.marker_value;
+        keep = in_window(*thread);
+    } else if (memref.exit.type == TRACE_TYPE_THREAD_EXIT) {
+        // A thread that has had nothing written needs no exit either.
+        keep = thread->written;
+    } else if (memref.flush.type == TRACE_TYPE_INSTR_FLUSH ||
+               memref.flush.type == TRACE_TYPE_DATA_FLUSH)
+        keep = in_window(*thread);
+    else
+        keep = thread->instr_kept;
+    if (keep)
+        write_memref(memref, *thread);
+    if (type_is_instr(memref.instr.type) ||
+        memref.instr.type == TRACE_TYPE_INSTR_NO_FETCH) {
+        if (keep)
+            ++kept_instrs;
+        ++total_instrs;
+    }
+    return !!*out;
+}
+
+bool
+trace_slice_t::print_results()
+{
+    bool res = finish();
+    std::cerr << TOOL_NAME << " results:\n";
+    std::cerr << "  Kept " << kept_refs << " of " << total_refs << " records, "
+              << kept_instrs << " of " << total_instrs << " instructions, from "
+              << kept_threads << " of " << threads.size() << " threads\n";
+    if (!res) {
+        ERRMSG("Failed to write the trace slice to %s\n", knobs.output_file.c_str());
+        return false;
+    }
+    if (knobs.verbose >= 1)
+        std::cerr << "Wrote the trace slice to " << knobs.output_file << "\n";
+    return true;
+}
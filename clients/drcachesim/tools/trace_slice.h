@@ -0,0 +1,87 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* trace_slice: writes the filtered parts of a trace as a new trace. */
+
+#ifndef _TRACE_SLICE_H_
+#define _TRACE_SLICE_H_ 1
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "analysis_tool.h"
+#include "memref.h"
+#include "trace_entry.h"
+#include "trace_slice_create.h"
+
+class trace_slice_t : public analysis_tool_t
+{
+ public:
+    trace_slice_t(const trace_slice_knobs_t &knobs);
+    virtual ~trace_slice_t();
+    virtual bool process_memref(const memref_t &memref);
+    virtual bool print_results();
+
+ protected:
+    struct thread_t {
+        thread_t() : timestamp(0), instr_kept(false), written(false) {}
+        // The value of the thread's most recent timestamp marker.
+        uint64_t timestamp;
+        // Whether the thread's most recent instruction was kept, which decides
+        // whether its data references are.
+        bool instr_kept;
+        bool written;
+    };
+
+    bool in_window(const thread_t &thread) const;
+    bool pc_selected(addr_t pc) const;
+    void write_entry(unsigned short type, unsigned short size, addr_t addr);
+    void write_memref(const memref_t &memref, thread_t &thread);
+    bool finish();
+
+    trace_slice_knobs_t knobs;
+    std::ostream *out;
+    std::unordered_set<memref_tid_t> tids;
+    std::unordered_map<memref_tid_t, thread_t> threads;
+    memref_tid_t last_tid;
+    thread_t *last_thread;
+    memref_tid_t written_tid;
+    uint64_t total_instrs;
+    uint64_t total_refs;
+    uint64_t kept_instrs;
+    uint64_t kept_refs;
+    uint64_t kept_threads;
+    static const std::string TOOL_NAME;
+};
+
+#endif /* _TRACE_SLICE_H_ */
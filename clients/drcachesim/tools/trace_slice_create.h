@@ -0,0 +1,88 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* trace slice tool creation */
+
+#ifndef _TRACE_SLICE_CREATE_H_
+#define _TRACE_SLICE_CREATE_H_ 1
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "analysis_tool.h"
+#include "memref.h"
+
+/**
+ * @file drmemtrace/trace_slice_create.h
+ * @brief DrMemtrace trace slicing tool creation.
+ */
+
+/**
+ * The options for trace_slice_tool_create().
+ * The options are currently documented in \ref sec_drcachesim_ops.
+ */
+// These options are currently documented in ../common/options.cpp.
+struct trace_slice_knobs_t {
+    trace_slice_knobs_t() :
+        timestamp_start(0),
+        timestamp_end(0),
+        instr_start(0),
+        instr_end(0),
+        chunk_entries(0),
+        verbose(0) {}
+    std::string output_file;
+    // Threads to keep; empty keeps all threads.
+    std::vector<memref_tid_t> tids;
+    // The window of timestamps to keep; an end of 0 means no end.
+    uint64_t timestamp_start;
+    uint64_t timestamp_end;
+    // The range of instruction ordinals to keep; an end of 0 means no end.
+    uint64_t instr_start;
+    uint64_t instr_end;
+    // Ranges [start, end) of instruction addresses to keep; empty keeps all.
+    std::vector<std::pair<addr_t, addr_t> > pc_ranges;
+    // If non-zero, the output is written in the chunked format with this many
+    // entries per chunk.
+    unsigned int chunk_entries;
+    unsigned int verbose;
+};
+
+/**
+ * Creates an analysis tool which writes the parts of the trace which pass every
+ * filter in \p knobs to a new offline trace file.  The result is a valid trace
+ * which can be analyzed by any other tool in place of the original.  An
+ * instruction's data references are kept together with it.
+ */
+analysis_tool_t *
+trace_slice_tool_create(const trace_slice_knobs_t &knobs);
+
+#endif /* _TRACE_SLICE_CREATE_H_ */
@@ -0,0 +1,217 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include "working_set.h"
+#include "../common/utils.h"
+
+const std::string working_set_t::TOOL_NAME = "Working set tool";
+
+analysis_tool_t *
+working_set_tool_create(const working_set_knobs_t &knobs)
+{
+    return new working_set_t(knobs);
+}
+
+working_set_t::working_set_t(const working_set_knobs_t &knobs_) :
+    knobs(knobs_), total_refs(0), window_refs(0), total(knobs_.sketch_precision),
+    current(knobs_.sketch_precision), last_tid(0), last_thread(NULL)
+{
+    if (!IS_POWER_OF_2(knobs.line_size) || !IS_POWER_OF_2(knobs.page_size) ||
+        knobs.page_size < knobs.line_size) {
+        ERRMSG("Usage error: invalid line or page size\n");
+        success = false;
+        return;
+    }
+    if (knobs.window_refs == 0) {
+        ERRMSG("Usage error: the working set window must be positive\n");
+        success = false;
+        return;
+    }
+    if (knobs.sketch_precision < cardinality_sketch_t::MIN_PRECISION ||
+        knobs.sketch_precision > cardinality_sketch_t::MAX_PRECISION) {
+        ERRMSG("Usage error: the working set sketch precision must be between %u "
+               "and %u\n", cardinality_sketch_t::MIN_PRECISION,
+               cardinality_sketch_t::MAX_PRECISION);
+        success = false;
+        return;
+    }
+    line_size_bits = compute_log2((int)knobs.line_size);
+    page_size_bits = compute_log2((int)knobs.page_size);
+}
+
+working_set_t::~working_set_t()
+{
+}
+
+void
+working_set_t::end_thread_window(thread_t &thread)
+{
+    thread.peak_lines = std::max(thread.peak_lines, thread.current.lines.estimate());
+    thread.peak_pages = std::max(thread.peak_pages, thread.current.pages.estimate());
+    thread.current.lines.clear();
+    thread.current.pages.clear();
+    thread.window = windows.size();
+}
+
+void
+working_set_t::add_address(thread_t &thread, addr_t addr)
+{
+    if (thread.window != windows.size())
+        end_thread_window(thread);
+    addr_t line = addr >> line_size_bits;
+    addr_t page = addr >> page_size_bits;
+    total.lines.add(line);
+    total.pages.add(page);
+    current.lines.add(line);
+    current.pages.add(page);
+    thread.total.lines.add(line);
+    thread.total.pages.add(page);
+    thread.current.lines.add(line);
+    thread.current.pages.add(page);
+}
+
+void
+working_set_t::end_window()
+{
+    window_t window;
+    window.refs = window_refs;
+    window.lines = current.lines.estimate();
+    window.pages = current.pages.estimate();
+    window.total_lines = total.lines.estimate();
+    window.total_pages = total.pages.estimate();
+    windows.push_back(window);
+    current.lines.clear();
+    current.pages.clear();
+    window_refs = 0;
+}
+
+bool
+working_set_t::process_memref(const memref_t &memref)
+{
+    addr_t addr;
+    size_t size;
+    if (type_is_instr(memref.instr.type) ||
+        memref.instr.type == TRACE_TYPE_PREFETCH_INSTR) {
+        addr = memref.instr.addr;
+        size = memref.instr.size;
+    } else if (memref.data.type == TRACE_TYPE_READ ||
+               memref.data.type == TRACE_TYPE_WRITE ||
+               type_is_prefetch(memref.data.type)) {
+        addr = memref.data.addr;
+        size = memref.data.size;
+    } else
+        return true;
+    if (last_thread == NULL || memref.data.tid != last_tid) {
+        last_tid = memref.data.tid;
+        auto it = threads.find(last_tid);
+        if (it == threads.end()) {
+            it = threads.insert(std::make_pair(last_tid,
+                                               thread_t(knobs.sketch_precision))).first;
+            it->second.window = windows.size();
+        }
+        last_thread = &it->second;
+    }
+    // An access can straddle two lines.
+    add_address(*last_thread, addr);
+    if (size > 1 && ((addr + size - 1) >> line_size_bits) != (addr >> line_size_bits))
+        add_address(*last_thread, addr + size - 1);
+    ++last_thread->refs;
+    ++total_refs;
+    if (++window_refs == knobs.window_refs)
+        end_window();
+    return true;
+}
+
+// The estimates are not integral.
+static uint64_t
+round_count(double estimate)
+{
+    return (uint64_t)(estimate + 0.5);
+}
+
+bool
+working_set_t::print_results()
+{
+    if (window_refs > 0)
+        end_window();
+    for (auto &keyval : threads)
+        end_thread_window(keyval.second);
+    std::cerr << TOOL_NAME << " results:\n";
+    std::cerr << "Total references: " << total_refs << "\n";
+    std::cerr << "Estimated unique cache lines: " << round_count(total.lines.estimate())
+              << " (" << knobs.line_size << " bytes each)\n";
+    std::cerr << "Estimated unique pages: " << round_count(total.pages.estimate())
+              << " (" << knobs.page_size << " bytes each)\n";
+
+    std::cerr << "Footprint per window of " << knobs.window_refs << " references:\n";
+    std::cerr << std::setw(8) << "Window" << std::setw(12) << "Refs"
+              << std::setw(12) << "Lines" << std::setw(12) << "Pages"
+              << std::setw(14) << "Total lines" << std::setw(14) << "Total pages"
+              << "\n";
+    for (size_t i = 0; i < windows.size(); i++) {
+        std::cerr << std::setw(8) << i << std::setw(12) << windows[i].refs
+                  << std::setw(12) << round_count(windows[i].lines)
+                  << std::setw(12) << round_count(windows[i].pages)
+                  << std::setw(14) << round_count(windows[i].total_lines)
+                  << std::setw(14) << round_count(windows[i].total_pages) << "\n";
+    }
+
+    // Print the threads sorted by references.
+    std::vector<std::pair<memref_tid_t, const thread_t *> > sorted;
+    for (const auto &keyval : threads)
+        sorted.push_back(std::make_pair(keyval.first, &keyval.second));
+    std::sort(sorted.begin(), sorted.end(),
+              [](const std::pair<memref_tid_t, const thread_t *> &l,
+                 const std::pair<memref_tid_t, const thread_t *> &r) {
+                  if (l.second->refs != r.second->refs)
+                      return l.second->refs > r.second->refs;
+                  return l.first < r.first;
+              });
+    for (const auto &keyval : sorted) {
+        const thread_t *thread = keyval.second;
+        std::cerr << "Thread " << keyval.first << " footprint:\n";
+        std::cerr << std::setw(12) << thread->refs << " references\n";
+        std::cerr << std::setw(12) << round_count(thread->total.lines.estimate())
+                  << " estimated unique cache lines\n";
+        std::cerr << std::setw(12) << round_count(thread->total.pages.estimate())
+                  << " estimated unique pages\n";
+        std::cerr << std::setw(12) << round_count(thread->peak_lines)
+                  << " estimated peak cache lines in one window\n";
+        std::cerr << std::setw(12) << round_count(thread->peak_pages)
+                  << " estimated peak pages in one window\n";
+    }
+    return true;
+}
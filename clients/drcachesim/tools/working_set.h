@@ -0,0 +1,100 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* working_set: estimates footprints over time with cardinality sketches. */
+
+#ifndef _WORKING_SET_H_
+#define _WORKING_SET_H_ 1
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "analysis_tool.h"
+#include "cardinality_sketch.h"
+#include "memref.h"
+#include "working_set_create.h"
+
+class working_set_t : public analysis_tool_t
+{
+ public:
+    working_set_t(const working_set_knobs_t &knobs);
+    virtual ~working_set_t();
+    virtual bool process_memref(const memref_t &memref);
+    virtual bool print_results();
+
+ protected:
+    // A pair of line and page sketches.
+    struct footprint_t {
+        footprint_t(unsigned int precision) : lines(precision), pages(precision) {}
+        cardinality_sketch_t lines;
+        cardinality_sketch_t pages;
+    };
+    struct window_t {
+        uint64_t refs;
+        double lines;
+        double pages;
+        double total_lines;
+        double total_pages;
+    };
+    struct thread_t {
+        thread_t(unsigned int precision) : refs(0), window(0), total(precision),
+            current(precision), peak_lines(0.), peak_pages(0.) {}
+        uint64_t refs;
+        // The index of the window that current covers.  It is cleared lazily
+        // when the thread is next seen in a later window.
+        uint64_t window;
+        footprint_t total;
+        footprint_t current;
+        double peak_lines;
+        double peak_pages;
+    };
+
+    void add_address(thread_t &thread, addr_t addr);
+    void end_window();
+    void end_thread_window(thread_t &thread);
+
+    working_set_knobs_t knobs;
+    size_t line_size_bits;
+    size_t page_size_bits;
+    uint64_t total_refs;
+    uint64_t window_refs;
+    footprint_t total;
+    footprint_t current;
+    // One entry per completed window: a few words regardless of the footprint.
+    std::vector<window_t> windows;
+    std::unordered_map<memref_tid_t, thread_t> threads;
+    memref_tid_t last_tid;
+    thread_t *last_thread;
+    static const std::string TOOL_NAME;
+};
+
+#endif /* _WORKING_SET_H_ */
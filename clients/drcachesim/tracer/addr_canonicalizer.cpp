@@ -0,0 +1,121 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <algorithm>
+#include "addr_canonicalizer.h"
+
+void
+addr_canonicalizer_t::add_module(uint64_t start, uint64_t size, uint64_t base,
+                                 uint32_t index)
+{
+    // Tags at or above STACK_TAG_BASE belong to the stacks.
+    if (size == 0 || start < base || start + size - base > HEAP_SIZE ||
+        index + 1 >= STACK_TAG_BASE)
+        return;
+    modules.push_back(region_t(start, start + size, base, index + 1));
+}
+
+void
+addr_canonicalizer_t::add_heap(uint64_t base)
+{
+    heap_bases.push_back(base);
+}
+
+void
+addr_canonicalizer_t::add_stack(uint64_t base)
+{
+    stack_bases.push_back(base);
+}
+
+void
+addr_canonicalizer_t::finalize()
+{
+    // A module unloaded and then reloaded elsewhere has two entries, which are
+    // kept in the order of their addresses.
+    std::stable_sort(modules.begin(), modules.end());
+    // Every thread of a process records the same heap base.
+    std::sort(heap_bases.begin(), heap_bases.end());
+    heap_bases.erase(std::unique(heap_bases.begin(), heap_bases.end()),
+                     heap_bases.end());
+    heaps.clear();
+    for (size_t i = 0; i < heap_bases.size(); ++i) {
+        uint64_t end = heap_bases[i] + HEAP_SIZE;
+        if (i + 1 < heap_bases.size() && heap_bases[i + 1] < end)
+            end = heap_bases[i + 1];
+        heaps.push_back(region_t(heap_bases[i], end, heap_bases[i], HEAP_TAG));
+    }
+    // The stacks are laid out in the same order in every run, so a stack's rank
+    // identifies it even though its address differs.
+    std::sort(stack_bases.begin(), stack_bases.end());
+    stack_bases.erase(std::unique(stack_bases.begin(), stack_bases.end()),
+                      stack_bases.end());
+    stacks.clear();
+    for (size_t i = 0; i < stack_bases.size(); ++i) {
+        uint64_t stack = stack_bases[i];
+        uint64_t base = stack < STACK_BELOW ? 0 : stack - STACK_BELOW;
+        uint64_t start = base;
+        if (!stacks.empty()) {
+            // The space above the prior stack's base belongs to it up to
+            // STACK_ABOVE and to this stack beyond that.
+            uint64_t prior = stack_bases[i - 1];
+            start = (std::max)(start, (std::min)(prior + STACK_ABOVE, stack));
+            stacks.back().end = (std::min)(stacks.back().end, start);
+        }
+        stacks.push_back(region_t(start, stack + STACK_ABOVE, base, STACK_TAG_BASE + i));
+    }
+}
+
+const addr_canonicalizer_t::region_t *
+addr_canonicalizer_t::find(const std::vector<region_t> &regions, uint64_t addr)
+{
+    auto it = std::upper_bound(regions.begin(), regions.end(),
+                               region_t(addr, addr, 0, 0));
+    if (it == regions.begin())
+        return nullptr;
+    --it;
+    if (addr >= it->end)
+        return nullptr;
+    return &*it;
+}
+
+uint64_t
+addr_canonicalizer_t::canonicalize(uint64_t addr) const
+{
+    const region_t *region = find(modules, addr);
+    if (region == nullptr)
+        region = find(heaps, addr);
+    if (region == nullptr)
+        region = find(stacks, addr);
+    if (region == nullptr)
+        return addr;
+    return CANONICAL_FLAG | (region->tag << TAG_SHIFT) | (addr - region->base);
+}
@@ -0,0 +1,95 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* addr_canonicalizer: rewrites trace addresses as offsets from stable region
+ * bases so that traces of identical runs match despite address space layout
+ * randomization.
+ */
+
+#ifndef _ADDR_CANONICALIZER_H_
+#define _ADDR_CANONICALIZER_H_ 1
+
+#include <stdint.h>
+#include <vector>
+
+// A canonical address has its top bit set, a region tag in the bits below that
+// starting at TAG_SHIFT, and the address's offset from its region's base in the
+// low TAG_SHIFT bits.  The regions are the segments of each module, whose base
+// is the start of the whole module and whose tag is one plus the module's index;
+// the heaps, which start at their recorded bases and share HEAP_TAG; and the
+// thread stacks, which cover STACK_BELOW bytes below and STACK_ABOVE bytes above
+// each recorded stack base and whose tags are STACK_TAG_BASE plus the rank of
+// their base among all the stack bases.  Modules take precedence over heaps,
+// which take precedence over stacks, and adjacent heaps or stacks are clipped to
+// not overlap.  Any other address is left unchanged.  All the regions must be
+// added before finalize() is called, after which canonicalize() may be called
+// from multiple threads.
+class addr_canonicalizer_t
+{
+ public:
+    static const uint64_t CANONICAL_FLAG = 1ULL << 63;
+    static const int TAG_SHIFT = 40;
+    static const uint64_t HEAP_TAG = 0;
+    static const uint64_t STACK_TAG_BASE = 1ULL << 22;
+    static const uint64_t HEAP_SIZE = 1ULL << TAG_SHIFT;
+    static const uint64_t STACK_BELOW = 1ULL << 30;
+    static const uint64_t STACK_ABOVE = 1ULL << 20;
+
+    addr_canonicalizer_t() {}
+    // Adds the segment [start, start + size) of the module with the given index,
+    // whose offsets are taken from the module's lowest address base.
+    void add_module(uint64_t start, uint64_t size, uint64_t base, uint32_t index);
+    void add_heap(uint64_t base);
+    void add_stack(uint64_t base);
+    void finalize();
+    uint64_t canonicalize(uint64_t addr) const;
+
+ private:
+    struct region_t {
+        region_t(uint64_t start, uint64_t end, uint64_t base, uint64_t tag) :
+            start(start), end(end), base(base), tag(tag) {}
+        bool operator<(const region_t &rhs) const { return start < rhs.start; }
+        uint64_t start;
+        uint64_t end;
+        uint64_t base;
+        uint64_t tag;
+    };
+    static const region_t *find(const std::vector<region_t> &regions, uint64_t addr);
+
+    std::vector<region_t> modules;
+    std::vector<uint64_t> heap_bases;
+    std::vector<uint64_t> stack_bases;
+    std::vector<region_t> heaps;
+    std::vector<region_t> stacks;
+};
+
+#endif /* _ADDR_CANONICALIZER_H_ */
@@ -0,0 +1,179 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string.h>
+#include <zlib.h>
+#include "chunked_ostream.h"
+
+chunked_ostream_t::chunk_buf_t::chunk_buf_t(const std::string &path,
+                                            uint32_t chunk_entries_in) :
+    file(path.c_str(), std::ofstream::binary), ok(true), finished(false),
+    chunk_entries(chunk_entries_in)
+{
+    if (chunk_entries == 0)
+        chunk_entries = CHUNKED_TRACE_DEFAULT_CHUNK_ENTRIES;
+    buf.resize(chunk_entries * sizeof(trace_entry_t));
+    compressed.resize(compressBound((uLong)buf.size()));
+    setp(&buf[0], &buf[0] + buf.size());
+    memset(&state, 0, sizeof(state));
+    chunked_trace_header_t header = {CHUNKED_TRACE_MAGIC, CHUNKED_TRACE_VERSION,
+                                     chunk_entries};
+    if (!file.write((char *)&header, sizeof(header)))
+        ok = false;
+}
+
+chunked_ostream_t::chunk_buf_t::~chunk_buf_t()
+{
+    finish();
+}
+
+// Tracks the state the reader will have after these entries.
+void
+chunked_ostream_t::chunk_buf_t::scan_entries(const trace_entry_t *entries,
+                                             size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        const trace_entry_t &entry = entries[i];
+        uint64_t instrs = chunked_trace_instr_count(entry);
+        state.instr_count += instrs;
+        if (entry.type == TRACE_TYPE_INSTR_BUNDLE) {
+            for (int j = 0; j < entry.size; ++j) {
+                state.cur_pc = state.next_pc;
+                state.next_pc = state.cur_pc + entry.length[j];
+            }
+        } else if (instrs > 0) {
+            state.cur_pc = entry.addr;
+            state.next_pc = entry.addr + entry.size;
+        } else if (type_is_instr((trace_type_t)entry.type)) {
+            // A pc-only entry for -L0_filter.
+            state.cur_pc = entry.addr;
+        } else if (entry.type == TRACE_TYPE_THREAD) {
+            state.tid = entry.addr;
+            state.pid = tid2pid[state.tid];
+        } else if (entry.type == TRACE_TYPE_PID) {
+            state.pid = entry.addr;
+            if (tid2pid.find(state.tid) == tid2pid.end())
+                threads.push_back({state.tid, state.pid});
+            tid2pid[state.tid] = state.pid;
+        } else if (entry.type == TRACE_TYPE_MARKER &&
+                   entry.size == TRACE_MARKER_TYPE_TIMESTAMP) {
+            state.timestamp = entry.addr;
+        }
+    }
+}
+
+bool
+chunked_ostream_t::chunk_buf_t::write_chunk()
+{
+    size_t size = pptr() - pbase();
+    if (size == 0)
+        return ok;
+    if (size % sizeof(trace_entry_t) != 0)
+        ok = false; // Partial entries are not supported.
+    if (!ok)
+        return false;
+    chunked_trace_index_t entry = state;
+    entry.file_offset = (uint64_t)file.tellp();
+    entry.entry_count = size / sizeof(trace_entry_t);
+    entry.first_instr = state.first_instr + state.instr_count;
+    state.first_instr = entry.first_instr;
+    state.instr_count = 0;
+    scan_entries((trace_entry_t *)pbase(), (size_t)entry.entry_count);
+    entry.instr_count = state.instr_count;
+    uLongf compressed_size = (uLongf)compressed.size();
+    if (compress2(&compressed[0], &compressed_size, (const Bytef *)pbase(),
+                  (uLong)size, Z_DEFAULT_COMPRESSION) != Z_OK ||
+        !file.write((char *)&compressed[0], compressed_size)) {
+        ok = false;
+        return false;
+    }
+    entry.compressed_size = compressed_size;
+    index.push_back(entry);
+    setp(&buf[0], &buf[0] + buf.size());
+    return true;
+}
+
+chunked_ostream_t::chunk_buf_t::int_type
+chunked_ostream_t::chunk_buf_t::overflow(int_type c)
+{
+    if (!write_chunk())
+        return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int
+chunked_ostream_t::chunk_buf_t::sync()
+{
+    // We only write whole chunks (besides the last), so there is nothing to do.
+    return ok ? 0 : -1;
+}
+
+bool
+chunked_ostream_t::chunk_buf_t::finish()
+{
+    if (finished)
+        return ok;
+    finished = true;
+    if (!write_chunk())
+        return false;
+    chunked_trace_footer_t footer;
+    footer.index_offset = (uint64_t)file.tellp();
+    footer.num_chunks = index.size();
+    footer.num_threads = threads.size();
+    footer.magic = CHUNKED_TRACE_MAGIC;
+    if (!index.empty())
+        file.write((char *)&index[0], index.size() * sizeof(index[0]));
+    if (!threads.empty())
+        file.write((char *)&threads[0], threads.size() * sizeof(threads[0]));
+    file.write((char *)&footer, sizeof(footer));
+    file.close();
+    if (!file)
+        ok = false;
+    return ok;
+}
+
+chunked_ostream_t::chunked_ostream_t(const std::string &path, uint32_t chunk_entries)
+    : std::ostream(NULL), chunk_buf(path, chunk_entries)
+{
+    rdbuf(&chunk_buf);
+    if (!chunk_buf.is_ok())
+        setstate(std::ios_base::badbit);
+}
+
+chunked_ostream_t::~chunked_ostream_t()
+{
+    chunk_buf.finish();
+}
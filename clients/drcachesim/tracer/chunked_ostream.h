@@ -0,0 +1,91 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* chunked_ostream: an output stream that writes a trace in the chunked,
+ * indexed format described in chunked_trace.h.
+ */
+
+#ifndef _CHUNKED_OSTREAM_H_
+#define _CHUNKED_OSTREAM_H_ 1
+
+#include <fstream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "../common/chunked_trace.h"
+#include "../common/trace_entry.h"
+
+// The data written must consist of whole trace_entry_t records, as written by
+// raw2trace_t.  The index is written and the file closed by the destructor.
+class chunked_ostream_t : public std::ostream
+{
+ public:
+    explicit chunked_ostream_t(const std::string &path,
+                               uint32_t chunk_entries =
+                               CHUNKED_TRACE_DEFAULT_CHUNK_ENTRIES);
+    virtual ~chunked_ostream_t();
+
+ private:
+    class chunk_buf_t : public std::streambuf
+    {
+     public:
+        chunk_buf_t(const std::string &path, uint32_t chunk_entries);
+        virtual ~chunk_buf_t();
+        bool finish();
+        bool is_ok() const { return ok; }
+
+     protected:
+        virtual int_type overflow(int_type c);
+        virtual int sync();
+
+     private:
+        bool write_chunk();
+        void scan_entries(const trace_entry_t *entries, size_t count);
+
+        std::ofstream file;
+        bool ok;
+        bool finished;
+        uint32_t chunk_entries;
+        std::vector<char> buf;
+        std::vector<unsigned char> compressed;
+        std::vector<chunked_trace_index_t> index;
+        // The reader state as of the end of the entries written so far.
+        chunked_trace_index_t state;
+        std::unordered_map<uint64_t, uint64_t> tid2pid;
+        std::vector<chunked_trace_thread_t> threads;
+    };
+    chunk_buf_t chunk_buf;
+};
+
+#endif /* _CHUNKED_OSTREAM_H_ */
@@ -0,0 +1,248 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Standalone collector of the raw files streamed by the tracer's -stream_to. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "droption.h"
+#include "../common/trace_socket.h"
+
+static droption_t<std::string> op_listen
+(DROPTION_SCOPE_FRONTEND, "listen", "", "[Required] Address to listen on",
+ "Specifies the address, of the form [host:]port, on which to accept connections "
+ "from tracers run with -stream_to.  Without a host, all local addresses are used.");
+
+static droption_t<std::string> op_outdir
+(DROPTION_SCOPE_FRONTEND, "outdir", "", "[Required] Directory for received files",
+ "Specifies the existing directory under which the files sent by each tracer are "
+ "written, in the layout that the tracer would have created under its own -outdir: "
+ "a drmemtrace.*.dir subdirectory per traced process, which can be passed to "
+ "drraw2trace's -indir once the process exits.");
+
+static droption_t<unsigned int> op_connections
+(DROPTION_SCOPE_FRONTEND, "connections", 0, "Exit after this many tracers finish",
+ "If non-zero, the collector exits once this many connections, one per traced "
+ "process, have been accepted and closed.  Otherwise it runs until killed.");
+
+static droption_t<unsigned int> op_verbose
+(DROPTION_SCOPE_FRONTEND, "verbose", 0, "Verbosity level for diagnostic output",
+ "Verbosity level for diagnostic output.");
+
+#define FATAL_ERROR(msg, ...) do { \
+    fprintf(stderr, "ERROR: " msg "\n", ##__VA_ARGS__);    \
+    fflush(stderr); \
+    exit(1); \
+} while (0)
+
+#define VPRINT(level, ...) do { \
+    if (op_verbose.get_value() >= (level)) { \
+        fprintf(stderr, __VA_ARGS__); \
+        fflush(stderr); \
+    } \
+} while (0)
+
+// We copy file data through a bounded buffer rather than holding whole writes.
+#define COPY_CHUNK_SIZE (1024 * 1024)
+
+static std::mutex finished_lock;
+static std::condition_variable finished_cond;
+static unsigned int num_finished;
+
+// We only accept paths that stay within -outdir.
+static bool
+path_is_safe(const std::string &path)
+{
+    if (path.empty() || path[0] == '/')
+        return false;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string::npos)
+            end = path.size();
+        if (path.compare(start, end - start, "..") == 0)
+            return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+// Returns whether file data was received for fd, or skipped if fd is -1.
+static bool
+copy_data(trace_socket_t *conn, uint64_t size, int fd, std::vector<char> *buf)
+{
+    while (size > 0) {
+        size_t chunk = size < buf->size() ? (size_t)size : buf->size();
+        if (!conn->read(buf->data(), chunk))
+            return false;
+        if (fd != -1) {
+            char *cur = buf->data();
+            size_t left = chunk;
+            while (left > 0) {
+                ssize_t res = write(fd, cur, left);
+                if (res < 0 && errno == EINTR)
+                    continue;
+                if (res <= 0)
+                    return false;
+                cur += res;
+                left -= res;
+            }
+        }
+        size -= chunk;
+    }
+    return true;
+}
+
+// Handles the messages from one tracer process until it disconnects.
+static void
+serve_connection(trace_socket_t *conn, unsigned int index)
+{
+    std::unordered_map<uint32_t, int> files;
+    std::vector<char> buf(COPY_CHUNK_SIZE);
+    trace_socket_msg_t msg;
+    std::string error;
+    if (!conn->read(&msg, sizeof(msg)) || msg.type != TRACE_SOCKET_MSG_HELLO ||
+        msg.id != TRACE_SOCKET_VERSION || msg.size != 0)
+        error = "unknown protocol or version";
+    while (error.empty() && conn->read(&msg, sizeof(msg))) {
+        if (msg.type == TRACE_SOCKET_MSG_WRITE) {
+            auto it = files.find(msg.id);
+            if (it == files.end())
+                error = "write to a file that is not open";
+            else if (!copy_data(conn, msg.size, it->second, &buf))
+                error = "failed to write data";
+            continue;
+        }
+        if (msg.type == TRACE_SOCKET_MSG_CLOSE) {
+            auto it = files.find(msg.id);
+            if (it != files.end()) {
+                close(it->second);
+                files.erase(it);
+            }
+            continue;
+        }
+        if (msg.type != TRACE_SOCKET_MSG_CREATE_DIR &&
+            msg.type != TRACE_SOCKET_MSG_OPEN) {
+            error = "unknown message type";
+            break;
+        }
+        if (msg.size >= PATH_MAX) {
+            error = "path too long";
+            break;
+        }
+        std::string path(msg.size, '\0');
+        if (msg.size > 0 && !conn->read(&path[0], msg.size))
+            break;
+        bool ok = path_is_safe(path);
+        std::string full = op_outdir.get_value() + "/" + path;
+        if (ok && msg.type == TRACE_SOCKET_MSG_CREATE_DIR) {
+            ok = mkdir(full.c_str(), 0777) == 0;
+            VPRINT(1, "Connection %u: %s directory %s\n", index,
+                   ok ? "created" : "failed to create", full.c_str());
+        } else if (ok) {
+            int fd = -1;
+            if (files.find(msg.id) == files.end()) {
+                fd = open(full.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                          0666);
+            }
+            ok = fd != -1;
+            if (ok)
+                files[msg.id] = fd;
+            VPRINT(2, "Connection %u: %s file %s\n", index,
+                   ok ? "created" : "failed to create", full.c_str());
+        }
+        if (!conn->write_msg(TRACE_SOCKET_MSG_REPLY, ok ? 1 : 0, NULL, 0))
+            break;
+    }
+    if (!error.empty())
+        fprintf(stderr, "Connection %u: %s\n", index, error.c_str());
+    // A tracer that ended abruptly leaves truncated files, which drraw2trace
+    // converts as far as they go.
+    if (!files.empty())
+        fprintf(stderr, "Connection %u: closed with files still open\n", index);
+    for (auto &keyval : files)
+        close(keyval.second);
+    VPRINT(1, "Connection %u: done\n", index);
+    delete conn;
+    std::lock_guard<std::mutex> guard(finished_lock);
+    ++num_finished;
+    finished_cond.notify_all();
+}
+
+int
+main(int argc, const char *argv[])
+{
+    std::string parse_err;
+    if (!droption_parser_t::parse_argv(DROPTION_SCOPE_FRONTEND, argc, argv,
+                                       &parse_err, NULL) ||
+        op_listen.get_value().empty() || op_outdir.get_value().empty()) {
+        FATAL_ERROR("Usage error: %s\nUsage:\n%s", parse_err.c_str(),
+                    droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
+    }
+    struct stat st;
+    if (stat(op_outdir.get_value().c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        FATAL_ERROR("Output directory %s does not exist", op_outdir.get_value().c_str());
+
+    trace_socket_t listener;
+    if (!listener.listen_on(op_listen.get_value()))
+        FATAL_ERROR("Failed to listen on %s", op_listen.get_value().c_str());
+    VPRINT(1, "Listening on %s\n", op_listen.get_value().c_str());
+
+    unsigned int num_accepted = 0;
+    while (op_connections.get_value() == 0 ||
+           num_accepted < op_connections.get_value()) {
+        trace_socket_t *conn = new trace_socket_t;
+        if (!conn->accept_from(listener)) {
+            delete conn;
+            FATAL_ERROR("Failed to accept a connection: %s", strerror(errno));
+        }
+        VPRINT(1, "Connection %u: accepted\n", num_accepted);
+        std::thread(serve_connection, conn, num_accepted).detach();
+        ++num_accepted;
+    }
+    std::unique_lock<std::mutex> lock(finished_lock);
+    finished_cond.wait(lock, [num_accepted] { return num_finished == num_accepted; });
+    return 0;
+}
@@ -0,0 +1,131 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string.h>
+#include "compact_ostream.h"
+
+compact_ostream_t::compact_buf_t::compact_buf_t(const std::string &path) :
+    file(path.c_str(), std::ofstream::binary), ok(true), finished(false)
+{
+    buf.resize(BUF_ENTRIES * sizeof(trace_entry_t));
+    encoded.resize(BUF_ENTRIES * COMPACT_TRACE_MAX_RECORD);
+    setp(&buf[0], &buf[0] + buf.size());
+    compact_trace_header_t header = {COMPACT_TRACE_MAGIC, COMPACT_TRACE_VERSION,
+                                     (uint32_t)sizeof(addr_t)};
+    if (!file.write((char *)&header, sizeof(header)))
+        ok = false;
+}
+
+compact_ostream_t::compact_buf_t::~compact_buf_t()
+{
+    finish();
+}
+
+// Encodes and writes the whole entries in the buffer, keeping any trailing
+// partial entry for the next call.
+bool
+compact_ostream_t::compact_buf_t::encode_entries()
+{
+    if (!ok)
+        return false;
+    size_t size = pptr() - pbase();
+    size_t count = size / sizeof(trace_entry_t);
+    unsigned char *out = &encoded[0];
+    for (size_t i = 0; i < count; ++i) {
+        trace_entry_t entry;
+        memcpy(&entry, pbase() + i * sizeof(entry), sizeof(entry));
+        size_t len = codec.encode(entry, out);
+        if (len == 0) {
+            ok = false;
+            return false;
+        }
+        out += len;
+    }
+    if (!file.write((char *)&encoded[0], out - &encoded[0])) {
+        ok = false;
+        return false;
+    }
+    size_t leftover = size - count * sizeof(trace_entry_t);
+    memmove(&buf[0], pbase() + count * sizeof(trace_entry_t), leftover);
+    setp(&buf[0], &buf[0] + buf.size());
+    pbump((int)leftover);
+    return true;
+}
+
+compact_ostream_t::compact_buf_t::int_type
+compact_ostream_t::compact_buf_t::overflow(int_type c)
+{
+    if (!encode_entries())
+        return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+int
+compact_ostream_t::compact_buf_t::sync()
+{
+    if (!encode_entries() || !file.flush())
+        return -1;
+    return 0;
+}
+
+bool
+compact_ostream_t::compact_buf_t::finish()
+{
+    if (finished)
+        return ok;
+    finished = true;
+    if (!encode_entries())
+        return false;
+    if (pptr() != pbase())
+        ok = false; // A partial entry was left over.
+    file.close();
+    if (!file)
+        ok = false;
+    return ok;
+}
+
+compact_ostream_t::compact_ostream_t(const std::string &path)
+    : std::ostream(NULL), compact_buf(path)
+{
+    rdbuf(&compact_buf);
+    if (!compact_buf.is_ok())
+        setstate(std::ios_base::badbit);
+}
+
+compact_ostream_t::~compact_ostream_t()
+{
+    compact_buf.finish();
+}
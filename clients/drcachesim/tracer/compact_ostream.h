@@ -0,0 +1,85 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* compact_ostream: an output stream that writes a trace in the compact
+ * encoding described in compact_trace.h.
+ */
+
+#ifndef _COMPACT_OSTREAM_H_
+#define _COMPACT_OSTREAM_H_ 1
+
+#include <fstream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "../common/compact_trace.h"
+#include "../common/trace_entry.h"
+
+// The data written must consist of whole trace_entry_t records, as written by
+// raw2trace_t, though a record may be split across write calls.  The file is
+// flushed and closed by the destructor.
+class compact_ostream_t : public std::ostream
+{
+ public:
+    explicit compact_ostream_t(const std::string &path);
+    virtual ~compact_ostream_t();
+
+ private:
+    class compact_buf_t : public std::streambuf
+    {
+     public:
+        explicit compact_buf_t(const std::string &path);
+        virtual ~compact_buf_t();
+        bool finish();
+        bool is_ok() const { return ok; }
+
+     protected:
+        virtual int_type overflow(int_type c);
+        virtual int sync();
+
+     private:
+        bool encode_entries();
+
+        std::ofstream file;
+        bool ok;
+        bool finished;
+        // We encode in large batches to reduce the per-write overhead.
+        static const int BUF_ENTRIES = 4096;
+        std::vector<char> buf;
+        std::vector<unsigned char> encoded;
+        compact_trace_codec_t codec;
+    };
+    compact_buf_t compact_buf;
+};
+
+#endif /* _COMPACT_OSTREAM_H_ */
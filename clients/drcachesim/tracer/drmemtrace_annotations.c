@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -30,22 +30,13 @@
  * DAMAGE.
  */
 
-/* tlb_entry: represents a TLB entry.
+/* The definitions of the annotations in drmemtrace_annotations.h, for compiling
+ * into the application.  As with DynamoRIO's own annotation sources, this must
+ * be compiled without optimizations.
  */
 
-#ifndef _TLB_ENTRY_H_
-#define _TLB_ENTRY_H_ 1
+#include "drmemtrace_annotations.h"
 
-#include "caching_device_block.h"
+DR_DEFINE_ANNOTATION(void, drmemtrace_annotate_start_tracing, (void), )
 
-class tlb_entry_t : public caching_device_block_t
-{
- public:
-    // process ID to differentiate virtual pages
-    // that have the same VPN but belong to different processes.
-    memref_pid_t pid;
-
-    //XXX: support page privilege and MMU-related exceptions
-};
-
-#endif /* _TLB_ENTRY_H_ */
+DR_DEFINE_ANNOTATION(void, drmemtrace_annotate_stop_tracing, (void), )
@@ -0,0 +1,79 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drmemtrace: annotations for applications to delimit the regions to trace
+ * when run with -trace_annotations.
+ */
+
+#ifndef _DRMEMTRACE_ANNOTATIONS_H_
+#define _DRMEMTRACE_ANNOTATIONS_H_ 1
+
+/**
+ * @file drmemtrace_annotations.h
+ * @brief Annotations for marking the regions traced by drmemtrace's
+ * -trace_annotations.  The application must also compile drmemtrace_annotations.c.
+ */
+
+#include "dr_annotations_asm.h"
+
+/* To simplify project configuration, this pragma excludes the file from GCC warnings. */
+#ifdef __GNUC__
+# pragma GCC system_header
+#endif
+
+/**
+ * Enables tracing for all threads, if it is not already enabled.  Outside of
+ * -trace_annotations, and when not running under DynamoRIO, this does nothing.
+ */
+#define DRMEMTRACE_ANNOTATE_START_TRACING() \
+    drmemtrace_annotate_start_tracing()
+
+/**
+ * Disables tracing for all threads, if it is enabled.  Outside of
+ * -trace_annotations, and when not running under DynamoRIO, this does nothing.
+ */
+#define DRMEMTRACE_ANNOTATE_STOP_TRACING() \
+    drmemtrace_annotate_stop_tracing()
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+DR_DECLARE_ANNOTATION(void, drmemtrace_annotate_start_tracing, (void));
+
+DR_DECLARE_ANNOTATION(void, drmemtrace_annotate_stop_tracing, (void));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _DRMEMTRACE_ANNOTATIONS_H_ */
@@ -0,0 +1,76 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include "gzip_istream.h"
+
+// We read in large pieces as each call into zlib has some overhead.
+#define GZIP_BUF_SIZE (256 * 1024)
+
+gzip_istream_t::gzip_buf_t::gzip_buf_t(const std::string &path) :
+    buf(GZIP_BUF_SIZE)
+{
+    file = gzopen(path.c_str(), "rb");
+    setg(&buf[0], &buf[0], &buf[0]);
+}
+
+gzip_istream_t::gzip_buf_t::~gzip_buf_t()
+{
+    if (file != NULL)
+        gzclose(file);
+}
+
+gzip_istream_t::gzip_buf_t::int_type
+gzip_istream_t::gzip_buf_t::underflow()
+{
+    if (gptr() < egptr())
+        return traits_type::to_int_type(*gptr());
+    if (file == NULL)
+        return traits_type::eof();
+    // Returns less than asked-for at the end of the file, or -1 for an error.
+    int len = gzread(file, &buf[0], (unsigned int)buf.size());
+    if (len <= 0)
+        return traits_type::eof();
+    setg(&buf[0], &buf[0], &buf[0] + len);
+    return traits_type::to_int_type(*gptr());
+}
+
+gzip_istream_t::gzip_istream_t(const std::string &path)
+    : std::istream(NULL), gzip_buf(path)
+{
+    rdbuf(&gzip_buf);
+    if (!gzip_buf.is_ok())
+        setstate(std::ios_base::failbit);
+}
+
+gzip_istream_t::~gzip_istream_t()
+{
+}
@@ -0,0 +1,71 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* gzip_istream: an input stream reading a gzip-compressed file, such as a raw
+ * offline trace file written by the tracer with -raw_compress.
+ */
+
+#ifndef _GZIP_ISTREAM_H_
+#define _GZIP_ISTREAM_H_ 1
+
+#include <istream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+// This supports sequential reading only: seeking is not supported.
+class gzip_istream_t : public std::istream
+{
+ public:
+    explicit gzip_istream_t(const std::string &path);
+    virtual ~gzip_istream_t();
+
+ private:
+    class gzip_buf_t : public std::streambuf
+    {
+     public:
+        explicit gzip_buf_t(const std::string &path);
+        virtual ~gzip_buf_t();
+        bool is_ok() const { return file != NULL; }
+
+     protected:
+        virtual int_type underflow();
+
+     private:
+        gzFile file;
+        std::vector<char> buf;
+    };
+    gzip_buf_t gzip_buf;
+};
+
+#endif /* _GZIP_ISTREAM_H_ */
@@ -119,6 +119,139 @@ instru_t::instr_is_flush(instr_t *instr)
     return false;
 }
 
+#ifdef X86
+// For a gather or masked move, returns the size of each data element and of each
+// index element (0 for a masked move), along with the source operand holding the
+// mask.  Returns false for other opcodes.
+static bool
+vector_memref_layout(instr_t *instr, OUT uint *data_size, OUT uint *index_size,
+                     OUT int *mask_src)
+{
+    *index_size = 0;
+    *mask_src = 0;
+    switch (instr_get_opcode(instr)) {
+    case OP_vpgatherdd:
+    case OP_vgatherdps:
+        *data_size = 4;
+        *index_size = 4;
+        break;
+    case OP_vpgatherdq:
+    case OP_vgatherdpd:
+        *data_size = 8;
+        *index_size = 4;
+        break;
+    case OP_vpgatherqd:
+    case OP_vgatherqps:
+        *data_size = 4;
+        *index_size = 8;
+        break;
+    case OP_vpgatherqq:
+    case OP_vgatherqpd:
+        *data_size = 8;
+        *index_size = 8;
+        break;
+    case OP_vmaskmovps:
+    case OP_vpmaskmovd:
+        *data_size = 4;
+        break;
+    case OP_vmaskmovpd:
+    case OP_vpmaskmovq:
+        *data_size = 8;
+        break;
+    default:
+        return false;
+    }
+    if (*index_size != 0) {
+        // Gathers list the VSIB operand first and the mask second.
+        *mask_src = 1;
+    } else if (instr_num_dsts(instr) > 0 && opnd_is_memory_reference
+               (instr_get_dst(instr, 0))) {
+        // Stores list the mask first, except vpmaskmov* which lists the data first.
+        if (instr_get_opcode(instr) == OP_vpmaskmovd ||
+            instr_get_opcode(instr) == OP_vpmaskmovq)
+            *mask_src = 1;
+    }
+    return true;
+}
+#endif
+
+int
+instru_t::vector_memref_count(instr_t *instr, opnd_t ref, OUT ushort *elem_size)
+{
+#ifdef X86
+    uint data_size, index_size;
+    int mask_src;
+    if (!opnd_is_memory_reference(ref) ||
+        !vector_memref_layout(instr, &data_size, &index_size, &mask_src))
+        return 0;
+    int count;
+    if (index_size != 0) {
+        if (!opnd_is_vsib(ref) || instr_num_dsts(instr) == 0 ||
+            !opnd_is_reg(instr_get_dst(instr, 0)))
+            return 0;
+        // The narrower of the destination and the index vector bounds the count.
+        uint dst_bytes =
+            opnd_size_in_bytes(reg_get_size(opnd_get_reg(instr_get_dst(instr, 0))));
+        uint index_bytes = opnd_size_in_bytes(reg_get_size(opnd_get_index(ref)));
+        count = (int)(dst_bytes / data_size < index_bytes / index_size ?
+                      dst_bytes / data_size : index_bytes / index_size);
+    } else
+        count = (int)(opnd_size_in_bytes(opnd_get_size(ref)) / data_size);
+    if (count <= 0 || count > MAX_VECTOR_MEMREF_ELEMENTS)
+        return 0;
+    *elem_size = (ushort)data_size;
+    return count;
+#else
+    return 0;
+#endif
+}
+
+bool
+instru_t::vector_memref_addrs(instr_t *instr, opnd_t ref, dr_mcontext_t *mc,
+                              OUT addr_t *addrs)
+{
+#ifdef X86
+    uint data_size, index_size;
+    int mask_src;
+    ushort elem_size;
+    int count = vector_memref_count(instr, ref, &elem_size);
+    if (count == 0 || !vector_memref_layout(instr, &data_size, &index_size, &mask_src))
+        return false;
+    opnd_t mask_opnd = instr_get_src(instr, mask_src);
+    byte mask[sizeof(dr_ymm_t)];
+    if (!opnd_is_reg(mask_opnd) ||
+        !reg_get_value_ex(opnd_get_reg(mask_opnd), mc, mask))
+        return false;
+    byte index[sizeof(dr_ymm_t)];
+    addr_t base;
+    if (index_size != 0) {
+        if (!reg_get_value_ex(opnd_get_index(ref), mc, index))
+            return false;
+        base = (addr_t) opnd_compute_address
+            (opnd_create_far_base_disp(opnd_get_segment(ref), opnd_get_base(ref),
+                                       DR_REG_NULL, 0, opnd_get_disp(ref), OPSZ_4), mc);
+    } else
+        base = (addr_t) opnd_compute_address(ref, mc);
+    for (int i = 0; i < count; i++) {
+        // An element is accessed when the top bit of its mask element is set.
+        if ((mask[(i + 1) * data_size - 1] & 0x80) == 0) {
+            addrs[i] = 0;
+            continue;
+        }
+        if (index_size == 0) {
+            addrs[i] = base + i * data_size;
+            continue;
+        }
+        int64 idx = index_size == 4 ? (int64) *(int *)(index + i * index_size) :
+            *(int64 *)(index + i * index_size);
+        addrs[i] = base + (addr_t)(idx * opnd_get_scale(ref));
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 void
 instru_t::insert_obtain_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
                              reg_id_t reg_addr, reg_id_t reg_scratch, opnd_t ref,
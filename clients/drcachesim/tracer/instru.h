@@ -45,6 +45,10 @@
 // Versioning for our drmodtrack custom module fields.
 #define CUSTOM_MODULE_VERSION 1
 
+// The most elements a gather or masked vector memory operand can touch, each of
+// which is traced as its own entry.
+#define MAX_VECTOR_MEMREF_ELEMENTS 8
+
 class instru_t
 {
 public:
@@ -66,6 +70,8 @@ public:
     virtual size_t get_entry_size(byte *buf_ptr) const = 0;
     virtual addr_t get_entry_addr(byte *buf_ptr) const = 0;
     virtual void set_entry_addr(byte *buf_ptr, addr_t addr) = 0;
+    // Returns how many dynamic instructions the entry represents.
+    virtual int get_entry_instr_count(byte *buf_ptr) const = 0;
 
     // All of these return how many bytes to advance the buffer pointer.
 
@@ -77,6 +83,17 @@ public:
     virtual int append_thread_header(byte *buf_ptr, thread_id_t tid) = 0;
     // This is a per-buffer-writeout header.
     virtual int append_unit_header(byte *buf_ptr, thread_id_t tid) = 0;
+    // Appends one entry per element of a gather or masked vector memory operand
+    // of the instruction at pc.  Elements with a zero address in addrs were not
+    // accessed.
+    virtual int append_vector_memref(byte *buf_ptr, app_pc pc, bool write,
+                                     ushort elem_size, const addr_t *addrs,
+                                     int count) = 0;
+    // Appends a TRACE_MARKER_TYPE_MEMREF_RANGE marker and its data reference for
+    // all iterations of one memory operand of a string loop, which access size
+    // bytes from start.
+    virtual int append_memref_range(byte *buf_ptr, bool write, ushort elem_size,
+                                    addr_t start, size_t size, bool backward) = 0;
 
     // These insert inlined code to add an entry into the trace buffer.
     virtual int instrument_memref(void *drcontext, instrlist_t *ilist, instr_t *where,
@@ -99,6 +116,14 @@ public:
     static unsigned short instr_to_instr_type(instr_t *instr,
                                               bool repstr_expanded = false);
     static bool instr_is_flush(instr_t *instr);
+    // Returns the number of elements, each elem_size bytes, of ref if it is the
+    // VSIB operand of a gather or the memory operand of a masked vector move.
+    // Returns 0 for any other operand.
+    static int vector_memref_count(instr_t *instr, opnd_t ref, OUT ushort *elem_size);
+    // Fills in the address of each element of a vector_memref_count() operand
+    // from the register values in mc, using zero for masked-off elements.
+    static bool vector_memref_addrs(instr_t *instr, opnd_t ref, dr_mcontext_t *mc,
+                                    OUT addr_t *addrs);
     static int get_cpu_id();
     static uint64 get_timestamp();
     virtual void insert_obtain_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
@@ -131,6 +156,7 @@ public:
     virtual size_t get_entry_size(byte *buf_ptr) const;
     virtual addr_t get_entry_addr(byte *buf_ptr) const;
     virtual void set_entry_addr(byte *buf_ptr, addr_t addr);
+    virtual int get_entry_instr_count(byte *buf_ptr) const;
 
     virtual int append_pid(byte *buf_ptr, process_id_t pid);
     virtual int append_tid(byte *buf_ptr, thread_id_t tid);
@@ -139,6 +165,11 @@ public:
     virtual int append_iflush(byte *buf_ptr, addr_t start, size_t size);
     virtual int append_thread_header(byte *buf_ptr, thread_id_t tid);
     virtual int append_unit_header(byte *buf_ptr, thread_id_t tid);
+    virtual int append_vector_memref(byte *buf_ptr, app_pc pc, bool write,
+                                     ushort elem_size, const addr_t *addrs,
+                                     int count);
+    virtual int append_memref_range(byte *buf_ptr, bool write, ushort elem_size,
+                                    addr_t start, size_t size, bool backward);
 
     virtual int instrument_memref(void *drcontext, instrlist_t *ilist, instr_t *where,
                                   reg_id_t reg_ptr, int adjust,
@@ -171,6 +202,8 @@ public:
     offline_instru_t(void (*insert_load_buf)(void *, instrlist_t *,
                                              instr_t *, reg_id_t),
                      bool memref_needs_info,
+                     bool instr_only,
+                     bool physical,
                      drvector_t *reg_vector,
                      ssize_t (*write_file)(file_t file,
                                            const void *data,
@@ -178,12 +211,16 @@ public:
                      file_t module_file);
     virtual ~offline_instru_t();
 
+    // Writes the list of modules seen so far to file, as is done at exit.
+    bool write_module_list(file_t file);
+
     virtual size_t sizeof_entry() const;
 
     virtual trace_type_t get_entry_type(byte *buf_ptr) const;
     virtual size_t get_entry_size(byte *buf_ptr) const;
     virtual addr_t get_entry_addr(byte *buf_ptr) const;
     virtual void set_entry_addr(byte *buf_ptr, addr_t addr);
+    virtual int get_entry_instr_count(byte *buf_ptr) const;
 
     virtual int append_pid(byte *buf_ptr, process_id_t pid);
     virtual int append_tid(byte *buf_ptr, thread_id_t tid);
@@ -192,6 +229,11 @@ public:
     virtual int append_iflush(byte *buf_ptr, addr_t start, size_t size);
     virtual int append_thread_header(byte *buf_ptr, thread_id_t tid);
     virtual int append_unit_header(byte *buf_ptr, thread_id_t tid);
+    virtual int append_vector_memref(byte *buf_ptr, app_pc pc, bool write,
+                                     ushort elem_size, const addr_t *addrs,
+                                     int count);
+    virtual int append_memref_range(byte *buf_ptr, bool write, ushort elem_size,
+                                    addr_t start, size_t size, bool backward);
 
     virtual int instrument_memref(void *drcontext, instrlist_t *ilist, instr_t *where,
                                   reg_id_t reg_ptr, int adjust,
@@ -208,6 +250,14 @@ public:
     virtual void bb_analysis(void *drcontext, void *tag, void **bb_field,
                              instrlist_t *ilist, bool repstr_expanded);
 
+    // For OFFLINE_FILE_FLAG_PHYSICAL: writes a mapping of the virtual page number
+    // virt_page to the physical page number phys_page.
+    int append_phys_mapping(byte *buf_ptr, addr_t virt_page, addr_t phys_page);
+    // For OFFLINE_FILE_FLAG_PHYSICAL: returns in [*start, *end] the range of
+    // addresses whose pages the entry at buf_ptr may reference, or false if it
+    // references none that post-processing translates.
+    bool get_entry_addr_range(byte *buf_ptr, OUT addr_t *start, OUT addr_t *end) const;
+
     static bool custom_module_data(void * (*load_cb)(module_data_t *module),
                                    int (*print_cb)(void *data, char *dst,
                                                    size_t max_len),
@@ -223,6 +273,9 @@ private:
     };
 
     bool instr_has_multiple_different_memrefs(instr_t *instr);
+    uint file_flags() const;
+    bool memref_address_is_static(void *drcontext, instr_t *app, opnd_t ref,
+                                  dr_pred_type_t pred);
     int insert_save_entry(void *drcontext, instrlist_t *ilist, instr_t *where,
                           reg_id_t reg_ptr, reg_id_t scratch, int adjust,
                           offline_entry_t *entry);
@@ -234,6 +287,10 @@ private:
     int insert_save_type_and_size(void *drcontext, instrlist_t *ilist, instr_t *where,
                                   reg_id_t reg_ptr, reg_id_t scratch, int adjust,
                                   instr_t *app, opnd_t ref, bool write);
+    // Whether data references are omitted, leaving one pc entry per block.
+    bool instrs_only;
+    // Whether we record physical page mappings, which requires full addresses.
+    bool physical;
     ssize_t (*write_file_func)(file_t file, const void *data, size_t count);
     file_t modfile;
 
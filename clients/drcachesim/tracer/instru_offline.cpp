@@ -45,6 +45,8 @@
 #include <string.h> /* for strlen */
 
 static const ptr_uint_t MAX_INSTR_COUNT = 64*1024;
+// An upper bound on any single instruction's length across our architectures.
+static const uint MAX_INSTR_BYTES = IF_X86_ELSE(17, 4);
 
 void * (*offline_instru_t::user_load)(module_data_t *module);
 int (*offline_instru_t::user_print)(void *data, char *dst, size_t max_len);
@@ -53,13 +55,16 @@ void (*offline_instru_t::user_free)(void *data);
 offline_instru_t::offline_instru_t(void (*insert_load_buf)(void *, instrlist_t *,
                                                            instr_t *, reg_id_t),
                                    bool memref_needs_info,
+                                   bool instr_only,
+                                   bool physical,
                                    drvector_t *reg_vector,
                                    ssize_t (*write_file)(file_t file,
                                                          const void *data,
                                                          size_t count),
                                    file_t module_file)
   : instru_t(insert_load_buf, memref_needs_info, reg_vector),
-    write_file_func(write_file), modfile(module_file)
+    instrs_only(instr_only), physical(physical), write_file_func(write_file),
+    modfile(module_file)
 {
     drcovlib_status_t res = drmodtrack_init();
     DR_ASSERT(res == DRCOVLIB_SUCCESS);
@@ -73,23 +78,32 @@ offline_instru_t::offline_instru_t(void (*insert_load_buf)(void *, instrlist_t *
 }
 
 offline_instru_t::~offline_instru_t()
+{
+    bool ok = write_module_list(modfile);
+    DR_ASSERT(ok);
+    drcovlib_status_t res = drmodtrack_exit();
+    DR_ASSERT(res == DRCOVLIB_SUCCESS);
+}
+
+bool
+offline_instru_t::write_module_list(file_t file)
 {
     drcovlib_status_t res;
     size_t size = 8192;
     char *buf;
     size_t wrote;
+    bool ok = false;
     do {
         buf = (char *)dr_global_alloc(size);
         res = drmodtrack_dump_buf(buf, size, &wrote);
         if (res == DRCOVLIB_SUCCESS) {
-            ssize_t written = write_file_func(modfile, buf, wrote - 1/*no null*/);
-            DR_ASSERT(written == (ssize_t)wrote - 1);
+            ssize_t written = write_file_func(file, buf, wrote - 1/*no null*/);
+            ok = (written == (ssize_t)wrote - 1);
         }
         dr_global_free(buf, size);
         size *= 2;
     } while (res == DRCOVLIB_ERROR_BUF_TOO_SMALL);
-    res = drmodtrack_exit();
-    DR_ASSERT(res == DRCOVLIB_SUCCESS);
+    return ok;
 }
 
 void *
@@ -188,6 +202,7 @@ offline_instru_t::get_entry_type(byte *buf_ptr) const
     case OFFLINE_TYPE_PID: return TRACE_TYPE_PID;
     case OFFLINE_TYPE_TIMESTAMP: return TRACE_TYPE_THREAD; // Closest.
     case OFFLINE_TYPE_IFLUSH: return TRACE_TYPE_INSTR_FLUSH;
+    case OFFLINE_TYPE_EXTENDED: return TRACE_TYPE_MARKER;
     }
     DR_ASSERT(false);
     return TRACE_TYPE_THREAD_EXIT; // Unknown: returning rarest entry.
@@ -200,6 +215,15 @@ offline_instru_t::get_entry_size(byte *buf_ptr) const
     return 0;
 }
 
+int
+offline_instru_t::get_entry_instr_count(byte *buf_ptr) const
+{
+    offline_entry_t *entry = (offline_entry_t *) buf_ptr;
+    if (entry->addr.type == OFFLINE_TYPE_PC)
+        return (int)entry->pc.instr_count;
+    return 0;
+}
+
 addr_t
 offline_instru_t::get_entry_addr(byte *buf_ptr) const
 {
@@ -280,6 +304,12 @@ offline_instru_t::append_thread_header(byte *buf_ptr, thread_id_t tid)
     new_buf += sizeof(*entry);
     new_buf += append_tid(new_buf, tid);
     new_buf += append_pid(new_buf, dr_get_process_id());
+    entry = (offline_entry_t *) new_buf;
+    entry->extended.type = OFFLINE_TYPE_EXTENDED;
+    entry->extended.ext = OFFLINE_EXT_TYPE_FILE_FLAGS;
+    entry->extended.valueA = file_flags();
+    entry->extended.valueB = 0;
+    new_buf += sizeof(*entry);
     return (int)(new_buf - buf_ptr);
 }
 
@@ -295,6 +325,95 @@ offline_instru_t::append_unit_header(byte *buf_ptr, thread_id_t tid)
     return (int)(new_buf - buf_ptr);
 }
 
+int
+offline_instru_t::append_phys_mapping(byte *buf_ptr, addr_t virt_page, addr_t phys_page)
+{
+    offline_entry_t *entry = (offline_entry_t *) buf_ptr;
+    entry->extended.type = OFFLINE_TYPE_EXTENDED;
+    entry->extended.ext = OFFLINE_EXT_TYPE_PHYS_MAPPING;
+    DR_ASSERT((unsigned long long)virt_page < 1ULL<<EXT_VALUE_A_BITS);
+    entry->extended.valueA = virt_page;
+    entry->extended.valueB = 0;
+    ++entry;
+    entry->combined_value = phys_page;
+    return 2 * sizeof(offline_entry_t);
+}
+
+bool
+offline_instru_t::get_entry_addr_range(byte *buf_ptr, OUT addr_t *start,
+                                       OUT addr_t *end) const
+{
+    offline_entry_t *entry = (offline_entry_t *) buf_ptr;
+    switch (entry->addr.type) {
+    case OFFLINE_TYPE_MEMREF:
+    case OFFLINE_TYPE_MEMREF_HIGH:
+        // Post-processing translates just the start of each access.
+        *start = (addr_t) entry->combined_value;
+        *end = *start;
+        return true;
+    case OFFLINE_TYPE_PC: {
+        uint containing;
+        app_pc modstart;
+        size_t modsize;
+        const char *path;
+        // Post-processing skips code not in a module (FIXME i#2062).
+        if ((entry->pc.modidx == 0 && entry->pc.modoffs == 0) ||
+            drmodtrack_lookup_module((uint)entry->pc.modidx, &containing, &modstart,
+                                     &modsize, &path) != DRCOVLIB_SUCCESS)
+            return false;
+        // We don't know the instrs' lengths, so we cover their maximum.
+        uint count = entry->pc.instr_count == 0 ? 1 : (uint)entry->pc.instr_count;
+        *start = (addr_t) (modstart + entry->pc.modoffs);
+        *end = *start + count * MAX_INSTR_BYTES - 1;
+        return true;
+    }
+    }
+    return false;
+}
+
+int
+offline_instru_t::append_vector_memref(byte *buf_ptr, app_pc pc, bool write,
+                                       ushort elem_size, const addr_t *addrs, int count)
+{
+    offline_entry_t *entry = (offline_entry_t *) buf_ptr;
+    if (memref_needs_full_info) {
+        app_pc modbase;
+        uint modidx;
+        if (drmodtrack_lookup(dr_get_current_drcontext(), pc, &modidx, &modbase) !=
+            DRCOVLIB_SUCCESS) {
+            // FIXME i#2062: add non-module support (see insert_save_pc()).
+            modidx = 0;
+            modbase = pc;
+        }
+        entry->pc.type = OFFLINE_TYPE_PC;
+        entry->pc.modoffs = pc - modbase;
+        entry->pc.modidx = modidx;
+        entry->pc.instr_count = 0;
+        ++entry;
+    }
+    // The post-processor expects one entry per element, so we keep the zero
+    // addresses of masked-off elements for it to drop.
+    for (int i = 0; i < count; i++) {
+        entry->combined_value = addrs[i];
+        ++entry;
+    }
+    return (int)((byte *)entry - buf_ptr);
+}
+
+int
+offline_instru_t::append_memref_range(byte *buf_ptr, bool write, ushort elem_size,
+                                      addr_t start, size_t size, bool backward)
+{
+    // The post-processor knows the type and element size from the instruction.
+    byte *new_buf = buf_ptr;
+    new_buf += append_marker(new_buf, TRACE_MARKER_TYPE_MEMREF_RANGE,
+                             ((uintptr_t)size << 1) | (backward ? 1 : 0));
+    offline_entry_t *entry = (offline_entry_t *) new_buf;
+    entry->combined_value = start;
+    ++entry;
+    return (int)((byte *)entry - buf_ptr);
+}
+
 int
 offline_instru_t::insert_save_entry(void *drcontext, instrlist_t *ilist, instr_t *where,
                                     reg_id_t reg_ptr, reg_id_t scratch, int adjust,
@@ -383,11 +502,11 @@ offline_instru_t::insert_save_addr(void *drcontext, instrlist_t *ilist, instr_t
     drreg_status_t res;
 #ifdef X86
     if (opnd_is_near_base_disp(ref) && opnd_get_base(ref) != DR_REG_NULL &&
-        opnd_get_index(ref) == DR_REG_NULL) {
+        opnd_get_index(ref) == DR_REG_NULL && !physical) {
         /* Optimization: to avoid needing a scratch reg to lea into, we simply
          * store the base reg directly and add the disp during post-processing.
          * We only do this for x86 for now to avoid dealing with complexities of
-         * PC bases.
+         * PC bases.  Recording physical mappings needs the full address.
          */
         reg_addr = opnd_get_base(ref);
         if (opnd_get_base(ref) == reg_ptr) {
@@ -453,12 +572,45 @@ offline_instru_t::instr_has_multiple_different_memrefs(instr_t *instr)
     return false;
 }
 
+uint
+offline_instru_t::file_flags() const
+{
+    uint flags = physical ? OFFLINE_FILE_FLAG_PHYSICAL : 0;
+    if (instrs_only)
+        return flags | OFFLINE_FILE_FLAG_INSTR_ONLY;
+#if defined(X86) && defined(X64)
+    // The tracer never sees an elided address, so it could not record the
+    // mapping of its page.
+    if (!memref_needs_full_info && !physical)
+        return flags | OFFLINE_FILE_FLAG_ELIDE_RIP_REL;
+#endif
+    return flags;
+}
+
+// Returns whether post-processing can compute ref's address from the instr's pc,
+// so that no entry is needed.  This must match summarize_memref() in raw2trace.
+bool
+offline_instru_t::memref_address_is_static(void *drcontext, instr_t *app, opnd_t ref,
+                                           dr_pred_type_t pred)
+{
+    if ((file_flags() & OFFLINE_FILE_FLAG_ELIDE_RIP_REL) == 0 ||
+        !opnd_is_rel_addr(ref) || pred != DR_PRED_NONE)
+        return false;
+    // Post-processing only decodes module code.
+    app_pc modbase;
+    uint modidx;
+    return drmodtrack_lookup(drcontext, instr_get_app_pc(app), &modidx, &modbase) ==
+        DRCOVLIB_SUCCESS;
+}
+
 int
 offline_instru_t::instrument_memref(void *drcontext, instrlist_t *ilist, instr_t *where,
                                     reg_id_t reg_ptr, int adjust,
                                     instr_t *app, opnd_t ref, bool write,
                                     dr_pred_type_t pred)
 {
+    if (memref_address_is_static(drcontext, app, ref, pred))
+        return adjust;
     // Post-processor distinguishes read, write, prefetch, flush, and finds size.
     if (!memref_needs_full_info) // For full info we skip this for !pred
         instrlist_set_auto_predicate(ilist, pred);
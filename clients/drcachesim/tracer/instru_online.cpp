@@ -73,6 +73,18 @@ online_instru_t::get_entry_size(byte *buf_ptr) const
     return entry->size;
 }
 
+int
+online_instru_t::get_entry_instr_count(byte *buf_ptr) const
+{
+    trace_entry_t *entry = (trace_entry_t *) buf_ptr;
+    if (type_is_instr((trace_type_t)entry->type) ||
+        entry->type == TRACE_TYPE_INSTR_NO_FETCH)
+        return 1;
+    if (entry->type == TRACE_TYPE_INSTR_BUNDLE)
+        return entry->size;
+    return 0;
+}
+
 addr_t
 online_instru_t::get_entry_addr(byte *buf_ptr) const
 {
@@ -165,6 +177,45 @@ online_instru_t::append_unit_header(byte *buf_ptr, thread_id_t tid)
     return (int)(new_buf - buf_ptr);
 }
 
+int
+online_instru_t::append_vector_memref(byte *buf_ptr, app_pc pc, bool write,
+                                      ushort elem_size, const addr_t *addrs, int count)
+{
+    trace_entry_t *entry = (trace_entry_t *) buf_ptr;
+    if (memref_needs_full_info) {
+        // As in instrument_memref(), a 0-sized instr entry supplies the PC.
+        entry->type = TRACE_TYPE_INSTR;
+        entry->size = 0;
+        entry->addr = (addr_t) pc;
+        ++entry;
+    }
+    for (int i = 0; i < count; i++) {
+        if (addrs[i] == 0)
+            continue;
+        entry->type = (ushort)(write ? TRACE_TYPE_WRITE : TRACE_TYPE_READ);
+        entry->size = elem_size;
+        entry->addr = addrs[i];
+        ++entry;
+    }
+    return (int)((byte *)entry - buf_ptr);
+}
+
+int
+online_instru_t::append_memref_range(byte *buf_ptr, bool write, ushort elem_size,
+                                     addr_t start, size_t size, bool backward)
+{
+    trace_entry_t *entry = (trace_entry_t *) buf_ptr;
+    entry->type = TRACE_TYPE_MARKER;
+    entry->size = (ushort) TRACE_MARKER_TYPE_MEMREF_RANGE;
+    entry->addr = ((addr_t)size << 1) | (backward ? 1 : 0);
+    ++entry;
+    entry->type = (ushort)(write ? TRACE_TYPE_WRITE : TRACE_TYPE_READ);
+    entry->size = elem_size;
+    entry->addr = start;
+    ++entry;
+    return (int)((byte *)entry - buf_ptr);
+}
+
 void
 online_instru_t::insert_save_pc(void *drcontext, instrlist_t *ilist, instr_t *where,
                                 reg_id_t base, reg_id_t scratch, app_pc pc, int adjust)
@@ -32,6 +32,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <string.h>
 #ifdef LINUX
 # include <sys/types.h>
 # include <unistd.h>
@@ -59,15 +60,40 @@
 # define PAGE_START(addr) ((addr) & (~((1 << PAGE_BITS)-1)))
 # define PAGE_OFFS(addr) ((addr) & ((1 << PAGE_BITS)-1))
 static const addr_t PAGE_INVALID = (addr_t)-1;
+
+// The cache covers 256MB of distinct pages at 512KB of memory.
+# define CACHE_BITS 16
+# define CACHE_SIZE (1 << CACHE_BITS)
+# define CACHE_MASK (CACHE_SIZE - 1)
+// Entry layout: valid:1 | tag:23 | pfn:40.  Pages whose tag or frame does not
+// fit are simply not cached.
+# define ENTRY_VALID 0x8000000000000000ULL
+# define ENTRY_TAG_SHIFT 40
+# define ENTRY_TAG_MASK ((1ULL << 23) - 1)
+# define ENTRY_PFN_MASK ((1ULL << ENTRY_TAG_SHIFT) - 1)
+# define ENTRY_TAG(vpn) (((uint64_t)(vpn)) >> CACHE_BITS)
+# define ENTRY_MATCHES(entry, vpn) \
+    (((entry) >> ENTRY_TAG_SHIFT) == (ENTRY_TAG(vpn) | (ENTRY_VALID >> ENTRY_TAG_SHIFT)))
+// How many pagemap entries we read per syscall on a miss.  The batch is aligned
+// so that neighboring misses share it.
+# define BATCH_PAGES 32
 #endif
 
 physaddr_t::physaddr_t()
 #ifdef LINUX
-    : last_vpage(PAGE_INVALID), last_ppage(PAGE_INVALID), fd(-1), count(0)
+    : cache(NULL), fd(-1), count(0)
 #endif
 {
     // Nothing else.
-    // No destructor needed either: ifstream closes when destroyed.
+}
+
+physaddr_t::~physaddr_t()
+{
+#ifdef LINUX
+    delete [] cache;
+    if (fd != -1)
+        close(fd);
+#endif
 }
 
 bool
@@ -80,10 +106,18 @@ physaddr_t::init()
     // We can't read pagemap with any buffered i/o, like ifstream, as we'll
     // get EINVAL on any non-8-aligned size, and ifstream at least likes to
     // read buffers of non-aligned sizes.
+    // We may be called again in a forked child, which needs its own pagemap.
+    if (fd != -1)
+        close(fd);
     fd = open(pagemap.c_str(), O_RDONLY);
     // Accessing /proc/pid/pagemap requires privileges on some distributions,
     // such as Fedora with recent kernels.  We have no choice but to fail there.
-    return (fd != -1);
+    if (fd == -1)
+        return false;
+    if (cache == NULL)
+        cache = new uint64_t[CACHE_SIZE];
+    clear();
+    return true;
 #else
     // i#1727: we assume this is not possible on Windows.  If it is we
     // may want to split into physaddr_linux.cpp vs others.
@@ -91,57 +125,92 @@ physaddr_t::init()
 #endif
 }
 
+#ifdef LINUX
+void
+physaddr_t::clear()
+{
+    memset(cache, 0, CACHE_SIZE * sizeof(cache[0]));
+}
+
+// Reads the batch of pagemap entries containing vpn, caches every present page
+// in it, and returns the physical page for vpn or PAGE_INVALID.
+addr_t
+physaddr_t::read_pagemap(addr_t vpn)
+{
+    if (fd == -1)
+        return PAGE_INVALID;
+    // The pagemap file contains one 64-bit int per page, which we assume
+    // here is 4096 bytes.
+    // (XXX i#1703: handle large pages)
+    addr_t first = vpn & ~((addr_t)BATCH_PAGES - 1);
+    uint64_t entries[BATCH_PAGES];
+    ssize_t got = pread64(fd, entries, sizeof(entries),
+                          (off64_t)first * sizeof(entries[0]));
+    if (got <= 0)
+        return PAGE_INVALID;
+    addr_t res = PAGE_INVALID;
+    for (uint i = 0; i < got / sizeof(entries[0]); i++) {
+        uint64_t entry = entries[i];
+        if (!TESTALL(PAGEMAP_VALID, entry) || TESTANY(PAGEMAP_SWAP, entry))
+            continue;
+        uint64_t pfn = entry & PAGEMAP_PFN;
+        addr_t cur = first + i;
+        if (cur == vpn)
+            res = (addr_t)(pfn << PAGE_BITS);
+        if (ENTRY_TAG(cur) <= ENTRY_TAG_MASK && pfn <= ENTRY_PFN_MASK) {
+            cache[cur & CACHE_MASK] =
+                ENTRY_VALID | (ENTRY_TAG(cur) << ENTRY_TAG_SHIFT) | pfn;
+        }
+    }
+    return res;
+}
+#endif
+
 addr_t
 physaddr_t::virtual2physical(addr_t virt)
 {
 #ifdef LINUX
-    addr_t vpage = PAGE_START(virt);
-    bool use_cache = true;
     if (op_virt2phys_freq.get_value() > 0 && ++count >= op_virt2phys_freq.get_value()) {
         // Flush the cache and re-sync with the kernel
-        use_cache = false;
-        last_vpage = PAGE_INVALID;
-        v2p.clear();
+        clear();
         count = 0;
     }
-    if (use_cache) {
-        // Use cached values on the assumption that the kernel hasn't re-mapped
-        // this virtual page.
-        if (vpage == last_vpage)
-            return last_ppage + PAGE_OFFS(virt);
-        // XXX i#1703: add (debug-build-only) internal stats here and
-        // on cache_t::request() fastpath.
-        std::unordered_map<addr_t,addr_t>::iterator exists = v2p.find(vpage);
-        if (exists != v2p.end()) {
-            last_vpage = vpage;
-            last_ppage = exists->second;
-            return last_ppage + PAGE_OFFS(virt);
-        }
-    }
-    // Not cached, or forced to re-sync, so we have to read from the file.
-    if (fd == -1)
-        return 0;
-    // The pagemap file contains one 64-bit int per page, which we assume
-    // here is 4096 bytes.
-    // (XXX i#1703: handle large pages)
-    // Thus we want offset:
-    //   (addr / 4096 * 8) == ((addr >> 12) << 3) == addr >> 9
-    if (lseek64(fd, vpage >> 9, SEEK_SET) < 0)
+    addr_t vpn = virt >> PAGE_BITS;
+    // Use cached values on the assumption that the kernel hasn't re-mapped
+    // this virtual page: we are told about unmaps and moves via invalidate().
+    // XXX i#1703: add (debug-build-only) internal stats here and
+    // on cache_t::request() fastpath.
+    uint64_t entry = cache[vpn & CACHE_MASK];
+    if (ENTRY_MATCHES(entry, vpn))
+        return (addr_t)((entry & ENTRY_PFN_MASK) << PAGE_BITS) + PAGE_OFFS(virt);
+    addr_t ppage = read_pagemap(vpn);
+    if (ppage == PAGE_INVALID)
         return 0;
-    unsigned long long entry;
-    if (read(fd, (char *)&entry, sizeof(entry)) != sizeof(entry))
-        return 0;
-    if (!TESTALL(PAGEMAP_VALID, entry) || TESTANY(PAGEMAP_SWAP, entry))
-        return 0;
-    last_ppage = (addr_t)((entry & PAGEMAP_PFN) << PAGE_BITS);
     if (op_verbose.get_value() >= 2) {
         std::cerr << "virtual " << virt << " => physical " <<
-            (last_ppage + PAGE_OFFS(virt)) << std::endl;
+            (ppage + PAGE_OFFS(virt)) << std::endl;
     }
-    v2p[vpage] = last_ppage;
-    last_vpage = vpage;
-    return last_ppage + PAGE_OFFS(virt);
+    return ppage + PAGE_OFFS(virt);
 #else
     return 0;
 #endif
 }
+
+void
+physaddr_t::invalidate(addr_t start, size_t size)
+{
+#ifdef LINUX
+    if (cache == NULL || size == 0)
+        return;
+    addr_t first = start >> PAGE_BITS;
+    addr_t last = (start + size - 1) >> PAGE_BITS;
+    if (last < first || last - first >= CACHE_SIZE) {
+        clear();
+        return;
+    }
+    for (addr_t vpn = first; vpn <= last; vpn++) {
+        if (ENTRY_MATCHES(cache[vpn & CACHE_MASK], vpn))
+            cache[vpn & CACHE_MASK] = 0;
+    }
+#endif
+}
@@ -36,24 +36,31 @@
 #ifndef _PHYSADDR_H_
 #define _PHYSADDR_H_ 1
 
-#include <fstream>
-#include <unordered_map>
+#include <stdint.h>
 #include "../common/trace_entry.h"
 
 class physaddr_t
 {
  public:
     physaddr_t();
+    ~physaddr_t();
     bool init();
     addr_t virtual2physical(addr_t virt);
+    // Drops any cached translations for [start, start+size), which the app is
+    // about to unmap or move.
+    void invalidate(addr_t start, size_t size);
 
  private:
-    // Assumed to be single-threaded
 #ifdef LINUX
-    addr_t last_vpage;
-    addr_t last_ppage;
+    addr_t read_pagemap(addr_t vpn);
+    void clear();
+
+    // Translations are cached in a direct-mapped table indexed by the low bits
+    // of the virtual page number.  Each entry packs a valid bit, the rest of the
+    // virtual page number as a tag, and the physical frame number into a single
+    // word, so concurrent lookups from multiple threads never see a torn entry.
+    uint64_t *cache;
     int fd;
-    std::unordered_map<addr_t,addr_t> v2p;
     unsigned int count;
 #endif
 };
@@ -38,12 +38,18 @@
 #include "drcovlib.h"
 #include "raw2trace.h"
 #include "instru.h"
+#include "../common/chunked_trace.h"
 #include "../common/memref.h"
 #include "../common/trace_entry.h"
 #include <algorithm>
 #include <cstring>
 #include <fstream>
+#include <functional>
+#include <queue>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 // XXX: DR should export this
@@ -283,6 +289,35 @@ raw2trace_t::do_module_parsing_and_mapping()
    return "";
 }
 
+const std::vector<drmodtrack_info_t> &
+raw2trace_t::get_module_list() const
+{
+    return modlist;
+}
+
+const std::vector<raw2trace_t::thread_summary_t> &
+raw2trace_t::get_thread_summaries() const
+{
+    return thread_summaries;
+}
+
+bool
+raw2trace_t::write_thread_out(uint tidx, const char *data, size_t size)
+{
+    if (!thread_out[tidx]->write(data, size))
+        return false;
+    if (per_thread_output) {
+        thread_summary_t &summary = thread_summaries[tidx];
+        const trace_entry_t *entry = (const trace_entry_t *)data;
+        const trace_entry_t *end = (const trace_entry_t *)(data + size);
+        for (; entry < end; ++entry) {
+            ++summary.entries;
+            summary.instrs += chunked_trace_instr_count(*entry);
+        }
+    }
+    return true;
+}
+
 std::string
 raw2trace_t::find_mapped_trace_address(app_pc trace_address, OUT app_pc *mapped_address)
 {
@@ -290,24 +325,43 @@ raw2trace_t::find_mapped_trace_address(app_pc trace_address, OUT app_pc *mapped_
         return "Failed to call do_module_parsing_and_mapping() first";
     if (mapped_address == nullptr)
         return "Invalid parameter";
+    app_pc trace_start = nullptr, mapped_start = nullptr;
+    size_t size;
+    std::string error = find_mapped_trace_bounds(trace_address, &trace_start,
+                                                 &mapped_start, &size);
+    if (!error.empty())
+        return error;
+    *mapped_address = trace_address - trace_start + mapped_start;
+    return "";
+}
+
+std::string
+raw2trace_t::find_mapped_trace_bounds(app_pc trace_address, OUT app_pc *trace_start,
+                                      OUT app_pc *mapped_start, OUT size_t *size)
+{
+    if (modhandle == nullptr || modlist.empty())
+        return "Failed to call do_module_parsing_and_mapping() first";
+    if (trace_start == nullptr || mapped_start == nullptr || size == nullptr)
+        return "Invalid parameter";
     // For simplicity we do a linear search, caching the prior hit.
-    if (trace_address >= last_orig_base &&
-        trace_address < last_orig_base + last_map_size) {
-        *mapped_address = trace_address - last_orig_base + last_map_base;
-        return "";
-    }
-    for (std::vector<module_t>::iterator mvi = modvec.begin();
-         mvi != modvec.end(); ++mvi) {
-        if (trace_address >= mvi->orig_base &&
-            trace_address < mvi->orig_base + mvi->map_size) {
-            *mapped_address = trace_address - mvi->orig_base + mvi->map_base;
-            last_orig_base = mvi->orig_base;
-            last_map_size = mvi->map_size;
-            last_map_base = mvi->map_base;
-            return "";
+    if (trace_address < last_orig_base ||
+        trace_address >= last_orig_base + last_map_size) {
+        std::vector<module_t>::iterator mvi;
+        for (mvi = modvec.begin(); mvi != modvec.end(); ++mvi) {
+            if (trace_address >= mvi->orig_base &&
+                trace_address < mvi->orig_base + mvi->map_size)
+                break;
         }
+        if (mvi == modvec.end())
+            return "Trace address not found";
+        last_orig_base = mvi->orig_base;
+        last_map_size = mvi->map_size;
+        last_map_base = mvi->map_base;
     }
-    return "Trace address not found";
+    *trace_start = last_orig_base;
+    *mapped_start = last_map_base;
+    *size = last_map_size;
+    return "";
 }
 
 /***************************************************************************
@@ -317,57 +371,141 @@ raw2trace_t::find_mapped_trace_address(app_pc trace_address, OUT app_pc *mapped_
 #define FAULT_INTERRUPTED_BB "INTERRUPTED"
 
 // We do our own buffering to avoid performance problems for some istreams where
-// seekg is slow.  We expect just 1 entry peeked and put back the vast majority of the
-// time, but we use a vector for generality.  We expect our overall performance to
-// be i/o bound (or ISA decode bound) and aren't worried about some extra copies
-// from the vector.
+// seekg is slow, and to turn the many small reads of the conversion into a
+// bounded number of large ones per thread.  We expect just 1 entry peeked and put
+// back the vast majority of the time.
 bool
 raw2trace_t::read_from_thread_file(uint tidx, offline_entry_t *dest, size_t count,
                                    OUT size_t *num_read)
 {
-    size_t from_buf = 0;
-    if (!pre_read[tidx].empty()) {
-        from_buf = (std::min)(pre_read[tidx].size(), count);
-        memcpy(dest, &pre_read[tidx][0], from_buf*sizeof(*dest));
-        pre_read[tidx].erase(pre_read[tidx].begin(), pre_read[tidx].begin() + from_buf);
-        dest += from_buf;
-        count -= from_buf;
-    }
-    if (count > 0) {
-        if (!thread_files[tidx]->read((char*)dest, count*sizeof(*dest))) {
-            if (num_read != nullptr)
-                *num_read = from_buf + (size_t)thread_files[tidx]->gcount();
-            return false;
+    read_ahead_t &ahead = read_ahead[tidx];
+    size_t done = 0;
+    while (done < count) {
+        if (ahead.pos == ahead.end) {
+            if (count - done >= read_ahead_entries) {
+                // Large requests bypass the buffer.
+                if (!thread_files[tidx]->read((char*)(dest + done),
+                                              (count - done)*sizeof(*dest))) {
+                    if (num_read != nullptr) {
+                        *num_read = done +
+                            (size_t)thread_files[tidx]->gcount()/sizeof(*dest);
+                    }
+                    return false;
+                }
+                done = count;
+                break;
+            }
+            if (ahead.buf.size() < read_ahead_entries)
+                ahead.buf.resize(read_ahead_entries);
+            thread_files[tidx]->read((char*)&ahead.buf[0],
+                                     read_ahead_entries*sizeof(ahead.buf[0]));
+            ahead.pos = 0;
+            ahead.end = (size_t)thread_files[tidx]->gcount()/sizeof(ahead.buf[0]);
+            if (ahead.end == 0) {
+                if (num_read != nullptr)
+                    *num_read = done;
+                return false;
+            }
         }
+        size_t from_buf = (std::min)(ahead.end - ahead.pos, count - done);
+        memcpy(dest + done, &ahead.buf[ahead.pos], from_buf*sizeof(*dest));
+        ahead.pos += from_buf;
+        done += from_buf;
     }
     if (num_read != nullptr)
-        *num_read = from_buf + count;
+        *num_read = done;
     return true;
 }
 
 void
 raw2trace_t::unread_from_thread_file(uint tidx, offline_entry_t *dest, size_t count)
 {
-    // We expect 1 the vast majority of the time, 2 occasionally.
-    for (size_t i = 0; i < count; ++i)
-        pre_read[tidx].push_back(*(dest + i));
+    read_ahead_t &ahead = read_ahead[tidx];
+    if (ahead.pos >= count) {
+        ahead.pos -= count;
+        memcpy(&ahead.buf[ahead.pos], dest, count*sizeof(*dest));
+    } else {
+        // Some of the entries bypassed the buffer.
+        ahead.buf.insert(ahead.buf.begin() + ahead.pos, dest, dest + count);
+        ahead.end += count;
+    }
 }
 
 bool
 raw2trace_t::thread_file_at_eof(uint tidx)
 {
-    return pre_read[tidx].empty() && thread_files[tidx]->eof();
+    return read_ahead[tidx].pos == read_ahead[tidx].end && thread_files[tidx]->eof();
+}
+
+// Consumes the file flags entry that follows the pid in newer thread files.
+void
+raw2trace_t::read_file_flags(uint tidx)
+{
+    offline_entry_t in_entry;
+    if (!read_from_thread_file(tidx, &in_entry, 1))
+        return;
+    if (in_entry.extended.type == OFFLINE_TYPE_EXTENDED &&
+        in_entry.extended.ext == OFFLINE_EXT_TYPE_FILE_FLAGS) {
+        file_flags[tidx] = (uint)in_entry.extended.valueA;
+        VPRINT(2, "File %u has flags 0x%x\n", tidx, file_flags[tidx]);
+    } else
+        unread_from_thread_file(tidx, &in_entry, 1);
+}
+
+void
+raw2trace_t::release_thread_file(uint tidx)
+{
+    std::vector<offline_entry_t>().swap(read_ahead[tidx].buf);
+    read_ahead[tidx].pos = 0;
+    read_ahead[tidx].end = 0;
+    std::unordered_map<addr_t, addr_t>().swap(phys_pages[tidx]);
+}
+
+addr_t
+raw2trace_t::map_address(uint tidx, addr_t virt)
+{
+    if ((file_flags[tidx] & OFFLINE_FILE_FLAG_PHYSICAL) != 0)
+        return to_physical(tidx, virt);
+    if (canonical)
+        return (addr_t) canonicalizer.canonicalize(virt);
+    return virt;
+}
+
+addr_t
+raw2trace_t::to_physical(uint tidx, addr_t virt)
+{
+    if ((file_flags[tidx] & OFFLINE_FILE_FLAG_PHYSICAL) == 0)
+        return virt;
+    auto it = phys_pages[tidx].find(virt >> OFFLINE_PHYS_PAGE_BITS);
+    if (it == phys_pages[tidx].end()) {
+        // The tracer could not translate it either (e.g., the vsyscall page).
+        VPRINT(4, "No physical mapping for " PFX "\n", (ptr_uint_t)virt);
+        return virt;
+    }
+    return (it->second << OFFLINE_PHYS_PAGE_BITS) |
+        (virt & ((1 << OFFLINE_PHYS_PAGE_BITS) - 1));
 }
 
 // Returns FAULT_INTERRUPTED_BB if a fault occurred on this memref.
 // Any other non-empty string is a fatal error.
 std::string
-raw2trace_t::append_memref(INOUT trace_entry_t **buf_in, uint tidx, instr_t *instr,
-                           opnd_t ref, bool write)
+raw2trace_t::append_memref(INOUT trace_entry_t **buf_in, uint tidx,
+                           const instr_summary_t::memref_summary_t &ref,
+                           app_pc orig_pc)
 {
     trace_entry_t *buf = *buf_in;
     offline_entry_t in_entry;
     bool have_type = false;
+    if (ref.pc_rel && (file_flags[tidx] & OFFLINE_FILE_FLAG_ELIDE_RIP_REL) != 0) {
+        // The tracer recorded nothing for this operand: we compute its address.
+        buf->type = ref.type;
+        buf->size = ref.size;
+        buf->addr = map_address(tidx, (addr_t) (orig_pc + ref.disp));
+        VPRINT(4, "Appended pc-relative memref type %d size %d to " PFX "\n",
+               buf->type, buf->size, (ptr_uint_t)buf->addr);
+        *buf_in = ++buf;
+        return check_for_fault(tidx);
+    }
     if (!read_from_thread_file(tidx, &in_entry, 1))
         return "Trace ends mid-block";
     if (in_entry.extended.type == OFFLINE_TYPE_EXTENDED &&
@@ -382,6 +520,20 @@ raw2trace_t::append_memref(INOUT trace_entry_t **buf_in, uint tidx, instr_t *ins
         if (!read_from_thread_file(tidx, &in_entry, 1))
             return "Trace ends mid-block";
     }
+    if (in_entry.extended.type == OFFLINE_TYPE_EXTENDED &&
+        in_entry.extended.ext == OFFLINE_EXT_TYPE_MARKER &&
+        in_entry.extended.valueB == TRACE_MARKER_TYPE_MEMREF_RANGE) {
+        // A string loop operand traced with -repstr_ranges: we pass the marker
+        // on for reader_t to expand together with the memref that follows.
+        buf->type = TRACE_TYPE_MARKER;
+        buf->size = TRACE_MARKER_TYPE_MEMREF_RANGE;
+        buf->addr = (addr_t) in_entry.extended.valueA;
+        VPRINT(4, "Found range marker 0x" ZHEX64_FORMAT_STRING "\n",
+               (uint64) in_entry.extended.valueA);
+        ++buf;
+        if (!read_from_thread_file(tidx, &in_entry, 1))
+            return "Trace ends mid-block";
+    }
     if (in_entry.addr.type != OFFLINE_TYPE_MEMREF &&
         in_entry.addr.type != OFFLINE_TYPE_MEMREF_HIGH) {
         // This happens when there are predicated memrefs in the bb, or for a
@@ -395,33 +547,33 @@ raw2trace_t::append_memref(INOUT trace_entry_t **buf_in, uint tidx, instr_t *ins
         unread_from_thread_file(tidx, &in_entry, 1);
         return "";
     }
+    if (ref.maybe_masked && in_entry.combined_value == 0) {
+        VPRINT(4, "Skipping masked-off vector element\n");
+        return "";
+    }
     if (!have_type) {
-        if (instr_is_prefetch(instr)) {
-            buf->type = instru_t::instr_to_prefetch_type(instr);
-            buf->size = 1;
-        } else if (instru_t::instr_is_flush(instr)) {
-            buf->type = TRACE_TYPE_DATA_FLUSH;
-            buf->size = (ushort) opnd_size_in_bytes(opnd_get_size(ref));
-        } else {
-            if (write)
-                buf->type = TRACE_TYPE_WRITE;
-            else
-                buf->type = TRACE_TYPE_READ;
-            buf->size = (ushort) opnd_size_in_bytes(opnd_get_size(ref));
-        }
+        buf->type = ref.type;
+        buf->size = ref.size;
     }
     // We take the full value, to handle low or high.
+    // We stored only the base reg for some operands, as an optimization, in which
+    // case the summary supplies the displacement.  Physical traces store the full
+    // address of every operand.
     buf->addr = (addr_t) in_entry.combined_value;
-#ifdef X86
-    if (opnd_is_near_base_disp(ref) && opnd_get_base(ref) != DR_REG_NULL &&
-        opnd_get_index(ref) == DR_REG_NULL) {
-        // We stored only the base reg, as an optimization.
-        buf->addr += opnd_get_disp(ref);
-    }
-#endif
+    if ((file_flags[tidx] & OFFLINE_FILE_FLAG_PHYSICAL) == 0)
+        buf->addr += ref.disp;
+    buf->addr = map_address(tidx, buf->addr);
     VPRINT(4, "Appended memref type %d size %d to " PFX "\n", buf->type, buf->size,
            (ptr_uint_t)buf->addr);
     *buf_in = ++buf;
+    return check_for_fault(tidx);
+}
+
+// Returns FAULT_INTERRUPTED_BB if the memref just appended faulted.
+std::string
+raw2trace_t::check_for_fault(uint tidx)
+{
+    offline_entry_t in_entry;
     // To avoid having to backtrack later, we read ahead to see whether this memref
     // faulted.  There's a footer so this should always succeed.
     if (!read_from_thread_file(tidx, &in_entry, 1))
@@ -438,14 +590,117 @@ raw2trace_t::append_memref(INOUT trace_entry_t **buf_in, uint tidx, instr_t *ins
     return "";
 }
 
+static instr_summary_t::memref_summary_t
+summarize_memref(instr_t *instr, app_pc decode_pc, opnd_t ref, bool write)
+{
+    instr_summary_t::memref_summary_t summary;
+    if (instr_is_prefetch(instr)) {
+        summary.type = instru_t::instr_to_prefetch_type(instr);
+        summary.size = 1;
+    } else if (instru_t::instr_is_flush(instr)) {
+        summary.type = TRACE_TYPE_DATA_FLUSH;
+        summary.size = (ushort) opnd_size_in_bytes(opnd_get_size(ref));
+    } else {
+        if (write)
+            summary.type = TRACE_TYPE_WRITE;
+        else
+            summary.type = TRACE_TYPE_READ;
+        summary.size = (ushort) opnd_size_in_bytes(opnd_get_size(ref));
+    }
+    summary.disp = 0;
+    summary.maybe_masked = false;
+    summary.pc_rel = false;
+#ifdef X86
+    if (opnd_is_near_base_disp(ref) && opnd_get_base(ref) != DR_REG_NULL &&
+        opnd_get_index(ref) == DR_REG_NULL) {
+        // The tracer stored only the base reg, as an optimization.
+        summary.disp = opnd_get_disp(ref);
+    }
+# ifdef X64
+    // This must match offline_instru_t::memref_address_is_static().
+    if (opnd_is_rel_addr(ref) && instr_get_predicate(instr) == DR_PRED_NONE) {
+        summary.pc_rel = true;
+        summary.disp = (int)((app_pc)opnd_get_addr(ref) - decode_pc);
+    }
+# endif
+#endif
+    return summary;
+}
+
+// Gather and masked vector operands are traced as one entry per element.
+static void
+summarize_memrefs(instr_t *instr, app_pc decode_pc, opnd_t ref, bool write,
+                  INOUT std::vector<instr_summary_t::memref_summary_t> *memrefs)
+{
+    ushort elem_size;
+    int count = instru_t::vector_memref_count(instr, ref, &elem_size);
+    if (count == 0) {
+        memrefs->push_back(summarize_memref(instr, decode_pc, ref, write));
+        return;
+    }
+    instr_summary_t::memref_summary_t summary;
+    summary.type = (ushort)(write ? TRACE_TYPE_WRITE : TRACE_TYPE_READ);
+    summary.size = elem_size;
+    summary.disp = 0;
+    summary.maybe_masked = true;
+    summary.pc_rel = false;
+    memrefs->insert(memrefs->end(), count, summary);
+}
+
+// Returns nullptr if the instruction cannot be decoded.
+const instr_summary_t *
+raw2trace_t::get_instr_summary(uint worker, app_pc decode_pc)
+{
+    // To avoid repeatedly decoding the same instruction on every one of its
+    // dynamic executions, we cache the decoding in a hashtable.
+    instr_summary_t *summary =
+        (instr_summary_t *) hashtable_lookup(&decode_cache[worker], decode_pc);
+    if (summary != nullptr)
+        return summary;
+    summary = (instr_summary_t *) hashtable_lookup(&persisted_cache, decode_pc);
+    if (summary != nullptr)
+        return summary;
+    instr_t instr;
+    instr_init(dcontext, &instr);
+    // We assume the default ISA mode and currently require the 32-bit
+    // postprocessor for 32-bit applications.
+    app_pc next_pc = decode(dcontext, decode_pc, &instr);
+    if (next_pc == NULL || !instr_valid(&instr)) {
+        instr_free(dcontext, &instr);
+        return nullptr;
+    }
+    summary = new instr_summary_t;
+    summary->type = instru_t::instr_to_instr_type(&instr);
+    summary->length = (ushort) instr_length(dcontext, &instr);
+    summary->next_offs = (ushort) (next_pc - decode_pc);
+    summary->is_cti = instr_is_cti(&instr);
+    // Rule out OP_lea.
+    if (instr_reads_memory(&instr) || instr_writes_memory(&instr)) {
+        for (int j = 0; j < instr_num_srcs(&instr); j++) {
+            if (opnd_is_memory_reference(instr_get_src(&instr, j)))
+                summarize_memrefs(&instr, decode_pc, instr_get_src(&instr, j), false,
+                                  &summary->memrefs);
+        }
+        for (int j = 0; j < instr_num_dsts(&instr); j++) {
+            if (opnd_is_memory_reference(instr_get_dst(&instr, j)))
+                summarize_memrefs(&instr, decode_pc, instr_get_dst(&instr, j), true,
+                                  &summary->memrefs);
+        }
+    }
+    instr_free(dcontext, &instr);
+    hashtable_add(&decode_cache[worker], decode_pc, summary);
+    return summary;
+}
+
 std::string
-raw2trace_t::append_bb_entries(uint tidx, offline_entry_t *in_entry, OUT bool *handled)
+raw2trace_t::append_bb_entries(uint tidx, uint worker, offline_entry_t *in_entry,
+                               OUT bool *handled)
 {
     uint instr_count = in_entry->pc.instr_count;
-    instr_t *instr;
+    const instr_summary_t *summary;
     trace_entry_t buf_start[MAX_COMBINED_ENTRIES];
     app_pc start_pc = modvec[in_entry->pc.modidx].map_base + in_entry->pc.modoffs;
-    app_pc pc, decode_pc = start_pc;
+    app_pc decode_pc = start_pc;
     if ((in_entry->pc.modidx == 0 && in_entry->pc.modoffs == 0) ||
         modvec[in_entry->pc.modidx].map_base == NULL) {
         // FIXME i#2062: add support for code not in a module (vsyscall, JIT, etc.).
@@ -466,45 +721,39 @@ raw2trace_t::append_bb_entries(uint tidx, offline_entry_t *in_entry, OUT bool *h
         skip_icache = true;
         instr_count = 1;
         // We set a flag to avoid peeking forward on instr entries.
-        if (!instrs_are_separate)
-            instrs_are_separate = true;
+        if (!instrs_are_separate[tidx])
+            instrs_are_separate[tidx] = true;
     }
-    CHECK(!instrs_are_separate || instr_count == 1, "cannot mix 0-count and >1-count");
+    CHECK(!instrs_are_separate[tidx] || instr_count == 1,
+          "cannot mix 0-count and >1-count");
     for (uint i = 0; !truncated && i < instr_count; ++i) {
         trace_entry_t *buf = buf_start;
         app_pc orig_pc = decode_pc - modvec[in_entry->pc.modidx].map_base +
             modvec[in_entry->pc.modidx].orig_base;
-        // To avoid repeatedly decoding the same instruction on every one of its
-        // dynamic executions, we cache the decoding in a hashtable.
-        instr = (instr_t *) hashtable_lookup(&decode_cache, decode_pc);
-        if (instr == NULL) {
-            instr = instr_create(dcontext);
-            // We assume the default ISA mode and currently require the 32-bit
-            // postprocessor for 32-bit applications.
-            pc = decode(dcontext, decode_pc, instr);
-            if (pc == NULL || !instr_valid(instr)) {
-                WARN("Encountered invalid/undecodable instr @ %s+" PFX,
-                     modvec[in_entry->pc.modidx].path, (ptr_uint_t)in_entry->pc.modoffs);
-                break;
-            }
-            hashtable_add(&decode_cache, decode_pc, instr);
-        } else {
-            pc = instr_get_raw_bits(instr) + instr_length(dcontext, instr);
+        summary = get_instr_summary(worker, decode_pc);
+        if (summary == nullptr) {
+            WARN("Encountered invalid/undecodable instr @ %s+" PFX,
+                 modvec[in_entry->pc.modidx].path, (ptr_uint_t)in_entry->pc.modoffs);
+            break;
         }
-        CHECK(!instr_is_cti(instr) || i == instr_count - 1, "invalid cti");
+        CHECK(!summary->is_cti || i == instr_count - 1, "invalid cti");
         // FIXME i#1729: make bundles via lazy accum until hit memref/end.
         DO_VERBOSE(3, {
-            instr_set_translation(instr, orig_pc);
-            dr_print_instr(dcontext, STDOUT, instr, "");
+            instr_t instr;
+            instr_init(dcontext, &instr);
+            decode(dcontext, decode_pc, &instr);
+            instr_set_translation(&instr, orig_pc);
+            dr_print_instr(dcontext, STDOUT, &instr, "");
+            instr_free(dcontext, &instr);
         });
-        buf->type = instru_t::instr_to_instr_type(instr);
+        buf->type = summary->type;
         if (buf->type == TRACE_TYPE_INSTR_MAYBE_FETCH) {
             // We want it to look like the original rep string, with just one instr
             // fetch for the whole loop, instead of the drutil-expanded loop.
             // We fix up the maybe-fetch here so our offline file doesn't have to
             // rely on our own reader.
-            if (!prev_instr_was_rep_string) {
-                prev_instr_was_rep_string = true;
+            if (!prev_instr_was_rep_string[tidx]) {
+                prev_instr_was_rep_string[tidx] = true;
                 buf->type = TRACE_TYPE_INSTR;
             } else {
                 VPRINT(3, "Skipping instr fetch for " PFX "\n", (ptr_uint_t)decode_pc);
@@ -513,41 +762,27 @@ raw2trace_t::append_bb_entries(uint tidx, offline_entry_t *in_entry, OUT bool *h
                 buf->type = TRACE_TYPE_INSTR_NO_FETCH;
             }
         } else
-            prev_instr_was_rep_string = false;
-        buf->size = (ushort) (skip_icache ? 0 : instr_length(dcontext, instr));
-        buf->addr = (addr_t) orig_pc;
+            prev_instr_was_rep_string[tidx] = false;
+        buf->size = (ushort) (skip_icache ? 0 : summary->length);
+        buf->addr = map_address(tidx, (addr_t) orig_pc);
         ++buf;
-        decode_pc = pc;
+        decode_pc += summary->next_offs;
         // We need to interleave instrs with memrefs.
-        // There is no following memref for (instrs_are_separate && !skip_icache).
-        if ((!instrs_are_separate || skip_icache) &&
-            // Rule out OP_lea.
-            (instr_reads_memory(instr) || instr_writes_memory(instr))) {
-            for (int j = 0; j < instr_num_srcs(instr); j++) {
-                if (opnd_is_memory_reference(instr_get_src(instr, j))) {
-                    std::string error = append_memref(&buf, tidx, instr,
-                                                      instr_get_src(instr, j), false);
-                    if (error == FAULT_INTERRUPTED_BB) {
-                        truncated = true;
-                        break;
-                    } else if (!error.empty())
-                        return error;
-                }
-            }
-            for (int j = 0; !truncated && j < instr_num_dsts(instr); j++) {
-                if (opnd_is_memory_reference(instr_get_dst(instr, j))) {
-                    std::string error = append_memref(&buf, tidx, instr,
-                                                      instr_get_dst(instr, j), true);
-                    if (error == FAULT_INTERRUPTED_BB) {
-                        truncated = true;
-                        break;
-                    } else if (!error.empty())
-                        return error;
-                }
+        // There is no following memref for (instrs_are_separate && !skip_icache),
+        // nor for any instr when the tracer recorded no data refs.
+        if ((!instrs_are_separate[tidx] || skip_icache) &&
+            (file_flags[tidx] & OFFLINE_FILE_FLAG_INSTR_ONLY) == 0) {
+            for (const auto &ref : summary->memrefs) {
+                std::string error = append_memref(&buf, tidx, ref, orig_pc);
+                if (error == FAULT_INTERRUPTED_BB) {
+                    truncated = true;
+                    break;
+                } else if (!error.empty())
+                    return error;
             }
         }
         CHECK((size_t)(buf - buf_start) < MAX_COMBINED_ENTRIES, "Too many entries");
-        if (instr_is_cti(instr)) {
+        if (summary->is_cti) {
             CHECK(delayed_branch[tidx].empty(), "Failed to flush delayed branch");
             // In case this is the last branch prior to a thread switch, buffer it.  We
             // avoid swapping threads immediately after a branch so that analyzers can
@@ -560,8 +795,8 @@ raw2trace_t::append_bb_entries(uint tidx, offline_entry_t *in_entry, OUT bool *h
             delayed_branch[tidx].insert(delayed_branch[tidx].begin(),
                                         (char *)buf_start, (char *)buf);
         } else {
-            if (!out_file->write((char*)buf_start,
-                                 (buf - buf_start)*sizeof(trace_entry_t)))
+            if (!write_thread_out(tidx, (char*)buf_start,
+                                  (buf - buf_start)*sizeof(trace_entry_t)))
                 return "Failed to write to output file";
         }
     }
@@ -575,16 +810,369 @@ raw2trace_t::append_delayed_branch(uint tidx)
     if (delayed_branch[tidx].empty())
         return "";
     VPRINT(4, "Appending delayed branch for thread %d\n", tidx);
-    if (!out_file->write(&delayed_branch[tidx][0], delayed_branch[tidx].size()))
+    if (!write_thread_out(tidx, &delayed_branch[tidx][0], delayed_branch[tidx].size()))
         return "Failed to write to output file";
     delayed_branch[tidx].clear();
     return "";
 }
 
+/***************************************************************************
+ * Persistent decode cache
+ */
+
+// The cache file consists of a header followed by a sequence of records, each a
+// persisted_instr_t followed by its num_memrefs memref summaries.
+#define DECODE_CACHE_MAGIC 0x45484341434d5244ULL // "DRMCACHE"
+#define DECODE_CACHE_VERSION 3
+
+struct persisted_header_t {
+    uint64 magic;
+    uint version;
+    uint summary_size; // Guards against mismatched builds.
+};
+
+struct persisted_instr_t {
+    uint64 module_hash;
+    uint64 offset;
+    unsigned short type;
+    unsigned short length;
+    unsigned short next_offs;
+    byte is_cti;
+    byte num_memrefs;
+};
+
+std::string
+raw2trace_t::set_persistent_decode_cache(const std::string &path)
+{
+    persisted_cache_path = path;
+    return "";
+}
+
+std::string
+raw2trace_t::set_canonical_addresses()
+{
+#ifdef X64
+    canonical = true;
+    return "";
+#else
+    return "Canonical addresses are not supported for 32-bit";
+#endif
+}
+
+// The bases are recorded right after the first buffer header, so we peek at the
+// start of each thread file without consuming anything.
+std::string
+raw2trace_t::read_canonical_bases()
+{
+    for (const auto &info : modlist) {
+        canonicalizer.add_module((uint64)info.start, (uint64)info.size,
+                                 (uint64)modlist[info.containing_index].start,
+                                 info.containing_index);
+    }
+    for (uint tidx = 0; tidx < thread_files.size(); ++tidx) {
+        offline_entry_t entries[CANONICAL_SCAN_ENTRIES];
+        size_t count = 0;
+        read_from_thread_file(tidx, entries, CANONICAL_SCAN_ENTRIES, &count);
+        for (size_t i = 0; i < count; ++i) {
+            const offline_entry_t &entry = entries[i];
+            if (entry.extended.type != OFFLINE_TYPE_EXTENDED)
+                continue;
+            if (entry.extended.ext == OFFLINE_EXT_TYPE_FILE_FLAGS &&
+                (entry.extended.valueA & OFFLINE_FILE_FLAG_PHYSICAL) != 0)
+                return "Physical addresses cannot be made canonical";
+            if (entry.extended.ext != OFFLINE_EXT_TYPE_MARKER)
+                continue;
+            if (entry.extended.valueB == TRACE_MARKER_TYPE_STACK_BASE) {
+                VPRINT(2, "File %u has stack base " PFX "\n", tidx,
+                       (ptr_uint_t)entry.extended.valueA);
+                canonicalizer.add_stack((uint64)entry.extended.valueA);
+            } else if (entry.extended.valueB == TRACE_MARKER_TYPE_HEAP_BASE) {
+                VPRINT(2, "File %u has heap base " PFX "\n", tidx,
+                       (ptr_uint_t)entry.extended.valueA);
+                canonicalizer.add_heap((uint64)entry.extended.valueA);
+            }
+        }
+        if (count > 0)
+            unread_from_thread_file(tidx, entries, count);
+    }
+    canonicalizer.finalize();
+    return "";
+}
+
+// We have no build id available from drmodtrack, so we identify a module by a
+// hash of its file contents, which changes whenever the binary is rebuilt.
+std::string
+raw2trace_t::hash_module_contents(uint modidx, OUT uint64 *hash)
+{
+    const uint64 FNV_PRIME = 1099511628211ULL;
+    uint64 result = 14695981039346656037ULL; // FNV-1a offset basis.
+    const module_t &mod = modvec[modidx];
+    *hash = 0;
+    if (mod.map_base == NULL)
+        return "";
+    if (mod.map_size == 0) {
+        // A secondary segment shares the mapping of its containing module.
+        *hash = module_hash[modlist[modidx].containing_index];
+        return "";
+    }
+    if (mod.is_external) {
+        for (size_t i = 0; i < mod.map_size; ++i)
+            result = (result ^ mod.map_base[i]) * FNV_PRIME;
+    } else {
+        // We can't read the mapping directly as it has holes where we skipped
+        // the writable segments.
+        file_t f = dr_open_file(mod.path, DR_FILE_READ);
+        if (f == INVALID_FILE)
+            return "Failed to open module " + std::string(mod.path);
+        byte buf[64 * 1024];
+        ssize_t len;
+        while ((len = dr_read_file(f, buf, sizeof(buf))) > 0) {
+            for (ssize_t i = 0; i < len; ++i)
+                result = (result ^ buf[i]) * FNV_PRIME;
+        }
+        dr_close_file(f);
+    }
+    // 0 means uncacheable.
+    *hash = (result == 0) ? 1 : result;
+    return "";
+}
+
+std::string
+raw2trace_t::load_persistent_decode_cache()
+{
+    module_hash.assign(modvec.size(), 0);
+    std::unordered_map<uint64, std::vector<uint>> hash2mod;
+    for (uint i = 0; i < modvec.size(); ++i) {
+        std::string error = hash_module_contents(i, &module_hash[i]);
+        if (!error.empty())
+            return error;
+        if (module_hash[i] != 0 && modvec[i].map_size != 0)
+            hash2mod[module_hash[i]].push_back(i);
+    }
+    std::ifstream file(persisted_cache_path.c_str(), std::ifstream::binary);
+    if (!file) {
+        VPRINT(1, "No existing decode cache %s\n", persisted_cache_path.c_str());
+        return "";
+    }
+    persisted_header_t header;
+    if (!file.read((char*)&header, sizeof(header)) ||
+        header.magic != DECODE_CACHE_MAGIC || header.version != DECODE_CACHE_VERSION ||
+        header.summary_size != sizeof(instr_summary_t::memref_summary_t))
+        return "Decode cache " + persisted_cache_path + " is invalid";
+    persisted_instr_t rec;
+    uint64 loaded = 0;
+    while (file.read((char*)&rec, sizeof(rec))) {
+        std::vector<instr_summary_t::memref_summary_t> memrefs(rec.num_memrefs);
+        if (rec.num_memrefs > 0 &&
+            !file.read((char*)memrefs.data(), rec.num_memrefs * sizeof(memrefs[0])))
+            return "Decode cache " + persisted_cache_path + " is truncated";
+        auto it = hash2mod.find(rec.module_hash);
+        if (it == hash2mod.end()) {
+            unmatched_cache_records.insert(unmatched_cache_records.end(), (char *)&rec,
+                                           (char *)&rec + sizeof(rec));
+            unmatched_cache_records.insert(unmatched_cache_records.end(),
+                                           (char *)memrefs.data(),
+                                           (char *)(memrefs.data() + memrefs.size()));
+            continue;
+        }
+        for (uint modidx : it->second) {
+            if (rec.offset >= modvec[modidx].map_size)
+                continue;
+            app_pc pc = modvec[modidx].map_base + rec.offset;
+            if (hashtable_lookup(&persisted_cache, pc) != nullptr)
+                continue;
+            instr_summary_t *summary = new instr_summary_t;
+            summary->type = rec.type;
+            summary->length = rec.length;
+            summary->next_offs = rec.next_offs;
+            summary->is_cti = rec.is_cti != 0;
+            summary->memrefs = memrefs;
+            hashtable_add(&persisted_cache, pc, summary);
+            ++loaded;
+        }
+    }
+    if (!file.eof())
+        return "Failed to read decode cache " + persisted_cache_path;
+    VPRINT(1, "Loaded " UINT64_FORMAT_STRING " entries from decode cache %s\n",
+           loaded, persisted_cache_path.c_str());
+    return "";
+}
+
+std::string
+raw2trace_t::save_persistent_decode_cache()
+{
+    uint64 added = 0;
+    if (modvec.empty())
+        return "";
+    for (auto &table : decode_cache)
+        added += table.entries;
+    if (added == 0)
+        return "";
+    // We write to a temporary file and rename it into place, so that a concurrent
+    // conversion never sees a partial file.  Concurrent conversions may lose each
+    // other's additions, which only costs some later re-decoding.
+    std::stringstream tmp_path;
+    tmp_path << persisted_cache_path << "." << dr_get_process_id() << ".tmp";
+    std::ofstream file(tmp_path.str().c_str(), std::ofstream::binary);
+    if (!file)
+        return "Failed to create " + tmp_path.str();
+    persisted_header_t header = {DECODE_CACHE_MAGIC, DECODE_CACHE_VERSION,
+                                 sizeof(instr_summary_t::memref_summary_t)};
+    file.write((char*)&header, sizeof(header));
+    if (!unmatched_cache_records.empty()) {
+        file.write(unmatched_cache_records.data(), unmatched_cache_records.size());
+    }
+    uint last_modidx = 0;
+    std::unordered_set<app_pc> written;
+    auto write_table = [&](hashtable_t *table, bool check_dups) {
+        for (uint i = 0; i < HASHTABLE_SIZE(table->table_bits); i++) {
+            for (hash_entry_t *e = table->table[i]; e != NULL; e = e->next) {
+                app_pc pc = (app_pc) e->key;
+                if (check_dups && !written.insert(pc).second)
+                    continue;
+                // Find the containing module, caching the prior hit.
+                if (pc < modvec[last_modidx].map_base ||
+                    pc >= modvec[last_modidx].map_base + modvec[last_modidx].map_size) {
+                    for (last_modidx = 0; last_modidx < modvec.size(); ++last_modidx) {
+                        if (module_hash[last_modidx] != 0 &&
+                            pc >= modvec[last_modidx].map_base &&
+                            pc < modvec[last_modidx].map_base +
+                            modvec[last_modidx].map_size)
+                            break;
+                    }
+                    if (last_modidx == modvec.size()) {
+                        last_modidx = 0;
+                        continue;
+                    }
+                }
+                const instr_summary_t *summary = (instr_summary_t *) e->payload;
+                persisted_instr_t rec;
+                rec.module_hash = module_hash[last_modidx];
+                rec.offset = pc - modvec[last_modidx].map_base;
+                rec.type = summary->type;
+                rec.length = summary->length;
+                rec.next_offs = summary->next_offs;
+                rec.is_cti = summary->is_cti ? 1 : 0;
+                rec.num_memrefs = (byte) summary->memrefs.size();
+                file.write((char*)&rec, sizeof(rec));
+                if (!summary->memrefs.empty()) {
+                    file.write((char*)summary->memrefs.data(),
+                               summary->memrefs.size() * sizeof(summary->memrefs[0]));
+                }
+            }
+        }
+    };
+    write_table(&persisted_cache, false);
+    for (auto &table : decode_cache)
+        write_table(&table, decode_cache.size() > 1);
+    file.close();
+    if (!file)
+        return "Failed to write " + tmp_path.str();
+    if (!dr_rename_file(tmp_path.str().c_str(), persisted_cache_path.c_str(), true))
+        return "Failed to rename " + tmp_path.str() + " to " + persisted_cache_path;
+    VPRINT(1, "Added " UINT64_FORMAT_STRING " entries to decode cache %s\n", added,
+           persisted_cache_path.c_str());
+    return "";
+}
+
 /***************************************************************************
  * Top-level
  */
 
+// Converts a single non-timestamp offline entry for thread tidx into trace_entry_t
+// records appended at *buf (except for bb entries, which append_bb_entries() writes
+// directly to the thread's output).  Sets *end_of_thread on reaching the footer.
+std::string
+raw2trace_t::process_offline_entry(uint tidx, uint worker, offline_entry_t *in_entry,
+                                   thread_id_t tid, INOUT byte **buf_in,
+                                   OUT bool *end_of_thread)
+{
+    online_instru_t instru(NULL, false, NULL);
+    byte *buf = *buf_in;
+    *end_of_thread = false;
+    std::string result = append_delayed_branch(tidx);
+    if (!result.empty())
+        return result;
+    if (in_entry->extended.type == OFFLINE_TYPE_EXTENDED) {
+        if (in_entry->extended.ext == OFFLINE_EXT_TYPE_FOOTER) {
+            // Push forward to EOF.
+            offline_entry_t entry;
+            if (read_from_thread_file(tidx, &entry, 1) ||
+                !thread_file_at_eof(tidx))
+                return "Footer is not the final entry";
+            CHECK(tid != INVALID_THREAD_ID, "Missing thread id");
+            VPRINT(2, "Thread %d exit\n", (uint)tid);
+            buf += instru.append_thread_exit(buf, tid);
+            *end_of_thread = true;
+        } else if (in_entry->extended.ext == OFFLINE_EXT_TYPE_MARKER) {
+            uintptr_t value = (uintptr_t)in_entry->extended.valueA;
+            if (canonical &&
+                (in_entry->extended.valueB == TRACE_MARKER_TYPE_STACK_BASE ||
+                 in_entry->extended.valueB == TRACE_MARKER_TYPE_HEAP_BASE ||
+                 in_entry->extended.valueB == TRACE_MARKER_TYPE_FUNC_RETADDR))
+                value = (uintptr_t) canonicalizer.canonicalize(value);
+            buf += instru.append_marker(buf,
+                                        (trace_marker_type_t)in_entry->extended.valueB,
+                                        value);
+            VPRINT(3, "Appended marker type %u value %zu\n",
+                   (trace_marker_type_t)in_entry->extended.valueB,
+                   (uintptr_t)in_entry->extended.valueA);
+        } else if (in_entry->extended.ext == OFFLINE_EXT_TYPE_PHYS_MAPPING) {
+            offline_entry_t entry;
+            if (!read_from_thread_file(tidx, &entry, 1))
+                return "Physical mapping missing 2nd entry";
+            VPRINT(4, "Page " PFX " is physical page " PFX "\n",
+                   (ptr_uint_t)in_entry->extended.valueA,
+                   (ptr_uint_t)entry.combined_value);
+            phys_pages[tidx][(addr_t)in_entry->extended.valueA] =
+                (addr_t)entry.combined_value;
+        } else {
+            std::stringstream ss;
+            ss << "Invalid extension type " << (int)in_entry->extended.ext;
+            return ss.str();
+        }
+    } else if (in_entry->addr.type == OFFLINE_TYPE_MEMREF ||
+               in_entry->addr.type == OFFLINE_TYPE_MEMREF_HIGH) {
+        if (!last_bb_handled[tidx]) {
+            // For currently-unhandled non-module code, memrefs are handled here
+            // where we can easily handle the transition out of the bb.
+            trace_entry_t *entry = (trace_entry_t *) buf;
+            entry->type = TRACE_TYPE_READ; // Guess.
+            entry->size = 1; // Guess.
+            entry->addr = map_address(tidx, (addr_t) in_entry->combined_value);
+            VPRINT(4, "Appended non-module memref to " PFX "\n",
+                   (ptr_uint_t)entry->addr);
+            buf += sizeof(*entry);
+        } else {
+            // We should see an instr entry first
+            return "memref entry found outside of bb";
+        }
+    } else if (in_entry->pc.type == OFFLINE_TYPE_PC) {
+        bool handled;
+        result = append_bb_entries(tidx, worker, in_entry, &handled);
+        last_bb_handled[tidx] = handled;
+        if (!result.empty())
+            return result;
+    } else if (in_entry->addr.type == OFFLINE_TYPE_IFLUSH) {
+        offline_entry_t entry;
+        if (!read_from_thread_file(tidx, &entry, 1) ||
+            entry.addr.type != OFFLINE_TYPE_IFLUSH)
+            return "Flush missing 2nd entry";
+        VPRINT(2, "Flush " PFX"-" PFX"\n", (ptr_uint_t)in_entry->addr.addr,
+               (ptr_uint_t)entry.addr.addr);
+        addr_t start = map_address(tidx, (addr_t) in_entry->addr.addr);
+        buf += instru.append_iflush(buf, start,
+                                    (size_t)(map_address(tidx, (addr_t)
+                                                         entry.addr.addr) - start));
+    } else {
+        std::stringstream ss;
+        ss << "Unknown trace type " << (int)in_entry->timestamp.type;
+        return ss.str();
+    }
+    *buf_in = buf;
+    return "";
+}
+
 std::string
 raw2trace_t::merge_and_process_thread_files()
 {
@@ -596,7 +1184,6 @@ raw2trace_t::merge_and_process_thread_files()
     uint thread_count = (uint)thread_files.size();
     offline_entry_t in_entry;
     online_instru_t instru(NULL, false, NULL);
-    bool last_bb_handled = true;
     size_t size;
     std::vector<thread_id_t> tids(thread_files.size(), INVALID_THREAD_ID);
     std::vector<process_id_t> pids(thread_files.size(), (process_id_t)INVALID_PROCESS_ID);
@@ -624,6 +1211,27 @@ raw2trace_t::merge_and_process_thread_files()
         DR_ASSERT(in_entry.pid.type == OFFLINE_TYPE_PID);
         VPRINT(2, "File %u is process %u\n", i, (uint)in_entry.pid.pid);
         pids[i] = in_entry.pid.pid;
+        read_file_flags(i);
+    }
+
+    // Each thread's next timestamp is kept in a min-heap, ordered by thread index
+    // among equal timestamps, so that picking the next thread costs a logarithm of
+    // the thread count rather than a scan of every thread.
+    typedef std::pair<uint64, uint> thread_time_t;
+    std::priority_queue<thread_time_t, std::vector<thread_time_t>,
+                        std::greater<thread_time_t>> next_times;
+    for (uint i=0; i<thread_files.size(); ++i) {
+        if (times[i] == 0 && !thread_file_at_eof(i)) {
+            if (!read_from_thread_file(i, &in_entry, 1))
+                return "Failed to read from input file";
+            if (in_entry.timestamp.type != OFFLINE_TYPE_TIMESTAMP)
+                return "Missing timestamp entry";
+            times[i] = in_entry.timestamp.usec;
+            VPRINT(3, "Thread %u timestamp is @0x" ZHEX64_FORMAT_STRING
+                   "\n", (uint)tids[i], times[i]);
+        }
+        if (times[i] != 0)
+            next_times.push(thread_time_t(times[i], i));
     }
 
     // We read the thread files simultaneously in lockstep and merge them into
@@ -634,25 +1242,11 @@ raw2trace_t::merge_and_process_thread_files()
     do {
         byte *buf = buf_base;
         if (tidx >= thread_files.size()) {
-            // Pick the next thread by looking for the smallest timestamp.
-            uint64 min_time = 0xffffffffffffffff;
-            uint next_tidx = 0;
-            for (uint i=0; i<times.size(); ++i) {
-                if (times[i] == 0 && !thread_file_at_eof(i)) {
-                    offline_entry_t entry;
-                    if (!read_from_thread_file(i, &entry, 1))
-                        return "Failed to read from input file";
-                    if (entry.timestamp.type != OFFLINE_TYPE_TIMESTAMP)
-                        return "Missing timestamp entry";
-                    times[i] = entry.timestamp.usec;
-                    VPRINT(3, "Thread %u timestamp is @0x" ZHEX64_FORMAT_STRING
-                           "\n", (uint)tids[i], times[i]);
-                }
-                if (times[i] != 0 && times[i] < min_time) {
-                    min_time = times[i];
-                    next_tidx = i;
-                }
-            }
+            // Pick the next thread by taking the smallest timestamp.
+            if (next_times.empty())
+                return "Missing timestamp entry";
+            uint next_tidx = next_times.top().second;
+            next_times.pop();
             VPRINT(2, "Next thread in timestamp order is %u @0x" ZHEX64_FORMAT_STRING
                    "\n", (uint)tids[next_tidx], times[next_tidx]);
             tidx = next_tidx;
@@ -663,6 +1257,8 @@ raw2trace_t::merge_and_process_thread_files()
                 DR_ASSERT(pids[tidx] != (process_id_t)INVALID_PROCESS_ID);
                 buf += instru.append_pid(buf, pids[tidx]);
                 wrote_pid[tidx] = true;
+                if ((file_flags[tidx] & OFFLINE_FILE_FLAG_INSTR_ONLY) != 0)
+                    buf += instru.append_marker(buf, TRACE_MARKER_TYPE_INSTR_ONLY, 0);
             }
             buf += instru.append_marker(buf, TRACE_MARKER_TYPE_TIMESTAMP,
                                         // Truncated for 32-bit, as documented.
@@ -675,8 +1271,7 @@ raw2trace_t::merge_and_process_thread_files()
             buf = buf_base;
             times[tidx] = 0; // Read from file for this thread's next timestamp.
         }
-        VPRINT(4, "About to read thread %d at pos %d\n",
-               (uint)tids[tidx], (int)thread_files[tidx]->tellg());
+        VPRINT(4, "About to read thread %d\n", (uint)tids[tidx]);
         if (!read_from_thread_file(tidx, &in_entry, 1)) {
             if (thread_file_at_eof(tidx)) {
                 // Rather than a fatal error we try to continue to provide partial
@@ -694,77 +1289,168 @@ raw2trace_t::merge_and_process_thread_files()
             VPRINT(2, "Thread %u timestamp 0x" ZHEX64_FORMAT_STRING "\n",
                    (uint)tids[tidx], in_entry.timestamp.usec);
             times[tidx] = in_entry.timestamp.usec;
-            tidx = (uint)thread_files.size(); // Request thread scan.
+            next_times.push(thread_time_t(times[tidx], tidx));
+            tidx = (uint)thread_files.size(); // Request the next thread.
             continue;
         }
-        std::string result = append_delayed_branch(tidx);
+        bool end_of_thread;
+        std::string result =
+            process_offline_entry(tidx, 0, &in_entry, tids[tidx], &buf, &end_of_thread);
         if (!result.empty())
             return result;
-        if (in_entry.extended.type == OFFLINE_TYPE_EXTENDED) {
-            if (in_entry.extended.ext == OFFLINE_EXT_TYPE_FOOTER) {
-                // Push forward to EOF.
-                offline_entry_t entry;
-                if (read_from_thread_file(tidx, &entry, 1) ||
-                    !thread_file_at_eof(tidx))
-                    return "Footer is not the final entry";
-                CHECK(tids[tidx] != INVALID_THREAD_ID, "Missing thread id");
-                VPRINT(2, "Thread %d exit\n", (uint)tids[tidx]);
-                buf += instru.append_thread_exit(buf, tids[tidx]);
-                --thread_count;
-                tidx = (uint)thread_files.size(); // Request thread scan.
-            } else if (in_entry.extended.ext == OFFLINE_EXT_TYPE_MARKER) {
-                buf += instru.append_marker(buf,
-                                            (trace_marker_type_t)in_entry.extended.valueB,
-                                            (uintptr_t)in_entry.extended.valueA);
-                VPRINT(3, "Appended marker type %u value %zu\n",
-                       (trace_marker_type_t)in_entry.extended.valueB,
-                       (uintptr_t)in_entry.extended.valueA);
+        if (end_of_thread) {
+            --thread_count;
+            release_thread_file(tidx);
+            tidx = (uint)thread_files.size(); // Request the next thread.
+        }
+        if (buf > buf_base) {
+            size_t size = buf - buf_base;
+            CHECK((uint)size < MAX_COMBINED_ENTRIES, "Too many entries");
+            if (!out_file->write((char*)buf_base, size))
+                return "Failed to write to output file";
+        }
+    } while (thread_count > 0);
+    return "";
+}
+
+// Converts thread file tidx into a complete final trace of its own in
+// thread_out[tidx], including a header and footer.
+std::string
+raw2trace_t::process_thread_file(uint tidx, uint worker)
+{
+    offline_entry_t in_entry;
+    online_instru_t instru(NULL, false, NULL);
+    thread_id_t tid;
+    process_id_t pid;
+    uint64 legacy_time = 0;
+    byte buf_base[MAX_COMBINED_ENTRIES * sizeof(trace_entry_t)];
+    byte *buf = buf_base;
+    thread_summary_t &summary = thread_summaries[tidx];
+
+    trace_entry_t *header = (trace_entry_t *) buf;
+    header->type = TRACE_TYPE_HEADER;
+    header->size = 0;
+    header->addr = TRACE_ENTRY_VERSION;
+    buf += sizeof(*header);
+    if (!read_from_thread_file(tidx, &in_entry, 1))
+        return "Failed to read header from input file";
+    // Handle legacy traces which have the timestamp first.
+    if (in_entry.tid.type == OFFLINE_TYPE_TIMESTAMP) {
+        legacy_time = in_entry.timestamp.usec;
+        if (!read_from_thread_file(tidx, &in_entry, 1))
+            return "Failed to read header from input file";
+    }
+    if (in_entry.tid.type != OFFLINE_TYPE_THREAD)
+        return "Missing thread id entry";
+    tid = in_entry.tid.tid;
+    VPRINT(2, "File %u is thread %u\n", tidx, (uint)tid);
+    if (!read_from_thread_file(tidx, &in_entry, 1))
+        return "Failed to read header from input file";
+    if (in_entry.pid.type != OFFLINE_TYPE_PID)
+        return "Missing process id entry";
+    pid = in_entry.pid.pid;
+    VPRINT(2, "File %u is process %u\n", tidx, (uint)pid);
+    read_file_flags(tidx);
+    summary.tid = tid;
+    summary.pid = pid;
+    buf += instru.append_tid(buf, tid);
+    buf += instru.append_pid(buf, pid);
+    if ((file_flags[tidx] & OFFLINE_FILE_FLAG_INSTR_ONLY) != 0)
+        buf += instru.append_marker(buf, TRACE_MARKER_TYPE_INSTR_ONLY, 0);
+    if (legacy_time != 0) {
+        buf += instru.append_marker(buf, TRACE_MARKER_TYPE_TIMESTAMP,
+                                    (uintptr_t)legacy_time);
+        summary.first_timestamp = legacy_time;
+        summary.last_timestamp = legacy_time;
+    }
+    if (!write_thread_out(tidx, (char*)buf_base, buf - buf_base))
+        return "Failed to write to output file";
+
+    bool end_of_thread = false;
+    while (!end_of_thread) {
+        buf = buf_base;
+        if (!read_from_thread_file(tidx, &in_entry, 1)) {
+            if (thread_file_at_eof(tidx)) {
+                // As in the merged case, we try to provide partial results.
+                WARN("Input file for thread %d is truncated", (uint)tid);
+                in_entry.extended.type = OFFLINE_TYPE_EXTENDED;
+                in_entry.extended.ext = OFFLINE_EXT_TYPE_FOOTER;
             } else {
                 std::stringstream ss;
-                ss << "Invalid extension type " << (int)in_entry.extended.ext;
+                ss << "Failed to read from file for thread " << (uint)tid;
                 return ss.str();
             }
-        } else if (in_entry.addr.type == OFFLINE_TYPE_MEMREF ||
-                   in_entry.addr.type == OFFLINE_TYPE_MEMREF_HIGH) {
-            if (!last_bb_handled) {
-                // For currently-unhandled non-module code, memrefs are handled here
-                // where we can easily handle the transition out of the bb.
-                trace_entry_t *entry = (trace_entry_t *) buf;
-                entry->type = TRACE_TYPE_READ; // Guess.
-                entry->size = 1; // Guess.
-                entry->addr = (addr_t) in_entry.combined_value;
-                VPRINT(4, "Appended non-module memref to " PFX "\n",
-                       (ptr_uint_t)entry->addr);
-                buf += sizeof(*entry);
-            } else {
-                // We should see an instr entry first
-                return "memref entry found outside of bb";
-            }
-        } else if (in_entry.pc.type == OFFLINE_TYPE_PC) {
-            result = append_bb_entries(tidx, &in_entry, &last_bb_handled);
+        }
+        if (in_entry.timestamp.type == OFFLINE_TYPE_TIMESTAMP) {
+            // We keep the timestamps, which the merged output uses to order the
+            // threads, so that a consumer can reconstruct the interleaving.
+            VPRINT(2, "Thread %u timestamp 0x" ZHEX64_FORMAT_STRING "\n",
+                   (uint)tid, in_entry.timestamp.usec);
+            buf += instru.append_marker(buf, TRACE_MARKER_TYPE_TIMESTAMP,
+                                        // Truncated for 32-bit, as documented.
+                                        (uintptr_t)in_entry.timestamp.usec);
+            if (summary.first_timestamp == 0)
+                summary.first_timestamp = in_entry.timestamp.usec;
+            summary.last_timestamp = in_entry.timestamp.usec;
+        } else {
+            std::string result =
+                process_offline_entry(tidx, worker, &in_entry, tid, &buf, &end_of_thread);
             if (!result.empty())
                 return result;
-        } else if (in_entry.addr.type == OFFLINE_TYPE_IFLUSH) {
-            offline_entry_t entry;
-            if (!read_from_thread_file(tidx, &entry, 1) ||
-                entry.addr.type != OFFLINE_TYPE_IFLUSH)
-                return "Flush missing 2nd entry";
-            VPRINT(2, "Flush " PFX"-" PFX"\n", (ptr_uint_t)in_entry.addr.addr,
-                   (ptr_uint_t)entry.addr.addr);
-            buf += instru.append_iflush(buf, in_entry.addr.addr,
-                                        (size_t)(entry.addr.addr - in_entry.addr.addr));
-        } else {
-            std::stringstream ss;
-            ss << "Unknown trace type " << (int)in_entry.timestamp.type;
-            return ss.str();
         }
         if (buf > buf_base) {
             size_t size = buf - buf_base;
             CHECK((uint)size < MAX_COMBINED_ENTRIES, "Too many entries");
-            if (!out_file->write((char*)buf_base, size))
+            if (!write_thread_out(tidx, (char*)buf_base, size))
                 return "Failed to write to output file";
         }
-    } while (thread_count > 0);
+    }
+
+    trace_entry_t entry;
+    entry.type = TRACE_TYPE_FOOTER;
+    entry.size = 0;
+    entry.addr = 0;
+    if (!write_thread_out(tidx, (char*)&entry, sizeof(entry)))
+        return "Failed to write footer to output file";
+    return "";
+}
+
+void
+raw2trace_t::process_tasks(uint worker)
+{
+    while (true) {
+        uint tidx = next_thread_file++;
+        if (tidx >= thread_files.size())
+            break;
+        VPRINT(1, "Worker %u converting thread file %u\n", worker, tidx);
+        thread_errors[tidx] = process_thread_file(tidx, worker);
+    }
+}
+
+std::string
+raw2trace_t::process_thread_files_in_parallel()
+{
+    if (thread_files.empty())
+        return "No thread files found.";
+    for (const auto &out : thread_out) {
+        if (out == nullptr)
+            return "Output file count does not match thread file count";
+    }
+    next_thread_file = 0;
+    thread_errors.assign(thread_files.size(), "");
+    if (worker_count == 1)
+        process_tasks(0);
+    else {
+        std::vector<std::thread> threads;
+        for (int i = 0; i < worker_count; ++i)
+            threads.push_back(std::thread(&raw2trace_t::process_tasks, this, i));
+        for (auto &thread : threads)
+            thread.join();
+    }
+    for (const auto &error : thread_errors) {
+        if (!error.empty())
+            return error;
+    }
     return "";
 }
 
@@ -780,9 +1466,11 @@ raw2trace_t::check_thread_file(std::istream *f)
         ver_entry.extended.ext != OFFLINE_EXT_TYPE_HEADER) {
         return "Thread log file is corrupted: missing version entry";
     }
-    if (ver_entry.extended.valueA != OFFLINE_FILE_VERSION) {
+    if (ver_entry.extended.valueA < OFFLINE_FILE_VERSION_OLDEST_SUPPORTED ||
+        ver_entry.extended.valueA > OFFLINE_FILE_VERSION) {
         std::stringstream ss;
-        ss << "Version mismatch: expect " << OFFLINE_FILE_VERSION << " vs "
+        ss << "Version mismatch: expect " << OFFLINE_FILE_VERSION_OLDEST_SUPPORTED
+           << "-" << OFFLINE_FILE_VERSION << " vs "
            << (int)ver_entry.extended.valueA;
         return ss.str();
     }
@@ -795,22 +1483,45 @@ raw2trace_t::do_conversion()
     std::string error = read_and_map_modules();
     if (!error.empty())
         return error;
-    trace_entry_t entry;
-    entry.type = TRACE_TYPE_HEADER;
-    entry.size = 0;
-    entry.addr = TRACE_ENTRY_VERSION;
-    if (!out_file->write((char*)&entry, sizeof(entry)))
-        return "Failed to write header to output file";
+    if (canonical) {
+        error = read_canonical_bases();
+        if (!error.empty())
+            return error;
+    }
+    if (!persisted_cache_path.empty()) {
+        error = load_persistent_decode_cache();
+        if (!error.empty()) {
+            WARN("Ignoring decode cache: %s", error.c_str());
+            persisted_cache_path.clear();
+        }
+    }
+    if (per_thread_output) {
+        error = process_thread_files_in_parallel();
+        if (!error.empty())
+            return error;
+    } else {
+        trace_entry_t entry;
+        entry.type = TRACE_TYPE_HEADER;
+        entry.size = 0;
+        entry.addr = TRACE_ENTRY_VERSION;
+        if (!out_file->write((char*)&entry, sizeof(entry)))
+            return "Failed to write header to output file";
 
-    error = merge_and_process_thread_files();
-    if (!error.empty())
-        return error;
+        error = merge_and_process_thread_files();
+        if (!error.empty())
+            return error;
 
-    entry.type = TRACE_TYPE_FOOTER;
-    entry.size = 0;
-    entry.addr = 0;
-    if (!out_file->write((char*)&entry, sizeof(entry)))
-        return "Failed to write footer to output file";
+        entry.type = TRACE_TYPE_FOOTER;
+        entry.size = 0;
+        entry.addr = 0;
+        if (!out_file->write((char*)&entry, sizeof(entry)))
+            return "Failed to write footer to output file";
+    }
+    if (!persisted_cache_path.empty()) {
+        error = save_persistent_decode_cache();
+        if (!error.empty())
+            WARN("Failed to update decode cache: %s", error.c_str());
+    }
     VPRINT(1, "Successfully converted %zu thread files\n", thread_files.size());
     return "";
 }
@@ -821,11 +1532,40 @@ raw2trace_t::raw2trace_t(const char *module_map_in,
                          void *dcontext_in,
                          unsigned int verbosity_in)
     : modmap(module_map_in), modhandle(NULL), thread_files(thread_files_in),
-      out_file(out_file_in), dcontext(dcontext_in),
-      prev_instr_was_rep_string(false), instrs_are_separate(false),
+      out_file(out_file_in), thread_out(thread_files_in.size(), out_file_in),
+      per_thread_output(false), verbosity(verbosity_in), user_process(nullptr),
+      user_process_data(nullptr), last_orig_base(nullptr), last_map_size(0),
+      last_map_base(nullptr)
+{
+    init(dcontext_in, 1);
+}
+
+raw2trace_t::raw2trace_t(const char *module_map_in,
+                         const std::vector<std::istream*> &thread_files_in,
+                         const std::vector<std::ostream*> &out_files_in,
+                         void *dcontext_in,
+                         unsigned int verbosity_in,
+                         int worker_count_in)
+    : modmap(module_map_in), modhandle(NULL), thread_files(thread_files_in),
+      out_file(nullptr), thread_out(out_files_in), per_thread_output(true),
       verbosity(verbosity_in), user_process(nullptr), user_process_data(nullptr),
       last_orig_base(nullptr), last_map_size(0), last_map_base(nullptr)
 {
+    // A mismatch is reported as an error by do_conversion().
+    if (thread_out.size() != thread_files.size())
+        thread_out.resize(thread_files.size(), nullptr);
+    if (worker_count_in <= 0)
+        worker_count_in = std::thread::hardware_concurrency();
+    if (worker_count_in > (int)thread_files.size())
+        worker_count_in = (int)thread_files.size();
+    init(dcontext_in, worker_count_in);
+}
+
+void
+raw2trace_t::init(void *dcontext_in, int worker_count_in)
+{
+    dcontext = dcontext_in;
+    canonical = false;
     if (dcontext == NULL) {
         dcontext = dr_standalone_init();
 #ifdef ARM
@@ -834,26 +1574,51 @@ raw2trace_t::raw2trace_t(const char *module_map_in,
         dr_set_isa_mode(dcontext, DR_ISA_ARM_A32, NULL);
 #endif
     }
-    // We go ahead and start with a reasonably large capacity.
-    hashtable_init_ex(&decode_cache, 16, HASH_INTPTR, false, false, NULL, NULL, NULL);
-    // We pay a little memory to get a lower load factor.
+    worker_count = worker_count_in < 1 ? 1 : worker_count_in;
+    decode_cache.resize(worker_count);
+    for (auto &table : decode_cache) {
+        // We go ahead and start with a reasonably large capacity.
+        hashtable_init_ex(&table, 16, HASH_INTPTR, false, false, NULL, NULL, NULL);
+        // We pay a little memory to get a lower load factor.
+        hashtable_config_t config = {sizeof(config), true, 40};
+        hashtable_configure(&table, &config);
+    }
+    hashtable_init_ex(&persisted_cache, 16, HASH_INTPTR, false, false, NULL, NULL, NULL);
     hashtable_config_t config = {sizeof(config), true, 40};
-    hashtable_configure(&decode_cache, &config);
+    hashtable_configure(&persisted_cache, &config);
 
     delayed_branch.resize(thread_files.size());
-
-    pre_read.resize(thread_files.size());
+    if (per_thread_output)
+        thread_summaries.resize(thread_files.size());
+    read_ahead.resize(thread_files.size());
+    read_ahead_entries = READ_AHEAD_BUDGET / sizeof(offline_entry_t) /
+        (thread_files.empty() ? 1 : thread_files.size());
+    if (read_ahead_entries < READ_AHEAD_MIN_ENTRIES)
+        read_ahead_entries = READ_AHEAD_MIN_ENTRIES;
+    else if (read_ahead_entries > READ_AHEAD_MAX_ENTRIES)
+        read_ahead_entries = READ_AHEAD_MAX_ENTRIES;
+    prev_instr_was_rep_string.resize(thread_files.size(), false);
+    instrs_are_separate.resize(thread_files.size(), false);
+    last_bb_handled.resize(thread_files.size(), true);
+    file_flags.resize(thread_files.size(), 0);
+    phys_pages.resize(thread_files.size());
 }
 
 raw2trace_t::~raw2trace_t()
 {
     unmap_modules();
-    // XXX: We can't use a free-payload function b/c we can't get the dcontext there,
-    // so we have to explicitly free the payloads.
-    for (uint i = 0; i < HASHTABLE_SIZE(decode_cache.table_bits); i++) {
-        for (hash_entry_t *e = decode_cache.table[i]; e != NULL; e = e->next) {
-            instr_destroy(dcontext, (instr_t *)e->payload);
+    // XXX: We can't use a free-payload function b/c the tables are C code that
+    // cannot invoke a C++ destructor, so we have to explicitly free the payloads.
+    for (auto &table : decode_cache) {
+        for (uint i = 0; i < HASHTABLE_SIZE(table.table_bits); i++) {
+            for (hash_entry_t *e = table.table[i]; e != NULL; e = e->next)
+                delete (instr_summary_t *)e->payload;
         }
+        hashtable_delete(&table);
+    }
+    for (uint i = 0; i < HASHTABLE_SIZE(persisted_cache.table_bits); i++) {
+        for (hash_entry_t *e = persisted_cache.table[i]; e != NULL; e = e->next)
+            delete (instr_summary_t *)e->payload;
     }
-    hashtable_delete(&decode_cache);
+    hashtable_delete(&persisted_cache);
 }
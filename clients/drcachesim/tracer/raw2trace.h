@@ -45,14 +45,27 @@
 #include "drmemtrace.h"
 #include "drcovlib.h"
 #include "trace_entry.h"
+#include "addr_canonicalizer.h"
+#include <atomic>
 #include <fstream>
 #include "hashtable.h"
+#include <unordered_map>
 #include <vector>
 
 #define OUTFILE_PREFIX "drmemtrace"
 #define OUTFILE_SUFFIX "raw"
+// The suffix of raw files which the tracer compressed with -raw_compress.
+#define OUTFILE_SUFFIX_GZ "raw.gz"
 #define OUTFILE_SUBDIR "raw"
+// With -offline_stream, the tracer writes each thread's raw file under a name with
+// this suffix appended and strips it once the thread exits.
+#define OUTFILE_SUFFIX_PARTIAL "part"
+// With -offline_stream, a copy of the module list covering every thread file
+// published so far, and a file created once tracing is complete.
+#define STREAM_MODULE_LIST_FILENAME "modules.stream.log"
+#define STREAM_DONE_FILENAME "stream.done"
 #define TRACE_FILENAME "drmemtrace.trace"
+#define TRACE_SUFFIX "trace"
 
 struct module_t {
     module_t(const char *path, app_pc orig, byte *map, size_t size,
@@ -66,6 +79,29 @@ struct module_t {
     bool is_external; // If true, the data is embedded in drmodtrack custom fields.
 };
 
+// A decoding-independent summary of the properties of one instruction that are
+// needed to convert its raw entries.  We cache these rather than decoded instr_t
+// objects, as they are smaller and can be saved to disk for use in later runs.
+struct instr_summary_t {
+    struct memref_summary_t {
+        unsigned short type; // A trace_type_t, unless overridden by meminfo.
+        unsigned short size;
+        int disp; // Added to the recorded address, which may omit the displacement.
+        // Set for the elements of gather and masked vector operands, where a zero
+        // recorded address marks a masked-off element.
+        bool maybe_masked;
+        // Set for a rip-relative operand, whose address is disp from the instr's
+        // pc.  No entry was recorded for it under OFFLINE_FILE_FLAG_ELIDE_RIP_REL.
+        bool pc_rel;
+    };
+    unsigned short type; // A trace_type_t.
+    unsigned short length;
+    // The offset from the decode pc to the next instruction's decode pc.
+    unsigned short next_offs;
+    bool is_cti;
+    std::vector<memref_summary_t> memrefs; // Sources first, then destinations.
+};
+
 /**
  * The raw2trace class converts the raw offline trace format to the format
  * expected by analysis tools.  It requires access to the binary files for the
@@ -78,6 +114,19 @@ public:
     raw2trace_t(const char *module_map, const std::vector<std::istream*> &thread_files,
                 std::ostream *out_file, void *dcontext = NULL,
                 unsigned int verbosity = 0);
+    /**
+     * Instead of merging all threads into a single output stream, this variant
+     * converts each input thread file into its own complete final trace in the
+     * corresponding entry of \p out_files, which must be the same size as \p
+     * thread_files.  Timestamp markers are kept in each output so that the
+     * original interleaving of the threads can be reconstructed.  The threads are
+     * converted in parallel by \p worker_count worker threads, or one per hardware
+     * thread if \p worker_count is 0.  As with the other constructor, the files are
+     * all owned and opened/closed by the caller.
+     */
+    raw2trace_t(const char *module_map, const std::vector<std::istream*> &thread_files,
+                const std::vector<std::ostream*> &out_files, void *dcontext = NULL,
+                unsigned int verbosity = 0, int worker_count = 0);
     ~raw2trace_t();
 
     /**
@@ -144,6 +193,84 @@ public:
     std::string find_mapped_trace_address(app_pc trace_address,
                                           OUT app_pc *mapped_address);
 
+    /**
+     * This interface is meant to be used with a final trace rather than a raw
+     * trace, using the module log file saved from the raw2trace conversion.
+     * When do_module_parsing_and_mapping() has been called, this routine returns
+     * the bounds of the mapped module containing \p trace_address: the module's
+     * start address in the trace in \p trace_start, where that start is mapped in
+     * the current process in \p mapped_start, and the mapped size in \p size.
+     * This lets a caller translate all the addresses in a module without
+     * repeating the module search for each one.
+     * Returns a non-empty error message on failure.
+     */
+    std::string find_mapped_trace_bounds(app_pc trace_address, OUT app_pc *trace_start,
+                                         OUT app_pc *mapped_start, OUT size_t *size);
+
+    /**
+     * Returns the list of modules parsed by do_module_parsing(), indexed by
+     * drmodtrack_info_t.index.  The entries remain valid until this object is
+     * destroyed.  The list is empty if do_module_parsing() has not yet been called.
+     */
+    const std::vector<drmodtrack_info_t> &get_module_list() const;
+
+    /**
+     * Describes the final trace file written for one thread when converting to
+     * per-thread output files.
+     */
+    struct thread_summary_t {
+        thread_summary_t() : tid(0), pid(0), first_timestamp(0), last_timestamp(0),
+                             entries(0), instrs(0) {}
+        thread_id_t tid;           /**< The thread id. */
+        process_id_t pid;          /**< The process id. */
+        uint64 first_timestamp;    /**< The first timestamp marker value, or 0. */
+        uint64 last_timestamp;     /**< The last timestamp marker value, or 0. */
+        uint64 entries;            /**< Entries written, with header and footer. */
+        uint64 instrs;             /**< The instructions written. */
+    };
+
+    /**
+     * For the per-thread output constructor, returns a summary of each thread's
+     * output file, indexed like the thread files, once do_conversion() has
+     * succeeded.
+     */
+    const std::vector<thread_summary_t> &get_thread_summaries() const;
+
+    /**
+     * Enables a persistent decode cache stored in the file \p path, which is read
+     * (if it exists) at the start of do_conversion() and rewritten with any newly
+     * decoded instructions at its end.  The cache is keyed by a hash of the
+     * contents of each module plus the offset within it, so it can be shared
+     * across conversions of traces of the same binaries, as well as by all of the
+     * worker threads of a parallel conversion.  Entries for modules not present in
+     * the current trace are preserved.  Problems reading or writing the file are
+     * reported as warnings and do not cause the conversion to fail.
+     * Must be called prior to do_conversion().
+     * Returns a non-empty error message on failure.
+     */
+    std::string set_persistent_decode_cache(const std::string &path);
+
+    /**
+     * Rewrites the instruction and data addresses in the output, along with the
+     * addresses in #TRACE_MARKER_TYPE_STACK_BASE, #TRACE_MARKER_TYPE_HEAP_BASE and
+     * #TRACE_MARKER_TYPE_FUNC_RETADDR markers, as offsets from region bases that
+     * do not depend on address space layout randomization, so that identical runs
+     * produce identical addresses.  Addresses in a module become offsets from
+     * the module's start, tagged with its index in the module list, and addresses
+     * in the heap or in a thread's stack become offsets from the bases recorded by
+     * the tracer, with the stacks tagged by their order in memory.  Each
+     * canonical address has its top bit set: see addr_canonicalizer_t for the
+     * layout.  Other addresses are left unchanged, as are the timestamps, cpu
+     * identifiers, and thread and process identifiers.  The instructions in the
+     * resulting trace cannot be located with find_mapped_trace_address().  Not
+     * supported for 32-bit
+     * or for traces of physical addresses.  The stack tags assume that the
+     * conversion covers all of the threads at once.
+     * Must be called prior to do_conversion().
+     * Returns a non-empty error message on failure.
+     */
+    std::string set_canonical_addresses();
+
     /**
      * Performs the conversion from raw data to finished trace files.
      * Returns a non-empty error message on failure.
@@ -161,22 +288,64 @@ private:
         void *user_data;
     };
 
+    void init(void *dcontext_in, int worker_count);
     std::string read_and_map_modules();
     std::string unmap_modules(void);
     std::string merge_and_process_thread_files();
-    std::string append_bb_entries(uint tidx, offline_entry_t *in_entry,
+    std::string process_thread_file(uint tidx, uint worker);
+    void process_tasks(uint worker);
+    std::string process_thread_files_in_parallel();
+    std::string process_offline_entry(uint tidx, uint worker, offline_entry_t *in_entry,
+                                      thread_id_t tid, INOUT byte **buf,
+                                      OUT bool *end_of_thread);
+    std::string append_bb_entries(uint tidx, uint worker, offline_entry_t *in_entry,
                                   OUT bool *handled);
-    std::string append_memref(INOUT trace_entry_t **buf_in, uint tidx, instr_t *instr,
-                              opnd_t ref, bool write);
+    std::string append_memref(INOUT trace_entry_t **buf_in, uint tidx,
+                              const instr_summary_t::memref_summary_t &ref,
+                              app_pc orig_pc);
+    std::string check_for_fault(uint tidx);
+    void read_file_flags(uint tidx);
+    // For OFFLINE_FILE_FLAG_PHYSICAL, translates virt via the thread's recorded
+    // mappings, leaving it virtual if its page has none.
+    addr_t to_physical(uint tidx, addr_t virt);
+    // Returns the address to write for the recorded address virt: physical or
+    // canonical if requested.
+    addr_t map_address(uint tidx, addr_t virt);
+    // For set_canonical_addresses(), collects the module, heap and stack bases.
+    std::string read_canonical_bases();
+    const instr_summary_t *get_instr_summary(uint worker, app_pc decode_pc);
+    std::string hash_module_contents(uint modidx, OUT uint64 *hash);
+    std::string load_persistent_decode_cache();
+    std::string save_persistent_decode_cache();
     std::string append_delayed_branch(uint tidx);
+    // Writes size bytes of trace entries to thread_out[tidx], accounting for them
+    // in thread_summaries in per-thread output mode.
+    bool write_thread_out(uint tidx, const char *data, size_t size);
 
     // We do some internal buffering to avoid istream::seekg whose performance is
-    // detrimental for some filesystem types.
+    // detrimental for some filesystem types, and to read ahead in large pieces.
     bool read_from_thread_file(uint tidx, offline_entry_t *dest, size_t count,
                                OUT size_t *num_read = nullptr);
     void unread_from_thread_file(uint tidx, offline_entry_t *dest, size_t count);
     bool thread_file_at_eof(uint tidx);
-    std::vector<std::vector<offline_entry_t>> pre_read;
+    // Frees the read-ahead buffer of a thread whose file has been fully processed.
+    void release_thread_file(uint tidx);
+    struct read_ahead_t {
+        read_ahead_t() : pos(0), end(0) {}
+        // The unconsumed entries are buf[pos, end).
+        std::vector<offline_entry_t> buf;
+        size_t pos;
+        size_t end;
+    };
+    std::vector<read_ahead_t> read_ahead;
+    // The per-thread read-ahead size in entries, which shrinks with the thread
+    // count to bound the total to READ_AHEAD_BUDGET bytes.
+    size_t read_ahead_entries;
+    static const size_t READ_AHEAD_BUDGET = 64 * 1024 * 1024;
+    static const size_t READ_AHEAD_MIN_ENTRIES = 64;
+    static const size_t READ_AHEAD_MAX_ENTRIES = 4096;
+    // How far into each thread file read_canonical_bases() looks for the bases.
+    static const size_t CANONICAL_SCAN_ENTRIES = 32;
 
     static const uint MAX_COMBINED_ENTRIES = 64;
     const char *modmap;
@@ -184,17 +353,49 @@ private:
     std::vector<module_t> modvec;
     std::vector<std::istream*> thread_files;
     std::ostream *out_file;
+    // The output stream for each thread: either all the single merged out_file,
+    // or a separate file per thread.
+    std::vector<std::ostream*> thread_out;
+    bool per_thread_output;
     void *dcontext;
-    bool prev_instr_was_rep_string;
+    // The following per-thread state is indexed by tidx.  We use char rather than
+    // bool to avoid std::vector<bool>'s packed bits, which different worker threads
+    // cannot safely update.
+    std::vector<char> prev_instr_was_rep_string;
     // This indicates that each memref has its own PC entry and that each
     // icache entry does not need to be considered a memref PC entry as well.
-    bool instrs_are_separate;
+    std::vector<char> instrs_are_separate;
+    std::vector<char> last_bb_handled;
+    // The OFFLINE_FILE_FLAG_* bits of each thread file.
+    std::vector<uint> file_flags;
+    // For OFFLINE_FILE_FLAG_PHYSICAL, the thread's current mappings from virtual
+    // to physical page numbers.
+    std::vector<std::unordered_map<addr_t, addr_t>> phys_pages;
+    // For set_canonical_addresses().  This is read-only during conversion.
+    bool canonical;
+    addr_canonicalizer_t canonicalizer;
     unsigned int verbosity;
     // We use a hashtable to cache decodings.  We compared the performance of
     // hashtable_t to std::map.find, std::map.lower_bound, std::tr1::unordered_map,
     // and c++11 std::unordered_map (including tuning its load factor, initial size,
     // and hash function), and hashtable_t outperformed the others (i#2056).
-    hashtable_t decode_cache;
+    // There is one table per worker thread to avoid synchronization.
+    // The tables map decode pcs to instr_summary_t.
+    std::vector<hashtable_t> decode_cache;
+    // Entries loaded from the persistent cache file, consulted before decoding.
+    // This is read-only during conversion so it is shared by all workers.
+    hashtable_t persisted_cache;
+    std::string persisted_cache_path;
+    // For each module in modvec, a hash of its contents, or 0 if not cacheable.
+    std::vector<uint64> module_hash;
+    // Records from the cache file for modules not present in this trace.
+    std::vector<char> unmatched_cache_records;
+    int worker_count;
+    // For handing out threads to workers in per-thread output mode.
+    std::atomic<uint> next_thread_file;
+    std::vector<std::string> thread_errors;
+    // For per-thread output mode, indexed by tidx.
+    std::vector<thread_summary_t> thread_summaries;
 
     // Used to delay thread-buffer-final branch to keep it next to its target.
     std::vector<std::vector<char>> delayed_branch;
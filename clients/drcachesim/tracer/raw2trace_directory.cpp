@@ -52,8 +52,14 @@
 
 #include "dr_api.h"
 #include "dr_frontend.h"
+#include "compact_ostream.h"
+#include "repeat_ostream.h"
 #include "raw2trace.h"
 #include "raw2trace_directory.h"
+#ifdef HAS_ZLIB
+# include "chunked_ostream.h"
+# include "gzip_istream.h"
+#endif
 #include "utils.h"
 
 #define FATAL_ERROR(msg, ...) do { \
@@ -128,12 +134,29 @@ raw2trace_directory_t::open_thread_log_file(const char *basename)
     // Skip any non-.raw in case someone put some other file in there.
     if (strstr(basename, OUTFILE_SUFFIX) == NULL)
         return;
+    // Skip files -offline_stream has not finished writing.
+    size_t name_len = strlen(basename);
+    if (name_len > strlen(OUTFILE_SUFFIX_PARTIAL) &&
+        strcmp(basename + name_len - strlen(OUTFILE_SUFFIX_PARTIAL),
+               OUTFILE_SUFFIX_PARTIAL) == 0)
+        return;
+    if (stream && !streamed.insert(basename).second)
+        return;
     if (dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s%s%s",
                     indir.c_str(), DIRSEP, basename) <= 0) {
         FATAL_ERROR("Failed to get full path of file %s", basename);
     }
     NULL_TERMINATE_BUFFER(path);
-    thread_files.push_back(new std::ifstream(path, std::ifstream::binary));
+    size_t len = strlen(basename);
+    if (len > strlen(OUTFILE_SUFFIX_GZ) &&
+        strcmp(basename + len - strlen(OUTFILE_SUFFIX_GZ), OUTFILE_SUFFIX_GZ) == 0) {
+#ifdef HAS_ZLIB
+        thread_files.push_back(new gzip_istream_t(path));
+#else
+        FATAL_ERROR("Reading compressed thread log file %s requires zlib", path);
+#endif
+    } else
+        thread_files.push_back(new std::ifstream(path, std::ifstream::binary));
     if (!(*thread_files.back()))
         FATAL_ERROR("Failed to open thread log file %s", path);
     std::string error = raw2trace_t::check_thread_file(thread_files.back());
@@ -142,6 +165,63 @@ raw2trace_directory_t::open_thread_log_file(const char *basename)
                     error.c_str());
     }
     VPRINT(1, "Opened thread log file %s\n", path);
+    if (per_thread_output) {
+        // Name the output after the input, replacing the .raw suffix.
+        std::string outbase(basename);
+        size_t pos = outbase.rfind(OUTFILE_SUFFIX);
+        outbase = outbase.substr(0, pos) + TRACE_SUFFIX;
+        std::string outpath = outname + std::string(DIRSEP) + outbase;
+        out_files.push_back(open_output_file(outpath));
+        out_names.push_back(outbase);
+        VPRINT(1, "Writing thread trace to %s\n", outpath.c_str());
+    }
+}
+
+std::ostream *
+raw2trace_directory_t::open_output_file(const std::string &path)
+{
+    std::ostream *out = NULL;
+    if (compact)
+        out = new compact_ostream_t(path);
+    else if (chunk_entries > 0) {
+#ifdef HAS_ZLIB
+        out = new chunked_ostream_t(path, chunk_entries);
+#else
+        FATAL_ERROR("Chunked output requires zlib support");
+#endif
+    } else
+        out = new std::ofstream(path.c_str(), std::ofstream::binary);
+    if (repeat && *out)
+        out = new repeat_ostream_t(out);
+    if (!*out)
+        FATAL_ERROR("Failed to open output file %s", path.c_str());
+    return out;
+}
+
+void
+raw2trace_directory_t::close_thread_files()
+{
+    for (std::vector<std::istream*>::iterator fi = thread_files.begin();
+         fi != thread_files.end(); ++fi) {
+        delete *fi;
+    }
+    thread_files.clear();
+    for (std::vector<std::ostream*>::iterator fo = out_files.begin();
+         fo != out_files.end(); ++fo) {
+        delete *fo;
+    }
+    out_files.clear();
+    out_names.clear();
+}
+
+void
+raw2trace_directory_t::close_module_file()
+{
+    delete[] modfile_bytes;
+    modfile_bytes = NULL;
+    if (modfile != INVALID_FILE)
+        dr_close_file(modfile);
+    modfile = INVALID_FILE;
 }
 
 void
@@ -161,38 +241,114 @@ raw2trace_directory_t::read_module_file(const std::string &modfilename)
 
 raw2trace_directory_t::raw2trace_directory_t(const std::string &indir_in,
                                              const std::string &outname_in,
-                                             unsigned int verbosity_in)
-    : indir(indir_in), outname(outname_in), verbosity(verbosity_in)
+                                             unsigned int verbosity_in,
+                                             bool per_thread_output_in,
+                                             unsigned int chunk_entries_in,
+                                             bool stream_in, bool compact_in,
+                                             bool repeat_in)
+    : modfile_bytes(NULL), out_stream(&out_file), modfile(INVALID_FILE),
+      indir(indir_in), outname(outname_in), verbosity(verbosity_in),
+      per_thread_output(per_thread_output_in), chunk_entries(chunk_entries_in),
+      stream(stream_in), compact(compact_in), repeat(repeat_in)
 {
     // Support passing both base dir and raw/ subdir.
     if (indir.find(OUTFILE_SUBDIR) == std::string::npos) {
         indir += std::string(DIRSEP) + OUTFILE_SUBDIR;
     }
-    std::string modfilename = indir + std::string(DIRSEP) +
-        DRMEMTRACE_MODULE_LIST_FILENAME;
-    read_module_file(modfilename);
+    if (stream && !per_thread_output)
+        FATAL_ERROR("Converting a trace as it is written requires per-thread output");
+    if (compact && chunk_entries > 0)
+        FATAL_ERROR("Compact output cannot be combined with chunked output");
+    if (repeat && chunk_entries > 0)
+        FATAL_ERROR("Repeat compression cannot be combined with chunked output");
+    if (!stream) {
+        read_module_file(indir + std::string(DIRSEP) +
+                         DRMEMTRACE_MODULE_LIST_FILENAME);
+    }
 
-    out_file.open(outname.c_str(), std::ofstream::binary);
-    if (!out_file)
-        FATAL_ERROR("Failed to open output file %s", outname.c_str());
-    VPRINT(1, "Writing to %s\n", outname.c_str());
+    if (per_thread_output) {
+        if (!dr_directory_exists(outname.c_str()) &&
+            !dr_create_dir(outname.c_str()))
+            FATAL_ERROR("Failed to create output dir %s", outname.c_str());
+    } else if (chunk_entries > 0 || compact || repeat) {
+        out_stream = open_output_file(outname);
+        VPRINT(1, "Writing %s trace to %s\n",
+               compact ? "compact" : (repeat ? "repeat-compressed" : "chunked"),
+               outname.c_str());
+    } else {
+        out_file.open(outname.c_str(), std::ofstream::binary);
+        if (!out_file)
+            FATAL_ERROR("Failed to open output file %s", outname.c_str());
+        VPRINT(1, "Writing to %s\n", outname.c_str());
+    }
 
-    open_thread_files();
+    if (!stream)
+        open_thread_files();
+}
+
+bool
+raw2trace_directory_t::next_stream_batch()
+{
+    close_thread_files();
+    close_module_file();
+    while (true) {
+        // We check for completion before scanning so that a completed scan sees
+        // every thread file.
+        bool done = dr_file_exists((indir + std::string(DIRSEP) +
+                                    STREAM_DONE_FILENAME).c_str());
+        open_thread_files();
+        if (!thread_files.empty()) {
+            // The tracer refreshes the module list before publishing each file, so
+            // reading it after the scan covers every file found.
+            read_module_file(indir + std::string(DIRSEP) +
+                             (done ? DRMEMTRACE_MODULE_LIST_FILENAME :
+                              STREAM_MODULE_LIST_FILENAME));
+            VPRINT(1, "Streaming %zu new thread files\n", thread_files.size());
+            return true;
+        }
+        if (done)
+            return false;
+        dr_sleep(STREAM_POLL_MS);
+    }
+}
+
+std::string
+raw2trace_directory_t::write_thread_index(
+    const std::vector<raw2trace_t::thread_summary_t> &summaries)
+{
+    if (!per_thread_output)
+        return "A thread index requires per-thread output";
+    if (summaries.size() != out_names.size())
+        return "Thread summary count does not match output file count";
+    for (size_t i = 0; i < summaries.size(); ++i) {
+        thread_index_entry_t entry;
+        entry.tid = summaries[i].tid;
+        entry.pid = summaries[i].pid;
+        entry.first_timestamp = summaries[i].first_timestamp;
+        entry.last_timestamp = summaries[i].last_timestamp;
+        entry.entries = summaries[i].entries;
+        entry.instrs = summaries[i].instrs;
+        entry.file = out_names[i];
+        thread_index.push_back(entry);
+    }
+    std::string path = outname + std::string(DIRSEP) + THREAD_INDEX_FILENAME;
+    VPRINT(1, "Writing thread index to %s\n", path.c_str());
+    return thread_index_write(path, thread_index);
 }
 
 raw2trace_directory_t::raw2trace_directory_t(const std::string &module_file_path,
                                              unsigned int verbosity_in)
-    : indir(""), outname(""), verbosity(verbosity_in)
+    : modfile_bytes(NULL), out_stream(&out_file), modfile(INVALID_FILE), indir(""),
+      outname(""), verbosity(verbosity_in), per_thread_output(false),
+      chunk_entries(0), stream(false), compact(false), repeat(false)
 {
     read_module_file(module_file_path);
 }
 
 raw2trace_directory_t::~raw2trace_directory_t()
 {
-    delete[] modfile_bytes;
-    dr_close_file(modfile);
-    for (std::vector<std::istream*>::iterator fi = thread_files.begin();
-         fi != thread_files.end(); ++fi) {
-        delete *fi;
-    }
+    close_module_file();
+    close_thread_files();
+    if (out_stream != &out_file)
+        delete out_stream;
 }
@@ -34,33 +34,84 @@
 #define _RAW2TRACE_DIRECTORY_H_ 1
 
 #include <fstream>
+#include <set>
 #include <string>
 #include <vector>
 
 #include "dr_api.h"
+#include "raw2trace.h"
+#include "../common/thread_index.h"
 
 class raw2trace_directory_t {
 public:
+    // If per_thread_output is true, outname is a directory (created if necessary)
+    // into which one final trace file per thread is written, via out_files;
+    // otherwise outname is the single merged trace file written via out_stream.
+    // If chunk_entries is non-zero, the output files use the compressed chunked
+    // format of chunked_trace.h with that many entries per chunk (this requires
+    // zlib).
+    // If compact is true, the output files instead use the encoding of
+    // compact_trace.h.
+    // If repeat is true, runs of repeated entries in the output files are written
+    // as TRACE_MARKER_TYPE_REPEAT sequences (see repeat_ostream.h).  This cannot
+    // be combined with chunk_entries.
+    // If stream is true, indir holds a trace still being written with
+    // -offline_stream: nothing is opened until next_stream_batch() is called, and
+    // per_thread_output is required.
     raw2trace_directory_t(const std::string &indir, const std::string &outname,
-                          unsigned int verbosity = 0);
+                          unsigned int verbosity = 0, bool per_thread_output = false,
+                          unsigned int chunk_entries = 0, bool stream = false,
+                          bool compact = false, bool repeat = false);
     // This version is for raw2trace_t::do_module_parsing() or
     // raw2trace_t::do_module_parsing_and_mapping().
     raw2trace_directory_t(const std::string &module_file_path,
                           unsigned int verbosity = 0);
     ~raw2trace_directory_t();
 
+    // For stream mode, replaces thread_files, out_files, and modfile_bytes with
+    // the thread files published since the prior call and a module list that
+    // covers them, waiting until at least one is published.  Returns false once
+    // tracing has completed and every thread file has been returned.
+    bool next_stream_batch();
+
+    // For per-thread output, adds the threads converted from the current
+    // thread_files, described by summaries from
+    // raw2trace_t::get_thread_summaries(), to the index of the output directory
+    // (see thread_index.h), and rewrites it.  Returns a non-empty error message on
+    // failure.
+    std::string
+    write_thread_index(const std::vector<raw2trace_t::thread_summary_t> &summaries);
+
     char *modfile_bytes;
     std::vector<std::istream*> thread_files;
     std::ofstream out_file;
+    // Either &out_file or a chunked, compact, or repeat stream.
+    std::ostream *out_stream;
+    std::vector<std::ostream*> out_files;
 
 private:
     void read_module_file(const std::string &modfilename);
+    void close_module_file();
     void open_thread_files();
     void open_thread_log_file(const char *basename);
+    void close_thread_files();
+    std::ostream *open_output_file(const std::string &path);
     file_t modfile;
     std::string indir;
     std::string outname;
     unsigned int verbosity;
+    bool per_thread_output;
+    unsigned int chunk_entries;
+    bool stream;
+    bool compact;
+    bool repeat;
+    // For per-thread output, the base names of out_files.
+    std::vector<std::string> out_names;
+    // For per-thread output, the threads written so far.
+    std::vector<thread_index_entry_t> thread_index;
+    // For stream mode, the thread files already returned.
+    std::set<std::string> streamed;
+    static const int STREAM_POLL_MS = 100;
 };
 
 #endif  /* _RAW2TRACE_DIRECTORY_H_ */
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2016-2017 Google, Inc.  All rights reserved.
+ * Copyright (c) 2016-2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -49,8 +49,76 @@ static droption_t<std::string> op_indir
  "Specifies a directory within which all *.log files will be processed.");
 
 static droption_t<std::string> op_out
-(DROPTION_SCOPE_FRONTEND, "out", "", "[Required] Path to output file",
- "Specifies the path to the output file.");
+(DROPTION_SCOPE_FRONTEND, "out", "", "Path to output file",
+ "Specifies the path to the output file, into which all threads are merged in "
+ "timestamp order.  Either this or -outdir is required.");
+
+static droption_t<std::string> op_outdir
+(DROPTION_SCOPE_FRONTEND, "outdir", "", "Path to output directory",
+ "Specifies a directory (created if it does not exist) into which a separate "
+ "final trace file is written for each thread, rather than merging all threads into "
+ "one file, along with an index file listing each thread's id, process id, first "
+ "and last timestamps, and entry and instruction counts.  The threads are "
+ "converted in parallel: see -jobs.  The resulting directory can be passed to "
+ "-infile for parallel analysis, optionally of a subset of the threads: see "
+ "-only_threads.  Either this or -out is required.");
+
+static droption_t<unsigned int> op_jobs
+(DROPTION_SCOPE_FRONTEND, "jobs", 0, "Number of conversion threads",
+ "Specifies the number of worker threads used to convert the thread files when "
+ "-outdir is used.  If 0, one worker per hardware thread is used.");
+
+static droption_t<unsigned int> op_chunk_entries
+(DROPTION_SCOPE_FRONTEND, "chunk_entries", 0, "Entries per compressed output chunk",
+ "If non-zero, each output file is written in a chunked format where every chunk of "
+ "this many trace entries is compressed independently and an index of the chunks, "
+ "including their instruction counts and timestamps, is stored at the end of the "
+ "file.  Such files can be read by drcachesim's -infile option and support fast "
+ "seeking to an instruction ordinal.  Requires zlib support.");
+
+static droption_t<bool> op_compact
+(DROPTION_SCOPE_FRONTEND, "compact", false, "Write delta-encoded output files",
+ "Writes each output file in a compact encoding where every trace entry's address "
+ "is stored as a variable-length difference from the address predicted from the "
+ "prior entries of its thread, typically a small fraction of the size of the "
+ "regular format.  Such files, compressed with gzip or not, can be read by "
+ "drcachesim's -infile option.  Cannot be combined with -chunk_entries.");
+
+static droption_t<bool> op_repeat
+(DROPTION_SCOPE_FRONTEND, "repeat", false, "Compress repeated loop iterations",
+ "Writes each run of repeated instruction sequences, such as the iterations of a "
+ "loop whose data addresses each advance by a constant stride, as a single "
+ "iteration with a repeat count and the strides.  drcachesim's -infile option "
+ "expands the iterations as it reads the trace.  This can be combined with "
+ "-compact but not with -chunk_entries.  The entry counts in the -outdir index "
+ "are those of the expanded trace.");
+
+static droption_t<std::string> op_decode_cache
+(DROPTION_SCOPE_FRONTEND, "decode_cache", "", "Path to persistent decode cache file",
+ "Specifies a file in which to cache summaries of decoded instructions across "
+ "conversions.  The file is created if it does not exist and is updated with newly "
+ "decoded instructions at the end of each conversion.  Entries are keyed by module "
+ "contents, so one file can be shared by conversions of traces of many binaries.");
+
+static droption_t<bool> op_canonical
+(DROPTION_SCOPE_FRONTEND, "canonical", false, "Make addresses independent of layout",
+ "Rewrites the instruction and data addresses in the output as offsets from the "
+ "start of their module, heap, or thread stack, tagged with a stable identifier of "
+ "that region, so that identical runs of the same binary produce identical "
+ "addresses despite address space layout randomization.  Such traces can be "
+ "compared or cached across runs.  Timestamps, cpu identifiers, and thread and "
+ "process identifiers are left unchanged.  Tools that decode instructions using "
+ "the module list, such as opcode_mix, do not support such traces.  Requires a "
+ "64-bit trace of virtual "
+ "addresses and cannot be combined with -follow.");
+
+static droption_t<bool> op_follow
+(DROPTION_SCOPE_FRONTEND, "follow", false, "Convert a trace while it is written",
+ "Converts a trace from a tracer run with -offline_stream while the application is "
+ "still running: each thread file is converted as soon as the tracer publishes it "
+ "at the thread's exit, and the conversion completes once tracing does.  Requires "
+ "-outdir.  Each batch of newly published thread files is converted in parallel "
+ "as described for -jobs.");
 
 static droption_t<unsigned int> op_verbose
 (DROPTION_SCOPE_FRONTEND, "verbose", 0, "Verbosity level for diagnostic output",
@@ -75,16 +143,60 @@ _tmain(int argc, const TCHAR *targv[])
     if (!droption_parser_t::parse_argv(DROPTION_SCOPE_FRONTEND, argc, (const char **)argv,
                                        &parse_err, NULL) ||
         op_indir.get_value().empty() ||
-        op_out.get_value().empty()) {
+        op_out.get_value().empty() == op_outdir.get_value().empty() ||
+        (op_follow.get_value() && op_outdir.get_value().empty()) ||
+        (op_compact.get_value() && op_chunk_entries.get_value() > 0) ||
+        (op_repeat.get_value() && op_chunk_entries.get_value() > 0) ||
+        (op_canonical.get_value() && op_follow.get_value())) {
         FATAL_ERROR("Usage error: %s\nUsage:\n%s", parse_err.c_str(),
                     droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
     }
 
-    raw2trace_directory_t dir(op_indir.get_value(), op_out.get_value(),
+    std::string error;
+    if (op_follow.get_value()) {
+        raw2trace_directory_t dir(op_indir.get_value(), op_outdir.get_value(),
+                                  op_verbose.get_value(), true,
+                                  op_chunk_entries.get_value(), true,
+                                  op_compact.get_value(), op_repeat.get_value());
+        while (error.empty() && dir.next_stream_batch()) {
+            raw2trace_t raw2trace(dir.modfile_bytes, dir.thread_files, dir.out_files,
+                                  NULL, op_verbose.get_value(),
+                                  (int)op_jobs.get_value());
+            if (!op_decode_cache.get_value().empty())
+                raw2trace.set_persistent_decode_cache(op_decode_cache.get_value());
+            error = raw2trace.do_conversion();
+            if (error.empty())
+                error = dir.write_thread_index(raw2trace.get_thread_summaries());
+        }
+    } else if (!op_outdir.get_value().empty()) {
+        raw2trace_directory_t dir(op_indir.get_value(), op_outdir.get_value(),
+                                  op_verbose.get_value(), true,
+                                  op_chunk_entries.get_value(), false,
+                                  op_compact.get_value(), op_repeat.get_value());
+        raw2trace_t raw2trace(dir.modfile_bytes, dir.thread_files, dir.out_files, NULL,
+                              op_verbose.get_value(), (int)op_jobs.get_value());
+        if (!op_decode_cache.get_value().empty())
+            raw2trace.set_persistent_decode_cache(op_decode_cache.get_value());
+        if (op_canonical.get_value())
+            error = raw2trace.set_canonical_addresses();
+        if (error.empty())
+            error = raw2trace.do_conversion();
+        if (error.empty())
+            error = dir.write_thread_index(raw2trace.get_thread_summaries());
+    } else {
+        raw2trace_directory_t dir(op_indir.get_value(), op_out.get_value(),
+                                  op_verbose.get_value(), false,
+                                  op_chunk_entries.get_value(), false,
+                                  op_compact.get_value(), op_repeat.get_value());
+        raw2trace_t raw2trace(dir.modfile_bytes, dir.thread_files, dir.out_stream, NULL,
                               op_verbose.get_value());
-    raw2trace_t raw2trace(dir.modfile_bytes, dir.thread_files, &dir.out_file, NULL,
-                          op_verbose.get_value());
-    std::string error = raw2trace.do_conversion();
+        if (!op_decode_cache.get_value().empty())
+            raw2trace.set_persistent_decode_cache(op_decode_cache.get_value());
+        if (op_canonical.get_value())
+            error = raw2trace.set_canonical_addresses();
+        if (error.empty())
+            error = raw2trace.do_conversion();
+    }
     if (!error.empty())
         FATAL_ERROR("Conversion failed: %s", error.c_str());
 
@@ -0,0 +1,306 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+#include <string.h>
+#include "repeat_ostream.h"
+
+static inline bool
+is_fetch(const trace_entry_t &entry)
+{
+    return (type_is_instr((trace_type_t)entry.type) ||
+            entry.type == TRACE_TYPE_INSTR_NO_FETCH) && entry.size > 0;
+}
+
+static inline bool
+is_data(const trace_entry_t &entry)
+{
+    return entry.type == TRACE_TYPE_READ || entry.type == TRACE_TYPE_WRITE ||
+        type_is_prefetch((trace_type_t)entry.type);
+}
+
+// Returns whether entry can be part of a repeated sequence.
+static inline bool
+is_repeatable(const trace_entry_t &entry)
+{
+    return is_fetch(entry) || is_data(entry) ||
+        entry.type == TRACE_TYPE_INSTR_BUNDLE;
+}
+
+// Returns whether entry matches the entry first iterations later than base,
+// whose address advances by stride per iteration if it is a data reference.
+static inline bool
+entry_matches(const trace_entry_t &entry, const trace_entry_t &base, addr_t stride,
+              uint64_t iterations)
+{
+    if (entry.type != base.type || entry.size != base.size)
+        return false;
+    if (is_data(base))
+        return entry.addr == base.addr + (addr_t)iterations * stride;
+    if (base.type == TRACE_TYPE_INSTR_BUNDLE)
+        return memcmp(entry.length, base.length, base.size) == 0;
+    return entry.addr == base.addr;
+}
+
+static inline trace_entry_t
+make_marker(trace_marker_type_t type, addr_t value)
+{
+    trace_entry_t entry;
+    entry.type = TRACE_TYPE_MARKER;
+    entry.size = (unsigned short)type;
+    entry.addr = value;
+    return entry;
+}
+
+repeat_ostream_t::repeat_buf_t::repeat_buf_t(std::ostream *out_in) :
+    out(out_in), ok(out_in != NULL && !!*out_in), finished(false), window_base(0),
+    iterations(0)
+{
+    buf.resize(BUF_ENTRIES * sizeof(trace_entry_t));
+    setp(&buf[0], &buf[0] + buf.size());
+}
+
+repeat_ostream_t::repeat_buf_t::~repeat_buf_t()
+{
+    finish();
+    delete out;
+}
+
+void
+repeat_ostream_t::repeat_buf_t::emit(const trace_entry_t &entry)
+{
+    pending.push_back(entry);
+}
+
+// Writes out the oldest count entries of the window.
+void
+repeat_ostream_t::repeat_buf_t::flush_window(size_t count)
+{
+    pending.insert(pending.end(), window.begin(), window.begin() + count);
+    window.erase(window.begin(), window.begin() + count);
+    window_base += count;
+}
+
+// Starts a run whose first two iterations are the entries of the window from
+// the ordinal start on, if they do repeat.
+bool
+repeat_ostream_t::repeat_buf_t::start_run(uint64_t start)
+{
+    uint64_t end = window_base + window.size();
+    size_t period = (size_t)((end - start) / 2);
+    if (start < window_base || (end - start) % 2 != 0 || period > MAX_BODY)
+        return false;
+    const trace_entry_t *first = &window[(size_t)(start - window_base)];
+    const trace_entry_t *second = first + period;
+    std::vector<addr_t> run_strides(period, 0);
+    for (size_t i = 0; i < period; ++i) {
+        if (is_data(first[i]))
+            run_strides[i] = second[i].addr - first[i].addr;
+        if (!entry_matches(second[i], first[i], run_strides[i], 1))
+            return false;
+    }
+    flush_window((size_t)(start - window_base));
+    body.assign(window.begin(), window.begin() + period);
+    strides.swap(run_strides);
+    iterations = 2;
+    window.clear();
+    window_base = end;
+    last_fetch.clear();
+    return true;
+}
+
+// Writes out the run in progress, as a repeat sequence if that is smaller, and
+// then resumes looking for a run with the entries that followed it.
+void
+repeat_ostream_t::repeat_buf_t::end_run()
+{
+    size_t data_count = 0;
+    for (size_t i = 0; i < body.size(); ++i) {
+        if (is_data(body[i]))
+            ++data_count;
+    }
+    if (iterations * body.size() > 1 + data_count + body.size()) {
+        emit(make_marker(TRACE_MARKER_TYPE_REPEAT,
+                         ((addr_t)iterations << TRACE_REPEAT_BODY_BITS) | body.size()));
+        for (size_t i = 0; i < body.size(); ++i) {
+            if (is_data(body[i]))
+                emit(make_marker(TRACE_MARKER_TYPE_REPEAT_STRIDE, strides[i]));
+        }
+        pending.insert(pending.end(), body.begin(), body.end());
+    } else {
+        for (uint64_t iter = 0; iter < iterations; ++iter) {
+            for (size_t i = 0; i < body.size(); ++i) {
+                trace_entry_t entry = body[i];
+                entry.addr += (addr_t)iter * strides[i];
+                emit(entry);
+            }
+        }
+    }
+    body.clear();
+    std::vector<trace_entry_t> rest;
+    rest.swap(partial);
+    for (size_t i = 0; i < rest.size(); ++i)
+        add_entry(rest[i]);
+}
+
+void
+repeat_ostream_t::repeat_buf_t::add_entry(const trace_entry_t &entry)
+{
+    if (!body.empty()) {
+        size_t pos = partial.size();
+        // We stop short of the largest count the marker can hold.
+        if (is_repeatable(entry) &&
+            entry_matches(entry, body[pos], strides[pos], iterations) &&
+            iterations < ((addr_t)-1 >> (TRACE_REPEAT_BODY_BITS + 1))) {
+            if (pos + 1 == body.size()) {
+                ++iterations;
+                partial.clear();
+            } else
+                partial.push_back(entry);
+            return;
+        }
+        end_run();
+        // The retried partial iteration may have started a new run.
+        if (!body.empty()) {
+            add_entry(entry);
+            return;
+        }
+    }
+    if (!is_repeatable(entry)) {
+        flush_window(window.size());
+        last_fetch.clear();
+        emit(entry);
+        return;
+    }
+    if (is_fetch(entry)) {
+        // A fetch of the pc that started each of the last two periods of entries
+        // may begin their third repetition.
+        std::unordered_map<addr_t, uint64_t>::iterator it = last_fetch.find(entry.addr);
+        if (it != last_fetch.end() && it->second >= window_base) {
+            uint64_t period = window_base + window.size() - it->second;
+            if (it->second >= window_base + period && start_run(it->second - period)) {
+                add_entry(entry);
+                return;
+            }
+        }
+        last_fetch[entry.addr] = window_base + window.size();
+    }
+    window.push_back(entry);
+    // We only need to keep enough entries for two iterations of a body.
+    if (window.size() > 4 * MAX_BODY)
+        flush_window(window.size() - 2 * MAX_BODY);
+}
+
+bool
+repeat_ostream_t::repeat_buf_t::write_out()
+{
+    if (pending.empty())
+        return true;
+    if (!out->write((const char *)&pending[0], pending.size() * sizeof(pending[0]))) {
+        ok = false;
+        return false;
+    }
+    pending.clear();
+    return true;
+}
+
+// Processes the whole entries in the buffer, keeping any trailing partial entry
+// for the next call.
+bool
+repeat_ostream_t::repeat_buf_t::process_entries()
+{
+    if (!ok)
+        return false;
+    size_t size = pptr() - pbase();
+    size_t count = size / sizeof(trace_entry_t);
+    for (size_t i = 0; i < count; ++i) {
+        trace_entry_t entry;
+        memcpy(&entry, pbase() + i * sizeof(entry), sizeof(entry));
+        add_entry(entry);
+    }
+    size_t leftover = size - count * sizeof(trace_entry_t);
+    memmove(&buf[0], pbase() + count * sizeof(trace_entry_t), leftover);
+    setp(&buf[0], &buf[0] + buf.size());
+    pbump((int)leftover);
+    return write_out();
+}
+
+repeat_ostream_t::repeat_buf_t::int_type
+repeat_ostream_t::repeat_buf_t::overflow(int_type c)
+{
+    if (!process_entries())
+        return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+    return traits_type::not_eof(c);
+}
+
+// A run in progress is left pending, so this only flushes what precedes it.
+int
+repeat_ostream_t::repeat_buf_t::sync()
+{
+    if (!process_entries() || !out->flush())
+        return -1;
+    return 0;
+}
+
+bool
+repeat_ostream_t::repeat_buf_t::finish()
+{
+    if (finished)
+        return ok;
+    finished = true;
+    if (!process_entries())
+        return false;
+    if (pptr() != pbase())
+        ok = false; // A partial entry was left over.
+    if (!body.empty())
+        end_run();
+    flush_window(window.size());
+    if (!write_out() || !out->flush())
+        ok = false;
+    return ok;
+}
+
+repeat_ostream_t::repeat_ostream_t(std::ostream *out)
+    : std::ostream(NULL), repeat_buf(out)
+{
+    rdbuf(&repeat_buf);
+    if (!repeat_buf.is_ok())
+        setstate(std::ios_base::badbit);
+}
+
+repeat_ostream_t::~repeat_ostream_t()
+{
+    repeat_buf.finish();
+}
@@ -0,0 +1,108 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* repeat_ostream: an output stream that replaces runs of repeated trace entries
+ * with TRACE_MARKER_TYPE_REPEAT sequences before passing them on to another
+ * stream.
+ */
+
+#ifndef _REPEAT_OSTREAM_H_
+#define _REPEAT_OSTREAM_H_ 1
+
+#include <ostream>
+#include <streambuf>
+#include <unordered_map>
+#include <vector>
+#include "../common/trace_entry.h"
+
+// The data written must consist of whole trace_entry_t records, as written by
+// raw2trace_t, though a record may be split across write calls.  A run of
+// instruction fetches and data references that repeats with each data address
+// advancing by a constant stride, as the iterations of a loop typically do, is
+// written as one TRACE_MARKER_TYPE_REPEAT sequence holding a single iteration.
+// Any other entry ends the run.  The wrapped stream, which this object owns, is
+// flushed and deleted by the destructor.
+class repeat_ostream_t : public std::ostream
+{
+ public:
+    explicit repeat_ostream_t(std::ostream *out);
+    virtual ~repeat_ostream_t();
+
+ private:
+    class repeat_buf_t : public std::streambuf
+    {
+     public:
+        explicit repeat_buf_t(std::ostream *out);
+        virtual ~repeat_buf_t();
+        bool finish();
+        bool is_ok() const { return ok; }
+
+     protected:
+        virtual int_type overflow(int_type c);
+        virtual int sync();
+
+     private:
+        bool process_entries();
+        void add_entry(const trace_entry_t &entry);
+        bool start_run(uint64_t start);
+        void end_run();
+        void flush_window(size_t count);
+        void emit(const trace_entry_t &entry);
+        bool write_out();
+
+        std::ostream *out;
+        bool ok;
+        bool finished;
+        // We process in large batches to reduce the per-write overhead.
+        static const int BUF_ENTRIES = 4096;
+        static const size_t MAX_BODY = (1 << TRACE_REPEAT_BODY_BITS) - 1;
+        std::vector<char> buf;
+        // The entries processed but not yet written to out.
+        std::vector<trace_entry_t> pending;
+        // The entries not yet part of a run, the first of which has the ordinal
+        // window_base among the entries processed.
+        std::vector<trace_entry_t> window;
+        uint64_t window_base;
+        // The ordinal of the latest fetch of each pc in window.
+        std::unordered_map<addr_t, uint64_t> last_fetch;
+        // The run in progress, if body is not empty: the first iteration, the
+        // stride of each of its entries, the count of iterations completed, and
+        // the entries of the current partial iteration.
+        std::vector<trace_entry_t> body;
+        std::vector<addr_t> strides;
+        uint64_t iterations;
+        std::vector<trace_entry_t> partial;
+    };
+    repeat_buf_t repeat_buf;
+};
+
+#endif /* _REPEAT_OSTREAM_H_ */
@@ -42,11 +42,14 @@
 #include <limits.h>
 #include <string.h>
 #include <string>
+#include <vector>
 #include "dr_api.h"
 #include "drmgr.h"
 #include "drmemtrace.h"
 #include "drreg.h"
+#include "drsyms.h"
 #include "drutil.h"
+#include "drwrap.h"
 #include "drx.h"
 #include "droption.h"
 #include "instru.h"
@@ -54,11 +57,27 @@
 #include "physaddr.h"
 #include "../common/trace_entry.h"
 #include "../common/named_pipe.h"
+#ifdef LINUX
+# include "../common/shm_ring.h"
+#endif
+#ifdef UNIX
+# include "../common/trace_socket.h"
+#endif
 #include "../common/options.h"
+#include "../common/record_function.h"
 #include "../common/utils.h"
 
 #ifdef ARM
 # include "../../../core/unix/include/syscall_linux_arm.h" // for SYS_cacheflush
+#elif defined(LINUX)
+# include <sys/syscall.h>
+#endif
+#ifdef LINUX
+# include <sched.h> // for CLONE_VM
+extern char **environ;
+#endif
+#ifdef HAS_ZLIB
+# include <zlib.h>
 #endif
 
 /* Make sure we export function name as the symbol name without mangling. */
@@ -83,7 +102,7 @@ DR_DISALLOW_UNSAFE_STATIC
 #define FATAL(...) do {                \
     dr_fprintf(STDERR, __VA_ARGS__);   \
     if (!op_offline.get_value())       \
-        ipc_pipe.close();              \
+        ipc_close();                   \
     dr_abort();                        \
 } while (0)
 
@@ -95,14 +114,33 @@ static file_t module_file;
  */
 // XXX i#1703: use an option instead.
 #define MAX_NUM_ENTRIES 4096
-/* The buffer size for holding trace entries. */
+/* The initial buffer size for holding trace entries, which with fixed-size
+ * buffers is the size of every buffer.
+ */
 static size_t trace_buf_size;
 /* The redzone is allocated right after the trace buffer.
  * We fill the redzone with sentinel value to detect when the redzone
  * is reached, i.e., when the trace buffer is full.
  */
 static size_t redzone_size;
-static size_t max_buf_size;
+/* For -max_buffer_entries: the largest buffer size, and the combined growth of all
+ * threads' buffers beyond trace_buf_size, which is protected by mutex.
+ */
+static size_t max_trace_buf_size;
+static size_t buffer_growth;
+/* A buffer that fills up within this many milliseconds of its prior write grows. */
+#define BUFFER_GROW_MS 100
+/* A buffer that is written while less than a quarter full this many times in a row
+ * shrinks.
+ */
+#define BUFFER_SHRINK_WRITES 8
+
+/* Returns the size to allocate for a buffer holding size bytes of entries. */
+static inline size_t
+buf_alloc_size(size_t size)
+{
+    return size + redzone_size;
+}
 
 static drvector_t scratch_reserve_vec;
 
@@ -121,6 +159,42 @@ typedef struct {
     /* For level 0 filters */
     byte *l0_dcache;
     byte *l0_icache;
+    /* For -L0_counts: the buffer outputs since the last recording of the counts,
+     * and the next cache slot to record, counting icache slots before dcache slots
+     */
+    uint l0_outputs;
+    size_t l0_count_pos;
+    /* For -raw_compress, when writing synchronously */
+    struct _raw_compressor_t *compressor;
+    /* For -async_writers: the counts are protected by the writer's lock */
+    struct _async_writer_t *writer;
+    uint64 num_queued;
+    uint64 num_finished;
+    /* For -trace_for_instrs and -trace_annotations: the last window marked in this
+     * thread's trace
+     */
+    uint window;
+    /* For -offline_stream: the temporary name of the raw file */
+    char stream_path[MAXIMUM_PATH];
+    /* The size of the entries area of buf_base.  For -max_buffer_entries, also the
+     * size chosen for the next buffer, when buf_base was last written, and how many
+     * writes in a row found it mostly empty.
+     */
+    size_t buf_size;
+    size_t next_buf_size;
+    uint64 last_write_ms;
+    uint num_sparse_writes;
+    /* For -use_physical with -offline: the pages whose mappings this thread has
+     * recorded since phys_generation, the mapping entries not yet written out, and
+     * the entries examined since the last rescan for -virt2phys_freq.
+     */
+    addr_t *phys_seen;
+    int phys_generation;
+    byte *phys_pending;
+    size_t phys_pending_size;
+    uint64 phys_entries;
+    /* For -offline: the value of the thread's TRACE_MARKER_TYPE_STACK_BASE, or 0 */
+    addr_t stack_base;
 } per_thread_t;
 
 #define MAX_NUM_DELAY_INSTRS 32
@@ -133,11 +207,54 @@ typedef struct {
     int num_delay_instrs;
     instr_t *delay_instrs[MAX_NUM_DELAY_INSTRS];
     bool repstr;
+    /* Whether -repstr_ranges left the string loops in this bb unexpanded. */
+    bool repstr_ranges;
     void *instru_field; /* for use by instru_t */
 } user_data_t;
 
 /* For online simulation, we write to a single global pipe */
 static named_pipe_t ipc_pipe;
+#ifdef LINUX
+/* Or, with -ipc_ring, to a shared-memory ring mapped at ipc_ring_base */
+static shm_ring_t ipc_ring;
+static byte *ipc_ring_base;
+static size_t ipc_ring_size;
+#endif
+
+static inline ssize_t
+ipc_write(const void *buf, size_t size)
+{
+#ifdef LINUX
+    if (op_ipc_ring.get_value())
+        return ipc_ring.write(buf, size);
+#endif
+    return ipc_pipe.write(buf, size);
+}
+
+static inline ssize_t
+ipc_atomic_write_size()
+{
+#ifdef LINUX
+    if (op_ipc_ring.get_value())
+        return ipc_ring.get_atomic_write_size();
+#endif
+    return ipc_pipe.get_atomic_write_size();
+}
+
+static void
+ipc_close()
+{
+#ifdef LINUX
+    if (op_ipc_ring.get_value()) {
+        ipc_ring.close();
+        if (ipc_ring_base != NULL)
+            dr_unmap_file(ipc_ring_base, ipc_ring_size);
+        ipc_ring_base = NULL;
+        return;
+    }
+#endif
+    ipc_pipe.close();
+}
 
 #define MAX_INSTRU_SIZE 64  /* the max obj size of instr_t or its children */
 static instru_t *instru;
@@ -148,16 +265,67 @@ static uint64 num_refs; /* keep a global memory reference count */
 static uint64 num_refs_racy; /* racy global memory reference count */
 static volatile bool exited_process;
 
+/* For -trace_for_instrs and -trace_annotations: the ordinal of the current window
+ * (or the most recent one, while tracing is suspended), a racy count of the
+ * instructions traced in it, and a count of how many times tracing has been suspended.
+ */
+static volatile uint tracing_window;
+static uint64 window_instr_count_racy;
+static volatile uint delay_phase;
+
+/* Whether tracing is suspended and resumed, with each traced stretch a window. */
+static inline bool
+has_tracing_windows()
+{
+    return op_trace_for_instrs.get_value() > 0 || op_trace_annotations.get_value();
+}
+
+// Whether we record only each block's pc entry, leaving post-processing to supply
+// its instrs from the module code.
+static inline bool
+instrs_only()
+{
+    return op_offline.get_value() && op_instr_only.get_value();
+}
+
 /* virtual to physical translation */
 static bool have_phys;
 static physaddr_t physaddr;
 
+/* For offline traces we record the physical page of each page a thread references,
+ * once per page, and raw2trace translates the addresses, rather than translating
+ * every address here.  A thread's records must precede its references, so they are
+ * written between a buffer's header and its entries.
+ * phys_seen is direct-mapped by virtual page: a collision just records a page again.
+ */
+#define PHYS_SEEN_ENTRIES 4096
+#define PHYS_PENDING_ENTRIES 512
+/* Bumped whenever recorded mappings may have gone stale, so threads record anew. */
+static volatile int phys_generation;
+
+#ifdef LINUX
+/* For -offline: the start of the brk heap, for TRACE_MARKER_TYPE_HEAP_BASE. */
+static addr_t heap_base;
+#endif
+
+static inline bool
+phys_offline()
+{
+    return have_phys && op_offline.get_value();
+}
+
 /* Allocated TLS slot offsets */
 enum {
     MEMTRACE_TLS_OFFS_BUF_PTR,
     /* XXX: we could make these dynamic to save slots when there's no -L0_filter. */
     MEMTRACE_TLS_OFFS_DCACHE,
     MEMTRACE_TLS_OFFS_ICACHE,
+    /* The delay_phase in which this thread last wrote out its buffer */
+    MEMTRACE_TLS_OFFS_DELAY_PHASE,
+    /* Always NULL: the -persistent_instru gate selects it while tracing is off */
+    MEMTRACE_TLS_OFFS_GATE_CLOSED,
+    /* The gate as read at the start of the current block, for -persistent_instru */
+    MEMTRACE_TLS_OFFS_BB_GATE,
     MEMTRACE_TLS_COUNT, /* total number of TLS slots allocated */
 };
 static reg_id_t tls_seg;
@@ -172,6 +340,27 @@ static bool (*should_trace_thread_cb)(thread_id_t tid, void *user_data);
 static void *trace_thread_cb_user_data;
 static bool thread_filtering_enabled;
 
+/* For -persistent_instru: the byte offset, from the start of our TLS slots, of the
+ * slot from which each block loads its buffer pointer.  This selects the real
+ * pointer while tracing and the always-NULL slot while suspended, so that the
+ * instrumentation stays in the code cache and just skips itself.
+ */
+static volatile ptr_uint_t tracing_gate_offs;
+
+static inline void
+set_tracing_gate(bool open)
+{
+    tracing_gate_offs = sizeof(void*) *
+        (open ? MEMTRACE_TLS_OFFS_BUF_PTR : MEMTRACE_TLS_OFFS_GATE_CLOSED);
+}
+
+static inline bool
+tracing_gate_closed()
+{
+    return op_persistent_instru.get_value() &&
+        tracing_gate_offs != sizeof(void*) * MEMTRACE_TLS_OFFS_BUF_PTR;
+}
+
 /***************************************************************************
  * Buffer writing to disk.
  */
@@ -283,11 +472,601 @@ drmemtrace_filter_threads(bool (*should_trace_thread)(thread_id_t tid, void *use
     return DRMEMTRACE_SUCCESS;
 }
 
+/***************************************************************************
+ * Sending offline files to a remote collector for -stream_to.
+ */
+
+#ifdef UNIX
+/* With -stream_to, these replace the default file operations, turning each one into
+ * a message over a single connection per process to a drtrace_collector, which
+ * recreates the files on its side.  The file_t we hand out is the id that names the
+ * file in our messages.  Nothing is buffered here: a write blocks until its data is
+ * sent, so a slow network holds back the writing thread rather than using up memory,
+ * and -async_writers keeps that wait off the application threads up to its bound.
+ *
+ * XXX: the application could close our socket: we should move it to DR's private
+ * file descriptor range as dr_open_file() does.
+ */
+static trace_socket_t *remote_socket;
+static void *remote_lock;
+static int remote_next_id;
+
+/* Returns path relative to -outdir, as the collector wants it. */
+static const char *
+remote_relative_path(const char *path)
+{
+    const std::string &outdir = op_outdir.get_value();
+    if (strncmp(path, outdir.c_str(), outdir.size()) != 0)
+        return path;
+    path += outdir.size();
+    while (*path == DIRSEP[0])
+        path++;
+    return path;
+}
+
+/* Sends a request for path and returns whether the collector carried it out. */
+static bool
+remote_request(uint type, uint id, const char *path)
+{
+    trace_socket_msg_t reply;
+    path = remote_relative_path(path);
+    dr_mutex_lock(remote_lock);
+    bool ok = remote_socket->write_msg(type, id, path, strlen(path)) &&
+        remote_socket->read(&reply, sizeof(reply));
+    dr_mutex_unlock(remote_lock);
+    if (!ok) {
+        FATAL("Fatal error: lost the connection to %s\n",
+              op_stream_to.get_value().c_str());
+    }
+    return reply.type == TRACE_SOCKET_MSG_REPLY && reply.id == 1;
+}
+
+static file_t
+remote_open_file(const char *fname, uint mode_flags)
+{
+    /* We only open new files for writing, which is what the collector does. */
+    DR_ASSERT(TESTANY(DR_FILE_WRITE_REQUIRE_NEW, mode_flags));
+    uint id = (uint)dr_atomic_add32_return_sum(&remote_next_id, 1);
+    if (!remote_request(TRACE_SOCKET_MSG_OPEN, id, fname))
+        return INVALID_FILE;
+    return (file_t)id;
+}
+
+static ssize_t
+remote_read_file(file_t file, void *buf, size_t count)
+{
+    return -1;
+}
+
+static ssize_t
+remote_write_file(file_t file, const void *data, size_t count)
+{
+    dr_mutex_lock(remote_lock);
+    bool ok = remote_socket->write_msg(TRACE_SOCKET_MSG_WRITE, (uint)file, data, count);
+    dr_mutex_unlock(remote_lock);
+    return ok ? (ssize_t)count : -1;
+}
+
+static void
+remote_close_file(file_t file)
+{
+    dr_mutex_lock(remote_lock);
+    remote_socket->write_msg(TRACE_SOCKET_MSG_CLOSE, (uint)file, NULL, 0);
+    dr_mutex_unlock(remote_lock);
+}
+
+static bool
+remote_create_dir(const char *dir)
+{
+    return remote_request(TRACE_SOCKET_MSG_CREATE_DIR, 0, dir);
+}
+
+static void
+remote_connect()
+{
+    if (!remote_socket->connect_to(op_stream_to.get_value()) ||
+        !remote_socket->write_msg(TRACE_SOCKET_MSG_HELLO, TRACE_SOCKET_VERSION,
+                                  NULL, 0)) {
+        FATAL("Fatal error: failed to connect to %s\n",
+              op_stream_to.get_value().c_str());
+    }
+    NOTIFY(1, "Streaming trace files to %s\n", op_stream_to.get_value().c_str());
+}
+
+static void
+remote_init()
+{
+    /* We use placement new to avoid the allocator while isolated from the app. */
+    remote_socket = new(dr_global_alloc(sizeof(trace_socket_t))) trace_socket_t();
+    remote_lock = dr_mutex_create();
+    remote_next_id = 0;
+    remote_connect();
+    file_ops_func.open_file = remote_open_file;
+    file_ops_func.read_file = remote_read_file;
+    file_ops_func.write_file = remote_write_file;
+    file_ops_func.close_file = remote_close_file;
+    file_ops_func.create_dir = remote_create_dir;
+}
+
+/* The child shares the parent's connection, where its messages would interleave
+ * with the parent's, so it makes its own.
+ */
+static void
+remote_fork_init()
+{
+    remote_socket->close();
+    remote_next_id = 0;
+    remote_connect();
+}
+
+static void
+remote_exit()
+{
+    remote_socket->~trace_socket_t();
+    dr_global_free(remote_socket, sizeof(trace_socket_t));
+    remote_socket = NULL;
+    dr_mutex_destroy(remote_lock);
+}
+#endif
+
+/***************************************************************************
+ * Raw file compression for -raw_compress.
+ */
+
+/* Each buffer is compressed as its own gzip member: concatenated members form
+ * a valid gzip file, and no state is carried between buffers, so any thread can
+ * compress any buffer.
+ */
+typedef struct _raw_compressor_t {
+#ifdef HAS_ZLIB
+    z_stream zstream;
+#endif
+    byte *out_buf;
+    size_t out_size;
+} raw_compressor_t;
+
+#ifdef HAS_ZLIB
+/* We keep zlib's state in DR's heap. */
+static voidpf
+raw_compressor_alloc(voidpf opaque, uInt items, uInt size)
+{
+    size_t alloc_size = (size_t)items * size + sizeof(size_t);
+    size_t *alloc = (size_t *) dr_global_alloc(alloc_size);
+    *alloc = alloc_size;
+    return alloc + 1;
+}
+
+static void
+raw_compressor_free(voidpf opaque, voidpf ptr)
+{
+    size_t *alloc = (size_t *)ptr - 1;
+    dr_global_free(alloc, *alloc);
+}
+#endif
+
+static raw_compressor_t *
+raw_compressor_create()
+{
+#ifdef HAS_ZLIB
+    raw_compressor_t *comp = (raw_compressor_t *) dr_global_alloc(sizeof(*comp));
+    memset(comp, 0, sizeof(*comp));
+    comp->zstream.zalloc = raw_compressor_alloc;
+    comp->zstream.zfree = raw_compressor_free;
+    /* Adding 16 to the window bits selects the gzip format. */
+    if (deflateInit2(&comp->zstream, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK)
+        FATAL("Fatal error: failed to initialize compression\n");
+    comp->out_size = deflateBound(&comp->zstream,
+                                  (uLong)buf_alloc_size(max_trace_buf_size));
+    comp->out_buf = (byte *) dr_global_alloc(comp->out_size);
+    return comp;
+#else
+    FATAL("Fatal error: -raw_compress requires zlib\n");
+    return NULL;
+#endif
+}
+
+static void
+raw_compressor_destroy(raw_compressor_t *comp)
+{
+#ifdef HAS_ZLIB
+    deflateEnd(&comp->zstream);
+    dr_global_free(comp->out_buf, comp->out_size);
+    dr_global_free(comp, sizeof(*comp));
+#endif
+}
+
+/* Writes the buffer to the file, compressed if comp is non-NULL. */
+static bool
+write_raw_file(file_t file, raw_compressor_t *comp, byte *buf, size_t size)
+{
+#ifdef HAS_ZLIB
+    if (comp != NULL) {
+        if (deflateReset(&comp->zstream) != Z_OK)
+            return false;
+        comp->zstream.next_in = buf;
+        comp->zstream.avail_in = (uInt)size;
+        comp->zstream.next_out = comp->out_buf;
+        comp->zstream.avail_out = (uInt)comp->out_size;
+        /* The output buffer holds the bound on compressed data, so this
+         * completes in one call.
+         */
+        if (deflate(&comp->zstream, Z_FINISH) != Z_STREAM_END)
+            return false;
+        buf = comp->out_buf;
+        size = comp->out_size - comp->zstream.avail_out;
+    }
+#endif
+    return file_ops_func.write_file(file, buf, size) >= (ssize_t)size;
+}
+
+/***************************************************************************
+ * Asynchronous buffer writing for -async_writers.
+ */
+
+/* With -async_writers, full offline buffers are queued to a pool of client threads
+ * which write them out while the application thread continues with a fresh buffer.
+ * Each application thread is served by a single writer so that its buffers reach its
+ * file in order.  Written buffers are cleared and kept on the writer's free list.
+ *
+ * Client threads do not run once process exit begins, so we wait for the writers
+ * before the process exits or forks, and any later buffers are written inline.
+ */
+typedef struct {
+    per_thread_t *data;
+    byte *buf;
+    size_t size;
+    /* The size of the entries area of buf. */
+    size_t capacity;
+} async_job_t;
+
+typedef struct _async_writer_t {
+    void *lock;
+    void *work_event;  /* signaled when a job is queued */
+    void *space_event; /* signaled when a job is finished */
+    async_job_t *jobs; /* ring of op_async_max_buffers entries */
+    uint head;
+    uint count;
+    /* Whether a job has been taken off the ring but not yet finished. */
+    bool busy;
+    uint64 num_finished;
+    /* Linked through the first pointer-sized slot of each buffer, with the
+     * buffer's capacity in the second.
+     */
+    byte *free_bufs;
+    /* For -raw_compress. */
+    raw_compressor_t *compressor;
+} async_writer_t;
+
+#define FREE_BUF_CAPACITY(buf) (((size_t *)(buf))[1])
+
+static async_writer_t *async_writers;
+static uint num_async_writers;
+static uint next_async_writer;
+/* Set once the writers can no longer be relied upon to run. */
+static volatile bool async_stopped;
+
+/* If the writers make no progress for this many milliseconds while we wait on
+ * them, we assume they have been stopped for process exit.
+ */
+#define ASYNC_STUCK_MS 10000
+
+static void
+async_write_job(async_writer_t *writer, async_job_t *job)
+{
+    if (!write_raw_file(job->data->file, writer->compressor, job->buf, job->size))
+        FATAL("Fatal error: failed to write trace\n");
+    /* Clear the buffer for reuse as memtrace() does after a synchronous write. */
+    memset(job->buf, 0, job->capacity);
+    memset(job->buf + job->capacity, -1, redzone_size);
+}
+
+/* The caller must hold writer->lock. */
+static void
+async_finish_job(async_writer_t *writer, async_job_t *job)
+{
+    job->data->num_finished++;
+    writer->num_finished++;
+    if (job->capacity != job->data->next_buf_size) {
+        /* The thread has moved on to a different size. */
+        dr_raw_mem_free(job->buf, buf_alloc_size(job->capacity));
+        return;
+    }
+    *(byte **)job->buf = writer->free_bufs;
+    FREE_BUF_CAPACITY(job->buf) = job->capacity;
+    writer->free_bufs = job->buf;
+}
+
+/* The caller must hold writer->lock. */
+static async_job_t
+async_pop_job(async_writer_t *writer)
+{
+    async_job_t job = writer->jobs[writer->head];
+    writer->head = (writer->head + 1) % op_async_max_buffers.get_value();
+    writer->count--;
+    return job;
+}
+
+static void
+async_writer_thread(void *arg)
+{
+    async_writer_t *writer = (async_writer_t *) arg;
+    /* We run until DR terminates us at process exit. */
+    while (true) {
+        dr_mutex_lock(writer->lock);
+        while (writer->count == 0) {
+            dr_mutex_unlock(writer->lock);
+            dr_event_wait(writer->work_event);
+            dr_mutex_lock(writer->lock);
+        }
+        async_job_t job = async_pop_job(writer);
+        writer->busy = true;
+        dr_mutex_unlock(writer->lock);
+        async_write_job(writer, &job);
+        dr_mutex_lock(writer->lock);
+        async_finish_job(writer, &job);
+        writer->busy = false;
+        dr_mutex_unlock(writer->lock);
+        dr_event_signal(writer->space_event);
+    }
+}
+
+static void
+async_init()
+{
+    num_async_writers = op_async_writers.get_value();
+    // A writer takes over a whole buffer, while phys_offline() splits its writes.
+    if (num_async_writers == 0 || !op_offline.get_value() || phys_offline() ||
+        file_ops_func.handoff_buf != NULL || op_async_max_buffers.get_value() == 0) {
+        num_async_writers = 0;
+        return;
+    }
+    async_stopped = false;
+    next_async_writer = 0;
+    async_writers = (async_writer_t *)
+        dr_global_alloc(num_async_writers * sizeof(*async_writers));
+    for (uint i = 0; i < num_async_writers; i++) {
+        async_writer_t *writer = &async_writers[i];
+        memset(writer, 0, sizeof(*writer));
+        writer->lock = dr_mutex_create();
+        writer->work_event = dr_event_create();
+        writer->space_event = dr_event_create();
+        writer->jobs = (async_job_t *)
+            dr_global_alloc(op_async_max_buffers.get_value() * sizeof(async_job_t));
+        if (op_raw_compress.get_value())
+            writer->compressor = raw_compressor_create();
+        if (!dr_create_client_thread(async_writer_thread, writer))
+            FATAL("Fatal error: failed to create trace writer thread\n");
+    }
+}
+
+/* Writes out the queued buffers on the calling thread.  This is only safe once
+ * the writer threads no longer run.
+ */
+static void
+async_write_inline()
+{
+    for (uint i = 0; i < num_async_writers; i++) {
+        async_writer_t *writer = &async_writers[i];
+        dr_mutex_lock(writer->lock);
+        while (writer->count > 0) {
+            async_job_t job = async_pop_job(writer);
+            async_write_job(writer, &job);
+            async_finish_job(writer, &job);
+        }
+        writer->busy = false;
+        dr_mutex_unlock(writer->lock);
+    }
+}
+
+/* Waits until the buffers queued by data, or by every thread if data is NULL,
+ * are written.
+ */
+static void
+async_wait(void *drcontext, per_thread_t *data)
+{
+    uint64 last_finished = 0;
+    int stuck_ms = 0;
+    while (true) {
+        bool done = true;
+        uint64 finished = 0;
+        for (uint i = 0; i < num_async_writers; i++) {
+            async_writer_t *writer = &async_writers[i];
+            if (data != NULL && writer != data->writer)
+                continue;
+            dr_mutex_lock(writer->lock);
+            if (data != NULL)
+                done = data->num_finished == data->num_queued;
+            else if (writer->count > 0 || writer->busy)
+                done = false;
+            finished += writer->num_finished;
+            dr_mutex_unlock(writer->lock);
+        }
+        if (done)
+            return;
+        /* At process exit we may be called on behalf of another thread. */
+        if (async_stopped || drcontext != dr_get_current_drcontext()) {
+            async_write_inline();
+            return;
+        }
+        if (finished != last_finished) {
+            last_finished = finished;
+            stuck_ms = 0;
+        } else if (++stuck_ms > ASYNC_STUCK_MS) {
+            async_stopped = true;
+            continue;
+        }
+        dr_sleep(1);
+    }
+}
+
+/* Hands the buffer to data's writer, waiting if the writer is too far behind. */
+static void
+async_enqueue(per_thread_t *data, byte *buf, size_t size)
+{
+    async_writer_t *writer = data->writer;
+    dr_mutex_lock(writer->lock);
+    while (writer->count == op_async_max_buffers.get_value()) {
+        dr_mutex_unlock(writer->lock);
+        dr_event_wait(writer->space_event);
+        dr_mutex_lock(writer->lock);
+    }
+    async_job_t *job = &writer->jobs[(writer->head + writer->count) %
+                                     op_async_max_buffers.get_value()];
+    job->data = data;
+    job->buf = buf;
+    job->size = size;
+    job->capacity = data->buf_size;
+    writer->count++;
+    data->num_queued++;
+    dr_mutex_unlock(writer->lock);
+    dr_event_signal(writer->work_event);
+}
+
+#ifdef LINUX
+/* Returns whether the writers must catch up before this syscall: when it ends or
+ * replaces the process, or creates a new process which would inherit our queues.
+ */
+static bool
+is_async_barrier_syscall(void *drcontext, int sysnum)
+{
+    switch (sysnum) {
+    case SYS_exit_group:
+    case SYS_execve:
+# ifdef SYS_fork
+    case SYS_fork:
+# endif
+# ifdef SYS_vfork
+    case SYS_vfork:
+# endif
+        return true;
+    case SYS_clone:
+        return !TESTANY(CLONE_VM, (ptr_uint_t)dr_syscall_get_param(drcontext, 0));
+    }
+    return false;
+}
+#endif
+
+static void
+async_thread_init(per_thread_t *data)
+{
+    if (num_async_writers == 0)
+        return;
+    dr_mutex_lock(mutex);
+    data->writer = &async_writers[next_async_writer++ % num_async_writers];
+    dr_mutex_unlock(mutex);
+}
+
+/* Called at thread exit prior to the final write, which we perform synchronously. */
+static void
+async_thread_exit(void *drcontext, per_thread_t *data)
+{
+    if (data->writer == NULL)
+        return;
+    async_wait(drcontext, data);
+    data->writer = NULL;
+}
+
+static void
+async_exit()
+{
+    if (num_async_writers == 0)
+        return;
+    /* The writers are no longer running. */
+    async_stopped = true;
+    async_write_inline();
+    for (uint i = 0; i < num_async_writers; i++) {
+        async_writer_t *writer = &async_writers[i];
+        while (writer->free_bufs != NULL) {
+            byte *next = *(byte **)writer->free_bufs;
+            dr_raw_mem_free(writer->free_bufs,
+                            buf_alloc_size(FREE_BUF_CAPACITY(writer->free_bufs)));
+            writer->free_bufs = next;
+        }
+        dr_global_free(writer->jobs,
+                       op_async_max_buffers.get_value() * sizeof(async_job_t));
+        if (writer->compressor != NULL)
+            raw_compressor_destroy(writer->compressor);
+        dr_event_destroy(writer->space_event);
+        dr_event_destroy(writer->work_event);
+        dr_mutex_destroy(writer->lock);
+    }
+    dr_global_free(async_writers, num_async_writers * sizeof(*async_writers));
+    async_writers = NULL;
+    num_async_writers = 0;
+}
+
+/* Sets the size of data's next buffer to size, or leaves it alone if growing it
+ * would exceed -buffer_memory_budget.
+ */
+static void
+set_next_buf_size(per_thread_t *data, size_t size)
+{
+    dr_mutex_lock(mutex);
+    if (size > data->next_buf_size &&
+        buffer_growth + (size - data->next_buf_size) >
+        op_buffer_memory_budget.get_value())
+        size = data->next_buf_size;
+    buffer_growth = buffer_growth + size - data->next_buf_size;
+    data->next_buf_size = size;
+    dr_mutex_unlock(mutex);
+}
+
+/* For -max_buffer_entries, picks the size of data's next buffer from how full its
+ * current buffer is when written out at buf_ptr and how quickly it filled.
+ */
+static void
+adapt_buffer_size(per_thread_t *data, byte *buf_ptr)
+{
+    uint64 now = dr_get_milliseconds();
+    size_t size = data->buf_size;
+    size_t used = buf_ptr - data->buf_base;
+    if (used >= data->buf_size) {
+        data->num_sparse_writes = 0;
+        if (now - data->last_write_ms < BUFFER_GROW_MS && size < max_trace_buf_size)
+            size *= 2;
+    } else if (used < data->buf_size / 4 && size > trace_buf_size) {
+        if (++data->num_sparse_writes >= BUFFER_SHRINK_WRITES) {
+            data->num_sparse_writes = 0;
+            size /= 2;
+        }
+    } else
+        data->num_sparse_writes = 0;
+    data->last_write_ms = now;
+    if (size != data->next_buf_size)
+        set_next_buf_size(data, size);
+}
+
+/* Points data->buf_base at a fresh buffer of size data->next_buf_size. */
 static void
 create_buffer(per_thread_t *data)
 {
+    size_t size = data->next_buf_size;
+    if (data->writer != NULL) {
+        /* Reuse a buffer of this size that has been written out, if there is one. */
+        async_writer_t *writer = data->writer;
+        dr_mutex_lock(writer->lock);
+        byte **prev = &writer->free_bufs;
+        byte *buf = writer->free_bufs;
+        while (buf != NULL && FREE_BUF_CAPACITY(buf) != size) {
+            prev = (byte **)buf;
+            buf = *prev;
+        }
+        if (buf != NULL) {
+            *prev = *(byte **)buf;
+            *(byte **)buf = NULL;
+            FREE_BUF_CAPACITY(buf) = 0;
+        }
+        dr_mutex_unlock(writer->lock);
+        if (buf != NULL) {
+            data->buf_base = buf;
+            data->buf_size = size;
+            return;
+        }
+    }
     data->buf_base = (byte *)
-        dr_raw_mem_alloc(max_buf_size, DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+        dr_raw_mem_alloc(buf_alloc_size(size), DR_MEMPROT_READ | DR_MEMPROT_WRITE,
+                         NULL);
     /* For file_ops_func.handoff_buf we have to handle failure as OOM is not unlikely. */
     if (data->buf_base == NULL) {
         /* Switch to "reserve" buffer. */
@@ -296,13 +1075,16 @@ create_buffer(per_thread_t *data)
         }
         NOTIFY(0, "Out of memory: truncating further tracing.\n");
         data->buf_base = data->reserve_buf;
+        data->buf_size = trace_buf_size;
+        set_next_buf_size(data, trace_buf_size);
         /* Avoid future buffer output. */
         op_max_trace_size.set_value(data->bytes_written - 1);
         return;
     }
     /* dr_raw_mem_alloc guarantees to give us zeroed memory, so no need for a memset */
     /* set sentinel (non-zero) value in redzone */
-    memset(data->buf_base + trace_buf_size, -1, redzone_size);
+    memset(data->buf_base + size, -1, redzone_size);
+    data->buf_size = size;
     data->num_buffers++;
     if (data->num_buffers == 2) {
         /* Create a "reserve" buffer so we can continue after hitting OOM later.
@@ -312,7 +1094,8 @@ create_buffer(per_thread_t *data)
          * why we wait for the 2nd buffer) but we gain simplicity.
          */
         data->reserve_buf = (byte *)
-            dr_raw_mem_alloc(max_buf_size, DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+            dr_raw_mem_alloc(buf_alloc_size(trace_buf_size),
+                             DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
         if (data->reserve_buf != NULL)
             memset(data->reserve_buf + trace_buf_size, -1, redzone_size);
     }
@@ -322,8 +1105,8 @@ static inline byte *
 atomic_pipe_write(void *drcontext, byte *pipe_start, byte *pipe_end)
 {
     ssize_t towrite = pipe_end - pipe_start;
-    DR_ASSERT(towrite <= ipc_pipe.get_atomic_write_size() && towrite > 0);
-    if (ipc_pipe.write((void *)pipe_start, towrite) < (ssize_t)towrite) {
+    DR_ASSERT(towrite <= ipc_atomic_write_size() && towrite > 0);
+    if (ipc_write((void *)pipe_start, towrite) < (ssize_t)towrite) {
         FATAL("Fatal error: failed to write to pipe\n");
     }
     // Re-emit buffer unit header to handle split pipe writes.
@@ -342,17 +1125,86 @@ write_trace_data(void *drcontext, byte *towrite_start, byte *towrite_end)
         ssize_t size = towrite_end - towrite_start;
         if (file_ops_func.handoff_buf != NULL) {
             if (!file_ops_func.handoff_buf(data->file, towrite_start, size,
-                                           max_buf_size)) {
+                                           buf_alloc_size(data->buf_size))) {
                 FATAL("Fatal error: failed to hand off trace\n");
             }
-        } else if (file_ops_func.write_file(data->file, towrite_start, size) < size) {
-            FATAL("Fatal error: failed to write trace\n");
+        } else if (data->writer != NULL) {
+            async_enqueue(data, towrite_start, size);
+        } else {
+            if (op_raw_compress.get_value() && data->compressor == NULL)
+                data->compressor = raw_compressor_create();
+            if (!write_raw_file(data->file, data->compressor, towrite_start, size))
+                FATAL("Fatal error: failed to write trace\n");
         }
         return towrite_start;
     } else
         return atomic_pipe_write(drcontext, towrite_start, towrite_end);
 }
 
+/* Writes out the pending mapping entries, first writing the part of the buffer
+ * from *towrite_start through its header if that has not been written yet.
+ */
+static void
+phys_write_pending(void *drcontext, per_thread_t *data, byte **towrite_start,
+                   size_t header_size)
+{
+    byte *header_end = data->buf_base + header_size;
+    if (data->phys_pending_size == 0)
+        return;
+    if (*towrite_start < header_end) {
+        write_trace_data(drcontext, *towrite_start, header_end);
+        *towrite_start = header_end;
+    }
+    write_trace_data(drcontext, data->phys_pending,
+                     data->phys_pending + data->phys_pending_size);
+    data->bytes_written += data->phys_pending_size;
+    data->phys_pending_size = 0;
+}
+
+/* Records the mapping of each page in [start, end] not yet seen by this thread. */
+static void
+phys_record_range(void *drcontext, per_thread_t *data, addr_t start, addr_t end,
+                  byte **towrite_start, size_t header_size)
+{
+    for (addr_t vpn = start >> OFFLINE_PHYS_PAGE_BITS;
+         vpn <= end >> OFFLINE_PHYS_PAGE_BITS; vpn++) {
+        addr_t *seen = &data->phys_seen[vpn % PHYS_SEEN_ENTRIES];
+        if (*seen == vpn + 1)
+            continue;
+        // We mark failures as seen too, to avoid querying again for bogus addresses.
+        *seen = vpn + 1;
+        addr_t phys = physaddr.virtual2physical(vpn << OFFLINE_PHYS_PAGE_BITS);
+        if (phys == 0) {
+            // As online, the addresses on this page are left virtual.
+            NOTIFY(1, "virtual2physical translation failure for page " PFX "\n",
+                   vpn << OFFLINE_PHYS_PAGE_BITS);
+            continue;
+        }
+        if (data->phys_pending_size + 2 * instru->sizeof_entry() >
+            PHYS_PENDING_ENTRIES * instru->sizeof_entry())
+            phys_write_pending(drcontext, data, towrite_start, header_size);
+        data->phys_pending_size += ((offline_instru_t *)instru)->
+            append_phys_mapping(data->phys_pending + data->phys_pending_size, vpn,
+                                phys >> OFFLINE_PHYS_PAGE_BITS);
+    }
+}
+
+static void
+phys_record_entry(void *drcontext, per_thread_t *data, byte *mem_ref,
+                  byte **towrite_start, size_t header_size)
+{
+    addr_t start, end;
+    if (op_virt2phys_freq.get_value() > 0 &&
+        ++data->phys_entries >= op_virt2phys_freq.get_value()) {
+        // Rescan the pagemap for every page, to catch migrations.
+        data->phys_entries = 0;
+        memset(data->phys_seen, 0, PHYS_SEEN_ENTRIES * sizeof(data->phys_seen[0]));
+        physaddr.invalidate(0, (size_t)-1);
+    }
+    if (((offline_instru_t *)instru)->get_entry_addr_range(mem_ref, &start, &end))
+        phys_record_range(drcontext, data, start, end, towrite_start, header_size);
+}
+
 static bool
 is_ok_to_split_before(trace_type_t type)
 {
@@ -360,6 +1212,9 @@ is_ok_to_split_before(trace_type_t type)
         type == TRACE_TYPE_MARKER || type == TRACE_TYPE_THREAD_EXIT;
 }
 
+static bool
+append_filter_counts(per_thread_t *data);
+
 static void
 memtrace(void *drcontext, bool skip_size_cap)
 {
@@ -369,6 +1224,7 @@ memtrace(void *drcontext, bool skip_size_cap)
     bool do_write = true;
     size_t header_size = 0;
     uint num_refs = 0;
+    uint num_instrs = 0;
 
     buf_ptr = BUF_PTR(data->seg_base);
     // For online we already wrote the thread header but for offline it is in
@@ -381,6 +1237,15 @@ memtrace(void *drcontext, bool skip_size_cap)
     // The initial slots are left empty for the header, which we add here.
     header_size += instru->append_unit_header(data->buf_base + header_size,
                                               dr_get_thread_id(drcontext));
+    if (has_tracing_windows() && data->window != tracing_window) {
+        // Shift the entries to insert the window marker right after the header.
+        // The redzone has room for the extra entry.
+        byte *start = data->buf_base + header_size;
+        memmove(start + instru->sizeof_entry(), start, buf_ptr - start);
+        instru->append_marker(start, TRACE_MARKER_TYPE_WINDOW_ID, tracing_window);
+        buf_ptr += instru->sizeof_entry();
+        data->window = tracing_window;
+    }
     pipe_start = data->buf_base;
     pipe_end = pipe_start;
     if (!skip_size_cap && op_max_trace_size.get_value() > 0 &&
@@ -394,14 +1259,23 @@ memtrace(void *drcontext, bool skip_size_cap)
         data->bytes_written += buf_ptr - pipe_start;
 
     if (do_write) {
+        if (phys_offline() && data->phys_generation != phys_generation) {
+            memset(data->phys_seen, 0, PHYS_SEEN_ENTRIES * sizeof(data->phys_seen[0]));
+            data->phys_generation = phys_generation;
+        }
         for (mem_ref = data->buf_base + header_size; mem_ref < buf_ptr;
              mem_ref += instru->sizeof_entry()) {
             num_refs++;
-            if (have_phys && op_use_physical.get_value()) {
+            if (op_trace_for_instrs.get_value() > 0)
+                num_instrs += instru->get_entry_instr_count(mem_ref);
+            if (phys_offline())
+                phys_record_entry(drcontext, data, mem_ref, &pipe_start, header_size);
+            else if (have_phys && op_use_physical.get_value()) {
                 trace_type_t type = instru->get_entry_type(mem_ref);
                 if (type != TRACE_TYPE_THREAD &&
                     type != TRACE_TYPE_THREAD_EXIT &&
-                    type != TRACE_TYPE_PID) {
+                    type != TRACE_TYPE_PID &&
+                    type != TRACE_TYPE_MARKER) {
                     addr_t virt = instru->get_entry_addr(mem_ref);
                     addr_t phys = physaddr.virtual2physical(virt);
                     DR_ASSERT(type != TRACE_TYPE_INSTR_BUNDLE);
@@ -431,7 +1305,7 @@ memtrace(void *drcontext, bool skip_size_cap)
                     // avoid splitting an instr from its subsequent bundle entry.
                     // An alternative is to have the reader use per-thread state.
                     if ((mem_ref + (1+MAX_NUM_DELAY_ENTRIES)*instru->sizeof_entry()
-                         - pipe_start) > ipc_pipe.get_atomic_write_size()) {
+                         - pipe_start) > ipc_atomic_write_size()) {
                         DR_ASSERT(is_ok_to_split_before(instru->get_entry_type
                                                         (pipe_start+header_size)));
                         pipe_start = atomic_pipe_write(drcontext, pipe_start, pipe_end);
@@ -440,6 +1314,8 @@ memtrace(void *drcontext, bool skip_size_cap)
             }
         }
         if (op_offline.get_value()) {
+            if (phys_offline())
+                phys_write_pending(drcontext, data, &pipe_start, header_size);
             write_trace_data(drcontext, pipe_start, buf_ptr);
         } else {
             // Write the rest to pipe
@@ -448,7 +1324,7 @@ memtrace(void *drcontext, bool skip_size_cap)
             // XXX i#2638: if we want to support branch target analysis in online
             // traces we'll need to not split after a branch by carrying a write-final
             // branch forward to the next buffer.
-            if ((buf_ptr - pipe_start) > ipc_pipe.get_atomic_write_size()) {
+            if ((buf_ptr - pipe_start) > ipc_atomic_write_size()) {
                 DR_ASSERT(is_ok_to_split_before(instru->get_entry_type
                                                 (pipe_start+header_size)));
                 pipe_start = atomic_pipe_write(drcontext, pipe_start, pipe_end);
@@ -462,22 +1338,39 @@ memtrace(void *drcontext, bool skip_size_cap)
         data->num_refs += num_refs;
     }
 
-    if (do_write && file_ops_func.handoff_buf != NULL) {
-        // The owner of the handoff callback now owns the buffer, and we get a new one.
+    // The final write at thread exit, the only one skipping the size cap, needs no
+    // next buffer.
+    if (do_write && !skip_size_cap && op_max_buffer_entries.get_value() > 0)
+        adapt_buffer_size(data, buf_ptr);
+    if (do_write && (file_ops_func.handoff_buf != NULL || data->writer != NULL)) {
+        // The owner of the handoff callback, or the -async_writers thread, now owns
+        // the buffer, and we get a new one.
+        create_buffer(data);
+    } else if (data->next_buf_size != data->buf_size &&
+               data->buf_base != data->reserve_buf) {
+        dr_raw_mem_free(data->buf_base, buf_alloc_size(data->buf_size));
         create_buffer(data);
     } else {
         // Our instrumentation reads from buffer and skips the clean call if the
         // content is 0, so we need set zero in the trace buffer and set non-zero
         // in redzone.
-        memset(data->buf_base, 0, trace_buf_size);
-        redzone = data->buf_base + trace_buf_size;
+        memset(data->buf_base, 0, data->buf_size);
+        redzone = data->buf_base + data->buf_size;
         if (buf_ptr > redzone) {
             // Set sentinel (non-zero) value in redzone
             memset(redzone, -1, buf_ptr - redzone);
         }
     }
     BUF_PTR(data->seg_base) = data->buf_base + buf_hdr_slots_size;
+    if (op_L0_filter.get_value() && op_L0_counts.get_value() > 0 && do_write) {
+        // We continue a partial recording regardless of the period.
+        if (data->l0_count_pos > 0 || ++data->l0_outputs >= op_L0_counts.get_value()) {
+            data->l0_outputs = 0;
+            append_filter_counts(data);
+        }
+    }
     num_refs_racy += num_refs;
+    window_instr_count_racy += num_instrs;
     if (op_exit_after_tracing.get_value() > 0 &&
         num_refs_racy > op_exit_after_tracing.get_value()) {
         dr_mutex_lock(mutex);
@@ -489,18 +1382,25 @@ memtrace(void *drcontext, bool skip_size_cap)
             // we settle for exiting.
             NOTIFY(0, "Exiting process after ~" UINT64_FORMAT_STRING" references.\n",
                    num_refs_racy);
+            async_wait(drcontext, NULL);
             dr_exit_process(0);
         }
         dr_mutex_unlock(mutex);
     }
 }
 
+static void
+hit_trace_window_end();
+
 /* clean_call sends the memory reference info to the simulator */
 static void
 clean_call(void)
 {
     void *drcontext = dr_get_current_drcontext();
     memtrace(drcontext, false);
+    if (op_trace_for_instrs.get_value() > 0 &&
+        window_instr_count_racy > op_trace_for_instrs.get_value())
+        hit_trace_window_end();
 }
 
 /***************************************************************************
@@ -515,6 +1415,38 @@ insert_load_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
                            tls_offs + sizeof(void*)*MEMTRACE_TLS_OFFS_BUF_PTR, reg_ptr);
 }
 
+#ifdef X86
+/* For -persistent_instru: loads the buffer pointer from the slot selected by
+ * tracing_gate_offs, yielding NULL while tracing is suspended.  The gate is read
+ * once per block and saved in a TLS slot for the block's remaining instrs, so that
+ * a block is never traced without its leading pc entry.
+ */
+static void
+insert_load_gated_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
+                          reg_id_t reg_ptr, bool first_instr)
+{
+    if (first_instr) {
+        instrlist_insert_mov_immed_ptrsz(drcontext, (ptr_int_t)&tracing_gate_offs,
+                                         opnd_create_reg(reg_ptr), ilist, where,
+                                         NULL, NULL);
+        MINSERT(ilist, where,
+                XINST_CREATE_load(drcontext, opnd_create_reg(reg_ptr),
+                                  OPND_CREATE_MEMPTR(reg_ptr, 0)));
+        dr_insert_write_raw_tls(drcontext, ilist, where, tls_seg,
+                                tls_offs + sizeof(void*)*MEMTRACE_TLS_OFFS_BB_GATE,
+                                reg_ptr);
+    } else {
+        dr_insert_read_raw_tls(drcontext, ilist, where, tls_seg,
+                               tls_offs + sizeof(void*)*MEMTRACE_TLS_OFFS_BB_GATE,
+                               reg_ptr);
+    }
+    MINSERT(ilist, where,
+            XINST_CREATE_load(drcontext, opnd_create_reg(reg_ptr),
+                              opnd_create_far_base_disp(tls_seg, reg_ptr, DR_REG_NULL,
+                                                        0, tls_offs, OPSZ_PTR)));
+}
+#endif
+
 static void
 insert_update_buf_ptr(void *drcontext, instrlist_t *ilist, instr_t *where,
                       reg_id_t reg_ptr, dr_pred_type_t pred, int adjust)
@@ -550,7 +1482,7 @@ instrument_delay_instrs(void *drcontext, void *tag, instrlist_t *ilist,
     adjust = instru->instrument_instr(drcontext, tag, &ud->instru_field,
                                       ilist, where, reg_ptr, adjust,
                                       ud->delay_instrs[0]);
-    if (have_phys && op_use_physical.get_value()) {
+    if (have_phys && op_use_physical.get_value() && !phys_offline()) {
         // No instr bundle if physical-2-virtual since instr bundle may
         // cross page bundary.
         int i;
@@ -719,6 +1651,57 @@ instrument_clean_call(void *drcontext, instrlist_t *ilist, instr_t *where,
 
 // Called before writing to the trace buffer.
 // reg_ptr is treated as scratch and may be clobbered by this routine.
+// Each set of a -L0_filter cache holds its ways adjacently, most recently used
+// first.  Each way is a slot holding the tag of its line, followed for
+// -L0_counts by the number of accesses to the line.
+static uint
+l0_line_size(bool is_icache)
+{
+    uint size = is_icache ? op_L0I_line_size.get_value() : op_L0D_line_size.get_value();
+    return size == 0 ? op_line_size.get_value() : size;
+}
+
+static size_t
+l0_slot_size()
+{
+    return (op_L0_counts.get_value() > 0 ? 2 : 1) * sizeof(void*);
+}
+
+static size_t
+l0_cache_alloc_size(bool is_icache)
+{
+    uint64 cache_size = is_icache ? op_L0I_size.get_value() : op_L0D_size.get_value();
+    return (size_t)(cache_size / l0_line_size(is_icache)) * l0_slot_size();
+}
+
+// Increments the count of the slot at reg_ptr + offs.
+static void
+insert_filter_count_increment(void *drcontext, instrlist_t *ilist, instr_t *where,
+                              reg_id_t reg_ptr, int offs, reg_id_t scratch)
+{
+    MINSERT(ilist, where,
+            XINST_CREATE_load
+            (drcontext, opnd_create_reg(scratch), OPND_CREATE_MEMPTR(reg_ptr, offs)));
+    MINSERT(ilist, where,
+            XINST_CREATE_add(drcontext, opnd_create_reg(scratch), OPND_CREATE_INT8(1)));
+    MINSERT(ilist, where,
+            XINST_CREATE_store
+            (drcontext, OPND_CREATE_MEMPTR(reg_ptr, offs), opnd_create_reg(scratch)));
+}
+
+// Copies the pointer-sized value at reg_ptr + from to reg_ptr + to.
+static void
+insert_filter_slot_copy(void *drcontext, instrlist_t *ilist, instr_t *where,
+                        reg_id_t reg_ptr, int from, int to, reg_id_t scratch)
+{
+    MINSERT(ilist, where,
+            XINST_CREATE_load
+            (drcontext, opnd_create_reg(scratch), OPND_CREATE_MEMPTR(reg_ptr, from)));
+    MINSERT(ilist, where,
+            XINST_CREATE_store
+            (drcontext, OPND_CREATE_MEMPTR(reg_ptr, to), opnd_create_reg(scratch)));
+}
+
 // Returns DR_REG_NULL to indicate *not* to insert the instrumentation to
 // write to the trace buffer.  Otherwise, returns a register that the caller
 // must restore *after* the skip target.  The caller must also restore the
@@ -729,15 +1712,20 @@ insert_filter_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
                    user_data_t *ud, reg_id_t reg_ptr,
                    opnd_t ref, instr_t *app, instr_t *skip, dr_pred_type_t pred)
 {
-    // Our "level 0" inlined direct-mapped cache filter.
+    // Our "level 0" inlined direct-mapped or 2-way cache filter.
     DR_ASSERT(op_L0_filter.get_value());
     reg_id_t reg_idx;
     bool is_icache = opnd_is_null(ref);
     uint64 cache_size = is_icache ? op_L0I_size.get_value() : op_L0D_size.get_value();
     if (cache_size == 0)
         return DR_REG_NULL; // Skip instru.
-    ptr_int_t mask = (ptr_int_t)(cache_size / op_line_size.get_value()) - 1;
-    int line_bits = compute_log2(op_line_size.get_value());
+    uint assoc = is_icache ? op_L0I_assoc.get_value() : op_L0D_assoc.get_value();
+    uint line_size = l0_line_size(is_icache);
+    ptr_int_t mask = (ptr_int_t)(cache_size / line_size / assoc) - 1;
+    int line_bits = compute_log2(line_size);
+    bool counting = op_L0_counts.get_value() > 0;
+    int slot = (int)l0_slot_size();
+    int count_offs = sizeof(void*);
     uint offs = is_icache ? MEMTRACE_TLS_OFFS_ICACHE : MEMTRACE_TLS_OFFS_DCACHE;
     reg_id_t reg_addr;
     if (is_icache) {
@@ -829,7 +1817,7 @@ insert_filter_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
     MINSERT(ilist, where,
             XINST_CREATE_add_sll
             (drcontext, opnd_create_reg(reg_ptr), opnd_create_reg(reg_ptr),
-             opnd_create_reg(reg_idx), compute_log2(sizeof(app_pc))));
+             opnd_create_reg(reg_idx), compute_log2(slot * assoc)));
     MINSERT(ilist, where,
             XINST_CREATE_load
             (drcontext, opnd_create_reg(reg_idx), OPND_CREATE_MEMPTR(reg_ptr, 0)));
@@ -837,12 +1825,87 @@ insert_filter_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
     MINSERT(ilist, where,
             XINST_CREATE_cmp
             (drcontext, opnd_create_reg(reg_idx), opnd_create_reg(reg_addr)));
-    MINSERT(ilist, where,
-            XINST_CREATE_jump_cond(drcontext, DR_PRED_EQ, opnd_create_instr(skip)));
-    // On a miss, replace the cache entry with the new cache line.
-    MINSERT(ilist, where,
-            XINST_CREATE_store
-            (drcontext, OPND_CREATE_MEMPTR(reg_ptr, 0), opnd_create_reg(reg_addr)));
+    if (!counting && assoc == 1) {
+        MINSERT(ilist, where,
+                XINST_CREATE_jump_cond(drcontext, DR_PRED_EQ, opnd_create_instr(skip)));
+    } else if (!counting) {
+        MINSERT(ilist, where,
+                XINST_CREATE_jump_cond(drcontext, DR_PRED_EQ, opnd_create_instr(skip)));
+        MINSERT(ilist, where,
+                XINST_CREATE_load
+                (drcontext, opnd_create_reg(reg_idx), OPND_CREATE_MEMPTR(reg_ptr, slot)));
+        MINSERT(ilist, where,
+                XINST_CREATE_cmp
+                (drcontext, opnd_create_reg(reg_idx), opnd_create_reg(reg_addr)));
+        // Both a hit in the second way and a miss move the first way's line to
+        // the second way and put the new line first, so we share that code and
+        // only then act on the compare: loads and stores leave the flags intact.
+        insert_filter_slot_copy(drcontext, ilist, where, reg_ptr, 0, slot, reg_idx);
+        MINSERT(ilist, where,
+                XINST_CREATE_store
+                (drcontext, OPND_CREATE_MEMPTR(reg_ptr, 0), opnd_create_reg(reg_addr)));
+        MINSERT(ilist, where,
+                XINST_CREATE_jump_cond(drcontext, DR_PRED_EQ, opnd_create_instr(skip)));
+    } else {
+        instr_t *miss = INSTR_CREATE_label(drcontext);
+        instr_t *not_first = assoc == 1 ? miss : INSTR_CREATE_label(drcontext);
+        MINSERT(ilist, where,
+                XINST_CREATE_jump_cond(drcontext, DR_PRED_NE,
+                                       opnd_create_instr(not_first)));
+        insert_filter_count_increment(drcontext, ilist, where, reg_ptr, count_offs,
+                                      reg_idx);
+        MINSERT(ilist, where,
+                XINST_CREATE_jump(drcontext, opnd_create_instr(skip)));
+        if (assoc == 2) {
+            MINSERT(ilist, where, not_first);
+            MINSERT(ilist, where,
+                    XINST_CREATE_load
+                    (drcontext, opnd_create_reg(reg_idx),
+                     OPND_CREATE_MEMPTR(reg_ptr, slot)));
+            MINSERT(ilist, where,
+                    XINST_CREATE_cmp
+                    (drcontext, opnd_create_reg(reg_idx), opnd_create_reg(reg_addr)));
+            MINSERT(ilist, where,
+                    XINST_CREATE_jump_cond(drcontext, DR_PRED_NE,
+                                           opnd_create_instr(miss)));
+            // A hit in the second way: swap the ways, incrementing the count.
+            // Once the tag is stored reg_addr is free to hold the count.
+            insert_filter_slot_copy(drcontext, ilist, where, reg_ptr, 0, slot, reg_idx);
+            MINSERT(ilist, where,
+                    XINST_CREATE_store
+                    (drcontext, OPND_CREATE_MEMPTR(reg_ptr, 0),
+                     opnd_create_reg(reg_addr)));
+            insert_filter_count_increment(drcontext, ilist, where, reg_ptr,
+                                          slot + count_offs, reg_addr);
+            insert_filter_slot_copy(drcontext, ilist, where, reg_ptr, count_offs,
+                                    slot + count_offs, reg_idx);
+            MINSERT(ilist, where,
+                    XINST_CREATE_store
+                    (drcontext, OPND_CREATE_MEMPTR(reg_ptr, count_offs),
+                     opnd_create_reg(reg_addr)));
+            MINSERT(ilist, where,
+                    XINST_CREATE_jump(drcontext, opnd_create_instr(skip)));
+        }
+        MINSERT(ilist, where, miss);
+        if (assoc == 2) {
+            insert_filter_slot_copy(drcontext, ilist, where, reg_ptr, 0, slot, reg_idx);
+            insert_filter_slot_copy(drcontext, ilist, where, reg_ptr, count_offs,
+                                    slot + count_offs, reg_idx);
+        }
+        MINSERT(ilist, where,
+                XINST_CREATE_load_int
+                (drcontext, opnd_create_reg(reg_idx), OPND_CREATE_INT32(1)));
+        MINSERT(ilist, where,
+                XINST_CREATE_store
+                (drcontext, OPND_CREATE_MEMPTR(reg_ptr, count_offs),
+                 opnd_create_reg(reg_idx)));
+    }
+    // On a miss, put the new cache line in the first way.
+    if (counting || assoc == 1) {
+        MINSERT(ilist, where,
+                XINST_CREATE_store
+                (drcontext, OPND_CREATE_MEMPTR(reg_ptr, 0), opnd_create_reg(reg_addr)));
+    }
     // Restore app value b/c the caller will re-compute the app addr.
     // We can avoid clobbering the app address if we either get a 4th scratch or
     // keep re-computing the tag and the mask but it's better to keep the common
@@ -854,11 +1917,180 @@ insert_filter_addr(void *drcontext, instrlist_t *ilist, instr_t *where,
     return reg_idx;
 }
 
+#ifdef X86
+/* vector_memref_clean_call writes one entry per element of a gather or masked
+ * vector memory operand, whose addresses depend on vector register contents.
+ */
+static void
+vector_memref_clean_call(app_pc pc, uint write)
+{
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    byte *buf_ptr = BUF_PTR(data->seg_base);
+    if (buf_ptr == NULL)
+        return;
+    dr_mcontext_t mc;
+    mc.size = sizeof(mc);
+    mc.flags = DR_MC_ALL;
+    if (!dr_get_mcontext(drcontext, &mc))
+        return;
+    instr_t instr;
+    instr_init(drcontext, &instr);
+    if (decode(drcontext, pc, &instr) != NULL) {
+        int num = write ? instr_num_dsts(&instr) : instr_num_srcs(&instr);
+        for (int i = 0; i < num; i++) {
+            opnd_t ref = write ? instr_get_dst(&instr, i) : instr_get_src(&instr, i);
+            addr_t addrs[MAX_VECTOR_MEMREF_ELEMENTS];
+            ushort elem_size;
+            int count = instru_t::vector_memref_count(&instr, ref, &elem_size);
+            if (count > 0 && instru_t::vector_memref_addrs(&instr, ref, &mc, addrs)) {
+                buf_ptr += instru->append_vector_memref(buf_ptr, pc, write != 0,
+                                                        elem_size, addrs, count);
+                BUF_PTR(data->seg_base) = buf_ptr;
+                break;
+            }
+        }
+    }
+    instr_free(drcontext, &instr);
+}
+
+/* Gather and masked vector operands can't be computed by drutil, so rather than
+ * inline code we compute each element's address in a clean call.
+ */
+static int
+instrument_vector_memref(void *drcontext, instrlist_t *ilist, instr_t *where,
+                         reg_id_t reg_ptr, int adjust, instr_t *app, opnd_t ref,
+                         bool write)
+{
+    // The clean call appends at the current buffer position.
+    if (adjust != 0)
+        insert_update_buf_ptr(drcontext, ilist, where, reg_ptr, DR_PRED_NONE, adjust);
+    // The clean call reads the address registers from the mcontext, so they must
+    // hold their app values, including reg_ptr if it is one of them.
+    drreg_status_t res = drreg_restore_app_values(drcontext, ilist, where, ref, NULL);
+    if (res != DRREG_SUCCESS && res != DRREG_ERROR_NO_APP_VALUE)
+        FATAL("Fatal error: failed to restore app values for vector memref\n");
+    dr_insert_clean_call(drcontext, ilist, where, (void *)vector_memref_clean_call,
+                         false, 2, OPND_CREATE_INTPTR(instr_get_app_pc(app)),
+                         OPND_CREATE_INT32(write ? 1 : 0));
+    insert_load_buf_ptr(drcontext, ilist, where, reg_ptr);
+    return 0;
+}
+
+/* repstr_range_clean_call writes one ranged entry per memory operand of a rep
+ * string loop left unexpanded by -repstr_ranges, whose extent depends on xcx
+ * and the direction flag.
+ */
+static void
+repstr_range_clean_call(app_pc pc)
+{
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    byte *buf_ptr = BUF_PTR(data->seg_base);
+    if (buf_ptr == NULL)
+        return;
+    dr_mcontext_t mc;
+    mc.size = sizeof(mc);
+    mc.flags = (dr_mcontext_flags_t)(DR_MC_INTEGER | DR_MC_CONTROL);
+    if (!dr_get_mcontext(drcontext, &mc))
+        return;
+    instr_t instr;
+    instr_init(drcontext, &instr);
+    if (decode(drcontext, pc, &instr) != NULL) {
+        // We match the operand order of the post-processor's instr summary.
+        for (int write = 0; write < 2; write++) {
+            int num = write ? instr_num_dsts(&instr) : instr_num_srcs(&instr);
+            for (int i = 0; i < num; i++) {
+                opnd_t ref = write ? instr_get_dst(&instr, i) : instr_get_src(&instr, i);
+                app_pc start;
+                size_t size;
+                bool backward;
+                if (!opnd_is_memory_reference(ref) ||
+                    !drutil_rep_string_mem_range(&instr, ref, &mc, &start, &size,
+                                                 &backward) ||
+                    size == 0) // As for a 0-iter loop, there is no memref.
+                    continue;
+                buf_ptr += instru->append_memref_range
+                    (buf_ptr, write != 0,
+                     (ushort) drutil_opnd_mem_size_in_bytes(ref, &instr),
+                     (addr_t) start, size, backward);
+            }
+        }
+        BUF_PTR(data->seg_base) = buf_ptr;
+    }
+    instr_free(drcontext, &instr);
+}
+
+/* Rather than expanding a rep movs, stos, or lods into a loop, for -repstr_ranges
+ * we compute the range of each of its operands once in a clean call.
+ */
+static int
+instrument_repstr_range(void *drcontext, instrlist_t *ilist, instr_t *where,
+                        reg_id_t reg_ptr, int adjust, instr_t *app)
+{
+    // The clean call appends at the current buffer position.
+    if (adjust != 0)
+        insert_update_buf_ptr(drcontext, ilist, where, reg_ptr, DR_PRED_NONE, adjust);
+    // The clean call reads xsi, xdi, and xcx from the mcontext, so they must
+    // hold their app values, including reg_ptr which is xcx.
+    for (int i = 0; i < instr_num_srcs(app); i++) {
+        drreg_status_t res =
+            drreg_restore_app_values(drcontext, ilist, where, instr_get_src(app, i), NULL);
+        if (res != DRREG_SUCCESS && res != DRREG_ERROR_NO_APP_VALUE)
+            FATAL("Fatal error: failed to restore app values for rep string\n");
+    }
+    dr_insert_clean_call(drcontext, ilist, where, (void *)repstr_range_clean_call,
+                         false, 1, OPND_CREATE_INTPTR(instr_get_app_pc(app)));
+    insert_load_buf_ptr(drcontext, ilist, where, reg_ptr);
+    return 0;
+}
+
+/* Returns whether bb holds a string loop and all such loops can be traced as
+ * ranges, in which case -repstr_ranges leaves bb unexpanded.
+ */
+static bool
+bb_has_only_ranged_repstr(instrlist_t *bb)
+{
+    bool found = false;
+    for (instr_t *inst = instrlist_first_app(bb); inst != NULL;
+         inst = instr_get_next_app(inst)) {
+        if (instr_is_rep_string_op(inst)) {
+            if (!drutil_rep_string_has_mem_range(inst))
+                return false;
+            found = true;
+        }
+    }
+    return found;
+}
+#endif
+
 static int
 instrument_memref(void *drcontext, user_data_t *ud, instrlist_t *ilist, instr_t *where,
                   reg_id_t reg_ptr, int adjust,
                   instr_t *app, opnd_t ref, bool write, dr_pred_type_t pred)
 {
+#ifdef X86
+    // These bypass the filter: each element is written out unfiltered.
+    ushort elem_size;
+    if (instru_t::vector_memref_count(app, ref, &elem_size) > 0) {
+        return instrument_vector_memref(drcontext, ilist, where, reg_ptr, adjust,
+                                        app, ref, write);
+    }
+    // One clean call covers all of a ranged loop's operands, so we insert it
+    // for the first one, which our caller visits first.
+    if (ud->repstr_ranges && drutil_rep_string_has_mem_range(app)) {
+        bool first = true;
+        for (int i = 0; i < instr_num_srcs(app); i++) {
+            if (opnd_is_memory_reference(instr_get_src(app, i))) {
+                first = opnd_same(ref, instr_get_src(app, i)) && !write;
+                break;
+            }
+        }
+        if (!first)
+            return adjust;
+        return instrument_repstr_range(drcontext, ilist, where, reg_ptr, adjust, app);
+    }
+#endif
     instr_t *skip = INSTR_CREATE_label(drcontext);
     reg_id_t reg_third = DR_REG_NULL;
     if (op_L0_filter.get_value()) {
@@ -973,7 +2205,8 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
     // However there is no way to completely avoid the instrumentation in between,
     // so we reduce the instrumentation in between by moving strex instru
     // from before the strex to after the strex.
-    if (ud->strex == NULL && instr_is_exclusive_store(instr)) {
+    // With only a pc entry per bb there is no strex instru to move.
+    if (ud->strex == NULL && !instrs_only() && instr_is_exclusive_store(instr)) {
         opnd_t dst = instr_get_dst(instr, 0);
         DR_ASSERT(opnd_is_base_disp(dst));
         // Assuming there are no consecutive strex instructions, otherwise we
@@ -988,8 +2221,9 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
 
     // Optimization: delay the simple instr trace instrumentation if possible.
     // For offline traces we want a single instr entry for the start of the bb.
+    // Without data refs, every instr but the first is delayed.
     if ((!op_offline.get_value() || !drmgr_is_first_instr(drcontext, instr)) &&
-        !(instr_reads_memory(instr) ||instr_writes_memory(instr)) &&
+        (instrs_only() || !(instr_reads_memory(instr) ||instr_writes_memory(instr))) &&
         // Avoid dropping trailing instrs
         !drmgr_is_last_instr(drcontext, instr) &&
         // Avoid bundling instrs whose types we separate.
@@ -1033,8 +2267,14 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
     reg_id_t reg_skip = DR_REG_NULL;
     reg_id_t reg_barrier = DR_REG_NULL;
     if (!op_L0_filter.get_value()) {
-        insert_load_buf_ptr(drcontext, bb, instr, reg_ptr);
-        if (thread_filtering_enabled) {
+#ifdef X86
+        if (op_persistent_instru.get_value())
+            insert_load_gated_buf_ptr(drcontext, bb, instr, reg_ptr,
+                                      drmgr_is_first_instr(drcontext, instr));
+        else
+#endif
+            insert_load_buf_ptr(drcontext, bb, instr, reg_ptr);
+        if (thread_filtering_enabled || op_persistent_instru.get_value()) {
             bool short_reaches = false;
 #ifdef X86
             if (ud->num_delay_instrs == 0 && !drmgr_is_last_instr(drcontext, instr)) {
@@ -1073,7 +2313,8 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
      * trace_entry_t than require a separate instr entry for every memref
      * instr (if average # of memrefs per instr is < 2, PC field is better).
      */
-    is_memref = instr_reads_memory(instr) || instr_writes_memory(instr);
+    is_memref = !instrs_only() &&
+        (instr_reads_memory(instr) || instr_writes_memory(instr));
     // See comment in instrument_delay_instrs: we only want the original string
     // ifetch and not any of the expansion instrs.  We instrument the first
     // one to handle a zero-iter loop.  For offline, we just record the pc; for
@@ -1143,7 +2384,25 @@ event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
     data->strex = NULL;
     data->num_delay_instrs = 0;
     data->instru_field = NULL;
+    data->repstr_ranges = false;
     *user_data = (void *)data;
+    // There is no need to expose the iterations of a string loop when we do not
+    // trace its data refs: post-processing supplies one fetch per execution.
+    if (instrs_only()) {
+        data->repstr = false;
+        return DR_EMIT_DEFAULT;
+    }
+#ifdef X86
+    // The clean call for a range bypasses the filter, whose trace format
+    // expects a single pc entry per instr.  A range can also span pages, which
+    // one physical address cannot express.
+    if (op_repstr_ranges.get_value() && !op_L0_filter.get_value() && !have_phys &&
+        bb_has_only_ranged_repstr(bb)) {
+        data->repstr = false;
+        data->repstr_ranges = true;
+        return DR_EMIT_DEFAULT;
+    }
+#endif
     if (!drutil_expand_rep_string_ex(drcontext, bb, &data->repstr, NULL)) {
         DR_ASSERT(false);
         /* in release build, carry on: we'll just miss per-iter refs */
@@ -1188,8 +2447,35 @@ event_pre_syscall(void *drcontext, int sysnum)
 #endif
     if (file_ops_func.handoff_buf == NULL)
         memtrace(drcontext, false);
+#ifdef LINUX
+    if (data->writer != NULL && is_async_barrier_syscall(drcontext, sysnum))
+        async_wait(drcontext, NULL);
+#endif
+    return true;
+}
+
+#ifdef LINUX
+/* Unlike event_pre_syscall, this remains registered while tracing is delayed. */
+static bool
+event_physaddr_pre_syscall(void *drcontext, int sysnum)
+{
+    // Drop cached translations for pages that are about to be unmapped or moved,
+    // or whose frames madvise may discard.
+    switch (sysnum) {
+    case SYS_munmap:
+    case SYS_mremap:
+    case SYS_madvise:
+        physaddr.invalidate((addr_t)dr_syscall_get_param(drcontext, 0),
+                            (size_t)dr_syscall_get_param(drcontext, 1));
+        // Every thread must record its pages anew, as we don't track which pages
+        // each has recorded.
+        if (phys_offline())
+            dr_atomic_add32_return_sum(&phys_generation, 1);
+        break;
+    }
     return true;
 }
+#endif
 
 static void
 event_kernel_xfer(void *drcontext, const dr_kernel_xfer_info_t *info)
@@ -1198,6 +2484,8 @@ event_kernel_xfer(void *drcontext, const dr_kernel_xfer_info_t *info)
     trace_marker_type_t marker_type;
     if (BUF_PTR(data->seg_base) == NULL)
         return; /* This thread was filtered out. */
+    if (tracing_gate_closed())
+        return;
     switch (info->type) {
     case DR_XFER_APC_DISPATCHER:
         /* Do not bother with a marker for the thread init routine. */
@@ -1234,6 +2522,8 @@ event_kernel_xfer(void *drcontext, const dr_kernel_xfer_info_t *info)
 static uint64 instr_count;
 static volatile bool tracing_enabled;
 static void *enable_tracing_lock;
+/* How many instructions to count before (re-)enabling tracing: zero if never. */
+static uint64 delay_threshold;
 
 #ifdef X86_64
 # define DELAYED_CHECK_INLINED 1
@@ -1250,18 +2540,25 @@ event_delay_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t
                             bool for_trace, bool translating, void *user_data);
 
 static void
-enable_delay_instrumentation()
+init_delay_instrumentation()
 {
 #ifdef DELAYED_CHECK_INLINED
     drx_init();
 #endif
+    enable_tracing_lock = dr_mutex_create();
+    delay_threshold = op_trace_after_instrs.get_value();
+}
+
+static void
+enable_delay_instrumentation()
+{
     /* We first have a phase where we count instructions.  Only then do we switch
-     * to tracing instrumentation.
+     * to tracing instrumentation.  With -trace_for_instrs we come back here
+     * between tracing windows.
      */
     if (!drmgr_register_bb_instrumentation_event(event_delay_bb_analysis,
                                                  event_delay_app_instruction, NULL))
         DR_ASSERT(false);
-    enable_tracing_lock = dr_mutex_create();
 }
 
 static void
@@ -1296,27 +2593,139 @@ enable_tracing_instrumentation()
 }
 
 static void
-hit_instr_count_threshold()
+disable_tracing_instrumentation()
+{
+    if (!drmgr_unregister_pre_syscall_event(event_pre_syscall) ||
+        !drmgr_unregister_kernel_xfer_event(event_kernel_xfer) ||
+        !drmgr_unregister_bb_instrumentation_ex_event(event_bb_app2app,
+                                                      event_bb_analysis,
+                                                      event_app_instruction,
+                                                      event_bb_instru2instru))
+        DR_ASSERT(false);
+    tracing_enabled = false;
+}
+
+static void
+resume_tracing(const char *reason)
 {
     bool do_flush = false;
     dr_mutex_lock(enable_tracing_lock);
     if (!tracing_enabled) { // Already came here?
-        NOTIFY(0, "Hit delay threshold: enabling tracing.\n");
+        NOTIFY(0, "%s: enabling tracing.\n", reason);
         disable_delay_instrumentation();
-        enable_tracing_instrumentation();
+        // Every window but the first follows a suspension.
+        if (delay_phase > 0)
+            tracing_window++;
+        window_instr_count_racy = 0;
+        if (op_persistent_instru.get_value()) {
+            // The instrumentation is still in place: we need only open the gate.
+            set_tracing_gate(true);
+            tracing_enabled = true;
+        } else {
+            enable_tracing_instrumentation();
+            do_flush = true;
+        }
+    }
+    dr_mutex_unlock(enable_tracing_lock);
+    if (do_flush && !dr_unlink_flush_region(NULL, ~0UL))
+        DR_ASSERT(false);
+}
+
+static void
+suspend_tracing(const char *reason)
+{
+    bool do_flush = false;
+    bool do_write = false;
+    dr_mutex_lock(enable_tracing_lock);
+    if (tracing_enabled && op_persistent_instru.get_value()) {
+        NOTIFY(0, "%s: disabling tracing.\n", reason);
+        // Blocks entered from now on skip their instrumentation.  Other threads
+        // write out what they recorded in this window at their next buffer flush.
+        set_tracing_gate(false);
+        tracing_enabled = false;
+        delay_phase++;
+        do_write = true;
+    } else if (tracing_enabled) { // Already came here?
+        NOTIFY(0, "%s: disabling tracing.\n", reason);
+        disable_tracing_instrumentation();
+        instr_count = 0;
+        delay_threshold = op_retrace_every_instrs.get_value();
+        delay_phase++;
+        enable_delay_instrumentation();
         do_flush = true;
     }
     dr_mutex_unlock(enable_tracing_lock);
+    if (do_write) {
+        void *drcontext = dr_get_current_drcontext();
+        per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+        if (BUF_PTR(data->seg_base) != NULL)
+            memtrace(drcontext, false);
+    }
     if (do_flush && !dr_unlink_flush_region(NULL, ~0UL))
         DR_ASSERT(false);
 }
 
+static void
+hit_instr_count_threshold()
+{
+    resume_tracing("Hit delay threshold");
+}
+
+/* Called once -trace_for_instrs instructions have been traced in this window. */
+static void
+hit_trace_window_end()
+{
+    suspend_tracing("Hit trace window end");
+}
+
+#ifdef HAS_ANNOTATIONS
+/* For -trace_annotations.  The flush in resume_tracing() and suspend_tracing() is
+ * safe from an annotation's clean call just as from our own.  Tracing applies to
+ * all code, so there is no subset of fragments we could flush instead.
+ */
+static void
+annotation_start_tracing()
+{
+    resume_tracing("Hit start tracing annotation");
+}
+
+static void
+annotation_stop_tracing()
+{
+    suspend_tracing("Hit stop tracing annotation");
+}
+#endif
+
+/* Other threads' buffers may still hold entries from the window that just ended.
+ * Each thread writes them out the first time it runs in a new untraced phase,
+ * so they are not mistaken for entries in the next window.
+ */
+static void
+flush_prior_window()
+{
+    void *drcontext = dr_get_current_drcontext();
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    if (BUF_PTR(data->seg_base) != NULL) // Else this thread was filtered out.
+        memtrace(drcontext, false);
+    *(ptr_uint_t *)TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_DELAY_PHASE) =
+        delay_phase;
+}
+
 #ifndef DELAYED_CHECK_INLINED
 static void
 check_instr_count_threshold(uint incby)
 {
+    if (has_tracing_windows()) {
+        per_thread_t *data = (per_thread_t *)
+            drmgr_get_tls_field(dr_get_current_drcontext(), tls_idx);
+        if (*(ptr_uint_t *)TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_DELAY_PHASE) !=
+            delay_phase)
+            flush_prior_window();
+    }
+    if (delay_threshold == 0)
+        return;
     instr_count += incby;
-    if (instr_count > op_trace_after_instrs.get_value())
+    if (instr_count > delay_threshold)
         hit_instr_count_threshold();
 }
 #endif
@@ -1347,21 +2756,43 @@ event_delay_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t
     drmgr_disable_auto_predication(drcontext, bb);
 #ifdef DELAYED_CHECK_INLINED
 # ifdef X86_64
+    if (has_tracing_windows()) {
+        // Code built in this phase compares against this phase's value.
+        instr_t *skip_flush = INSTR_CREATE_label(drcontext);
+        if (drreg_reserve_aflags(drcontext, bb, instr) != DRREG_SUCCESS)
+            FATAL("Fatal error: failed to reserve aflags");
+        MINSERT(bb, instr,
+                XINST_CREATE_cmp
+                (drcontext, opnd_create_far_base_disp
+                 (tls_seg, DR_REG_NULL, DR_REG_NULL, 0,
+                  tls_offs + sizeof(void*)*MEMTRACE_TLS_OFFS_DELAY_PHASE, OPSZ_PTR),
+                 OPND_CREATE_INT32(delay_phase)));
+        MINSERT(bb, instr,
+                INSTR_CREATE_jcc(drcontext, OP_je, opnd_create_instr(skip_flush)));
+        dr_insert_clean_call(drcontext, bb, instr,
+                             (void *)flush_prior_window, false/*fpstate */, 0);
+        MINSERT(bb, instr, skip_flush);
+        if (drreg_unreserve_aflags(drcontext, bb, instr) != DRREG_SUCCESS)
+            DR_ASSERT(false);
+    }
+    // A zero threshold means tracing is never resumed, so there is nothing to count.
+    if (delay_threshold == 0)
+        return DR_EMIT_DEFAULT;
     if (!drx_insert_counter_update(drcontext, bb, instr,
                                    (dr_spill_slot_t)(SPILL_SLOT_MAX+1)/*use drmgr*/,
                                    &instr_count, num_instrs, DRX_COUNTER_64BIT))
         DR_ASSERT(false);
     instr_t *skip_call = INSTR_CREATE_label(drcontext);
     reg_id_t scratch = DR_REG_NULL;
-    if (op_trace_after_instrs.get_value() < INT_MAX) {
+    if (delay_threshold < INT_MAX) {
         MINSERT(bb, instr,
                 XINST_CREATE_cmp
                 (drcontext,  OPND_CREATE_ABSMEM(&instr_count, OPSZ_8),
-                 OPND_CREATE_INT32(op_trace_after_instrs.get_value())));
+                 OPND_CREATE_INT32(delay_threshold)));
     } else {
         if (drreg_reserve_register(drcontext, bb, instr, NULL, &scratch) != DRREG_SUCCESS)
             FATAL("Fatal error: failed to reserve scratch register");
-        instrlist_insert_mov_immed_ptrsz(drcontext, op_trace_after_instrs.get_value(),
+        instrlist_insert_mov_immed_ptrsz(drcontext, delay_threshold,
                                          opnd_create_reg(scratch), bb, instr, NULL, NULL);
         MINSERT(bb, instr,
                 XINST_CREATE_cmp
@@ -1390,6 +2821,242 @@ event_delay_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t
     return DR_EMIT_DEFAULT;
 }
 
+/***************************************************************************
+ * Function tracing for -record_function.
+ */
+
+static std::vector<record_function_t> *record_funcs;
+
+static void
+append_func_marker(per_thread_t *data, trace_marker_type_t type, uintptr_t val)
+{
+    // Offline markers hold fewer bits than a pointer.
+    if (op_offline.get_value())
+        val &= (1ULL << EXT_VALUE_A_BITS) - 1;
+    BUF_PTR(data->seg_base) += instru->append_marker(BUF_PTR(data->seg_base), type, val);
+}
+
+// Appends -L0_counts markers for the filter cache lines with non-zero counts,
+// starting at data->l0_count_pos, and resets those counts.  If the buffer fills
+// first, returns false, leaving l0_count_pos where to resume.
+static bool
+append_filter_counts(per_thread_t *data)
+{
+    size_t slot_size = l0_slot_size();
+    size_t num_islots =
+        data->l0_icache == NULL ? 0 : l0_cache_alloc_size(true) / slot_size;
+    size_t num_dslots =
+        data->l0_dcache == NULL ? 0 : l0_cache_alloc_size(false) / slot_size;
+    int iline_bits = compute_log2(l0_line_size(true));
+    int dline_bits = compute_log2(l0_line_size(false));
+    for (; data->l0_count_pos < num_islots + num_dslots; data->l0_count_pos++) {
+        bool is_icache = data->l0_count_pos < num_islots;
+        ptr_uint_t *way = (ptr_uint_t *)
+            (is_icache ? data->l0_icache + data->l0_count_pos * slot_size :
+             data->l0_dcache + (data->l0_count_pos - num_islots) * slot_size);
+        if (way[1] == 0)
+            continue;
+        if (BUF_PTR(data->seg_base) + 2 * instru->sizeof_entry() >
+            data->buf_base + data->buf_size)
+            return false;
+        append_func_marker(data, is_icache ? TRACE_MARKER_TYPE_FILTER_ILINE :
+                           TRACE_MARKER_TYPE_FILTER_DLINE,
+                           way[0] << (is_icache ? iline_bits : dline_bits));
+        append_func_marker(data, TRACE_MARKER_TYPE_FILTER_COUNT, way[1]);
+        way[1] = 0;
+    }
+    data->l0_count_pos = 0;
+    return true;
+}
+
+static per_thread_t *
+get_func_trace_data(void *drcontext)
+{
+    if (!tracing_enabled)
+        return NULL;
+    per_thread_t *data = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
+    if (data == NULL || BUF_PTR(data->seg_base) == NULL)
+        return NULL; /* This thread was filtered out. */
+    return data;
+}
+
+static void
+flush_func_markers(void *drcontext, per_thread_t *data)
+{
+    // The redzone has ample room for a call's markers, so we only write out the
+    // buffer once it is as full as the instrumentation would let it get.
+    if (BUF_PTR(data->seg_base) - data->buf_base > (ptrdiff_t)data->buf_size)
+        memtrace(drcontext, false);
+}
+
+static void
+func_pre_hook(void *wrapcxt, INOUT void **user_data)
+{
+    void *drcontext = drwrap_get_drcontext(wrapcxt);
+    per_thread_t *data = get_func_trace_data(drcontext);
+    if (data == NULL)
+        return;
+    uintptr_t id = (uintptr_t)*user_data;
+    append_func_marker(data, TRACE_MARKER_TYPE_FUNC_ID, id);
+    append_func_marker(data, TRACE_MARKER_TYPE_FUNC_RETADDR,
+                       (uintptr_t)drwrap_get_retaddr(wrapcxt));
+    for (int i = 0; i < (*record_funcs)[id].num_args; i++) {
+        append_func_marker(data, TRACE_MARKER_TYPE_FUNC_ARG,
+                           (uintptr_t)drwrap_get_arg(wrapcxt, i));
+    }
+    flush_func_markers(drcontext, data);
+}
+
+static void
+func_post_hook(void *wrapcxt, void *user_data)
+{
+    // A NULL wrapcxt means the function is being unwound past by an exception
+    // or longjmp.  We still mark its exit to keep tools' call stacks balanced.
+    void *drcontext = wrapcxt == NULL ? dr_get_current_drcontext() :
+        drwrap_get_drcontext(wrapcxt);
+    per_thread_t *data = get_func_trace_data(drcontext);
+    if (data == NULL)
+        return;
+    append_func_marker(data, TRACE_MARKER_TYPE_FUNC_ID, (uintptr_t)user_data);
+    append_func_marker(data, TRACE_MARKER_TYPE_FUNC_RETVAL,
+                       wrapcxt == NULL ? 0 : (uintptr_t)drwrap_get_retval(wrapcxt));
+    flush_func_markers(drcontext, data);
+}
+
+static void
+event_func_module_load(void *drcontext, const module_data_t *mod, bool loaded)
+{
+    for (size_t id = 0; id < record_funcs->size(); id++) {
+        const char *name = (*record_funcs)[id].name.c_str();
+        app_pc func = (app_pc)dr_get_proc_address(mod->handle, name);
+        size_t modoffs;
+        if (func == NULL && mod->full_path != NULL &&
+            drsym_lookup_symbol(mod->full_path, name, &modoffs, DRSYM_DEMANGLE) ==
+            DRSYM_SUCCESS)
+            func = mod->start + modoffs;
+        if (func == NULL)
+            continue;
+        // This fails harmlessly if an alias already wrapped func.
+        if (drwrap_wrap_ex(func, func_pre_hook, func_post_hook, (void *)id, 0)) {
+            NOTIFY(1, "Recording function %s at " PFX " in %s\n", name, func,
+                   mod->full_path == NULL ? "" : mod->full_path);
+        }
+    }
+}
+
+static void
+init_func_tracing()
+{
+    record_funcs = new std::vector<record_function_t>;
+    if (!parse_record_function_list(op_record_function.get_value(), record_funcs)) {
+        FATAL("Usage error: -record_function must be a list of name|num_args entries "
+              "separated by &, with at most %d arguments each.\n",
+              RECORD_FUNCTION_MAX_ARGS);
+    }
+    if (!drwrap_init() || drsym_init(0) != DRSYM_SUCCESS ||
+        !drmgr_register_module_load_event(event_func_module_load))
+        DR_ASSERT(false);
+}
+
+static void
+exit_func_tracing()
+{
+    if (record_funcs == NULL)
+        return;
+    if (!drmgr_unregister_module_load_event(event_func_module_load) ||
+        drsym_exit() != DRSYM_SUCCESS)
+        DR_ASSERT(false);
+    drwrap_exit();
+    delete record_funcs;
+    record_funcs = NULL;
+}
+
+/***************************************************************************
+ * Publishing finished thread files for -offline_stream.
+ */
+
+/* The module loads seen so far, and how many of them the last module list
+ * snapshot covers.  The latter is protected by mutex.
+ */
+static volatile int stream_module_loads;
+static int stream_snapshot_loads = -1;
+
+static void
+event_stream_module_load(void *drcontext, const module_data_t *mod, bool loaded)
+{
+    /* We registered after drmodtrack, so the module is already in its list. */
+    dr_atomic_add32_return_sum(&stream_module_loads, 1);
+}
+
+/* Refreshes the module list snapshot if any module was loaded since the last one,
+ * replacing it atomically so that raw2trace never reads a partial list.
+ */
+static void
+stream_write_module_snapshot()
+{
+    char path[MAXIMUM_PATH], tmp_path[MAXIMUM_PATH];
+    dr_mutex_lock(mutex);
+    /* Every load counted here is already in the list we dump. */
+    int loads = stream_module_loads;
+    if (loads != stream_snapshot_loads) {
+        dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s%s%s", logsubdir, DIRSEP,
+                    STREAM_MODULE_LIST_FILENAME);
+        NULL_TERMINATE_BUFFER(path);
+        dr_snprintf(tmp_path, BUFFER_SIZE_ELEMENTS(tmp_path), "%s.tmp", path);
+        NULL_TERMINATE_BUFFER(tmp_path);
+        file_t file = dr_open_file(tmp_path, DR_FILE_WRITE_OVERWRITE);
+        if (file == INVALID_FILE)
+            FATAL("Fatal error: failed to create module list snapshot %s\n", tmp_path);
+        if (!((offline_instru_t *)instru)->write_module_list(file))
+            FATAL("Fatal error: failed to write module list snapshot %s\n", tmp_path);
+        dr_close_file(file);
+        if (!dr_rename_file(tmp_path, path, true))
+            FATAL("Fatal error: failed to rename %s to %s\n", tmp_path, path);
+        stream_snapshot_loads = loads;
+    }
+    dr_mutex_unlock(mutex);
+}
+
+/* Gives a closed thread file its final name, which tells raw2trace -follow that
+ * it is complete.
+ */
+static void
+stream_publish_thread_file(per_thread_t *data)
+{
+    char path[MAXIMUM_PATH];
+    stream_write_module_snapshot();
+    dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s", data->stream_path);
+    NULL_TERMINATE_BUFFER(path);
+    /* Strip the ".part" suffix. */
+    size_t len = strlen(path) - strlen("." OUTFILE_SUFFIX_PARTIAL);
+    DR_ASSERT(strcmp(path + len, "." OUTFILE_SUFFIX_PARTIAL) == 0);
+    path[len] = '\0';
+    if (!dr_rename_file(data->stream_path, path, false))
+        FATAL("Fatal error: failed to rename %s to %s\n", data->stream_path, path);
+    NOTIFY(2, "Published thread trace file %s\n", path);
+}
+
+/* Creates the file telling raw2trace -follow that modules.log is final and no
+ * more thread files will be published.
+ */
+static void
+stream_exit()
+{
+    char path[MAXIMUM_PATH];
+    dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s%s%s", logsubdir, DIRSEP,
+                STREAM_DONE_FILENAME);
+    NULL_TERMINATE_BUFFER(path);
+    file_t file = dr_open_file(path, DR_FILE_WRITE_OVERWRITE);
+    if (file == INVALID_FILE)
+        NOTIFY(0, "Failed to create %s\n", path);
+    else
+        dr_close_file(file);
+    if (!drmgr_unregister_module_load_event(event_stream_module_load))
+        DR_ASSERT(false);
+    stream_module_loads = 0;
+    stream_snapshot_loads = -1;
+}
+
 /***************************************************************************
  * Top level.
  */
@@ -1416,10 +3083,17 @@ init_thread_in_process(void *drcontext)
          * file name for creation.  Retry if the same name file already exists.
          * Abort if we fail too many times.
          */
+        const char *suffix = op_raw_compress.get_value() ?
+            OUTFILE_SUFFIX_GZ : OUTFILE_SUFFIX;
+        if (op_offline_stream.get_value()) {
+            suffix = op_raw_compress.get_value() ?
+                OUTFILE_SUFFIX_GZ "." OUTFILE_SUFFIX_PARTIAL :
+                OUTFILE_SUFFIX "." OUTFILE_SUFFIX_PARTIAL;
+        }
         for (i = 0; i < NUM_OF_TRIES; i++) {
             drx_open_unique_appid_file(logsubdir,
                                        dr_get_thread_id(drcontext),
-                                       OUTFILE_PREFIX, OUTFILE_SUFFIX,
+                                       OUTFILE_PREFIX, suffix,
                                        DRX_FILE_SKIP_OPEN,
                                        buf, BUFFER_SIZE_ELEMENTS(buf));
             NULL_TERMINATE_BUFFER(buf);
@@ -1431,12 +3105,28 @@ init_thread_in_process(void *drcontext)
             FATAL("Fatal error: failed to create trace file %s\n", buf);
         }
         NOTIFY(2, "Created thread trace file %s\n", buf);
+        if (op_offline_stream.get_value()) {
+            dr_snprintf(data->stream_path, BUFFER_SIZE_ELEMENTS(data->stream_path),
+                        "%s", buf);
+            NULL_TERMINATE_BUFFER(data->stream_path);
+        }
 
         /* Write initial headers at the top of the first buffer. */
         data->init_header_size =
             instru->append_thread_header(data->buf_base, dr_get_thread_id(drcontext));
         BUF_PTR(data->seg_base) = data->buf_base + data->init_header_size +
             buf_hdr_slots_size;
+        /* Record the region bases that raw2trace's -canonical uses. */
+        if (data->stack_base != 0) {
+            BUF_PTR(data->seg_base) +=
+                instru->append_marker(BUF_PTR(data->seg_base),
+                                      TRACE_MARKER_TYPE_STACK_BASE, data->stack_base);
+        }
+#ifdef LINUX
+        BUF_PTR(data->seg_base) +=
+            instru->append_marker(BUF_PTR(data->seg_base),
+                                  TRACE_MARKER_TYPE_HEAP_BASE, heap_base);
+#endif
     } else {
         /* pass pid and tid to the simulator to register current thread */
         proc_info = (byte *)buf;
@@ -1452,15 +3142,13 @@ init_thread_in_process(void *drcontext)
     if (op_L0_filter.get_value()) {
         if (op_L0D_size.get_value() > 0) {
             data->l0_dcache = (byte *) dr_raw_mem_alloc
-                ((size_t)op_L0D_size.get_value()/op_line_size.get_value()*sizeof(void*),
-                 DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+                (l0_cache_alloc_size(false), DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
             *(byte **)TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_DCACHE) =
                 data->l0_dcache;
         }
         if (op_L0I_size.get_value() > 0) {
             data->l0_icache = (byte *) dr_raw_mem_alloc
-                ((size_t)op_L0I_size.get_value()/op_line_size.get_value()*sizeof(void*),
-                 DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+                (l0_cache_alloc_size(true), DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
             *(byte **)TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_ICACHE) =
                 data->l0_icache;
         }
@@ -1469,6 +3157,22 @@ init_thread_in_process(void *drcontext)
     // XXX i#1729: gather and store an initial callstack for the thread.
 }
 
+static addr_t
+thread_stack_base(void *drcontext)
+{
+    dr_mcontext_t mc = {sizeof(mc), DR_MC_CONTROL};
+    if (dr_get_mcontext(drcontext, &mc))
+        return (addr_t) mc.xsp;
+#ifdef LINUX
+    /* The initial thread's context is not available at its init event, but the
+     * kernel placed the environment array at a fixed offset from its stack pointer.
+     */
+    if (environ != NULL)
+        return (addr_t) environ;
+#endif
+    return 0;
+}
+
 static void
 event_thread_init(void *drcontext)
 {
@@ -1483,13 +3187,33 @@ event_thread_init(void *drcontext)
      */
     data->seg_base = (byte *) dr_get_dr_segment_base(tls_seg);
     DR_ASSERT(data->seg_base != NULL);
+    data->window = (uint)-1;
+    // There is nothing from a prior window to flush.
+    *(ptr_uint_t *)TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_DELAY_PHASE) =
+        delay_phase;
+    *(ptr_uint_t *)TLS_SLOT(data->seg_base, MEMTRACE_TLS_OFFS_BB_GATE) =
+        sizeof(void*) * MEMTRACE_TLS_OFFS_GATE_CLOSED;
 
     if (should_trace_thread_cb != NULL &&
         !(*should_trace_thread_cb)(dr_get_thread_id(drcontext),
                                    trace_thread_cb_user_data))
         BUF_PTR(data->seg_base) = NULL;
     else {
+        async_thread_init(data);
+        data->next_buf_size = trace_buf_size;
+        if (op_max_buffer_entries.get_value() > 0)
+            data->last_write_ms = dr_get_milliseconds();
         create_buffer(data);
+        if (phys_offline()) {
+            data->phys_seen = (addr_t *)
+                dr_thread_alloc(drcontext, PHYS_SEEN_ENTRIES * sizeof(addr_t));
+            memset(data->phys_seen, 0, PHYS_SEEN_ENTRIES * sizeof(addr_t));
+            data->phys_generation = phys_generation;
+            data->phys_pending = (byte *)
+                dr_thread_alloc(drcontext, PHYS_PENDING_ENTRIES * instru->sizeof_entry());
+        }
+        if (op_offline.get_value())
+            data->stack_base = thread_stack_base(drcontext);
         init_thread_in_process(drcontext);
         // XXX i#1729: gather and store an initial callstack for the thread.
     }
@@ -1502,6 +3226,17 @@ event_thread_exit(void *drcontext)
     if (BUF_PTR(data->seg_base) != NULL) {
         /* This thread was *not* filtered out. */
 
+        if (op_L0_filter.get_value() && op_L0_counts.get_value() > 0 &&
+            (op_max_trace_size.get_value() == 0 ||
+             data->bytes_written <= op_max_trace_size.get_value())) {
+            // Record the final counts, writing out the buffer each time it fills.
+            // This completes any partial recording and then records every line.
+            for (int round = data->l0_count_pos > 0 ? 0 : 1; round < 2; round++) {
+                while (!append_filter_counts(data))
+                    memtrace(drcontext, false);
+            }
+        }
+
         /* let the simulator know this thread has exited */
         if (op_max_trace_size.get_value() > 0 &&
             data->bytes_written > op_max_trace_size.get_value()) {
@@ -1512,30 +3247,38 @@ event_thread_exit(void *drcontext)
             instru->append_thread_exit(BUF_PTR(data->seg_base),
                                        dr_get_thread_id(drcontext));
 
+        // Our prior buffers must reach the file first.
+        async_thread_exit(drcontext, data);
         memtrace(drcontext, true);
 
         if (op_offline.get_value())
             file_ops_func.close_file(data->file);
+        if (data->compressor != NULL)
+            raw_compressor_destroy(data->compressor);
+        if (op_offline_stream.get_value())
+            stream_publish_thread_file(data);
 
         if (op_L0_filter.get_value()) {
             if (op_L0D_size.get_value() > 0) {
-                dr_raw_mem_free(data->l0_dcache,
-                                (size_t)op_L0D_size.get_value()/op_line_size.get_value()
-                                *sizeof(void*));
+                dr_raw_mem_free(data->l0_dcache, l0_cache_alloc_size(false));
             }
             if (op_L0I_size.get_value() > 0) {
-                dr_raw_mem_free(data->l0_icache,
-                                (size_t)op_L0I_size.get_value()/op_line_size.get_value()
-                                *sizeof(void*));
+                dr_raw_mem_free(data->l0_icache, l0_cache_alloc_size(true));
             }
         }
 
         dr_mutex_lock(mutex);
         num_refs += data->num_refs;
         dr_mutex_unlock(mutex);
-        dr_raw_mem_free(data->buf_base, max_buf_size);
+        dr_raw_mem_free(data->buf_base, buf_alloc_size(data->buf_size));
         if (data->reserve_buf != NULL)
-            dr_raw_mem_free(data->reserve_buf, max_buf_size);
+            dr_raw_mem_free(data->reserve_buf, buf_alloc_size(trace_buf_size));
+        set_next_buf_size(data, trace_buf_size);
+        if (data->phys_seen != NULL) {
+            dr_thread_free(drcontext, data->phys_seen, PHYS_SEEN_ENTRIES * sizeof(addr_t));
+            dr_thread_free(drcontext, data->phys_pending,
+                           PHYS_PENDING_ENTRIES * instru->sizeof_entry());
+        }
     }
     dr_thread_free(drcontext, data, sizeof(per_thread_t));
 }
@@ -1551,10 +3294,17 @@ event_exit(void)
     instru->~instru_t();
     dr_global_free(instru, MAX_INSTRU_SIZE);
 
-    if (op_offline.get_value())
+    if (op_offline.get_value()) {
+        async_exit();
         file_ops_func.close_file(module_file);
-    else
-        ipc_pipe.close();
+        if (op_offline_stream.get_value())
+            stream_exit();
+#ifdef UNIX
+        if (!op_stream_to.get_value().empty())
+            remote_exit();
+#endif
+    } else
+        ipc_close();
 
     if (file_ops_func.exit_cb != NULL)
         (*file_ops_func.exit_cb)(file_ops_func.exit_arg);
@@ -1564,17 +3314,24 @@ event_exit(void)
 
     drvector_delete(&scratch_reserve_vec);
 
-    if (tracing_enabled) {
-        if (!drmgr_unregister_pre_syscall_event(event_pre_syscall) ||
-            !drmgr_unregister_kernel_xfer_event(event_kernel_xfer) ||
-            !drmgr_unregister_bb_instrumentation_ex_event(event_bb_app2app,
-                                                          event_bb_analysis,
-                                                          event_app_instruction,
-                                                          event_bb_instru2instru))
+#ifdef HAS_ANNOTATIONS
+    if (op_trace_annotations.get_value()) {
+        if (!dr_annotation_unregister_call("drmemtrace_annotate_start_tracing",
+                                           (void *)annotation_start_tracing) ||
+            !dr_annotation_unregister_call("drmemtrace_annotate_stop_tracing",
+                                           (void *)annotation_stop_tracing))
             DR_ASSERT(false);
-    } else {
-        disable_delay_instrumentation();
     }
+#endif
+    if (tracing_enabled || op_persistent_instru.get_value())
+        disable_tracing_instrumentation();
+    else
+        disable_delay_instrumentation();
+    exit_func_tracing();
+#ifdef LINUX
+    if (have_phys && !drmgr_unregister_pre_syscall_event(event_physaddr_pre_syscall))
+        DR_ASSERT(false);
+#endif
     if (!drmgr_unregister_tls_field(tls_idx) ||
         !drmgr_unregister_thread_init_event(event_thread_init) ||
         !drmgr_unregister_thread_exit_event(event_thread_exit) ||
@@ -1592,7 +3349,7 @@ event_exit(void)
 
     dr_mutex_destroy(mutex);
     drutil_exit();
-    if (op_trace_after_instrs.get_value() > 0)
+    if (op_trace_after_instrs.get_value() > 0 || has_tracing_windows())
         exit_delay_instrumentation();
     drmgr_exit();
 }
@@ -1658,11 +3415,40 @@ fork_init(void *drcontext)
      * initial header in memtrace() for offline).
      */
     data->num_refs = 0;
+    /* The other threads' buffers are gone. */
+    buffer_growth = data->next_buf_size - trace_buf_size;
     if (op_offline.get_value()) {
+        if (!op_stream_to.get_value().empty())
+            remote_fork_init();
         if (!init_offline_dir()) {
             FATAL("Failed to create a subdir in %s\n", op_outdir.get_value().c_str());
         }
+        /* Our writer threads do not exist in the child, but we waited for them
+         * to finish before the fork so we can simply start over.
+         */
+        async_exit();
+        async_init();
+        /* The child's new subdir needs its own module list snapshot. */
+        stream_snapshot_loads = -1;
+        data->writer = NULL;
+        data->num_queued = 0;
+        data->num_finished = 0;
+        async_thread_init(data);
+    }
+#ifdef LINUX
+    else if (op_ipc_ring.get_value()) {
+        /* The child inherits our mapping but must register as a separate
+         * writer so the reader waits for both processes to exit.
+         */
+        if (!ipc_ring.attach(ipc_ring_base, ipc_ring_size))
+            FATAL("Fatal error: Failed to attach to ring in child process\n");
     }
+#endif
+    /* The inherited pagemap, translations, and recorded mappings are our parent's. */
+    if (have_phys && !physaddr.init())
+        NOTIFY(0, "Unable to open pagemap: using virtual addresses.\n");
+    if (phys_offline())
+        dr_atomic_add32_return_sum(&phys_generation, 1);
     init_thread_in_process(drcontext);
 }
 #endif
@@ -1701,6 +3487,91 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
           op_L0D_size.get_value() != 0))) {
         FATAL("Usage error: L0I_size and L0D_size must be 0 or powers of 2.");
     }
+    if (op_L0_filter.get_value() &&
+        ((op_L0I_assoc.get_value() != 1 && op_L0I_assoc.get_value() != 2) ||
+         (op_L0D_assoc.get_value() != 1 && op_L0D_assoc.get_value() != 2) ||
+         !IS_POWER_OF_2(l0_line_size(true)) || !IS_POWER_OF_2(l0_line_size(false)) ||
+         (op_L0I_size.get_value() != 0 &&
+          op_L0I_size.get_value() < l0_line_size(true) * op_L0I_assoc.get_value()) ||
+         (op_L0D_size.get_value() != 0 &&
+          op_L0D_size.get_value() < l0_line_size(false) * op_L0D_assoc.get_value()))) {
+        FATAL("Usage error: L0I_assoc and L0D_assoc must be 1 or 2, the L0 line sizes "
+              "must be powers of 2, and each L0 cache must hold at least one set.");
+    }
+    if (op_instr_only.get_value() && op_L0_filter.get_value())
+        FATAL("Usage error: -instr_only cannot be combined with -L0_filter.");
+#ifndef HAS_ZLIB
+    if (op_raw_compress.get_value())
+        FATAL("Usage error: -raw_compress requires zlib.");
+#endif
+    if (op_offline_stream.get_value() &&
+        (!op_offline.get_value() || file_ops_func.open_file != dr_open_file ||
+         file_ops_func.write_file != dr_write_file ||
+         file_ops_func.close_file != dr_close_file ||
+         file_ops_func.handoff_buf != NULL)) {
+        FATAL("Usage error: -offline_stream requires -offline and the default file "
+              "functions.");
+    }
+    if (!op_stream_to.get_value().empty()) {
+#ifdef UNIX
+        if (!op_offline.get_value() || op_offline_stream.get_value() ||
+            file_ops_func.open_file != dr_open_file ||
+            file_ops_func.write_file != dr_write_file ||
+            file_ops_func.close_file != dr_close_file ||
+            file_ops_func.create_dir != dr_create_dir ||
+            file_ops_func.handoff_buf != NULL) {
+            FATAL("Usage error: -stream_to requires -offline and the default file "
+                  "functions, and cannot be combined with -offline_stream.");
+        }
+#else
+        FATAL("Usage error: -stream_to is not supported on this platform.");
+#endif
+    }
+    if (op_trace_annotations.get_value()) {
+#ifndef HAS_ANNOTATIONS
+        FATAL("Usage error: -trace_annotations requires annotation support.");
+#endif
+        if (op_trace_after_instrs.get_value() > 0 ||
+            op_trace_for_instrs.get_value() > 0 ||
+            op_retrace_every_instrs.get_value() > 0) {
+            FATAL("Usage error: -trace_annotations cannot be combined with "
+                  "-trace_after_instrs, -trace_for_instrs, or -retrace_every_instrs.");
+        }
+    }
+    if (op_persistent_instru.get_value()) {
+#ifndef X86
+        FATAL("Usage error: -persistent_instru is only supported on x86.");
+#endif
+        if (!op_trace_annotations.get_value() || op_L0_filter.get_value()) {
+            FATAL("Usage error: -persistent_instru requires -trace_annotations and "
+                  "cannot be combined with -L0_filter.");
+        }
+    }
+
+    if (op_use_physical.get_value()) {
+        if (op_offline.get_value() && file_ops_func.handoff_buf != NULL) {
+            FATAL("Usage error: -use_physical with -offline cannot be combined with "
+                  "a buffer handoff function.");
+        }
+        /* Unfortunately the allocation of the cache in physaddr_t calls malloc
+         * and thus we cannot support it for static linking, so we override the
+         * DR_DISALLOW_UNSAFE_STATIC declaration.
+         */
+        dr_allow_unsafe_static_behavior();
+#ifdef DRMEMTRACE_STATIC
+        NOTIFY(0, "-use_physical is unsafe with statically linked clients\n");
+#endif
+        // We need to know whether it works before creating instru.
+        have_phys = physaddr.init();
+        if (!have_phys)
+            NOTIFY(0, "Unable to open pagemap: using virtual addresses.\n");
+    }
+
+#ifdef LINUX
+    /* The app has not yet moved its program break, unless we attached late. */
+    if (op_offline.get_value())
+        heap_base = (addr_t) dr_raw_brk(NULL);
+#endif
 
     drreg_init_and_fill_vector(&scratch_reserve_vec, true);
 #ifdef X86
@@ -1712,6 +3583,10 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
 
     if (op_offline.get_value()) {
         void *buf;
+#ifdef UNIX
+        if (!op_stream_to.get_value().empty())
+            remote_init();
+#endif
         if (!init_offline_dir()) {
             FATAL("Failed to create a subdir in %s\n", op_outdir.get_value().c_str());
         }
@@ -1720,6 +3595,8 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
         buf = dr_global_alloc(MAX_INSTRU_SIZE);
         instru = new(buf) offline_instru_t(insert_load_buf_ptr,
                                            op_L0_filter.get_value(),
+                                           op_instr_only.get_value(),
+                                           phys_offline(),
                                            &scratch_reserve_vec,
                                            file_ops_func.write_file,
                                            module_file);
@@ -1731,6 +3608,29 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
         instru = new(buf) online_instru_t(insert_load_buf_ptr,
                                           op_L0_filter.get_value(),
                                           &scratch_reserve_vec);
+#ifdef LINUX
+        if (op_ipc_ring.get_value()) {
+            if (!ipc_ring.set_name(op_ipc_name.get_value().c_str()))
+                DR_ASSERT(false);
+            /* We map the ring ourselves to keep it isolated from the app. */
+            file_t fd = dr_open_file(ipc_ring.get_ring_path().c_str(),
+                                     DR_FILE_WRITE_APPEND);
+            uint64 file_size;
+            if (fd == INVALID_FILE || !dr_file_size(fd, &file_size)) {
+                FATAL("Fatal error: Failed to open ring %s.\n",
+                      ipc_ring.get_ring_path().c_str());
+            }
+            ipc_ring_size = (size_t)file_size;
+            ipc_ring_base = (byte *)
+                dr_map_file(fd, &ipc_ring_size, 0, NULL,
+                            DR_MEMPROT_READ | DR_MEMPROT_WRITE, 0);
+            dr_close_file(fd);
+            if (ipc_ring_base == NULL || !ipc_ring.attach(ipc_ring_base, ipc_ring_size)) {
+                FATAL("Fatal error: Failed to attach to ring %s.\n",
+                      ipc_ring.get_ring_path().c_str());
+            }
+        } else {
+#endif
         if (!ipc_pipe.set_name(op_ipc_name.get_value().c_str()))
             DR_ASSERT(false);
 #ifdef UNIX
@@ -1753,6 +3653,9 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
 #endif
         if (!ipc_pipe.maximize_buffer())
             NOTIFY(1, "Failed to maximize pipe buffer: performance may suffer.\n");
+#ifdef LINUX
+        }
+#endif
     }
 
     /* We need an extra for -L0_filter. */
@@ -1770,11 +3673,37 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
     if (!drmgr_register_thread_init_event(event_thread_init) ||
         !drmgr_register_thread_exit_event(event_thread_exit))
         DR_ASSERT(false);
+    /* This follows drmodtrack's registration in offline_instru_t. */
+    if (op_offline_stream.get_value() &&
+        !drmgr_register_module_load_event(event_stream_module_load))
+        DR_ASSERT(false);
+
+    if (!op_record_function.get_value().empty())
+        init_func_tracing();
 
-    if (op_trace_after_instrs.get_value() > 0)
+    if (op_trace_after_instrs.get_value() > 0 || has_tracing_windows())
+        init_delay_instrumentation();
+    // With -trace_annotations we start out suspended, as though after a window.
+    if (op_persistent_instru.get_value()) {
+        enable_tracing_instrumentation();
+        set_tracing_gate(false);
+        tracing_enabled = false;
+    } else if (op_trace_after_instrs.get_value() > 0 ||
+               op_trace_annotations.get_value())
         enable_delay_instrumentation();
     else
         enable_tracing_instrumentation();
+#ifdef HAS_ANNOTATIONS
+    if (op_trace_annotations.get_value()) {
+        if (!dr_annotation_register_call("drmemtrace_annotate_start_tracing",
+                                         (void *)annotation_start_tracing, false, 0,
+                                         DR_ANNOTATION_CALL_TYPE_FASTCALL) ||
+            !dr_annotation_register_call("drmemtrace_annotate_stop_tracing",
+                                         (void *)annotation_stop_tracing, false, 0,
+                                         DR_ANNOTATION_CALL_TYPE_FASTCALL))
+            DR_ASSERT(false);
+    }
+#endif
 
     trace_buf_size = instru->sizeof_entry() * MAX_NUM_ENTRIES;
 
@@ -1784,21 +3713,30 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
      * instructions accessing memory once, which is fairly
      * pathological as by default that's 256 memrefs for one bb.  We double
      * it to ensure we cover skipping clean calls for sthg like strex.
+     * On x86 we further leave room for gathers and masked moves, which write
+     * one entry per vector element.
      */
     uint64 max_bb_instrs;
     if (!dr_get_integer_option("max_bb_instrs", &max_bb_instrs))
         max_bb_instrs = 256; /* current default */
-    redzone_size = instru->sizeof_entry() * (size_t)max_bb_instrs * 2;
+    redzone_size = instru->sizeof_entry() * (size_t)max_bb_instrs *
+        (2 IF_X86(+ MAX_VECTOR_MEMREF_ELEMENTS));
 
-    max_buf_size = ALIGN_FORWARD(trace_buf_size + redzone_size, dr_page_size());
     /* Mark any padding as redzone as well */
-    redzone_size = max_buf_size - trace_buf_size;
+    redzone_size = ALIGN_FORWARD(trace_buf_size + redzone_size, dr_page_size()) -
+        trace_buf_size;
+    /* We only double the initial size, so every size stays page-aligned. */
+    max_trace_buf_size = trace_buf_size;
+    while ((uint64)max_trace_buf_size * 2 <=
+           (uint64)instru->sizeof_entry() * op_max_buffer_entries.get_value())
+        max_trace_buf_size *= 2;
     /* Append a throwaway header to get its size. */
     buf_hdr_slots_size = instru->append_unit_header(buf, 0/*doesn't matter*/);
     DR_ASSERT(BUFFER_SIZE_BYTES(buf) >= buf_hdr_slots_size);
 
     client_id = id;
     mutex = dr_mutex_create();
+    async_init();
 
     tls_idx = drmgr_register_tls_field();
     DR_ASSERT(tls_idx != -1);
@@ -1812,19 +3750,10 @@ drmemtrace_client_main(client_id_t id, int argc, const char *argv[])
     /* make it easy to tell, by looking at log file, which client executed */
     dr_log(NULL, DR_LOG_ALL, 1, "drcachesim client initializing\n");
 
-    if (op_use_physical.get_value()) {
-        have_phys = physaddr.init();
-        if (!have_phys)
-            NOTIFY(0, "Unable to open pagemap: using virtual addresses.\n");
-        /* Unfortunately the use of std::unordered_map in physaddr_t calls malloc
-         * and thus we cannot support it for static linking, so we override the
-         * DR_DISALLOW_UNSAFE_STATIC declaration.
-         */
-        dr_allow_unsafe_static_behavior();
-#ifdef DRMEMTRACE_STATIC
-        NOTIFY(0, "-use_physical is unsafe with statically linked clients\n");
+#ifdef LINUX
+    if (have_phys && !drmgr_register_pre_syscall_event(event_physaddr_pre_syscall))
+        DR_ASSERT(false);
 #endif
-    }
 }
 
 /* To support statically linked multiple clients, we add drmemtrace_client_main
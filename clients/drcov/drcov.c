@@ -42,6 +42,14 @@
  * The runtime options for this client include:
  * -dump_text         Dumps the log file in text format
  * -dump_binary       Dumps the log file in binary format
+ * -dump_bitmap       Dumps one coverage bitmap per module instead of a bb list
+ * -bitmap_bb_start   With -dump_bitmap, only marks the start of each bb
+ * -hit_counts        With -dump_bitmap, also counts executions of each bb
+ * -hit_count_threshold <n>
+ *                    With -hit_counts, removes a bb's counter once it reaches n
+ * -hit_count_deadline <ms>
+ *                    With -hit_counts, removes all counters after ms milliseconds
+ * -shared_map <file> Maps a shared file of per-bb execution counters
  * -[no_]nudge_kills  On by default.
  *                    Uses nudge to notify a child process being terminated
  *                    by its parent, so that the exit event will be called.
@@ -57,6 +65,10 @@
 static uint verbose;
 static bool nudge_kills;
 static client_id_t client_id;
+static const char *shared_map_path;
+
+/* The same size as the coverage maps of common fuzzers */
+#define SHARED_MAP_SLOTS (64 * 1024)
 
 #define NOTIFY(level, ...) do {          \
     if (verbose >= (level))              \
@@ -132,10 +144,32 @@ options_init(client_id_t id, int argc, const char *argv[], drcovlib_options_t *o
             ops->flags |= DRCOVLIB_DUMP_AS_TEXT;
         else if (strcmp(token, "-dump_binary") == 0)
             ops->flags &= ~DRCOVLIB_DUMP_AS_TEXT;
+        else if (strcmp(token, "-dump_bitmap") == 0)
+            ops->flags |= DRCOVLIB_DUMP_AS_BITMAP;
+        else if (strcmp(token, "-bitmap_bb_start") == 0)
+            ops->flags |= DRCOVLIB_BITMAP_BB_START;
+        else if (strcmp(token, "-hit_counts") == 0)
+            ops->flags |= DRCOVLIB_BITMAP_HIT_COUNTS;
+        else if (strcmp(token, "-hit_count_threshold") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -hit_count_threshold number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &ops->hit_count_threshold) != 1)
+                USAGE_CHECK(false, "invalid -hit_count_threshold number");
+        }
+        else if (strcmp(token, "-hit_count_deadline") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing -hit_count_deadline number");
+            token = argv[++i];
+            if (dr_sscanf(token, "%u", &ops->hit_count_deadline_ms) != 1)
+                USAGE_CHECK(false, "invalid -hit_count_deadline number");
+        }
         else if (strcmp(token, "-no_nudge_kills") == 0)
             nudge_kills = false;
         else if (strcmp(token, "-nudge_kills") == 0)
             nudge_kills = true;
+        else if (strcmp(token, "-shared_map") == 0) {
+            USAGE_CHECK((i + 1) < argc, "missing shared map path");
+            shared_map_path = argv[++i];
+        }
         else if (strcmp(token, "-logdir") == 0) {
             USAGE_CHECK((i + 1) < argc, "missing logdir path");
             ops->logdir = argv[++i];
@@ -178,7 +212,15 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
         NOTIFY(0, "fatal error: drcovlib failed to initialize\n");
         dr_abort();
     }
-    if (!dr_using_all_private_caches()) {
+    if (shared_map_path != NULL) {
+        uint *map;
+        if (drcovlib_shared_map_create(shared_map_path, SHARED_MAP_SLOTS, &map) !=
+            DRCOVLIB_SUCCESS) {
+            NOTIFY(0, "fatal error: failed to create shared map %s\n", shared_map_path);
+            dr_abort();
+        }
+    }
+    if (!dr_using_all_private_caches() || TEST(DRCOVLIB_DUMP_AS_BITMAP, ops.flags)) {
         const char *logname;
         if (drcovlib_logfile(NULL, &logname) == DRCOVLIB_SUCCESS)
             NOTIFY(1, "<created log file %s>\n", logname);
@@ -45,7 +45,11 @@
 #include "drsyms.h"
 #include "hashtable.h"
 #include "dr_frontend.h"
+#include <atomic>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "../../common/utils.h"
 #undef ASSERT /* we're standalone, so no client assert */
@@ -178,6 +182,13 @@ static droption_t<bool> op_help
 (DROPTION_SCOPE_FRONTEND, "help", false, "Print this message",
  "Prints the usage message.");
 
+static droption_t<unsigned int> op_jobs
+(DROPTION_SCOPE_FRONTEND, "jobs", 0, "Number of threads reading log files",
+ "Specifies the number of threads used to read the input log files, each of which "
+ "accumulates coverage into its own module tables before they are merged.  0, the "
+ "default, uses one thread per hardware thread.  A single thread is always used with "
+ "-test_pattern or -reduce_set, as they depend on the order in which files are read.");
+
 static droption_t<unsigned int> op_verbose
 (DROPTION_SCOPE_FRONTEND, "verbose", 1, 0, 64, "Verbosity level",
  "Verbosity level for informational notifications.");
@@ -749,11 +760,96 @@ module_is_from_tool(const char * path)
             strstr(path, DRMEM_LIB_NAME) != NULL);
 }
 
-static const char *
-read_module_list(const char *buf, module_table_t ***tables, uint *num_mods)
+/* Returns the table for the module at path, creating it if necessary, or
+ * MODULE_TABLE_IGNORE if the module is filtered out.
+ */
+static module_table_t *
+module_table_lookup_or_create(hashtable_t *htable, const char *path, size_t size)
 {
     const char *modpath;
     char subst[MAXIMUM_PATH];
+    module_table_t *mod_table;
+
+    mod_table = (module_table_t *)hashtable_lookup(htable, (void*)path);
+    if (mod_table != NULL)
+        return mod_table;
+    modpath = path;
+    if (size >= UINT_MAX)
+        ASSERT(false, "module size is too large");
+    /* FIXME i#1445: we have seen the pdb convert paths to all-lowercase,
+     * so these should be case-insensitive on Windows.
+     */
+    if (strstr(path, "<unknown>") != NULL ||
+        (op_mod_filter.specified() &&
+         strstr(path, op_mod_filter.get_value().c_str()) == NULL) ||
+        (op_mod_skip_filter.specified() &&
+         strstr(path, op_mod_skip_filter.get_value().c_str()) != NULL) ||
+        (!op_include_tool.get_value() && module_is_from_tool(path)))
+        mod_table = (module_table_t *) MODULE_TABLE_IGNORE;
+    else {
+        if (op_pathmap.specified()) {
+            const char *tofind = op_pathmap.get_value().first.c_str();
+            const char *match = strstr(path, tofind);
+            if (match != NULL) {
+                if (dr_snprintf(subst, BUFFER_SIZE_ELEMENTS(subst),
+                                "%.*s%s%s", match - path, path,
+                                op_pathmap.get_value().second.c_str(),
+                                match + strlen(tofind)) <= 0) {
+                    WARN(1, "Failed to replace %s in %s\n", tofind, path);
+                } else {
+                    NULL_TERMINATE_BUFFER(subst);
+                    PRINT(2, "Substituting |%s| for |%s|\n", subst, path);
+                    modpath = subst;
+                }
+            }
+        }
+        mod_table = module_table_create(modpath, size);
+    }
+    PRINT(4, "Create module table " PFX" for module %s\n",
+          (ptr_uint_t)mod_table, modpath);
+    if (!hashtable_add(htable, (void *)modpath, mod_table))
+        ASSERT(false, "Failed to add new module");
+    return mod_table;
+}
+
+/* Moves the module tables of a reader thread into module_htable, ORing
+ * together the coverage of modules seen by more than one thread.
+ */
+static void
+module_tables_merge(hashtable_t *htable)
+{
+    uint i;
+    size_t j, num_bytes;
+    for (i = 0; i < HASHTABLE_SIZE(htable->table_bits); i++) {
+        hash_entry_t *e;
+        for (e = htable->table[i]; e != NULL; e = e->next) {
+            module_table_t *src = (module_table_t *)e->payload;
+            module_table_t *dst = (module_table_t *)
+                hashtable_lookup(&module_htable, e->key);
+            if (dst == NULL) {
+                num_module_htable_entries++;
+                if (!hashtable_add(&module_htable, e->key, src))
+                    ASSERT(false, "Failed to add new module");
+                continue;
+            }
+            /* The filters only depend on the path, so both or neither are ignored,
+             * and with -test_pattern there is only one reader.
+             */
+            if (src != MODULE_TABLE_IGNORE && dst != MODULE_TABLE_IGNORE) {
+                num_bytes = (src->size < dst->size ? src->size : dst->size) /
+                    BITS_PER_BYTE;
+                for (j = 0; j < num_bytes; j++)
+                    dst->bb_table.bitmap[j] |= src->bb_table.bitmap[j];
+            }
+            module_table_delete(src);
+        }
+    }
+}
+
+static const char *
+read_module_list(hashtable_t *htable, const char *buf, module_table_t ***tables,
+                 uint *num_mods)
+{
     uint i;
     void *handle;
 
@@ -767,59 +863,60 @@ read_module_list(const char *buf, module_table_t ***tables, uint *num_mods)
 
     *tables = (module_table_t **) calloc(*num_mods, sizeof(*tables));
     for (i = 0; i < *num_mods; i++) {
-        module_table_t *mod_table;
         drmodtrack_info_t info = {sizeof(info),};
 
         if (drmodtrack_offline_lookup(handle, i, &info) != DRCOVLIB_SUCCESS)
             ASSERT(false, "Failed to read module table");
         PRINT(5, "Module: %u, " PFX", %s\n", i, (ptr_uint_t)info.size, info.path);
-        mod_table = (module_table_t *)hashtable_lookup(&module_htable, (void*)info.path);
-        if (mod_table == NULL) {
-            modpath = info.path;
-            if (info.size >= UINT_MAX)
-                ASSERT(false, "module size is too large");
-            /* FIXME i#1445: we have seen the pdb convert paths to all-lowercase,
-             * so these should be case-insensitive on Windows.
-             */
-            if (strstr(info.path, "<unknown>") != NULL ||
-                (op_mod_filter.specified() &&
-                 strstr(info.path, op_mod_filter.get_value().c_str()) == NULL) ||
-                (op_mod_skip_filter.specified() &&
-                 strstr(info.path, op_mod_skip_filter.get_value().c_str()) != NULL) ||
-                (!op_include_tool.get_value() && module_is_from_tool(info.path)))
-                mod_table = (module_table_t *) MODULE_TABLE_IGNORE;
-            else {
-                if (op_pathmap.specified()) {
-                    const char *tofind = op_pathmap.get_value().first.c_str();
-                    const char *match = strstr(info.path, tofind);
-                    if (match != NULL) {
-                        if (dr_snprintf(subst, BUFFER_SIZE_ELEMENTS(subst),
-                                        "%.*s%s%s", match - info.path, info.path,
-                                        op_pathmap.get_value().second.c_str(),
-                                        match + strlen(tofind)) <= 0) {
-                            WARN(1, "Failed to replace %s in %s\n", tofind, info.path);
-                        } else {
-                            NULL_TERMINATE_BUFFER(subst);
-                            PRINT(2, "Substituting |%s| for |%s|\n", subst, info.path);
-                            modpath = subst;
-                        }
-                    }
-                }
-                mod_table = module_table_create(modpath, info.size);
-            }
-            PRINT(4, "Create module table " PFX" for module %s\n",
-                  (ptr_uint_t)mod_table, modpath);
-            num_module_htable_entries++;
-            if (!hashtable_add(&module_htable, (void *)modpath, mod_table))
-                ASSERT(false, "Failed to add new module");
-        }
-        (*tables)[i] = mod_table;
+        (*tables)[i] = module_table_lookup_or_create(htable, info.path, info.size);
     }
     if (drmodtrack_offline_exit(handle) != DRCOVLIB_SUCCESS)
         ASSERT(false, "failed to clean up module table data");
     return buf;
 }
 
+/* Reads a DRCOVLIB_DUMP_AS_BITMAP log, whose records name their modules. */
+static bool
+read_bitmap_list(hashtable_t *htable, const char *input, const char *ptr,
+                 const char *map_end, uint num_mods, uint flags)
+{
+    uint i;
+    size_t j, num_bytes;
+    bool add_new_bb = false;
+
+    PRINT(4, "Reading %u module bitmaps\n", num_mods);
+    if (op_test_pattern.specified())
+        WARN(1, "Test case coverage is not supported for bitmap log %s\n", input);
+    if (TEST(DRCOVLIB_BITMAP_BB_START, flags))
+        WARN(2, "Bitmap log %s only records block starts\n", input);
+    for (i = 0; i < num_mods; i++) {
+        drcovlib_bitmap_module_t module;
+        module_table_t *table;
+        if (drcovlib_bitmap_offline_next(&ptr, map_end, &module) != DRCOVLIB_SUCCESS) {
+            WARN(1, "Failed to read module bitmap, corrupt log file %s\n", input);
+            return false;
+        }
+        PRINT(5, "Bitmap: " PFX", %s\n", (ptr_uint_t)module.size, module.path);
+        /* Module tables must be page-aligned */
+        table = module_table_lookup_or_create(htable, module.path, (size_t)
+                                              ((module.size + dr_page_size() - 1) &
+                                               ~((uint64)dr_page_size() - 1)));
+        if (table == MODULE_TABLE_IGNORE || op_test_pattern.specified())
+            continue;
+        num_bytes = (size_t)(module.size + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+        if (num_bytes > table->size / BITS_PER_BYTE)
+            num_bytes = table->size / BITS_PER_BYTE;
+        for (j = 0; j < num_bytes; j++) {
+            byte bits = table->bb_table.bitmap[j] | module.bitmap[j];
+            if (bits != table->bb_table.bitmap[j]) {
+                table->bb_table.bitmap[j] = bits;
+                add_new_bb = true;
+            }
+        }
+    }
+    return add_new_bb;
+}
+
 static bool
 read_bb_list(const char *buf, module_table_t **tables, uint num_mods, uint num_bbs)
 {
@@ -930,13 +1027,13 @@ close_input_file(file_t f, const char *map, size_t map_size)
 }
 
 static bool
-read_drcov_file(const char *input)
+read_drcov_file(hashtable_t *htable, const char *input)
 {
     file_t log;
     const char  *map, *ptr;
     size_t map_size;
     module_table_t **tables;
-    uint   num_mods, num_bbs;
+    uint   num_mods, num_bbs, flags;
     bool   res;
 
     PRINT(2, "Reading drcov log file: %s\n", input);
@@ -951,7 +1048,16 @@ read_drcov_file(const char *input)
         return false;
     }
 
-    ptr = read_module_list(ptr, &tables, &num_mods);
+    if (drcovlib_bitmap_offline_read(map, map_size, &num_mods, &flags, &ptr) ==
+        DRCOVLIB_SUCCESS) {
+        res = read_bitmap_list(htable, input, ptr, map + map_size, num_mods, flags);
+        if (res && set_log != INVALID_FILE)
+            dr_fprintf(set_log, "%s\n", input);
+        close_input_file(log, map, map_size);
+        return true;
+    }
+
+    ptr = read_module_list(htable, ptr, &tables, &num_mods);
     if (ptr == NULL)
         return false;
 
@@ -985,6 +1091,29 @@ is_drcov_log_file(const char *fname)
     return false;
 }
 
+/* The log files to read, gathered from all inputs before any are read. */
+static std::vector<std::string> input_files;
+static std::atomic<size_t> next_input_file;
+
+/* Each reader thread accumulates coverage into its own module tables, which
+ * are merged once all files are read: the files are independent, so this
+ * avoids any locking.
+ */
+typedef struct _reader_t {
+    hashtable_t module_htable;
+    bool found_logs;
+} reader_t;
+
+static void
+reader_main(reader_t *reader)
+{
+    size_t i;
+    while ((i = next_input_file.fetch_add(1)) < input_files.size()) {
+        if (read_drcov_file(&reader->module_htable, input_files[i].c_str()))
+            reader->found_logs = true;
+    }
+}
+
 #ifdef UNIX
 static bool
 read_drcov_dir(void)
@@ -1006,7 +1135,7 @@ read_drcov_dir(void)
                     WARN(1, "Fail to get full path of log file %s\n", ent->d_name);
                 } else {
                     NULL_TERMINATE_BUFFER(path);
-                    read_drcov_file(path);
+                    input_files.push_back(path);
                     found_logs = true;
                 }
             }
@@ -1053,7 +1182,8 @@ read_drcov_dir(void)
             if (!has_sep)
                 strcat(path, "\\");
             strcat(path, ffd.cFileName);
-            found_logs = read_drcov_file(path) || found_logs;
+            input_files.push_back(path);
+            found_logs = true;
         }
     } while (FindNextFile(hFind, &ffd) != 0);
     FindClose(hFind);
@@ -1086,7 +1216,8 @@ read_drcov_list(void)
         NULL_TERMINATE_BUFFER(path);
         ptr = move_to_next_line(ptr);
         null_terminate_path(path);
-        found_logs = read_drcov_file(path) || found_logs;
+        input_files.push_back(path);
+        found_logs = true;
     }
     close_input_file(list, map, map_size);
     if (!found_logs)
@@ -1098,13 +1229,46 @@ static bool
 read_drcov_input(void)
 {
     bool res = true;
+    bool found_logs = false;
+    uint i, num_readers = op_jobs.get_value();
     if (op_input.specified())
-        res = read_drcov_file(input_file_buf) && res;
+        input_files.push_back(input_file_buf);
     if (op_list.specified())
         res = read_drcov_list() && res;
     if (op_dir.specified())
         res = read_drcov_dir() && res;
-    return res;
+
+    if (num_readers == 0)
+        num_readers = std::thread::hardware_concurrency();
+    if (num_readers == 0 || op_test_pattern.specified() || op_reduce_set.specified())
+        num_readers = 1;
+    if (num_readers > input_files.size())
+        num_readers = (uint)input_files.size();
+    PRINT(2, "Reading %u log files with %u threads\n", (uint)input_files.size(),
+          num_readers);
+    std::vector<reader_t> readers(num_readers);
+    for (i = 0; i < num_readers; i++) {
+        hashtable_init_ex(&readers[i].module_htable, MODULE_HASH_TABLE_BITS,
+                          HASH_STRING, true /* strdup */, false /* !synch */,
+                          NULL /* the merge frees or moves the tables */,
+                          NULL /* hash */, NULL /* cmp */);
+        readers[i].found_logs = false;
+    }
+    if (num_readers == 1)
+        reader_main(&readers[0]);
+    else {
+        std::vector<std::thread> threads;
+        for (i = 0; i < num_readers; i++)
+            threads.push_back(std::thread(reader_main, &readers[i]));
+        for (i = 0; i < num_readers; i++)
+            threads[i].join();
+    }
+    for (i = 0; i < num_readers; i++) {
+        found_logs = found_logs || readers[i].found_logs;
+        module_tables_merge(&readers[i].module_htable);
+        hashtable_delete(&readers[i].module_htable);
+    }
+    return res && found_logs;
 }
 
 static bool
@@ -0,0 +1,390 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* drcovmerge.cpp
+ *
+ * Merges drcov log files written with -dump_bitmap into a single log file in
+ * the same format, by ORing the bitmaps of each module and summing hit counts.
+ */
+
+#include "dr_api.h"
+#include "droption.h"
+#include "drcovlib.h"
+#include "dr_frontend.h"
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../../common/utils.h"
+#undef ASSERT /* we're standalone, so no client assert */
+
+#include <string.h> /* memcpy */
+#include <stdlib.h> /* exit */
+#include <stdio.h>
+
+#ifdef UNIX
+# include <dirent.h> /* opendir, readdir */
+#else
+# include <windows.h>
+#endif
+
+#define PRINT(lvl, ...) do {                                \
+    if (op_verbose.get_value() >= lvl) {                    \
+        fprintf(stdout, "[DRCOVMERGE] INFO(%d):    ", lvl); \
+        fprintf(stdout, __VA_ARGS__);                       \
+    }                                                       \
+} while (0)
+
+#define WARN(lvl, ...) do {                                 \
+    if (op_warning.get_value() >= lvl) {                    \
+        fprintf(stderr, "[DRCOVMERGE] WARNING(%d): ", lvl); \
+        fprintf(stderr, __VA_ARGS__);                       \
+    }                                                       \
+} while (0)
+
+#define ASSERT(val, ...) do {                               \
+    if (!(val)) {                                           \
+        fprintf(stderr, "[DRCOVMERGE] ERROR:      ");       \
+        fprintf(stderr, __VA_ARGS__);                       \
+        exit(1);                                            \
+    }                                                       \
+} while (0)
+
+#define DEFAULT_OUTPUT_FILE "drcov.merged.log"
+
+/***************************************************************************
+ * Options
+ */
+
+static droption_t<std::string> op_dir
+(DROPTION_SCOPE_FRONTEND, "dir", "", "Directory with drcov.*.log files to merge",
+ "Specifies a directory within which all drcov.*.log files written with "
+ "-dump_bitmap will be merged.  Other log files are skipped.");
+
+static droption_t<std::string> op_list
+(DROPTION_SCOPE_FRONTEND, "list", "", "Text file listing log files to merge",
+ "Specifies a text file that contains a list of paths of log files to merge.");
+
+static droption_t<std::string> op_output
+(DROPTION_SCOPE_FRONTEND, "output", DEFAULT_OUTPUT_FILE, "Names the output file",
+ "Specifies the name for the merged output file, which can itself be passed to "
+ "drcov2lcov or to another merge.");
+
+static droption_t<bool> op_help
+(DROPTION_SCOPE_FRONTEND, "help", false, "Print this message",
+ "Prints the usage message.");
+
+static droption_t<unsigned int> op_verbose
+(DROPTION_SCOPE_FRONTEND, "verbose", 1, 0, 64, "Verbosity level",
+ "Verbosity level for informational notifications.");
+
+static droption_t<unsigned int> op_warning
+(DROPTION_SCOPE_FRONTEND, "warning", 1, 0, 64, "Warning level",
+ "Level for enabling progressively less serious warning messages.");
+
+static char output_file_buf[MAXIMUM_PATH];
+
+/***************************************************************************
+ * Merged coverage
+ */
+
+struct merged_module_t {
+    merged_module_t() : size(0) {}
+    uint64 size;
+    /* The bitmap, held in words so that merging goes a word at a time. */
+    std::vector<uint64> words;
+    /* Hit counts keyed by block offset. */
+    std::map<uint, uint64> counts;
+};
+
+/* Keyed by path, as module indices are not stable across runs. */
+static std::map<std::string, merged_module_t> merged;
+static uint merged_flags = DRCOVLIB_DUMP_AS_BITMAP | DRCOVLIB_BITMAP_BB_START;
+static uint num_merged_files;
+
+static void
+merge_module(const drcovlib_bitmap_module_t &module)
+{
+    merged_module_t &dst = merged[module.path];
+    size_t num_bytes = (size_t)((module.size + 7) / 8);
+    size_t num_words = (num_bytes + sizeof(uint64) - 1) / sizeof(uint64);
+    size_t i;
+    if (module.size > dst.size) {
+        if (dst.size != 0)
+            WARN(2, "Module %s changed size\n", module.path);
+        dst.size = module.size;
+        dst.words.resize(num_words, 0);
+    }
+    /* The mapped bitmap is not aligned: copy out each word. */
+    for (i = 0; i < num_bytes / sizeof(uint64); i++) {
+        uint64 word;
+        memcpy(&word, module.bitmap + i * sizeof(word), sizeof(word));
+        dst.words[i] |= word;
+    }
+    if (i < num_words) {
+        uint64 word = 0;
+        memcpy(&word, module.bitmap + i * sizeof(word), num_bytes % sizeof(word));
+        dst.words[i] |= word;
+    }
+    for (i = 0; i < module.num_counts; i++) {
+        drcovlib_bitmap_count_t count;
+        memcpy(&count, module.counts + i * sizeof(count), sizeof(count));
+        dst.counts[count.offset] += count.count;
+    }
+}
+
+static bool
+read_bitmap_file(const char *input)
+{
+    file_t f;
+    uint64 file_size;
+    size_t map_size;
+    char *map;
+    const char *ptr;
+    uint num_mods, flags, i;
+    bool res = true;
+
+    if (strcmp(input, output_file_buf) == 0) {
+        PRINT(2, "Skipping the output file %s\n", input);
+        return false;
+    }
+    PRINT(2, "Reading bitmap log file: %s\n", input);
+    f = dr_open_file(input, DR_FILE_READ | DR_FILE_ALLOW_LARGE);
+    if (f == INVALID_FILE) {
+        WARN(1, "Failed to open file %s\n", input);
+        return false;
+    }
+    if (!dr_file_size(f, &file_size) || file_size == 0) {
+        WARN(1, "Failed to get size of file %s\n", input);
+        dr_close_file(f);
+        return false;
+    }
+    map_size = (size_t)file_size;
+    map = (char *) dr_map_file(f, &map_size, 0, NULL, DR_MEMPROT_READ, 0);
+    if (map == NULL || (size_t)file_size > map_size) {
+        WARN(1, "Failed to map file %s\n", input);
+        dr_close_file(f);
+        return false;
+    }
+    if (drcovlib_bitmap_offline_read(map, (size_t)file_size, &num_mods, &flags, &ptr) !=
+        DRCOVLIB_SUCCESS) {
+        WARN(1, "Skipping %s: not a drcov bitmap log file\n", input);
+        res = false;
+    } else {
+        for (i = 0; i < num_mods; i++) {
+            drcovlib_bitmap_module_t module;
+            if (drcovlib_bitmap_offline_next(&ptr, map + file_size, &module) !=
+                DRCOVLIB_SUCCESS) {
+                WARN(1, "Corrupt bitmap log file %s\n", input);
+                break;
+            }
+            merge_module(module);
+        }
+        /* The result only has block-start granularity if every input does. */
+        if (!TEST(DRCOVLIB_BITMAP_BB_START, flags))
+            merged_flags &= ~DRCOVLIB_BITMAP_BB_START;
+        merged_flags |= (flags & DRCOVLIB_BITMAP_HIT_COUNTS);
+        num_merged_files++;
+    }
+    dr_unmap_file(map, map_size);
+    dr_close_file(f);
+    return res;
+}
+
+static inline bool
+is_drcov_log_file(const char *fname)
+{
+    return strncmp(fname, "drcov.", 6) == 0 && strstr(fname, ".log") != NULL;
+}
+
+static bool
+read_bitmap_dir(const char *dirname)
+{
+    char path[MAXIMUM_PATH];
+    bool found_logs = false;
+#ifdef UNIX
+    DIR *dir;
+    struct dirent *ent;
+    if ((dir = opendir(dirname)) == NULL) {
+        WARN(1, "Failed to open directory %s\n", dirname);
+        return false;
+    }
+    while ((ent = readdir(dir)) != NULL) {
+        if (!is_drcov_log_file(ent->d_name))
+            continue;
+        if (dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s/%s", dirname,
+                        ent->d_name) <= 0) {
+            WARN(1, "Fail to get full path of log file %s\n", ent->d_name);
+            continue;
+        }
+        NULL_TERMINATE_BUFFER(path);
+        found_logs = read_bitmap_file(path) || found_logs;
+    }
+    closedir(dir);
+#else
+    HANDLE hFind;
+    WIN32_FIND_DATA ffd;
+    dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s\\*", dirname);
+    NULL_TERMINATE_BUFFER(path);
+    hFind = FindFirstFile(path, &ffd);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        WARN(1, "Failed to open directory %s\n", dirname);
+        return false;
+    }
+    do {
+        if (TESTANY(ffd.dwFileAttributes, FILE_ATTRIBUTE_DIRECTORY) ||
+            !is_drcov_log_file(ffd.cFileName))
+            continue;
+        dr_snprintf(path, BUFFER_SIZE_ELEMENTS(path), "%s\\%s", dirname,
+                    ffd.cFileName);
+        NULL_TERMINATE_BUFFER(path);
+        found_logs = read_bitmap_file(path) || found_logs;
+    } while (FindNextFile(hFind, &ffd) != 0);
+    FindClose(hFind);
+#endif
+    return found_logs;
+}
+
+static bool
+read_bitmap_list(const char *list)
+{
+    FILE *f = fopen(list, "r");
+    char path[MAXIMUM_PATH];
+    bool found_logs = false;
+    if (f == NULL) {
+        WARN(1, "Failed to read list %s\n", list);
+        return false;
+    }
+    while (fgets(path, BUFFER_SIZE_ELEMENTS(path), f) != NULL) {
+        size_t len = strlen(path);
+        while (len > 0 && (path[len - 1] == '\n' || path[len - 1] == '\r'))
+            path[--len] = '\0';
+        if (len > 0)
+            found_logs = read_bitmap_file(path) || found_logs;
+    }
+    fclose(f);
+    return found_logs;
+}
+
+static bool
+write_merged_file(void)
+{
+    file_t f = dr_open_file(output_file_buf, DR_FILE_WRITE_OVERWRITE);
+    std::map<std::string, merged_module_t>::iterator it;
+    if (f == INVALID_FILE) {
+        WARN(1, "Failed to open output file %s\n", output_file_buf);
+        return false;
+    }
+    dr_fprintf(f, "DRCOV VERSION: %d\n", DRCOV_VERSION);
+    dr_fprintf(f, "DRCOV FLAVOR: %s\n", DRCOV_FLAVOR);
+    dr_fprintf(f, "BB Bitmap: version %u, count %u, flags 0x%x\n",
+               DRCOV_BITMAP_VERSION, (uint)merged.size(), merged_flags);
+    for (it = merged.begin(); it != merged.end(); ++it) {
+        drcovlib_bitmap_header_t header;
+        std::map<uint, uint64>::iterator cit;
+        header.size = it->second.size;
+        header.path_size = (uint)it->first.size() + 1;
+        header.num_counts = (uint)it->second.counts.size();
+        dr_write_file(f, &header, sizeof(header));
+        dr_write_file(f, it->first.c_str(), header.path_size);
+        if (!it->second.words.empty()) {
+            /* The words are in memory order, so the bytes come out as read. */
+            dr_write_file(f, &it->second.words[0], (size_t)(header.size + 7) / 8);
+        }
+        for (cit = it->second.counts.begin(); cit != it->second.counts.end(); ++cit) {
+            drcovlib_bitmap_count_t count;
+            count.count = cit->second;
+            count.offset = cit->first;
+            count.reserved = 0;
+            dr_write_file(f, &count, sizeof(count));
+        }
+    }
+    dr_close_file(f);
+    return true;
+}
+
+static void
+print_usage()
+{
+    fprintf(stderr, "drcovmerge: merge drcov -dump_bitmap log files\n");
+    fprintf(stderr, "usage: drcovmerge [options]\n%s",
+            droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
+}
+
+int
+main(int argc, const char *argv[])
+{
+    std::string parse_err;
+    char path[MAXIMUM_PATH];
+    bool found_logs = false;
+
+    if (!droption_parser_t::parse_argv(DROPTION_SCOPE_FRONTEND, argc, argv,
+                                       &parse_err, NULL)) {
+        WARN(0, "Usage error: %s\n", parse_err.c_str());
+        print_usage();
+        return 1;
+    }
+    if (op_help.specified() || (!op_dir.specified() && !op_list.specified())) {
+        print_usage();
+        return 1;
+    }
+    dr_standalone_init();
+
+    if (drfront_get_absolute_path(op_output.get_value().c_str(), output_file_buf,
+                                  BUFFER_SIZE_ELEMENTS(output_file_buf)) !=
+        DRFRONT_SUCCESS) {
+        ASSERT(false, "Failed to get full path of output file\n");
+    }
+    NULL_TERMINATE_BUFFER(output_file_buf);
+
+    if (op_list.specified())
+        found_logs = read_bitmap_list(op_list.get_value().c_str()) || found_logs;
+    if (op_dir.specified()) {
+        if (drfront_get_absolute_path(op_dir.get_value().c_str(), path,
+                                      BUFFER_SIZE_ELEMENTS(path)) != DRFRONT_SUCCESS)
+            ASSERT(false, "Failed to get full path of input dir\n");
+        NULL_TERMINATE_BUFFER(path);
+        found_logs = read_bitmap_dir(path) || found_logs;
+    }
+    if (!found_logs) {
+        ASSERT(false, "Failed to find bitmap log files\n");
+        return 1;
+    }
+    PRINT(1, "Merged %u files covering %u modules\n", num_merged_files,
+          (uint)merged.size());
+    if (!write_merged_file()) {
+        ASSERT(false, "Failed to write output file\n");
+        return 1;
+    }
+    return 0;
+}
@@ -43,6 +43,7 @@
 #include "drmgr.h"
 #include "droption.h"
 #include "options.h"
+#include <map>
 #include <vector>
 #include <string>
 #include <sstream>
@@ -53,7 +54,25 @@
         dr_fprintf(STDERR, __VA_ARGS__);   \
 } while (0)
 
-static bool (*opcode_supported)(instr_t *);
+#ifdef WINDOWS
+# define DIRSEP '\\'
+#else
+# define DIRSEP '/'
+#endif
+
+// A CPU model being checked.  Several can be checked in one run.
+typedef struct _sim_model_t {
+    // The name as requested by the user, used when reporting.
+    std::string name;
+    // The name of the underlying model, used for persisted verdicts.
+    std::string verdict_name;
+    bool (*opcode_supported)(instr_t *);
+    volatile int invalid_count;
+} sim_model_t;
+
+// The legality verdicts for a block are kept as a bitmask indexed like this vector.
+#define MAX_MODELS 32
+static std::vector<sim_model_t> models;
 
 static std::vector<std::string> blacklist;
 
@@ -720,10 +739,237 @@ fake_cpuid(void)
         dr_set_mcontext(drcontext, &mc);
     }
 }
+
+// Fills in the model fields for the CPU named \p cpu, returning false if the name
+// is not recognized.
+static bool
+lookup_model(const std::string &cpu, sim_model_t *model, cpuid_model_t **info)
+{
+    if (cpu == "Pentium") {
+        model->opcode_supported = opcode_supported_Pentium;
+        *info = &model_Pentium;
+        model->verdict_name = "Pentium";
+    } else if (cpu == "PentiumMMX") {
+        model->opcode_supported = opcode_supported_PentiumMMX;
+        *info = &model_PentiumMMX;
+        model->verdict_name = "PentiumMMX";
+    } else if (cpu == "PentiumPro") {
+        model->opcode_supported = opcode_supported_PentiumPro;
+        *info = &model_PentiumPro;
+        model->verdict_name = "PentiumPro";
+    } else if (cpu == "Pentium2" ||
+               cpu == "Klamath") {
+        model->opcode_supported = opcode_supported_Klamath;
+        *info = &model_Klamath;
+        model->verdict_name = "Klamath";
+    } else if (cpu == "Deschutes") {
+        model->opcode_supported = opcode_supported_Deschutes;
+        *info = &model_Deschutes;
+        model->verdict_name = "Deschutes";
+    } else if (cpu == "Pentium3" ||
+               cpu == "Coppermine" ||
+               cpu == "Tualatin") {
+        model->opcode_supported = opcode_supported_Pentium3;
+        *info = &model_Pentium3;
+        model->verdict_name = "Pentium3";
+    } else if (cpu == "PentiumM" ||
+               cpu == "Banias" ||
+               cpu == "Dothan" ||
+               // These are early Pentium4 models
+               cpu == "Willamette" ||
+               cpu == "Northwood") {
+        model->opcode_supported = opcode_supported_Banias;
+        *info = &model_Banias;
+        model->verdict_name = "Banias";
+    } else if (cpu == "Pentium4" ||
+               cpu == "Prescott" ||
+               cpu == "Presler") {
+        model->opcode_supported = opcode_supported_Prescott;
+        *info = &model_Prescott;
+        model->verdict_name = "Prescott";
+    } else if (cpu == "Core2" ||
+               cpu == "Merom") {
+        model->opcode_supported = opcode_supported_Merom;
+        *info = &model_Merom;
+        model->verdict_name = "Merom";
+    } else if (cpu == "Penryn") {
+        model->opcode_supported = opcode_supported_Penryn;
+        *info = &model_Penryn;
+        model->verdict_name = "Penryn";
+    } else if (cpu == "Nehalem") {
+        model->opcode_supported = opcode_supported_Nehalem;
+        *info = &model_Nehalem;
+        model->verdict_name = "Nehalem";
+    } else if (cpu == "Westmere") {
+        model->opcode_supported = opcode_supported_Westmere;
+        *info = &model_Westmere;
+        model->verdict_name = "Westmere";
+    } else if (cpu == "Sandybridge") {
+        model->opcode_supported = opcode_supported_Sandybridge;
+        *info = &model_Sandybridge;
+        model->verdict_name = "Sandybridge";
+    } else if (cpu == "Ivybridge") {
+        model->opcode_supported = opcode_supported_Ivybridge;
+        *info = &model_Ivybridge;
+        model->verdict_name = "Ivybridge";
+    } else {
+        // XXX i#1732: add Atom and AMD models.
+        // Maybe also add particular features like SSE2.
+        return false;
+    }
+    return true;
+}
 #endif /* X86 */
 
+/***************************************************************************
+ * Block verdict cache
+ *
+ * Checking a block against each model is repeated every time the block is
+ * (re-)translated, including when it is added to a trace, and again in every
+ * run of every process that loads the same module.  We remember, per module,
+ * which models each block was found to be legal for, and optionally persist
+ * those verdicts to a file per module so that later runs skip the checks for
+ * blocks already known to be legal.  Blocks with violations are never cached,
+ * as their violations should be reported in every run.
+ */
+
+// A block is identified by its start and end offsets from its module's base.
+typedef std::pair<ptr_uint_t, ptr_uint_t> block_range_t;
+
+#define VERDICT_FILE_HEADER "drcpusim block verdicts version 1"
+
+typedef struct _module_verdicts_t {
+    // The file the verdicts are persisted to, or empty if they are not.
+    std::string path;
+    // Bitmasks of the models each block is legal for.
+    std::map<block_range_t, uint> legal;
+    // Verdicts read from the file for models not checked in this run, which
+    // we keep so that rewriting the file does not drop them.
+    std::vector<std::string> other_lines;
+    bool dirty;
+} module_verdicts_t;
+
+// Keyed by module base.  Protected by verdict_lock.
+static std::map<app_pc, module_verdicts_t *> verdicts;
+static void *verdict_lock;
+
+static int
+verdict_model_index(const std::string &verdict_name)
+{
+    for (size_t i = 0; i < models.size(); ++i) {
+        if (models[i].verdict_name == verdict_name)
+            return (int)i;
+    }
+    return -1;
+}
+
+static void
+read_verdicts(module_verdicts_t *mv)
+{
+    file_t f = dr_open_file(mv->path.c_str(), DR_FILE_READ);
+    if (f == INVALID_FILE)
+        return;
+    std::string contents;
+    uint64 size;
+    if (dr_file_size(f, &size) && size > 0) {
+        contents.resize((size_t)size);
+        if (dr_read_file(f, &contents[0], (size_t)size) != (ssize_t)size)
+            contents.clear();
+    }
+    dr_close_file(f);
+    std::istringstream stream(contents);
+    std::string line;
+    if (!std::getline(stream, line) || line != VERDICT_FILE_HEADER) {
+        NOTIFY(1, "Ignoring invalid verdict file %s\n", mv->path.c_str());
+        return;
+    }
+    while (std::getline(stream, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        block_range_t range;
+        if (!(fields >> name >> std::hex >> range.first >> range.second))
+            continue;
+        int idx = verdict_model_index(name);
+        if (idx < 0)
+            mv->other_lines.push_back(line);
+        else
+            mv->legal[range] |= 1U << idx;
+    }
+    NOTIFY(1, "Read %d block verdicts from %s\n", (int)mv->legal.size(),
+           mv->path.c_str());
+}
+
+static void
+write_verdicts(module_verdicts_t *mv)
+{
+    if (mv->path.empty() || !mv->dirty)
+        return;
+    file_t f = dr_open_file(mv->path.c_str(), DR_FILE_WRITE_OVERWRITE);
+    if (f == INVALID_FILE) {
+        NOTIFY(0, "Failed to write verdict file %s\n", mv->path.c_str());
+        return;
+    }
+    dr_fprintf(f, "%s\n", VERDICT_FILE_HEADER);
+    for (std::vector<std::string>::iterator i = mv->other_lines.begin();
+         i != mv->other_lines.end(); ++i)
+        dr_fprintf(f, "%s\n", i->c_str());
+    for (std::map<block_range_t, uint>::iterator i = mv->legal.begin();
+         i != mv->legal.end(); ++i) {
+        for (size_t m = 0; m < models.size(); ++m) {
+            if ((i->second & (1U << m)) != 0) {
+                dr_fprintf(f, "%s " PIFX" " PIFX"\n", models[m].verdict_name.c_str(),
+                           i->first.first, i->first.second);
+            }
+        }
+    }
+    dr_close_file(f);
+    mv->dirty = false;
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *mod, bool loaded)
+{
+    module_verdicts_t *mv = new module_verdicts_t;
+    mv->dirty = false;
+    const char *modname = dr_module_preferred_name(mod);
+    if (!op_verdict_cache_dir.get_value().empty() && modname != NULL) {
+        // The timestamp and size distinguish different builds of the same library.
+        std::ostringstream path;
+        path << op_verdict_cache_dir.get_value() << DIRSEP << modname << "-"
+             << std::hex << mod->timestamp << "-" << (mod->end - mod->start)
+             << ".verdicts";
+        mv->path = path.str();
+        read_verdicts(mv);
+    }
+    dr_mutex_lock(verdict_lock);
+    std::map<app_pc, module_verdicts_t *>::iterator it = verdicts.find(mod->start);
+    if (it != verdicts.end()) {
+        write_verdicts(it->second);
+        delete it->second;
+    }
+    verdicts[mod->start] = mv;
+    dr_mutex_unlock(verdict_lock);
+}
+
 static void
-report_invalid_opcode(int opc, app_pc pc)
+event_module_unload(void *drcontext, const module_data_t *mod)
+{
+    dr_mutex_lock(verdict_lock);
+    std::map<app_pc, module_verdicts_t *>::iterator it = verdicts.find(mod->start);
+    if (it != verdicts.end()) {
+        write_verdicts(it->second);
+        delete it->second;
+        verdicts.erase(it);
+    }
+    dr_mutex_unlock(verdict_lock);
+}
+
+/***************************************************************************
+ * Checking
+ */
+
+static void
+report_invalid_opcode(sim_model_t *model, int opc, app_pc pc)
 {
     // XXX i#1732: add drsyms and provide file + line# (will require locating dbghelp
     // and installing it in the release package).
@@ -745,15 +991,18 @@ report_invalid_opcode(int opc, app_pc pc)
                 return;
             }
         }
+    }
+    dr_atomic_add32_return_sum(&model->invalid_count, 1);
+    if (modname != NULL) {
         // It would be nice to share pieces of the msg but we'd want to
         // build up a buffer to ensure a single atomic print.
         NOTIFY(0, "<Invalid %s instruction \"%s\" @ %s+" PIFX".  %s.>\n",
-               op_cpu.get_value().c_str(), decode_opcode_name(opc),
+               model->name.c_str(), decode_opcode_name(opc),
                modname, pc - mod->start,
                op_continue.get_value() ? "Continuing" : "Aborting");
     } else {
         NOTIFY(0, "<Invalid %s instruction \"%s\" @ " PFX".  %s.>\n",
-               op_cpu.get_value().c_str(), decode_opcode_name(opc), pc,
+               model->name.c_str(), decode_opcode_name(opc), pc,
                op_continue.get_value() ? "Continuing" : "Aborting");
     }
     if (mod != NULL)
@@ -762,14 +1011,71 @@ report_invalid_opcode(int opc, app_pc pc)
         dr_abort();
 }
 
+static dr_emit_flags_t
+event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
+                  bool for_trace, bool translating, void **user_data)
+{
+    uint all_models = (uint)(((uint64)1 << models.size()) - 1);
+    uint legal = 0;
+    instr_t *first = instrlist_first_app(bb);
+    instr_t *last = instrlist_last_app(bb);
+    module_data_t *mod = NULL;
+    block_range_t range;
+    if (first != NULL && instr_get_app_pc(first) != NULL)
+        mod = dr_lookup_module(instr_get_app_pc(first));
+    if (mod != NULL) {
+        range.first = instr_get_app_pc(first) - mod->start;
+        range.second = instr_get_app_pc(last) + instr_length(drcontext, last) -
+            mod->start;
+        dr_mutex_lock(verdict_lock);
+        std::map<app_pc, module_verdicts_t *>::iterator it = verdicts.find(mod->start);
+        if (it != verdicts.end()) {
+            std::map<block_range_t, uint>::iterator v = it->second->legal.find(range);
+            if (v != it->second->legal.end())
+                legal = v->second;
+        }
+        dr_mutex_unlock(verdict_lock);
+        if ((legal & all_models) == all_models) {
+            dr_free_module_data(mod);
+            return DR_EMIT_DEFAULT;
+        }
+    }
+    // We check meta instrs too.
+    uint illegal = 0;
+    for (instr_t *instr = instrlist_first(bb); instr != NULL;
+         instr = instr_get_next(instr)) {
+        for (size_t m = 0; m < models.size(); ++m) {
+            if ((legal & (1U << m)) != 0)
+                continue;
+            if (!models[m].opcode_supported(instr)) {
+                illegal |= 1U << m;
+                report_invalid_opcode(&models[m], instr_get_opcode(instr),
+                                      instr_get_app_pc(instr));
+            }
+        }
+    }
+    if (mod != NULL) {
+        uint now_legal = all_models & ~illegal;
+        if ((now_legal & ~legal) != 0) {
+            dr_mutex_lock(verdict_lock);
+            std::map<app_pc, module_verdicts_t *>::iterator it =
+                verdicts.find(mod->start);
+            if (it != verdicts.end()) {
+                it->second->legal[range] |= now_legal;
+                it->second->dirty = true;
+            }
+            dr_mutex_unlock(verdict_lock);
+        }
+        dr_free_module_data(mod);
+    }
+    return DR_EMIT_DEFAULT;
+}
+
 static dr_emit_flags_t
 event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
                       instr_t *instr, bool for_trace,
                       bool translating, void *user_data)
 {
-    // We check meta instrs too
-    if (!opcode_supported(instr))
-        report_invalid_opcode(instr_get_opcode(instr), instr_get_app_pc(instr));
 #ifdef X86
     if (op_fool_cpuid.get_value() && instr_get_opcode(instr) == OP_cpuid) {
         // It's non-trivial to fully emulate cpuid, or even to emulate the cases
@@ -796,6 +1102,19 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb,
 static void
 event_exit(void)
 {
+    for (std::map<app_pc, module_verdicts_t *>::iterator it = verdicts.begin();
+         it != verdicts.end(); ++it) {
+        write_verdicts(it->second);
+        delete it->second;
+    }
+    verdicts.clear();
+    dr_mutex_destroy(verdict_lock);
+    if (models.size() > 1) {
+        for (size_t m = 0; m < models.size(); ++m) {
+            NOTIFY(0, "<%s: %d invalid instruction(s) reported.>\n",
+                   models[m].name.c_str(), models[m].invalid_count);
+        }
+    }
     drmgr_exit();
 }
 
@@ -822,63 +1141,37 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
     }
 
 #ifdef X86
-    if (op_cpu.get_value() == "Pentium") {
-        opcode_supported = opcode_supported_Pentium;
-        model_info = &model_Pentium;
-    } else if (op_cpu.get_value() == "PentiumMMX") {
-        opcode_supported = opcode_supported_PentiumMMX;
-        model_info = &model_PentiumMMX;
-    } else if (op_cpu.get_value() == "PentiumPro") {
-        opcode_supported = opcode_supported_PentiumPro;
-        model_info = &model_PentiumPro;
-    } else if (op_cpu.get_value() == "Pentium2" ||
-               op_cpu.get_value() == "Klamath") {
-        opcode_supported = opcode_supported_Klamath;
-        model_info = &model_Klamath;
-    } else if (op_cpu.get_value() == "Deschutes") {
-        opcode_supported = opcode_supported_Deschutes;
-        model_info = &model_Deschutes;
-    } else if (op_cpu.get_value() == "Pentium3" ||
-               op_cpu.get_value() == "Coppermine" ||
-               op_cpu.get_value() == "Tualatin") {
-        opcode_supported = opcode_supported_Pentium3;
-        model_info = &model_Pentium3;
-    } else if (op_cpu.get_value() == "PentiumM" ||
-               op_cpu.get_value() == "Banias" ||
-               op_cpu.get_value() == "Dothan" ||
-               // These are early Pentium4 models
-               op_cpu.get_value() == "Willamette" ||
-               op_cpu.get_value() == "Northwood") {
-        opcode_supported = opcode_supported_Banias;
-        model_info = &model_Banias;
-    } else if (op_cpu.get_value() == "Pentium4" ||
-               op_cpu.get_value() == "Prescott" ||
-               op_cpu.get_value() == "Presler") {
-        opcode_supported = opcode_supported_Prescott;
-        model_info = &model_Prescott;
-    } else if (op_cpu.get_value() == "Core2" ||
-               op_cpu.get_value() == "Merom") {
-        opcode_supported = opcode_supported_Merom;
-        model_info = &model_Merom;
-    } else if (op_cpu.get_value() == "Penryn") {
-        opcode_supported = opcode_supported_Penryn;
-        model_info = &model_Penryn;
-    } else if (op_cpu.get_value() == "Nehalem") {
-        opcode_supported = opcode_supported_Nehalem;
-        model_info = &model_Nehalem;
-    } else if (op_cpu.get_value() == "Westmere") {
-        opcode_supported = opcode_supported_Westmere;
-        model_info = &model_Westmere;
-    } else if (op_cpu.get_value() == "Sandybridge") {
-        opcode_supported = opcode_supported_Sandybridge;
-        model_info = &model_Sandybridge;
-    } else if (op_cpu.get_value() == "Ivybridge") {
-        opcode_supported = opcode_supported_Ivybridge;
-        model_info = &model_Ivybridge;
-    } else {
-        // XXX i#1732: add Atom and AMD models.
-        // Maybe also add particular features like SSE2.
-        NOTIFY(0, "Usage error: invalid cpu %s\nUsage:\n%s", op_cpu.get_value().c_str(),
+    std::stringstream cpu_stream(op_cpu.get_value());
+    std::string cpu;
+    while (std::getline(cpu_stream, cpu, ':')) {
+        sim_model_t model;
+        cpuid_model_t *info;
+        if (!lookup_model(cpu, &model, &info)) {
+            NOTIFY(0, "Usage error: invalid cpu %s\nUsage:\n%s", cpu.c_str(),
+                   droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
+            dr_abort();
+        }
+        // Whether PREFETCHW is allowed changes the verdicts of the models that
+        // do not support it.
+        if (!op_allow_prefetchw.get_value())
+            model.verdict_name += "-no_prefetchw";
+        // Aliases of a model already requested add nothing.
+        if (verdict_model_index(model.verdict_name) >= 0)
+            continue;
+        if (models.size() >= MAX_MODELS) {
+            NOTIFY(0, "Usage error: at most %d cpu models are supported\n",
+                   MAX_MODELS);
+            dr_abort();
+        }
+        model.name = cpu;
+        model.invalid_count = 0;
+        // The first model is the one whose cpuid results we supply.
+        if (models.empty())
+            model_info = info;
+        models.push_back(model);
+    }
+    if (models.empty()) {
+        NOTIFY(0, "Usage error: cpu is required\nUsage:\n%s",
                droption_parser_t::usage_short(DROPTION_SCOPE_ALL).c_str());
         dr_abort();
     }
@@ -902,11 +1195,16 @@ dr_client_main(client_id_t id, int argc, const char *argv[])
         dr_free_module_data(exe);
     }
 
+    verdict_lock = dr_mutex_create();
+
     if (!drmgr_init())
         DR_ASSERT(false);
 
     /* register events */
     dr_register_exit_event(event_exit);
-    if (!drmgr_register_bb_instrumentation_event(NULL, event_app_instruction, NULL))
+    if (!drmgr_register_module_load_event(event_module_load) ||
+        !drmgr_register_module_unload_event(event_module_unload) ||
+        !drmgr_register_bb_instrumentation_event(event_bb_analysis,
+                                                 event_app_instruction, NULL))
         DR_ASSERT(false);
 }
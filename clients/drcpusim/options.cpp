@@ -43,7 +43,7 @@
 #endif
 
 droption_t<std::string> op_cpu
-(DROPTION_SCOPE_CLIENT, "cpu", "Westmere", "CPU model to simulate.  Typical values:\n"
+(DROPTION_SCOPE_CLIENT, "cpu", "Westmere", "CPU model(s) to simulate.  Typical values:\n"
  "                                Pentium,PentiumMMX,PentiumPro,Klamath,Deschutes,\n"
  "                                Pentium3,Banias,Dothan,Prescott,Presler,Merom,\n"
  "                                Penryn,Westmere,Sandybridge,Ivybridge.",
@@ -106,7 +106,12 @@ droption_t<std::string> op_cpu
  "models support 64-bit, ignoring the early E-series models.  Furthermore, drcpusim "
  "focuses on cpuid features rather than the family, and ends up treating requests "
  "for slightly different cpu models that have insignificant cpuid feature differences "
- "as identical: for example, a request for Northwood will result in a Banias model.");
+ "as identical: for example, a request for Northwood will result in a Banias model.\n"
+ "Several models can be checked in a single run by separating their names with ':', "
+ "as in \"-cpu Pentium3:Merom:Westmere\".  Each violation is reported with the model "
+ "it violates, and a count of violations per model is printed at exit (combine with "
+ "-continue to see them all).  The CPUID results supplied are those of the first "
+ "model listed.");
 
 droption_t<bool> op_continue
 (DROPTION_SCOPE_CLIENT, "continue", false, "Continue (don't abort) on bad instr.",
@@ -138,6 +143,19 @@ droption_t<bool> op_ignore_all_libs
  "Violations in libraries are ignored: only violations in the application executable "
  "itself are reported.");
 
+droption_t<std::string> op_verdict_cache_dir
+(DROPTION_SCOPE_CLIENT, "verdict_cache_dir", "",
+ "Directory for persisted per-module block verdicts.",
+ "drcpusim remembers which code blocks it has found to be legal for each model so "
+ "that it need not check a block again when it is re-translated.  If this option "
+ "names an existing directory, those verdicts are also saved there in one file per "
+ "module (named by module name, timestamp, and size) and are read back by later runs, "
+ "which then skip checking blocks already known to be legal for the requested "
+ "models.  Blocks containing violations are never cached and are checked and "
+ "reported in every run.  The directory can be shared by runs with different -cpu "
+ "values.  Concurrent processes writing verdicts for the same module are not "
+ "coordinated: the last one to exit wins, which at worst loses some verdicts.");
+
 droption_t<unsigned int> op_verbose
 (DROPTION_SCOPE_CLIENT, "verbose", 0, 0, 64, "Verbosity level",
  "Verbosity level for notifications.");
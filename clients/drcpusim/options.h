@@ -44,6 +44,7 @@ extern droption_t<bool> op_fool_cpuid;
 extern droption_t<bool> op_allow_prefetchw;
 extern droption_t<std::string> op_blacklist;
 extern droption_t<bool> op_ignore_all_libs;
+extern droption_t<std::string> op_verdict_cache_dir;
 extern droption_t<unsigned int> op_verbose;
 
 #endif /* _OPTIONS_H_ */
@@ -37,6 +37,7 @@
 #include "decode_fast.h"
 #include "utils.h"
 #include "annotations.h"
+#include "module_shared.h"
 
 #ifdef ANNOTATIONS /* around whole file */
 
@@ -318,6 +319,28 @@ annotation_exit()
     strhash_hash_destroy(GLOBAL_DCONTEXT, handlers);
 }
 
+/* Returns whether a DR annotation may appear in the module containing pc.  This is
+ * always true unless -annotations_from_notes is on, in which case it is only true
+ * for modules carrying the note emitted by the annotation macros.
+ */
+bool
+annotation_possible_in_module(app_pc pc)
+{
+#ifdef LINUX
+    module_area_t *ma;
+    bool res;
+    if (!DYNAMO_OPTION(annotations_from_notes))
+        return true;
+    os_get_module_info_lock();
+    ma = module_pc_lookup(pc);
+    res = (ma != NULL && ma->os_data.has_annotation_note);
+    os_get_module_info_unlock();
+    return res;
+#else
+    return true;
+#endif
+}
+
 bool
 instrument_annotation(dcontext_t *dcontext, IN OUT app_pc *start_pc,
                       OUT instr_t **substitution _IF_WINDOWS_X64(IN bool hint_is_safe))
@@ -334,6 +334,9 @@ annotation_init();
 void
 annotation_exit();
 
+bool
+annotation_possible_in_module(app_pc pc);
+
 static inline bool
 is_annotation_label(instr_t * instr)
 {
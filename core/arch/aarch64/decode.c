@@ -85,6 +85,20 @@ decode_opcode(dcontext_t *dcontext, byte *pc, instr_t *instr)
     return NULL;
 }
 
+byte *
+decode_opcode_only(dcontext_t *dcontext, byte *pc, OUT int *opcode)
+{
+    /* XXX i#2374: Performing full decode here is inefficient. */
+    instr_t instr;
+    instr_init(dcontext, &instr);
+    pc = decode_common(dcontext, pc, pc, &instr);
+    *opcode = instr_get_opcode(&instr);
+    instr_free(dcontext, &instr);
+    if (*opcode == OP_INVALID)
+        return NULL;
+    return pc;
+}
+
 byte *
 decode(dcontext_t *dcontext, byte *pc, instr_t *instr)
 {
@@ -1313,6 +1313,7 @@ typedef struct _callee_info_t {
     int num_simd_used;        /* number of SIMD registers (xmms) used by callee */
     bool simd_used[NUM_SIMD_REGS]; /* SIMD (xmm/ymm) registers usage */
     bool reg_used[NUM_GP_REGS];   /* general purpose registers usage */
+    bool fp_used;             /* if the function touches x87/MMX/SIMD state */
     int num_callee_save_regs; /* number of regs callee saved */
     bool callee_save_regs[NUM_GP_REGS]; /* callee-save registers */
     bool has_locals;          /* if reference local via stack */
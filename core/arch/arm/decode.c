@@ -2462,6 +2462,20 @@ decode_opcode(dcontext_t *dcontext, byte *pc, instr_t *instr)
     return pc;
 }
 
+byte *
+decode_opcode_only(dcontext_t *dcontext, byte *pc, OUT int *opcode)
+{
+    const instr_info_t *info;
+    decode_info_t di;
+    pc = read_instruction(dcontext, pc, pc, &info, &di _IF_DEBUG(false));
+    if (pc == NULL || info->type == OP_INVALID) {
+        *opcode = OP_INVALID;
+        return NULL;
+    }
+    *opcode = info->type;
+    return pc;
+}
+
 /* XXX: some of this code could be shared with x86/decode.c */
 static byte *
 decode_common(dcontext_t *dcontext, byte *pc, byte *orig_pc, instr_t *instr)
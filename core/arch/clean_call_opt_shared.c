@@ -85,6 +85,7 @@ callee_info_init(callee_info_t *ci)
         ci->simd_used[i] = true;
     for (i = 0; i < NUM_GP_REGS; i++)
         ci->reg_used[i] = true;
+    ci->fp_used = true;
     ci->spill_reg = DR_REG_INVALID;
 }
 
@@ -420,6 +421,53 @@ analyze_callee_pick_spill_reg(dcontext_t *dcontext, callee_info_t *ci)
     ci->spill_reg = DR_REG_INVALID;
 }
 
+/* Points the callee's intra-function branches at their target instrs so they
+ * survive cloning at each call site.  By now the frame setup, stack adjustments
+ * and return have been removed: a branch to one of those goes to the next
+ * remaining instr, or to a label ending the inlined code.
+ */
+static bool
+retarget_callee_branches(dcontext_t *dcontext, callee_info_t *ci)
+{
+    instr_t *cti, *tgt, *end = NULL;
+    app_pc tgt_pc;
+    for (cti  = instrlist_first(ci->ilist);
+         cti != NULL;
+         cti  = instr_get_next(cti)) {
+        if (!instr_is_cti(cti) || !opnd_is_pc(instr_get_target(cti)))
+            continue;
+#ifdef X86
+        /* These have no 32-bit form, and inlining may push the target out of
+         * range of an 8-bit one.
+         */
+        if (instr_is_cti_loop(cti)) {
+            LOG(THREAD, LOG_CLEANCALL, 1,
+                "CLEANCALL: callee "PFX" cannot be inlined: loop or jecxz at "PFX".\n",
+                ci->start, instr_get_app_pc(cti));
+            return false;
+        }
+        convert_to_near_rel(dcontext, cti);
+#endif
+        tgt_pc = opnd_get_pc(instr_get_target(cti));
+        /* the list is still in callee address order */
+        for (tgt  = instrlist_first(ci->ilist);
+             tgt != NULL;
+             tgt  = instr_get_next(tgt)) {
+            if (instr_get_app_pc(tgt) != NULL && instr_get_app_pc(tgt) >= tgt_pc)
+                break;
+        }
+        if (tgt == NULL) {
+            if (end == NULL) {
+                end = INSTR_CREATE_label(GLOBAL_DCONTEXT);
+                instrlist_append(ci->ilist, end);
+            }
+            tgt = end;
+        }
+        instr_set_target(cti, opnd_create_instr(tgt));
+    }
+    return true;
+}
+
 static void
 analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
 {
@@ -436,36 +484,43 @@ analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
         LOG(THREAD, LOG_CLEANCALL, 1,
             "CLEANCALL: callee "PFX" cannot be inlined: num of instrs: %d.\n",
             ci->start, ci->num_instrs);
+        STATS_INC(cleancall_noinline_size);
         opt_inline = false;
     }
-    if (ci->bwd_tgt != NULL || ci->fwd_tgt != NULL) {
+    /* Forward branches, which never form loops, are supported on x86. */
+    if (ci->bwd_tgt != NULL IF_X86_ELSE(, || ci->fwd_tgt != NULL)) {
         LOG(THREAD, LOG_CLEANCALL, 1,
             "CLEANCALL: callee "PFX" cannot be inlined: has control flow.\n",
             ci->start);
+        STATS_INC(cleancall_noinline_cti);
         opt_inline = false;
     }
     if (ci->num_simd_used != 0) {
         LOG(THREAD, LOG_CLEANCALL, 1,
             "CLEANCALL: callee "PFX" cannot be inlined: uses XMM.\n",
             ci->start);
+        STATS_INC(cleancall_noinline_simd);
         opt_inline = false;
     }
     if (ci->tls_used) {
         LOG(THREAD, LOG_CLEANCALL, 1,
             "CLEANCALL: callee "PFX" cannot be inlined: accesses TLS.\n",
             ci->start);
+        STATS_INC(cleancall_noinline_tls);
         opt_inline = false;
     }
     if (ci->spill_reg == DR_REG_INVALID) {
         LOG(THREAD, LOG_CLEANCALL, 1,
             "CLEANCALL: callee "PFX" cannot be inlined:"
             " unable to pick spill reg.\n", ci->start);
+        STATS_INC(cleancall_noinline_slots);
         opt_inline = false;
     }
     if (!SCRATCH_ALWAYS_TLS() || ci->slots_used > CLEANCALL_NUM_INLINE_SLOTS) {
         LOG(THREAD, LOG_CLEANCALL, 1,
             "CLEANCALL: callee "PFX" cannot be inlined:"
             " not enough scratch slots.\n", ci->start);
+        STATS_INC(cleancall_noinline_slots);
         opt_inline = false;
     }
     if (!opt_inline) {
@@ -475,8 +530,13 @@ analyze_callee_inline(dcontext_t *dcontext, callee_info_t *ci)
     }
 
     /* Check if possible for inline, and convert memory references */
-    if (!check_callee_ilist_inline(dcontext, ci))
+    if (!check_callee_ilist_inline(dcontext, ci)) {
+        STATS_INC(cleancall_noinline_stack);
         opt_inline = false;
+    } else if (!retarget_callee_branches(dcontext, ci)) {
+        STATS_INC(cleancall_noinline_cti);
+        opt_inline = false;
+    }
 
     if (opt_inline) {
         ci->opt_inline = true;
@@ -530,6 +590,16 @@ analyze_clean_call_regs(dcontext_t *dcontext, clean_call_info_t *cci)
     }
     if (INTERNAL_OPTION(opt_cleancall) > 2 && cci->num_simd_skip != NUM_SIMD_REGS)
         cci->should_align = false;
+    /* The callee was fully decoded, so if it never touches the floating-point
+     * state there is nothing for a full fpstate save to preserve.
+     */
+    if (cci->save_fpstate && !info->fp_used) {
+        LOG(THREAD, LOG_CLEANCALL, 3,
+            "CLEANCALL: if inserting clean call "PFX
+            ", skip saving fpstate.\n", info->start);
+        STATS_INC(cleancall_fpstate_skipped);
+        cci->save_fpstate = false;
+    }
     /* 2. general purpose registers */
     /* set regs not to be saved for clean call */
     for (i = 0; i < NUM_GP_REGS; i++) {
@@ -628,6 +698,7 @@ analyze_clean_call_inline(dcontext_t *dcontext, clean_call_info_t *cci)
         LOG(THREAD, LOG_CLEANCALL, 2,
             "CLEANCALL: fail inlining clean call "PFX", number of args %d > 1.\n",
             info->start, cci->num_args);
+        STATS_INC(cleancall_noinline_args);
         opt_inline = false;
     }
     if (cci->num_args > info->num_args) {
@@ -635,12 +706,14 @@ analyze_clean_call_inline(dcontext_t *dcontext, clean_call_info_t *cci)
             "CLEANCALL: fail inlining clean call "PFX
             ", number of args increases.\n",
             info->start);
+        STATS_INC(cleancall_noinline_args);
         opt_inline = false;
     }
     if (cci->save_fpstate) {
         LOG(THREAD, LOG_CLEANCALL, 2,
             "CLEANCALL: fail inlining clean call "PFX", saving fpstate.\n",
             info->start);
+        STATS_INC(cleancall_noinline_fpstate);
         opt_inline = false;
     }
     if (!info->opt_inline) {
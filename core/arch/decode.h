@@ -475,6 +475,32 @@ DR_UNS_API
 byte *
 decode_opcode(dcontext_t *dcontext, byte *pc, instr_t *instr);
 
+DR_API
+/**
+ * Decodes only enough of the instruction at address \p pc to determine its
+ * opcode, which is returned in \p opcode as an OP_ constant.  No #instr_t is
+ * involved, making this much cheaper than decode() for tools that only need
+ * the opcode.  The instruction's length is the difference between the
+ * returned address and \p pc.
+ * Returns the address of the next byte after the decoded instruction.
+ * Returns NULL on decoding an invalid instruction and sets \p opcode to
+ * OP_INVALID.
+ */
+byte *
+decode_opcode_only(dcontext_t *dcontext, byte *pc, OUT int *opcode);
+
+DR_API
+/**
+ * Decodes the opcodes, as decode_opcode_only() does, of consecutive instructions
+ * starting at \p start and ending before \p end, storing up to \p max_count of
+ * them in \p opcodes.  If \p lengths is non-NULL, the length of each instruction
+ * is stored there as well.  Stops early at an invalid instruction or one that
+ * extends past \p end.  Returns the number of instructions decoded.
+ */
+uint
+decode_opcodes(dcontext_t *dcontext, byte *start, byte *end, OUT int *opcodes,
+               OUT byte *lengths, uint max_count);
+
 DR_API
 /**
  * Decodes the instruction at address \p pc into \p instr, filling in the
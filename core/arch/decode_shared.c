@@ -303,6 +303,24 @@ dr_get_isa_mode(dcontext_t *dcontext)
         return dcontext->isa_mode;
 }
 
+uint
+decode_opcodes(dcontext_t *dcontext, byte *start, byte *end, OUT int *opcodes,
+               OUT byte *lengths, uint max_count)
+{
+    byte *pc = start;
+    uint count = 0;
+    while (count < max_count && pc < end) {
+        byte *next_pc = decode_opcode_only(dcontext, pc, &opcodes[count]);
+        if (next_pc == NULL || next_pc > end)
+            break;
+        if (lengths != NULL)
+            lengths[count] = (byte)(next_pc - pc);
+        count++;
+        pc = next_pc;
+    }
+    return count;
+}
+
 #ifdef DEBUG
 void
 decode_debug_checks(void)
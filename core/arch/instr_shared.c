@@ -99,6 +99,44 @@ instr_create(dcontext_t *dcontext)
     return instr;
 }
 
+/* The dst array and the array of srcs beyond src0 share a single allocation, with
+ * the srcs immediately following the dsts.  This halves the heap operations per
+ * decoded instr and keeps its operands together in the cache.
+ */
+static inline uint
+instr_opnds_alloc_count(uint num_dsts, uint num_srcs)
+{
+    /* remember that src0 is static, rest are dynamic */
+    return num_dsts + (num_srcs > 1 ? num_srcs - 1 : 0);
+}
+
+/* Allocates operand storage for the given counts and points instr's dsts and srcs
+ * into it.  Does not set the counts themselves.
+ */
+static void
+instr_opnds_alloc(dcontext_t *dcontext, instr_t *instr, uint num_dsts, uint num_srcs)
+{
+    uint count = instr_opnds_alloc_count(num_dsts, num_srcs);
+    opnd_t *opnds = NULL;
+    if (count > 0)
+        opnds = (opnd_t *) heap_alloc(dcontext, count*sizeof(opnd_t) HEAPACCT(ACCT_IR));
+    if (num_dsts > 0)
+        instr->dsts = opnds;
+    if (num_srcs > 1)
+        instr->srcs = opnds + num_dsts;
+}
+
+/* Frees the storage from instr_opnds_alloc(), given instr's current counts. */
+static void
+instr_opnds_free(dcontext_t *dcontext, instr_t *instr)
+{
+    uint count = instr_opnds_alloc_count(instr->num_dsts, instr->num_srcs);
+    if (count > 0) {
+        opnd_t *opnds = instr->num_dsts > 0 ? instr->dsts : instr->srcs;
+        heap_free(dcontext, opnds, count*sizeof(opnd_t) HEAPACCT(ACCT_IR));
+    }
+}
+
 /* deletes the instr_t object with handle "inst" and frees its storage */
 void
 instr_destroy(dcontext_t *dcontext, instr_t *instr)
@@ -136,21 +174,20 @@ instr_clone(dcontext_t *dcontext, instr_t *orig)
         instrlist_t *existing = (instrlist_t *) orig->dsts;
         CLIENT_ASSERT(existing != NULL, "instr_clone: src has inconsistent custom stub");
         instr->dsts = (opnd_t *) instrlist_clone(dcontext, existing);
+        /* a custom stub implies no dsts, so the block below only holds srcs */
     }
-    else /* disable normal dst cloning */
 #endif
-    if (orig->num_dsts > 0) { /* checking num_dsts, not dsts, b/c of label data */
-        instr->dsts = (opnd_t *) heap_alloc(dcontext, instr->num_dsts*sizeof(opnd_t)
-                                          HEAPACCT(ACCT_IR));
-        memcpy((void *)instr->dsts, (void *)orig->dsts,
-               instr->num_dsts*sizeof(opnd_t));
-    }
-    if (orig->num_srcs > 1) { /* checking num_src, not srcs, b/c of label data */
-        instr->srcs = (opnd_t *) heap_alloc(dcontext,
-                                          (instr->num_srcs-1)*sizeof(opnd_t)
-                                          HEAPACCT(ACCT_IR));
-        memcpy((void *)instr->srcs, (void *)orig->srcs,
-               (instr->num_srcs-1)*sizeof(opnd_t));
+    /* checking the counts, not dsts and srcs, b/c of label data */
+    if (instr_opnds_alloc_count(orig->num_dsts, orig->num_srcs) > 0) {
+        instr_opnds_alloc(dcontext, instr, orig->num_dsts, orig->num_srcs);
+        if (orig->num_dsts > 0) {
+            memcpy((void *)instr->dsts, (void *)orig->dsts,
+                   instr->num_dsts*sizeof(opnd_t));
+        }
+        if (orig->num_srcs > 1) {
+            memcpy((void *)instr->srcs, (void *)orig->srcs,
+                   (instr->num_srcs-1)*sizeof(opnd_t));
+        }
     }
     /* copy note (we make no guarantee, and have no way, to do a deep clone) */
     instr->note = orig->note;
@@ -187,18 +224,17 @@ instr_free(dcontext_t *dcontext, instr_t *instr)
         instr->dsts = NULL;
     }
 #endif
-    if (instr->num_dsts > 0) { /* checking num_dsts, not dsts, b/c of label data */
-        heap_free(dcontext, instr->dsts, instr->num_dsts*sizeof(opnd_t)
-                  HEAPACCT(ACCT_IR));
-        instr->dsts = NULL;
-        instr->num_dsts = 0;
-    }
-    if (instr->num_srcs > 1) { /* checking num_src, not src, b/c of label data */
-        /* remember one src is static, rest are dynamic */
-        heap_free(dcontext, instr->srcs, (instr->num_srcs-1)*sizeof(opnd_t)
-                  HEAPACCT(ACCT_IR));
-        instr->srcs = NULL;
-        instr->num_srcs = 0;
+    /* checking the counts, not dsts and srcs, b/c of label data */
+    if (instr_opnds_alloc_count(instr->num_dsts, instr->num_srcs) > 0) {
+        instr_opnds_free(dcontext, instr);
+        if (instr->num_dsts > 0) {
+            instr->dsts = NULL;
+            instr->num_dsts = 0;
+        }
+        if (instr->num_srcs > 1) {
+            instr->srcs = NULL;
+            instr->num_srcs = 0;
+        }
     }
 }
 
@@ -316,9 +352,33 @@ instr_build_bits(dcontext_t *dcontext, int opcode, uint num_bytes)
     return instr;
 }
 
+#ifdef X86
+/* Returns whether instr encodes to the same bytes wherever it is placed:
+ * no cti, no pc or instr_t operands, and no absolute or relative address
+ * that the encoder may turn into (or keep as) a rip-relative reference.
+ */
+static bool
+instr_encoding_is_position_independent(instr_t *instr)
+{
+    int i;
+    if (instr_is_cti(instr) || instr_is_label(instr))
+        return false;
+    for (i = 0; i < instr_num_dsts(instr) + instr_num_srcs(instr); i++) {
+        opnd_t opnd = (i < instr_num_dsts(instr)) ? instr_get_dst(instr, i) :
+            instr_get_src(instr, i - instr_num_dsts(instr));
+        if (!opnd_is_reg(opnd) && !opnd_is_immed(opnd) && !opnd_is_base_disp(opnd))
+            return false;
+    }
+    return true;
+}
+#endif
+
 /* encodes to buffer, then returns length.
  * needed for things we must have encoding for: length and eflags.
- * if !always_cache, only caches the encoding if instr_is_app();
+ * if !always_cache, only caches the encoding if instr_is_app(), or on x86 if
+ * the encoding is position-independent (as for the spills, restores and other
+ * DR-generated instrs whose length is computed before they are emitted, so
+ * that emitting just copies the bytes);
  * if always_cache, the caller should invalidate the cache when done.
  */
 static int
@@ -362,7 +422,9 @@ private_instr_encode(dcontext_t *dcontext, instr_t *instr, bool always_cache)
      * sets instr_set_rip_rel_pos() for us.
      */
     if (len > 0 &&
-        ((valid_to_cache && instr_is_app(instr)) ||
+        ((valid_to_cache &&
+          (instr_is_app(instr)
+           IF_X86(|| instr_encoding_is_position_independent(instr)))) ||
          always_cache /*caller will use then invalidate*/)) {
         bool valid = instr_operands_valid(instr);
 #ifdef X86_64
@@ -531,22 +593,24 @@ instr_set_num_opnds(dcontext_t *dcontext,
                       "instr_set_num_opnds: dsts are already set");
         CLIENT_ASSERT_TRUNCATE(instr->num_dsts, byte, instr_num_dsts,
                                "instr_set_num_opnds: too many dsts");
-        instr->num_dsts = (byte) instr_num_dsts;
-        instr->dsts = (opnd_t *) heap_alloc(dcontext, instr_num_dsts*sizeof(opnd_t)
-                                          HEAPACCT(ACCT_IR));
+    }
+    if (instr_num_srcs > 1) {
+        CLIENT_ASSERT(instr->num_srcs <= 1 && instr->srcs == NULL,
+                      "instr_set_num_opnds: srcs are already set");
     }
     if (instr_num_srcs > 0) {
-        /* remember that src0 is static, rest are dynamic */
-        if (instr_num_srcs > 1) {
-            CLIENT_ASSERT(instr->num_srcs <= 1 && instr->srcs == NULL,
-                          "instr_set_num_opnds: srcs are already set");
-            instr->srcs = (opnd_t *)
-                heap_alloc(dcontext, (instr_num_srcs-1)*sizeof(opnd_t) HEAPACCT(ACCT_IR));
-        }
         CLIENT_ASSERT_TRUNCATE(instr->num_srcs, byte, instr_num_srcs,
                                "instr_set_num_opnds: too many srcs");
-        instr->num_srcs = (byte) instr_num_srcs;
     }
+    /* Both arrays come from one allocation, so they must be sized together. */
+    CLIENT_ASSERT(instr_opnds_alloc_count(instr_num_dsts, instr_num_srcs) == 0 ||
+                  instr_opnds_alloc_count(instr->num_dsts, instr->num_srcs) == 0,
+                  "instr_set_num_opnds: operands are already set");
+    instr_opnds_alloc(dcontext, instr, instr_num_dsts, instr_num_srcs);
+    if (instr_num_dsts > 0)
+        instr->num_dsts = (byte) instr_num_dsts;
+    if (instr_num_srcs > 0)
+        instr->num_srcs = (byte) instr_num_srcs;
     instr_being_modified(instr, false/*raw bits invalid*/);
     /* assume all operands are valid */
     instr_set_operands_valid(instr, true);
@@ -580,58 +644,61 @@ instr_set_dst(instr_t *instr, uint pos, opnd_t opnd)
     instr_set_operands_valid(instr, true);
 }
 
+/* Moves instr's operands into fresh storage sized for new_num_dsts and
+ * new_num_srcs, keeping all but dsts [dst_start, dst_end) and srcs
+ * [src_start, src_end).
+ */
+static void
+instr_remove_opnds(dcontext_t *dcontext, instr_t *instr, uint dst_start, uint dst_end,
+                   uint src_start, uint src_end)
+{
+    instr_t old = *instr;
+    uint new_num_dsts = instr->num_dsts - (dst_end - dst_start);
+    uint new_num_srcs = instr->num_srcs - (src_end - src_start);
+    uint i, j;
+    /* dsts is a custom stub list if there are no dsts */
+    if (old.num_dsts > 0)
+        instr->dsts = NULL;
+    if (old.num_srcs > 1)
+        instr->srcs = NULL;
+    instr_opnds_alloc(dcontext, instr, new_num_dsts, new_num_srcs);
+    for (i = 0, j = 0; i < old.num_dsts; i++) {
+        if (i < dst_start || i >= dst_end)
+            instr->dsts[j++] = old.dsts[i];
+    }
+    for (i = 0, j = 0; i < old.num_srcs; i++) {
+        if (i >= src_start && i < src_end)
+            continue;
+        /* remember that src0 is static, rest are dynamic */
+        if (j == 0)
+            instr->src0 = (i == 0) ? old.src0 : old.srcs[i - 1];
+        else
+            instr->srcs[j - 1] = (i == 0) ? old.src0 : old.srcs[i - 1];
+        j++;
+    }
+    instr_opnds_free(dcontext, &old);
+    instr->num_dsts = (byte) new_num_dsts;
+    instr->num_srcs = (byte) new_num_srcs;
+    instr_being_modified(instr, false/*raw bits invalid*/);
+    instr_set_operands_valid(instr, true);
+}
+
 /* end is open-ended (so pass pos,pos+1 to remove just the pos-th src) */
 void
 instr_remove_srcs(dcontext_t *dcontext, instr_t *instr, uint start, uint end)
 {
-    opnd_t *new_srcs;
     CLIENT_ASSERT(start >= 0 && end <= instr->num_srcs && start < end,
                   "instr_remove_srcs: ordinals invalid");
-    if (instr->num_srcs - 1 > (byte)(end - start)) {
-        new_srcs = (opnd_t *) heap_alloc
-            (dcontext, (instr->num_srcs - 1 - (end-start))*sizeof(opnd_t)
-             HEAPACCT(ACCT_IR));
-        if (start > 1)
-            memcpy(new_srcs, instr->srcs, (start-1)*sizeof(opnd_t));
-        if ((byte)end < instr->num_srcs - 1) {
-            memcpy(new_srcs + (start == 0 ? 0 : (start-1)), instr->srcs + end,
-                   (instr->num_srcs - 1 - end)*sizeof(opnd_t));
-        }
-    } else
-        new_srcs = NULL;
-    if (start == 0 && end < instr->num_srcs)
-        instr->src0 = instr->srcs[end - 1];
-    heap_free(dcontext, instr->srcs, (instr->num_srcs-1)*sizeof(opnd_t)
-              HEAPACCT(ACCT_IR));
-    instr->num_srcs -= (byte)(end - start);
-    instr->srcs = new_srcs;
-    instr_being_modified(instr, false/*raw bits invalid*/);
-    instr_set_operands_valid(instr, true);
+    instr_remove_opnds(dcontext, instr, 0, 0, start, end);
 }
 
 /* end is open-ended (so pass pos,pos+1 to remove just the pos-th dst) */
 void
 instr_remove_dsts(dcontext_t *dcontext, instr_t *instr, uint start, uint end)
 {
-    opnd_t *new_dsts;
     CLIENT_ASSERT(start >= 0 && end <= instr->num_dsts && start < end,
                   "instr_remove_dsts: ordinals invalid");
-    if (instr->num_dsts > (byte)(end - start)) {
-        new_dsts = (opnd_t *) heap_alloc
-            (dcontext, (instr->num_dsts - (end-start))*sizeof(opnd_t) HEAPACCT(ACCT_IR));
-        if (start > 0)
-            memcpy(new_dsts, instr->dsts, start*sizeof(opnd_t));
-        if (end < instr->num_dsts) {
-            memcpy(new_dsts + start, instr->dsts + end,
-                   (instr->num_dsts - end)*sizeof(opnd_t));
-        }
-    } else
-        new_dsts = NULL;
-    heap_free(dcontext, instr->dsts, instr->num_dsts*sizeof(opnd_t) HEAPACCT(ACCT_IR));
-    instr->num_dsts -= (byte)(end - start);
-    instr->dsts = new_dsts;
-    instr_being_modified(instr, false/*raw bits invalid*/);
-    instr_set_operands_valid(instr, true);
+    instr_remove_opnds(dcontext, instr, start, end, 0, 0);
 }
 
 #undef instr_get_target
@@ -215,12 +215,16 @@ typedef struct {
     bool native_call;        /* the gateway is a call */
 #ifdef CLIENT_INTERFACE
     instrlist_t **unmangled_ilist; /* PR 299808: clone ilist pre-mangling */
+    uint client_bytes;       /* -cache_size_breakdown: size of client meta instrs */
 #endif
 
     /* internal usage only */
     bool full_decode;        /* decode every instruction into a separate instr_t? */
     bool follow_direct;      /* elide unconditional branches? */
     bool check_vm_area;      /* whether to call check_thread_vm_area() */
+#ifdef ANNOTATIONS
+    bool check_annotations;  /* whether DR annotations may be present */
+#endif
     uint num_elide_jmp;
     uint num_elide_call;
     app_pc last_page;
@@ -2823,6 +2827,15 @@ client_process_bb(dcontext_t *dcontext, build_bb_t *bb)
 
     bb->post_client = true;
 
+    if (bb->for_cache && DYNAMO_OPTION(cache_size_breakdown)) {
+        bb->client_bytes = 0;
+        for (inst = instrlist_first(bb->ilist); inst != NULL;
+             inst = instr_get_next(inst)) {
+            if (instr_is_meta(inst) && instr_ok_to_emit(inst))
+                bb->client_bytes += instr_length(dcontext, inst);
+        }
+    }
+
     /* FIXME: instrumentor may totally mess us up -- our flags
      * or syscall info might be wrong.  xref PR 215217
      */
@@ -3329,6 +3342,13 @@ build_bb_ilist(dcontext_t *dcontext, build_bb_t *bb)
 #endif
     }
 
+#ifdef ANNOTATIONS
+    /* Looked up once per block: a block crossing into a different module is
+     * rare, and a missed annotation just runs its native version.
+     */
+    bb->check_annotations = annotation_possible_in_module(bb->start_pc);
+#endif
+
     LOG(THREAD, LOG_INTERP, 3, "\ninterp%s: ",
         IF_X86_64_ELSE(X64_MODE_DC(dcontext) ? "" : " (x86 mode)", ""));
     BBPRINT(bb, 3, "start_pc = "PFX"\n", bb->start_pc);
@@ -3687,7 +3707,7 @@ build_bb_ilist(dcontext_t *dcontext, build_bb_t *bb)
             }
         } else /* Top-level annotation recognition is unambiguous (xchg vs. jmp). */
 # endif
-        if (is_annotation_jump_over_dead_code(bb->instr)) {
+        if (bb->check_annotations && is_annotation_jump_over_dead_code(bb->instr)) {
             instr_t *substitution = NULL;
             if (instrument_annotation(dcontext, &bb->cur_pc, &substitution
                                       _IF_WINDOWS_X64(bb->cur_pc < bb->checked_end))) {
@@ -4229,7 +4249,9 @@ build_bb_ilist(dcontext_t *dcontext, build_bb_t *bb)
      * bbs injected with hot patches are also not shared (see case 5272).
      */
     if (DYNAMO_OPTION(shared_bbs) && !TEST(FRAG_SELFMOD_SANDBOXED, bb->flags) &&
-        !TEST(FRAG_TEMP_PRIVATE, bb->flags)
+        !TEST(FRAG_TEMP_PRIVATE, bb->flags) &&
+        /* built without the bb_building_lock: -private_bbs_on_contention */
+        !(bb->for_cache && dcontext->bb_build_unshared)
 #ifdef HOT_PATCHING_INTERFACE
         && !hotp_injected
 #endif
@@ -4483,6 +4505,7 @@ bb_build_abort(dcontext_t *dcontext, bool clean_vmarea, bool unlock)
                 ASSERT_DO_NOT_OWN_MUTEX(USE_BB_BUILDING_LOCK(), &bb_building_lock);
         }
         dcontext->bb_build_info = NULL;
+        dcontext->bb_build_unshared = false;
     }
 }
 
@@ -4835,7 +4858,8 @@ build_native_exec_bb(dcontext_t *dcontext, build_bb_t *bb)
     instrlist_append(bb->ilist, XINST_CREATE_jump(dcontext,
                                                   opnd_create_pc(bb->start_pc)));
 
-    if (DYNAMO_OPTION(shared_bbs) && !TEST(FRAG_TEMP_PRIVATE, bb->flags))
+    if (DYNAMO_OPTION(shared_bbs) && !TEST(FRAG_TEMP_PRIVATE, bb->flags) &&
+        !dcontext->bb_build_unshared)
         bb->flags |= FRAG_SHARED;
 
     /* Can't be coarse-grain since has non-exit cti */
@@ -5062,7 +5086,8 @@ init_interp_build_bb(dcontext_t *dcontext, build_bb_t *bb, app_pc start,
                      _IF_CLIENT(bool for_trace)
                      _IF_CLIENT(instrlist_t **unmangled_ilist))
 {
-    ASSERT_OWN_MUTEX(USE_BB_BUILDING_LOCK() && !TEST(FRAG_TEMP_PRIVATE, initial_flags),
+    ASSERT_OWN_MUTEX(USE_BB_BUILDING_LOCK() && !TEST(FRAG_TEMP_PRIVATE, initial_flags) &&
+                     !dcontext->bb_build_unshared,
                      &bb_building_lock);
     /* We need to set up for abort prior to native exec and other checks
      * that can crash */
@@ -5076,7 +5101,7 @@ init_interp_build_bb(dcontext_t *dcontext, build_bb_t *bb, app_pc start,
                   INVALID_FILE, initial_flags |
                   (INTERNAL_OPTION(store_translations) ?
                    FRAG_HAS_TRANSLATION_INFO : 0), NULL/*no overlap*/);
-    if (!TEST(FRAG_TEMP_PRIVATE, initial_flags))
+    if (!TEST(FRAG_TEMP_PRIVATE, initial_flags) && !dcontext->bb_build_unshared)
         bb->has_bb_building_lock = true;
 #ifdef CLIENT_INTERFACE
     /* We avoid races where there is no hook when we start building a
@@ -5215,6 +5240,10 @@ build_basic_block_fragment(dcontext_t *dcontext, app_pc start, uint initial_flag
     KSTART(bb_emit);
     f = emit_fragment_ex(dcontext, start, bb.ilist, bb.flags, bb.vmlist, link, visible);
     KSTOP(bb_emit);
+#ifdef CLIENT_INTERFACE
+    if (DYNAMO_OPTION(cache_size_breakdown))
+        RSTATS_ADD(cache_bb_client_bytes, bb.client_bytes);
+#endif
 
 #ifdef CUSTOM_TRACES_RET_REMOVAL
     f->num_calls = dcontext->num_calls;
@@ -5891,15 +5920,26 @@ mangle_x64_ib_in_trace(dcontext_t *dcontext, instrlist_t *trace,
                        instr_t *targeter, app_pc next_tag)
 {
     int added_size = 0;
+    /* When the tag fits in a sign-extended 32-bit immediate we compare against
+     * it directly, avoiding the materialization of the tag in xax and its
+     * round trip through the xbx tls slot.  Nothing past the jne reads that
+     * slot before the exit stub or the ibl overwrites it.
+     */
+    bool cmp_immed = X64_MODE_DC(dcontext) &&
+        CHECK_TRUNCATE_TYPE_int((ptr_int_t)next_tag);
     if (X64_MODE_DC(dcontext) || !DYNAMO_OPTION(x86_to_x64_ibl_opt)) {
         added_size += tracelist_add
             (dcontext, trace, targeter, INSTR_CREATE_mov_st
              (dcontext, opnd_create_tls_slot(os_tls_offset(PREFIX_XAX_SPILL_SLOT)),
               opnd_create_reg(REG_XAX)));
-        added_size += tracelist_add
-            (dcontext, trace, targeter, INSTR_CREATE_mov_imm
-             (dcontext, opnd_create_reg(REG_XAX),
-              OPND_CREATE_INTPTR((ptr_int_t)next_tag)));
+        if (cmp_immed)
+            STATS_INC(trace_ib_cmp_immed);
+        else {
+            added_size += tracelist_add
+                (dcontext, trace, targeter, INSTR_CREATE_mov_imm
+                 (dcontext, opnd_create_reg(REG_XAX),
+                  OPND_CREATE_INTPTR((ptr_int_t)next_tag)));
+        }
     } else {
         ASSERT(X64_CACHE_MODE_DC(dcontext));
         added_size += tracelist_add
@@ -5914,7 +5954,8 @@ mangle_x64_ib_in_trace(dcontext_t *dcontext, instrlist_t *trace,
      * -unsafe_ignore_eflags_{trace,ibl} must be equivalent
      */
     if (!INTERNAL_OPTION(unsafe_ignore_eflags_trace)) {
-        if (X64_MODE_DC(dcontext) || !DYNAMO_OPTION(x86_to_x64_ibl_opt)) {
+        if (!cmp_immed &&
+            (X64_MODE_DC(dcontext) || !DYNAMO_OPTION(x86_to_x64_ibl_opt))) {
             added_size += tracelist_add
                 (dcontext, trace, targeter, INSTR_CREATE_mov_st
                  (dcontext, opnd_create_tls_slot
@@ -5930,7 +5971,12 @@ mangle_x64_ib_in_trace(dcontext_t *dcontext, instrlist_t *trace,
                 (dcontext, trace, targeter,
                  INSTR_CREATE_setcc(dcontext, OP_seto, opnd_create_reg(REG_AL)));
         }
-        if (X64_MODE_DC(dcontext) || !DYNAMO_OPTION(x86_to_x64_ibl_opt)) {
+        if (cmp_immed) {
+            added_size += tracelist_add
+                (dcontext, trace, targeter,
+                 INSTR_CREATE_cmp(dcontext, opnd_create_reg(REG_XCX),
+                                  OPND_CREATE_INT32((int)(ptr_int_t)next_tag)));
+        } else if (X64_MODE_DC(dcontext) || !DYNAMO_OPTION(x86_to_x64_ibl_opt)) {
             added_size += tracelist_add
                 (dcontext, trace, targeter,
                  INSTR_CREATE_cmp(dcontext, opnd_create_reg(REG_XCX),
@@ -5942,6 +5988,11 @@ mangle_x64_ib_in_trace(dcontext_t *dcontext, instrlist_t *trace,
                  INSTR_CREATE_cmp(dcontext, opnd_create_reg(REG_XCX),
                                   opnd_create_reg(REG_R10)));
         }
+    } else if (cmp_immed) {
+        added_size += tracelist_add
+            (dcontext, trace, targeter,
+             INSTR_CREATE_cmp(dcontext, opnd_create_reg(REG_XCX),
+                              OPND_CREATE_INT32((int)(ptr_int_t)next_tag)));
     } else {
         added_size += tracelist_add
             (dcontext, trace, targeter,
@@ -5963,6 +6014,42 @@ mangle_x64_ib_in_trace(dcontext_t *dcontext, instrlist_t *trace,
                                INSTR_TRACE_CMP_EXIT);
     return added_size;
 }
+
+/* Undoes the eflags and xax spills of mangle_x64_ib_in_trace() on the path where
+ * the comparison matched, ahead of the code with flags next_flags.
+ * Returns the size of instructions added to trace.
+ */
+static int
+insert_restore_x64_ib_cmp_state(dcontext_t *dcontext, instrlist_t *trace,
+                                instr_t *next, uint next_flags)
+{
+    int added_size = 0;
+    if (!TEST(FRAG_WRITES_EFLAGS_6, next_flags) &&
+        !INTERNAL_OPTION(unsafe_ignore_eflags_trace)) {
+        if (!TEST(FRAG_WRITES_EFLAGS_OF, next_flags) &&  /* OF was saved */
+            !INTERNAL_OPTION(unsafe_ignore_overflow)) {
+            /* restore OF using add that overflows if OF was on when we did seto */
+            added_size += tracelist_add
+                (dcontext, trace, next, INSTR_CREATE_add
+                 (dcontext, opnd_create_reg(REG_AL), OPND_CREATE_INT8(0x7f)));
+        }
+        added_size += tracelist_add
+            (dcontext, trace, next, INSTR_CREATE_sahf(dcontext));
+    } else
+        STATS_INC(trace_ib_no_flag_restore);
+    /* TODO optimization: check if xax is live or not in next bb */
+    if (X64_MODE_DC(dcontext) || !DYNAMO_OPTION(x86_to_x64_ibl_opt)) {
+        added_size += tracelist_add
+            (dcontext, trace, next, INSTR_CREATE_mov_ld
+             (dcontext, opnd_create_reg(REG_XAX),
+              opnd_create_tls_slot(os_tls_offset(PREFIX_XAX_SPILL_SLOT))));
+    } else {
+        added_size += tracelist_add
+            (dcontext, trace, next, INSTR_CREATE_mov_ld
+             (dcontext, opnd_create_reg(REG_XAX), opnd_create_reg(REG_R8)));
+    }
+    return added_size;
+}
 #endif
 
 /* Mangles an indirect branch in a trace where a basic block with tag "tag"
@@ -6020,6 +6107,8 @@ mangle_indirect_branch_in_trace(dcontext_t *dcontext, instrlist_t *trace,
      *         cmp xcx, xbx-tls-spill-slot
      *       else
      *         cmp xcx, xax
+     *     where if staytarget fits in a sign-extended 32-bit immediate we drop the
+     *     mov of it into xax and its spill and instead use cmp xcx, $staytarget
      *       jne exit
      *       if xcx live:
      *         mov xcx-tls-spill-slot, xcx
@@ -6143,30 +6232,8 @@ mangle_indirect_branch_in_trace(dcontext_t *dcontext, instrlist_t *trace,
     if (X64_CACHE_MODE_DC(dcontext)) {
         LOG(THREAD, LOG_INTERP, 4, "next_flags for post-ibl-cmp: 0x%x\n",
             next_flags);
-        if (!TEST(FRAG_WRITES_EFLAGS_6, next_flags) &&
-            !INTERNAL_OPTION(unsafe_ignore_eflags_trace)) {
-            if (!TEST(FRAG_WRITES_EFLAGS_OF, next_flags) &&  /* OF was saved */
-                !INTERNAL_OPTION(unsafe_ignore_overflow)) {
-                /* restore OF using add that overflows if OF was on when we did seto */
-                added_size += tracelist_add
-                    (dcontext, trace, next, INSTR_CREATE_add
-                     (dcontext, opnd_create_reg(REG_AL), OPND_CREATE_INT8(0x7f)));
-            }
-            added_size += tracelist_add
-                (dcontext, trace, next, INSTR_CREATE_sahf(dcontext));
-        } else
-            STATS_INC(trace_ib_no_flag_restore);
-        /* TODO optimization: check if xax is live or not in next bb */
-        if (X64_MODE_DC(dcontext) || !DYNAMO_OPTION(x86_to_x64_ibl_opt)) {
-            added_size += tracelist_add
-                (dcontext, trace, next, INSTR_CREATE_mov_ld
-                 (dcontext, opnd_create_reg(REG_XAX),
-                  opnd_create_tls_slot(os_tls_offset(PREFIX_XAX_SPILL_SLOT))));
-        } else {
-            added_size += tracelist_add
-                (dcontext, trace, next, INSTR_CREATE_mov_ld
-                 (dcontext, opnd_create_reg(REG_XAX), opnd_create_reg(REG_R8)));
-        }
+        added_size += insert_restore_x64_ib_cmp_state(dcontext, trace, next,
+                                                      next_flags);
     }
 # endif
 #elif defined(ARM)
@@ -6473,7 +6540,6 @@ append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
     /* XCX holds value to match */
 
     /* should use similar eflags-clobbering scheme to inline cmp */
-    IF_X64(ASSERT_NOT_IMPLEMENTED(false));
     /*
      *    8d 89 76 9b bf ff    lea    -tag(%ecx) -> %ecx
      *    e3 0b                jecxz  continue
@@ -6486,11 +6552,21 @@ append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
      *                        <restore app ecx>
      *    e9 cc aa dd 00       jmp speculate_next_tag
      *
+     * On 64-bit we use the same comparison as for an indirect branch within
+     * a trace (see mangle_indirect_branch_in_trace()), which turns the exit
+     * into a jne to the trace cmp entry of the ibl routine.
      */
 
-    /* leave jmp as it is, a jmp to exit stub (thence to ind br lookup) */
-    added_size +=
-        insert_transparent_comparison(dcontext, trace, where, speculate_next_tag);
+#if defined(X86) && defined(X64)
+    if (X64_CACHE_MODE_DC(dcontext)) {
+        added_size +=
+            mangle_x64_ib_in_trace(dcontext, trace, where, speculate_next_tag);
+        instr_set_our_mangling(where, true);
+    } else
+#endif
+        /* leave jmp as it is, a jmp to exit stub (thence to ind br lookup) */
+        added_size +=
+            insert_transparent_comparison(dcontext, trace, where, speculate_next_tag);
 
 #ifdef HASHTABLE_STATISTICS
     DOSTATS({
@@ -6548,6 +6624,11 @@ append_trace_speculate_last_ibl(dcontext_t *dcontext, instrlist_t *trace,
 
     /* must restore xcx to app value, FIXME: see above for doing this in prefix+stub */
     added_size += insert_restore_spilled_xcx(dcontext, trace, next);
+#if defined(X86) && defined(X64)
+    /* We do not know the target's flags usage, so we restore conservatively. */
+    if (X64_CACHE_MODE_DC(dcontext))
+        added_size += insert_restore_x64_ib_cmp_state(dcontext, trace, next, 0);
+#endif
 
     /* add a new direct exit stub */
     added_size += tracelist_add(dcontext, trace, next,
@@ -65,6 +65,7 @@ analyze_callee_regs_usage(dcontext_t *dcontext, callee_info_t *ci)
     ci->num_simd_used = 0;
     memset(ci->simd_used, 0, sizeof(bool) * NUM_SIMD_REGS);
     memset(ci->reg_used, 0, sizeof(bool) * NUM_GP_REGS);
+    ci->fp_used = false;
     ci->write_flags = false;
     for (instr  = instrlist_first(ilist);
          instr != NULL;
@@ -86,6 +87,13 @@ analyze_callee_regs_usage(dcontext_t *dcontext, callee_info_t *ci)
                 ci->num_simd_used++;
             }
         }
+        /* x87/MMX state, which the SIMD register scan above does not cover */
+        if (!ci->fp_used && (instr_is_floating(instr) || instr_is_mmx(instr))) {
+            LOG(THREAD, LOG_CLEANCALL, 2,
+                "CLEANCALL: callee "PFX" uses fpstate at "PFX"\n",
+                ci->start, instr_get_app_pc(instr));
+            ci->fp_used = true;
+        }
         /* General purpose registers */
         for (i = 0; i < NUM_GP_REGS; i++) {
             reg_id_t reg = DR_REG_XAX + (reg_id_t)i;
@@ -137,6 +145,8 @@ analyze_callee_regs_usage(dcontext_t *dcontext, callee_info_t *ci)
         LOG(THREAD, LOG_CLEANCALL, 2,
             "CLEANCALL: callee "PFX" reads aflags from caller\n", ci->start);
     }
+    if (ci->num_simd_used != 0)
+        ci->fp_used = true;
 
     /* If we read or write aflags, we need to reserve a slot to save them.
      * We may or may not use the slot at the call site, but it needs to be
@@ -1953,6 +1953,24 @@ decode_opcode(dcontext_t *dcontext, byte *pc, instr_t *instr)
     return pc + sz;
 }
 
+byte *
+decode_opcode_only(dcontext_t *dcontext, byte *pc, OUT int *opcode)
+{
+    const instr_info_t *info;
+    decode_info_t di;
+    int sz;
+    IF_X64(di.x86_mode = get_x86_mode(dcontext));
+    /* As in decode_opcode(), decode_sizeof is faster than decoding immeds. */
+    read_instruction(pc, pc, &info, &di, true /* just opcode */ _IF_DEBUG(false));
+    sz = decode_sizeof(dcontext, pc, NULL _IF_X64(NULL));
+    if (sz == 0 || info->type == OP_INVALID) {
+        *opcode = OP_INVALID;
+        return NULL;
+    }
+    *opcode = info->type;
+    return pc + sz;
+}
+
 #if defined(DEBUG) && !defined(STANDALONE_DECODER)
 /* PR 215143: we must resolve variable sizes at decode time */
 static bool
@@ -468,6 +468,10 @@ decode_sizeof(dcontext_t *dcontext, byte *start_pc, int *num_prefixes
     bool found_prefix = true;
     bool rep_prefix = false;
     byte reg_opcode;    /* reg_opcode field of modrm byte */
+    /* Looking up the mode is not free and this routine is called for every
+     * app instr during bb building, so only do it once.
+     */
+    bool x64_mode = X64_MODE_DC(dcontext);
 #ifdef X64
     byte *rip_rel_pc = NULL;
 #endif
@@ -482,7 +486,7 @@ decode_sizeof(dcontext_t *dcontext, byte *start_pc, int *num_prefixes
          * (xref PR 241563 and Intel Manual 2A 2.2.1) is the correct thing to do.
          * Rex prefixes are 0x40-0x4f; >=0x48 has rex.w bit set.
          */
-        if (X64_MODE_DC(dcontext) && opc >= REX_PREFIX_BASE_OPCODE &&
+        if (x64_mode && opc >= REX_PREFIX_BASE_OPCODE &&
             opc <= (REX_PREFIX_BASE_OPCODE | REX_PREFIX_ALL_OPFLAGS)) {
             if (opc >= (REX_PREFIX_BASE_OPCODE | REX_PREFIX_W_OPFLAG)) {
                 qword_operands = true;
@@ -520,7 +524,7 @@ decode_sizeof(dcontext_t *dcontext, byte *start_pc, int *num_prefixes
             case 0xc4:
             case 0xc5: {
                 /* If 64-bit mode or mod selects for register, this is vex */
-                if (X64_MODE_DC(dcontext) || TESTALL(MODRM_BYTE(3, 0, 0), *(pc+1))) {
+                if (x64_mode || TESTALL(MODRM_BYTE(3, 0, 0), *(pc+1))) {
                     /* Assumptions:
                      * - no vex-encoded instr size differs based on vex.w,
                      *   so we don't bother to set qword_operands
@@ -602,20 +606,20 @@ decode_sizeof(dcontext_t *dcontext, byte *start_pc, int *num_prefixes
         /* for x64 Intel, always 64-bit addr ("f64" in Intel table)
          * FIXME: what about 2-byte jcc?
          */
-        if (X64_MODE_DC(dcontext) && proc_get_vendor() == VENDOR_INTEL)
+        if (x64_mode && proc_get_vendor() == VENDOR_INTEL)
             sz += immed_adjustment_intel64[opc];
         else
 #endif
             sz += immed_adjustment[opc]; /* no adjustment for 2-byte escapes */
     }
     if (addr16) {  /* no adjustment for 2-byte escapes */
-        if (X64_MODE_DC(dcontext)) /* from 64 bits down to 32 bits */
+        if (x64_mode) /* from 64 bits down to 32 bits */
             sz += 2*disp_adjustment[opc];
         else /* from 32 bits down to 16 bits */
             sz += disp_adjustment[opc];
     }
 #ifdef X64
-    if (X64_MODE_DC(dcontext)) {
+    if (x64_mode) {
         int adj64 = x64_adjustment[opc];
         if (adj64 > 0) /* default size adjustment */
             sz += adj64;
@@ -665,7 +669,7 @@ decode_sizeof(dcontext_t *dcontext, byte *start_pc, int *num_prefixes
 #ifdef X64
     if (rip_rel_pos != NULL) {
         if (rip_rel_pc != NULL) {
-            CLIENT_ASSERT(X64_MODE_DC(dcontext),
+            CLIENT_ASSERT(x64_mode,
                           "decode_sizeof: invalid non-x64 rip_rel instr");
             CLIENT_ASSERT(CHECK_TRUNCATE_TYPE_uint(rip_rel_pc - start_pc),
                           "decode_sizeof: unknown rip_rel instr type");
@@ -760,7 +764,8 @@ sizeof_modrm(dcontext_t *dcontext, byte *pc, bool addr16 _IF_X64(byte **rip_rel_
     uint sib;
 
 #ifdef X64
-    if (rip_rel_pc != NULL && X64_MODE_DC(dcontext) && mod == 0 && r_m == 5) {
+    /* test the mode last: it is the most expensive check */
+    if (rip_rel_pc != NULL && mod == 0 && r_m == 5 && X64_MODE_DC(dcontext)) {
         *rip_rel_pc = pc + 1; /* no sib: next 4 bytes are disp */
     }
 #endif
@@ -1525,6 +1525,16 @@ append_save_simd_reg(dcontext_t *dcontext, instrlist_t *ilist, bool absolute)
         /* FIXME i#438: once have SandyBridge processor need to measure
          * cost of vmovdqu and whether worth arranging 32-byte alignment
          */
+        /* XXX: we would like to skip this on most exits and only save the
+         * vector state lazily, on the paths that read it (signal delivery,
+         * DR_MC_MULTIMEDIA queries, translation, detach).  That is not safe
+         * today: DR's own C code is not built with -mno-sse and may clobber the
+         * xmm registers once we're back in DR, and privately loaded client
+         * libraries may use AVX and clobber the full ymm registers.  A lazy
+         * scheme needs both of those fenced off first, plus a per-thread flag
+         * recording whether the mcontext copy is current.  Only then could
+         * xsaveopt's modified-state tracking save just what changed here.
+         */
         int i;
         uint opcode = move_mm_reg_opcode(true/*align32*/, true/*align16*/);
         ASSERT(proc_has_feature(FEATURE_SSE));
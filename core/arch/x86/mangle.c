@@ -2855,11 +2855,17 @@ mangle_rel_addr(dcontext_t *dcontext, instrlist_t *ilist, instr_t *instr,
         ASSERT(opnd_is_reg(dst));
         ASSERT(opnd_is_rel_addr(src));
         ASSERT(opnd_get_addr(src) == tgt);
+        /* PR 253446: if the target still reaches from anywhere in the code
+         * cache we leave the lea alone and let encoding re-relativize it
+         * (PR 251479), which is 3 bytes shorter than the mov_imm.
+         */
+        if (rel32_reachable_from_vmcode(tgt)) {
+            STATS_INC(rip_rel_lea_reachable);
+            return next_instr;
+        }
         /* Replace w/ an absolute immed of the target app address, following Intel
          * Table 3-59 "64-bit Mode LEA Operation with Address and Operand Size
          * Attributes" */
-        /* FIXME PR 253446: optimization: we could leave this as rip-rel if it
-         * still reaches from the code cache. */
         if (reg_get_size(opnd_get_reg(dst)) == OPSZ_8) {
             /* PR 253327: there is no explicit addr32 marker; we assume
              * that decode or the user already zeroed out the top bits
@@ -3679,6 +3685,19 @@ sandbox_top_of_bb_check_s2ro(dcontext_t *dcontext, app_pc start_pc)
             !is_driver_address(start_pc));
 }
 
+/* Moves both string compare pointers by disp without touching eflags. */
+static void
+sandbox_top_of_bb_adjust_ptrs(dcontext_t *dcontext, instrlist_t *ilist, instr_t *where,
+                              int disp)
+{
+    PRE(ilist, where,
+        INSTR_CREATE_lea(dcontext, opnd_create_reg(REG_XSI),
+                         opnd_create_base_disp(REG_XSI, REG_NULL, 0, disp, OPSZ_lea)));
+    PRE(ilist, where,
+        INSTR_CREATE_lea(dcontext, opnd_create_reg(REG_XDI),
+                         opnd_create_base_disp(REG_XDI, REG_NULL, 0, disp, OPSZ_lea)));
+}
+
 static void
 sandbox_top_of_bb(dcontext_t *dcontext, instrlist_t *ilist,
                   bool s2ro, uint flags,
@@ -3693,7 +3712,10 @@ sandbox_top_of_bb(dcontext_t *dcontext, instrlist_t *ilist,
      * start address blank here, will be touched up after emitting this ilist.
      *
      * FIXME case 8165/PR 212600: optimize this: move reg restores to
-     * custom fcache_return, use cmpsd instead of cmpsb, etc.
+     * custom fcache_return, etc.
+     *
+     * After the first byte, the bulk of the block is compared 4 bytes at a
+     * time with cmpsd and only the 0-3 remaining bytes are compared with cmpsb.
      *
      * if eflags live entering this bb:
      *   save xax
@@ -3738,13 +3760,38 @@ sandbox_top_of_bb(dcontext_t *dcontext, instrlist_t *ilist,
      *   else
      *     cmp xsi, start_pc
      *   endif
+     *   if copy_size-1 < 4
      *     mov copy_size-1, xcx # -1 b/c we already checked 1st byte
+     *   else
+     *     mov (copy_size-1)/4, xcx
+     *   endif
      *     jge forward
      *     mov copy_end_pc - 1, xdi # -1 b/c it is the end of this basic block
      *         # => patch point 2
      *     mov end_pc - 1, xsi
+     *   if copy_size-1 < 4
      *   forward:
      *     repe cmpsb
+     *   else
+     *     lea -3(xsi), xsi # backward cmpsd compares the 4 bytes ending at xsi+3
+     *     lea -3(xdi), xdi
+     *     repe cmpsd
+     *    if (copy_size-1) % 4 != 0
+     *     jne check_results
+     *     lea 3(xsi), xsi
+     *     lea 3(xdi), xdi
+     *     mov (copy_size-1)%4, xcx
+     *     repe cmpsb
+     *    endif
+     *     jmp check_results
+     *   forward:
+     *     repe cmpsd
+     *    if (copy_size-1) % 4 != 0
+     *     jne check_results
+     *     mov (copy_size-1)%4, xcx
+     *     repe cmpsb
+     *    endif
+     *   endif
      * endif # copy_size > 1
      *   check_results:
      *     restore xcx
@@ -3889,6 +3936,13 @@ sandbox_top_of_bb(dcontext_t *dcontext, instrlist_t *ilist,
      */
     if (end_pc - start_pc > 1) {
         instr_t *forward = INSTR_CREATE_label(dcontext);
+        /* The bytes left after the 1st, compared in dwords and then a byte tail.
+         * The dword count is only non-zero if there is at least one dword, so
+         * each "repe cmps" below has xcx > 0 and always sets eflags.
+         */
+        ptr_uint_t remaining = end_pc - (start_pc + 1);
+        ptr_uint_t words = remaining / 4;
+        ptr_uint_t tail = remaining % 4;
         PRE(ilist, instr,
             INSTR_CREATE_jcc(dcontext, OP_jne, opnd_create_instr(check_results)));
 #ifdef X64
@@ -3909,7 +3963,7 @@ sandbox_top_of_bb(dcontext_t *dcontext, instrlist_t *ilist,
 #endif
         PRE(ilist, instr,
             INSTR_CREATE_mov_imm(dcontext, opnd_create_reg(REG_XCX),
-                                 OPND_CREATE_INTPTR(end_pc - (start_pc + 1))));
+                                 OPND_CREATE_INTPTR(words > 0 ? words : remaining)));
         /* i#2155: In the case where the direction flag is set, xsi will be lesser
          * than start_pc after cmps, and the jump branch will not be taken.
          */
@@ -3934,8 +3988,38 @@ sandbox_top_of_bb(dcontext_t *dcontext, instrlist_t *ilist,
         PRE(ilist, instr,
             INSTR_CREATE_mov_imm(dcontext, opnd_create_reg(REG_XSI),
                                  OPND_CREATE_INTPTR(end_pc - 1)));
-        PRE(ilist, instr, forward);
-        PRE(ilist, instr, INSTR_CREATE_rep_cmps_1(dcontext));
+        if (words == 0) {
+            PRE(ilist, instr, forward);
+            PRE(ilist, instr, INSTR_CREATE_rep_cmps_1(dcontext));
+        } else {
+            /* The two directions leave xsi and xdi at different offsets from the
+             * next byte to compare, so each gets its own tail.  The patched
+             * copy end above is unchanged: we adjust relative to it here.
+             */
+            sandbox_top_of_bb_adjust_ptrs(dcontext, ilist, instr, -3);
+            PRE(ilist, instr, INSTR_CREATE_rep_cmps_4(dcontext));
+            if (tail > 0) {
+                PRE(ilist, instr, INSTR_CREATE_jcc(dcontext, OP_jne,
+                                                   opnd_create_instr(check_results)));
+                sandbox_top_of_bb_adjust_ptrs(dcontext, ilist, instr, 3);
+                PRE(ilist, instr,
+                    INSTR_CREATE_mov_imm(dcontext, opnd_create_reg(REG_XCX),
+                                         OPND_CREATE_INTPTR(tail)));
+                PRE(ilist, instr, INSTR_CREATE_rep_cmps_1(dcontext));
+            }
+            PRE(ilist, instr,
+                INSTR_CREATE_jmp(dcontext, opnd_create_instr(check_results)));
+            PRE(ilist, instr, forward);
+            PRE(ilist, instr, INSTR_CREATE_rep_cmps_4(dcontext));
+            if (tail > 0) {
+                PRE(ilist, instr, INSTR_CREATE_jcc(dcontext, OP_jne,
+                                                   opnd_create_instr(check_results)));
+                PRE(ilist, instr,
+                    INSTR_CREATE_mov_imm(dcontext, opnd_create_reg(REG_XCX),
+                                         OPND_CREATE_INTPTR(tail)));
+                PRE(ilist, instr, INSTR_CREATE_rep_cmps_1(dcontext));
+            }
+        }
     }
     PRE(ilist, instr, check_results);
     PRE(ilist, instr,
@@ -413,6 +413,19 @@ config_read(config_info_t *cfg, const char *appname_in, process_id_t pid, const
     int retval;
 #endif
     ASSERT(cfg->query != NULL || cfg->u.v != NULL);
+    /* With many short-lived processes the config file search (up to five
+     * opens per process, plus one more set for each execve target) is a
+     * noticeable part of startup, so we let a launcher that already supplies
+     * everything via env vars skip it.
+     */
+    local = my_getenv(L_IF_WIN(DYNAMORIO_VAR_CONFIG_ENV_ONLY), buf,
+                      BUFFER_SIZE_BYTES(buf));
+    if (local != NULL && local[0] != '\0' && strcmp(local, "0") != 0) {
+        INFO(1, "%s set: ignoring config files", DYNAMORIO_VAR_CONFIG_ENV_ONLY);
+        if (appname_in == NULL)
+            set_config_from_env(cfg);
+        return;
+    }
     /* for now we only support config files by short name: we'll see
      * whether we need to also support full paths
      */
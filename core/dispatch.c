@@ -136,6 +136,7 @@ dispatch(dcontext_t *dcontext)
 {
     fragment_t *targetf;
     fragment_t coarse_f;
+    bool build_unshared;
 
 #ifdef HAVE_TLS
 # if defined(UNIX) && defined(X86)
@@ -201,8 +202,21 @@ dispatch(dcontext_t *dcontext)
             }
             if (targetf != NULL)
                 break;
-            /* must call outside of USE_BB_BUILDING_LOCK guard for bb_lock_would_have: */
-            SHARED_BB_LOCK();
+            /* With -private_bbs_on_contention, rather than serializing behind
+             * another thread's shared bb build we build our own thread-private
+             * copy without the lock.  The modload hook requires serialization
+             * even of private bbs (i#884) so we never skip the lock for it.
+             */
+            build_unshared = false;
+            if (DYNAMO_OPTION(private_bbs_on_contention) && USE_BB_BUILDING_LOCK() &&
+                !dr_modload_hook_exists()) {
+                build_unshared = !mutex_trylock(&bb_building_lock);
+            } else {
+                /* must call outside of USE_BB_BUILDING_LOCK guard for
+                 * bb_lock_would_have:
+                 */
+                SHARED_BB_LOCK();
+            }
             if (USE_BB_BUILDING_LOCK() || targetf == NULL) {
                 /* must re-lookup while holding lock and keep the lock until we've
                  * built the bb and added it to the lookup table
@@ -213,11 +227,15 @@ dispatch(dcontext_t *dcontext)
             }
             if (targetf == NULL) {
                 SELF_PROTECT_LOCAL(dcontext, WRITABLE);
+                dcontext->bb_build_unshared = build_unshared;
                 targetf =
                     build_basic_block_fragment(dcontext, dcontext->next_tag,
                                                0, true/*link*/, true/*visible*/
                                                _IF_CLIENT(false/*!for_trace*/)
                                                _IF_CLIENT(NULL));
+                dcontext->bb_build_unshared = false;
+                if (build_unshared && targetf != NULL)
+                    STATS_INC(num_bbs_private_on_contention);
                 SELF_PROTECT_LOCAL(dcontext, READONLY);
             }
             if (targetf != NULL && TEST(FRAG_COARSE_GRAIN, targetf->flags)) {
@@ -232,7 +250,8 @@ dispatch(dcontext_t *dcontext)
                                         FCACHE_ENTRY_PC(targetf));
                 targetf = &coarse_f;
             }
-            SHARED_BB_UNLOCK();
+            if (!build_unshared)
+                SHARED_BB_UNLOCK();
             if (targetf == NULL)
                 break;
             /* loop around and re-do monitor check */
@@ -395,6 +414,12 @@ dispatch_enter_fcache(dcontext_t *dcontext, fragment_t *targetf)
         return false;
     }
 
+    /* Entries are the reference signal for -cache_replace_clock.  We are
+     * nolinking, so no flusher can be changing a private targetf's flags.
+     */
+    if (DYNAMO_OPTION(cache_replace_clock) && !TEST(FRAG_SHARED, targetf->flags))
+        targetf->flags |= FRAG_FIFO_REFERENCED;
+
     dispatch_enter_fcache_stats(dcontext, targetf);
 
     /* FIXME: for now we do this before the synch point to avoid complexity of
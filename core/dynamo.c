@@ -352,9 +352,83 @@ statistics_init(void)
 #undef RSTATS_DEF
 }
 
+#ifdef UNIX
+/* The -rstats_shm_dir file and our shared mapping of it, if any. */
+static char stats_shm_path[MAXIMUM_PATH];
+static dr_statistics_t *stats_shm;
+
+/* Moves the stats out of nonshared_stats and into a shared mapping of a file
+ * under -rstats_shm_dir, so an external monitor can read them at any time
+ * without nudging us.  Must be called after dynamo_vm_areas_init().
+ */
+static void
+statistics_shm_init(void)
+{
+    file_t fd;
+    size_t size = sizeof(*stats);
+    dr_statistics_t *map;
+    if (DYNAMO_OPTION(rstats_shm_dir)[0] == '\0' || !DYNAMO_OPTION(global_rstats))
+        return;
+    ASSERT(stats == &nonshared_stats && stats_shm == NULL);
+    snprintf(stats_shm_path, BUFFER_SIZE_ELEMENTS(stats_shm_path), "%s/%s.%d",
+             DYNAMO_OPTION(rstats_shm_dir), DR_STATS_SHM_PREFIX, get_process_id());
+    NULL_TERMINATE_BUFFER(stats_shm_path);
+    /* Any existing file was left by an earlier process with our pid. */
+    os_delete_file(stats_shm_path);
+    fd = os_open(stats_shm_path, OS_OPEN_READ | OS_OPEN_WRITE | OS_OPEN_REQUIRE_NEW);
+    if (fd == INVALID_FILE) {
+        SYSLOG_INTERNAL_WARNING("unable to create rstats file %s", stats_shm_path);
+        return;
+    }
+    /* Writing out the current values both sizes the file and initializes it.
+     * We're the only thread in DR here, so nothing changes stats in between.
+     */
+    if (os_write(fd, stats, size) == (ssize_t) size) {
+        map = (dr_statistics_t *)
+            os_map_file(fd, &size, 0, NULL, MEMPROT_READ | MEMPROT_WRITE, 0);
+    } else
+        map = NULL;
+    os_close(fd);
+    if (map == NULL) {
+        SYSLOG_INTERNAL_WARNING("unable to map rstats file %s", stats_shm_path);
+        os_delete_file(stats_shm_path);
+        return;
+    }
+    add_dynamo_vm_area((app_pc)map, (app_pc)map + ALIGN_FORWARD(size, PAGE_SIZE),
+                       MEMPROT_READ | MEMPROT_WRITE, false _IF_DEBUG("rstats file"));
+    stats_shm = map;
+    stats = map;
+}
+
+/* The child of a fork shares the parent's mapping, so it takes a private copy
+ * of the values and publishes them under its own pid.
+ */
+static void
+statistics_shm_fork_init(void)
+{
+    size_t size = ALIGN_FORWARD(sizeof(*stats), PAGE_SIZE);
+    if (stats_shm == NULL)
+        return;
+    memcpy(&nonshared_stats, stats_shm, sizeof(nonshared_stats));
+    stats = &nonshared_stats;
+    remove_dynamo_vm_area((app_pc)stats_shm, (app_pc)stats_shm + size);
+    os_unmap_file((byte *)stats_shm, size);
+    stats_shm = NULL;
+    statistics_shm_init();
+}
+#endif
+
 static void
 statistics_exit(void)
 {
+#ifdef UNIX
+    if (stats_shm != NULL) {
+        /* dynamo areas are already gone, so we just unmap. */
+        os_unmap_file((byte *)stats_shm, ALIGN_FORWARD(sizeof(*stats), PAGE_SIZE));
+        os_delete_file(stats_shm_path);
+        stats_shm = NULL;
+    }
+#endif
     stats = NULL;
 }
 
@@ -518,6 +592,9 @@ dynamorio_app_init(void)
         modules_init(); /* before vm_areas_init() */
         os_init();
         config_heap_init(); /* after heap_init */
+#ifdef UNIX
+        statistics_shm_init(); /* after dynamo_vm_areas_init */
+#endif
 
         /* Setup for handling faults in loader_init() */
         /* initial stack so we don't have to use app's
@@ -668,6 +745,9 @@ dynamorio_app_init(void)
          *       DllMain.
          */
         instrument_init();
+# if defined(LINUX) && defined(CLIENT_SIDELINE)
+        nudge_thread_init();
+# endif
         /* To give clients a chance to process pcaches as we load them, we
          * delay the loading until we've initialized the clients.
          */
@@ -736,6 +816,19 @@ dynamorio_app_init(void)
 }
 
 #ifdef UNIX
+/* XXX: A zygote-style template, where a pre-initialized DR plus client forks
+ * off fresh app instances, cannot be built on top of this routine.  A plain
+ * fork already keeps the parent's warm state (heap, vmm, privately loaded
+ * libraries, client init, and the code cache).  A new app instance, however,
+ * arrives via execve, which discards the address space.  A template would
+ * have to throw away everything keyed to the old image: module lists, the
+ * code cache, client and drsyms per-module data, app TLS and the app's own
+ * loader state.  It would then have to map and relocate the new image from
+ * inside DR, which is the early-injection path and is itself most of the
+ * startup cost.  Workers that fork without exec'ing get the amortization
+ * today.  Exec'ing workers should trim the config search
+ * (DYNAMORIO_CONFIG_ENV_ONLY) and client init instead.
+ */
 void
 dynamorio_fork_init(dcontext_t *dcontext)
 {
@@ -752,6 +845,7 @@ dynamorio_fork_init(dcontext_t *dcontext)
      * create log dirs (xref i#189/PR 452168)
      */
     os_fork_init(dcontext);
+    statistics_shm_fork_init();
 
     /* sanity check, plus need to set this for statistics_init:
      * even if parent did an execve, env var should be reset by now
@@ -1134,6 +1228,8 @@ dynamo_shared_exit(thread_record_t *toexit /* must ==cur thread for Linux */
     });
     if (INTERNAL_OPTION(rstats_to_stderr))
         dump_global_rstats_to_stderr();
+    if (DYNAMO_OPTION(cache_size_breakdown))
+        dump_cache_size_breakdown_to_stderr();
 
     statistics_exit();
 #ifdef DEBUG
@@ -1538,6 +1634,13 @@ dynamo_process_exit(void)
 
     if (INTERNAL_OPTION(rstats_to_stderr))
         dump_global_rstats_to_stderr();
+    if (DYNAMO_OPTION(cache_size_breakdown))
+        dump_cache_size_breakdown_to_stderr();
+#ifdef UNIX
+    /* The mapping goes away with the process but the file would not. */
+    if (stats_shm != NULL)
+        os_delete_file(stats_shm_path);
+#endif
 
     return SUCCESS;
 #endif /* !DEBUG */
@@ -2852,12 +2955,15 @@ dynamorio_take_over_threads(dcontext_t *dcontext)
      */
     bool found_threads;
     uint attempts = 0;
+    uint64 start_ms = query_time_millis();
+    int start_threads;
 
     os_process_under_dynamorio_initiate(dcontext);
     signal_event(dr_app_started);
     /* XXX i#1305: we should suspend all the other threads for DR init to
      * satisfy the parts of the init process that assume there are no races.
      */
+    start_threads = get_num_threads();
     do {
         found_threads = os_take_over_all_unknown_threads(dcontext);
         attempts++;
@@ -2865,6 +2971,13 @@ dynamorio_take_over_threads(dcontext_t *dcontext)
             bb_lock_start = true;
     } while (found_threads && attempts < MAX_TAKE_OVER_ATTEMPTS);
     os_process_under_dynamorio_complete(dcontext);
+    /* Attach latency is dominated by the per-thread takeover, so expose it
+     * in release builds as well.  Threads created meanwhile count too.
+     */
+    RSTATS_ADD(attach_threads_taken_over, get_num_threads() - start_threads);
+    RSTATS_ADD(attach_takeover_rounds, attempts);
+    RSTATS_ADD(attach_takeover_ms, (uint)(query_time_millis() - start_ms));
+    RSTATS_TRACK_MAX(max_attach_takeover_ms, query_time_millis() - start_ms);
 
     if (found_threads) {
         REPORT_FATAL_ERROR_AND_EXIT(dcontext, FAILED_TO_TAKE_OVER_THREADS,
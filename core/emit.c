@@ -411,6 +411,11 @@ emit_fragment_common(dcontext_t *dcontext, app_pc tag,
     bool      no_stub = false;
     dr_isa_mode_t isa_mode;
     uint      mode_flags;
+    /* -cache_size_breakdown */
+    uint      app_bytes = 0;
+    uint      meta_bytes = 0;
+    uint      exit_cti_bytes = 0;
+    uint      separate_stub_bytes = 0;
 
     KSTART(emit);
     /* we do entire cache b/c links may touch many units
@@ -455,8 +460,18 @@ emit_fragment_common(dcontext_t *dcontext, app_pc tag,
              * the note field (used by instr_encode) */
             instr_set_note(inst, (void *)(ptr_uint_t)offset);
         }
-        if (instr_ok_to_emit(inst))
-            offset += instr_length(dcontext, inst);
+        if (instr_ok_to_emit(inst)) {
+            len = instr_length(dcontext, inst);
+            offset += len;
+            if (DYNAMO_OPTION(cache_size_breakdown)) {
+                if (instr_is_exit_cti(inst))
+                    exit_cti_bytes += len;
+                else if (instr_is_meta(inst))
+                    meta_bytes += len;
+                else
+                    app_bytes += len;
+            }
+        }
         ASSERT_NOT_IMPLEMENTED(!TEST(INSTR_HOT_PATCHABLE, inst->flags));
         if (instr_is_exit_cti(inst)) {
             target = instr_get_branch_target_pc(inst);
@@ -506,8 +521,10 @@ emit_fragment_common(dcontext_t *dcontext, app_pc tag,
                 } else if (!should_separate_stub(dcontext, target, flags)) {
                     stub_size_total += len;
                     STATS_FCACHE_ADD(flags, direct_stubs, len);
-                } else /* ensure have cti to jmp to separate stub! */
+                } else { /* ensure have cti to jmp to separate stub! */
                     ASSERT(instr_ok_to_emit(inst));
+                    separate_stub_bytes += len;
+                }
             }
 #ifdef CUSTOM_EXIT_STUBS
             if (!custom_stubs_present && instr_exit_stub_code(inst) != NULL)
@@ -601,6 +618,24 @@ emit_fragment_common(dcontext_t *dcontext, app_pc tag,
     STATS_FCACHE_ADD(flags, bodies, offset);
     STATS_FCACHE_ADD(flags, prefixes, fragment_prefix_size(flags));
 
+    if (DYNAMO_OPTION(cache_size_breakdown)) {
+        if (TEST(FRAG_IS_TRACE, flags)) {
+            RSTATS_ADD(cache_trace_app_bytes, app_bytes);
+            RSTATS_ADD(cache_trace_meta_bytes, meta_bytes);
+            RSTATS_ADD(cache_trace_exit_cti_bytes, exit_cti_bytes);
+            RSTATS_ADD(cache_trace_stub_bytes, stub_size_total);
+            RSTATS_ADD(cache_trace_separate_stub_bytes, separate_stub_bytes);
+            RSTATS_ADD(cache_trace_prefix_bytes, fragment_prefix_size(flags));
+        } else {
+            RSTATS_ADD(cache_bb_app_bytes, app_bytes);
+            RSTATS_ADD(cache_bb_meta_bytes, meta_bytes);
+            RSTATS_ADD(cache_bb_exit_cti_bytes, exit_cti_bytes);
+            RSTATS_ADD(cache_bb_stub_bytes, stub_size_total);
+            RSTATS_ADD(cache_bb_separate_stub_bytes, separate_stub_bytes);
+            RSTATS_ADD(cache_bb_prefix_bytes, fragment_prefix_size(flags));
+        }
+    }
+
     if (TEST(FRAG_SELFMOD_SANDBOXED, flags)) {
         /* We need a copy of the original app code at bottom of
          * fragment.  We count it as part of the fragment body size,
@@ -738,6 +773,15 @@ emit_fragment_common(dcontext_t *dcontext, app_pc tag,
                     ASSERT(EXIT_STUB_PC(dcontext, f, l) == prev_stub_pc);
                 }
             } else {
+                /* XXX: we considered deferring this until the exit is first
+                 * taken, routing it through a shared trampoline meanwhile.  But
+                 * the stub is what hands the linkstub_t to fcache_return, and
+                 * a plain jmp exit cti leaves no trace of which exit it was, so
+                 * a shared trampoline cannot recover it.  Separated stubs are
+                 * already out of the cache proper, are shared across both sides
+                 * of a cbr (-cbr_single_stub), and are freed once linked
+                 * (-free_private_stubs), which covers most of the savings.
+                 */
                 separate_stub_create(dcontext, f, l);
             }
             prev_stub_pc = EXIT_STUB_PC(dcontext, f, l);
@@ -65,6 +65,20 @@
  * to have huge units.
  */
 
+/* XXX: on multi-socket machines every thread executes shared fragments out of
+ * the same units, and probes the same shared IBL tables, regardless of which
+ * NUMA node it runs on.  Replicating hot shared traces and IBL tables per node
+ * is not a matter of placing units: a fragment_t has a single start_pc, which
+ * the fragment tables, IBL entries, exit stubs and incoming links all refer to,
+ * and flushing, resizing and shifting assume that one copy.  A replica would
+ * need its own fragment identity (much as private fragments shadowing shared
+ * ones have today), per-node shared IBL tables selected through the
+ * per-thread table pointers that update_private_ibt_table_ptrs() maintains,
+ * and a node recorded per thread in thread_record_t that is refreshed as
+ * threads migrate.  Until then, -no_shared_traces together with private IBL
+ * tables gives the thread-local placement, at the cost of per-thread copies.
+ */
+
 /* to make it easy to switch to INTERNAL_OPTION */
 #define FCACHE_OPTION(o) dynamo_options.o
 
@@ -2263,6 +2277,10 @@ fifo_append(fcache_t *cache, fragment_t *f)
 {
     ASSERT(USE_FIFO(f));
     ASSERT(CACHE_PROTECTED(cache));
+    /* A new fragment may carry FRAG_FOLLOWS_FREE_ENTRY from a shared original,
+     * which would read as FRAG_FIFO_REFERENCED.
+     */
+    f->flags &= ~FRAG_FIFO_REFERENCED;
     /* start has prev to end, but end does NOT have next to start */
     FIFO_NEXT_ASSIGN(f, NULL);
     if (cache->fifo == NULL) {
@@ -2786,9 +2804,13 @@ force_fragment_from_cache(dcontext_t *dcontext, fcache_t *cache, fragment_t *vic
     }
 }
 
+/* If spare_referenced, fails when a fragment after fifo that would be replaced
+ * has FRAG_FIFO_REFERENCED, clearing it so that it is only spared once.
+ */
 static bool
 replace_fragments(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
-                  fragment_t *f, fragment_t *fifo, uint slot_size)
+                  fragment_t *f, fragment_t *fifo, uint slot_size,
+                  bool spare_referenced)
 {
     fragment_t *victim;
     uint slot_so_far;
@@ -2809,6 +2831,13 @@ replace_fragments(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
             DODEBUG({ cache->consistent = true; });
             return false;
         }
+        if (spare_referenced && victim != fifo && !FRAG_EMPTY(victim) &&
+            TEST(FRAG_FIFO_REFERENCED, victim->flags)) {
+            victim->flags &= ~FRAG_FIFO_REFERENCED;
+            STATS_INC(num_fragments_clock_spared);
+            DODEBUG({ cache->consistent = true; });
+            return false;
+        }
         slot_so_far += FRAG_SIZE(victim);
         if (slot_so_far >= slot_size)
             break;
@@ -2898,26 +2927,50 @@ replace_fragments(dcontext_t *dcontext, fcache_t *cache, fcache_unit_t *unit,
     return true;
 }
 
+/* With -cache_replace_clock the FIFO serves as a CLOCK: fragments entered since
+ * the hand last considered them have their reference cleared and are moved to the
+ * tail rather than replaced.  If that finds no room we fall back to plain FIFO
+ * order rather than grow the cache.
+ */
 static inline bool
 replace_fifo(dcontext_t *dcontext, fcache_t *cache, fragment_t *f, uint slot_size,
              fragment_t *fifo)
 {
     fcache_unit_t *unit;
+    fragment_t *next;
+    bool clock = DYNAMO_OPTION(cache_replace_clock);
     ASSERT(USE_FIFO(f));
     ASSERT(CACHE_PROTECTED(cache));
-    while (fifo != NULL) {
-        unit = FIFO_UNIT(fifo);
-        if ((ptr_uint_t)(unit->end_pc - FRAG_HDR_START(fifo)) >= slot_size) {
-            /* try to replace fifo and possibly subsequent frags with f
-             * could fail if un-deletable frags
-             */
-            DOLOG(4, LOG_CACHE, { verify_fifo(dcontext, cache); });
-            if (replace_fragments(dcontext, cache, unit, f, fifo, slot_size))
-                return true;
+    while (true) {
+        while (fifo != NULL) {
+            next = FIFO_NEXT(fifo);
+            if (clock && !FRAG_EMPTY(fifo) && TEST(FRAG_FIFO_REFERENCED, fifo->flags)) {
+                fifo->flags &= ~FRAG_FIFO_REFERENCED;
+                STATS_INC(num_fragments_clock_spared);
+                LOG(THREAD, LOG_CACHE, 4, "\tsparing referenced F%d\n", FRAG_ID(fifo));
+                if (next != NULL) {
+                    fifo_remove(dcontext, cache, fifo);
+                    fifo_append(cache, fifo);
+                    fifo = next;
+                } /* else it is already the tail: reconsider it now */
+                continue;
+            }
+            unit = FIFO_UNIT(fifo);
+            if ((ptr_uint_t)(unit->end_pc - FRAG_HDR_START(fifo)) >= slot_size) {
+                /* try to replace fifo and possibly subsequent frags with f
+                 * could fail if un-deletable frags
+                 */
+                DOLOG(4, LOG_CACHE, { verify_fifo(dcontext, cache); });
+                if (replace_fragments(dcontext, cache, unit, f, fifo, slot_size, clock))
+                    return true;
+            }
+            fifo = next;
         }
-        fifo = FIFO_NEXT(fifo);
+        if (!clock)
+            return false;
+        clock = false;
+        fifo = cache->fifo;
     }
-    return false;
 }
 
 static inline
@@ -3293,7 +3346,8 @@ add_fragment_common(dcontext_t *dcontext, fcache_t *cache, fragment_t *f, uint s
                  */
                 LOG(THREAD, LOG_CACHE, 4, "\ttrying to fit in empty slot\n");
                 DOLOG(4, LOG_CACHE, { verify_fifo(dcontext, cache); });
-                if (replace_fragments(dcontext, cache, unit, f, fifo, slot_size))
+                if (replace_fragments(dcontext, cache, unit, f, fifo, slot_size,
+                                      false))
                     return;
             }
             fifo = FIFO_NEXT(fifo);
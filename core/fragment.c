@@ -642,6 +642,36 @@ static const fragment_entry_t fe_sentinel = { NULL_TAG, HASHLOOKUP_SENTINEL_STAR
 #define HASHTABLE_WHICH_HEAP(flags) FRAGTABLE_WHICH_HEAP(flags)
 #define HTLOCK_RANK               table_rwlock
 #define HASHTABLE_ENTRY_STATS 1
+#define HASHTABLE_ADD_CLUSTER_HOOK(dc, table, len) ibl_table_note_cluster(table, len)
+/* IBL tables only cache fragments held in the main fragment tables, so a
+ * lookup missing a not-yet-migrated entry just takes the slow path.
+ */
+#define HASHTABLE_INCREMENTAL_RESIZE 1
+#define HASHTABLE_MIGRATE_STEP DYNAMO_OPTION(ibl_table_migrate_step)
+
+/* The IBL routines probe these tables linearly from the home slot, so we export
+ * per-branch-type counts of how often, and how far, insertions had to probe.
+ */
+static inline void
+ibl_table_note_cluster(ibl_table_t *table, uint cluster_len)
+{
+    if (cluster_len == 0)
+        return;
+    switch (table->branch_type) {
+    case IBL_RETURN:
+        RSTATS_INC(num_ibt_collisions_ret);
+        RSTATS_TRACK_MAX(max_ibt_cluster_ret, cluster_len);
+        break;
+    case IBL_INDCALL:
+        RSTATS_INC(num_ibt_collisions_indcall);
+        RSTATS_TRACK_MAX(max_ibt_cluster_indcall, cluster_len);
+        break;
+    default:
+        RSTATS_INC(num_ibt_collisions_indjmp);
+        RSTATS_TRACK_MAX(max_ibt_cluster_indjmp, cluster_len);
+        break;
+    }
+}
 
 #include "hashtablex.h"
 /* all defines are undef-ed at end of hashtablex.h */
@@ -1413,6 +1443,8 @@ fragment_init()
     /* ensure we can read this w/o a lock: no cache line crossing, please */
     ASSERT(ALIGNED(&flushtime_global, 4));
 
+    translation_cache_init();
+
     if (SHARED_FRAGMENTS_ENABLED()) {
         /* tables are persistent across resets, only on heap for selfprot (case 7957) */
         if (DYNAMO_OPTION(shared_bbs)) {
@@ -1458,6 +1490,9 @@ fragment_reset_free(void)
     if (RUNNING_WITHOUT_CODE_CACHE())
         return;
 
+    /* Not all fragments are individually freed at reset in every build. */
+    translation_cache_reset();
+
     /* We must study the ibl tables before the trace/bb tables so that we're
      * not looking at freed entries
      */
@@ -1712,6 +1747,7 @@ fragment_exit()
                                   false /* no flush */);
     DELETE_LOCK(client_flush_request_lock);
 #endif
+    translation_cache_exit();
     /* avoid compile error "error: label at end of compound statement"
      * from vps-release-external build
      */
@@ -2295,6 +2331,13 @@ fragment_create_heap(dcontext_t *dcontext,
     LOG(THREAD, LOG_FRAGMENT, 5,
         "fragment heap size for flags 0x%08x, exits %d %d, is %d => "PFX"\n",
         flags, direct_exits, indirect_exits, heapsz, f);
+    DOSTATS({
+        if (TEST(FRAG_IS_TRACE, flags))
+            STATS_ADD_PEAK(fragment_metadata_trace, FRAGMENT_STRUCT_SIZE(flags));
+        else
+            STATS_ADD_PEAK(fragment_metadata_bb, FRAGMENT_STRUCT_SIZE(flags));
+        STATS_ADD_PEAK(fragment_metadata_linkstubs, heapsz - FRAGMENT_STRUCT_SIZE(flags));
+    });
 
     return f;
 }
@@ -2599,6 +2642,7 @@ fragment_free(dcontext_t *dcontext, fragment_t *f)
         translation_info_free(dcontext, FRAGMENT_TRANSLATION_INFO(f));
     } else
         ASSERT(FRAGMENT_TRANSLATION_INFO(f) == NULL);
+    translation_cache_remove(dcontext, f);
 
     /* N.B.: monitor_remove_fragment() was called in fragment_delete,
      * which is assumed to have been called prior to fragment_free
@@ -2606,16 +2650,20 @@ fragment_free(dcontext_t *dcontext, fragment_t *f)
 
     linkstub_free_exitstubs(dcontext, f);
 
+    STATS_SUB(fragment_metadata_linkstubs, heapsz - FRAGMENT_STRUCT_SIZE(f->flags));
     if ((f->flags & FRAG_IS_TRACE) != 0) {
         trace_only_t *t = TRACE_FIELDS(f);
         if (t->bbs != NULL) {
             nonpersistent_heap_free(alloc_dc, t->bbs, t->num_bbs*sizeof(trace_bb_info_t)
                                     HEAPACCT(ACCT_TRACE));
+            STATS_SUB(fragment_metadata_trace, t->num_bbs*sizeof(trace_bb_info_t));
         }
         nonpersistent_heap_free(alloc_dc, f, heapsz HEAPACCT(ACCT_TRACE));
+        STATS_SUB(fragment_metadata_trace, FRAGMENT_STRUCT_SIZE(f->flags));
     }
     else {
         nonpersistent_heap_free(alloc_dc, f, heapsz HEAPACCT(ACCT_FRAGMENT));
+        STATS_SUB(fragment_metadata_bb, FRAGMENT_STRUCT_SIZE(f->flags));
     }
 }
 
@@ -3797,7 +3845,7 @@ fragment_remove_ibl_entries_in_region(dcontext_t *dcontext, app_pc start, app_pc
         ibl_table_t *ibtable = GET_IBT_TABLE(pt, frag_flags, branch_type);
         uint removed = 0;
         TABLE_RWLOCK(ibtable, write, lock);
-        if (ibtable->entries > 0) {
+        if (ibtable->entries + ibtable->migrate_pending > 0) {
             removed = hashtable_ibl_range_remove(dcontext, ibtable,
                                                  (ptr_uint_t)start, (ptr_uint_t)end,
                                                  NULL);
@@ -4017,6 +4065,8 @@ fragment_copy_data_fields(dcontext_t *dcontext, fragment_t *f_src, fragment_t *f
                                          HEAPACCT(ACCT_TRACE));
             memcpy(t_dst->bbs, t_src->bbs, t_src->num_bbs*sizeof(trace_bb_info_t));
             t_dst->num_bbs = t_src->num_bbs;
+            STATS_ADD_PEAK(fragment_metadata_trace,
+                           t_src->num_bbs*sizeof(trace_bb_info_t));
         }
 
 #ifdef PROFILE_RDTSC
@@ -4384,7 +4434,7 @@ fragment_add_ibl_target(dcontext_t *dcontext, app_pc tag,
 #endif
         }
     } else {
-        STATS_INC(num_ibt_cold_misses);
+        RSTATS_INC(num_ibt_cold_misses);
     }
 #ifdef HASHTABLE_STATISTICS
     if (INTERNAL_OPTION(stay_on_trace_stats)) {
@@ -5691,34 +5741,85 @@ check_safe_for_flush_synch(dcontext_t *dcontext)
 #endif /* DEBUG */
 
 #ifdef CLIENT_INTERFACE
+/* Returns whether [start,end) overlaps or abuts req's region, so that flushing
+ * their union covers no address that neither asked for.
+ */
+static inline bool
+client_flush_req_touches(client_flush_req_t *req, app_pc start, app_pc end)
+{
+    return req->start <= end && req->start + req->size >= start;
+}
+
+/* Before flushing, coalesces overlapping or adjacent requests so that a burst of
+ * dr_delay_flush_region() calls costs one flush per contiguous region rather
+ * than one per call.  Requests without a callback are merged wherever they
+ * appear in the list; requests with a callback are merged only with a run of
+ * successors that also have one, and every callback in the run is invoked
+ * once the combined synch-all flush completes.
+ */
 static void
 process_client_flush_requests(dcontext_t *dcontext, dcontext_t *alloc_dcontext,
                               client_flush_req_t *req, bool flush)
 {
     client_flush_req_t *iter = req;
     while (iter != NULL) {
-        client_flush_req_t *next = iter->next;
+        client_flush_req_t *run_end = iter, *next;
+        bool done;
         if (flush) {
-            /* Note that we don't free futures from potentially linked-to region b/c we
-             * don't have lazy linking (xref case 2236) */
-            /* FIXME - if there's more then one of these would be nice to batch them
-             * especially for the synch all ones. */
-            if (iter->flush_callback != NULL) {
-                /* FIXME - for implementation simplicity we do a synch-all flush so
-                 * that we can inform the client right away, it might be nice to use
-                 * the more performant regular flush when possible. */
-                flush_fragments_from_region(dcontext, iter->start, iter->size,
-                                            true/*force synchall*/);
-                (*iter->flush_callback)(iter->flush_id);
+            app_pc start = iter->start;
+            app_pc end = iter->start + iter->size;
+            bool synchall = (iter->flush_callback != NULL);
+            if (!synchall) {
+                /* Absorb later callback-less requests; repeat since each
+                 * growth of the region can make an earlier-skipped one touch.
+                 */
+                bool absorbed;
+                do {
+                    client_flush_req_t *prev = iter, *cur;
+                    absorbed = false;
+                    for (cur = iter->next; cur != NULL; cur = next) {
+                        next = cur->next;
+                        if (cur->flush_callback == NULL &&
+                            client_flush_req_touches(cur, start, end)) {
+                            start = MIN(start, cur->start);
+                            end = MAX(end, cur->start + cur->size);
+                            prev->next = next;
+                            HEAP_TYPE_FREE(alloc_dcontext, cur, client_flush_req_t,
+                                           ACCT_CLIENT, UNPROTECTED);
+                            STATS_INC(num_client_flushes_coalesced);
+                            absorbed = true;
+                        } else
+                            prev = cur;
+                    }
+                } while (absorbed);
             } else {
-                /* do a regular flush */
-                flush_fragments_from_region(dcontext, iter->start, iter->size,
-                                            false/*don't force synchall*/);
+                while (run_end->next != NULL && run_end->next->flush_callback != NULL &&
+                       client_flush_req_touches(run_end->next, start, end)) {
+                    run_end = run_end->next;
+                    start = MIN(start, run_end->start);
+                    end = MAX(end, run_end->start + run_end->size);
+                    STATS_INC(num_client_flushes_coalesced);
+                }
             }
+            /* Note that we don't free futures from potentially linked-to region b/c we
+             * don't have lazy linking (xref case 2236) */
+            /* FIXME - for implementation simplicity we do a synch-all flush for
+             * requests with a callback so that we can inform the client right away,
+             * it might be nice to use the more performant regular flush when
+             * possible.
+             */
+            flush_fragments_from_region(dcontext, start, end - start,
+                                        synchall/*force synchall*/);
         }
-        HEAP_TYPE_FREE(alloc_dcontext, iter, client_flush_req_t, ACCT_CLIENT,
-                       UNPROTECTED);
-        iter = next;
+        do {
+            next = iter->next;
+            done = (iter == run_end);
+            if (flush && iter->flush_callback != NULL)
+                (*iter->flush_callback)(iter->flush_id);
+            HEAP_TYPE_FREE(alloc_dcontext, iter, client_flush_req_t, ACCT_CLIENT,
+                           UNPROTECTED);
+            iter = next;
+        } while (!done);
     }
 }
 #endif
@@ -6035,7 +6136,7 @@ flush_fragments_synchall_start(dcontext_t *ignored, app_pc base, size_t size,
         "\nflush_fragments_synchall_start: thread "TIDFMT" suspending all threads\n",
         get_thread_id());
 
-    STATS_INC(flush_synchall);
+    RSTATS_INC(flush_synchall);
     /* suspend all DR-controlled threads at safe locations */
     DEBUG_DECLARE(ok =)
         synch_with_all_threads(desired_state, &flush_threads, &flush_num_threads,
@@ -6552,7 +6653,7 @@ flush_fragments_synch_unlink_priv(dcontext_t *dcontext, app_pc base, size_t size
     ASSERT_CURIOSITY(size == 0 ||
                      executable_vm_area_overlap(base, base+size, false/*no lock*/));
 
-    STATS_INC(num_flushes);
+    RSTATS_INC(num_flushes);
 
     if (force_synchall ||
         (size > 0 && executable_vm_area_coarse_overlap(base, base+size))) {
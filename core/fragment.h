@@ -156,6 +156,10 @@
 
 /* This fragment immediately follows a free entry in the fcache */
 #define FRAG_FOLLOWS_FREE_ENTRY   0x80000000
+/* Free lists are only used for shared caches, so for private fragments we re-use
+ * the bit to mark entry since the -cache_replace_clock hand last passed.
+ */
+#define FRAG_FIFO_REFERENCED      FRAG_FOLLOWS_FREE_ENTRY
 
 /* Flags that a future fragment can transfer to a real on taking its place:
  * Naturally we don't want FRAG_IS_FUTURE or FRAG_WAS_DELETED.
@@ -442,6 +446,7 @@ typedef struct _fragment_entry_t {
 #define NAME_KEY ibl
 #define ENTRY_TYPE fragment_entry_t
 /* not defining HASHTABLE_USE_LOOKUPTABLE */
+#define HASHTABLE_INCREMENTAL_RESIZE 1
 #ifdef HASHTABLE_STATISTICS
 # define HASHTABLE_ENTRY_STATS 1
 # define CUSTOM_FIELDS \
@@ -1021,6 +1021,11 @@ struct _dcontext_t {
 
     /* Used to abort bb building on decode faults.  Not persistent across cache. */
     void *bb_build_info;
+    /* Set by dispatch while building a bb without the bb_building_lock because
+     * another thread held it (-private_bbs_on_contention).  The bb is then
+     * made thread-private.
+     */
+    bool bb_build_unshared;
 
 #ifdef UNIX
     pending_nudge_t *nudge_pending;
@@ -102,6 +102,18 @@
  * to obtain persistence routines, define
  *   HASHTABLE_SUPPORT_PERSISTENCE
  *
+ * to rehash a grown table's old entries a few at a time on later adds rather
+ * than all at once (only safe for tables caching data held elsewhere, since a
+ * lookup misses an entry until it is migrated), define
+ *   HASHTABLE_INCREMENTAL_RESIZE
+ *   uint HASHTABLE_MIGRATE_STEP
+ *     entries to migrate per add; 0 rehashes on resize as usual
+ *
+ * to observe collisions on insertion, define
+ *   HASHTABLE_ADD_CLUSTER_HOOK(dcontext, table, cluster_len)
+ *     called on every add with the count of occupied slots probed past
+ *     the home slot, including adds made while rehashing on a resize
+ *
  * for custom behavior we assume that these routines exist:
  *
  *    static void
@@ -225,6 +237,18 @@ typedef struct HTNAME(_,NAME_KEY,_table_t) {
 #ifdef HASHTABLE_USE_LOOKUPTABLE
     byte *lookup_table_unaligned; /* real allocation unit for lookuptable */
 #endif
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+    /* Pre-resize table whose slots from migrate_index on are yet to be rehashed
+     * into table.  migrate_pending counts its real entries, which count toward
+     * the resize threshold but not toward entries.
+     */
+    ENTRY_TYPE *migrate_table;
+    ENTRY_TYPE *migrate_table_unaligned; /* NULL if migrate_table is a private copy */
+    ptr_uint_t migrate_hash_mask;
+    uint migrate_capacity;
+    uint migrate_index;
+    uint migrate_pending;
+#endif
 #ifdef DEBUG
     const char *name;
     bool is_local;           /* no lock needed since only known to this thread */
@@ -248,6 +272,12 @@ HTNAME(hashtable_,NAME_KEY,_init_internal_custom)(dcontext_t *dcontext,
                                                   HTNAME(,NAME_KEY,_table_t) *htable
                                                   _IFLOOKUP(bool use_lookup));
 
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+static void
+HTNAME(hashtable_,NAME_KEY,_migrate_free)(dcontext_t *dcontext,
+                                          HTNAME(,NAME_KEY,_table_t) *table);
+#endif
+
 static void
 HTNAME(hashtable_,NAME_KEY,_resized_custom)(dcontext_t *dcontext,
                                             HTNAME(,NAME_KEY,_table_t) *htable,
@@ -548,6 +578,13 @@ HTNAME(hashtable_,NAME_KEY,_init)(dcontext_t *dcontext,
     table->entry_stats = NULL;
     table->added_since_dumped = 0;
 # endif
+#endif
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+    table->migrate_table = NULL;
+    table->migrate_table_unaligned = NULL;
+    table->migrate_capacity = 0;
+    table->migrate_index = 0;
+    table->migrate_pending = 0;
 #endif
     ASSERT(dcontext != GLOBAL_DCONTEXT || TEST(HASHTABLE_SHARED, table_flags));
     HTNAME(hashtable_,NAME_KEY,_init_internal)(dcontext, table, bits,
@@ -620,6 +657,10 @@ HTNAME(hashtable_,NAME_KEY,_free)(dcontext_t *dcontext,
 # endif
 #endif /* HASHTABLE_STATISTICS */
 
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+    if (table->migrate_table != NULL)
+        HTNAME(hashtable_,NAME_KEY,_migrate_free)(dcontext, table);
+#endif
     HTNAME(hashtable_,NAME_KEY,_free_table)(dcontext, table->table_unaligned
                                             _IFLOOKUP(table->lookup_table_unaligned),
                                             table->table_flags, table->capacity);
@@ -778,6 +819,118 @@ HTNAME(hashtable_,NAME_KEY,_rlookup)(dcontext_t *dcontext, ptr_uint_t tag,
     return e;
 }
 
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+/* Returns the slot holding fr's tag among the not-yet-migrated slots of the
+ * pre-resize table, or NULL if there is none.
+ */
+static inline ENTRY_TYPE *
+HTNAME(hashtable_,NAME_KEY,_migrate_lookup)(ENTRY_TYPE fr,
+                                            HTNAME(,NAME_KEY,_table_t) *table)
+{
+    uint wrap_mask, hindex;
+    if (table->migrate_table == NULL)
+        return NULL;
+    /* Resizing keeps the hash function and offset, so only the mask differs. */
+    wrap_mask = (uint)(table->migrate_hash_mask >> table->hash_mask_offset);
+    hindex = (uint)((HASH_VALUE_FOR_TABLE(ENTRY_TAG(fr), table) &
+                     table->migrate_hash_mask) >> table->hash_mask_offset);
+    while (!ENTRY_IS_EMPTY(table->migrate_table[hindex])) {
+        if (ENTRIES_ARE_EQUAL(table, fr, table->migrate_table[hindex])) {
+            /* Slots before migrate_index are stale copies of migrated entries. */
+            return (hindex >= table->migrate_index) ?
+                &table->migrate_table[hindex] : NULL;
+        }
+        hindex = (hindex + 1) & wrap_mask;
+    }
+    return NULL;
+}
+
+/* Drops the not-yet-migrated copy of e's tag, if any, for e is now
+ * found in or about to be added to the new table.  Returns whether there was one.
+ */
+static inline bool
+HTNAME(hashtable_,NAME_KEY,_migrate_drop)(ENTRY_TYPE e,
+                                          HTNAME(,NAME_KEY,_table_t) *table)
+{
+    ENTRY_TYPE *pg = HTNAME(hashtable_,NAME_KEY,_migrate_lookup)(e, table);
+    if (pg == NULL)
+        return false;
+    /* Not empty, so that later probes of this cluster still see past it. */
+    *pg = ENTRY_SENTINEL;
+    ASSERT(table->migrate_pending > 0);
+    table->migrate_pending--;
+    return true;
+}
+
+/* Adds an entry coming from the pre-resize table, without the size checks of
+ * hashtable_add as it was already counted toward the resize threshold.
+ */
+static inline void
+HTNAME(hashtable_,NAME_KEY,_migrate_insert)(HTNAME(,NAME_KEY,_table_t) *table,
+                                            ENTRY_TYPE e)
+{
+    uint hindex = HASH_FUNC(ENTRY_TAG(e), table);
+    while (!ENTRY_IS_EMPTY(table->table[hindex])) {
+        /* A miss may have re-added this entry before we got to it. */
+        if (ENTRIES_ARE_EQUAL(table, e, table->table[hindex]))
+            return;
+        hindex = HASH_INDEX_WRAPAROUND(hindex + 1, table);
+    }
+    table->table[hindex] = e;
+    table->entries++;
+}
+
+static void
+HTNAME(hashtable_,NAME_KEY,_migrate_free)(dcontext_t *dcontext,
+                                          HTNAME(,NAME_KEY,_table_t) *table)
+{
+    dcontext_t *alloc_dc = FRAGMENT_TABLE_ALLOC_DC(dcontext, table->table_flags);
+    if (table->migrate_table_unaligned != NULL) {
+        HTNAME(hashtable_,NAME_KEY,_free_table)
+            (alloc_dc, table->migrate_table_unaligned _IFLOOKUP(NULL),
+             table->table_flags, table->migrate_capacity);
+    } else {
+        HEAP_ARRAY_FREE(alloc_dc, table->migrate_table, ENTRY_TYPE,
+                        table->migrate_capacity,
+                        HASHTABLE_WHICH_HEAP(table->table_flags), PROTECTED);
+    }
+    table->migrate_table = NULL;
+    table->migrate_table_unaligned = NULL;
+    table->migrate_pending = 0;
+}
+
+/* Rehashes up to max_entries of the pre-resize table's remaining entries into
+ * the table, freeing the pre-resize table once they have all been moved.
+ * Caller must hold the write lock, if this is a shared table!
+ */
+static void
+HTNAME(hashtable_,NAME_KEY,_migrate)(dcontext_t *dcontext,
+                                     HTNAME(,NAME_KEY,_table_t) *table,
+                                     uint max_entries)
+{
+    uint migrated = 0;
+    if (table->migrate_table == NULL)
+        return;
+    ASSERT_TABLE_SYNCHRONIZED(table, WRITE);
+    while (table->migrate_index < table->migrate_capacity && migrated < max_entries) {
+        ENTRY_TYPE e = table->migrate_table[table->migrate_index++];
+        if (!ENTRY_IS_REAL(e))
+            continue;
+        ASSERT(table->migrate_pending > 0);
+        table->migrate_pending--;
+        HTNAME(hashtable_,NAME_KEY,_migrate_insert)(table, e);
+        migrated++;
+    }
+    STATS_ADD(num_ibt_entries_migrated, migrated);
+    if (table->migrate_index >= table->migrate_capacity) {
+        ASSERT(table->migrate_pending == 0);
+        LOG(THREAD, LOG_HTABLE, 2, "%s hashtable finished migrating to capacity %d\n",
+            table->name, table->capacity);
+        HTNAME(hashtable_,NAME_KEY,_migrate_free)(dcontext, table);
+    }
+}
+#endif /* HASHTABLE_INCREMENTAL_RESIZE */
+
 /* add f to a fragment table
  * returns whether resized the table or not
  * N.B.: this routine will recursively call itself via check_table_size if the
@@ -789,7 +942,9 @@ HTNAME(hashtable_,NAME_KEY,_add)(dcontext_t *dcontext, ENTRY_TYPE e,
 {
     uint hindex;
     bool resized;
-    DEBUG_DECLARE(uint cluster_len = 0;)
+#if defined(DEBUG) || defined(HASHTABLE_ADD_CLUSTER_HOOK)
+    uint cluster_len = 0;
+#endif
 
     ASSERT_TABLE_SYNCHRONIZED(table, WRITE); /* add requires write lock */
 
@@ -807,6 +962,11 @@ HTNAME(hashtable_,NAME_KEY,_add)(dcontext_t *dcontext, ENTRY_TYPE e,
      * call, like hindex, as it will change if resized.
      */
     resized = !HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext, table, 1, 0);
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+    /* We supersede any copy waiting to be migrated, which was already counted. */
+    if (HTNAME(hashtable_,NAME_KEY,_migrate_drop)(e, table))
+        STATS_INC(num_ibt_entries_readded_before_migration);
+#endif
 
     hindex = HASH_FUNC(ENTRY_TAG(e), table);
     /* find an empty null slot */
@@ -857,9 +1017,14 @@ HTNAME(hashtable_,NAME_KEY,_add)(dcontext_t *dcontext, ENTRY_TYPE e,
                 break;
             }
         }
-        DODEBUG({++cluster_len;});
+#if defined(DEBUG) || defined(HASHTABLE_ADD_CLUSTER_HOOK)
+        ++cluster_len;
+#endif
         hindex = HASH_INDEX_WRAPAROUND(hindex + 1, table);
     } while (1);
+#ifdef HASHTABLE_ADD_CLUSTER_HOOK
+    HASHTABLE_ADD_CLUSTER_HOOK(dcontext, table, cluster_len);
+#endif
 
     /* FIXME: case 4814 we may want to flush the table if we are running into a too long
      * collision cluster
@@ -922,6 +1087,9 @@ HTNAME(hashtable_,NAME_KEY,_add)(dcontext_t *dcontext, ENTRY_TYPE e,
     LOG(THREAD_GET, LOG_HTABLE, 4,
         "hashtable_"KEY_STRING"_add: added "PFX" to %s at table[%u]\n",
         ENTRY_TAG(e), table->name, hindex);
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+    HTNAME(hashtable_,NAME_KEY,_migrate)(dcontext, table, HASHTABLE_MIGRATE_STEP);
+#endif
 
     return resized;
 }
@@ -1010,6 +1178,16 @@ HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext_t *dcontext,
      * followed up by a full removal of the unlinked entries.
      */
     entries = lockless ? table->entries + table->unlinked_entries : table->entries;
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+    if (table->migrate_table != NULL &&
+        entries + table->migrate_pending > table->resize_threshold) {
+        /* Finish the earlier migration before considering growing again. */
+        HTNAME(hashtable_,NAME_KEY,_migrate)(dcontext, table, UINT_MAX);
+        STATS_INC(num_ibt_migrations_completed_by_resize);
+        entries = lockless ? table->entries + table->unlinked_entries : table->entries;
+    }
+    entries += table->migrate_pending;
+#endif
     if (entries > table->resize_threshold) {
         ENTRY_TYPE *old_table = table->table;
         ENTRY_TYPE *old_table_unaligned = table->table_unaligned;
@@ -1022,6 +1200,10 @@ HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext_t *dcontext,
                                                     * reference to the table */
         uint i;
         DEBUG_DECLARE(uint old_entries  = table->entries - add_later;)
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+        ptr_uint_t old_hash_mask = table->hash_mask;
+        uint old_real_entries = table->entries - add_now - add_later;
+#endif
 
         DODEBUG({
             /* study before resizing */
@@ -1045,6 +1227,9 @@ HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext_t *dcontext,
             HTNAME(hashtable_,NAME_KEY,_groom_helper)(dcontext, table);
             return true; /* == did not resize the table */
         }
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+        KSTART(ibl_table_resize);
+#endif
 
         /* For an IBT table, if the # unlinked entries is what kicked
          * in the resize then check the # actual entries and do
@@ -1081,6 +1266,35 @@ HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext_t *dcontext,
         table->unlinked_entries = 0;
         ASSERT(table->ref_count == 0);
 
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+        if (HASHTABLE_MIGRATE_STEP > 0 && table->capacity > old_capacity) {
+            /* Rather than stalling to rehash every entry here, leave them to be
+             * moved a few at a time by later adds.  Until then a lookup misses on
+             * them, which is fine as this table only caches data held elsewhere.
+             */
+            table->migrate_hash_mask = old_hash_mask;
+            table->migrate_capacity = old_capacity;
+            table->migrate_index = 0;
+            table->migrate_pending = old_real_entries;
+            if (!shared_lockless || old_ref_count == 0) {
+                table->migrate_table = old_table;
+                table->migrate_table_unaligned = old_table_unaligned;
+            } else {
+                /* Other threads still look up in the old table, which
+                 * resized_custom is about to nullify, so we migrate from a copy.
+                 */
+                table->migrate_table = HEAP_ARRAY_ALLOC(alloc_dc, ENTRY_TYPE,
+                                                        old_capacity,
+                                                        HASHTABLE_WHICH_HEAP
+                                                        (table->table_flags),
+                                                        PROTECTED);
+                memcpy(table->migrate_table, old_table,
+                       old_capacity * sizeof(ENTRY_TYPE));
+                table->migrate_table_unaligned = NULL;
+            }
+            STATS_INC(num_ibt_incremental_resizes);
+        } else
+#endif
         /* can't just memcpy, must rehash */
         /* For open address table rehash should first find an empty
          * slot and start from there so that we make sure that entries
@@ -1143,7 +1357,11 @@ HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext_t *dcontext,
         }
         else {
             /* should have rehashed all old entries into new table */
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+            ASSERT(table->entries + table->migrate_pending == old_entries);
+#else
             ASSERT(table->entries == old_entries);
+#endif
         }
 
         LOG(THREAD, LOG_HTABLE, 2,
@@ -1170,6 +1388,11 @@ HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext_t *dcontext,
          * they are accessed while in-cache, unlike other shared tables
          * such as the shared BB or shared trace table.
          */
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+        if (table->migrate_table == old_table) {
+            /* freed by hashtable_migrate once emptied */
+        } else
+#endif
         if (!shared_lockless) {
             HTNAME(hashtable_,NAME_KEY,_free_table)
                 (alloc_dc, old_table_unaligned _IFLOOKUP(old_lookup_table_unaligned),
@@ -1192,6 +1415,9 @@ HTNAME(hashtable_,NAME_KEY,_check_size)(dcontext_t *dcontext,
              _IFLOOKUP(old_lookuptable_to_nullify)
              _IFLOOKUP(old_lookup_table_unaligned),
              old_ref_count, table->table_flags);
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+        KSTOP(ibl_table_resize);
+#endif
 
         return false; /* == resized the table */
     }
@@ -1246,6 +1472,20 @@ HTNAME(hashtable_,NAME_KEY,_lookup_for_removal)(ENTRY_TYPE fr,
         hindex = HASH_INDEX_WRAPAROUND(hindex + 1, htable);
         pg = &htable->table[hindex];
     }
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+    /* Callers go on to modify or remove the entry, so we must not leave a copy
+     * behind to be migrated later: we migrate it now instead.  The table is write
+     * locked, except when shifting fcache pointers, which is serialized per table.
+     */
+    pg = HTNAME(hashtable_,NAME_KEY,_migrate_lookup)(fr, htable);
+    if (pg != NULL) {
+        ENTRY_TYPE e = *pg;
+        HTNAME(hashtable_,NAME_KEY,_migrate_drop)(e, htable);
+        HTNAME(hashtable_,NAME_KEY,_migrate_insert)(htable, e);
+        STATS_INC(num_ibt_entries_migrated_for_removal);
+        return HTNAME(hashtable_,NAME_KEY,_lookup_for_removal)(fr, htable, rhindex);
+    }
+#endif
     *rhindex = 0; /* to make sure always initialized */
     return NULL;
 }
@@ -1482,6 +1722,10 @@ HTNAME(hashtable_,NAME_KEY,_clear)(dcontext_t *dcontext,
 #endif
     table->entries = 0;
     table->unlinked_entries = 0;
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+    if (table->migrate_table != NULL)
+        HTNAME(hashtable_,NAME_KEY,_migrate_free)(dcontext, table);
+#endif
 }
 
 /* removes all entries within a specified range of tags
@@ -1508,6 +1752,10 @@ HTNAME(hashtable_,NAME_KEY,_range_remove)(dcontext_t *dcontext,
     if (TEST(HASHTABLE_READ_ONLY, table->table_flags))
         return 0;
     LOG(THREAD, LOG_HTABLE, 2, "hashtable_"KEY_STRING"_range_remove\n");
+#ifdef HASHTABLE_INCREMENTAL_RESIZE
+    /* Any not-yet-migrated entries in the range must go too. */
+    HTNAME(hashtable_,NAME_KEY,_migrate)(dcontext, table, UINT_MAX);
+#endif
     DOLOG(2, LOG_HTABLE|LOG_STATS, {
         HTNAME(hashtable_,NAME_KEY,_load_statistics)(dcontext, table);
     });
@@ -2281,6 +2529,9 @@ HTNAME(hashtable_,NAME_KEY,_resurrect)(dcontext_t *dcontext, byte *mapped_table
 #undef HASHTABLE_USE_LOOKUPTABLE
 #undef HASHTABLE_ENTRY_STATS
 #undef HASHTABLE_SUPPORT_PERSISTENCE
+#undef HASHTABLE_ADD_CLUSTER_HOOK
+#undef HASHTABLE_INCREMENTAL_RESIZE
+#undef HASHTABLE_MIGRATE_STEP
 #undef HTLOCK_RANK
 
 #undef _IFLOOKUP
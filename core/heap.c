@@ -281,6 +281,14 @@ typedef struct _thread_units_t {
 typedef struct _thread_heap_t {
     thread_units_t *local_heap;
     thread_units_t *nonpersistent_heap;
+    /* Per-thread cache of freed global heap blocks, one list per fixed-size
+     * bucket, so that most global_heap_alloc() and global_heap_free() calls
+     * avoid global_alloc_lock (see -global_heap_thread_cache).  The blocks
+     * remain allocated from the global heap's point of view.
+     */
+    bool global_cache_enabled;
+    heap_pc global_cache[BLOCK_TYPES-1];
+    uint global_cache_count[BLOCK_TYPES-1];
 } thread_heap_t;
 
 /* global, unique thread-shared structure:
@@ -719,14 +727,20 @@ vmm_heap_initialize_unusable(vm_heap_t *vmh)
     vmh->num_free_blocks = vmh->num_blocks = 0;
 }
 
+/* With -vm_huge_pages we align the vm region to this size. */
+#define VMM_HUGE_PAGE_SIZE (2*1024*1024)
+
 static void
 vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
 {
     ptr_uint_t preferred = 0;
     heap_error_code_t error_code = 0;
+    size_t vm_align = DYNAMO_OPTION(vmm_block_size);
     ASSIGN_INIT_LOCK_FREE(vmh->lock, vmh_lock);
 
-    size = ALIGN_FORWARD(size, DYNAMO_OPTION(vmm_block_size));
+    if (DYNAMO_OPTION(vm_huge_pages) && vm_align < VMM_HUGE_PAGE_SIZE)
+        vm_align = VMM_HUGE_PAGE_SIZE;
+    size = ALIGN_FORWARD(size, vm_align);
     ASSERT(size <= MAX_VMM_HEAP_UNIT_SIZE);
     vmh->alloc_size = size;
     vmh->start_addr = NULL;
@@ -762,10 +776,10 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
                 vmh->alloc_start = os_heap_reserve_in_region
                     ((void *)ALIGN_FORWARD(reach_base, PAGE_SIZE),
                      (void *)ALIGN_BACKWARD(reach_end, PAGE_SIZE),
-                     size + DYNAMO_OPTION(vmm_block_size), &error_code, true/*+x*/);
+                     size + vm_align, &error_code, true/*+x*/);
                 if (vmh->alloc_start != NULL) {
                     vmh->start_addr = (heap_pc)
-                        ALIGN_FORWARD(vmh->alloc_start, DYNAMO_OPTION(vmm_block_size));
+                        ALIGN_FORWARD(vmh->alloc_start, vm_align);
                     request_region_be_heap_reachable(app_base, app_end - app_base);
                 }
             }
@@ -786,7 +800,7 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
                      + get_random_offset(DYNAMO_OPTION(vm_max_offset) /
                                          DYNAMO_OPTION(vmm_block_size)) *
                      DYNAMO_OPTION(vmm_block_size));
-        preferred = ALIGN_FORWARD(preferred, DYNAMO_OPTION(vmm_block_size));
+        preferred = ALIGN_FORWARD(preferred, vm_align);
         /* overflow check: w/ vm_base shouldn't happen so debug-only check */
         ASSERT(!POINTER_OVERFLOW_ON_ADD(preferred, size));
         /* let's assume a single chunk is sufficient to reserve */
@@ -811,21 +825,20 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
          * syslog or assert here
          */
         /* need extra size to ensure alignment */
-        vmh->alloc_size = size + DYNAMO_OPTION(vmm_block_size);
+        vmh->alloc_size = size + vm_align;
 #ifdef X64
         /* PR 215395, make sure allocation satisfies heap reachability contraints */
         vmh->alloc_start = os_heap_reserve_in_region
             ((void *)ALIGN_FORWARD(heap_allowable_region_start, PAGE_SIZE),
              (void *)ALIGN_BACKWARD(heap_allowable_region_end, PAGE_SIZE),
-             size + DYNAMO_OPTION(vmm_block_size), &error_code,
+             size + vm_align, &error_code,
              true/*+x*/);
 #else
         vmh->alloc_start = (heap_pc)
-            os_heap_reserve(NULL, size + DYNAMO_OPTION(vmm_block_size),
+            os_heap_reserve(NULL, size + vm_align,
                             &error_code, true/*+x*/);
 #endif
-        vmh->start_addr = (heap_pc) ALIGN_FORWARD(vmh->alloc_start,
-                                                  DYNAMO_OPTION(vmm_block_size));
+        vmh->start_addr = (heap_pc) ALIGN_FORWARD(vmh->alloc_start, vm_align);
         LOG(GLOBAL, LOG_HEAP, 1, "vmm_heap_unit_init unable to allocate at preferred="
             PFX" letting OS place sz=%dM addr="PFX"\n",
             preferred, size/(1024*1024), vmh->start_addr);
@@ -860,6 +873,12 @@ vmm_heap_unit_init(vm_heap_t *vmh, size_t size)
         ASSERT_NOT_REACHED();
     }
     vmh->end_addr = vmh->start_addr + size;
+    if (DYNAMO_OPTION(vm_huge_pages)) {
+        if (os_heap_request_huge_pages(vmh->start_addr, size))
+            RSTATS_ADD(vmm_vsize_huge_pages, size);
+        else
+            SYSLOG_INTERNAL_WARNING_ONCE("Unable to request huge pages for vmm heap");
+    }
     ASSERT_TRUNCATE(vmh->num_blocks, uint, size / DYNAMO_OPTION(vmm_block_size));
     vmh->num_blocks = (uint) (size / DYNAMO_OPTION(vmm_block_size));
     vmh->num_free_blocks = vmh->num_blocks;
@@ -2791,10 +2810,153 @@ common_global_heap_free(thread_units_t *tu, void *p, size_t size
     ASSERT(ok);
 }
 
+/* Returns the current thread's heap if its global heap block cache can be used. */
+static inline thread_heap_t *
+global_cache_thread_heap(void)
+{
+    dcontext_t *dcontext;
+    thread_heap_t *th;
+    /* The cache writes list pointers into blocks outside of global_alloc_lock. */
+    if (DYNAMO_OPTION(global_heap_thread_cache) == 0 ||
+        TEST(SELFPROT_GLOBAL, DYNAMO_OPTION(protect_mask)))
+        return NULL;
+    dcontext = get_thread_private_dcontext();
+    if (dcontext == NULL || dcontext == GLOBAL_DCONTEXT)
+        return NULL;
+    th = (thread_heap_t *) dcontext->heap_field;
+    if (th == NULL || !th->global_cache_enabled)
+        return NULL;
+    return th;
+}
+
+/* Returns the fixed-size bucket for size, or BLOCK_TYPES-1 for variable-sized. */
+static inline int
+global_cache_bucket(size_t size)
+{
+    int bucket = 0;
+    size_t aligned_size = ALIGN_FORWARD(size, HEAP_ALIGNMENT);
+    if (size == 0 || size > MAX_VALID_HEAP_ALLOCATION)
+        return BLOCK_TYPES-1;
+    while (aligned_size > BLOCK_SIZES[bucket])
+        bucket++;
+    return bucket;
+}
+
+/* Returns the oldest num blocks of th's cache for bucket to the global heap
+ * under a single acquisition of global_alloc_lock.
+ */
+static void
+global_cache_release(thread_heap_t *th, int bucket, uint num)
+{
+    heap_pc p, next;
+    uint i;
+    /* The cache is a LIFO list: keep the most recently freed (and thus most
+     * likely cache-hot) blocks, by skipping over them first.
+     */
+    uint keep = th->global_cache_count[bucket] - num;
+    heap_pc *prev = &th->global_cache[bucket];
+    ASSERT(num <= th->global_cache_count[bucket]);
+    for (i = 0; i < keep; i++)
+        prev = (heap_pc *) *prev;
+    p = *prev;
+    *prev = NULL;
+    th->global_cache_count[bucket] = keep;
+    acquire_recursive_lock(&global_alloc_lock);
+    for (i = 0; i < num; i++) {
+        bool ok;
+        ASSERT(p != NULL);
+        next = *(heap_pc *) p;
+        /* A bucket-sized block never needs to free a unit, so this cannot fail. */
+        ok = common_heap_free(&heapmgt->global_units, p, BLOCK_SIZES[bucket]
+                              HEAPACCT(ACCT_MEM_MGT));
+        ASSERT(ok);
+        p = next;
+    }
+    release_recursive_lock(&global_alloc_lock);
+    ASSERT(p == NULL);
+}
+
+/* Returns all of th's cached blocks to the global heap and stops further caching. */
+static void
+global_cache_flush(thread_heap_t *th)
+{
+    int bucket;
+    th->global_cache_enabled = false;
+    for (bucket = 0; bucket < BLOCK_TYPES-1; bucket++) {
+        if (th->global_cache_count[bucket] > 0)
+            global_cache_release(th, bucket, th->global_cache_count[bucket]);
+    }
+}
+
+/* Refills th's empty cache for bucket with a batch of blocks taken under a single
+ * acquisition of global_alloc_lock and returns one of them.
+ */
+static heap_pc
+global_cache_refill(thread_heap_t *th, int bucket)
+{
+    heap_pc p;
+    uint i, num = MAX(DYNAMO_OPTION(global_heap_thread_cache) / 2, 1);
+    ASSERT(th->global_cache[bucket] == NULL && th->global_cache_count[bucket] == 0);
+    acquire_recursive_lock(&global_alloc_lock);
+    for (i = 0; i < num; i++) {
+        p = common_heap_alloc(&heapmgt->global_units, BLOCK_SIZES[bucket]
+                              HEAPACCT(ACCT_MEM_MGT));
+        /* NULL means a new unit is needed: leave that to the slow path below. */
+        if (p == NULL)
+            break;
+        *(heap_pc *) p = th->global_cache[bucket];
+        th->global_cache[bucket] = p;
+        th->global_cache_count[bucket]++;
+    }
+    release_recursive_lock(&global_alloc_lock);
+    p = th->global_cache[bucket];
+    if (p == NULL) {
+        return (heap_pc) common_global_heap_alloc(&heapmgt->global_units,
+                                                  BLOCK_SIZES[bucket]
+                                                  HEAPACCT(ACCT_MEM_MGT));
+    }
+    th->global_cache[bucket] = *(heap_pc *) p;
+    th->global_cache_count[bucket]--;
+    return p;
+}
+
+static void *
+global_cache_alloc(thread_heap_t *th, int bucket)
+{
+    heap_pc p = th->global_cache[bucket];
+    if (p == NULL)
+        p = global_cache_refill(th, bucket);
+    else {
+        th->global_cache[bucket] = *(heap_pc *) p;
+        th->global_cache_count[bucket]--;
+    }
+    DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_ALLOCATED_BYTE, sizeof(void *)););
+    return (void *) p;
+}
+
+static void
+global_cache_free(thread_heap_t *th, void *p, int bucket)
+{
+    /* Cached blocks are still allocated: we do not use HEAP_UNALLOCATED_BYTE
+     * as common_heap_free() would then complain of a double free on release.
+     */
+    DOCHECK(CHKLVL_MEMFILL, memset(p, HEAP_ALLOCATED_BYTE, BLOCK_SIZES[bucket]););
+    *(heap_pc *) p = th->global_cache[bucket];
+    th->global_cache[bucket] = (heap_pc) p;
+    th->global_cache_count[bucket]++;
+    if (th->global_cache_count[bucket] > DYNAMO_OPTION(global_heap_thread_cache)) {
+        global_cache_release(th, bucket,
+                             th->global_cache_count[bucket] -
+                             DYNAMO_OPTION(global_heap_thread_cache) / 2);
+    }
+}
+
 /* these functions use the global heap instead of a thread's heap: */
 void *
 global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 {
+    thread_heap_t *th;
+    int bucket;
     void *p;
 #ifdef CLIENT_INTERFACE
     /* We pay the cost of this branch to support using DR's decode routines from the
@@ -2807,7 +2969,12 @@ global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
         standalone_init();
     }
 #endif
-    p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
+    th = global_cache_thread_heap();
+    bucket = global_cache_bucket(size);
+    if (th != NULL && bucket < BLOCK_TYPES-1)
+        p = global_cache_alloc(th, bucket);
+    else
+        p = common_global_heap_alloc(&heapmgt->global_units, size HEAPACCT(which));
     ASSERT(p != NULL);
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal alloc: "PFX" (%d bytes)\n", p, size);
     return p;
@@ -2816,7 +2983,12 @@ global_heap_alloc(size_t size HEAPACCT(which_heap_t which))
 void
 global_heap_free(void *p, size_t size HEAPACCT(which_heap_t which))
 {
-    common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
+    thread_heap_t *th = global_cache_thread_heap();
+    int bucket = global_cache_bucket(size);
+    if (th != NULL && bucket < BLOCK_TYPES-1 && p != NULL)
+        global_cache_free(th, p, bucket);
+    else
+        common_global_heap_free(&heapmgt->global_units, p, size HEAPACCT(which));
     LOG(GLOBAL, LOG_HEAP, 6, "\nglobal free: "PFX" (%d bytes)\n", p, size);
 }
 
@@ -2929,6 +3101,43 @@ heap_create_unit(thread_units_t *tu, size_t size, bool must_be_new)
     return u;
 }
 
+/* Caller must hold heap_unit_lock.  Returns the committed bytes held by the
+ * dead list.
+ */
+static size_t
+heap_dead_list_commit_size(void)
+{
+    heap_unit_t *u;
+    size_t commit = 0;
+    ASSERT_OWN_RECURSIVE_LOCK(true, &heap_unit_lock);
+    for (u = heapmgt->heap.dead; u != NULL; u = u->next_global)
+        commit += UNIT_COMMIT_SIZE(u);
+    return commit;
+}
+
+/* Returns unit's memory beyond what a new unit commits up front to the OS,
+ * leaving the unit ready for reuse from the dead list.
+ * Caller must hold the DR areas lock so the unit cannot be reused underneath us.
+ */
+static void
+heap_unit_retract_commitment(heap_unit_t *unit)
+{
+    heap_pc new_end = (heap_pc)
+        ALIGN_FORWARD((ptr_uint_t)unit + DYNAMO_OPTION(heap_commit_increment), PAGE_SIZE);
+    ASSERT(self_owns_dynamo_vm_area_lock());
+    if (unit->end_pc > new_end) {
+        heap_error_code_t error_code;
+        size_t decommit_size = unit->end_pc - new_end;
+        LOG(GLOBAL, LOG_HEAP, 2, "	decommitting dead unit "PFX" "PFX"-"PFX"\n",
+            unit, new_end, unit->end_pc);
+        vmm_heap_decommit(new_end, decommit_size, &error_code);
+        unit->end_pc = new_end;
+        RSTATS_SUB(heap_capacity, decommit_size);
+        STATS_ADD_PEAK(heap_reserved_only, decommit_size);
+        RSTATS_ADD(heap_dead_decommit, decommit_size);
+    }
+}
+
 /* dcontext only used to determine whether a global unit or not */
 static void
 heap_free_unit(heap_unit_t *unit, dcontext_t *dcontext)
@@ -2997,6 +3206,12 @@ heap_free_unit(heap_unit_t *unit, dcontext_t *dcontext)
     if (UNITALLOC(unit) <= HEAP_UNIT_MAX_SIZE &&
         (heapmgt->heap.num_dead < 5 ||
          heapmgt->heap.num_dead * 4U <= (uint) get_num_threads())) {
+        /* Keep idle memory bounded: past the retain budget the unit goes on
+         * the list holding only its initial commitment.
+         */
+        if (heap_dead_list_commit_size() + UNIT_COMMIT_SIZE(unit) >
+            DYNAMO_OPTION(heap_dead_commit_retain))
+            heap_unit_retract_commitment(unit);
         /* Keep dead list sorted small-to-large to avoid grabbing large
          * when can take small and then needing to allocate when only
          * have small left.  Helps out with lots of small threads.
@@ -3283,6 +3498,9 @@ heap_thread_init(dcontext_t *dcontext)
             global_heap_alloc(sizeof(thread_units_t) HEAPACCT(ACCT_MEM_MGT));
     } else
         th->nonpersistent_heap = NULL;
+    memset(th->global_cache, 0, sizeof(th->global_cache));
+    memset(th->global_cache_count, 0, sizeof(th->global_cache_count));
+    th->global_cache_enabled = true;
     heap_thread_reset_init(dcontext);
 }
 
@@ -3305,6 +3523,8 @@ void
 heap_thread_exit(dcontext_t *dcontext)
 {
     thread_heap_t *th = (thread_heap_t *) dcontext->heap_field;
+    /* This also ensures that the frees below go straight to the global heap. */
+    global_cache_flush(th);
     threadunits_exit(th->local_heap, dcontext);
     heap_thread_reset_free(dcontext);
     global_heap_free(th->local_heap, sizeof(thread_units_t) HEAPACCT(ACCT_MEM_MGT));
@@ -3314,6 +3534,8 @@ heap_thread_exit(dcontext_t *dcontext)
                          HEAPACCT(ACCT_MEM_MGT));
     }
     global_heap_free(th, sizeof(thread_heap_t) HEAPACCT(ACCT_MEM_MGT));
+    /* Later global heap use by this thread must not look at the freed cache. */
+    dcontext->heap_field = NULL;
 }
 
 #if defined(DEBUG_MEMORY) && defined(DEBUG)
@@ -210,6 +210,22 @@ do { \
     */
 #  define ANNOT_LBL(annot, base) #annot "_label@GOT(%" base ")"
 # endif
+/* On ELF targets each annotation site also emits an empty "DynamoRIO" note of type
+ * DR_ANNOTATION_NOTE_TYPE, which the linker gathers into a PT_NOTE segment. This lets
+ * DR restrict annotation detection to the modules that contain annotations (see the
+ * runtime option -annotations_from_notes). The note is outside the code sequence, so
+ * it has no cost when running natively.
+ */
+# define DR_ANNOTATION_NOTE_NAME "DynamoRIO"
+# define DR_ANNOTATION_NOTE_TYPE 1
+# ifdef __ELF__
+#  define DR_ANNOTATION_NOTE \
+    ".pushsection .note.dynamorio.annotation,\"a\",@note; \
+     .balign 4; .long 10; .long 0; .long 1; .asciz \"DynamoRIO\"; .balign 4; \
+     .popsection;"
+# else
+#  define DR_ANNOTATION_NOTE ""
+# endif
 # define DR_ANNOTATION_ATTRIBUTES \
     __attribute__((noinline, visibility("hidden") _CALL_TYPE))
 # define DR_WEAK_DECLARATION __attribute__ ((weak))
@@ -218,7 +234,8 @@ do { \
 ({ \
     __label__ native_run, native_end_marker; \
     extern const char *annotation##_label; \
-    __asm__ volatile goto (".byte 0xeb; .byte "LABEL_REFERENCE_LENGTH"; \
+    __asm__ volatile goto (DR_ANNOTATION_NOTE \
+                           ".byte 0xeb; .byte "LABEL_REFERENCE_LENGTH"; \
                             mov _GLOBAL_OFFSET_TABLE_,%"LABEL_REFERENCE_REGISTER"; \
                             bsf " ANNOT_LBL(annotation, LABEL_REFERENCE_REGISTER) ", \
                                %" LABEL_REFERENCE_REGISTER "; \
@@ -240,7 +257,8 @@ do { \
     { \
         __label__ native_run, native_end_marker; \
         extern const char *annotation##_label; \
-        __asm__ volatile goto (".byte 0xeb; .byte "LABEL_REFERENCE_LENGTH"; \
+        __asm__ volatile goto (DR_ANNOTATION_NOTE \
+                               ".byte 0xeb; .byte "LABEL_REFERENCE_LENGTH"; \
                                mov _GLOBAL_OFFSET_TABLE_,%"LABEL_REFERENCE_REGISTER"; \
                                bsr " ANNOT_LBL(annotation, LABEL_REFERENCE_REGISTER) ", \
                                   %" LABEL_REFERENCE_REGISTER "; \
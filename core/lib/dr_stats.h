@@ -48,6 +48,12 @@
 #elif defined(UNIX)
 # define DYNAMORIO_MAGIC_STRING "DYNAMORIO_MAGIC_STRING"
 # define DYNAMORIO_MAGIC_STRING_LEN 16 /*include trailing \0*/
+/* With -rstats_shm_dir, each process publishes its dr_statistics_t in the file
+ * <dir>/DR_STATS_SHM_PREFIX.<pid>, which an external process can map read-only.
+ * Compiled with NOT_DYNAMORIO_CORE, dr_statistics_t below gives its layout, with
+ * num_stats entries in stats[].  The file is removed when the process exits.
+ */
+# define DR_STATS_SHM_PREFIX "dynamorio_stats"
 #endif
 
 #define STAT_NAME_MAX_LEN 50
@@ -1068,6 +1068,8 @@ typedef char liststring_t[MAX_LIST_OPTION_LENGTH];
 #endif
 
 #define DYNAMORIO_VAR_CONFIGDIR_ID  DYNAMORIO_CONFIGDIR
+/* If set, config files are not searched and only env vars are used */
+#define DYNAMORIO_VAR_CONFIG_ENV_ONLY_ID  DYNAMORIO_CONFIG_ENV_ONLY
 #define DYNAMORIO_VAR_HOME_ID       DYNAMORIO_HOME
 #define DYNAMORIO_VAR_LOGDIR_ID     DYNAMORIO_LOGDIR
 #define DYNAMORIO_VAR_OPTIONS_ID    DYNAMORIO_OPTIONS
@@ -1113,6 +1115,7 @@ typedef char liststring_t[MAX_LIST_OPTION_LENGTH];
 #endif
 
 #define DYNAMORIO_VAR_CONFIGDIR  STRINGIFY(DYNAMORIO_VAR_CONFIGDIR_ID)
+#define DYNAMORIO_VAR_CONFIG_ENV_ONLY  STRINGIFY(DYNAMORIO_VAR_CONFIG_ENV_ONLY_ID)
 #define DYNAMORIO_VAR_HOME       STRINGIFY(DYNAMORIO_VAR_HOME_ID)
 #define DYNAMORIO_VAR_LOGDIR     STRINGIFY(DYNAMORIO_VAR_LOGDIR_ID)
 #define DYNAMORIO_VAR_OPTIONS    STRINGIFY(DYNAMORIO_VAR_OPTIONS_ID)
@@ -1160,6 +1163,7 @@ typedef char liststring_t[MAX_LIST_OPTION_LENGTH];
 
 /* unicode versions of shared names*/
 #  define L_DYNAMORIO_VAR_CONFIGDIR   L_EXPAND_LEVEL(DYNAMORIO_VAR_CONFIGDIR)
+#  define L_DYNAMORIO_VAR_CONFIG_ENV_ONLY L_EXPAND_LEVEL(DYNAMORIO_VAR_CONFIG_ENV_ONLY)
 #  define L_DYNAMORIO_VAR_HOME        L_EXPAND_LEVEL(DYNAMORIO_VAR_HOME)
 #  define L_DYNAMORIO_VAR_LOGDIR      L_EXPAND_LEVEL(DYNAMORIO_VAR_LOGDIR)
 #  define L_DYNAMORIO_VAR_OPTIONS     L_EXPAND_LEVEL(DYNAMORIO_VAR_OPTIONS)
@@ -1494,6 +1498,10 @@ typedef struct {
  * looking at the interrupted pc.
  */
 # define NUDGESIG_SIGNUM         SIGILL
+/* The name of the dedicated -nudge_thread, which external nudgers look for in
+ * order to send nudges to it rather than to the app's thread group.
+ */
+# define NUDGE_THREAD_NAME       "dr-nudge"
 #endif
 
 /* Define AVOID_API_EXPORT here rather than in configure.h.
@@ -61,6 +61,7 @@
 #include "../synch.h"
 #include "../annotations.h"
 #include "../translate.h"
+#include "../native_exec.h"
 #ifdef UNIX
 # include <sys/time.h> /* ITIMER_* */
 # include "../unix/module.h" /* redirect_* functions */
@@ -3759,6 +3760,13 @@ dr_atomic_add32_return_sum(volatile int *x, int val)
     return atomic_add_exchange_int(x, val);
 }
 
+DR_API
+bool
+dr_atomic_compare_exchange_ptr(void * volatile *x, void *expected, void *desired)
+{
+    return atomic_compare_exchange_ptr(x, expected, desired);
+}
+
 /***************************************************************************
  * MODULES
  */
@@ -3959,6 +3967,8 @@ dr_module_set_should_instrument(module_handle_t handle, bool should_instrument)
     }
     os_get_module_info_write_unlock();
     IF_DEBUG(executable_areas_unlock());
+    if (ma != NULL)
+        native_exec_module_instrument_changed((app_pc)handle);
     return (ma != NULL);
 }
 
@@ -5353,6 +5363,8 @@ dr_insert_clean_call_ex_varg(void *drcontext, instrlist_t *ilist, instr_t *where
         ASSERT_NOT_REACHED();
 #endif /* CLIENT_INTERFACE */
     }
+    /* the analysis drops the fpstate save if the callee never touches it */
+    save_fpstate = cci.save_fpstate;
     /* honor requests from caller */
     if (TEST(DR_CLEANCALL_NOSAVE_FLAGS, save_flags)) {
         /* even if we remove flag saves we want to keep mcontext shape */
@@ -6561,6 +6573,54 @@ dr_get_mcontext(void *drcontext, dr_mcontext_t *dmc)
 }
 
 #ifdef CLIENT_INTERFACE
+DR_API bool
+dr_get_mcontext_reg(void *drcontext, reg_id_t reg, OUT reg_t *value)
+{
+    dcontext_t *dcontext = (dcontext_t *)drcontext;
+    priv_mcontext_t *state = NULL;
+    priv_mcontext_t tmp;
+    CLIENT_ASSERT(drcontext != NULL, "dr_get_mcontext_reg: drcontext cannot be NULL");
+    CLIENT_ASSERT(value != NULL, "dr_get_mcontext_reg: value cannot be NULL");
+    if (!reg_is_gpr(reg))
+        return false;
+    if (!dynamo_initialized)
+        return false;
+    /* We mirror the sources consulted by dr_get_mcontext_priv() but read the
+     * single slot in place rather than copying the whole context.
+     */
+    if (dcontext->client_data->cur_mc != NULL)
+        state = dcontext->client_data->cur_mc;
+    else if (dcontext->client_data->mcontext_in_dcontext ||
+             dcontext->client_data->in_pre_syscall ||
+             dcontext->client_data->in_post_syscall)
+        state = get_mcontext(dcontext);
+    else if (!is_os_cxt_ptr_null(dcontext->client_data->os_cxt) ||
+             dcontext->client_data->suspended) {
+        /* These need a conversion or translation anyway. */
+        if (!dr_get_mcontext_priv(dcontext, NULL, &tmp))
+            return false;
+        state = &tmp;
+    }
+    if (state == NULL) {
+        /* A clean call context: the dstack copy has a dstack xsp and, on ARM,
+         * a stale stolen register, so we take those from where
+         * dr_get_mcontext_priv() does.
+         */
+        if (reg_to_pointer_sized(reg) == DR_REG_XSP)
+            state = get_mcontext(dcontext);
+#ifdef AARCHXX
+        else if (reg_to_pointer_sized(reg) == dr_reg_stolen) {
+            set_stolen_reg_val(&tmp, (reg_t) get_tls(os_tls_offset(TLS_REG_STOLEN_SLOT)));
+            state = &tmp;
+        }
+#endif
+        else
+            state = get_priv_mcontext_from_dstack(dcontext);
+    }
+    *value = reg_get_value_priv(reg, state);
+    return true;
+}
+
 DR_API bool
 dr_set_mcontext(void *drcontext, dr_mcontext_t *context)
 {
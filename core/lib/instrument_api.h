@@ -2897,6 +2897,14 @@ DR_API
 int
 dr_atomic_add32_return_sum(volatile int *x, int val);
 
+DR_API
+/**
+ * Atomically compares \p *x with \p expected and, if they are equal, replaces
+ * \p *x with \p desired.  Returns whether the replacement took place.
+ */
+bool
+dr_atomic_compare_exchange_ptr(void * volatile *x, void *expected, void *desired);
+
 /* DR_API EXPORT BEGIN */
 /**************************************************
  * MODULE INFORMATION ROUTINES
@@ -3342,6 +3350,12 @@ DR_API
  * event for the module referred to by \p handle.
  * \return whether successful.
  *
+ * With the runtime option -native_exec_uninstrumented, a module that is
+ * not to be instrumented is executed natively instead, which removes DR's
+ * overhead inside it entirely.  Control returns to the code cache when the
+ * module returns, and when it calls out to other modules if
+ * -native_exec_retakeover is also set.
+ *
  * \warning Turning off instrumentation for modules breaks clients and
  * extensions, such as drwrap, that expect to see every instruction.
  */
@@ -5598,6 +5612,22 @@ bool
 dr_get_mcontext(void *drcontext, dr_mcontext_t *context);
 
 #ifdef CLIENT_INTERFACE
+DR_API
+/**
+ * Reads the value of the single general-purpose register \p reg (which may be a
+ * sub-register) from the application machine context and stores it in \p value.
+ * This may be called from the same points as dr_get_mcontext() and returns the
+ * same value that dr_get_mcontext() would with #DR_MC_INTEGER and #DR_MC_CONTROL
+ * set, but it reads the register straight from where DR saved it rather than
+ * copying out the whole context.  It is meant for callbacks such as clean calls
+ * that only need one or two registers.
+ *
+ * \return false if \p reg is not a general-purpose register or if called from
+ * the init event or the initial thread's init event; true otherwise.
+ */
+bool
+dr_get_mcontext_reg(void *drcontext, reg_id_t reg, OUT reg_t *value);
+
 DR_API
 /**
  * Sets the fields of the application machine context selected by the
@@ -68,6 +68,7 @@ KSTAT_DEF("in trace monitor, thci ", monitor_enter_thci)
 KSTAT_DEF("cache flush unit walk ", cache_flush_unit_walk)
 KSTAT_DEF("flush_region", flush_region)
 KSTAT_DEF("synchall flush ", synchall_flush)
+KSTAT_DEF("IBL table resize", ibl_table_resize)
 KSTAT_DEF("coarse pclookup", coarse_pclookup)
 KSTAT_DEF("coarse freeze all", coarse_freeze_all)
 KSTAT_DEF("persisted cache generation", persisted_generation)
@@ -116,6 +117,7 @@ KSTAT_DEF("pre-syscall ProtectVM handling", pre_syscall_protect)
 KSTAT_DEF("pre-syscall Unmap handling", pre_syscall_unmap)
 KSTAT_DEF("post-syscall AllocVM handling", post_syscall_alloc)
 KSTAT_DEF("post-syscall Map handling", post_syscall_map)
+KSTAT_DEF("synchronous signal delivery from cache", synch_signal_from_cache)
 
 KSTAT_DEF("native_exec [not propagated]", native_exec_fcache)
 
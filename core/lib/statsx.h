@@ -78,6 +78,10 @@ under -rstats_to_stderr.
     RSTATS_DEF("Current threads under DynamoRIO control", num_threads)
     RSTATS_DEF("Peak threads under DynamoRIO control", peak_num_threads)
     RSTATS_DEF("Threads ever created", num_threads_created)
+    RSTATS_DEF("Threads taken over at attach", attach_threads_taken_over)
+    RSTATS_DEF("Attach takeover rounds", attach_takeover_rounds)
+    RSTATS_DEF("Attach takeover time (ms)", attach_takeover_ms)
+    RSTATS_DEF("Peak attach takeover time (ms)", max_attach_takeover_ms)
     STATS_DEF("Threads killed", num_threads_killed)
     STATS_DEF("Threads killed cleanly", num_threads_killed_cleanly)
 #ifdef WINDOWS
@@ -99,6 +103,7 @@ under -rstats_to_stderr.
 #else
     RSTATS_DEF("Total signals delivered", num_signals)
     RSTATS_DEF("Signals dropped", num_signals_dropped)
+    RSTATS_DEF("Synchronous signals delivered from cache", num_signals_synch_from_cache)
     RSTATS_DEF("Signals in coarse units delayed", num_signals_coarse_delayed)
 #endif
     STATS_DEF("Exceptions in decoding app memory", num_exceptions_decode)
@@ -135,6 +140,9 @@ under -rstats_to_stderr.
     STATS_DEF("Native module entrance blocks, ret", num_native_module_entrances_ret)
     STATS_DEF("Native module execution entrances", num_native_module_enter)
     STATS_DEF("Native module execution exits", num_native_module_exit)
+    STATS_DEF("Native module execution exits, returns", num_native_module_exit_ret)
+    STATS_DEF("Native module execution exits, callouts", num_native_module_exit_callout)
+    RSTATS_DEF("Native modules present, uninstrumented", num_native_module_uninstrumented)
     STATS_DEF("Native our-fault write faults", num_native_cachecons_faults)
     STATS_DEF("System call trampolines, total", num_syscall_trampolines)
     STATS_DEF("System call trampolines, native", num_syscall_trampolines_native)
@@ -144,6 +152,10 @@ under -rstats_to_stderr.
     RSTATS_DEF("Application mmaps", num_app_mmaps)
     RSTATS_DEF("Application munmaps", num_app_munmaps)
     STATS_DEF("Module rebindings", num_app_rebinds)
+#ifdef UNIX
+    STATS_DEF("Memory cache hole queries checked with the OS", memcache_verified_hole_misses)
+    STATS_DEF("Memory cache hole queries already verified", memcache_verified_hole_hits)
+#endif
 #ifdef WINDOWS
     STATS_DEF("Application map mismatches with sections", map_section_mismatch)
     STATS_DEF("Application map file unknown Dos name", map_unknown_Dos_name)
@@ -216,6 +228,8 @@ under -rstats_to_stderr.
 
     STATS_DEF("Code origin addresses checked", checked_addresses)
     STATS_DEF("Code origin addresses in last area", looked_up_in_last_area)
+    STATS_DEF("Code origin addresses in thread's shared area cache",
+              looked_up_in_shared_area_cache)
 
     STATS_DEF("Writable code regions", num_writable_code_regions)
     STATS_DEF("Writable code regions we made read-only", num_rw2r_code_regions)
@@ -237,9 +251,10 @@ under -rstats_to_stderr.
     STATS_DEF("Write fault races", num_write_fault_races)
     STATS_DEF("Write fault races, one selfmod", num_write_fault_races_selfmod)
     STATS_DEF("Flushes racy, no exec removal since selfmod", flush_selfmod_race_no_remove)
-    STATS_DEF("Cache consistency flushes", num_flushes)
+    RSTATS_DEF("Cache consistency flushes", num_flushes)
     STATS_DEF("Cache consistency flushes that flushed nothing", num_empty_flushes)
-    STATS_DEF("Cache consistency flushes via synchall", flush_synchall)
+    RSTATS_DEF("Cache consistency flushes via synchall", flush_synchall)
+    STATS_DEF("Client flush requests coalesced", num_client_flushes_coalesced)
     STATS_DEF("Thread not translated in synchall flush (race)", flush_synchall_races)
     STATS_DEF("Thread not synched with in synchall flush", flush_synchall_fail)
     STATS_DEF("Cache consistency coarse units flushed", flush_coarse_units)
@@ -338,6 +353,9 @@ under -rstats_to_stderr.
     STATS_DEF("RCT live tables created", rct_live_tables)
     STATS_DEF("RCT live table entries", rct_live_entries)
     STATS_DEF("RCT indirect branch targets, total", rct_ind_branch_valid_targets)
+#ifdef UNIX
+    STATS_DEF("RCT analysis code rescans skipped", rct_ind_branch_code_rescan_skipped)
+#endif
     STATS_DEF("RCT indirect branch target entries, current", rct_ind_branch_entries)
     STATS_DEF("RCT indirect branch target entries, removed", rct_ind_branch_entries_removed)
     STATS_DEF("RCT indirect branch targets existing", rct_ind_branch_existing_targets)
@@ -389,12 +407,29 @@ under -rstats_to_stderr.
 
     STATS_DEF("Fragments generated, bb and trace", num_fragments)
     RSTATS_DEF("Basic block fragments generated", num_bbs)
+    STATS_DEF("Basic blocks made private due to bb lock contention",
+              num_bbs_private_on_contention)
     RSTATS_DEF("Trace fragments generated", num_traces)
 #ifdef X64
     STATS_DEF("32-bit basic block fragments generated", num_32bit_bbs)
     STATS_DEF("32-bit trace fragments generated", num_32bit_traces)
     STATS_DEF("32-bit instructions translated to 64-bit", num_32bit_instrs_translated)
 #endif
+    /* -cache_size_breakdown */
+    RSTATS_DEF("Emitted bb bytes: app instrs", cache_bb_app_bytes)
+    RSTATS_DEF("Emitted bb bytes: meta instrs", cache_bb_meta_bytes)
+    RSTATS_DEF("Emitted bb bytes: client meta instrs", cache_bb_client_bytes)
+    RSTATS_DEF("Emitted bb bytes: exit ctis", cache_bb_exit_cti_bytes)
+    RSTATS_DEF("Emitted bb bytes: inline exit stubs", cache_bb_stub_bytes)
+    RSTATS_DEF("Emitted bb bytes: separate exit stubs", cache_bb_separate_stub_bytes)
+    RSTATS_DEF("Emitted bb bytes: prefixes", cache_bb_prefix_bytes)
+    RSTATS_DEF("Emitted trace bytes: app instrs", cache_trace_app_bytes)
+    RSTATS_DEF("Emitted trace bytes: meta instrs", cache_trace_meta_bytes)
+    RSTATS_DEF("Emitted trace bytes: exit ctis", cache_trace_exit_cti_bytes)
+    RSTATS_DEF("Emitted trace bytes: inline exit stubs", cache_trace_stub_bytes)
+    RSTATS_DEF("Emitted trace bytes: separate exit stubs",
+               cache_trace_separate_stub_bytes)
+    RSTATS_DEF("Emitted trace bytes: prefixes", cache_trace_prefix_bytes)
     STATS_DEF("Trace fragments aborted for any reason", num_aborted_traces)
     STATS_DEF("Trace fragments aborted: shared race", num_aborted_traces_race)
     STATS_DEF("Trace fragments aborted: client bad mod", num_aborted_traces_client)
@@ -414,6 +449,7 @@ under -rstats_to_stderr.
     STATS_DEF("Shared trace links shifted back to trace head", links_shared_trace_to_head)
     STATS_DEF("Shadowed trace head deleted", shadowed_trace_head_deleted)
     STATS_DEF("Trace head counters reset on trace deletion", th_counter_reset)
+    STATS_DEF("Trace head counters started for persisted units", th_counter_persisted)
     STATS_DEF("Trace heads re-marked", trace_head_remark)
     STATS_DEF("Future fragments generated", num_future_fragments)
     STATS_DEF("Shared fragments generated", num_shared_fragments)
@@ -443,6 +479,7 @@ under -rstats_to_stderr.
 #ifdef X64
     STATS_DEF("Rip-relative instrs mangled", rip_rel_instrs)
     STATS_DEF("Rip-relative leas mangled", rip_rel_lea)
+    STATS_DEF("Rip-relative leas left rip-relative", rip_rel_lea_reachable)
     STATS_DEF("Rip-relative instrs w/ un-reachable targets", rip_rel_unreachable)
     STATS_DEF("Rip-relative unreachable spill avoided", rip_rel_unreachable_nospill)
 #endif
@@ -471,12 +508,21 @@ under -rstats_to_stderr.
     STATS_DEF("Fragments final size < minimum fcache slot size", num_final_fragment_too_small)
     STATS_DEF("Fragments unlinked for flushing", num_flushed_fragments)
     STATS_DEF("Fragments deleted for any reason", num_fragments_deleted)
+    STATS_DEF("Fragment metadata bytes, bbs", fragment_metadata_bb)
+    STATS_DEF("Peak fragment metadata bytes, bbs", peak_fragment_metadata_bb)
+    STATS_DEF("Fragment metadata bytes, traces", fragment_metadata_trace)
+    STATS_DEF("Peak fragment metadata bytes, traces", peak_fragment_metadata_trace)
+    STATS_DEF("Fragment metadata bytes, linkstubs", fragment_metadata_linkstubs)
+    STATS_DEF("Peak fragment metadata bytes, linkstubs",
+              peak_fragment_metadata_linkstubs)
     STATS_DEF("Fragments unlinked for deletion", fragments_unlinked_for_deletion)
     STATS_DEF("Fragments unlinked for deletion from list",
               list_entries_unlinked_for_deletion)
     STATS_DEF("Shared fragments deleted no-flush, race", shared_delete_noflush_race)
     STATS_DEF("Trace component fragments deleted", trace_components_deleted)
     STATS_DEF("Fragments deleted due to capacity conflicts", num_fragments_replaced)
+    STATS_DEF("Fragments spared from replacement as recently entered",
+              num_fragments_clock_spared)
     STATS_DEF("Fragments deleted on thread/process death", num_fragments_deleted_exit)
     STATS_DEF("Fragments deleted on thread/process reset", num_fragments_deleted_reset)
     STATS_DEF("Trace heads marked", num_trace_heads_marked)
@@ -500,6 +546,14 @@ under -rstats_to_stderr.
     STATS_DEF("IBT linked/unlinked table rehashes", num_ibt_table_rehashes)
     STATS_DEF("IBT resizes", num_ibt_table_resizes)
     STATS_DEF("Same-size IBT table resizes", num_same_size_ibt_table_resizes)
+    STATS_DEF("IBT table resizes migrating incrementally", num_ibt_incremental_resizes)
+    STATS_DEF("IBT entries migrated after a resize", num_ibt_entries_migrated)
+    STATS_DEF("IBT entries re-added before migration",
+              num_ibt_entries_readded_before_migration)
+    STATS_DEF("IBT entries migrated early for removal",
+              num_ibt_entries_migrated_for_removal)
+    STATS_DEF("IBT migrations completed by a further resize",
+              num_ibt_migrations_completed_by_resize)
     STATS_DEF("Shared IBT table flushes", num_shared_ibt_table_flushes)
     STATS_DEF("Shared IBT table ptr resets", num_shared_ibt_table_ptr_resets)
     STATS_DEF("IBT adds disallowed shared table, private frag",
@@ -520,7 +574,18 @@ under -rstats_to_stderr.
     STATS_DEF("BB fragments in 2 IBL tables", num_bbs_in_2_ibl_tables)
     STATS_DEF("BB fragments in 1 IBL tables", num_bbs_in_1_ibl_tables)
     STATS_DEF("BB fragments targeted by IBL", num_bbs_ibl_targets)
-    STATS_DEF("Exits due to IBL cold misses", num_ibt_cold_misses)
+    RSTATS_DEF("Exits due to IBL cold misses", num_ibt_cold_misses)
+    RSTATS_DEF("IBL inserts probing past home slot, ret",
+               num_ibt_collisions_ret)
+    RSTATS_DEF("IBL inserts probing past home slot, ind call",
+               num_ibt_collisions_indcall)
+    RSTATS_DEF("IBL inserts probing past home slot, ind jmp",
+               num_ibt_collisions_indjmp)
+    RSTATS_DEF("Peak IBL table insertion probe length, ret", max_ibt_cluster_ret)
+    RSTATS_DEF("Peak IBL table insertion probe length, ind call",
+               max_ibt_cluster_indcall)
+    RSTATS_DEF("Peak IBL table insertion probe length, ind jmp",
+               max_ibt_cluster_indjmp)
     STATS_DEF("Exits due to IB targeting TH", num_ib_th_target)
     STATS_DEF("Exits preventable if IB targeted bbs", num_ibt_bb_preventable)
     STATS_DEF("Extra exits due to trace building", num_ibt_exit_trace_building)
@@ -550,6 +615,7 @@ under -rstats_to_stderr.
     STATS_DEF("Trace inline-ib comparisons", trace_ib_cmp)
 #ifdef X64
     STATS_DEF("Trace inline-ib no eflag restore needed", trace_ib_no_flag_restore)
+    STATS_DEF("Trace inline-ib comparisons against an immediate", trace_ib_cmp_immed)
 #endif
     STATS_DEF("Trace fragments extended, ibl exits updated", num_traces_ibl_extended)
 #ifdef WINDOWS
@@ -565,6 +631,11 @@ under -rstats_to_stderr.
     STATS_DEF("Recreated fragments, traces", num_recreated_traces)
     STATS_DEF("Recreations via app re-decode", recreate_via_app_ilist)
     STATS_DEF("Recreations via stored info", recreate_via_stored_info)
+    STATS_DEF("Recreations via translation cache", translation_cache_hits)
+    STATS_DEF("Translation cache entries added", translation_cache_adds)
+    STATS_DEF("Translation cache adds skipped", translation_cache_skipped)
+    STATS_DEF("Translation cache bytes", translation_cache_bytes)
+    STATS_DEF("Peak translation cache bytes", peak_translation_cache_bytes)
     STATS_DEF("Recreation spill value restores", recreate_spill_restores)
     STATS_DEF("IBL stubs updated on table resize", num_ibl_stub_resize_updates)
 
@@ -598,6 +669,7 @@ under -rstats_to_stderr.
     STATS_DEF("Lazy links from persisted units", lazy_links_from_persisted)
     STATS_DEF("Lazy links from fine-grain", lazy_links_from_fine)
     STATS_DEF("Lazy links that failed to link", lazy_links_failed)
+    STATS_DEF("Lazy links found linked without the link lock", lazy_links_unlocked_skips)
     STATS_DEF("Coarse-grain direct re-links", coarse_relinks)
     STATS_DEF("Coarse-grain trace head path-dependent", coarse_th_path_dependent)
     STATS_DEF("Coarse-grain trace heads from fine", coarse_th_from_fine)
@@ -897,6 +969,7 @@ under -rstats_to_stderr.
     RSTATS_DEF("Peak heap units on live list", peak_heap_num_live)
     RSTATS_DEF("Current heap units on free list", heap_num_free)
     RSTATS_DEF("Peak heap units on free list", peak_heap_num_free)
+    RSTATS_DEF("Freed heap unit bytes decommitted", heap_dead_decommit)
     STATS_DEF("Heap headers (bytes)", heap_headers)
     STATS_DEF("Heap align space (bytes)", heap_align)
     STATS_DEF("Peak heap align space (bytes)", peak_heap_align)
@@ -995,6 +1068,8 @@ under -rstats_to_stderr.
     STATS_DEF("Blocks used for multi-block allocs", vmm_multi_blocks)
     RSTATS_DEF("Current vmm virtual memory in use (bytes)", vmm_vsize_used)
     RSTATS_DEF("Peak vmm virtual memory in use (bytes)", peak_vmm_vsize_used)
+    RSTATS_DEF("Vmm virtual memory advised for huge pages (bytes)",
+               vmm_vsize_huge_pages)
     STATS_DEF("Number of landing pad areas allocated", num_landing_pad_areas)
     STATS_DEF("Total times mutexes acquired", total_acquired)
     STATS_DEF("Total times mutexes contended", total_contended)
@@ -1112,8 +1187,12 @@ under -rstats_to_stderr.
     STATS_DEF("Num unsafe hot patches", unaligned_patches)
     STATS_DEF("Num nops removed for tracing", num_nops_removed)
     STATS_DEF("Num bytes nops removed for tracing", num_nop_bytes_removed)
+    RSTATS_DEF("Synch-all operations", num_synch_all)
     STATS_DEF("Num synch yields for exiting threads", synch_yields_for_exiting_thread)
     STATS_DEF("Num synch yields for uninit threads", synch_yields_for_uninit_thread)
+#ifdef UNIX
+    STATS_DEF("Threads suspended ahead in synch-all", synch_threads_suspended_ahead)
+#endif
     STATS_DEF("Num synch yields", synch_yields)
     STATS_DEF("Num synch loops in wait_at_safe_spot", synch_loops_wait_safe)
     STATS_DEF("Multiple setcontexts while in wait_at_safe_spot", wait_multiple_setcxt)
@@ -1209,11 +1288,24 @@ under -rstats_to_stderr.
     STATS_DEF("GBOP violations, BAD", gbop_violations)
     STATS_DEF("Nudges", num_nudges)
     STATS_DEF("Doubled-up nudges", num_pending_nudges)
+#ifdef LINUX
+    STATS_DEF("Nudges handled on the nudge thread", num_nudges_on_nudge_thread)
+#endif
     /*  Clean Calls */
     STATS_DEF("Clean Call analyzed", cleancall_analyzed)
     STATS_DEF("Clean Call inserted", cleancall_inserted)
     STATS_DEF("Clean Call inlined", cleancall_inlined)
+    STATS_DEF("Clean Call callee not inlined: too long", cleancall_noinline_size)
+    STATS_DEF("Clean Call callee not inlined: control flow", cleancall_noinline_cti)
+    STATS_DEF("Clean Call callee not inlined: uses SIMD", cleancall_noinline_simd)
+    STATS_DEF("Clean Call callee not inlined: uses TLS", cleancall_noinline_tls)
+    STATS_DEF("Clean Call callee not inlined: out of slots",
+              cleancall_noinline_slots)
+    STATS_DEF("Clean Call callee not inlined: stack usage", cleancall_noinline_stack)
+    STATS_DEF("Clean Call not inlined: args", cleancall_noinline_args)
+    STATS_DEF("Clean Call not inlined: fpstate", cleancall_noinline_fpstate)
     STATS_DEF("Clean Call xmm skipped", cleancall_simd_skipped)
+    STATS_DEF("Clean Call fpstate skipped", cleancall_fpstate_skipped)
     STATS_DEF("Clean Call aflags save skipped", cleancall_aflags_save_skipped)
     STATS_DEF("Clean Call aflags clear skipped", cleancall_aflags_clear_skipped)
     /* i#107 handle application using same segment register */
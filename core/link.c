@@ -3423,8 +3423,19 @@ coarse_lazy_link(dcontext_t *dcontext, fragment_t *targetf)
             }
             /* May already be linked (we may have just built its target)
              * Case 8825: we must hold the change_linking_lock when we check.
-             * Cheaper to just grab lock than to test first, unless high contention.
+             * With many threads running the same code the stub is usually
+             * linked by the time we get here, and the global lock is heavily
+             * contended, so we first test without it.  The stub's jmp target
+             * is patched atomically, and not linking is always safe as we'll
+             * just come back here, so only a negative result needs to be
+             * re-verified with the lock held.
              */
+            if (entrance_stub_linked(stub, info) ||
+                (coarse_is_trace_head(stub) && !DYNAMO_OPTION(disable_traces))) {
+                STATS_INC(lazy_links_unlocked_skips);
+                DODEBUG({ already_linked = true; });
+                goto lazy_link_done;
+            }
             acquire_recursive_lock(&change_linking_lock);
             if (!entrance_stub_linked(stub, info) &&
                 (!coarse_is_trace_head(stub) || DYNAMO_OPTION(disable_traces))) {
@@ -1530,6 +1530,7 @@ end_and_emit_trace(dcontext_t *dcontext, fragment_t *cur_f)
                                  HEAPACCT(ACCT_TRACE));
     for (i = 0; i < md->num_blks; i++)
         trace_tr->bbs[i] = md->blk_info[i].info;
+    STATS_ADD_PEAK(fragment_metadata_trace, md->num_blks*sizeof(trace_bb_info_t));
 
     if (TEST(FRAG_SHARED, md->trace_flags))
         mutex_unlock(&trace_building_lock);
@@ -2185,8 +2186,21 @@ monitor_cache_enter(dcontext_t *dcontext, fragment_t *f)
     /* Found a trace head, increment its counter */
     ctr = thcounter_lookup(dcontext, f->tag);
     /* May not have been added for this thread yet */
-    if (ctr == NULL)
+    if (ctr == NULL) {
         ctr = thcounter_add(dcontext, f->tag);
+        /* A trace head in a persisted unit starts out closer to the threshold, as
+         * the code was run in a prior execution.
+         */
+        if (DYNAMO_OPTION(trace_threshold_persisted) > 0 &&
+            TEST(FRAG_COARSE_GRAIN, f->flags)) {
+            coarse_info_t *info = get_fragment_coarse_info(f);
+            if (info != NULL && info->persisted) {
+                ctr->counter = INTERNAL_OPTION(trace_threshold) -
+                    DYNAMO_OPTION(trace_threshold_persisted);
+                STATS_INC(th_counter_persisted);
+            }
+        }
+    }
     ASSERT(ctr != NULL);
 
     if (ctr->counter == TH_COUNTER_CREATED_TRACE_VALUE()) {
@@ -143,17 +143,35 @@ on_native_exec_list(const char *modname)
 }
 
 static bool
-check_and_mark_native_exec(module_area_t *ma, bool add)
+module_should_run_native(module_area_t *ma)
 {
-    bool is_native = false;
     const char *name = GET_MODULE_NAME(&ma->names);
     ASSERT(os_get_module_info_locked());
     if (DYNAMO_OPTION(native_exec) && name != NULL &&
         on_native_exec_list(name)) {
         LOG(GLOBAL, LOG_INTERP|LOG_VMAREAS, 1,
             "module %s is on native_exec list\n", name);
-        is_native = true;
+        return true;
+    }
+#ifdef CLIENT_INTERFACE
+    /* The client's module load event is its interest filter: a module it has
+     * asked us not to instrument has nothing to gain from the code cache.
+     */
+    if (DYNAMO_OPTION(native_exec_uninstrumented) &&
+        TEST(MODULE_NULL_INSTRUMENT, ma->flags)) {
+        LOG(GLOBAL, LOG_INTERP|LOG_VMAREAS, 1,
+            "module %s is not instrumented: running it natively\n",
+            name == NULL ? "<no name>" : name);
+        return true;
     }
+#endif
+    return false;
+}
+
+static bool
+check_and_mark_native_exec(module_area_t *ma, bool add)
+{
+    bool is_native = module_should_run_native(ma);
 
     if (add && is_native) {
         RSTATS_INC(num_native_module_loads);
@@ -198,6 +216,44 @@ native_exec_module_unload(module_area_t *ma)
     }
 }
 
+#ifdef CLIENT_INTERFACE
+/* Called when the client changes whether the module at modbase should be
+ * instrumented, which it may only do from the module's own load event, before
+ * any code from the module has been executed.  For -native_exec_uninstrumented
+ * we move the module into or out of native_exec_areas.
+ */
+void
+native_exec_module_instrument_changed(app_pc modbase)
+{
+    module_area_t *ma;
+    bool was_native, is_native;
+    if (!DYNAMO_OPTION(native_exec) || !DYNAMO_OPTION(native_exec_uninstrumented) ||
+        native_exec_areas == NULL)
+        return;
+    os_get_module_info_write_lock();
+    ma = module_pc_lookup(modbase);
+    if (ma != NULL) {
+        was_native = vmvector_overlap(native_exec_areas, ma->start, ma->end);
+        is_native = module_should_run_native(ma);
+        if (is_native && !was_native) {
+            RSTATS_INC(num_native_module_loads);
+            RSTATS_INC(num_native_module_uninstrumented);
+            vmvector_add(native_exec_areas, ma->start, ma->end, NULL);
+            /* The loader has relocated the module by the time the client sees it. */
+            if (DYNAMO_OPTION(native_exec_retakeover))
+                native_module_hook(ma, false/*!at_map*/);
+        } else if (!is_native && was_native) {
+            RSTATS_DEC(num_native_module_loads);
+            RSTATS_DEC(num_native_module_uninstrumented);
+            vmvector_remove(native_exec_areas, ma->start, ma->end);
+            if (DYNAMO_OPTION(native_exec_retakeover))
+                native_module_unhook(ma);
+        }
+    }
+    os_get_module_info_write_unlock();
+}
+#endif
+
 /* Clean call called on every fcache to native transition.  Turns on and off
  * asynch handling and updates some state.  Called from native bbs built by
  * build_native_exec_bb() in arch/interp.c.
@@ -351,6 +407,8 @@ back_from_native_common(dcontext_t *dcontext, priv_mcontext_t *mc, app_pc target
     /* XXX: setting same var that set_asynch_interception is! */
     dcontext->thread_record->under_dynamo_control = true;
 
+    STATS_INC(num_native_module_exit);
+
     *get_mcontext(dcontext) = *mc;
     /* clear pc */
     get_mcontext(dcontext)->pc = 0;
@@ -415,6 +473,7 @@ return_from_native(priv_mcontext_t *mc)
            "shouldn't return from native to native PC (i#1090?)");
     LOG(THREAD, LOG_ASYNCH, 1, "\n!!!! Returned from NATIVE module to "PFX"\n",
         target);
+    STATS_INC(num_native_module_exit_ret);
     back_from_native_common(dcontext, mc, target); /* noreturn */
     ASSERT_NOT_REACHED();
 }
@@ -434,8 +493,12 @@ native_module_callout(priv_mcontext_t *mc, app_pc target)
     }
     ASSERT(dcontext != NULL);
     ASSERT(DYNAMO_OPTION(native_exec_retakeover));
-    LOG(THREAD, LOG_ASYNCH, 4, "%s: cross-module call to %p\n",
+    /* A high count here relative to num_native_module_enter points at a hot
+     * callback from a native module: run with -loglevel 3 to find it.
+     */
+    LOG(THREAD, LOG_ASYNCH, 3, "%s: cross-module call to %p\n",
         __FUNCTION__, target);
+    STATS_INC(num_native_module_exit_callout);
     back_from_native_common(dcontext, mc, target);
     ASSERT_NOT_REACHED();
 }
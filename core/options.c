@@ -1234,6 +1234,11 @@ check_option_compatibility_helper(int recurse_count)
         SET_DEFAULT_VALUE(trace_counter_on_delete);
         changed_options = true;
     }
+    if (DYNAMO_OPTION(trace_threshold_persisted) > INTERNAL_OPTION(trace_threshold)) {
+        USAGE_ERROR("trace_threshold_persisted cannot be > trace_threshold");
+        SET_DEFAULT_VALUE(trace_threshold_persisted);
+        changed_options = true;
+    }
     if (INTERNAL_OPTION(alt_hash_func) >= HASH_FUNCTION_ENUM_MAX) {
         USAGE_ERROR("Invalid selection (%d) for shared cache hash func, must be < %d",
                     INTERNAL_OPTION(alt_hash_func),
@@ -240,6 +240,14 @@
     OPTION_DEFAULT(bool, global_rstats, true, "enable global release-build statistics")
     OPTION_DEFAULT_INTERNAL(bool, rstats_to_stderr, false,
                             "print the final global rstats to stderr")
+#ifdef UNIX
+    OPTION_DEFAULT(pathstring_t, rstats_shm_dir, EMPTY_STRING,
+        "publish the global rstats in a shared file in this directory (e.g., /dev/shm) "
+        "for external monitoring")
+#endif
+    OPTION_DEFAULT(bool, cache_size_breakdown, false,
+        "track how code cache bytes split into app code, instrumentation, "
+        "mangling, exit ctis, stubs, and prefixes, and print it to stderr at exit")
 
     /* this takes precedence over the DYNAMORIO_VAR_LOGDIR config var */
     OPTION_DEFAULT(pathstring_t, logdir, EMPTY_STRING,
@@ -775,6 +783,12 @@
      }, "enable trace creation", STATIC, OP_PCACHE_GLOBAL)
     OPTION_DEFAULT_INTERNAL(uint, trace_counter_on_delete, 0U,
         "trace head counter will be reset to this value upon trace deletion")
+    /* Code loaded from a persisted cache was executed in a prior run, so its trace
+     * heads are likely to become hot again: to reach trace-level performance sooner
+     * on a warm start we can build their traces after fewer executions.
+     */
+    OPTION_DEFAULT(uint, trace_threshold_persisted, 0U,
+        "hot threshold for trace heads in persisted units (0 = -trace_threshold)")
 
     OPTION_DEFAULT(uint, max_elide_jmp,  16,
         "maximum direct jumps to elide in a basic block")
@@ -792,6 +806,15 @@
      */
     OPTION_DEFAULT(uint, max_bb_instrs, IF_CLIENT_INTERFACE_ELSE(256, 1024),
         "maximum instrs per basic block")
+#if defined(ANNOTATIONS) && defined(LINUX)
+    /* The annotation macros in dr_annotations_asm.h emit an ELF note at each
+     * site, so with this option we skip looking for DR annotations while
+     * building blocks from modules without that note.  Valgrind client
+     * requests don't emit the note and are still looked for everywhere.
+     */
+    OPTION_DEFAULT(bool, annotations_from_notes, false,
+        "only look for DR annotations in modules containing an annotation note")
+#endif
     PC_OPTION_DEFAULT(bool, process_SEH_push,
         IF_RETURN_AFTER_CALL_ELSE(true, false),
         "break bb's at an SEH push so we can see the frame pushed on in "
@@ -803,6 +826,9 @@
     /* PR 361894: if no TLS available, we fall back to thread-private */
     PC_OPTION_DEFAULT(bool, shared_bbs, IF_HAVE_TLS_ELSE(true, false),
                       "use thread-shared basic blocks")
+    OPTION_DEFAULT(bool, private_bbs_on_contention, false,
+         "when another thread holds the shared bb building lock, build a "
+         "thread-private bb instead of waiting")
     /* Note that if we want traces off by default we would have to turn
      * off -shared_traces to avoid tripping over un-initialized ibl tables
      * PR 361894: if no TLS available, we fall back to thread-private
@@ -964,6 +990,14 @@
     OPTION_DEFAULT_INTERNAL(bool, rehash_unlinked_always, false,
         "always rehash a shared BB IBT table when # unlinked entries > 0")
 
+    /* A grown IBT table keeps its old entries aside and moves this many of them
+     * into the new table on each later insertion, rather than stalling to rehash
+     * them all at resize time.  Entries not yet moved miss in the new table and
+     * are re-added by the ensuing cache exit.
+     */
+    OPTION_DEFAULT(uint, ibl_table_migrate_step, 0,
+        "IBT table entries to migrate per insertion after a resize, 0 = all at once")
+
 #ifdef SHARING_STUDY
     OPTION_COMMAND_INTERNAL(bool, fragment_sharing_study, false,
         "fragment_sharing_study", {
@@ -1167,6 +1201,18 @@
     OPTION_DEFAULT_INTERNAL(uint_size, max_heap_unit_size, 256*1024, "maximum heap unit size")
     /* heap_commit_increment may be adjusted by adjust_defaults_for_page_size(). */
     OPTION_DEFAULT(uint_size, heap_commit_increment, 4*1024, "heap commit increment")
+    /* Freed heap units are kept on a dead list for reuse; beyond this many
+     * committed bytes across that list, each further unit is decommitted down
+     * to its initial commitment so its pages go back to the OS.
+     */
+    OPTION_DEFAULT(uint_size, heap_dead_commit_retain, 256*1024,
+                   "committed bytes retained across freed heap units")
+    /* Each thread caches up to this many freed global heap blocks per size
+     * bucket, refilling and releasing them in batches, so that threads do not
+     * serialize on the global heap lock.  0 disables the cache.
+     */
+    OPTION_DEFAULT(uint, global_heap_thread_cache, 32,
+                   "freed global heap blocks cached per thread and size bucket")
     /* cache_commit_increment may be adjusted by adjust_defaults_for_page_size(). */
     OPTION_DEFAULT(uint, cache_commit_increment, 4*1024, "cache commit increment")
 
@@ -1268,6 +1314,8 @@
         "adaptive working set shared trace cache management")
     OPTION_DEFAULT(bool, finite_coarse_bb_cache, false,
         "adaptive working set shared bb cache management")
+    OPTION_DEFAULT(bool, cache_replace_clock, false,
+        "when replacing in private caches, spare fragments entered since last considered")
     OPTION_DEFAULT(uint_size, cache_bb_unit_upgrade, (64*1024),
         "bb cache units are always upgraded to this size, in KB or MB")
         /* default size is in Kilobytes, Examples: 4, 4k, 4m, or 0 for unlimited */
@@ -1431,6 +1479,10 @@
     OPTION_DEFAULT(bool, vm_base_near_app, true,
                    "allocate vm region near the app if possible (if not, if "
                    "-vm_allow_not_at_base, will try elsewhere)")
+    /* Reduces iTLB and dTLB misses for large code caches and heaps. */
+    OPTION_DEFAULT(bool, vm_huge_pages, false,
+                   "align the vm region to huge page boundaries and ask the "
+                   "kernel to back it with transparent huge pages (Linux only)")
 #ifdef X64
     /* We prefer low addresses in general, and only need this option if it's
      * an absolute requirement (XXX i#829: it is required for mixed-mode).
@@ -1570,6 +1622,11 @@
     OPTION_DEFAULT(bool, ignore_syscalls, IF_WINDOWS_ELSE(false, true),
                    "ignore system calls that do not need to be intercepted")
     /* Whether we inline ignoreable syscalls inside of bbs (xref PR 307284) */
+    /* Logs, at thread exit, which syscall numbers reached DR most often, to find
+     * candidates for inlining (e.g., a client filter that can be relaxed).
+     */
+    OPTION_DEFAULT_INTERNAL(bool, profile_syscalls, false,
+        "profile per-thread counts of syscalls not executed inline")
     OPTION_DEFAULT(bool, inline_ignored_syscalls, true,
                    "inline ignored system calls in the middle of bbs")
 #ifdef LINUX
@@ -2029,6 +2086,9 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
         "store info at flush time for safe post-flush translation")
     PC_OPTION_INTERNAL(bool, store_translations,
         "store info at emit time for fragment translation")
+    /* 0 disables the cache */
+    OPTION_DEFAULT(uint_size, translation_cache_max, 0,
+        "max bytes of translation info lazily cached for shared fragments")
     /* i#698: our fpu state xl8 is a perf hit for some apps */
     PC_OPTION(bool, translate_fpu_pc,
         "translate the saved last floating-point pc when FPU state is saved")
@@ -2285,6 +2345,10 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
         "if module has .pexe section (proxy for strange int 3 behavior), execute it natively")
     OPTION_DEFAULT(bool, native_exec_retakeover, false,
         "attempt to re-takeover when a native module calls out to a non-native module")
+#ifdef CLIENT_INTERFACE
+    OPTION_DEFAULT(bool, native_exec_uninstrumented, false,
+        "execute natively modules the client asked not to instrument")
+#endif
     /* XXX i#1238-c#1: we do not support inline optimization in Windows. */
     OPTION_COMMAND(bool, native_exec_opt, false, "native_exec_opt", {
         if (options->native_exec_opt) {
@@ -2718,6 +2782,13 @@ IF_RCT_IND_BRANCH(options->rct_ind_jump = OPTION_DISABLED;)
     /* FIXME: temporary fix for case 9467 - option to disable if not needed */
     OPTION_DEFAULT(bool, mute_nudge, true, "mute nudges for thin_clients")
 #endif /* WINDOWS */
+#if defined(LINUX) && defined(CLIENT_SIDELINE)
+    /* Creates a thread named NUDGE_THREAD_NAME that external nudgers target
+     * directly, so that nudges do not interrupt app threads.
+     */
+    OPTION_DEFAULT(bool, nudge_thread, false,
+        "handle external nudges on a dedicated thread")
+#endif
 
     /* Pseudo Random Number Generator seed affects all random number users:
      * (currently vm_max_offset, aslr_dll_offset, aslr_dll_pad) */
@@ -133,6 +133,9 @@ void *os_heap_reserve_in_region(void *start, void *end, size_t size,
 bool os_heap_commit(void *p, size_t size, uint prot, heap_error_code_t *error_code);
 /* decommit previously committed page, so it is reserved for future reuse */
 void os_heap_decommit(void *p, size_t size, heap_error_code_t *error_code);
+/* asks that previously reserved pages be backed by huge pages where possible;
+ * returns whether the request was accepted */
+bool os_heap_request_huge_pages(void *p, size_t size);
 /* frees size bytes starting at address p (note - on windows the entire allocation
  * containing p is freed and size is ignored) */
 void os_heap_free(void *p, size_t size, heap_error_code_t *error_code);
@@ -156,6 +159,13 @@ void os_thread_sleep(uint64 milliseconds);
  * Windows); setting timeout to 0 results in blocking forever.
  */
 bool os_thread_suspend(thread_record_t *tr, int timeout_ms);
+#ifdef UNIX
+/* os_thread_suspend() split in two so that a caller can overlap the suspension
+ * of many threads: _start sends the request and _finish waits for it.
+ */
+bool os_thread_suspend_start(thread_record_t *tr);
+bool os_thread_suspend_finish(thread_record_t *tr, int timeout_ms);
+#endif
 bool os_thread_resume(thread_record_t *tr);
 bool os_thread_terminate(thread_record_t *tr);
 
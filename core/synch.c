@@ -1141,6 +1141,31 @@ synch_with_thread(thread_id_t id, bool block, bool hold_initexit_lock,
     return res;
 }
 
+#ifdef UNIX
+/* Drops the extra suspend references synch_with_all_threads() took with
+ * os_thread_suspend_start() on the threads in [start, num_threads).  A
+ * reference can only be released by a resume once the target has reached its
+ * suspend point, so we wait for that first, just as os_thread_suspend() would
+ * have.
+ */
+static void
+synch_drop_pre_suspended(thread_record_t **threads, bool *pre_suspended,
+                         int start, int num_threads)
+{
+    int i;
+    for (i = start; i < num_threads; i++) {
+        if (pre_suspended[i]) {
+            if (os_thread_suspend_finish(threads[i], SUSPEND_THREAD_TIMEOUT)) {
+                DEBUG_DECLARE(bool ok =)
+                    os_thread_resume(threads[i]);
+                ASSERT(ok);
+            }
+            pre_suspended[i] = false;
+        }
+    }
+}
+#endif
+
 /* desired_synch_state - a requested state define from above that describes
  *                        the synchronization required
  * threads, num_threads - must not be NULL, if !THREAD_SYNCH_IS_CLEANED(desired
@@ -1195,6 +1220,13 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
     thread_synch_result_t synch_res;
     const uint max_loops = TEST(THREAD_SYNCH_SMALL_LOOP_MAX, flags) ?
         (SYNCH_ALL_THREADS_MAXIMUM_LOOPS/10) : SYNCH_ALL_THREADS_MAXIMUM_LOOPS;
+#ifdef UNIX
+    /* Cleaning up a thread frees its record, which we need to drop our extra
+     * suspend reference, so we only suspend ahead when no thread is cleaned.
+     */
+    const bool suspend_ahead = !THREAD_SYNCH_IS_CLEANED(desired_synch_state);
+    bool *pre_suspended = NULL;
+#endif
 #ifdef CLIENT_INTERFACE
     /* We treat client-owned threads as native but they don't have a clean native state
      * for us to suspend them in (they are always in client or dr code).  We need to be
@@ -1252,6 +1284,7 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
         "synch with all threads my id = "SZFMT
         " Giving %d permission and seeking %d state\n",
         my_id, cur_state, desired_synch_state);
+    RSTATS_INC(num_synch_all);
 
     /* grab all_threads_synch_lock */
     /* since all_threads synch doesn't give any permissions this is necessary
@@ -1372,6 +1405,36 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
         num_threads_temp = num_threads;
         synch_array_temp = synch_array;
 
+#ifdef UNIX
+        /* Each block-free synch_with_thread() below sends one suspend signal
+         * and then waits for that thread to reach its handler, so the passes
+         * cost one signal round trip per thread in sequence.  We instead send
+         * all the signals first so the targets' deliveries overlap, holding
+         * an extra suspend reference on each one until synch_with_thread() is
+         * done with it.
+         */
+        if (suspend_ahead) {
+            pre_suspended = (bool *)
+                global_heap_alloc(num_threads * sizeof(bool) HEAPACCT(ACCT_THREAD_MGT));
+            for (i = 0; i < num_threads; i++) {
+                pre_suspended[i] = false;
+                if (synch_array[i] == SYNCH_WITH_ALL_SYNCHED ||
+                    threads[i]->id == my_id || threads[i]->execve)
+                    continue;
+# ifdef CLIENT_INTERFACE
+                /* Client threads are synched last and may be left unsuspended. */
+                if (IS_CLIENT_THREAD(threads[i]->dcontext))
+                    continue;
+# endif
+                pre_suspended[i] = os_thread_suspend_start(threads[i]);
+                DOSTATS({
+                    if (pre_suspended[i])
+                        STATS_INC(synch_threads_suspended_ahead);
+                });
+            }
+        }
+#endif
+
         for (i = 0; i < num_threads; i++) {
             /* do not de-ref threads[i] after synching if it was cleaned up! */
             if (synch_array[i] != SYNCH_WITH_ALL_SYNCHED && threads[i]->id != my_id) {
@@ -1414,6 +1477,13 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
                 synch_res = synch_with_thread(threads[i]->id, false, true,
                                               THREAD_SYNCH_NONE,
                                               desired_synch_state, flags_one);
+#ifdef UNIX
+                /* The thread stays suspended if synch_with_thread() holds its
+                 * own reference.
+                 */
+                if (pre_suspended != NULL)
+                    synch_drop_pre_suspended(threads, pre_suspended, i, i + 1);
+#endif
                 if (synch_res == THREAD_SYNCH_RESULT_SUCCESS) {
                     LOG(THREAD, LOG_SYNCH, 2, "Synch succeeded!\n");
                     /* successful synch */
@@ -1424,8 +1494,19 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
                     LOG(THREAD, LOG_SYNCH, 2, "Synch failed!\n");
                     all_synched = false;
                     if (synch_res == THREAD_SYNCH_RESULT_SUSPEND_FAILURE) {
-                        if (TEST(THREAD_SYNCH_SUSPEND_FAILURE_ABORT, flags))
+                        if (TEST(THREAD_SYNCH_SUSPEND_FAILURE_ABORT, flags)) {
+#ifdef UNIX
+                            if (pre_suspended != NULL) {
+                                synch_drop_pre_suspended(threads, pre_suspended,
+                                                         i + 1, num_threads);
+                                global_heap_free(pre_suspended,
+                                                 num_threads * sizeof(bool)
+                                                 HEAPACCT(ACCT_THREAD_MGT));
+                                pre_suspended = NULL;
+                            }
+#endif
                             goto synch_with_all_abort;
+                        }
                     } else
                         ASSERT(synch_res == THREAD_SYNCH_RESULT_NOT_SAFE);
                 }
@@ -1435,6 +1516,18 @@ synch_with_all_threads(thread_synch_state_t desired_synch_state,
             }
         }
 
+#ifdef UNIX
+        if (pre_suspended != NULL) {
+            /* Every thread we took a reference on was handed to
+             * synch_with_thread() above, so this should find nothing to drop.
+             */
+            synch_drop_pre_suspended(threads, pre_suspended, 0, num_threads);
+            global_heap_free(pre_suspended, num_threads * sizeof(bool)
+                             HEAPACCT(ACCT_THREAD_MGT));
+            pre_suspended = NULL;
+        }
+#endif
+
         if (loop_count++ >= max_loops)
             break;
         /* We test the exiting thread count to avoid races between exit
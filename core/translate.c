@@ -886,6 +886,160 @@ recreate_selfmod_ilist(dcontext_t *dcontext, fragment_t *f)
     return ilist;
 }
 
+/***************************************************************************
+ * TRANSLATION CACHE
+ *
+ * Fragments that do not store translation info are normally re-decoded from
+ * app memory (and re-instrumented) on every translation.  Apps that fault
+ * repeatedly in the same fragments pay that cost each time, so under
+ * -translation_cache_max we lazily record translation info on the first
+ * translation of a shared fragment and reuse it afterward.  Entries are keyed
+ * by fragment_t and are removed when the fragment is freed.
+ */
+
+static generic_table_t *translation_cache;
+static size_t translation_cache_size; /* bytes of cached info */
+DECLARE_CXTSWPROT_VAR(static mutex_t translation_cache_lock,
+                      INIT_LOCK_FREE(translation_cache_lock));
+#define INIT_HTABLE_SIZE_TRANSLATION_CACHE 8
+
+static inline uint
+translation_info_alloc_size(uint num_entries);
+
+static void
+translation_cache_free_payload(dcontext_t *dcontext, void *info)
+{
+    translation_info_free(GLOBAL_DCONTEXT, (translation_info_t *)info);
+}
+
+void
+translation_cache_init(void)
+{
+    if (DYNAMO_OPTION(translation_cache_max) == 0)
+        return;
+    translation_cache = generic_hash_create(GLOBAL_DCONTEXT,
+                                            INIT_HTABLE_SIZE_TRANSLATION_CACHE,
+                                            80 /* load factor: not perf-critical */,
+                                            HASHTABLE_SHARED | HASHTABLE_PERSISTENT,
+                                            translation_cache_free_payload
+                                            _IF_DEBUG("translation cache"));
+}
+
+void
+translation_cache_exit(void)
+{
+    if (translation_cache != NULL) {
+        generic_hash_destroy(GLOBAL_DCONTEXT, translation_cache);
+        translation_cache = NULL;
+        translation_cache_size = 0;
+    }
+    DELETE_LOCK(translation_cache_lock);
+}
+
+/* Called at reset, when all fragments are going away. */
+void
+translation_cache_reset(void)
+{
+    ptr_uint_t key;
+    int iter = 0;
+    if (translation_cache == NULL)
+        return;
+    mutex_lock(&translation_cache_lock);
+    do {
+        iter = generic_hash_iterate_next(GLOBAL_DCONTEXT, translation_cache, iter,
+                                         &key, NULL);
+        if (iter < 0)
+            break;
+        iter = generic_hash_iterate_remove(GLOBAL_DCONTEXT, translation_cache,
+                                           iter, key);
+    } while (true);
+    STATS_SUB(translation_cache_bytes, translation_cache_size);
+    translation_cache_size = 0;
+    mutex_unlock(&translation_cache_lock);
+}
+
+void
+translation_cache_remove(dcontext_t *dcontext, fragment_t *f)
+{
+    translation_info_t *info;
+    if (translation_cache == NULL || !TEST(FRAG_SHARED, f->flags))
+        return;
+    mutex_lock(&translation_cache_lock);
+    info = (translation_info_t *)
+        generic_hash_lookup(GLOBAL_DCONTEXT, translation_cache, (ptr_uint_t)f);
+    if (info != NULL) {
+        size_t size = translation_info_alloc_size(info->num_entries);
+        ASSERT(translation_cache_size >= size);
+        translation_cache_size -= size;
+        STATS_SUB(translation_cache_bytes, size);
+        generic_hash_remove(GLOBAL_DCONTEXT, translation_cache, (ptr_uint_t)f);
+    }
+    mutex_unlock(&translation_cache_lock);
+}
+
+/* Only fragments that are freed individually through fragment_free() and whose
+ * translation is computed from app memory are cached.
+ */
+static inline bool
+translation_cache_eligible(fragment_t *f)
+{
+    return (translation_cache != NULL &&
+            TEST(FRAG_SHARED, f->flags) &&
+            !TESTANY(FRAG_COARSE_GRAIN | FRAG_SELFMOD_SANDBOXED | FRAG_WAS_DELETED |
+                     FRAG_FAKE, f->flags));
+}
+
+/* A fragment cached before it was flushed keeps its entry: the cached info
+ * reflects the original app code, which re-decoding may no longer see.
+ */
+static const translation_info_t *
+translation_cache_lookup(dcontext_t *dcontext, fragment_t *f)
+{
+    translation_info_t *info;
+    if (translation_cache == NULL || !TEST(FRAG_SHARED, f->flags) ||
+        TESTANY(FRAG_COARSE_GRAIN | FRAG_SELFMOD_SANDBOXED, f->flags))
+        return NULL;
+    mutex_lock(&translation_cache_lock);
+    info = (translation_info_t *)
+        generic_hash_lookup(GLOBAL_DCONTEXT, translation_cache, (ptr_uint_t)f);
+    mutex_unlock(&translation_cache_lock);
+    if (info != NULL)
+        STATS_INC(translation_cache_hits);
+    return info;
+}
+
+/* Records translation info for f from the just-recreated ilist and caches it
+ * if it fits within -translation_cache_max.
+ */
+static void
+translation_cache_add(dcontext_t *dcontext, fragment_t *f, instrlist_t *ilist)
+{
+    translation_info_t *info;
+    size_t size;
+    bool added = false;
+    if (!translation_cache_eligible(f))
+        return;
+    /* Record outside of the lock: this allocates from global heap. */
+    info = record_translation_info(dcontext, f, ilist);
+    size = translation_info_alloc_size(info->num_entries);
+    mutex_lock(&translation_cache_lock);
+    if (translation_cache_size + size <= DYNAMO_OPTION(translation_cache_max) &&
+        /* another thread may have beaten us to it */
+        generic_hash_lookup(GLOBAL_DCONTEXT, translation_cache, (ptr_uint_t)f) == NULL) {
+        generic_hash_add(GLOBAL_DCONTEXT, translation_cache, (ptr_uint_t)f, info);
+        translation_cache_size += size;
+        added = true;
+    }
+    mutex_unlock(&translation_cache_lock);
+    if (added) {
+        STATS_INC(translation_cache_adds);
+        STATS_ADD_PEAK(translation_cache_bytes, size);
+    } else {
+        STATS_INC(translation_cache_skipped);
+        translation_info_free(dcontext, info);
+    }
+}
+
 /* The esp in mcontext must either be valid or NULL (if null will be unable to
  * recreate on XP and 03 at vsyscall_after_syscall and on sygate 2k at after syscall).
  * Returns true if successful.  Whether successful or not, attempts to modify
@@ -1031,6 +1185,7 @@ recreate_app_state_internal(dcontext_t *tdcontext, priv_mcontext_t *mcontext,
         linkstub_t *l;
         cache_pc cti_pc;
         instrlist_t *ilist = NULL;
+        const translation_info_t *info = NULL;
         fragment_t *f = owning_f;
         bool alloc = false, ok;
         dr_isa_mode_t old_mode;
@@ -1080,7 +1235,9 @@ recreate_app_state_internal(dcontext_t *tdcontext, priv_mcontext_t *mcontext,
         if (f == NULL) {
             ilist = recreate_fragment_ilist(tdcontext, mcontext->pc, &f, &alloc,
                                             true/*mangle*/ _IF_CLIENT(true/*client*/));
-        } else if (FRAGMENT_TRANSLATION_INFO(f) == NULL) {
+        } else if (FRAGMENT_TRANSLATION_INFO(f) != NULL) {
+            info = FRAGMENT_TRANSLATION_INFO(f);
+        } else if ((info = translation_cache_lookup(tdcontext, f)) == NULL) {
             if (TEST(FRAG_SELFMOD_SANDBOXED, f->flags)) {
                 ilist = recreate_selfmod_ilist(tdcontext, f);
             } else {
@@ -1093,9 +1250,11 @@ recreate_app_state_internal(dcontext_t *tdcontext, priv_mcontext_t *mcontext,
                 ASSERT(owning_f == NULL || f == owning_f ||
                        (TEST(FRAG_COARSE_GRAIN, owning_f->flags) && f == pre_f));
                 ASSERT(!new_alloc);
+                if (ilist != NULL && !alloc)
+                    translation_cache_add(tdcontext, f, ilist);
             }
         }
-        if (ilist == NULL && (f == NULL || FRAGMENT_TRANSLATION_INFO(f) == NULL)) {
+        if (ilist == NULL && info == NULL) {
             /* It is problematic if this routine fails.  Many places assume that
              * recreate_app_pc() will work.
              */
@@ -1159,10 +1318,11 @@ recreate_app_state_internal(dcontext_t *tdcontext, priv_mcontext_t *mcontext,
         client_info.raw_mcontext_valid = true;
 #endif
         if (ilist == NULL) {
-            ASSERT(f != NULL && FRAGMENT_TRANSLATION_INFO(f) != NULL);
+            ASSERT(f != NULL && info != NULL);
             ASSERT(!TEST(FRAG_WAS_DELETED, f->flags) ||
-                   INTERNAL_OPTION(safe_translate_flushed));
-            res = recreate_app_state_from_info(tdcontext, FRAGMENT_TRANSLATION_INFO(f),
+                   INTERNAL_OPTION(safe_translate_flushed) ||
+                   info != FRAGMENT_TRANSLATION_INFO(f));
+            res = recreate_app_state_from_info(tdcontext, info,
                                                (byte *) f->start_pc,
                                                (byte *) f->start_pc + f->size,
                                                mcontext, just_pc _IF_DEBUG(f->flags));
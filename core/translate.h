@@ -101,6 +101,10 @@ void translation_info_free(dcontext_t *tdcontext, translation_info_t *info);
 translation_info_t *record_translation_info(dcontext_t *dcontext, fragment_t *f,
                                             instrlist_t *ilist);
 void translation_info_print(const translation_info_t *info, cache_pc start, file_t file);
+void translation_cache_init(void);
+void translation_cache_exit(void);
+void translation_cache_reset(void);
+void translation_cache_remove(dcontext_t *dcontext, fragment_t *f);
 #ifdef INTERNAL
 void stress_test_recreate_state(dcontext_t *dcontext, fragment_t *f, instrlist_t *ilist);
 #endif
@@ -89,6 +89,23 @@ static void *allmem_info_merge(void *dst_data, void *src_data);
  */
 DECLARE_CXTSWPROT_VAR(uint all_memory_areas_recursion, 0);
 
+#ifdef HAVE_MEMINFO
+/* Holes in all_memory_areas that we have recently confirmed against the maps
+ * file.  all_memory_areas is maintained from the memory syscalls we intercept,
+ * so the maps file is only a fallback for memory mapped behind our back, but
+ * without this every query of an unallocated address (probes, client queries
+ * of arbitrary pointers) re-reads it, which is slow with many mappings.
+ * Adding an area evicts the holes it overlaps; removing one only grows holes.
+ * Protected by all_memory_areas->lock.
+ */
+# define NUM_VERIFIED_HOLES 16
+static struct {
+    app_pc start;
+    app_pc end;
+} verified_holes[NUM_VERIFIED_HOLES];
+static uint verified_holes_next;
+#endif
+
 void
 memcache_init(void)
 {
@@ -214,6 +231,44 @@ sync_all_memory_areas(void)
     }
 }
 
+#ifdef HAVE_MEMINFO
+static bool
+verified_hole_lookup(const byte *pc)
+{
+    uint i;
+    ASSERT_OWN_WRITE_LOCK(true, &all_memory_areas->lock);
+    for (i = 0; i < NUM_VERIFIED_HOLES; i++) {
+        if (pc >= verified_holes[i].start && pc < verified_holes[i].end)
+            return true;
+    }
+    return false;
+}
+
+static void
+verified_hole_add(app_pc start, app_pc end)
+{
+    ASSERT_OWN_WRITE_LOCK(true, &all_memory_areas->lock);
+    if (start >= end)
+        return;
+    verified_holes[verified_holes_next].start = start;
+    verified_holes[verified_holes_next].end = end;
+    verified_holes_next = (verified_holes_next + 1) % NUM_VERIFIED_HOLES;
+}
+
+static void
+verified_hole_evict(app_pc start, app_pc end)
+{
+    uint i;
+    ASSERT_OWN_WRITE_LOCK(true, &all_memory_areas->lock);
+    for (i = 0; i < NUM_VERIFIED_HOLES; i++) {
+        if (start < verified_holes[i].end && end > verified_holes[i].start) {
+            verified_holes[i].start = NULL;
+            verified_holes[i].end = NULL;
+        }
+    }
+}
+#endif
+
 /* caller should call sync_all_memory_areas first */
 static void
 add_all_memory_area(app_pc start, app_pc end, uint prot, int type, bool shareable)
@@ -221,6 +276,9 @@ add_all_memory_area(app_pc start, app_pc end, uint prot, int type, bool shareabl
     allmem_info_t *info;
     ASSERT(ALIGNED(start, PAGE_SIZE));
     ASSERT_OWN_WRITE_LOCK(true, &all_memory_areas->lock);
+#ifdef HAVE_MEMINFO
+    verified_hole_evict(start, end);
+#endif
     LOG(GLOBAL, LOG_VMAREAS|LOG_SYSCALLS, 3,
         "update_all_memory_areas: adding: "PFX"-"PFX" prot=%d type=%d share=%d\n",
         start, end, prot, type, shareable);
@@ -437,27 +495,34 @@ memcache_query_memory(const byte *pc, OUT dr_mem_info_t *out_info)
          * best to check with the OS (xref PR 363811).
          */
 #ifdef HAVE_MEMINFO
-        byte *from_os_base_pc;
-        size_t from_os_size;
-        uint from_os_prot;
-        if (get_memory_info_from_os(pc, &from_os_base_pc, &from_os_size,
-                                    &from_os_prot) &&
-            /* maps file shows our reserved-but-not-committed regions, which
-             * are holes in all_memory_areas
-             */
-            from_os_prot != MEMPROT_NONE) {
+        dr_mem_info_t from_os;
+        if (verified_hole_lookup(pc)) {
+            STATS_INC(memcache_verified_hole_hits);
+        } else if (query_memory_ex_from_os(pc, &from_os) &&
+                   from_os.type != DR_MEMTYPE_FREE &&
+                   /* maps file shows our reserved-but-not-committed regions, which
+                    * are holes in all_memory_areas
+                    */
+                   from_os.prot != MEMPROT_NONE) {
             SYSLOG_INTERNAL_WARNING_ONCE
                 ("all_memory_areas is missing regions including " PFX"-"PFX,
-                 from_os_base_pc, from_os_base_pc + from_os_size);
+                 from_os.base_pc, from_os.base_pc + from_os.size);
             DOLOG(4, LOG_VMAREAS, memcache_print(THREAD_GET, ""););
             /* be paranoid */
-            out_info->base_pc = from_os_base_pc;
-            out_info->size = from_os_size;
-            out_info->prot = from_os_prot;
+            out_info->base_pc = from_os.base_pc;
+            out_info->size = from_os.size;
+            out_info->prot = from_os.prot;
             out_info->type = DR_MEMTYPE_DATA; /* hopefully we won't miss an image */
             /* Update our list to avoid coming back here again (i#2037). */
-            memcache_update_locked(from_os_base_pc, from_os_base_pc+from_os_size,
-                                   from_os_prot, -1, false/*!exists*/);
+            memcache_update_locked(from_os.base_pc, from_os.base_pc + from_os.size,
+                                   from_os.prot, -1, false/*!exists*/);
+        } else if (from_os.type != DR_MEMTYPE_ERROR) {
+            /* Only the part of our hole that the OS agrees is empty is verified. */
+            app_pc hole_start = MAX(out_info->base_pc, from_os.base_pc);
+            app_pc hole_end = MIN(out_info->base_pc + out_info->size,
+                                  from_os.base_pc + from_os.size);
+            STATS_INC(memcache_verified_hole_misses);
+            verified_hole_add(hole_start, hole_end);
         }
 #else
         /* We now have nested probes, but currently probing sometimes calls
@@ -587,6 +652,9 @@ memcache_update_all_from_os(void)
     memcache_lock();
     /* We clear the entire cache to avoid false positive queries. */
     vmvector_reset_vector(GLOBAL_DCONTEXT, all_memory_areas);
+#ifdef HAVE_MEMINFO
+    memset(verified_holes, 0, sizeof(verified_holes));
+#endif
     os_walk_address_space(&iter, false);
     memcache_unlock();
     memquery_iterator_stop(&iter);
@@ -191,6 +191,14 @@ os_module_area_init(module_area_t *ma, app_pc base, size_t view_size,
      * all libs: I see DT_CHECKSUM and the prelink field on FC12 but not
      * on Ubuntu 9.04.
      */
+#ifdef LINUX
+    /* The build-id is unique per build of the module, unlike DT_CHECKSUM or
+     * our first-page crc below, so a pcache keyed on it is never reused for a
+     * rebuilt library with an identical header.
+     */
+    if (ma->os_data.build_id_hash != 0)
+        ma->os_data.checksum = ma->os_data.build_id_hash;
+#endif
     if (ma->os_data.checksum == 0 &&
         (DYNAMO_OPTION(coarse_enable_freeze) || DYNAMO_OPTION(use_persisted))) {
         /* Use something so we have usable pcache names */
@@ -462,6 +470,37 @@ os_module_get_rct_htable(app_pc pc, rct_type_t which)
 }
 #endif
 
+#ifdef RCT_IND_BRANCH
+/* Returns whether [start, end) is covered by a non-writable segment of a module
+ * whose references have already been added by rct_analyze_module_at_violation().
+ * If mark, records that they have been, unless the segment is writable: its
+ * contents can change, so we must rescan it on each violation.
+ */
+bool
+module_rct_segment_scanned(app_pc start, app_pc end, bool mark)
+{
+    module_area_t *ma;
+    bool scanned = false;
+    uint i;
+    os_get_module_info_write_lock();
+    ma = module_pc_lookup(start);
+    if (ma != NULL) {
+        for (i = 0; i < ma->os_data.num_segments; i++) {
+            module_segment_t *seg = &ma->os_data.segments[i];
+            if (start >= seg->start && end <= seg->end &&
+                !TEST(MEMPROT_WRITE, seg->prot)) {
+                scanned = seg->rct_scanned;
+                if (mark)
+                    seg->rct_scanned = true;
+                break;
+            }
+        }
+    }
+    os_get_module_info_write_unlock();
+    return scanned;
+}
+#endif
+
 /* Adds an entry for a segment to the out_data->segments array */
 void
 module_add_segment_data(OUT os_module_data_t *out_data,
@@ -522,6 +561,9 @@ module_add_segment_data(OUT os_module_data_t *out_data,
         ALIGN_FORWARD(segment_start + segment_size, PAGE_SIZE);
     out_data->segments[seg].prot = segment_prot;
     out_data->segments[seg].shared = shared;
+#ifdef RCT_IND_BRANCH
+    out_data->segments[seg].rct_scanned = false;
+#endif
     if (seg > 0) {
         ASSERT(out_data->segments[seg].start >= out_data->segments[seg - 1].end);
         if (out_data->segments[seg].start > out_data->segments[seg - 1].end)
@@ -48,6 +48,12 @@ typedef struct _module_segment_t {
     app_pc end;
     uint prot;
     bool shared; /* not unique to this module */
+#ifdef RCT_IND_BRANCH
+    /* References from this read-only segment have been added, see
+     * module_rct_segment_scanned().
+     */
+    bool rct_scanned;
+#endif
 } module_segment_t;
 
 typedef struct _os_module_data_t {
@@ -66,6 +72,16 @@ typedef struct _os_module_data_t {
     size_t timestamp;
 
 #ifdef LINUX
+    /* crc32 of the NT_GNU_BUILD_ID note's descriptor, or 0 if there is no
+     * build-id.  Preferred over checksum as the module's pcache identity.
+     */
+    uint build_id_hash;
+#ifdef ANNOTATIONS
+    /* Does a PT_NOTE segment hold a note emitted by the annotation macros in
+     * dr_annotations_asm.h?  Used by -annotations_from_notes.
+     */
+    bool has_annotation_note;
+#endif
     /* i#112: Dynamic section info for exported symbol lookup.  Not
      * using elf types here to avoid having to export those.
      */
@@ -153,6 +169,11 @@ module_add_segment_data(OUT os_module_data_t *out_data,
                         size_t alignment,
                         bool shared);
 
+#ifdef RCT_IND_BRANCH
+bool
+module_rct_segment_scanned(app_pc start, app_pc end, bool mark);
+#endif
+
 /* Redirected functions for loaded module,
  * they are also used by __wrap_* functions in instrument.c
  */
@@ -133,6 +133,10 @@ typedef struct _elf_symbol_iterator_t {
 # define STT_GNU_IFUNC STT_LOOS
 #endif
 
+#ifndef NT_GNU_BUILD_ID
+# define NT_GNU_BUILD_ID 3
+#endif
+
 /* forward declaration */
 static void
 module_hashtab_init(os_module_data_t *os_data);
@@ -485,6 +489,68 @@ module_fill_os_data(ELF_PROGRAM_HEADER_TYPE *prog_hdr, /* PT_DYNAMIC entry */
     return res;
 }
 
+#ifdef LINUX
+# ifdef ANNOTATIONS
+/* Must match DR_ANNOTATION_NOTE_{NAME,TYPE} in lib/dr_annotations_asm.h. */
+#  define ANNOTATION_NOTE_NAME "DynamoRIO"
+#  define ANNOTATION_NOTE_TYPE 1
+# endif
+
+/* Walks the notes in the PT_NOTE segment prog_hdr.  Fills in
+ * out_data->build_id_hash from the NT_GNU_BUILD_ID note, if present and not
+ * already found in an earlier segment, and sets out_data->has_annotation_note
+ * if an annotation site note is present.  As with module_fill_os_data(), if
+ * at_map we use the file offset; else the load-adjusted virtual address.
+ */
+static void
+module_read_notes(ELF_PROGRAM_HEADER_TYPE *prog_hdr, /* PT_NOTE entry */
+                  app_pc base, size_t view_size, bool at_map, ptr_int_t load_delta,
+                  OUT os_module_data_t *out_data)
+{
+    app_pc note = at_map ? base + prog_hdr->p_offset :
+        (app_pc)prog_hdr->p_vaddr + load_delta;
+    app_pc note_end = note + prog_hdr->p_filesz;
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    ASSERT(prog_hdr->p_type == PT_NOTE);
+    /* The notes are normally in the first page, but don't fault on a
+     * partial initial map.
+     */
+    if (at_map && prog_hdr->p_offset + prog_hdr->p_filesz > view_size)
+        return;
+    TRY_EXCEPT_ALLOW_NO_DCONTEXT(dcontext, {
+        while (note + sizeof(ELF_NOTE_HEADER_TYPE) <= note_end) {
+            ELF_NOTE_HEADER_TYPE *nhdr = (ELF_NOTE_HEADER_TYPE *) note;
+            app_pc name = note + sizeof(*nhdr);
+            app_pc desc = name + ALIGN_FORWARD(nhdr->n_namesz, 4);
+            if (desc + nhdr->n_descsz > note_end)
+                break;
+            if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+                strncmp((const char *)name, "GNU", 4) == 0 && nhdr->n_descsz > 0 &&
+                out_data->build_id_hash == 0) {
+                out_data->build_id_hash = crc32((const char *)desc, nhdr->n_descsz);
+                LOG(GLOBAL, LOG_VMAREAS, 2, "%s "PFX": build-id hash 0x%08x\n",
+                    __FUNCTION__, base, out_data->build_id_hash);
+            }
+# ifdef ANNOTATIONS
+            if (nhdr->n_type == ANNOTATION_NOTE_TYPE &&
+                nhdr->n_namesz == sizeof(ANNOTATION_NOTE_NAME) &&
+                strncmp((const char *)name, ANNOTATION_NOTE_NAME,
+                        sizeof(ANNOTATION_NOTE_NAME)) == 0 &&
+                !out_data->has_annotation_note) {
+                out_data->has_annotation_note = true;
+                LOG(GLOBAL, LOG_VMAREAS|LOG_ANNOTATIONS, 2,
+                    "%s "PFX": contains annotations\n", __FUNCTION__, base);
+            }
+# endif
+            note = desc + ALIGN_FORWARD(nhdr->n_descsz, 4);
+        }
+    } , { /* EXCEPT */
+        ASSERT_CURIOSITY(false && "crashed while walking note segment");
+        out_data->build_id_hash = 0;
+    });
+}
+#endif
+
 /* Returned addresses out_base and out_end are relative to the actual
  * loaded module base, so the "base" param should be added to produce
  * absolute addresses.
@@ -543,6 +609,12 @@ module_walk_program_headers(app_pc base, size_t view_size, bool at_map, bool dyn
                 }
                 found_load = true;
             }
+#ifdef LINUX
+            if (out_data != NULL && prog_hdr->p_type == PT_NOTE) {
+                module_read_notes(prog_hdr, base, view_size, at_map, load_delta,
+                                  out_data);
+            }
+#endif
             if ((out_soname != NULL || out_data != NULL) &&
                 prog_hdr->p_type == PT_DYNAMIC) {
                 module_fill_os_data(prog_hdr, mod_base, max_end,
@@ -815,6 +887,7 @@ elf_sym_matches(ELF_SYM_TYPE *sym, char *strtab, const char *name,
  */
 static app_pc
 gnu_hash_lookup(const char   *name,
+                Elf_Symndx    hidx,
                 ptr_int_t     load_delta,
                 ELF_SYM_TYPE *symtab,
                 char         *strtab,
@@ -827,13 +900,12 @@ gnu_hash_lookup(const char   *name,
                 bool         *is_indirect_code)
 {
     Elf_Symndx sidx;
-    Elf_Symndx hidx;
     ELF_ADDR entry;
     uint h1, h2;
     app_pc res = NULL;
 
     ASSERT(bitmask != NULL);
-    hidx = elf_gnu_hash(name);
+    ASSERT(hidx == elf_gnu_hash(name));
     entry = bitmask[(hidx / ELF_WORD_SIZE) & bitidx];
     h1 = hidx & (ELF_WORD_SIZE - 1);
     h2 = (hidx >> shift) & (ELF_WORD_SIZE - 1); /* bloom filter hash */
@@ -860,6 +932,7 @@ gnu_hash_lookup(const char   *name,
  */
 static app_pc
 elf_hash_lookup(const char   *name,
+                Elf_Symndx    hidx,
                 ptr_int_t     load_delta,
                 ELF_SYM_TYPE *symtab,
                 char         *strtab,
@@ -870,11 +943,10 @@ elf_hash_lookup(const char   *name,
                 bool         *is_indirect_code)
 {
     Elf_Symndx    sidx;
-    Elf_Symndx    hidx;
     ELF_SYM_TYPE *sym;
     app_pc        res;
 
-    hidx = elf_hash(name);
+    ASSERT(hidx == elf_hash(name));
     for (sidx = buckets[hidx % num_buckets];
          sidx != STN_UNDEF;
          sidx = chain[sidx]) {
@@ -898,12 +970,16 @@ elf_hash_lookup(const char   *name,
     return res;
 }
 
-/* get the address by using the hashtable information in os_module_data_t */
-app_pc
-get_proc_address_from_os_data(os_module_data_t *os_data,
-                              ptr_int_t load_delta,
-                              const char *name,
-                              OUT bool *is_indirect_code)
+/* Looks up name using hashes the caller computed, so that a search across
+ * many modules hashes each name only once.
+ */
+static app_pc
+get_proc_address_from_os_data_hashed(os_module_data_t *os_data,
+                                     ptr_int_t load_delta,
+                                     const char *name,
+                                     Elf_Symndx gnu_hidx,
+                                     Elf_Symndx elf_hidx,
+                                     OUT bool *is_indirect_code)
 {
     if (os_data->hashtab != NULL) {
         Elf_Symndx *buckets = (Elf_Symndx *) os_data->buckets;
@@ -913,7 +989,7 @@ get_proc_address_from_os_data(os_module_data_t *os_data,
         size_t num_buckets = os_data->num_buckets;
         if (os_data->hash_is_gnu) {
             /* The new GNU hash scheme */
-            return gnu_hash_lookup(name, load_delta, symtab, strtab,
+            return gnu_hash_lookup(name, gnu_hidx, load_delta, symtab, strtab,
                                    buckets, chain,
                                    (ELF_ADDR *)os_data->gnu_bitmask,
                                    (ptr_uint_t)os_data->gnu_bitidx,
@@ -921,7 +997,7 @@ get_proc_address_from_os_data(os_module_data_t *os_data,
                                    num_buckets, is_indirect_code);
         } else {
             /* ELF hash scheme */
-            return elf_hash_lookup(name, load_delta, symtab, strtab,
+            return elf_hash_lookup(name, elf_hidx, load_delta, symtab, strtab,
                                    buckets, chain,
                                    num_buckets, os_data->dynstr_size,
                                    is_indirect_code);
@@ -930,6 +1006,22 @@ get_proc_address_from_os_data(os_module_data_t *os_data,
     return NULL;
 }
 
+/* get the address by using the hashtable information in os_module_data_t */
+app_pc
+get_proc_address_from_os_data(os_module_data_t *os_data,
+                              ptr_int_t load_delta,
+                              const char *name,
+                              OUT bool *is_indirect_code)
+{
+    if (os_data->hashtab == NULL)
+        return NULL;
+    /* only the hash matching this module's table is needed */
+    return get_proc_address_from_os_data_hashed
+        (os_data, load_delta, name,
+         os_data->hash_is_gnu ? elf_gnu_hash(name) : 0,
+         os_data->hash_is_gnu ? 0 : elf_hash(name), is_indirect_code);
+}
+
 /* if we add any more values, switch to a globally-defined dr_export_info_t
  * and use it here
  */
@@ -1359,6 +1451,7 @@ module_lookup_symbol(ELF_SYM_TYPE *sym, os_privmod_data_t *pd)
     const char *name;
     privmod_t *mod;
     bool is_ifunc;
+    Elf_Symndx gnu_hidx, elf_hidx;
     dcontext_t *dcontext = get_thread_private_dcontext();
 
     /* no name, do not search */
@@ -1368,10 +1461,17 @@ module_lookup_symbol(ELF_SYM_TYPE *sym, os_privmod_data_t *pd)
     name = (char *)pd->os_data.dynstr + sym->st_name;
     LOG(GLOBAL, LOG_LOADER, 3, "sym lookup for %s from %s\n",
         name, pd->soname);
+    /* Every relocation of every private library comes through here and may
+     * walk the whole module list, so hash the name once up front rather than
+     * once per module.  Modules can use either hash style.
+     */
+    gnu_hidx = elf_gnu_hash(name);
+    elf_hidx = elf_hash(name);
     /* check my current module */
-    res = get_proc_address_from_os_data(&pd->os_data,
-                                        pd->load_delta,
-                                        name, &is_ifunc);
+    res = get_proc_address_from_os_data_hashed(&pd->os_data,
+                                               pd->load_delta,
+                                               name, gnu_hidx, elf_hidx,
+                                               &is_ifunc);
     if (res != NULL) {
         if (is_ifunc) {
             TRY_EXCEPT_ALLOW_NO_DCONTEXT(dcontext, {
@@ -1395,9 +1495,10 @@ module_lookup_symbol(ELF_SYM_TYPE *sym, os_privmod_data_t *pd)
         ASSERT(pd != NULL && name != NULL);
         LOG(GLOBAL, LOG_LOADER, 3, "sym lookup for %s from %s = %s\n",
             name, pd->soname, mod->path);
-        res = get_proc_address_from_os_data(&pd->os_data,
-                                            pd->load_delta,
-                                            name, &is_ifunc);
+        res = get_proc_address_from_os_data_hashed(&pd->os_data,
+                                                   pd->load_delta,
+                                                   name, gnu_hidx, elf_hidx,
+                                                   &is_ifunc);
         if (res != NULL) {
             if (is_ifunc) {
                 TRY_EXCEPT_ALLOW_NO_DCONTEXT(dcontext, {
@@ -2093,7 +2194,7 @@ elf_loader_map_phdrs(elf_loader_t *elf, bool fixed, map_fn_t map_func,
         ELF_PROGRAM_HEADER_TYPE *prog_hdr = (ELF_PROGRAM_HEADER_TYPE *)
             ((byte *)elf->phdrs + i * elf_hdr->e_phentsize);
         if (prog_hdr->p_type == PT_LOAD) {
-            bool do_mmap = true;
+            bool do_mmap = true, zero_fill;
             seg_base = (app_pc)ALIGN_BACKWARD(prog_hdr->p_vaddr, PAGE_SIZE)
                        + delta;
             seg_end  = (app_pc)ALIGN_FORWARD(prog_hdr->p_vaddr +
@@ -2128,13 +2229,20 @@ elf_loader_map_phdrs(elf_loader_t *elf, bool fixed, map_fn_t map_func,
              * another thread requests memory via mmap takes the memory here,
              * a racy condition.
              */
+            /* Like ld.so, we only zero the tail of the final file page for a
+             * segment with .bss-style contents past its file data.  Zeroing it for
+             * every segment would dirty the last page of each library's text, and
+             * mapping text writable would charge it all as private memory: instead
+             * it stays clean and shared with the page cache across processes.
+             */
+            zero_fill = prog_hdr->p_memsz > prog_hdr->p_filesz;
             if (seg_size > 0) { /* i#1872: handle empty segments */
                 (*unmap_func)(seg_base, seg_size);
                 if (do_mmap) {
                     map = (*map_func)
                         (elf->fd, &seg_size, pg_offs,
                          seg_base /* base */,
-                         seg_prot | MEMPROT_WRITE /* prot */,
+                         seg_prot | (zero_fill ? MEMPROT_WRITE : 0) /* prot */,
                          MAP_FILE_COPY_ON_WRITE/*writes should not change file*/ |
                          MAP_FILE_IMAGE |
                          /* we don't need MAP_FILE_REACHABLE b/c we're fixed */
@@ -2142,7 +2250,7 @@ elf_loader_map_phdrs(elf_loader_t *elf, bool fixed, map_fn_t map_func,
                     ASSERT(map != NULL);
                     /* fill zeros at extend size */
                     file_end = (app_pc)prog_hdr->p_vaddr + prog_hdr->p_filesz;
-                    if (seg_end > file_end + delta) {
+                    if (zero_fill && seg_end > file_end + delta) {
 #ifndef NOT_DYNAMORIO_CORE_PROPER
                         memset(file_end + delta, 0, seg_end - (file_end + delta));
 #else
@@ -44,6 +44,10 @@
 #include "globals_shared.h"
 #ifndef NOT_DYNAMORIO_CORE
 # include "../globals.h" /* for arch_exports.h for dynamorio_syscall */
+#else
+# include <dirent.h>
+# include <stdio.h>
+# include <stdlib.h>
 #endif
 
 /* shared with tools/nudgeunix.c */
@@ -72,7 +76,63 @@ create_nudge_signal_payload(siginfo_t *info OUT, uint action_mask,
     return true;
 }
 
-#ifndef NOT_DYNAMORIO_CORE
+#ifdef NOT_DYNAMORIO_CORE
+static bool
+is_nudge_thread(long id)
+{
+    char path[64];
+    char name[32];
+    FILE *f;
+    bool res = false;
+    snprintf(path, sizeof(path), "/proc/%ld/comm", id);
+    f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+    if (fgets(name, sizeof(name), f) != NULL)
+        res = (strcmp(name, NUDGE_THREAD_NAME"\n") == 0);
+    fclose(f);
+    return res;
+}
+
+/* shared with tools/nudgeunix.c
+ * Returns the id to send a nudge signal for process pid to: the thread created
+ * by -nudge_thread if pid has one, else pid itself.  That thread is a child of
+ * one of pid's threads in its own thread group, so we only need to look at the
+ * children of pid's threads.
+ */
+process_id_t
+get_nudge_signal_target(process_id_t pid)
+{
+    char path[64];
+    DIR *dir;
+    struct dirent *ent;
+    process_id_t target = pid;
+    snprintf(path, sizeof(path), "/proc/%d/task", (int)pid);
+    dir = opendir(path);
+    if (dir == NULL)
+        return pid;
+    while (target == pid && (ent = readdir(dir)) != NULL) {
+        FILE *f;
+        long child;
+        long tid = strtol(ent->d_name, NULL, 10);
+        if (tid <= 0) /* "." or ".." */
+            continue;
+        snprintf(path, sizeof(path), "/proc/%d/task/%ld/children", (int)pid, tid);
+        f = fopen(path, "r");
+        if (f == NULL)
+            continue;
+        while (fscanf(f, "%ld", &child) == 1) {
+            if (is_nudge_thread(child)) {
+                target = (process_id_t) child;
+                break;
+            }
+        }
+        fclose(f);
+    }
+    closedir(dir);
+    return target;
+}
+#else
 bool
 send_nudge_signal(process_id_t pid, uint action_mask,
                   client_id_t client_id, uint64 client_arg)
@@ -84,4 +144,4 @@ send_nudge_signal(process_id_t pid, uint action_mask,
     res = dynamorio_syscall(SYS_rt_sigqueueinfo, 3, pid, NUDGESIG_SIGNUM, &info);
     return (res >= 0);
 }
-#endif /* !NOT_DYNAMORIO_CORE */
+#endif /* NOT_DYNAMORIO_CORE */
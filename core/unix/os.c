@@ -2179,6 +2179,13 @@ os_tls_cfree(uint offset, uint num_slots)
 }
 #endif
 
+#ifdef DEBUG
+/* Normalized numbers at or above this are not profiled (e.g., Mac markers). */
+# define SYSCALL_PROFILE_MAX 1024
+static void
+syscall_profile_dump(dcontext_t *dcontext, uint *counts);
+#endif
+
 void
 os_thread_init(dcontext_t *dcontext)
 {
@@ -2232,6 +2239,14 @@ os_thread_init(dcontext_t *dcontext)
     }
 #endif
 
+#ifdef DEBUG
+    if (INTERNAL_OPTION(profile_syscalls)) {
+        ostd->syscall_counts = HEAP_ARRAY_ALLOC(dcontext, uint, SYSCALL_PROFILE_MAX,
+                                                ACCT_OTHER, UNPROTECTED);
+        memset(ostd->syscall_counts, 0, sizeof(uint) * SYSCALL_PROFILE_MAX);
+    }
+#endif
+
     LOG(THREAD, LOG_THREADS, 1, "post-TLS-setup, cur %s base is "PFX"\n",
         IF_X86_ELSE("gs", "tpidruro"),
         get_segment_base(IF_X86_ELSE(SEG_GS, DR_REG_TPIDRURO)));
@@ -2259,6 +2274,15 @@ os_thread_exit(dcontext_t *dcontext, bool other_thread)
 
     DELETE_LOCK(ostd->suspend_lock);
 
+#ifdef DEBUG
+    if (ostd->syscall_counts != NULL) {
+        syscall_profile_dump(dcontext, ostd->syscall_counts);
+        HEAP_ARRAY_FREE(dcontext, ostd->syscall_counts, uint, SYSCALL_PROFILE_MAX,
+                        ACCT_OTHER, UNPROTECTED);
+        ostd->syscall_counts = NULL;
+    }
+#endif
+
     signal_thread_exit(dcontext, other_thread);
 
     ksynch_free_var(&ostd->suspended);
@@ -3322,17 +3346,38 @@ os_heap_decommit(void *p, size_t size, heap_error_code_t *error_code)
         LOG(GLOBAL, LOG_HEAP, 4, "os_heap_decommit: %d bytes @ "PFX"\n", size, p);
 
     *error_code = HEAP_ERROR_SUCCESS;
-    /* FIXME: for now do nothing since os_heap_reserve has in fact committed the memory */
+    /* os_heap_reserve has in fact committed the memory, so we leave the mapping
+     * and its protection alone and only hand the physical pages back: they read
+     * as zero if touched again, which is what a re-commit would give on Windows.
+     */
+#ifdef LINUX
+    rc = dynamorio_syscall(SYS_madvise, 3, p, size, MADV_DONTNEED);
+#else
+    /* XXX: MADV_DONTNEED is only advisory on Mac, so we do nothing. */
     rc = 0;
-    /* TODO:
-           p = mmap_syscall(p, size, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-       we should either do a mremap()
-       or we can do a munmap() followed 'quickly' by a mmap() -
-       also see above the comment that os_heap_reserve() in fact is not so lightweight
-    */
+#endif
     ASSERT(rc == 0);
 }
 
+bool
+os_heap_request_huge_pages(void *p, size_t size)
+{
+#ifdef LINUX
+# ifndef MADV_HUGEPAGE
+#  define MADV_HUGEPAGE 14
+# endif
+    /* The advice sticks to the mapping, so pages committed later via mprotect
+     * are eligible for transparent huge pages.
+     */
+    ptr_int_t res = dynamorio_syscall(SYS_madvise, 3, p, size, MADV_HUGEPAGE);
+    LOG(GLOBAL, LOG_HEAP, 2, "os_heap_request_huge_pages: %d bytes @ "PFX" => %d\n",
+        size, p, res);
+    return res == 0;
+#else
+    return false;
+#endif
+}
+
 bool
 os_heap_systemwide_overcommit(heap_error_code_t last_error_code)
 {
@@ -3446,8 +3491,12 @@ os_thread_sleep(uint64 milliseconds)
 #endif
 }
 
+/* Takes a suspend reference on tr and sends it the suspend signal if it is
+ * not already suspended, without waiting for it to reach the suspend point.
+ * A successful call must be followed by os_thread_suspend_finish().
+ */
 bool
-os_thread_suspend(thread_record_t *tr, int timeout_ms)
+os_thread_suspend_start(thread_record_t *tr)
 {
     os_thread_data_t *ostd = (os_thread_data_t *) tr->dcontext->os_field;
     ASSERT(ostd != NULL);
@@ -3458,14 +3507,14 @@ os_thread_suspend(thread_record_t *tr, int timeout_ms)
     ostd->suspend_count++;
     ASSERT(ostd->suspend_count > 0);
     /* If already suspended, do not send another signal.  However, we do
-     * need to ensure the target is suspended in case of a race, so we can't
-     * just return.
+     * need to ensure the target is suspended in case of a race, so
+     * os_thread_suspend() can't just return.
      */
     if (ostd->suspend_count == 1) {
         /* PR 212090: we use a custom signal handler to suspend.  We wait
-         * here until the target reaches the suspend point, and leave it
-         * up to the caller to check whether it is a safe suspend point,
-         * to match Windows behavior.
+         * in os_thread_suspend() until the target reaches the suspend point,
+         * and leave it up to the caller to check whether it is a safe suspend
+         * point, to match Windows behavior.
          */
         ASSERT(ksynch_get_value(&ostd->suspended) == 0);
         if (!known_thread_signal(tr, SUSPEND_SIGNAL)) {
@@ -3480,6 +3529,17 @@ os_thread_suspend(thread_record_t *tr, int timeout_ms)
      * suspending thread gets scheduled again.
      */
     mutex_unlock(&ostd->suspend_lock);
+    return true;
+}
+
+/* Waits for a suspend started by os_thread_suspend_start() to take effect.
+ * On a timeout, drops the reference it took and returns false.
+ */
+bool
+os_thread_suspend_finish(thread_record_t *tr, int timeout_ms)
+{
+    os_thread_data_t *ostd = (os_thread_data_t *) tr->dcontext->os_field;
+    ASSERT(ostd != NULL);
     while (ksynch_get_value(&ostd->suspended) == 0) {
         /* For Linux, waits only if the suspended flag is not set as 1. Other
          * than a timeout value, the return value doesn't matter because the
@@ -3500,6 +3560,14 @@ os_thread_suspend(thread_record_t *tr, int timeout_ms)
     return true;
 }
 
+bool
+os_thread_suspend(thread_record_t *tr, int timeout_ms)
+{
+    if (!os_thread_suspend_start(tr))
+        return false;
+    return os_thread_suspend_finish(tr, timeout_ms);
+}
+
 bool
 os_thread_resume(thread_record_t *tr)
 {
@@ -5145,6 +5213,38 @@ ignorable_system_call(int num_raw, instr_t *gateway, dcontext_t *dcontext_live)
         (os_normalized_sysnum(num_raw, gateway, dcontext_live));
 }
 
+#ifdef DEBUG
+/* Logs the most frequent syscalls that went through pre_system_call().  Those
+ * that are ignorable only missed being inlined because their number was not
+ * known at block build time or because a client filter asked to see them.
+ */
+static void
+syscall_profile_dump(dcontext_t *dcontext, uint *counts)
+{
+    uint total = 0;
+    int i, printed;
+    for (i = 0; i < SYSCALL_PROFILE_MAX; i++)
+        total += counts[i];
+    LOG(THREAD, LOG_SYSCALLS|LOG_STATS, 1,
+        "syscall profile: %u syscalls not executed inline\n", total);
+    /* Print the top entries by repeatedly picking the maximum: we're at thread
+     * exit and the table is small, so this is simpler than sorting a copy.
+     */
+    for (printed = 0; printed < 20; printed++) {
+        int max = -1;
+        for (i = 0; i < SYSCALL_PROFILE_MAX; i++) {
+            if (counts[i] > 0 && (max == -1 || counts[i] > counts[max]))
+                max = i;
+        }
+        if (max == -1)
+            break;
+        LOG(THREAD, LOG_SYSCALLS|LOG_STATS, 1, "  #%4d: %10u%s\n", max, counts[max],
+            ignorable_system_call_normalized(max) ? "  (ignorable)" : "");
+        counts[max] = 0;
+    }
+}
+#endif
+
 typedef struct {
         unsigned long addr;
         unsigned long len;
@@ -6681,6 +6781,12 @@ pre_system_call(dcontext_t *dcontext)
             if (ignorable_system_call_normalized(dcontext->sys_num))
             STATS_INC(pre_syscall_ignorable);
     });
+    DODEBUG({
+        os_thread_data_t *ostd = (os_thread_data_t *) dcontext->os_field;
+        if (ostd->syscall_counts != NULL && dcontext->sys_num >= 0 &&
+            dcontext->sys_num < SYSCALL_PROFILE_MAX)
+            ostd->syscall_counts[dcontext->sys_num]++;
+    });
     LOG(THREAD, LOG_SYSCALLS, 2, "system call %d\n", dcontext->sys_num);
 
 #if defined(LINUX) && defined(X86)
@@ -10145,9 +10251,11 @@ rct_analyze_module_at_violation(dcontext_t *dcontext, app_pc target_pc)
     app_pc code_start;
     size_t code_size;
     uint prot;
+    bool code_writable;
 
     if (!get_memory_info(target_pc, &code_start, &code_size, &prot))
         return false;
+    code_writable = TEST(MEMPROT_WRITE, prot);
     /* TODO: in almost all cases expect the region at module_base+module_size to be
      * the corresponding data section.
      * Writable yet initialized data indeed needs to be processed.
@@ -10170,6 +10278,17 @@ rct_analyze_module_at_violation(dcontext_t *dcontext, app_pc target_pc)
         app_pc text_start = code_start;
         app_pc text_end = data_start + data_size;
 
+        /* Scanning a large module can take seconds, and violations keep
+         * coming back to the same module.  The code itself cannot gain new
+         * references while it stays read-only, so once scanned we only rescan
+         * the writable data.
+         */
+        if (!code_writable &&
+            module_rct_segment_scanned(code_start, code_end, true/*mark*/)) {
+            STATS_INC(rct_ind_branch_code_rescan_skipped);
+            text_start = data_start;
+        }
+
         /* TODO: performance: do this only in case relocation info is not present */
         DEBUG_DECLARE(uint found = )
             find_address_references(dcontext, text_start, text_end,
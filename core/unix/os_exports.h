@@ -352,6 +352,9 @@ typedef struct _kernel_sigset_t {
 void receive_pending_signal(dcontext_t *dcontext);
 bool is_signal_restorer_code(byte *pc, size_t *len);
 bool is_currently_on_sigaltstack(dcontext_t *dcontext);
+#if defined(LINUX) && defined(CLIENT_SIDELINE)
+void nudge_thread_init(void);
+#endif
 
 #define CONTEXT_HEAP_SIZE(sc) (sizeof(sc))
 #define CONTEXT_HEAP_SIZE_OPAQUE (CONTEXT_HEAP_SIZE(sigcontext_t))
@@ -181,6 +181,10 @@ typedef struct _os_thread_data_t {
     void *app_thread_areas; /* data structure for app's thread area info */
     struct _os_local_state_t *clone_tls; /* i#2089: a copy for children to inherit */
 #endif
+#ifdef DEBUG
+    /* -profile_syscalls: per-number counts of syscalls that reach DR */
+    uint *syscall_counts;
+#endif
 } os_thread_data_t;
 
 enum { ARGC_PTRACE_SENTINEL = -1 };
@@ -78,6 +78,7 @@ typedef struct _pc_profile_entry_t {
     int                     id;      /* if in fragment, id */
 #endif
     ushort              offset;      /* if in fragment, offset from start pc */
+    app_pc             app_pc;       /* if in fragment, translated app pc */
     dr_where_am_i_t    whereami:8;      /* location of pc */
     bool               trace:1;      /* if in fragment, is it a trace? */
     bool             retired:1;      /* owning fragment was deleted */
@@ -93,6 +94,7 @@ typedef struct _thread_pc_info_t {
     pc_profile_entry_t **htable; /* HASH_BITS-bit addressed hash table, key is pc */
     void *special_heap;
     file_t file;
+    file_t folded_file;          /* samples in folded-stack form */
     int where[DR_WHERE_LAST];
 } thread_pc_info_t;
 
@@ -104,6 +106,7 @@ static pc_profile_entry_t *pcprofile_add_entry(thread_pc_info_t *info, void *pc,
 static pc_profile_entry_t *pcprofile_lookup(thread_pc_info_t *info, void *pc);
 static void pcprofile_reset(thread_pc_info_t *info);
 static void pcprofile_results(thread_pc_info_t *info);
+static void pcprofile_folded_results(thread_pc_info_t *info);
 static void pcprofile_alarm(dcontext_t *dcontext, priv_mcontext_t *mcontext);
 
 /* initialization */
@@ -142,6 +145,7 @@ pcprofile_thread_init(dcontext_t *dcontext, bool shared_itimer, void *parent_inf
     for (i = 0; i < DR_WHERE_LAST; i++)
         info->where[i] = 0;
     info->file = open_log_file("pcsamples", NULL, 0);
+    info->folded_file = open_log_file("pcsamples.folded", NULL, 0);
     /* FIXME PR 596808: we can easily fill up the initial special heap unit,
      * and creating a new one acquires global locks and can deadlock:
      * we should allocate many units up front or something
@@ -168,6 +172,7 @@ pcprofile_thread_exit(dcontext_t *dcontext)
     set_itimer_callback(dcontext, ITIMER_VIRTUAL, 0, NULL, NULL);
 
     pcprofile_results(info);
+    pcprofile_folded_results(info);
     size = HASHTABLE_SIZE(HASH_BITS) * sizeof(pc_profile_entry_t*);
     pcprofile_reset(info); /* special heap so no fast path */
 #ifdef DEBUG
@@ -179,6 +184,7 @@ pcprofile_thread_exit(dcontext_t *dcontext)
         symtab_exit();
 #endif
     close_log_file(info->file);
+    close_log_file(info->folded_file);
     special_heap_exit(info->special_heap);
 #ifdef DEBUG
     /* for non-debug we do fast exit path and don't free local heap */
@@ -196,6 +202,7 @@ pcprofile_fork_init(dcontext_t *dcontext)
     info->thread_shared = false;
     pcprofile_reset(info);
     info->file = open_log_file("pcsamples", NULL, 0);
+    info->folded_file = open_log_file("pcsamples.folded", NULL, 0);
     set_itimer_callback(dcontext, ITIMER_VIRTUAL, ALARM_FREQUENCY, pcprofile_alarm, NULL);
 }
 
@@ -269,6 +276,10 @@ pcprofile_alarm(dcontext_t *dcontext, priv_mcontext_t *mcontext)
                 ASSERT(CHECK_TRUNCATE_TYPE_int((byte *)pc - fragment->start_pc));
                 entry->offset = (int) ((byte *)pc - fragment->start_pc);
                 entry->trace = (fragment->flags & FRAG_IS_TRACE) != 0;
+                /* Translate now while the fragment is guaranteed to exist, so
+                 * samples can be attributed to app code rather than to tags.
+                 */
+                entry->app_pc = recreate_app_pc(dcontext, pc, fragment);
             }
         }
     }
@@ -298,6 +309,7 @@ pcprofile_add_entry(thread_pc_info_t *info, void *pc, int whereami)
 #endif
     e->tag = 0;
     e->offset = 0;
+    e->app_pc = NULL;
     e->trace = false;
     e->retired = false;
 
@@ -491,11 +503,12 @@ pcprofile_results(thread_pc_info_t *info)
                     type = "fragment";
                 print_file(info->file,
 #ifdef DEBUG
-                        "pc="PFX"\t#=%d\tin %s #%6d @"PFX" w/ offs "PFX"\n",
-                        e->pc, e->counter, type, e->id, e->tag, e->offset);
+                        "pc="PFX"\t#=%d\tin %s #%6d @"PFX" w/ offs "PFX
+                        " app pc "PFX"\n",
+                        e->pc, e->counter, type, e->id, e->tag, e->offset, e->app_pc);
 #else
-                        "pc="PFX"\t#=%d\tin %s @"PFX" w/ offs "PFX"\n",
-                        e->pc, e->counter, type, e->tag, e->offset);
+                        "pc="PFX"\t#=%d\tin %s @"PFX" w/ offs "PFX" app pc "PFX"\n",
+                        e->pc, e->counter, type, e->tag, e->offset, e->app_pc);
 #endif
 #if USE_SYMTAB
                 /* FIXME: this only works for fragments whose tags are app pc's! */
@@ -575,3 +588,38 @@ pcprofile_results(thread_pc_info_t *info)
         }
     }
 }
+
+/* Prints one line per sampled pc in the "folded stacks" format consumed by
+ * flame graph and pprof conversion tools: semicolon-separated frames from
+ * outermost to innermost, a space, and the sample count.  Code cache samples
+ * are attributed to their fragment and translated app pc so that time in the
+ * cache can be compared against time in DR itself.
+ */
+static void
+pcprofile_folded_results(thread_pc_info_t *info)
+{
+    static const char *const where_names[DR_WHERE_LAST] = {
+        "app", "interp", "dispatch", "monitor", "syscall_handler",
+        "signal_handler", "trampoline", "context_switch", "ibl", "fcache",
+        "clean_callee", "unknown",
+#ifdef HOT_PATCHING_INTERFACE
+        "hotpatch",
+#endif
+    };
+    int i;
+    pc_profile_entry_t *e;
+    for (i = 0; i < HASHTABLE_SIZE(HASH_BITS); i++) {
+        for (e = info->htable[i]; e != NULL; e = e->next) {
+            if (e->whereami == DR_WHERE_FCACHE && e->tag != NULL) {
+                print_file(info->folded_file, "fcache;%s "PFX";"PFX" %d\n",
+                           e->trace ? "trace" : "bb", e->tag,
+                           e->app_pc == NULL ? e->tag : e->app_pc, e->counter);
+            } else if (e->whereami == DR_WHERE_APP) {
+                print_file(info->folded_file, "app;"PFX" %d\n", e->pc, e->counter);
+            } else {
+                print_file(info->folded_file, "dynamorio;%s;"PFX" %d\n",
+                           where_names[e->whereami], e->pc, e->counter);
+            }
+        }
+    }
+}
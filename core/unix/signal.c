@@ -58,6 +58,7 @@
 
 #ifdef LINUX
 #  include <linux/sched.h>
+#  include <sys/prctl.h> /* PR_SET_NAME */
 #endif
 
 #include <sys/time.h>
@@ -3732,6 +3733,7 @@ record_pending_signal(dcontext_t *dcontext, int sig, kernel_ucontext_t *ucxt,
     bool blocked = false;
     bool handled = false;
     bool at_auto_restart_syscall = false;
+    bool synch_from_cache = false;
     int syslen = 0;
     reg_t orig_retval_reg = sc->IF_X86_ELSE(SC_XAX, SC_R0);
     sigpending_t *pend;
@@ -4022,6 +4024,15 @@ record_pending_signal(dcontext_t *dcontext, int sig, kernel_ucontext_t *ucxt,
         ASSERT(!forged);
         /* cache the fragment since pclookup is expensive for coarse (i#658) */
         f = fragment_pclookup(dcontext, (cache_pc)sc->SC_XIP, &wrapper);
+        if (!can_always_delay[sig] && f != NULL) {
+            /* A fault in app code, which runtimes using faults for null checks
+             * or safepoints hit at high frequency: -translation_cache_max avoids
+             * re-decoding f for each one.
+             */
+            synch_from_cache = true;
+            RSTATS_INC(num_signals_synch_from_cache);
+            KSTART_DC(dcontext, synch_signal_from_cache);
+        }
         xl8_success = translate_sigcontext(dcontext, ucxt, !can_always_delay[sig], f);
 
         if (can_always_delay[sig] && !xl8_success) {
@@ -4057,6 +4068,8 @@ record_pending_signal(dcontext_t *dcontext, int sig, kernel_ucontext_t *ucxt,
          */
         execute_handler_from_cache(dcontext, sig, frame, &sc_orig, f
                                    _IF_CLIENT(access_address));
+        if (synch_from_cache)
+            KSTOP_DC(dcontext, synch_signal_from_cache);
 
     } else if (!handled) {
 
@@ -6953,6 +6966,62 @@ dr_setjmp_sigmask(dr_jmp_buf_t *buf)
 #endif
 }
 
+#if defined(LINUX) && defined(CLIENT_SIDELINE)
+/* -nudge_thread: a client thread that sits in a futex wait for nudges.  Like
+ * all client threads it is in its own thread group, so an external nudger
+ * that sends the nudge signal to its id (found via NUDGE_THREAD_NAME) does
+ * not interrupt any app thread.  Nudges sent to the app's thread group are
+ * still handled by whichever app thread receives them.
+ */
+static thread_id_t nudge_thread_tid;
+static volatile int nudge_thread_signaled;
+
+static void
+nudge_thread_run(void *arg)
+{
+    dcontext_t *dcontext = get_thread_private_dcontext();
+    kernel_sigset_t set, oset;
+    nudge_thread_tid = get_thread_id();
+    dynamorio_syscall(SYS_prctl, 5, PR_SET_NAME, (ptr_uint_t)NUDGE_THREAD_NAME,
+                      0, 0, 0);
+    LOG(THREAD, LOG_ASYNCH, 1, "nudge thread "TIDFMT" waiting for nudges\n",
+        nudge_thread_tid);
+    kernel_sigemptyset(&set);
+    kernel_sigaddset(&set, NUDGESIG_SIGNUM);
+    while (true) {
+        /* The nudge signal handler sets nudge_thread_signaled, and a restarted
+         * wait then returns immediately as the value no longer matches.
+         */
+        ksynch_wait(&nudge_thread_signaled, 0, 0);
+        /* Block further nudges while we unlink from the pending list, which
+         * the handler appends to.
+         */
+        sigprocmask_syscall(SIG_BLOCK, &set, &oset, sizeof(set));
+        ksynch_set_value(&nudge_thread_signaled, 0);
+        while (dcontext->nudge_pending != NULL) {
+            pending_nudge_t local = *dcontext->nudge_pending;
+            heap_free(dcontext, dcontext->nudge_pending,
+                      sizeof(local) HEAPACCT(ACCT_OTHER));
+            dcontext->nudge_pending = local.next;
+            sigprocmask_syscall(SIG_SETMASK, &oset, NULL, sizeof(oset));
+            STATS_INC(num_nudges_on_nudge_thread);
+            handle_nudge(dcontext, &local.arg);
+            sigprocmask_syscall(SIG_BLOCK, &set, &oset, sizeof(set));
+        }
+        sigprocmask_syscall(SIG_SETMASK, &oset, NULL, sizeof(oset));
+    }
+}
+
+void
+nudge_thread_init(void)
+{
+    if (!DYNAMO_OPTION(nudge_thread))
+        return;
+    if (!dr_create_client_thread(nudge_thread_run, NULL))
+        SYSLOG_INTERNAL_WARNING("failed to create the nudge thread");
+}
+#endif
+
 /* i#61/PR 211530: nudge on Linux.
  * Determines whether this is a nudge signal, and if so queues up a nudge,
  * or is an app signal.  Returns whether to pass the signal on to the app.
@@ -7061,6 +7130,12 @@ handle_nudge_signal(dcontext_t *dcontext, siginfo_t *siginfo, kernel_ucontext_t
 
     /* No lock is needed since thread-private and this signal is blocked now */
     nudge_add_pending(dcontext, arg);
+#if defined(LINUX) && defined(CLIENT_SIDELINE)
+    if (dcontext->owning_thread == nudge_thread_tid) {
+        /* The nudge thread re-checks this when its futex wait resumes. */
+        ksynch_set_value(&nudge_thread_signaled, 1);
+    }
+#endif
 
     return false; /* do not pass to app */
 }
@@ -727,6 +727,10 @@ mutex_fork_reset(mutex_t *mutex)
 #endif
 
 static uint spinlock_count = 0;     /* initialized in utils_init, but 0 is always safe */
+/* Minimum spin budget of a contended mutex_lock() beyond twice its lock's
+ * spin_estimate, so a lock whose estimate decayed to 0 can still recover.
+ */
+#define MUTEX_SPIN_ESTIMATE_SLACK 10
 DECLARE_FREQPROT_VAR(static uint random_seed, 1234); /* initialized in utils_init */
 DEBUG_DECLARE(static uint initial_random_seed;)
 
@@ -853,17 +857,23 @@ mutex_lock_app(mutex_t *lock _IF_CLIENT_INTERFACE(priv_mcontext_t *mc))
      */
     /* option is external only so that we can set it to 0 on a uniprocessor */
     if (spinlock_count) {
-        uint i;
+        uint i, max_spins;
         /* in the common case we'll just get it */
         if (mutex_trylock(lock))
             return;
 
-        /* otherwise contended, we should spin for some time */
-        i = spinlock_count;
+        /* otherwise contended, we should spin for some time.  Rather than
+         * always spinning the full spinlock_count, which grows with the
+         * number of processors and makes waiters convoy behind a lock that
+         * is held for long stretches, we spin up to about twice what this
+         * lock recently needed.
+         */
+        max_spins = MIN(spinlock_count,
+                        lock->spin_estimate * 2 + MUTEX_SPIN_ESTIMATE_SLACK);
         /* while spinning we are PAUSEing and reading without LOCKing the bus in the
          * spin loop
          */
-        do {
+        for (i = 0; i < max_spins; i++) {
             /* hint we are spinning */
             SPINLOCK_PAUSE();
 
@@ -879,8 +889,11 @@ mutex_lock_app(mutex_t *lock _IF_CLIENT_INTERFACE(priv_mcontext_t *mc))
 #               endif
                 break;
             }
-            i--;
-        } while (i>0);
+        }
+        /* Move the estimate 1/8 of the way toward this round.  The racy update
+         * from concurrent waiters only perturbs a heuristic.
+         */
+        lock->spin_estimate += ((int)i - (int)lock->spin_estimate) / 8;
     }
 
     /* we have strong intentions to grab this lock, increment requests */
@@ -3252,6 +3265,38 @@ dump_global_rstats_to_stderr(void)
     }
 }
 
+/* For -cache_size_breakdown.  The mangling share is what remains of the
+ * meta instructions once the client's own instrumentation is removed.
+ */
+void
+dump_cache_size_breakdown_to_stderr(void)
+{
+    stats_int_t bb_mangling;
+    if (!GLOBAL_STATS_ON())
+        return;
+    bb_mangling = GLOBAL_STAT(cache_bb_meta_bytes) - GLOBAL_STAT(cache_bb_client_bytes);
+    print_file(STDERR, "%s code cache size breakdown (bytes):\n", PRODUCT_NAME);
+    print_file(STDERR, "%24s %18s %18s\n", "", "bb", "trace");
+#define CACHE_BREAKDOWN_ROW(desc, bb_val, trace_val)                           \
+    print_file(STDERR, "%24s %18"SSZFC" %18"SSZFC"\n", desc,                    \
+               (stats_int_t)(bb_val), (stats_int_t)(trace_val))
+    CACHE_BREAKDOWN_ROW("app instrs", GLOBAL_STAT(cache_bb_app_bytes),
+                        GLOBAL_STAT(cache_trace_app_bytes));
+    CACHE_BREAKDOWN_ROW("client instrumentation", GLOBAL_STAT(cache_bb_client_bytes), 0);
+    CACHE_BREAKDOWN_ROW("mangling", bb_mangling, 0);
+    CACHE_BREAKDOWN_ROW("meta instrs (total)", GLOBAL_STAT(cache_bb_meta_bytes),
+                        GLOBAL_STAT(cache_trace_meta_bytes));
+    CACHE_BREAKDOWN_ROW("exit ctis", GLOBAL_STAT(cache_bb_exit_cti_bytes),
+                        GLOBAL_STAT(cache_trace_exit_cti_bytes));
+    CACHE_BREAKDOWN_ROW("inline exit stubs", GLOBAL_STAT(cache_bb_stub_bytes),
+                        GLOBAL_STAT(cache_trace_stub_bytes));
+    CACHE_BREAKDOWN_ROW("separate exit stubs", GLOBAL_STAT(cache_bb_separate_stub_bytes),
+                        GLOBAL_STAT(cache_trace_separate_stub_bytes));
+    CACHE_BREAKDOWN_ROW("prefixes", GLOBAL_STAT(cache_bb_prefix_bytes),
+                        GLOBAL_STAT(cache_trace_prefix_bytes));
+#undef CACHE_BREAKDOWN_ROW
+}
+
 static void
 dump_buffer_as_ascii(file_t logfile, char *buffer, size_t len)
 {
@@ -293,6 +293,11 @@ typedef struct _mutex_t {
 #endif /* MUTEX_CALLSTACK */
     bool deleted;  /* this lock has been deleted at least once */
 #endif /* DEADLOCK_AVOIDANCE */
+    /* Running average of the spins a contended mutex_lock() recently needed,
+     * used to adapt its spin budget.  Left 0 by INIT_LOCK_NO_TYPE, so it must
+     * be last.
+     */
+    uint spin_estimate;
     /* Any new field needs to be initialized with INIT_LOCK_NO_TYPE */
 } mutex_t;
 
@@ -526,6 +531,7 @@ enum {
      * added between the allunits_lock and heap_unit_lock must have special
      * handling in the fcache_low_on_memory() routine.
      */
+    LOCK_RANK(translation_cache_lock), /* > table_rwlock, < allunits_lock */
     LOCK_RANK(allunits_lock),  /* < global_alloc_lock */
     LOCK_RANK(fcache_unit_areas), /* > allunits_lock,
                                      < dynamo_areas, < global_alloc_lock */
@@ -1582,6 +1588,7 @@ enum {LONGJMP_EXCEPTION = 1};
 #define RSTATS_ADD XSTATS_ADD
 #define RSTATS_SUB XSTATS_SUB
 #define RSTATS_ADD_PEAK XSTATS_ADD_PEAK
+#define RSTATS_TRACK_MAX XSTATS_TRACK_MAX
 
 #if defined(DEBUG) && defined(INTERNAL)
 #   define DODEBUGINT DODEBUG
@@ -2024,6 +2031,7 @@ print_symbolic_address(app_pc tag, char *buf, int max_chars, bool exact_only);
 #endif /* DEBUG */
 
 void dump_global_rstats_to_stderr(void);
+void dump_cache_size_breakdown_to_stderr(void);
 
 bool
 under_internal_exception(void);
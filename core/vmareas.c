@@ -213,6 +213,9 @@ typedef struct vm_area_t {
     } custom;
 } vm_area_t;
 
+/* number of shared areas cached per thread in thread_data_t */
+#define SHARED_AREA_CACHE_SIZE 4
+
 /* for each thread we record all executable areas, to make it faster
  * to decide whether we need to flush any fragments on an munmap
  */
@@ -220,12 +223,17 @@ typedef struct thread_data_t {
     vm_area_vector_t areas;
     /* cached pointer to last area encountered by thread */
     vm_area_t *last_area;
-    /* FIXME: for locality would be nice to have per-thread last_shared_area
-     * (cannot put shared in private last_area, that would void its usefulness
-     *  since couldn't tell if area really in shared list or not)
-     * but then have to update all other threads whenever change shared
-     * vmarea vector, so for now we use a global last_area
-     */
+    /* For locality, each thread also caches the shared_data areas it recently
+     * used (cannot put shared in private last_area, that would void its
+     * usefulness since couldn't tell if area really in shared list or not).
+     * Rather than update all other threads whenever the shared vmarea vector
+     * changes, entries are only valid while shared_data->areas.generation
+     * equals shared_area_cache_generation.  Used only in thread-private
+     * structures, and only while holding the shared_data->areas lock.
+     */
+    vm_area_t *shared_area_cache[SHARED_AREA_CACHE_SIZE];
+    uint shared_area_cache_generation;
+    uint shared_area_cache_next;
     /* cached pointer of a PC in the last page decoded by thread -- set only
      * in thread-private structures, not in shared structures like shared_data */
     app_pc last_decode_area_page_pc;
@@ -845,8 +853,11 @@ vm_area_vector_check_size(vm_area_vector_t *v)
                                                   HEAPACCT(ACCT_VMAREAS));
         }
         else {
-            /* FIXME: case 4471 we should be doubling size here */
-            int new_size = (INTERNAL_OPTION(vmarea_increment_size) + v->length);
+            /* case 4471: grow geometrically so that a process with very many
+             * mappings does not pay a realloc+copy every few insertions
+             */
+            int new_size = v->length + MAX((int)INTERNAL_OPTION(vmarea_increment_size),
+                                           v->length);
             STATS_INC(num_vmareas_resized);
             v->buf = global_heap_realloc(v->buf, v->size, new_size,
                                          sizeof(struct vm_area_t)
@@ -857,6 +868,26 @@ vm_area_vector_check_size(vm_area_vector_t *v)
     }
 }
 
+/* Returns the index of the first area in v whose end is >= start, or v->length
+ * if there is none.  Since areas are sorted and never overlap, every area
+ * before that index lies entirely below start and is not adjacent to it, so
+ * add_vm_area() and remove_vm_area() can begin their walks there.
+ */
+static int
+vm_area_lower_bound(vm_area_vector_t *v, app_pc start)
+{
+    int min = 0;
+    int max = v->length;
+    while (min < max) {
+        int i = (min + max) / 2;
+        if (v->buf[i].end < start)
+            min = i + 1;
+        else
+            max = i;
+    }
+    return min;
+}
+
 static void
 vm_area_merge_fraglists(vm_area_t *dst, vm_area_t *src)
 {
@@ -908,7 +939,7 @@ static void
 add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
             uint vm_flags, uint frag_flags, void *data _IF_DEBUG(const char *comment))
 {
-    int i, j, diff;
+    int i, diff;
     /* if we have overlap, we extend an existing area -- else we add a new area */
     int overlap_start = -1, overlap_end = -1;
     DEBUG_DECLARE(uint flagignore;)
@@ -917,12 +948,13 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
     ASSERT(start < end);
 
     ASSERT_VMAREA_VECTOR_PROTECTED(v, WRITE);
+    v->generation++;
     LOG(GLOBAL, LOG_VMAREAS, 4, "in add_vm_area%s "PFX" "PFX" %s\n",
         (v == executable_areas ? " executable_areas" :
          (v == IF_LINUX_ELSE(all_memory_areas, NULL) ? " all_memory_areas" :
           (v == dynamo_areas ? " dynamo_areas" : ""))), start, end, comment);
     /* N.B.: new area could span multiple existing areas! */
-    for (i = 0; i < v->length; i++) {
+    for (i = vm_area_lower_bound(v, start); i < v->length; i++) {
         /* look for overlap, or adjacency of same type (including all flags, and never
          * merge adjacent if keeping write counts)
          */
@@ -1149,8 +1181,7 @@ add_vm_area(vm_area_vector_t *v, app_pc start, app_pc end,
         LOG(GLOBAL, LOG_VMAREAS, 3, "=> adding "PFX"-"PFX"\n", start, end);
         vm_area_vector_check_size(v);
         /* shift subsequent entries */
-        for (j = v->length; j > i; j--)
-            v->buf[j] = v->buf[j-1];
+        memmove(&v->buf[i+1], &v->buf[i], (v->length - i) * sizeof(vm_area_t));
         v->buf[i] = new_area;
         /* assumption: no overlaps between areas in list! */
 #ifdef DEBUG
@@ -1307,9 +1338,10 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
     bool official_coarse_vector = (v == executable_areas);
 
     ASSERT_VMAREA_VECTOR_PROTECTED(v, WRITE);
+    v->generation++;
     LOG(GLOBAL, LOG_VMAREAS, 4, "in remove_vm_area "PFX" "PFX"\n", start, end);
     /* N.B.: removed area could span multiple areas! */
-    for (i = 0; i < v->length; i++) {
+    for (i = vm_area_lower_bound(v, start); i < v->length; i++) {
         /* look for overlap */
         if (start < v->buf[i].end && end > v->buf[i].start) {
             if (overlap_start == -1)
@@ -1428,8 +1460,8 @@ remove_vm_area(vm_area_vector_t *v, app_pc start, app_pc end, bool restore_prot)
                    v->buf[i].custom.frags == NULL);
         }
         diff = overlap_end - overlap_start;
-        for (i = overlap_start; i < v->length-diff; i++)
-            v->buf[i] = v->buf[i+diff];
+        memmove(&v->buf[overlap_start], &v->buf[overlap_end],
+                (v->length - overlap_end) * sizeof(vm_area_t));
 #ifdef DEBUG
         memset(v->buf + v->length - diff, 0, diff * sizeof(vm_area_t));
 #endif
@@ -1558,9 +1590,12 @@ vm_area_overlap(vm_area_vector_t *v, app_pc start, app_pc end)
 void
 vm_areas_reset_init(void)
 {
+    /* Keep thread caches of shared areas from matching across a reset. */
+    uint generation = shared_data->areas.generation;
     memset(shared_data, 0, sizeof(*shared_data));
     VMVECTOR_INITIALIZE_VECTOR(&shared_data->areas,
                                VECTOR_SHARED | VECTOR_FRAGMENT_LIST, shared_vm_areas);
+    shared_data->areas.generation = generation + 1;
 }
 
 void
@@ -1608,6 +1643,8 @@ vm_areas_init()
 
     shared_data = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, thread_data_t, ACCT_VMAREAS,
                                   PROTECTED);
+    /* vm_areas_reset_init() preserves the generation */
+    memset(shared_data, 0, sizeof(*shared_data));
 
     todelete = HEAP_TYPE_ALLOC(GLOBAL_DCONTEXT, deletion_lists_t, ACCT_VMAREAS,
                                PROTECTED);
@@ -2129,6 +2166,7 @@ vmvector_reset_vector(dcontext_t *dcontext, vm_area_vector_t *v)
         v->buf = NULL;
     } else
         ASSERT(v->size == 0 && v->length == 0);
+    v->generation++;
 }
 
 static void
@@ -7303,6 +7341,49 @@ allow_xfer_for_frag_flags(dcontext_t *dcontext, app_pc pc,
     return allow;
 }
 
+/* Returns the area containing pc among those the calling thread recently found in
+ * shared_data, or NULL.  The caller must hold the shared_data->areas lock.
+ */
+static vm_area_t *
+shared_area_cache_lookup(dcontext_t *dcontext, app_pc pc)
+{
+    thread_data_t *data;
+    uint i;
+    if (dcontext == GLOBAL_DCONTEXT || dcontext->vm_areas_field == NULL)
+        return NULL;
+    ASSERT_VMAREA_VECTOR_PROTECTED(&shared_data->areas, READWRITE);
+    data = (thread_data_t *) dcontext->vm_areas_field;
+    if (data->shared_area_cache_generation != shared_data->areas.generation)
+        return NULL;
+    for (i = 0; i < SHARED_AREA_CACHE_SIZE; i++) {
+        vm_area_t *area = data->shared_area_cache[i];
+        if (area != NULL && area->start <= pc && pc < area->end)
+            return area;
+    }
+    return NULL;
+}
+
+/* Records area, which must be in shared_data, in the calling thread's cache.
+ * The caller must hold the shared_data->areas lock.
+ */
+static void
+shared_area_cache_add(dcontext_t *dcontext, vm_area_t *area)
+{
+    thread_data_t *data;
+    if (dcontext == GLOBAL_DCONTEXT || dcontext->vm_areas_field == NULL)
+        return;
+    ASSERT_VMAREA_VECTOR_PROTECTED(&shared_data->areas, READWRITE);
+    data = (thread_data_t *) dcontext->vm_areas_field;
+    if (data->shared_area_cache_generation != shared_data->areas.generation) {
+        memset(data->shared_area_cache, 0, sizeof(data->shared_area_cache));
+        data->shared_area_cache_generation = shared_data->areas.generation;
+        data->shared_area_cache_next = 0;
+    }
+    data->shared_area_cache[data->shared_area_cache_next] = area;
+    data->shared_area_cache_next =
+        (data->shared_area_cache_next + 1) % SHARED_AREA_CACHE_SIZE;
+}
+
 /* check origins of code for several purposes:
  * 1) we need list of areas where this thread's fragments come
  *    from, for faster flushing on munmaps
@@ -7397,22 +7478,32 @@ check_thread_vm_area(dcontext_t *dcontext, app_pc pc, app_pc tag, void **vmlist,
     /* no lock on data->areas needed if thread-local,
      * if shared we grabbed either read or write lock above
      */
-    /* check cached last area first to avoid lookup cost */
-    if (data->last_area != NULL)
-        in_last = (pc < data->last_area->end && data->last_area->start <= pc);
+    /* check cached areas first to avoid lookup cost */
+    if (data == shared_data)
+        local_area = shared_area_cache_lookup(dcontext, pc);
+    if (local_area == NULL && data->last_area != NULL &&
+        pc < data->last_area->end && data->last_area->start <= pc) {
+        in_last = true;
+        local_area = data->last_area;
+    }
 
     DOSTATS({
         STATS_INC(checked_addresses);
         if (in_last)
             STATS_INC(looked_up_in_last_area);
+        else if (local_area != NULL)
+            STATS_INC(looked_up_in_shared_area_cache);
     });
 
-    if (in_last) {
-        local_area = data->last_area;
+    if (local_area != NULL) {
         area = local_area;
+        if (in_last && data == shared_data)
+            shared_area_cache_add(dcontext, local_area);
     } else if (lookup_addr(&data->areas, pc, &local_area)) {
         /* ok to hold onto pointer since it's this thread's */
         area = local_area;
+        if (data == shared_data)
+            shared_area_cache_add(dcontext, local_area);
     } else {
         bool is_allocated_mem;
         /* not in this thread's current executable list
@@ -8170,6 +8261,8 @@ check_thread_vm_area(dcontext_t *dcontext, app_pc pc, app_pc tag, void **vmlist,
 
     ASSERT(local_area != NULL);
     data->last_area = local_area;
+    if (data == shared_data)
+        shared_area_cache_add(dcontext, local_area);
 
     /* for adding new bbs to frag lists */
     if (tag != NULL) {
@@ -111,6 +111,10 @@ struct vm_area_vector_t {
      * If non-NULL, the free_payload_func will NOT be called.
      */
     void *(*merge_payload_func)(void *dst, void *src);
+    /* Incremented on every change to the areas, so that pointers into buf
+     * cached outside of the lock can be validated.
+     */
+    uint generation;
 }; /* typedef-ed in globals.h */
 
 /* vm_area_vectors should NOT be declared statically if their locks need to be
@@ -4824,6 +4824,15 @@ os_heap_decommit(void *p, size_t size, heap_error_code_t *error_code)
     ASSERT(NT_SUCCESS(*error_code));
 }
 
+bool
+os_heap_request_huge_pages(void *p, size_t size)
+{
+    /* Large pages on Windows must be committed up front with
+     * SeLockMemoryPrivilege, which does not fit our reserve-then-commit model.
+     */
+    return false;
+}
+
 bool
 os_heap_systemwide_overcommit(heap_error_code_t last_error_code)
 {
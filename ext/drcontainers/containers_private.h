@@ -45,5 +45,6 @@
 #endif
 
 #define MAX(x,y) ((x) >= (y) ? (x) : (y))
+#define MIN(x,y) ((x) <= (y) ? (x) : (y))
 
 #endif /* _CONTAINERS_PRIVATE_H_ */
@@ -156,3 +156,220 @@ drvector_unlock(drvector_t *vec)
 {
     dr_mutex_unlock(vec->lock);
 }
+
+/***************************************************************************
+ * SEGMENTED DRVECTOR
+ *
+ * Segment k holds 2^(first_bits + k) entries, so index idx lives in the
+ * segment given by the top bit of idx + 2^first_bits.  An append reserves
+ * its index with an atomic add and then stores into a segment that never
+ * moves, so appends only contend on the counter.  Segments are zeroed
+ * before they are published, which is how readers tell an index whose
+ * append is still in progress from a completed one.
+ */
+
+/* Stay clear of the int overflow of the reservation counter */
+#define SEGMENTED_MAX_ENTRIES (1U << 30)
+
+#ifdef X86
+/* x86 does not reorder stores, so a reader that sees an entry also sees
+ * whatever was written before it was appended.
+ * XXX: DR exports no memory barrier for extensions, so on weaker memory
+ * models appends and reads take the lock.
+ */
+# define SEGMENTED_LOCK_FREE 1
+#endif
+
+/* Used purely as a barrier when publishing a new segment */
+static volatile int segment_publish_version;
+
+static uint
+segment_size(drvector_segmented_t *vec, uint seg)
+{
+    return 1U << (vec->first_bits + seg);
+}
+
+static void
+segment_locate(drvector_segmented_t *vec, uint idx, uint *seg /*OUT*/,
+               uint *offs /*OUT*/)
+{
+    uint pos = idx + (1U << vec->first_bits);
+    uint top = 0;
+    /* Find the top bit of pos by binary search */
+    if (pos >= 1U << 16) { top += 16; pos >>= 16; }
+    if (pos >= 1U << 8) { top += 8; pos >>= 8; }
+    if (pos >= 1U << 4) { top += 4; pos >>= 4; }
+    if (pos >= 1U << 2) { top += 2; pos >>= 2; }
+    if (pos >= 1U << 1) { top += 1; }
+    *seg = top - vec->first_bits;
+    *offs = idx + (1U << vec->first_bits) - (1U << top);
+}
+
+/* Caller must hold the lock. */
+static void
+segment_allocate(drvector_segmented_t *vec, uint seg)
+{
+    void **segment;
+    if (vec->segments[seg] != NULL)
+        return; /* another append got here first */
+    segment = dr_global_alloc(segment_size(vec, seg) * sizeof(void*));
+    memset(segment, 0, segment_size(vec, seg) * sizeof(void*));
+    /* The zeroing must be complete before the segment is visible: the
+     * atomic add is a full barrier.
+     */
+    dr_atomic_add32_return_sum(&segment_publish_version, 1);
+    vec->segments[seg] = segment;
+}
+
+bool
+drvector_segmented_init(drvector_segmented_t *vec, uint first_segment_bits,
+                        void (*free_data_func)(void*))
+{
+    uint i;
+    if (vec == NULL || first_segment_bits >= 30)
+        return false;
+    vec->reserved = 0;
+    vec->first_bits = first_segment_bits;
+    for (i = 0; i < DRVECTOR_SEGMENTS_MAX; i++)
+        vec->segments[i] = NULL;
+    vec->lock = dr_mutex_create();
+    vec->free_data_func = free_data_func;
+    return true;
+}
+
+bool
+drvector_segmented_append(drvector_segmented_t *vec, void *data, uint *idx /*OUT*/)
+{
+    int sum;
+    uint seg, offs;
+    bool res = false;
+    if (vec == NULL || data == NULL)
+        return false;
+#ifndef SEGMENTED_LOCK_FREE
+    dr_mutex_lock(vec->lock);
+#endif
+    sum = dr_atomic_add32_return_sum(&vec->reserved, 1);
+    if (sum > 0 && (uint)sum <= SEGMENTED_MAX_ENTRIES) {
+        segment_locate(vec, (uint)sum - 1, &seg, &offs);
+        if (vec->segments[seg] == NULL) {
+#ifdef SEGMENTED_LOCK_FREE
+            dr_mutex_lock(vec->lock);
+            segment_allocate(vec, seg);
+            dr_mutex_unlock(vec->lock);
+#else
+            segment_allocate(vec, seg);
+#endif
+        }
+        vec->segments[seg][offs] = data;
+        if (idx != NULL)
+            *idx = (uint)sum - 1;
+        res = true;
+    }
+#ifndef SEGMENTED_LOCK_FREE
+    dr_mutex_unlock(vec->lock);
+#endif
+    return res;
+}
+
+uint
+drvector_segmented_size(drvector_segmented_t *vec)
+{
+    uint size;
+    if (vec == NULL)
+        return 0;
+    size = (uint)vec->reserved;
+    return size > SEGMENTED_MAX_ENTRIES ? SEGMENTED_MAX_ENTRIES : size;
+}
+
+/* Caller must hold the lock if !SEGMENTED_LOCK_FREE. */
+static void *
+segmented_get_entry(drvector_segmented_t *vec, uint idx)
+{
+    uint seg, offs;
+    void *volatile *segment;
+    segment_locate(vec, idx, &seg, &offs);
+    segment = vec->segments[seg];
+    if (segment == NULL)
+        return NULL;
+    return segment[offs];
+}
+
+void *
+drvector_segmented_get_entry(drvector_segmented_t *vec, uint idx)
+{
+    void *res = NULL;
+    if (vec == NULL)
+        return NULL;
+#ifndef SEGMENTED_LOCK_FREE
+    dr_mutex_lock(vec->lock);
+#endif
+    if (idx < drvector_segmented_size(vec))
+        res = segmented_get_entry(vec, idx);
+#ifndef SEGMENTED_LOCK_FREE
+    dr_mutex_unlock(vec->lock);
+#endif
+    return res;
+}
+
+void
+drvector_segmented_iterate(drvector_segmented_t *vec,
+                           bool (*iter_func)(uint idx, void *data, void *user_data),
+                           void *user_data)
+{
+    uint size, idx, seg, offs;
+    if (vec == NULL || iter_func == NULL)
+        return;
+    size = drvector_segmented_size(vec);
+    /* Walk a segment at a time to avoid locating each index */
+    for (idx = 0, seg = 0; idx < size; seg++) {
+        uint end = idx + segment_size(vec, seg);
+        void *volatile *segment;
+#ifndef SEGMENTED_LOCK_FREE
+        dr_mutex_lock(vec->lock);
+#endif
+        segment = vec->segments[seg];
+#ifndef SEGMENTED_LOCK_FREE
+        dr_mutex_unlock(vec->lock);
+#endif
+        if (end > size)
+            end = size;
+        for (offs = 0; idx < end; idx++, offs++) {
+            void *data;
+            if (segment == NULL)
+                continue; /* its first append is still in progress */
+#ifndef SEGMENTED_LOCK_FREE
+            dr_mutex_lock(vec->lock);
+#endif
+            data = segment[offs];
+#ifndef SEGMENTED_LOCK_FREE
+            dr_mutex_unlock(vec->lock);
+#endif
+            if (data != NULL && !iter_func(idx, data, user_data))
+                return;
+        }
+    }
+}
+
+bool
+drvector_segmented_delete(drvector_segmented_t *vec)
+{
+    uint seg, offs;
+    if (vec == NULL)
+        return false;
+    for (seg = 0; seg < DRVECTOR_SEGMENTS_MAX; seg++) {
+        void **segment = (void **) vec->segments[seg];
+        if (segment == NULL)
+            continue;
+        if (vec->free_data_func != NULL) {
+            for (offs = 0; offs < segment_size(vec, seg); offs++) {
+                if (segment[offs] != NULL)
+                    (vec->free_data_func)(segment[offs]);
+            }
+        }
+        dr_global_free(segment, segment_size(vec, seg) * sizeof(void*));
+        vec->segments[seg] = NULL;
+    }
+    vec->reserved = 0;
+    dr_mutex_destroy(vec->lock);
+    return true;
+}
@@ -120,6 +120,88 @@ drvector_lock(drvector_t *vec);
 void
 drvector_unlock(drvector_t *vec);
 
+/***************************************************************************
+ * SEGMENTED DRVECTOR
+ */
+
+/** The maximum number of segments in a drvector_segmented_t. */
+#define DRVECTOR_SEGMENTS_MAX 32
+
+/**
+ * The storage for a segmented vector.  Entries live in segments whose sizes
+ * double, starting from the size given to drvector_segmented_init().  A
+ * segment never moves once allocated, so growth never copies entries and
+ * appends can proceed concurrently with each other and with readers.
+ * Only the allocation of a new segment takes the lock.
+ */
+typedef struct _drvector_segmented_t {
+    /** The number of indices handed out by drvector_segmented_append(). */
+    volatile int reserved;
+    uint first_bits; /**< log2 of the first segment's size. */
+    /** The segments, allocated on first use. */
+    void *volatile *volatile segments[DRVECTOR_SEGMENTS_MAX];
+    void *lock; /**< The lock used for segment allocation. */
+    void (*free_data_func)(void*);  /**< The routine called when freeing each entry. */
+} drvector_segmented_t;
+
+/**
+ * Initializes a segmented drvector.  Unlike a drvector_t, all operations
+ * are always safe to call concurrently except drvector_segmented_delete().
+ *
+ * @param[out] vec     The vector to be initialized.
+ * @param[in]  first_segment_bits  log2 of the number of entries in the first
+ *   segment.  Each subsequent segment is twice as large as the previous one.
+ * @param[in]  free_data_func   A callback for freeing each data item.
+ *   Leave it NULL if no callback is needed.
+ */
+bool
+drvector_segmented_init(drvector_segmented_t *vec, uint first_segment_bits,
+                        void (*free_data_func)(void*));
+
+/**
+ * Adds \p data to the end of the vector without acquiring the lock, unless
+ * a new segment is needed.  On architectures other than x86 the lock is
+ * always acquired, as DR does not export a memory barrier to order the
+ * store with respect to concurrent readers.  Returns false if \p data is
+ * NULL, as NULL marks entries whose append has not completed, or if the
+ * vector is full.  If \p idx is non-NULL it receives the new entry's index.
+ */
+bool
+drvector_segmented_append(drvector_segmented_t *vec, void *data, uint *idx /*OUT*/);
+
+/**
+ * Returns the entry at index \p idx, or NULL if \p idx is beyond the end of
+ * the vector or its append is still in progress.
+ */
+void *
+drvector_segmented_get_entry(drvector_segmented_t *vec, uint idx);
+
+/**
+ * Returns the number of indices handed out so far.  Entries below this
+ * index whose append is still in progress read as NULL.
+ */
+uint
+drvector_segmented_size(drvector_segmented_t *vec);
+
+/**
+ * Calls \p iter_func, in index order, for each entry whose index was handed
+ * out before this call, stopping early if \p iter_func returns false.
+ * Concurrent appends are not blocked: entries whose append is still in
+ * progress are skipped, and entries appended after the call began are not
+ * visited.
+ */
+void
+drvector_segmented_iterate(drvector_segmented_t *vec,
+                           bool (*iter_func)(uint idx, void *data, void *user_data),
+                           void *user_data);
+
+/**
+ * Destroys all storage for the vector.  If free_data_func was specified
+ * calls it for each entry.  No other operation may be in progress.
+ */
+bool
+drvector_segmented_delete(drvector_segmented_t *vec);
+
 /*@}*/ /* end doxygen group */
 
 #ifdef __cplusplus
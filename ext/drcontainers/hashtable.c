@@ -690,3 +690,525 @@ hashtable_resurrect(void *drcontext, byte **map INOUT, hashtable_t *table,
     }
     return true;
 }
+
+/***************************************************************************
+ * OPEN-ADDRESSING HASHTABLE
+ *
+ * Each array is a power-of-two number of cache-line-sized buckets that are
+ * probed linearly.  A slot's payload is NULL until the slot is first used,
+ * after which its key never changes for the life of the array: a removal
+ * replaces the payload with OAHASH_REMOVED and a later add of the same key
+ * revives the slot.  Removed slots are only reclaimed when the array is
+ * replaced.  This is what lets lookups skip the lock: the key is written
+ * before the payload, so a reader that sees a non-NULL payload also sees
+ * the slot's final key.
+ *
+ * A resize installs a new array as cur and keeps the previous one as old.
+ * Each later update copies OAHASH_MIGRATE_BUCKETS buckets of old into cur.
+ * Writers never modify old: an update to a key first copies its entry to
+ * cur, so an entry found in cur, live or removed, is authoritative and
+ * lookups only consult old on a miss in cur.  Writers set old before
+ * replacing cur and lookups read cur before old, so a lookup sees either
+ * an array that was complete when it was replaced, or the current array
+ * plus the old one it is being filled from.
+ */
+
+#define OAHASH_MIGRATE_BUCKETS 8
+#define OAHASH_MAX_THRESHOLD 90
+#define OAHASH_CACHE_LINE 64
+#ifdef X64
+# define OAHASH_BUCKET_SLOT_BITS 2
+#else
+# define OAHASH_BUCKET_SLOT_BITS 3
+#endif
+#define OAHASH_NUM_BUCKETS(arr) HASHTABLE_SIZE((arr)->bucket_bits)
+#define OAHASH_CAPACITY(arr) ((size_t)OAHASH_NUM_BUCKETS(arr) * OAHASH_BUCKET_SLOTS)
+
+/* Marks a removed entry: no real payload can share its address */
+static char oahash_removed_marker;
+#define OAHASH_REMOVED ((void *)&oahash_removed_marker)
+
+/* Used purely as a barrier when publishing a new array */
+static volatile int oahash_publish_version;
+
+#ifdef X86
+/* x86 does not reorder stores, so lookups need no lock (see above).
+ * XXX: DR exports no memory barrier for extensions, so on weaker memory
+ * models lookups on a synchronized table take the lock.
+ */
+# define OAHASH_LOCK_FREE_READS 1
+#endif
+
+static oahash_array_t *
+oahash_array_create(uint bucket_bits)
+{
+    oahash_array_t *arr = (oahash_array_t *) hash_alloc(sizeof(*arr));
+    size_t sz = (size_t)HASHTABLE_SIZE(bucket_bits) * sizeof(oahash_bucket_t);
+    arr->alloc_size = sz + OAHASH_CACHE_LINE - 1;
+    arr->alloc = hash_alloc(arr->alloc_size);
+    arr->buckets = (oahash_bucket_t *) ALIGN_FORWARD(arr->alloc, OAHASH_CACHE_LINE);
+    memset(arr->buckets, 0, sz);
+    arr->bucket_bits = bucket_bits;
+    arr->used = 0;
+    arr->retired_next = NULL;
+    return arr;
+}
+
+static void
+oahash_array_free(oahash_array_t *arr)
+{
+    hash_free(arr->alloc, arr->alloc_size);
+    hash_free(arr, sizeof(*arr));
+}
+
+/* Unlike hash_key(), returns the full hash: oahash_bucket_index() picks the
+ * bits to use.
+ */
+static uint
+oahash_key(oahashtable_t *table, void *key)
+{
+    uint hash = 0;
+    if (table->hash_key_func != NULL) {
+        hash = table->hash_key_func(key);
+    } else if (table->hashtype == HASH_STRING || table->hashtype == HASH_STRING_NOCASE) {
+        const char *s = (const char *) key;
+        char c;
+        uint i;
+        for (i = 0; s[i] != '\0'; i++) {
+            c = s[i];
+            if (table->hashtype == HASH_STRING_NOCASE)
+                c = (char) tolower(c);
+            hash = hash * 31 + (byte) c;
+        }
+    } else {
+        /* HASH_INTPTR, or fallback for HASH_CUSTOM in release build */
+        ASSERT(table->hashtype == HASH_INTPTR,
+               "hashtable.c oahash_key internal error: invalid hash type");
+        hash = (uint)(ptr_uint_t) key;
+#ifdef X64
+        hash ^= (uint)((ptr_uint_t) key >> 32);
+#endif
+    }
+    return hash;
+}
+
+/* Multiplicative hashing takes the top bits, which spreads aligned pointers
+ * (whose low bits are all zero) across the buckets.
+ */
+static uint
+oahash_bucket_index(oahash_array_t *arr, uint hash)
+{
+    return (hash * 2654435769U) >> (32 - arr->bucket_bits);
+}
+
+static bool
+oahash_keys_equal(oahashtable_t *table, void *key1, void *key2)
+{
+    if (table->cmp_key_func != NULL)
+        return table->cmp_key_func(key1, key2);
+    else if (table->hashtype == HASH_STRING)
+        return strcmp((const char *) key1, (const char *) key2) == 0;
+    else if (table->hashtype == HASH_STRING_NOCASE)
+        return stri_eq((const char *) key1, (const char *) key2);
+    else {
+        /* HASH_INTPTR, or fallback for HASH_CUSTOM in release build */
+        ASSERT(table->hashtype == HASH_INTPTR,
+               "hashtable.c oahash_keys_equal internal error: invalid hash type");
+        return key1 == key2;
+    }
+}
+
+/* Returns the slot holding key in arr, or NULL.  If empty is non-NULL it is
+ * set to the first never-used slot on key's probe sequence, which is where
+ * key belongs if it is absent, or NULL if arr is full.
+ */
+static oahash_slot_t *
+oahash_probe(oahashtable_t *table, oahash_array_t *arr, void *key, uint hash,
+             oahash_slot_t **empty)
+{
+    uint mask = OAHASH_NUM_BUCKETS(arr) - 1;
+    uint b = oahash_bucket_index(arr, hash);
+    uint probes, i;
+    if (empty != NULL)
+        *empty = NULL;
+    for (probes = 0; probes <= mask; probes++) {
+        oahash_bucket_t *bucket = &arr->buckets[b];
+        for (i = 0; i < OAHASH_BUCKET_SLOTS; i++) {
+            oahash_slot_t *slot = &bucket->slot[i];
+            /* The payload must be read before the key */
+            if (slot->payload == NULL) {
+                if (empty != NULL)
+                    *empty = slot;
+                return NULL;
+            }
+            if (oahash_keys_equal(table, slot->key, key))
+                return slot;
+        }
+        b = (b + 1) & mask;
+    }
+    return NULL;
+}
+
+/* Caller must hold lock */
+static void
+oahash_fill_slot(oahash_array_t *arr, oahash_slot_t *slot, void *key, void *payload)
+{
+    /* The key must be written before the payload */
+    slot->key = key;
+    slot->payload = payload;
+    arr->used++;
+}
+
+/* Caller must hold lock.  Copies up to num_buckets buckets of table->old
+ * into table->cur, retiring old once all of it has been copied.
+ */
+static void
+oahash_migrate(oahashtable_t *table, uint num_buckets)
+{
+    oahash_array_t *old = table->old;
+    uint i;
+    if (old == NULL)
+        return;
+    for (; num_buckets > 0 && table->migrate_next < OAHASH_NUM_BUCKETS(old);
+         num_buckets--, table->migrate_next++) {
+        oahash_bucket_t *bucket = &old->buckets[table->migrate_next];
+        for (i = 0; i < OAHASH_BUCKET_SLOTS; i++) {
+            void *key = bucket->slot[i].key;
+            void *payload = bucket->slot[i].payload;
+            oahash_slot_t *empty;
+            if (payload == NULL || payload == OAHASH_REMOVED)
+                continue;
+            /* An update may have already copied this entry */
+            if (oahash_probe(table, table->cur, key, oahash_key(table, key),
+                             &empty) == NULL) {
+                ASSERT(empty != NULL, "oahashtable migration overflow");
+                oahash_fill_slot(table->cur, empty, key, payload);
+            }
+        }
+    }
+    if (table->migrate_next >= OAHASH_NUM_BUCKETS(old)) {
+        table->old = NULL;
+        /* Lookups may still be reading it */
+        old->retired_next = table->retired;
+        table->retired = old;
+    }
+}
+
+/* Caller must hold lock.  Replaces cur with a new array if adding one more
+ * entry would exceed the threshold.  The new array is twice the size unless
+ * removed entries account for most of the load, in which case replacing the
+ * array just reclaims their slots.
+ */
+static bool
+oahash_check_for_resize(oahashtable_t *table)
+{
+    oahash_array_t *cur = table->cur;
+    size_t capacity = OAHASH_CAPACITY(cur);
+    uint threshold = MIN(table->config.resize_threshold, OAHASH_MAX_THRESHOLD);
+    uint bucket_bits = cur->bucket_bits;
+    oahash_array_t *arr;
+    /* avoid fp ops.  should check for overflow. */
+    if ((size_t)(cur->used + 1) * 100 <= threshold * capacity)
+        return false;
+    if ((size_t)table->entries * 2 * 100 > threshold * capacity) {
+        if (!table->config.resizable)
+            return false;
+        bucket_bits++;
+    }
+    /* Only one migration at a time */
+    oahash_migrate(table, ~0U);
+    arr = oahash_array_create(bucket_bits);
+    table->old = cur;
+    table->migrate_next = 0;
+    /* The new array must be initialized before it is visible: the atomic add
+     * is a full barrier.
+     */
+    dr_atomic_add32_return_sum(&oahash_publish_version, 1);
+    table->cur = arr;
+    return true;
+}
+
+/* Caller must hold lock.  Returns key's slot in table->cur, first copying
+ * its entry over from table->old if it has not been migrated yet.  If key
+ * has no entry in either, returns NULL and sets *empty to the slot in cur
+ * where it belongs.
+ */
+static oahash_slot_t *
+oahash_find_for_update(oahashtable_t *table, void *key, uint hash,
+                       oahash_slot_t **empty)
+{
+    oahash_slot_t *slot = oahash_probe(table, table->cur, key, hash, empty);
+    if (slot == NULL && table->old != NULL) {
+        oahash_slot_t *old_slot = oahash_probe(table, table->old, key, hash, NULL);
+        if (old_slot != NULL && old_slot->payload != OAHASH_REMOVED) {
+            ASSERT(*empty != NULL, "oahashtable migration overflow");
+            slot = *empty;
+            oahash_fill_slot(table->cur, slot, old_slot->key, old_slot->payload);
+        }
+    }
+    return slot;
+}
+
+void
+oahashtable_init_ex(oahashtable_t *table, uint num_bits, hash_type_t hashtype,
+                    bool synch, void (*free_payload_func)(void*),
+                    uint (*hash_key_func)(void*), bool (*cmp_key_func)(void*, void*))
+{
+    uint bucket_bits = num_bits > OAHASH_BUCKET_SLOT_BITS + 1 ?
+        num_bits - OAHASH_BUCKET_SLOT_BITS : 1;
+    table->cur = oahash_array_create(bucket_bits);
+    table->old = NULL;
+    table->migrate_next = 0;
+    table->retired = NULL;
+    table->hashtype = hashtype;
+    table->lock = dr_mutex_create();
+    table->synch = synch;
+    table->free_payload_func = free_payload_func;
+    table->hash_key_func = hash_key_func;
+    table->cmp_key_func = cmp_key_func;
+    ASSERT(table->hashtype != HASH_CUSTOM ||
+           (table->hash_key_func != NULL && table->cmp_key_func != NULL),
+           "oahashtable_init_ex missing cmp/hash key func");
+    table->entries = 0;
+    table->config.size = sizeof(table->config);
+    table->config.resizable = true;
+    table->config.resize_threshold = 75;
+}
+
+void
+oahashtable_configure(oahashtable_t *table, hashtable_config_t *config)
+{
+    ASSERT(table != NULL && config != NULL, "invalid params");
+    /* Ignoring size of field: shouldn't be in between */
+    if (config->size > offsetof(hashtable_config_t, resizable))
+        table->config.resizable = config->resizable;
+    if (config->size > offsetof(hashtable_config_t, resize_threshold))
+        table->config.resize_threshold = config->resize_threshold;
+}
+
+void
+oahashtable_lock(oahashtable_t *table)
+{
+    dr_mutex_lock(table->lock);
+}
+
+void
+oahashtable_unlock(oahashtable_t *table)
+{
+    dr_mutex_unlock(table->lock);
+}
+
+void *
+oahashtable_lookup(oahashtable_t *table, void *key)
+{
+    void *res = NULL;
+    uint hash = oahash_key(table, key);
+    oahash_array_t *cur, *old;
+    oahash_slot_t *slot;
+#ifndef OAHASH_LOCK_FREE_READS
+    if (table->synch)
+        dr_mutex_lock(table->lock);
+#endif
+    /* cur must be read before old */
+    cur = table->cur;
+    old = table->old;
+    slot = oahash_probe(table, cur, key, hash, NULL);
+    if (slot == NULL && old != NULL && old != cur)
+        slot = oahash_probe(table, old, key, hash, NULL);
+    if (slot != NULL) {
+        res = slot->payload;
+        if (res == OAHASH_REMOVED)
+            res = NULL;
+    }
+#ifndef OAHASH_LOCK_FREE_READS
+    if (table->synch)
+        dr_mutex_unlock(table->lock);
+#endif
+    return res;
+}
+
+bool
+oahashtable_add(oahashtable_t *table, void *key, void *payload)
+{
+    uint hash = oahash_key(table, key);
+    oahash_slot_t *slot, *empty;
+    bool res = false;
+    /* if payload is null can't tell from lookup miss */
+    ASSERT(payload != NULL && payload != OAHASH_REMOVED,
+           "oahashtable_add internal error");
+    if (table->synch)
+        dr_mutex_lock(table->lock);
+    oahash_migrate(table, OAHASH_MIGRATE_BUCKETS);
+    oahash_check_for_resize(table);
+    slot = oahash_find_for_update(table, key, hash, &empty);
+    if (slot == NULL) {
+        /* empty is only NULL for a full non-resizable table */
+        if (empty != NULL) {
+            oahash_fill_slot(table->cur, empty, key, payload);
+            table->entries++;
+            res = true;
+        }
+    } else if (slot->payload == OAHASH_REMOVED) {
+        slot->payload = payload;
+        table->entries++;
+        res = true;
+    }
+    if (table->synch)
+        dr_mutex_unlock(table->lock);
+    return res;
+}
+
+void *
+oahashtable_add_replace(oahashtable_t *table, void *key, void *payload)
+{
+    uint hash = oahash_key(table, key);
+    oahash_slot_t *slot, *empty;
+    void *old_payload = NULL;
+    /* if payload is null can't tell from lookup miss */
+    ASSERT(payload != NULL && payload != OAHASH_REMOVED,
+           "oahashtable_add_replace internal error");
+    if (table->synch)
+        dr_mutex_lock(table->lock);
+    oahash_migrate(table, OAHASH_MIGRATE_BUCKETS);
+    oahash_check_for_resize(table);
+    slot = oahash_find_for_update(table, key, hash, &empty);
+    if (slot == NULL) {
+        /* empty is only NULL for a full non-resizable table */
+        if (empty != NULL) {
+            oahash_fill_slot(table->cur, empty, key, payload);
+            table->entries++;
+        }
+    } else {
+        /* up to caller to free payload */
+        old_payload = slot->payload;
+        slot->payload = payload;
+        if (old_payload == OAHASH_REMOVED) {
+            old_payload = NULL;
+            table->entries++;
+        }
+    }
+    if (table->synch)
+        dr_mutex_unlock(table->lock);
+    return old_payload;
+}
+
+bool
+oahashtable_remove(oahashtable_t *table, void *key)
+{
+    uint hash = oahash_key(table, key);
+    oahash_slot_t *slot, *empty;
+    bool res = false;
+    if (table->synch)
+        dr_mutex_lock(table->lock);
+    oahash_migrate(table, OAHASH_MIGRATE_BUCKETS);
+    slot = oahash_find_for_update(table, key, hash, &empty);
+    if (slot != NULL && slot->payload != OAHASH_REMOVED) {
+        void *payload = slot->payload;
+        slot->payload = OAHASH_REMOVED;
+        table->entries--;
+        if (table->free_payload_func != NULL)
+            (table->free_payload_func)(payload);
+        res = true;
+    }
+    if (table->synch)
+        dr_mutex_unlock(table->lock);
+    return res;
+}
+
+/* Caller must hold lock.  Removes every live entry in cur, or just those
+ * with HASH_INTPTR keys in [start..end) if start < end.
+ */
+static bool
+oahash_remove_all(oahashtable_t *table, ptr_uint_t start, ptr_uint_t end)
+{
+    oahash_array_t *cur;
+    uint b, i;
+    bool res = false;
+    oahash_migrate(table, ~0U);
+    cur = table->cur;
+    for (b = 0; b < OAHASH_NUM_BUCKETS(cur); b++) {
+        for (i = 0; i < OAHASH_BUCKET_SLOTS; i++) {
+            oahash_slot_t *slot = &cur->buckets[b].slot[i];
+            void *payload = slot->payload;
+            if (payload == NULL || payload == OAHASH_REMOVED)
+                continue;
+            if (start < end &&
+                ((ptr_uint_t)slot->key < start || (ptr_uint_t)slot->key >= end))
+                continue;
+            slot->payload = OAHASH_REMOVED;
+            table->entries--;
+            if (table->free_payload_func != NULL)
+                (table->free_payload_func)(payload);
+            res = true;
+        }
+    }
+    return res;
+}
+
+bool
+oahashtable_remove_range(oahashtable_t *table, void *start, void *end)
+{
+    bool res;
+    ASSERT(table->hashtype == HASH_INTPTR, "oahashtable_remove_range called on "
+           "non-HASH_INTPTR table");
+    if ((ptr_uint_t)start >= (ptr_uint_t)end)
+        return false;
+    if (table->synch)
+        dr_mutex_lock(table->lock);
+    res = oahash_remove_all(table, (ptr_uint_t)start, (ptr_uint_t)end);
+    if (table->synch)
+        dr_mutex_unlock(table->lock);
+    return res;
+}
+
+void
+oahashtable_apply_to_all_payloads(oahashtable_t *table,
+                                  void (*apply_func)(void *payload))
+{
+    oahash_array_t *cur;
+    uint b, i;
+    DR_ASSERT_MSG(apply_func != NULL, "The apply_func ptr cannot be NULL.");
+    /* Bring everything into cur so we visit each entry once */
+    if (table->synch)
+        dr_mutex_lock(table->lock);
+    oahash_migrate(table, ~0U);
+    cur = table->cur;
+    if (table->synch)
+        dr_mutex_unlock(table->lock);
+    for (b = 0; b < OAHASH_NUM_BUCKETS(cur); b++) {
+        for (i = 0; i < OAHASH_BUCKET_SLOTS; i++) {
+            void *payload = cur->buckets[b].slot[i].payload;
+            if (payload != NULL && payload != OAHASH_REMOVED)
+                apply_func(payload);
+        }
+    }
+}
+
+void
+oahashtable_clear(oahashtable_t *table)
+{
+    if (table->synch)
+        dr_mutex_lock(table->lock);
+    oahash_remove_all(table, 0, 0);
+    if (table->synch)
+        dr_mutex_unlock(table->lock);
+}
+
+void
+oahashtable_delete(oahashtable_t *table)
+{
+    if (table->synch)
+        dr_mutex_lock(table->lock);
+    oahash_remove_all(table, 0, 0);
+    oahash_array_free(table->cur);
+    table->cur = NULL;
+    while (table->retired != NULL) {
+        oahash_array_t *next = table->retired->retired_next;
+        oahash_array_free(table->retired);
+        table->retired = next;
+    }
+    table->entries = 0;
+    if (table->synch)
+        dr_mutex_unlock(table->lock);
+    dr_mutex_destroy(table->lock);
+}
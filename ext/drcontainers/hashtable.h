@@ -341,6 +341,160 @@ hashtable_resurrect(void *drcontext, byte **map /*INOUT*/, hashtable_t *table,
                     size_t entry_size, void *perscxt, hasthable_persist_flags_t flags,
                     bool (*process_payload)(void *key, void *payload, ptr_int_t shift));
 
+/***************************************************************************
+ * OPEN-ADDRESSING HASHTABLE
+ */
+
+/**
+ * The number of key-payload slots in each oahashtable_t bucket.  A bucket
+ * fills exactly one 64-byte cache line.
+ */
+#ifdef X64
+# define OAHASH_BUCKET_SLOTS 4
+#else
+# define OAHASH_BUCKET_SLOTS 8
+#endif
+
+typedef struct _oahash_slot_t {
+    void *volatile key;
+    void *volatile payload;
+} oahash_slot_t;
+
+typedef struct _oahash_bucket_t {
+    oahash_slot_t slot[OAHASH_BUCKET_SLOTS];
+} oahash_bucket_t;
+
+typedef struct _oahash_array_t {
+    oahash_bucket_t *buckets; /* cache-line-aligned */
+    void *alloc;
+    size_t alloc_size;
+    uint bucket_bits;
+    uint used; /* slots holding a key, live or removed */
+    struct _oahash_array_t *retired_next;
+} oahash_array_t;
+
+/**
+ * An open-addressing hashtable with the same interface as hashtable_t.
+ * Keys and payloads are stored inline in cache-line-sized buckets, so
+ * adding an entry never allocates memory.  Lookups do not acquire the
+ * table lock and may run concurrently with additions and removals, which
+ * are serialized by the lock.  A resize moves a few buckets at a time into
+ * the new array on each subsequent update rather than all at once.
+ */
+typedef struct _oahashtable_t {
+    oahash_array_t *volatile cur;
+    oahash_array_t *volatile old; /* being migrated into cur */
+    uint migrate_next;            /* next bucket of old to migrate */
+    oahash_array_t *retired;      /* freed at oahashtable_delete() time */
+    hash_type_t hashtype;
+    void *lock;
+    bool synch;
+    void (*free_payload_func)(void*);
+    uint (*hash_key_func)(void*);
+    bool (*cmp_key_func)(void*, void*);
+    uint entries;
+    hashtable_config_t config;
+} oahashtable_t;
+
+/**
+ * Initializes an open-addressing hashtable with the given parameters.
+ * The parameters match those of hashtable_init_ex(), with these differences:
+ *
+ * - \p num_bits determines the initial number of slots, which is rounded
+ *   up to at least two buckets of #OAHASH_BUCKET_SLOTS slots.
+ * - String keys are never duplicated: the caller must keep each key's
+ *   storage alive until the table is deleted, as a concurrent lookup may
+ *   still be comparing against a removed key.
+ * - \p synch controls whether updates acquire the table lock.  Lookups do
+ *   not acquire it on x86; on other architectures they do if \p synch is
+ *   true, as DR does not export a memory barrier to order their reads.
+ * - Replaced arrays are kept until oahashtable_delete() as a concurrent
+ *   lookup may still be reading them.  Since each is at most half the size
+ *   of its replacement this at most doubles the table's footprint.
+ * - A \p resize_threshold above 90 is treated as 90.  When the table is not
+ *   resizable, adding to a table that is full of live entries fails.
+ */
+void
+oahashtable_init_ex(oahashtable_t *table, uint num_bits, hash_type_t hashtype,
+                    bool synch, void (*free_payload_func)(void*),
+                    uint (*hash_key_func)(void*), bool (*cmp_key_func)(void*, void*));
+
+/** Configures optional parameters of open-addressing hashtable operation. */
+void
+oahashtable_configure(oahashtable_t *table, hashtable_config_t *config);
+
+/**
+ * Returns the payload for the given key, or NULL if the key is not found.
+ * A lookup that races with an update of the same key returns either the
+ * old or the new payload.
+ */
+void *
+oahashtable_lookup(oahashtable_t *table, void *key);
+
+/**
+ * Adds a new entry.  Returns false if an entry for \p key already exists.
+ * \note Never use NULL as a payload as that is used for a lookup failure.
+ */
+bool
+oahashtable_add(oahashtable_t *table, void *key, void *payload);
+
+/**
+ * Adds a new entry, replacing an existing entry if any.
+ * Returns the old payload, or NULL if there was no existing entry.
+ * \note Never use NULL as a payload as that is used for a lookup failure.
+ */
+void *
+oahashtable_add_replace(oahashtable_t *table, void *key, void *payload);
+
+/**
+ * Removes the entry for key.  If free_payload_func was specified calls it
+ * for the payload being removed.  Returns false if no such entry
+ * exists.
+ */
+bool
+oahashtable_remove(oahashtable_t *table, void *key);
+
+/**
+ * Removes all entries with key in [start..end).  If free_payload_func
+ * was specified calls it for each payload being removed.  Returns
+ * false if no such entry exists.  Only valid for HASH_INTPTR keys.
+ */
+bool
+oahashtable_remove_range(oahashtable_t *table, void *start, void *end);
+
+/**
+ * Calls the \p apply_func for each payload.
+ * @param table The hashtable to apply the function.
+ * @param apply_func A pointer to a function that is called for all payloads
+ * stored in the map.
+ */
+void
+oahashtable_apply_to_all_payloads(oahashtable_t *table,
+                                  void (*apply_func)(void *payload));
+
+/**
+ * Removes all entries from the table.  If free_payload_func was specified
+ * calls it for each payload.
+ */
+void
+oahashtable_clear(oahashtable_t *table);
+
+/**
+ * Destroys all storage for the table, including all entries and the
+ * table itself.  If free_payload_func was specified calls it for each
+ * payload.  No lookups may be in progress.
+ */
+void
+oahashtable_delete(oahashtable_t *table);
+
+/** Acquires the open-addressing hashtable lock. */
+void
+oahashtable_lock(oahashtable_t *table);
+
+/** Releases the open-addressing hashtable lock. */
+void
+oahashtable_unlock(oahashtable_t *table);
+
 /*@}*/ /* end doxygen group */
 
 #ifdef __cplusplus
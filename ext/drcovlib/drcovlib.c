@@ -53,9 +53,11 @@
 #include "dr_api.h"
 #include "drmgr.h"
 #include "drx.h"
+#include "drreg.h"
 #include "drcovlib.h"
 #include "hashtable.h"
 #include "drtable.h"
+#include "drvector.h"
 #include "modules.h"
 #include "drcovlib_private.h"
 #include <limits.h>
@@ -73,19 +75,55 @@ static char logdir[MAXIMUM_PATH];
 
 typedef struct _per_thread_t {
     void *bb_table;
+    /* For DRCOVLIB_DUMP_AS_BITMAP: cov_bitmap_t entries indexed by the
+     * containing module index.
+     */
+    drvector_t *bitmaps;
+    /* The bb_table entries already written by drcovlib_dump_delta(), and the
+     * end of the entries being written by an in-progress call.
+     */
+    ptr_uint_t delta_mark;
+    ptr_uint_t delta_end;
     file_t  log;
     char logname[MAXIMUM_PATH];
 } per_thread_t;
 
 static per_thread_t *global_data;
 static bool drcov_per_thread = false;
+/* DRCOVLIB_DUMP_AS_BITMAP with DRCOVLIB_THREAD_PRIVATE: per-thread bitmaps are
+ * merged into global_data at thread exit rather than dumped separately.
+ */
+static bool merge_thread_bitmaps = false;
 #ifndef WINDOWS
 static int sysnum_execve = IF_X64_ELSE(59, 11);
 #endif
 static volatile bool go_native;
 static int tls_idx = -1;
+/* For drcovlib_dump_delta() with drcov_per_thread: the live threads' data, and
+ * those blocks of exited threads that have not yet been written.  The vector's
+ * lock also protects exited_bb_table.
+ */
+static drvector_t thread_list;
+static void *exited_bb_table;
+/* For drcovlib_shared_map_create() */
+static uint *shared_map;
+static uint shared_map_slots;
+static size_t shared_map_size;
+static file_t shared_map_file = INVALID_FILE;
+/* For hit_count_threshold and hit_count_deadline_ms: the instrumented blocks,
+ * keyed by tag pc, which a sideline thread checks periodically, flushing those
+ * whose counter increment should be removed.
+ */
+static hashtable_t retire_table;
+static bool retire_enabled;
+static volatile bool retire_all;
+static volatile bool retire_exiting;
+static uint64 retire_deadline;
 static int drcovlib_init_count;
 
+#define RETIRE_TABLE_HASH_BITS 12
+#define RETIRE_SCAN_INTERVAL_MS 10
+
 /****************************************************************************
  * Utility Functions
  */
@@ -139,6 +177,7 @@ bb_table_print(void *drcontext, per_thread_t *data)
         ASSERT(false, "invalid log file");
         return;
     }
+    drtable_lock(data->bb_table);
     dr_fprintf(data->log, "BB Table: %u bbs\n",
                drtable_num_entries(data->bb_table));
     if (TEST(DRCOVLIB_DUMP_AS_TEXT, options.flags)) {
@@ -146,15 +185,48 @@ bb_table_print(void *drcontext, per_thread_t *data)
         drtable_iterate(data->bb_table, data, bb_table_entry_print);
     } else
         drtable_dump_entries(data->bb_table, data->log);
+    drtable_unlock(data->bb_table);
+}
+
+/* Writes the entries in [start, end) of a locked table. */
+static void
+bb_table_print_range(file_t log, void *table, ptr_uint_t start, ptr_uint_t end)
+{
+    ptr_uint_t i;
+    byte *run = NULL;
+    size_t run_size = 0;
+    for (i = start; i < end; i++) {
+        bb_entry_t *bb_entry = (bb_entry_t *)drtable_get_entry(table, i);
+        if (TEST(DRCOVLIB_DUMP_AS_TEXT, options.flags)) {
+            dr_fprintf(log, "module[%3u]: "PFX", %3u\n",
+                       bb_entry->mod_id, bb_entry->start, bb_entry->size);
+            continue;
+        }
+        /* Entries are contiguous within a chunk, so we write runs of them. */
+        if ((byte *)bb_entry != run + run_size) {
+            if (run_size > 0)
+                dr_write_file(log, run, run_size);
+            run = (byte *)bb_entry;
+            run_size = 0;
+        }
+        run_size += sizeof(*bb_entry);
+    }
+    if (run_size > 0)
+        dr_write_file(log, run, run_size);
 }
 
 static void
 bb_table_entry_add(void *drcontext, per_thread_t *data, app_pc start, uint size)
 {
-    bb_entry_t *bb_entry = drtable_alloc(data->bb_table, 1, NULL);
+    bb_entry_t *bb_entry;
     uint mod_id;
     app_pc mod_start;
     drcovlib_status_t res = drmodtrack_lookup(drcontext, start, &mod_id, &mod_start);
+    /* We hold the lock until the entry is filled in, as drcovlib_dump_delta()
+     * may read other threads' tables.
+     */
+    drtable_lock(data->bb_table);
+    bb_entry = drtable_alloc(data->bb_table, 1, NULL);
     /* we do not de-duplicate repeated bbs */
     ASSERT(size < USHRT_MAX, "size overflow");
     bb_entry->size = (ushort)size;
@@ -172,14 +244,29 @@ bb_table_entry_add(void *drcontext, per_thread_t *data, app_pc start, uint size)
         bb_entry->mod_id = UNKNOWN_MODULE_ID;
         bb_entry->start  = (uint)(ptr_uint_t)start;
     }
+    drtable_unlock(data->bb_table);
 }
 
 #define INIT_BB_TABLE_ENTRIES 4096
 static void *
-bb_table_create(bool synch)
+bb_table_create(void)
 {
+    /* We synchronize ourselves via drtable_lock(): see bb_table_entry_add(). */
     return drtable_create(INIT_BB_TABLE_ENTRIES,
-                          sizeof(bb_entry_t), 0 /* flags */, synch, NULL);
+                          sizeof(bb_entry_t), 0 /* flags */, false /* !synch */, NULL);
+}
+
+/* Appends the entries of src from mark onward to dst.  The caller must hold
+ * both locks.
+ */
+static void
+bb_table_copy_since(void *dst, void *src, ptr_uint_t mark)
+{
+    ptr_uint_t i;
+    for (i = mark; i < drtable_num_entries(src); i++) {
+        bb_entry_t *bb_entry = drtable_alloc(dst, 1, NULL);
+        *bb_entry = *(bb_entry_t *)drtable_get_entry(src, i);
+    }
 }
 
 static void
@@ -188,6 +275,257 @@ bb_table_destroy(void *table, void *data)
     drtable_destroy(table, data);
 }
 
+/****************************************************************************
+ * Bitmap Functions
+ *
+ * For DRCOVLIB_DUMP_AS_BITMAP we keep one bitmap per module with a bit per
+ * byte, allocated on the first block executed in the module.  Hit counts
+ * are drcovlib_bitmap_count_t entries in a drtable, so their addresses are
+ * stable for the inserted counter updates, with a hashtable mapping each
+ * block start offset to its entry so that rebuilt blocks share a counter.
+ */
+
+typedef struct _cov_bitmap_t {
+    const char *path;
+    size_t size;
+    byte *bits;
+    void *count_table;
+    hashtable_t count_index;
+} cov_bitmap_t;
+
+#define COUNT_INDEX_HASH_BITS 10
+#define INIT_COUNT_TABLE_ENTRIES 1024
+
+static size_t
+bitmap_bytes(size_t size)
+{
+    return (size + 7) / 8;
+}
+
+static cov_bitmap_t *
+bitmap_create(const char *path, size_t size)
+{
+    cov_bitmap_t *bm = dr_global_alloc(sizeof(*bm));
+    bm->path = path;
+    bm->size = size;
+    bm->bits = dr_raw_mem_alloc(ALIGN_FORWARD(bitmap_bytes(size), dr_page_size()),
+                                DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+    /* Fresh pages are zero */
+    if (TEST(DRCOVLIB_BITMAP_HIT_COUNTS, options.flags)) {
+        bm->count_table = drtable_create(INIT_COUNT_TABLE_ENTRIES,
+                                         sizeof(drcovlib_bitmap_count_t),
+                                         0 /* flags */, false /* !synch */, NULL);
+        hashtable_init_ex(&bm->count_index, COUNT_INDEX_HASH_BITS, HASH_INTPTR,
+                          false /* !strdup */, false /* !synch */, NULL, NULL, NULL);
+    } else
+        bm->count_table = NULL;
+    return bm;
+}
+
+static void
+bitmap_free(void *p)
+{
+    cov_bitmap_t *bm = (cov_bitmap_t *)p;
+    if (bm == NULL)
+        return; /* an unused module index */
+    dr_raw_mem_free(bm->bits, ALIGN_FORWARD(bitmap_bytes(bm->size), dr_page_size()));
+    if (bm->count_table != NULL) {
+        hashtable_delete(&bm->count_index);
+        drtable_destroy(bm->count_table, NULL);
+    }
+    dr_global_free(bm, sizeof(*bm));
+}
+
+static drvector_t *
+bitmaps_create(void)
+{
+    drvector_t *vec = dr_global_alloc(sizeof(*vec));
+    /* We synchronize shared bitmaps ourselves via drvector_lock(). */
+    drvector_init(vec, 16, false /* !synch */, bitmap_free);
+    return vec;
+}
+
+static void
+bitmaps_destroy(drvector_t *vec)
+{
+    drvector_delete(vec);
+    dr_global_free(vec, sizeof(*vec));
+}
+
+/* Caller must hold the lock for a shared vector. */
+static cov_bitmap_t *
+bitmaps_lookup(drvector_t *vec, uint mod_index, const char *path, size_t size,
+               bool create)
+{
+    cov_bitmap_t *bm = NULL;
+    if (mod_index < vec->entries)
+        bm = (cov_bitmap_t *)vec->array[mod_index];
+    if (bm == NULL && create) {
+        bm = bitmap_create(path, size);
+        /* drvector_set_entry() leaves skipped entries uninitialized */
+        while (vec->entries < mod_index)
+            drvector_append(vec, NULL);
+        drvector_set_entry(vec, mod_index, bm);
+    }
+    return bm;
+}
+
+/* Caller must hold the lock for a shared vector. */
+static drcovlib_bitmap_count_t *
+bitmap_counter(cov_bitmap_t *bm, uint offset, bool create)
+{
+    drcovlib_bitmap_count_t *counter =
+        hashtable_lookup(&bm->count_index, (void *)(ptr_uint_t)offset);
+    if (counter == NULL && create) {
+        counter = drtable_alloc(bm->count_table, 1, NULL);
+        counter->count = 0;
+        counter->offset = offset;
+        counter->reserved = 0;
+        hashtable_add(&bm->count_index, (void *)(ptr_uint_t)offset, counter);
+    }
+    return counter;
+}
+
+static inline void
+bitmap_set(cov_bitmap_t *bm, app_pc mod_start, app_pc pc)
+{
+    size_t offs = pc - mod_start;
+    /* Displaced code such as the vsyscall hook can lie outside the module. */
+    if (pc >= mod_start && offs < bm->size)
+        bm->bits[offs / 8] |= (byte)(1 << (offs % 8));
+}
+
+/* Records the block and returns its hit counter, if any.  When translating,
+ * only looks up the counter.
+ */
+static drcovlib_bitmap_count_t *
+bitmap_record_bb(void *drcontext, per_thread_t *data, app_pc tag_pc, instrlist_t *bb,
+                 bool translating)
+{
+    uint mod_index, containing_index;
+    app_pc mod_start;
+    size_t mod_size;
+    const char *path;
+    cov_bitmap_t *bm;
+    drcovlib_bitmap_count_t *counter = NULL;
+    bool shared = !drcov_per_thread;
+    if (drmodtrack_lookup(drcontext, tag_pc, &mod_index, &mod_start) !=
+        DRCOVLIB_SUCCESS ||
+        drmodtrack_lookup_module(mod_index, &containing_index, &mod_start, &mod_size,
+                                 &path) != DRCOVLIB_SUCCESS) {
+        /* Like unknown-module entries in the bb table, these would be ignored
+         * in post-processing, so we do not record them.
+         */
+        return NULL;
+    }
+    if (shared)
+        drvector_lock(data->bitmaps);
+    bm = bitmaps_lookup(data->bitmaps, containing_index, path, mod_size, !translating);
+    if (bm != NULL) {
+        if (!translating) {
+            if (TEST(DRCOVLIB_BITMAP_BB_START, options.flags))
+                bitmap_set(bm, mod_start, tag_pc);
+            else {
+                instr_t *instr;
+                bitmap_set(bm, mod_start, tag_pc);
+                for (instr  = instrlist_first_app(bb);
+                     instr != NULL;
+                     instr  = instr_get_next_app(instr))
+                    bitmap_set(bm, mod_start, instr_get_app_pc(instr));
+            }
+        }
+        if (bm->count_table != NULL && tag_pc >= mod_start &&
+            (size_t)(tag_pc - mod_start) < bm->size)
+            counter = bitmap_counter(bm, (uint)(tag_pc - mod_start), !translating);
+    }
+    if (shared)
+        drvector_unlock(data->bitmaps);
+    return counter;
+}
+
+static uint
+bitmaps_num_recorded(drvector_t *vec)
+{
+    uint i, count = 0;
+    for (i = 0; i < vec->entries; i++) {
+        if (vec->array[i] != NULL)
+            count++;
+    }
+    return count;
+}
+
+static bool
+bitmap_count_dump(ptr_uint_t idx, void *entry, void *iter_data)
+{
+    file_t log = *(file_t *)iter_data;
+    dr_write_file(log, entry, sizeof(drcovlib_bitmap_count_t));
+    return true; /* continue iteration */
+}
+
+/* Caller must hold the lock for a shared vector. */
+static void
+bitmaps_print(per_thread_t *data)
+{
+    uint i;
+    dr_fprintf(data->log, "BB Bitmap: version %u, count %u, flags 0x%x\n",
+               DRCOV_BITMAP_VERSION, bitmaps_num_recorded(data->bitmaps),
+               options.flags & (DRCOVLIB_DUMP_AS_BITMAP | DRCOVLIB_BITMAP_BB_START |
+                                DRCOVLIB_BITMAP_HIT_COUNTS));
+    for (i = 0; i < data->bitmaps->entries; i++) {
+        cov_bitmap_t *bm = (cov_bitmap_t *)data->bitmaps->array[i];
+        drcovlib_bitmap_header_t header;
+        if (bm == NULL)
+            continue;
+        header.size = bm->size;
+        header.path_size = (uint)strlen(bm->path) + 1;
+        header.num_counts = bm->count_table == NULL ? 0 :
+            (uint)drtable_num_entries(bm->count_table);
+        dr_write_file(data->log, &header, sizeof(header));
+        dr_write_file(data->log, bm->path, header.path_size);
+        dr_write_file(data->log, bm->bits, bitmap_bytes(bm->size));
+        if (bm->count_table != NULL)
+            drtable_iterate(bm->count_table, &data->log, bitmap_count_dump);
+    }
+}
+
+static bool
+bitmap_count_merge(ptr_uint_t idx, void *entry, void *iter_data)
+{
+    cov_bitmap_t *dst = (cov_bitmap_t *)iter_data;
+    drcovlib_bitmap_count_t *src = (drcovlib_bitmap_count_t *)entry;
+    bitmap_counter(dst, src->offset, true)->count += src->count;
+    return true; /* continue iteration */
+}
+
+/* ORs src's bitmaps into dst's, whose lock the caller must hold. */
+static void
+bitmaps_merge(drvector_t *dst, drvector_t *src)
+{
+    uint i;
+    size_t j;
+    for (i = 0; i < src->entries; i++) {
+        cov_bitmap_t *from = (cov_bitmap_t *)src->array[i];
+        cov_bitmap_t *to;
+        ptr_uint_t *to_words, *from_words;
+        size_t num_words;
+        if (from == NULL)
+            continue;
+        to = bitmaps_lookup(dst, i, from->path, from->size, true);
+        ASSERT(to->size == from->size, "module size mismatch");
+        /* The bitmaps are page-aligned and page-padded, so we can go a word
+         * at a time.
+         */
+        to_words = (ptr_uint_t *)to->bits;
+        from_words = (ptr_uint_t *)from->bits;
+        num_words = ALIGN_FORWARD(bitmap_bytes(from->size), sizeof(ptr_uint_t)) /
+            sizeof(ptr_uint_t);
+        for (j = 0; j < num_words; j++)
+            to_words[j] |= from_words[j];
+        if (from->count_table != NULL)
+            drtable_iterate(from->count_table, to, bitmap_count_merge);
+    }
+}
+
 static void
 version_print(file_t log)
 {
@@ -215,6 +553,16 @@ dump_drcov_data(void *drcontext, per_thread_t *data)
         return;
     }
     version_print(data->log);
+    if (TEST(DRCOVLIB_DUMP_AS_BITMAP, options.flags)) {
+        /* The records name their modules, so there is no module table. */
+        bool shared = drcontext == NULL;
+        if (shared)
+            drvector_lock(data->bitmaps);
+        bitmaps_print(data);
+        if (shared)
+            drvector_unlock(data->bitmaps);
+        return;
+    }
     drmodtrack_dump(data->log);
     bb_table_print(drcontext, data);
 }
@@ -239,29 +587,71 @@ thread_data_create(void *drcontext)
 {
     per_thread_t *data;
     if (drcontext == NULL) {
-        ASSERT(!drcov_per_thread, "drcov_per_thread should not be set");
+        ASSERT(!drcov_per_thread || merge_thread_bitmaps,
+               "drcov_per_thread should not be set");
         data = dr_global_alloc(sizeof(*data));
     } else {
         ASSERT(drcov_per_thread, "drcov_per_thread should be set");
         data = dr_thread_alloc(drcontext, sizeof(*data));
     }
-    /* XXX: can we assume bb create event is serialized,
-     * if so, no lock is required for bb_table operation.
-     */
-    data->bb_table = bb_table_create(drcontext == NULL ? true : false);
-    log_file_create(drcontext, data);
+    if (TEST(DRCOVLIB_DUMP_AS_BITMAP, options.flags)) {
+        data->bb_table = NULL;
+        data->bitmaps = bitmaps_create();
+    } else {
+        data->bb_table = bb_table_create();
+        data->bitmaps = NULL;
+    }
+    data->delta_mark = 0;
+    data->delta_end = 0;
+    if (drcontext != NULL && merge_thread_bitmaps) {
+        /* Merged into the process-wide log instead */
+        data->log = INVALID_FILE;
+        data->logname[0] = '\0';
+    } else
+        log_file_create(drcontext, data);
+    if (drcontext != NULL && data->bb_table != NULL) {
+        drvector_lock(&thread_list);
+        drvector_append(&thread_list, data);
+        drvector_unlock(&thread_list);
+    }
     return data;
 }
 
+/* Drops data from thread_list, saving its blocks not yet written by
+ * drcovlib_dump_delta().
+ */
+static void
+thread_list_remove(per_thread_t *data)
+{
+    uint i;
+    drvector_lock(&thread_list);
+    for (i = 0; i < thread_list.entries; i++) {
+        if (thread_list.array[i] == data) {
+            drtable_lock(data->bb_table);
+            bb_table_copy_since(exited_bb_table, data->bb_table, data->delta_mark);
+            drtable_unlock(data->bb_table);
+            /* Order does not matter */
+            thread_list.array[i] = thread_list.array[--thread_list.entries];
+            break;
+        }
+    }
+    drvector_unlock(&thread_list);
+}
+
 static void
 thread_data_destroy(void *drcontext, per_thread_t *data)
 {
     /* destroy the bb table */
-    bb_table_destroy(data->bb_table, data);
-    dr_close_file(data->log);
+    if (data->bb_table != NULL)
+        bb_table_destroy(data->bb_table, data);
+    if (data->bitmaps != NULL)
+        bitmaps_destroy(data->bitmaps);
+    if (data->log != INVALID_FILE)
+        dr_close_file(data->log);
     /* free thread data */
     if (drcontext == NULL) {
-        ASSERT(!drcov_per_thread, "drcov_per_thread should not be set");
+        ASSERT(!drcov_per_thread || merge_thread_bitmaps,
+               "drcov_per_thread should not be set");
         dr_global_free(data, sizeof(*data));
     } else {
         ASSERT(drcov_per_thread, "drcov_per_thread is not set");
@@ -281,6 +671,110 @@ global_data_destroy(per_thread_t *data)
     thread_data_destroy(NULL, data);
 }
 
+/****************************************************************************
+ * Hit count instrumentation removal
+ */
+
+typedef struct _retire_entry_t {
+    drcovlib_bitmap_count_t *counter;
+    size_t size;
+} retire_entry_t;
+
+static void
+retire_entry_free(void *p)
+{
+    dr_global_free(p, sizeof(retire_entry_t));
+}
+
+static inline bool
+retire_counter_done(drcovlib_bitmap_count_t *counter)
+{
+    /* A racy read suffices: the count only grows. */
+    return retire_all ||
+        (options.hit_count_threshold > 0 &&
+         counter->count >= options.hit_count_threshold);
+}
+
+/* Returns whether the block at tag_pc should still increment counter, in which
+ * case it is added to retire_table for the sideline thread to check.  Once
+ * false, this stays false, so a block that was built without the increment is
+ * reproduced exactly on translation.
+ */
+static bool
+retire_should_instrument(void *drcontext, app_pc tag_pc, instrlist_t *bb,
+                         drcovlib_bitmap_count_t *counter, bool translating)
+{
+    retire_entry_t *entry;
+    instr_t *instr;
+    size_t size = 1;
+    if (retire_counter_done(counter))
+        return false;
+    if (translating)
+        return true;
+    /* Flushing just the block's own range lets adjacent requests coalesce. */
+    for (instr  = instrlist_first_app(bb);
+         instr != NULL;
+         instr  = instr_get_next_app(instr)) {
+        app_pc pc = instr_get_app_pc(instr);
+        if (pc >= tag_pc && (size_t)(pc - tag_pc) + instr_length(drcontext, instr) > size)
+            size = (pc - tag_pc) + instr_length(drcontext, instr);
+    }
+    hashtable_lock(&retire_table);
+    /* A block rebuilt before its removal, such as for another flush, is
+     * already present.
+     */
+    if (hashtable_lookup(&retire_table, tag_pc) == NULL) {
+        entry = dr_global_alloc(sizeof(*entry));
+        entry->counter = counter;
+        entry->size = size;
+        hashtable_add(&retire_table, tag_pc, entry);
+    }
+    hashtable_unlock(&retire_table);
+    return true;
+}
+
+static void
+retire_thread(void *arg)
+{
+    uint i;
+    /* We run until drcovlib_exit().  DR never suspends a client thread while it
+     * holds a client lock, so at process exit we are stopped outside of it.
+     */
+    while (!retire_exiting) {
+        dr_sleep(RETIRE_SCAN_INTERVAL_MS);
+        if (options.hit_count_deadline_ms > 0 && !retire_all &&
+            dr_get_milliseconds() >= retire_deadline)
+            retire_all = true;
+        hashtable_lock(&retire_table);
+        if (retire_exiting) {
+            hashtable_unlock(&retire_table);
+            break;
+        }
+        for (i = 0; i < HASHTABLE_SIZE(retire_table.table_bits); i++) {
+            hash_entry_t *he, *next;
+            for (he = retire_table.table[i]; he != NULL; he = next) {
+                retire_entry_t *entry = (retire_entry_t *)he->payload;
+                next = he->next;
+                if (retire_counter_done(entry->counter)) {
+                    /* Without a callback DR uses a cheaper non-synchall flush.
+                     * The rebuilt block sees the same condition and omits the
+                     * increment.
+                     */
+                    dr_delay_flush_region((app_pc)he->key, entry->size, 0, NULL);
+                    hashtable_remove(&retire_table, he->key);
+                }
+            }
+        }
+        hashtable_unlock(&retire_table);
+    }
+}
+
+static bool
+retire_thread_start(void)
+{
+    return dr_create_client_thread(retire_thread, NULL);
+}
+
 /****************************************************************************
  * Event Callbacks
  */
@@ -303,7 +797,14 @@ event_pre_syscall(void *drcontext, int sysnum)
         /* for !drcov_per_thread, the per-thread data is a copy of global data */
         per_thread_t *data = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_idx);
         ASSERT(data != NULL, "data must not be NULL");
-        if (!drcov_per_thread)
+        if (merge_thread_bitmaps) {
+            /* The image is going away, so this thread will not merge at exit. */
+            drvector_lock(global_data->bitmaps);
+            bitmaps_merge(global_data->bitmaps, data->bitmaps);
+            drvector_unlock(global_data->bitmaps);
+            data = global_data;
+            drcontext = NULL;
+        } else if (!drcov_per_thread)
             drcontext = NULL;
         /* We only dump the data but do not free any memory.
          * XXX: for drcov_per_thread, we only dump the current thread.
@@ -330,11 +831,31 @@ event_basic_block_analysis(void *drcontext, void *tag, instrlist_t *bb,
     instr_t *instr;
     app_pc tag_pc, start_pc, end_pc;
 
+    data = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_idx);
+    if (TEST(DRCOVLIB_DUMP_AS_BITMAP, options.flags)) {
+        drcovlib_bitmap_count_t *counter;
+        dr_emit_flags_t flags = DR_EMIT_DEFAULT;
+        tag_pc = dr_fragment_app_pc(tag);
+        /* When translating we must reproduce the same counter update. */
+        counter = bitmap_record_bb(drcontext, data, tag_pc, bb, translating);
+        if (counter != NULL && retire_enabled) {
+            if (!retire_should_instrument(drcontext, tag_pc, bb, counter, translating))
+                counter = NULL;
+            else {
+                /* The block may no longer be instrumented when re-created. */
+                flags = DR_EMIT_STORE_TRANSLATIONS;
+            }
+        }
+        *user_data = counter;
+        if (go_native && !translating)
+            return flags | DR_EMIT_GO_NATIVE;
+        return flags;
+    }
+
     /* do nothing for translation */
     if (translating)
         return DR_EMIT_DEFAULT;
 
-    data = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_idx);
     /* Collect the number of instructions and the basic block size,
      * assuming the basic block does not have any elision on control
      * transfer instructions, which is true for default options passed
@@ -375,6 +896,34 @@ event_basic_block_analysis(void *drcontext, void *tag, instrlist_t *bb,
         return DR_EMIT_DEFAULT;
 }
 
+static dr_emit_flags_t
+event_bb_insert_hit_count(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                          bool for_trace, bool translating, void *user_data)
+{
+    uint flags = IF_X64(DRX_COUNTER_64BIT);
+    if (user_data == NULL || !drmgr_is_first_instr(drcontext, inst))
+        return DR_EMIT_DEFAULT;
+#ifdef X86
+    /* Thread-private counters need no atomicity.
+     * XXX: shared counters are racy elsewhere as drx only supports a locked
+     * update on x86.
+     */
+    if (!drcov_per_thread)
+        flags |= DRX_COUNTER_LOCK;
+#endif
+    if (!drx_insert_counter_update(drcontext, bb, inst, SPILL_SLOT_MAX + 1,
+                                   IF_NOT_X86_(SPILL_SLOT_MAX + 1)
+                                   &((drcovlib_bitmap_count_t *)user_data)->count,
+                                   1, flags)) {
+        /* A locked update is not supported everywhere: fall back to a racy one. */
+        drx_insert_counter_update(drcontext, bb, inst, SPILL_SLOT_MAX + 1,
+                                  IF_NOT_X86_(SPILL_SLOT_MAX + 1)
+                                  &((drcovlib_bitmap_count_t *)user_data)->count,
+                                  1, flags & ~DRX_COUNTER_LOCK);
+    }
+    return DR_EMIT_DEFAULT;
+}
+
 static void
 event_thread_exit(void *drcontext)
 {
@@ -383,8 +932,14 @@ event_thread_exit(void *drcontext)
     data = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_idx);
     ASSERT(data != NULL, "data must not be NULL");
 
-    if (drcov_per_thread) {
+    if (merge_thread_bitmaps) {
+        drvector_lock(global_data->bitmaps);
+        bitmaps_merge(global_data->bitmaps, data->bitmaps);
+        drvector_unlock(global_data->bitmaps);
+        thread_data_destroy(drcontext, data);
+    } else if (drcov_per_thread) {
         dump_drcov_data(drcontext, data);
+        thread_list_remove(data);
         thread_data_destroy(drcontext, data);
     } else {
         /* the per-thread data is a copy of global data */
@@ -442,10 +997,19 @@ event_thread_init(void *drcontext)
 static void
 event_fork(void *drcontext)
 {
-    if (!drcov_per_thread) {
+    if (!drcov_per_thread || merge_thread_bitmaps)
         log_file_create(NULL, global_data);
-    } else {
+    /* Our sideline thread does not exist in the child. */
+    if (retire_enabled && !retire_thread_start())
+        retire_all = true; /* the blocks already instrumented stay so */
+    if (drcov_per_thread) {
         per_thread_t *data = drmgr_get_tls_field(drcontext, tls_idx);
+        /* The other threads do not exist in the child.  We leak their data,
+         * as before they were on this list.
+         */
+        drvector_lock(&thread_list);
+        thread_list.entries = 0;
+        drvector_unlock(&thread_list);
         if (data != NULL) {
             thread_data_destroy(drcontext, data);
         }
@@ -461,13 +1025,13 @@ drcovlib_logfile(void *drcontext, OUT const char **path)
         return DRCOVLIB_ERROR_INVALID_PARAMETER;
     if (drcontext != NULL) {
         per_thread_t *data;
-        if (!drcov_per_thread)
+        if (!drcov_per_thread || merge_thread_bitmaps)
             return DRCOVLIB_ERROR_INVALID_PARAMETER;
         data = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_idx);
         ASSERT(data != NULL, "data must not be NULL");
         *path = data->logname;
     } else {
-        if (drcov_per_thread)
+        if (drcov_per_thread && !merge_thread_bitmaps)
             return DRCOVLIB_ERROR_INVALID_PARAMETER;
         *path = global_data->logname;
     }
@@ -479,19 +1043,143 @@ drcovlib_dump(void *drcontext)
 {
     if (drcontext != NULL) {
         per_thread_t *data;
-        if (!drcov_per_thread)
+        if (!drcov_per_thread || merge_thread_bitmaps)
             return DRCOVLIB_ERROR_INVALID_PARAMETER;
         data = (per_thread_t *)drmgr_get_tls_field(drcontext, tls_idx);
         ASSERT(data != NULL, "data must not be NULL");
         dump_drcov_data(drcontext, data);
     } else {
-        if (drcov_per_thread)
+        if (drcov_per_thread && !merge_thread_bitmaps)
             return DRCOVLIB_ERROR_INVALID_PARAMETER;
         dump_drcov_data(drcontext, global_data);
     }
     return DRCOVLIB_SUCCESS;
 }
 
+drcovlib_status_t
+drcovlib_dump_delta(file_t log, OUT uint *num_new_bbs)
+{
+    ptr_uint_t count;
+    uint i;
+    if (log == INVALID_FILE)
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    if (TEST(DRCOVLIB_DUMP_AS_BITMAP, options.flags))
+        return DRCOVLIB_ERROR_FEATURE_NOT_AVAILABLE;
+    version_print(log);
+    drmodtrack_dump(log);
+    if (!drcov_per_thread) {
+        void *table = global_data->bb_table;
+        drtable_lock(table);
+        count = drtable_num_entries(table) - global_data->delta_mark;
+        dr_fprintf(log, "BB Table: %u bbs\n", (uint)count);
+        if (TEST(DRCOVLIB_DUMP_AS_TEXT, options.flags))
+            dr_fprintf(log, "module id, start, size:\n");
+        bb_table_print_range(log, table, global_data->delta_mark,
+                             drtable_num_entries(table));
+        global_data->delta_mark = drtable_num_entries(table);
+        drtable_unlock(table);
+    } else {
+        /* Blocks added while we write go into the next delta, so we fix each
+         * table's end up front for an accurate count in the header.
+         */
+        drvector_lock(&thread_list);
+        count = drtable_num_entries(exited_bb_table);
+        for (i = 0; i < thread_list.entries; i++) {
+            per_thread_t *data = (per_thread_t *)thread_list.array[i];
+            drtable_lock(data->bb_table);
+            data->delta_end = drtable_num_entries(data->bb_table);
+            drtable_unlock(data->bb_table);
+            count += data->delta_end - data->delta_mark;
+        }
+        dr_fprintf(log, "BB Table: %u bbs\n", (uint)count);
+        if (TEST(DRCOVLIB_DUMP_AS_TEXT, options.flags))
+            dr_fprintf(log, "module id, start, size:\n");
+        bb_table_print_range(log, exited_bb_table, 0,
+                             drtable_num_entries(exited_bb_table));
+        bb_table_destroy(exited_bb_table, NULL);
+        exited_bb_table = bb_table_create();
+        for (i = 0; i < thread_list.entries; i++) {
+            per_thread_t *data = (per_thread_t *)thread_list.array[i];
+            drtable_lock(data->bb_table);
+            bb_table_print_range(log, data->bb_table, data->delta_mark,
+                                 data->delta_end);
+            drtable_unlock(data->bb_table);
+            data->delta_mark = data->delta_end;
+        }
+        drvector_unlock(&thread_list);
+    }
+    if (num_new_bbs != NULL)
+        *num_new_bbs = (uint)count;
+    return DRCOVLIB_SUCCESS;
+}
+
+static inline uint
+shared_map_slot(uint offset, uint mod_index)
+{
+    return (offset + mod_index * 0x9e3779b1) % shared_map_slots;
+}
+
+static dr_emit_flags_t
+event_bb_insert_shared_map(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                           bool for_trace, bool translating, void *user_data)
+{
+    app_pc tag_pc = dr_fragment_app_pc(tag);
+    app_pc mod_start;
+    uint mod_index, slot;
+    if (!drmgr_is_first_instr(drcontext, inst))
+        return DR_EMIT_DEFAULT;
+    if (drmodtrack_lookup(drcontext, tag_pc, &mod_index, &mod_start) == DRCOVLIB_SUCCESS)
+        slot = shared_map_slot((uint)(tag_pc - mod_start), mod_index);
+    else
+        slot = shared_map_slot((uint)(ptr_uint_t)tag_pc, 0);
+    drx_insert_counter_update(drcontext, bb, inst, SPILL_SLOT_MAX + 1,
+                              IF_NOT_X86_(SPILL_SLOT_MAX + 1) &shared_map[slot], 1, 0);
+    return DR_EMIT_DEFAULT;
+}
+
+drcovlib_status_t
+drcovlib_shared_map_create(const char *path, uint num_slots, OUT uint **map)
+{
+    static const byte zeroes[4096];
+    size_t size, written;
+    drreg_options_t drreg_ops = {sizeof(drreg_ops), 2 /*max slots needed*/, false};
+    if (path == NULL || num_slots == 0 || map == NULL || shared_map != NULL)
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    size = ALIGN_FORWARD((size_t)num_slots * sizeof(uint), dr_page_size());
+    shared_map_file = dr_open_file(path, DR_FILE_WRITE_OVERWRITE);
+    if (shared_map_file == INVALID_FILE)
+        return DRCOVLIB_ERROR;
+    /* Extend the file to the map size */
+    for (written = 0; written < size; written += sizeof(zeroes)) {
+        if (dr_write_file(shared_map_file, zeroes, sizeof(zeroes)) != sizeof(zeroes))
+            break;
+    }
+    shared_map_size = size;
+    /* Keep the counters reachable so the inserted updates can use absolute or
+     * pc-relative addressing without a scratch register.
+     */
+    if (written >= size) {
+        shared_map = (uint *)dr_map_file(shared_map_file, &shared_map_size, 0, NULL,
+                                         DR_MEMPROT_READ | DR_MEMPROT_WRITE,
+                                         DR_MAP_CACHE_REACHABLE);
+    }
+    if (shared_map == NULL || shared_map_size < size ||
+        drreg_init(&drreg_ops) != DRREG_SUCCESS) {
+        if (shared_map != NULL)
+            dr_unmap_file(shared_map, shared_map_size);
+        shared_map = NULL;
+        dr_close_file(shared_map_file);
+        shared_map_file = INVALID_FILE;
+        return DRCOVLIB_ERROR;
+    }
+    shared_map_slots = num_slots;
+    if (!drmgr_register_bb_instrumentation_event(NULL, event_bb_insert_shared_map,
+                                                 NULL))
+        return DRCOVLIB_ERROR;
+    *map = shared_map;
+    return DRCOVLIB_SUCCESS;
+}
+
 drcovlib_status_t
 drcovlib_exit(void)
 {
@@ -499,15 +1187,34 @@ drcovlib_exit(void)
     if (count != 0)
         return DRCOVLIB_SUCCESS;
 
-    if (!drcov_per_thread) {
+    if (retire_enabled) {
+        /* The counters are freed along with global_data. */
+        hashtable_lock(&retire_table);
+        retire_exiting = true;
+        hashtable_unlock(&retire_table);
+        hashtable_delete(&retire_table);
+    }
+    if (!drcov_per_thread || merge_thread_bitmaps) {
         dump_drcov_data(NULL, global_data);
         global_data_destroy(global_data);
     }
+    if (drcov_per_thread && !TEST(DRCOVLIB_DUMP_AS_BITMAP, options.flags)) {
+        drvector_delete(&thread_list);
+        bb_table_destroy(exited_bb_table, NULL);
+    }
+    if (shared_map != NULL) {
+        dr_unmap_file(shared_map, shared_map_size);
+        dr_close_file(shared_map_file);
+        shared_map = NULL;
+        drreg_exit();
+    }
     /* destroy module table */
     drmodtrack_exit();
 
     drmgr_unregister_tls_field(tls_idx);
 
+    if (TEST(DRCOVLIB_BITMAP_HIT_COUNTS, options.flags))
+        drreg_exit();
     drx_exit();
     drmgr_exit();
 
@@ -531,8 +1238,13 @@ event_init(void)
     if (res != DRCOVLIB_SUCCESS)
         return res;
 
-    /* create process data if whole process bb coverage. */
-    if (!drcov_per_thread)
+    if (drcov_per_thread && !TEST(DRCOVLIB_DUMP_AS_BITMAP, options.flags)) {
+        drvector_init(&thread_list, 16, false /* !synch */, NULL);
+        exited_bb_table = bb_table_create();
+    }
+
+    /* create process data if whole process bb coverage, or to merge into. */
+    if (!drcov_per_thread || merge_thread_bitmaps)
         global_data = global_data_create();
     return DRCOVLIB_SUCCESS;
 }
@@ -546,12 +1258,28 @@ drcovlib_init(drcovlib_options_t *ops)
 
     if (ops->struct_size != sizeof(options))
         return DRCOVLIB_ERROR_INVALID_PARAMETER;
-    if ((ops->flags & (~(DRCOVLIB_DUMP_AS_TEXT|DRCOVLIB_THREAD_PRIVATE))) != 0)
+    if ((ops->flags & (~(DRCOVLIB_DUMP_AS_TEXT|DRCOVLIB_THREAD_PRIVATE|
+                          DRCOVLIB_DUMP_AS_BITMAP|DRCOVLIB_BITMAP_BB_START|
+                          DRCOVLIB_BITMAP_HIT_COUNTS))) != 0)
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    if (TESTANY(DRCOVLIB_BITMAP_BB_START|DRCOVLIB_BITMAP_HIT_COUNTS, ops->flags) &&
+        !TEST(DRCOVLIB_DUMP_AS_BITMAP, ops->flags))
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    if (TESTALL(DRCOVLIB_DUMP_AS_BITMAP|DRCOVLIB_DUMP_AS_TEXT, ops->flags))
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    /* Thread-private counters are freed at thread exit, while our sideline
+     * thread may still refer to them.
+     */
+    if ((ops->hit_count_threshold > 0 || ops->hit_count_deadline_ms > 0) &&
+        (!TEST(DRCOVLIB_BITMAP_HIT_COUNTS, ops->flags) ||
+         TEST(DRCOVLIB_THREAD_PRIVATE, ops->flags)))
         return DRCOVLIB_ERROR_INVALID_PARAMETER;
     if (TEST(DRCOVLIB_THREAD_PRIVATE, ops->flags)) {
         if (!dr_using_all_private_caches())
             return DRCOVLIB_ERROR_INVALID_SETUP;
         drcov_per_thread = true;
+        if (TEST(DRCOVLIB_DUMP_AS_BITMAP, ops->flags))
+            merge_thread_bitmaps = true;
     }
     options = *ops;
     if (options.logdir != NULL)
@@ -565,6 +1293,12 @@ drcovlib_init(drcovlib_options_t *ops)
 
     drmgr_init();
     drx_init();
+    if (TEST(DRCOVLIB_BITMAP_HIT_COUNTS, options.flags)) {
+        /* drx_insert_counter_update() needs the flags and, off x86, a register */
+        drreg_options_t drreg_ops = {sizeof(drreg_ops), 2 /*max slots needed*/, false};
+        if (drreg_init(&drreg_ops) != DRREG_SUCCESS)
+            return DRCOVLIB_ERROR;
+    }
 
     /* We follow a simple model of the caller requesting the coverage dump,
      * either via calling the exit routine, using its own soft_kills nudge, or
@@ -576,7 +1310,11 @@ drcovlib_init(drcovlib_options_t *ops)
 
     drmgr_register_thread_init_event(event_thread_init);
     drmgr_register_thread_exit_event(event_thread_exit);
-    drmgr_register_bb_instrumentation_event(event_basic_block_analysis, NULL, NULL);
+    drmgr_register_bb_instrumentation_event(event_basic_block_analysis,
+                                            TEST(DRCOVLIB_BITMAP_HIT_COUNTS,
+                                                 options.flags) ?
+                                            event_bb_insert_hit_count : NULL,
+                                            NULL);
     dr_register_filter_syscall_event(event_filter_syscall);
     drmgr_register_pre_syscall_event(event_pre_syscall);
 #ifdef UNIX
@@ -587,5 +1325,103 @@ drcovlib_init(drcovlib_options_t *ops)
     if (tls_idx == -1)
         return DRCOVLIB_ERROR;
 
+    if (options.hit_count_threshold > 0 || options.hit_count_deadline_ms > 0) {
+        hashtable_init_ex(&retire_table, RETIRE_TABLE_HASH_BITS, HASH_INTPTR,
+                          false /* !strdup */, false /* !synch */, retire_entry_free,
+                          NULL, NULL);
+        retire_deadline = dr_get_milliseconds() + options.hit_count_deadline_ms;
+        retire_enabled = true;
+        /* The thread only starts running once the app does. */
+        if (!retire_thread_start())
+            return DRCOVLIB_ERROR;
+    }
+
     return event_init();
 }
+
+/***************************************************************************
+ * Offline bitmap parsing
+ */
+
+static const char *
+bitmap_skip_line(const char *pos, const char *map_end)
+{
+    while (pos < map_end && *pos != '\n')
+        pos++;
+    return pos < map_end ? pos + 1 : NULL;
+}
+
+drcovlib_status_t
+drcovlib_bitmap_offline_read(const char *map, size_t map_size, OUT uint *num_mods,
+                             OUT uint *flags, OUT const char **records)
+{
+    const char *map_end = map + map_size;
+    const char *pos = map;
+    uint version, count, file_flags;
+    char line[128];
+    size_t len;
+    int i;
+    if (map == NULL || num_mods == NULL || flags == NULL || records == NULL)
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    /* Skip the version and flavor lines */
+    for (i = 0; i < 2 && pos != NULL; i++)
+        pos = bitmap_skip_line(pos, map_end);
+    if (pos == NULL)
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    /* Copy the line out as the records that follow are not null-terminated. */
+    len = map_end - pos;
+    if (len > BUFFER_SIZE_ELEMENTS(line) - 1)
+        len = BUFFER_SIZE_ELEMENTS(line) - 1;
+    memcpy(line, pos, len);
+    line[len] = '\0';
+    if (dr_sscanf(line, "BB Bitmap: version %u, count %u, flags 0x%x", &version,
+                  &count, &file_flags) != 3)
+        return DRCOVLIB_ERROR_NOT_FOUND;
+    if (version > DRCOV_BITMAP_VERSION || !TEST(DRCOVLIB_DUMP_AS_BITMAP, file_flags))
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    pos = bitmap_skip_line(pos, map_end);
+    if (pos == NULL)
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    *num_mods = count;
+    *flags = file_flags;
+    *records = pos;
+    return DRCOVLIB_SUCCESS;
+}
+
+drcovlib_status_t
+drcovlib_bitmap_offline_next(const char **pos INOUT, const char *map_end,
+                             OUT drcovlib_bitmap_module_t *module)
+{
+    drcovlib_bitmap_header_t header;
+    const char *cur;
+    size_t avail, bytes;
+    if (pos == NULL || *pos == NULL || module == NULL || *pos > map_end)
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    cur = *pos;
+    if ((size_t)(map_end - cur) < sizeof(header))
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    /* Records are not aligned */
+    memcpy(&header, cur, sizeof(header));
+    cur += sizeof(header);
+    avail = map_end - cur;
+    if (header.path_size == 0 || header.path_size > avail ||
+        cur[header.path_size - 1] != '\0')
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    module->path = cur;
+    cur += header.path_size;
+    avail -= header.path_size;
+    if (header.size > (uint64)avail * 8)
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    bytes = (size_t)((header.size + 7) / 8);
+    module->size = header.size;
+    module->bitmap = (const byte *)cur;
+    cur += bytes;
+    avail -= bytes;
+    if (header.num_counts > avail / sizeof(drcovlib_bitmap_count_t))
+        return DRCOVLIB_ERROR_INVALID_PARAMETER;
+    module->num_counts = header.num_counts;
+    module->counts = (const byte *)cur;
+    cur += header.num_counts * sizeof(drcovlib_bitmap_count_t);
+    *pos = cur;
+    return DRCOVLIB_SUCCESS;
+}
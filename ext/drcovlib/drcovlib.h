@@ -78,6 +78,34 @@ typedef enum {
      * drcovlib's own thread exit events rather than in drcovlib_exit().
      */
     DRCOVLIB_THREAD_PRIVATE  = 0x0002,
+    /**
+     * Requests to dump coverage as one bitmap per module instead of as a list
+     * of basic blocks.  By default a bit is set for the start of each executed
+     * instruction.  Bitmaps are merged, across threads or across runs, with a
+     * bitwise OR, and log files in this format are much faster to read and
+     * merge than basic block lists: see drcovlib_bitmap_offline_read() for the
+     * format.  \ref sec_drcov2lcov reads these log files as well.  This
+     * format is always binary and may not be combined with
+     * #DRCOVLIB_DUMP_AS_TEXT.
+     *
+     * If #DRCOVLIB_THREAD_PRIVATE is also in effect, each thread records into
+     * its own bitmaps without synchronization and merges them into the
+     * process-wide bitmaps at thread exit.  No per-thread log files are
+     * written: the process-wide log file is written by drcovlib_exit().
+     */
+    DRCOVLIB_DUMP_AS_BITMAP  = 0x0004,
+    /**
+     * With #DRCOVLIB_DUMP_AS_BITMAP, only sets the bit for the start of each
+     * executed basic block, rather than for every instruction.
+     */
+    DRCOVLIB_BITMAP_BB_START = 0x0008,
+    /**
+     * With #DRCOVLIB_DUMP_AS_BITMAP, also records how many times each basic
+     * block start was executed.  Unlike the other modes, this inserts
+     * instrumentation, which uses the drreg extension with up to two spill
+     * slots.
+     */
+    DRCOVLIB_BITMAP_HIT_COUNTS = 0x0010,
 } drcovlib_flags_t;
 
 /** Specifies the options when initializing drcovlib. */
@@ -97,6 +125,24 @@ typedef struct _drcovlib_options_t {
      * option, is created.  This option only works under Windows.
      */
     int native_until_thread;
+    /**
+     * With #DRCOVLIB_BITMAP_HIT_COUNTS, once a basic block's hit count reaches
+     * this value, the block is flushed from the code cache and rebuilt without
+     * the counter increment, so that hot code runs uninstrumented.  Recorded
+     * counts are thus exact below this value and a lower bound at or above it.
+     * Zero, the default, keeps the instrumentation for the whole run.  May not
+     * be combined with #DRCOVLIB_THREAD_PRIVATE.
+     */
+    uint hit_count_threshold;
+    /**
+     * With #DRCOVLIB_BITMAP_HIT_COUNTS, once this many milliseconds have
+     * elapsed since drcovlib_init(), every instrumented block is flushed and
+     * rebuilt, and new blocks are built, without the counter increment.  Later
+     * executions are then not counted, though blocks still appear in the
+     * coverage bitmaps.  Zero, the default, sets no deadline.  May not be
+     * combined with #DRCOVLIB_THREAD_PRIVATE.
+     */
+    uint hit_count_deadline_ms;
 } drcovlib_options_t;
 
 /***************************************************************************
@@ -137,6 +183,37 @@ typedef struct _bb_entry_t {
     ushort mod_id;
 } bb_entry_t;
 
+/* bitmap file format version */
+#define DRCOV_BITMAP_VERSION 1
+
+/**
+ * Each module record in a #DRCOVLIB_DUMP_AS_BITMAP log file starts with this
+ * header.  See drcovlib_bitmap_offline_read() for the full format.
+ */
+typedef struct _drcovlib_bitmap_header_t {
+    uint64 size;     /**< The module size in bytes: one bit per byte. */
+    uint path_size;  /**< The size of the path, including its terminating null. */
+    uint num_counts; /**< The number of #drcovlib_bitmap_count_t entries. */
+} drcovlib_bitmap_header_t;
+
+/** A hit count in a #DRCOVLIB_DUMP_AS_BITMAP log file. */
+typedef struct _drcovlib_bitmap_count_t {
+    uint64 count;  /**< The number of times the block was executed. */
+    uint offset;   /**< The offset of the block start from the module base. */
+    uint reserved; /**< Set to 0. */
+} drcovlib_bitmap_count_t;
+
+/** One module's coverage as returned by drcovlib_bitmap_offline_next(). */
+typedef struct _drcovlib_bitmap_module_t {
+    const char *path;   /**< The full path of the module. */
+    uint64 size;        /**< The number of bits in \p bitmap. */
+    /** The bitmap: bit (i % 8) of byte (i / 8) represents offset i. */
+    const byte *bitmap;
+    uint num_counts;    /**< The number of entries in \p counts. */
+    /** The hit counts, as unaligned #drcovlib_bitmap_count_t entries. */
+    const byte *counts;
+} drcovlib_bitmap_module_t;
+
 /***************************************************************************
  * Coverage interface
  */
@@ -201,6 +278,88 @@ DR_EXPORT
 drcovlib_status_t
 drcovlib_dump(void *drcontext);
 
+DR_EXPORT
+/**
+ * Writes to \p log, which the caller opens and closes, a log file in the same
+ * format as drcovlib_dump() holding only the basic blocks first executed since
+ * the previous call to this routine, or since drcovlib_init() for the first
+ * call.  The module table is always complete.  If #DRCOVLIB_THREAD_PRIVATE is
+ * in effect, the blocks of every thread are included, including threads that
+ * exited since the previous call.  As with drcovlib_dump(), a block may be
+ * listed more than once, e.g., when executed by several threads.
+ *
+ * This does not affect the regular dump by drcovlib_exit() or by \p drcovlib's
+ * thread exit events, which still include every block.  It is not supported
+ * with #DRCOVLIB_DUMP_AS_BITMAP: see drcovlib_shared_map_create() for cheap
+ * per-iteration coverage in that case.
+ *
+ * @param[in] log  The file to write to.
+ * @param[out] num_new_bbs  If non-NULL, returns the number of blocks written.
+ *
+ * @return whether successful or an error code on failure.
+ */
+drcovlib_status_t
+drcovlib_dump_delta(file_t log, OUT uint *num_new_bbs);
+
+DR_EXPORT
+/**
+ * Creates a coverage map of \p num_slots 32-bit counters in the file \p path,
+ * which is mapped shared so that another process, such as a fuzzer, can map
+ * the same file and read or clear the counters with no file I/O.  On Linux a
+ * path under /dev/shm keeps the map in memory.  The file is not deleted by
+ * drcovlib_exit().
+ *
+ * Each basic block increments the counter at index ((offset + module index *
+ * 0x9e3779b1) % \p num_slots) every time it executes, where offset is the
+ * block start's offset from its module's base and the module index is that
+ * reported by drmodtrack_lookup().  Blocks outside of any module use their
+ * absolute address as the offset and 0 as the module index.  The increments
+ * are not atomic.  This inserts instrumentation, which uses the drreg
+ * extension with up to two spill slots.
+ *
+ * This must be called after drcovlib_init() and before any application code
+ * is executed, typically from dr_client_main(), and can only be called once.
+ *
+ * @param[in] path  The file to create or overwrite.
+ * @param[in] num_slots  The number of counters.
+ * @param[out] map  Returns the mapped counters.
+ *
+ * @return whether successful or an error code on failure.
+ */
+drcovlib_status_t
+drcovlib_shared_map_create(const char *path, uint num_slots, OUT uint **map);
+
+DR_EXPORT
+/**
+ * Usable from standalone mode (hence the "offline" name).  Parses the header
+ * of a #DRCOVLIB_DUMP_AS_BITMAP log file mapped at \p map.  Such a file starts
+ * with the same version and flavor lines as a regular log file, followed by
+ * the line "BB Bitmap: version %u, count %u, flags 0x%x" where count is the
+ * number of module records and flags holds the #DRCOVLIB_DUMP_AS_BITMAP,
+ * #DRCOVLIB_BITMAP_BB_START, and #DRCOVLIB_BITMAP_HIT_COUNTS flags it was
+ * written with.  Each module record follows with no alignment padding: a
+ * #drcovlib_bitmap_header_t, then the null-terminated path, then (size + 7) / 8
+ * bytes of bitmap, then the #drcovlib_bitmap_count_t hit counts.
+ *
+ * Returns the number of records in \p num_mods, the flags in \p flags, and a
+ * pointer to the first record, for use with drcovlib_bitmap_offline_next(), in
+ * \p records.  Returns DRCOVLIB_ERROR_NOT_FOUND if \p map holds a regular
+ * log file.
+ */
+drcovlib_status_t
+drcovlib_bitmap_offline_read(const char *map, size_t map_size, OUT uint *num_mods,
+                             OUT uint *flags, OUT const char **records);
+
+DR_EXPORT
+/**
+ * Usable from standalone mode.  Parses the module record at \p *pos, which
+ * must not extend past \p map_end, into \p module and advances \p *pos to
+ * the following record.  The fields of \p module point into the mapped file.
+ */
+drcovlib_status_t
+drcovlib_bitmap_offline_next(const char **pos INOUT, const char *map_end,
+                             OUT drcovlib_bitmap_module_t *module);
+
 /***************************************************************************
  * Module tracking
  */
@@ -276,6 +435,18 @@ DR_EXPORT
 drcovlib_status_t
 drmodtrack_lookup(void *drcontext, app_pc pc, OUT uint *mod_index, OUT app_pc *mod_base);
 
+DR_EXPORT
+/**
+ * Returns the index in \p containing_index, the bounds in \p start and \p size,
+ * and the path in \p path of the whole module containing the segment with index
+ * \p mod_index as returned by drmodtrack_lookup().  The returned \p start is the
+ * same \p mod_base returned by drmodtrack_lookup() for that segment.  If there is
+ * no such index, returns DRCOVLIB_ERROR_NOT_FOUND.
+ */
+drcovlib_status_t
+drmodtrack_lookup_module(uint mod_index, OUT uint *containing_index, OUT app_pc *start,
+                         OUT size_t *size, OUT const char **path);
+
 DR_EXPORT
 /**
  * Writes the complete module information to \p file.  The information can be read
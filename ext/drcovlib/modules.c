@@ -32,6 +32,7 @@
 
 #include "dr_api.h"
 #include "drvector.h"
+#include "hashtable.h"
 #include "drcovlib.h"
 #include "drcovlib_private.h"
 #include <string.h>
@@ -43,6 +44,8 @@
 #define NUM_GLOBAL_MODULE_CACHE 8
 #define NUM_THREAD_MODULE_CACHE 4
 
+#define MODULE_START_HASH_BITS 8
+
 typedef struct _module_entry_t {
     uint id;
     uint containing_id;
@@ -64,6 +67,18 @@ typedef struct _module_table_t {
     drvector_t vector;
     /* for quick query without lock, assuming pointer-aligned */
     module_entry_t *cache[NUM_GLOBAL_MODULE_CACHE];
+    /* Maps a module base to the most recent main entry loaded there, so that
+     * load and unload events need not scan the whole vector when an app loads
+     * hundreds of libraries.  Protected by the vector lock.
+     */
+    hashtable_t start_index;
+    /* The loaded entries (including segments) sorted by start address, so a
+     * thread-cache miss is a binary search rather than a scan of every module
+     * ever loaded.  Protected by the vector lock.
+     */
+    module_entry_t **sorted;
+    uint num_sorted;
+    uint sorted_capacity;
 } module_table_t;
 
 typedef struct _per_thread_t {
@@ -112,6 +127,62 @@ thread_module_cache_add(module_entry_t **cache, uint cache_size,
     thread_module_cache_adjust(cache, entry, cache_size - 1, cache_size);
 }
 
+/* Returns the index of the last sorted entry whose start is <= pc, or -1.
+ * Caller must hold the vector lock.
+ */
+static int
+sorted_find(app_pc pc)
+{
+    int lo = 0, hi = (int)module_table.num_sorted - 1;
+    while (lo <= hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (module_table.sorted[mid]->start <= pc)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return hi;
+}
+
+/* Caller must hold the vector lock. */
+static void
+sorted_insert(module_entry_t *entry)
+{
+    int pos = sorted_find(entry->start) + 1;
+    if (module_table.num_sorted == module_table.sorted_capacity) {
+        uint new_cap = module_table.sorted_capacity * 2;
+        module_entry_t **grown = dr_global_alloc(new_cap * sizeof(*grown));
+        memcpy(grown, module_table.sorted,
+               module_table.num_sorted * sizeof(*grown));
+        dr_global_free(module_table.sorted,
+                       module_table.sorted_capacity * sizeof(*grown));
+        module_table.sorted = grown;
+        module_table.sorted_capacity = new_cap;
+    }
+    memmove(&module_table.sorted[pos + 1], &module_table.sorted[pos],
+            (module_table.num_sorted - pos) * sizeof(*module_table.sorted));
+    module_table.sorted[pos] = entry;
+    module_table.num_sorted++;
+}
+
+/* Caller must hold the vector lock. */
+static void
+sorted_remove(module_entry_t *entry)
+{
+    int pos;
+    /* Entries with the same start are adjacent, so walk back from the last. */
+    for (pos = sorted_find(entry->start);
+         pos >= 0 && module_table.sorted[pos]->start == entry->start; pos--) {
+        if (module_table.sorted[pos] == entry) {
+            module_table.num_sorted--;
+            memmove(&module_table.sorted[pos], &module_table.sorted[pos + 1],
+                    (module_table.num_sorted - pos) * sizeof(*module_table.sorted));
+            return;
+        }
+    }
+    ASSERT(false, "module entry missing from sorted list");
+}
+
 static void
 module_table_entry_free(void *tofree)
 {
@@ -124,24 +195,12 @@ module_table_entry_free(void *tofree)
     dr_global_free(entry, sizeof(module_entry_t));
 }
 
-static void
-event_module_load(void *drcontext, const module_data_t *data, bool loaded)
+/* Returns whether entry is an unloaded main entry that can be re-used for data. */
+static bool
+module_entry_matches(module_entry_t *entry, const module_data_t *data)
 {
-    module_entry_t *entry = NULL;
-    module_data_t  *mod;
-    int i;
-    /* Some apps repeatedly unload and reload the same module,
-     * so we will try to re-use the old one.
-     */
-    ASSERT(data != NULL, "data must not be NULL");
-    drvector_lock(&module_table.vector);
-    /* Assuming most recently loaded entries are most likely to be unloaded,
-     * we iterate the module table in a backward way for better performance.
-     */
-    for (i = module_table.vector.entries-1; i >= 0; i--) {
-        entry = drvector_get_entry(&module_table.vector, i);
-        mod   = entry->data;
-        if (entry->unload &&
+    module_data_t *mod = entry->data;
+    return (entry->unload &&
             /* Only check the main (containing) module.
              * This is necessary because the loop is backward.
              */
@@ -162,19 +221,47 @@ event_module_load(void *drcontext, const module_data_t *data, bool loaded)
             dr_module_preferred_name(data) != NULL &&
             dr_module_preferred_name(mod)  != NULL &&
             strcmp(dr_module_preferred_name(data),
-                   dr_module_preferred_name(mod)) == 0) {
+                   dr_module_preferred_name(mod)) == 0);
+}
+
+static void
+event_module_load(void *drcontext, const module_data_t *data, bool loaded)
+{
+    module_entry_t *entry = NULL;
+    int i;
+    /* Some apps repeatedly unload and reload the same module,
+     * so we will try to re-use the old one.
+     */
+    ASSERT(data != NULL, "data must not be NULL");
+    drvector_lock(&module_table.vector);
+    /* Only an entry with the same base can be re-used.  The most recent entry
+     * there is usually the one, so we only scan the rest of the table if it
+     * does not match.
+     */
+    entry = hashtable_lookup(&module_table.start_index, data->start);
+    i = (entry == NULL) ? -1 :
+        (module_entry_matches(entry, data) ? entry->id : module_table.vector.entries-1);
+    /* Assuming most recently loaded entries are most likely to be unloaded,
+     * we iterate the module table in a backward way for better performance.
+     */
+    for (; i >= 0; i--) {
+        entry = drvector_get_entry(&module_table.vector, i);
+        if (module_entry_matches(entry, data)) {
             entry->unload = false;
+            sorted_insert(entry);
+            hashtable_add_replace(&module_table.start_index, entry->start, entry);
 #ifndef WINDOWS
-            if (!mod->contiguous) {
+            if (!entry->data->contiguous) {
                 int j;
                 /* Find subsequent non-contiguous entries. */
                 for (j = i + 1; j < module_table.vector.entries; j++) {
                     module_entry_t *sub_entry =
                         drvector_get_entry(&module_table.vector, j);
                     ASSERT(sub_entry != NULL, "fail to get module entry");
-                    if (sub_entry->containing_id == entry->id)
+                    if (sub_entry->containing_id == entry->id) {
                         sub_entry->unload = false;
-                    else
+                        sorted_insert(sub_entry);
+                    } else
                         break;
                 }
             }
@@ -194,6 +281,8 @@ event_module_load(void *drcontext, const module_data_t *data, bool loaded)
         if (module_load_cb != NULL)
             entry->custom = module_load_cb(entry->data);
         drvector_append(&module_table.vector, entry);
+        sorted_insert(entry);
+        hashtable_add_replace(&module_table.start_index, entry->start, entry);
 #ifndef WINDOWS
         if (!data->contiguous) {
             uint j;
@@ -216,6 +305,7 @@ event_module_load(void *drcontext, const module_data_t *data, bool loaded)
                 sub_entry->data = entry->data;
                 sub_entry->custom = entry->custom;
                 drvector_append(&module_table.vector, sub_entry);
+                sorted_insert(sub_entry);
                 global_module_cache_add(module_table.cache, sub_entry);
             }
         }
@@ -277,15 +367,11 @@ drmodtrack_lookup(void *drcontext, app_pc pc, OUT uint *mod_index, OUT app_pc *m
     /* lookup module table */
     entry = NULL;
     drvector_lock(&module_table.vector);
-    for (i = module_table.vector.entries - 1; i >= 0; i--) {
-        entry = drvector_get_entry(&module_table.vector, i);
-        ASSERT(entry != NULL, "fail to get module entry");
-        if (pc_is_in_module(entry, pc)) {
-            global_module_cache_add(module_table.cache, entry);
-            thread_module_cache_add(data->cache, NUM_THREAD_MODULE_CACHE, entry);
-            break;
-        }
-        entry = NULL;
+    i = sorted_find(pc);
+    if (i >= 0 && pc_is_in_module(module_table.sorted[i], pc)) {
+        entry = module_table.sorted[i];
+        global_module_cache_add(module_table.cache, entry);
+        thread_module_cache_add(data->cache, NUM_THREAD_MODULE_CACHE, entry);
     }
     if (entry != NULL)
         lookup_helper_set_fields(entry, mod_index, mod_base);
@@ -293,24 +379,52 @@ drmodtrack_lookup(void *drcontext, app_pc pc, OUT uint *mod_index, OUT app_pc *m
     return entry == NULL ? DRCOVLIB_ERROR_NOT_FOUND : DRCOVLIB_SUCCESS;
 }
 
+drcovlib_status_t
+drmodtrack_lookup_module(uint mod_index, OUT uint *containing_index, OUT app_pc *start,
+                         OUT size_t *size, OUT const char **path)
+{
+    module_entry_t *entry;
+    /* Entries are never removed and their data never changes, xref
+     * drmodtrack_lookup().
+     */
+    entry = drvector_get_entry(&module_table.vector, mod_index);
+    if (entry == NULL)
+        return DRCOVLIB_ERROR_NOT_FOUND;
+    *containing_index = entry->containing_id;
+    *start = entry->data->start;
+    *size = entry->data->end - entry->data->start;
+    if (entry->data->full_path != NULL && entry->data->full_path[0] != '\0')
+        *path = entry->data->full_path;
+    else
+        *path = "<unknown>";
+    return DRCOVLIB_SUCCESS;
+}
+
 static void
 event_module_unload(void *drcontext, const module_data_t *data)
 {
     module_entry_t *entry = NULL;
     int i;
     drvector_lock(&module_table.vector);
-    for (i = module_table.vector.entries - 1; i >= 0; i--) {
-        entry = drvector_get_entry(&module_table.vector, i);
-        ASSERT(entry != NULL, "fail to get module entry");
-        /* Only check the main (containing) module.
-         * This is necessary because the loop is backward.
-         */
-        if (entry->id == entry->containing_id && pc_is_in_module(entry, data->start))
-            break;
-        entry = NULL;
+    entry = hashtable_lookup(&module_table.start_index, data->start);
+    if (entry != NULL && pc_is_in_module(entry, data->start))
+        i = entry->id;
+    else {
+        for (i = module_table.vector.entries - 1; i >= 0; i--) {
+            entry = drvector_get_entry(&module_table.vector, i);
+            ASSERT(entry != NULL, "fail to get module entry");
+            /* Only check the main (containing) module.
+             * This is necessary because the loop is backward.
+             */
+            if (entry->id == entry->containing_id &&
+                pc_is_in_module(entry, data->start))
+                break;
+            entry = NULL;
+        }
     }
     if (entry != NULL) {
         entry->unload = true;
+        sorted_remove(entry);
 #ifndef WINDOWS
         if (!data->contiguous) {
             int j;
@@ -318,9 +432,10 @@ event_module_unload(void *drcontext, const module_data_t *data)
             for (j = i + 1; j < module_table.vector.entries; j++) {
                 module_entry_t *sub_entry = drvector_get_entry(&module_table.vector, j);
                 ASSERT(sub_entry != NULL, "fail to get module entry");
-                if (sub_entry->containing_id == entry->id)
+                if (sub_entry->containing_id == entry->id) {
                     sub_entry->unload = true;
-                else
+                    sorted_remove(sub_entry);
+                } else
                     break;
             }
         }
@@ -366,6 +481,12 @@ drmodtrack_init(void)
 
     memset(module_table.cache, 0, sizeof(module_table.cache));
     drvector_init(&module_table.vector, 16, false, module_table_entry_free);
+    hashtable_init_ex(&module_table.start_index, MODULE_START_HASH_BITS, HASH_INTPTR,
+                      false/*!strdup*/, false/*!synch*/, NULL, NULL, NULL);
+    module_table.num_sorted = 0;
+    module_table.sorted_capacity = 16;
+    module_table.sorted = dr_global_alloc(module_table.sorted_capacity *
+                                          sizeof(*module_table.sorted));
 
     return DRCOVLIB_SUCCESS;
 }
@@ -378,6 +499,9 @@ drmodtrack_exit(void)
         return DRCOVLIB_SUCCESS;
 
     drmgr_unregister_tls_field(tls_idx);
+    hashtable_delete(&module_table.start_index);
+    dr_global_free(module_table.sorted,
+                   module_table.sorted_capacity * sizeof(*module_table.sorted));
     drvector_delete(&module_table.vector);
     drmgr_exit();
     return DRCOVLIB_SUCCESS;
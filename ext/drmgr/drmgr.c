@@ -90,10 +90,23 @@ typedef struct _priority_event_entry_t {
 } priority_event_entry_t;
 
 
+/* Per-pass build-time accounting, kept separate from the cb_entry_t so
+ * that it survives unregistration and the per-event local copies of the
+ * callback lists.  Entries are only freed in drmgr_exit().
+ */
+typedef struct _pass_stats_t {
+    drmgr_pass_stats_t data;
+    char name[64];
+    struct _pass_stats_t *next;
+} pass_stats_t;
+
 /* bb event list entry */
 typedef struct _cb_entry_t {
     priority_event_entry_t pri;
+    pass_stats_t *stats;
     bool has_quartet;
+    uint filter;   /* DRMGR_INSTR_FILTER_* for insertion, or 0 for all instrs */
+    uint data_idx; /* index into the pair or quartet user_data: snapshots only */
     union {
         drmgr_xform_cb_t xform_cb;
         struct {
@@ -197,6 +210,33 @@ static cb_list_t cblist_instru2instru;
 static uint pair_count;
 static uint quartet_count;
 
+/* An immutable copy of the valid entries of the bb lists, rebuilt on every
+ * registration change so that bb events need neither a lock nor a private
+ * copy.  Replaced snapshots may still be in use by in-flight bb events, so
+ * we keep them until exit: registration changes are rare.
+ */
+typedef struct _bb_snapshot_t {
+    cb_entry_t *app2app;
+    cb_entry_t *insert;
+    cb_entry_t *instru;
+    uint num_app2app;
+    uint num_insert;
+    uint num_instru;
+    uint pair_count;
+    uint quartet_count;
+    bool any_filter; /* any insertion pass has an instr filter */
+    struct _bb_snapshot_t *retired_next;
+} bb_snapshot_t;
+
+/* Written under bb_cb_lock, read without it */
+static bb_snapshot_t *volatile bb_snapshot;
+/* Replaced snapshots, protected by bb_cb_lock */
+static bb_snapshot_t *bb_snapshot_retired;
+/* Stands in before anything is registered */
+static bb_snapshot_t bb_snapshot_empty;
+/* Used purely as a barrier when publishing a snapshot */
+static volatile int bb_snapshot_version;
+
 /* Priority used for non-_ex events */
 static const drmgr_priority_t default_priority = {
     sizeof(default_priority), "__DEFAULT__", NULL, NULL, 0
@@ -204,6 +244,13 @@ static const drmgr_priority_t default_priority = {
 
 static int our_tls_idx;
 
+/* Build-time accounting of bb passes.  The list is protected by
+ * pass_stats_lock, which is also used for updating the counters.
+ */
+static bool pass_stats_enabled;
+static pass_stats_t *pass_stats_list;
+static void *pass_stats_lock;
+
 static dr_emit_flags_t
 drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
                bool for_trace, bool translating);
@@ -214,6 +261,9 @@ drmgr_bb_init(void);
 static void
 drmgr_bb_exit(void);
 
+static void
+drmgr_pass_stats_exit(void);
+
 /* Size of tls/cls arrays.  In order to support slot access from the
  * code cache, this number cannot be changed dynamically.  We could
  * make it a runtime parameter, but that would add another level of
@@ -229,6 +279,12 @@ drmgr_bb_exit(void);
 typedef struct _tls_array_t {
     void *tls[MAX_NUM_TLS];
     void *cls[MAX_NUM_TLS];
+    /* This thread's base for the raw tls slots backing fast tls fields. */
+    byte *raw_seg_base;
+    /* Callback entries made at this level while no cls fields were registered,
+     * for which we did not push a new level.  Their pops are skipped to match.
+     */
+    uint skipped_pushes;
     struct _tls_array_t *prev;
     struct _tls_array_t *next;
 } tls_array_t;
@@ -236,8 +292,24 @@ typedef struct _tls_array_t {
 /* Whether each slot is reserved.  Protected by tls_lock. */
 static bool tls_taken[MAX_NUM_TLS];
 static bool cls_taken[MAX_NUM_TLS];
+/* Number of registered cls fields.  Written under tls_lock. */
+static uint num_cls_fields;
 static void *tls_lock;
 
+/* Fields from drmgr_register_fast_tls_field() are stored in raw tls slots
+ * rather than in tls_array_t, so they can be accessed from the cache with a
+ * single segment-relative load or store.  The block of raw slots is only
+ * allocated on the first such request, as raw slots are scarce and shared
+ * by all components.  Protected by tls_lock.
+ */
+#define MAX_NUM_RAW_TLS 8
+static reg_id_t tls_raw_reg;
+static uint tls_raw_base;
+static bool tls_raw_allocated;
+static bool raw_taken[MAX_NUM_RAW_TLS];
+/* The raw slot storing each tls index, or -1 if it lives in tls_array_t. */
+static int tls_raw_slot[MAX_NUM_TLS];
+
 static void *note_lock;
 
 /* Thread event cbs and rwlock */
@@ -345,10 +417,12 @@ drmgr_init(void)
 {
     /* handle multiple sets of init/exit calls */
     int count = dr_atomic_add32_return_sum(&drmgr_init_count, 1);
+    int i;
     if (count > 1)
         return true;
 
     note_lock = dr_mutex_create();
+    pass_stats_lock = dr_mutex_create();
 
     bb_cb_lock = dr_rwlock_create();
     thread_event_lock = dr_rwlock_create();
@@ -384,6 +458,11 @@ drmgr_init(void)
     drmgr_bb_init();
     drmgr_event_init();
 
+    /* Asking for no slots just tells us the register. */
+    dr_raw_tls_calloc(&tls_raw_reg, &tls_raw_base, 0, 0);
+    for (i = 0; i < MAX_NUM_TLS; i++)
+        tls_raw_slot[i] = -1;
+
     our_tls_idx = drmgr_register_tls_field();
     if (!drmgr_register_thread_init_event(our_thread_init_event) ||
         !drmgr_register_thread_exit_event(our_thread_exit_event))
@@ -405,8 +484,15 @@ drmgr_exit(void)
     drmgr_unregister_thread_init_event(our_thread_init_event);
     drmgr_unregister_thread_exit_event(our_thread_exit_event);
 
+    if (tls_raw_allocated) {
+        dr_raw_tls_cfree(tls_raw_base, MAX_NUM_RAW_TLS);
+        tls_raw_allocated = false;
+        memset(raw_taken, 0, sizeof(raw_taken));
+    }
+
     drmgr_bb_exit();
     drmgr_event_exit();
+    drmgr_pass_stats_exit();
 
     dr_unregister_thread_init_event(drmgr_thread_init_event);
     dr_unregister_thread_exit_event(drmgr_thread_exit_event);
@@ -446,6 +532,7 @@ drmgr_exit(void)
     dr_rwlock_destroy(thread_event_lock);
     dr_rwlock_destroy(bb_cb_lock);
 
+    dr_mutex_destroy(pass_stats_lock);
     dr_mutex_destroy(note_lock);
 }
 
@@ -552,6 +639,110 @@ cblist_delete_local(void *drcontext, cb_list_t *l, size_t local_num)
  * BB EVENTS
  */
 
+/* Copies the valid entries of src into a new array and assigns each entry its
+ * user_data index.  Returns NULL if there are none.
+ */
+static cb_entry_t *
+bb_snapshot_copy(cb_list_t *src, uint *num OUT, bool *any_filter OUT)
+{
+    cb_entry_t *array;
+    uint i, count = 0, pair_idx = 0, quartet_idx = 0;
+    for (i = 0; i < src->num; i++) {
+        if (src->cbs.bb[i].pri.valid)
+            count++;
+    }
+    *num = count;
+    if (count == 0)
+        return NULL;
+    array = dr_global_alloc(count * sizeof(*array));
+    for (count = 0, i = 0; i < src->num; i++) {
+        cb_entry_t *e = &src->cbs.bb[i];
+        if (!e->pri.valid)
+            continue;
+        array[count] = *e;
+        if (e->has_quartet)
+            array[count].data_idx = quartet_idx++;
+        else
+            array[count].data_idx = pair_idx++;
+        if (e->filter != 0)
+            *any_filter = true;
+        count++;
+    }
+    return array;
+}
+
+static void
+bb_snapshot_free(bb_snapshot_t *snap)
+{
+    if (snap->app2app != NULL)
+        dr_global_free(snap->app2app, snap->num_app2app * sizeof(cb_entry_t));
+    if (snap->insert != NULL)
+        dr_global_free(snap->insert, snap->num_insert * sizeof(cb_entry_t));
+    if (snap->instru != NULL)
+        dr_global_free(snap->instru, snap->num_instru * sizeof(cb_entry_t));
+    dr_global_free(snap, sizeof(*snap));
+}
+
+/* Caller must hold the bb_cb_lock write lock. */
+static void
+bb_snapshot_rebuild(void)
+{
+    bb_snapshot_t *snap = dr_global_alloc(sizeof(*snap));
+    bool unused;
+    snap->any_filter = false;
+    snap->app2app = bb_snapshot_copy(&cblist_app2app, &snap->num_app2app, &unused);
+    snap->insert = bb_snapshot_copy(&cblist_instrumentation, &snap->num_insert,
+                                    &snap->any_filter);
+    snap->instru = bb_snapshot_copy(&cblist_instru2instru, &snap->num_instru,
+                                    &unused);
+    snap->pair_count = pair_count;
+    snap->quartet_count = quartet_count;
+    snap->retired_next = NULL;
+    /* The snapshot must be complete before it is visible: the atomic add is
+     * a full barrier on x86, and on other architectures readers take the
+     * lock (see bb_snapshot_get()).
+     */
+    dr_atomic_add32_return_sum(&bb_snapshot_version, 1);
+    if (bb_snapshot != NULL) {
+        bb_snapshot->retired_next = bb_snapshot_retired;
+        bb_snapshot_retired = bb_snapshot;
+    }
+    bb_snapshot = snap;
+}
+
+static bb_snapshot_t *
+bb_snapshot_get(void)
+{
+    bb_snapshot_t *snap;
+#ifdef X86
+    /* x86 does not reorder stores, so a published snapshot is complete. */
+    snap = bb_snapshot;
+#else
+    /* XXX: DR exports no memory barrier for extensions, so on weaker memory
+     * models we rely on the lock to order our reads after the publication.
+     */
+    dr_rwlock_read_lock(bb_cb_lock);
+    snap = bb_snapshot;
+    dr_rwlock_read_unlock(bb_cb_lock);
+#endif
+    if (snap == NULL)
+        return &bb_snapshot_empty;
+    return snap;
+}
+
+static uint
+instr_filter_kind(instr_t *inst)
+{
+    uint kind = 0;
+    if (!instr_is_app(inst))
+        return 0;
+    if (instr_reads_memory(inst) || instr_writes_memory(inst))
+        kind |= DRMGR_INSTR_FILTER_MEMREF;
+    if (instr_is_cti(inst))
+        kind |= DRMGR_INSTR_FILTER_CTI;
+    return kind;
+}
+
 /* To support multiple non-meta ctis in app2app phase, we mark them meta
  * before handing to DR to satisfy its bb constraints
  */
@@ -581,6 +772,127 @@ drmgr_fix_app_ctis(void *drcontext, instrlist_t *bb)
     }
 }
 
+/* Counts the instrs strictly between start and end, where NULL for start
+ * means the head of bb and NULL for end means its tail.
+ */
+static int
+count_instrs_between(instrlist_t *bb, instr_t *start, instr_t *end)
+{
+    int count = 0;
+    instr_t *inst;
+    for (inst = (start == NULL) ? instrlist_first(bb) : instr_get_next(start);
+         inst != end; inst = instr_get_next(inst))
+        count++;
+    return count;
+}
+
+static uint
+count_app_instrs(instrlist_t *bb)
+{
+    uint count = 0;
+    instr_t *inst;
+    for (inst = instrlist_first_app(bb); inst != NULL; inst = instr_get_next_app(inst))
+        count++;
+    return count;
+}
+
+static void
+pass_stats_start(instrlist_t *bb, instr_t *start, instr_t *end,
+                 int *pre_count OUT, uint64 *start_time OUT)
+{
+    *pre_count = count_instrs_between(bb, start, end);
+    *start_time = dr_get_microseconds();
+}
+
+/* The per-callback times are coarse at microsecond granularity but the sums
+ * are unbiased since we difference a single clock.
+ */
+static void
+pass_stats_stop(pass_stats_t *stats, instrlist_t *bb, instr_t *start, instr_t *end,
+                int pre_count, uint64 start_time, bool new_bb, uint num_app)
+{
+    uint64 elapsed = dr_get_microseconds() - start_time;
+    int post_count = count_instrs_between(bb, start, end);
+    dr_mutex_lock(pass_stats_lock);
+    stats->data.microseconds += elapsed;
+    stats->data.instrs_added += post_count - pre_count;
+    if (new_bb) {
+        stats->data.bb_count++;
+        stats->data.app_instrs += num_app;
+    }
+    dr_mutex_unlock(pass_stats_lock);
+}
+
+static pass_stats_t *
+pass_stats_create(const char *name, drmgr_bb_phase_t phase)
+{
+    pass_stats_t *stats = dr_global_alloc(sizeof(*stats));
+    memset(stats, 0, sizeof(*stats));
+    dr_snprintf(stats->name, BUFFER_SIZE_ELEMENTS(stats->name), "%s", name);
+    stats->name[BUFFER_SIZE_ELEMENTS(stats->name) - 1] = '\0';
+    stats->data.struct_size = sizeof(stats->data);
+    stats->data.name = stats->name;
+    stats->data.phase = phase;
+    dr_mutex_lock(pass_stats_lock);
+    /* Append so indices stay stable and follow registration order. */
+    if (pass_stats_list == NULL)
+        pass_stats_list = stats;
+    else {
+        pass_stats_t *last;
+        for (last = pass_stats_list; last->next != NULL; last = last->next)
+            ; /* nothing */
+        last->next = stats;
+    }
+    dr_mutex_unlock(pass_stats_lock);
+    return stats;
+}
+
+static void
+drmgr_pass_stats_exit(void)
+{
+    pass_stats_t *stats, *next;
+    for (stats = pass_stats_list; stats != NULL; stats = next) {
+        next = stats->next;
+        if (pass_stats_enabled) {
+            dr_log(NULL, DR_LOG_ALL, 1, "drmgr pass %s phase %d: "
+                   UINT64_FORMAT_STRING" bbs, "UINT64_FORMAT_STRING" app instrs, "
+                   INT64_FORMAT_STRING" instrs added, "UINT64_FORMAT_STRING" us\n",
+                   stats->name, stats->data.phase,
+                   stats->data.bb_count, stats->data.app_instrs,
+                   stats->data.instrs_added, stats->data.microseconds);
+        }
+        dr_global_free(stats, sizeof(*stats));
+    }
+    pass_stats_list = NULL;
+    pass_stats_enabled = false;
+}
+
+DR_EXPORT
+bool
+drmgr_enable_pass_stats(bool enable)
+{
+    pass_stats_enabled = enable;
+    return true;
+}
+
+DR_EXPORT
+bool
+drmgr_get_pass_stats(uint index, drmgr_pass_stats_t *stats OUT)
+{
+    pass_stats_t *entry;
+    uint i;
+    if (stats == NULL || stats->struct_size < sizeof(*stats))
+        return false;
+    dr_mutex_lock(pass_stats_lock);
+    for (entry = pass_stats_list, i = 0; entry != NULL && i < index;
+         entry = entry->next, i++)
+        ; /* nothing */
+    if (entry != NULL)
+        *stats = entry->data;
+    dr_mutex_unlock(pass_stats_lock);
+    return entry != NULL;
+}
+
 static dr_emit_flags_t
 drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
                bool for_trace, bool translating)
@@ -590,70 +902,71 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
     dr_emit_flags_t res = DR_EMIT_DEFAULT;
     instr_t *inst, *next_inst;
     void **pair_data = NULL, **quartet_data = NULL;
-    uint pair_idx, quartet_idx;
-    cb_entry_t local_app2app[EVENTS_STACK_SZ];
-    cb_entry_t local_insert[EVENTS_STACK_SZ];
-    cb_entry_t local_instru[EVENTS_STACK_SZ];
-    cb_list_t iter_app2app;
-    cb_list_t iter_insert;
-    cb_list_t iter_instru;
-    per_thread_t *pt = (per_thread_t *) drmgr_get_tls_field(drcontext, our_tls_idx);
-
-    dr_rwlock_read_lock(bb_cb_lock);
-    /* We use arrays to more easily support unregistering while in an event (i#1356).
-     * With arrays we can make a temporary copy and avoid holding a lock while
-     * delivering events.
+    /* Unregistering while in an event (i#1356) simply publishes a new
+     * snapshot: we keep using the one we started with.
      */
-    cblist_create_local(drcontext, &cblist_app2app, &iter_app2app,
-                        (byte *)local_app2app, BUFFER_SIZE_ELEMENTS(local_app2app));
-    cblist_create_local(drcontext, &cblist_instrumentation, &iter_insert,
-                        (byte *)local_insert, BUFFER_SIZE_ELEMENTS(local_insert));
-    cblist_create_local(drcontext, &cblist_instru2instru, &iter_instru,
-                        (byte *)local_instru, BUFFER_SIZE_ELEMENTS(local_instru));
-    dr_rwlock_read_unlock(bb_cb_lock);
+    bb_snapshot_t *snap = bb_snapshot_get();
+    uint inst_kind = 0;
+    per_thread_t *pt = (per_thread_t *) drmgr_get_tls_field(drcontext, our_tls_idx);
+    /* Read once so a concurrent toggle does not leave a pass half-measured. */
+    bool measure = pass_stats_enabled;
+    uint num_app = 0;
+    int pre_count = 0;
+    uint64 start = 0;
+    instr_t *pre_prev = NULL;
 
     /* We need per-thread user_data */
-    if (pair_count > 0)
-        pair_data = (void **) dr_thread_alloc(drcontext, sizeof(void*)*pair_count);
-    if (quartet_count > 0)
-        quartet_data = (void **) dr_thread_alloc(drcontext, sizeof(void*)*quartet_count);
+    if (snap->pair_count > 0) {
+        pair_data = (void **)
+            dr_thread_alloc(drcontext, sizeof(void*)*snap->pair_count);
+    }
+    if (snap->quartet_count > 0) {
+        quartet_data = (void **)
+            dr_thread_alloc(drcontext, sizeof(void*)*snap->quartet_count);
+    }
 
     /* Pass 1: app2app */
     /* XXX: better to avoid all this set_tls overhead and assume DR is globally
      * synchronizing bb building anyway and use a global var + mutex?
      */
     pt->cur_phase = DRMGR_PHASE_APP2APP;
-    for (quartet_idx = 0, i = 0; i < iter_app2app.num; i++) {
-        e = &iter_app2app.cbs.bb[i];
-        if (!e->pri.valid)
-            continue;
+    if (measure)
+        num_app = count_app_instrs(bb);
+    for (i = 0; i < snap->num_app2app; i++) {
+        e = &snap->app2app[i];
+        if (measure)
+            pass_stats_start(bb, NULL, NULL, &pre_count, &start);
         if (e->has_quartet) {
             res |= (*e->cb.app2app_ex_cb)
-                (drcontext, tag, bb, for_trace, translating, &quartet_data[quartet_idx]);
-            quartet_idx++;
+                (drcontext, tag, bb, for_trace, translating, &quartet_data[e->data_idx]);
         } else
             res |= (*e->cb.xform_cb)(drcontext, tag, bb, for_trace, translating);
+        if (measure)
+            pass_stats_stop(e->stats, bb, NULL, NULL, pre_count, start, true, num_app);
     }
 
     /* Pass 2: analysis */
     pt->cur_phase = DRMGR_PHASE_ANALYSIS;
-    for (quartet_idx = 0, pair_idx = 0, i = 0; i < iter_insert.num; i++) {
-        e = &iter_insert.cbs.bb[i];
-        if (!e->pri.valid)
-            continue;
+    if (measure)
+        num_app = count_app_instrs(bb);
+    for (i = 0; i < snap->num_insert; i++) {
+        e = &snap->insert[i];
+        if (measure)
+            pass_stats_start(bb, NULL, NULL, &pre_count, &start);
         if (e->has_quartet) {
             res |= (*e->cb.pair_ex.analysis_ex_cb)
-                (drcontext, tag, bb, for_trace, translating, quartet_data[quartet_idx]);
-            quartet_idx++;
+                (drcontext, tag, bb, for_trace, translating, quartet_data[e->data_idx]);
         } else {
             if (e->cb.pair.analysis_cb == NULL) {
-                pair_data[pair_idx] = NULL;
+                pair_data[e->data_idx] = NULL;
             } else {
                 res |= (*e->cb.pair.analysis_cb)
-                    (drcontext, tag, bb, for_trace, translating, &pair_data[pair_idx]);
+                    (drcontext, tag, bb, for_trace, translating,
+                     &pair_data[e->data_idx]);
             }
-            pair_idx++;
         }
+        if (measure)
+            pass_stats_stop(e->stats, bb, NULL, NULL, pre_count, start, true, num_app);
         /* XXX: add checks that cb followed the rules */
     }
 
@@ -663,9 +976,11 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
     pt->last_app = instrlist_last(bb);
     for (inst = instrlist_first(bb); inst != NULL; inst = next_inst) {
         next_inst = instr_get_next(inst);
-        for (quartet_idx = 0, pair_idx = 0, i = 0; i < iter_insert.num; i++) {
-            e = &iter_insert.cbs.bb[i];
-            if (!e->pri.valid)
+        if (snap->any_filter)
+            inst_kind = instr_filter_kind(inst);
+        for (i = 0; i < snap->num_insert; i++) {
+            e = &snap->insert[i];
+            if (e->filter != 0 && !TESTANY(e->filter, inst_kind))
                 continue;
             /* Most client instrumentation wants to be predicated to match the app
              * instruction, so we do it by default (i#1723). Clients may opt-out
@@ -673,18 +988,27 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
              * insertion bb event.
              */
             instrlist_set_auto_predicate(bb, instr_get_predicate(inst));
+            if (measure) {
+                /* Insertion may only add instrs around inst, so we only
+                 * count that range rather than the whole list.
+                 */
+                pre_prev = instr_get_prev(inst);
+                pass_stats_start(bb, pre_prev, next_inst, &pre_count, &start);
+            }
             if (e->has_quartet) {
                 res |= (*e->cb.pair_ex.insertion_ex_cb)
                     (drcontext, tag, bb, inst, for_trace, translating,
-                     quartet_data[quartet_idx]);
-                quartet_idx++;
+                     quartet_data[e->data_idx]);
             } else {
                 if (e->cb.pair.insertion_cb != NULL) {
                     res |= (*e->cb.pair.insertion_cb)
                         (drcontext, tag, bb, inst, for_trace, translating,
-                         pair_data[pair_idx]);
+                         pair_data[e->data_idx]);
                 }
-                pair_idx++;
+            }
+            if (measure) {
+                pass_stats_stop(e->stats, bb, pre_prev, next_inst, pre_count, start,
+                                false, 0);
             }
             instrlist_set_auto_predicate(bb, DR_PRED_NONE);
             /* XXX: add checks that cb followed the rules */
@@ -693,16 +1017,17 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
 
     /* Pass 4: final */
     pt->cur_phase = DRMGR_PHASE_INSTRU2INSTRU;
-    for (quartet_idx = 0, i = 0; i < iter_instru.num; i++) {
-        e = &iter_instru.cbs.bb[i];
-        if (!e->pri.valid)
-            continue;
+    for (i = 0; i < snap->num_instru; i++) {
+        e = &snap->instru[i];
+        if (measure)
+            pass_stats_start(bb, NULL, NULL, &pre_count, &start);
         if (e->has_quartet) {
             res |= (*e->cb.instru2instru_ex_cb)
-                (drcontext, tag, bb, for_trace, translating, quartet_data[quartet_idx]);
-            quartet_idx++;
+                (drcontext, tag, bb, for_trace, translating, quartet_data[e->data_idx]);
         } else
             res |= (*e->cb.xform_cb)(drcontext, tag, bb, for_trace, translating);
+        if (measure)
+            pass_stats_stop(e->stats, bb, NULL, NULL, pre_count, start, true, num_app);
     }
 
     /* Pass 5: our private pass to support multiple non-meta ctis in app2app phase */
@@ -723,14 +1048,10 @@ drmgr_bb_event(void *drcontext, void *tag, instrlist_t *bb,
 
     pt->cur_phase = DRMGR_PHASE_NONE;
 
-    if (pair_count > 0)
-        dr_thread_free(drcontext, pair_data, sizeof(void*)*pair_count);
-    if (quartet_count > 0)
-        dr_thread_free(drcontext, quartet_data, sizeof(void*)*quartet_count);
-
-    cblist_delete_local(drcontext, &iter_app2app, BUFFER_SIZE_ELEMENTS(local_app2app));
-    cblist_delete_local(drcontext, &iter_insert, BUFFER_SIZE_ELEMENTS(local_insert));
-    cblist_delete_local(drcontext, &iter_instru, BUFFER_SIZE_ELEMENTS(local_instru));
+    if (snap->pair_count > 0)
+        dr_thread_free(drcontext, pair_data, sizeof(void*)*snap->pair_count);
+    if (snap->quartet_count > 0)
+        dr_thread_free(drcontext, quartet_data, sizeof(void*)*snap->quartet_count);
 
     return res;
 }
@@ -868,6 +1189,13 @@ drmgr_bb_cb_add(cb_list_t *list,
     idx = priority_event_add(list, priority);
     if (idx >= 0) {
         cb_entry_t *new_e = &list->cbs.bb[idx];
+        new_e->filter = 0;
+        new_e->stats = pass_stats_create(new_e->pri.name,
+                                         list == &cblist_app2app ?
+                                         DRMGR_PHASE_APP2APP :
+                                         (list == &cblist_instrumentation ?
+                                          DRMGR_PHASE_INSERTION :
+                                          DRMGR_PHASE_INSTRU2INSTRU));
         if (app2app_ex_func != NULL) {
             new_e->has_quartet = true;
             new_e->cb.app2app_ex_cb = app2app_ex_func;
@@ -894,6 +1222,7 @@ drmgr_bb_cb_add(cb_list_t *list,
             quartet_count++;
         else if (xform_func == NULL)
             pair_count++;
+        bb_snapshot_rebuild();
         res = true;
     }
     dr_rwlock_write_unlock(bb_cb_lock);
@@ -1007,6 +1336,7 @@ drmgr_bb_cb_remove(cb_list_t *list,
             bb_event_count--;
             if (bb_event_count == 0)
                 dr_unregister_bb_event(drmgr_bb_event);
+            bb_snapshot_rebuild();
             break;
         }
     }
@@ -1032,6 +1362,38 @@ drmgr_bb_exit(void)
     cblist_delete(&cblist_app2app);
     cblist_delete(&cblist_instrumentation);
     cblist_delete(&cblist_instru2instru);
+    if (bb_snapshot != NULL) {
+        bb_snapshot_free(bb_snapshot);
+        bb_snapshot = NULL;
+    }
+    while (bb_snapshot_retired != NULL) {
+        bb_snapshot_t *next = bb_snapshot_retired->retired_next;
+        bb_snapshot_free(bb_snapshot_retired);
+        bb_snapshot_retired = next;
+    }
+}
+
+DR_EXPORT
+bool
+drmgr_set_insertion_instr_filter(drmgr_insertion_cb_t func, uint filter)
+{
+    bool res = false;
+    uint i;
+    if (func == NULL)
+        return false; /* invalid params */
+    dr_rwlock_write_lock(bb_cb_lock);
+    for (i = 0; i < cblist_instrumentation.num; i++) {
+        cb_entry_t *e = &cblist_instrumentation.cbs.bb[i];
+        /* The quartet's insertion_ex_cb shares the pair's slot. */
+        if (e->pri.valid && e->cb.pair.insertion_cb == func) {
+            e->filter = filter;
+            res = true;
+        }
+    }
+    if (res)
+        bb_snapshot_rebuild();
+    dr_rwlock_write_unlock(bb_cb_lock);
+    return res;
 }
 
 DR_EXPORT
@@ -1883,6 +2245,11 @@ drmgr_thread_init_event(void *drcontext)
     uint i;
     tls_array_t *tls = dr_thread_alloc(drcontext, sizeof(*tls));
     memset(tls, 0, sizeof(*tls));
+    tls->raw_seg_base = dr_get_dr_segment_base(tls_raw_reg);
+    if (tls_raw_allocated) {
+        memset(tls->raw_seg_base + tls_raw_base, 0,
+               MAX_NUM_RAW_TLS * sizeof(void *));
+    }
     dr_set_tls_field(drcontext, (void *)tls);
 
     dr_rwlock_read_lock(thread_event_lock);
@@ -1955,7 +2322,7 @@ static bool
 drmgr_unreserve_tls_cls_field(bool *taken, int idx)
 {
     bool res = false;
-    if (idx < 0 || idx > MAX_NUM_TLS)
+    if (idx < 0 || idx >= MAX_NUM_TLS)
         return false;
     dr_mutex_lock(tls_lock);
     if (taken[idx]) {
@@ -1974,11 +2341,52 @@ drmgr_register_tls_field(void)
     return drmgr_reserve_tls_cls_field(tls_taken);
 }
 
+DR_EXPORT
+int
+drmgr_register_fast_tls_field(void)
+{
+    int idx = drmgr_reserve_tls_cls_field(tls_taken);
+    int slot;
+    if (idx < 0)
+        return idx;
+    dr_mutex_lock(tls_lock);
+    if (!tls_raw_allocated) {
+        tls_raw_allocated = dr_raw_tls_calloc(&tls_raw_reg, &tls_raw_base,
+                                              MAX_NUM_RAW_TLS, 0);
+    }
+    if (tls_raw_allocated) {
+        for (slot = 0; slot < MAX_NUM_RAW_TLS; slot++) {
+            if (!raw_taken[slot]) {
+                raw_taken[slot] = true;
+                tls_raw_slot[idx] = slot;
+                break;
+            }
+        }
+    }
+    /* else, fall back to a regular slot */
+    dr_mutex_unlock(tls_lock);
+    return idx;
+}
+
 DR_EXPORT
 bool
 drmgr_unregister_tls_field(int idx)
 {
-    return drmgr_unreserve_tls_cls_field(tls_taken, idx);
+    if (!drmgr_unreserve_tls_cls_field(tls_taken, idx))
+        return false;
+    dr_mutex_lock(tls_lock);
+    if (tls_raw_slot[idx] >= 0) {
+        raw_taken[tls_raw_slot[idx]] = false;
+        tls_raw_slot[idx] = -1;
+    }
+    dr_mutex_unlock(tls_lock);
+    return true;
+}
+
+static inline uint
+drmgr_raw_tls_offs(int idx)
+{
+    return tls_raw_base + tls_raw_slot[idx] * sizeof(void *);
 }
 
 DR_EXPORT
@@ -1987,8 +2395,10 @@ drmgr_get_tls_field(void *drcontext, int idx)
 {
     tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
     /* no need to check for tls_taken since would return NULL anyway (i#484) */
-    if (idx < 0 || idx > MAX_NUM_TLS || tls == NULL)
+    if (idx < 0 || idx >= MAX_NUM_TLS || tls == NULL)
         return NULL;
+    if (tls_raw_slot[idx] >= 0)
+        return *(void **)(tls->raw_seg_base + drmgr_raw_tls_offs(idx));
     return tls->tls[idx];
 }
 
@@ -1997,13 +2407,16 @@ bool
 drmgr_set_tls_field(void *drcontext, int idx, void *value)
 {
     tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
-    if (idx < 0 || idx > MAX_NUM_TLS || tls == NULL)
+    if (idx < 0 || idx >= MAX_NUM_TLS || tls == NULL)
         return false;
     /* going DR's traditional route of efficiency over safety: making this
      * a debug-only check to avoid cost in release build
      */
     ASSERT(tls_taken[idx], "usage error: setting tls index that is not reserved");
-    tls->tls[idx] = value;
+    if (tls_raw_slot[idx] >= 0)
+        *(void **)(tls->raw_seg_base + drmgr_raw_tls_offs(idx)) = value;
+    else
+        tls->tls[idx] = value;
     return true;
 }
 
@@ -2013,10 +2426,15 @@ drmgr_insert_read_tls_field(void *drcontext, int idx,
                             instrlist_t *ilist, instr_t *where, reg_id_t reg)
 {
     tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
-    if (idx < 0 || idx > MAX_NUM_TLS || !tls_taken[idx] || tls == NULL)
+    if (idx < 0 || idx >= MAX_NUM_TLS || !tls_taken[idx] || tls == NULL)
         return false;
     if (!reg_is_gpr(reg) || !reg_is_pointer_sized(reg))
         return false;
+    if (tls_raw_slot[idx] >= 0) {
+        dr_insert_read_raw_tls(drcontext, ilist, where, tls_raw_reg,
+                               drmgr_raw_tls_offs(idx), reg);
+        return true;
+    }
     dr_insert_read_tls_field(drcontext, ilist, where, reg);
     instrlist_meta_preinsert(ilist, where, XINST_CREATE_load
                              (drcontext, opnd_create_reg(reg),
@@ -2032,11 +2450,16 @@ drmgr_insert_write_tls_field(void *drcontext, int idx,
                              reg_id_t scratch)
 {
     tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
-    if (idx < 0 || idx > MAX_NUM_TLS || !tls_taken[idx] || tls == NULL)
+    if (idx < 0 || idx >= MAX_NUM_TLS || !tls_taken[idx] || tls == NULL)
         return false;
     if (!reg_is_gpr(reg) || !reg_is_pointer_sized(reg) ||
         !reg_is_gpr(scratch) || !reg_is_pointer_sized(scratch))
         return false;
+    if (tls_raw_slot[idx] >= 0) {
+        dr_insert_write_raw_tls(drcontext, ilist, where, tls_raw_reg,
+                                drmgr_raw_tls_offs(idx), reg);
+        return true;
+    }
     dr_insert_read_tls_field(drcontext, ilist, where, scratch);
     instrlist_meta_preinsert(ilist, where, XINST_CREATE_store
                              (drcontext,
@@ -2089,6 +2512,15 @@ drmgr_cls_stack_push(void)
         return false;
     }
 
+    /* With no cls fields there is nothing to give the callback its own copy of,
+     * so we avoid copying the tls array and invoking the cls events on each of
+     * what can be a very high rate of callbacks.
+     */
+    if (num_cls_fields == 0) {
+        tls_parent->skipped_pushes++;
+        return true;
+    }
+
     tls_child = tls_parent->next;
     /* we re-use to avoid churn */
     if (tls_child == NULL) {
@@ -2103,6 +2535,7 @@ drmgr_cls_stack_push(void)
 
     /* share the tls slots */
     memcpy(tls_child->tls, tls_parent->tls, sizeof(*tls_child->tls)*MAX_NUM_TLS);
+    tls_child->raw_seg_base = tls_parent->raw_seg_base;
     /* swap in as the current structure */
     dr_set_tls_field(drcontext, (void *)tls_child);
 
@@ -2124,6 +2557,12 @@ drmgr_cls_stack_pop(void)
         return false;
     }
 
+    if (tls_child->skipped_pushes > 0) {
+        /* matches a push made while there were no cls fields */
+        tls_child->skipped_pushes--;
+        return true;
+    }
+
     tls_parent = tls_child->prev;
     if (tls_parent == NULL) {
         /* DR took over in the middle of a callback: ignore */
@@ -2298,6 +2737,7 @@ int
 drmgr_register_cls_field(void (*cb_init_func)(void *drcontext, bool new_depth),
                          void (*cb_exit_func)(void *drcontext, bool thread_exit))
 {
+    int idx;
     if (cb_init_func == NULL || cb_exit_func == NULL)
         return -1;
     if (!drmgr_generic_event_add(&cblist_cls_init, cls_event_lock,
@@ -2306,7 +2746,13 @@ drmgr_register_cls_field(void (*cb_init_func)(void *drcontext, bool new_depth),
     if (!drmgr_generic_event_add(&cblist_cls_exit, cls_event_lock,
                                  (void (*)(void)) cb_exit_func, NULL, false, NULL))
         return -1;
-    return drmgr_reserve_tls_cls_field(cls_taken);
+    idx = drmgr_reserve_tls_cls_field(cls_taken);
+    if (idx >= 0) {
+        dr_mutex_lock(tls_lock);
+        num_cls_fields++;
+        dr_mutex_unlock(tls_lock);
+    }
+    return idx;
 }
 
 DR_EXPORT
@@ -2319,7 +2765,12 @@ drmgr_unregister_cls_field(void (*cb_init_func)(void *drcontext, bool new_depth)
                                           (void (*)(void)) cb_init_func);
     res = drmgr_generic_event_remove(&cblist_cls_exit, cls_event_lock,
                                      (void (*)(void)) cb_exit_func) && res;
-    res = drmgr_unreserve_tls_cls_field(cls_taken, idx) && res;
+    if (drmgr_unreserve_tls_cls_field(cls_taken, idx)) {
+        dr_mutex_lock(tls_lock);
+        num_cls_fields--;
+        dr_mutex_unlock(tls_lock);
+    } else
+        res = false;
     return res;
 }
 
@@ -2328,7 +2779,7 @@ void *
 drmgr_get_cls_field(void *drcontext, int idx)
 {
     tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
-    if (idx < 0 || idx > MAX_NUM_TLS || !cls_taken[idx] || tls == NULL)
+    if (idx < 0 || idx >= MAX_NUM_TLS || !cls_taken[idx] || tls == NULL)
         return NULL;
     return tls->cls[idx];
 }
@@ -2338,7 +2789,7 @@ bool
 drmgr_set_cls_field(void *drcontext, int idx, void *value)
 {
     tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
-    if (idx < 0 || idx > MAX_NUM_TLS || !cls_taken[idx] || tls == NULL)
+    if (idx < 0 || idx >= MAX_NUM_TLS || !cls_taken[idx] || tls == NULL)
         return false;
     tls->cls[idx] = value;
     return true;
@@ -2349,7 +2800,7 @@ void *
 drmgr_get_parent_cls_field(void *drcontext, int idx)
 {
     tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
-    if (idx < 0 || idx > MAX_NUM_TLS || !cls_taken[idx] || tls == NULL)
+    if (idx < 0 || idx >= MAX_NUM_TLS || !cls_taken[idx] || tls == NULL)
         return NULL;
     if (tls->prev != NULL)
         return tls->prev->cls[idx];
@@ -2362,7 +2813,7 @@ drmgr_insert_read_cls_field(void *drcontext, int idx,
                             instrlist_t *ilist, instr_t *where, reg_id_t reg)
 {
     tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
-    if (idx < 0 || idx > MAX_NUM_TLS || !cls_taken[idx] || tls == NULL)
+    if (idx < 0 || idx >= MAX_NUM_TLS || !cls_taken[idx] || tls == NULL)
         return false;
     if (!reg_is_gpr(reg) || !reg_is_pointer_sized(reg))
         return false;
@@ -2381,7 +2832,7 @@ drmgr_insert_write_cls_field(void *drcontext, int idx,
                              reg_id_t scratch)
 {
     tls_array_t *tls = (tls_array_t *) dr_get_tls_field(drcontext);
-    if (idx < 0 || idx > MAX_NUM_TLS || !cls_taken[idx] || tls == NULL)
+    if (idx < 0 || idx >= MAX_NUM_TLS || !cls_taken[idx] || tls == NULL)
         return false;
     if (!reg_is_gpr(reg) || !reg_is_pointer_sized(reg) ||
         !reg_is_gpr(scratch) || !reg_is_pointer_sized(scratch))
@@ -371,6 +371,30 @@ DR_EXPORT
 bool
 drmgr_unregister_bb_insertion_event(drmgr_insertion_cb_t func);
 
+/** Instruction filters for drmgr_set_insertion_instr_filter(). */
+enum {
+    /** Application instructions that read or write memory. */
+    DRMGR_INSTR_FILTER_MEMREF = 0x01,
+    /** Application control transfer instructions. */
+    DRMGR_INSTR_FILTER_CTI    = 0x02,
+};
+
+DR_EXPORT
+/**
+ * Restricts the registered insertion callback \p func to the instructions
+ * matching any of the DRMGR_INSTR_FILTER_* flags in \p filter, so that drmgr
+ * does not invoke it for anything else.  A filtered callback is never called
+ * for meta instructions or labels, nor for an unmatched first or last
+ * instruction of the block, so it should not rely on drmgr_is_first_instr()
+ * or drmgr_is_last_instr().  Passing 0 removes the filter.  The filter
+ * applies to blocks built after this call.
+ *
+ * 
+eturn false if \p func is not a registered insertion callback.
+ */
+bool
+drmgr_set_insertion_instr_filter(drmgr_insertion_cb_t func, uint filter);
+
 DR_EXPORT
 /**
  * Registers a callback function for the fourth instrumentation stage:
@@ -488,6 +512,24 @@ DR_EXPORT
 int
 drmgr_register_tls_field(void);
 
+DR_EXPORT
+/**
+ * Reserves a thread-local storage (tls) slot for every thread, just like
+ * drmgr_register_tls_field(), but asks for the slot to be backed by raw
+ * thread-local storage (see dr_raw_tls_calloc()).  The returned index is used
+ * with the same routines as a regular slot.  For a raw-backed slot,
+ * drmgr_insert_read_tls_field() and drmgr_insert_write_tls_field() emit a
+ * single segment-relative load or store rather than first loading the
+ * drcontext field.  Only a small number of raw-backed slots are available:
+ * once they are exhausted, a regular slot is returned instead.  Returns -1 if
+ * there are no more slots available of either kind.  As with regular slots,
+ * each slot is initialized to NULL for each thread created after the slot
+ * is reserved, and should be set with drmgr_set_tls_field() in the thread
+ * initialization event.
+ */
+int
+drmgr_register_fast_tls_field(void);
+
 DR_EXPORT
 /**
  * Frees a previously reserved thread-local storage (tls) slot index.
@@ -1244,6 +1286,56 @@ DR_EXPORT
 bool
 drmgr_disable_auto_predication(void *drcontext, instrlist_t *ilist);
 
+/**
+ * Build-time accounting for one registered bb pass, as returned by
+ * drmgr_get_pass_stats().  A pass registered for several phases (e.g., via
+ * drmgr_register_bb_instrumentation_ex_event()) has one entry per phase.
+ */
+typedef struct _drmgr_pass_stats_t {
+    /** The size of this structure, used for compatibility.  Must be set by the caller. */
+    size_t struct_size;
+    /** The name from the pass's #drmgr_priority_t. */
+    const char *name;
+    /**
+     * The phase this entry covers: #DRMGR_PHASE_APP2APP,
+     * #DRMGR_PHASE_INSERTION (which includes the analysis callback), or
+     * #DRMGR_PHASE_INSTRU2INSTRU.
+     */
+    drmgr_bb_phase_t phase;
+    /** The number of basic blocks this pass was invoked on. */
+    uint64 bb_count;
+    /** The total number of application instructions in those blocks. */
+    uint64 app_instrs;
+    /** The net number of instructions this pass added to those blocks. */
+    int64 instrs_added;
+    /** The time spent in this pass's callbacks, in microseconds. */
+    uint64 microseconds;
+} drmgr_pass_stats_t;
+
+DR_EXPORT
+/**
+ * Enables or disables per-pass build-time accounting of the bb events,
+ * which is off by default as it adds overhead to every basic block built.
+ * When enabled, the time spent in and the instructions added by each
+ * registered pass are recorded and can be retrieved with
+ * drmgr_get_pass_stats(); they are also written to the DR log at
+ * drmgr_exit().
+ * \return whether successful.
+ */
+bool
+drmgr_enable_pass_stats(bool enable);
+
+DR_EXPORT
+/**
+ * Retrieves the build-time accounting for the \p index-th registered bb
+ * pass, in registration order, including passes that have since been
+ * unregistered.  The caller must set the \p struct_size field of \p stats.
+ * Counters are only updated while drmgr_enable_pass_stats() is on.
+ * \return false if \p index is out of range.
+ */
+bool
+drmgr_get_pass_stats(uint index, drmgr_pass_stats_t *stats OUT);
+
 /*@}*/ /* end doxygen group */
 
 #ifdef __cplusplus
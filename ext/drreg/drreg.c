@@ -282,18 +282,130 @@ count_app_uses(per_thread_t *pt, opnd_t opnd)
  * per-instr event b/c we need the liveness to advance at the label
  * but not after the label.
  */
+/* Limit on how far into a successor we look for writes. */
+#define SUCCESSOR_SCAN_INSTRS 16
+/* Longest encoding we may decode, to keep successor scans on one page. */
+#define SUCCESSOR_MAX_INSTR_LEN IF_X86_ELSE(17, 4)
+
+/* Marks live in live[] and *aflags every GPR and arithmetic flag that the
+ * successor at pc may read before writing, leaving the rest untouched so that
+ * callers can combine several successors.  We only look at code on the same
+ * page as from_pc that the app cannot currently write: a change in protection
+ * or content then flushes the predecessor block along with it, so the result
+ * cannot go stale.
+ */
+static void
+successor_liveness(void *drcontext, app_pc from_pc, app_pc pc,
+                   void *live[DR_NUM_GPR_REGS], ptr_uint_t *aflags)
+{
+    byte *page = (byte *) ALIGN_BACKWARD(from_pc, dr_page_size());
+    byte *base;
+    size_t size;
+    uint prot;
+    bool resolved[DR_NUM_GPR_REGS] = {0,};
+    ptr_uint_t aflags_written = 0;
+    reg_id_t reg;
+    instr_t inst;
+    int count;
+
+    if (pc < page || pc >= page + dr_page_size() ||
+        !dr_query_memory(pc, &base, &size, &prot) ||
+        TEST(DR_MEMPROT_WRITE, prot) || !TEST(DR_MEMPROT_READ, prot))
+        count = SUCCESSOR_SCAN_INSTRS; /* skip the scan: everything stays live */
+    else
+        count = 0;
+    instr_init(drcontext, &inst);
+    for (; count < SUCCESSOR_SCAN_INSTRS; count++) {
+        /* Do not decode past the page we know is mapped and consistent. */
+        if (pc + SUCCESSOR_MAX_INSTR_LEN > page + dr_page_size())
+            break;
+        instr_reset(drcontext, &inst);
+        pc = decode(drcontext, pc, &inst);
+        if (pc == NULL || !instr_valid(&inst))
+            break;
+        for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++) {
+            bool full_write;
+            if (resolved[GPR_IDX(reg)])
+                continue;
+            /* Conditional writes are excluded, as the old value may survive. */
+            full_write = instr_writes_to_exact_reg(&inst, reg, DR_QUERY_DEFAULT)
+                /* a write to a 32-bit reg for amd64 zeroes the top 32 bits */
+                IF_X86_64(|| instr_writes_to_exact_reg(&inst, reg_64_to_32(reg),
+                                                       DR_QUERY_DEFAULT));
+            if (instr_reads_from_reg(&inst, reg, DR_QUERY_INCLUDE_ALL) ||
+                (!full_write && instr_writes_to_reg(&inst, reg, DR_QUERY_INCLUDE_ALL))) {
+                live[GPR_IDX(reg)] = REG_LIVE;
+                resolved[GPR_IDX(reg)] = true;
+            } else if (full_write)
+                resolved[GPR_IDX(reg)] = true;
+        }
+        *aflags |= instr_get_arith_flags(&inst, DR_QUERY_INCLUDE_COND_SRCS) &
+            EFLAGS_READ_ARITH & ~EFLAGS_WRITE_TO_READ(aflags_written);
+        aflags_written |= instr_get_arith_flags(&inst, DR_QUERY_DEFAULT) &
+            EFLAGS_WRITE_ARITH;
+        if (instr_is_cti(&inst) || instr_is_interrupt(&inst) || instr_is_syscall(&inst))
+            break;
+    }
+    instr_free(drcontext, &inst);
+    /* Anything not yet seen written might be read further on. */
+    for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++) {
+        if (!resolved[GPR_IDX(reg)])
+            live[GPR_IDX(reg)] = REG_LIVE;
+    }
+    *aflags |= EFLAGS_READ_ARITH & ~EFLAGS_WRITE_TO_READ(aflags_written);
+}
+
+/* Fills in the liveness of GPRs and arithmetic flags at the end of bb, which
+ * is all-live unless ops.successor_liveness lets us prove otherwise from the
+ * block's direct successors.  Returns whether the successors were analyzed.
+ */
+static bool
+bb_exit_liveness(void *drcontext, instrlist_t *bb, void *live[DR_NUM_GPR_REGS],
+                 ptr_uint_t *aflags)
+{
+    instr_t *last = instrlist_last(bb);
+    app_pc last_pc = (last == NULL) ? NULL : instr_get_app_pc(last);
+    reg_id_t reg;
+    for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++)
+        live[GPR_IDX(reg)] = REG_LIVE;
+    *aflags = EFLAGS_READ_ARITH;
+    if (!ops.successor_liveness || last_pc == NULL || !instr_is_app(last))
+        return false;
+    if (instr_is_cti(last)) {
+        if ((!instr_is_ubr(last) && !instr_is_cbr(last)) ||
+            !opnd_is_pc(instr_get_target(last)))
+            return false;
+    } else if (instr_is_interrupt(last) || instr_is_syscall(last))
+        return false;
+    for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++)
+        live[GPR_IDX(reg)] = REG_DEAD;
+    *aflags = 0;
+    if (instr_is_cti(last)) {
+        successor_liveness(drcontext, last_pc, opnd_get_pc(instr_get_target(last)),
+                           live, aflags);
+    }
+    if (!instr_is_ubr(last)) {
+        successor_liveness(drcontext, last_pc,
+                           last_pc + instr_length(drcontext, last), live, aflags);
+    }
+    return true;
+}
+
 static dr_emit_flags_t
 drreg_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
                         bool for_trace, bool translating, OUT void **user_data)
 {
     per_thread_t *pt = (per_thread_t *) drmgr_get_tls_field(drcontext, tls_idx);
     instr_t *inst;
-    ptr_uint_t aflags_new, aflags_cur = 0;
+    ptr_uint_t aflags_new, aflags_cur = 0, aflags_exit;
+    void *live_exit[DR_NUM_GPR_REGS];
+    bool exit_known;
     uint index = 0;
     reg_id_t reg;
 
     for (reg = DR_REG_START_GPR; reg <= DR_REG_STOP_GPR; reg++)
         pt->reg[GPR_IDX(reg)].app_uses = 0;
+    exit_known = bb_exit_liveness(drcontext, bb, live_exit, &aflags_exit);
     /* pt->bb_props is set to 0 at thread init and after each bb */
     pt->bb_has_internal_flow = false;
 
@@ -330,9 +442,11 @@ drreg_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
                      IF_X86_64(|| instr_writes_to_exact_reg(inst, reg_64_to_32(reg),
                                                             DR_QUERY_INCLUDE_COND_SRCS)))
                 value = REG_DEAD;
+            else if (index == 0)
+                value = live_exit[GPR_IDX(reg)];
             else if (xfer)
                 value = REG_LIVE;
-            else if (index > 0)
+            else
                 value = drvector_get_entry(&pt->reg[GPR_IDX(reg)].live, index-1);
             LOG(drcontext, DR_LOG_ALL, 3, " %s=%d", get_register_name(reg),
                 (int)(ptr_uint_t)value);
@@ -341,12 +455,12 @@ drreg_event_bb_analysis(void *drcontext, void *tag, instrlist_t *bb,
 
         /* aflags liveness */
         aflags_new = instr_get_arith_flags(inst, DR_QUERY_INCLUDE_COND_SRCS);
-        if (xfer)
+        if (xfer && (index > 0 || !exit_known))
             aflags_cur = EFLAGS_READ_ARITH; /* assume flags are read before written */
         else {
             uint aflags_read, aflags_w2r;
             if (index == 0)
-                aflags_cur = EFLAGS_READ_ARITH; /* assume flags are read before written */
+                aflags_cur = aflags_exit;
             else {
                 aflags_cur = (uint)(ptr_uint_t)
                     drvector_get_entry(&pt->aflags.live, index-1);
@@ -1695,6 +1809,9 @@ drreg_init(drreg_options_t *ops_in)
     /* If anyone wants to be conservative, then be conservative. */
     ops.conservative = ops.conservative || ops_in->conservative;
 
+    if (ops_in->struct_size > offsetof(drreg_options_t, successor_liveness))
+        ops.successor_liveness = ops.successor_liveness || ops_in->successor_liveness;
+
     /* The first callback wins. */
     if (ops_in->struct_size > offsetof(drreg_options_t, error_callback) &&
         ops.error_callback == NULL)
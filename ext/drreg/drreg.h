@@ -167,6 +167,21 @@ typedef struct _drreg_options_t {
      * needed.
      */
     bool do_not_sum_slots;
+    /**
+     * By default, drreg assumes that every register and the arithmetic flags
+     * are live at the end of each basic block.  If this is set, drreg instead
+     * decodes the start of each direct successor of a block (its fall-through
+     * and direct branch targets) and treats a value as dead at the block's
+     * end if every successor overwrites it before reading it.  This avoids
+     * spills and restores that the next block would make pointless.  Only
+     * successors on the same unwritable page as the block's final
+     * instruction are considered, so code changes that could invalidate the
+     * analysis also flush the block itself.
+     *
+     * If multiple drreg_init() calls are made, this field is combined by
+     * logical OR.
+     */
+    bool successor_liveness;
 } drreg_options_t;
 
 DR_EXPORT
@@ -240,6 +240,55 @@ drsym_error_t
 drsym_lookup_address(const char *modpath, size_t modoffs, drsym_info_t *info /*INOUT*/,
                      uint flags);
 
+DR_EXPORT
+/**
+ * Enables a persistent, on-disk index of each module's symbols sorted by
+ * address, stored in the existing directory \p dir and keyed by the
+ * module's build-id.  When a module is first queried by address (e.g., via
+ * drsym_lookup_address()), a matching index file is mapped if present;
+ * otherwise the index is built and written there for later processes.
+ * This avoids rebuilding the index for large binaries on every run.
+ * Pass NULL to disable.  Modules already queried are not affected.
+ *
+ * \note Currently only supported for ELF modules with a build-id.
+ *
+ * \return DRSYM_SUCCESS, or DRSYM_ERROR_NOT_IMPLEMENTED if unsupported on
+ * this platform, or DRSYM_ERROR_INVALID_PARAMETER if \p dir does not exist.
+ */
+drsym_error_t
+drsym_set_index_cache_dir(const char *dir);
+
+DR_EXPORT
+/**
+ * Retrieves symbol information for each of \p count module offsets in the
+ * same module.  This is equivalent to calling drsym_lookup_address() on each
+ * offset, but the module is looked up and the internal lock acquired only
+ * once, and the queries are performed in increasing offset order regardless
+ * of their order in \p modoffs, which keeps the symbol and line table
+ * lookups local.  This is meant for post-processing tools that symbolize
+ * many addresses at once.  Concurrent calls are safe but are serialized.
+ *
+ * @param[in] modpath The full path to the module to be queried.
+ * @param[in] modoffs An array of \p count offsets from the base of the module.
+ * @param[in] count The number of entries in \p modoffs, \p infos, and
+ *   \p results.
+ * @param[in,out] infos An array of \p count structures, each set up as for
+ *   drsym_lookup_address(), receiving the information for the offset at the
+ *   same index in \p modoffs.
+ * @param[out] results An array of \p count entries, each set to the result
+ *   drsym_lookup_address() would have returned for the offset at the same
+ *   index in \p modoffs.
+ * @param[in]  flags   Options for the operation, as for drsym_lookup_address().
+ *
+ * \return DRSYM_SUCCESS if the per-address lookups were performed, in which
+ * case their individual outcomes are in \p results; otherwise, the error
+ * that prevented any lookup.
+ */
+drsym_error_t
+drsym_lookup_addresses(const char *modpath, const size_t *modoffs, uint count,
+                       drsym_info_t *infos /*INOUT*/, drsym_error_t *results /*OUT*/,
+                       uint flags);
+
 enum {
     DRSYM_TYPE_OTHER,  /**< Unknown type, cannot downcast. */
     DRSYM_TYPE_INT,    /**< Integer, cast to drsym_int_type_t. */
@@ -572,7 +621,6 @@ DR_EXPORT
 drsym_error_t
 drsym_module_has_symbols(const char *modpath);
 
-#ifdef WINDOWS
 DR_EXPORT
 /**
  * Enumerates all symbol information (including exports) matching a
@@ -580,7 +628,12 @@ DR_EXPORT
  * Calls the given callback function for each matching symbol.
  * If the callback returns false, the enumeration will end.
  *
- * This routine is only supported for PDB symbols (DRSYM_PDB).
+ * For symbol tables other than PDB (DRSYM_ELF_SYMTAB, DRSYM_PECOFF_SYMTAB,
+ * DRSYM_MACHO_SYMTAB), the first search builds a sorted index of the module's
+ * symbol names, which is kept until drsym_free_resources() is called.  Later
+ * searches whose pattern starts with literal characters only visit names
+ * sharing that prefix.  The pattern may contain '*' and '?' wildcards, and
+ * matching symbols are passed to \p callback in name order.
  *
  * Modifying the demangling is currently not supported:
  * DRSYM_DEFAULT_FLAGS is used.
@@ -622,10 +675,10 @@ DR_EXPORT
  * drsym_search_symbols()).
  * If the callback returns false, the enumeration will end.
  *
- * This routine is only supported for PDB symbols (DRSYM_PDB).
- *
- * Modifying the demangling is currently not supported:
- * DRSYM_DEFAULT_FLAGS is used.
+ * For PDB symbols, modifying the demangling is currently not supported:
+ * DRSYM_DEFAULT_FLAGS is used.  For other symbol tables, the indexing
+ * described for drsym_search_symbols() applies, with a separate index for
+ * each demangling choice in \p flags.
  *
  * Due to dbghelp leaving template parameters in place (they are removed
  * for DRSYM_DEMANGLE in the drsyms library itself), searching may find
@@ -640,8 +693,8 @@ DR_EXPORT
  *                      to be enumerated.  To specify a target module, use the
  *                      "module_pattern!symbol_pattern" format.
  * @param[in] flags     Options for the operation as a combination of drsym_flags_t
- *                      values.  DRSYM_LEAVE_MANGLED and DRSYM_DEMANGLE_FULL are
- *                      ignored.  DRSYM_FULL_SEARCH, if set, requests to search all
+ *                      values.  For PDB, DRSYM_LEAVE_MANGLED and DRSYM_DEMANGLE_FULL
+ *                      are ignored.  DRSYM_FULL_SEARCH, if set, requests to search all
  *                      symbols as opposed to the default of just functions.  A full
  *                      search takes significantly more time and memory and
  *                      eliminates the performance advantage over other lookup
@@ -655,7 +708,6 @@ DR_EXPORT
 drsym_error_t
 drsym_search_symbols_ex(const char *modpath, const char *match, uint flags,
                         drsym_enumerate_ex_cb callback, size_t info_size, void *data);
-#endif
 
 DR_EXPORT
 /**
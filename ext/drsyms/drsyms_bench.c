@@ -32,8 +32,9 @@
 
 /* DRSyms benchmarking standalone app. */
 
-/* This is a standalone app for benchmarking drsyms.  Currently we just time
- * symbol enumeration of an arbitrary object file.
+/* This is a standalone app for benchmarking drsyms.  We time symbol
+ * enumeration of an arbitrary object file as well as address lookups of a
+ * sample of its symbols.
  */
 
 #include <stdio.h>
@@ -45,6 +46,11 @@
 
 static char sym_buf[4096];
 
+#define MAX_LOOKUP_OFFS 20000
+#define LOOKUP_ROUNDS 5
+static size_t lookup_offs[MAX_LOOKUP_OFFS];
+static uint num_lookup_offs;
+
 static int
 usage(const char *msg)
 {
@@ -58,7 +64,7 @@ usage(const char *msg)
     if (msg != NULL && msg[0] != '\0') {
         dr_fprintf(STDERR, "%s\n", msg);
     }
-    dr_fprintf(STDERR, "usage: bench <modpath>\n");
+    dr_fprintf(STDERR, "usage: bench <modpath> [index_cache_dir]\n");
     return 1;
 }
 
@@ -70,6 +76,8 @@ sym_callback(const char *name, size_t modoffs, void *data)
 {
     uint64 *count = (uint64*)data;
     *count += 1;
+    if (num_lookup_offs < MAX_LOOKUP_OFFS && modoffs != 0)
+        lookup_offs[num_lookup_offs++] = modoffs;
     if (*count % 50000 == 0) {
         dr_printf("{\"%s\",\n", name);
         memset(sym_buf, 0, sizeof(sym_buf));
@@ -104,6 +112,50 @@ enumerate_with_flags(const char *modpath, drsym_flags_t flags)
     dr_printf("Took %d.%03d seconds.\n", (int)(time / 1000), (int)(time % 1000));
 }
 
+static void
+lookup_addresses(const char *modpath)
+{
+    uint64 start, end, time;
+    uint64 lookups = 0, found = 0;
+    char name[256];
+    char file[MAXIMUM_PATH];
+    drsym_info_t info;
+    uint i;
+    int round;
+
+    info.struct_size = sizeof(info);
+    info.name = name;
+    info.name_size = sizeof(name);
+    info.file = file;
+    info.file_size = sizeof(file);
+
+    dr_printf("Beginning address lookups of %u offsets\n", num_lookup_offs);
+    for (round = 0; round < LOOKUP_ROUNDS; round++) {
+        lookups = 0;
+        found = 0;
+        start = dr_get_milliseconds();
+        /* Stride through the offsets so consecutive queries hit different
+         * symbols and line tables.
+         */
+        for (i = 0; i < num_lookup_offs; i++) {
+            uint j = (uint)(((uint64)i * 7919) % num_lookup_offs);
+            drsym_error_t res = drsym_lookup_address(modpath, lookup_offs[j], &info,
+                                                     DRSYM_DEFAULT_FLAGS);
+            lookups++;
+            if (res == DRSYM_SUCCESS || res == DRSYM_ERROR_LINE_NOT_AVAILABLE)
+                found++;
+        }
+        end = dr_get_milliseconds();
+        time = end - start;
+        /* The first round includes building the lookup indices. */
+        dr_printf("Round %d: %d lookups (%d found) took %d.%03d seconds: "
+                  "%d lookups/sec.\n", round, (int)lookups, (int)found,
+                  (int)(time / 1000), (int)(time % 1000),
+                  (int)(lookups * 1000 / (time == 0 ? 1 : time)));
+    }
+    dr_printf("Finished address lookups.\n");
+}
+
 int
 main(int argc, char **argv)
 {
@@ -115,10 +167,12 @@ main(int argc, char **argv)
     dr_standalone_init();
     drsym_init(0);
 
-    if (argc != 2) {
+    if (argc != 2 && argc != 3) {
         return usage(NULL);
     }
     modpath = argv[1];
+    if (argc == 3 && drsym_set_index_cache_dir(argv[2]) != DRSYM_SUCCESS)
+        return usage("Unable to use index cache directory.");
 #ifdef WINDOWS
     /* Work around i#289. */
     if (GetFullPathName(modpath, sizeof(full_path), full_path, NULL) == 0) {
@@ -136,5 +190,8 @@ main(int argc, char **argv)
     enumerate_with_flags(modpath, DRSYM_DEFAULT_FLAGS);
     enumerate_with_flags(modpath, DRSYM_DEFAULT_FLAGS);
 
+    if (num_lookup_offs > 0)
+        lookup_addresses(modpath);
+
     drsym_exit();
 }
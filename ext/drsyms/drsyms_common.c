@@ -39,6 +39,8 @@
 #include "drsyms.h"
 #include "drsyms_private.h"
 
+#include <stdlib.h> /* qsort */
+
 void
 pool_init(mempool_t *pool, char *buf, size_t sz)
 {
@@ -62,3 +64,42 @@ pool_alloc(mempool_t *pool, size_t sz)
     }
     return ret;
 }
+
+typedef struct _offs_entry_t {
+    size_t modoffs;
+    uint idx;
+} offs_entry_t;
+
+static int
+compare_offs_entries(const void *a_in, const void *b_in)
+{
+    const offs_entry_t *a = (const offs_entry_t *) a_in;
+    const offs_entry_t *b = (const offs_entry_t *) b_in;
+    if (a->modoffs != b->modoffs)
+        return (a->modoffs > b->modoffs) ? 1 : -1;
+    if (a->idx != b->idx)
+        return (a->idx > b->idx) ? 1 : -1;
+    return 0;
+}
+
+void
+drsym_lookup_addresses_sorted(const char *modpath, const size_t *modoffs, uint count,
+                              drsym_info_t *infos INOUT, drsym_error_t *results OUT,
+                              uint flags, drsym_lookup_address_func_t lookup_func)
+{
+    offs_entry_t *sorted;
+    uint i;
+    if (count == 0)
+        return;
+    sorted = (offs_entry_t *) dr_global_alloc(count * sizeof(*sorted));
+    for (i = 0; i < count; i++) {
+        sorted[i].modoffs = modoffs[i];
+        sorted[i].idx = i;
+    }
+    qsort(sorted, count, sizeof(*sorted), compare_offs_entries);
+    for (i = 0; i < count; i++) {
+        uint idx = sorted[i].idx;
+        results[idx] = (*lookup_func)(modpath, sorted[i].modoffs, &infos[idx], flags);
+    }
+    dr_global_free(sorted, count * sizeof(*sorted));
+}
@@ -40,6 +40,7 @@
 
 #include "dwarf.h"
 #include "libdwarf.h"
+#include "hashtable.h"
 
 #include <stdlib.h> /* qsort */
 #include <string.h>
@@ -53,13 +54,36 @@ static bool verbose = false;
     } \
 } while (0)
 
+/* Sorted line tables of recently-queried CUs */
+#define LINES_CACHE_SIZE 8
+
+typedef struct _lines_cache_entry_t {
+    /* The CU's DIE offset: DIE pointers are not stable across CU walks */
+    Dwarf_Off cu_offs;
+    Dwarf_Line *lines;
+    Dwarf_Signed num_lines;
+    uint last_use;
+} lines_cache_entry_t;
+
+/* The address range of a CU's line table, which lets us rule a CU in or out
+ * when searching all CUs without fetching and sorting its lines again.
+ */
+#define CU_SUMMARY_HASH_BITS 8
+
+typedef struct _cu_summary_t {
+    Dwarf_Signed num_lines; /* -1 if the CU has no line info */
+    Dwarf_Addr min_addr;
+    Dwarf_Addr max_addr;
+} cu_summary_t;
+
 typedef struct _dwarf_module_t {
     byte *load_base;
     Dwarf_Debug dbg;
-    /* we cache the last CU we looked up */
-    Dwarf_Die lines_cu;
-    Dwarf_Line *lines;
-    Dwarf_Signed num_lines;
+    /* LRU cache of the CUs we most recently looked up */
+    lines_cache_entry_t lines_cache[LINES_CACHE_SIZE];
+    uint lines_cache_clock;
+    /* Maps the DIE offset of a CU to cu_summary_t */
+    hashtable_t cu_summaries;
     /* Amount to adjust all offsets for __PAGEZERO + PIE (i#1365) */
     ssize_t offs_adjust;
 } dwarf_module_t;
@@ -74,6 +98,9 @@ static search_result_t
 search_addr2line_in_cu(dwarf_module_t *mod, Dwarf_Addr pc, Dwarf_Die cu_die,
                        drsym_info_t *sym_info INOUT);
 
+static search_result_t
+classify_cu(dwarf_module_t *mod, Dwarf_Addr pc, Dwarf_Die cu_die);
+
 /******************************************************************************
  * DWARF parsing code.
  */
@@ -188,7 +215,7 @@ drsym_dwarf_search_addr2line(void *mod_in, Dwarf_Addr pc, drsym_info_t *sym_info
 {
     dwarf_module_t *mod = (dwarf_module_t *) mod_in;
     Dwarf_Error de; /* expensive to init (DrM#1770) */
-    Dwarf_Die cu_die;
+    Dwarf_Die cu_die, found_cu = NULL;
     Dwarf_Unsigned cu_offset = 0;
     bool success = false;
     search_result_t res;
@@ -217,6 +244,8 @@ drsym_dwarf_search_addr2line(void *mod_in, Dwarf_Addr pc, drsym_info_t *sym_info
     /* We failed to find a CU containing this PC.  Some compilers (clang) don't
      * put lo_pc hi_pc attributes on compilation units.  In this case, we
      * iterate all the CUs and dig into the dwarf tag soup for all of them.
+     * We use each CU's cached line range to pick the CU and only then
+     * search its lines.
      */
     while (dwarf_next_cu_header(mod->dbg, NULL, NULL, NULL, NULL,
                                 &cu_offset, &de) == DW_DLV_OK) {
@@ -225,16 +254,18 @@ drsym_dwarf_search_addr2line(void *mod_in, Dwarf_Addr pc, drsym_info_t *sym_info
 
         /* We found a CU die, now check if it's the one we wanted. */
         if (cu_die != NULL) {
-            res = search_addr2line_in_cu(mod, pc, cu_die, sym_info);
+            res = classify_cu(mod, pc, cu_die);
             if (res == SEARCH_FOUND) {
-                success = true;
+                found_cu = cu_die;
                 break;
             } else if (res == SEARCH_MAYBE) {
-                success = true;
                 /* try to find a better fit: continue searching */
+                found_cu = cu_die;
             }
         }
     }
+    if (found_cu != NULL)
+        success = (search_addr2line_in_cu(mod, pc, found_cu, sym_info) != SEARCH_NOT_FOUND);
 
     while (dwarf_next_cu_header(mod->dbg, NULL, NULL, NULL, NULL,
                                 &cu_offset, &de) == DW_DLV_OK) {
@@ -248,10 +279,23 @@ static Dwarf_Signed
 get_lines_from_cu(dwarf_module_t *mod, Dwarf_Die cu_die,
                   Dwarf_Line **lines_out OUT)
 {
-    if (mod->lines_cu != cu_die) {
+    lines_cache_entry_t *entry = NULL;
+    Dwarf_Off cu_offs;
+    Dwarf_Error de; /* expensive to init (DrM#1770) */
+    int i;
+    if (dwarf_dieoffset(cu_die, &cu_offs, &de) != DW_DLV_OK) {
+        NOTIFY_DWARF(de);
+        return -1;
+    }
+    for (i = 0; i < LINES_CACHE_SIZE; i++) {
+        if (mod->lines_cache[i].lines != NULL && mod->lines_cache[i].cu_offs == cu_offs) {
+            entry = &mod->lines_cache[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
         Dwarf_Line *lines;
         Dwarf_Signed num_lines;
-        Dwarf_Error de; /* expensive to init (DrM#1770) */
         if (dwarf_srclines(cu_die, &lines, &num_lines, &de) != DW_DLV_OK) {
             NOTIFY_DWARF(de);
             return -1;
@@ -260,14 +304,61 @@ get_lines_from_cu(dwarf_module_t *mod, Dwarf_Die cu_die,
          * it's easier to sort and store here
          */
         qsort(lines, (size_t)num_lines, sizeof(*lines), compare_lines);
-        /* Save for next query */
-        dwarf_srclines_dealloc(mod->dbg, mod->lines, mod->num_lines);
-        mod->lines_cu = cu_die;
-        mod->lines = lines;
-        mod->num_lines = num_lines;
+        /* Save for later queries, evicting the least recently used entry */
+        entry = &mod->lines_cache[0];
+        for (i = 1; i < LINES_CACHE_SIZE; i++) {
+            if (mod->lines_cache[i].last_use < entry->last_use)
+                entry = &mod->lines_cache[i];
+        }
+        if (entry->lines != NULL)
+            dwarf_srclines_dealloc(mod->dbg, entry->lines, entry->num_lines);
+        entry->cu_offs = cu_offs;
+        entry->lines = lines;
+        entry->num_lines = num_lines;
     }
-    *lines_out = mod->lines;
-    return mod->num_lines;
+    entry->last_use = ++mod->lines_cache_clock;
+    *lines_out = entry->lines;
+    return entry->num_lines;
+}
+
+/* Returns what search_addr2line_in_cu() would find for pc in cu_die, based on
+ * the CU's line range.
+ */
+static search_result_t
+classify_cu(dwarf_module_t *mod, Dwarf_Addr pc, Dwarf_Die cu_die)
+{
+    cu_summary_t *sum;
+    Dwarf_Off cu_offs;
+    Dwarf_Error de; /* expensive to init (DrM#1770) */
+    if (dwarf_dieoffset(cu_die, &cu_offs, &de) != DW_DLV_OK) {
+        NOTIFY_DWARF(de);
+        return SEARCH_NOT_FOUND;
+    }
+    sum = (cu_summary_t *) hashtable_lookup(&mod->cu_summaries,
+                                            (void *)(ptr_uint_t)cu_offs);
+    if (sum == NULL) {
+        Dwarf_Line *lines;
+        sum = (cu_summary_t *) dr_global_alloc(sizeof(*sum));
+        sum->num_lines = get_lines_from_cu(mod, cu_die, &lines);
+        sum->min_addr = 0;
+        sum->max_addr = 0;
+        if (sum->num_lines > 0 &&
+            (dwarf_lineaddr(lines[0], &sum->min_addr, &de) != DW_DLV_OK ||
+             dwarf_lineaddr(lines[sum->num_lines - 1], &sum->max_addr, &de) !=
+             DW_DLV_OK)) {
+            NOTIFY_DWARF(de);
+            sum->num_lines = -1;
+        }
+        hashtable_add(&mod->cu_summaries, (void *)(ptr_uint_t)cu_offs, sum);
+    }
+    if (sum->num_lines <= 0)
+        return SEARCH_NOT_FOUND;
+    /* Keep this consistent with search_addr2line_in_cu(). */
+    if (sum->num_lines == 1 || pc >= sum->max_addr)
+        return SEARCH_MAYBE;
+    if (pc >= sum->min_addr)
+        return SEARCH_FOUND;
+    return SEARCH_NOT_FOUND;
 }
 
 static search_result_t
@@ -276,8 +367,8 @@ search_addr2line_in_cu(dwarf_module_t *mod, Dwarf_Addr pc, Dwarf_Die cu_die,
 {
     Dwarf_Line *lines;
     Dwarf_Signed num_lines;
-    int i;
-    Dwarf_Addr lineaddr, next_lineaddr = 0;
+    Dwarf_Signed lo, hi;
+    Dwarf_Addr lineaddr;
     Dwarf_Line dw_line;
     Dwarf_Error de; /* expensive to init (DrM#1770) */
     search_result_t res = SEARCH_NOT_FOUND;
@@ -294,30 +385,34 @@ search_addr2line_in_cu(dwarf_module_t *mod, Dwarf_Addr pc, Dwarf_Die cu_die,
         }
     }
 
-    /* We could binary search this, but we assume dwarf_srclines is the
-     * bottleneck.
+    /* Now that the sorted tables are cached, dwarf_srclines is no longer the
+     * bottleneck for repeated queries, so we binary search for the number of
+     * lines starting at or below pc.
      */
     dw_line = NULL;
-    for (i = 0; i < num_lines - 1; i++) {
-        if (dwarf_lineaddr(lines[i], &lineaddr, &de) != DW_DLV_OK ||
-            dwarf_lineaddr(lines[i + 1], &next_lineaddr, &de) != DW_DLV_OK) {
+    lo = 0;
+    hi = num_lines;
+    while (lo < hi) {
+        Dwarf_Signed mid = lo + (hi - lo) / 2;
+        if (dwarf_lineaddr(lines[mid], &lineaddr, &de) != DW_DLV_OK) {
             NOTIFY_DWARF(de);
-            break;
-        }
-        NOTIFY("%s: pc "PFX" vs line "PFX"-"PFX"\n", __FUNCTION__, (ptr_uint_t)pc,
-               (ptr_uint_t)lineaddr, (ptr_uint_t)next_lineaddr);
-        if (lineaddr <= pc && pc < next_lineaddr) {
-            dw_line = lines[i];
-            res = SEARCH_FOUND;
-            break;
+            return SEARCH_NOT_FOUND;
         }
+        NOTIFY("%s: pc "PFX" vs line "PFX"\n", __FUNCTION__, (ptr_uint_t)pc,
+               (ptr_uint_t)lineaddr);
+        if (lineaddr <= pc)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
-    /* Handle the case when the PC is from the last line of the CU. */
-    if (i == num_lines - 1 && dw_line == NULL && next_lineaddr <= pc) {
-        NOTIFY("%s: pc "PFX" vs last line "PFX"\n",
-               __FUNCTION__, (ptr_uint_t)pc, (ptr_uint_t)next_lineaddr);
+    if (num_lines == 1 || (lo == num_lines && lo > 0)) {
+        /* Handle the case when the PC is from the last line of the CU. */
+        NOTIFY("%s: pc "PFX" in last line\n", __FUNCTION__, (ptr_uint_t)pc);
         dw_line = lines[num_lines - 1];
         res = SEARCH_MAYBE;
+    } else if (lo > 0) {
+        dw_line = lines[lo - 1];
+        res = SEARCH_FOUND;
     }
 
     /* If we found dw_line, use it to fill out sym_info. */
@@ -440,12 +535,20 @@ drsym_dwarf_enumerate_lines(void *mod_in, drsym_enumerate_lines_cb callback, voi
     return success;
 }
 
+static void
+free_cu_summary(void *sum)
+{
+    dr_global_free(sum, sizeof(cu_summary_t));
+}
+
 void *
 drsym_dwarf_init(Dwarf_Debug dbg)
 {
     dwarf_module_t *mod = (dwarf_module_t *) dr_global_alloc(sizeof(*mod));
     memset(mod, 0, sizeof(*mod));
     mod->dbg = dbg;
+    hashtable_init_ex(&mod->cu_summaries, CU_SUMMARY_HASH_BITS, HASH_INTPTR,
+                      false/*!strdup*/, false/*!synch*/, free_cu_summary, NULL, NULL);
     return mod;
 }
 
@@ -453,8 +556,14 @@ void
 drsym_dwarf_exit(void *mod_in)
 {
     dwarf_module_t *mod = (dwarf_module_t *) mod_in;
-    if (mod->lines != NULL)
-        dwarf_srclines_dealloc(mod->dbg, mod->lines, mod->num_lines);
+    int i;
+    for (i = 0; i < LINES_CACHE_SIZE; i++) {
+        if (mod->lines_cache[i].lines != NULL) {
+            dwarf_srclines_dealloc(mod->dbg, mod->lines_cache[i].lines,
+                                   mod->lines_cache[i].num_lines);
+        }
+    }
+    hashtable_delete(&mod->cu_summaries);
     dwarf_finish(mod->dbg, NULL);
     dr_global_free(mod, sizeof(*mod));
 }
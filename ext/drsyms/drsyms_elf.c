@@ -43,6 +43,7 @@
 #include "dwarf.h"
 #include "libdwarf.h"
 
+#include <stdlib.h> /* qsort */
 #include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -102,6 +103,7 @@ static bool verbose = 0;
 # define Elf_Phdr Elf64_Phdr
 # define Elf_Shdr Elf64_Shdr
 # define Elf_Sym  Elf64_Sym
+# define Elf_Nhdr Elf64_Nhdr
 # define ELF_ST_TYPE ELF64_ST_TYPE
 #else
 # define elf_getehdr elf32_getehdr
@@ -111,9 +113,40 @@ static bool verbose = 0;
 # define Elf_Phdr Elf32_Phdr
 # define Elf_Shdr Elf32_Shdr
 # define Elf_Sym  Elf32_Sym
+# define Elf_Nhdr Elf32_Nhdr
 # define ELF_ST_TYPE ELF32_ST_TYPE
 #endif
 
+/* An entry in the address-sorted symbol index */
+typedef struct _addr_entry_t {
+    size_t lo_offs;
+    size_t hi_offs;
+    /* The maximum hi_offs of this and all prior entries in the index, which
+     * bounds how far back a containing symbol can be.
+     */
+    size_t max_hi_offs;
+    uint idx;
+} addr_entry_t;
+
+/* Header of a persistent index file, which is followed by num_syms
+ * addr_entry_t.  We only reuse a file written by the same build of drsyms
+ * for the same bitwidth and the same build-id.
+ */
+#define INDEX_FILE_MAGIC 0x5844494d59535244ULL /* "DRSYMIDX" */
+#define INDEX_FILE_VERSION 1
+#define INDEX_FILE_SUFFIX ".drsymidx"
+#define MAX_BUILD_ID_LEN 64
+
+typedef struct _index_file_header_t {
+    uint64 magic;
+    uint version;
+    uint entry_size;
+    uint64 load_base;
+    uint num_syms;
+    uint build_id_len;
+    byte build_id[MAX_BUILD_ID_LEN];
+} index_file_header_t;
+
 typedef struct _elf_info_t {
     Elf *elf;
     Elf_Sym *syms;
@@ -122,8 +155,19 @@ typedef struct _elf_info_t {
     byte *map_base;
     ptr_uint_t load_base;
     drsym_debug_kind_t debug_kind;
+    /* Built on the first address lookup, sorted by lo_offs then idx.
+     * If index_map_base is non-NULL it points into a mapped index file.
+     */
+    addr_entry_t *addr_index;
+    byte *index_map_base;
+    size_t index_map_size;
 } elf_info_t;
 
+/* Directory of persistent index files, or empty if disabled.
+ * Protected by the caller's synchronization, like the rest of this file.
+ */
+static char index_cache_dir[MAXIMUM_PATH];
+
 /* Looks for a section with real data, not just a section with a header */
 static Elf_Scn *
 find_elf_section_by_name(Elf *elf, const char *match_name)
@@ -290,6 +334,10 @@ drsym_obj_mod_exit(void *mod_in)
         return;
     if (mod->elf != NULL)
         elf_end(mod->elf);
+    if (mod->index_map_base != NULL)
+        dr_unmap_file(mod->index_map_base, mod->index_map_size);
+    else if (mod->addr_index != NULL)
+        dr_global_free(mod->addr_index, mod->num_syms * sizeof(*mod->addr_index));
     dr_global_free(mod, sizeof(*mod));
 }
 
@@ -378,44 +426,250 @@ drsym_obj_symbol_offs(void *mod_in, uint idx, size_t *offs_start OUT,
     return DRSYM_SUCCESS;
 }
 
+static int
+compare_addr_entries(const void *a_in, const void *b_in)
+{
+    const addr_entry_t *a = (const addr_entry_t *) a_in;
+    const addr_entry_t *b = (const addr_entry_t *) b_in;
+    if (a->lo_offs != b->lo_offs)
+        return (a->lo_offs > b->lo_offs) ? 1 : -1;
+    if (a->idx != b->idx)
+        return (a->idx > b->idx) ? 1 : -1;
+    return 0;
+}
+
+/* Returns the length of the NT_GNU_BUILD_ID note's descriptor, which is
+ * copied into buf, or 0 if there is none.
+ */
+static uint
+find_build_id(elf_info_t *mod, byte *buf, uint buf_size)
+{
+    Elf_Scn *scn = find_elf_section_by_name(mod->elf, ".note.gnu.build-id");
+    Elf_Shdr *shdr;
+    Elf_Data *data;
+    byte *cur, *end;
+    if (scn == NULL || (shdr = elf_getshdr(scn)) == NULL)
+        return 0;
+    data = elf_getdata(scn, NULL);
+    if (data == NULL || data->d_buf == NULL)
+        return 0;
+    cur = (byte *) data->d_buf;
+    end = cur + data->d_size;
+    while (cur + sizeof(Elf_Nhdr) <= end) {
+        Elf_Nhdr *nhdr = (Elf_Nhdr *) cur;
+        byte *name = cur + sizeof(*nhdr);
+        byte *desc = name + ALIGN_FORWARD(nhdr->n_namesz, 4);
+        if (desc + nhdr->n_descsz > end)
+            break;
+        if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+            strncmp((char *) name, "GNU", 4) == 0) {
+            if (nhdr->n_descsz == 0 || nhdr->n_descsz > buf_size)
+                return 0;
+            memcpy(buf, desc, nhdr->n_descsz);
+            return nhdr->n_descsz;
+        }
+        cur = desc + ALIGN_FORWARD(nhdr->n_descsz, 4);
+    }
+    return 0;
+}
+
+/* Fills in the index file path and header for mod.  Returns false if
+ * persistent indices are disabled or mod has no build-id.
+ */
+static bool
+get_index_file(elf_info_t *mod, char *path, size_t path_size,
+               index_file_header_t *hdr OUT)
+{
+    char *cur;
+    uint i;
+    int len;
+    if (index_cache_dir[0] == '\0')
+        return false;
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->build_id_len = find_build_id(mod, hdr->build_id, sizeof(hdr->build_id));
+    if (hdr->build_id_len == 0)
+        return false;
+    hdr->magic = INDEX_FILE_MAGIC;
+    hdr->version = INDEX_FILE_VERSION;
+    hdr->entry_size = sizeof(addr_entry_t);
+    hdr->load_base = mod->load_base;
+    hdr->num_syms = mod->num_syms;
+    len = dr_snprintf(path, path_size, "%s/", index_cache_dir);
+    if (len < 0 || (size_t)len + hdr->build_id_len * 2 + strlen(INDEX_FILE_SUFFIX) >=
+        path_size)
+        return false;
+    cur = path + len;
+    for (i = 0; i < hdr->build_id_len; i++) {
+        dr_snprintf(cur, 3, "%02x", hdr->build_id[i]);
+        cur += 2;
+    }
+    strncpy(cur, INDEX_FILE_SUFFIX, path_size - (cur - path));
+    path[path_size - 1] = '\0';
+    return true;
+}
+
+/* Maps a previously written index file, if it matches mod. */
+static bool
+load_addr_index(elf_info_t *mod, const char *path, const index_file_header_t *hdr)
+{
+    uint64 file_size;
+    size_t map_size;
+    byte *map;
+    int i;
+    file_t fd = dr_open_file(path, DR_FILE_READ);
+    if (fd == INVALID_FILE)
+        return false;
+    if (!dr_file_size(fd, &file_size) ||
+        file_size != sizeof(*hdr) + (uint64)mod->num_syms * sizeof(addr_entry_t)) {
+        dr_close_file(fd);
+        return false;
+    }
+    map_size = (size_t) file_size;
+    map = dr_map_file(fd, &map_size, 0, NULL, DR_MEMPROT_READ, DR_MAP_PRIVATE);
+    /* The mapping remains valid after closing the file. */
+    dr_close_file(fd);
+    if (map == NULL)
+        return false;
+    if (map_size < file_size || memcmp(map, hdr, sizeof(*hdr)) != 0) {
+        dr_unmap_file(map, map_size);
+        return false;
+    }
+    /* Do not trust the file's indices into our symbol table. */
+    for (i = 0; i < mod->num_syms; i++) {
+        if (((addr_entry_t *)(map + sizeof(*hdr)))[i].idx >= (uint)mod->num_syms) {
+            dr_unmap_file(map, map_size);
+            return false;
+        }
+    }
+    mod->index_map_base = map;
+    mod->index_map_size = map_size;
+    mod->addr_index = (addr_entry_t *)(map + sizeof(*hdr));
+    NOTIFY(1, "%s: mapped %s\n", __FUNCTION__, path);
+    return true;
+}
+
+/* Writes the index to a temporary file and renames it into place, so that
+ * concurrent processes never map a partial file.
+ */
+static void
+save_addr_index(elf_info_t *mod, const char *path, const index_file_header_t *hdr)
+{
+    char tmp_path[MAXIMUM_PATH];
+    size_t size = mod->num_syms * sizeof(*mod->addr_index);
+    file_t fd;
+    bool ok;
+    if (dr_snprintf(tmp_path, BUFFER_SIZE_ELEMENTS(tmp_path), "%s.%d", path,
+                    dr_get_process_id()) < 0)
+        return;
+    NULL_TERMINATE_BUFFER(tmp_path);
+    fd = dr_open_file(tmp_path, DR_FILE_WRITE_OVERWRITE);
+    if (fd == INVALID_FILE)
+        return;
+    ok = (dr_write_file(fd, hdr, sizeof(*hdr)) == sizeof(*hdr) &&
+          dr_write_file(fd, mod->addr_index, size) == (ssize_t) size);
+    dr_close_file(fd);
+    if (!ok || !dr_rename_file(tmp_path, path, true/*replace*/))
+        dr_delete_file(tmp_path);
+    else
+        NOTIFY(1, "%s: wrote %s\n", __FUNCTION__, path);
+}
+
+/* Sorts the symbol table by address so that lookups are a binary search
+ * rather than a walk of every symbol.  All symbols are included, so that
+ * the results match a linear walk in table order.
+ * If a persistent index matching this module is available, it is mapped
+ * instead; otherwise a newly built index is saved for later runs.
+ */
+static bool
+build_addr_index(elf_info_t *mod)
+{
+    int i;
+    size_t max_hi = 0;
+    char path[MAXIMUM_PATH];
+    index_file_header_t hdr;
+    bool use_file;
+    if (mod->num_syms <= 0)
+        return false;
+    use_file = get_index_file(mod, path, BUFFER_SIZE_ELEMENTS(path), &hdr);
+    if (use_file && load_addr_index(mod, path, &hdr))
+        return true;
+    mod->addr_index = (addr_entry_t *)
+        dr_global_alloc(mod->num_syms * sizeof(*mod->addr_index));
+    for (i = 0; i < mod->num_syms; i++) {
+        mod->addr_index[i].lo_offs = mod->syms[i].st_value - mod->load_base;
+        mod->addr_index[i].hi_offs = mod->addr_index[i].lo_offs + mod->syms[i].st_size;
+        mod->addr_index[i].idx = i;
+    }
+    qsort(mod->addr_index, mod->num_syms, sizeof(*mod->addr_index),
+          compare_addr_entries);
+    for (i = 0; i < mod->num_syms; i++) {
+        if (mod->addr_index[i].hi_offs > max_hi)
+            max_hi = mod->addr_index[i].hi_offs;
+        mod->addr_index[i].max_hi_offs = max_hi;
+    }
+    NOTIFY(1, "%s: indexed %d symbols\n", __FUNCTION__, mod->num_syms);
+    if (use_file)
+        save_addr_index(mod, path, &hdr);
+    return true;
+}
+
 drsym_error_t
 drsym_obj_addrsearch_symtab(void *mod_in, size_t modoffs, uint *idx OUT)
 {
     elf_info_t *mod = (elf_info_t *) mod_in;
-    int i;
+    int lo, hi, k;
     int closest_idx = -1;
-    size_t closest_diff = SIZE_T_MAX;
+    uint found_idx = UINT_MAX;
 
     if (mod == NULL || mod->syms == NULL || idx == NULL)
         return DRSYM_ERROR;
+    if (mod->addr_index == NULL && !build_addr_index(mod))
+        return DRSYM_ERROR_SYMBOL_NOT_FOUND;
 
     NOTIFY(1, "%s: +"PIFX"\n", __FUNCTION__, modoffs);
+    /* Find the number of entries starting at or below modoffs. */
+    lo = 0;
+    hi = mod->num_syms;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (mod->addr_index[mid].lo_offs <= modoffs)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return DRSYM_ERROR_SYMBOL_NOT_FOUND;
+
     /* XXX: if a function is split into non-contiguous pieces, will it
      * have multiple entries?
      */
-    for (i = 0; i < mod->num_syms; i++) {
-        size_t lo_offs = mod->syms[i].st_value - mod->load_base;
-        size_t hi_offs = lo_offs + mod->syms[i].st_size;
-        NOTIFY(3, "\tcomparing +"PIFX" to "PIFX"-"PIFX"\n", modoffs, lo_offs, hi_offs);
-        if (lo_offs <= modoffs && modoffs < hi_offs) {
-            NOTIFY(2, "\tfound +"PIFX" in "PIFX"-"PIFX"\n", modoffs, lo_offs, hi_offs);
-            *idx = i;
-            return DRSYM_SUCCESS;
-        }
-        /* i#1337: handle st_size==0 asm routines */
-        if (modoffs >= lo_offs) {
-            if (modoffs - lo_offs < closest_diff) {
-                closest_idx = i;
-                closest_diff = modoffs - lo_offs;
-                NOTIFY(3, "\tclosest diff is now "PIFX"\n", closest_diff);
-            }
-        }
+    /* Symbols may overlap, so we walk back over every entry that could contain
+     * modoffs and, as a walk in table order would, take the lowest index.
+     */
+    for (k = lo - 1; k >= 0 && mod->addr_index[k].max_hi_offs > modoffs; k--) {
+        if (modoffs < mod->addr_index[k].hi_offs && mod->addr_index[k].idx < found_idx)
+            found_idx = mod->addr_index[k].idx;
+    }
+    if (found_idx != UINT_MAX) {
+        NOTIFY(2, "\tfound +"PIFX" in "PIFX"-"PIFX"\n", modoffs,
+               mod->syms[found_idx].st_value - mod->load_base,
+               mod->syms[found_idx].st_value - mod->load_base +
+               mod->syms[found_idx].st_size);
+        *idx = found_idx;
+        return DRSYM_SUCCESS;
     }
 
+    /* i#1337: handle st_size==0 asm routines: use the first symbol in table
+     * order among those starting closest below modoffs.
+     */
+    for (k = lo - 1; k >= 0 &&
+             mod->addr_index[k].lo_offs == mod->addr_index[lo - 1].lo_offs; k--)
+        closest_idx = mod->addr_index[k].idx;
     if (closest_idx >= 0 && mod->syms[closest_idx].st_size == 0) {
         /* i#1337: rule out anything without a name */
         const char *name = drsym_obj_symbol_name(mod_in, closest_idx);
-        NOTIFY(2, "\tusing closest +"PIFX" diff "PIFX"\n", modoffs, closest_diff);
+        NOTIFY(2, "\tusing closest +"PIFX" diff "PIFX"\n", modoffs,
+               modoffs - mod->addr_index[lo - 1].lo_offs);
         if (name != NULL && name[0] != '\0') {
             *idx = closest_idx;
             return DRSYM_SUCCESS;
@@ -453,6 +707,20 @@ drsym_obj_same_file(const char *path1, const char *path2)
     return stat1.st_ino == stat2.st_ino;
 }
 
+bool
+drsym_obj_set_index_cache_dir(const char *dir)
+{
+    if (dir == NULL) {
+        index_cache_dir[0] = '\0';
+        return true;
+    }
+    if (strlen(dir) >= BUFFER_SIZE_ELEMENTS(index_cache_dir) || !dr_directory_exists(dir))
+        return false;
+    strncpy(index_cache_dir, dir, BUFFER_SIZE_ELEMENTS(index_cache_dir));
+    NULL_TERMINATE_BUFFER(index_cache_dir);
+    return true;
+}
+
 const char *
 drsym_obj_debug_path(void)
 {
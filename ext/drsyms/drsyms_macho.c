@@ -629,6 +629,13 @@ drsym_obj_same_file(const char *path1, const char *path2)
     return stat1.st_ino == stat2.st_ino;
 }
 
+bool
+drsym_obj_set_index_cache_dir(const char *dir)
+{
+    /* NYI: only ELF has a persistent symbol index */
+    return false;
+}
+
 const char *
 drsym_obj_debug_path(void)
 {
@@ -101,6 +101,12 @@ drsym_obj_same_file(const char *path1, const char *path2);
 const char *
 drsym_obj_debug_path(void);
 
+/* Sets the directory for persistent symbol indices, or disables them if dir
+ * is NULL.  Returns false if unsupported for this object format.
+ */
+bool
+drsym_obj_set_index_cache_dir(const char *dir);
+
 /***************************************************************************
  * DWARF
  */
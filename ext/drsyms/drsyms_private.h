@@ -74,6 +74,18 @@ void pool_init(mempool_t *pool, char *buf, size_t sz);
  */
 void *pool_alloc(mempool_t *pool, size_t sz);
 
+/* Performs the queries of drsym_lookup_addresses() via lookup_func in
+ * increasing offset order.  The caller is responsible for synchronization.
+ */
+typedef drsym_error_t (*drsym_lookup_address_func_t)(const char *modpath,
+                                                     size_t modoffs,
+                                                     drsym_info_t *out INOUT,
+                                                     uint flags);
+void
+drsym_lookup_addresses_sorted(const char *modpath, const size_t *modoffs, uint count,
+                              drsym_info_t *infos INOUT, drsym_error_t *results OUT,
+                              uint flags, drsym_lookup_address_func_t lookup_func);
+
 #define POOL_ALLOC(pool, type) \
     ((type*)pool_alloc(pool, sizeof(type)))
 #define POOL_ALLOC_SIZE(pool, type, size) \
@@ -109,6 +121,15 @@ drsym_unix_enumerate_symbols(void *moddata, drsym_enumerate_cb callback,
                              drsym_enumerate_ex_cb callback_ex, size_t info_size,
                              void *data, uint flags);
 
+drsym_error_t
+drsym_unix_search_symbols(void *moddata, const char *match, uint flags,
+                          drsym_enumerate_cb callback,
+                          drsym_enumerate_ex_cb callback_ex, size_t info_size,
+                          void *data);
+
+bool
+drsym_unix_set_index_cache_dir(const char *dir);
+
 size_t
 drsym_unix_demangle_symbol(char *dst OUT, size_t dst_sz, const char *mangled,
                            uint flags);
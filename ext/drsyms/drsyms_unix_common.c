@@ -45,6 +45,7 @@
 #include <string.h> /* strlen */
 #include <errno.h>
 #include <stddef.h> /* offsetof */
+#include <stdlib.h> /* qsort */
 
 #include "demangle.h"
 #include "libelftc.h"
@@ -58,6 +59,35 @@
 /* For debugging */
 static bool verbose = false;
 
+/* An entry in a name index: the symbol's name in the form produced by a given
+ * set of demangling flags, along with its symbol table index.
+ */
+typedef struct _name_entry_t {
+    const char *name;
+    uint idx;
+} name_entry_t;
+
+/* The demangling choices that lead to distinct symbol names. */
+enum {
+    NAME_INDEX_MANGLED,
+    NAME_INDEX_SHORT,
+    NAME_INDEX_FULL,
+    NAME_INDEX_KINDS,
+};
+
+/* Symbol names sorted by strcmp, built on the first name query with a given
+ * demangling choice so that later queries need not walk and demangle the
+ * whole symbol table.  Demangled names are copied into pool while mangled ones
+ * point into the module's string table.
+ */
+typedef struct _name_index_t {
+    name_entry_t *entries;
+    uint num_entries;
+    uint max_entries;
+    char *pool;
+    size_t pool_size;
+} name_index_t;
+
 typedef struct _dbg_module_t {
     file_t fd;
     size_t file_size;
@@ -71,6 +101,7 @@ typedef struct _dbg_module_t {
      * while the primary mod has symtab+strtab.
      */
     struct _dbg_module_t *mod_with_dwarf;
+    name_index_t *name_index[NAME_INDEX_KINDS];
 } dbg_module_t;
 
 /******************************************************************************
@@ -78,6 +109,7 @@ typedef struct _dbg_module_t {
  */
 
 static void unload_module(dbg_module_t *mod);
+static void free_name_index(name_index_t *index);
 static bool follow_debuglink(const char * modpath, dbg_module_t *mod,
                              const char *debuglink, char debug_modpath[MAXIMUM_PATH]);
 
@@ -288,6 +320,11 @@ follow_debuglink(const char *modpath, dbg_module_t *mod, const char *debuglink,
 static void
 unload_module(dbg_module_t *mod)
 {
+    int i;
+    for (i = 0; i < NAME_INDEX_KINDS; i++) {
+        if (mod->name_index[i] != NULL)
+            free_name_index(mod->name_index[i]);
+    }
     if (mod->dwarf_info != NULL)
         drsym_dwarf_exit(mod->dwarf_info);
     if (mod->obj_info != NULL)
@@ -426,6 +463,205 @@ addrsearch_symtab(dbg_module_t *mod, size_t modoffs, drsym_info_t *info INOUT,
     return drsym_obj_symbol_offs(mod->obj_info, idx, &info->start_offs, &info->end_offs);
 }
 
+/******************************************************************************
+ * Name index
+ */
+
+static uint
+name_index_kind(uint flags)
+{
+    if (!TEST(DRSYM_DEMANGLE, flags))
+        return NAME_INDEX_MANGLED;
+    return TEST(DRSYM_DEMANGLE_FULL, flags) ? NAME_INDEX_FULL : NAME_INDEX_SHORT;
+}
+
+static int
+compare_name_entries(const void *a_in, const void *b_in)
+{
+    const name_entry_t *a = (const name_entry_t *) a_in;
+    const name_entry_t *b = (const name_entry_t *) b_in;
+    int cmp = strcmp(a->name, b->name);
+    if (cmp != 0)
+        return cmp;
+    if (a->idx != b->idx)
+        return (a->idx > b->idx) ? 1 : -1;
+    return 0;
+}
+
+static void
+free_name_index(name_index_t *index)
+{
+    if (index->pool != NULL)
+        dr_global_free(index->pool, index->pool_size);
+    dr_global_free(index->entries, index->max_entries * sizeof(*index->entries));
+    dr_global_free(index, sizeof(*index));
+}
+
+/* Appends name to the index's pool, growing it as needed, and returns the
+ * offset of the copy: the pool may move until the index is complete.
+ */
+static size_t
+name_index_append(name_index_t *index, size_t *pool_used INOUT, const char *name)
+{
+    size_t len = strlen(name) + 1;
+    size_t offs = *pool_used;
+    if (offs + len > index->pool_size) {
+        size_t new_size = index->pool_size * 2;
+        char *new_pool;
+        if (new_size < offs + len)
+            new_size = offs + len;
+        new_pool = (char *) dr_global_alloc(new_size);
+        memcpy(new_pool, index->pool, offs);
+        dr_global_free(index->pool, index->pool_size);
+        index->pool = new_pool;
+        index->pool_size = new_size;
+    }
+    memcpy(index->pool + offs, name, len);
+    *pool_used += len;
+    return offs;
+}
+
+/* Walks and, if requested by flags, demangles the symbol table once to
+ * build a name index.  Imports are left out, as in symsearch_symtab().
+ */
+static drsym_error_t
+build_name_index(dbg_module_t *mod, uint flags, name_index_t **index_out OUT)
+{
+    int num_syms;
+    int i;
+    name_index_t *index;
+    bool demangle = TEST(DRSYM_DEMANGLE, flags);
+    size_t name_buf_size = 1024;  /* C++ symbols can be quite long. */
+    char *name_buf = NULL;
+    size_t pool_used = 0;
+    drsym_error_t res = DRSYM_SUCCESS;
+
+    num_syms = drsym_obj_num_symbols(mod->obj_info);
+    if (num_syms == 0)
+        return DRSYM_ERROR;
+
+    index = (name_index_t *) dr_global_alloc(sizeof(*index));
+    memset(index, 0, sizeof(*index));
+    index->max_entries = num_syms;
+    index->entries = (name_entry_t *)
+        dr_global_alloc(index->max_entries * sizeof(*index->entries));
+    if (demangle) {
+        /* Just a starting guess: name_index_append() grows it. */
+        index->pool_size = num_syms * 32;
+        index->pool = (char *) dr_global_alloc(index->pool_size);
+        name_buf = (char *) dr_global_alloc(name_buf_size);
+    }
+
+    for (i = 0; i < num_syms; i++) {
+        const char *mangled = drsym_obj_symbol_name(mod->obj_info, i);
+        name_entry_t *entry;
+        size_t modoffs, len;
+        if (mangled == NULL) {
+            res = DRSYM_ERROR;
+            break;
+        }
+        res = drsym_obj_symbol_offs(mod->obj_info, i, &modoffs, NULL);
+        if (res == DRSYM_ERROR_SYMBOL_NOT_FOUND) { /* an import, so skip */
+            res = DRSYM_SUCCESS; /* if go off end of loop */
+            continue;
+        }
+        if (res != DRSYM_SUCCESS)
+            break;
+        entry = &index->entries[index->num_entries++];
+        entry->idx = i;
+        if (!demangle) {
+            entry->name = mangled;
+            continue;
+        }
+        /* Resize until it's big enough. */
+        while ((len = drsym_demangle_symbol(name_buf, name_buf_size, mangled, flags))
+               > name_buf_size) {
+            dr_global_free(name_buf, name_buf_size);
+            name_buf_size = len;
+            name_buf = (char *) dr_global_alloc(name_buf_size);
+        }
+        /* We store the offset until the pool stops moving. */
+        entry->name = (const char *) (ptr_uint_t)
+            name_index_append(index, &pool_used, len == 0 ? mangled : name_buf);
+    }
+    if (name_buf != NULL)
+        dr_global_free(name_buf, name_buf_size);
+    if (res != DRSYM_SUCCESS) {
+        free_name_index(index);
+        return res;
+    }
+
+    if (demangle) {
+        uint j;
+        for (j = 0; j < index->num_entries; j++) {
+            index->entries[j].name =
+                index->pool + (ptr_uint_t) index->entries[j].name;
+        }
+    }
+    qsort(index->entries, index->num_entries, sizeof(*index->entries),
+          compare_name_entries);
+    NOTIFY("%s: indexed %u names\n", __FUNCTION__, index->num_entries);
+    *index_out = index;
+    return DRSYM_SUCCESS;
+}
+
+static drsym_error_t
+get_name_index(dbg_module_t *mod, uint flags, name_index_t **index_out OUT)
+{
+    uint kind = name_index_kind(flags);
+    if (mod->name_index[kind] == NULL) {
+        drsym_error_t res = build_name_index(mod, flags, &mod->name_index[kind]);
+        if (res != DRSYM_SUCCESS)
+            return res;
+    }
+    *index_out = mod->name_index[kind];
+    return DRSYM_SUCCESS;
+}
+
+/* Returns the index of the first entry whose name is not less than prefix when
+ * only the first prefix_len characters are compared.  Since the entries are
+ * sorted, all names starting with prefix follow it contiguously.
+ */
+static uint
+name_index_lower_bound(name_index_t *index, const char *prefix, size_t prefix_len)
+{
+    uint lo = 0, hi = index->num_entries;
+    while (lo < hi) {
+        uint mid = lo + (hi - lo) / 2;
+        if (strncmp(index->entries[mid].name, prefix, prefix_len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* Matches str against pattern, where '*' matches any sequence of characters
+ * and '?' matches any single character.
+ */
+static bool
+match_wildcard(const char *pattern, const char *str)
+{
+    const char *star_pattern = NULL, *star_str = NULL;
+    while (*str != '\0') {
+        if (*pattern == '*') {
+            star_pattern = pattern++;
+            star_str = str;
+        } else if (*pattern == '?' || *pattern == *str) {
+            pattern++;
+            str++;
+        } else if (star_pattern != NULL) {
+            /* Let the last '*' absorb one more character and retry. */
+            pattern = star_pattern + 1;
+            str = ++star_str;
+        } else
+            return false;
+    }
+    while (*pattern == '*')
+        pattern++;
+    return *pattern == '\0';
+}
+
 /******************************************************************************
  * Exports
  */
@@ -442,6 +678,12 @@ drsym_unix_exit(void)
     /* nothing */
 }
 
+bool
+drsym_unix_set_index_cache_dir(const char *dir)
+{
+    return drsym_obj_set_index_cache_dir(dir);
+}
+
 void *
 drsym_unix_load(const char *modpath)
 {
@@ -466,39 +708,46 @@ drsym_unix_enumerate_symbols(void *mod_in, drsym_enumerate_cb callback,
     return symsearch_symtab(mod, callback, callback_ex, info_size, data, flags);
 }
 
-/* Params to sym_lookup_cb passed through data. */
-typedef struct _sym_lookup_params_t {
-    const char *search_sym;
-    size_t search_sym_len;
-    size_t *modoffs;
-} sym_lookup_params_t;
-
-/* Symbol enumeration callback for doing a single lookup.
+/* Finds the first symbol table entry matching symbol, leaving *modoffs at 0
+ * if there is none.
  */
-static bool
-sym_lookup_cb(const char *sym, size_t modoffs, void *data INOUT)
+static drsym_error_t
+name_index_lookup(dbg_module_t *mod, const char *symbol, size_t *modoffs OUT,
+                  uint flags)
 {
-    sym_lookup_params_t *p = (sym_lookup_params_t*)data;
-
-    if (strncmp(sym, p->search_sym, p->search_sym_len) == 0 &&
-        strlen(sym) >= p->search_sym_len &&
-        (sym[p->search_sym_len] == '\0' ||
-         /* Left paren means the beginning of the parameter list.  Since the
-          * parameter list starts where our search string ends, we assume the
-          * user doesn't care about possible overloads.
-          */
-         sym[p->search_sym_len] == '(' ||
-         /* We match the name part of versioned symbols: so "foo" will match
-          * "foo@@GLIBC_2.1".  If there are multiple, a user who wants one in
-          * particular needs to include the version name in the search target.
-          */
-          sym[p->search_sym_len] == '@')) {
-        NOTIFY("Looked up symbol: %s %s\n", p->search_sym, sym);
-        *p->modoffs = modoffs;
-        /* Stop after the first match. */
-        return false;
-    }
-    return true;
+    name_index_t *index;
+    size_t len = strlen(symbol);
+    uint i, best_idx = 0;
+    bool found = false;
+    drsym_error_t r = get_name_index(mod, flags, &index);
+    if (r != DRSYM_SUCCESS)
+        return r;
+    for (i = name_index_lower_bound(index, symbol, len);
+         i < index->num_entries && strncmp(index->entries[i].name, symbol, len) == 0;
+         i++) {
+        char next = index->entries[i].name[len];
+        if ((next == '\0' ||
+             /* Left paren means the beginning of the parameter list.  Since the
+              * parameter list starts where our search string ends, we assume the
+              * user doesn't care about possible overloads.
+              */
+             next == '(' ||
+             /* We match the name part of versioned symbols: so "foo" will match
+              * "foo@@GLIBC_2.1".  If there are multiple, a user who wants one in
+              * particular needs to include the version name in the search target.
+              */
+             next == '@') &&
+            (!found || index->entries[i].idx < best_idx)) {
+            /* Several names can match: we want the first in table order. */
+            found = true;
+            best_idx = index->entries[i].idx;
+        }
+    }
+    if (!found)
+        return DRSYM_SUCCESS;
+    NOTIFY("Looked up symbol: %s %s\n", symbol,
+           drsym_obj_symbol_name(mod->obj_info, best_idx));
+    return drsym_obj_symbol_offs(mod->obj_info, best_idx, modoffs, NULL);
 }
 
 drsym_error_t
@@ -508,7 +757,6 @@ drsym_unix_lookup_symbol(void *mod_in, const char *symbol, size_t *modoffs OUT,
     dbg_module_t *mod = (dbg_module_t *) mod_in;
     drsym_error_t r;
     const char *sym_no_mod;
-    sym_lookup_params_t params;
 
     if (symbol == NULL) {
         sym_no_mod = NULL;
@@ -539,11 +787,7 @@ drsym_unix_lookup_symbol(void *mod_in, const char *symbol, size_t *modoffs OUT,
     }
 
     if (*modoffs == 0) {
-        params.search_sym = sym_no_mod;
-        params.search_sym_len = strlen(sym_no_mod);
-        params.modoffs = modoffs;
-        r = drsym_unix_enumerate_symbols(mod, sym_lookup_cb, NULL, sizeof(drsym_info_t),
-                                         &params, flags);
+        r = name_index_lookup(mod, sym_no_mod, modoffs, flags);
         if (r != DRSYM_SUCCESS)
             return r;
     }
@@ -552,6 +796,93 @@ drsym_unix_lookup_symbol(void *mod_in, const char *symbol, size_t *modoffs OUT,
     return DRSYM_SUCCESS;
 }
 
+drsym_error_t
+drsym_unix_search_symbols(void *mod_in, const char *match, uint flags,
+                          drsym_enumerate_cb callback,
+                          drsym_enumerate_ex_cb callback_ex, size_t info_size,
+                          void *data)
+{
+    dbg_module_t *mod = (dbg_module_t *) mod_in;
+    name_index_t *index;
+    const char *pattern;
+    size_t prefix_len;
+    size_t name_buf_size = 1024;
+    drsym_info_t *out = NULL;
+    bool keep_searching = true, found = false;
+    drsym_error_t res;
+    uint i;
+
+    if (callback_ex != NULL && info_size != sizeof(drsym_info_t))
+        return DRSYM_ERROR_INVALID_SIZE;
+    /* As in drsym_unix_lookup_symbol(), the module portion is ignored. */
+    pattern = strchr(match, '!');
+    if (pattern != NULL)
+        pattern++;
+    else
+        pattern = match;
+    res = get_name_index(mod, flags, &index);
+    if (res != DRSYM_SUCCESS)
+        return res;
+
+    if (callback_ex != NULL) {
+        out = (drsym_info_t *) dr_global_alloc(info_size);
+        out->name = (char *) dr_global_alloc(name_buf_size);
+        out->struct_size = info_size;
+        out->debug_kind = mod->debug_kind;
+        out->type_id = 0; /* NYI */
+        out->file = NULL;
+        out->file_size = 0;
+        out->file_available_size = 0;
+        out->flags = flags & ~(UNSUPPORTED_NONPDB_FLAGS);
+    }
+
+    /* Only names sharing the pattern's literal prefix need to be visited.
+     * A pattern starting with a wildcard still visits every name, but without
+     * re-demangling the symbol table.
+     */
+    prefix_len = strcspn(pattern, "*?");
+    for (i = name_index_lower_bound(index, pattern, prefix_len);
+         keep_searching && i < index->num_entries; i++) {
+        name_entry_t *entry = &index->entries[i];
+        size_t modoffs;
+        if (strncmp(entry->name, pattern, prefix_len) != 0)
+            break;
+        if (!match_wildcard(pattern + prefix_len, entry->name + prefix_len))
+            continue;
+        found = true;
+        if (callback_ex != NULL) {
+            size_t len = strlen(entry->name);
+            res = drsym_obj_symbol_offs(mod->obj_info, entry->idx, &out->start_offs,
+                                        &out->end_offs);
+            if (res != DRSYM_SUCCESS)
+                break;
+            if (len + 1 > name_buf_size) {
+                dr_global_free(out->name, name_buf_size);
+                name_buf_size = len + 1;
+                out->name = (char *) dr_global_alloc(name_buf_size);
+            }
+            memcpy(out->name, entry->name, len + 1);
+            out->name_size = name_buf_size;
+            out->name_available_size = len;
+            /* As with enumeration, we have no line information. */
+            keep_searching = callback_ex(out, DRSYM_ERROR_LINE_NOT_AVAILABLE, data);
+        } else {
+            res = drsym_obj_symbol_offs(mod->obj_info, entry->idx, &modoffs, NULL);
+            if (res != DRSYM_SUCCESS)
+                break;
+            keep_searching = callback(entry->name, modoffs, data);
+        }
+    }
+
+    if (out != NULL) {
+        dr_global_free(out->name, name_buf_size);
+        dr_global_free(out, info_size);
+    }
+    if (res == DRSYM_SUCCESS && !found)
+        return DRSYM_ERROR_SYMBOL_NOT_FOUND;
+    return res;
+}
+
 drsym_error_t
 drsym_unix_lookup_address(void *mod_in, size_t modoffs,
                           drsym_info_t *out INOUT, uint flags)
@@ -107,6 +107,34 @@ drsym_enumerate_symbols_local(const char *modpath, drsym_enumerate_cb callback,
     return r;
 }
 
+static drsym_error_t
+drsym_search_symbols_local(const char *modpath, const char *match, uint flags,
+                           drsym_enumerate_cb callback,
+                           drsym_enumerate_ex_cb callback_ex, size_t info_size,
+                           void *data)
+{
+    void *mod;
+    drsym_error_t r;
+
+    if (modpath == NULL || match == NULL || (callback == NULL && callback_ex == NULL))
+        return DRSYM_ERROR_INVALID_PARAMETER;
+
+    dr_recurlock_lock(symbol_lock);
+    mod = lookup_or_load(modpath);
+    if (mod == NULL) {
+        dr_recurlock_unlock(symbol_lock);
+        return DRSYM_ERROR_LOAD_FAILED;
+    }
+
+    recursive_context = true;
+    r = drsym_unix_search_symbols(mod, match, flags, callback, callback_ex, info_size,
+                                  data);
+    recursive_context = false;
+
+    dr_recurlock_unlock(symbol_lock);
+    return r;
+}
+
 static drsym_error_t
 drsym_lookup_symbol_local(const char *modpath, const char *symbol,
                           size_t *modoffs OUT, uint flags)
@@ -246,6 +274,44 @@ drsym_lookup_address(const char *modpath, size_t modoffs, drsym_info_t *out INOU
     }
 }
 
+DR_EXPORT
+drsym_error_t
+drsym_set_index_cache_dir(const char *dir)
+{
+    drsym_error_t res = DRSYM_SUCCESS;
+    dr_recurlock_lock(symbol_lock);
+#ifdef MACOS
+    res = DRSYM_ERROR_NOT_IMPLEMENTED;
+#else
+    if (!drsym_unix_set_index_cache_dir(dir))
+        res = DRSYM_ERROR_INVALID_PARAMETER;
+#endif
+    dr_recurlock_unlock(symbol_lock);
+    return res;
+}
+
+DR_EXPORT
+drsym_error_t
+drsym_lookup_addresses(const char *modpath, const size_t *modoffs, uint count,
+                       drsym_info_t *infos INOUT, drsym_error_t *results OUT,
+                       uint flags)
+{
+    if (IS_SIDELINE)
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    if (modpath == NULL || modoffs == NULL || infos == NULL || results == NULL)
+        return DRSYM_ERROR_INVALID_PARAMETER;
+    dr_recurlock_lock(symbol_lock);
+    if (lookup_or_load(modpath) == NULL) {
+        dr_recurlock_unlock(symbol_lock);
+        return DRSYM_ERROR_LOAD_FAILED;
+    }
+    /* The per-address calls re-acquire our recursive lock. */
+    drsym_lookup_addresses_sorted(modpath, modoffs, count, infos, results, flags,
+                                  drsym_lookup_address_local);
+    dr_recurlock_unlock(symbol_lock);
+    return DRSYM_SUCCESS;
+}
+
 DR_EXPORT
 drsym_error_t
 drsym_lookup_symbol(const char *modpath, const char *symbol, size_t *modoffs OUT,
@@ -284,6 +350,33 @@ drsym_enumerate_symbols_ex(const char *modpath, drsym_enumerate_ex_cb callback,
     }
 }
 
+DR_EXPORT
+drsym_error_t
+drsym_search_symbols(const char *modpath, const char *match, bool full,
+                     drsym_enumerate_cb callback, void *data)
+{
+    if (IS_SIDELINE) {
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    } else {
+        /* There is no distinction between functions and other symbols here. */
+        return drsym_search_symbols_local(modpath, match, DRSYM_DEFAULT_FLAGS,
+                                          callback, NULL, sizeof(drsym_info_t), data);
+    }
+}
+
+DR_EXPORT
+drsym_error_t
+drsym_search_symbols_ex(const char *modpath, const char *match, uint flags,
+                        drsym_enumerate_ex_cb callback, size_t info_size, void *data)
+{
+    if (IS_SIDELINE) {
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    } else {
+        return drsym_search_symbols_local(modpath, match, flags, NULL, callback,
+                                          info_size, data);
+    }
+}
+
 DR_EXPORT
 drsym_error_t
 drsym_get_type(const char *modpath, size_t modoffs, uint levels_to_expand,
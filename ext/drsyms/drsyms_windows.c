@@ -903,10 +903,10 @@ drsym_search_symbols_local(const char *modpath, const char *match, uint flags,
     if (mod == NULL)
         res = DRSYM_ERROR_LOAD_FAILED;
     else if (mod->use_pecoff_symtable) {
-        /* pecoff doesn't support search, and the enumerate impl in
-         * drsyms_unix.c doesn't take a pattern
-         */
-        res = DRSYM_ERROR_NOT_IMPLEMENTED;
+        recursive_context = true;
+        res = drsym_unix_search_symbols(mod->u.pecoff_data, match, flags, callback,
+                                        callback_ex, info_size, data);
+        recursive_context = false;
     } else {
         enum_info_t info;
         if (func == NULL) {
@@ -1495,6 +1495,36 @@ drsym_lookup_address(const char *modpath, size_t modoffs, drsym_info_t *out INOU
     }
 }
 
+DR_EXPORT
+drsym_error_t
+drsym_set_index_cache_dir(const char *dir)
+{
+    /* NYI: neither dbghelp nor PECOFF use the persistent index */
+    return DRSYM_ERROR_NOT_IMPLEMENTED;
+}
+
+DR_EXPORT
+drsym_error_t
+drsym_lookup_addresses(const char *modpath, const size_t *modoffs, uint count,
+                       drsym_info_t *infos INOUT, drsym_error_t *results OUT,
+                       uint flags)
+{
+    if (IS_SIDELINE)
+        return DRSYM_ERROR_NOT_IMPLEMENTED;
+    if (modpath == NULL || modoffs == NULL || infos == NULL || results == NULL)
+        return DRSYM_ERROR_INVALID_PARAMETER;
+    dr_recurlock_lock(symbol_lock);
+    if (lookup_or_load(modpath, true/*use dbghelp*/) == NULL) {
+        dr_recurlock_unlock(symbol_lock);
+        return DRSYM_ERROR_LOAD_FAILED;
+    }
+    /* The per-address calls re-acquire our recursive lock. */
+    drsym_lookup_addresses_sorted(modpath, modoffs, count, infos, results, flags,
+                                  drsym_lookup_address_local);
+    dr_recurlock_unlock(symbol_lock);
+    return DRSYM_SUCCESS;
+}
+
 DR_EXPORT
 drsym_error_t
 drsym_lookup_symbol(const char *modpath, const char *symbol, size_t *modoffs OUT,
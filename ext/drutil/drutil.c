@@ -26,6 +26,7 @@
 #include "dr_api.h"
 #include "drmgr.h"
 #include "../ext_utils.h"
+#include <limits.h>
 
 /* currently using asserts on internal logic sanity checks (never on
  * input from user)
@@ -56,6 +57,10 @@
 /* for inserting an app instruction, which must have a translation ("xl8") field */
 #define PREXL8 instrlist_preinsert
 
+#ifdef AARCHXX
+# define MAX_ADD_IMM_DISP (1 << 12)
+#endif
+
 /***************************************************************************
  * INIT
  */
@@ -145,6 +150,130 @@ drutil_insert_get_mem_addr(void *drcontext, instrlist_t *bb, instr_t *where,
 #endif
 }
 
+/* Splits memref into a register part, returned in the OUT params, and a signed
+ * displacement.  Returns false for references whose address depends on more than
+ * their registers and displacement, or which we do not bother to handle.
+ */
+static bool
+mem_addr_parts(opnd_t memref, OUT reg_id_t *base, OUT reg_id_t *index,
+               OUT int *scale, OUT reg_id_t *seg, OUT ptr_int_t *disp)
+{
+#ifdef X64
+    if (!opnd_is_base_disp(memref) &&
+        (opnd_is_abs_addr(memref) || opnd_is_rel_addr(memref))) {
+        /* DR has already resolved a pc-relative reference to its target. */
+        *base = DR_REG_NULL;
+        *index = DR_REG_NULL;
+        *scale = 0;
+        *seg = opnd_get_segment(memref);
+        *disp = (ptr_int_t)opnd_get_addr(memref);
+        return true;
+    }
+#endif
+    if (!opnd_is_base_disp(memref))
+        return false;
+    *base = opnd_get_base(memref);
+    *index = opnd_get_index(memref);
+    *seg = opnd_get_segment(memref);
+    *disp = opnd_get_disp(memref);
+#ifdef X86
+    *scale = opnd_get_scale(memref);
+    /* Sub-pointer-sized address registers wrap around, and xlat's index is
+     * special-cased by drutil_insert_get_mem_addr().
+     */
+    if ((*base != DR_REG_NULL && !reg_is_pointer_sized(*base)) ||
+        (*index != DR_REG_NULL && !reg_is_pointer_sized(*index)))
+        return false;
+#else
+    /* We leave shifted and extended indices and pc bases to
+     * drutil_insert_get_mem_addr().
+     */
+    *scale = 0;
+    if (*index != DR_REG_NULL || *base == DR_REG_PC)
+        return false;
+    if (TEST(DR_OPND_NEGATED, opnd_get_flags(memref)))
+        *disp = -*disp;
+#endif
+    return true;
+}
+
+DR_EXPORT
+bool
+drutil_mem_addr_offset(instr_t *base_inst, opnd_t base_memref,
+                       instr_t *inst, opnd_t memref, OUT ptr_int_t *offset)
+{
+    reg_id_t base[2], index[2], seg[2];
+    int scale[2];
+    ptr_int_t disp[2];
+    instr_t *in;
+    if (!mem_addr_parts(base_memref, &base[0], &index[0], &scale[0], &seg[0],
+                        &disp[0]) ||
+        !mem_addr_parts(memref, &base[1], &index[1], &scale[1], &seg[1], &disp[1]))
+        return false;
+    if (base[0] != base[1] || index[0] != index[1] || scale[0] != scale[1] ||
+        seg[0] != seg[1])
+        return false;
+    /* The registers must hold the same values at both references.  A write by
+     * base_inst itself happens after its own reference is evaluated.
+     */
+    for (in = base_inst; in != inst; in = instr_get_next(in)) {
+        if (in == NULL || (in != base_inst && instr_is_cti(in)) ||
+            instr_is_syscall(in) || instr_is_interrupt(in))
+            return false;
+        if ((base[0] != DR_REG_NULL &&
+             instr_writes_to_reg(in, base[0], DR_QUERY_INCLUDE_ALL)) ||
+            (index[0] != DR_REG_NULL &&
+             instr_writes_to_reg(in, index[0], DR_QUERY_INCLUDE_ALL)))
+            return false;
+    }
+    if (offset != NULL)
+        *offset = disp[1] - disp[0];
+    return true;
+}
+
+DR_EXPORT
+bool
+drutil_insert_get_mem_addr_from_base(void *drcontext, instrlist_t *bb, instr_t *where,
+                                     reg_id_t base_addr, ptr_int_t offset,
+                                     reg_id_t dst)
+{
+    if (offset == 0) {
+        if (dst != base_addr) {
+            PRE(bb, where, XINST_CREATE_move(drcontext, opnd_create_reg(dst),
+                                             opnd_create_reg(base_addr)));
+        }
+        return true;
+    }
+#ifdef X86
+    if (offset < INT_MIN || offset > INT_MAX)
+        return false;
+    PRE(bb, where,
+        INSTR_CREATE_lea(drcontext, opnd_create_reg(dst),
+                         opnd_create_base_disp(base_addr, DR_REG_NULL, 0, (int)offset,
+                                               OPSZ_lea)));
+#else
+    {
+        instr_t *instr;
+        ptr_int_t magnitude = offset < 0 ? -offset : offset;
+        if (magnitude >= MAX_ADD_IMM_DISP)
+            return false;
+        instr = offset < 0 ?
+            INSTR_CREATE_sub(drcontext, opnd_create_reg(dst),
+                             opnd_create_reg(base_addr),
+                             OPND_CREATE_INT((int)magnitude)) :
+            XINST_CREATE_add_2src(drcontext, opnd_create_reg(dst),
+                                  opnd_create_reg(base_addr),
+                                  OPND_CREATE_INT((int)magnitude));
+        if (IF_ARM_ELSE(!instr_is_encoding_possible(instr), false)) {
+            instr_destroy(drcontext, instr);
+            return false;
+        }
+        PRE(bb, where, instr);
+    }
+#endif
+    return true;
+}
+
 #ifdef X86
 static bool
 drutil_insert_get_mem_addr_x86(void *drcontext, instrlist_t *bb, instr_t *where,
@@ -373,7 +502,6 @@ drutil_insert_get_mem_addr_arm(void *drcontext, instrlist_t *bb, instr_t *where,
                                       opnd_create_reg(dst),
                                       opnd_create_reg(base),
                                       OPND_CREATE_INT(disp));
-# define MAX_ADD_IMM_DISP (1 << 12)
             if (IF_ARM_ELSE(instr_is_encoding_possible(instr),
                             disp < MAX_ADD_IMM_DISP)) {
                 PRE(bb, where, instr);
@@ -655,3 +783,50 @@ drutil_expand_rep_string(void *drcontext, instrlist_t *bb)
 {
     return drutil_expand_rep_string_ex(drcontext, bb, NULL, NULL);
 }
+
+DR_EXPORT
+bool
+drutil_rep_string_has_mem_range(instr_t *strop)
+{
+#ifdef X86
+    uint opc = instr_get_opcode(strop);
+    return (opc == OP_rep_movs || opc == OP_rep_stos || opc == OP_rep_lods);
+#else
+    return false;
+#endif
+}
+
+DR_EXPORT
+bool
+drutil_rep_string_mem_range(instr_t *strop, opnd_t memref, dr_mcontext_t *mc,
+                            OUT app_pc *start, OUT size_t *size, OUT bool *backward)
+{
+#ifdef X86
+    opnd_t xcx;
+    reg_t count;
+    uint elem_size;
+    app_pc first;
+    if (!drutil_rep_string_has_mem_range(strop) || !opnd_is_memory_reference(memref) ||
+        !TESTALL(DR_MC_INTEGER | DR_MC_CONTROL, mc->flags) ||
+        start == NULL || size == NULL || backward == NULL)
+        return false;
+    /* As in create_nonloop_stringop(), xcx is the last src, with the width
+     * given by the address size.
+     */
+    xcx = instr_get_src(strop, instr_num_srcs(strop) - 1);
+    ASSERT(opnd_is_reg(xcx) && opnd_uses_reg(xcx, DR_REG_XCX),
+           "rep opnd order assumption violated");
+    count = reg_get_value(opnd_get_reg(xcx), mc);
+    elem_size = drutil_opnd_mem_size_in_bytes(memref, strop);
+    first = opnd_compute_address(memref, mc);
+    *size = (size_t)count * elem_size;
+    *backward = TEST(EFLAGS_DF, mc->xflags);
+    if (*backward && count > 0)
+        *start = first - (count - 1) * elem_size;
+    else
+        *start = first;
+    return true;
+#else
+    return false;
+#endif
+}
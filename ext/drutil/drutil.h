@@ -104,6 +104,44 @@ drutil_insert_get_mem_addr_ex(void *drcontext, instrlist_t *bb, instr_t *where,
                               opnd_t memref, reg_id_t dst, reg_id_t scratch,
                               OUT bool *scratch_used);
 
+DR_EXPORT
+/**
+ * Determines whether the address referred to by \p memref in the instruction
+ * \p inst is always at a constant offset from the address referred to by
+ * \p base_memref in \p base_inst.  This holds when both are the same kind of
+ * reference, use the same registers and segment, and differ only in their
+ * displacements, and none of the instructions from \p base_inst up to \p inst
+ * writes those registers.  \p base_inst must be \p inst or precede it
+ * in the same instruction list.  If so, returns true and the difference in the
+ * OUT parameter \p offset.
+ *
+ * This lets a tool compute the address of the first of several references
+ * that share a base register, such as a run of struct field accesses, with
+ * drutil_insert_get_mem_addr().  The tool can then record each of the others
+ * as that address plus \p offset, or materialize it with
+ * drutil_insert_get_mem_addr_from_base(), rather than computing every address
+ * from scratch.
+ */
+bool
+drutil_mem_addr_offset(instr_t *base_inst, opnd_t base_memref,
+                       instr_t *inst, opnd_t memref, OUT ptr_int_t *offset);
+
+DR_EXPORT
+/**
+ * Inserts instructions prior to \p where in \p bb that store into \p dst the
+ * address held in \p base_addr plus \p offset, which is typically obtained
+ * from drutil_mem_addr_offset().  At most a single instruction is inserted, and
+ * \p dst may be the same as \p base_addr.  Fails if \p offset cannot be
+ * encoded as an immediate.  On ARM and AArch64 this is limited to magnitudes
+ * below 4096.
+ *
+ * \return whether successful.
+ */
+bool
+drutil_insert_get_mem_addr_from_base(void *drcontext, instrlist_t *bb, instr_t *where,
+                                     reg_id_t base_addr, ptr_int_t offset,
+                                     reg_id_t dst);
+
 DR_EXPORT
 /**
  * Returns the size of the memory reference \p memref in bytes.
@@ -166,6 +204,43 @@ bool
 drutil_expand_rep_string_ex(void *drcontext, instrlist_t *bb, OUT bool *expanded,
                             OUT instr_t **stringop);
 
+DR_EXPORT
+/**
+ * Returns whether drutil_rep_string_mem_range() can describe each memory
+ * operand of the single-instruction string loop \p strop as one range.  This
+ * holds for the \p rep forms of movs, stos, and lods on x86, which always run
+ * for the full count in xcx, but not for cmps or scas, which can stop early,
+ * nor for ins or outs.  A client can then leave such loops unexpanded, rather
+ * than calling drutil_expand_rep_string(), and obtain each memory operand's
+ * extent once per execution of the loop instead of once per iteration.
+ */
+bool
+drutil_rep_string_has_mem_range(instr_t *strop);
+
+DR_EXPORT
+/**
+ * Computes the memory accessed by all iterations of the single-instruction
+ * string loop \p strop through its memory operand \p memref, given the
+ * machine state \p mc prior to the loop, which must include at least
+ * #DR_MC_INTEGER and #DR_MC_CONTROL.  This is normally called from a clean
+ * call inserted prior to \p strop.  \p strop must satisfy
+ * drutil_rep_string_has_mem_range().
+ *
+ * @param[in]  strop     The rep string instruction.
+ * @param[in]  memref    One of the memory operands of \p strop.
+ * @param[in]  mc        The machine state prior to \p strop.
+ * @param[out] start     The lowest address accessed.
+ * @param[out] size      The total number of bytes accessed, which is 0 for a
+ *                       loop with no iterations.
+ * @param[out] backward  Whether the loop walks from the highest address down
+ *                       to \p start, as it does when the direction flag is set.
+ *
+ * \return whether successful.
+ */
+bool
+drutil_rep_string_mem_range(instr_t *strop, opnd_t memref, dr_mcontext_t *mc,
+                            OUT app_pc *start, OUT size_t *size, OUT bool *backward);
+
 
 /*@}*/ /* end doxygen group */
 
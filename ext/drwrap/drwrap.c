@@ -170,6 +170,34 @@ wrap_entry_free(void *v)
     }
 }
 
+/* Lightweight pre-hooks from drwrap_wrap_pre_inline(), also protected by
+ * wrap_lock.
+ */
+#define INLINE_TABLE_HASH_BITS 6
+#define INLINE_PRE_MAX_ARGS 4
+/* i#1689: we store the decorated (LSB=1) pc (passed from client) in the table */
+static hashtable_t inline_table;
+
+typedef struct _inline_entry_t {
+    void *callee;
+    uint num_args;
+    drwrap_callconv_t callconv;
+    struct _inline_entry_t *next;
+} inline_entry_t;
+
+static void
+inline_entry_free(void *v)
+{
+    inline_entry_t *e = (inline_entry_t *) v;
+    inline_entry_t *tmp;
+    ASSERT(e != NULL, "invalid hashtable deletion");
+    while (e != NULL) {
+        tmp = e;
+        e = e->next;
+        dr_global_free(tmp, sizeof(*tmp));
+    }
+}
+
 /* TLS.  OK to be callback-shared: just more nesting. */
 static int tls_idx;
 
@@ -287,13 +315,29 @@ typedef struct _post_call_notify_t {
 /* protected by post_call_rwlock */
 post_call_notify_t *post_call_notify_list;
 
-/* FIFO cache read w/o a lock (which we assume is fine b/c it's word-aligned
- * and thus does not cross a cache line) and written under post_call_rwlock
+/* Direct-mapped cache of post-call sites known to be in post_call_table.
+ * It is read w/o a lock (which we assume is fine b/c each slot is
+ * word-aligned and thus does not cross a cache line) and written under
+ * post_call_rwlock, so that lookups of known retaddrs, the common case,
+ * never touch the lock or the table.
  */
-static uint postcall_cache_idx;
-#define POSTCALL_CACHE_SIZE 8
+#define POSTCALL_CACHE_BITS 9
+#define POSTCALL_CACHE_SIZE (1 << POSTCALL_CACHE_BITS)
 static app_pc postcall_cache[POSTCALL_CACHE_SIZE];
 
+static inline uint
+postcall_cache_idx(app_pc pc)
+{
+    ptr_uint_t val = (ptr_uint_t)pc;
+    return (uint)((val ^ (val >> POSTCALL_CACHE_BITS)) & (POSTCALL_CACHE_SIZE - 1));
+}
+
+static inline bool
+postcall_cache_lookup(app_pc pc)
+{
+    return pc != NULL && postcall_cache[postcall_cache_idx(pc)] == pc;
+}
+
 static void
 post_call_entry_free(void *v)
 {
@@ -350,6 +394,8 @@ static bool
 post_call_lookup(app_pc pc)
 {
     bool res = false;
+    if (postcall_cache_lookup(pc))
+        return true;
     dr_rwlock_read_lock(post_call_rwlock);
     res = (hashtable_lookup(&post_call_table, (void*)pc) != NULL);
     dr_rwlock_read_unlock(post_call_rwlock);
@@ -368,7 +414,6 @@ post_call_lookup_for_instru(app_pc pc)
     if (e != NULL) {
         res = post_call_consistent(pc, e);
         if (!res) {
-            int i;
             /* need the write lock */
             dr_rwlock_read_unlock(post_call_rwlock);
             e = NULL; /* no longer safe */
@@ -376,10 +421,8 @@ post_call_lookup_for_instru(app_pc pc)
             /* might not be found now if racily removed: but that's fine */
             hashtable_remove(&post_call_table, (void *)pc);
             /* invalidate cache */
-            for (i = 0; i < POSTCALL_CACHE_SIZE; i++) {
-                if (pc == postcall_cache[i])
-                    postcall_cache[i] = NULL;
-            }
+            if (postcall_cache_lookup(pc))
+                postcall_cache[postcall_cache_idx(pc)] = NULL;
             dr_rwlock_write_unlock(post_call_rwlock);
             return res;
         } else {
@@ -686,14 +729,89 @@ drwrap_arg_addr(drwrap_context_t *wrapcxt, int arg)
     }
 }
 
+/* Returns the operand holding argument arg at the entry of a function with
+ * calling convention callconv, or a null operand if unsupported.
+ * Mirrors drwrap_arg_addr().
+ */
+static opnd_t
+drwrap_entry_arg_opnd(drwrap_callconv_t callconv, uint arg)
+{
+    uint reg_arg_count = 0, stack_arg_offset = 0;
+    switch (callconv) {
+#if defined(ARM)
+    case DRWRAP_CALLCONV_ARM:
+        if (arg < 4)
+            return opnd_create_reg(DR_REG_R0 + arg);
+        reg_arg_count = 4;
+        break;
+#elif defined(AARCH64)
+    case DRWRAP_CALLCONV_AARCH64:
+        if (arg < 8)
+            return opnd_create_reg(DR_REG_X0 + arg);
+        reg_arg_count = 8;
+        break;
+#else /* Intel x86 or x64 */
+# ifdef X64 /* registers are platform-exclusive */
+    case DRWRAP_CALLCONV_AMD64: {
+        static const reg_id_t regs[] = {DR_REG_RDI, DR_REG_RSI, DR_REG_RDX,
+                                        DR_REG_RCX, DR_REG_R8, DR_REG_R9};
+        if (arg < BUFFER_SIZE_ELEMENTS(regs))
+            return opnd_create_reg(regs[arg]);
+        reg_arg_count = BUFFER_SIZE_ELEMENTS(regs);
+        stack_arg_offset = 1/*retaddr*/;
+        break;
+    }
+    case DRWRAP_CALLCONV_MICROSOFT_X64: {
+        static const reg_id_t regs[] = {DR_REG_RCX, DR_REG_RDX, DR_REG_R8, DR_REG_R9};
+        if (arg < BUFFER_SIZE_ELEMENTS(regs))
+            return opnd_create_reg(regs[arg]);
+        reg_arg_count = BUFFER_SIZE_ELEMENTS(regs);
+        stack_arg_offset = 1/*retaddr*/ + 4/*reserved*/;
+        break;
+    }
+# endif
+    case DRWRAP_CALLCONV_CDECL:
+        stack_arg_offset = 1/*retaddr*/;
+        break;
+    case DRWRAP_CALLCONV_FASTCALL:
+        if (arg == 0)
+            return opnd_create_reg(DR_REG_XCX);
+        if (arg == 1)
+            return opnd_create_reg(DR_REG_XDX);
+        reg_arg_count = 2;
+        stack_arg_offset = 1/*retaddr*/;
+        break;
+    case DRWRAP_CALLCONV_THISCALL:
+        if (arg == 0)
+            return opnd_create_reg(DR_REG_XCX);
+        reg_arg_count = 1;
+        stack_arg_offset = 1/*retaddr*/;
+        break;
+#endif
+    default:
+        return opnd_create_null();
+    }
+    return OPND_CREATE_MEMPTR(DR_REG_XSP, (arg - reg_arg_count + stack_arg_offset) *
+                              sizeof(reg_t));
+}
+
 DR_EXPORT
 void *
 drwrap_get_arg(void *wrapcxt_opaque, int arg)
 {
     drwrap_context_t *wrapcxt = (drwrap_context_t *) wrapcxt_opaque;
-    reg_t *addr = drwrap_arg_addr(wrapcxt, arg);
+    reg_t *addr;
     if (wrapcxt->where_am_i != DRWRAP_WHERE_PRE_FUNC)
         return NULL; /* can only get args in pre */
+    if (wrapcxt->mc != NULL && !TEST(DR_MC_INTEGER, wrapcxt->mc->flags)) {
+        /* Avoid a full dr_get_mcontext() for a register argument. */
+        opnd_t opnd = drwrap_entry_arg_opnd(wrapcxt->callconv, arg);
+        reg_t val;
+        if (opnd_is_reg(opnd) &&
+            dr_get_mcontext_reg(wrapcxt->drcontext, opnd_get_reg(opnd), &val))
+            return (void *) val;
+    }
+    addr = drwrap_arg_addr(wrapcxt, arg);
     if (addr == NULL)
         return NULL;
     else if (TEST(DRWRAP_SAFE_READ_ARGS, global_flags)) {
@@ -738,6 +856,12 @@ drwrap_get_retval(void *wrapcxt_opaque)
         return false; /* can only get retval in post */
     if (wrapcxt == NULL || wrapcxt->mc == NULL)
         return NULL;
+    if (!TEST(DR_MC_INTEGER, wrapcxt->mc->flags)) {
+        reg_t val;
+        if (dr_get_mcontext_reg(wrapcxt->drcontext, IF_X86_ELSE(DR_REG_XAX, DR_REG_R0),
+                                &val))
+            return (void *) val;
+    }
     /* ensure we have the info we need */
     drwrap_get_mcontext_internal(wrapcxt_opaque, DR_MC_INTEGER);
     return (void *) wrapcxt->mc->IF_X86_ELSE(xax, r0);
@@ -925,6 +1049,9 @@ drwrap_init(void)
     hashtable_init_ex(&wrap_table, WRAP_TABLE_HASH_BITS, HASH_INTPTR,
                       false/*!str_dup*/, false/*!synch*/, wrap_entry_free,
                       NULL, NULL);
+    hashtable_init_ex(&inline_table, INLINE_TABLE_HASH_BITS, HASH_INTPTR,
+                      false/*!str_dup*/, false/*!synch*/, inline_entry_free,
+                      NULL, NULL);
     hashtable_init_ex(&call_site_table, CALL_SITE_TABLE_HASH_BITS, HASH_INTPTR,
                       false/*!strdup*/, false/*!synch*/, NULL, NULL, NULL);
     hashtable_init_ex(&post_call_table, POST_CALL_TABLE_HASH_BITS, HASH_INTPTR,
@@ -977,6 +1104,7 @@ drwrap_exit(void)
     hashtable_delete(&replace_table);
     hashtable_delete(&replace_native_table);
     hashtable_delete(&wrap_table);
+    hashtable_delete(&inline_table);
     hashtable_delete(&call_site_table);
     hashtable_delete(&post_call_table);
     dr_rwlock_destroy(post_call_rwlock);
@@ -1211,6 +1339,20 @@ drwrap_replace_native(app_pc original, app_pc replacement, bool at_entry,
         rn->user_data = user_data;
     }
     hashtable_lock(&replace_native_table);
+    if (rn != NULL && override) {
+        /* Re-issuing an identical request, e.g. on each load of a module, changes
+         * nothing in code already built with it, so we avoid a flush.
+         */
+        replace_native_t *prior = hashtable_lookup(&replace_native_table, original);
+        if (prior != NULL && prior->replacement == rn->replacement &&
+            prior->at_entry == rn->at_entry &&
+            prior->stack_adjust == rn->stack_adjust &&
+            prior->user_data == rn->user_data) {
+            hashtable_unlock(&replace_native_table);
+            replace_native_free(rn);
+            return true;
+        }
+    }
     res = drwrap_replace_common(&replace_native_table, original, rn, override,
                                 /* i#1438: if we're not at the entry, we'd better
                                  * flush to ensure we replace.  If this is done at
@@ -1458,8 +1600,14 @@ drwrap_event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
 {
     instr_t *inst;
     app_pc pc, replace;
-    if (replace_table.entries == 0 && replace_native_table.entries == 0)
+    bool check_native = replace_native_table.entries > 0;
+    if (replace_table.entries == 0 && !check_native)
         return DR_EMIT_DEFAULT;
+    /* We hold the lock across the whole block rather than per instruction, as this
+     * is called for every new block once any native replacement exists.
+     */
+    if (check_native)
+        hashtable_lock(&replace_native_table);
     /* XXX: if we had dr_bbs_cross_ctis() query (i#427) we could just check 1st instr */
     for (inst = instrlist_first(bb);
          inst != NULL;
@@ -1479,10 +1627,8 @@ drwrap_event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
                 break;
             }
         }
-        if (replace_native_table.entries > 0) {
-            replace_native_t *rn;
-            hashtable_lock(&replace_native_table);
-            rn = hashtable_lookup(&replace_native_table, pc);
+        if (check_native) {
+            replace_native_t *rn = hashtable_lookup(&replace_native_table, pc);
             if (rn != NULL) {
                 app_pc topush = NULL;
                 if (!rn->at_entry) {
@@ -1495,12 +1641,12 @@ drwrap_event_bb_app2app(void *drcontext, void *tag, instrlist_t *bb,
                     }
                 }
                 drwrap_replace_native_bb(drcontext, bb, inst, pc, rn, topush);
-                hashtable_unlock(&replace_native_table);
                 break;
             }
-            hashtable_unlock(&replace_native_table);
         }
     }
+    if (check_native)
+        hashtable_unlock(&replace_native_table);
     return DR_EMIT_DEFAULT;
 }
 
@@ -1732,21 +1878,15 @@ drwrap_ensure_postcall(void *drcontext, wrap_entry_t *wrap,
 {
     app_pc retaddr = dr_app_pc_as_load_target(DR_ISA_ARM_THUMB, wrapcxt->retaddr);
     app_pc plain_pc = dr_app_pc_as_load_target(DR_ISA_ARM_THUMB, decorated_pc);
-    int i;
     /* avoid lock and hashtable lookup by caching prior retaddrs */
-    for (i = 0; i < POSTCALL_CACHE_SIZE; i++) {
-        if (retaddr == postcall_cache[i])
-            return;
-    }
+    if (postcall_cache_lookup(retaddr))
+        return;
 
     /* to write to the cache we need a write lock */
     dr_rwlock_write_lock(post_call_rwlock);
 
-    /* add to FIFO cache */
-    postcall_cache_idx++;
-    if (postcall_cache_idx >= POSTCALL_CACHE_SIZE)
-        postcall_cache_idx = 0;
-    postcall_cache[postcall_cache_idx] = retaddr;
+    /* add to cache */
+    postcall_cache[postcall_cache_idx(retaddr)] = retaddr;
 
     if (hashtable_lookup(&post_call_table, (void*)retaddr) == NULL) {
         bool enabled = wrap->enabled;
@@ -2190,6 +2330,43 @@ drwrap_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *ins
                                 opnd_create_reg(DR_REG_XSP)
                                 _IF_NOT_X86(opnd_create_reg(DR_REG_LR)));
     }
+    if (inline_table.entries > 0) {
+        inline_entry_t *e = hashtable_lookup(&inline_table, (void *)pc);
+        /* Inserted after drwrap_in_callee so that a flush-and-redirect from
+         * there does not execute these twice.
+         */
+        for (; e != NULL; e = e->next) {
+            opnd_t args[INLINE_PRE_MAX_ARGS];
+            uint i;
+            dr_cleancall_save_t flags = TEST(DRWRAP_FAST_CLEANCALLS, global_flags) ?
+                (DR_CLEANCALL_NOSAVE_FLAGS|DR_CLEANCALL_NOSAVE_XMM_NONPARAM) : 0;
+            for (i = 0; i < e->num_args; i++)
+                args[i] = drwrap_entry_arg_opnd(e->callconv, i);
+            /* dr_insert_clean_call_ex_varg is not exported */
+            switch (e->num_args) {
+            case 0:
+                dr_insert_clean_call_ex(drcontext, bb, inst, e->callee, flags, 0);
+                break;
+            case 1:
+                dr_insert_clean_call_ex(drcontext, bb, inst, e->callee, flags, 1,
+                                        args[0]);
+                break;
+            case 2:
+                dr_insert_clean_call_ex(drcontext, bb, inst, e->callee, flags, 2,
+                                        args[0], args[1]);
+                break;
+            case 3:
+                dr_insert_clean_call_ex(drcontext, bb, inst, e->callee, flags, 3,
+                                        args[0], args[1], args[2]);
+                break;
+            default:
+                ASSERT(e->num_args == INLINE_PRE_MAX_ARGS, "too many inline args");
+                dr_insert_clean_call_ex(drcontext, bb, inst, e->callee, flags, 4,
+                                        args[0], args[1], args[2], args[3]);
+                break;
+            }
+        }
+    }
     dr_recurlock_unlock(wrap_lock);
 
     if (post_call_lookup_for_instru(instr_get_app_pc(inst)/*normalized*/)) {
@@ -2214,6 +2391,7 @@ drwrap_event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *ins
 static void
 drwrap_event_module_unload(void *drcontext, const module_data_t *info)
 {
+    int i;
     /* XXX: should also remove from post_call_table and call_site_table
      * on other code modifications: for now we assume no such
      * changes to app code that's being targeted for wrapping.
@@ -2222,6 +2400,10 @@ drwrap_event_module_unload(void *drcontext, const module_data_t *info)
 
     dr_rwlock_write_lock(post_call_rwlock);
     hashtable_remove_range(&post_call_table, (void *)info->start, (void *)info->end);
+    for (i = 0; i < POSTCALL_CACHE_SIZE; i++) {
+        if (postcall_cache[i] >= info->start && postcall_cache[i] < info->end)
+            postcall_cache[i] = NULL;
+    }
     dr_rwlock_write_unlock(post_call_rwlock);
 }
 
@@ -2231,15 +2413,20 @@ drwrap_fragment_delete(void *dc/*may be NULL*/, void *tag)
     /* switched to checking consistency at lookup time (DrMemi#673) */
 }
 
-DR_EXPORT
-bool
-drwrap_wrap_ex(app_pc func,
-               void (*pre_func_cb)(void *wrapcxt, INOUT void **user_data),
-               void (*post_func_cb)(void *wrapcxt, void *user_data),
-               void *user_data, uint flags)
+/* Adds the wrap request to wrap_table.  The caller must hold wrap_lock.
+ * Rather than flushing, sets *need_flush if func may already be in the
+ * code cache and thus must be flushed by the caller.
+ */
+static bool
+drwrap_wrap_add(app_pc func,
+                void (*pre_func_cb)(void *wrapcxt, INOUT void **user_data),
+                void (*post_func_cb)(void *wrapcxt, void *user_data),
+                void *user_data, uint flags, OUT bool *need_flush)
 {
     wrap_entry_t *wrap_cur, *wrap_new;
 
+    *need_flush = false;
+
     /* allow one side to be NULL (i#562) */
     if (func == NULL || (pre_func_cb == NULL && post_func_cb == NULL))
         return false;
@@ -2259,7 +2446,7 @@ drwrap_wrap_ex(app_pc func,
     if (wrap_new->callconv == 0)
         wrap_new->callconv = DRWRAP_CALLCONV_DEFAULT;
 
-    dr_recurlock_lock(wrap_lock);
+    ASSERT(dr_recurlock_self_owns(wrap_lock), "caller must hold wrap_lock");
     wrap_cur = hashtable_lookup(&wrap_table, (void *)func);
     if (wrap_cur != NULL) {
         /* we add in reverse order (documented in interface) */
@@ -2275,13 +2462,11 @@ drwrap_wrap_ex(app_pc func,
                     e->user_data = user_data;
                     e->flags = flags;
                     dr_global_free(wrap_new, sizeof(*wrap_new));
-                    dr_recurlock_unlock(wrap_lock);
                     return true;
                 } /* else continue */
             } else if (TEST(DRWRAP_NO_FRILLS, global_flags) && e->enabled) {
                 /* more than one wrap of same address is not allowed */
                 dr_global_free(wrap_new, sizeof(*wrap_new));
-                dr_recurlock_unlock(wrap_lock);
                 return false;
             }
         }
@@ -2296,14 +2481,65 @@ drwrap_wrap_ex(app_pc func,
         wrap_new->next = NULL;
         hashtable_add(&wrap_table, (void *)func, (void *)wrap_new);
         /* XXX: we're assuming void* tag == pc */
-        if (dr_fragment_exists_at(dr_get_current_drcontext(), func)) {
-            /* we do not guarantee faster than a lazy flush */
-            if (!dr_unlink_flush_region(func, 1))
-                ASSERT(false, "wrap update flush failed");
+        if (dr_fragment_exists_at(dr_get_current_drcontext(), func))
+            *need_flush = true;
+    }
+    return true;
+}
+
+DR_EXPORT
+bool
+drwrap_wrap_ex(app_pc func,
+               void (*pre_func_cb)(void *wrapcxt, INOUT void **user_data),
+               void (*post_func_cb)(void *wrapcxt, void *user_data),
+               void *user_data, uint flags)
+{
+    bool res, need_flush;
+    dr_recurlock_lock(wrap_lock);
+    res = drwrap_wrap_add(func, pre_func_cb, post_func_cb, user_data, flags,
+                          &need_flush);
+    if (need_flush) {
+        /* we do not guarantee faster than a lazy flush */
+        if (!dr_unlink_flush_region(func, 1))
+            ASSERT(false, "wrap update flush failed");
+    }
+    dr_recurlock_unlock(wrap_lock);
+    return res;
+}
+
+DR_EXPORT
+uint
+drwrap_wrap_batch(const drwrap_wrap_info_t *wraps, uint num_wraps,
+                  OUT bool *results)
+{
+    uint i, num_ok = 0;
+    app_pc flush_start = NULL, flush_end = NULL;
+    if (wraps == NULL)
+        return 0;
+    dr_recurlock_lock(wrap_lock);
+    for (i = 0; i < num_wraps; i++) {
+        bool need_flush;
+        bool ok = drwrap_wrap_add(wraps[i].func, wraps[i].pre_func_cb,
+                                  wraps[i].post_func_cb, wraps[i].user_data,
+                                  wraps[i].flags, &need_flush);
+        if (ok)
+            num_ok++;
+        if (results != NULL)
+            results[i] = ok;
+        if (need_flush) {
+            if (flush_start == NULL || wraps[i].func < flush_start)
+                flush_start = wraps[i].func;
+            if (flush_end == NULL || wraps[i].func + 1 > flush_end)
+                flush_end = wraps[i].func + 1;
         }
     }
+    if (flush_start != NULL) {
+        /* a single flush for the whole batch */
+        if (!dr_unlink_flush_region(flush_start, flush_end - flush_start))
+            ASSERT(false, "wrap update flush failed");
+    }
     dr_recurlock_unlock(wrap_lock);
-    return true;
+    return num_ok;
 }
 
 DR_EXPORT
@@ -2315,6 +2551,85 @@ drwrap_wrap(app_pc func,
     return drwrap_wrap_ex(func, pre_func_cb, post_func_cb, NULL, DRWRAP_CALLCONV_DEFAULT);
 }
 
+DR_EXPORT
+bool
+drwrap_wrap_pre_inline(app_pc func, void *pre_func_cb, uint num_args, uint flags)
+{
+    inline_entry_t *e, *cur;
+    drwrap_callconv_t callconv = EXTRACT_CALLCONV(flags);
+    uint i;
+    if (func == NULL || pre_func_cb == NULL || num_args > INLINE_PRE_MAX_ARGS)
+        return false;
+    if (callconv == 0)
+        callconv = DRWRAP_CALLCONV_DEFAULT;
+    for (i = 0; i < num_args; i++) {
+        if (opnd_is_null(drwrap_entry_arg_opnd(callconv, i)))
+            return false; /* unsupported calling convention */
+    }
+
+    dr_recurlock_lock(wrap_lock);
+    cur = hashtable_lookup(&inline_table, (void *)func);
+    for (e = cur; e != NULL; e = e->next) {
+        if (e->callee == pre_func_cb) {
+            /* matches existing request: update it */
+            e->num_args = num_args;
+            e->callconv = callconv;
+            dr_recurlock_unlock(wrap_lock);
+            return true;
+        }
+    }
+    e = dr_global_alloc(sizeof(*e));
+    e->callee = pre_func_cb;
+    e->num_args = num_args;
+    e->callconv = callconv;
+    e->next = cur;
+    hashtable_add_replace(&inline_table, (void *)func, (void *)e);
+    /* XXX: we're assuming void* tag == pc */
+    if (dr_fragment_exists_at(dr_get_current_drcontext(), func)) {
+        /* we do not guarantee faster than a lazy flush */
+        if (!dr_unlink_flush_region(func, 1))
+            ASSERT(false, "wrap update flush failed");
+    }
+    dr_recurlock_unlock(wrap_lock);
+    return true;
+}
+
+DR_EXPORT
+bool
+drwrap_unwrap_pre_inline(app_pc func, void *pre_func_cb)
+{
+    inline_entry_t *e, *prev = NULL;
+    bool res = false;
+    if (func == NULL || pre_func_cb == NULL)
+        return false;
+    dr_recurlock_lock(wrap_lock);
+    for (e = hashtable_lookup(&inline_table, (void *)func); e != NULL;
+         prev = e, e = e->next) {
+        if (e->callee == pre_func_cb)
+            break;
+    }
+    if (e != NULL) {
+        if (prev != NULL)
+            prev->next = e->next;
+        else if (e->next != NULL)
+            hashtable_add_replace(&inline_table, (void *)func, (void *)e->next);
+        else {
+            /* Removing the last entry frees it via inline_entry_free. */
+            hashtable_remove(&inline_table, (void *)func);
+            e = NULL;
+        }
+        if (e != NULL)
+            dr_global_free(e, sizeof(*e));
+        if (dr_fragment_exists_at(dr_get_current_drcontext(), func)) {
+            if (!dr_unlink_flush_region(func, 1))
+                ASSERT(false, "wrap update flush failed");
+        }
+        res = true;
+    }
+    dr_recurlock_unlock(wrap_lock);
+    return res;
+}
+
 DR_EXPORT
 bool
 drwrap_unwrap(app_pc func,
@@ -2379,6 +2694,8 @@ drwrap_is_post_wrap(app_pc pc)
     bool res = false;
     if (pc == NULL)
         return false;
+    if (postcall_cache_lookup(pc))
+        return true;
     dr_rwlock_read_lock(post_call_rwlock);
     res = (hashtable_lookup(&post_call_table, (void*)pc) != NULL);
     dr_rwlock_read_unlock(post_call_rwlock);
@@ -183,7 +183,12 @@ DR_EXPORT
  * and \b true for \p override.  When removing or replacing a prior
  * replacement, existing replaced code in the code cache will be
  * flushed lazily: i.e., there may be some execution in other threads
- * after this call is made.
+ * after this call is made.  Re-issuing a request identical to the
+ * existing replacement with \p override set succeeds without a flush.
+ *
+ * The replacement is resolved when a basic block containing \p original
+ * is built, which ends the block with a direct transfer to \p
+ * replacement: there is no lookup when the replaced code executes.
  *
  * Non-native replacements take precedence over native.  I.e., if a
  * drwrap_replace() replacement exists for \p original, then a native
@@ -420,6 +425,42 @@ drwrap_wrap_ex(app_pc func,
                void (*post_func_cb)(void *wrapcxt, void *user_data),
                void *user_data, uint flags);
 
+/**
+ * One wrap request for drwrap_wrap_batch().  The fields correspond to the
+ * parameters of drwrap_wrap_ex().
+ */
+typedef struct _drwrap_wrap_info_t {
+    /** The function to wrap. */
+    app_pc func;
+    /** The pre-function callback, or NULL. */
+    void (*pre_func_cb)(void *wrapcxt, INOUT void **user_data);
+    /** The post-function callback, or NULL. */
+    void (*post_func_cb)(void *wrapcxt, void *user_data);
+    /** The initial value of *user_data passed to \p pre_func_cb. */
+    void *user_data;
+    /** The #drwrap_wrap_flags_t and at most one #drwrap_callconv_t. */
+    uint flags;
+} drwrap_wrap_info_t;
+
+DR_EXPORT
+/**
+ * Equivalent to calling drwrap_wrap_ex() on each of the \p num_wraps entries
+ * in \p wraps, but acquires drwrap's lock only once and, rather than
+ * flushing each already-executed target individually, issues a single
+ * flush covering all of them.  That flush spans from the lowest to the
+ * highest such target, so any other code in between is also flushed; this
+ * is intended for wrapping many functions in the same module, such as a
+ * set of symbols looked up at module load time.
+ *
+ * If \p results is non-NULL, it must have room for \p num_wraps entries, and
+ * results[i] is set to whether the request in wraps[i] succeeded.
+ *
+ * \return the number of requests that succeeded.
+ */
+uint
+drwrap_wrap_batch(const drwrap_wrap_info_t *wraps, uint num_wraps,
+                  OUT bool *results);
+
 DR_EXPORT
 /**
  * Removes a previously-requested wrap for the function \p func
@@ -737,6 +778,43 @@ bool
 drwrap_set_global_flags(drwrap_global_flags_t flags);
 
 
+DR_EXPORT
+/**
+ * Wraps the application function \p func with a lightweight pre-function
+ * hook.  Rather than going through drwrap's regular context switch, table
+ * lookup, and wrap-level bookkeeping, drwrap inserts at the entry of \p func
+ * a plain clean call to \p pre_func_cb, passing the first \p num_args
+ * (at most 4) arguments of \p func directly as pointer-sized parameters,
+ * read according to the calling convention in \p flags (one of
+ * #drwrap_callconv_t, or 0 for DRWRAP_CALLCONV_DEFAULT).  \p pre_func_cb's
+ * signature is thus, for example, void pre(reg_t arg0, reg_t arg1).
+ *
+ * As this is a regular clean call, DR's clean call optimizations (see the
+ * -opt_cleancall runtime option) apply: a \p pre_func_cb that is a simple
+ * leaf routine, such as one that only reads its arguments and increments a
+ * counter, is inlined into the code cache.  There is no post-function hook,
+ * no wrapcxt, and \p pre_func_cb may not change the arguments, skip the
+ * call, or otherwise change the application state.  When \p func is also
+ * wrapped with drwrap_wrap(), \p pre_func_cb is called after the regular
+ * pre-callbacks, and is not called if one of them skips the call.
+ *
+ * The same considerations as for drwrap_wrap() about when to make the
+ * request apply here.
+ *
+ * \return whether successful.
+ */
+bool
+drwrap_wrap_pre_inline(app_pc func, void *pre_func_cb, uint num_args, uint flags);
+
+DR_EXPORT
+/**
+ * Removes a request previously made with drwrap_wrap_pre_inline().
+ * Existing code for \p func is flushed lazily.
+ * \return whether successful.
+ */
+bool
+drwrap_unwrap_pre_inline(app_pc func, void *pre_func_cb);
+
 DR_EXPORT
 /**
  * \return whether \p func is currently wrapped with \p pre_func_cb
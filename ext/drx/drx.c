@@ -54,6 +54,7 @@
 #endif
 
 #include <limits.h>
+#include <string.h> /* for memset */
 
 #ifdef DEBUG
 # define ASSERT(x, msg) DR_ASSERT_MSG(x, msg)
@@ -79,6 +80,10 @@ static bool soft_kills_enabled;
 
 static void soft_kills_exit(void);
 
+static bool counters_init(void);
+static void counters_exit(void);
+static void fragment_counts_exit(void);
+
 /* For debugging */
 static uint verbose = 0;
 
@@ -93,6 +98,14 @@ static uint verbose = 0;
 bool drx_buf_init_library(void);
 void drx_buf_exit_library(void);
 
+/* defined in drx_workq.c */
+bool drx_workq_init_library(void);
+void drx_workq_exit_library(void);
+
+/* defined in drx_defer.c */
+bool drx_defer_init_library(void);
+void drx_defer_exit_library(void);
+
 /***************************************************************************
  * INIT
  */
@@ -121,7 +134,16 @@ drx_init(void)
     if (drreg_init(&ops) != DRREG_SUCCESS)
         return false;
 
-    return drx_buf_init_library();
+    if (!counters_init())
+        return false;
+
+    if (!drx_workq_init_library())
+        return false;
+
+    if (!drx_buf_init_library())
+        return false;
+
+    return drx_defer_init_library();
 }
 
 DR_EXPORT
@@ -135,7 +157,11 @@ drx_exit()
     if (soft_kills_enabled)
         soft_kills_exit();
 
+    drx_workq_exit_library();
+    drx_defer_exit_library();
     drx_buf_exit_library();
+    fragment_counts_exit();
+    counters_exit();
     drreg_exit();
     drmgr_exit();
 }
@@ -558,6 +584,439 @@ drx_insert_counter_update(void *drcontext, instrlist_t *ilist, instr_t *where,
     return true;
 }
 
+/***************************************************************************
+ * PER-THREAD COUNTERS
+ */
+
+/* Each thread gets its own cache-line-aligned array of 64-bit counters whose
+ * base is kept in raw TLS.  Nobody else writes to it, so the inlined increment
+ * needs no lock prefix and never shares a cache line with another thread.
+ */
+typedef struct _counter_block_t {
+    uint64 *vals;
+    byte *alloc;
+    size_t alloc_size;
+    struct _counter_block_t *prev;
+    struct _counter_block_t *next;
+} counter_block_t;
+
+struct _drx_counters_t {
+    uint num_counters;
+    int tls_idx;       /* drmgr TLS field holding the thread's counter_block_t */
+    uint tls_offs;     /* raw TLS slot holding counter_block_t.vals */
+    reg_id_t tls_seg;
+    void *lock;        /* protects totals and blocks */
+    uint64 *totals;    /* merged values of exited threads */
+    counter_block_t *blocks; /* live threads */
+    struct _drx_counters_t *next;
+};
+
+/* Protects the counters_list */
+static void *counters_lock;
+static drx_counters_t *counters_list;
+
+static void
+counters_thread_init(void *drcontext)
+{
+    drx_counters_t *c;
+    dr_rwlock_read_lock(counters_lock);
+    for (c = counters_list; c != NULL; c = c->next) {
+        size_t line = proc_get_cache_line_size();
+        counter_block_t *block = dr_global_alloc(sizeof(*block));
+        /* Pad out to whole lines so no other thread's data shares ours. */
+        block->alloc_size = ALIGN_FORWARD(c->num_counters * sizeof(uint64), line) +
+            line;
+        block->alloc = dr_global_alloc(block->alloc_size);
+        block->vals = (uint64 *)ALIGN_FORWARD(block->alloc, line);
+        memset(block->vals, 0, c->num_counters * sizeof(uint64));
+        dr_mutex_lock(c->lock);
+        block->prev = NULL;
+        block->next = c->blocks;
+        if (c->blocks != NULL)
+            c->blocks->prev = block;
+        c->blocks = block;
+        dr_mutex_unlock(c->lock);
+        drmgr_set_tls_field(drcontext, c->tls_idx, block);
+        *(uint64 **)(dr_get_dr_segment_base(c->tls_seg) + c->tls_offs) = block->vals;
+    }
+    dr_rwlock_read_unlock(counters_lock);
+}
+
+static void
+counters_free_block(counter_block_t *block)
+{
+    dr_global_free(block->alloc, block->alloc_size);
+    dr_global_free(block, sizeof(*block));
+}
+
+static void
+counters_thread_exit(void *drcontext)
+{
+    drx_counters_t *c;
+    dr_rwlock_read_lock(counters_lock);
+    for (c = counters_list; c != NULL; c = c->next) {
+        counter_block_t *block = drmgr_get_tls_field(drcontext, c->tls_idx);
+        uint i;
+        if (block == NULL)
+            continue;
+        dr_mutex_lock(c->lock);
+        for (i = 0; i < c->num_counters; i++)
+            c->totals[i] += block->vals[i];
+        if (block->prev != NULL)
+            block->prev->next = block->next;
+        else
+            c->blocks = block->next;
+        if (block->next != NULL)
+            block->next->prev = block->prev;
+        dr_mutex_unlock(c->lock);
+        drmgr_set_tls_field(drcontext, c->tls_idx, NULL);
+        counters_free_block(block);
+    }
+    dr_rwlock_read_unlock(counters_lock);
+}
+
+static bool
+counters_init(void)
+{
+    drmgr_priority_t init_priority = {
+        sizeof(init_priority), DRMGR_PRIORITY_NAME_DRX_COUNTERS_INIT, NULL, NULL,
+        DRMGR_PRIORITY_THREAD_INIT_DRX_COUNTERS};
+    drmgr_priority_t exit_priority = {
+        sizeof(exit_priority), DRMGR_PRIORITY_NAME_DRX_COUNTERS_EXIT, NULL, NULL,
+        DRMGR_PRIORITY_THREAD_EXIT_DRX_COUNTERS};
+    counters_lock = dr_rwlock_create();
+    if (counters_lock == NULL)
+        return false;
+    return (drmgr_register_thread_init_event_ex(counters_thread_init,
+                                                &init_priority) &&
+            drmgr_register_thread_exit_event_ex(counters_thread_exit,
+                                                &exit_priority));
+}
+
+static void
+counters_exit(void)
+{
+    drmgr_unregister_thread_init_event(counters_thread_init);
+    drmgr_unregister_thread_exit_event(counters_thread_exit);
+    dr_rwlock_destroy(counters_lock);
+}
+
+DR_EXPORT
+drx_counters_t *
+drx_counters_create(uint num_counters)
+{
+    drx_counters_t *c;
+    uint tls_offs;
+    reg_id_t tls_seg;
+    int tls_idx;
+    if (drx_init_count == 0) {
+        ASSERT(false, "drx_counters_create requires drx_init");
+        return NULL;
+    }
+    if (num_counters == 0)
+        return NULL;
+    if (!dr_raw_tls_calloc(&tls_seg, &tls_offs, 1, 0))
+        return NULL;
+    tls_idx = drmgr_register_tls_field();
+    if (tls_idx == -1) {
+        dr_raw_tls_cfree(tls_offs, 1);
+        return NULL;
+    }
+    c = dr_global_alloc(sizeof(*c));
+    c->num_counters = num_counters;
+    c->tls_idx = tls_idx;
+    c->tls_offs = tls_offs;
+    c->tls_seg = tls_seg;
+    c->lock = dr_mutex_create();
+    c->totals = dr_global_alloc(num_counters * sizeof(uint64));
+    memset(c->totals, 0, num_counters * sizeof(uint64));
+    c->blocks = NULL;
+    dr_rwlock_write_lock(counters_lock);
+    c->next = counters_list;
+    counters_list = c;
+    dr_rwlock_write_unlock(counters_lock);
+    return c;
+}
+
+DR_EXPORT
+bool
+drx_counters_free(drx_counters_t *counters)
+{
+    drx_counters_t *c, *prev = NULL;
+    counter_block_t *block, *next_block;
+    dr_rwlock_write_lock(counters_lock);
+    for (c = counters_list; c != NULL; prev = c, c = c->next) {
+        if (c == counters)
+            break;
+    }
+    if (c == NULL) {
+        dr_rwlock_write_unlock(counters_lock);
+        return false;
+    }
+    if (prev == NULL)
+        counters_list = c->next;
+    else
+        prev->next = c->next;
+    dr_rwlock_write_unlock(counters_lock);
+
+    /* Any threads still alive no longer need their blocks: we only expect
+     * to be called at process exit.
+     */
+    for (block = c->blocks; block != NULL; block = next_block) {
+        next_block = block->next;
+        counters_free_block(block);
+    }
+    dr_global_free(c->totals, c->num_counters * sizeof(uint64));
+    dr_mutex_destroy(c->lock);
+    if (!drmgr_unregister_tls_field(c->tls_idx) ||
+        !dr_raw_tls_cfree(c->tls_offs, 1)) {
+        dr_global_free(c, sizeof(*c));
+        return false;
+    }
+    dr_global_free(c, sizeof(*c));
+    return true;
+}
+
+DR_EXPORT
+uint64
+drx_counters_get_total(drx_counters_t *counters, uint index)
+{
+    uint64 total;
+    counter_block_t *block;
+    if (counters == NULL || index >= counters->num_counters)
+        return 0;
+    dr_mutex_lock(counters->lock);
+    total = counters->totals[index];
+    for (block = counters->blocks; block != NULL; block = block->next)
+        total += block->vals[index];
+    dr_mutex_unlock(counters->lock);
+    return total;
+}
+
+DR_EXPORT
+uint64
+drx_counters_get_thread_value(void *drcontext, drx_counters_t *counters, uint index)
+{
+    counter_block_t *block;
+    if (counters == NULL || index >= counters->num_counters)
+        return 0;
+    block = drmgr_get_tls_field(drcontext, counters->tls_idx);
+    if (block == NULL)
+        return 0;
+    return block->vals[index];
+}
+
+DR_EXPORT
+bool
+drx_insert_counters_update(void *drcontext, drx_counters_t *counters,
+                           instrlist_t *ilist, instr_t *where, uint index, int value)
+{
+    reg_id_t reg_base;
+    int offs;
+#ifdef X86
+    bool aflags_dead;
+#else
+    reg_id_t reg_val;
+#endif
+    if (drcontext == NULL) {
+        ASSERT(false, "drcontext cannot be NULL");
+        return false;
+    }
+    if (counters == NULL || index >= counters->num_counters)
+        return false;
+    if (drmgr_current_bb_phase(drcontext) != DRMGR_PHASE_INSERTION) {
+        ASSERT(false, "drx_insert_counters_update must be called from the insertion "
+               "phase");
+        return false;
+    }
+#ifdef ARM
+    /* FIXME i#1551: implement 64-bit counter support */
+    ASSERT(false, "drx per-thread counters are not implemented for ARM");
+    return false;
+#endif
+    offs = (int)(index * sizeof(uint64));
+    if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg_base) !=
+        DRREG_SUCCESS)
+        return false;
+    dr_insert_read_raw_tls(drcontext, ilist, where, counters->tls_seg,
+                           counters->tls_offs, reg_base);
+#ifdef X86
+    if (drreg_are_aflags_dead(drcontext, where, &aflags_dead) != DRREG_SUCCESS)
+        aflags_dead = false;
+    if (IF_X64_ELSE(aflags_dead, true)) {
+        /* The flags cost nothing to clobber (or, on 32-bit, we need the carry). */
+        if (drreg_reserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS)
+            return false;
+        MINSERT(ilist, where, INSTR_CREATE_add
+                (drcontext, OPND_CREATE_MEMPTR(reg_base, offs),
+                 OPND_CREATE_INT32(value)));
+# ifndef X64
+        MINSERT(ilist, where, INSTR_CREATE_adc
+                (drcontext, OPND_CREATE_MEM32(reg_base, offs + 4),
+                 OPND_CREATE_INT32(0)));
+# endif
+        if (drreg_unreserve_aflags(drcontext, ilist, where) != DRREG_SUCCESS)
+            return false;
+    }
+# ifdef X64
+    else {
+        /* Avoid the costly aflags spill: lea does not touch the flags. */
+        reg_id_t reg_val;
+        if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg_val) !=
+            DRREG_SUCCESS)
+            return false;
+        MINSERT(ilist, where, INSTR_CREATE_mov_ld
+                (drcontext, opnd_create_reg(reg_val),
+                 OPND_CREATE_MEMPTR(reg_base, offs)));
+        MINSERT(ilist, where, INSTR_CREATE_lea
+                (drcontext, opnd_create_reg(reg_val),
+                 OPND_CREATE_MEM_lea(reg_val, DR_REG_NULL, 0, value)));
+        MINSERT(ilist, where, INSTR_CREATE_mov_st
+                (drcontext, OPND_CREATE_MEMPTR(reg_base, offs),
+                 opnd_create_reg(reg_val)));
+        if (drreg_unreserve_register(drcontext, ilist, where, reg_val) !=
+            DRREG_SUCCESS)
+            return false;
+    }
+# endif
+#elif defined(AARCH64)
+    /* Loads, adds, and stores need no flags on AArch64. */
+    if (drreg_reserve_register(drcontext, ilist, where, NULL, &reg_val) !=
+        DRREG_SUCCESS)
+        return false;
+    if (offs >= 4096) {
+        /* Too far for the scaled immediate offset: fold it into the base. */
+        instrlist_insert_mov_immed_ptrsz(drcontext, offs, opnd_create_reg(reg_val),
+                                         ilist, where, NULL, NULL);
+        MINSERT(ilist, where, XINST_CREATE_add
+                (drcontext, opnd_create_reg(reg_base), opnd_create_reg(reg_val)));
+        offs = 0;
+    }
+    MINSERT(ilist, where, XINST_CREATE_load
+            (drcontext, opnd_create_reg(reg_val),
+             OPND_CREATE_MEMPTR(reg_base, offs)));
+    MINSERT(ilist, where, XINST_CREATE_add
+            (drcontext, opnd_create_reg(reg_val), OPND_CREATE_INT(value)));
+    MINSERT(ilist, where, XINST_CREATE_store
+            (drcontext, OPND_CREATE_MEMPTR(reg_base, offs),
+             opnd_create_reg(reg_val)));
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_val) != DRREG_SUCCESS)
+        return false;
+#endif
+    if (drreg_unreserve_register(drcontext, ilist, where, reg_base) != DRREG_SUCCESS)
+        return false;
+    return true;
+}
+
+/***************************************************************************
+ * PER-FRAGMENT EXECUTION COUNTS
+ */
+
+/* Each counted tag is given the next index into fragment_counts, which
+ * fragment_tags maps back to the tag.  Indices are never reused, so a
+ * re-created block (after a flush, or for a trace or translation) keeps
+ * adding to the same counter.
+ */
+static drx_counters_t *fragment_counts;
+static hashtable_t fragment_index_table; /* tag => index + 1 */
+static app_pc *fragment_tags;
+static uint fragment_max;
+static volatile uint fragment_num;
+static bool (*fragment_should_count)(void *drcontext, void *tag, instrlist_t *bb);
+
+static dr_emit_flags_t
+fragment_counts_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                       bool for_trace, bool translating, void *user_data)
+{
+    ptr_uint_t index;
+    if (!drmgr_is_first_instr(drcontext, inst))
+        return DR_EMIT_DEFAULT;
+    if (fragment_should_count != NULL && !(*fragment_should_count)(drcontext, tag, bb))
+        return DR_EMIT_DEFAULT;
+    hashtable_lock(&fragment_index_table);
+    index = (ptr_uint_t) hashtable_lookup(&fragment_index_table, tag);
+    if (index == 0 && fragment_num < fragment_max) {
+        fragment_tags[fragment_num] = (app_pc) tag;
+        index = ++fragment_num;
+        hashtable_add(&fragment_index_table, tag, (void *) index);
+    }
+    hashtable_unlock(&fragment_index_table);
+    if (index == 0) {
+        NOTIFY(1, "--drx-- fragment count limit reached: not counting "PFX"\n", tag);
+        return DR_EMIT_DEFAULT;
+    }
+    drx_insert_counters_update(drcontext, fragment_counts, bb, inst,
+                               (uint)(index - 1), 1);
+    return DR_EMIT_DEFAULT;
+}
+
+DR_EXPORT
+bool
+drx_fragment_counts_enable(uint max_fragments,
+                           bool (*should_count)(void *drcontext, void *tag,
+                                                instrlist_t *bb))
+{
+    if (fragment_counts != NULL || max_fragments == 0)
+        return false;
+#ifdef ARM
+    /* FIXME i#1551: depends on 64-bit per-thread counter support */
+    return false;
+#endif
+    fragment_counts = drx_counters_create(max_fragments);
+    if (fragment_counts == NULL)
+        return false;
+    fragment_tags = dr_global_alloc(max_fragments * sizeof(*fragment_tags));
+    fragment_max = max_fragments;
+    fragment_num = 0;
+    fragment_should_count = should_count;
+    hashtable_init(&fragment_index_table, 10, HASH_INTPTR, false/*!strdup*/);
+    if (!drmgr_register_bb_instrumentation_event(NULL, fragment_counts_insert, NULL)) {
+        fragment_counts_exit();
+        return false;
+    }
+    return true;
+}
+
+static void
+fragment_counts_exit(void)
+{
+    if (fragment_counts == NULL)
+        return;
+    drmgr_unregister_bb_insertion_event(fragment_counts_insert);
+    hashtable_delete(&fragment_index_table);
+    dr_global_free(fragment_tags, fragment_max * sizeof(*fragment_tags));
+    drx_counters_free(fragment_counts);
+    fragment_counts = NULL;
+}
+
+DR_EXPORT
+bool
+drx_fragment_counts_iterate(void *drcontext,
+                            bool (*callback)(drx_fragment_count_t *info,
+                                             void *user_data),
+                            void *user_data)
+{
+    drx_fragment_count_t info;
+    uint i, num;
+    if (fragment_counts == NULL || callback == NULL)
+        return false;
+    info.struct_size = sizeof(info);
+    /* Tags are only appended, so entries below the count we read are stable. */
+    hashtable_lock(&fragment_index_table);
+    num = fragment_num;
+    hashtable_unlock(&fragment_index_table);
+    for (i = 0; i < num; i++) {
+        info.tag = fragment_tags[i];
+        if (drcontext == NULL)
+            info.count = drx_counters_get_total(fragment_counts, i);
+        else
+            info.count = drx_counters_get_thread_value(drcontext, fragment_counts, i);
+        if (!(*callback)(&info, user_data))
+            break;
+    }
+    return true;
+}
+
 /***************************************************************************
  * SOFT KILLS
  */
@@ -160,6 +160,154 @@ drx_insert_counter_update(void *drcontext, instrlist_t *ilist, instr_t *where,
                           dr_spill_slot_t slot, IF_NOT_X86_(dr_spill_slot_t slot2)
                           void *addr, int value, uint flags);
 
+/***************************************************************************
+ * PER-THREAD COUNTERS
+ */
+
+struct _drx_counters_t;
+
+/**
+ * Opaque handle which represents an array of 64-bit counters that each
+ * thread updates privately.
+ */
+typedef struct _drx_counters_t drx_counters_t;
+
+/**
+ * Priorities of the thread events used by drx per-thread counters.  The init
+ * event runs early and the exit event runs late so that a client's own thread
+ * events can query drx_counters_get_thread_value().
+ */
+enum {
+    /** Priority of drx per-thread counters thread init event */
+    DRMGR_PRIORITY_THREAD_INIT_DRX_COUNTERS  =  -7500,
+    /** Priority of drx per-thread counters thread exit event */
+    DRMGR_PRIORITY_THREAD_EXIT_DRX_COUNTERS  =   7500,
+};
+
+/** Name of drx per-thread counters thread init priority. */
+#define DRMGR_PRIORITY_NAME_DRX_COUNTERS_INIT "drx_counters.init"
+
+/** Name of drx per-thread counters thread exit priority. */
+#define DRMGR_PRIORITY_NAME_DRX_COUNTERS_EXIT "drx_counters.exit"
+
+DR_EXPORT
+/**
+ * Creates an array of \p num_counters 64-bit counters, each of which is
+ * updated by drx_insert_counters_update().  Every thread gets a private,
+ * cache-line-aligned copy of the array whose base is kept in raw TLS, so
+ * updates need neither a lock prefix nor any sharing of cache lines between
+ * threads.  A thread's values are merged into the totals when it exits.
+ *
+ * Requires drx_init().  This must be called during process initialization,
+ * as threads that already exist are not given a copy of the array.
+ *
+ * \return NULL if unsuccessful, a valid opaque struct pointer if successful.
+ */
+drx_counters_t *
+drx_counters_create(uint num_counters);
+
+DR_EXPORT
+/**
+ * Frees the counters array created by drx_counters_create().  This should
+ * only be called at process exit, once no code cache instrumentation will
+ * touch \p counters again.
+ *
+ * \return whether successful.
+ */
+bool
+drx_counters_free(drx_counters_t *counters);
+
+DR_EXPORT
+/**
+ * Inserts into \p ilist prior to \p where meta-instruction(s) to add the
+ * constant \p value to entry \p index of the current thread's copy of
+ * \p counters.  Must be called from drmgr's insertion phase: drreg is used to
+ * obtain scratch registers.  On 64-bit x86 the arithmetic flags are only
+ * clobbered when they are dead at \p where; otherwise an extra scratch
+ * register is used instead of spilling the flags.
+ *
+ * \note Not yet implemented for 32-bit ARM.
+ *
+ * \return whether successful.
+ */
+bool
+drx_insert_counters_update(void *drcontext, drx_counters_t *counters,
+                           instrlist_t *ilist, instr_t *where, uint index, int value);
+
+DR_EXPORT
+/**
+ * Returns the sum of entry \p index of \p counters across all threads: the
+ * merged values of exited threads plus the current values of live ones.
+ * Live threads are not suspended, so the result is only a snapshot while
+ * they are running.
+ */
+uint64
+drx_counters_get_total(drx_counters_t *counters, uint index);
+
+DR_EXPORT
+/**
+ * Returns the value of entry \p index of the copy of \p counters that belongs
+ * to the thread whose context is \p drcontext.
+ */
+uint64
+drx_counters_get_thread_value(void *drcontext, drx_counters_t *counters, uint index);
+
+/***************************************************************************
+ * PER-FRAGMENT EXECUTION COUNTS
+ */
+
+/** Information about one basic block passed to drx_fragment_counts_iterate(). */
+typedef struct _drx_fragment_count_t {
+    /** For compatibility.  Set to sizeof(drx_fragment_count_t). */
+    size_t struct_size;
+    /** The tag of the basic block. */
+    app_pc tag;
+    /**
+     * The number of times the block executed, either in all threads or in
+     * the requested thread.  Executions as part of a trace are included.
+     */
+    uint64 count;
+} drx_fragment_count_t;
+
+DR_EXPORT
+/**
+ * Enables execution counts for each basic block, kept in the per-thread
+ * counters of drx_counters_create() so that the inserted increments are
+ * contention-free.  If \p should_count is non-NULL, only blocks for which it
+ * returns true are counted; it is called from the insertion phase with the
+ * block's tag and instruction list, and the client can use it to restrict
+ * counting to, e.g., trace heads it has marked with dr_mark_trace_head().
+ * At most \p max_fragments distinct tags are counted: later blocks are
+ * silently left uninstrumented.
+ *
+ * Requires drx_init() and must be called during process initialization.
+ * The counts are freed by drx_exit().
+ *
+ * \note Not yet implemented for 32-bit ARM.
+ *
+ * \return whether successful.
+ */
+bool
+drx_fragment_counts_enable(uint max_fragments,
+                           bool (*should_count)(void *drcontext, void *tag,
+                                                instrlist_t *bb));
+
+DR_EXPORT
+/**
+ * Calls \p callback for each basic block counted by
+ * drx_fragment_counts_enable(), passing \p user_data through.  If
+ * \p drcontext is NULL, the counts are summed across all threads as in
+ * drx_counters_get_total(); otherwise they are that thread's own counts.
+ * Iteration stops early if \p callback returns false.
+ *
+ * \return whether successful.
+ */
+bool
+drx_fragment_counts_iterate(void *drcontext,
+                            bool (*callback)(drx_fragment_count_t *info,
+                                             void *user_data),
+                            void *user_data);
+
 /***************************************************************************
  * SOFT KILLS
  */
@@ -294,6 +442,69 @@ drx_open_unique_appid_dir(const char *dir, ptr_int_t id,
                           const char *prefix, const char *suffix,
                           char *result OUT, size_t result_len);
 
+/***************************************************************************
+ * WORK QUEUE
+ */
+
+/**
+ * A unit of work submitted with drx_workq_submit().  It is called on one of the
+ * queue's worker threads, with that thread's \p drcontext, and \p arg as passed
+ * to drx_workq_submit().
+ */
+typedef void (*drx_workq_func_t)(void *drcontext, void *arg);
+
+struct _drx_workq_t;
+
+/** Opaque handle which represents a work queue and its pool of worker threads. */
+typedef struct _drx_workq_t drx_workq_t;
+
+DR_EXPORT
+/**
+ * Creates a work queue served by a fixed pool of \p num_threads client threads,
+ * which must be at least 1.  Work submitted with drx_workq_submit() is
+ * processed in submission order by whichever worker is free, so with more than
+ * one worker, items may complete out of order.  The workers are not suspended
+ * for DR synchronizations such as flushes: see dr_client_thread_set_suspendable().
+ *
+ * Requires drx_init().  Any queue not destroyed by the time drx_exit() is
+ * called is destroyed there, so that all of its work is completed at process
+ * exit and detach.
+ *
+ * \return NULL if unsuccessful, a valid opaque struct pointer if successful.
+ */
+drx_workq_t *
+drx_workq_create(uint num_threads);
+
+DR_EXPORT
+/**
+ * Queues a call to \p func with \p arg on one of the worker threads of \p queue.
+ * Submitting never blocks on the workers and takes no locks, apart from DR's
+ * heap allocation, so it may be called from a clean call.
+ * \returns whether successful.
+ */
+bool
+drx_workq_submit(drx_workq_t *queue, drx_workq_func_t func, void *arg);
+
+DR_EXPORT
+/**
+ * Waits until all work submitted to \p queue so far has completed.  Only one
+ * thread at a time should wait on a given queue.  This must not be called from a
+ * worker thread of \p queue.
+ * \returns whether successful.
+ */
+bool
+drx_workq_wait(drx_workq_t *queue);
+
+DR_EXPORT
+/**
+ * Completes all work submitted to \p queue, then shuts down its worker threads
+ * and frees it.  No further work may be submitted.  To ensure all work is
+ * done, it should be called from the client's exit event rather than later.
+ * \returns whether successful.
+ */
+bool
+drx_workq_destroy(drx_workq_t *queue);
+
 /***************************************************************************
  * BUFFER FILLING LIBRARY
  */
@@ -364,6 +575,28 @@ drx_buf_t *
 drx_buf_create_trace_buffer(size_t buffer_size,
                             drx_buf_full_cb_t full_cb);
 
+DR_EXPORT
+/**
+ * Initializes the drx_buf extension with an asynchronous trace buffer.  Each
+ * thread gets \p num_buffers buffers of \p buffer_size bytes each, which must
+ * be at least 2.  When a thread fills a buffer, the buffer is queued and the
+ * thread continues writing into the next one.  A client thread created by
+ * drx_buf calls \p full_cb on queued buffers in order, passing its own
+ * drcontext rather than that of the thread that filled the buffer.
+ * A thread only waits if its next buffer has not been processed yet.
+ * drx_buf_get_stall_time() reports the total time spent waiting.
+ *
+ * A thread's final partial buffer is queued at thread exit.  drx_buf_free()
+ * waits for every queued buffer to be processed.  To ensure all data is
+ * delivered, it should be called from the client's exit event rather than
+ * later.
+ *
+ * \return NULL if unsuccessful, a valid opaque struct pointer if successful.
+ */
+drx_buf_t *
+drx_buf_create_trace_buffer_async(size_t buffer_size, uint num_buffers,
+                                  drx_buf_full_cb_t full_cb);
+
 DR_EXPORT
 /** Cleans up the buffer associated with \p buf. \returns whether successful. */
 bool
@@ -435,6 +668,25 @@ DR_EXPORT
 size_t
 drx_buf_get_buffer_size(void *drcontext, drx_buf_t *buf);
 
+DR_EXPORT
+/**
+ * Returns the total time, in microseconds, that threads have spent waiting for
+ * a free buffer of an asynchronous trace buffer created with
+ * drx_buf_create_trace_buffer_async().  Returns 0 for other buffer types.
+ */
+uint64
+drx_buf_get_stall_time(drx_buf_t *buf);
+
+DR_EXPORT
+/**
+ * When called from the \p full_cb of an asynchronous trace buffer created with
+ * drx_buf_create_trace_buffer_async(), returns the id of the thread that filled
+ * the buffer being passed to the callback, which may have since exited.
+ * The result is not meaningful when called from anywhere else.
+ */
+thread_id_t
+drx_buf_get_owner_thread(drx_buf_t *buf);
+
 DR_EXPORT
 /**
  * Pads a basic block with a label at the end for routines which rely on inserting
@@ -460,6 +712,99 @@ void
 drx_buf_insert_buf_memcpy(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
                           instr_t *where, reg_id_t dst, reg_id_t src, ushort len);
 
+/***************************************************************************
+ * DEFERRED CALLS
+ */
+
+/**
+ * The callee of a deferred call, invoked once for each call recorded by
+ * drx_defer_insert_call() with the \p num_args values in \p args that were
+ * recorded.  It runs in the thread that recorded the call, or, at process
+ * exit, possibly on its behalf in another thread (see
+ * dr_register_thread_exit_event()), with \p drcontext being the recording
+ * thread's context.
+ */
+typedef void (*drx_defer_func_t)(void *drcontext, ptr_uint_t *args);
+
+/** Flags controlling when deferred calls are delivered. */
+typedef enum {
+    /** Delivers the calls each thread has recorded prior to each of its syscalls. */
+    DRX_DEFER_FLUSH_SYSCALL     = 0x01,
+    /**
+     * Delivers the calls each thread has recorded prior to each of its kernel
+     * control transfers, such as signal delivery (see
+     * drmgr_register_kernel_xfer_event()).
+     */
+    DRX_DEFER_FLUSH_KERNEL_XFER = 0x02,
+} drx_defer_flags_t;
+
+struct _drx_defer_t;
+
+/** Opaque handle which represents a deferred call. */
+typedef struct _drx_defer_t drx_defer_t;
+
+DR_EXPORT
+/**
+ * Creates a deferred call to \p func, an alternative to a clean call for
+ * instrumentation that executes frequently but only needs to record a few
+ * values.  drx_defer_insert_call() inserts inline code which appends the
+ * \p num_args argument values to a per-thread drx_buf trace buffer, rather
+ * than switching to a clean call context.  \p func is called on each record
+ * once the thread has recorded \p batch_count calls, so the cost of entering
+ * DR is paid once per batch.  The rest of a thread's records are delivered
+ * at thread exit, by drx_defer_flush(), and at the points requested in \p
+ * flags.
+ *
+ * Since the callee runs later than the instrumented code, it must not
+ * inspect application state such as registers or memory, which may have
+ * changed in between: anything it needs must be passed as an argument.
+ * The callees of different threads may run concurrently.
+ *
+ * Requires drx_init().  Deferred calls should be created before application
+ * code executes, for \p flags to apply to all syscalls.
+ *
+ * \return NULL if unsuccessful, a valid opaque struct pointer if successful.
+ */
+drx_defer_t *
+drx_defer_create(drx_defer_func_t func, uint num_args, uint batch_count,
+                 drx_defer_flags_t flags);
+
+DR_EXPORT
+/**
+ * Delivers any calls recorded by the current thread, then frees \p defer.
+ * Calls recorded by other live threads are discarded, so this should be
+ * called from the client's exit event.
+ * \returns whether successful.
+ */
+bool
+drx_defer_destroy(drx_defer_t *defer);
+
+DR_EXPORT
+/**
+ * Inserts into \p ilist prior to \p where meta-instructions which record a
+ * deferred call to the callee of \p defer with the \p num_args pointer-sized
+ * arguments that follow, which must match the count passed to
+ * drx_defer_create().  Each argument is an opnd_t which must be a register
+ * or an immediate integer, and must not use \p scratch1 or \p scratch2.  The
+ * two scratch registers are clobbered and must be preserved by the caller,
+ * for example with drreg; the arithmetic flags are not modified.  As with
+ * drx_buf_insert_buf_store(), \p where must have a translation set.
+ * \returns whether successful.
+ */
+bool
+drx_defer_insert_call(void *drcontext, drx_defer_t *defer, instrlist_t *ilist,
+                      instr_t *where, reg_id_t scratch1, reg_id_t scratch2,
+                      uint num_args, ...);
+
+DR_EXPORT
+/**
+ * Delivers, in order, all calls to \p defer recorded so far by the thread
+ * owning \p drcontext.  This must be called either by that thread or while
+ * it is suspended.
+ */
+void
+drx_defer_flush(void *drcontext, drx_defer_t *defer);
+
 /*@}*/ /* end doxygen group */
 
 #ifdef __cplusplus
@@ -56,13 +56,37 @@ typedef enum {
     DRX_BUF_TRACE
 } drx_buf_type_t;
 
+/* one of the rotating buffers of an asynchronous trace buffer */
+typedef struct {
+    byte *cli_base;
+    byte *buf_base;
+    volatile bool busy; /* queued for or being processed by the consumer */
+} async_slot_t;
+
 typedef struct {
     byte  *seg_base;
     byte  *cli_base;   /* the base of the buffer from the client's perspective */
     byte  *buf_base;   /* the actual base of the buffer */
     size_t total_size; /* the actual size of the buffer */
+    /* Asynchronous trace buffers only.  cli_base and buf_base mirror
+     * slots[active], which only the owning thread changes; busy, outstanding,
+     * and orphaned are protected by the drx_buf_t's queue_lock.
+     */
+    async_slot_t *slots;
+    uint active;
+    uint outstanding;  /* slots queued for or being processed by the consumer */
+    bool orphaned;     /* thread has exited: consumer frees us when idle */
+    thread_id_t owner_tid;
 } per_thread_t;
 
+/* a full buffer waiting for the consumer of an asynchronous trace buffer */
+typedef struct _async_item_t {
+    per_thread_t *owner;
+    uint slot;
+    size_t size;
+    struct _async_item_t *next;
+} async_item_t;
+
 struct _drx_buf_t {
     drx_buf_type_t buf_type;
     size_t         buf_size;
@@ -72,6 +96,19 @@ struct _drx_buf_t {
     int      tls_idx;
     uint     tls_offs;
     reg_id_t tls_seg;
+    /* Asynchronous trace buffers only (num_bufs is 0 otherwise): full buffers
+     * are queued for a consumer thread and app threads move on to the next of
+     * their num_bufs buffers.
+     */
+    uint          num_bufs;
+    void         *queue_lock;
+    void         *work_event;  /* signaled when an item is queued */
+    void         *done_event;  /* signaled when the consumer exits */
+    async_item_t *queue_head;
+    async_item_t *queue_tail;
+    bool          exiting;
+    uint64        stall_us;    /* time app threads waited for a free buffer */
+    thread_id_t   cb_owner;    /* owner of the buffer the consumer is handing out */
 };
 
 /* global rwlock to lock against updates to the clients vector */
@@ -85,11 +122,17 @@ static bool any_bufs_created;
 bool drx_buf_init_library(void);
 void drx_buf_exit_library(void);
 
-static drx_buf_t *drx_buf_init(drx_buf_type_t bt, size_t bsz,
+static drx_buf_t *drx_buf_init(drx_buf_type_t bt, size_t bsz, uint num_bufs,
                                drx_buf_full_cb_t full_cb);
 
 static per_thread_t *per_thread_init_2byte(void *drcontext, drx_buf_t *buf);
 static per_thread_t *per_thread_init_fault(void *drcontext, drx_buf_t *buf);
+static per_thread_t *per_thread_init_async(void *drcontext, drx_buf_t *buf);
+static void per_thread_exit_async(drx_buf_t *buf, per_thread_t *data);
+
+static void buffer_full(void *drcontext, drx_buf_t *buf, per_thread_t *data,
+                        byte *cli_ptr);
+static void async_consumer(void *arg);
 
 static void drx_buf_insert_update_buf_ptr_2byte(void *drcontext, drx_buf_t *buf,
                                                 instrlist_t *ilist, instr_t *where,
@@ -112,8 +155,8 @@ static dr_signal_action_t signal_event(void *drcontext, dr_siginfo_t *info);
 #endif
 
 static reg_id_t deduce_buf_ptr(instr_t *instr);
-static bool reset_buf_ptr(void *drcontext, dr_mcontext_t *raw_mcontext, byte *seg_base,
-                          byte *cli_base, drx_buf_t *buf);
+static bool reset_buf_ptr(void *drcontext, dr_mcontext_t *raw_mcontext,
+                          per_thread_t *data, drx_buf_t *buf);
 static bool fault_event_helper(void *drcontext, byte *target,
                                dr_mcontext_t *raw_mcontext);
 
@@ -174,7 +217,7 @@ drx_buf_create_circular_buffer(size_t buf_size)
     /* We can optimize circular buffers that are this size */
     drx_buf_type_t buf_type = (buf_size == DRX_BUF_FAST_CIRCULAR_BUFSZ) ?
         DRX_BUF_CIRCULAR_FAST : DRX_BUF_CIRCULAR;
-    return drx_buf_init(buf_type, buf_size, NULL);
+    return drx_buf_init(buf_type, buf_size, 0, NULL);
 }
 
 DR_EXPORT
@@ -182,11 +225,21 @@ drx_buf_t *
 drx_buf_create_trace_buffer(size_t buf_size,
                             drx_buf_full_cb_t full_cb)
 {
-    return drx_buf_init(DRX_BUF_TRACE, buf_size, full_cb);
+    return drx_buf_init(DRX_BUF_TRACE, buf_size, 0, full_cb);
+}
+
+DR_EXPORT
+drx_buf_t *
+drx_buf_create_trace_buffer_async(size_t buf_size, uint num_buffers,
+                                  drx_buf_full_cb_t full_cb)
+{
+    if (num_buffers < 2)
+        return NULL;
+    return drx_buf_init(DRX_BUF_TRACE, buf_size, num_buffers, full_cb);
 }
 
 static drx_buf_t *
-drx_buf_init(drx_buf_type_t bt, size_t bsz,
+drx_buf_init(drx_buf_type_t bt, size_t bsz, uint num_bufs,
              drx_buf_full_cb_t full_cb)
 {
     drx_buf_t *new_client;
@@ -210,6 +263,26 @@ drx_buf_init(drx_buf_type_t bt, size_t bsz,
     new_client->tls_seg = tls_seg;
     new_client->tls_idx = tls_idx;
     new_client->full_cb = full_cb;
+    new_client->num_bufs = num_bufs;
+    new_client->queue_head = NULL;
+    new_client->queue_tail = NULL;
+    new_client->exiting = false;
+    new_client->stall_us = 0;
+    new_client->cb_owner = 0;
+    if (num_bufs > 0) {
+        new_client->queue_lock = dr_mutex_create();
+        new_client->work_event = dr_event_create();
+        new_client->done_event = dr_event_create();
+        if (!dr_create_client_thread(async_consumer, new_client)) {
+            dr_event_destroy(new_client->done_event);
+            dr_event_destroy(new_client->work_event);
+            dr_mutex_destroy(new_client->queue_lock);
+            dr_global_free(new_client, sizeof(*new_client));
+            drmgr_unregister_tls_field(tls_idx);
+            dr_raw_tls_cfree(tls_offs, 1);
+            return NULL;
+        }
+    }
     dr_rwlock_write_lock(global_buf_rwlock);
     /* We don't attempt to re-use NULL entries (presumably which
      * have already been freed), for simplicity.
@@ -240,6 +313,18 @@ drx_buf_free(drx_buf_t *buf)
     ((drx_buf_t **)clients.array)[buf->vec_idx] = NULL;
     dr_rwlock_write_unlock(global_buf_rwlock);
 
+    if (buf->num_bufs > 0) {
+        /* Let the consumer drain what is queued before it exits. */
+        dr_mutex_lock(buf->queue_lock);
+        buf->exiting = true;
+        dr_mutex_unlock(buf->queue_lock);
+        dr_event_signal(buf->work_event);
+        dr_event_wait(buf->done_event);
+        dr_event_destroy(buf->done_event);
+        dr_event_destroy(buf->work_event);
+        dr_mutex_destroy(buf->queue_lock);
+    }
+
     if (!drmgr_unregister_tls_field(buf->tls_idx) ||
         !dr_raw_tls_cfree(buf->tls_offs, 1))
         return false;
@@ -279,6 +364,27 @@ drx_buf_get_buffer_size(void *drcontext, drx_buf_t *buf)
     return buf->buf_size;
 }
 
+DR_EXPORT
+uint64
+drx_buf_get_stall_time(drx_buf_t *buf)
+{
+    uint64 stall_us;
+    if (buf->num_bufs == 0)
+        return 0;
+    dr_mutex_lock(buf->queue_lock);
+    stall_us = buf->stall_us;
+    dr_mutex_unlock(buf->queue_lock);
+    return stall_us;
+}
+
+DR_EXPORT
+thread_id_t
+drx_buf_get_owner_thread(drx_buf_t *buf)
+{
+    /* Only the consumer writes this, just around its full_cb invocations. */
+    return buf->cb_owner;
+}
+
 void
 event_thread_init(void *drcontext)
 {
@@ -290,6 +396,8 @@ event_thread_init(void *drcontext)
         if (buf != NULL) {
             if (buf->buf_type == DRX_BUF_CIRCULAR_FAST)
                 data = per_thread_init_2byte(drcontext, buf);
+            else if (buf->num_bufs > 0)
+                data = per_thread_init_async(drcontext, buf);
             else
                 data = per_thread_init_fault(drcontext, buf);
             drmgr_set_tls_field(drcontext, buf->tls_idx, data);
@@ -309,6 +417,11 @@ event_thread_exit(void *drcontext)
         if (buf != NULL) {
             per_thread_t *data = drmgr_get_tls_field(drcontext, buf->tls_idx);
             byte *cli_ptr = BUF_PTR(data->seg_base, buf->tls_offs);
+            if (buf->num_bufs > 0) {
+                /* The consumer may still be using our other buffers. */
+                per_thread_exit_async(buf, data);
+                continue;
+            }
             /* buffer has not yet been deleted, call user callback(s) */
             if (buf->full_cb != NULL) {
                 (*buf->full_cb)(drcontext, data->cli_base,
@@ -367,9 +480,175 @@ per_thread_init_fault(void *drcontext, drx_buf_t *buf)
     DR_ASSERT(ok);
     per_thread->buf_base = ret;
     per_thread->cli_base = ret + ALIGN_FORWARD(buf->buf_size, page_size) - buf->buf_size;
+    per_thread->slots = NULL;
+    return per_thread;
+}
+
+static per_thread_t *
+per_thread_init_async(void *drcontext, drx_buf_t *buf)
+{
+    size_t page_size = dr_page_size();
+    /* Global, as the consumer frees it if it outlives the thread. */
+    per_thread_t *per_thread = dr_global_alloc(sizeof(per_thread_t));
+    uint i;
+    per_thread->seg_base = dr_get_dr_segment_base(buf->tls_seg);
+    /* Each buffer gets its own trailing read-only page, as for
+     * per_thread_init_fault().
+     */
+    per_thread->total_size = ALIGN_FORWARD(buf->buf_size, page_size) + page_size;
+    per_thread->slots = dr_global_alloc(buf->num_bufs * sizeof(async_slot_t));
+    for (i = 0; i < buf->num_bufs; i++) {
+        byte *ret = dr_raw_mem_alloc(per_thread->total_size,
+                                     DR_MEMPROT_READ | DR_MEMPROT_WRITE, NULL);
+        bool ok = dr_memory_protect(ret + per_thread->total_size - page_size,
+                                    page_size, DR_MEMPROT_READ);
+        DR_ASSERT(ok);
+        per_thread->slots[i].buf_base = ret;
+        per_thread->slots[i].cli_base =
+            ret + ALIGN_FORWARD(buf->buf_size, page_size) - buf->buf_size;
+        per_thread->slots[i].busy = false;
+    }
+    per_thread->active = 0;
+    per_thread->buf_base = per_thread->slots[0].buf_base;
+    per_thread->cli_base = per_thread->slots[0].cli_base;
+    per_thread->outstanding = 0;
+    per_thread->orphaned = false;
+    per_thread->owner_tid = dr_get_thread_id(drcontext);
     return per_thread;
 }
 
+static void
+per_thread_free_async(drx_buf_t *buf, per_thread_t *data)
+{
+    uint i;
+    for (i = 0; i < buf->num_bufs; i++)
+        dr_raw_mem_free(data->slots[i].buf_base, data->total_size);
+    dr_global_free(data->slots, buf->num_bufs * sizeof(async_slot_t));
+    dr_global_free(data, sizeof(per_thread_t));
+}
+
+/* Queues the active buffer of data, holding size bytes, for the consumer. */
+static void
+async_enqueue(drx_buf_t *buf, per_thread_t *data, size_t size)
+{
+    async_item_t *item = dr_global_alloc(sizeof(*item));
+    item->owner = data;
+    item->slot = data->active;
+    item->size = size;
+    item->next = NULL;
+    dr_mutex_lock(buf->queue_lock);
+    data->slots[data->active].busy = true;
+    data->outstanding++;
+    if (buf->queue_tail == NULL)
+        buf->queue_head = item;
+    else
+        buf->queue_tail->next = item;
+    buf->queue_tail = item;
+    dr_mutex_unlock(buf->queue_lock);
+    dr_event_signal(buf->work_event);
+}
+
+/* Hands off the active buffer and switches to the next one, waiting for the
+ * consumer to release it if necessary.
+ */
+static void
+async_rotate(drx_buf_t *buf, per_thread_t *data, size_t size)
+{
+    uint next;
+    if (size == 0)
+        return;
+    async_enqueue(buf, data, size);
+    next = (data->active + 1) % buf->num_bufs;
+    if (data->slots[next].busy) {
+        uint64 start = dr_get_microseconds();
+        while (data->slots[next].busy)
+            dr_thread_yield();
+        dr_mutex_lock(buf->queue_lock);
+        buf->stall_us += dr_get_microseconds() - start;
+        dr_mutex_unlock(buf->queue_lock);
+    }
+    data->active = next;
+    data->buf_base = data->slots[next].buf_base;
+    data->cli_base = data->slots[next].cli_base;
+}
+
+static void
+per_thread_exit_async(drx_buf_t *buf, per_thread_t *data)
+{
+    byte *cli_ptr = BUF_PTR(data->seg_base, buf->tls_offs);
+    bool free_now;
+    if (cli_ptr > data->cli_base)
+        async_enqueue(buf, data, (size_t)(cli_ptr - data->cli_base));
+    dr_mutex_lock(buf->queue_lock);
+    data->orphaned = true;
+    free_now = (data->outstanding == 0);
+    dr_mutex_unlock(buf->queue_lock);
+    if (free_now)
+        per_thread_free_async(buf, data);
+}
+
+static void
+async_consumer(void *arg)
+{
+    drx_buf_t *buf = (drx_buf_t *)arg;
+    void *drcontext = dr_get_current_drcontext();
+    /* App threads may wait on us from DR's fault handling, so we must not be
+     * held up by synchronizations which wait on them in turn.
+     */
+    dr_client_thread_set_suspendable(false);
+    while (true) {
+        async_item_t *item;
+        bool free_owner;
+        dr_mutex_lock(buf->queue_lock);
+        item = buf->queue_head;
+        if (item != NULL) {
+            buf->queue_head = item->next;
+            if (buf->queue_head == NULL)
+                buf->queue_tail = NULL;
+        } else if (buf->exiting) {
+            dr_mutex_unlock(buf->queue_lock);
+            break;
+        }
+        dr_mutex_unlock(buf->queue_lock);
+        if (item == NULL) {
+            dr_event_wait(buf->work_event);
+            continue;
+        }
+        if (buf->full_cb != NULL) {
+            buf->cb_owner = item->owner->owner_tid;
+            (*buf->full_cb)(drcontext, item->owner->slots[item->slot].cli_base,
+                            item->size);
+            buf->cb_owner = 0;
+        }
+        dr_mutex_lock(buf->queue_lock);
+        item->owner->slots[item->slot].busy = false;
+        item->owner->outstanding--;
+        free_owner = item->owner->orphaned && item->owner->outstanding == 0;
+        dr_mutex_unlock(buf->queue_lock);
+        if (free_owner)
+            per_thread_free_async(buf, item->owner);
+        dr_global_free(item, sizeof(*item));
+    }
+    dr_event_signal(buf->done_event);
+}
+
+/* Resets the buffer pointer to the start of a buffer and hands the full
+ * contents [cli_base, cli_ptr) to the client.  The pointer is set before the
+ * callback so it's easier for the user to override it in the callback.
+ */
+static void
+buffer_full(void *drcontext, drx_buf_t *buf, per_thread_t *data, byte *cli_ptr)
+{
+    if (buf->num_bufs > 0) {
+        async_rotate(buf, data, (size_t)(cli_ptr - data->cli_base));
+        BUF_PTR(data->seg_base, buf->tls_offs) = data->cli_base;
+        return;
+    }
+    BUF_PTR(data->seg_base, buf->tls_offs) = data->cli_base;
+    if (buf->full_cb != NULL)
+        (*buf->full_cb)(drcontext, data->cli_base, (size_t)(cli_ptr - data->cli_base));
+}
+
 DR_EXPORT
 void
 drx_buf_insert_load_buf_ptr(void *drcontext, drx_buf_t *buf, instrlist_t *ilist,
@@ -697,11 +976,8 @@ safe_memcpy(drx_buf_t *buf, void *src, size_t len)
     /* try to perform a safe memcpy */
     if (!dr_safe_write(cli_ptr, len, src, NULL)) {
         /* we overflowed the client buffer, so flush it and try again */
-        byte *cli_base = data->cli_base;
-        BUF_PTR(data->seg_base, buf->tls_offs) = cli_base;
-        if (buf->full_cb != NULL)
-            (*buf->full_cb)(drcontext, cli_base, (size_t)(cli_ptr - cli_base));
-        memcpy(cli_base, src, len);
+        buffer_full(drcontext, buf, data, cli_ptr);
+        memcpy(data->cli_base, src, len);
     }
 }
 
@@ -786,12 +1062,11 @@ deduce_buf_ptr(instr_t *instr)
 
 /* returns true if we won't intercept the fault, false otherwise */
 static bool
-reset_buf_ptr(void *drcontext, dr_mcontext_t *raw_mcontext, byte *seg_base,
-              byte *cli_base, drx_buf_t *buf)
+reset_buf_ptr(void *drcontext, dr_mcontext_t *raw_mcontext, per_thread_t *data,
+              drx_buf_t *buf)
 {
     instr_t *instr;
     reg_id_t buf_ptr;
-    app_pc tmp_base;
 
     /* decode the instruction to extract the base register */
     instr = instr_create(drcontext);
@@ -801,17 +1076,11 @@ reset_buf_ptr(void *drcontext, dr_mcontext_t *raw_mcontext, byte *seg_base,
     if (buf_ptr == DR_REG_NULL)
         return true;
 
-    /* We set the buffer pointer before the callback so it's easier
-     * for the user to override it in the callback.
-     */
-    tmp_base = BUF_PTR(seg_base, buf->tls_offs);
-    BUF_PTR(seg_base, buf->tls_offs) = cli_base;
-    if (buf->full_cb != NULL)
-        (*buf->full_cb)(drcontext, cli_base, (size_t)(tmp_base - cli_base));
+    buffer_full(drcontext, buf, data, BUF_PTR(data->seg_base, buf->tls_offs));
 
     /* change contents of buf_ptr and retry the instruction */
     reg_set_value(buf_ptr, raw_mcontext,
-                  (reg_t)BUF_PTR(seg_base, buf->tls_offs));
+                  (reg_t)BUF_PTR(data->seg_base, buf->tls_offs));
     return false;
 }
 
@@ -840,8 +1109,7 @@ fault_event_helper(void *drcontext, byte *target,
 
             /* we found the right client */
             if (target >= ro_lo && target < ro_lo + page_size) {
-                bool ret = reset_buf_ptr(drcontext, raw_mcontext, data->seg_base,
-                                         data->cli_base, buf);
+                bool ret = reset_buf_ptr(drcontext, raw_mcontext, data, buf);
                 dr_rwlock_read_unlock(global_buf_rwlock);
                 return ret;
             }
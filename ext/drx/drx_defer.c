@@ -0,0 +1,268 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* DynamoRio eXtension Deferred Call API */
+
+#include "dr_api.h"
+#include "drmgr.h"
+#include "drx.h"
+#include "../ext_utils.h"
+#include <limits.h>
+#include <stdarg.h> /* for varargs */
+#include <string.h> /* for memset */
+
+#ifdef DEBUG
+# define ASSERT(x, msg) DR_ASSERT_MSG(x, msg)
+#else
+# define ASSERT(x, msg) /* nothing */
+#endif
+
+struct _drx_defer_t {
+    drx_defer_func_t func;
+    uint num_args;
+    size_t record_size;
+    drx_defer_flags_t flags;
+    /* Each record holds num_args pointer-sized values. */
+    drx_buf_t *buf;
+    struct _drx_defer_t *next;
+};
+
+/* Deferred calls which have not yet been destroyed.  The buffer-full callback
+ * and the flush events only read the list, so this is a read-write lock.
+ */
+static drx_defer_t *defers;
+static void *defers_lock;
+/* the number of live deferred calls asking to be flushed prior to syscalls */
+static int syscall_flushes;
+
+static void defer_buffer_full(void *drcontext, void *buf_base, size_t size);
+static bool event_filter_syscall(void *drcontext, int sysnum);
+static bool event_pre_syscall(void *drcontext, int sysnum);
+static void event_kernel_xfer(void *drcontext, const dr_kernel_xfer_info_t *info);
+
+/* called by drx_init() */
+bool
+drx_defer_init_library(void)
+{
+    defers = NULL;
+    syscall_flushes = 0;
+    defers_lock = dr_rwlock_create();
+    if (defers_lock == NULL)
+        return false;
+    dr_register_filter_syscall_event(event_filter_syscall);
+    return drmgr_register_pre_syscall_event(event_pre_syscall) &&
+        drmgr_register_kernel_xfer_event(event_kernel_xfer);
+}
+
+/* called by drx_exit() */
+void
+drx_defer_exit_library(void)
+{
+    while (defers != NULL)
+        drx_defer_destroy(defers);
+    drmgr_unregister_kernel_xfer_event(event_kernel_xfer);
+    drmgr_unregister_pre_syscall_event(event_pre_syscall);
+    dr_unregister_filter_syscall_event(event_filter_syscall);
+    dr_rwlock_destroy(defers_lock);
+}
+
+DR_EXPORT
+drx_defer_t *
+drx_defer_create(drx_defer_func_t func, uint num_args, uint batch_count,
+                 drx_defer_flags_t flags)
+{
+    drx_defer_t *defer;
+    if (func == NULL || num_args == 0 || batch_count == 0 ||
+        /* the record offsets must fit drx_buf's short and ushort parameters */
+        num_args * sizeof(ptr_uint_t) > SHRT_MAX)
+        return NULL;
+    defer = dr_global_alloc(sizeof(*defer));
+    memset(defer, 0, sizeof(*defer));
+    defer->func = func;
+    defer->num_args = num_args;
+    defer->record_size = num_args * sizeof(ptr_uint_t);
+    defer->flags = flags;
+    defer->buf = drx_buf_create_trace_buffer(batch_count * defer->record_size,
+                                             defer_buffer_full);
+    if (defer->buf == NULL) {
+        dr_global_free(defer, sizeof(*defer));
+        return NULL;
+    }
+    dr_rwlock_write_lock(defers_lock);
+    defer->next = defers;
+    defers = defer;
+    if (TEST(DRX_DEFER_FLUSH_SYSCALL, flags))
+        syscall_flushes++;
+    dr_rwlock_write_unlock(defers_lock);
+    return defer;
+}
+
+DR_EXPORT
+bool
+drx_defer_destroy(drx_defer_t *defer)
+{
+    drx_defer_t *d, *prev = NULL;
+    bool res;
+    dr_rwlock_write_lock(defers_lock);
+    for (d = defers; d != NULL; prev = d, d = d->next) {
+        if (d == defer)
+            break;
+    }
+    if (d == NULL) {
+        dr_rwlock_write_unlock(defers_lock);
+        return false;
+    }
+    if (prev == NULL)
+        defers = defer->next;
+    else
+        prev->next = defer->next;
+    if (TEST(DRX_DEFER_FLUSH_SYSCALL, defer->flags))
+        syscall_flushes--;
+    dr_rwlock_write_unlock(defers_lock);
+    /* Only the current thread's records can be delivered here. */
+    if (dr_get_current_drcontext() != NULL)
+        drx_defer_flush(dr_get_current_drcontext(), defer);
+    res = drx_buf_free(defer->buf);
+    dr_global_free(defer, sizeof(*defer));
+    return res;
+}
+
+/* Invokes the callee on each record in [buf_base, buf_base + size). */
+static void
+defer_deliver(void *drcontext, drx_defer_t *defer, byte *buf_base, size_t size)
+{
+    byte *rec;
+    ASSERT(size % defer->record_size == 0, "partial deferred call record");
+    for (rec = buf_base; rec + defer->record_size <= buf_base + size;
+         rec += defer->record_size)
+        (*defer->func)(drcontext, (ptr_uint_t *)rec);
+}
+
+/* drx_buf does not tell us which buffer filled up, so we match its base
+ * against this thread's base for each of our buffers.
+ */
+static void
+defer_buffer_full(void *drcontext, void *buf_base, size_t size)
+{
+    drx_defer_t *defer;
+    dr_rwlock_read_lock(defers_lock);
+    for (defer = defers; defer != NULL; defer = defer->next) {
+        if (drx_buf_get_buffer_base(drcontext, defer->buf) == buf_base) {
+            defer_deliver(drcontext, defer, (byte *)buf_base, size);
+            break;
+        }
+    }
+    dr_rwlock_read_unlock(defers_lock);
+}
+
+DR_EXPORT
+void
+drx_defer_flush(void *drcontext, drx_defer_t *defer)
+{
+    byte *base = drx_buf_get_buffer_base(drcontext, defer->buf);
+    byte *ptr = drx_buf_get_buffer_ptr(drcontext, defer->buf);
+    if (base == NULL || ptr <= base)
+        return;
+    /* Reset first, as for a full buffer, so a callee which triggers further
+     * deferred calls does not see these records again.
+     */
+    drx_buf_set_buffer_ptr(drcontext, defer->buf, base);
+    defer_deliver(drcontext, defer, base, (size_t)(ptr - base));
+}
+
+static void
+defer_flush_all(void *drcontext, drx_defer_flags_t flag)
+{
+    drx_defer_t *defer;
+    dr_rwlock_read_lock(defers_lock);
+    for (defer = defers; defer != NULL; defer = defer->next) {
+        if (TEST(flag, defer->flags))
+            drx_defer_flush(drcontext, defer);
+    }
+    dr_rwlock_read_unlock(defers_lock);
+}
+
+static bool
+event_filter_syscall(void *drcontext, int sysnum)
+{
+    return syscall_flushes > 0;
+}
+
+static bool
+event_pre_syscall(void *drcontext, int sysnum)
+{
+    defer_flush_all(drcontext, DRX_DEFER_FLUSH_SYSCALL);
+    return true;
+}
+
+static void
+event_kernel_xfer(void *drcontext, const dr_kernel_xfer_info_t *info)
+{
+    defer_flush_all(drcontext, DRX_DEFER_FLUSH_KERNEL_XFER);
+}
+
+DR_EXPORT
+bool
+drx_defer_insert_call(void *drcontext, drx_defer_t *defer, instrlist_t *ilist,
+                      instr_t *where, reg_id_t scratch1, reg_id_t scratch2,
+                      uint num_args, ...)
+{
+    va_list ap;
+    uint i;
+    bool res = true;
+    if (num_args != defer->num_args)
+        return false;
+    /* Validate up front so we never emit a partial record. */
+    va_start(ap, num_args);
+    for (i = 0; i < num_args; i++) {
+        opnd_t arg = va_arg(ap, opnd_t);
+        if ((!opnd_is_reg(arg) && !opnd_is_immed_int(arg)) ||
+            opnd_uses_reg(arg, scratch1) || opnd_uses_reg(arg, scratch2))
+            res = false;
+    }
+    va_end(ap);
+    if (!res)
+        return false;
+    drx_buf_insert_load_buf_ptr(drcontext, defer->buf, ilist, where, scratch1);
+    va_start(ap, num_args);
+    for (i = 0; i < num_args; i++) {
+        opnd_t arg = va_arg(ap, opnd_t);
+        if (!drx_buf_insert_buf_store(drcontext, defer->buf, ilist, where, scratch1,
+                                      scratch2, arg, OPSZ_PTR,
+                                      (short)(i * sizeof(ptr_uint_t))))
+            res = false;
+    }
+    va_end(ap);
+    drx_buf_insert_update_buf_ptr(drcontext, defer->buf, ilist, where, scratch1,
+                                  scratch2, (ushort)defer->record_size);
+    return res;
+}
@@ -0,0 +1,282 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* DynamoRio eXtension Work Queue API */
+
+#include "dr_api.h"
+#include "drx.h"
+#include "../ext_utils.h"
+#include <string.h> /* for memset */
+
+#ifdef DEBUG
+# define ASSERT(x, msg) DR_ASSERT_MSG(x, msg)
+#else
+# define ASSERT(x, msg) /* nothing */
+#endif
+
+/* a submitted unit of work */
+typedef struct _workq_item_t {
+    drx_workq_func_t func;
+    void *arg;
+    struct _workq_item_t *next;
+} workq_item_t;
+
+struct _drx_workq_t {
+    /* Producers push onto this list with a compare-and-swap and never take a
+     * lock.  The items are in reverse submission order.
+     */
+    workq_item_t * volatile pending;
+    /* The workers take the whole pending list at once, under ready_lock, and
+     * move it here in submission order.
+     */
+    void *ready_lock;
+    workq_item_t *ready_head;
+    bool exiting;
+    /* signaled when work arrives in an empty queue, and passed on by workers */
+    void *work_event;
+    /* items submitted but not yet completed */
+    volatile int outstanding;
+    /* signaled when outstanding drops to 0 */
+    void *idle_event;
+    uint num_threads;
+    volatile int live_threads;
+    /* signaled when the last worker exits */
+    void *done_event;
+    struct _drx_workq_t *next;
+};
+
+/* queues which have not yet been destroyed, for drx_exit() */
+static drx_workq_t *queues;
+static void *queues_lock;
+
+static void workq_worker(void *arg);
+
+/* called by drx_init() */
+bool
+drx_workq_init_library(void)
+{
+    queues = NULL;
+    queues_lock = dr_mutex_create();
+    return queues_lock != NULL;
+}
+
+/* called by drx_exit() */
+void
+drx_workq_exit_library(void)
+{
+    while (queues != NULL)
+        drx_workq_destroy(queues);
+    dr_mutex_destroy(queues_lock);
+}
+
+static void
+workq_free(drx_workq_t *queue)
+{
+    if (queue->done_event != NULL)
+        dr_event_destroy(queue->done_event);
+    if (queue->idle_event != NULL)
+        dr_event_destroy(queue->idle_event);
+    if (queue->work_event != NULL)
+        dr_event_destroy(queue->work_event);
+    if (queue->ready_lock != NULL)
+        dr_mutex_destroy(queue->ready_lock);
+    dr_global_free(queue, sizeof(*queue));
+}
+
+DR_EXPORT
+drx_workq_t *
+drx_workq_create(uint num_threads)
+{
+    drx_workq_t *queue;
+    uint i;
+    if (num_threads == 0)
+        return NULL;
+    queue = dr_global_alloc(sizeof(*queue));
+    memset(queue, 0, sizeof(*queue));
+    queue->num_threads = num_threads;
+    queue->ready_lock = dr_mutex_create();
+    queue->work_event = dr_event_create();
+    queue->idle_event = dr_event_create();
+    queue->done_event = dr_event_create();
+    if (queue->ready_lock == NULL || queue->work_event == NULL ||
+        queue->idle_event == NULL || queue->done_event == NULL) {
+        workq_free(queue);
+        return NULL;
+    }
+    for (i = 0; i < num_threads; i++) {
+        dr_atomic_add32_return_sum(&queue->live_threads, 1);
+        if (!dr_create_client_thread(workq_worker, queue)) {
+            dr_atomic_add32_return_sum(&queue->live_threads, -1);
+            break;
+        }
+    }
+    if (i == 0) {
+        workq_free(queue);
+        return NULL;
+    }
+    /* We run with fewer workers rather than failing if only some were created. */
+    queue->num_threads = i;
+    dr_mutex_lock(queues_lock);
+    queue->next = queues;
+    queues = queue;
+    dr_mutex_unlock(queues_lock);
+    return queue;
+}
+
+DR_EXPORT
+bool
+drx_workq_submit(drx_workq_t *queue, drx_workq_func_t func, void *arg)
+{
+    workq_item_t *item, *head;
+    if (queue == NULL || func == NULL || queue->exiting)
+        return false;
+    item = dr_global_alloc(sizeof(*item));
+    item->func = func;
+    item->arg = arg;
+    /* Counted before it is visible so a concurrent drx_workq_wait() can't miss it. */
+    dr_atomic_add32_return_sum(&queue->outstanding, 1);
+    do {
+        head = queue->pending;
+        item->next = head;
+    } while (!dr_atomic_compare_exchange_ptr((void * volatile *)&queue->pending,
+                                             head, item));
+    /* A non-empty pending list always has a wakeup on its way: any worker that
+     * takes it passes the signal on if there is more to do.
+     */
+    if (head == NULL)
+        dr_event_signal(queue->work_event);
+    return true;
+}
+
+/* Takes the next item to run, moving the pending list over if needed.
+ * Sets *more if other items remain.  Returns NULL if there is nothing to run.
+ */
+static workq_item_t *
+workq_take(drx_workq_t *queue, bool *more)
+{
+    workq_item_t *item;
+    dr_mutex_lock(queue->ready_lock);
+    if (queue->ready_head == NULL) {
+        workq_item_t *list;
+        do {
+            list = queue->pending;
+        } while (list != NULL &&
+                 !dr_atomic_compare_exchange_ptr((void * volatile *)&queue->pending,
+                                                 list, NULL));
+        /* Reverse into submission order. */
+        while (list != NULL) {
+            workq_item_t *next = list->next;
+            list->next = queue->ready_head;
+            queue->ready_head = list;
+            list = next;
+        }
+    }
+    item = queue->ready_head;
+    if (item != NULL)
+        queue->ready_head = item->next;
+    *more = (queue->ready_head != NULL || queue->pending != NULL);
+    dr_mutex_unlock(queue->ready_lock);
+    return item;
+}
+
+static void
+workq_worker(void *arg)
+{
+    drx_workq_t *queue = (drx_workq_t *)arg;
+    void *drcontext = dr_get_current_drcontext();
+    /* Other threads may wait on us in drx_workq_wait() from clean calls, so we
+     * must not be held up by synchronizations which wait on them in turn.
+     */
+    dr_client_thread_set_suspendable(false);
+    while (true) {
+        bool more;
+        workq_item_t *item = workq_take(queue, &more);
+        if (item == NULL) {
+            if (queue->exiting)
+                break;
+            dr_event_wait(queue->work_event);
+            continue;
+        }
+        /* Wake another worker to share the rest. */
+        if (more && queue->num_threads > 1)
+            dr_event_signal(queue->work_event);
+        (*item->func)(drcontext, item->arg);
+        dr_global_free(item, sizeof(*item));
+        if (dr_atomic_add32_return_sum(&queue->outstanding, -1) == 0)
+            dr_event_signal(queue->idle_event);
+    }
+    /* Pass the exit request on to the next worker. */
+    dr_event_signal(queue->work_event);
+    if (dr_atomic_add32_return_sum(&queue->live_threads, -1) == 0)
+        dr_event_signal(queue->done_event);
+}
+
+DR_EXPORT
+bool
+drx_workq_wait(drx_workq_t *queue)
+{
+    if (queue == NULL)
+        return false;
+    /* The idle event may be left over from an earlier idle point, so we re-check. */
+    while (queue->outstanding > 0)
+        dr_event_wait(queue->idle_event);
+    return true;
+}
+
+DR_EXPORT
+bool
+drx_workq_destroy(drx_workq_t *queue)
+{
+    drx_workq_t **prev;
+    if (queue == NULL)
+        return false;
+    dr_mutex_lock(queues_lock);
+    for (prev = &queues; *prev != NULL && *prev != queue; prev = &(*prev)->next)
+        ; /* nothing */
+    if (*prev == NULL) {
+        dr_mutex_unlock(queues_lock);
+        return false;
+    }
+    *prev = queue->next;
+    dr_mutex_unlock(queues_lock);
+
+    /* The workers drain what is queued before they exit. */
+    dr_mutex_lock(queue->ready_lock);
+    queue->exiting = true;
+    dr_mutex_unlock(queue->ready_lock);
+    dr_event_signal(queue->work_event);
+    dr_event_wait(queue->done_event);
+    ASSERT(queue->outstanding == 0 && queue->pending == NULL &&
+           queue->ready_head == NULL, "work left in destroyed queue");
+    workq_free(queue);
+    return true;
+}
@@ -80,6 +80,8 @@ int our_snprintf_wide(wchar_t *s, size_t max, const wchar_t *fmt, ...);
 extern bool
 create_nudge_signal_payload(siginfo_t *info OUT, uint action_mask,
                             client_id_t client_id, uint64 client_arg);
+extern process_id_t
+get_nudge_signal_target(process_id_t pid);
 #endif
 
 /* The minimum option size is 3, e.g., "-x ".  Note that we need the
@@ -1988,8 +1990,9 @@ dr_nudge_pid(process_id_t process_id, client_id_t client_id, uint64 arg, uint ti
     /* construct the payload */
     if (!create_nudge_signal_payload(&info, NUDGE_GENERIC(client), client_id, arg))
         return DR_FAILURE;
-    /* send the nudge */
-    res = syscall(SYS_rt_sigqueueinfo, process_id, NUDGESIG_SIGNUM, &info);
+    /* send the nudge, to the -nudge_thread if there is one */
+    res = syscall(SYS_rt_sigqueueinfo, get_nudge_signal_target(process_id),
+                  NUDGESIG_SIGNUM, &info);
     if (res < 0)
         return DR_FAILURE;
     return DR_SUCCESS;
@@ -0,0 +1,98 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* CPU-bound benchmark workload: a few hot loops executed many times, for
+ * measuring steady-state overhead once the code cache is warm.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DIM 64
+
+static unsigned int a[DIM][DIM], b[DIM][DIM], c[DIM][DIM];
+
+static unsigned int
+matmul(unsigned int seed)
+{
+    int i, j, k;
+    unsigned int sum = 0;
+    for (i = 0; i < DIM; i++) {
+        for (j = 0; j < DIM; j++) {
+            a[i][j] = seed + i * j;
+            b[i][j] = seed ^ (i + j);
+        }
+    }
+    for (i = 0; i < DIM; i++) {
+        for (j = 0; j < DIM; j++) {
+            unsigned int val = 0;
+            for (k = 0; k < DIM; k++)
+                val += a[i][k] * b[k][j];
+            c[i][j] = val;
+            sum += val;
+        }
+    }
+    return sum;
+}
+
+static unsigned int
+sieve(int limit)
+{
+    static char composite[1 << 16];
+    int i, j;
+    unsigned int count = 0;
+    for (i = 0; i < limit; i++)
+        composite[i] = 0;
+    for (i = 2; i < limit; i++) {
+        if (!composite[i]) {
+            count++;
+            for (j = i * 2; j < limit; j += i)
+                composite[j] = 1;
+        }
+    }
+    return count;
+}
+
+int
+main(int argc, char **argv)
+{
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    int iters = 800 * scale;
+    unsigned int checksum = 0;
+    int i;
+    for (i = 0; i < iters; i++) {
+        checksum += matmul(i);
+        checksum += sieve(1 << 16);
+    }
+    printf("cpu: %u\n", checksum);
+    return 0;
+}
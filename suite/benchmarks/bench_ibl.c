@@ -0,0 +1,90 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Indirect-branch-heavy benchmark workload: indirect calls through a function
+ * table, a dense switch compiled to a jump table, and the returns from both,
+ * with unpredictable targets.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef unsigned int (*func_t)(unsigned int);
+
+#define FUNC(n) \
+    static unsigned int f##n(unsigned int x) { return x * (2 * n + 1) + n; }
+FUNC(0) FUNC(1) FUNC(2) FUNC(3) FUNC(4) FUNC(5) FUNC(6) FUNC(7)
+FUNC(8) FUNC(9) FUNC(10) FUNC(11) FUNC(12) FUNC(13) FUNC(14) FUNC(15)
+
+static func_t funcs[] = {
+    f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15
+};
+
+static unsigned int
+dispatch(unsigned int op, unsigned int x)
+{
+    switch (op) {
+    case 0: return x + 1;
+    case 1: return x ^ 0x5555;
+    case 2: return x * 3;
+    case 3: return x >> 1;
+    case 4: return x - 7;
+    case 5: return x << 2;
+    case 6: return ~x;
+    case 7: return x + (x >> 3);
+    case 8: return x * 5 + 1;
+    case 9: return x ^ (x << 5);
+    case 10: return x - (x >> 2);
+    case 11: return x | 0x101;
+    case 12: return x & 0xfff0fff;
+    case 13: return x + 0x1234;
+    case 14: return x * 7;
+    default: return x;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    unsigned int iters = 20000000 * scale;
+    unsigned int rand = 12345, x = 1;
+    unsigned int i;
+    for (i = 0; i < iters; i++) {
+        /* A simple LCG keeps the targets unpredictable but deterministic. */
+        rand = rand * 1103515245 + 12345;
+        x = funcs[(rand >> 16) & 0xf](x);
+        x = dispatch((rand >> 24) & 0xf, x);
+    }
+    printf("ibl: %u\n", x);
+    return 0;
+}
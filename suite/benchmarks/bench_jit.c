@@ -0,0 +1,102 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* JIT benchmark workload: repeatedly generates small functions into a
+ * writable and executable region and calls them, as a JIT compiler does,
+ * so that code modification and its invalidation are measured.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define NUM_FUNCS 64
+#define FUNC_SLOT 64
+
+typedef unsigned int (*jit_func_t)(void);
+
+/* Writes a function returning val into slot. */
+static void
+emit_return_const(unsigned char *slot, unsigned short val)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    slot[0] = 0xb8; /* mov eax, imm32 */
+    slot[1] = (unsigned char)val;
+    slot[2] = (unsigned char)(val >> 8);
+    slot[3] = 0;
+    slot[4] = 0;
+    slot[5] = 0xc3; /* ret */
+#elif defined(__aarch64__)
+    unsigned int instrs[2];
+    instrs[0] = 0x52800000 | ((unsigned int)val << 5); /* movz w0, #val */
+    instrs[1] = 0xd65f03c0; /* ret */
+    memcpy(slot, instrs, sizeof(instrs));
+#elif defined(__arm__)
+    unsigned int instrs[3];
+    instrs[0] = 0xe3000000 | ((val & 0xf000) << 4) | (val & 0xfff); /* movw r0, #val */
+    instrs[1] = 0xe12fff1e; /* bx lr */
+    memcpy(slot, instrs, sizeof(instrs));
+#else
+# error Unsupported architecture
+#endif
+}
+
+int
+main(int argc, char **argv)
+{
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    int rounds = 20000 * scale;
+    unsigned int checksum = 0;
+    unsigned char *code;
+    int i, j;
+    code = mmap(NULL, NUM_FUNCS * FUNC_SLOT, PROT_READ | PROT_WRITE | PROT_EXEC,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED) {
+        perror("mmap");
+        return 1;
+    }
+    for (i = 0; i < NUM_FUNCS; i++)
+        emit_return_const(code + i * FUNC_SLOT, 0);
+    __builtin___clear_cache((char *)code, (char *)code + NUM_FUNCS * FUNC_SLOT);
+    for (i = 0; i < rounds; i++) {
+        /* Regenerate one function per round, then run them all a few times. */
+        unsigned char *slot = code + (i % NUM_FUNCS) * FUNC_SLOT;
+        emit_return_const(slot, (unsigned short)i);
+        __builtin___clear_cache((char *)slot, (char *)slot + FUNC_SLOT);
+        for (j = 0; j < NUM_FUNCS * 4; j++)
+            checksum += ((jit_func_t)(code + (j % NUM_FUNCS) * FUNC_SLOT))();
+    }
+    munmap(code, NUM_FUNCS * FUNC_SLOT);
+    printf("jit: %u\n", checksum);
+    return 0;
+}
@@ -1,5 +1,5 @@
 /* **********************************************************
- * Copyright (c) 2015 Google, Inc.  All rights reserved.
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
  * **********************************************************/
 
 /*
@@ -30,24 +30,26 @@
  * DAMAGE.
  */
 
-/* cache_line: represents a cache line.
+/* Syscall-heavy benchmark workload: cheap system calls in a tight loop, for
+ * measuring the cost of each transition through DR's system call handling.
  */
 
-#ifndef _CACHE_LINE_H_
-#define _CACHE_LINE_H_ 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
-#include "caching_device_block.h"
-
-class cache_line_t : public caching_device_block_t
+int
+main(int argc, char **argv)
 {
-
-    // Currently, "cache_line_t" is identical to caching_device_block_t; however,
-    // cache_line_t is probably to be extended to have distinct member variables
-    // and functions, e.g., coherency-related ones. Therefore, it is
-    // reasonable to keep two identical classes now rather than use one instead.
-
-    // FIXME i#1726: implement cache coherency protocols
-
-};
-
-#endif /* _CACHE_LINE_H_ */
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    int iters = 1000000 * scale;
+    long checksum = 0;
+    int i;
+    for (i = 0; i < iters; i++) {
+        /* We invoke the syscall directly as libc may cache the result. */
+        checksum += syscall(SYS_getppid) == getppid();
+    }
+    printf("syscall: %ld\n", checksum);
+    return 0;
+}
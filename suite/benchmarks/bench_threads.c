@@ -0,0 +1,78 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Many-threads benchmark workload: waves of short-lived threads, for
+ * measuring thread initialization and exit costs and contention between
+ * threads on shared code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#define NUM_THREADS 16
+
+static void *
+thread_func(void *arg)
+{
+    unsigned int val = (unsigned int)(unsigned long)arg;
+    int i;
+    for (i = 0; i < 100000; i++)
+        val = val * 1103515245 + 12345;
+    return (void *)(unsigned long)(val & 0xffff);
+}
+
+int
+main(int argc, char **argv)
+{
+    int scale = argc > 1 ? atoi(argv[1]) : 1;
+    int waves = 100 * scale;
+    pthread_t threads[NUM_THREADS];
+    unsigned long checksum = 0;
+    int i, j;
+    for (i = 0; i < waves; i++) {
+        for (j = 0; j < NUM_THREADS; j++) {
+            if (pthread_create(&threads[j], NULL, thread_func,
+                               (void *)(unsigned long)(i * NUM_THREADS + j)) != 0) {
+                perror("pthread_create");
+                return 1;
+            }
+        }
+        for (j = 0; j < NUM_THREADS; j++) {
+            void *res;
+            pthread_join(threads[j], &res);
+            checksum += (unsigned long)res;
+        }
+    }
+    printf("threads: %lu\n", checksum);
+    return 0;
+}
@@ -1457,6 +1457,42 @@ test_stack_pointer_size(void *dc)
                    "addr16 leave  %ebp %esp (%ebp)[4byte] -> %esp %ebp\n")) == 0);
 }
 
+static void
+test_decode_opcode_only(void *dc)
+{
+    const byte bytes[] = {
+        0x48, 0x01, 0x43, 0x08, /* add %rax|%eax, 0x8(%rbx) (dec %eax on 32-bit) */
+        0x66, 0x0f, 0x6f, 0xc1, /* movdqa %xmm1, %xmm0 */
+        0xc3,                   /* ret */
+        0x0f, 0x0b,             /* ud2 */
+        0x0f, 0xff,             /* invalid */
+    };
+    int opcodes[8];
+    byte lengths[8];
+    byte *pc = (byte *)bytes;
+    uint count, i;
+    count = decode_opcodes(dc, (byte *)bytes, (byte *)bytes + sizeof(bytes),
+                           opcodes, lengths, BUFFER_SIZE_ELEMENTS(opcodes));
+    ASSERT(count == IF_X64_ELSE(4, 5));
+    for (i = 0; i < count; i++) {
+        instr_t instr;
+        int opcode;
+        byte *next_pc;
+        instr_init(dc, &instr);
+        next_pc = decode(dc, pc, &instr);
+        ASSERT(next_pc != NULL && next_pc - pc == lengths[i]);
+        ASSERT(instr_get_opcode(&instr) == opcodes[i]);
+        ASSERT(decode_opcode_only(dc, pc, &opcode) == next_pc && opcode == opcodes[i]);
+        instr_free(dc, &instr);
+        pc = next_pc;
+    }
+    ASSERT(pc == bytes + sizeof(bytes) - 2);
+    {
+        int opcode;
+        ASSERT(decode_opcode_only(dc, pc, &opcode) == NULL && opcode == OP_INVALID);
+    }
+}
+
 int
 main(int argc, char *argv[])
 {
@@ -1524,6 +1560,8 @@ main(int argc, char *argv[])
 
     test_stack_pointer_size(dcontext);
 
+    test_decode_opcode_only(dcontext);
+
     print("all done\n");
     return 0;
 }
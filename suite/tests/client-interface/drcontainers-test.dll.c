@@ -34,9 +34,11 @@
 /* Tests the drcontainers extension */
 
 #include "dr_api.h"
+#include "client_tools.h"
 #include "drvector.h"
 #include "hashtable.h"
 #include "stdint.h"
+#include <string.h>
 
 #define CHECK(x, msg) do {               \
     if (!(x)) {                          \
@@ -78,6 +80,54 @@ test_vector(void)
     CHECK(ok, "drvector_delete failed");
 }
 
+static uint segmented_freed;
+
+static void
+segmented_free(void *data)
+{
+    segmented_freed++;
+}
+
+static bool
+segmented_check(uint idx, void *data, void *user_data)
+{
+    uint *visited = (uint *)user_data;
+    CHECK(data == (void *)(uintptr_t)(idx + 1), "iterated entry not equal");
+    (*visited)++;
+    return *visited < 1000;
+}
+
+static void
+test_vector_segmented(void)
+{
+    drvector_segmented_t vec;
+    uint i, idx, visited = 0;
+    bool ok = drvector_segmented_init(&vec, 2, segmented_free);
+    CHECK(ok, "drvector_segmented_init failed");
+    CHECK(drvector_segmented_size(&vec) == 0, "should start empty");
+    CHECK(!drvector_segmented_append(&vec, NULL, NULL), "NULL append succeeded");
+
+    /* Enough entries to span many segments */
+    for (i = 0; i < 5000; i++) {
+        ok = drvector_segmented_append(&vec, (void *)(uintptr_t)(i + 1), &idx);
+        CHECK(ok && idx == i, "drvector_segmented_append failed");
+    }
+    CHECK(drvector_segmented_size(&vec) == 5000, "wrong size");
+    for (i = 0; i < 5000; i++) {
+        CHECK(drvector_segmented_get_entry(&vec, i) == (void *)(uintptr_t)(i + 1),
+              "entries not equal");
+    }
+    CHECK(drvector_segmented_get_entry(&vec, 5000) == NULL, "entry beyond the end");
+
+    /* The iterator stops when told to */
+    drvector_segmented_iterate(&vec, segmented_check, &visited);
+    CHECK(visited == 1000, "iteration did not stop");
+
+    ok = drvector_segmented_delete(&vec);
+    CHECK(ok, "drvector_segmented_delete failed");
+    CHECK(segmented_freed == 5000, "free_data_func not called for each entry");
+}
+
 unsigned int c;
 
 static void
@@ -116,11 +166,148 @@ test_hashtable_apply_all(void)
     hashtable_delete(&hash_table);
 }
 
+static void
+test_oahashtable(void)
+{
+    oahashtable_t table;
+    hashtable_config_t config;
+    static char keys[64][16];
+    char upper[16];
+    uintptr_t i;
+
+    oahashtable_init_ex(&table, 2, HASH_INTPTR, true/*synch*/, NULL, NULL, NULL);
+    /* Aligned keys, and enough of them to go through several resizes */
+    for (i = 1; i <= 4096; i++)
+        CHECK(oahashtable_add(&table, (void *)(i * 16), (void *)i), "add failed");
+    CHECK(table.entries == 4096, "wrong entry count");
+    CHECK(!oahashtable_add(&table, (void *)16, (void *)2), "duplicate add succeeded");
+    for (i = 1; i <= 4096; i++)
+        CHECK(oahashtable_lookup(&table, (void *)(i * 16)) == (void *)i, "lookup failed");
+    CHECK(oahashtable_lookup(&table, (void *)8) == NULL, "lookup of absent key");
+
+    CHECK(oahashtable_add_replace(&table, (void *)16, (void *)7) == (void *)1,
+          "replace returned wrong payload");
+    CHECK(oahashtable_lookup(&table, (void *)16) == (void *)7, "replace failed");
+    CHECK(oahashtable_remove(&table, (void *)16), "remove failed");
+    CHECK(!oahashtable_remove(&table, (void *)16), "double remove succeeded");
+    CHECK(oahashtable_lookup(&table, (void *)16) == NULL, "lookup of removed key");
+    CHECK(oahashtable_add(&table, (void *)16, (void *)1), "re-add failed");
+
+    /* Keys 16..1024 are payloads 1..64 */
+    CHECK(oahashtable_remove_range(&table, (void *)16, (void *)(65 * 16)),
+          "remove_range failed");
+    CHECK(table.entries == 4096 - 64, "wrong entry count after remove_range");
+    CHECK(oahashtable_lookup(&table, (void *)(64 * 16)) == NULL, "range not removed");
+    CHECK(oahashtable_lookup(&table, (void *)(65 * 16)) == (void *)65,
+          "remove_range removed too much");
+
+    c = 0;
+    total = 0;
+    oahashtable_apply_to_all_payloads(&table, count);
+    oahashtable_apply_to_all_payloads(&table, sum);
+    CHECK(c == table.entries, "oahashtable_apply_to_all_payloads (count test) failed");
+    CHECK(total == 4096 * 4097 / 2 - 64 * 65 / 2,
+          "oahashtable_apply_to_all_payloads (sum test) failed");
+
+    oahashtable_clear(&table);
+    CHECK(table.entries == 0, "clear failed");
+    CHECK(oahashtable_lookup(&table, (void *)(65 * 16)) == NULL, "clear left entries");
+    oahashtable_delete(&table);
+
+    /* A non-resizable table still reclaims removed slots */
+    oahashtable_init_ex(&table, 4, HASH_INTPTR, false/*!synch*/, NULL, NULL, NULL);
+    config.size = sizeof(config);
+    config.resizable = false;
+    config.resize_threshold = 75;
+    oahashtable_configure(&table, &config);
+    for (i = 1; i <= 1024; i++) {
+        CHECK(oahashtable_add(&table, (void *)i, (void *)i), "add failed");
+        CHECK(oahashtable_remove(&table, (void *)i), "remove failed");
+    }
+    CHECK(table.cur->bucket_bits == 2, "non-resizable table grew");
+    oahashtable_delete(&table);
+
+    /* String keys are not duplicated, so they must outlive the table */
+    oahashtable_init_ex(&table, 4, HASH_STRING_NOCASE, true/*synch*/,
+                        NULL, NULL, NULL);
+    for (i = 0; i < 64; i++) {
+        dr_snprintf(keys[i], BUFFER_SIZE_ELEMENTS(keys[i]), "key%d", (int)i);
+        NULL_TERMINATE_BUFFER(keys[i]);
+        CHECK(oahashtable_add(&table, keys[i], (void *)(i + 1)), "add failed");
+    }
+    for (i = 0; i < 64; i++) {
+        dr_snprintf(upper, BUFFER_SIZE_ELEMENTS(upper), "KEY%d", (int)i);
+        NULL_TERMINATE_BUFFER(upper);
+        CHECK(oahashtable_lookup(&table, upper) == (void *)(i + 1), "nocase lookup failed");
+    }
+    oahashtable_delete(&table);
+}
+
+/* Compares hashtable_t and oahashtable_t on aligned pointer keys.  Run with
+ * the client option -bench to print the timings; otherwise we do fewer
+ * lookups and just check the results.
+ */
+#define BENCH_LOOKUPS (1 << 22)
+
+static void
+bench_hashtables(bool print)
+{
+    hashtable_t table;
+    oahashtable_t oatable;
+    uint num_keys, i;
+    uint num_lookups = print ? BENCH_LOOKUPS : BENCH_LOOKUPS / 64;
+    uint64 start, add_time, lookup_time, oa_add_time, oa_lookup_time;
+    uintptr_t found;
+    for (num_keys = 1 << 10; num_keys <= 1 << 18; num_keys <<= 4) {
+        hashtable_init_ex(&table, 10, HASH_INTPTR, false/*!str_dup*/, true/*synch*/,
+                          NULL, NULL, NULL);
+        oahashtable_init_ex(&oatable, 10, HASH_INTPTR, true/*synch*/, NULL, NULL, NULL);
+
+        start = dr_get_microseconds();
+        for (i = 0; i < num_keys; i++)
+            hashtable_add(&table, (void *)(0x10000 + (uintptr_t)i * 16), (void *)1);
+        add_time = dr_get_microseconds() - start;
+        start = dr_get_microseconds();
+        for (i = 0, found = 0; i < num_lookups; i++) {
+            /* A stride coprime with num_keys visits keys out of order */
+            uintptr_t key = 0x10000 + (uintptr_t)((i * 40503) % num_keys) * 16;
+            found += (uintptr_t)hashtable_lookup(&table, (void *)key);
+        }
+        lookup_time = dr_get_microseconds() - start;
+        CHECK(found == num_lookups, "hashtable lookups failed");
+
+        start = dr_get_microseconds();
+        for (i = 0; i < num_keys; i++)
+            oahashtable_add(&oatable, (void *)(0x10000 + (uintptr_t)i * 16), (void *)1);
+        oa_add_time = dr_get_microseconds() - start;
+        start = dr_get_microseconds();
+        for (i = 0, found = 0; i < num_lookups; i++) {
+            uintptr_t key = 0x10000 + (uintptr_t)((i * 40503) % num_keys) * 16;
+            found += (uintptr_t)oahashtable_lookup(&oatable, (void *)key);
+        }
+        oa_lookup_time = dr_get_microseconds() - start;
+        CHECK(found == num_lookups, "oahashtable lookups failed");
+
+        if (print) {
+            dr_fprintf(STDERR, "%6d keys: add %6d vs %6d us, %d lookups %7d vs %7d us\n",
+                       num_keys, (int)add_time, (int)oa_add_time, num_lookups,
+                       (int)lookup_time, (int)oa_lookup_time);
+        }
+        hashtable_delete(&table);
+        oahashtable_delete(&oatable);
+    }
+}
+
 DR_EXPORT void
 dr_init(client_id_t id)
 {
+    bool bench = strstr(dr_get_options(id), "-bench") != NULL;
+
     test_vector();
+    test_vector_segmented();
     test_hashtable_apply_all();
+    test_oahashtable();
+    bench_hashtables(bench);
 
     /* XXX: test other data structures */
 }
@@ -0,0 +1,113 @@
+/* **********************************************************
+ * Copyright (c) 2018 Google, Inc.  All rights reserved.
+ * **********************************************************/
+
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * * Redistributions of source code must retain the above copyright notice,
+ *   this list of conditions and the following disclaimer.
+ *
+ * * Redistributions in binary form must reproduce the above copyright notice,
+ *   this list of conditions and the following disclaimer in the documentation
+ *   and/or other materials provided with the distribution.
+ *
+ * * Neither the name of Google, Inc. nor the names of its contributors may be
+ *   used to endorse or promote products derived from this software without
+ *   specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL VMWARE, INC. OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH
+ * DAMAGE.
+ */
+
+/* Tests drcovlib's incremental dumps and shared coverage map. */
+
+#include "dr_api.h"
+#include "drcovlib.h"
+#include "drx.h"
+#include "client_tools.h"
+#include <string.h>
+
+#define CHECK(x, msg) do {               \
+    if (!(x)) {                          \
+        dr_fprintf(STDERR, "CHECK failed %s:%d: %s\n", __FILE__, __LINE__, msg); \
+        dr_abort();                      \
+    }                                    \
+} while (0);
+
+#define MAP_SLOTS 4096
+
+static char cwd[MAXIMUM_PATH];
+static char map_path[MAXIMUM_PATH];
+static uint *map;
+
+static uint
+dump_delta(void)
+{
+    char fname[MAXIMUM_PATH];
+    char buf[64];
+    uint num_bbs;
+    file_t f = drx_open_unique_file(cwd, "drcovlib-delta", "log", 0,
+                                    fname, BUFFER_SIZE_ELEMENTS(fname));
+    CHECK(f != INVALID_FILE, "drx_open_unique_file failed");
+    CHECK(drcovlib_dump_delta(f, &num_bbs) == DRCOVLIB_SUCCESS, "delta dump failed");
+    dr_close_file(f);
+    /* The delta is a regular log file. */
+    f = dr_open_file(fname, DR_FILE_READ);
+    CHECK(f != INVALID_FILE, "failed to open delta");
+    CHECK(dr_read_file(f, buf, sizeof(buf)) == sizeof(buf), "failed to read delta");
+    CHECK(strncmp(buf, "DRCOV VERSION", strlen("DRCOV VERSION")) == 0,
+          "delta is missing the header");
+    dr_close_file(f);
+    CHECK(dr_delete_file(fname), "failed to delete delta");
+    return num_bbs;
+}
+
+static void
+event_exit(void)
+{
+    char logname[MAXIMUM_PATH];
+    const char *path;
+    uint i, total = 0;
+
+    CHECK(dump_delta() > 0, "first delta should hold the app's blocks");
+    /* Nothing has executed since. */
+    CHECK(dump_delta() == 0, "second delta should be empty");
+
+    for (i = 0; i < MAP_SLOTS; i++)
+        total += map[i];
+    CHECK(total > 0, "shared map was not updated");
+
+    CHECK(drcovlib_logfile(NULL, &path) == DRCOVLIB_SUCCESS, "no log file");
+    dr_snprintf(logname, BUFFER_SIZE_ELEMENTS(logname), "%s", path);
+    NULL_TERMINATE_BUFFER(logname);
+    CHECK(drcovlib_exit() == DRCOVLIB_SUCCESS, "drcovlib exit failed");
+    CHECK(dr_delete_file(logname), "failed to delete log");
+    CHECK(dr_delete_file(map_path), "failed to delete map");
+}
+
+DR_EXPORT void
+dr_init(client_id_t id)
+{
+    drcovlib_options_t ops = {sizeof(ops),};
+    bool ok = dr_get_current_directory(cwd, BUFFER_SIZE_ELEMENTS(cwd));
+    CHECK(ok, "dr_get_current_directory failed");
+    ops.logdir = cwd;
+    CHECK(drcovlib_init(&ops) == DRCOVLIB_SUCCESS, "drcovlib init failed");
+    dr_snprintf(map_path, BUFFER_SIZE_ELEMENTS(map_path), "%s/drcovlib-delta.%d.map",
+                cwd, dr_get_process_id());
+    NULL_TERMINATE_BUFFER(map_path);
+    CHECK(drcovlib_shared_map_create(map_path, MAP_SLOTS, &map) == DRCOVLIB_SUCCESS,
+          "shared map creation failed");
+    dr_register_exit_event(event_exit);
+}
@@ -51,6 +51,7 @@
  * check preservation
  */
 static int tls_idx;
+static int fast_tls_idx;
 static int cls_idx;
 static thread_id_t main_thread;
 static int cb_depth;
@@ -80,9 +81,11 @@ static uint one_time_exec;
 #define MAGIC_NUMBER_FROM_CACHE 0x0eadbeef
 
 static bool checked_tls_from_cache;
+static bool checked_fast_tls_from_cache;
 static bool checked_cls_from_cache;
 static bool checked_tls_write_from_cache;
 static bool checked_cls_write_from_cache;
+static uint memref_filter_calls;
 
 static void event_exit(void);
 static void event_thread_init(void *drcontext);
@@ -114,6 +117,10 @@ static dr_emit_flags_t event_bb_analysis(void *drcontext, void *tag, instrlist_t
 static dr_emit_flags_t event_bb_insert(void *drcontext, void *tag, instrlist_t *bb,
                                        instr_t *inst, bool for_trace, bool translating,
                                        void *user_data);
+static dr_emit_flags_t event_bb_insert_memref(void *drcontext, void *tag,
+                                              instrlist_t *bb, instr_t *inst,
+                                              bool for_trace, bool translating,
+                                              void *user_data);
 
 static dr_emit_flags_t event_bb4_app2app(void *drcontext, void *tag, instrlist_t *bb,
                                          bool for_trace, bool translating,
@@ -179,6 +186,8 @@ dr_init(client_id_t id)
     bool ok;
 
     drmgr_init();
+    ok = drmgr_enable_pass_stats(true);
+    CHECK(ok, "drmgr_enable_pass_stats failed");
     dr_register_exit_event(event_exit);
     drmgr_register_thread_init_event(event_thread_init);
     drmgr_register_thread_exit_event(event_thread_exit);
@@ -202,6 +211,15 @@ dr_init(client_id_t id)
                                                  &priority);
     CHECK(ok, "drmgr register bb failed");
 
+    /* check an insertion pass restricted to memory references */
+    ok = drmgr_register_bb_instrumentation_event(NULL, event_bb_insert_memref, NULL);
+    CHECK(ok, "drmgr register memref bb failed");
+    ok = drmgr_set_insertion_instr_filter(event_bb_insert_memref,
+                                          DRMGR_INSTR_FILTER_MEMREF);
+    CHECK(ok, "drmgr_set_insertion_instr_filter failed");
+    ok = drmgr_set_insertion_instr_filter(event_bb4_insert2, DRMGR_INSTR_FILTER_CTI);
+    CHECK(!ok, "drmgr_set_insertion_instr_filter should fail if unregistered");
+
     /* check register/unregister instrumentation_ex */
     ok = drmgr_register_bb_instrumentation_ex_event(event_bb4_app2app,
                                                     event_bb4_analysis,
@@ -230,6 +248,8 @@ dr_init(client_id_t id)
 
     tls_idx = drmgr_register_tls_field();
     CHECK(tls_idx != -1, "drmgr_register_tls_field failed");
+    fast_tls_idx = drmgr_register_fast_tls_field();
+    CHECK(fast_tls_idx != -1, "drmgr_register_fast_tls_field failed");
     cls_idx = drmgr_register_cls_field(event_thread_context_init,
                                        event_thread_context_exit);
     CHECK(cls_idx != -1, "drmgr_register_tls_field failed");
@@ -268,16 +288,37 @@ dr_init(client_id_t id)
     CHECK(ok, "drmgr_register_kernel_xfer_event_ex failed");
 }
 
+static void
+check_pass_stats(void)
+{
+    drmgr_pass_stats_t stats;
+    uint i;
+    bool found = false;
+    stats.struct_size = sizeof(stats);
+    for (i = 0; drmgr_get_pass_stats(i, &stats); i++) {
+        if (strcmp(stats.name, "drmgr-test") == 0) {
+            found = true;
+            CHECK(stats.phase == DRMGR_PHASE_INSERTION, "wrong pass stats phase");
+            CHECK(stats.bb_count > 0, "pass stats missed bbs");
+            CHECK(stats.app_instrs >= stats.bb_count, "pass stats missed app instrs");
+        }
+    }
+    CHECK(found, "drmgr-test pass stats not found");
+}
+
 static void
 event_exit(void)
 {
+    check_pass_stats();
     dr_mutex_destroy(syslock);
     dr_mutex_destroy(threadlock);
     CHECK(checked_tls_from_cache, "failed to hit clean call");
+    CHECK(checked_fast_tls_from_cache, "failed to hit clean call");
     CHECK(checked_cls_from_cache, "failed to hit clean call");
     CHECK(checked_tls_write_from_cache, "failed to hit clean call");
     CHECK(checked_cls_write_from_cache, "failed to hit clean call");
     CHECK(one_time_exec == 1, "failed to execute one-time event");
+    CHECK(memref_filter_calls > 0, "filtered insertion pass never called");
 
     if (thread_exit_events > 0)
         dr_fprintf(STDERR, "saw event_thread_exit\n");
@@ -295,6 +336,8 @@ event_exit(void)
 
     if (!drmgr_unregister_bb_instrumentation_event(event_bb_analysis))
         CHECK(false, "drmgr unregistration failed");
+    if (!drmgr_unregister_bb_insertion_event(event_bb_insert_memref))
+        CHECK(false, "drmgr unregistration failed");
 
     if (!drmgr_unregister_bb_instrumentation_ex_event(event_bb4_app2app,
                                                       event_bb4_analysis,
@@ -325,6 +368,10 @@ event_thread_init(void *drcontext)
         main_thread = dr_get_thread_id(drcontext);
     drmgr_set_tls_field(drcontext, tls_idx,
                         (void *)(ptr_int_t)dr_get_thread_id(drcontext));
+    CHECK(drmgr_get_tls_field(drcontext, fast_tls_idx) == NULL,
+          "fast tls not initialized");
+    drmgr_set_tls_field(drcontext, fast_tls_idx,
+                        (void *)(ptr_int_t)dr_get_thread_id(drcontext));
     if (!in_event_thread_init) {
         dr_mutex_lock(threadlock);
         if (!in_event_thread_init) {
@@ -486,6 +533,14 @@ check_tls_from_cache(void *tls_val)
     checked_tls_from_cache = true;
 }
 
+static void
+check_fast_tls_from_cache(void *tls_val)
+{
+    CHECK(tls_val == drmgr_get_tls_field(dr_get_current_drcontext(), fast_tls_idx),
+          "fast tls read from cache incorrect");
+    checked_fast_tls_from_cache = true;
+}
+
 static void
 check_cls_from_cache(void *cls_val)
 {
@@ -541,6 +596,9 @@ event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
         drmgr_insert_read_tls_field(drcontext, tls_idx, bb, inst, reg1);
         dr_insert_clean_call(drcontext, bb, inst, (void *)check_tls_from_cache,
                              false, 1, opnd_create_reg(reg1));
+        drmgr_insert_read_tls_field(drcontext, fast_tls_idx, bb, inst, reg1);
+        dr_insert_clean_call(drcontext, bb, inst, (void *)check_fast_tls_from_cache,
+                             false, 1, opnd_create_reg(reg1));
         drmgr_insert_read_cls_field(drcontext, cls_idx, bb, inst, reg1);
         dr_insert_clean_call(drcontext, bb, inst, (void *)check_cls_from_cache,
                              false, 1, opnd_create_reg(reg1));
@@ -566,6 +624,18 @@ event_bb_insert(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
     return DR_EMIT_DEFAULT;
 }
 
+static dr_emit_flags_t
+event_bb_insert_memref(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst,
+                       bool for_trace, bool translating, void *user_data)
+{
+    CHECK(instr_is_app(inst) &&
+          (instr_reads_memory(inst) || instr_writes_memory(inst)),
+          "filtered insertion pass called for non-memref");
+    /* assumes DR serializes bb events */
+    memref_filter_calls++;
+    return DR_EMIT_DEFAULT;
+}
+
 /* test data passed among all 4 phases */
 static dr_emit_flags_t
 event_bb4_app2app(void *drcontext, void *tag, instrlist_t *bb,
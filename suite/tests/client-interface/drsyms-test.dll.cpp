@@ -220,6 +220,45 @@ post_func(void *wrapcxt, void *user_data)
 {
 }
 
+/* Looks up both offsets with one drsym_lookup_addresses() call and checks the
+ * results against individual drsym_lookup_address() calls.
+ */
+static void
+lookup_addresses_batch(const char *modpath, size_t offs_a, size_t offs_b)
+{
+    size_t offs[2] = {offs_a, offs_b};
+    drsym_info_t infos[2];
+    drsym_error_t results[2];
+    char names[2][MAX_FUNC_LEN];
+    drsym_error_t r;
+    int i;
+    for (i = 0; i < 2; i++) {
+        infos[i].struct_size = sizeof(infos[i]);
+        infos[i].name = names[i];
+        infos[i].name_size = MAX_FUNC_LEN;
+        infos[i].file = NULL;
+        infos[i].file_size = 0;
+    }
+    r = drsym_lookup_addresses(modpath, offs, 2, infos, results, DRSYM_DEFAULT_FLAGS);
+    ASSERT(r == DRSYM_SUCCESS);
+    for (i = 0; i < 2; i++) {
+        drsym_info_t single;
+        char name[MAX_FUNC_LEN];
+        single.struct_size = sizeof(single);
+        single.name = name;
+        single.name_size = MAX_FUNC_LEN;
+        single.file = NULL;
+        single.file_size = 0;
+        r = drsym_lookup_address(modpath, offs[i], &single, DRSYM_DEFAULT_FLAGS);
+        ASSERT(r == results[i]);
+        ASSERT(r == DRSYM_SUCCESS || r == DRSYM_ERROR_LINE_NOT_AVAILABLE);
+        ASSERT(infos[i].start_offs == single.start_offs);
+        ASSERT(strcmp(infos[i].name, single.name) == 0);
+    }
+    r = drsym_lookup_addresses(NULL, offs, 2, infos, results, DRSYM_DEFAULT_FLAGS);
+    ASSERT(r == DRSYM_ERROR_INVALID_PARAMETER);
+}
+
 /* Use dr_get_proc_addr to get the exported address of a symbol.  Attempt to
  * look through any export table jumps so that we get the address for the
  * symbol that would be returned by looking at debug information.
@@ -316,8 +355,12 @@ lookup_exe_syms(void)
     /* exe_public is a function in the exe we wouldn't be able to find without
      * drsyms and debug info.
      */
-    (void)lookup_and_wrap(exe_path, exe_base, appbase,
-                          "exe_public", DRSYM_DEFAULT_FLAGS);
+    exe_public_offs = lookup_and_wrap(exe_path, exe_base, appbase,
+                                      "exe_public", DRSYM_DEFAULT_FLAGS);
+
+    /* Test batch lookup, with the offsets in both orders. */
+    lookup_addresses_batch(exe_path, exe_export_offs, exe_public_offs);
+    lookup_addresses_batch(exe_path, exe_public_offs, exe_export_offs);
 
     /* Test symbol not found error handling. */
     r = drsym_lookup_symbol(exe_path, "nonexistent_sym", &exe_public_offs,
@@ -848,39 +891,45 @@ enum_syms_with_flags(const char *dll_path, const char **syms_expected,
             dr_fprintf(STDERR, "_ex failed to find symbol for %s!\n", dll_syms[i]);
     }
 
-#ifdef WINDOWS
-    if (TEST(DRSYM_PDB, debug_kind)) {
-        /* drsym_search_symbols should find the same symbols with the short
-         * mangling, regardless of the flags used by the previous enumerations.
-         */
-        memset(&syms_found, 0, sizeof(syms_found));
-        syms_found.syms_expected = dll_syms_short_pdb;
-        r = drsym_search_symbols(dll_path, "*!*dll_*", false, enum_sym_cb,
-                                 &syms_found);
-        ASSERT(r == DRSYM_SUCCESS);
-        r = drsym_search_symbols(dll_path, "*!*stack_trace*", false, enum_sym_cb,
-                                 &syms_found);
-        ASSERT(r == DRSYM_SUCCESS);
-        for (i = 0; i < BUFFER_SIZE_ELEMENTS(syms_found.syms_found); i++) {
-            if (!syms_found.syms_found[i])
-                dr_fprintf(STDERR, "search failed to find %s!\n", dll_syms[i]);
-        }
+    /* drsym_search_symbols should find the same symbols with the short
+     * mangling, regardless of the flags used by the previous enumerations.
+     * Outside of PDB we use literal prefixes to exercise the name index.
+     */
+    bool pdb = TEST(DRSYM_PDB, debug_kind);
+    memset(&syms_found, 0, sizeof(syms_found));
+    syms_found.syms_expected = pdb ? dll_syms_short_pdb : dll_syms_short;
+    r = drsym_search_symbols(dll_path, pdb ? "*!*dll_*" : "*!dll_*", false,
+                             enum_sym_cb, &syms_found);
+    ASSERT(r == DRSYM_SUCCESS);
+    r = drsym_search_symbols(dll_path, pdb ? "*!*stack_trace*" : "*!stack_t?ace*",
+                             false, enum_sym_cb, &syms_found);
+    ASSERT(r == DRSYM_SUCCESS);
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(syms_found.syms_found); i++) {
+        if (!syms_found.syms_found[i])
+            dr_fprintf(STDERR, "search failed to find %s!\n", dll_syms[i]);
+    }
 
-        /* Test the _ex version */
-        memset(&syms_found, 0, sizeof(syms_found));
-        syms_found.dll_path = dll_path;
-        r = drsym_search_symbols_ex(dll_path, "*!*dll_*", DRSYM_DEMANGLE, enum_sym_ex_cb,
-                                    sizeof(drsym_info_t), &syms_found);
-        ASSERT(r == DRSYM_SUCCESS && !syms_found.prev_mismatch);
-        r = drsym_search_symbols_ex(dll_path, "*!*stack_trace*", DRSYM_DEMANGLE,
-                                    enum_sym_ex_cb, sizeof(drsym_info_t), &syms_found);
-        ASSERT(r == DRSYM_SUCCESS && !syms_found.prev_mismatch);
-        for (i = 0; i < BUFFER_SIZE_ELEMENTS(syms_found.syms_found); i++) {
-            if (!syms_found.syms_found[i])
-                dr_fprintf(STDERR, "search _ex failed to find %s!\n", dll_syms[i]);
-        }
+    /* Test the _ex version.  Outside of PDB the flags are honored, so we
+     * search with those of the enumerations above.
+     */
+    memset(&syms_found, 0, sizeof(syms_found));
+    syms_found.dll_path = dll_path;
+    uint search_flags = pdb ? DRSYM_DEMANGLE : flags;
+    if (!pdb)
+        syms_found.flags_expected = flags;
+    r = drsym_search_symbols_ex(dll_path, "*!*dll_*", search_flags, enum_sym_ex_cb,
+                                sizeof(drsym_info_t), &syms_found);
+    ASSERT(r == DRSYM_SUCCESS && !syms_found.prev_mismatch);
+    r = drsym_search_symbols_ex(dll_path, "*!*stack_trace*", search_flags,
+                                enum_sym_ex_cb, sizeof(drsym_info_t), &syms_found);
+    ASSERT(r == DRSYM_SUCCESS && !syms_found.prev_mismatch);
+    for (i = 0; i < BUFFER_SIZE_ELEMENTS(syms_found.syms_found); i++) {
+        if (!syms_found.syms_found[i])
+            dr_fprintf(STDERR, "search _ex failed to find %s!\n", dll_syms[i]);
     }
-#endif
+    r = drsym_search_symbols(dll_path, "*!dll_nonexistent_sym*", false, enum_sym_cb,
+                             &syms_found);
+    ASSERT(r == DRSYM_ERROR_SYMBOL_NOT_FOUND || (pdb && r == DRSYM_SUCCESS));
 }
 
 
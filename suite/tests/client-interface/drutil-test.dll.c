@@ -63,6 +63,42 @@ static dr_emit_flags_t event_bb_insert(void *drcontext, void *tag, instrlist_t *
                                        instr_t *inst, bool for_trace, bool translating,
                                        void *user_data);
 
+static void
+test_mem_addr_offset(void)
+{
+    void *drcontext = GLOBAL_DCONTEXT;
+    reg_id_t base = IF_X86_ELSE(DR_REG_XBX, DR_REG_R2);
+    reg_id_t val = IF_X86_ELSE(DR_REG_XCX, DR_REG_R3);
+    reg_id_t dst = IF_X86_ELSE(DR_REG_XAX, DR_REG_R0);
+    instrlist_t *ilist = instrlist_create(drcontext);
+    instr_t *first = XINST_CREATE_store(drcontext, OPND_CREATE_MEMPTR(base, 8),
+                                        opnd_create_reg(val));
+    instr_t *second = XINST_CREATE_store(drcontext, OPND_CREATE_MEMPTR(base, 24),
+                                         opnd_create_reg(val));
+    instr_t *clobber = XINST_CREATE_load_int(drcontext, opnd_create_reg(base),
+                                             OPND_CREATE_INT(1));
+    instr_t *third = XINST_CREATE_store(drcontext, OPND_CREATE_MEMPTR(base, 0),
+                                        opnd_create_reg(val));
+    ptr_int_t offset;
+    instrlist_append(ilist, first);
+    instrlist_append(ilist, second);
+    instrlist_append(ilist, clobber);
+    instrlist_append(ilist, third);
+    CHECK(drutil_mem_addr_offset(first, instr_get_dst(first, 0),
+                                 second, instr_get_dst(second, 0), &offset) &&
+          offset == 16, "drutil_mem_addr_offset failed");
+    CHECK(drutil_insert_get_mem_addr_from_base(drcontext, ilist, second, dst, offset,
+                                               dst),
+          "drutil_insert_get_mem_addr_from_base failed");
+    CHECK(!drutil_mem_addr_offset(second, instr_get_dst(second, 0),
+                                  first, instr_get_dst(first, 0), &offset),
+          "drutil_mem_addr_offset should fail backward");
+    CHECK(!drutil_mem_addr_offset(first, instr_get_dst(first, 0),
+                                  third, instr_get_dst(third, 0), &offset),
+          "drutil_mem_addr_offset missed a base register write");
+    instrlist_clear_and_destroy(drcontext, ilist);
+}
+
 DR_EXPORT void
 dr_init(client_id_t id)
 {
@@ -80,6 +116,8 @@ dr_init(client_id_t id)
                                                  event_bb_insert,
                                                  &priority);
     CHECK(ok, "drmgr register bb failed");
+
+    test_mem_addr_offset();
 }
 
 static void
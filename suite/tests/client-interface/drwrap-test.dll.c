@@ -56,8 +56,12 @@ static void wrap_unwindtest_seh_post(void *wrapcxt, void *user_data);
 static int replacewith(int *x);
 static int replacewith2(int *x);
 static int replace_callsite(int *x);
+static void inline_pre_skip_flags(reg_t arg0, reg_t arg1);
+static void inline_pre_runlots(void);
 
 static uint load_count;
+static uint inline_skip_flags_count;
+static uint inline_runlots_count;
 static bool repeated = false;
 static ptr_uint_t repeat_xsp;
 #ifdef ARM
@@ -158,6 +162,10 @@ module_load_event(void *drcontext, const module_data_t *mod, bool loaded)
         ok = drwrap_replace_native(addr_replace2, (app_pc) replacewith2, true/*at entry*/,
                                    0, (void *)(ptr_int_t)DRWRAP_NATIVE_PARAM, false);
         CHECK(ok, "replace_native failed");
+        /* An identical request with override should succeed w/o a flush */
+        ok = drwrap_replace_native(addr_replace2, (app_pc) replacewith2, true/*at entry*/,
+                                   0, (void *)(ptr_int_t)DRWRAP_NATIVE_PARAM, true);
+        CHECK(ok, "identical replace_native failed");
 
         init_pc = (app_pc) dr_get_proc_address(mod->handle, "replace_callsite");
         CHECK(init_pc != NULL, "cannot find lib export");
@@ -185,9 +193,32 @@ module_load_event(void *drcontext, const module_data_t *mod, bool loaded)
         CHECK(ok, "replace_native failed");
         instr_free(drcontext, &inst);
 
-        wrap_addr(&addr_level0, "level0", mod, true, true);
-        wrap_addr(&addr_level1, "level1", mod, true, true);
-        wrap_addr(&addr_level2, "level2", mod, true, true);
+        /* test batch wrapping */
+        {
+            drwrap_wrap_info_t wraps[3];
+            bool results[3];
+            int i;
+            addr_level0 = (app_pc) dr_get_proc_address(mod->handle, "level0");
+            addr_level1 = (app_pc) dr_get_proc_address(mod->handle, "level1");
+            addr_level2 = (app_pc) dr_get_proc_address(mod->handle, "level2");
+            CHECK(addr_level0 != NULL && addr_level1 != NULL && addr_level2 != NULL,
+                  "cannot find lib export");
+            wraps[0].func = addr_level0;
+            wraps[1].func = addr_level1;
+            wraps[2].func = addr_level2;
+            for (i = 0; i < 3; i++) {
+                wraps[i].pre_func_cb = wrap_pre;
+                wraps[i].post_func_cb = wrap_post;
+                wraps[i].user_data = NULL;
+                wraps[i].flags = 0;
+            }
+            CHECK(drwrap_wrap_batch(wraps, 3, results) == 3, "wrap_batch failed");
+            for (i = 0; i < 3; i++) {
+                CHECK(results[i], "wrap_batch failed");
+                CHECK(drwrap_is_wrapped(wraps[i].func, wrap_pre, wrap_post),
+                      "drwrap_is_wrapped query failed");
+            }
+        }
         wrap_addr(&addr_tailcall, "makes_tailcall", mod, true, true);
         wrap_addr(&addr_skipme, "skipme", mod, true, true);
         wrap_addr(&addr_repeat, "repeatme", mod, true, true);
@@ -232,6 +263,13 @@ module_load_event(void *drcontext, const module_data_t *mod, bool loaded)
         if (load_count == 2)
             drwrap_set_global_flags(DRWRAP_NO_FRILLS | DRWRAP_FAST_CLEANCALLS);
         wrap_addr(&addr_skip_flags, "skip_flags", mod, true, false);
+
+        /* test lightweight pre-hooks */
+        ok = drwrap_wrap_pre_inline(addr_skip_flags, (void *)inline_pre_skip_flags,
+                                    2, 0);
+        CHECK(ok, "wrap_pre_inline failed");
+        ok = drwrap_wrap_pre_inline(addr_runlots, (void *)inline_pre_runlots, 0, 0);
+        CHECK(ok, "wrap_pre_inline failed");
     }
 }
 
@@ -249,6 +287,12 @@ module_unload_event(void *drcontext, const module_data_t *mod)
         CHECK(ok, "un-replace_native failed");
 
         unwrap_addr(addr_skip_flags, "skip_flags", mod, true, false);
+        ok = drwrap_unwrap_pre_inline(addr_skip_flags, (void *)inline_pre_skip_flags);
+        CHECK(ok, "unwrap_pre_inline failed");
+        ok = drwrap_unwrap_pre_inline(addr_runlots, (void *)inline_pre_runlots);
+        CHECK(ok, "unwrap_pre_inline failed");
+        ok = drwrap_unwrap_pre_inline(addr_runlots, (void *)inline_pre_runlots);
+        CHECK(!ok, "unwrap_pre_inline should fail");
         unwrap_addr(addr_level0, "level0", mod, true, true);
         unwrap_addr(addr_level1, "level1", mod, true, true);
         unwrap_addr(addr_level2, "level2", mod, true, true);
@@ -301,12 +345,28 @@ dr_init(client_id_t id)
 static void
 event_exit(void)
 {
+    /* skip_flags is called once and runlots 2048 times per load */
+    CHECK(inline_skip_flags_count == 2, "inline pre-hook miscount");
+    CHECK(inline_runlots_count == 2 * 2048, "inline pre-hook miscount");
     drmgr_unregister_tls_field(tls_idx);
     drwrap_exit();
     drmgr_exit();
     dr_fprintf(STDERR, "all done\n");
 }
 
+static void
+inline_pre_skip_flags(reg_t arg0, reg_t arg1)
+{
+    if ((int)arg0 == 1 && (int)arg1 == 2)
+        inline_skip_flags_count++;
+}
+
+static void
+inline_pre_runlots(void)
+{
+    inline_runlots_count++;
+}
+
 static int
 replacewith(int *x)
 {
@@ -54,9 +54,21 @@ static uint counterC;
 static uint counterD;
 #endif
 
+static drx_workq_t *workq;
+static int work_submitted;
+static int work_done;
+
+static drx_defer_t *defer;
+static int deferred_calls;
+
 static void
 event_exit(void)
 {
+    CHECK(drx_workq_wait(workq), "drx_workq_wait failed");
+    CHECK(work_done == work_submitted, "work queue lost work");
+    CHECK(drx_workq_destroy(workq), "drx_workq_destroy failed");
+    CHECK(drx_defer_destroy(defer), "drx_defer_destroy failed");
+    CHECK(deferred_calls > 0, "deferred calls never delivered");
     drx_exit();
     CHECK(counterB == 2*counterA, "counter inc messed up");
 #if defined(ARM)
@@ -87,12 +99,44 @@ event_soft_kill(process_id_t pid, int exit_code)
     return true; /* skip kill */
 }
 
+static void
+do_work(void *drcontext, void *arg)
+{
+    dr_atomic_add32_return_sum(&work_done, (int)(ptr_int_t)arg);
+}
+
+static void
+deferred_call(void *drcontext, ptr_uint_t *args)
+{
+    CHECK(args[0] == 1 && args[1] == (ptr_uint_t)&deferred_calls,
+          "deferred call args incorrect");
+    dr_atomic_add32_return_sum(&deferred_calls, 1);
+}
+
 static dr_emit_flags_t
 event_basic_block(void *drcontext, void *tag, instrlist_t *bb,
                   bool for_trace, bool translating)
 {
     instr_t *first = instrlist_first_app(bb);
     instr_t *last;
+    if (!translating) {
+        /* Exercise offloading work from app threads */
+        dr_atomic_add32_return_sum(&work_submitted, 1);
+        CHECK(drx_workq_submit(workq, do_work, (void *)1), "drx_workq_submit failed");
+    }
+    /* Exercise recording a deferred call */
+    dr_save_reg(drcontext, bb, first, IF_X86_ELSE(DR_REG_XAX, DR_REG_R0), SPILL_SLOT_3);
+    dr_save_reg(drcontext, bb, first, IF_X86_ELSE(DR_REG_XDX, DR_REG_R1), SPILL_SLOT_4);
+    CHECK(drx_defer_insert_call(drcontext, defer, bb, first,
+                                IF_X86_ELSE(DR_REG_XAX, DR_REG_R0),
+                                IF_X86_ELSE(DR_REG_XDX, DR_REG_R1), 2,
+                                OPND_CREATE_INTPTR(1),
+                                OPND_CREATE_INTPTR(&deferred_calls)),
+          "drx_defer_insert_call failed");
+    dr_restore_reg(drcontext, bb, first, IF_X86_ELSE(DR_REG_XDX, DR_REG_R1),
+                   SPILL_SLOT_4);
+    dr_restore_reg(drcontext, bb, first, IF_X86_ELSE(DR_REG_XAX, DR_REG_R0),
+                   SPILL_SLOT_3);
     /* Exercise drx's adjacent increment aflags spill removal code */
     drx_insert_counter_update(drcontext, bb, first,
                               SPILL_SLOT_1, IF_NOT_X86_(SPILL_SLOT_2)
@@ -186,6 +230,10 @@ dr_init(client_id_t id)
     bool ok = drx_init();
     client_id = id;
     CHECK(ok, "drx_init failed");
+    workq = drx_workq_create(2);
+    CHECK(workq != NULL, "drx_workq_create failed");
+    defer = drx_defer_create(deferred_call, 2, 64, DRX_DEFER_FLUSH_SYSCALL);
+    CHECK(defer != NULL, "drx_defer_create failed");
     dr_register_exit_event(event_exit);
     drx_register_soft_kills(event_soft_kill);
     dr_register_nudge_event(event_nudge, id);
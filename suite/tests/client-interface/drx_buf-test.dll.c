@@ -68,7 +68,9 @@ static const char test_null[TRACE_SZ];
 static drx_buf_t *circular_fast;
 static drx_buf_t *circular_slow;
 static drx_buf_t *trace;
+static drx_buf_t *async_trace;
 static volatile int num_faults;
+static volatile int num_async_full;
 
 static void
 event_thread_init(void *drcontext)
@@ -86,6 +88,8 @@ event_thread_init(void *drcontext)
 
     buf_base = drx_buf_get_buffer_base(drcontext, trace);
     memset(buf_base, 0, TRACE_SZ);
+    buf_base = drx_buf_get_buffer_base(drcontext, async_trace);
+    memset(buf_base, 0, TRACE_SZ);
 }
 
 static void
@@ -117,6 +121,16 @@ verify_trace_buffer(void *drcontext, void *buf_base, size_t size)
     dr_atomic_add32_return_sum(&num_faults, 1);
 }
 
+static void
+verify_async_trace_buffer(void *drcontext, void *buf_base, size_t size)
+{
+    /* Only full buffers are handed off: the pointer is back at the base of
+     * the next buffer by thread exit.
+     */
+    CHECK(size == TRACE_SZ, "async trace buffer has wrong size");
+    dr_atomic_add32_return_sum(&num_async_full, 1);
+}
+
 static void
 verify_store(drx_buf_t *client)
 {
@@ -274,6 +288,36 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst
         /* the buffer is now clean */
         dr_insert_clean_call(drcontext, bb, inst, verify_buffers_empty, false, 1,
                              OPND_CREATE_INTPTR(trace));
+        /* the same for the asynchronous trace buffer, which moves on to its
+         * next buffer on the fault
+         */
+        /* test to make sure that on first invocation, the buffer is empty */
+        dr_insert_clean_call(drcontext, bb, inst, verify_buffers_empty, false, 1,
+                             OPND_CREATE_INTPTR(async_trace));
+
+        /* load the buf pointer, and then write an element to the buffer */
+        drx_buf_insert_load_buf_ptr(drcontext, async_trace, bb, inst, reg_ptr);
+        drx_buf_insert_buf_store(drcontext, circular_fast, bb, inst, reg_ptr,
+                                 DR_REG_NULL, opnd_create_reg(scratch), OPSZ_4, 0);
+        drx_buf_insert_update_buf_ptr(drcontext, async_trace, bb, inst, reg_ptr,
+                                      DR_REG_NULL, sizeof(int));
+
+        /* verify the buffer was written to */
+        dr_insert_clean_call(drcontext, bb, inst, verify_buffers_dirty, false, 2,
+                             OPND_CREATE_INTPTR(async_trace),
+                             opnd_create_reg(scratch));
+
+        /* trace buffer: trigger a fault and verify */
+        drx_buf_insert_load_buf_ptr(drcontext, async_trace, bb, inst, reg_ptr);
+        drx_buf_insert_update_buf_ptr(drcontext, async_trace, bb, inst, reg_ptr,
+                                      DR_REG_NULL, TRACE_SZ - sizeof(int));
+        /* the "trigger" is a write, so we write whatever garbage is in reg_tmp */
+        drx_buf_insert_buf_store(drcontext, circular_fast, bb, inst, reg_ptr,
+                                 DR_REG_NULL, opnd_create_reg(scratch), OPSZ_4, 0);
+
+        /* the buffer is now clean */
+        dr_insert_clean_call(drcontext, bb, inst, verify_buffers_empty, false, 1,
+                             OPND_CREATE_INTPTR(async_trace));
     } else if (subtest == DRX_BUF_TEST_4_C) {
         /* test immediate store: 8 bytes (if possible), 4 bytes, 2 bytes and 1 byte */
         /* "ABCDEFGH\x00" (x2 for x64) */
@@ -435,6 +479,10 @@ event_exit(void)
     drx_buf_free(circular_fast);
     drx_buf_free(circular_slow);
     drx_buf_free(trace);
+    /* Freeing waits for the consumer to process every queued buffer. */
+    drx_buf_get_stall_time(async_trace);
+    drx_buf_free(async_trace);
+    CHECK(num_async_full > 0, "async trace buffer never handed off");
     drmgr_unregister_thread_init_event(event_thread_init);
     drmgr_exit();
     drx_exit();
@@ -451,9 +499,12 @@ dr_init(client_id_t id)
     circular_fast = drx_buf_create_circular_buffer(DRX_BUF_FAST_CIRCULAR_BUFSZ);
     circular_slow = drx_buf_create_circular_buffer(CIRCULAR_SLOW_SZ);
     trace         = drx_buf_create_trace_buffer(TRACE_SZ, verify_trace_buffer);
+    async_trace   = drx_buf_create_trace_buffer_async(TRACE_SZ, 2,
+                                                      verify_async_trace_buffer);
     CHECK(circular_fast != NULL, "circular fast failed");
     CHECK(circular_slow != NULL, "circular slow failed");
     CHECK(trace != NULL, "trace failed");
+    CHECK(async_trace != NULL, "async trace failed");
 
     CHECK(drmgr_register_thread_init_event(event_thread_init),
           "event thread init failed");
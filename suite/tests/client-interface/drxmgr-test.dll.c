@@ -47,10 +47,29 @@
 
 static uint counterA;
 static uint counterB;
+static drx_counters_t *counters;
+static uint64 fragment_total;
+
+static bool
+sum_fragment_counts(drx_fragment_count_t *info, void *user_data)
+{
+    *(uint64 *)user_data += info->count;
+    return true;
+}
 
 static void
 event_exit(void)
 {
+#ifndef ARM
+    CHECK(drx_counters_get_total(counters, 0) == counterA,
+          "per-thread counter A messed up");
+    CHECK(drx_counters_get_total(counters, 1) == 3*(uint64)counterA,
+          "per-thread counter B messed up");
+    CHECK(drx_fragment_counts_iterate(NULL, sum_fragment_counts, &fragment_total),
+          "drx_fragment_counts_iterate failed");
+    CHECK(fragment_total == counterA, "fragment counts messed up");
+#endif
+    CHECK(drx_counters_free(counters), "drx_counters_free failed");
     drx_exit();
     drreg_exit();
     drmgr_exit();
@@ -69,6 +88,10 @@ event_app_instruction(void *drcontext, void *tag, instrlist_t *bb, instr_t *inst
                               IF_NOT_X86_(SPILL_SLOT_MAX+1) &counterA, 1, 0);
     drx_insert_counter_update(drcontext, bb, inst, SPILL_SLOT_MAX+1,
                               IF_NOT_X86_(SPILL_SLOT_MAX+1) &counterB, 3, 0);
+#ifndef ARM
+    drx_insert_counters_update(drcontext, counters, bb, inst, 0, 1);
+    drx_insert_counters_update(drcontext, counters, bb, inst, 1, 3);
+#endif
     return DR_EMIT_DEFAULT;
 }
 
@@ -83,6 +106,12 @@ dr_init(client_id_t id)
     CHECK(ok, "drx_init failed");
     res = drreg_init(&ops);
     CHECK(res == DRREG_SUCCESS, "drreg_init failed");
+    counters = drx_counters_create(2);
+    CHECK(counters != NULL, "drx_counters_create failed");
+#ifndef ARM
+    ok = drx_fragment_counts_enable(1 << 16, NULL);
+    CHECK(ok, "drx_fragment_counts_enable failed");
+#endif
     dr_register_exit_event(event_exit);
     if (!drmgr_register_bb_instrumentation_event(NULL, event_app_instruction, NULL))
         DR_ASSERT(false);
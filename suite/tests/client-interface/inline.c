@@ -49,6 +49,7 @@
          FUNCTION(callpic_mov) \
          FUNCTION(nonleaf) \
          FUNCTION(cond_br) \
+         FUNCTION(cond_br_fwd) \
          FUNCTION(tls_clobber) \
          FUNCTION(aflags_clobber) \
          FUNCTION(compiler_inscount) \
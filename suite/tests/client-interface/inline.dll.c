@@ -53,6 +53,7 @@
          FUNCTION(callpic_mov) \
          FUNCTION(nonleaf) \
          FUNCTION(cond_br) \
+         FUNCTION(cond_br_fwd) \
          FUNCTION(tls_clobber) \
          FUNCTION(aflags_clobber) \
          FUNCTION(compiler_inscount) \
@@ -490,6 +491,37 @@ codegen_cond_br(void *dc)
     return ilist;
 }
 
+/* Forward conditional branches can be inlined.  The branch targets the
+ * epilogue, which the inliner removes.
+cond_br_fwd:
+    push REG_XBP
+    mov REG_XBP, REG_XSP
+    mov REG_XCX, global_count
+    cmp [REG_XCX], 0
+    jnz Lnonzero
+        mov [REG_XCX], HEX(DEADBEEF)
+    Lnonzero:
+    leave
+    ret
+*/
+static instrlist_t *
+codegen_cond_br_fwd(void *dc)
+{
+    instrlist_t *ilist = instrlist_create(dc);
+    instr_t *nonzero = INSTR_CREATE_label(dc);
+    opnd_t xcx = opnd_create_reg(DR_REG_XCX);
+    codegen_prologue(dc, ilist);
+    APP(ilist, INSTR_CREATE_mov_imm(dc, xcx, OPND_CREATE_INTPTR(&global_count)));
+    APP(ilist, INSTR_CREATE_cmp(dc, OPND_CREATE_MEM32(DR_REG_XCX, 0),
+                                OPND_CREATE_INT8(0)));
+    APP(ilist, INSTR_CREATE_jcc(dc, OP_jnz, opnd_create_instr(nonzero)));
+    APP(ilist, INSTR_CREATE_mov_st(dc, OPND_CREATE_MEM32(DR_REG_XCX, 0),
+                                   OPND_CREATE_INT32((int)0xDEADBEEF)));
+    APP(ilist, nonzero);
+    codegen_epilogue(dc, ilist);
+    return ilist;
+}
+
 /* A function that uses 2 registers and 1 local variable, which should fill all
  * of the scratch slots that the inliner uses.  This used to clobber the scratch
  * slots exposed to the client.
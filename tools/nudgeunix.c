@@ -51,6 +51,8 @@
 extern bool
 create_nudge_signal_payload(siginfo_t *info OUT, uint action_mask,
                             client_id_t client_id, uint64 client_arg);
+extern process_id_t
+get_nudge_signal_target(process_id_t pid);
 
 static const char *usage_str =
     "usage: nudgeunix [-help] [-v] [-pid <pid>] [-type <type>] [-client <ID> <arg>]\n"
@@ -145,7 +147,8 @@ main(int argc, const char *argv[])
     assert(success); /* failure means kernel's sigqueueinfo has changed */
 
     /* send the nudge */
-    i = syscall(SYS_rt_sigqueueinfo, target_pid, NUDGESIG_SIGNUM, &info);
+    i = syscall(SYS_rt_sigqueueinfo, get_nudge_signal_target(target_pid),
+                NUDGESIG_SIGNUM, &info);
     if (i < 0)
         fprintf(stderr, "nudge FAILED with error %d\n", i);
     return i;
@@ -88,6 +88,7 @@ struct timeval start, end;
 static int silent; /* whether to print anything */
 static int kill_group; /* use killpg instead of kill */
 static FILE *FP;
+static const char *results_file; /* machine-readable results, for benchmarks */
 
 static void
 info(const char *fmt, ...)
@@ -308,10 +309,32 @@ print_stats(struct timeval *start, struct timeval *end,
     }
 }
 
+/* Writes one "name value" pair per line, independently of -silent */
+static void
+write_results(struct timeval *start, struct timeval *end,
+              struct rusage *ru, int status)
+{
+    long ms = (end->tv_sec - start->tv_sec) * 1000 +
+        (end->tv_usec - start->tv_usec) / 1000;
+    FILE *f = fopen(results_file, "w");
+    if (f == NULL) {
+        fprintf(FP, "ERROR: cannot write %s\n", results_file);
+        return;
+    }
+    fprintf(f, "elapsed_ms %ld\n", ms);
+    fprintf(f, "maxrss_kb %ld\n", ru->ru_maxrss);
+    if (WIFSIGNALED(status))
+        fprintf(f, "signal %d\n", WTERMSIG(status));
+    else
+        fprintf(f, "exit %d\n", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    fclose(f);
+}
+
 int usage(char *us)
 {
     fprintf(FP, "Usage: %s [-s limit_sec | -m limit_min | -h limit_hr]\n"
-                "  [-killpg] [-f] [-silent] [-env var value] <program> <args...>\n", us);
+                "  [-killpg] [-f] [-silent] [-results file] [-env var value]\n"
+                "  <program> <args...>\n", us);
     return 1;
 }
 
@@ -362,6 +385,11 @@ int main(int argc, char *argv[])
                 return 1;
             FP = fopen(fname, "w");
             arg_offs += 1;
+        } else if (strcmp(argv[arg_offs], "-results") == 0) {
+            if (argc <= arg_offs+1)
+                return usage(argv[0]);
+            results_file = argv[arg_offs+1];
+            arg_offs += 2;
         } else if (strcmp(argv[arg_offs], "-env") == 0) {
             if (argc <= arg_offs+2)
                 return usage(argv[0]);
@@ -425,6 +453,8 @@ int main(int argc, char *argv[])
         rc = setitimer(ITIMER_REAL, &t, NULL);
         assert(rc == 0);
 
+        if (results_file != NULL)
+            write_results(&start, &end, &ru, status);
         if (!silent)
             print_stats(&start, &end, &ru, status);
         return (status == 0 ? 0 : 1);